@@ -43,7 +43,7 @@ oversub=(50)
 cd ${pwd0}
 echo ""
 
-cp penguin-sc.h penguin.h
+# SC baseline: same runtime, run_sc.sh builds with -penguin-policy=static
 
 for ((idx=0; idx<${#benchmarks[@]}; ++idx)); do
     benchmark=${benchmarks[idx]}
@@ -0,0 +1,110 @@
+/* 3x3 convolution of PolyBench/GPU's 2DConvolution over an NI x NJ float
+ * image, one thread per output element.
+ *
+ *   2dconv.out [-n rows and columns] [-b band rows]
+ *
+ * By default the whole image is one launch, whose A and B are each half the
+ * footprint (PENGUIN_FOOTPRINT_MB, the environment variable, else the
+ * build's). With -b the image is convolved as bands of that many rows, one
+ * launch per band: a band of B reads its rows of A and the halo row above and
+ * below, so each launch touches a contiguous slice of both arrays and the
+ * slices of successive launches follow each other through memory, the
+ * boundaries SUV's iteration migration streams by. It is what splitting the
+ * single launch's grid along y (-penguin-grid-split) is meant to get to. */
+
+#include <unistd.h> // getopt
+#include <chrono> // high_resolution_clock
+#include <iostream> // cout
+#include <cstdio> // printf
+#include <cstdlib>
+#include <ratio>  // milli
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include "penguin.h"
+
+#define DIM_THREAD_BLOCK_X 32
+#define DIM_THREAD_BLOCK_Y 8
+
+__global__ void convolution2D_kernel(const float* A, float* B,
+                                     unsigned long long ni,
+                                     unsigned long long nj,
+                                     unsigned long long row_begin,
+                                     unsigned long long row_end) {
+  const float c11 = +0.2f, c21 = +0.5f, c31 = -0.8f;
+  const float c12 = -0.3f, c22 = +0.6f, c32 = -0.9f;
+  const float c13 = +0.4f, c23 = +0.7f, c33 = +0.10f;
+  unsigned long long j = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  unsigned long long i = row_begin + (unsigned long long) blockIdx.y * blockDim.y + threadIdx.y;
+  if(i < row_end && i > 0 && i < ni - 1 && j > 0 && j < nj - 1) {
+    B[i * nj + j] =
+        c11 * A[(i - 1) * nj + (j - 1)] + c12 * A[i * nj + (j - 1)] + c13 * A[(i + 1) * nj + (j - 1)] +
+        c21 * A[(i - 1) * nj + j] + c22 * A[i * nj + j] + c23 * A[(i + 1) * nj + j] +
+        c31 * A[(i - 1) * nj + (j + 1)] + c32 * A[i * nj + (j + 1)] + c33 * A[(i + 1) * nj + (j + 1)];
+  }
+}
+
+static void usage(const char* binary) {
+  std::cerr << "usage: " << binary << " [-n rows and columns] [-b band rows]\n";
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  unsigned long long footprint_mb = PENGUIN_FOOTPRINT_MB;
+  if(getenv("PENGUIN_FOOTPRINT_MB") != NULL)
+    footprint_mb = strtoull(getenv("PENGUIN_FOOTPRINT_MB"), NULL, 10);
+  // A and B of the footprint, square
+  unsigned long long n = 1;
+  while((n * 2) * (n * 2) * 2 * sizeof(float) <= footprint_mb * 1024ULL * 1024ULL)
+    n *= 2;
+  unsigned long long band = 0;
+  int opt;
+  while((opt = getopt(argc, argv, "n:b:")) != -1) {
+    switch(opt) {
+      case 'n': n = strtoull(optarg, NULL, 10); break;
+      case 'b': band = strtoull(optarg, NULL, 10); break;
+      default: usage(argv[0]);
+    }
+  }
+  if(n < 3)
+    usage(argv[0]);
+  if(band == 0 || band > n)
+    band = n;
+
+  // 2x oversubscribed unless PENGUIN_OVERSUB says otherwise
+  unsigned long long reserve_mb = footprint_mb / 2 < PENGUIN_GPU_SIZE_MB ?
+      PENGUIN_GPU_SIZE_MB - footprint_mb / 2 : 0;
+  int* reservation;
+  cudaMalloc((void**) &reservation, penguin_reservation_bytes(reserve_mb));
+
+  float* A;
+  float* B;
+  cudaMallocManaged(&A, n * n * sizeof(float));
+  cudaMallocManaged(&B, n * n * sizeof(float));
+  for(unsigned long long i = 0; i < n; i++)
+    for(unsigned long long j = 0; j < n; j++)
+      A[i * n + j] = (float) rand() / RAND_MAX;
+
+  nvml_start();
+  penguinStartStatCollection();
+  std::cout << "2D convolution of " << n << "x" << n << " in bands of " << band
+    << " rows\n";
+  auto start = std::chrono::high_resolution_clock::now();
+  dim3 block(DIM_THREAD_BLOCK_X, DIM_THREAD_BLOCK_Y);
+  for(unsigned long long row = 0; row < n; row += band) {
+    unsigned long long rows = row + band < n ? band : n - row;
+    dim3 grid((n + block.x - 1) / block.x, (rows + block.y - 1) / block.y);
+    convolution2D_kernel<<<grid, block>>>(A, B, n, n, row, row + rows);
+  }
+  cudaDeviceSynchronize();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> start_to_end = end - start;
+  std::cout << "GPU.Parser.Time: " << start_to_end.count() << "\n\n";
+  nvml_stop();
+  penguinStopStatCollection();
+
+  cudaFree(A);
+  cudaFree(B);
+  cudaFree(reservation);
+}
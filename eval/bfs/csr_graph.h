@@ -0,0 +1,147 @@
+/* Loads the binary CSR graphs of inputGen/graphgen (see csr_format.h).
+ *
+ *   csr_graph graph;
+ *   if(csr_graph_load("graph.csr", csr_graph_mode(), &graph) != 0) ...
+ *   kernel<<<...>>>(graph.offsets, graph.edges, ...);
+ *   csr_graph_free(&graph);
+ *
+ * CSR_LOAD_MANAGED reads the arrays straight into cudaMallocManaged memory,
+ * CSR_LOAD_THREADS (8) parallel reads of large chunks, so SUV plans them
+ * like any managed allocation. CSR_LOAD_REGISTERED maps the file and
+ * registers the mapping with cudaHostRegister, the GPU reading it over PCIe
+ * as a host-pinned allocation would be, without a copy. Either way the load
+ * is done, and its page faults are taken, before the measured run starts.
+ * CSR_LOAD=managed|registered in the environment picks the mode of
+ * csr_graph_mode(). */
+
+#ifndef CSR_GRAPH_H
+#define CSR_GRAPH_H
+
+#include <cuda_runtime.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+#include "inputGen/csr_format.h"
+
+#define CSR_LOAD_MANAGED 0
+#define CSR_LOAD_REGISTERED 1
+
+#ifndef CSR_LOAD_THREADS
+#define CSR_LOAD_THREADS 8
+#endif
+
+#define CSR_LOAD_CHUNK (64ULL * 1024ULL * 1024ULL)
+
+typedef struct {
+    csr_header header;
+    unsigned long long* offsets; // device accessible
+    unsigned int* edges;
+    int mode;
+    char* mapping; // the file, CSR_LOAD_REGISTERED
+} csr_graph;
+
+static inline int csr_graph_mode() {
+    const char* mode = getenv("CSR_LOAD");
+    return mode != NULL && strcmp(mode, "registered") == 0 ? CSR_LOAD_REGISTERED : CSR_LOAD_MANAGED;
+}
+
+// Reads bytes at offset of fd into buffer, chunks spread over the threads
+static inline bool csr_parallel_read(int fd, char* buffer, unsigned long long bytes,
+                                     unsigned long long offset) {
+    unsigned long long chunks = (bytes + CSR_LOAD_CHUNK - 1) / CSR_LOAD_CHUNK;
+    std::vector<std::thread> threads;
+    std::vector<char> failed(CSR_LOAD_THREADS, 0);
+    for(int t = 0; t < CSR_LOAD_THREADS; t++) {
+        threads.emplace_back([=, &failed]() {
+            for(unsigned long long c = t; c < chunks; c += CSR_LOAD_THREADS) {
+                unsigned long long begin = c * CSR_LOAD_CHUNK;
+                unsigned long long end = begin + CSR_LOAD_CHUNK < bytes ? begin + CSR_LOAD_CHUNK : bytes;
+                while(begin < end) {
+                    ssize_t n = pread(fd, buffer + begin, end - begin, offset + begin);
+                    if(n <= 0) {
+                        failed[t] = 1;
+                        return;
+                    }
+                    begin += n;
+                }
+            }
+        });
+    }
+    bool ok = true;
+    for(int t = 0; t < CSR_LOAD_THREADS; t++) {
+        threads[t].join();
+        ok = ok && !failed[t];
+    }
+    return ok;
+}
+
+// 0 on success; prints why and returns -1 otherwise
+static inline int csr_graph_load(const char* path, int mode, csr_graph* graph) {
+    memset(graph, 0, sizeof(*graph));
+    graph->mode = mode;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        perror(path);
+        return -1;
+    }
+    csr_header* header = &graph->header;
+    if(pread(fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header) ||
+       header->magic != CSR_MAGIC || header->version != CSR_VERSION) {
+        fprintf(stderr, "%s is not a CSR graph of version %d\n", path, CSR_VERSION);
+        close(fd);
+        return -1;
+    }
+    unsigned long long offsets_bytes = (header->num_nodes + 1) * sizeof(unsigned long long);
+    unsigned long long edges_bytes = header->num_edges * sizeof(unsigned int);
+    bool ok = true;
+    if(mode == CSR_LOAD_REGISTERED) {
+        graph->mapping = (char*) mmap(NULL, header->file_size, PROT_READ,
+                                      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if(graph->mapping == MAP_FAILED) {
+            graph->mapping = NULL;
+            ok = false;
+        } else if(cudaHostRegister(graph->mapping, header->file_size,
+                                   cudaHostRegisterMapped | cudaHostRegisterReadOnly) != cudaSuccess) {
+            munmap(graph->mapping, header->file_size);
+            graph->mapping = NULL;
+            ok = false;
+        } else {
+            char* device = NULL;
+            ok = cudaHostGetDevicePointer((void**) &device, graph->mapping, 0) == cudaSuccess;
+            graph->offsets = (unsigned long long*) (device + header->offsets_offset);
+            graph->edges = (unsigned int*) (device + header->edges_offset);
+        }
+    } else {
+        ok = cudaMallocManaged((void**) &graph->offsets, offsets_bytes) == cudaSuccess &&
+             cudaMallocManaged((void**) &graph->edges, edges_bytes) == cudaSuccess &&
+             csr_parallel_read(fd, (char*) graph->offsets, offsets_bytes, header->offsets_offset) &&
+             csr_parallel_read(fd, (char*) graph->edges, edges_bytes, header->edges_offset);
+    }
+    close(fd);
+    if(!ok) {
+        fprintf(stderr, "loading %s failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void csr_graph_free(csr_graph* graph) {
+    if(graph->mode == CSR_LOAD_REGISTERED) {
+        if(graph->mapping != NULL) {
+            cudaHostUnregister(graph->mapping);
+            munmap(graph->mapping, graph->header.file_size);
+        }
+    } else {
+        cudaFree(graph->offsets);
+        cudaFree(graph->edges);
+    }
+    memset(graph, 0, sizeof(*graph));
+}
+
+#endif
@@ -0,0 +1,46 @@
+/* Binary CSR graph file written by graphgen and read by csr_graph.h.
+ *
+ * The file is the header, padded to a page, then the arrays, each starting
+ * on a page boundary so it can be mapped or read in place:
+ *   offsets  unsigned long long[num_nodes + 1], edges of node i are
+ *            edges[offsets[i]] to edges[offsets[i + 1] - 1]
+ *   edges    unsigned int[num_edges], destination nodes
+ * Section offsets in the header are in bytes from the start of the file. */
+
+#ifndef CSR_FORMAT_H
+#define CSR_FORMAT_H
+
+#define CSR_MAGIC 0x47525343U // "CSRG"
+#define CSR_VERSION 1
+#define CSR_ALIGN 4096ULL
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long num_nodes;
+    unsigned long long num_edges;
+    unsigned long long source; // node the search starts from
+    unsigned long long offsets_offset;
+    unsigned long long edges_offset;
+    unsigned long long file_size;
+} csr_header;
+
+static inline unsigned long long csr_align(unsigned long long bytes) {
+    return (bytes + CSR_ALIGN - 1) / CSR_ALIGN * CSR_ALIGN;
+}
+
+// Fills in the layout of a graph of this size
+static inline void csr_layout(csr_header* header, unsigned long long num_nodes,
+                              unsigned long long num_edges) {
+    header->magic = CSR_MAGIC;
+    header->version = CSR_VERSION;
+    header->num_nodes = num_nodes;
+    header->num_edges = num_edges;
+    header->offsets_offset = csr_align(sizeof(csr_header));
+    header->edges_offset = header->offsets_offset +
+        csr_align((num_nodes + 1) * sizeof(unsigned long long));
+    header->file_size = header->edges_offset +
+        csr_align(num_edges * sizeof(unsigned int));
+}
+
+#endif
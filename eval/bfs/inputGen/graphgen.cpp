@@ -0,0 +1,154 @@
+// Generates a random graph for bfs:
+//
+//   graphgen <num nodes> [output]
+//
+// The output defaults to graph<num nodes>.csr, the binary CSR format of
+// csr_format.h, which the threads fill in parallel through a shared mapping
+// of the file. An output ending in .txt gets the Rodinia text format instead.
+// Every node has MIN_EDGES to MAX_EDGES edges to random nodes; node i's edges
+// only depend on i, so the graph is the same for any number of threads.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "csr_format.h"
+
+#define MIN_EDGES 2
+#define MAX_EDGES 8
+
+static inline unsigned long long mix(unsigned long long x) {
+    // splitmix64 finalizer
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline unsigned degree(unsigned long long node) {
+    return MIN_EDGES + mix(node) % (MAX_EDGES - MIN_EDGES + 1);
+}
+
+static inline unsigned destination(unsigned long long node, unsigned edge,
+                                   unsigned long long num_nodes) {
+    return mix(node * MAX_EDGES + edge + 0x5bd1e995ULL) % num_nodes;
+}
+
+// offsets[i] = edges of the nodes before i; a blocked scan, one block per
+// thread
+static unsigned long long fill_offsets(unsigned long long* offsets,
+                                       unsigned long long num_nodes) {
+    int threads = omp_get_max_threads();
+    std::vector<unsigned long long> block_sums(threads + 1, 0);
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        unsigned long long begin = num_nodes * t / threads;
+        unsigned long long end = num_nodes * (t + 1) / threads;
+        unsigned long long sum = 0;
+        for(unsigned long long i = begin; i < end; i++) {
+            sum += degree(i);
+        }
+        block_sums[t + 1] = sum;
+        #pragma omp barrier
+        #pragma omp single
+        for(int b = 0; b < threads; b++) {
+            block_sums[b + 1] += block_sums[b];
+        }
+        sum = block_sums[t];
+        for(unsigned long long i = begin; i < end; i++) {
+            offsets[i] = sum;
+            sum += degree(i);
+        }
+    }
+    offsets[num_nodes] = block_sums[threads];
+    return block_sums[threads];
+}
+
+static int write_csr(const char* path, unsigned long long num_nodes) {
+    std::vector<unsigned long long> offsets(num_nodes + 1);
+    unsigned long long num_edges = fill_offsets(offsets.data(), num_nodes);
+    csr_header header;
+    csr_layout(&header, num_nodes, num_edges);
+    header.source = 0;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, header.file_size) != 0) {
+        perror(path);
+        return 1;
+    }
+    char* file = (char*) mmap(NULL, header.file_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+    if(file == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    memcpy(file, &header, sizeof(header));
+    unsigned long long* file_offsets = (unsigned long long*) (file + header.offsets_offset);
+    unsigned int* edges = (unsigned int*) (file + header.edges_offset);
+    #pragma omp parallel for schedule(static)
+    for(unsigned long long i = 0; i <= num_nodes; i++) {
+        file_offsets[i] = offsets[i];
+    }
+    #pragma omp parallel for schedule(static)
+    for(unsigned long long i = 0; i < num_nodes; i++) {
+        unsigned d = degree(i);
+        for(unsigned e = 0; e < d; e++) {
+            edges[offsets[i] + e] = destination(i, e, num_nodes);
+        }
+    }
+    if(munmap(file, header.file_size) != 0 || close(fd) != 0) {
+        perror(path);
+        return 1;
+    }
+    printf("%s: %llu nodes, %llu edges, %llu MiB\n", path, num_nodes, num_edges,
+           header.file_size >> 20);
+    return 0;
+}
+
+static int write_text(const char* path, unsigned long long num_nodes) {
+    FILE* f = fopen(path, "w");
+    if(f == NULL) {
+        perror(path);
+        return 1;
+    }
+    unsigned long long start = 0;
+    fprintf(f, "%llu\n", num_nodes);
+    for(unsigned long long i = 0; i < num_nodes; i++) {
+        fprintf(f, "%llu %u\n", start, degree(i));
+        start += degree(i);
+    }
+    fprintf(f, "\n0\n\n%llu\n", start);
+    for(unsigned long long i = 0; i < num_nodes; i++) {
+        unsigned d = degree(i);
+        for(unsigned e = 0; e < d; e++) {
+            fprintf(f, "%u %u\n", destination(i, e, num_nodes), 1 + (unsigned) (mix(start++) % 10));
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <num nodes> [output]\n", argv[0]);
+        return 1;
+    }
+    unsigned long long num_nodes = strtoull(argv[1], NULL, 10);
+    if(num_nodes == 0 || num_nodes > 0xffffffffULL) {
+        fprintf(stderr, "num nodes must be between 1 and 2^32 - 1\n");
+        return 1;
+    }
+    std::string path = argc > 2 ? argv[2] : "graph" + std::string(argv[1]) + ".csr";
+    if(path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0) {
+        return write_text(path.c_str(), num_nodes);
+    }
+    return write_csr(path.c_str(), num_nodes);
+}
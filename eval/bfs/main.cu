@@ -0,0 +1,189 @@
+/* Level-synchronous BFS over a binary CSR graph of inputGen/graphgen.
+ *
+ *   bfs.out [-b] [graph.csr]
+ *
+ * Every level launches one thread per frontier node, which walks the node's
+ * adjacency list and appends the nodes it reaches first to the next
+ * frontier. The frontier is in the order its nodes were reached, so the
+ * adjacency lists of a level are read in a random order across the edges
+ * array.
+ *
+ * With -b each level's frontier is first binned by the 2MB block of the edges
+ * array its adjacency list starts in, a counting sort: the lists of a level
+ * are then read block after block, in the order of the array. The offsets
+ * grow with the node, so the offsets read follow the same order. The graph is
+ * loaded as csr_graph.h's CSR_LOAD says, before the measured run; it is
+ * graph.csr of the working directory unless given, as run.sh runs it. */
+
+#include <chrono> // high_resolution_clock
+#include <iostream> // cout
+#include <cstdio> // printf
+#include <cstdlib>
+#include <cstring>
+#include <ratio>  // milli
+#include <utility> // swap
+#include <unistd.h> // getopt
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include "csr_graph.h"
+#include "penguin.h"
+
+#define THREADS_PER_BLOCK 256
+
+#define MiB 22120
+#define RESERVATION (penguin_reservation_bytes(MiB)) // MiB unless PENGUIN_OVERSUB is set
+
+// The granularity the frontier is binned at, a 2MB block of the driver
+#define BFS_BIN_BYTES (2ULL * 1024ULL * 1024ULL)
+
+__device__ __forceinline__
+unsigned bfs_bin(const unsigned long long* offsets, unsigned v) {
+  return offsets[v] * sizeof(unsigned int) / BFS_BIN_BYTES;
+}
+
+__global__ void expand_kernel(const unsigned long long* offsets,
+                              const unsigned int* edges, int* levels,
+                              const unsigned int* frontier, unsigned count,
+                              int level, unsigned int* next,
+                              unsigned int* next_count) {
+  unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+  if(i >= count)
+    return;
+  unsigned v = frontier[i];
+  unsigned long long end = offsets[v + 1];
+  for(unsigned long long e = offsets[v]; e < end; e++) {
+    unsigned w = edges[e];
+    if(levels[w] == -1 && atomicCAS(&levels[w], -1, level + 1) == -1)
+      next[atomicAdd(next_count, 1)] = w;
+  }
+}
+
+__global__ void bin_count_kernel(const unsigned long long* offsets,
+                                 const unsigned int* frontier, unsigned count,
+                                 unsigned int* bin_counts) {
+  unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+  if(i < count)
+    atomicAdd(&bin_counts[bfs_bin(offsets, frontier[i])], 1);
+}
+
+// bin_cursors[b] starts at the first slot of bin b in binned
+__global__ void bin_scatter_kernel(const unsigned long long* offsets,
+                                   const unsigned int* frontier, unsigned count,
+                                   unsigned int* bin_cursors,
+                                   unsigned int* binned) {
+  unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+  if(i < count) {
+    unsigned v = frontier[i];
+    binned[atomicAdd(&bin_cursors[bfs_bin(offsets, v)], 1)] = v;
+  }
+}
+
+static unsigned blocks_for(unsigned long long threads) {
+  return (threads + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+}
+
+static void usage(const char* binary) {
+  std::cerr << "usage: " << binary << " [-b] [graph.csr]\n";
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  bool bin = false;
+  int opt;
+  while((opt = getopt(argc, argv, "b")) != -1) {
+    switch(opt) {
+      case 'b': bin = true; break;
+      default: usage(argv[0]);
+    }
+  }
+  if(optind < argc - 1)
+    usage(argv[0]);
+  const char* path = optind < argc ? argv[optind] : "graph.csr";
+
+  int* reservation;
+  cudaMalloc((void**) &reservation, RESERVATION);
+
+  csr_graph graph;
+  if(csr_graph_load(path, csr_graph_mode(), &graph) != 0)
+    return 1;
+  unsigned long long n = graph.header.num_nodes;
+  unsigned long long* offsets = graph.offsets;
+  unsigned int* edges = graph.edges;
+
+  int* levels;
+  unsigned int* frontier;
+  unsigned int* next;
+  unsigned int* next_count;
+  cudaMallocManaged(&levels, n * sizeof(int));
+  cudaMallocManaged(&frontier, n * sizeof(unsigned int));
+  cudaMallocManaged(&next, n * sizeof(unsigned int));
+  cudaMallocManaged(&next_count, sizeof(unsigned int));
+  // the bins, one past the last block the edges reach
+  unsigned bins = graph.header.num_edges * sizeof(unsigned int) / BFS_BIN_BYTES + 1;
+  unsigned int* binned = nullptr;
+  unsigned int* bin_counts = nullptr;
+  unsigned int* bin_cursors = nullptr;
+  if(bin) {
+    cudaMallocManaged(&binned, n * sizeof(unsigned int));
+    cudaMallocManaged(&bin_counts, bins * sizeof(unsigned int));
+    cudaMallocManaged(&bin_cursors, bins * sizeof(unsigned int));
+  }
+  memset(levels, 0xff, n * sizeof(int));
+  unsigned source = graph.header.source;
+  levels[source] = 0;
+  frontier[0] = source;
+
+  nvml_start();
+  penguinStartStatCollection();
+  std::cout << "BFS of " << n << " nodes and " << graph.header.num_edges
+    << " edges from node " << source << (bin ? ", frontier binned by 2MB block" : "")
+    << "\n";
+  auto start = std::chrono::high_resolution_clock::now();
+  unsigned count = 1;
+  int level = 0;
+  while(count > 0) {
+    const unsigned int* expanded = frontier;
+    if(bin) {
+      cudaMemset(bin_counts, 0, bins * sizeof(unsigned int));
+      bin_count_kernel<<<blocks_for(count), THREADS_PER_BLOCK>>>(offsets, frontier, count, bin_counts);
+      cudaDeviceSynchronize();
+      unsigned start_slot = 0;
+      for(unsigned b = 0; b < bins; b++) {
+        bin_cursors[b] = start_slot;
+        start_slot += bin_counts[b];
+      }
+      bin_scatter_kernel<<<blocks_for(count), THREADS_PER_BLOCK>>>(offsets, frontier, count, bin_cursors, binned);
+      expanded = binned;
+    }
+    *next_count = 0;
+    expand_kernel<<<blocks_for(count), THREADS_PER_BLOCK>>>(offsets, edges, levels, expanded, count, level, next, next_count);
+    cudaDeviceSynchronize();
+    count = *next_count;
+    std::swap(frontier, next);
+    level++;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> start_to_end = end - start;
+  std::cout << "GPU.Parser.Time: " << start_to_end.count() << "\n\n";
+  nvml_stop();
+  penguinStopStatCollection();
+
+  unsigned long long visited = 0;
+  for(unsigned long long v = 0; v < n; v++)
+    visited += levels[v] != -1;
+  std::cout << "Visited " << visited << " nodes in " << level << " levels\n";
+
+  cudaFree(levels);
+  cudaFree(frontier);
+  cudaFree(next);
+  cudaFree(next_count);
+  if(bin) {
+    cudaFree(binned);
+    cudaFree(bin_counts);
+    cudaFree(bin_cursors);
+  }
+  csr_graph_free(&graph);
+  cudaFree(reservation);
+}
@@ -0,0 +1,120 @@
+#!/bin/bash
+
+# Runs two to four workloads at once on one GPU, from the root folder of the
+# artifact:
+#
+#   bash eval/colocate/colocate.sh <benchmark>[:<delay s>] ...
+#
+# Job i starts COLOCATE_STAGGER (10) seconds after job i-1 unless its delay
+# is given. Every job is eval/build/<benchmark>/suv.out run in eval/<benchmark>,
+# first alone through eval/trials.sh and then COLOCATE_TRIALS (3) times with
+# the others. The co-located jobs split the GPU through the arbiter of
+# penguin.h, so PENGUIN_OVERSUB is unset for them and for the solo runs. Every run
+# is under eval/build/sweep/reserve.out holding COLOCATE_RESERVE_MB (0) of the
+# GPU, which keeps the workloads from making their own reservations. The
+# policy comes from PENGUIN_POLICY as for trials.sh.
+#
+# eval/colocate/colocate.csv gets job,benchmark,delay,alone,together,slowdown
+# per job, the medians of GPU.Parser.Time in ms and their ratio, and the
+# summary of the group is printed:
+#   fairness    Jain's index of the jobs' progress (alone / together), 1 when
+#               all slow down alike
+#   throughput  the sum of their progress, the jobs' worth of work done per
+#               job time alone; above 1 sharing beats running them in turn
+#   makespan    the median wall time from the first start to the last exit
+
+pwd0=$(pwd) # the root folder of the artifact
+if [ $# -lt 2 ] || [ $# -gt 4 ]; then
+    echo "usage: bash eval/colocate/colocate.sh <benchmark>[:<delay s>] ... (2 to 4)"
+    exit 1
+fi
+stagger=${COLOCATE_STAGGER:-10}
+trials=${COLOCATE_TRIALS:-3}
+reserve=${pwd0}/eval/build/sweep/reserve.out
+reservation=${COLOCATE_RESERVE_MB:-0}
+out=${pwd0}/eval/colocate
+unset PENGUIN_OVERSUB
+
+benchmarks=()
+delays=()
+for ((j=0; j<$#; ++j)); do
+    job=${@:j+1:1}
+    benchmarks+=(${job%%:*})
+    if [[ ${job} == *:* ]]; then
+        delays+=(${job#*:})
+    else
+        delays+=($((j*stagger)))
+    fi
+    if [ ! -x ${pwd0}/eval/build/${benchmarks[j]}/suv.out ]; then
+        echo "no eval/build/${benchmarks[j]}/suv.out, see compile.sh"
+        exit 1
+    fi
+done
+
+median() {
+    printf "%s\n" "$@" | sort -g | awk '
+        { t[NR] = $1 }
+        END { print NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2 }'
+}
+
+# alone
+alone=()
+for ((j=0; j<${#benchmarks[@]}; ++j)); do
+    b=${benchmarks[j]}
+    cd ${pwd0}/eval/${b}
+    bash ${pwd0}/eval/trials.sh colocate.alone ${reserve} ${reservation} \
+        ${pwd0}/eval/build/${b}/suv.out
+    alone+=($(grep -m1 "GPU.Parser.Time" colocate.alone.txt | awk '{print $2}'))
+    cd ${pwd0}
+done
+
+# together: one reservation for the group, each job after its delay
+together=() # together[t * jobs + j]
+makespans=()
+for ((t=0; t<trials; ++t)); do
+    start=$(date +%s%N)
+    ${reserve} ${reservation} bash -c '
+        pwd0=$1
+        shift
+        while [ $# -ge 3 ]; do
+            (sleep $2 && cd ${pwd0}/eval/$1 &&
+             ${pwd0}/eval/build/$1/suv.out &> colocate.job$3.txt) &
+            shift 3
+        done
+        wait' colocate ${pwd0} $(for ((j=0; j<${#benchmarks[@]}; ++j)); do
+            echo "${benchmarks[j]} ${delays[j]} ${j}.${t}"; done)
+    end=$(date +%s%N)
+    makespans+=($(((end-start)/1000000)))
+    for ((j=0; j<${#benchmarks[@]}; ++j)); do
+        together[t*${#benchmarks[@]}+j]=$(grep -m1 "GPU.Parser.Time" \
+            ${pwd0}/eval/${benchmarks[j]}/colocate.job${j}.${t}.txt | awk '{print $2}')
+    done
+done
+
+echo "job,benchmark,delay,alone,together,slowdown" > ${out}/colocate.csv
+progress=()
+for ((j=0; j<${#benchmarks[@]}; ++j)); do
+    times=()
+    for ((t=0; t<trials; ++t)); do
+        time=${together[t*${#benchmarks[@]}+j]}
+        if [ -n "${time}" ]; then
+            times+=(${time})
+        fi
+    done
+    if [ ${#times[@]} -eq 0 ] || [ -z "${alone[j]}" ]; then
+        echo "job ${j} (${benchmarks[j]}) didn't finish, see eval/${benchmarks[j]}/colocate.*.txt"
+        exit 1
+    fi
+    co=$(median ${times[@]})
+    slowdown=$(awk -v a=${alone[j]} -v c=${co} 'BEGIN { printf "%.3f", c / a }')
+    progress+=($(awk -v a=${alone[j]} -v c=${co} 'BEGIN { print a / c }'))
+    echo "${j},${benchmarks[j]},${delays[j]},${alone[j]},${co},${slowdown}" >> ${out}/colocate.csv
+done
+cat ${out}/colocate.csv
+printf "%s\n" "${progress[@]}" | awk -v makespan=$(median ${makespans[@]}) '
+    { sum += $1; squares += $1 * $1; n++ }
+    END {
+        printf "fairness %.3f\n", sum * sum / (n * squares)
+        printf "throughput %.3f\n", sum
+        printf "makespan %d ms\n", makespan
+    }'
@@ -0,0 +1,56 @@
+// Host baseline of main.cu: the same graph, Floyd-Warshall blocked by
+// FW_CPU_TILE (64) x FW_CPU_TILE tiles, the tiles of each phase spread over
+// every core by floyd_warshall_blocked_tasks (floyd_warshall.ispc), each
+// vectorized by floyd_warshall_in_place. Prints GPU.Parser.Time like the GPU
+// binaries, so eval/trials.sh and the parse scripts read it the same way.
+#include <algorithm>
+#include <chrono> // high_resolution_clock
+#include <cstdlib>
+#include <iostream> // cout
+#include <ratio>  // milli
+#include <thread>
+#include <vector>
+
+#include "floyd_warshall.hpp"
+
+int main(int argc, char* argv[]) {
+  unsigned long seed = 0;
+  unsigned n = 32 * 1024;
+  double p = 0.5;
+  int tile = 64;
+  if (getenv("FW_CPU_TILE") != nullptr) {
+    tile = atoi(getenv("FW_CPU_TILE"));
+  }
+  if (tile < 1 || n % tile != 0) {
+    std::cerr << "FW_CPU_TILE must divide " << n << "\n";
+    return 1;
+  }
+
+  int* graph = new int[(unsigned long long) n * n];
+  unsigned thread_count = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < thread_count; t++) {
+    threads.emplace_back([=]() {
+      for (unsigned i = (unsigned long long) n * t / thread_count;
+           i < (unsigned long long) n * (t + 1) / thread_count; i++) {
+        for (unsigned j = 0; j < n; j++) {
+          graph[(unsigned long long) i * n + j] = floyd_warshall_weight(seed, i, j, n, p);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::cout << "Using Floyd-Warshall's on " << n << "x" << n << " with p=" << p
+    << " and seed=" << seed << " on " << thread_count << " threads, tiles of "
+    << tile << "\n";
+  auto start = std::chrono::high_resolution_clock::now();
+  floyd_warshall_blocked_tasks(graph, n, tile);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> start_to_end = end - start;
+  std::cout << "GPU.Parser.Time: " << start_to_end.count() << "\n\n";
+
+  delete[] graph;
+}
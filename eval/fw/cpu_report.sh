@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Compares fw on the GPU with the host baseline (cpu.out, cpu.cpp), from the
+# root folder of the artifact after run.sh:
+#
+#   bash eval/fw/cpu_report.sh [oversub...]
+#
+# Prints, for every oversubscription (15 30 50 by default), the median
+# GPU.Parser.Time in ms of each policy run.sh measured, eval/fw/<policy>.<os>.txt,
+# the one of eval/fw/cpu.txt, which doesn't depend on it, and how many times
+# faster than the CPU each policy is; above 1 the GPU wins.
+
+pwd0=$(pwd) # the root folder of the artifact
+oversub=("$@")
+if [ ${#oversub[@]} -eq 0 ]; then
+    oversub=(15 30 50)
+fi
+policies=(uvm suv ac)
+
+median() {
+    grep -m1 "GPU.Parser.Time" $1 2> /dev/null | awk '{print $2}'
+}
+
+cpu=$(median ${pwd0}/eval/fw/cpu.txt)
+if [ -z "${cpu}" ]; then
+    echo "no eval/fw/cpu.txt, run.sh runs eval/build/fw/cpu.out when ispc built it"
+    exit 1
+fi
+
+header="oversub,cpu"
+for policy in ${policies[@]}; do
+    header="${header},${policy},${policy}_speedup"
+done
+echo ${header}
+for os in ${oversub[@]}; do
+    row="${os},${cpu}"
+    for policy in ${policies[@]}; do
+        time=$(median ${pwd0}/eval/fw/${policy}.${os}.txt)
+        if [ -z "${time}" ]; then
+            row="${row},,"
+        else
+            row="${row},${time},$(awk -v c=${cpu} -v t=${time} 'BEGIN { printf "%.2f", c / t }')"
+        fi
+    done
+    echo ${row}
+done
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <climits> // INT_MAX
+
+#ifdef __CUDACC__
+#define FW_HOST_DEVICE __host__ __device__
+#else
+#define FW_HOST_DEVICE
+#endif
+
 // we need this to initialized to 0 on the diagonal, infinity anywhere there is no edge
 int* floyd_warshall_init(const int n, const double p, const unsigned long seed);
 
@@ -29,6 +37,12 @@ inline void floyd_warshall_in_place(int* C, const int* A, const int* B, const in
 }
 #endif
 
+#ifdef ISPC
+// output, n x n, in place by blocks of b x b, the tiles of each phase in ISPC
+// tasks; b divides n
+extern "C" void floyd_warshall_blocked_tasks(int* output, const int n, const int b);
+#endif
+
 // expects len(input) == len(output) == n*n
 void floyd_warshall_blocked(const int* input, int* output, const int n, const int b);
 
@@ -37,3 +51,21 @@ void floyd_warshall_cuda(int* input, int* output, int n);
 void floyd_warshall_blocked_cuda(int* input, int* output, int n);
 #endif
 
+// Edge (i, j) of the graph, a function of the seed and the position alone so
+// the host and the device initialization, and cpu.cpp, fill the same matrix
+FW_HOST_DEVICE inline
+int floyd_warshall_weight(unsigned long long seed, unsigned i, unsigned j,
+                          unsigned n, double p) {
+  if (i == j) return 0;
+  // splitmix64 finalizer
+  unsigned long long x = seed * 0x9e3779b97f4a7c15ULL + ((unsigned long long) i << 32 | j);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  // TODO: create negative edges without negative cycles
+  if (i < n && j < n && (x >> 11) * (1.0 / 9007199254740992.0) < p) {
+    return 1 + (int) ((x & 0xffffffffULL) % 100);
+  }
+  // "infinity" - the highest value we can still safely add two infinities
+  return INT_MAX / 2;
+}
@@ -107,6 +107,94 @@ __host__ bool bellman_ford_cuda(graph_cuda_t* gr, int* dist, int s) {
   return no_neg_cycle;
 }
 
+// Relaxes the out-edges of the vertices on the worklist; a vertex whose
+// distance drops goes on the next worklist once, which in_next guards. A
+// vertex clears its flag before it reads its distance, so a drop after the
+// read puts it back on.
+__global__ void bellman_ford_worklist_kernel(int* dist, const int* worklist,
+                                             int count, int* next,
+                                             int* next_count, int* in_next) {
+  int i = threadIdx.x + blockDim.x * blockIdx.x;
+
+  if (i >= count) return;
+  int* starts = graph_const.starts;
+  int* weights = graph_const.weights;
+  edge_t* edges = graph_const.edge_array;
+  int u = worklist[i];
+  atomicExch(&in_next[u], 0);
+  int dist_u = atomicMin(&dist[u], INT_MAX); // the current distance
+  for (int e = starts[u]; e < starts[u+1]; e++) {
+    int v = edges[e].v;
+    int new_dist = dist_u + weights[e];
+    if (new_dist < atomicMin(&dist[v], new_dist) && atomicExch(&in_next[v], 1) == 0)
+      next[atomicAdd(next_count, 1)] = v;
+  }
+}
+
+// JOHNSON_BF=worklist runs bellman_ford_worklist_cuda, else the V-1 sweeps
+__host__ bool bellman_ford_worklist_enabled() {
+  const char* bf = getenv("JOHNSON_BF");
+  return bf != nullptr && strcmp(bf, "worklist") == 0;
+}
+
+// Bellman-Ford from the source johnson_cuda adds, over the graph in
+// graph_const. The source's edges of weight 0 leave every vertex at distance
+// 0 and on the first worklist; each round then only reads the edges of the
+// vertices whose distance dropped in the one before, and the rounds stop
+// when none did. Rounds past V mean a negative cycle.
+__host__ bool bellman_ford_worklist_cuda(int V, int* dist) {
+  for (int i = 0; i <= V; i++) {
+    dist[i] = 0;
+  }
+
+  int* device_dist;
+  int* worklist;
+  int* next;
+  int* next_count;
+  int* in_next;
+  cudaMalloc(&device_dist, sizeof(int) * V);
+  cudaMalloc(&worklist, sizeof(int) * V);
+  cudaMalloc(&next, sizeof(int) * V);
+  cudaMallocManaged(&next_count, sizeof(int));
+  cudaMalloc(&in_next, sizeof(int) * V);
+  cudaMemcpy(device_dist, dist, sizeof(int) * V, cudaMemcpyHostToDevice);
+  int* all = new int[V];
+  for (int i = 0; i < V; i++) {
+    all[i] = i;
+  }
+  cudaMemcpy(worklist, all, sizeof(int) * V, cudaMemcpyHostToDevice);
+  delete[] all;
+  // none is on the next worklist yet
+  cudaMemset(in_next, 0, sizeof(int) * V);
+
+  int count = V;
+  int rounds = 0;
+  long long relaxed = 0;
+  while (count > 0 && rounds <= V) {
+    *next_count = 0;
+    int blocks = (count + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+    bellman_ford_worklist_kernel<<<blocks, THREADS_PER_BLOCK>>>(
+        device_dist, worklist, count, next, next_count, in_next);
+    cudaDeviceSynchronize();
+    relaxed += count;
+    count = *next_count;
+    std::swap(worklist, next);
+    rounds++;
+  }
+  std::cout << "Bellman-Ford: " << rounds << " rounds over " << relaxed
+            << " vertices\n";
+
+  cudaMemcpy(dist, device_dist, sizeof(int) * V, cudaMemcpyDeviceToHost);
+
+  cudaFree(device_dist);
+  cudaFree(worklist);
+  cudaFree(next);
+  cudaFree(next_count);
+  cudaFree(in_next);
+
+  return count == 0;
+}
+
 /**************************************************************************
                         Johnson's Algorithm CUDA
 **************************************************************************/
@@ -171,7 +259,8 @@ __host__ void johnson_cuda(graph_cuda_t* gr, int* output) {
   std::memset(&bf_graph->weights[gr->E], 0, V * sizeof(int));
 
   int* h = new int[bf_graph->V];
-  bool r = bellman_ford_cuda(bf_graph, h, V);
+  bool r = bellman_ford_worklist_enabled() ? bellman_ford_worklist_cuda(V, h)
+                                           : bellman_ford_cuda(bf_graph, h, V);
   if (!r) {
     std::cerr << "\nNegative Cycles Detected! Terminating Early\n";
     exit(1);
@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <stdio.h>
 #include <random>
+#include <thread>
+#include <climits>
+#include <cstring>
 
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -23,7 +26,7 @@
 #define CUDA
 
 #define MiB 21130
-#define RESERVATION ((MiB*1024UL*1024))
+#define RESERVATION (penguin_reservation_bytes(MiB)) // MiB unless PENGUIN_OVERSUB is set
 
 int do_saby = 0;
 
@@ -243,13 +246,20 @@ __host__ void floyd_warshall_blocked_cuda(int* input, int* output, unsigned n, i
   cudaFree(device_graph);
 }
 
-int* floyd_warshall_blocked_init(const int n, const int block_size, const double p, const unsigned long seed) {
-  static std::uniform_real_distribution<double> flip(0, 1);
-  // TODO: create negative edges without negative cycles
-  static std::uniform_int_distribution<int> choose_weight(1, 100);
-
-  std::mt19937_64 rand_engine(seed);
+__global__ void floyd_warshall_init_kernel(int* graph, unsigned n_oversized, unsigned n,
+                                           double p, unsigned long long seed) {
+  const unsigned int i = blockIdx.y * blockDim.y + threadIdx.y;
+  const unsigned int j = blockIdx.x * blockDim.x + threadIdx.x;
+  if ((i >= n_oversized) || (j >= n_oversized)) return;
+  graph[(unsigned long long) i * n_oversized + j] = floyd_warshall_weight(seed, i, j, n, p);
+}
 
+// Fills out, n_oversized x n_oversized with n_oversized the multiple of
+// block_size above n, straight into the managed allocation the kernels use:
+// on the host, rows split over the hardware threads, or on the GPU with
+// on_gpu, so the matrix starts out resident there instead of on the host
+void floyd_warshall_blocked_init(int* out, const int n, const int block_size, const double p,
+                                 const unsigned long seed, bool on_gpu) {
   int n_oversized;
   int block_remainder = n % block_size;
   if (block_remainder == 0) {
@@ -258,21 +268,33 @@ int* floyd_warshall_blocked_init(const int n, const int block_size, const double
     n_oversized = n + block_size - block_remainder;
   }
 
-  int* out = new int[n_oversized * n_oversized];
-  for (int i = 0; i < n_oversized; i++) {
-    for (int j = 0; j < n_oversized; j++) {
-      if (i == j) {
-        out[i*n_oversized + j] = 0;
-      } else if (i < n && j < n && flip(rand_engine) < p) {
-        out[i*n_oversized + j] = choose_weight(rand_engine);
-      } else {
-        // "infinity" - the highest value we can still safely add two infinities
-        out[i*n_oversized + j] = std::numeric_limits<int>::max() / 2;
-      }
-    }
+  if (on_gpu) {
+    const int blocks = (n_oversized + BLOCK_DIM - 1) / BLOCK_DIM;
+    dim3 block_dim(BLOCK_DIM, BLOCK_DIM, 1);
+    dim3 grid(blocks, blocks, 1);
+    floyd_warshall_init_kernel<<<grid, block_dim>>>(out, n_oversized, n, p, seed);
+    cudaDeviceSynchronize();
+    check_cuda_error();
+    return;
   }
 
-  return out;
+  unsigned thread_count = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < thread_count; t++) {
+    threads.emplace_back([=]() {
+      unsigned begin = (unsigned long long) n_oversized * t / thread_count;
+      unsigned end = (unsigned long long) n_oversized * (t + 1) / thread_count;
+      for (unsigned i = begin; i < end; i++) {
+        int* row = out + (unsigned long long) i * n_oversized;
+        for (unsigned j = 0; j < (unsigned) n_oversized; j++) {
+          row[j] = floyd_warshall_weight(seed, i, j, n, p);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
 }
 
 int main(int argc, char* argv[]) {
@@ -283,9 +305,10 @@ int main(int argc, char* argv[]) {
   double p = 0.5;
   int block_size = 32;
   int thread_count = 1;
-  int* matrix = nullptr;
   int* output = nullptr;
-  matrix = floyd_warshall_blocked_init(n, block_size, p, seed);
+  // FW_INIT=gpu initializes the graph on the GPU, else on the host
+  const char* init = getenv("FW_INIT");
+  bool init_on_gpu = init != nullptr && strcmp(init, "gpu") == 0;
   /* unsigned long long n_blocked = n; */
   unsigned long n_blocked = n;
   int block_remainder = n % block_size;
@@ -293,6 +316,15 @@ int main(int argc, char* argv[]) {
     n_blocked = n + block_size - block_remainder;
   }
   output = new int[n_blocked * n_blocked];
+#ifdef CUDA
+  int* device_graph;
+  const size_t size = sizeof(int) * n_blocked * n_blocked;
+  cudaMallocManaged(&device_graph, size);
+  floyd_warshall_blocked_init(device_graph, n, block_size, p, seed, init_on_gpu);
+#else
+  int* matrix = new int[n_blocked * n_blocked];
+  floyd_warshall_blocked_init(matrix, n, block_size, p, seed, false);
+#endif
 
   nvml_start();
   penguinStartStatCollection();
@@ -300,11 +332,7 @@ int main(int argc, char* argv[]) {
     << " with p=" << p << " and seed=" << seed << "\n";
   auto start = std::chrono::high_resolution_clock::now();
 #ifdef CUDA
-  int* device_graph;
-  const size_t size = sizeof(int) * 1024 * 1024ULL * 1024ULL;
-  cudaMallocManaged(&device_graph, size);
-  memcpy(device_graph, matrix, size);
-  floyd_warshall_blocked_cuda(matrix, output, n_blocked, device_graph);
+  floyd_warshall_blocked_cuda(nullptr, output, n_blocked, device_graph);
 #else
   floyd_warshall_blocked(matrix, output, n_blocked, block_size);
 #endif
@@ -314,6 +342,8 @@ int main(int argc, char* argv[]) {
   nvml_stop();
   penguinStopStatCollection();
 
+#ifndef CUDA
   delete[] matrix;
+#endif
   delete[] output;
 }
@@ -4,13 +4,13 @@ penguinpath=$1
 compilerpath=$2
 binary=$3
 
-rm *.ll *.o *.ptx *.fatbin ${binary}
+rm *.ll *.o *.ptx *.fatbin ${binary} ${binary}.meta
 
 clang++  -O1 --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -pthread  -S -emit-llvm main.cu
 
 opt --loop-simplify -o loopsim.ll --debug-pass-manager -S main-cuda-nvptx64-nvidia-cuda-sm_86.ll
 
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/CudaAnalysis.so --CudaAnalysis --disable-output --debug-pass-manager loopsim.ll
+opt -load ${compilerpath}/build/lib/CudaAnalysis.so -load-pass-plugin=${compilerpath}/build/lib/CudaAnalysis.so -passes=cuda-analysis -cuda-analysis-metadata=${binary}.meta --disable-output --debug-pass-manager loopsim.ll
 
 clang++  -O3 --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -pthread  -S -emit-llvm main.cu
 
@@ -24,8 +24,7 @@ fatbinary -64 --create device.fatbin --image=profile=sm_86,file=device.ptx.o --i
 
 clang -Xclang -fcuda-include-gpubinary -Xclang './device.fatbin'  --cuda-host-only -fproc-stat-report -O3  --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include  -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -lpthread -S -emit-llvm main.cu
 
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/SCHostTransform.so -S -o looprotated.ll  -loop-rotate --debug-pass-manager main.ll
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/SCHostTransform.so -S -o modified.ll  -SCHostTransform --debug-pass-manager looprotated.ll
+opt -load ${compilerpath}/build/lib/DynamicHostTransform.so -load-pass-plugin=${compilerpath}/build/lib/DynamicHostTransform.so -S -o modified.ll -passes='function(loop(loop-rotate)),dynamic-host-transform' -penguin-policy=static -cuda-analysis-metadata=${binary}.meta --debug-pass-manager main.ll
 
 opt -S -O3 -o modif.ll modified.ll
 
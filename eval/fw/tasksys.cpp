@@ -0,0 +1,61 @@
+// The task runtime ISPC's launch and sync call into. A launch runs its tasks
+// right away on a thread per hardware thread, each taking the next task
+// index, and returns when all are done; sync only frees the launches'
+// arguments.
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef void (*ispc_task_t)(void* data, int thread_index, int thread_count,
+                            int task_index, int task_count, int task_index0,
+                            int task_index1, int task_index2, int task_count0,
+                            int task_count1, int task_count2);
+
+struct ispc_task_group {
+  std::vector<void*> arguments;
+};
+
+static ispc_task_group* task_group(void** handle) {
+  if (*handle == nullptr) *handle = new ispc_task_group;
+  return static_cast<ispc_task_group*>(*handle);
+}
+
+extern "C" void* ISPCAlloc(void** handle, int64_t size, int32_t alignment) {
+  void* memory = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  task_group(handle)->arguments.push_back(memory);
+  return memory;
+}
+
+extern "C" void ISPCLaunch(void** handle, void* f, void* data, int count0,
+                           int count1, int count2) {
+  task_group(handle);
+  ispc_task_t task = (ispc_task_t) f;
+  int count = count0 * count1 * count2;
+  int thread_count = std::max(1u, std::thread::hardware_concurrency());
+  if (thread_count > count) thread_count = count;
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = next++; i < count; i = next++) {
+        task(data, t, thread_count, i, count, i % count0, i / count0 % count1,
+             i / (count0 * count1), count0, count1, count2);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+extern "C" void ISPCSync(void* handle) {
+  ispc_task_group* group = static_cast<ispc_task_group*>(handle);
+  if (group == nullptr) return;
+  for (void* memory : group->arguments) {
+    free(memory);
+  }
+  delete group;
+}
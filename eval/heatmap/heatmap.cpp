@@ -0,0 +1,197 @@
+// Viewer of the access heat the runtime writes with PENGUIN_HEATMAP (see
+// penguin.h):
+//
+//   heatmap.out [-a id] [-w columns] [-c] <file>
+//
+// Draws a grid per allocation, or only allocation id with -a: a row per
+// launch, in the order they ran, with its invocation id, start time and
+// faults, and a column per group of 2MB blocks of the allocation, as many
+// blocks to a column as fit it in -w (64) columns. A cell is the
+// notifications and samples of its blocks in the launch, on a log scale of
+// " .:-=+*#%@" up to the hottest cell of the allocation. With -c the cells
+// are printed as CSV instead, one row per launch and block that saw any:
+// launch,invocation,time_ms,allocation,block,notifications,samples.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// penguin_heatmap_* of penguin.h
+#define HEATMAP_MAGIC 0x3150414d54414548ULL
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t block;
+    uint64_t allocations;
+    uint64_t launches;
+    uint64_t cells;
+} heatmap_header;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t decision;
+    uint64_t base;
+    uint64_t size;
+    uint64_t faults;
+    uint64_t evictions;
+} heatmap_allocation;
+
+typedef struct
+{
+    uint32_t invocation;
+    uint32_t pad;
+    uint64_t time_ns;
+    uint64_t faults;
+} heatmap_launch;
+
+typedef struct
+{
+    uint32_t launch;
+    uint32_t id;
+    uint64_t block;
+    uint64_t notifications;
+    uint64_t samples;
+} heatmap_cell;
+
+// penguin_decision_name of penguin.h
+static const char* decision_name[] = {"none", "host_pin", "gpu_pin",
+    "gpu_host_partial_pin", "migrate_on_demand", "iteration_migration",
+    "iteration_migration_plus_gpu_host_pin", "access_counter", "host_write_stream"};
+
+struct Heatmap {
+    heatmap_header header;
+    std::vector<heatmap_allocation> allocations;
+    std::vector<heatmap_launch> launches;
+    std::vector<heatmap_cell> cells;
+};
+
+template <typename T>
+static bool read_records(FILE* f, std::vector<T>& records, uint64_t count) {
+    records.resize(count);
+    return fread(records.data(), sizeof(T), count, f) == count;
+}
+
+static bool load(const char* path, Heatmap& h) {
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    bool ok = fread(&h.header, sizeof(h.header), 1, f) == 1 && h.header.magic == HEATMAP_MAGIC &&
+        read_records(f, h.allocations, h.header.allocations) &&
+        read_records(f, h.launches, h.header.launches) &&
+        read_records(f, h.cells, h.header.cells);
+    fclose(f);
+    if(!ok) {
+        fprintf(stderr, "%s is not a PENGUIN_HEATMAP file\n", path);
+    }
+    return ok;
+}
+
+static void print_csv(const Heatmap& h, long long only) {
+    printf("launch,invocation,time_ms,allocation,block,notifications,samples\n");
+    uint64_t t0 = h.launches.empty() ? 0 : h.launches[0].time_ns;
+    for(auto &c : h.cells) {
+        if((only >= 0 && c.id != only) || c.launch >= h.launches.size()) {
+            continue;
+        }
+        const heatmap_launch& l = h.launches[c.launch];
+        printf("%u,%u,%.3f,%u,%llu,%llu,%llu\n", c.launch, l.invocation, (l.time_ns - t0) / 1e6, c.id,
+                (unsigned long long) c.block, (unsigned long long) c.notifications,
+                (unsigned long long) c.samples);
+    }
+}
+
+static void print_grid(const Heatmap& h, const heatmap_allocation& a, unsigned width) {
+    static const char shades[] = " .:-=+*#%@";
+    uint64_t blocks = std::max<uint64_t>((a.size + h.header.block - 1) / h.header.block, 1);
+    uint64_t per_column = (blocks + width - 1) / width;
+    unsigned columns = (blocks + per_column - 1) / per_column;
+    // launch -> column -> heat
+    std::map<unsigned, std::vector<uint64_t>> rows;
+    uint64_t hottest = 0;
+    for(auto &c : h.cells) {
+        if(c.id != a.id || c.block >= blocks) {
+            continue;
+        }
+        auto &row = rows[c.launch];
+        row.resize(columns);
+        uint64_t &heat = row[c.block / per_column];
+        heat += c.notifications + c.samples;
+        hottest = std::max(hottest, heat);
+    }
+    printf("allocation %u, %s, %llu MiB at 0x%llx, %llu faults, %llu evictions, %llu blocks to a column\n",
+            a.id, a.decision < sizeof(decision_name) / sizeof(decision_name[0]) ? decision_name[a.decision] : "?",
+            (unsigned long long) a.size >> 20, (unsigned long long) a.base, (unsigned long long) a.faults,
+            (unsigned long long) a.evictions, (unsigned long long) per_column);
+    printf("%6s %10s %10s %8s |%*s|\n", "launch", "invocation", "time_ms", "faults", columns, "");
+    uint64_t t0 = h.launches.empty() ? 0 : h.launches[0].time_ns;
+    for(unsigned l = 0; l < h.launches.size(); l++) {
+        auto row = rows.find(l);
+        printf("%6u %10u %10.3f %8llu |", l, h.launches[l].invocation, (h.launches[l].time_ns - t0) / 1e6,
+                (unsigned long long) h.launches[l].faults);
+        for(unsigned c = 0; c < columns; c++) {
+            uint64_t heat = row != rows.end() ? row->second[c] : 0;
+            // log scale, any heat at all is at least the first shade
+            unsigned shade = heat == 0 ? 0 : 1 + (unsigned) (log((double) heat + 1) / log((double) hottest + 1) *
+                (sizeof(shades) - 2));
+            putchar(shades[std::min<unsigned>(shade, sizeof(shades) - 2)]);
+        }
+        printf("|\n");
+    }
+    printf("\n");
+}
+
+static void usage(const char* self) {
+    fprintf(stderr, "usage: %s [-a id] [-w columns] [-c] <file>\n", self);
+}
+
+int main(int argc, char* argv[]) {
+    long long only = -1;
+    unsigned width = 64;
+    bool csv = false;
+    int opt;
+    while((opt = getopt(argc, argv, "a:w:ch")) != -1) {
+        switch(opt) {
+            case 'a':
+                only = atoll(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'c':
+                csv = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - 1 || width == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    Heatmap h;
+    if(!load(argv[optind], h)) {
+        return 1;
+    }
+    if(csv) {
+        print_csv(h, only);
+        return 0;
+    }
+    printf("%zu allocations, %zu launches, %zu cells, blocks of %llu KiB\n\n", h.allocations.size(),
+            h.launches.size(), h.cells.size(), (unsigned long long) h.header.block >> 10);
+    for(auto &a : h.allocations) {
+        if(only < 0 || a.id == only) {
+            print_grid(h, a, width);
+        }
+    }
+    return 0;
+}
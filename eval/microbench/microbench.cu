@@ -0,0 +1,416 @@
+// Micro-benchmarks of the UVM driver paths SUV changes, run outside the
+// workloads:
+//
+//   fault_latency      service time of a single GPU fault (one 2MB block each)
+//   fault_throughput   faults serviced per second, per fault batch size
+//   eviction           cost of evicting from the unused, used and prioritized
+//                      root chunk lists
+//   prefetch           cudaMemPrefetchAsync bandwidth, regular and quick_migrate
+//   ac_migration       time from the first remote access of a host page to its
+//                      access counter migration
+//   ioctl              cost of each PENGUIN_* ioctl
+//
+// Usage: microbench.out [benchmark ...], all of them without arguments. Every
+// benchmark is repeated MICROBENCH_REPS times (5) and one CSV row per
+// configuration goes to stdout:
+//
+//   benchmark,config,median,min,max,unit
+//
+// fault_throughput sets uvm_perf_fault_batch_count through sysfs for each of
+// MICROBENCH_BATCHES ("32 64 128 256"), which needs root; counts above the
+// one the driver was loaded with are capped to it, and without root the
+// current count is measured alone. ioctl leaves out the access counter
+// reconfiguration and the event ring registration, which are one-off.
+
+#include <cuda_runtime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "penguin.h"
+
+#define MB (1024ULL * 1024ULL)
+#define BLOCK_SIZE (2 * MB)
+#define PAGE_SIZE 4096ULL
+#define FAULT_BATCH_PARAM "/sys/module/nvidia_uvm/parameters/uvm_perf_fault_batch_count"
+
+#define CHECK(call) \
+    do { \
+        cudaError_t err_ = (call); \
+        if(err_ != cudaSuccess) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, cudaGetErrorString(err_)); \
+            exit(1); \
+        } \
+    } while(0)
+
+static unsigned reps = 5;
+
+__device__ unsigned long long globaltimer() {
+    unsigned long long t;
+    asm volatile("mov.u64 %0, %%globaltimer;" : "=l"(t));
+    return t;
+}
+
+// One thread follows a chain through the blocks, so every hop is a fault that
+// is serviced before the next; times[i] is taken once hop i has its value
+__global__ void chase(const unsigned long long* buffer, unsigned hops,
+        unsigned long long* times, unsigned long long* sink) {
+    unsigned long long next = 0;
+    for(unsigned i = 0; i < hops; i++) {
+        next = *(volatile const unsigned long long*) (buffer + next);
+        times[i] = globaltimer() + (next & 0);
+    }
+    *sink = next;
+}
+
+// One thread per page, each touching its first word
+__global__ void touch_pages(char* buffer, unsigned long long pages, unsigned long long* sink) {
+    unsigned long long p = blockIdx.x * (unsigned long long) blockDim.x + threadIdx.x;
+    if(p < pages) {
+        atomicAdd(sink, (unsigned long long) buffer[p * PAGE_SIZE]);
+    }
+}
+
+// Reads the buffer pass after pass, each pass timed, until passes are done
+__global__ void passes(const int* buffer, unsigned long long words, unsigned count,
+        unsigned long long* times, unsigned long long* sink) {
+    unsigned long long sum = 0;
+    for(unsigned pass = 0; pass < count; pass++) {
+        for(unsigned long long w = threadIdx.x; w < words; w += blockDim.x) {
+            sum += ((volatile const int*) buffer)[w];
+        }
+        __syncthreads();
+        if(threadIdx.x == 0) {
+            times[pass] = globaltimer();
+        }
+        __syncthreads();
+    }
+    atomicAdd(sink, sum);
+}
+
+static unsigned long long* sink;
+
+static double now_us() {
+    return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* benchmark, const std::string& config, std::vector<double> values,
+        const char* unit) {
+    if(values.empty()) {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    double median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    printf("%s,%s,%.3f,%.3f,%.3f,%s\n", benchmark, config.c_str(), median, values.front(),
+            values.back(), unit);
+    fflush(stdout);
+}
+
+// Kernel time in microseconds
+static double time_kernel_us(void (*launch)(void*), void* arg) {
+    cudaEvent_t start, end;
+    CHECK(cudaEventCreate(&start));
+    CHECK(cudaEventCreate(&end));
+    CHECK(cudaEventRecord(start));
+    launch(arg);
+    CHECK(cudaEventRecord(end));
+    CHECK(cudaEventSynchronize(end));
+    float ms = 0;
+    CHECK(cudaEventElapsedTime(&ms, start, end));
+    CHECK(cudaEventDestroy(start));
+    CHECK(cudaEventDestroy(end));
+    return ms * 1000.0;
+}
+
+static void bench_fault_latency() {
+    const unsigned hops = 256;
+    const unsigned long long words = BLOCK_SIZE / sizeof(unsigned long long);
+    unsigned long long* buffer;
+    unsigned long long* times;
+    CHECK(cudaMallocManaged(&buffer, hops * BLOCK_SIZE));
+    CHECK(cudaMalloc(&times, hops * sizeof(unsigned long long)));
+    std::vector<double> latencies;
+    std::vector<unsigned long long> host_times(hops);
+    for(unsigned r = 0; r < reps; r++) {
+        // back on the host, one hop per 2MB block so prefetching within a
+        // block doesn't serve the next one
+        for(unsigned h = 0; h < hops; h++) {
+            buffer[h * words] = (h + 1) % hops * words;
+        }
+        chase<<<1, 1>>>(buffer, hops, times, sink);
+        CHECK(cudaDeviceSynchronize());
+        CHECK(cudaMemcpy(host_times.data(), times, hops * sizeof(unsigned long long),
+                cudaMemcpyDeviceToHost));
+        for(unsigned h = 1; h < hops; h++) {
+            latencies.push_back((host_times[h] - host_times[h - 1]) / 1000.0);
+        }
+    }
+    report("fault_latency", "2MB_stride", latencies, "us");
+    CHECK(cudaFree(times));
+    CHECK(cudaFree(buffer));
+}
+
+struct touch_args {
+    char* buffer;
+    unsigned long long pages;
+};
+
+static void launch_touch(void* arg) {
+    touch_args* t = (touch_args*) arg;
+    touch_pages<<<(t->pages + 255) / 256, 256>>>(t->buffer, t->pages, sink);
+}
+
+static bool set_fault_batch_count(unsigned count) {
+    FILE* f = fopen(FAULT_BATCH_PARAM, "w");
+    if(f == NULL) {
+        return false;
+    }
+    bool ok = fprintf(f, "%u\n", count) > 0;
+    return fclose(f) == 0 && ok;
+}
+
+static unsigned get_fault_batch_count() {
+    unsigned count = 0;
+    FILE* f = fopen(FAULT_BATCH_PARAM, "r");
+    if(f != NULL) {
+        if(fscanf(f, "%u", &count) != 1) {
+            count = 0;
+        }
+        fclose(f);
+    }
+    return count;
+}
+
+static void bench_fault_throughput() {
+    const unsigned long long size = 256 * MB;
+    touch_args t;
+    t.pages = size / PAGE_SIZE;
+    CHECK(cudaMallocManaged(&t.buffer, size));
+    unsigned initial = get_fault_batch_count();
+    const char* env = getenv("MICROBENCH_BATCHES");
+    std::string list = env != NULL ? env : "32 64 128 256";
+    std::vector<unsigned> batches;
+    for(char* tok = strtok(&list[0], " ,"); tok != NULL; tok = strtok(NULL, " ,")) {
+        batches.push_back(strtoul(tok, NULL, 10));
+    }
+    if(initial == 0 || !set_fault_batch_count(initial)) {
+        fprintf(stderr, "cannot set %s, measuring the current batch count\n", FAULT_BATCH_PARAM);
+        batches.assign(1, initial);
+    }
+    for(unsigned batch : batches) {
+        if(batch != initial) {
+            set_fault_batch_count(batch);
+        }
+        std::vector<double> rates;
+        for(unsigned r = 0; r < reps; r++) {
+            memset(t.buffer, 1, size);
+            double us = time_kernel_us(launch_touch, &t);
+            rates.push_back(t.pages / us);
+        }
+        report("fault_throughput", batch ? "batch_" + std::to_string(batch) : "batch_current",
+                rates, "faults_per_us");
+    }
+    if(initial != 0) {
+        set_fault_batch_count(initial);
+    }
+    CHECK(cudaFree(t.buffer));
+}
+
+// The victim fills the free GPU memory, left on the list of the case; the
+// probe then faults in probe_size, evicting as much of the victim
+static void bench_eviction() {
+    const unsigned long long probe_size = 512 * MB;
+    const char* cases[] = {"none", "unused", "used", "prioritized"};
+    for(const char* c : cases) {
+        std::vector<double> costs;
+        for(unsigned r = 0; r < reps; r++) {
+            size_t free_mem = 0, total_mem = 0;
+            CHECK(cudaMemGetInfo(&free_mem, &total_mem));
+            char* victim = NULL;
+            unsigned long long victim_size = (free_mem - 64 * MB) / BLOCK_SIZE * BLOCK_SIZE;
+            if(strcmp(c, "none") != 0) {
+                CHECK(cudaMallocManaged(&victim, victim_size));
+                if(strcmp(c, "prioritized") == 0) {
+                    penguinSetPrioritizedLocation(victim, victim_size, 0);
+                }
+                memset(victim, 1, victim_size);
+                CHECK(cudaMemPrefetchAsync(victim, victim_size, 0));
+                CHECK(cudaDeviceSynchronize());
+                if(strcmp(c, "unused") == 0) {
+                    // the pages move back, the chunks stay allocated
+                    CHECK(cudaMemPrefetchAsync(victim, victim_size, cudaCpuDeviceId));
+                    CHECK(cudaDeviceSynchronize());
+                }
+            }
+            touch_args t;
+            t.pages = probe_size / PAGE_SIZE;
+            CHECK(cudaMallocManaged(&t.buffer, probe_size));
+            memset(t.buffer, 1, probe_size);
+            double us = time_kernel_us(launch_touch, &t);
+            costs.push_back(us / (probe_size / BLOCK_SIZE));
+            CHECK(cudaFree(t.buffer));
+            if(victim != NULL) {
+                CHECK(cudaFree(victim));
+            }
+        }
+        report("eviction", c, costs, "us_per_2MB");
+    }
+}
+
+static void bench_prefetch() {
+    const unsigned long long size = 1024 * MB;
+    char* buffer;
+    CHECK(cudaMallocManaged(&buffer, size));
+    for(int quick = 0; quick < 2; quick++) {
+        penguinSetQuickMigrate(buffer, size, quick != 0);
+        std::vector<double> bandwidth;
+        for(unsigned r = 0; r < reps; r++) {
+            memset(buffer, 1, size);
+            double start = now_us();
+            CHECK(cudaMemPrefetchAsync(buffer, size, 0));
+            CHECK(cudaDeviceSynchronize());
+            bandwidth.push_back(size / MB / ((now_us() - start) / 1e6));
+        }
+        report("prefetch", quick ? "quick_migrate" : "regular", bandwidth, "MB_per_s");
+    }
+    penguinSetQuickMigrate(buffer, size, false);
+    CHECK(cudaFree(buffer));
+}
+
+// The GPU reads a host-resident block it is mapped to; once the access
+// counters migrate it, a pass takes a fraction of the remote one
+static void bench_ac_migration() {
+    const unsigned long long size = BLOCK_SIZE;
+    const unsigned count = 4096;
+    if(penguinEnableAccessCounters() != PENGUIN_OK) {
+        fprintf(stderr, "access counters unavailable, skipping ac_migration\n");
+        return;
+    }
+    int* buffer;
+    unsigned long long* times;
+    std::vector<unsigned long long> host_times(count);
+    CHECK(cudaMalloc(&times, count * sizeof(unsigned long long)));
+    std::vector<double> latencies;
+    for(unsigned r = 0; r < reps; r++) {
+        CHECK(cudaMallocManaged(&buffer, size));
+        CHECK(cudaMemAdvise(buffer, size, cudaMemAdviseSetAccessedBy, 0));
+        memset(buffer, 1, size);
+        passes<<<1, 1024>>>(buffer, size / sizeof(int), count, times, sink);
+        CHECK(cudaDeviceSynchronize());
+        CHECK(cudaMemcpy(host_times.data(), times, count * sizeof(unsigned long long),
+                cudaMemcpyDeviceToHost));
+        // the first pass is remote and the kernel started about one pass
+        // before it ended; migrated once a pass takes under half
+        unsigned long long remote = host_times[1] - host_times[0];
+        for(unsigned p = 2; p < count; p++) {
+            if((host_times[p] - host_times[p - 1]) * 2 < remote) {
+                latencies.push_back((host_times[p - 1] - host_times[0] + remote) / 1000.0);
+                break;
+            }
+        }
+        CHECK(cudaFree(buffer));
+    }
+    report("ac_migration", std::to_string(size / MB) + "MB", latencies, "us");
+    CHECK(cudaFree(times));
+}
+
+static void bench_ioctl() {
+    const unsigned long long size = 64 * MB;
+    const unsigned calls = 1000;
+    char* buffer;
+    CHECK(cudaMallocManaged(&buffer, size));
+    CHECK(cudaMemPrefetchAsync(buffer, size, 0));
+    CHECK(cudaDeviceSynchronize());
+    penguin_thrashing_event events[16];
+    struct ioctl_case {
+        const char* name;
+        void (*call)(char*, unsigned long long, penguin_thrashing_event*);
+    } cases[] = {
+        {"prioritized_location", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetPrioritizedLocation(b, s, 0); }},
+        {"no_migrate", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetNoMigrateRegion(b, s, 0, false); }},
+        {"stat_collection", [](char*, unsigned long long, penguin_thrashing_event*) {
+            penguin_start_stat_collection_params start = {};
+            penguin_stop_stat_collection_params stop = {};
+            penguin_ioctl(PENGUIN_START_STAT_COLLECTION_IOCTL_NUM, &start);
+            penguin_ioctl(PENGUIN_STOP_STAT_COLLECTION_IOCTL_NUM, &stop); }},
+        {"quick_migrate", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetQuickMigrate(b, s, false); }},
+        {"is_allocated", [](char* b, unsigned long long, penguin_thrashing_event*) {
+            penguin_pin_host_params request = {};
+            request.base = b;
+            penguin_ioctl(PENGUIN_IS_ALLOCATED, &request); }},
+        {"prefetch_stride", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetPrefetchStride(b, s, 0); }},
+        {"access_pattern", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetAccessPattern(b, s, PENGUIN_PATTERN_UNKNOWN, 0, 0, 0); }},
+        {"policy_batch", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinPolicyBatchBegin();
+            penguinSetAccessPattern(b, s, PENGUIN_PATTERN_UNKNOWN, 0, 0, 0);
+            penguinPolicyBatchEnd(); }},
+        {"discardable", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetDiscardable(b, s, false); }},
+        {"access_counter_policy", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetAccessCounterPolicy(b, s, 0, 0); }},
+        {"thrashing_events", [](char*, unsigned long long, penguin_thrashing_event* e) {
+            unsigned count = 16, dropped = 0;
+            penguinGetThrashingEvents(e, &count, &dropped); }},
+        {"host_huge_pages", [](char* b, unsigned long long s, penguin_thrashing_event*) {
+            penguinSetHostHugePages(b, s, false); }},
+    };
+    if(penguin_uvm_fd() < 0) {
+        fprintf(stderr, "Cannot open %s, skipping ioctl\n", PSF_DIR);
+        CHECK(cudaFree(buffer));
+        return;
+    }
+    for(auto &c : cases) {
+        std::vector<double> costs;
+        for(unsigned r = 0; r < reps; r++) {
+            double start = now_us();
+            for(unsigned i = 0; i < calls; i++) {
+                c.call(buffer, size, events);
+            }
+            costs.push_back((now_us() - start) / calls);
+        }
+        report("ioctl", c.name, costs, "us");
+    }
+    penguinUnsetPrioritizedLocation(buffer, size);
+    CHECK(cudaFree(buffer));
+}
+
+int main(int argc, char* argv[]) {
+    const char* env_reps = getenv("MICROBENCH_REPS");
+    if(env_reps != NULL && atoi(env_reps) > 0) {
+        reps = atoi(env_reps);
+    }
+    CHECK(cudaMalloc(&sink, sizeof(unsigned long long)));
+    struct {
+        const char* name;
+        void (*run)();
+    } benchmarks[] = {
+        {"fault_latency", bench_fault_latency},
+        {"fault_throughput", bench_fault_throughput},
+        {"eviction", bench_eviction},
+        {"prefetch", bench_prefetch},
+        {"ac_migration", bench_ac_migration},
+        {"ioctl", bench_ioctl},
+    };
+    printf("benchmark,config,median,min,max,unit\n");
+    for(auto &b : benchmarks) {
+        bool selected = argc < 2;
+        for(int a = 1; a < argc; a++) {
+            selected |= strcmp(argv[a], b.name) == 0;
+        }
+        if(selected) {
+            b.run();
+        }
+    }
+    CHECK(cudaFree(sink));
+    return 0;
+}
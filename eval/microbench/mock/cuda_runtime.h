@@ -0,0 +1,253 @@
+// CPU-only stand-in for the parts of the CUDA runtime penguin.h calls, for
+// runtime.cpp. Every call succeeds without doing anything, but for the few
+// the planner reads from: one GPU of MOCK_GPU_MB (16384) with MOCK_FREE_MB
+// (16384) free, the memory and events allocations return, and the host
+// functions streams run, which run at once.
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifndef MOCK_GPU_MB
+#define MOCK_GPU_MB 16384
+#endif
+#ifndef MOCK_FREE_MB
+#define MOCK_FREE_MB 16384
+#endif
+
+#define __device__
+#define __host__
+#define __global__
+#define CUDART_CB
+
+typedef int cudaError_t;
+enum { cudaSuccess = 0, cudaErrorMemoryAllocation = 2, cudaErrorInvalidValue = 1, cudaErrorNotReady = 600 };
+typedef struct CUstream_st* cudaStream_t;
+typedef struct CUevent_st* cudaEvent_t;
+typedef struct CUgraph_st* cudaGraph_t;
+typedef struct CUgraphExec_st* cudaGraphExec_t;
+typedef struct CUgraphNode_st* cudaGraphNode_t;
+typedef struct CUmemPool_st* cudaMemPool_t;
+typedef void (*cudaHostFn_t)(void*);
+
+struct cudaUUID_t { char bytes[16]; };
+struct cudaDeviceProp {
+    char name[256];
+    cudaUUID_t uuid;
+    size_t totalGlobalMem;
+    int multiProcessorCount;
+    int maxThreadsPerMultiProcessor;
+    int pciBusID;
+    int pciDeviceID;
+    int pciDomainID;
+    int l2CacheSize;
+    int major;
+    int minor;
+};
+struct uint3 { unsigned x, y, z; };
+struct dim3 {
+    unsigned x, y, z;
+    dim3(unsigned a = 1, unsigned b = 1, unsigned c = 1) : x(a), y(b), z(c) {}
+};
+struct cudaKernelNodeParams {
+    void* func;
+    dim3 gridDim;
+    dim3 blockDim;
+    unsigned sharedMemBytes;
+    void** kernelParams;
+    void** extra;
+};
+typedef struct cudaMemPoolProps { int allocType; } cudaMemPoolProps;
+
+enum cudaMemoryAdvise {
+    cudaMemAdviseSetReadMostly = 1,
+    cudaMemAdviseUnsetReadMostly,
+    cudaMemAdviseSetPreferredLocation,
+    cudaMemAdviseUnsetPreferredLocation,
+    cudaMemAdviseSetAccessedBy,
+    cudaMemAdviseUnsetAccessedBy
+};
+enum cudaMemcpyKind {
+    cudaMemcpyHostToHost,
+    cudaMemcpyHostToDevice,
+    cudaMemcpyDeviceToHost,
+    cudaMemcpyDeviceToDevice,
+    cudaMemcpyDefault
+};
+enum cudaDeviceAttr {
+    cudaDevAttrMultiProcessorCount = 16,
+    cudaDevAttrMaxThreadsPerMultiProcessor = 39,
+    cudaDevAttrHostNativeAtomicSupported = 86,
+    cudaDevAttrPageableMemoryAccess = 88,
+    cudaDevAttrConcurrentManagedAccess = 89
+};
+enum cudaDeviceP2PAttr {
+    cudaDevP2PAttrPerformanceRank = 1,
+    cudaDevP2PAttrAccessSupported = 2,
+    cudaDevP2PAttrNativeAtomicSupported = 3
+};
+
+#define cudaStreamNonBlocking 0x01
+#define cudaEventDisableTiming 0x02
+#define cudaMemAttachGlobal 0x01
+#define cudaHostAllocDefault 0
+#define cudaHostAllocPortable 1
+#define cudaHostAllocMapped 2
+#define cudaHostRegisterDefault 0
+#define cudaHostRegisterPortable 1
+#define cudaHostRegisterMapped 2
+#define cudaCpuDeviceId (-1)
+#define cudaInvalidDeviceId (-2)
+
+// handles only need to be distinct and not NULL
+static inline void* mock_handle() {
+    static size_t next = 0;
+    return (void*) ++next;
+}
+
+static inline cudaError_t mock_alloc(void** p, size_t size) {
+    *p = calloc(1, size ? size : 1);
+    return *p != NULL ? cudaSuccess : cudaErrorMemoryAllocation;
+}
+
+static inline cudaError_t cudaGetDeviceProperties(cudaDeviceProp* p, int) {
+    memset(p, 0, sizeof(*p));
+    strcpy(p->name, "mock");
+    p->totalGlobalMem = MOCK_GPU_MB * 1024ULL * 1024ULL;
+    p->multiProcessorCount = 80;
+    p->maxThreadsPerMultiProcessor = 2048;
+    p->l2CacheSize = 6 << 20;
+    p->major = 7;
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGetDeviceCount(int* count) { *count = 1; return cudaSuccess; }
+static inline cudaError_t cudaGetDevice(int* device) { *device = 0; return cudaSuccess; }
+static inline cudaError_t cudaSetDevice(int) { return cudaSuccess; }
+static inline cudaError_t cudaDeviceGetAttribute(int* value, cudaDeviceAttr attr, int) {
+    *value = attr == cudaDevAttrMultiProcessorCount ? 80 :
+        attr == cudaDevAttrMaxThreadsPerMultiProcessor ? 2048 : 0;
+    return cudaSuccess;
+}
+static inline cudaError_t cudaDeviceGetP2PAttribute(int* value, cudaDeviceP2PAttr, int, int) {
+    *value = 0;
+    return cudaSuccess;
+}
+static inline cudaError_t cudaDeviceGetPCIBusId(char* id, int length, int) {
+    snprintf(id, length, "0000:00:00.0");
+    return cudaSuccess;
+}
+static inline cudaError_t cudaMemGetInfo(size_t* free, size_t* total) {
+    *free = MOCK_FREE_MB * 1024ULL * 1024ULL;
+    *total = MOCK_GPU_MB * 1024ULL * 1024ULL;
+    return cudaSuccess;
+}
+static inline cudaError_t cudaDeviceSynchronize() { return cudaSuccess; }
+static inline cudaError_t cudaGetLastError() { return cudaSuccess; }
+static inline const char* cudaGetErrorString(cudaError_t) { return "mock"; }
+static inline cudaError_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int* blocks, const void*, int, size_t) {
+    *blocks = 8;
+    return cudaSuccess;
+}
+
+static inline cudaError_t cudaMallocManaged(void** p, size_t size, unsigned = cudaMemAttachGlobal) {
+    return mock_alloc(p, size);
+}
+static inline cudaError_t cudaMalloc(void** p, size_t size) { return mock_alloc(p, size); }
+static inline cudaError_t cudaMallocAsync(void** p, size_t size, cudaStream_t) { return mock_alloc(p, size); }
+static inline cudaError_t cudaMallocFromPoolAsync(void** p, size_t size, cudaMemPool_t, cudaStream_t) {
+    return mock_alloc(p, size);
+}
+static inline cudaError_t cudaHostAlloc(void** p, size_t size, unsigned) { return mock_alloc(p, size); }
+static inline cudaError_t cudaFree(void* p) { free(p); return cudaSuccess; }
+static inline cudaError_t cudaFreeAsync(void* p, cudaStream_t) { free(p); return cudaSuccess; }
+static inline cudaError_t cudaFreeHost(void* p) { free(p); return cudaSuccess; }
+static inline cudaError_t cudaHostRegister(void*, size_t, unsigned) { return cudaSuccess; }
+static inline cudaError_t cudaHostUnregister(void*) { return cudaSuccess; }
+static inline cudaError_t cudaHostGetDevicePointer(void** device, void* host, unsigned) {
+    *device = host;
+    return cudaSuccess;
+}
+static inline cudaError_t cudaMemPoolCreate(cudaMemPool_t* pool, const cudaMemPoolProps*) {
+    *pool = (cudaMemPool_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaMemPoolDestroy(cudaMemPool_t) { return cudaSuccess; }
+
+static inline cudaError_t cudaMemPrefetchAsync(const void*, size_t, int, cudaStream_t = 0) { return cudaSuccess; }
+static inline cudaError_t cudaMemAdvise(const void*, size_t, cudaMemoryAdvise, int) { return cudaSuccess; }
+static inline cudaError_t cudaMemcpy(void*, const void*, size_t, cudaMemcpyKind) { return cudaSuccess; }
+static inline cudaError_t cudaMemcpyAsync(void*, const void*, size_t, cudaMemcpyKind, cudaStream_t = 0) {
+    return cudaSuccess;
+}
+static inline cudaError_t cudaMemset(void*, int, size_t) { return cudaSuccess; }
+template <typename T>
+cudaError_t cudaMemcpyToSymbol(const T&, const void*, size_t, size_t = 0, cudaMemcpyKind = cudaMemcpyHostToDevice) {
+    return cudaSuccess;
+}
+template <typename T>
+cudaError_t cudaMemcpyFromSymbol(void* dst, const T&, size_t count, size_t = 0,
+        cudaMemcpyKind = cudaMemcpyDeviceToHost) {
+    memset(dst, 0, count);
+    return cudaSuccess;
+}
+template <typename T>
+cudaError_t cudaMemcpyFromSymbolAsync(void* dst, const T&, size_t count, size_t, cudaMemcpyKind, cudaStream_t) {
+    memset(dst, 0, count);
+    return cudaSuccess;
+}
+template <typename T>
+cudaError_t cudaGetSymbolAddress(void** p, const T& symbol) {
+    *p = (void*) &symbol;
+    return cudaSuccess;
+}
+
+static inline cudaError_t cudaStreamCreateWithFlags(cudaStream_t* s, unsigned) {
+    *s = (cudaStream_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaStreamSynchronize(cudaStream_t) { return cudaSuccess; }
+static inline cudaError_t cudaStreamQuery(cudaStream_t) { return cudaSuccess; }
+static inline cudaError_t cudaStreamWaitEvent(cudaStream_t, cudaEvent_t, unsigned = 0) { return cudaSuccess; }
+static inline cudaError_t cudaLaunchHostFunc(cudaStream_t, cudaHostFn_t fn, void* data) {
+    fn(data);
+    return cudaSuccess;
+}
+static inline cudaError_t cudaEventCreate(cudaEvent_t* e) {
+    *e = (cudaEvent_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaEventCreateWithFlags(cudaEvent_t* e, unsigned) { return cudaEventCreate(e); }
+static inline cudaError_t cudaEventDestroy(cudaEvent_t) { return cudaSuccess; }
+static inline cudaError_t cudaEventRecord(cudaEvent_t, cudaStream_t = 0) { return cudaSuccess; }
+static inline cudaError_t cudaEventQuery(cudaEvent_t) { return cudaSuccess; }
+static inline cudaError_t cudaEventSynchronize(cudaEvent_t) { return cudaSuccess; }
+static inline cudaError_t cudaEventElapsedTime(float* ms, cudaEvent_t, cudaEvent_t) {
+    *ms = 0;
+    return cudaSuccess;
+}
+
+static inline cudaError_t cudaLaunchKernel(const void*, dim3, dim3, void**, size_t, cudaStream_t) {
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGraphCreate(cudaGraph_t* g, unsigned) {
+    *g = (cudaGraph_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGraphAddKernelNode(cudaGraphNode_t* n, cudaGraph_t, const cudaGraphNode_t*, size_t,
+        const cudaKernelNodeParams*) {
+    *n = (cudaGraphNode_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGraphInstantiate(cudaGraphExec_t* e, cudaGraph_t, unsigned long long = 0) {
+    *e = (cudaGraphExec_t) mock_handle();
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGraphExecKernelNodeSetParams(cudaGraphExec_t, cudaGraphNode_t,
+        const cudaKernelNodeParams*) {
+    return cudaSuccess;
+}
+static inline cudaError_t cudaGraphLaunch(cudaGraphExec_t, cudaStream_t) { return cudaSuccess; }
+static inline cudaError_t cudaGraphExecDestroy(cudaGraphExec_t) { return cudaSuccess; }
+static inline cudaError_t cudaGraphDestroy(cudaGraph_t) { return cudaSuccess; }
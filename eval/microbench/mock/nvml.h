@@ -0,0 +1,69 @@
+// CPU-only stand-in for NVML, for runtime.cpp: there is no device, so the
+// monitor of penguin.h stops at nvmlInit
+#pragma once
+
+typedef int nvmlReturn_t;
+enum { NVML_SUCCESS = 0, NVML_ERROR_UNINITIALIZED = 1, NVML_ERROR_INSUFFICIENT_SIZE = 7 };
+typedef struct nvmlDevice_st* nvmlDevice_t;
+typedef enum { NVML_PCIE_UTIL_TX_BYTES = 0, NVML_PCIE_UTIL_RX_BYTES = 1 } nvmlPcieUtilCounter_t;
+typedef enum { NVML_CLOCK_GRAPHICS = 0, NVML_CLOCK_SM = 1, NVML_CLOCK_MEM = 2 } nvmlClockType_t;
+typedef enum { NVML_FEATURE_DISABLED = 0, NVML_FEATURE_ENABLED = 1 } nvmlEnableState_t;
+typedef struct { unsigned int gpu, memory; } nvmlUtilization_t;
+typedef struct {
+    unsigned int pid;
+    unsigned long long usedGpuMemory;
+    unsigned int gpuInstanceId, computeInstanceId;
+} nvmlProcessInfo_t;
+typedef struct {
+    char busIdLegacy[16];
+    unsigned int domain, bus, device, pciDeviceId, pciSubSystemId;
+    char busId[32];
+} nvmlPciInfo_t;
+#define NVML_VALUE_NOT_AVAILABLE (-1)
+#define NVML_NVLINK_MAX_LINKS 18
+
+static inline nvmlReturn_t nvmlInit() { return NVML_ERROR_UNINITIALIZED; }
+static inline nvmlReturn_t nvmlShutdown() { return NVML_ERROR_UNINITIALIZED; }
+static inline nvmlReturn_t nvmlDeviceGetHandleByPciBusId(const char*, nvmlDevice_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetPcieThroughput(nvmlDevice_t, nvmlPcieUtilCounter_t, unsigned*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetTotalEnergyConsumption(nvmlDevice_t, unsigned long long*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetClockInfo(nvmlDevice_t, nvmlClockType_t, unsigned*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetUtilizationRates(nvmlDevice_t, nvmlUtilization_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetComputeRunningProcesses(nvmlDevice_t, unsigned int*, nvmlProcessInfo_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetNvLinkState(nvmlDevice_t, unsigned int, nvmlEnableState_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetNvLinkRemotePciInfo(nvmlDevice_t, unsigned int, nvmlPciInfo_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetCurrPcieLinkGeneration(nvmlDevice_t, unsigned int*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetCurrPcieLinkWidth(nvmlDevice_t, unsigned int*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+typedef struct { unsigned long long total, free, used; } nvmlMemory_t;
+static inline nvmlReturn_t nvmlDeviceGetHandleByUUID(const char*, nvmlDevice_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceIsMigDeviceHandle(nvmlDevice_t, unsigned int*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetDeviceHandleFromMigDeviceHandle(nvmlDevice_t, nvmlDevice_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
+static inline nvmlReturn_t nvmlDeviceGetMemoryInfo(nvmlDevice_t, nvmlMemory_t*) {
+    return NVML_ERROR_UNINITIALIZED;
+}
@@ -0,0 +1,210 @@
+// Micro-benchmarks of the hot paths of penguin.h, on the CPU: built against
+// the CUDA and NVML stand-ins of mock/, so every CUDA call returns at once
+// and the driver ioctls fail without a UVM fd. What is timed is the
+// runtime's own bookkeeping:
+//
+//   identify      identify_memory_allocation with K allocations registered,
+//                 for random addresses inside them and in the gaps between
+//   recorders     the add_aid_* calls the host transform makes before a
+//                 launch, with M aids recorded, the values unchanged
+//   mmg           perform_memory_management for one of 4 invocations of M
+//                 aids over 64 allocations, nothing changed since the last
+//                 plan
+//   prefetch      penguinSuperPrefetchWrapper with N allocations under
+//                 iteration prefetch
+//
+// Usage: runtime.out [benchmark ...], all of them without arguments. Each
+// configuration runs in a process of its own, so that the runtime starts
+// empty, and repeats MICROBENCH_REPS times (5) a loop of at least
+// MICROBENCH_MIN_MS (20) ms. Rows are in the format of microbench.out, the
+// time per call in ns, on stdout; what the runtime prints goes to /dev/null:
+//
+//   benchmark,config,median,min,max,unit
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "penguin.h"
+
+#define MB (1024ULL * 1024ULL)
+// where the fake allocations go, one every ALLOCATION_STRIDE bytes; only
+// their addresses are used
+#define ALLOCATION_BASE 0x7f0000000000ULL
+#define ALLOCATION_STRIDE (64 * MB)
+#define ALLOCATION_SIZE (48 * MB)
+
+static unsigned reps = 5;
+static double min_ms = 20;
+// stdout, which the runtime's own prints no longer reach
+static FILE* out;
+
+static void report(const char* benchmark, const std::string& config, std::vector<double> values,
+        const char* unit) {
+    if(values.empty()) {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    double median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    fprintf(out, "%s,%s,%.3f,%.3f,%.3f,%s\n", benchmark, config.c_str(), median, values.front(),
+            values.back(), unit);
+    fflush(out);
+}
+
+// ns per call of op, which is given the call's index; the calls of a rep
+// double until the rep takes min_ms
+static void run(const char* benchmark, const std::string& config,
+        const std::function<void(unsigned long long)>& op) {
+    std::vector<double> costs;
+    unsigned long long calls = 1;
+    unsigned long long i = 0;
+    while(costs.size() < reps) {
+        auto start = std::chrono::steady_clock::now();
+        for(unsigned long long c = 0; c < calls; c++) {
+            op(i++);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if(ns < min_ms * 1e6) {
+            calls *= 2;
+            continue;
+        }
+        costs.push_back(ns / calls);
+    }
+    report(benchmark, config, costs, "ns");
+}
+
+static void* allocation(unsigned i) {
+    return (void*) (ALLOCATION_BASE + i * ALLOCATION_STRIDE);
+}
+
+static void register_allocations(unsigned count) {
+    for(unsigned i = 0; i < count; i++) {
+        void* p = allocation(i);
+        addIntoAllocationMap(&p, ALLOCATION_SIZE);
+    }
+}
+
+// aid a accesses allocation a % allocations in invocation a % invocations
+static void record_aids(unsigned aids, unsigned allocations, unsigned invocations) {
+    for(unsigned a = 0; a < aids; a++) {
+        add_aid_allocation_map(a, allocation(a % allocations));
+        add_aid_invocation_map(a, a % invocations);
+        add_aid_wss_map(a, ALLOCATION_SIZE / 4);
+        add_aid_ac_map(a, 1 << 20);
+    }
+    for(unsigned i = 0; i < invocations; i++) {
+        add_invocation_id(i);
+    }
+}
+
+static unsigned long long next_random(unsigned long long& state) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 17;
+}
+
+static void bench_identify(unsigned k) {
+    register_allocations(k);
+    std::vector<void*> addresses(4096);
+    unsigned long long state = 1;
+    for(auto &a : addresses) {
+        a = (void*) (ALLOCATION_BASE + next_random(state) % (k * ALLOCATION_STRIDE));
+    }
+    run("identify", "allocations=" + std::to_string(k), [&](unsigned long long i) {
+        identify_memory_allocation(addresses[i % addresses.size()]);
+    });
+}
+
+static void bench_recorders(unsigned m) {
+    const unsigned allocations = 16;
+    register_allocations(allocations);
+    record_aids(m, allocations, 4);
+    std::string config = "aids=" + std::to_string(m);
+    run("recorders", "add_aid_allocation_map/" + config, [&](unsigned long long i) {
+        add_aid_allocation_map(i % m, allocation(i % m % allocations));
+    });
+    run("recorders", "add_aid_invocation_map/" + config, [&](unsigned long long i) {
+        add_aid_invocation_map(i % m, i % m % 4);
+    });
+    run("recorders", "add_aid_wss_map/" + config, [&](unsigned long long i) {
+        add_aid_wss_map(i % m, ALLOCATION_SIZE / 4);
+    });
+    run("recorders", "add_aid_ac_map/" + config, [&](unsigned long long i) {
+        add_aid_ac_map(i % m, 1 << 20);
+    });
+}
+
+static void bench_mmg(unsigned m) {
+    const unsigned allocations = 64;
+    const unsigned invocations = 4;
+    register_allocations(allocations);
+    record_aids(m, allocations, invocations);
+    run("mmg", "aids=" + std::to_string(m), [&](unsigned long long i) {
+        perform_memory_management(allocations * ALLOCATION_SIZE, i % invocations);
+    });
+}
+
+static void bench_prefetch(unsigned n) {
+    register_allocations(n);
+    for(unsigned i = 0; i < n; i++) {
+        set_allocation_prefetch(allocation(i), ALLOCATION_SIZE / 64, 1, 4);
+    }
+    run("prefetch", "allocations=" + std::to_string(n), [&](unsigned long long i) {
+        penguinSuperPrefetchWrapper(i % 64);
+    });
+}
+
+int main(int argc, char* argv[]) {
+    const char* env_reps = getenv("MICROBENCH_REPS");
+    if(env_reps != NULL && atoi(env_reps) > 0) {
+        reps = atoi(env_reps);
+    }
+    const char* env_min_ms = getenv("MICROBENCH_MIN_MS");
+    if(env_min_ms != NULL && atof(env_min_ms) > 0) {
+        min_ms = atof(env_min_ms);
+    }
+    struct {
+        const char* name;
+        void (*run)(unsigned);
+        std::vector<unsigned> sizes;
+    } benchmarks[] = {
+        {"identify", bench_identify, {16, 256, 4096}},
+        {"recorders", bench_recorders, {16, 256, 4096}},
+        {"mmg", bench_mmg, {16, 256, 4096}},
+        {"prefetch", bench_prefetch, {4, 32, PENGUIN_MAX_PREFETCH_ALLOCS}},
+    };
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if(out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+    fprintf(out, "benchmark,config,median,min,max,unit\n");
+    fflush(out);
+    for(auto &b : benchmarks) {
+        bool selected = argc < 2;
+        for(int a = 1; a < argc; a++) {
+            selected |= strcmp(argv[a], b.name) == 0;
+        }
+        if(!selected) {
+            continue;
+        }
+        for(unsigned size : b.sizes) {
+            pid_t pid = fork();
+            if(pid == 0) {
+                b.run(size);
+                _exit(0);
+            }
+            int status = 0;
+            if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "%s with %u failed\n", b.name, size);
+            }
+        }
+    }
+    return 0;
+}
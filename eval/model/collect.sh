@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Gathers training rows for the placement tree of penguin.h, from the root
+# folder of the artifact:
+#
+#   bash eval/model/collect.sh <benchmark> [args...]
+#
+# Runs eval/build/<benchmark>/suv.out through eval/trials.sh once with the
+# cascade and then with PENGUIN_MODEL_EXPLORE set to 1 to MODEL_RUNS (8), each
+# appending the features and classes of its allocations to a file of its own.
+# eval/<benchmark>/model.csv gets those rows led by the workload, the run and
+# its median GPU.Parser.Time. Train on the workloads collected so far with
+#
+#   eval/build/model/train.out -w penguin-suv.h eval/*/model.csv
+#
+# then copy penguin-suv.h to penguin.h and rebuild. The policy and
+# oversubscription come from the environment as for trials.sh.
+
+pwd0=$(pwd) # the root folder of the artifact
+benchmark=$1
+shift
+runs=${MODEL_RUNS:-8}
+bin=${pwd0}/eval/build/${benchmark} # see compile.sh
+cd ${pwd0}/eval/${benchmark}
+
+rm -f model.csv
+for ((run=0; run<=runs; ++run)); do
+    rm -f model.${run}.rows
+    explore=""
+    if [ ${run} -gt 0 ]; then
+        explore=${run}
+    fi
+    echo "${benchmark} run ${run}${explore:+, exploring}"
+    # the rows of every trial are the same, the decisions follow the seed
+    PENGUIN_MODEL_EXPLORE=${explore} PENGUIN_MODEL_FEATURES=${pwd0}/eval/${benchmark}/model.${run}.rows \
+        bash ${pwd0}/eval/trials.sh model.${run} ${bin}/suv.out "$@"
+    median=$(grep "GPU.Parser.Time" model.${run}.txt | awk '{print $2}')
+    if [ -n "${median}" ] && [ -f model.${run}.rows ]; then
+        sort -u model.${run}.rows | sed "s/^/${benchmark},${run},${median},/" >> model.csv
+    fi
+    rm -f model.${run}.rows
+done
+cd ${pwd0}
@@ -0,0 +1,244 @@
+// Trains the placement tree of penguin.h (penguin_model_tree) from the rows
+// eval/model/collect.sh gathers:
+//
+//   train.out [-d depth] [-m rows] [-w header] <model.csv>...
+//
+// A row is workload,run,time,invid,seq and then the PENGUIN_MODEL_FEATURES
+// row of an allocation: its features and the class it was placed with. The
+// label of an allocation at a launch, a workload, invid and seq, is its class
+// in the fastest run of the workload; each run placed it as one of them,
+// the cascade or at random. The tree splits on the feature and threshold
+// that lower the Gini impurity the most, down to -d (4) levels or leaves of
+// -m (4) rows, and a leaf's confidence is the share of its rows with its
+// label. The table goes to stdout, or replaces the one in header with -w.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// penguin_model_feature and penguin_model_class of penguin.h
+static const char* feature_names[] = {"PENGUIN_FEAT_DENSITY", "PENGUIN_FEAT_WSS_RATIO",
+    "PENGUIN_FEAT_SIZE_MB", "PENGUIN_FEAT_PCHASE", "PENGUIN_FEAT_ITERDEP"};
+static const char* class_names[] = {"PENGUIN_MODEL_TEMPORAL", "PENGUIN_MODEL_PIN",
+    "PENGUIN_MODEL_HOST"};
+static const int features = 5;
+static const int classes = 3;
+
+struct Row {
+    float f[features];
+    int label;
+};
+
+struct Node {
+    int feature = -1;
+    float threshold = 0;
+    int left = 0;
+    int right = 0;
+    int label = 0;
+    float confidence = 0;
+};
+
+typedef std::tuple<std::string, unsigned, unsigned> Key; // workload, invid, seq
+
+struct Sample {
+    double time;
+    std::string run;
+    Row row;
+};
+
+static bool load(const char* path, std::map<Key, Sample>& samples) {
+    std::ifstream in(path);
+    if(!in) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    std::string line;
+    while(std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while(std::getline(ss, field, ',')) {
+            fields.push_back(field);
+        }
+        if(fields.size() != 6 + features || fields[2].empty()) {
+            continue;
+        }
+        Sample s;
+        s.run = fields[1];
+        s.time = atof(fields[2].c_str());
+        for(int f = 0; f < features; f++) {
+            s.row.f[f] = atof(fields[5 + f].c_str());
+        }
+        s.row.label = atoi(fields[5 + features].c_str());
+        if(s.row.label < 0 || s.row.label >= classes) {
+            continue;
+        }
+        Key k(fields[0], strtoul(fields[3].c_str(), NULL, 10), strtoul(fields[4].c_str(), NULL, 10));
+        auto i = samples.find(k);
+        if(i == samples.end() || s.time < i->second.time) {
+            samples[k] = s;
+        }
+    }
+    return true;
+}
+
+static double gini(const int* count, int n) {
+    if(n == 0) {
+        return 0;
+    }
+    double g = 1;
+    for(int c = 0; c < classes; c++) {
+        g -= ((double) count[c] / n) * ((double) count[c] / n);
+    }
+    return g;
+}
+
+static int build(std::vector<Row>& rows, size_t begin, size_t end, int depth, int max_depth,
+        size_t min_rows, std::vector<Node>& tree) {
+    int n = tree.size();
+    tree.emplace_back();
+    int count[classes] = {};
+    for(size_t r = begin; r < end; r++) {
+        count[rows[r].label]++;
+    }
+    int label = std::max_element(count, count + classes) - count;
+    tree[n].label = label;
+    tree[n].confidence = (float) count[label] / (end - begin);
+    if(depth == max_depth || end - begin < 2 * min_rows || count[label] == (int) (end - begin)) {
+        return n;
+    }
+    double best = gini(count, end - begin);
+    int best_feature = -1;
+    float best_threshold = 0;
+    for(int f = 0; f < features; f++) {
+        std::sort(rows.begin() + begin, rows.begin() + end,
+                [f](const Row& a, const Row& b) { return a.f[f] < b.f[f]; });
+        int left[classes] = {};
+        for(size_t r = begin; r + 1 < end; r++) {
+            left[rows[r].label]++;
+            size_t nl = r + 1 - begin, nr = end - r - 1;
+            if(rows[r].f[f] == rows[r + 1].f[f] || nl < min_rows || nr < min_rows) {
+                continue;
+            }
+            int right[classes];
+            for(int c = 0; c < classes; c++) {
+                right[c] = count[c] - left[c];
+            }
+            double g = (nl * gini(left, nl) + nr * gini(right, nr)) / (end - begin);
+            if(g < best - 1e-9) {
+                best = g;
+                best_feature = f;
+                best_threshold = (rows[r].f[f] + rows[r + 1].f[f]) / 2;
+            }
+        }
+    }
+    if(best_feature < 0) {
+        return n;
+    }
+    auto mid = std::partition(rows.begin() + begin, rows.begin() + end,
+            [&](const Row& r) { return r.f[best_feature] <= best_threshold; }) - rows.begin();
+    tree[n].feature = best_feature;
+    tree[n].threshold = best_threshold;
+    int l = build(rows, begin, mid, depth + 1, max_depth, min_rows, tree);
+    int r = build(rows, mid, end, depth + 1, max_depth, min_rows, tree);
+    tree[n].left = l;
+    tree[n].right = r;
+    return n;
+}
+
+static std::string table(const std::vector<Node>& tree) {
+    std::string s = "constexpr penguin_model_node penguin_model_tree[] = {\n";
+    char line[256];
+    for(auto& n : tree) {
+        if(n.feature < 0) {
+            snprintf(line, sizeof(line), "    {-1, 0, 0, 0, %s, %.3ff},\n",
+                    class_names[n.label], n.confidence);
+        } else {
+            snprintf(line, sizeof(line), "    {%s, %gf, %d, %d, 0, 0},\n",
+                    feature_names[n.feature], n.threshold, n.left, n.right);
+        }
+        s += line;
+    }
+    return s + "};\n";
+}
+
+// Replaces the lines between the begin and end markers of penguin_model_tree
+static bool rewrite(const char* path, const std::string& t) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string s = ss.str();
+    size_t b = s.find("// begin penguin_model_tree");
+    size_t e = s.find("// end penguin_model_tree");
+    if(!in || b == std::string::npos || e == std::string::npos || e < b) {
+        fprintf(stderr, "no penguin_model_tree in %s\n", path);
+        return false;
+    }
+    b = s.find('\n', b) + 1;
+    s = s.substr(0, b) + t + s.substr(e);
+    std::ofstream out(path);
+    out << s;
+    return (bool) out;
+}
+
+static void usage(const char* self) {
+    fprintf(stderr, "usage: %s [-d depth] [-m rows] [-w header] <model.csv>...\n", self);
+}
+
+int main(int argc, char* argv[]) {
+    int max_depth = 4;
+    size_t min_rows = 4;
+    const char* header = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "d:m:w:h")) != -1) {
+        switch(opt) {
+            case 'd':
+                max_depth = atoi(optarg);
+                break;
+            case 'm':
+                min_rows = std::max(atoi(optarg), 1);
+                break;
+            case 'w':
+                header = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind == argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::map<Key, Sample> samples;
+    for(int i = optind; i < argc; i++) {
+        if(!load(argv[i], samples)) {
+            return 1;
+        }
+    }
+    std::vector<Row> rows;
+    for(auto& s : samples) {
+        rows.push_back(s.second.row);
+    }
+    if(rows.empty()) {
+        fprintf(stderr, "no rows with a time\n");
+        return 1;
+    }
+    std::vector<Node> tree;
+    build(rows, 0, rows.size(), 0, max_depth, min_rows, tree);
+    fprintf(stderr, "%zu allocations, %zu nodes\n", rows.size(), tree.size());
+    std::string t = table(tree);
+    if(header == NULL) {
+        fputs(t.c_str(), stdout);
+        return 0;
+    }
+    return rewrite(header, t) ? 0 : 1;
+}
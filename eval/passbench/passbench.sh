@@ -0,0 +1,154 @@
+#!/bin/bash
+
+# Compile-time benchmark of the SUV passes, run by the passbench target of
+# eval/CMakeLists.txt:
+#
+#   cmake --build eval/build --target passbench
+#
+# or by hand from eval/build/passbench, with the variables of the eval build
+# in the environment:
+#
+#   SUV_OPT=... SUV_CLANG=... SUV_CLANGXX=... SUV_LLVM_BUILD=... SUV_HOME=...
+#   CUDA_HOME=... CUDA_GPU_ARCH=... bash passbench.sh <eval build dir>
+#
+# The corpus is the IR the eval build leaves per workload, eval/build/<b>/
+# analysis.loopsim.ll for CudaAnalysis and program.host.ll for the host
+# transforms, and the synthetic programs of synthetic.sh, one per
+# <kernels>:<loops>:<arrays> of PASSBENCH_SYNTHETIC ("16:4:8 64:8:16
+# 256:8:32"), compiled here the way penguin_benchmark compiles a workload.
+# Every module is run PASSBENCH_REPS (3) times through
+#   cuda-analysis           on the device IR, which writes the metadata the
+#                           host transforms read
+#   dynamic-host-transform  on the host IR, -penguin-policy=dynamic
+#   cuda-host-transform     on the host IR
+#   verify                  on either, the cost of reading the IR alone
+# with -time-passes, under rusage.out. passbench.csv gets per pass and
+# module the IR size in kB, the medians in s of
+#   pass_s    the pass itself, the analyses it asks for not included
+#   passes_s  all the passes and analyses of the pipeline
+#   parse_s   reading the IR
+#   opt_s     the whole opt process
+# and the largest peak resident set of opt in kB. The outputs of the build
+# are left as they are; the metadata goes to passbench's own .meta files.
+
+build=$1
+if [ -z "${build}" ] || [ -z "${SUV_OPT}" ] || [ -z "${SUV_LLVM_BUILD}" ]; then
+    echo "usage: SUV_OPT=... SUV_LLVM_BUILD=... bash passbench.sh <eval build dir>"
+    exit 1
+fi
+here=$(dirname $(readlink -f $0))
+reps=${PASSBENCH_REPS:-3}
+synthetic=${PASSBENCH_SYNTHETIC:-"16:4:8 64:8:16 256:8:32"}
+rusage=$(pwd)/rusage.out
+lib=${SUV_LLVM_BUILD}/lib
+analysis=${lib}/CudaAnalysis.so
+dynamic=${lib}/DynamicHostTransform.so
+static=${lib}/CudaHostTransform.so
+cuda_flags="--cuda-gpu-arch=${CUDA_GPU_ARCH} -I${SUV_HOME} -I${CUDA_HOME}/include"
+mkdir -p corpus
+
+median() {
+    printf "%s\n" "$@" | sort -g | awk '
+        { t[NR] = $1 }
+        END { print NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2 }'
+}
+
+# <class> <log>: the wall times of the pass whose class name ends in <class>,
+# of the whole pass report and of parsing, from the -time-passes report
+report() {
+    awk -v pass=$1 '
+        /LLVM IR Parsing/ { parsing = 1 }
+        /%\)/ {
+            n = split($0, f, "%\\)")
+            split(f[n - 1], t, " ")
+            name = f[n]
+            sub(/^ */, "", name)
+            if(parsing) {
+                if(name == "Parse IR")
+                    parse += t[1]
+            } else if(name == "Total") {
+                total = t[1]
+            } else if(name ~ pass "$") {
+                own += t[1]
+            }
+        }
+        END { printf "%.4f %.4f %.4f\n", own, total, parse }' $2
+}
+
+# <pass> <class> <module> <ll> <opt args...>
+bench() {
+    pass=$1
+    class=$2
+    module=$3
+    ll=$4
+    shift 4
+    own=()
+    total=()
+    parse=()
+    wall=()
+    peak=0
+    for ((r=0; r<reps; ++r)); do
+        if ! ${rusage} corpus/rusage.txt ${SUV_OPT} "$@" -time-passes \
+                --disable-output ${ll} &> corpus/time-passes.txt; then
+            echo "${pass} on ${module} failed, see corpus/time-passes.txt"
+            return 1
+        fi
+        read o t p <<< $(report ${class} corpus/time-passes.txt)
+        read w k < corpus/rusage.txt
+        own+=(${o})
+        total+=(${t})
+        parse+=(${p})
+        wall+=(${w})
+        if [ ${k} -gt ${peak} ]; then
+            peak=${k}
+        fi
+    done
+    kb=$(($(stat -c %s ${ll}) / 1024))
+    echo "${pass},${module},${kb},$(median ${own[@]}),$(median ${total[@]}),$(median ${parse[@]}),$(median ${wall[@]}),${peak}" >> passbench.csv
+}
+
+# <module> <device ll> <host ll>
+bench_module() {
+    meta=corpus/$1.meta
+    bench cuda-analysis CudaAnalysisPass $1 $2 -load ${analysis} \
+        -load-pass-plugin=${analysis} -passes=cuda-analysis \
+        -cuda-analysis-metadata=${meta} || return
+    bench verify VerifierPass $1.device $2 -passes=verify
+    bench dynamic-host-transform DynamicHostTransformPass $1 $3 -load ${dynamic} \
+        -load-pass-plugin=${dynamic} \
+        "-passes=function(loop(loop-rotate)),dynamic-host-transform" \
+        -penguin-policy=dynamic -cuda-analysis-metadata=${meta}
+    bench cuda-host-transform CudaHostTransformPass $1 $3 \
+        -load-pass-plugin=${static} -passes=cuda-host-transform
+    bench verify VerifierPass $1.host $3 -passes=verify
+}
+
+echo "pass,module,ir_kb,pass_s,passes_s,parse_s,opt_s,peak_kb" > passbench.csv
+
+for device in ${build}/*/analysis.loopsim.ll; do
+    dir=$(dirname ${device})
+    if [ -f ${dir}/program.host.ll ]; then
+        bench_module $(basename ${dir}) ${device} ${dir}/program.host.ll
+    fi
+done
+
+# the host side embeds no device code, it is never run
+echo "passbench" > corpus/placeholder.fatbin
+for config in ${synthetic}; do
+    IFS=: read kernels loops arrays <<< ${config}
+    name=synthetic-${kernels}x${loops}x${arrays}
+    bash ${here}/synthetic.sh ${kernels} ${loops} ${arrays} > corpus/${name}.cu
+    if ! ${SUV_CLANGXX} -O1 --cuda-device-only ${cuda_flags} -S -emit-llvm \
+            corpus/${name}.cu -o corpus/${name}.analysis.ll ||
+       ! ${SUV_OPT} --loop-simplify -S corpus/${name}.analysis.ll \
+            -o corpus/${name}.loopsim.ll ||
+       ! ${SUV_CLANG} -Xclang -fcuda-include-gpubinary \
+            -Xclang corpus/placeholder.fatbin --cuda-host-only -O3 ${cuda_flags} \
+            -S -emit-llvm corpus/${name}.cu -o corpus/${name}.host.ll; then
+        echo "compiling ${name} failed"
+        continue
+    fi
+    bench_module ${name} corpus/${name}.loopsim.ll corpus/${name}.host.ll
+done
+
+column -s, -t passbench.csv
@@ -0,0 +1,50 @@
+// Runs a command and records what it cost, for passbench.sh:
+//
+//   rusage.out <report> <command> [args...]
+//
+// <report> gets one line, the wall time in s and the peak resident set of the
+// command in kB, from wait4. The exit status is the command's.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <report> <command> [args...]\n", argv[0]);
+        return 2;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if(pid == 0) {
+        execvp(argv[2], &argv[2]);
+        fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if(wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return 2;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    FILE* report = fopen(argv[1], "w");
+    if(report == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    // ru_maxrss is in kB on Linux
+    fprintf(report, "%.4f %ld\n", seconds, usage.ru_maxrss);
+    fclose(report);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
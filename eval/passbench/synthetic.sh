@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Writes a synthetic CUDA program of many large kernels to stdout, a module
+# to time the SUV passes on rather than a workload to run:
+#
+#   bash eval/passbench/synthetic.sh <kernels> <loops> <arrays> > synthetic.cu
+#
+# There are <arrays> managed float arrays and an index array. Kernel k reads
+# arrays k and k + 1 and writes array k + 2 (mod <arrays>) in <loops> loops
+# of its own, each with an affine and a strided access, then one indirect
+# access through the index array. main launches every kernel twice in a host
+# loop, so the host transforms see <arrays> allocations and 2 * <kernels>
+# launches with their loops.
+
+if [ $# -ne 3 ]; then
+    echo "usage: bash eval/passbench/synthetic.sh <kernels> <loops> <arrays>"
+    exit 1
+fi
+kernels=$1
+loops=$2
+arrays=$3
+
+cat << EOF
+/* Generated by eval/passbench/synthetic.sh ${kernels} ${loops} ${arrays} */
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include "penguin.h"
+
+#define THREADS_PER_BLOCK 256
+EOF
+
+for ((k=0; k<kernels; ++k)); do
+    echo
+    echo "__global__ void synthetic_kernel${k}(const float* a, const float* b, float* c,"
+    echo "                                  const int* idx, unsigned long long n) {"
+    echo "  unsigned long long t = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;"
+    echo "  if(t >= n)"
+    echo "    return;"
+    echo "  float acc = 0;"
+    for ((l=0; l<loops; ++l)); do
+        echo "  for(unsigned long long i = 0; i < $((l + 2)); i++)"
+        echo "    acc += a[(t * $((l + 1)) + i) % n] * b[(t + i * $((k % 7 + l + 1)) * 1024) % n];"
+    done
+    echo "  c[t] = acc + a[idx[t] % n];"
+    echo "}"
+done
+
+echo
+echo "int main() {"
+echo "  unsigned long long n = 1ULL << 24;"
+for ((a=0; a<arrays; ++a)); do
+    echo "  float* a${a};"
+    echo "  cudaMallocManaged(&a${a}, n * sizeof(float));"
+done
+echo "  int* idx;"
+echo "  cudaMallocManaged(&idx, n * sizeof(int));"
+echo "  penguinStartStatCollection();"
+echo "  for(int it = 0; it < 2; it++) {"
+for ((k=0; k<kernels; ++k)); do
+    echo "    synthetic_kernel${k}<<<(n + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK, THREADS_PER_BLOCK>>>(a$((k % arrays)), a$(((k + 1) % arrays)), a$(((k + 2) % arrays)), idx, n);"
+done
+echo "    cudaDeviceSynchronize();"
+echo "  }"
+echo "  penguinStopStatCollection();"
+for ((a=0; a<arrays; ++a)); do
+    echo "  cudaFree(a${a});"
+done
+echo "  cudaFree(idx);"
+echo "}"
@@ -0,0 +1,311 @@
+// SUV for binaries that were not built with the SUV passes:
+//
+//   LD_PRELOAD=eval/build/preload/libpenguin.so PENGUIN_POLICY=suv <binary> [args...]
+//
+// The library holds the runtime (penguin.h) and interposes the CUDA runtime
+// calls DynamicHostTransform would otherwise instrument. In place of the
+// compile-time analysis it plans from what the runtime sees:
+//   cudaMallocManaged  registers the allocation, as addIntoAllocationMap
+//   cudaFree           gives back what it held, penguinFreeAllocation
+//   cudaLaunchKernel   records the managed allocations the pointer arguments
+//                      point into and plans the launch, perform_memory_management
+//   cudaMemcpy         a copy into managed memory after the first launch
+//                      counts as a store to it
+// The pointer parameters of a kernel come from its mangled name, which the
+// binary registers with __cudaRegisterFunction; the arguments of extern "C"
+// kernels are not looked at. Every allocation a launch passes is sampled
+// with the access counters (penguin_ac_sample_start) and then has its
+// hottest blocks pinned in its share of the budget, and what the launch that
+// followed a kernel last time passed in is prefetched while that kernel runs
+// (PENGUIN_LAUNCH_NEXT). The interposition only sees a binary that links the
+// CUDA runtime dynamically (nvcc -cudart shared).
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "penguin.h"
+
+// Parameters of a kernel
+#define PRELOAD_PARAM_VALUE 0
+#define PRELOAD_PARAM_POINTER 1       // the kernel may store through it
+#define PRELOAD_PARAM_CONST_POINTER 2 // pointer to const
+
+typedef struct
+{
+    std::string name;                  // device name, as registered
+    bool known;                        // the parameters are known
+    std::vector<unsigned char> params;
+    unsigned invocation_id;
+    unsigned aid_base;                 // aid of parameter i is aid_base + i
+    std::vector<void*> inputs;         // allocations of its last launch
+    const void* next;                  // kernel launched after it last time
+} penguin_preload_kernel;
+
+// host stub -> kernel, under the registry lock
+std::map<const void*, penguin_preload_kernel> preload_kernels;
+std::map<const void*, std::string> preload_kernel_names;
+const void* preload_previous = NULL;
+unsigned preload_invocation_ids = 1;
+unsigned preload_aids = 1;
+
+// The next definition of symbol after this library's, the CUDA runtime's
+void* penguin_preload_next(const char* symbol) {
+    void* fn = dlsym(RTLD_NEXT, symbol);
+    if(fn == NULL) {
+        fprintf(stderr, "libpenguin: %s not found, is the CUDA runtime linked statically?\n", symbol);
+        abort();
+    }
+    return fn;
+}
+
+static std::string penguin_preload_trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(' ');
+    size_t end = s.find_last_not_of(' ');
+    return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+}
+
+static bool penguin_preload_ends_with(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Strips the trailing cv and restrict qualifiers of a demangled type; true
+// if const was one of them
+static bool penguin_preload_strip(std::string& type) {
+    static const char* qualifiers[] = {" const", " volatile", " __restrict", " restrict"};
+    bool is_const = false;
+    bool stripped = true;
+    while(stripped) {
+        stripped = false;
+        for(unsigned q = 0; q < sizeof(qualifiers) / sizeof(qualifiers[0]); q++) {
+            if(penguin_preload_ends_with(type, qualifiers[q])) {
+                type = penguin_preload_trim(type.substr(0, type.size() - strlen(qualifiers[q])));
+                is_const |= q == 0;
+                stripped = true;
+            }
+        }
+    }
+    return is_const;
+}
+
+// Kind of one demangled parameter, e.g. "float const* __restrict"
+static unsigned char penguin_preload_param(std::string p) {
+    penguin_preload_strip(p);
+    if(p.empty() || p[p.size() - 1] != '*') {
+        return PRELOAD_PARAM_VALUE;
+    }
+    std::string pointee = penguin_preload_trim(p.substr(0, p.size() - 1));
+    if(penguin_preload_strip(pointee) || pointee.compare(0, 6, "const ") == 0) {
+        return PRELOAD_PARAM_CONST_POINTER;
+    }
+    return PRELOAD_PARAM_POINTER;
+}
+
+// Parameters of the kernel called name: its demangled parameter list, the
+// parenthesis the name ends with, split at its top-level commas. False if
+// the name isn't mangled.
+bool penguin_preload_params(const char* name, std::vector<unsigned char>& params) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+    if(status != 0 || demangled == NULL) {
+        free(demangled);
+        return false;
+    }
+    std::string s(demangled);
+    free(demangled);
+    size_t end = s.rfind(')');
+    if(end == std::string::npos) {
+        return false;
+    }
+    size_t begin = end;
+    int depth = 0;
+    for(size_t i = end + 1; i-- > 0; ) {
+        depth += s[i] == ')' ? 1 : s[i] == '(' ? -1 : 0;
+        if(depth == 0) {
+            begin = i;
+            break;
+        }
+    }
+    if(depth != 0) {
+        return false;
+    }
+    params.clear();
+    std::string list = s.substr(begin + 1, end - begin - 1);
+    if(penguin_preload_trim(list).empty()) {
+        return true;
+    }
+    size_t start = 0;
+    depth = 0;
+    for(size_t i = 0; i <= list.size(); i++) {
+        if(i == list.size() || (list[i] == ',' && depth == 0)) {
+            params.push_back(penguin_preload_param(penguin_preload_trim(list.substr(start, i - start))));
+            start = i + 1;
+        } else if(list[i] == '(' || list[i] == '<' || list[i] == '[') {
+            depth++;
+        } else if(list[i] == ')' || list[i] == '>' || list[i] == ']') {
+            depth--;
+        }
+    }
+    return true;
+}
+
+penguin_preload_kernel& penguin_preload_kernel_of(const void* func) {
+    auto k = preload_kernels.find(func);
+    if(k != preload_kernels.end()) {
+        return k->second;
+    }
+    penguin_preload_kernel kernel;
+    auto name = preload_kernel_names.find(func);
+    Dl_info info;
+    if(name != preload_kernel_names.end()) {
+        kernel.name = name->second;
+    } else if(dladdr(func, &info) != 0 && info.dli_sname != NULL) {
+        // the host stub has the kernel's name where the binary exports it
+        kernel.name = info.dli_sname;
+    }
+    kernel.known = !kernel.name.empty() && penguin_preload_params(kernel.name.c_str(), kernel.params);
+    kernel.invocation_id = preload_invocation_ids++;
+    kernel.aid_base = preload_aids;
+    preload_aids += kernel.params.size();
+    kernel.next = NULL;
+    /* std::cout << "kernel " << kernel.name << " " << kernel.params.size() << " params\n"; */
+    return preload_kernels.insert(std::make_pair(func, kernel)).first->second;
+}
+
+// Base of the managed allocation ptr points into, NULL if none
+void* penguin_preload_allocation(void* ptr) {
+    auto id = lookup_allocation_id(ptr);
+    if(id != PENGUIN_INVALID_ALLOC_ID && allocation_table[id].size != 0) {
+        return allocation_table[id].base;
+    }
+    return identify_memory_allocation(ptr);
+}
+
+// What DynamicHostTransform inserts before a launch, from the arguments
+void penguin_preload_plan(const void* func, dim3 grid, dim3 block, void** args,
+        size_t shmem, cudaStream_t stream) {
+    penguin_preload_kernel& kernel = penguin_preload_kernel_of(func);
+    add_invocation_id(kernel.invocation_id);
+    penguinSetLaunchStream(stream);
+    penguinRecordLaunchShape(func, grid.x | ((unsigned long long) grid.y << 32), grid.z,
+            block.x | ((unsigned long long) block.y << 32), block.z, shmem);
+
+    std::vector<penguin_launch_record> records;
+    std::vector<penguin_launch_values> values;
+    std::vector<void*> inputs;
+    for(size_t i = 0; kernel.known && args != NULL && i < kernel.params.size(); i++) {
+        if(kernel.params[i] == PRELOAD_PARAM_VALUE) {
+            continue;
+        }
+        void* allocation = penguin_preload_allocation(*(void**) args[i]);
+        if(allocation == NULL) {
+            continue;
+        }
+        unsigned flags = PENGUIN_LAUNCH_INCOMP;
+        if(kernel.params[i] == PRELOAD_PARAM_POINTER) {
+            flags |= PENGUIN_LAUNCH_STORE;
+        }
+        records.push_back(penguin_launch_record{kernel.aid_base + (unsigned) i, flags, (unsigned) i});
+        penguin_launch_values v = {};
+        v.allocation = allocation;
+        values.push_back(v);
+        inputs.push_back(allocation);
+    }
+    // the inputs of the launch that followed this kernel last time
+    if(kernel.next != NULL) {
+        const std::vector<void*>& next_inputs = preload_kernels[kernel.next].inputs;
+        for(auto a = next_inputs.begin(); a != next_inputs.end(); a++) {
+            if(std::find(inputs.begin(), inputs.end(), *a) != inputs.end() ||
+                    penguin_preload_allocation(*a) != *a) {
+                continue;
+            }
+            records.push_back(penguin_launch_record{0, PENGUIN_LAUNCH_NEXT, PENGUIN_LAUNCH_NO_ARG});
+            penguin_launch_values v = {};
+            v.allocation = *a;
+            values.push_back(v);
+        }
+    }
+    if(preload_previous != NULL) {
+        preload_kernels[preload_previous].next = func;
+    }
+    preload_previous = func;
+    kernel.inputs = inputs;
+
+    penguin_launch_desc desc = {kernel.invocation_id, (unsigned) records.size(), records.data(), NULL,
+        kernel.name.c_str()};
+    penguinRecordLaunch(&desc, values.data());
+    perform_memory_management(gpu_memory, kernel.invocation_id);
+}
+
+extern "C" {
+
+void __cudaRegisterFunction(void** fatCubinHandle, const char* hostFun, char* deviceFun,
+        const char* deviceName, int thread_limit, uint3* tid, uint3* bid, dim3* bDim,
+        dim3* gDim, int* wSize) {
+    typedef void (*register_fn)(void**, const char*, char*, const char*, int, uint3*,
+            uint3*, dim3*, dim3*, int*);
+    static register_fn real = (register_fn) penguin_preload_next("__cudaRegisterFunction");
+    {
+        penguin_registry_scope registry;
+        preload_kernel_names[hostFun] = deviceName;
+    }
+    real(fatCubinHandle, hostFun, deviceFun, deviceName, thread_limit, tid, bid, bDim, gDim, wSize);
+}
+
+cudaError_t cudaMallocManaged(void** devPtr, size_t size, unsigned int flags) {
+    typedef cudaError_t (*malloc_fn)(void**, size_t, unsigned int);
+    static malloc_fn real = (malloc_fn) penguin_preload_next("cudaMallocManaged");
+    cudaError_t status = real(devPtr, size, flags);
+    if(status == cudaSuccess) {
+        // the program's call is the allocation's site, not this one
+        penguin_add_allocation(devPtr, size, __builtin_return_address(0));
+    }
+    return status;
+}
+
+cudaError_t cudaFree(void* devPtr) {
+    typedef cudaError_t (*free_fn)(void*);
+    static free_fn real = (free_fn) penguin_preload_next("cudaFree");
+    if(devPtr != NULL) {
+        penguinFreeAllocation(devPtr);
+    }
+    return real(devPtr);
+}
+
+cudaError_t cudaLaunchKernel(const void* func, dim3 gridDim, dim3 blockDim, void** args,
+        size_t sharedMem, cudaStream_t stream) {
+    typedef cudaError_t (*launch_fn)(const void*, dim3, dim3, void**, size_t, cudaStream_t);
+    static launch_fn real = (launch_fn) penguin_preload_next("cudaLaunchKernel");
+    if(penguin_planning()) {
+        penguin_registry_scope registry;
+        penguin_policy_batch_scope batch;
+        penguin_preload_plan(func, gridDim, blockDim, args, sharedMem, stream);
+    }
+    penguinKernelBegin(func, stream);
+    cudaError_t status = real(func, gridDim, blockDim, args, sharedMem, stream);
+    penguinKernelEnd();
+    return status;
+}
+
+cudaError_t cudaMemcpy(void* dst, const void* src, size_t count, cudaMemcpyKind kind) {
+    typedef cudaError_t (*memcpy_fn)(void*, const void*, size_t, cudaMemcpyKind);
+    static memcpy_fn real = (memcpy_fn) penguin_preload_next("cudaMemcpy");
+    if(penguin_planning() && (kind == cudaMemcpyHostToDevice || kind == cudaMemcpyDefault)) {
+        penguin_registry_scope registry;
+        // copies before the first launch only initialize it
+        void* allocation = preload_previous != NULL ? penguin_preload_allocation(dst) : NULL;
+        if(allocation != NULL) {
+            penguin_note_access(allocation, true, penguin_launch_device());
+        }
+    }
+    return real(dst, src, count, kind);
+}
+
+}
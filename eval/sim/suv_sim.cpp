@@ -0,0 +1,620 @@
+// Offline policy simulator. Replays a trace the runtime recorded with
+// PENGUIN_SIM_TRACE (see penguin.h) against placement and eviction policies,
+// with the PCIe cost model of the planner:
+//
+//   suv_sim.out [-c MiB] [-b GB/s] [-l us] [-f us] [-p policy,...] <trace>
+//
+// -c is the GPU memory, the budget the runtime planned with by default; -b,
+// -l and -f the link bandwidth, the latency of a transfer and what servicing
+// the faults of a block adds to it (PENGUIN_PCIE_LATENCY_US and
+// PENGUIN_MIGRATION_FAULT_US). Every launch accesses the blocks the trace
+// lists for it, in order; a block that isn't resident faults in, evicting
+// one first when the GPU is full, and a dirty victim is copied back. The
+// policies:
+//   uvm     LRU eviction, everything migrated on demand
+//   clock   CLOCK (second chance) eviction, everything migrated on demand
+//   belady  evicts the block used furthest in the future, an upper bound
+//           for any eviction policy under demand migration
+//   suv     the decisions and the prefetches the runtime made: host pinned
+//           and access counter allocations are accessed over the link, GPU
+//           pinned ones are never evicted, and the recorded prefetches and
+//           evictions run before each launch; LRU for the rest
+// A policy is a Policy subclass and a line in policies. The faults and bytes
+// the driver counted in the recorded run come first, for comparison with
+// the policy it ran.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// penguin_sim_header, penguin_sim_entry and penguin_sim_type of penguin.h
+#define SIM_MAGIC 0x3143525456555355ULL
+
+enum {
+    SIM_ALLOC,
+    SIM_DECISION,
+    SIM_ACCESS,
+    SIM_STORE,
+    SIM_LAUNCH,
+    SIM_H2D,
+    SIM_D2H,
+    SIM_FREE,
+    SIM_FAULTS,
+    SIM_MIGRATED,
+};
+
+// Decision of penguin.h
+enum {
+    DEC_HOST_PIN = 1,
+    DEC_GPU_PIN = 2,
+    DEC_ACCESS_COUNTER = 7,
+};
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t block;
+    uint64_t budget;
+    uint64_t records;
+} sim_header;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t id;
+    uint64_t a;
+    uint64_t b;
+} sim_entry;
+
+// Blocks are numbered across the allocations of the trace, in the order
+// they were registered
+struct Allocation {
+    uint64_t base;
+    uint64_t size;
+    uint64_t first;  // first block
+    uint64_t blocks;
+    unsigned decision;
+};
+
+struct Access {
+    uint64_t block;
+    bool store;
+};
+
+struct Launch {
+    std::vector<uint64_t> freed;    // blocks of the allocations freed before it
+    std::vector<uint64_t> h2d;      // blocks the runtime prefetched before it
+    std::vector<uint64_t> d2h;      // blocks the runtime evicted before it
+    std::vector<Access> accesses;
+};
+
+struct Trace {
+    uint64_t block_size = 0;
+    uint64_t budget = 0;
+    uint64_t blocks = 0;
+    std::vector<Allocation> allocations;
+    std::vector<unsigned> owner;           // block -> allocation
+    std::vector<Launch> launches;
+    std::vector<std::vector<uint32_t>> uses; // block -> launches accessing it
+    uint64_t faults = 0, evictions = 0, bytes_h2d = 0, bytes_d2h = 0;
+};
+
+// Blocks of [address, address + length) of the live allocations
+static void blocks_of(const Trace& t, const std::map<uint64_t, unsigned>& live, uint64_t address,
+        uint64_t length, std::vector<uint64_t>& out) {
+    auto a = live.upper_bound(address);
+    if(a == live.begin()) {
+        return;
+    }
+    --a;
+    const Allocation& alloc = t.allocations[a->second];
+    if(address >= alloc.base + alloc.size || length == 0) {
+        return;
+    }
+    uint64_t lo = (address - alloc.base) / t.block_size;
+    uint64_t hi = std::min(address - alloc.base + length, alloc.size);
+    for(uint64_t b = lo; b < (hi + t.block_size - 1) / t.block_size; b++) {
+        out.push_back(alloc.first + b);
+    }
+}
+
+static bool load(const char* path, Trace& t) {
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    sim_header header;
+    if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != SIM_MAGIC || header.block == 0) {
+        fprintf(stderr, "%s: not a PENGUIN_SIM_TRACE file\n", path);
+        fclose(f);
+        return false;
+    }
+    std::vector<sim_entry> entries(header.records);
+    size_t read = fread(entries.data(), sizeof(sim_entry), entries.size(), f);
+    fclose(f);
+    if(read != entries.size()) {
+        fprintf(stderr, "%s: truncated after %zu of %zu records\n", path, read, entries.size());
+        entries.resize(read);
+    }
+    t.block_size = header.block;
+    t.budget = header.budget;
+    // allocation ID of the runtime -> allocation of the trace, while live
+    std::map<unsigned, unsigned> ids;
+    std::map<uint64_t, unsigned> live;
+    Launch next;
+    for(auto &e : entries) {
+        switch(e.type) {
+            case SIM_ALLOC: {
+                Allocation alloc = {e.a, e.b, t.blocks, (e.b + t.block_size - 1) / t.block_size, 0};
+                ids[e.id] = t.allocations.size();
+                live[alloc.base] = t.allocations.size();
+                t.owner.insert(t.owner.end(), alloc.blocks, t.allocations.size());
+                t.blocks += alloc.blocks;
+                t.allocations.push_back(alloc);
+                break;
+            }
+            case SIM_DECISION: {
+                auto id = ids.find(e.id);
+                if(id != ids.end()) {
+                    t.allocations[id->second].decision = e.a;
+                }
+                break;
+            }
+            case SIM_ACCESS:
+            case SIM_STORE: {
+                auto id = ids.find(e.id);
+                if(id == ids.end()) {
+                    break;
+                }
+                const Allocation& alloc = t.allocations[id->second];
+                for(uint64_t b = e.a; b < e.a + e.b && b < alloc.blocks; b++) {
+                    next.accesses.push_back(Access{alloc.first + b, e.type == SIM_STORE});
+                }
+                break;
+            }
+            case SIM_LAUNCH:
+                t.launches.push_back(std::move(next));
+                next = Launch();
+                break;
+            case SIM_H2D:
+                blocks_of(t, live, e.a, e.b, next.h2d);
+                break;
+            case SIM_D2H:
+                blocks_of(t, live, e.a, e.b, next.d2h);
+                break;
+            case SIM_FREE: {
+                auto a = live.find(e.a);
+                if(a == live.end()) {
+                    break;
+                }
+                const Allocation& alloc = t.allocations[a->second];
+                for(uint64_t b = 0; b < alloc.blocks; b++) {
+                    next.freed.push_back(alloc.first + b);
+                }
+                for(auto id = ids.begin(); id != ids.end(); id++) {
+                    if(id->second == a->second) {
+                        ids.erase(id);
+                        break;
+                    }
+                }
+                live.erase(a);
+                break;
+            }
+            case SIM_FAULTS:
+                t.faults += e.a;
+                t.evictions += e.b;
+                break;
+            case SIM_MIGRATED:
+                t.bytes_h2d += e.a;
+                t.bytes_d2h += e.b;
+                break;
+            default:
+                break;
+        }
+    }
+    t.uses.resize(t.blocks);
+    for(size_t l = 0; l < t.launches.size(); l++) {
+        for(auto &a : t.launches[l].accesses) {
+            auto &uses = t.uses[a.block];
+            if(uses.empty() || uses.back() != l) {
+                uses.push_back(l);
+            }
+        }
+    }
+    return true;
+}
+
+struct Cost {
+    double bandwidth_gbs = 12.0;
+    double latency_us = 1.0;
+    double fault_us = 20.0;
+
+    double transfer_us(uint64_t bytes) const {
+        return latency_us + bytes / (bandwidth_gbs * 1e3);
+    }
+};
+
+struct Result {
+    uint64_t faults = 0, prefetches = 0, evictions = 0, writebacks = 0;
+    uint64_t bytes_h2d = 0, bytes_d2h = 0, bytes_remote = 0;
+    double us = 0;
+};
+
+class Sim;
+
+// Chooses what is resident. The simulator calls inserted and removed as
+// blocks come and go and touched on every access to a resident block, and
+// victim when it needs room; the victim must be resident and not pinned.
+class Policy {
+public:
+    virtual ~Policy() {}
+    virtual void reset(const Trace& t) {}
+    // before the accesses of launch l
+    virtual void plan(Sim& sim, size_t l) {}
+    virtual void inserted(uint64_t block) {}
+    virtual void removed(uint64_t block) {}
+    virtual void touched(uint64_t block) {}
+    virtual uint64_t victim(const Sim& sim, size_t l) = 0;
+    // accessed over the link where it is rather than migrated
+    virtual bool remote(uint64_t block) const { return false; }
+    // never evicted
+    virtual bool pinned(uint64_t block) const { return false; }
+};
+
+class Sim {
+public:
+    Sim(const Trace& t, const Cost& cost, uint64_t capacity, Policy& policy)
+        : t(t), cost(cost), capacity(capacity), policy(policy),
+          resident(t.blocks, false), dirty(t.blocks, false), current(t.blocks, 0) {
+        policy.reset(t);
+    }
+
+    const Trace& t;
+    const Cost& cost;
+    uint64_t capacity; // blocks
+    Policy& policy;
+    std::vector<bool> resident;
+    std::vector<bool> dirty;
+    std::vector<uint32_t> current; // block -> last launch accessing it, + 1
+    uint64_t used = 0;
+    Result result;
+
+    void evict(uint64_t block) {
+        if(!resident[block]) {
+            return;
+        }
+        if(dirty[block]) {
+            result.writebacks++;
+            result.bytes_d2h += t.block_size;
+            result.us += cost.transfer_us(t.block_size);
+        }
+        resident[block] = false;
+        dirty[block] = false;
+        used--;
+        policy.removed(block);
+    }
+
+    // Makes room for one block; false if only pinned blocks are left
+    bool make_room(size_t l) {
+        while(used >= capacity) {
+            uint64_t block = policy.victim(*this, l);
+            if(block >= t.blocks || !resident[block]) {
+                return false;
+            }
+            result.evictions++;
+            evict(block);
+        }
+        return true;
+    }
+
+    void migrate(uint64_t block, size_t l, bool fault) {
+        if(resident[block] || !make_room(l)) {
+            return;
+        }
+        if(fault) {
+            result.faults++;
+            result.us += cost.fault_us;
+        } else {
+            result.prefetches++;
+        }
+        result.bytes_h2d += t.block_size;
+        result.us += cost.transfer_us(t.block_size);
+        resident[block] = true;
+        used++;
+        policy.inserted(block);
+    }
+
+    void free(uint64_t block) {
+        if(resident[block]) {
+            resident[block] = false;
+            dirty[block] = false;
+            used--;
+            policy.removed(block);
+        }
+    }
+
+    void run() {
+        for(size_t l = 0; l < t.launches.size(); l++) {
+            const Launch& launch = t.launches[l];
+            for(auto b : launch.freed) {
+                free(b);
+            }
+            for(auto &a : launch.accesses) {
+                current[a.block] = l + 1;
+            }
+            policy.plan(*this, l);
+            for(auto &a : launch.accesses) {
+                if(policy.remote(a.block)) {
+                    result.bytes_remote += t.block_size;
+                    result.us += cost.transfer_us(t.block_size);
+                    continue;
+                }
+                if(resident[a.block]) {
+                    policy.touched(a.block);
+                } else {
+                    migrate(a.block, l, true);
+                }
+                // a block that found no room was accessed over the link
+                if(!resident[a.block]) {
+                    result.bytes_remote += t.block_size;
+                    result.us += cost.transfer_us(t.block_size);
+                    continue;
+                }
+                if(a.store) {
+                    dirty[a.block] = true;
+                }
+            }
+        }
+    }
+
+    // Blocks the launch being run accesses are evicted last
+    bool needed(uint64_t block, size_t l) const {
+        return current[block] == l + 1;
+    }
+};
+
+class LruPolicy : public Policy {
+public:
+    void reset(const Trace& t) override {
+        order.clear();
+        where.assign(t.blocks, order.end());
+    }
+    void inserted(uint64_t block) override {
+        where[block] = order.insert(order.end(), block);
+    }
+    void removed(uint64_t block) override {
+        order.erase(where[block]);
+        where[block] = order.end();
+    }
+    void touched(uint64_t block) override {
+        order.splice(order.end(), order, where[block]);
+    }
+    uint64_t victim(const Sim& sim, size_t l) override {
+        uint64_t fallback = UINT64_MAX;
+        for(auto b : order) {
+            if(pinned(b)) {
+                continue;
+            }
+            if(!sim.needed(b, l)) {
+                return b;
+            }
+            if(fallback == UINT64_MAX) {
+                fallback = b;
+            }
+        }
+        return fallback;
+    }
+
+protected:
+    std::list<uint64_t> order; // least recently used first
+    std::vector<std::list<uint64_t>::iterator> where;
+};
+
+class ClockPolicy : public Policy {
+public:
+    void reset(const Trace& t) override {
+        ring.clear();
+        slot.assign(t.blocks, UINT64_MAX);
+        referenced.assign(t.blocks, false);
+        hand = 0;
+    }
+    void inserted(uint64_t block) override {
+        slot[block] = ring.size();
+        ring.push_back(block);
+        referenced[block] = true;
+    }
+    void removed(uint64_t block) override {
+        // the last block of the ring takes the slot
+        uint64_t s = slot[block];
+        ring[s] = ring.back();
+        slot[ring[s]] = s;
+        ring.pop_back();
+        slot[block] = UINT64_MAX;
+        if(hand >= ring.size()) {
+            hand = 0;
+        }
+    }
+    void touched(uint64_t block) override {
+        referenced[block] = true;
+    }
+    uint64_t victim(const Sim& sim, size_t l) override {
+        // two sweeps clear every reference bit; a third takes what the
+        // launch needs too
+        for(size_t step = 0; step < 3 * ring.size(); step++) {
+            uint64_t b = ring[hand];
+            hand = (hand + 1) % ring.size();
+            if(referenced[b]) {
+                referenced[b] = false;
+                continue;
+            }
+            if(!sim.needed(b, l) || step >= 2 * ring.size()) {
+                return b;
+            }
+        }
+        return ring.empty() ? UINT64_MAX : ring[hand];
+    }
+
+private:
+    std::vector<uint64_t> ring;
+    std::vector<uint64_t> slot;
+    std::vector<bool> referenced;
+    size_t hand = 0;
+};
+
+class BeladyPolicy : public Policy {
+public:
+    void reset(const Trace& t) override {
+        trace = &t;
+        resident.clear();
+    }
+    void inserted(uint64_t block) override {
+        resident.push_back(block);
+    }
+    void removed(uint64_t block) override {
+        auto r = std::find(resident.begin(), resident.end(), block);
+        *r = resident.back();
+        resident.pop_back();
+    }
+    uint64_t victim(const Sim& sim, size_t l) override {
+        uint64_t best = UINT64_MAX;
+        uint64_t best_use = 0;
+        for(auto b : resident) {
+            // launches before and at l are done or being run
+            auto &uses = trace->uses[b];
+            auto next = std::upper_bound(uses.begin(), uses.end(), (uint32_t) l);
+            uint64_t use = next == uses.end() ? UINT64_MAX : *next;
+            if(sim.needed(b, l)) {
+                use = l;
+            }
+            if(best == UINT64_MAX || use > best_use) {
+                best = b;
+                best_use = use;
+            }
+        }
+        return best;
+    }
+
+private:
+    const Trace* trace = NULL;
+    std::vector<uint64_t> resident;
+};
+
+class SuvPolicy : public LruPolicy {
+public:
+    void reset(const Trace& t) override {
+        LruPolicy::reset(t);
+        trace = &t;
+    }
+    void plan(Sim& sim, size_t l) override {
+        const Launch& launch = trace->launches[l];
+        for(auto b : launch.d2h) {
+            sim.evict(b);
+        }
+        for(auto b : launch.h2d) {
+            if(!remote(b)) {
+                sim.migrate(b, l, false);
+            }
+        }
+    }
+    bool remote(uint64_t block) const override {
+        unsigned decision = trace->allocations[trace->owner[block]].decision;
+        return decision == DEC_HOST_PIN || decision == DEC_ACCESS_COUNTER;
+    }
+    bool pinned(uint64_t block) const override {
+        return trace->allocations[trace->owner[block]].decision == DEC_GPU_PIN;
+    }
+
+private:
+    const Trace* trace = NULL;
+};
+
+static const struct {
+    const char* name;
+    Policy* (*make)();
+} policies[] = {
+    {"uvm", []() -> Policy* { return new LruPolicy(); }},
+    {"clock", []() -> Policy* { return new ClockPolicy(); }},
+    {"belady", []() -> Policy* { return new BeladyPolicy(); }},
+    {"suv", []() -> Policy* { return new SuvPolicy(); }},
+};
+
+static void usage(const char* self) {
+    fprintf(stderr, "usage: %s [-c MiB] [-b GB/s] [-l us] [-f us] [-p policy,...] <trace>\n", self);
+    fprintf(stderr, "policies:");
+    for(auto &p : policies) {
+        fprintf(stderr, " %s", p.name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[]) {
+    Cost cost;
+    uint64_t capacity_mib = 0;
+    std::string selected;
+    int opt;
+    while((opt = getopt(argc, argv, "c:b:l:f:p:h")) != -1) {
+        switch(opt) {
+            case 'c':
+                capacity_mib = strtoull(optarg, NULL, 10);
+                break;
+            case 'b':
+                cost.bandwidth_gbs = atof(optarg);
+                break;
+            case 'l':
+                cost.latency_us = atof(optarg);
+                break;
+            case 'f':
+                cost.fault_us = atof(optarg);
+                break;
+            case 'p':
+                selected = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - 1 || cost.bandwidth_gbs <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    Trace t;
+    if(!load(argv[optind], t)) {
+        return 1;
+    }
+    uint64_t capacity = capacity_mib ? capacity_mib * 1024ULL * 1024ULL : t.budget;
+    uint64_t blocks = std::max<uint64_t>(capacity / t.block_size, 1);
+    printf("%zu allocations, %llu blocks of %llu KiB, %zu launches, %llu MiB of GPU memory\n",
+            t.allocations.size(), (unsigned long long) t.blocks, (unsigned long long) t.block_size >> 10,
+            t.launches.size(), (unsigned long long) (blocks * t.block_size) >> 20);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %12s\n", "policy", "faults", "prefetch",
+            "evictions", "h2d_mib", "d2h_mib", "remote_mib", "transfer_ms");
+    printf("%-8s %10llu %10s %10llu %10llu %10llu %10s %12s\n", "recorded",
+            (unsigned long long) t.faults, "-", (unsigned long long) t.evictions,
+            (unsigned long long) t.bytes_h2d >> 20, (unsigned long long) t.bytes_d2h >> 20, "-", "-");
+    for(auto &p : policies) {
+        if(!selected.empty() && ("," + selected + ",").find(std::string(",") + p.name + ",") == std::string::npos) {
+            continue;
+        }
+        std::unique_ptr<Policy> policy(p.make());
+        Sim sim(t, cost, blocks, *policy);
+        sim.run();
+        const Result& r = sim.result;
+        printf("%-8s %10llu %10llu %10llu %10llu %10llu %10llu %12.3f\n", p.name,
+                (unsigned long long) r.faults, (unsigned long long) r.prefetches,
+                (unsigned long long) r.evictions, (unsigned long long) r.bytes_h2d >> 20,
+                (unsigned long long) r.bytes_d2h >> 20, (unsigned long long) r.bytes_remote >> 20,
+                r.us / 1e3);
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/* Worklist Bellman-Ford single-source shortest paths over a binary CSR graph
+ * of bfs/inputGen/graphgen, the worklist variant of fw/johnson.cu's
+ * (JOHNSON_BF=worklist) on a graph larger than the GPU.
+ *
+ *   sssp.out [graph.csr]
+ *
+ * Every round launches one thread per vertex whose distance dropped in the
+ * round before, which relaxes its out-edges; the rounds stop when no
+ * distance drops. Only the adjacency lists of the worklist are read, so the
+ * working set grows over the first rounds and then shrinks to a few lists,
+ * and which lists depends on the distances. The weights are a hash of the
+ * edge, 1 to 100. The graph is graph.csr of the working directory unless
+ * given, loaded as csr_graph.h's CSR_LOAD says before the measured run. */
+
+#include <chrono> // high_resolution_clock
+#include <iostream> // cout
+#include <climits>
+#include <cstdio> // printf
+#include <cstdlib>
+#include <cstring>
+#include <ratio>  // milli
+#include <utility> // swap
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include "../bfs/csr_graph.h"
+#include "penguin.h"
+
+#define THREADS_PER_BLOCK 256
+
+#define MiB 22060
+#define RESERVATION (penguin_reservation_bytes(MiB)) // MiB unless PENGUIN_OVERSUB is set
+
+__device__ __forceinline__
+unsigned sssp_weight(unsigned long long e) {
+  // splitmix64 finalizer
+  e += 0x9e3779b97f4a7c15ULL;
+  e = (e ^ (e >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  e = (e ^ (e >> 27)) * 0x94d049bb133111ebULL;
+  return 1 + (e ^ (e >> 31)) % 100;
+}
+
+// A vertex whose distance drops goes on the next worklist once, which
+// in_next guards; a vertex clears its flag before it reads its distance, so
+// a drop after the read puts it back on
+__global__ void relax_kernel(const unsigned long long* offsets,
+                             const unsigned int* edges, unsigned int* dist,
+                             const unsigned int* worklist, unsigned count,
+                             unsigned int* next, unsigned int* next_count,
+                             unsigned int* in_next) {
+  unsigned i = blockIdx.x * blockDim.x + threadIdx.x;
+  if(i >= count)
+    return;
+  unsigned u = worklist[i];
+  atomicExch(&in_next[u], 0);
+  unsigned dist_u = atomicMin(&dist[u], UINT_MAX); // the current distance
+  unsigned long long end = offsets[u + 1];
+  for(unsigned long long e = offsets[u]; e < end; e++) {
+    unsigned v = edges[e];
+    unsigned new_dist = dist_u + sssp_weight(e);
+    if(new_dist < atomicMin(&dist[v], new_dist) && atomicExch(&in_next[v], 1) == 0)
+      next[atomicAdd(next_count, 1)] = v;
+  }
+}
+
+static unsigned blocks_for(unsigned long long threads) {
+  return (threads + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc > 2) {
+    std::cerr << "usage: " << argv[0] << " [graph.csr]\n";
+    return 1;
+  }
+  int* reservation;
+  cudaMalloc((void**) &reservation, RESERVATION);
+
+  csr_graph graph;
+  if(csr_graph_load(argc > 1 ? argv[1] : "graph.csr", csr_graph_mode(), &graph) != 0)
+    return 1;
+  unsigned long long n = graph.header.num_nodes;
+  unsigned long long* offsets = graph.offsets;
+  unsigned int* edges = graph.edges;
+
+  unsigned int* dist;
+  unsigned int* worklist;
+  unsigned int* next;
+  unsigned int* next_count;
+  unsigned int* in_next;
+  cudaMallocManaged(&dist, n * sizeof(unsigned int));
+  cudaMallocManaged(&worklist, n * sizeof(unsigned int));
+  cudaMallocManaged(&next, n * sizeof(unsigned int));
+  cudaMallocManaged(&next_count, sizeof(unsigned int));
+  cudaMallocManaged(&in_next, n * sizeof(unsigned int));
+  memset(dist, 0xff, n * sizeof(unsigned int));
+  memset(in_next, 0, n * sizeof(unsigned int));
+  unsigned source = graph.header.source;
+  dist[source] = 0;
+  worklist[0] = source;
+
+  nvml_start();
+  penguinStartStatCollection();
+  std::cout << "SSSP of " << n << " nodes and " << graph.header.num_edges
+    << " edges from node " << source << "\n";
+  auto start = std::chrono::high_resolution_clock::now();
+  unsigned count = 1;
+  int rounds = 0;
+  unsigned long long relaxed = 0;
+  while(count > 0) {
+    *next_count = 0;
+    relax_kernel<<<blocks_for(count), THREADS_PER_BLOCK>>>(offsets, edges, dist, worklist, count, next, next_count, in_next);
+    cudaDeviceSynchronize();
+    relaxed += count;
+    count = *next_count;
+    std::swap(worklist, next);
+    rounds++;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> start_to_end = end - start;
+  std::cout << "GPU.Parser.Time: " << start_to_end.count() << "\n\n";
+  nvml_stop();
+  penguinStopStatCollection();
+
+  unsigned long long reached = 0;
+  for(unsigned long long v = 0; v < n; v++)
+    reached += dist[v] != UINT_MAX;
+  std::cout << "Reached " << reached << " nodes in " << rounds << " rounds over "
+    << relaxed << " vertices\n";
+
+  cudaFree(dist);
+  cudaFree(worklist);
+  cudaFree(next);
+  cudaFree(next_count);
+  cudaFree(in_next);
+  csr_graph_free(&graph);
+  cudaFree(reservation);
+}
@@ -0,0 +1,56 @@
+// Holds GPU memory while a workload runs, so the oversubscription of a sweep
+// is set by the harness rather than by a cudaMalloc in the workload:
+//
+//   reserve.out <MiB> <binary> [args...]
+//
+// The reservation is made before the workload starts and freed when it exits.
+// PENGUIN_RESERVED_MB tells penguin_reservation_bytes (penguin-oversub.h) that
+// the workload must not reserve again; PENGUIN_OVERSUB still sets the budget
+// the runtime plans with. The exit status is the workload's.
+
+#include <cuda_runtime.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <MiB> <binary> [args...]\n", argv[0]);
+        return 2;
+    }
+    unsigned long long mib = strtoull(argv[1], NULL, 10);
+    void* reservation = NULL;
+    if(mib > 0) {
+        cudaError_t err = cudaMalloc(&reservation, mib * 1024ULL * 1024ULL);
+        if(err != cudaSuccess) {
+            fprintf(stderr, "reserving %llu MiB: %s\n", mib, cudaGetErrorString(err));
+            return 2;
+        }
+    }
+    size_t free_mem = 0, total_mem = 0;
+    cudaMemGetInfo(&free_mem, &total_mem);
+    printf("Reserved %llu MiB, %zu MiB left\n", mib, free_mem >> 20);
+    fflush(stdout);
+    setenv("PENGUIN_RESERVED_MB", argv[1], 1);
+
+    // the child execs right away, so it never touches the parent's context
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if(pid == 0) {
+        execvp(argv[2], argv + 2);
+        perror(argv[2]);
+        _exit(127);
+    }
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if(reservation != NULL) {
+        cudaFree(reservation);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,102 @@
+#!/bin/bash
+
+# Runs one workload across a range of oversubscription, from the root folder
+# of the artifact:
+#
+#   bash eval/sweep/sweep.sh <benchmark> [first last step] [args...]
+#
+# The range is in percent, 0 to 300 in steps of 10 by default. At every step
+# eval/build/sweep/reserve.out holds the GPU memory the workload must not get,
+# GPU size - footprint * 100 / (100 + oversub) MiB, and runs
+# eval/build/<benchmark>/suv.out under each of SWEEP_POLICIES ("uvm suv")
+# through eval/trials.sh, so nothing is rebuilt or patched between steps.
+# The footprint comes from the same table as run.sh, or SWEEP_FOOTPRINT_MB.
+#
+# eval/<benchmark>/sweep.csv gets oversub,policy,median,variance,slowdown per
+# step, the slowdown relative to the first step of the same policy, and the
+# cliff of each policy, the step its slowdown grows the most at, is printed.
+# With gnuplot installed the curves are plotted to sweep.png.
+
+benchmarks=("2dconv" "alexnet" "bfs" "bicg" "bptree" "doitgen" "fdtd" "fw" "gemm" "gramschmit" "hellinger-cuda" "mm" "mvt" "xsbench" "synthetic")
+
+footprints=(8192 3500 2610 4096 5120 8192 6912 4096 6912 3072 6912 5760 4096 3884 8192)
+
+GPU_SIZE=${PENGUIN_GPU_SIZE_MB:-23860}
+
+pwd0=$(pwd) # the root folder of the artifact
+benchmark=$1
+shift
+first=0
+last=300
+step=10
+if [ $# -ge 3 ]; then
+    first=$1
+    last=$2
+    step=$3
+    shift 3
+fi
+policies=(${SWEEP_POLICIES:-uvm suv})
+
+footprint=${SWEEP_FOOTPRINT_MB}
+for ((idx=0; idx<${#benchmarks[@]}; ++idx)); do
+    if [ -z "${footprint}" ] && [ "${benchmarks[idx]}" == "${benchmark}" ]; then
+        footprint=${footprints[idx]}
+    fi
+done
+if [ -z "${footprint}" ]; then
+    echo "no footprint for ${benchmark}, set SWEEP_FOOTPRINT_MB"
+    exit 1
+fi
+
+bin=${pwd0}/eval/build/${benchmark} # see compile.sh
+reserve=${pwd0}/eval/build/sweep/reserve.out
+cd ${pwd0}/eval/${benchmark}
+echo "oversub,policy,median,variance" > sweep.raw.csv
+for ((os=first; os<=last; os+=step)); do
+    available=$((footprint*100/(100+os)))
+    reservation=$((GPU_SIZE-available))
+    if [ ${reservation} -lt 0 ]; then
+        reservation=0
+    fi
+    for policy in ${policies[@]}; do
+        echo "${benchmark} ${os}%: reserve ${reservation} MiB, PENGUIN_POLICY=${policy}"
+        PENGUIN_POLICY=${policy} PENGUIN_OVERSUB=${os} \
+            bash ${pwd0}/eval/trials.sh sweep.${policy}.${os} \
+            ${reserve} ${reservation} ${bin}/suv.out "$@"
+        median=$(grep "GPU.Parser.Time" sweep.${policy}.${os}.txt | awk '{print $2}')
+        variance=$(grep "Trial variance" sweep.${policy}.${os}.txt | awk '{print $3}')
+        echo "${os},${policy},${median},${variance}" >> sweep.raw.csv
+    done
+done
+
+# slowdown against the first step of each policy, and the largest jump
+awk -F, '
+    NR == 1 { print $0 ",slowdown" > "sweep.csv"; next }
+    $3 == "" { print $0 "," > "sweep.csv"; next }
+    {
+        if(!($2 in base)) base[$2] = $3
+        slowdown = $3 / base[$2]
+        print $0 "," slowdown > "sweep.csv"
+        if(($2 in prev) && slowdown - prev[$2] > jump[$2]) {
+            jump[$2] = slowdown - prev[$2]
+            cliff[$2] = prevos[$2] "% -> " $1 "%: " prev[$2] "x -> " slowdown "x"
+        }
+        prev[$2] = slowdown
+        prevos[$2] = $1
+    }
+    END { for(p in cliff) print "cliff " p ": " cliff[p] }' sweep.raw.csv
+rm sweep.raw.csv
+
+if command -v gnuplot > /dev/null; then
+    plot=""
+    for policy in ${policies[@]}; do
+        grep ",${policy}," sweep.csv > sweep.${policy}.dat
+        plot="${plot}${plot:+, }'sweep.${policy}.dat' using 1:5 with linespoints title '${policy}'"
+    done
+    gnuplot -e "set terminal png size 800,500; set output 'sweep.png';
+                set datafile separator ','; set title '${benchmark}';
+                set xlabel 'oversubscription (%)'; set ylabel 'slowdown';
+                plot ${plot}"
+    rm sweep.*.dat
+fi
+cd ${pwd0}
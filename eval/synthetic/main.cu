@@ -0,0 +1,265 @@
+/* Synthetic oversubscription workload: a configurable footprint split over a
+ * number of managed allocations, accessed with one of a few patterns so that
+ * specific placement decisions of the runtime can be stressed.
+ *
+ *   suv.out [-p pattern] [-f footprint MiB] [-a allocations] [-k kernels]
+ *           [-i iterations] [-w write percent] [-s stride] [-c chase length]
+ *
+ * Every iteration launches the given number of kernels, kernel j accessing
+ * allocation j % allocations, one element per thread:
+ *   seq     every element in order
+ *   stride  every stride-th element
+ *   random  uniformly random elements
+ *   zipf    Zipfian ranks (exponent 1), the hot set at the front
+ *   chase   chains of chase length links through a random cycle
+ *   phases  seq, stride, zipf and random in turn, each for all the
+ *           iterations, over half of the allocations starting a quarter
+ *           further every phase
+ * A thread writes its element with the write percent probability and only
+ * reads it otherwise.
+ *
+ * The footprint is PENGUIN_FOOTPRINT_MB (the environment variable, else the
+ * build's), which -f sets, so PENGUIN_OVERSUB=100 to 900 runs it from 2x to
+ * 10x oversubscribed; without PENGUIN_OVERSUB it runs 2x oversubscribed. */
+
+#include <unistd.h> // getopt
+#include <chrono> // high_resolution_clock
+#include <iostream> // cout
+#include <vector>
+#include <string>
+#include <cstdio> // printf
+#include <cstdlib>
+#include <cstring>
+#include <ratio>  // milli
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+
+#include "penguin.h"
+
+#define THREADS_PER_BLOCK 256
+
+// Full-period LCG modulo a power of two, the links of the chase cycle
+#define CHASE_MULTIPLIER 6364136223846793005ULL
+#define CHASE_INCREMENT 1442695040888963407ULL
+
+__host__ __device__ __forceinline__
+unsigned long long synth_hash(unsigned long long x) {
+  // splitmix64 finalizer
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+__device__ __forceinline__
+void synth_touch(unsigned long long* data, unsigned long long i,
+                 unsigned long long tid, unsigned seed, int write_pct,
+                 unsigned long long* sink) {
+  unsigned long long v = data[i];
+  if((int) (synth_hash(tid ^ ((unsigned long long) seed << 40)) % 100) < write_pct)
+    data[i] = v + 2;
+  else if(v == ~0ULL)
+    *sink = v; // never true, keeps the read
+}
+
+__global__ void sequential_kernel(unsigned long long* data, unsigned long long n,
+                                  unsigned seed, int write_pct,
+                                  unsigned long long* sink) {
+  unsigned long long tid = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  if(tid < n)
+    synth_touch(data, tid, tid, seed, write_pct, sink);
+}
+
+__global__ void strided_kernel(unsigned long long* data, unsigned long long n,
+                               unsigned long long stride, unsigned seed,
+                               int write_pct, unsigned long long* sink) {
+  unsigned long long tid = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  if(tid * stride < n)
+    synth_touch(data, tid * stride, tid, seed, write_pct, sink);
+}
+
+__global__ void random_kernel(unsigned long long* data, unsigned long long n,
+                              unsigned seed, int write_pct,
+                              unsigned long long* sink) {
+  unsigned long long tid = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  if(tid < n)
+    synth_touch(data, synth_hash(tid + ((unsigned long long) seed << 32)) % n,
+                tid, seed, write_pct, sink);
+}
+
+__global__ void zipf_kernel(unsigned long long* data, unsigned long long n,
+                            unsigned seed, int write_pct,
+                            unsigned long long* sink) {
+  unsigned long long tid = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  if(tid >= n)
+    return;
+  // P(rank <= r) = log(r) / log(n), i.e. the probability of rank r goes
+  // with 1 / r
+  double u = (synth_hash(tid + ((unsigned long long) seed << 32)) >> 11) *
+             (1.0 / 9007199254740992.0);
+  unsigned long long rank = (unsigned long long) exp(u * log((double) n));
+  synth_touch(data, rank > n ? n - 1 : rank - 1, tid, seed, write_pct, sink);
+}
+
+// The links are stored shifted left by one; writes flip the low bit, so the
+// cycle survives them
+__global__ void chase_kernel(unsigned long long* data, unsigned long long n,
+                             int length, unsigned seed, int write_pct,
+                             unsigned long long* sink) {
+  unsigned long long tid = (unsigned long long) blockIdx.x * blockDim.x + threadIdx.x;
+  if(tid * length >= n)
+    return;
+  bool write = (int) (synth_hash(tid ^ ((unsigned long long) seed << 40)) % 100) < write_pct;
+  unsigned long long j = synth_hash(tid + ((unsigned long long) seed << 32)) & (n - 1);
+  for(int step = 0; step < length; step++) {
+    unsigned long long v = data[j];
+    if(write)
+      data[j] = v ^ 1;
+    j = v >> 1;
+  }
+  if(j == ~0ULL)
+    *sink = j; // never true, keeps the chase
+}
+
+enum Pattern { SEQUENTIAL, STRIDED, RANDOM, ZIPF, CHASE, PHASES };
+
+static const char* pattern_names[] = { "seq", "stride", "random", "zipf", "chase", "phases" };
+
+static unsigned blocks_for(unsigned long long threads) {
+  return (threads + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+}
+
+static void launch(Pattern pattern, unsigned long long* data, unsigned long long n,
+                   unsigned long long stride, int length, unsigned seed,
+                   int write_pct, unsigned long long* sink) {
+  switch(pattern) {
+    case SEQUENTIAL:
+      sequential_kernel<<<blocks_for(n), THREADS_PER_BLOCK>>>(data, n, seed, write_pct, sink);
+      break;
+    case STRIDED:
+      strided_kernel<<<blocks_for((n + stride - 1) / stride), THREADS_PER_BLOCK>>>(data, n, stride, seed, write_pct, sink);
+      break;
+    case RANDOM:
+      random_kernel<<<blocks_for(n), THREADS_PER_BLOCK>>>(data, n, seed, write_pct, sink);
+      break;
+    case ZIPF:
+      zipf_kernel<<<blocks_for(n), THREADS_PER_BLOCK>>>(data, n, seed, write_pct, sink);
+      break;
+    case CHASE:
+      chase_kernel<<<blocks_for((n + length - 1) / length), THREADS_PER_BLOCK>>>(data, n, length, seed, write_pct, sink);
+      break;
+    default:
+      break;
+  }
+}
+
+static void usage(const char* binary) {
+  std::cerr << "usage: " << binary << " [-p seq|stride|random|zipf|chase|phases]"
+            << " [-f footprint MiB] [-a allocations] [-k kernels] [-i iterations]"
+            << " [-w write percent] [-s stride] [-c chase length]\n";
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  Pattern pattern = SEQUENTIAL;
+  int allocations = 4;
+  int kernels = 4;
+  int iterations = 2;
+  int write_pct = 30;
+  unsigned long long stride = 16;
+  int length = 64;
+  int opt;
+  while((opt = getopt(argc, argv, "p:f:a:k:i:w:s:c:")) != -1) {
+    switch(opt) {
+      case 'p': {
+        int p = 0;
+        while(p <= PHASES && strcmp(optarg, pattern_names[p]) != 0)
+          p++;
+        if(p > PHASES)
+          usage(argv[0]);
+        pattern = (Pattern) p;
+        break;
+      }
+      // before anything reads it, the reservation and the runtime's budget
+      case 'f': setenv("PENGUIN_FOOTPRINT_MB", optarg, 1); break;
+      case 'a': allocations = atoi(optarg); break;
+      case 'k': kernels = atoi(optarg); break;
+      case 'i': iterations = atoi(optarg); break;
+      case 'w': write_pct = atoi(optarg); break;
+      case 's': stride = strtoull(optarg, NULL, 10); break;
+      case 'c': length = atoi(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  unsigned long long footprint_mb = PENGUIN_FOOTPRINT_MB;
+  if(getenv("PENGUIN_FOOTPRINT_MB") != NULL)
+    footprint_mb = strtoull(getenv("PENGUIN_FOOTPRINT_MB"), NULL, 10);
+  if(footprint_mb == 0 || allocations < 1 || kernels < 1 || iterations < 1 ||
+     stride < 1 || length < 1)
+    usage(argv[0]);
+
+  // 2x oversubscribed unless PENGUIN_OVERSUB says otherwise
+  unsigned long long reserve_mb = footprint_mb / 2 < PENGUIN_GPU_SIZE_MB ?
+      PENGUIN_GPU_SIZE_MB - footprint_mb / 2 : 0;
+  int* reservation;
+  cudaMalloc((void**) &reservation, penguin_reservation_bytes(reserve_mb));
+
+  unsigned long long n = footprint_mb * 1024ULL * 1024ULL / allocations /
+                         sizeof(unsigned long long);
+  if(pattern == CHASE) {
+    // the cycle is over a power of two
+    while(n & (n - 1))
+      n &= n - 1;
+  }
+  std::vector<unsigned long long*> data(allocations);
+  unsigned long long* sink;
+  cudaMallocManaged(&sink, sizeof(unsigned long long));
+  *sink = 0;
+  for(int a = 0; a < allocations; a++) {
+    cudaMallocManaged(&data[a], n * sizeof(unsigned long long));
+    unsigned long long* d = data[a];
+    for(unsigned long long i = 0; i < n; i++)
+      d[i] = pattern == CHASE ? ((CHASE_MULTIPLIER * i + CHASE_INCREMENT) & (n - 1)) << 1 : i;
+  }
+
+  nvml_start();
+  penguinStartStatCollection();
+  std::cout << "Synthetic " << pattern_names[pattern] << " over " << allocations
+    << " allocations of " << n * sizeof(unsigned long long) / (1024 * 1024)
+    << " MiB, " << kernels << " kernels x " << iterations << " iterations, "
+    << write_pct << "% writes\n";
+  auto start = std::chrono::high_resolution_clock::now();
+  unsigned seed = 0;
+  if(pattern == PHASES) {
+    static const Pattern phase_patterns[] = { SEQUENTIAL, STRIDED, ZIPF, RANDOM };
+    int window = allocations / 2 > 0 ? allocations / 2 : 1;
+    for(int phase = 0; phase < 4; phase++) {
+      int first = phase * allocations / 4;
+      for(int it = 0; it < iterations; it++) {
+        for(int j = 0; j < kernels; j++) {
+          launch(phase_patterns[phase], data[(first + j % window) % allocations], n,
+                 stride, length, seed++, write_pct, sink);
+        }
+      }
+    }
+  } else {
+    for(int it = 0; it < iterations; it++) {
+      for(int j = 0; j < kernels; j++) {
+        launch(pattern, data[j % allocations], n, stride, length, seed++,
+               write_pct, sink);
+      }
+    }
+  }
+  cudaDeviceSynchronize();
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> start_to_end = end - start;
+  std::cout << "GPU.Parser.Time: " << start_to_end.count() << "\n\n";
+  nvml_stop();
+  penguinStopStatCollection();
+
+  for(int a = 0; a < allocations; a++)
+    cudaFree(data[a]);
+  cudaFree(sink);
+  cudaFree(reservation);
+}
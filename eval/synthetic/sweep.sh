@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Runs the synthetic workload for every pattern from 2x to 10x
+# oversubscription under each policy, from the root folder of the artifact:
+#
+#   bash eval/synthetic/sweep.sh [footprint MiB] [extra arguments of suv.out]
+#
+# Results go to eval/synthetic/<pattern>.<policy>.<oversub>.txt through
+# eval/trials.sh; the driver is expected to be loaded as run.sh loads it.
+
+pwd0=$(pwd)
+footprint=${1:-8192}
+shift
+bin=${pwd0}/eval/build/synthetic # see compile.sh
+
+patterns=(seq stride random zipf chase phases)
+oversub=(100 300 500 700 900) # 2x, 4x, 6x, 8x and 10x
+
+cd ${pwd0}/eval/synthetic
+for pattern in ${patterns[@]}; do
+    for os in ${oversub[@]}; do
+        for policy in uvm suv ac; do
+            echo "suv.out -p ${pattern}, PENGUIN_POLICY=${policy} PENGUIN_OVERSUB=${os}"
+            PENGUIN_POLICY=${policy} PENGUIN_OVERSUB=${os} \
+                bash ${pwd0}/eval/trials.sh ${pattern}.${policy}.${os} \
+                ${bin}/suv.out -p ${pattern} -f ${footprint} "$@"
+        done
+    done
+    echo ""
+done
+cd ${pwd0}
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Runs a workload binary repeatedly and summarizes its GPU.Parser.Time.
+#
+#   bash eval/trials.sh <output prefix> <binary> [args...]
+#
+# PENGUIN_WARMUP (1) runs are discarded, then PENGUIN_TRIALS (5) are timed.
+# Every run is logged to <prefix>.<n>.txt (warm-ups as <prefix>.w<n>.txt) with
+# the tail of the kernel log in <prefix>.<n>.pf.txt, and <prefix>.txt gets the
+# median as GPU.Parser.Time, so the parse scripts read it as one run, followed
+# by the times, their variance and the log of the median run. The policy,
+# oversubscription and access counter settings come from the environment
+# (PENGUIN_POLICY, PENGUIN_OVERSUB, PENGUIN_AC_*, see penguin.h).
+
+prefix=$1
+shift
+warmup=${PENGUIN_WARMUP:-1}
+trials=${PENGUIN_TRIALS:-5}
+
+for ((w=0; w<warmup; ++w)); do
+    "$@" &> ${prefix}.w${w}.txt
+    sleep 1
+done
+
+times=()
+ran=() # the run each time is from
+for ((t=0; t<trials; ++t)); do
+    "$@" &> ${prefix}.${t}.txt
+    sudo dmesg | tail &> ${prefix}.${t}.pf.txt
+    time=$(grep "GPU.Parser.Time" ${prefix}.${t}.txt | awk '{print $2}')
+    if [ -n "${time}" ]; then
+        times+=(${time})
+        ran+=(${t})
+    fi
+    sleep 1
+done
+
+if [ ${#times[@]} -eq 0 ]; then
+    echo "no timed run of $* finished, see ${prefix}.0.txt" | tee ${prefix}.txt
+    exit 1
+fi
+
+# median and sample variance; the log of the median run goes along
+summary=$(printf "%s\n" "${times[@]}" | sort -g | awk '
+    { t[NR] = $1; sum += $1 }
+    END {
+        mean = sum / NR
+        median = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+        for(i = 1; i <= NR; i++) ss += (t[i] - mean) ^ 2
+        printf "%s %s\n", median, (NR > 1 ? ss / (NR - 1) : 0)
+    }')
+median=$(echo ${summary} | awk '{print $1}')
+variance=$(echo ${summary} | awk '{print $2}')
+closest=0
+for ((t=1; t<${#times[@]}; ++t)); do
+    if awk -v a=${times[t]} -v b=${times[closest]} -v m=${median} \
+            'BEGIN { exit !((a - m) ^ 2 < (b - m) ^ 2) }'; then
+        closest=${t}
+    fi
+done
+
+{
+    echo "GPU.Parser.Time: ${median}"
+    echo "Trials: ${#times[@]} of ${trials}, warm-up ${warmup}"
+    echo "Trial times: ${times[*]}"
+    echo "Trial variance: ${variance}"
+    echo ""
+    grep -v "GPU.Parser.Time" ${prefix}.${ran[closest]}.txt
+} > ${prefix}.txt
+cp ${prefix}.${ran[closest]}.pf.txt ${prefix}.pf.txt
+echo "${prefix}: median ${median} variance ${variance} over ${#times[@]} trials"
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Tunes the planner constants of one workload by successive halving, from the
+# root folder of the artifact:
+#
+#   bash eval/tune/tune.sh <benchmark> [args...]
+#
+# TUNE_CANDIDATES (16) configurations are drawn from the grids below, each a
+# PENGUIN_TUNE list (see penguin.h). Every round runs the candidates left
+# through eval/trials.sh with PENGUIN_TRIALS doubling from 1, keeps the faster
+# half by median GPU.Parser.Time and stops at one. Each candidate records into
+# its own profile, tune.<n>.bin, with PENGUIN_PROFILE_REPLAY=0 so every run
+# plans; the winner's is copied to eval/<benchmark>/penguin_profile.bin (or
+# $PENGUIN_PROFILE), which holds the tunables along with the decisions, so the
+# next run of eval/build/<benchmark>/suv.out replays both. The policy and
+# oversubscription come from the environment as for trials.sh, and must be
+# the ones production runs with, the profile is only used for the same GPU
+# memory budget. eval/<benchmark>/tune.csv gets round,candidate,median,tune.
+
+min_prefetch=(4m 8m 16m 32m)
+prefetch_batches=(2 4 8)
+iteronly_ratio=(0.02 0.05 0.1 0.2)
+pchase_headroom=(4m 10m 32m)
+ac_granularity=(64k 2m)
+ac_threshold=(64 256 1024)
+
+pwd0=$(pwd) # the root folder of the artifact
+benchmark=$1
+shift
+count=${TUNE_CANDIDATES:-16}
+bin=${pwd0}/eval/build/${benchmark} # see compile.sh
+cd ${pwd0}/eval/${benchmark}
+
+pick() {
+    local grid=("$@")
+    echo ${grid[RANDOM % ${#grid[@]}]}
+}
+
+# candidate 0 is the defaults, so tuning never ends worse than not tuning
+tunes=("min_prefetch=8m,prefetch_batches=4,iteronly_ratio=0.05,pchase_headroom=10m,ac_granularity=64k,ac_threshold=256")
+for ((c=1; c<count; ++c)); do
+    tunes+=("min_prefetch=$(pick ${min_prefetch[@]}),prefetch_batches=$(pick ${prefetch_batches[@]}),iteronly_ratio=$(pick ${iteronly_ratio[@]}),pchase_headroom=$(pick ${pchase_headroom[@]}),ac_granularity=$(pick ${ac_granularity[@]}),ac_threshold=$(pick ${ac_threshold[@]})")
+done
+
+echo "round,candidate,median,tune" > tune.csv
+left=($(seq 0 $((count - 1))))
+trials=1
+round=0
+while [ ${#left[@]} -gt 1 ]; do
+    rm -f tune.round.txt
+    for c in ${left[@]}; do
+        echo "${benchmark} round ${round}, candidate ${c}: ${tunes[c]}"
+        PENGUIN_TUNE=${tunes[c]} PENGUIN_PROFILE=${pwd0}/eval/${benchmark}/tune.${c}.bin \
+            PENGUIN_PROFILE_REPLAY=0 PENGUIN_TRIALS=${trials} \
+            bash ${pwd0}/eval/trials.sh tune.${c} ${bin}/suv.out "$@"
+        median=$(grep "GPU.Parser.Time" tune.${c}.txt | awk '{print $2}')
+        echo "${round},${c},${median},${tunes[c]}" >> tune.csv
+        # a candidate whose runs all failed goes last
+        echo "${c} ${median:-inf}" >> tune.round.txt
+    done
+    keep=$(((${#left[@]} + 1) / 2))
+    left=($(sort -g -k2 tune.round.txt | head -n ${keep} | awk '{print $1}'))
+    trials=$((trials * 2))
+    round=$((round + 1))
+done
+rm -f tune.round.txt
+
+best=${left[0]}
+profile=${PENGUIN_PROFILE:-penguin_profile.bin}
+if [ -f tune.${best}.bin ]; then
+    cp tune.${best}.bin ${profile}
+    echo "best ${tunes[best]}, profile in ${profile}"
+else
+    echo "best ${tunes[best]}, but it recorded no profile; run with PENGUIN_TUNE=${tunes[best]}"
+fi
+cd ${pwd0}
@@ -9,8 +9,8 @@
 // implementation of the algorithm, with only minor CPU optimizations in place.
 // Following these functions are a number of optimized variants,
 // which each deploy a different combination of optimizations strategies. By
-// default, XSBench will only run the baseline implementation. Optimized variants
-// are not yet implemented in this CUDA port.
+// default, XSBench will only run the baseline implementation. The one optimized
+// variant of this CUDA port is the energy-batched lookup (-k 1).
 ////////////////////////////////////////////////////////////////////////////////////
 __host__ __device__
 double LCG_random_double(uint64_t * seed)
@@ -23,6 +23,59 @@ double LCG_random_double(uint64_t * seed)
   return (double) (*seed) / (double) m;
 }  
 
+// Index grid decoded from its packed form (-c), indexed like index_grid. The
+// lookups pay a division and a popcount for every index they read, for a grid
+// 16 times smaller.
+struct PackedIndexGrid {
+  const PackedIndex *__restrict__ packed;
+  long n_isotopes;
+
+  __device__ int operator[](long k) const {
+    long e = k / n_isotopes;
+    long nuc = k - e * n_isotopes;
+    PackedIndex p = packed[(e / PACKED_INDEX_BLOCK) * n_isotopes + nuc];
+    unsigned upto = (2u << (e % PACKED_INDEX_BLOCK)) - 1;
+    return p.base + __popc(p.steps & upto);
+  }
+};
+
+// Packs the unionized index grid of SD into length PackedIndex; NULL if a
+// nuclide's index moves by more than one between two energies, as in a grid
+// of a binary file
+PackedIndex * pack_index_grid(SimulationData SD, long n_isotopes, long *length)
+{
+  long energies = SD.length_unionized_energy_array;
+  long blocks = (energies + PACKED_INDEX_BLOCK - 1) / PACKED_INDEX_BLOCK;
+  PackedIndex * packed = (PackedIndex *) malloc(sizeof(PackedIndex) * blocks * n_isotopes);
+  assert(packed != NULL);
+
+  for( long e = 0; e < energies; e++ )
+  {
+    int r = e % PACKED_INDEX_BLOCK;
+    for( long i = 0; i < n_isotopes; i++ )
+    {
+      int idx = SD.index_grid[e * n_isotopes + i];
+      PackedIndex * p = &packed[(e / PACKED_INDEX_BLOCK) * n_isotopes + i];
+      if( r == 0 )
+      {
+        p->base = idx;
+        p->steps = 0;
+        continue;
+      }
+      int step = idx - SD.index_grid[(e - 1) * n_isotopes + i];
+      if( step < 0 || step > 1 )
+      {
+        free(packed);
+        return NULL;
+      }
+      p->steps |= (unsigned) step << r;
+    }
+  }
+
+  *length = blocks * n_isotopes;
+  return packed;
+}
+
 __global__ void lookup (
     const int *__restrict__ num_nucs,
     const double *__restrict__ concs,
@@ -31,6 +84,7 @@ __global__ void lookup (
     int*__restrict__  verification,
     const double *__restrict__ unionized_energy_array,
     const int *__restrict__ index_grid,
+    const PackedIndex *__restrict__ packed_index_grid,
     const int n_lookups,
     const long n_isotopes, 
     const long n_gridpoints,
@@ -58,6 +112,14 @@ __global__ void lookup (
 
     double macro_xs_vector[5] = {0};
 
+    // The same lookup through the packed index grid (-c)
+    if( packed_index_grid != NULL )
+      calculate_macro_xs(
+          p_energy, mat, n_isotopes, n_gridpoints, num_nucs, concs,
+          unionized_energy_array, PackedIndexGrid{packed_index_grid, n_isotopes},
+          nuclide_grid, mats, macro_xs_vector, grid_type, hash_bins, max_num_nucs );
+    else
+    {
     // Perform macroscopic Cross Section Lookup
     calculate_macro_xs(
         p_energy,     // Sampled neutron energy (in lethargy)
@@ -75,6 +137,7 @@ __global__ void lookup (
         hash_bins,    // Number of hash bins used (if using hash lookup type)
         max_num_nucs  // Maximum number of nuclides present in any material
      );
+    }
 
     // For verification, and to prevent the compiler from optimizing
     // all work out, we interrogate the returned macro_xs_vector array
@@ -96,6 +159,112 @@ __global__ void lookup (
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Energy-batched lookups (-k 1)
+////////////////////////////////////////////////////////////////////////////////
+// The lookups are sampled as in the baseline, bucketed by energy, and each
+// bucket is looked up by its own launch. Both grids are sorted by energy, so
+// a launch only touches the slice of index_grid and of every nuclide's grid
+// its energy range falls in, and the slices of successive launches follow
+// each other through memory.
+////////////////////////////////////////////////////////////////////////////////
+__host__ __device__
+int energy_batch(double p_energy, int batches)
+{
+  int b = (int) (p_energy * batches);
+  return b < batches ? b : batches - 1;
+}
+
+__global__ void sample_lookups(
+    const int n_lookups,
+    double *__restrict__ p_energy_samples,
+    int *__restrict__ mat_samples,
+    const int batches,
+    int *__restrict__ batch_counts ) {
+
+  size_t i = threadIdx.x + blockIdx.x * blockDim.x;
+
+  if (i < n_lookups) {
+    // the same samples as the baseline's lookup i
+    uint64_t seed = STARTING_SEED;
+    seed = fast_forward_LCG(seed, 2*i);
+    double p_energy = LCG_random_double(&seed);
+    int mat         = pick_mat(&seed);
+    p_energy_samples[i] = p_energy;
+    mat_samples[i] = mat;
+    atomicAdd(&batch_counts[energy_batch(p_energy, batches)], 1);
+  }
+}
+
+// batch_cursors[b] starts at the first slot of batch b in order
+__global__ void bucket_lookups(
+    const int n_lookups,
+    const double *__restrict__ p_energy_samples,
+    const int batches,
+    int *__restrict__ batch_cursors,
+    int *__restrict__ order ) {
+
+  size_t i = threadIdx.x + blockIdx.x * blockDim.x;
+
+  if (i < n_lookups)
+    order[atomicAdd(&batch_cursors[energy_batch(p_energy_samples[i], batches)], 1)] = i;
+}
+
+__global__ void lookup_batch (
+    const int *__restrict__ order,
+    const int batch_start,
+    const int batch_count,
+    const double *__restrict__ p_energy_samples,
+    const int *__restrict__ mat_samples,
+    const int *__restrict__ num_nucs,
+    const double *__restrict__ concs,
+    const int *__restrict__ mats, 
+    const NuclideGridPoint *__restrict__ nuclide_grid,
+    int*__restrict__  verification,
+    const double *__restrict__ unionized_energy_array,
+    const int *__restrict__ index_grid,
+    const PackedIndex *__restrict__ packed_index_grid,
+    const long n_isotopes, 
+    const long n_gridpoints,
+    const int grid_type,
+    const int hash_bins,
+    const int max_num_nucs ) {
+
+  size_t t = threadIdx.x + blockIdx.x * blockDim.x;
+
+  if (t < batch_count) {
+    int i = order[batch_start + t];
+
+    double macro_xs_vector[5] = {0};
+
+    if( packed_index_grid != NULL )
+      calculate_macro_xs(
+          p_energy_samples[i], mat_samples[i], n_isotopes, n_gridpoints,
+          num_nucs, concs, unionized_energy_array,
+          PackedIndexGrid{packed_index_grid, n_isotopes}, nuclide_grid,
+          mats, macro_xs_vector, grid_type, hash_bins, max_num_nucs );
+    else
+      calculate_macro_xs(
+          p_energy_samples[i], mat_samples[i], n_isotopes, n_gridpoints,
+          num_nucs, concs, unionized_energy_array, index_grid, nuclide_grid,
+          mats, macro_xs_vector, grid_type, hash_bins, max_num_nucs );
+
+    // verified as in the baseline
+    double max = -1.0;
+    int max_idx = 0;
+    for(int j = 0; j < 5; j++ )
+    {
+      if( macro_xs_vector[j] > max )
+      {
+        max = macro_xs_vector[j];
+        max_idx = j;
+      }
+    }
+    verification[i] = max_idx+1;
+  }
+}
+
+
 unsigned long long
 run_event_based_simulation(Inputs in, SimulationData SD,
                            int mype, double *kernel_time)
@@ -186,10 +355,53 @@ run_event_based_simulation(Inputs in, SimulationData SD,
     SD.index_grid = (int *) malloc(sizeof(int));
   }
 
+  // With -c the lookups read the packed grid, small enough for the planners
+  // to keep on the GPU, and index_grid_d is a single int like the empty
+  // buffers above
+  long length_packed_index_grid = 0;
+  PackedIndex *packed_index_grid_h = nullptr;
+  if( in.packed_index )
+  {
+    packed_index_grid_h = pack_index_grid(SD, in.n_isotopes, &length_packed_index_grid);
+    if( packed_index_grid_h == NULL && mype == 0 )
+      printf("The index grid does not pack, looking it up unpacked...\n");
+  }
+  PackedIndex * PENGUIN_ANNOTATE_HINT(dense, 0) packed_index_grid_d = nullptr;
+  long length_index_grid_d = SD.length_index_grid;
+  if( packed_index_grid_h != NULL )
+  {
+    if( mype == 0 )
+      printf("Packed the index grid into %.1lf MB, from %.1lf MB...\n",
+             sizeof(PackedIndex) * length_packed_index_grid /1024.0/1024.0,
+             sizeof(int) * SD.length_index_grid /1024.0/1024.0);
+    cudaMallocManaged((void**)&packed_index_grid_d, sizeof(PackedIndex) * length_packed_index_grid);
+    memcpy(packed_index_grid_d, packed_index_grid_h, sizeof(PackedIndex) * length_packed_index_grid);
+    free(packed_index_grid_h);
+    length_index_grid_d = 1;
+  }
+
   //buffer<int, 1> index_grid_d(SD.index_grid, (unsigned long long ) SD.length_index_grid);
   int *index_grid_d = nullptr;
-  cudaMallocManaged((void**)&index_grid_d, sizeof(int) * (unsigned long long)SD.length_index_grid);
-  memcpy(index_grid_d, SD.index_grid, sizeof(int) * (unsigned long long )SD.length_index_grid);
+  cudaMallocManaged((void**)&index_grid_d, sizeof(int) * (unsigned long long)length_index_grid_d);
+  memcpy(index_grid_d, SD.index_grid, sizeof(int) * (unsigned long long )length_index_grid_d);
+
+  // Buffers of the energy-batched lookups
+  double *p_energy_samples_d = nullptr;
+  int *mat_samples_d = nullptr;
+  int *order_d = nullptr;
+  int *batch_counts_d = nullptr;
+  int *batch_cursors_d = nullptr;
+  int *batch_starts_h = nullptr;
+  if( in.kernel_id == 1 )
+  {
+    cudaMallocManaged((void**)&p_energy_samples_d, sizeof(double) * in.lookups);
+    cudaMallocManaged((void**)&mat_samples_d, sizeof(int) * in.lookups);
+    cudaMallocManaged((void**)&order_d, sizeof(int) * in.lookups);
+    cudaMallocManaged((void**)&batch_counts_d, sizeof(int) * in.batches);
+    cudaMallocManaged((void**)&batch_cursors_d, sizeof(int) * in.batches);
+    memset(batch_counts_d, 0, sizeof(int) * in.batches);
+    batch_starts_h = (int *) malloc(sizeof(int) * (in.batches + 1));
+  }
 
   ////////////////////////////////////////////////////////////////////////////////
   // Define Device Kernel
@@ -210,13 +422,42 @@ run_event_based_simulation(Inputs in, SimulationData SD,
       /* cudaMemPrefetchAsync(index_grid_d ,sizeof(int) * (unsigned long long)SD.length_index_grid, 0,  0); */
       /*   cudaMemAdvise(verification_d, sizeof(int) * in.lookups, cudaMemAdviseSetPreferredLocation, 0); */
 
+  if( in.kernel_id == 1 )
+  {
+    sample_lookups<<< dim3((in.lookups + 255) / 256), dim3(256) >>> (
+        in.lookups, p_energy_samples_d, mat_samples_d, in.batches, batch_counts_d );
+    cudaDeviceSynchronize();
+    batch_starts_h[0] = 0;
+    for( int b = 0; b < in.batches; b++ )
+    {
+      batch_cursors_d[b] = batch_starts_h[b];
+      batch_starts_h[b + 1] = batch_starts_h[b] + batch_counts_d[b];
+    }
+    bucket_lookups<<< dim3((in.lookups + 255) / 256), dim3(256) >>> (
+        in.lookups, p_energy_samples_d, in.batches, batch_cursors_d, order_d );
+    for( int b = 0; b < in.batches; b++ )
+    {
+      int batch_count = batch_starts_h[b + 1] - batch_starts_h[b];
+      if( batch_count == 0 )
+        continue;
+      lookup_batch<<< dim3((batch_count + 255) / 256), dim3(256) >>> (
+          order_d, batch_starts_h[b], batch_count, p_energy_samples_d, mat_samples_d,
+          num_nucs_d, concs_d, mats_d, 
+          nuclide_grid_d, verification_d, unionized_energy_array_d,
+          index_grid_d, packed_index_grid_d, in.n_isotopes, in.n_gridpoints, 
+          in.grid_type, in.hash_bins, SD.max_num_nucs );
+    }
+  }
+  else
+  {
   /* for (int i = 0; i < in.kernel_repeat; i++) { */ 
     lookup<<< dim3((in.lookups + 255) / 256), dim3(256) >>> (
         num_nucs_d, concs_d, mats_d, 
         nuclide_grid_d, verification_d, unionized_energy_array_d,
-        index_grid_d, in.lookups, in.n_isotopes, in.n_gridpoints, 
+        index_grid_d, packed_index_grid_d, in.lookups, in.n_isotopes, in.n_gridpoints, 
         in.grid_type, in.hash_bins, SD.max_num_nucs );
   /* } */
+  }
 
   cudaDeviceSynchronize();
   double kstop = get_time();
@@ -233,6 +474,17 @@ run_event_based_simulation(Inputs in, SimulationData SD,
   cudaFree(nuclide_grid_d);
   cudaFree(unionized_energy_array_d);
   cudaFree(index_grid_d);
+  if( packed_index_grid_d != nullptr )
+    cudaFree(packed_index_grid_d);
+  if( in.kernel_id == 1 )
+  {
+    cudaFree(p_energy_samples_d);
+    cudaFree(mat_samples_d);
+    cudaFree(order_d);
+    cudaFree(batch_counts_d);
+    cudaFree(batch_cursors_d);
+    free(batch_starts_h);
+  }
 
   // Host reduces the verification array
   unsigned long long verification_scalar = 0;
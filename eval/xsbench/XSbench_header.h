@@ -62,8 +62,23 @@ typedef struct{
   int binary_mode;
   int kernel_id;
   int kernel_repeat;
+  int batches; // energy buckets of the batched lookups (-k 1)
+  int packed_index; // bit-packed unionized index grid (-c)
 } Inputs;
 
+// Bit-packed unionized index grid (-c). Going up the unionized grid, the
+// index into a nuclide's grid moves up by 0 or 1 at each energy, so for each
+// block of PACKED_INDEX_BLOCK energies a nuclide keeps the index at the first
+// energy of the block and a bit per energy for the steps, bit r set if the
+// index moves up between energies r - 1 and r of the block; indexed like
+// index_grid, by block * n_isotopes + nuclide.
+#define PACKED_INDEX_BLOCK 32
+
+typedef struct{
+  int base;
+  unsigned steps;
+} PackedIndex;
+
 typedef struct{
   int * num_nucs;                     // Length = length_num_nucs;
   double * concs;                     // Length = length_concs
@@ -147,6 +147,12 @@ void print_inputs(Inputs in, int nprocs, int version )
 #else
   printf("Est. Memory Usage (MB):       "); fancy_int(mem_tot);
 #endif
+  if( in.kernel_id == 1 )
+  {
+    printf("Energy Batches:               "); fancy_int(in.batches);
+  }
+  if( in.packed_index )
+    printf("Index Grid:                   Bit-Packed\n");
   printf("Binary File Mode:             ");
   if( in.binary_mode == NONE )
     printf("Off\n");
@@ -202,6 +208,8 @@ void print_CLI_error(void)
   printf("  -b <binary mode>         Read or write all data structures to file. If reading, this will skip initialization phase. (read, write)\n");
   printf("  -k <kernel ID>           Specifies which kernel to run. 0 is baseline, 1, 2, etc are optimized variants. (0 is default.)\n");
   printf("  -r <kernel count>        Specifies the kernel execution count. (1 is default.)\n");
+  printf("  -B <energy batches>      Energy buckets the lookups of kernel 1 are batched in. (64 is default.)\n");
+  printf("  -c                       Bit-pack the unionized index grid, the lookups decode it. (Off by default.)\n");
   printf("Default is equivalent to: -m history -s large -l 34 -p 500000 -G unionized\n");
   printf("See readme for full description of default run values\n");
   exit(4);
@@ -244,6 +252,12 @@ Inputs read_CLI( int argc, char * argv[] )
   // defaults to kernel execution once 
   input.kernel_repeat = 1;
 
+  // defaults to 64 energy batches
+  input.batches = 64;
+
+  // defaults to the unpacked index grid
+  input.packed_index = 0;
+
   // defaults to H-M Large benchmark
   input.HM = (char *) malloc( 6 * sizeof(char) );
   input.HM[0] = 'l' ; 
@@ -391,6 +405,21 @@ Inputs read_CLI( int argc, char * argv[] )
       else
         print_CLI_error();
     }
+    // energy batches (-B)
+    else if( strcmp(arg, "-B") == 0 )
+    {
+      if( ++i < argc )
+      {
+        input.batches = atoi(argv[i]);
+      }
+      else
+        print_CLI_error();
+    }
+    // bit-packed index grid (-c)
+    else if( strcmp(arg, "-c") == 0 )
+    {
+      input.packed_index = 1;
+    }
     else
       print_CLI_error();
   }
@@ -417,6 +446,14 @@ Inputs read_CLI( int argc, char * argv[] )
   if( input.hash_bins < 1 )
     print_CLI_error();
 
+  // Validate energy batches
+  if( input.batches < 1 )
+    print_CLI_error();
+
+  // Only the unionized grid is packed
+  if( input.packed_index && input.grid_type != UNIONIZED )
+    print_CLI_error();
+
   // Validate HM size
   if( strcasecmp(input.HM, "small") != 0 &&
       strcasecmp(input.HM, "large") != 0 &&
@@ -1,11 +1,12 @@
 #include "XSbench_header.h"
+#include "penguin-oversub.h"
 
 #ifdef MPI
 #include<mpi.h>
 #endif
 
 #define MiB 21271
-#define RESERVATION ((MiB*1024UL*1024))
+#define RESERVATION (penguin_reservation_bytes(MiB)) // MiB unless PENGUIN_OVERSUB is set
 
 int main( int argc, char* argv[] )
 {
@@ -80,7 +81,8 @@ int main( int argc, char* argv[] )
   // Run simulation
   if( in.simulation_method == EVENT_BASED )
   {
-    if( in.kernel_id == 0 )
+    // 1 batches the lookups by energy, see Simulation.cu
+    if( in.kernel_id == 0 || in.kernel_id == 1 )
     {
       verification = run_event_based_simulation(in, SD, mype, &kernel_time);
     }
@@ -4,29 +4,31 @@ penguinpath=$1
 compilerpath=$2
 binary=$3
 
-rm *.ll *.o *.ptx *.fatbin ${binary}
+sources="Simulation.cu main.cu io.cu GridInit.cu Materials.cu XSutils.cu"
 
-clang++  -O3 --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -pthread  -S -emit-llvm Simulation.cu
+rm *.ll *.o *.ptx *.fatbin ${binary} ${binary}.meta
 
-opt --loop-simplify -o loopsim.ll --debug-pass-manager -S Simulation-cuda-nvptx64-nvidia-cuda-sm_86.ll
+# the device code of every source, as one module, so the analysis sees all kernels
+clang++  -O3 --cuda-gpu-arch=sm_86 --cuda-device-only -I${penguinpath} -I/usr/local/cuda-11.8/include -S -emit-llvm ${sources}
+llvm-link -S -o device.ll *-cuda-nvptx64-nvidia-cuda-sm_86.ll
 
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/CudaAnalysis.so --CudaAnalysis --disable-output --debug-pass-manager loopsim.ll
+opt --loop-simplify -o loopsim.ll --debug-pass-manager -S device.ll
+
+opt -load ${compilerpath}/build/lib/CudaAnalysis.so -load-pass-plugin=${compilerpath}/build/lib/CudaAnalysis.so -passes=cuda-analysis -cuda-analysis-metadata=${binary}.meta --disable-output --debug-pass-manager loopsim.ll
 
 llc -mcpu=sm_86 loopsim.ll -o device.ptx
 ptxas --gpu-name=sm_86 device.ptx -o device.ptx.o
 fatbinary -64 --create device.fatbin --image=profile=sm_86,file=device.ptx.o --image=profile=compute_86,file=device.ptx
 
 # compile all .cu files to .ll files
-clang -Xclang -fcuda-include-gpubinary -Xclang './device.fatbin'  --cuda-host-only -fproc-stat-report -O3  --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include  -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -lpthread -S -emit-llvm *.cu
+clang -Xclang -fcuda-include-gpubinary -Xclang './device.fatbin'  --cuda-host-only -fproc-stat-report -O3  --cuda-gpu-arch=sm_86 -I${penguinpath} -I/usr/local/cuda-11.8/include  -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -lpthread -S -emit-llvm ${sources}
+
+# the transform runs once over the whole host program, main and the
+# allocations of every source included
+llvm-link -S -o program.ll ${sources//.cu/.ll}
 
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/DynamicHostTransform.so -S -o looprotated.ll  -loop-rotate --debug-pass-manager Simulation.ll
-opt -enable-new-pm=0 -load ${compilerpath}/build/lib/DynamicHostTransform.so -S -o modified.ll  -DynamicHostTransform --debug-pass-manager looprotated.ll
+opt -load ${compilerpath}/build/lib/DynamicHostTransform.so -load-pass-plugin=${compilerpath}/build/lib/DynamicHostTransform.so -S -o modified.ll -passes='function(loop(loop-rotate)),dynamic-host-transform' -cuda-analysis-metadata=${binary}.meta --debug-pass-manager program.ll
 opt -S -O3 -o modif.ll modified.ll
 
 llc --relocation-model=pic -filetype=obj modif.ll
-llc --relocation-model=pic -filetype=obj main.ll
-llc --relocation-model=pic -filetype=obj XSutils.ll
-llc --relocation-model=pic -filetype=obj Materials.ll
-llc --relocation-model=pic -filetype=obj GridInit.ll
-llc --relocation-model=pic -filetype=obj io.ll
-clang++ -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -lpthread -lnvidia-ml modif.o main.o io.o GridInit.o Materials.o XSutils.o -o ${binary}
+clang++ -L/usr/local/cuda-11.8/lib64 -lcudart -ldl -lrt -lpthread -lnvidia-ml modif.o -o ${binary}
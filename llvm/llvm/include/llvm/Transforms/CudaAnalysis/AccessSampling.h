@@ -0,0 +1,39 @@
+//===- AccessSampling.h - Sampled global accesses per 2MB block -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Device side of the access profiler: every load and store of global memory
+// in the device code first calls penguin_sample_access with its address, the
+// device function penguin.h defines when built with PENGUIN_ACCESS_SAMPLING=1.
+// It counts the accesses of one thread in PENGUIN_SAMPLE_PERIOD per 2MB
+// block, which penguinStopStatCollection sets against the access counts and
+// working sets the host transform predicted for every aid. Accesses to the
+// stack and to device globals aren't sampled, nor are modules without the
+// function.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_ACCESSSAMPLING_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_ACCESSSAMPLING_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+namespace cuda_analysis {
+// Device function the accesses are sampled in
+static constexpr const char *SampleFunctionName = "penguin_sample_access";
+} // namespace cuda_analysis
+
+// -passes=penguin-access-sampling, on the device module before codegen
+struct AccessSamplingPass : PassInfoMixin<AccessSamplingPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_ACCESSSAMPLING_H
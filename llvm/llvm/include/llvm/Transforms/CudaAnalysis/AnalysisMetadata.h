@@ -0,0 +1,279 @@
+//===- AnalysisMetadata.h - CudaAnalysis to host pass handoff ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Binary channel between CudaAnalysis, which runs on the device module, and
+// the host transform (DynamicHostTransform, any -penguin-policy). It replaces the
+// access_detail/access_tree/loop_detail/if_detail/phi_loop/reuse_detail .lst
+// files.
+//
+// The file is a header, a string table and a list of records. Every record
+// has a kind, the kernel it belongs to, a few integer fields and a list of
+// tokens (expression terms), all as 32-bit words; strings are referenced by
+// their index in the table, so the reader maps the file and never parses text.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_ANALYSISMETADATA_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_ANALYSISMETADATA_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+namespace cuda_analysis {
+
+// Default file name, in the working directory. Builds that share a directory
+// pass a distinct name through -cuda-analysis-metadata.
+static constexpr const char *DefaultMetadataFile = "cuda_analysis.meta";
+
+static constexpr uint32_t MetadataMagic = 0x4d415543; // "CUAM"
+static constexpr uint32_t MetadataVersion = 13;
+static constexpr uint32_t NoKernel = ~0U;
+
+enum RecordKind : uint32_t {
+  // fields: loop id, parent loop id[, iterations]; tokens: IN ... FIN ...
+  // STEP ...
+  RK_Loop,
+  // fields: phi id, loop id
+  RK_PhiLoop,
+  // fields: if id; tokens: condition expression
+  RK_If,
+  // fields: access id, kernel arg, loop id, if id, if type[, is store[,
+  // tile reuse]]; tokens: RPN
+  RK_Access,
+  // fields: access id; tokens: serialized expression tree
+  RK_AccessTree,
+  // fields: kernel arg, access id, #accesses; tokens: axis, [multipliers]
+  RK_Reuse,
+  // fields: access id, kernel arg, element bytes, broadcast axes; tokens: LO
+  // ... HI ... BLO ... BHI ...[ TS ...], byte offsets of the first and last
+  // element accessed in a launch and in its first thread block, and the
+  // bytes between the elements of neighbouring threads along x. The axes, 1
+  // for x and 2 for y, are those whose thread blocks all load the same slice
+  RK_Footprint,
+  // fields: access id, probability the access runs, in 1/65536; tokens:
+  // [LT|GE LO ... HI ... LIM ...], the bounds of the index its condition
+  // compares with a bound of the launch, LIM
+  RK_Branch,
+  // fields: kernel parameters; present for kernels whose thread blocks may
+  // run as separate sub-grids (see GridSplit.h)
+  RK_GridSplit,
+  // fields: kernel arg, struct bytes, fields loaded, fields stored, #fields,
+  // then offset and bytes of each field; present for pointer arguments the
+  // runtime may split by field (see FieldSplit.h)
+  RK_FieldSplit,
+  // fields: the kernel's pointer arguments that are only loaded from (see
+  // ReadOnly.h)
+  RK_ReadOnly,
+  // fields: parameters of the kernel and of the second, element bytes, then
+  // the arguments each loads and stores; tokens: the second kernel, the
+  // fused one; present for pairs the runtime may launch fused (see
+  // KernelFusion.h)
+  RK_KernelFusion,
+  // fields: element bytes, arguments loaded, arguments stored; present for
+  // element-wise kernels whose launches in a host loop the runtime may run
+  // tile by tile, all iterations of a tile at once (see KernelFusion.h)
+  RK_LoopTiling,
+  // fields: the kernel's pointer arguments that are only stored to (see
+  // ReadOnly.h)
+  RK_WriteOnly,
+  // fields: the kernel's pointer arguments that atomics update (see
+  // ReadOnly.h)
+  RK_Atomic,
+  RK_NumKinds
+};
+
+struct MetadataHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t NumStrings;
+  uint32_t StringBytes;
+  uint32_t NumRecords;
+  uint32_t RecordWords;
+};
+
+// Record layout in the file: kind, kernel, #fields, #tokens, fields, tokens
+struct MetadataRecord {
+  RecordKind Kind;
+  StringRef Kernel;
+  ArrayRef<uint32_t> Fields;
+  ArrayRef<uint32_t> Tokens;
+};
+
+class MetadataWriter {
+  std::vector<std::string> Strings;
+  StringMap<uint32_t> StringIds;
+  std::vector<uint32_t> Words;
+  uint32_t NumRecords = 0;
+  // record being built
+  uint32_t Kind = RK_NumKinds;
+  uint32_t Kernel = NoKernel;
+  std::vector<uint32_t> Fields;
+  std::vector<uint32_t> Tokens;
+
+  uint32_t intern(StringRef S) {
+    auto It = StringIds.try_emplace(S, Strings.size());
+    if (It.second)
+      Strings.push_back(S.str());
+    return It.first->second;
+  }
+
+public:
+  void begin(RecordKind K, StringRef KernelName = StringRef()) {
+    Kind = K;
+    Kernel = KernelName.empty() ? NoKernel : intern(KernelName);
+    Fields.clear();
+    Tokens.clear();
+  }
+  void field(uint64_t V) { Fields.push_back(V); }
+  void token(StringRef T) { Tokens.push_back(intern(T)); }
+  void tokens(ArrayRef<std::string> Ts) {
+    for (auto &T : Ts)
+      token(T);
+  }
+  // Splits a whitespace separated string, e.g. a serialized tree, into tokens
+  void splitTokens(StringRef S) {
+    SmallVector<StringRef, 32> Parts;
+    SplitString(S, Parts);
+    for (auto P : Parts)
+      token(P);
+  }
+  void end() {
+    Words.push_back(Kind);
+    Words.push_back(Kernel);
+    Words.push_back(Fields.size());
+    Words.push_back(Tokens.size());
+    Words.insert(Words.end(), Fields.begin(), Fields.end());
+    Words.insert(Words.end(), Tokens.begin(), Tokens.end());
+    NumRecords++;
+    Kind = RK_NumKinds;
+  }
+
+  bool write(StringRef Path) const {
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC, sys::fs::OF_None);
+    if (EC) {
+      errs() << "Unable to open " << Path << ": " << EC.message() << "\n";
+      return false;
+    }
+    MetadataHeader H;
+    H.Magic = MetadataMagic;
+    H.Version = MetadataVersion;
+    H.NumStrings = Strings.size();
+    H.StringBytes = 0;
+    for (auto &S : Strings)
+      H.StringBytes += S.size() + 1;
+    // keep the offsets and records 4-byte aligned
+    uint32_t Pad = (4 - H.StringBytes % 4) % 4;
+    H.StringBytes += Pad;
+    H.NumRecords = NumRecords;
+    H.RecordWords = Words.size();
+    OS.write(reinterpret_cast<const char *>(&H), sizeof(H));
+    uint32_t Offset = 0;
+    for (auto &S : Strings) {
+      OS.write(reinterpret_cast<const char *>(&Offset), sizeof(Offset));
+      Offset += S.size() + 1;
+    }
+    for (auto &S : Strings) {
+      OS << S;
+      OS.write('\0');
+    }
+    OS.write_zeros(Pad);
+    OS.write(reinterpret_cast<const char *>(Words.data()),
+             Words.size() * sizeof(uint32_t));
+    return !OS.has_error();
+  }
+};
+
+class MetadataReader {
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const MetadataHeader *Header = nullptr;
+  const uint32_t *Offsets = nullptr;
+  const char *StringData = nullptr;
+  const uint32_t *Words = nullptr;
+
+public:
+  // Returns false, with a message, if the file is missing or malformed
+  bool open(StringRef Path) {
+    auto BufOrErr = MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                          /*RequiresNullTerminator=*/false);
+    if (!BufOrErr) {
+      errs() << "Unable to open " << Path << "\n";
+      return false;
+    }
+    Buffer = std::move(*BufOrErr);
+    size_t Size = Buffer->getBufferSize();
+    const char *Start = Buffer->getBufferStart();
+    if (Size < sizeof(MetadataHeader))
+      return invalid(Path);
+    Header = reinterpret_cast<const MetadataHeader *>(Start);
+    if (Header->Magic != MetadataMagic || Header->Version != MetadataVersion)
+      return invalid(Path);
+    size_t Expected = sizeof(MetadataHeader) +
+                      size_t(Header->NumStrings) * sizeof(uint32_t) +
+                      Header->StringBytes +
+                      size_t(Header->RecordWords) * sizeof(uint32_t);
+    if (Size != Expected)
+      return invalid(Path);
+    Offsets = reinterpret_cast<const uint32_t *>(Start + sizeof(MetadataHeader));
+    StringData = reinterpret_cast<const char *>(Offsets + Header->NumStrings);
+    Words = reinterpret_cast<const uint32_t *>(StringData + Header->StringBytes);
+    return true;
+  }
+
+  StringRef string(uint32_t Id) const {
+    if (Id >= Header->NumStrings)
+      return StringRef();
+    return StringRef(StringData + Offsets[Id]);
+  }
+
+  // Calls F(const MetadataRecord &) for every record, in file order
+  template <typename Fn> void forEach(Fn F) const {
+    if (!Header)
+      return;
+    const uint32_t *W = Words;
+    const uint32_t *End = Words + Header->RecordWords;
+    for (uint32_t R = 0; R < Header->NumRecords && W + 4 <= End; R++) {
+      MetadataRecord Rec;
+      Rec.Kind = static_cast<RecordKind>(W[0]);
+      Rec.Kernel = W[1] == NoKernel ? StringRef() : string(W[1]);
+      uint32_t NumFields = W[2], NumTokens = W[3];
+      W += 4;
+      if (W + NumFields + NumTokens > End)
+        return;
+      Rec.Fields = makeArrayRef(W, NumFields);
+      Rec.Tokens = makeArrayRef(W + NumFields, NumTokens);
+      W += NumFields + NumTokens;
+      F(Rec);
+    }
+  }
+
+private:
+  bool invalid(StringRef Path) {
+    errs() << Path << " is not a CudaAnalysis metadata file of version "
+           << MetadataVersion << "\n";
+    Header = nullptr;
+    return false;
+  }
+};
+
+} // namespace cuda_analysis
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_ANALYSISMETADATA_H
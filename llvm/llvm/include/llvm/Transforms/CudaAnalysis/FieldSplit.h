@@ -0,0 +1,73 @@
+//===- FieldSplit.h - Per-field arrays of kernel struct arrays --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Device side of the field split: the runtime may hand a kernel an array of
+// structs as one array per field, so that the fields the kernels never read
+// are not migrated and each field array is placed on its own. CudaAnalysis
+// writes an RK_FieldSplit record for every kernel pointer argument that is
+// only dereferenced field by field; this pass makes those kernels take the
+// argument either way. A pointer with bit FieldSplitTagShift set is the
+// split layout: a header with the byte offset from the pointer of the array
+// of each field, 0 for the ones left out, then the arrays. The host
+// transform, with -penguin-field-split, passes such pointers through
+// penguinFieldSplitPointer.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_FIELDSPLIT_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_FIELDSPLIT_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace llvm {
+
+class Argument;
+class CallBase;
+class Instruction;
+class StructType;
+
+namespace cuda_analysis {
+static constexpr unsigned FieldSplitTagShift = 63;
+// the masks of a record have a bit per field
+static constexpr unsigned FieldSplitMaxFields = 32;
+
+struct FieldAccesses {
+  StructType *Ty = nullptr;
+  uint32_t Loaded = 0;
+  uint32_t Stored = 0;
+  // the loads and stores of each field
+  SmallVector<SmallVector<Instruction *, 4>, 8> Accesses;
+  // calls the argument is passed on to, which the pass inlines
+  SmallVector<CallBase *, 4> Calls;
+};
+
+// True if the kernel only loads and stores the fields of the structs A
+// points at, through indexing and field addressing the pass can rewrite,
+// also in the functions it passes A on to. R gets the fields accessed.
+bool findFieldAccesses(Argument &A, FieldAccesses &R);
+} // namespace cuda_analysis
+
+// -passes=penguin-field-split, on the device module before codegen, with the
+// metadata of the same source
+struct FieldSplitPass : PassInfoMixin<FieldSplitPass> {
+  std::string MetadataPath;
+
+  explicit FieldSplitPass(std::string MetadataPath)
+      : MetadataPath(std::move(MetadataPath)) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_FIELDSPLIT_H
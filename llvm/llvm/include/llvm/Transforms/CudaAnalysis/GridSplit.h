@@ -0,0 +1,64 @@
+//===- GridSplit.h - Sub-grid launches of independent kernels ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Device side of the grid splitting: the runtime may issue a launch of a
+// kernel whose thread blocks don't depend on each other as a series of
+// sub-grids, prefetching and evicting between them. CudaAnalysis writes an
+// RK_GridSplit record for every such kernel; this pass gives each of them a
+// hidden last parameter, the place of its sub-grid in the full grid, and
+// rebases the blockIdx and gridDim reads on it. The host transform, with
+// -penguin-grid-split, launches the same kernels through
+// penguinLaunchKernelSplit, which passes the parameter on every launch. The
+// rebased index wraps around the full grid, so the runtime can also launch a
+// whole grid rotated, its blocks over resident data first.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_GRIDSPLIT_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_GRIDSPLIT_H
+
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace llvm {
+
+class Function;
+
+namespace cuda_analysis {
+// Hidden parameter: blockIdx offset of the sub-grid in the low 32 bits, the
+// blocks of the full grid along the split dimension in bits 32 to 62, and
+// bit 63 set if the sub-grids are rows of blockIdx.y rather than spans of
+// blockIdx.x. The offset index is taken modulo the blocks of the full grid.
+static constexpr unsigned GridSplitExtentShift = 32;
+static constexpr uint64_t GridSplitExtentMask = 0x7fffffffULL;
+static constexpr unsigned GridSplitYShift = 63;
+
+// True if no thread block of kernel F can observe another: no fence across
+// the grid, cmpxchg, atomic whose result is used, volatile access outside
+// shared memory or call the pass can't see into, and no callee that reads
+// blockIdx or gridDim.
+bool blocksAreIndependent(const Function &F);
+} // namespace cuda_analysis
+
+// -passes=penguin-grid-split, on the device module before codegen, with the
+// metadata of the same source
+struct GridSplitPass : PassInfoMixin<GridSplitPass> {
+  std::string MetadataPath;
+
+  explicit GridSplitPass(std::string MetadataPath)
+      : MetadataPath(std::move(MetadataPath)) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_GRIDSPLIT_H
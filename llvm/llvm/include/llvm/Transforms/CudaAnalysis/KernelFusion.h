@@ -0,0 +1,78 @@
+//===- KernelFusion.h - Fused producer/consumer kernels ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Device side of the kernel fusion: the runtime may run a launch of a kernel
+// that stores an array element-wise and the launch right after it, of one
+// that loads an array element-wise, as a single launch, so that the array is
+// not evicted between the two. Each thread of an element-wise kernel only
+// touches the element of its global index, blockIdx.x * blockDim.x +
+// threadIdx.x, of the arrays its arguments point at, all elements of the
+// same size; running the producer's thread and then the consumer's in one
+// thread of the same grid keeps every dependence between them. CudaAnalysis
+// writes an RK_KernelFusion record for such pairs; this pass adds the fused
+// kernel, which takes the parameters of the first kernel and then those of
+// the second. The host transform, with -penguin-kernel-fusion, launches
+// adjacent launches of a pair through penguinLaunchKernelFused, which checks
+// that their grids and arguments allow it. CudaAnalysis also writes an
+// RK_LoopTiling record for the element-wise kernels on their own, whose
+// launches in a host loop -penguin-loop-tiling lets the runtime run tile by
+// tile.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_KERNELFUSION_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_KERNELFUSION_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace llvm {
+
+class Function;
+
+namespace cuda_analysis {
+// the masks of a record have a bit per argument
+static constexpr unsigned FusionMaxArgs = 32;
+// pairs recorded per module, each one more kernel in the device code
+static constexpr unsigned FusionMaxPairs = 16;
+
+struct ElementWise {
+  uint64_t ElementBytes = 0;
+  uint32_t Loaded = 0;
+  uint32_t Stored = 0;
+};
+
+// True if every thread of kernel F only loads and stores the element of its
+// global index of the arrays its pointer arguments point at, besides its own
+// stack and constants, and calls nothing that accesses memory. R gets the
+// element size and the arguments loaded and stored.
+bool findElementWiseAccesses(const Function &F, ElementWise &R);
+
+inline std::string fusedKernelName(StringRef First, StringRef Second) {
+  return ("__penguin_fused_" + First + "_" + Second).str();
+}
+} // namespace cuda_analysis
+
+// -passes=penguin-kernel-fusion, on the device module before codegen, with
+// the metadata of the same source
+struct KernelFusionPass : PassInfoMixin<KernelFusionPass> {
+  std::string MetadataPath;
+
+  explicit KernelFusionPass(std::string MetadataPath)
+      : MetadataPath(std::move(MetadataPath)) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_KERNELFUSION_H
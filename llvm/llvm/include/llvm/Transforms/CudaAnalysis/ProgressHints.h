@@ -0,0 +1,37 @@
+//===- ProgressHints.h - Thread block progress counter ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Device side of the intra-kernel prefetch: the first thread of every block
+// of every kernel counts the block in penguin_progress_blocks, the device
+// variable penguin.h declares when built with PENGUIN_PROGRESS=1. The runtime
+// polls the counter during a long launch and prefetches the pages of the
+// waves of blocks about to start. Modules without the variable are left
+// alone.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_PROGRESSHINTS_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_PROGRESSHINTS_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+namespace cuda_analysis {
+// Device variable the blocks are counted in
+static constexpr const char *ProgressCounterName = "penguin_progress_blocks";
+} // namespace cuda_analysis
+
+// -passes=penguin-progress-hints, on the device module before codegen
+struct ProgressHintsPass : PassInfoMixin<ProgressHintsPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_PROGRESSHINTS_H
@@ -0,0 +1,49 @@
+//===- ReadOnly.h - Read-only kernel pointer arguments ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Kernel pointer arguments that are only loaded from. CudaAnalysis writes an
+// RK_ReadOnly record listing them for every kernel; the host transform, with
+// -penguin-read-mostly, marks the allocations that only ever go to such
+// arguments read mostly. This pass marks the ones no store of the kernel can
+// reach noalias and readonly, which NVPTX lowers to ld.global.nc, the
+// non-coherent data path, as it does for const __restrict__ parameters.
+// Arguments only stored to go in an RK_WriteOnly record, for the outputs
+// -penguin-write-stream leaves on the host, and the arguments atomics update
+// in an RK_Atomic one, for the runtime to keep on the GPU.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_CUDAANALYSIS_READONLY_H
+#define LLVM_TRANSFORMS_CUDAANALYSIS_READONLY_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+class Argument;
+
+namespace cuda_analysis {
+// True if nothing the kernel, or a function it calls, does with A or a
+// pointer computed from it writes memory or lets the pointer escape.
+bool isOnlyLoaded(const Argument &A);
+// True if A and the pointers computed from it are only stored to, whole or
+// through memset and memcpy destinations, and never loaded or escape.
+bool isOnlyStored(const Argument &A);
+// True if an atomic of the kernel, or of a function it calls, updates memory
+// through A or a pointer computed from it.
+bool isAtomicTarget(const Argument &A);
+} // namespace cuda_analysis
+
+// -passes=penguin-read-only, on the device module before codegen
+struct ReadOnlyPass : PassInfoMixin<ReadOnlyPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+} // namespace llvm
+
+#endif // LLVM_TRANSFORMS_CUDAANALYSIS_READONLY_H
@@ -0,0 +1,73 @@
+//===- AccessSampling.cpp - Sampled global accesses per 2MB block ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/AccessSampling.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-access-sampling"
+
+// NVPTX global memory; generic pointers may point there too
+static constexpr unsigned GlobalAddressSpace = 1;
+
+// The address a load or store of global memory of the allocations accesses,
+// null for other instructions and for the stack and device globals
+static Value *sampledAddress(Instruction &I) {
+  Value *Ptr = nullptr;
+  if (auto *Load = dyn_cast<LoadInst>(&I))
+    Ptr = Load->getPointerOperand();
+  else if (auto *Store = dyn_cast<StoreInst>(&I))
+    Ptr = Store->getPointerOperand();
+  else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I))
+    Ptr = RMW->getPointerOperand();
+  else if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(&I))
+    Ptr = CmpXchg->getPointerOperand();
+  if (!Ptr)
+    return nullptr;
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+  if (AS != 0 && AS != GlobalAddressSpace)
+    return nullptr;
+  const Value *Object = getUnderlyingObject(Ptr);
+  if (isa<AllocaInst>(Object) || isa<GlobalVariable>(Object))
+    return nullptr;
+  return Ptr;
+}
+
+PreservedAnalyses AccessSamplingPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  Function *Sample = M.getFunction(cuda_analysis::SampleFunctionName);
+  if (!Sample || Sample->isDeclaration() || Sample->arg_size() != 1 ||
+      !Sample->getArg(0)->getType()->isPointerTy())
+    return PreservedAnalyses::all();
+  Type *Param = Sample->getArg(0)->getType();
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration() || &F == Sample)
+      continue;
+    SmallVector<std::pair<Instruction *, Value *>, 32> Accesses;
+    for (Instruction &I : instructions(F))
+      if (Value *Ptr = sampledAddress(I))
+        Accesses.push_back({&I, Ptr});
+    for (auto &Access : Accesses) {
+      IRBuilder<> B(Access.first);
+      B.CreateCall(Sample,
+                   B.CreatePointerBitCastOrAddrSpaceCast(Access.second, Param));
+    }
+    Changed |= !Accesses.empty();
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -8,29 +8,54 @@
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/BlockFrequencyInfoImpl.h"
 #include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopNestAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Pass.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/CudaAnalysis/AccessSampling.h"
+#include "llvm/Transforms/CudaAnalysis/AnalysisMetadata.h"
+#include "llvm/Transforms/CudaAnalysis/FieldSplit.h"
+#include "llvm/Transforms/CudaAnalysis/GridSplit.h"
+#include "llvm/Transforms/CudaAnalysis/KernelFusion.h"
+#include "llvm/Transforms/CudaAnalysis/ProgressHints.h"
+#include "llvm/Transforms/CudaAnalysis/ReadOnly.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
 
 #include <algorithm>
 #include <bits/types/FILE.h>
 #include <cstddef>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <queue>
 #include <set>
@@ -46,6 +71,26 @@ using namespace llvm;
 
 #define DEBUG_TYPE "CudaAnalysis"
 
+static cl::opt<std::string>
+    MetadataFile("cuda-analysis-metadata",
+                 cl::desc("File the analysis results are handed to the host "
+                          "transform in"),
+                 cl::init(cuda_analysis::DefaultMetadataFile));
+
+static cl::opt<std::string>
+    AnalysisCache("cuda-analysis-cache",
+                  cl::desc("Directory the metadata of every analyzed module "
+                           "is kept in, by a hash of its IR, for later runs "
+                           "on the same IR to reuse"),
+                  cl::init(""));
+
+static cl::opt<unsigned>
+    InlineDepth("cuda-analysis-inline-depth",
+                cl::desc("Levels of device function calls the kernels are "
+                         "analyzed through, on a copy of the module with the "
+                         "calls inlined; 0 analyzes the kernels as they are"),
+                cl::init(4));
+
 static unsigned AccessID= 0;
 
 namespace {
@@ -127,6 +172,7 @@ struct CudaAnalysis : public FunctionPass {
   static char ID; // Pass identification, replacement for typeid
                   //
   std::vector<Instruction *> SeenPhiNodes;
+  std::set<Instruction *> PrintedBack;
   std::vector<Value *> SharedMemoryPointers;
   std::vector<Value *> KernelArgVector;
   std::set<Value *> TerminalValues; // terminal values are like blockIdx, kernel-arguments, 
@@ -149,6 +195,9 @@ struct CudaAnalysis : public FunctionPass {
   std::map<Loop *, unsigned int> LoopToInitialValue;
   std::map<Loop *, unsigned int> LoopToFinalValue;
   std::map<Loop *, unsigned int> LoopToStepValue;
+  // closed-form trip count from ScalarEvolution, in the prefix tokens of the
+  // loop records, for the loops whose bounds aren't constant
+  std::map<Loop *, std::vector<std::string>> LoopToTripCountMap;
 
   std::map<Value *, SpecialValueType> SpecialValues;
   std::map<Value *, SpecialValueType> GridDimValues;
@@ -164,6 +213,14 @@ struct CudaAnalysis : public FunctionPass {
   std::map<Value *, Loop*> MemoryOpToEnclosingLoopMap;
   std::map<Value *, Value*> MemoryOpToPointerMap;
 
+  // Per kernel caches of the expression walkers. A tree only depends on the
+  // value and the terminals, which are fixed once findSpecialValues has run.
+  std::map<Value *, std::vector<Value *>> ExpressionTreeCache;
+  std::map<Value *, std::string> SerializedTreeCache;
+  // phis on the path of the running serialization, with their depth
+  std::map<Value *, unsigned> SerializePath;
+  static constexpr unsigned NoPathPhi = ~0U;
+
   std::map<Value *, unsigned long int> BranchToBranchIdMapping;
   std::map<Value *, bool> BranchProcessed;
   std::map<Value *, Value*> MemoryOpToIfBranch;
@@ -172,20 +229,19 @@ struct CudaAnalysis : public FunctionPass {
   std::map<PHINode*, unsigned> PhiNodeToUIDMap;
   unsigned int phiNodeUIDCounter = 0;
 
-  std::ofstream AccessDetailFile; // ("access_detail_file.lst");
-  std::ofstream AccessTreeFile; // ("access_tree_file.lst");
-  std::ofstream ReuseDetailfile;  // ("reuse_detail_file.lst");
-  std::ofstream LoopDetailFile;  // ("loop_detail_file.lst");
-  std::ofstream IfDetailFile;  // ("if_detail_file.lst");
-  std::ofstream SelectOpsFile;  // ("select_ops_file.lst");
-  std::ofstream SmallTressFile;  // ("small_trees_file.lst");
-  std::ofstream PhiToLoopFile;  // ("phi_loop_file.lst");
+  // loop, access, access tree, if, phi and reuse records for the host pass,
+  // written to -cuda-analysis-metadata in doFinalization
+  cuda_analysis::MetadataWriter Metadata;
 
   unsigned long int LoopId = 0;
   unsigned long int BranchId = 0;
 
   CudaAnalysis() : FunctionPass(ID) {}
 
+  // Function analyses, from the legacy or the new pass manager
+  std::function<LoopInfo &(Function &)> GetLI;
+  std::function<ScalarEvolution &(Function &)> GetSE;
+
   void printBack(GetElementPtrInst *G);
   void recursivePrintBack(Instruction *I);
   // bool isSpecialRegisterRead(CallInst *V);
@@ -202,7 +258,8 @@ struct CudaAnalysis : public FunctionPass {
 
   std::string convertValueToString(Value * V);
   vector<std::string> convertValuesToStrings(std::vector<Value *> Values);
-  void serializeExpressionTree(Value* V, std::ostringstream &out, std::set<Value*> PhiNodesVisited);
+  void serializeExpressionTree(Value *V, std::string &Out);
+  unsigned serializeExpressionNode(Value *V, std::string &Out);
 
   std::vector<Value*> getExpressionTree(Value *V);
   bool isPointerChase(Value* V); // do not use this. this is wrong.
@@ -212,7 +269,20 @@ struct CudaAnalysis : public FunctionPass {
   std::vector<Value*> handleNonConstantLoopBoundDFS(Value *V);
   Value* findPointerForGivenOp(Value* V);
   bool isDataDependent(Value *V);
-  unsigned long handleNonConstantLoopBounds(Loop::LoopBounds &LI);
+  unsigned long handleNonConstantLoopBounds(Loop *L, ScalarEvolution &SE);
+  bool convertSCEVToTokens(const SCEV *S, ScalarEvolution &SE,
+                           std::vector<std::string> &Tokens, int Bound = 0);
+  unsigned broadcastAxes(const SCEV *Offset);
+  const SCEV *threadStride(const SCEV *S, ScalarEvolution &SE);
+  bool writeFootprint(Instruction *MemOp, Value *Arg, ScalarEvolution &SE);
+  void writeBranch(Instruction *MemOp, ScalarEvolution &SE,
+                   BranchProbabilityInfo &BPI);
+  void writeGridSplit(Module &M);
+  void writeFieldSplit(Module &M);
+  void writeReadOnly(Module &M);
+  void writeKernelFusion(Module &M);
+  void writeLoopTiling(Module &M);
+  uint64_t computeTileReuse(Instruction *MemOp, LoopInfo &LI);
   bool computeIterations(LoopInfo &LI, ScalarEvolution &SE, Function &F);
   bool computeIterationsUsingBFI(LoopInfo &LI, ScalarEvolution &SE,
                                  Function &F);
@@ -240,18 +310,30 @@ struct CudaAnalysis : public FunctionPass {
   bool isIfConditionalBB(BasicBlock* BB);
 
   bool doInitialization(Module &M) override {
-    AccessDetailFile.open("access_detail_file.lst");
-    AccessTreeFile.open("access_tree_file.lst");
-    ReuseDetailfile.open("reuse_detail_file.lst");
-    LoopDetailFile.open("loop_detail_file.lst");
-    IfDetailFile.open("if_detail_file.lst");
-    SelectOpsFile.open("select_ops_file.lst");
-    SmallTressFile.open("small_trees_file.lst");
-    PhiToLoopFile.open("phi_loop_file.lst");
+    return false;
+  }
+
+  bool doFinalization(Module &M) override {
+    writeGridSplit(M);
+    writeFieldSplit(M);
+    writeReadOnly(M);
+    writeKernelFusion(M);
+    writeLoopTiling(M);
+    Metadata.write(MetadataFile);
     return false;
   }
 
   bool runOnFunction(Function &F) override {
+    GetLI = [this](Function &) -> LoopInfo & {
+      return getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    };
+    GetSE = [this](Function &) -> ScalarEvolution & {
+      return getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+    };
+    return runImpl(F);
+  }
+
+  bool runImpl(Function &F) {
     PointerInfoMap.clear();
     KernelArgVector.clear();
     MemoryOpToNumAccessMap.clear();
@@ -267,9 +349,11 @@ struct CudaAnalysis : public FunctionPass {
     LoopToFinalValue.clear();
     LoopToStepValue.clear();
     PhiNodeToUIDMap.clear();
+    ExpressionTreeCache.clear();
+    SerializedTreeCache.clear();
 
-    errs() << "Kernel CudaAnalysis: ";
-    errs().write_escaped(F.getName()) << '\n';
+    LLVM_DEBUG(dbgs() << "Kernel CudaAnalysis: ");
+    LLVM_DEBUG(dbgs().write_escaped(F.getName()) << '\n');
     // errs() << "Kernel arguments : \n";
 
     if(F.getName().compare("_Z7getNodejbP12_PixelOfNode")==0) return false;
@@ -284,15 +368,15 @@ struct CudaAnalysis : public FunctionPass {
     if(F.getName().compare("_Z2rcc")==0) return false;
 
     for (auto &Arg : F.args()) {
-      Arg.dump();
-      Arg.getType()->dump();
+      LLVM_DEBUG(Arg.dump());
+      LLVM_DEBUG(Arg.getType()->dump());
       KernelArgVector.push_back(&Arg);
       if (isa<llvm::PointerType>(Arg.getType())) {
         if (Arg.hasByValAttr()) {
           // Arg.getParamByValType()->dump();
           if (Arg.getParamByValType()->isStructTy()) {
-             errs() << "struct type\n";
-             Arg.getParamByValType()->dump();
+             LLVM_DEBUG(dbgs() << "struct type\n");
+             LLVM_DEBUG(Arg.getParamByValType()->dump());
              ByValArgsSet.insert(&Arg);
           }
           KernelArgTypeMap[&Arg] = ArgTypeStructByValue;
@@ -319,14 +403,14 @@ struct CudaAnalysis : public FunctionPass {
       
     }
 
-    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-    ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+    LoopInfo &LI = GetLI(F);
+    ScalarEvolution &SE = GetSE(F);
 
     findSpecialValues(F);
-    errs() << "TERMINAL VALUES\n";
+    LLVM_DEBUG(dbgs() << "TERMINAL VALUES\n");
     for (auto TermIter = TerminalValues.begin();
          TermIter != TerminalValues.end(); TermIter++) {
-      (*TermIter)->dump();
+      LLVM_DEBUG((*TermIter)->dump());
       // errs() << ArgTypeNames[KernelArgTypeMap[*ArgIter]] << "\n";
     }
       
@@ -347,8 +431,7 @@ struct CudaAnalysis : public FunctionPass {
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<LoopInfoWrapperPass>();
     AU.addRequired<ScalarEvolutionWrapperPass>();
-    AU.addRequired<BlockFrequencyInfoWrapperPass>();
-    AU.addRequired<BranchProbabilityInfoWrapperPass>();
+    AU.setPreservesAll();
   }
 };
 
@@ -368,10 +451,10 @@ bool CudaAnalysis::isInsideConditional(Value* V) {
   auto I = dyn_cast<Instruction> (V);
   auto B = I->getParent();
   auto pred = B->getSinglePredecessor();
-  B->dump();
+  LLVM_DEBUG(B->dump());
   if(pred) {
     if(isIfConditionalBB(pred)) {
-      errs() << "if ending bb\n";
+      LLVM_DEBUG(dbgs() << "if ending bb\n");
       /* pred->dump(); */
       Instruction* cond = pred->getTerminator();
       /* cond->getOperand(0)->dump(); */
@@ -379,21 +462,21 @@ bool CudaAnalysis::isInsideConditional(Value* V) {
       /* cond->getOperand(2)->dump(); */
       // Extermely curiously, the order in IR and the order of operands not match up!
       if(cond->getOperand(1) == B) {
-        errs() << "false\n";
-        cond->dump();
+        LLVM_DEBUG(dbgs() << "false\n");
+        LLVM_DEBUG(cond->dump());
         MemoryOpToIfBranch[I] = cond;
         MemoryOpToIfType[I] = false;
       } 
       if(cond->getOperand(2) == B) {
-        errs() << "true\n";
-        cond->dump();
+        LLVM_DEBUG(dbgs() << "true\n");
+        LLVM_DEBUG(cond->dump());
         MemoryOpToIfBranch[I] = cond;
         MemoryOpToIfType[I] = true;
       } 
       if(BranchToBranchIdMapping.find(cond) == BranchToBranchIdMapping.end()){
-        errs() << "new branch ID\n";
+        LLVM_DEBUG(dbgs() << "new branch ID\n");
         BranchToBranchIdMapping[cond] = ++ BranchId;
-        cond->getOperand(0)->dump();
+        LLVM_DEBUG(cond->getOperand(0)->dump());
         BranchProcessed[cond] = false;
         // recuse with select operations
       }
@@ -410,7 +493,10 @@ bool CudaAnalysis::isInsideConditional(Value* V) {
 }
 
 void CudaAnalysis::recursivePrintBack(Instruction *I) {
-  I->dump();
+  // shared subexpressions are printed once
+  if (!PrintedBack.insert(I).second)
+    return;
+  LLVM_DEBUG(I->dump());
   for (auto *OpIter = I->op_begin(); OpIter != I->op_end(); OpIter++) {
     Value *V = dyn_cast<Value>(*OpIter);
     /* V->dump(); */
@@ -418,19 +504,19 @@ void CudaAnalysis::recursivePrintBack(Instruction *I) {
     if (In) {
       if (auto *CI = dyn_cast<CallInst>(In)) {
         if (isSpecialRegisterRead(CI)) {
-          errs() << "register read\n";
+          LLVM_DEBUG(dbgs() << "register read\n");
           return;
         }
       }
       if (isPhiNode(In)) {
-        errs() << "PHI node\n";
+        LLVM_DEBUG(dbgs() << "PHI node\n");
         /* In->dump(); */
         auto It = std::find(SeenPhiNodes.begin(), SeenPhiNodes.end(), In);
         if (It != SeenPhiNodes.end()) {
-          errs() << "found in list\n";
+          LLVM_DEBUG(dbgs() << "found in list\n");
           return;
         }
-        errs() << "NOT found in list\n";
+        LLVM_DEBUG(dbgs() << "NOT found in list\n");
         SeenPhiNodes.push_back(In);
         recursivePrintBack(In);
       }
@@ -440,15 +526,16 @@ void CudaAnalysis::recursivePrintBack(Instruction *I) {
 }
 
 void CudaAnalysis::printBack(GetElementPtrInst *G) {
-  errs() << "examination\n";
-  errs() << "pointer : ";
-  G->getPointerOperand()->dump();
+  LLVM_DEBUG(dbgs() << "examination\n");
+  LLVM_DEBUG(dbgs() << "pointer : ");
+  LLVM_DEBUG(G->getPointerOperand()->dump());
   for (auto *OpIter = G->idx_begin(); OpIter != G->idx_end(); OpIter++) {
     Value *V = dyn_cast<Value>(*OpIter);
     Instruction *I = dyn_cast<Instruction>(*OpIter);
     if (I) {
-      errs() << "found instruction, initiating recursive print back\n";
+      LLVM_DEBUG(dbgs() << "found instruction, initiating recursive print back\n");
       SeenPhiNodes.clear();
+      PrintedBack.clear();
       recursivePrintBack(I);
     }
   }
@@ -456,7 +543,7 @@ void CudaAnalysis::printBack(GetElementPtrInst *G) {
 
 // we are assuming one of the operands to be const or blockid or the entire tree be made of terminal leaves
 std::string CudaAnalysis::getMultiplierString(Value *Multiplier) {
-  Multiplier->dump();
+  LLVM_DEBUG(Multiplier->dump());
   assert(isa<BinaryOperator>(Multiplier));
   if (auto *MulInst = dyn_cast<BinaryOperator>(Multiplier)) {
     Value *Oper0 = MulInst->getOperand(0);
@@ -510,7 +597,7 @@ std::string CudaAnalysis::getMultiplierString(Value *Multiplier) {
 bool CudaAnalysis::isSharedMemoryAccess(Value *V) {
   if (isa<llvm::PointerType>(V->getType())) {
     // errs() << "dumping\n";
-    V->dump();
+    LLVM_DEBUG(V->dump());
     // V->getType()->dump();
     if (auto *U = dyn_cast<User>(V)) {
       // errs() << "user \n";
@@ -583,9 +670,9 @@ bool CudaAnalysis::computeIterationsUsingBFI(LoopInfo &LI, ScalarEvolution &SE,
   auto BPI = BranchProbabilityInfo(F, LI);
   auto BFI = BlockFrequencyInfo(F, BPI, LI);
   for (auto &BB : F) {
-    BB.dump();
-    errs() << BFI.getBlockFreq(&BB).getFrequency();
-    errs() << "\n\n";
+    LLVM_DEBUG(BB.dump());
+    LLVM_DEBUG(dbgs() << BFI.getBlockFreq(&BB).getFrequency());
+    LLVM_DEBUG(dbgs() << "\n\n");
   }
   return false;
 }
@@ -605,8 +692,8 @@ bool CudaAnalysis::isTerminalValue(Value *V) {
 
 // NOTE: must have identified all terminals before calling this function
 void CudaAnalysis::collectTerminalSources(Value *V) {
-  errs() << "Identifying terminal sources for \n";
-  V->dump();
+  LLVM_DEBUG(dbgs() << "Identifying terminal sources for \n");
+  LLVM_DEBUG(V->dump());
   std::stack<Value *> ValueQueue;
   std::set<Value *> Visited;
   ValueQueue.push(V);
@@ -615,14 +702,15 @@ void CudaAnalysis::collectTerminalSources(Value *V) {
     Top = ValueQueue.top();
     // Top->dump();
     ValueQueue.pop();
-    Visited.insert(Top);
+    if (!Visited.insert(Top).second)
+      continue;
     if (auto *In = dyn_cast<Instruction>(Top)) {
       for (auto &Operand : In->operands()) {
         // Check if terminal
         Value *U = dyn_cast<Value>(&Operand);
         if (isTerminalValue(U)) {
-          errs() << "Found Terminal \n";
-          Operand->dump();
+          LLVM_DEBUG(dbgs() << "Found Terminal \n");
+          LLVM_DEBUG(Operand->dump());
         } else {
           ValueQueue.push(U);
         }
@@ -634,29 +722,29 @@ void CudaAnalysis::collectTerminalSources(Value *V) {
 
 // Check if V is dependent on U
 bool CudaAnalysis::isDependent(Value *V, Value *U) {
-  errs() << "Checking dependency\n";
-  V->dump();
-  U->dump();
+  LLVM_DEBUG(dbgs() << "Checking dependency\n");
+  LLVM_DEBUG(V->dump());
+  LLVM_DEBUG(U->dump());
   std::stack<Value *> ValueQueue;
   std::set<Value *> Visited;
   ValueQueue.push(V);
   Value *Top;
   while (!ValueQueue.empty()) {
     Top = ValueQueue.top();
-    Top->dump();
+    LLVM_DEBUG(Top->dump());
     ValueQueue.pop();
     if (Visited.find(Top) != Visited.end()) {
       continue;
     }
     Visited.insert(Top);
     if (auto *In = dyn_cast<Instruction>(Top)) {
-      In->dump();
+      LLVM_DEBUG(In->dump());
       for (auto &Operand : In->operands()) {
         Value *O = dyn_cast<Value>(&Operand);
-        O->dump();
+        LLVM_DEBUG(O->dump());
         if (O == U) {
-          errs() << "Found U \n";
-          Operand->dump();
+          LLVM_DEBUG(dbgs() << "Found U \n");
+          LLVM_DEBUG(Operand->dump());
           return true;
         }
         ValueQueue.push(O);
@@ -666,45 +754,646 @@ bool CudaAnalysis::isDependent(Value *V, Value *U) {
   return false;
 }
 
-unsigned long CudaAnalysis::handleNonConstantLoopBounds(Loop::LoopBounds &lpb) {
-  errs() << "hello from non constant loop bound handler\n";
-  Value &VInitial = lpb.getInitialIVValue();
-  Value &VFinal = lpb.getFinalIVValue();
-  Value *VSteps = lpb.getStepValue();
+// Trip count of a loop whose bounds aren't constant, from ScalarEvolution.
+// The closed form, over kernel arguments and block dims, goes in
+// LoopToTripCountMap for the host transform to evaluate at the launch; the
+// return value is the trip count if it is constant, 0 otherwise.
+unsigned long CudaAnalysis::handleNonConstantLoopBounds(Loop *L,
+                                                         ScalarEvolution &SE) {
+  LLVM_DEBUG(dbgs() << "hello from non constant loop bound handler\n");
+  const SCEV *BackedgeTaken = SE.getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BackedgeTaken))
+    BackedgeTaken = SE.getSymbolicMaxBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BackedgeTaken)) {
+    LLVM_DEBUG(dbgs() << "UNHANDLED PATTERN\n");
+    return 0;
+  }
+  const SCEV *TripCount =
+      SE.getTripCountFromExitCount(BackedgeTaken, /*Extend=*/false);
+  LLVM_DEBUG(TripCount->dump());
+  std::vector<std::string> Tokens;
+  if (!convertSCEVToTokens(TripCount, SE, Tokens)) {
+    LLVM_DEBUG(dbgs() << "UNHANDLED PATTERN\n");
+    return 0;
+  }
+  for (auto &T : Tokens)
+    LLVM_DEBUG(dbgs() << T << " ");
+  LLVM_DEBUG(dbgs() << "\n");
+  LoopToTripCountMap[L] = Tokens;
+  if (auto *Const = dyn_cast<SCEVConstant>(TripCount))
+    return Const->getValue()->getZExtValue();
+  return 0;
+}
 
-  VInitial.dump();
-  VFinal.dump();
-  VSteps->dump();
+// Appends S to Tokens in prefix order, "OP left right", the order the host
+// transform builds its expression trees from. Only the terms the host can
+// evaluate at a launch are taken: constants, kernel arguments, block and grid
+// dims. With Bound 0 the block and thread indices are taken as 0, which gives
+// the trip count of the first thread, the longest for the usual strided loops.
+// With Bound 1 (-1) the tokens are an upper (lower) bound of S over the
+// launch: the indices and the recurrences of the loops take their largest
+// (smallest) value, and the kernel arguments are assumed non-negative. Bound
+// 2 (-2) is the same for the first thread block, the block indices are 0. A min
+// or max against a constant, as loop guards leave behind, is taken as its
+// other operand. A sum with negative terms is written as a difference so that
+// the host, which computes in unsigned, never sees a negative constant.
+bool CudaAnalysis::convertSCEVToTokens(const SCEV *S, ScalarEvolution &SE,
+                                       std::vector<std::string> &Tokens,
+                                       int Bound) {
+  if (auto *Const = dyn_cast<SCEVConstant>(S)) {
+    const APInt &V = Const->getAPInt();
+    if (V.isNegative() || !V.isIntN(31))
+      return false;
+    Tokens.push_back(std::to_string(V.getZExtValue()));
+    return true;
+  }
+  if (auto *Unknown = dyn_cast<SCEVUnknown>(S)) {
+    Value *V = Unknown->getValue();
+    auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), V);
+    if (It != KernelArgVector.end()) {
+      Tokens.push_back("ARG" + std::to_string(It - KernelArgVector.begin()));
+      return true;
+    }
+    auto Axis = AxisValues.find(V);
+    if (Axis == AxisValues.end())
+      return false;
+    const char *Dim = nullptr;
+    switch (Axis->second) {
+    case AXIS_TYPE_BDIMX:
+    case AXIS_TYPE_BDIMY:
+      Tokens.push_back(AxisValueNames[Axis->second]);
+      return true;
+    case AXIS_TYPE_BIDX:
+      Dim = Bound == 2 || Bound == -2 ? nullptr : "GDIMX";
+      break;
+    case AXIS_TYPE_BIDY:
+      Dim = Bound == 2 || Bound == -2 ? nullptr : "GDIMY";
+      break;
+    case AXIS_TYPE_TIDX:
+      Dim = "BDIMX";
+      break;
+    case AXIS_TYPE_TIDY:
+      Dim = "BDIMY";
+      break;
+    default:
+      return false;
+    }
+    if (Bound > 0 && Dim) {
+      Tokens.push_back("SUB");
+      Tokens.push_back(Dim);
+      Tokens.push_back("1");
+    } else {
+      Tokens.push_back("0");
+    }
+    return true;
+  }
+  if (auto *Cast = dyn_cast<SCEVCastExpr>(S))
+    return convertSCEVToTokens(Cast->getOperand(), SE, Tokens, Bound);
+  if (auto *Add = dyn_cast<SCEVAddExpr>(S)) {
+    SmallVector<const SCEV *, 4> Added, Subtracted;
+    for (auto *Op : Add->operands()) {
+      const SCEV *Coefficient = Op;
+      if (auto *Mul = dyn_cast<SCEVMulExpr>(Op))
+        Coefficient = Mul->getOperand(0);
+      auto *Const = dyn_cast<SCEVConstant>(Coefficient);
+      if (Const && Const->getAPInt().isNegative())
+        Subtracted.push_back(SE.getNegativeSCEV(Op));
+      else
+        Added.push_back(Op);
+    }
+    if (Added.empty())
+      return false;
+    if (!Subtracted.empty())
+      Tokens.push_back("SUB");
+    for (unsigned I = 0; I + 1 < Added.size(); I++)
+      Tokens.push_back("ADD");
+    for (auto *Op : Added)
+      if (!convertSCEVToTokens(Op, SE, Tokens, Bound))
+        return false;
+    for (unsigned I = 0; I + 1 < Subtracted.size(); I++)
+      Tokens.push_back("ADD");
+    for (auto *Op : Subtracted)
+      if (!convertSCEVToTokens(Op, SE, Tokens, -Bound))
+        return false;
+    return true;
+  }
+  if (auto *Mul = dyn_cast<SCEVMulExpr>(S)) {
+    for (unsigned I = 0; I + 1 < Mul->getNumOperands(); I++)
+      Tokens.push_back("MUL");
+    for (auto *Op : Mul->operands())
+      if (!convertSCEVToTokens(Op, SE, Tokens, Bound))
+        return false;
+    return true;
+  }
+  if (auto *Div = dyn_cast<SCEVUDivExpr>(S)) {
+    Tokens.push_back("UDIV");
+    return convertSCEVToTokens(Div->getLHS(), SE, Tokens, Bound) &&
+           convertSCEVToTokens(Div->getRHS(), SE, Tokens, -Bound);
+  }
+  if (isa<SCEVMinMaxExpr>(S) || isa<SCEVSequentialMinMaxExpr>(S)) {
+    const SCEV *Variable = nullptr;
+    for (auto *Op : cast<SCEVNAryExpr>(S)->operands()) {
+      if (isa<SCEVConstant>(Op))
+        continue;
+      if (Variable)
+        return false;
+      Variable = Op;
+    }
+    return Variable && convertSCEVToTokens(Variable, SE, Tokens, Bound);
+  }
+  if (auto *AddRec = dyn_cast<SCEVAddRecExpr>(S)) {
+    // a trip count over the recurrence of an outer loop has no closed form
+    if (Bound == 0 || !AddRec->isAffine())
+      return false;
+    auto *Step = dyn_cast<SCEVConstant>(AddRec->getStepRecurrence(SE));
+    bool Increasing = !Step || !Step->getAPInt().isNegative();
+    if ((Bound > 0) != Increasing)
+      return convertSCEVToTokens(AddRec->getStart(), SE, Tokens, Bound);
+    const SCEV *BackedgeTaken = SE.getBackedgeTakenCount(AddRec->getLoop());
+    if (isa<SCEVCouldNotCompute>(BackedgeTaken))
+      BackedgeTaken = SE.getSymbolicMaxBackedgeTakenCount(AddRec->getLoop());
+    if (isa<SCEVCouldNotCompute>(BackedgeTaken))
+      return false;
+    return convertSCEVToTokens(AddRec->evaluateAtIteration(BackedgeTaken, SE),
+                               SE, Tokens, Bound);
+  }
+  return false;
+}
 
-  auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), &VInitial);
-  if (It != KernelArgVector.end()) {
-    errs() << "FOUND KERNEL ARG for non constant loop bound\n";
+// Shared memory reads each element of a tile fill feeds: for a global load
+// whose value is stored into a __shared__ array, the iterations of the loads
+// of that array over those of the fill, per thread as every other count; 1
+// for any other access. The fill then costs one transfer for K accesses.
+uint64_t CudaAnalysis::computeTileReuse(Instruction *MemOp, LoopInfo &LI) {
+  auto *LdI = dyn_cast<LoadInst>(MemOp);
+  if (!LdI)
+    return 1;
+  const Value *Tile = nullptr;
+  for (User *U : LdI->users()) {
+    auto *SI = dyn_cast<StoreInst>(U);
+    if (!SI || SI->getValueOperand() != LdI)
+      continue;
+    const Value *Obj = getUnderlyingObject(SI->getPointerOperand());
+    if (Obj->getType()->getPointerAddressSpace() == 3)
+      Tile = Obj;
+  }
+  if (!Tile)
+    return 1;
+  auto Iters = [&](Instruction *I) -> uint64_t {
+    if (Loop *L = LI.getLoopFor(I->getParent())) {
+      auto It = LoopToTotalIterMapping.find(L);
+      if (It != LoopToTotalIterMapping.end() && It->second)
+        return It->second;
+    }
+    return 1;
+  };
+  uint64_t Reads = 0;
+  for (Instruction &I : instructions(*LdI->getFunction()))
+    if (auto *SL = dyn_cast<LoadInst>(&I))
+      if (getUnderlyingObject(SL->getPointerOperand()) == Tile)
+        Reads += Iters(SL);
+  return std::max<uint64_t>(1, Reads / Iters(LdI));
+}
+
+// Byte range of the kernel argument a memory operation accesses in a launch,
+// as a LO and a HI bound for the host transform, and in the first thread
+// block, as BLO and BHI; HI and BHI are offsets of the last element. Accesses
+// whose offset from the argument isn't an affine function of the loops, the
+// indices and the arguments have none.
+// The grid axes, 1 for x and 2 for y, whose block index an offset doesn't
+// depend on, if it depends on a scalar kernel argument: the thread blocks
+// along them all read the slice the argument selects, the pivot row k of a
+// blocked Floyd-Warshall say. 0 for any other offset.
+unsigned CudaAnalysis::broadcastAxes(const SCEV *Offset) {
+  auto Uses = [&](AxisValueType Type) {
+    return SCEVExprContains(Offset, [&](const SCEV *S) {
+      auto *Unknown = dyn_cast<SCEVUnknown>(S);
+      if (!Unknown)
+        return false;
+      auto Axis = AxisValues.find(Unknown->getValue());
+      return Axis != AxisValues.end() && Axis->second == Type;
+    });
+  };
+  bool Selected = SCEVExprContains(Offset, [&](const SCEV *S) {
+    auto *Unknown = dyn_cast<SCEVUnknown>(S);
+    return Unknown && !Unknown->getType()->isPointerTy() &&
+           std::find(KernelArgVector.begin(), KernelArgVector.end(),
+                     Unknown->getValue()) != KernelArgVector.end();
+  });
+  if (!Selected)
+    return 0;
+  return (Uses(AXIS_TYPE_BIDX) ? 0 : 1) | (Uses(AXIS_TYPE_BIDY) ? 0 : 2);
+}
+
+// The change of S from a thread to the next one along x, the derivative of
+// S in threadIdx.x: the bytes between the elements neighbouring threads of a
+// warp access, for a byte offset. Null if S isn't linear in threadIdx.x.
+const SCEV *CudaAnalysis::threadStride(const SCEV *S, ScalarEvolution &SE) {
+  auto IsThread = [&](const SCEV *E) {
+    auto *Unknown = dyn_cast<SCEVUnknown>(E);
+    if (!Unknown)
+      return false;
+    auto Axis = AxisValues.find(Unknown->getValue());
+    return Axis != AxisValues.end() && Axis->second == AXIS_TYPE_TIDX;
+  };
+  if (!SCEVExprContains(S, IsThread))
+    return S->getType()->isPointerTy() ? nullptr : SE.getZero(S->getType());
+  if (IsThread(S))
+    return SE.getOne(S->getType());
+  if (auto *Cast = dyn_cast<SCEVCastExpr>(S)) {
+    if (Cast->getOperand()->getType()->isPointerTy())
+      return nullptr;
+    const SCEV *D = threadStride(Cast->getOperand(), SE);
+    return D ? SE.getTruncateOrSignExtend(D, S->getType()) : nullptr;
+  }
+  if (auto *Add = dyn_cast<SCEVAddExpr>(S)) {
+    SmallVector<const SCEV *, 4> Terms;
+    for (auto *Op : Add->operands()) {
+      const SCEV *D = threadStride(Op, SE);
+      if (!D)
+        return nullptr;
+      Terms.push_back(D);
+    }
+    return SE.getAddExpr(Terms);
+  }
+  if (auto *Mul = dyn_cast<SCEVMulExpr>(S)) {
+    // a product is linear if a single factor is
+    SmallVector<const SCEV *, 4> Factors;
+    const SCEV *D = nullptr;
+    for (auto *Op : Mul->operands()) {
+      if (!SCEVExprContains(Op, IsThread)) {
+        Factors.push_back(Op);
+        continue;
+      }
+      if (D)
+        return nullptr;
+      D = threadStride(Op, SE);
+      if (!D)
+        return nullptr;
+    }
+    Factors.push_back(D);
+    return SE.getMulExpr(Factors);
+  }
+  // the same step for every thread
+  if (auto *AddRec = dyn_cast<SCEVAddRecExpr>(S))
+    if (AddRec->isAffine() &&
+        !SCEVExprContains(AddRec->getStepRecurrence(SE), IsThread))
+      return threadStride(AddRec->getStart(), SE);
+  return nullptr;
+}
+
+bool CudaAnalysis::writeFootprint(Instruction *MemOp, Value *Arg,
+                                  ScalarEvolution &SE) {
+  Value *Ptr = getLoadStorePointerOperand(MemOp);
+  if (!Ptr || !SE.isSCEVable(Ptr->getType()))
+    return false;
+  const SCEV *Offset = SE.getMinusSCEV(SE.getSCEV(Ptr), SE.getSCEV(Arg));
+  if (isa<SCEVCouldNotCompute>(Offset))
+    return false;
+  LLVM_DEBUG(Offset->dump());
+  std::vector<std::string> Lo, Hi, BlockLo, BlockHi;
+  if (!convertSCEVToTokens(Offset, SE, Lo, -1) ||
+      !convertSCEVToTokens(Offset, SE, Hi, 1) ||
+      !convertSCEVToTokens(Offset, SE, BlockLo, -2) ||
+      !convertSCEVToTokens(Offset, SE, BlockHi, 2))
+    return false;
+  const DataLayout &DL = MemOp->getModule()->getDataLayout();
+  Metadata.begin(cuda_analysis::RK_Footprint, MemOp->getFunction()->getName());
+  Metadata.field(MemoryOpToAccessIDMap[MemOp]);
+  Metadata.field(std::find(KernelArgVector.begin(), KernelArgVector.end(), Arg) -
+                 KernelArgVector.begin());
+  Metadata.field(DL.getTypeStoreSize(getLoadStoreType(MemOp)));
+  Metadata.field(isa<LoadInst>(MemOp) ? broadcastAxes(Offset) : 0);
+  Metadata.token("LO");
+  Metadata.tokens(Lo);
+  Metadata.token("HI");
+  Metadata.tokens(Hi);
+  Metadata.token("BLO");
+  Metadata.tokens(BlockLo);
+  Metadata.token("BHI");
+  Metadata.tokens(BlockHi);
+  std::vector<std::string> Stride;
+  const SCEV *D = threadStride(Offset, SE);
+  if (D && convertSCEVToTokens(D, SE, Stride)) {
+    Metadata.token("TS");
+    Metadata.tokens(Stride);
+  }
+  Metadata.end();
+  return true;
+}
+
+// An analysis remark on kernel F for a record of the kernel as a whole
+static void remarkKernel(const Function &F, StringRef Name,
+                         const Twine &Message) {
+  OptimizationRemarkEmitter ORE(&F);
+  ORE.emit([&]() {
+    return OptimizationRemarkAnalysis(DEBUG_TYPE, Name, &F) << Message.str();
+  });
+}
+
+// Kernels whose thread blocks the runtime may launch as separate sub-grids,
+// with the number of parameters the launches pass them before the hidden one
+void CudaAnalysis::writeGridSplit(Module &M) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    if (!F || !cuda_analysis::blocksAreIndependent(*F))
+      continue;
+    LLVM_DEBUG(dbgs() << "thread blocks of " << F->getName() << " are independent\n");
+    remarkKernel(*F, "GridSplit", "thread blocks are independent");
+    Metadata.begin(cuda_analysis::RK_GridSplit, F->getName());
+    Metadata.field(F->arg_size());
+    Metadata.end();
   }
+}
 
-  // check for VFinal being dependent on VInitial by iterating over non-terminal
-  // operands recursively.
-  if (isDependent(&VFinal, &VInitial)) {
-    if (auto *In = dyn_cast<Instruction>(&VFinal)) {
-      if (In->getOpcode() == Instruction::Add) {
-        for (auto &Operand : In->operands()) {
-          if (dyn_cast<Value>(&Operand) == &VInitial) {
-            errs() << "ADD\n";
-            In->dump();
-          }
-        }
-      } else if (In->getOpcode() == Instruction::Mul) {
-        errs() << "MUL\n";
-        In->dump();
-      } else {
-        errs() << "UNHANDLED PATTERN\n";
+// Pointer arguments to arrays of structs that the kernel only accesses field
+// by field, and for which a layout by field pays: some field is never
+// accessed, so it needn't be migrated, or some is accessed in deeper loops
+// than the others, e.g. the key of a search, so its pages are denser.
+void CudaAnalysis::writeFieldSplit(Module &M) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  const DataLayout &DL = M.getDataLayout();
+  std::map<Function *, std::pair<std::unique_ptr<DominatorTree>,
+                                 std::unique_ptr<LoopInfo>>>
+      Loops;
+  auto Depth = [&](Instruction *I) {
+    Function *F = I->getFunction();
+    auto &L = Loops[F];
+    if (!L.first) {
+      L.first = std::make_unique<DominatorTree>(*F);
+      L.second = std::make_unique<LoopInfo>(*L.first);
+    }
+    return L.second->getLoopDepth(I->getParent());
+  };
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    if (!F || F->isDeclaration())
+      continue;
+    for (Argument &A : F->args()) {
+      cuda_analysis::FieldAccesses R;
+      if (!cuda_analysis::findFieldAccesses(A, R) || !(R.Loaded | R.Stored))
+        continue;
+      unsigned NumFields = R.Ty->getNumElements();
+      bool Unused = (R.Loaded | R.Stored) != (uint32_t)((1ULL << NumFields) - 1);
+      unsigned MinDepth = ~0U, MaxDepth = 0;
+      for (auto &Accesses : R.Accesses) {
+        if (Accesses.empty())
+          continue;
+        unsigned D = 0;
+        for (Instruction *I : Accesses)
+          D = std::max(D, Depth(I));
+        MinDepth = std::min(MinDepth, D);
+        MaxDepth = std::max(MaxDepth, D);
+      }
+      if (!Unused && MinDepth == MaxDepth)
+        continue;
+      LLVM_DEBUG(dbgs() << "argument " << A.getArgNo() << " of " << F->getName()
+             << " can be split by field\n");
+      remarkKernel(*F, "FieldSplit",
+                   "argument " + Twine(A.getArgNo()) + " can be split by field");
+      const StructLayout *SL = DL.getStructLayout(R.Ty);
+      Metadata.begin(cuda_analysis::RK_FieldSplit, F->getName());
+      Metadata.field(A.getArgNo());
+      Metadata.field(SL->getSizeInBytes());
+      Metadata.field(R.Loaded);
+      Metadata.field(R.Stored);
+      Metadata.field(NumFields);
+      for (unsigned Field = 0; Field < NumFields; Field++) {
+        Metadata.field(SL->getElementOffset(Field));
+        Metadata.field(DL.getTypeAllocSize(R.Ty->getElementType(Field)));
       }
+      Metadata.end();
     }
-    // collectTerminalSources(&VFinal);
   }
+}
 
-  // TODO: check for VInitial and VFinal being multiples or strides of each other.
+void CudaAnalysis::writeReadOnly(Module &M) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    if (!F || F->isDeclaration())
+      continue;
+    std::vector<unsigned> Loaded, Stored, Atomic;
+    for (Argument &A : F->args()) {
+      if (cuda_analysis::isOnlyLoaded(A))
+        Loaded.push_back(A.getArgNo());
+      else if (cuda_analysis::isOnlyStored(A))
+        Stored.push_back(A.getArgNo());
+      else if (cuda_analysis::isAtomicTarget(A))
+        Atomic.push_back(A.getArgNo());
+    }
+    auto Write = [&](cuda_analysis::RecordKind RK,
+                     const std::vector<unsigned> &Args, StringRef Remark,
+                     const Twine &What) {
+      if (Args.empty())
+        return;
+      std::string List;
+      Metadata.begin(RK, F->getName());
+      for (unsigned Arg : Args) {
+        Metadata.field(Arg);
+        List += (List.empty() ? "" : " ") + std::to_string(Arg);
+      }
+      Metadata.end();
+      remarkKernel(*F, Remark, What + List);
+    };
+    Write(cuda_analysis::RK_ReadOnly, Loaded, "ReadOnly",
+          "arguments only loaded from: ");
+    Write(cuda_analysis::RK_WriteOnly, Stored, "WriteOnly",
+          "arguments only stored to: ");
+    Write(cuda_analysis::RK_Atomic, Atomic, "Atomic",
+          "arguments atomics update: ");
+  }
+}
 
-  return 0;
+// Pairs of element-wise kernels, the first storing an array and the second
+// loading one, with elements of the same size; the fused kernel's blocks are
+// as independent as theirs, so it gets its own RK_GridSplit record
+void CudaAnalysis::writeKernelFusion(Module &M) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  std::vector<std::pair<Function *, cuda_analysis::ElementWise>> Kernels;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    cuda_analysis::ElementWise R;
+    if (F && cuda_analysis::findElementWiseAccesses(*F, R) &&
+        cuda_analysis::blocksAreIndependent(*F))
+      Kernels.push_back({F, R});
+  }
+  unsigned Pairs = 0;
+  for (auto &First : Kernels) {
+    for (auto &Second : Kernels) {
+      if (!First.second.Stored || !Second.second.Loaded ||
+          First.second.ElementBytes != Second.second.ElementBytes ||
+          Pairs == cuda_analysis::FusionMaxPairs)
+        continue;
+      std::string Fused = cuda_analysis::fusedKernelName(
+          First.first->getName(), Second.first->getName());
+      LLVM_DEBUG(dbgs() << First.first->getName() << " and " << Second.first->getName()
+             << " may run fused\n");
+      remarkKernel(*First.first, "KernelFusion",
+                   "may run fused with " + Second.first->getName());
+      Metadata.begin(cuda_analysis::RK_KernelFusion, First.first->getName());
+      Metadata.field(First.first->arg_size());
+      Metadata.field(Second.first->arg_size());
+      Metadata.field(First.second.ElementBytes);
+      Metadata.field(First.second.Loaded);
+      Metadata.field(First.second.Stored);
+      Metadata.field(Second.second.Loaded);
+      Metadata.field(Second.second.Stored);
+      Metadata.token(Second.first->getName());
+      Metadata.token(Fused);
+      Metadata.end();
+      Metadata.begin(cuda_analysis::RK_GridSplit, Fused);
+      Metadata.field(First.first->arg_size() + Second.first->arg_size());
+      Metadata.end();
+      Pairs++;
+    }
+  }
+}
+
+// Element-wise kernels with independent blocks: a thread of one launch only
+// depends on the same thread of the launch before it, so the launches of a
+// host loop may run over one tile of the grid after the other
+void CudaAnalysis::writeLoopTiling(Module &M) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    cuda_analysis::ElementWise R;
+    if (!F || !cuda_analysis::findElementWiseAccesses(*F, R) ||
+        !cuda_analysis::blocksAreIndependent(*F))
+      continue;
+    remarkKernel(*F, "LoopTiling", "launches may run tile by tile");
+    Metadata.begin(cuda_analysis::RK_LoopTiling, F->getName());
+    Metadata.field(R.ElementBytes);
+    Metadata.field(R.Loaded);
+    Metadata.field(R.Stored);
+    Metadata.end();
+  }
+}
+
+// Likelihood that a memory operation under a conditional runs, for the host
+// transform to scale its access count by: the edge probability of
+// BranchProbabilityInfo and, when the condition compares an index the launch
+// ranges over with a bound of the launch (the usual boundary check), the
+// bounds of both sides, LT when the access runs for indices below LIM and GE
+// when at or above it, so that the host computes the share of the indices
+// that pass.
+void CudaAnalysis::writeBranch(Instruction *MemOp, ScalarEvolution &SE,
+                               BranchProbabilityInfo &BPI) {
+  auto If = MemoryOpToIfBranch.find(MemOp);
+  if (If == MemoryOpToIfBranch.end())
+    return;
+  auto *Br = dyn_cast<BranchInst>(If->second);
+  if (!Br || !Br->isConditional())
+    return;
+  unsigned Succ = Br->getSuccessor(0) == MemOp->getParent() ? 0 : 1;
+  BranchProbability Prob = BPI.getEdgeProbability(Br->getParent(), Succ);
+  Metadata.begin(cuda_analysis::RK_Branch, MemOp->getFunction()->getName());
+  Metadata.field(MemoryOpToAccessIDMap[MemOp]);
+  Metadata.field(Prob.scale(1 << 16));
+
+  auto *Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+  if (!Cmp || !SE.isSCEVable(Cmp->getOperand(0)->getType())) {
+    Metadata.end();
+    return;
+  }
+  CmpInst::Predicate Pred =
+      Succ == 0 ? Cmp->getPredicate() : Cmp->getInversePredicate();
+  const SCEV *Index = SE.getSCEV(Cmp->getOperand(0));
+  const SCEV *Limit = SE.getSCEV(Cmp->getOperand(1));
+  // the same tokens at both bounds: the side doesn't vary over the launch
+  auto Bounds = [&](const SCEV *S, std::vector<std::string> &Lo,
+                    std::vector<std::string> &Hi) {
+    Lo.clear();
+    Hi.clear();
+    return convertSCEVToTokens(S, SE, Lo, -1) &&
+           convertSCEVToTokens(S, SE, Hi, 1);
+  };
+  std::vector<std::string> Lo, Hi, LimLo, LimHi;
+  bool Known = Bounds(Index, Lo, Hi) && Bounds(Limit, LimLo, LimHi);
+  if (Known && Lo == Hi && LimLo != LimHi) {
+    std::swap(Index, Limit);
+    Pred = CmpInst::getSwappedPredicate(Pred);
+    Known = Bounds(Index, Lo, Hi) && Bounds(Limit, LimLo, LimHi);
+  }
+  if (!Known || Lo == Hi || LimLo != LimHi) {
+    Metadata.end();
+    return;
+  }
+  // i <= n is i < n + 1, i > n is i >= n + 1
+  const char *Kind = nullptr;
+  bool PlusOne = false;
+  switch (Pred) {
+  case CmpInst::ICMP_ULT:
+  case CmpInst::ICMP_SLT:
+    Kind = "LT";
+    break;
+  case CmpInst::ICMP_ULE:
+  case CmpInst::ICMP_SLE:
+    Kind = "LT";
+    PlusOne = true;
+    break;
+  case CmpInst::ICMP_UGE:
+  case CmpInst::ICMP_SGE:
+    Kind = "GE";
+    break;
+  case CmpInst::ICMP_UGT:
+  case CmpInst::ICMP_SGT:
+    Kind = "GE";
+    PlusOne = true;
+    break;
+  default:
+    break;
+  }
+  if (Kind) {
+    Metadata.token(Kind);
+    Metadata.token("LO");
+    Metadata.tokens(Lo);
+    Metadata.token("HI");
+    Metadata.tokens(Hi);
+    Metadata.token("LIM");
+    if (PlusOne)
+      Metadata.token("ADD");
+    Metadata.tokens(LimLo);
+    if (PlusOne)
+      Metadata.token("1");
+  }
+  Metadata.end();
 }
 
 bool CudaAnalysis::isPointerChaseFixed(Value* V) {
@@ -712,19 +1401,19 @@ bool CudaAnalysis::isPointerChaseFixed(Value* V) {
   std::set<Value*> Visited;
   std::set<Value*> PhiNodesVisited;
 
-  errs() << "is pointer chase fixing\n";
+  LLVM_DEBUG(dbgs() << "is pointer chase fixing\n");
   Stack.push(V);
 
   bool foundOnce = false;
 
   while (!Stack.empty()) {
     Value *Current = Stack.top();
-    Current->dump();
+    LLVM_DEBUG(Current->dump());
     Stack.pop();
     if(Current == V) {
       if (foundOnce == true) {
-        errs() << "is indeed PC: ";
-        V->dump();
+        LLVM_DEBUG(dbgs() << "is indeed PC: ");
+        LLVM_DEBUG(V->dump());
         return true;
       } else {
         foundOnce = true;
@@ -734,7 +1423,7 @@ bool CudaAnalysis::isPointerChaseFixed(Value* V) {
       continue;
     }
     if(Visited.find(Current) != Visited.end()) {
-      errs() << "hi visited already\n";
+      LLVM_DEBUG(dbgs() << "hi visited already\n");
     /*   continue; */
     }
     if(TerminalValues.find(Current)!=TerminalValues.end()){
@@ -752,13 +1441,13 @@ bool CudaAnalysis::isPointerChaseFixed(Value* V) {
         // then skip it, 
         // else if the gep leads to another 
         if(PointerInfoMap.find(GEPI->getPointerOperand()) != PointerInfoMap.end()){
-          errs() << "found in pim " ;
-          GEPI->getPointerOperand()->dump();
+          LLVM_DEBUG(dbgs() << "found in pim " );
+          LLVM_DEBUG(GEPI->getPointerOperand()->dump());
           for(int i = 1; i < GEPI->getNumIndices() + 1; i++){ // indices not includes the pointer 
             Stack.push(GEPI->getOperand(i));
           }
         } else {
-          errs() << "not found in pim " ;
+          LLVM_DEBUG(dbgs() << "not found in pim " );
           for(int i = 0; i < GEPI->getNumIndices() + 1; i++){ // indices not includes the pointer 
             Stack.push(GEPI->getOperand(i));
           }
@@ -782,8 +1471,8 @@ bool CudaAnalysis::isPointerChaseFixed(Value* V) {
 
 // recursively traverses the expression tree and checks for pointer chase loops
 bool CudaAnalysis::isPointerChase(Value* V) {
-  errs() << "\nstart is pointer chase : ";
-  V->dump();
+  LLVM_DEBUG(dbgs() << "\nstart is pointer chase : ");
+  LLVM_DEBUG(V->dump());
 
   std::stack<Value*> Stack;
   std::set<Value*> Visited;
@@ -794,8 +1483,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
 
   while (!Stack.empty()) {
     Value *Current = Stack.top();
-    errs() << "top: ";
-    Current->dump();
+    LLVM_DEBUG(dbgs() << "top: ");
+    LLVM_DEBUG(Current->dump());
     if(Visited.find(Current) == Visited.end()){
       OnStack.insert(Current);
       Visited.insert(Current);
@@ -817,8 +1506,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
         /* Stack.push(LI->getPointerOperand()); */
         auto oper = LI->getPointerOperand();
           if ((OnStack.find(oper) != OnStack.end()) && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -827,8 +1516,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
         /* Stack.push(SI->getPointerOperand()); */
         auto oper = SI->getPointerOperand();
           if ((OnStack.find(oper) != OnStack.end()) && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -842,8 +1531,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
             /* Stack.push(GEPI->getOperand(i)); */
             auto oper = GEPI->getOperand(i);
           if ((OnStack.find(oper) != OnStack.end()) && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -854,8 +1543,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
             /* Stack.push(GEPI->getOperand(i)); */
             auto oper = GEPI->getOperand(i);
           if ((OnStack.find(oper) != OnStack.end()) && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -867,8 +1556,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
           /* Stack.push(Operand); */
           auto oper = dyn_cast<Value>(Operand);
           if ((OnStack.find(oper) != OnStack.end()) && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -878,7 +1567,7 @@ bool CudaAnalysis::isPointerChase(Value* V) {
       } else if (auto * CI = dyn_cast<CallInst>(In)) {
         auto *Callee = CI->getCalledFunction();
         if (Callee->getName() == "llvm.nvvm.shfl.sync.idx.i32") {
-          errs() << "found a special funcion\n";
+          LLVM_DEBUG(dbgs() << "found a special funcion\n");
           /* for(auto arg = CI->arg_begin(); arg != CI->arg_end(); arg++) { */
           /*   if(auto argval = dyn_cast<Value>(arg)){ */
           /*     argval->dump(); */
@@ -886,12 +1575,12 @@ bool CudaAnalysis::isPointerChase(Value* V) {
           /* } */
           auto arg1 = CI->getArgOperand(1);
           auto arg1val = dyn_cast<Value>(arg1);
-          arg1->dump();
+          LLVM_DEBUG(arg1->dump());
           /* Stack.push(arg1val); */
           auto oper = arg1val;
           if (OnStack.find(oper) != OnStack.end() && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -902,8 +1591,8 @@ bool CudaAnalysis::isPointerChase(Value* V) {
           /* Stack.push(Operand); */
           auto oper = dyn_cast<Value>(Operand);
           if (OnStack.find(oper) != OnStack.end() && (PhiNodesVisited.find(oper) == PhiNodesVisited.end())){
-            errs() << "FOUND POINTER CHASE\n";
-            oper->dump();
+            LLVM_DEBUG(dbgs() << "FOUND POINTER CHASE\n");
+            LLVM_DEBUG(oper->dump());
             return true;
           } else if((Visited.find(oper) == Visited.end())){ 
             Stack.push(oper);
@@ -913,22 +1602,26 @@ bool CudaAnalysis::isPointerChase(Value* V) {
       continue;
     }
   }
-  errs() << "end is pointer chase\n\n";
+  LLVM_DEBUG(dbgs() << "end is pointer chase\n\n");
   return false;
 }
 
 std::vector<Value *> CudaAnalysis::getExpressionTree(Value *V) {
+  auto Cached = ExpressionTreeCache.find(V);
+  if (Cached != ExpressionTreeCache.end())
+    return Cached->second;
+
   std::vector<Value*> RPN(0);
   std::stack<Value*> Stack;
   std::set<Value*> Visited;
   std::set<Value*> PhiNodesVisited;
 
-  errs() << "Getting Expression Tree\n";
+  LLVM_DEBUG(dbgs() << "Getting Expression Tree\n");
   Stack.push(V);
 
   while (!Stack.empty()) {
     Value *Current = Stack.top();
-    Current->dump();
+    LLVM_DEBUG(Current->dump());
     Stack.pop();
     if(PhiNodesVisited.find(Current) != PhiNodesVisited.end()) {
       RPN.push_back(Current);
@@ -936,7 +1629,7 @@ std::vector<Value *> CudaAnalysis::getExpressionTree(Value *V) {
     }
     RPN.push_back(Current);
     if(Visited.find(Current) != Visited.end()) {
-      errs() << "hi visited already\n";
+      LLVM_DEBUG(dbgs() << "hi visited already\n");
     /*   continue; */
     }
     if(TerminalValues.find(Current)!=TerminalValues.end()){
@@ -977,18 +1670,19 @@ std::vector<Value *> CudaAnalysis::getExpressionTree(Value *V) {
     }
   }
 
-errs() << "RPN \n";
+LLVM_DEBUG(dbgs() << "RPN \n");
   for (auto RPNIter = RPN.begin(); RPNIter != RPN.end(); RPNIter++) {
     if(TerminalValues.find(*RPNIter)!=TerminalValues.end() || isa<ConstantInt> (*RPNIter)){
-      errs() << "terminal ";
+      LLVM_DEBUG(dbgs() << "terminal ");
     }
     else {
-      errs() << "operand ";
+      LLVM_DEBUG(dbgs() << "operand ");
     }
-    (*RPNIter)->dump();
+    LLVM_DEBUG((*RPNIter)->dump());
   }
-  errs() << "\n";
+  LLVM_DEBUG(dbgs() << "\n");
 
+  ExpressionTreeCache[V] = RPN;
   return RPN;
 }
 
@@ -998,7 +1692,7 @@ bool CudaAnalysis::isDataDependent(Value *V) {
   std::set<Value*> Visited;
   std::set<Value*> PhiNodesVisited;
 
-  errs() << "checking for data dependencies \n";
+  LLVM_DEBUG(dbgs() << "checking for data dependencies \n");
   Stack.push(V);
 
   while (!Stack.empty()) {
@@ -1022,10 +1716,10 @@ bool CudaAnalysis::isDataDependent(Value *V) {
         Stack.push(SI->getPointerOperand());
       } else if (auto * GEPI = dyn_cast<GetElementPtrInst>(In)) {
         if(ByValArgsSet.find(GEPI->getPointerOperand())  != ByValArgsSet.end()){
-          errs() << "found indirect access to struct element\n";
+          LLVM_DEBUG(dbgs() << "found indirect access to struct element\n");
         }
         if(PointerInfoMap.find(GEPI->getPointerOperand())  != PointerInfoMap.end()){
-          errs() << "found indirect access to kernel arg pointer\n";
+          LLVM_DEBUG(dbgs() << "found indirect access to kernel arg pointer\n");
           return true;
         }
         for(int i = 1; i < GEPI->getNumIndices() + 1; i++){ // indices not includes the pointer 
@@ -1056,17 +1750,17 @@ Value* CudaAnalysis::findPointerForGivenOp(Value *V) {
   Stack.push(V);
   while (!Stack.empty()) {
     Value *Current = Stack.top();
-    Current->dump();
+    LLVM_DEBUG(Current->dump());
     Stack.pop();
     if(PhiNodesVisited.find(Current) != PhiNodesVisited.end()) {
       continue;
     }
     if(Visited.find(Current) != Visited.end()) {
-      errs() << "hi\n";
+      LLVM_DEBUG(dbgs() << "hi\n");
       continue;
     }
     if(TerminalValues.find(Current)!=TerminalValues.end()){
-      errs() << "Found terminal\n";
+      LLVM_DEBUG(dbgs() << "Found terminal\n");
       return Current;
     }
     // iterate through operands
@@ -1103,19 +1797,19 @@ std::vector<Value *> CudaAnalysis::handleNonConstantLoopBoundDFS(Value *V) {
   std::set<Value*> Visited;
   std::set<Value*> PhiNodesVisited;
 
-  errs() << "Handling non-constant loop bound with DFS\n";
+  LLVM_DEBUG(dbgs() << "Handling non-constant loop bound with DFS\n");
   Stack.push(V);
 
   while (!Stack.empty()) {
     Value *Current = Stack.top();
-    Current->dump();
+    LLVM_DEBUG(Current->dump());
     Stack.pop();
     if(PhiNodesVisited.find(Current) != PhiNodesVisited.end()) {
       RPN.push_back(Current);
       continue;
     }
     if(Visited.find(Current) != Visited.end()) {
-      errs() << "hi\n";
+      LLVM_DEBUG(dbgs() << "hi\n");
       continue;
     }
     RPN.push_back(Current);
@@ -1148,41 +1842,41 @@ std::vector<Value *> CudaAnalysis::handleNonConstantLoopBoundDFS(Value *V) {
     }
   }
 
-errs() << "RPN \n";
+LLVM_DEBUG(dbgs() << "RPN \n");
   for (auto RPNIter = RPN.begin(); RPNIter != RPN.end(); RPNIter++) {
     if(TerminalValues.find(*RPNIter)!=TerminalValues.end() || isa<ConstantInt> (*RPNIter)){
-      errs() << "terminal ";
+      LLVM_DEBUG(dbgs() << "terminal ");
     }
     else {
-      errs() << "operand ";
+      LLVM_DEBUG(dbgs() << "operand ");
     }
-    (*RPNIter)->dump();
+    LLVM_DEBUG((*RPNIter)->dump());
   }
-  errs() << "\n";
+  LLVM_DEBUG(dbgs() << "\n");
 
   return RPN;
 }
 
 Value *CudaAnalysis::handleNonConstantLoopBound(Value *V) {
-  errs() << "HANDLING non constant loop bound\n";
+  LLVM_DEBUG(dbgs() << "HANDLING non constant loop bound\n");
   // V->dump();
   auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), V);
   if (It != KernelArgVector.end()) {
-    errs() << "FOUND KERNEL ARG for non constant loop bound\n";
+    LLVM_DEBUG(dbgs() << "FOUND KERNEL ARG for non constant loop bound\n");
     return V;
   }
-  errs() << "Checking inside\n";
+  LLVM_DEBUG(dbgs() << "Checking inside\n");
   if (auto *I = dyn_cast_or_null<Instruction>(V)) {
     auto Iter = std::find(KernelArgVector.begin(), KernelArgVector.end(),
                           I->getOperand(0));
     if (Iter != KernelArgVector.end()) {
-      errs() << "FOUND KERNEL ARG for non constant loop bound INDIRECTLY\n";
+      LLVM_DEBUG(dbgs() << "FOUND KERNEL ARG for non constant loop bound INDIRECTLY\n");
       return I->getOperand(0);
     }
   }
   auto GDIt = GridDimValues.find(V);
   if (GDIt != GridDimValues.end()) {
-    errs() << "FOUND GRID DIM value in loop bound\n";
+    LLVM_DEBUG(dbgs() << "FOUND GRID DIM value in loop bound\n");
     return V;
   }
   return nullptr;
@@ -1191,13 +1885,13 @@ Value *CudaAnalysis::handleNonConstantLoopBound(Value *V) {
 std::string 
 CudaAnalysis::convertValueToString(Value* V) {
     if(TerminalValues.find(V) != TerminalValues.end()){
-        errs() << "terminal value\n";
+        LLVM_DEBUG(dbgs() << "terminal value\n");
         auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), V);
         if(It != KernelArgVector.end()) {
             std::string arg = "ARG";
             auto argid = It - KernelArgVector.begin();
             arg.append(std::to_string(argid));
-            errs() << argid << "\n";
+            LLVM_DEBUG(dbgs() << argid << "\n");
             return (arg);
         }
         auto AxIter = AxisValues.find(V);
@@ -1206,12 +1900,12 @@ CudaAnalysis::convertValueToString(Value* V) {
         }
     }
     if(isa<ConstantInt>(V)){
-        errs() << "constant\n";
+        LLVM_DEBUG(dbgs() << "constant\n");
         auto Value = dyn_cast<ConstantInt>(V);
         return (std::to_string(Value->getSExtValue()));
     }
     if(isa<ConstantFP>(V)){
-        errs() << "constant\n";
+        LLVM_DEBUG(dbgs() << "constant\n");
         auto Value = dyn_cast<ConstantFP>(V);
         std::string fpStr;
         llvm::raw_string_ostream rso(fpStr);
@@ -1219,98 +1913,98 @@ CudaAnalysis::convertValueToString(Value* V) {
         return rso.str();
     }
     if(isa<UndefValue>(V)){
-        errs() << "undef value\n";
+        LLVM_DEBUG(dbgs() << "undef value\n");
         auto Value = dyn_cast<UndefValue>(V);
         return std::string("UNDEF");
     }
     if(isa<Instruction>(V)) {
-        errs() << "instruction\n";
+        LLVM_DEBUG(dbgs() << "instruction\n");
         auto In = dyn_cast<Instruction>(V);
-        errs() << In->getOpcodeName() << "\n";
+        LLVM_DEBUG(dbgs() << In->getOpcodeName() << "\n");
         if (isa<BinaryOperator>(In)) {
             if (In->getOpcode() == Instruction::Add) {
-                errs() << "add\n";
+                LLVM_DEBUG(dbgs() << "add\n");
                 return std::string("ADD");
             }
             if (In->getOpcode() == Instruction::Sub) {
-                errs() << "sub\n";
+                LLVM_DEBUG(dbgs() << "sub\n");
                 return std::string("SUB");
             }
             if (In->getOpcode() == Instruction::Or) {
-                errs() << "or\n";
+                LLVM_DEBUG(dbgs() << "or\n");
                 return std::string("OR");
             }
             if (In->getOpcode() == Instruction::And) {
-                errs() << "and\n";
+                LLVM_DEBUG(dbgs() << "and\n");
                 return std::string("AND");
             }
             if (In->getOpcode() == Instruction::Mul) {
-                errs() << "Mul\n";
+                LLVM_DEBUG(dbgs() << "Mul\n");
                 return std::string("MUL");
             }
             if (In->getOpcode() == Instruction::UDiv) {
-                errs() << "UDiv\n";
+                LLVM_DEBUG(dbgs() << "UDiv\n");
                 return std::string("UDIV");
             }
             if (In->getOpcode() == Instruction::SDiv) {
-                errs() << "SDiv\n";
+                LLVM_DEBUG(dbgs() << "SDiv\n");
                 return std::string("SDIV");
             }
             if (In->getOpcode() == Instruction::SRem) {
-                errs() << "SRem\n";
+                LLVM_DEBUG(dbgs() << "SRem\n");
                 return std::string("SREM");
             }
             if (In->getOpcode() == Instruction::Shl) {
-                errs() << "Shl\n";
+                LLVM_DEBUG(dbgs() << "Shl\n");
                 return std::string("SHL");
             }
             if (In->getOpcode() == Instruction::LShr) {
-                errs() << "LShr\n";
+                LLVM_DEBUG(dbgs() << "LShr\n");
                 return std::string("LSHR");
             }
             if (In->getOpcode() == Instruction::Xor) {
-                errs() << "Xor\n";
+                LLVM_DEBUG(dbgs() << "Xor\n");
                 return std::string("XOR");
             }
             if (In->getOpcode() == Instruction::FDiv) {
-                errs() << "FDiv\n";
+                LLVM_DEBUG(dbgs() << "FDiv\n");
                 return std::string("FDIV");
             }
             if (In->getOpcode() == Instruction::FMul) {
-                errs() << "FMul\n";
+                LLVM_DEBUG(dbgs() << "FMul\n");
                 return std::string("FMUL");
             }
         }
         if (In->getOpcode() == Instruction::ICmp) {
-            errs() << "Icmp\n";
+            LLVM_DEBUG(dbgs() << "Icmp\n");
             return std::string("ICMP");
         }
         if (In->getOpcode() == Instruction::FCmp) {
-            errs() << "Fcmp\n";
+            LLVM_DEBUG(dbgs() << "Fcmp\n");
             return std::string("FCMP");
         }
         if (In->getOpcode() == Instruction::FPToSI) {
-            errs() << "FPToSI\n";
+            LLVM_DEBUG(dbgs() << "FPToSI\n");
             return std::string("FPTOSI");
         }
         if (In->getOpcode() == Instruction::UIToFP) {
-            errs() << "UIToFP\n";
+            LLVM_DEBUG(dbgs() << "UIToFP\n");
             return std::string("UITOFP");
         }
         if (In->getOpcode() == Instruction::SIToFP) {
-            errs() << "SIToFP\n";
+            LLVM_DEBUG(dbgs() << "SIToFP\n");
             return std::string("SITOFP");
         }
         if (In->getOpcode() == Instruction::Call) {
-            errs() << "Call\n";
+            LLVM_DEBUG(dbgs() << "Call\n");
             return std::string("CALL");
         }
         if (In->getOpcode() == Instruction::AtomicRMW) {
-            errs() << "AtomicRmw\n";
+            LLVM_DEBUG(dbgs() << "AtomicRmw\n");
             return std::string("ATOMICRMW");
         }
         if (In->getOpcode() == Instruction::PHI) {
-            errs() << "Phi\n";
+            LLVM_DEBUG(dbgs() << "Phi\n");
             unsigned phiNodeUID = 0;
             PHINode* PhiNodeInst = dyn_cast<PHINode>(In);
             if(PhiNodeToUIDMap.find(PhiNodeInst) != PhiNodeToUIDMap.end()) {
@@ -1322,40 +2016,40 @@ CudaAnalysis::convertValueToString(Value* V) {
             return std::string("PHI"+std::to_string(phiNodeUID));
         }
         if (In->getOpcode() == Instruction::Load) {
-            errs() << "LOAD\n";
+            LLVM_DEBUG(dbgs() << "LOAD\n");
             return std::string("LOAD");
         }
         if (In->getOpcode() == Instruction::Store) {
-            errs() << "STORE\n";
+            LLVM_DEBUG(dbgs() << "STORE\n");
             return std::string("STORE");
         }
         if (In->getOpcode() == Instruction::GetElementPtr) {
-            errs() << "GEP\n";
+            LLVM_DEBUG(dbgs() << "GEP\n");
             return std::string("GEP");
         }
         if (In->getOpcode() == Instruction::ZExt) {
-            errs() << "ZEXT\n";
+            LLVM_DEBUG(dbgs() << "ZEXT\n");
             return std::string("ZEXT");
         }
         if (In->getOpcode() == Instruction::SExt) {
-            errs() << "SEXT\n";
+            LLVM_DEBUG(dbgs() << "SEXT\n");
             return std::string("SEXT");
         }
         if (In->getOpcode() == Instruction::Freeze) {
-            errs() << "FREEZE\n";
+            LLVM_DEBUG(dbgs() << "FREEZE\n");
             return std::string("FREEZE");
         }
         if (In->getOpcode() == Instruction::Trunc) {
-            errs() << "TRUNC\n";
+            LLVM_DEBUG(dbgs() << "TRUNC\n");
             return std::string("TRUNC");
         }
         if (In->getOpcode() == Instruction::Select) {
-            errs() << "SELECT\n";
+            LLVM_DEBUG(dbgs() << "SELECT\n");
             return std::string("SELECT");
         }
     }
-    errs() << "not handled\n";
-    V->dump();
+    LLVM_DEBUG(dbgs() << "not handled\n");
+    LLVM_DEBUG(V->dump());
     /* assert(false); */
     return std::string("UNKNOWN");
 }
@@ -1364,19 +2058,19 @@ CudaAnalysis::convertValueToString(Value* V) {
 
 vector<std::string>
 CudaAnalysis::convertValuesToStrings(std::vector<Value *> Values) {
-  errs() << " \nconvert values to strings\n";
+  LLVM_DEBUG(dbgs() << " \nconvert values to strings\n");
   std::vector<std::string> Strings;
   for (auto ValueIter = Values.begin(); ValueIter != Values.end();
       ValueIter++) {
-    (*ValueIter)->dump();
+    LLVM_DEBUG((*ValueIter)->dump());
     if(TerminalValues.find(*ValueIter) != TerminalValues.end()){
-      errs() << "terminal value\n";
+      LLVM_DEBUG(dbgs() << "terminal value\n");
       auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), *ValueIter);
       if(It != KernelArgVector.end()) {
         std::string arg = "ARG";
         auto argid = It - KernelArgVector.begin();
         arg.append(std::to_string(argid));
-        errs() << argid << "\n";
+        LLVM_DEBUG(dbgs() << argid << "\n");
         Strings.push_back(arg);
         continue;
       }
@@ -1386,128 +2080,153 @@ CudaAnalysis::convertValuesToStrings(std::vector<Value *> Values) {
       }
     }
     if(isa<ConstantInt>(*ValueIter)){
-      errs() << "constant\n";
+      LLVM_DEBUG(dbgs() << "constant\n");
       auto Value = dyn_cast<ConstantInt>(*ValueIter);
       Strings.push_back(std::to_string(Value->getSExtValue()));
     }
     if(isa<Instruction>(*ValueIter)) {
-      errs() << "instruction\n";
+      LLVM_DEBUG(dbgs() << "instruction\n");
       auto In = dyn_cast<Instruction>(*ValueIter);
-      errs() << In->getOpcodeName() << "\n";
+      LLVM_DEBUG(dbgs() << In->getOpcodeName() << "\n");
       if (isa<BinaryOperator>(In)) {
         if (In->getOpcode() == Instruction::Add) {
-          errs() << "add\n";
+          LLVM_DEBUG(dbgs() << "add\n");
           Strings.push_back("ADD");
         }
         if (In->getOpcode() == Instruction::Sub) {
-          errs() << "sub\n";
+          LLVM_DEBUG(dbgs() << "sub\n");
           Strings.push_back("SUB");
         }
         if (In->getOpcode() == Instruction::Or) {
-          errs() << "or\n";
+          LLVM_DEBUG(dbgs() << "or\n");
           Strings.push_back("OR");
         }
         if (In->getOpcode() == Instruction::And) {
-          errs() << "and\n";
+          LLVM_DEBUG(dbgs() << "and\n");
           Strings.push_back("AND");
         }
         if (In->getOpcode() == Instruction::Mul) {
-          errs() << "Mul\n";
+          LLVM_DEBUG(dbgs() << "Mul\n");
           Strings.push_back("MUL");
         }
         if (In->getOpcode() == Instruction::UDiv) {
-          errs() << "UDiv\n";
+          LLVM_DEBUG(dbgs() << "UDiv\n");
           Strings.push_back("UDIV");
         }
         if (In->getOpcode() == Instruction::SDiv) {
-          errs() << "SDiv\n";
+          LLVM_DEBUG(dbgs() << "SDiv\n");
           Strings.push_back("SDIV");
         }
         if (In->getOpcode() == Instruction::Shl) {
-          errs() << "Shl\n";
+          LLVM_DEBUG(dbgs() << "Shl\n");
           Strings.push_back("SHL");
         }
       }
       if (In->getOpcode() == Instruction::ICmp) {
-        errs() << "Icmp\n";
+        LLVM_DEBUG(dbgs() << "Icmp\n");
         Strings.push_back("ICMP");
       }
       if (In->getOpcode() == Instruction::PHI) {
-        errs() << "Phi\n";
+        LLVM_DEBUG(dbgs() << "Phi\n");
         Strings.push_back("PHI");
       }
     }
   }
   for (auto ArgIter = Strings.begin(); ArgIter != Strings.end(); ArgIter++){
-    errs() << (*ArgIter) << "  ";
+    LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
   }
   return Strings;
 }
 
-void CudaAnalysis::serializeExpressionTree(Value* root, std::ostringstream &out, std::set<Value*> PhiNodesVisited) {
-
-    if (root == nullptr)
-        return;
+void CudaAnalysis::serializeExpressionTree(Value *Root, std::string &Out) {
+    SerializePath.clear();
+    serializeExpressionNode(Root, Out);
+}
 
-    errs()<< "node: ";
-    root->dump();
+// Appends the subtree of V to Out. A phi already on the path is printed as a
+// leaf, so a subtree that stops at such a phi prints differently from another
+// path; the return value is the depth of the outermost path phi the subtree
+// stopped at, or NoPathPhi. Subtrees that stopped at none are cached, which
+// makes the walk linear in the number of distinct values.
+unsigned CudaAnalysis::serializeExpressionNode(Value *V, std::string &Out) {
 
-    out << " ( ";
-    out << (convertValueToString(root)) << " ";
+    if (V == nullptr)
+        return NoPathPhi;
 
-    if(PhiNodesVisited.find(root) != PhiNodesVisited.end()) {
-        out << " ) ";
-        return;
+    auto Cached = SerializedTreeCache.find(V);
+    if (Cached != SerializedTreeCache.end()) {
+        Out += Cached->second;
+        return NoPathPhi;
     }
-    if(TerminalValues.find(root)!=TerminalValues.end()){
-        out << " ) ";
-        return;
+
+    LLVM_DEBUG(dbgs()<< "node: ");
+    LLVM_DEBUG(V->dump());
+
+    size_t Start = Out.size();
+    Out += " ( ";
+    Out += convertValueToString(V);
+    Out += " ";
+
+    auto OnPath = SerializePath.find(V);
+    if (OnPath != SerializePath.end()) {
+        Out += " ) ";
+        return OnPath->second;
     }
 
-    if (isa<Instruction>(root)) {
-        auto *In = dyn_cast<Instruction>(root);
+    unsigned Outer = NoPathPhi;
+    auto Visit = [&](Value *Operand) {
+        Outer = std::min(Outer, serializeExpressionNode(Operand, Out));
+    };
+    if (TerminalValues.find(V) == TerminalValues.end() && isa<Instruction>(V)) {
+        auto *In = dyn_cast<Instruction>(V);
         if(auto * LI = dyn_cast<LoadInst>(In)) {
-            serializeExpressionTree(LI->getPointerOperand(), out, PhiNodesVisited);
+            Visit(LI->getPointerOperand());
         } else if (auto * SI = dyn_cast<StoreInst>(In)) {
-            serializeExpressionTree(SI->getPointerOperand(), out, PhiNodesVisited);
+            Visit(SI->getPointerOperand());
         } else if (auto * GEPI = dyn_cast<GetElementPtrInst>(In)) {
             // if the pointer operand is one of the arguments:
             // then skip it, 
             // else if the gep leads to another 
             if(PointerInfoMap.find(GEPI->getPointerOperand()) != PointerInfoMap.end()){
                 for(int i = 1; i < GEPI->getNumIndices() + 1; i++){ // indices not includes the pointer 
-                    /* Stack.push(GEPI->getOperand(i)); */
-                    serializeExpressionTree(GEPI->getOperand(i), out, PhiNodesVisited);
+                    Visit(GEPI->getOperand(i));
                 }
             } else {
                 for(int i = 0; i < GEPI->getNumIndices() + 1; i++){ // indices not includes the pointer 
-                    /* Stack.push(GEPI->getOperand(i)); */
-                    serializeExpressionTree(GEPI->getOperand(i), out, PhiNodesVisited);
+                    Visit(GEPI->getOperand(i));
                 }
             }
-        } else if (auto * Phi = dyn_cast<PHINode>(In)) {
-            PhiNodesVisited.insert(Phi);
+        } else if (isa<PHINode>(In)) {
+            unsigned Depth = SerializePath.size();
+            SerializePath[V] = Depth;
             for (auto &Operand : In->operands()) {
-                /* Stack.push(Operand); */
-                serializeExpressionTree(Operand, out, PhiNodesVisited);
+                Visit(Operand);
             }
+            SerializePath.erase(V);
+            // stopping at this phi is internal to its own subtree
+            if (Outer == Depth)
+                Outer = NoPathPhi;
         } else{
             for (auto &Operand : In->operands()) {
-                /* Stack.push(Operand); */
-                serializeExpressionTree(Operand, out, PhiNodesVisited);
+                Visit(Operand);
             }
         }
     }
-    out << " ) ";
+    Out += " ) ";
+
+    if (Outer == NoPathPhi)
+        SerializedTreeCache[V] = Out.substr(Start);
+    return Outer;
 }
 
 bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
         Function &F) {
-    errs() << "Compute Iteration\n";
+    LLVM_DEBUG(dbgs() << "Compute Iteration\n");
     LoopToTotalIterMapping.clear(); // clear this map, since we are keeping track
                                     // on a per kernel basis.
+    LoopToTripCountMap.clear();
     for (LoopInfo::iterator lii = LI.begin(); lii != LI.end(); ++lii) {
-        errs() << "\nLOOP \n" << *lii << "\n";
+        LLVM_DEBUG(dbgs() << "\nLOOP \n" << *lii << "\n");
         /* (*lii)->dump(); */
         // errs() << (*lii) << "\n";
         Loop &Root = *(*lii);
@@ -1517,23 +2236,23 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
         unsigned Loopnestdepth = Loopnest->getNestDepth();
         auto Loops = Loopnest->getLoops();
         for (const auto *Li = Loops.begin(); Li != Loops.end(); Li++) {
-            (*Li)->dump();
-            errs() << "is canonical " << ((*Li)->isCanonical(SE)) << "\n";
+            LLVM_DEBUG((*Li)->dump());
+            LLVM_DEBUG(dbgs() << "is canonical " << ((*Li)->isCanonical(SE)) << "\n");
             /* errs() << "loop details " << (*Li) << "\n"; */
             /* errs() << "loop parent " << (*Li)->getParentLoop() << "\n"; */
             /* errs() << "Induciton variable is :"; */
             /* auto *LIV = (*Li)->getCanonicalInductionVariable(); */
             auto *LIV = (*Li)->getInductionVariable(SE);
             if (LIV) {
-                errs() << "LIV: ";
-                LIV->dump();
+                LLVM_DEBUG(dbgs() << "LIV: ");
+                LLVM_DEBUG(LIV->dump());
                 LoopInductionVariables.insert(LIV);
                 LoopInductionVariableToLoopMap[LIV] = (*Li);
                 AxisValues[LIV] = AXIS_TYPE_LOOPVAR;
             }
             auto Loopbounds = (*Li)->getBounds(SE);
             if (Loopbounds) {
-                errs() << "loop bounds found\n";
+                LLVM_DEBUG(dbgs() << "loop bounds found\n");
                 // Loopbounds->getInitialIVValue().dump();
                 // Loopbounds->getStepValue()->dump();
                 // Loopbounds->getFinalIVValue().dump();
@@ -1546,12 +2265,12 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
                 std::vector<Value*> InitialRPN, FinalRPN, StepRPN;
                 if (ConstantInt *CInitial = dyn_cast<ConstantInt>(&VInitial)) {
                     Initial = CInitial->getSExtValue();
-                    errs() << "initial " << Initial << "\n";
+                    LLVM_DEBUG(dbgs() << "initial " << Initial << "\n");
                     IsConstInitial = true;
                     LoopToInitialValue[*Li] = Initial;
                 } else {
-                    errs() << "Initial NOT A CONSTANT\n";
-                    VInitial.dump();
+                    LLVM_DEBUG(dbgs() << "Initial NOT A CONSTANT\n");
+                    LLVM_DEBUG(VInitial.dump());
                     // handleNonConstantLoopBound(&VInitial);
                     InitialRPN = handleNonConstantLoopBoundDFS(&VInitial);
                     LoopToInitialComputabilityMap[*Li] = isDataDependent(&VInitial);
@@ -1559,12 +2278,12 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
                 }
                 if (ConstantInt *CFinal = dyn_cast<ConstantInt>(&VFinal)) {
                     Final = CFinal->getSExtValue();
-                    errs() << "final " << Final << "\n";
+                    LLVM_DEBUG(dbgs() << "final " << Final << "\n");
                     IsConstFinal = true;
                     LoopToFinalValue[*Li] = Final;
                 } else {
-                    errs() << "Final NOT A CONSTANT\n";
-                    VFinal.dump();
+                    LLVM_DEBUG(dbgs() << "Final NOT A CONSTANT\n");
+                    LLVM_DEBUG(VFinal.dump());
                     // handleNonConstantLoopBound(&VFinal);
                     FinalRPN = handleNonConstantLoopBoundDFS(&VFinal);
                     LoopToFinalComputabilityMap[*Li] = isDataDependent(&VFinal);
@@ -1572,12 +2291,12 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
                 }
                 if (ConstantInt *CSteps = dyn_cast<ConstantInt>(VSteps)) {
                     Steps = CSteps->getSExtValue();
-                    errs() << "steps " << Steps << "\n";
+                    LLVM_DEBUG(dbgs() << "steps " << Steps << "\n");
                     IsConstSteps = true;
                     LoopToStepValue[*Li] = Steps;
                 } else {
-                    errs() << "Steps NOT A CONSTANT\n";
-                    VSteps->dump();
+                    LLVM_DEBUG(dbgs() << "Steps NOT A CONSTANT\n");
+                    LLVM_DEBUG(VSteps->dump());
                     // handleNonConstantLoopBound(VSteps);
                     StepRPN = handleNonConstantLoopBoundDFS(VSteps);
                     LoopToStepComputabilityMap[*Li] = isDataDependent(VSteps);
@@ -1588,17 +2307,18 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
                     // errs() << "iters " << Iters << "\n";
                     LoopToIterMapping[(*Li)] = Iters;
                 } else {
-                    unsigned long Iters = handleNonConstantLoopBounds(lpb);
-                    errs() << "iters " << Iters << "\n";
+                    unsigned long Iters = handleNonConstantLoopBounds(*Li, SE);
+                    LLVM_DEBUG(dbgs() << "iters " << Iters << "\n");
                     LoopToIterMapping[(*Li)] = Iters;
                 }
             } else {
-                errs() << "loop bound not found, requiring manual loop info computing\n";
+                LLVM_DEBUG(dbgs() << "loop bound not found, requiring manual loop info computing\n");
+                LoopToIterMapping[(*Li)] = handleNonConstantLoopBounds(*Li, SE);
                 auto BB = (*Li)->getHeader();
                 /* BB->dump(); */
                 for (auto &I : (*BB)) {
                     if(isPhiNode(&I)) {
-                        I.dump();
+                        LLVM_DEBUG(I.dump());
                     }
                 }
             }
@@ -1630,90 +2350,92 @@ bool CudaAnalysis::computeIterations(LoopInfo &LI, ScalarEvolution &SE,
     }
   }
 
-  if (!LoopDetailFile.is_open()) {
-    errs() << "Unable to open file\n";
-  } else {
-  }
-
-  errs() << "Total Iteration Map \n";
+  LLVM_DEBUG(dbgs() << "Total Iteration Map \n");
   for (auto I = LoopToTotalIterMapping.begin();
       I != LoopToTotalIterMapping.end(); I++) {
-    I->first->dump();
-    errs() << "loop id = " << LoopToLoopIdMapping[I->first] << "\n";
-    errs() << "iters  " << I->second << "\n";
+    LLVM_DEBUG(I->first->dump());
+    LLVM_DEBUG(dbgs() << "loop id = " << LoopToLoopIdMapping[I->first] << "\n");
+    LLVM_DEBUG(dbgs() << "iters  " << I->second << "\n");
     // BUG: if the actual number of iteration is indeed zero, then this hack
     // won't work
     /* if (I->second != 0) { */
     unsigned long int parent_id = 0;
     if(LoopToParentMapping.find(I->first) != LoopToParentMapping.end()) {
-        errs() << "parent loop is " << LoopToLoopIdMapping[LoopToParentMapping[I->first]];
+        LLVM_DEBUG(dbgs() << "parent loop is " << LoopToLoopIdMapping[LoopToParentMapping[I->first]]);
         parent_id = LoopToLoopIdMapping[LoopToParentMapping[I->first]];
     }
+    Metadata.begin(cuda_analysis::RK_Loop, F.getName());
+    Metadata.field(LoopToLoopIdMapping[I->first]);
+    Metadata.field(parent_id);
+    auto TripCount = LoopToTripCountMap.find(I->first);
     if (0) {
-      LoopDetailFile << F.getName().str() << " "
-          << parent_id << " " 
-        << LoopToLoopIdMapping[I->first];
-      LoopDetailFile << " IT "
-        << LoopToIterMapping[I->first] << "\n";
+      // constant trip count, as an optional third field
+      Metadata.field(LoopToIterMapping[I->first]);
+    } else if (TripCount != LoopToTripCountMap.end()) {
+      // closed form from ScalarEvolution, as a loop from 0 with step 1
+      Metadata.token("IN");
+      Metadata.token("0");
+      Metadata.token("FIN");
+      Metadata.tokens(TripCount->second);
+      Metadata.token("STEP");
+      Metadata.token("1");
     } else {
-      LoopDetailFile << F.getName().str() << " " << LoopToLoopIdMapping[I->first] << " ";
-          LoopDetailFile << " " << parent_id<< " " ;
-      I->first->dump();
+      LLVM_DEBUG(I->first->dump());
       auto InitialRPN = convertValuesToStrings(LoopToInitialMap[I->first]);
       auto FinalRPN = convertValuesToStrings(LoopToFinalMap[I->first]);
       auto StepRPN = convertValuesToStrings(LoopToStepMap[I->first]);
-      errs() << "\ninitial\n";
+      LLVM_DEBUG(dbgs() << "\ninitial\n");
       if (LoopToInitialValue.find(I->first) == LoopToInitialValue.end()){
-        LoopDetailFile << "IN ";
+        Metadata.token("IN");
         if(LoopToInitialComputabilityMap[I->first] == true) {
-          errs() << "loop is not computable initial\n";
+          LLVM_DEBUG(dbgs() << "loop is not computable initial\n");
         }
         for (auto ArgIter = InitialRPN.begin(); ArgIter != InitialRPN.end(); ArgIter++){
-          errs() << (*ArgIter) << "  ";
-          LoopDetailFile << (*ArgIter) << " ";
+          LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
+          Metadata.token(*ArgIter);
         }
       }
       else {
-        LoopDetailFile << "IN ";
-        LoopDetailFile << LoopToInitialValue[I->first] << " ";
-        errs() << LoopToInitialValue[I->first] << "\n";
+        Metadata.token("IN");
+        Metadata.token(std::to_string(LoopToInitialValue[I->first]));
+        LLVM_DEBUG(dbgs() << LoopToInitialValue[I->first] << "\n");
       }
-      errs() << "\nfinal\n";
+      LLVM_DEBUG(dbgs() << "\nfinal\n");
       if (LoopToFinalValue.find(I->first) == LoopToFinalValue.end()){
-        LoopDetailFile << "FIN ";
+        Metadata.token("FIN");
         if(LoopToFinalComputabilityMap[I->first] == true) {
-          errs() << "loop is not computable final\n";
-          LoopDetailFile << "INCOMP ";
+          LLVM_DEBUG(dbgs() << "loop is not computable final\n");
+          Metadata.token("INCOMP");
         } else {
           for (auto ArgIter = FinalRPN.begin(); ArgIter != FinalRPN.end(); ArgIter++){
-            errs() << (*ArgIter) << "  ";
-            LoopDetailFile << (*ArgIter) << " ";
+            LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
+            Metadata.token(*ArgIter);
           }
         }
       }
       else {
-        LoopDetailFile << "FIN ";
-        LoopDetailFile << LoopToFinalValue[I->first] << " ";
-        errs() << LoopToFinalValue[I->first] << "\n";
+        Metadata.token("FIN");
+        Metadata.token(std::to_string(LoopToFinalValue[I->first]));
+        LLVM_DEBUG(dbgs() << LoopToFinalValue[I->first] << "\n");
       }
-      errs() << "\nstep\n";
+      LLVM_DEBUG(dbgs() << "\nstep\n");
       if (LoopToStepValue.find(I->first) == LoopToStepValue.end()){
-        LoopDetailFile << "STEP ";
+        Metadata.token("STEP");
         if(LoopToStepComputabilityMap[I->first] == true) {
-          errs() << "loop is not computable step\n";
+          LLVM_DEBUG(dbgs() << "loop is not computable step\n");
         }
         for (auto ArgIter = StepRPN.begin(); ArgIter != StepRPN.end(); ArgIter++){
-          errs() << (*ArgIter) << "  ";
-          LoopDetailFile << (*ArgIter) << " ";
+          LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
+          Metadata.token(*ArgIter);
         }
       }
       else {
-        LoopDetailFile << "STEP ";
-        errs() << LoopToStepValue[I->first] << "\n";
-        LoopDetailFile << LoopToStepValue[I->first] << " ";
+        Metadata.token("STEP");
+        LLVM_DEBUG(dbgs() << LoopToStepValue[I->first] << "\n");
+        Metadata.token(std::to_string(LoopToStepValue[I->first]));
       }
     }
-    LoopDetailFile << "\n";
+    Metadata.end();
   }
 
   return true;
@@ -1743,7 +2465,7 @@ bool CudaAnalysis::findNumberOfAccessesUsingBFI(
             if (!isSharedMemoryAccess(G->getPointerOperand())) {
               // errs() << "pointer address space = "
               //  << G->getPointerAddressSpace() << "\n";
-              G->getPointerOperand()->dump();
+              LLVM_DEBUG(G->getPointerOperand()->dump());
               PointerInfoMap[G->getPointerOperand()]->Loads += Iters;
               MemoryOpToNumAccessMap[&I] = Iters;
               MemoryOpToAccessIDMap[&I] = AccessID++; //post increment
@@ -1756,7 +2478,7 @@ bool CudaAnalysis::findNumberOfAccessesUsingBFI(
           }
         }
       } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
-        errs() << "\n";
+        LLVM_DEBUG(dbgs() << "\n");
         // SI->dump();
         for (Use &U : SI->operands()) {
           // U->dump();
@@ -1805,18 +2527,13 @@ bool CudaAnalysis::findNumberOfAccessesUsingBFI(
   //   errs() << "Count  " << I->second->Loads << "\n";
   // }
 
-  errs() << "Attempting file write\n";
-  if (!AccessDetailFile.is_open()) {
-    errs() << "Unable to open file\n";
-  } else {
-    for (auto I = PointerInfoMap.begin(); I != PointerInfoMap.end(); I++) {
-      I->first->dump();
-      auto It =
-          std::find(KernelArgVector.begin(), KernelArgVector.end(), I->first);
-      AccessDetailFile << F.getName().str() << " "
-                       << It - KernelArgVector.begin() << " "
-                       << I->second->Loads << "\n";
-    }
+  // load counts are not part of the metadata the host transform reads
+  for (auto I = PointerInfoMap.begin(); I != PointerInfoMap.end(); I++) {
+    LLVM_DEBUG(I->first->dump());
+    auto It =
+        std::find(KernelArgVector.begin(), KernelArgVector.end(), I->first);
+    LLVM_DEBUG(dbgs() << F.getName().str() << " " << It - KernelArgVector.begin() << " "
+           << I->second->Loads << "\n");
   }
   return false;
 }
@@ -1824,8 +2541,8 @@ bool CudaAnalysis::findNumberOfAccessesUsingBFI(
 void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
     GetElementPtrInst *GEPI,
     Value *Index) {
-  errs() << "Reuse Analysis\n";
-  GEPI->dump();
+  LLVM_DEBUG(dbgs() << "Reuse Analysis\n");
+  LLVM_DEBUG(GEPI->dump());
   // Index->dump();
   std::stack<Value *> ValueQueue;
   std::set<Value *> Visited;
@@ -1834,7 +2551,7 @@ void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
   Value *Top;
   while (!ValueQueue.empty()) {
     Top = ValueQueue.top();
-    errs() << "top: "; Top->dump();
+    LLVM_DEBUG(dbgs() << "top: "); LLVM_DEBUG(Top->dump());
     ValueQueue.pop();
     Visited.insert(Top);
     if (std::find(TopologicalOrderList.begin(), TopologicalOrderList.end(),
@@ -1844,13 +2561,13 @@ void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
     if (auto *In = dyn_cast<Instruction>(Top)) {
       /* In->dump(); */
       if (SpecialValues.find(In) != SpecialValues.end()) {
-        errs() << "special value "
-          << SpecialValueNames[SpecialValues.find(In)->second] << " \n";
-        In->dump();
+        LLVM_DEBUG(dbgs() << "special value "
+          << SpecialValueNames[SpecialValues.find(In)->second] << " \n");
+        LLVM_DEBUG(In->dump());
       } else if (LoopInductionVariables.find(In) !=
           LoopInductionVariables.end()) {
-        errs() << "loop induction value \n";
-        In->dump();
+        LLVM_DEBUG(dbgs() << "loop induction value \n");
+        LLVM_DEBUG(In->dump());
         for (auto &Operand : In->operands()) {
           // Operand->dump();
           if (Visited.find(Operand) == Visited.end()) {
@@ -1864,7 +2581,7 @@ void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
         }
       } else {
         for (auto &Operand : In->operands()) {
-          Operand->dump();
+          LLVM_DEBUG(Operand->dump());
           if (Visited.find(Operand) == Visited.end()) {
             if (isa<Instruction>(Operand)) {
               ValueQueue.push(Operand);
@@ -1879,47 +2596,47 @@ void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
   }
 
   std::reverse(TopologicalOrderList.begin(), TopologicalOrderList.end());
-  errs() << "TOPOLOGICAL ORDER\n";
+  LLVM_DEBUG(dbgs() << "TOPOLOGICAL ORDER\n");
   for (auto TopoIter = TopologicalOrderList.begin();
        TopoIter != TopologicalOrderList.end(); TopoIter++) {
-    (*TopoIter)->dump();
+    LLVM_DEBUG((*TopoIter)->dump());
   }
-  errs() << "END TOPOLOGICAL ORDER\n";
+  LLVM_DEBUG(dbgs() << "END TOPOLOGICAL ORDER\n");
 
   for (auto TopoIter = TopologicalOrderList.begin();
       TopoIter != TopologicalOrderList.end(); TopoIter++) {
     /* (*TopoIter)->dump(); */
     if (AxisValues.find(*TopoIter) == AxisValues.end() &&
         std::find(KernelArgVector.begin(), KernelArgVector.end(), *TopoIter) == KernelArgVector.end()) {
-      errs() << "NOT AN AXIS VALUE\n";
+      LLVM_DEBUG(dbgs() << "NOT AN AXIS VALUE\n");
       continue;
     }
-    errs() << "\nTOPO ITEM which is AXIS VALUE\n";
-    (*TopoIter)->dump();
+    LLVM_DEBUG(dbgs() << "\nTOPO ITEM which is AXIS VALUE\n");
+    LLVM_DEBUG((*TopoIter)->dump());
     std::queue<Value *> Descendents;
     std::set<Value *> LocallyVisited;
     LocallyVisited.clear();
     Descendents.push(*TopoIter);
     Value *Descendent;
     while (!Descendents.empty()) {
-      errs() << "Descendent\n";
+      LLVM_DEBUG(dbgs() << "Descendent\n");
       Descendent = Descendents.front();
       Descendents.pop();
       LocallyVisited.insert(Descendent);
-      Descendent->dump();
+      LLVM_DEBUG(Descendent->dump());
       /* if (auto *In = dyn_cast<Instruction>(Descendent)) { */
         // In->dump();
         /* for (auto *User : In->users()) { */
         for (auto *User : Descendent->users()) {
-          errs() << "USERs\n";
-           User->dump();
+          LLVM_DEBUG(dbgs() << "USERs\n");
+           LLVM_DEBUG(User->dump());
           if (IndexSubComputationToMultiplierMap.find(User) !=
               IndexSubComputationToMultiplierMap.end()) {
             if (std::find(TopologicalOrderList.begin(),
                   TopologicalOrderList.end(),
                   User) != TopologicalOrderList.end()) {
-              errs() << "-----MULTIPLIER ANCESTOR\n";
-              User->dump();
+              LLVM_DEBUG(dbgs() << "-----MULTIPLIER ANCESTOR\n");
+              LLVM_DEBUG(User->dump());
               MemoryOpToMuliplierVectorMap[MemInst][*TopoIter].push_back(User);
             }
           }
@@ -1937,7 +2654,7 @@ void CudaAnalysis::analyzeGEPIndexForReuse(Value *MemInst,
         }
       /* } */
     }
-    errs() << "END\n";
+    LLVM_DEBUG(dbgs() << "END\n");
   }
 
 }
@@ -1946,17 +2663,17 @@ bool CudaAnalysis::isFormedFromTerminalsOnly(Value *value) {
   bool onlyTerminals = true;
   std::stack<Value*> Stack;
   std::set<Value*> Visited;
-  errs() << "Checking if only terminals are used\n";
-  value->dump();
+  LLVM_DEBUG(dbgs() << "Checking if only terminals are used\n");
+  LLVM_DEBUG(value->dump());
 
   Stack.push(value);
 
   while(!Stack.empty()) {
     Value *Current = Stack.top();
-    Current->dump();
+    LLVM_DEBUG(Current->dump());
     Stack.pop();
     if(Visited.find(Current) != Visited.end()) {
-      errs() << "hi\n";
+      LLVM_DEBUG(dbgs() << "hi\n");
       continue;
     }
     if(!isa<Instruction>(Current)){
@@ -1975,7 +2692,7 @@ bool CudaAnalysis::isFormedFromTerminalsOnly(Value *value) {
     }
   }
 
-  errs() << "hill " << onlyTerminals << "\n";
+  LLVM_DEBUG(dbgs() << "hill " << onlyTerminals << "\n");
   return onlyTerminals;
 
 }
@@ -2044,24 +2761,24 @@ void CudaAnalysis::analyzeGEPIndex(Value *MemInst, Value *Index) {
           }
         } else if ((In->getOpcode() == Instruction::Mul) ||
                    (In->getOpcode() == Instruction::Shl)) {
-          errs() << "multiply op\n";
-          In->dump();
+          LLVM_DEBUG(dbgs() << "multiply op\n");
+          LLVM_DEBUG(In->dump());
           if (IndexSubComputationToMultiplierMap.find(In) ==
               IndexSubComputationToMultiplierMap.end()) {
             auto *Oper0 = In->getOperand(0);
             auto *Oper1 = In->getOperand(1);
-            Oper0->dump();
-            Oper1->dump();
+            LLVM_DEBUG(Oper0->dump());
+            LLVM_DEBUG(Oper1->dump());
             // change to only DIM values
             if ((GridDimValues.find(Oper0) != GridDimValues.end()) ||
                 isa<ConstantInt>(Oper0) || isFormedFromTerminalsOnly(Oper0) ) { // add a condition to check if only formed from terminals
               IndexSubComputationToMultiplierMap[In].push_back(Oper0);
-              errs() << "added\n";
+              LLVM_DEBUG(dbgs() << "added\n");
             }
             if ((GridDimValues.find(Oper1) != GridDimValues.end()) ||
                 isa<ConstantInt>(Oper1) || isFormedFromTerminalsOnly(Oper1) ) {
               IndexSubComputationToMultiplierMap[In].push_back(Oper1);
-              errs() << "added\n";
+              LLVM_DEBUG(dbgs() << "added\n");
             }
           }
         }
@@ -2077,19 +2794,19 @@ void CudaAnalysis::analyzeGEPIndex(Value *MemInst, Value *Index) {
     }
   }
 
-  errs() << "\nPRINTING OUT INDEX SUB COMPUTATION MULTIPLIERS\n";
+  LLVM_DEBUG(dbgs() << "\nPRINTING OUT INDEX SUB COMPUTATION MULTIPLIERS\n");
   for (auto ValueIter = IndexSubComputationToMultiplierMap.begin();
        ValueIter != IndexSubComputationToMultiplierMap.end(); ValueIter++) {
-    (*ValueIter).first->dump();
+    LLVM_DEBUG((*ValueIter).first->dump());
     auto MulVector = (*ValueIter).second;
     for (auto MulIter = MulVector.begin(); MulIter != MulVector.end();
          MulIter++) {
-      errs() << "   ";
-      (*MulIter)->dump();
+      LLVM_DEBUG(dbgs() << "   ");
+      LLVM_DEBUG((*MulIter)->dump());
     }
   }
 
-  errs() << "CHECKINg FOR TERMS OVER\n";
+  LLVM_DEBUG(dbgs() << "CHECKINg FOR TERMS OVER\n");
   for (auto AddIter = AddOps.begin(); AddIter != AddOps.end(); AddIter++) {
     // (*AddIter)->dump();
     auto *AddOp = dyn_cast<BinaryOperator>(*AddIter);
@@ -2273,19 +2990,19 @@ void CudaAnalysis::printTreeForStrideComputation(Value *V) {
   Value *Top;
   while (!ValueQueue.empty()) {
     Top = ValueQueue.top();
-    errs() << " .  . ";
-    Top->dump();
+    LLVM_DEBUG(dbgs() << " .  . ");
+    LLVM_DEBUG(Top->dump());
     ValueQueue.pop();
     Visited.insert(Top);
     if (auto *In = dyn_cast<Instruction>(Top)) {
       // if (auto *CI = dyn_cast<CallInst>(In)) {
       // }
       if (SpecialValues.find(In) != SpecialValues.end()) {
-        errs() << "--->> special value \n";
+        LLVM_DEBUG(dbgs() << "--->> special value \n");
         // In->dump();
       } else if (LoopInductionVariables.find(In) !=
                  LoopInductionVariables.end()) {
-        errs() << "--->> loop induction value \n";
+        LLVM_DEBUG(dbgs() << "--->> loop induction value \n");
         // In->dump();
       } else {
         for (auto &Operand : In->operands()) {
@@ -2303,17 +3020,17 @@ void CudaAnalysis::printTreeForStrideComputation(Value *V) {
 }
 
 bool CudaAnalysis::computeStrides() {
-  errs() << "PRINTING TERM INFO\n";
+  LLVM_DEBUG(dbgs() << "PRINTING TERM INFO\n");
   for (auto MemInstIter = MemoryOpToStrideInfoMap.begin();
        MemInstIter != MemoryOpToStrideInfoMap.end(); MemInstIter++) {
-    errs() << "Mem Inst\n";
-    (*MemInstIter).first->dump();
+    LLVM_DEBUG(dbgs() << "Mem Inst\n");
+    LLVM_DEBUG((*MemInstIter).first->dump());
     auto *MemInst = (*MemInstIter).first;
     auto *TermInfoStruct = (*MemInstIter).second;
-    errs() << "Terms\n";
+    LLVM_DEBUG(dbgs() << "Terms\n");
     for (auto TermIter = TermInfoStruct->Terms.begin();
          TermIter != TermInfoStruct->Terms.end(); TermIter++) {
-      (*TermIter)->dump();
+      LLVM_DEBUG((*TermIter)->dump());
       printTreeForStrideComputation(*TermIter);
     }
   }
@@ -2322,7 +3039,7 @@ bool CudaAnalysis::computeStrides() {
 
 void CudaAnalysis::computeReuse(LoopInfo &LI, Function &F,
                                 std::vector<Value *> KernelArgVector) {
-  errs() << "COMPUTING REUSE\n";
+  LLVM_DEBUG(dbgs() << "COMPUTING REUSE\n");
   std::map<Value *, SpecialValueType> ReuseForMemoryAllocation;
   for (auto &BB : F) {
     for (auto &I : BB) {
@@ -2379,14 +3096,12 @@ void CudaAnalysis::computeReuse(LoopInfo &LI, Function &F,
   //   errs() << "\n";
   // }
 
-  errs() << "\nWRITING TO REUSE FILE\n\n";
-  if (!ReuseDetailfile.is_open()) {
-    errs() << "Unable to open file\n";
-  } else {
+  LLVM_DEBUG(dbgs() << "\nWRITING REUSE RECORDS\n\n");
+  {
     for (auto MGMVMIter = MemoryOpToMuliplierVectorMap.begin();
         MGMVMIter != MemoryOpToMuliplierVectorMap.end(); MGMVMIter++) {
       Value *MemOp = (*MGMVMIter).first;
-      MemOp->dump();
+      LLVM_DEBUG(MemOp->dump());
       Value *GEPI = nullptr;
       if (auto *SI = dyn_cast<StoreInst>(MemOp)) {
         GEPI = SI->getPointerOperand();
@@ -2401,36 +3116,34 @@ void CudaAnalysis::computeReuse(LoopInfo &LI, Function &F,
         std::map<Value *, std::vector<Value *>> Axes = (*MGMVMIter).second;
         for (auto AxisIter = Axes.begin(); AxisIter != Axes.end(); AxisIter++) {
           // (*AxisIter).first->dump();
-          ReuseDetailfile << F.getName().str() << " "
-            << It - KernelArgVector.begin();
-          ReuseDetailfile << " " << MemoryOpToAccessIDMap[MemOp];
-          ReuseDetailfile << " " << MemoryOpToNumAccessMap[MemOp];
-          (*AxisIter).first->dump();
+          Metadata.begin(cuda_analysis::RK_Reuse, F.getName());
+          Metadata.field(It - KernelArgVector.begin());
+          Metadata.field(MemoryOpToAccessIDMap[MemOp]);
+          Metadata.field(MemoryOpToNumAccessMap[MemOp]);
+          LLVM_DEBUG((*AxisIter).first->dump());
           auto AxIter = AxisValues.find((*AxisIter).first);
           if(AxIter != AxisValues.end()) {
-            ReuseDetailfile << " "
-              << AxisValueNames[AxisValues[(*AxisIter).first]];
+            Metadata.token(AxisValueNames[AxisValues[(*AxisIter).first]]);
           } 
           auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), (*AxisIter).first);
           if(It != KernelArgVector.end()) {
             std::string arg = "ARG";
             auto argid = It - KernelArgVector.begin();
             arg.append(std::to_string(argid));
-            ReuseDetailfile << " "
-              << arg;
+            Metadata.token(arg);
           }
 
           /* errs() << " axis = " << AxisValueNames[AxisValues[(*AxisIter).first]] << "\n"; */
           std::vector<Value *> Multipliers = (*AxisIter).second;
-          errs() << "multipliers\n";
+          LLVM_DEBUG(dbgs() << "multipliers\n");
           for (auto MulIter = Multipliers.begin(); MulIter != Multipliers.end();
               MulIter++) {
             // TODO : for differnt possible types of multipiers (constants,
             // BIDs), find out the relavant value and print it out
-            ReuseDetailfile << " [" << getMultiplierString(*MulIter) << "] ";
-            (*MulIter)->dump();
+            Metadata.token("[" + getMultiplierString(*MulIter) + "]");
+            LLVM_DEBUG((*MulIter)->dump());
           }
-          ReuseDetailfile << "\n";
+          Metadata.end();
         }
       }
     }
@@ -2490,16 +3203,16 @@ bool CudaAnalysis::findDirectionOfAccess(LoopInfo &LI, Function &F,
 
 Value* CudaAnalysis::getIndirectMemop(Value* V){
   // iterate through GEP chain till reaching args
-  errs() << "indirect memop: ";
-  V->dump();
+  LLVM_DEBUG(dbgs() << "indirect memop: ");
+  LLVM_DEBUG(V->dump());
   if (auto *LdI = dyn_cast<LoadInst>(V)) {
     Value* PO = LdI->getPointerOperand();
     auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), PO);
     if(It == KernelArgVector.end()) {
-      errs() << "recurse\n";
+      LLVM_DEBUG(dbgs() << "recurse\n");
       getIndirectMemop(PO);
     } else {
-      errs() << "return\n";
+      LLVM_DEBUG(dbgs() << "return\n");
       return PO;
     }
   } else if (auto * GEPI = dyn_cast<GetElementPtrInst>(V)) {
@@ -2515,12 +3228,12 @@ Value* CudaAnalysis::getIndirectMemop(Value* V){
 
 bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
     std::vector<Value *> KernelArgVector) {
-  errs() << "Count memory operations\n";
+  LLVM_DEBUG(dbgs() << "Count memory operations\n");
   for (auto &BB : F) {
     for (auto &I : BB) {
       if (auto *LdI = dyn_cast<LoadInst>(&I)) {
-        errs() << "----\n";
-        LdI->dump();
+        LLVM_DEBUG(dbgs() << "----\n");
+        LLVM_DEBUG(LdI->dump());
         auto U = LdI->getPointerOperand();
         // errs() << "..";
         // U->dump();
@@ -2537,33 +3250,33 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
           if (!isSharedMemoryAccess(G)) {
             // errs() << "pointer address space = "
             //        << G->getPointerAddressSpace() << "\n";
-            errs() << "\n\n";
-            LdI->dump();
-            G->dump();
+            LLVM_DEBUG(dbgs() << "\n\n");
+            LLVM_DEBUG(LdI->dump());
+            LLVM_DEBUG(G->dump());
             if (PointerInfoMap.find(Ptr) == PointerInfoMap.end()) {
-              errs() << "NOT FOUND. NEED TO DO RECURSIVE\n";
+              LLVM_DEBUG(dbgs() << "NOT FOUND. NEED TO DO RECURSIVE\n");
               // if a memory access is to a stack variable, then it doesn't count.
               if(ByValArgsSet.find(Ptr) != ByValArgsSet.end()){
-                errs() << "found by value (arg maybe a struct) \n";
+                LLVM_DEBUG(dbgs() << "found by value (arg maybe a struct) \n");
                 StackAccesses.insert(LdI);
-                Ptr->dump();
+                LLVM_DEBUG(Ptr->dump());
               }
               if(StackAccesses.find(Ptr) != StackAccesses.end()) {
-                errs() << "accssing an address from stack (not on stack)\n";
-                Ptr->dump();
+                LLVM_DEBUG(dbgs() << "accssing an address from stack (not on stack)\n");
+                LLVM_DEBUG(Ptr->dump());
                 LoadInst* SecondLoad = dyn_cast<LoadInst>(Ptr);
                 Value* ByValArg = SecondLoad->getPointerOperand();
-                errs() << "by val arg\n";
-                ByValArg->dump();
+                LLVM_DEBUG(dbgs() << "by val arg\n");
+                LLVM_DEBUG(ByValArg->dump());
                 if(ByValArgsSet.find(ByValArg) != ByValArgsSet.end()){
-                  errs() << "found the struct \n";
+                  LLVM_DEBUG(dbgs() << "found the struct \n");
                   auto Arg = dyn_cast<Argument>(ByValArg);
-                  Arg->getParamByValType()->dump();
+                  LLVM_DEBUG(Arg->getParamByValType()->dump());
                   MemoryOpToAccessIDMap[&I] = AccessID++; // post increment
                   if (Loop *Loop = LI.getLoopFor(LdI->getParent())) {
                     MemoryOpToEnclosingLoopMap[&I] = Loop;
                   } else {
-                    errs() << "Unable to find enclosing loop\n";
+                    LLVM_DEBUG(dbgs() << "Unable to find enclosing loop\n");
                   }
                   MemoryOpToPointerMap[&I] = Ptr;
                   isInsideConditional(&I);
@@ -2576,21 +3289,21 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
               if (Loop *Loop = LI.getLoopFor(LdI->getParent())) {
                 MemoryOpToEnclosingLoopMap[&I] = Loop;
               } else {
-                errs() << "Unable to find enclosing loop\n";
+                LLVM_DEBUG(dbgs() << "Unable to find enclosing loop\n");
               }
               MemoryOpToPointerMap[&I] = Ptr;
                   isInsideConditional(&I);
             }
           } else {
-            errs() << "shared memory access\n";
+            LLVM_DEBUG(dbgs() << "shared memory access\n");
           }
         }
         else {
-          errs() << "Unable to find pointer\n";
+          LLVM_DEBUG(dbgs() << "Unable to find pointer\n");
         }
       } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
-        errs() << "----\n";
-        SI->dump();
+        LLVM_DEBUG(dbgs() << "----\n");
+        LLVM_DEBUG(SI->dump());
         // if (auto G = dyn_cast<GetElementPtrInst>(U)) {
         auto U = SI->getPointerOperand();
         // errs() << "found GEP\n";
@@ -2604,16 +3317,16 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
             // errs() << "NOT FOUND \n";
           }
           auto *Ptr = G;
-          errs() << "GEP\n";
-          G->dump();
+          LLVM_DEBUG(dbgs() << "GEP\n");
+          LLVM_DEBUG(G->dump());
           if (!isSharedMemoryAccess(G)) {
             // errs() << "pointer address space = "
             //  << G->getPointerAddressSpace() << "\n";
-            errs() << "\n";
-            SI->dump();
-            G->dump();
+            LLVM_DEBUG(dbgs() << "\n");
+            LLVM_DEBUG(SI->dump());
+            LLVM_DEBUG(G->dump());
             if (PointerInfoMap.find(Ptr) == PointerInfoMap.end()) {
-              errs() << "NOT FOUND. NEED TO DO RECURSIVE\n";
+              LLVM_DEBUG(dbgs() << "NOT FOUND. NEED TO DO RECURSIVE\n");
               // if a memory access is to a stack variable, then it doesn't count.
               /* if(ByValArgsSet.find(Ptr) != ByValArgsSet.end()){ */
               /*   errs() << "found by value (arg maybe a struct) \n"; */
@@ -2621,28 +3334,28 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
               /*   Ptr->dump(); */
               /* } */
               if(StackAccesses.find(Ptr) != StackAccesses.end()) {
-                errs() << "accssing an address from stack (not on stack)\n";
-                Ptr->dump();
+                LLVM_DEBUG(dbgs() << "accssing an address from stack (not on stack)\n");
+                LLVM_DEBUG(Ptr->dump());
                 LoadInst* SecondLoad = dyn_cast<LoadInst>(Ptr);
                 Value* ByValArg = SecondLoad->getPointerOperand();
-                errs() << "by val arg\n";
-                ByValArg->dump();
+                LLVM_DEBUG(dbgs() << "by val arg\n");
+                LLVM_DEBUG(ByValArg->dump());
                 if(ByValArgsSet.find(ByValArg) != ByValArgsSet.end()){
-                  errs() << "found the struct \n";
+                  LLVM_DEBUG(dbgs() << "found the struct \n");
                   auto Arg = dyn_cast<Argument>(ByValArg);
-                  Arg->getParamByValType()->dump();
+                  LLVM_DEBUG(Arg->getParamByValType()->dump());
                   MemoryOpToAccessIDMap[&I] = AccessID++; // post increment
                   if (Loop *Loop = LI.getLoopFor(SI->getParent())) {
                     MemoryOpToEnclosingLoopMap[&I] = Loop;
                   } else {
-                    errs() << "Unable to find enclosing loop\n";
+                    LLVM_DEBUG(dbgs() << "Unable to find enclosing loop\n");
                   }
                   MemoryOpToPointerMap[&I] = Ptr;
                   isInsideConditional(&I);
                 }
               }
             } else {
-              errs() << "found in pointer map\n";
+              LLVM_DEBUG(dbgs() << "found in pointer map\n");
               PointerInfoMap[Ptr]->Loads += Iters;
               MemoryOpToNumAccessMap[&I] = Iters;
               MemoryOpToAccessIDMap[&I] = AccessID++; // post increment
@@ -2650,7 +3363,7 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
                 MemoryOpToEnclosingLoopMap[&I] = Loop;
               } else {
                 // MemoryOpToEnclosingLoopMap[&I] = nullptr;
-                errs() << "Unable to find enclosing loop\n";
+                LLVM_DEBUG(dbgs() << "Unable to find enclosing loop\n");
               }
               MemoryOpToPointerMap[&I] = Ptr;
                   isInsideConditional(&I);
@@ -2663,126 +3376,149 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
       }
       }
 
-      errs() << "Attempting file write\n";
-      if (!AccessDetailFile.is_open()) {
-        errs() << "Unable to open file\n";
-      } else {
+      LLVM_DEBUG(dbgs() << "Attempting metadata write\n");
+      {
+        BranchProbabilityInfo BPI(F, GetLI(F));
+        OptimizationRemarkEmitter ORE(&F);
         for (auto I = MemoryOpToPointerMap.begin(); I != MemoryOpToPointerMap.end();
             I++) {
-          errs() << "memory op\n";
-          I->first->dump();
-          I->second->dump();
+          LLVM_DEBUG(dbgs() << "memory op\n");
+          LLVM_DEBUG(I->first->dump());
+          LLVM_DEBUG(I->second->dump());
           // auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(),
           // I->second);
 
-          AccessDetailFile << F.getName().str() << " ";
-          AccessDetailFile << MemoryOpToAccessIDMap[I->first] << " ";
+          Metadata.begin(cuda_analysis::RK_Access, F.getName());
+          Metadata.field(MemoryOpToAccessIDMap[I->first]);
           auto It =
             std::find(KernelArgVector.begin(), KernelArgVector.end(), I->second);
-          errs() << MemoryOpToAccessIDMap[I->first] << " " << It - KernelArgVector.begin() << " ";
+          LLVM_DEBUG(dbgs() << MemoryOpToAccessIDMap[I->first] << " " << It - KernelArgVector.begin() << " ");
+          long ArgNo;
           if(It != KernelArgVector.end()){
-            AccessDetailFile << It - KernelArgVector.begin() << " ";
+            ArgNo = It - KernelArgVector.begin();
           } else {
             // TODO: indirect search
             Value* arg = getIndirectMemop(I->second);
           auto It = std::find(KernelArgVector.begin(), KernelArgVector.end(), arg);
-            AccessDetailFile << It - KernelArgVector.begin() << " ";
+            ArgNo = It - KernelArgVector.begin();
           }
+          Metadata.field(ArgNo);
 
+          unsigned LoopId = 0;
           if (MemoryOpToEnclosingLoopMap.find(I->first) !=
               MemoryOpToEnclosingLoopMap.end()) {
-            MemoryOpToEnclosingLoopMap[I->first]->dump();
-            AccessDetailFile << LoopToLoopIdMapping[MemoryOpToEnclosingLoopMap[I->first]] << " ";
+            LLVM_DEBUG(MemoryOpToEnclosingLoopMap[I->first]->dump());
+            LoopId = LoopToLoopIdMapping[MemoryOpToEnclosingLoopMap[I->first]];
+            Metadata.field(LoopId);
           } else {
-            errs() << "no enclosing loop\n";
-            AccessDetailFile << "0 ";
+            LLVM_DEBUG(dbgs() << "no enclosing loop\n");
+            Metadata.field(0);
           }
-          errs() << "\n";
+          LLVM_DEBUG(dbgs() << "\n");
 
           // print if 
           if (MemoryOpToIfBranch.find(I->first) !=
               MemoryOpToIfBranch.end()) {
-            errs() << "inside if\n";
-            MemoryOpToIfBranch[I->first]->dump();
+            LLVM_DEBUG(dbgs() << "inside if\n");
+            LLVM_DEBUG(MemoryOpToIfBranch[I->first]->dump());
             auto br = MemoryOpToIfBranch[I->first];
-            errs() << BranchToBranchIdMapping[br] << "\n";
-            AccessDetailFile << BranchToBranchIdMapping[br] << " ";
+            LLVM_DEBUG(dbgs() << BranchToBranchIdMapping[br] << "\n");
+            Metadata.field(BranchToBranchIdMapping[br]);
             if(MemoryOpToIfType[I->first] == true) {
-                AccessDetailFile << " 1 ";
-                errs() << "adf true\n";
+                Metadata.field(1);
+                LLVM_DEBUG(dbgs() << "adf true\n");
             } else {
-                AccessDetailFile << " 0 ";
-                errs() << "adf false\n";
+                Metadata.field(0);
+                LLVM_DEBUG(dbgs() << "adf false\n");
             }
           } else {
-            AccessDetailFile << " 0 ";
-            AccessDetailFile << " 0 ";
+            Metadata.field(0);
+            Metadata.field(0);
           }
+          // the host side treats allocations that are never stored to as
+          // read-only
+          Metadata.field(isa<StoreInst>(I->first) ? 1 : 0);
+          Metadata.field(computeTileReuse(cast<Instruction>(I->first), GetLI(F)));
 
           bool isPtrChase = isPointerChaseFixed(I->first);
           auto expression = getExpressionTree(I->first);
           auto expr_strings = convertValuesToStrings(expression);
-          errs() << "expression strings\n";
-          AccessDetailFile << "[ ";
+          LLVM_DEBUG(dbgs() << "expression strings\n");
           if(!isPtrChase){
             for (auto ArgIter = expr_strings.begin(); ArgIter != expr_strings.end(); ArgIter++){
-              errs() << (*ArgIter) << "  ";
-              AccessDetailFile << (*ArgIter) << "  ";
+              LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
+              Metadata.token(*ArgIter);
             }
-            errs() << " \n";
+            LLVM_DEBUG(dbgs() << " \n");
           } else {
-            AccessDetailFile << "PC";
+            Metadata.token("PC");
           }
-            AccessDetailFile << " ]";
-
-          AccessDetailFile << "\n";
-
-
-          // Access tree file
-          AccessTreeFile << F.getName().str() << " ";
-          AccessTreeFile << MemoryOpToAccessIDMap[I->first] << " ";
-          std::ostringstream serializedExprTree;
-          isPtrChase = isPointerChaseFixed(I->first);
+          Metadata.end();
+          // -pass-remarks-analysis=CudaAnalysis, or the YAML of
+          // -fsave-optimization-record, say what the host side is told
+          ORE.emit([&]() {
+            OptimizationRemarkAnalysis R(DEBUG_TYPE, "Access",
+                                         cast<Instruction>(I->first));
+            R << (isa<StoreInst>(I->first) ? "store " : "load ")
+              << ore::NV("Access", MemoryOpToAccessIDMap[I->first])
+              << " of argument " << ore::NV("Argument", ArgNo);
+            if (LoopId)
+              R << " in loop " << ore::NV("Loop", LoopId);
+            if (isPtrChase)
+              return R << ": pointer chase";
+            std::string Index;
+            for (auto &S : expr_strings)
+              Index += (Index.empty() ? "" : " ") + S;
+            return R << ": index " << ore::NV("Index", Index);
+          });
+
+
+          // Access tree record
+          Metadata.begin(cuda_analysis::RK_AccessTree, F.getName());
+          Metadata.field(MemoryOpToAccessIDMap[I->first]);
           if(!isPtrChase){
-              std::set<Value*> PhiNodesVisited;
-              errs() << "hihi serialize expr tree\n";
-              serializeExpressionTree(I->first, serializedExprTree, PhiNodesVisited);
-              AccessTreeFile << serializedExprTree.str() ;
-              AccessTreeFile << "\n";
+              std::string serializedExprTree;
+              LLVM_DEBUG(dbgs() << "hihi serialize expr tree\n");
+              serializeExpressionTree(I->first, serializedExprTree);
+              Metadata.splitTokens(serializedExprTree);
           } else {
-              AccessTreeFile << "PC \n";
+              Metadata.token("PC");
           }
+          Metadata.end();
 
+          // Footprint record, for the accesses straight off an argument
+          if (!isPtrChase && It != KernelArgVector.end())
+            writeFootprint(cast<Instruction>(I->first), I->second, GetSE(F));
+          writeBranch(cast<Instruction>(I->first), GetSE(F), BPI);
         }
       }
 
-      errs() << "writing if else information\n";
+      LLVM_DEBUG(dbgs() << "writing if else information\n");
       for(auto br = BranchToBranchIdMapping.begin();
           br != BranchToBranchIdMapping.end(); br++) {
         if ((BranchProcessed[br->first]) == true ) {
           continue;
         }
         BranchProcessed[br->first] = true;
-        errs() << "\nbr id = " << (br->second) << "\n";
-        br->first->dump();
-        IfDetailFile << br->second << " " ;
+        LLVM_DEBUG(dbgs() << "\nbr id = " << (br->second) << "\n");
+        LLVM_DEBUG(br->first->dump());
+        Metadata.begin(cuda_analysis::RK_If);
+        Metadata.field(br->second);
         Instruction* bri = dyn_cast<Instruction>(br->first);
         assert(bri);
-        bri->getOperand(0)->dump();
+        LLVM_DEBUG(bri->getOperand(0)->dump());
         auto pred = bri->getOperand(0);
         auto expression = getExpressionTree(pred);
-        /* IfDetailFile << "[ "; */
         auto expr_strings = convertValuesToStrings(expression);
-          errs() << "expression strings\n";
+          LLVM_DEBUG(dbgs() << "expression strings\n");
             for (auto ArgIter = expr_strings.begin(); ArgIter != expr_strings.end(); ArgIter++){
-              errs() << (*ArgIter) << "  ";
-              IfDetailFile << (*ArgIter) << "  ";
+              LLVM_DEBUG(dbgs() << (*ArgIter) << "  ");
+              Metadata.token(*ArgIter);
             }
-        /* IfDetailFile << " ]"; */
-        IfDetailFile << "\n";
+        Metadata.end();
       }
 
-      errs() << "writing loop to phi information\n";
+      LLVM_DEBUG(dbgs() << "writing loop to phi information\n");
       for(auto phi = PhiNodeToUIDMap.begin();
               phi != PhiNodeToUIDMap.end(); phi++) {
           /* Loop* loop = LoopInductionVariableToLoopMap[phi->first]; */
@@ -2794,7 +3530,10 @@ bool CudaAnalysis::countMemoryOperations(LoopInfo &LI, Function &F,
           if (Loop *loop = LI.getLoopFor(phi->first->getParent())) {
               loopid = LoopToLoopIdMapping[loop];
           }
-          PhiToLoopFile << phi->second << "  " << loopid  << "\n";
+          Metadata.begin(cuda_analysis::RK_PhiLoop);
+          Metadata.field(phi->second);
+          Metadata.field(loopid);
+          Metadata.end();
       }
 
       return false;
@@ -2823,11 +3562,11 @@ bool CudaAnalysis::findNumberOfAccesses(LoopInfo &LI, Function &F,
             if (!isSharedMemoryAccess(G->getPointerOperand())) {
               // errs() << "pointer address space = "
               //        << G->getPointerAddressSpace() << "\n";
-              errs() << "\n";
-              LdI->dump();
-              G->getPointerOperand()->dump();
+              LLVM_DEBUG(dbgs() << "\n");
+              LLVM_DEBUG(LdI->dump());
+              LLVM_DEBUG(G->getPointerOperand()->dump());
               if (PointerInfoMap.find(Ptr) == PointerInfoMap.end()) {
-                errs() << "NOT FOUND. NEED TO DO RECURSIVE\n";
+                LLVM_DEBUG(dbgs() << "NOT FOUND. NEED TO DO RECURSIVE\n");
               } else {
                 PointerInfoMap[Ptr]->Loads += Iters;
                 MemoryOpToNumAccessMap[&I] = Iters;
@@ -2859,11 +3598,11 @@ bool CudaAnalysis::findNumberOfAccesses(LoopInfo &LI, Function &F,
               if (!isSharedMemoryAccess(G->getPointerOperand())) {
                 // errs() << "pointer address space = "
                 //  << G->getPointerAddressSpace() << "\n";
-                errs() << "\n";
-                SI->dump();
-                G->getPointerOperand()->dump();
+                LLVM_DEBUG(dbgs() << "\n");
+                LLVM_DEBUG(SI->dump());
+                LLVM_DEBUG(G->getPointerOperand()->dump());
                 if (PointerInfoMap.find(Ptr) == PointerInfoMap.end()) {
-                  errs() << "NOT FOUND. NEED TO DO RECURSIVE\n";
+                  LLVM_DEBUG(dbgs() << "NOT FOUND. NEED TO DO RECURSIVE\n");
                 } else{
                   PointerInfoMap[Ptr]->Loads += Iters;
                   MemoryOpToNumAccessMap[&I] = Iters;
@@ -2896,18 +3635,14 @@ bool CudaAnalysis::findNumberOfAccesses(LoopInfo &LI, Function &F,
       //   errs() << "Count  " << I->second->Loads << "\n";
       // }
 
-      errs() << "Attempting file write\n";
-      if (!AccessDetailFile.is_open()) {
-        errs() << "Unable to open file\n";
-      } else {
-        for (auto I = PointerInfoMap.begin(); I != PointerInfoMap.end(); I++) {
-          // I->first->dump();
-          auto It =
-            std::find(KernelArgVector.begin(), KernelArgVector.end(), I->first);
-          AccessDetailFile << F.getName().str() << " "
-            << It - KernelArgVector.begin() << " "
-            << I->second->Loads << "\n";
-        }
+      // load counts are not part of the metadata the host transform reads
+      for (auto I = PointerInfoMap.begin(); I != PointerInfoMap.end(); I++) {
+        // I->first->dump();
+        auto It =
+          std::find(KernelArgVector.begin(), KernelArgVector.end(), I->first);
+        LLVM_DEBUG(dbgs() << F.getName().str() << " "
+          << It - KernelArgVector.begin() << " "
+          << I->second->Loads << "\n");
       }
       return false;
     }
@@ -2916,3 +3651,222 @@ bool CudaAnalysis::findNumberOfAccesses(LoopInfo &LI, Function &F,
 
 char CudaAnalysis::ID = 0;
 static RegisterPass<CudaAnalysis> X("CudaAnalysis", "CudaAnalysis World Pass");
+
+// The entry of M in -cuda-analysis-cache. The records only depend on the IR,
+// the format they are written in and -cuda-analysis-inline-depth, not on the
+// options of the other passes.
+static std::string cachedMetadata(const Module &M) {
+  std::string IR;
+  raw_string_ostream OS(IR);
+  M.print(OS, nullptr);
+  OS.flush();
+  MD5 Hash;
+  Hash.update(IR);
+  Hash.update(std::to_string(cuda_analysis::MetadataVersion));
+  Hash.update(std::to_string(InlineDepth));
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<256> Path(AnalysisCache);
+  sys::path::append(Path, Twine(Result.digest()) + ".meta");
+  return std::string(Path);
+}
+
+// Copies the metadata just written into the cache under a temporary name and
+// renames it, so that concurrent builds never read half an entry
+static void storeMetadata(StringRef Cached) {
+  SmallString<256> Temp;
+  std::error_code EC = sys::fs::create_directories(AnalysisCache);
+  if (!EC)
+    EC = sys::fs::createUniqueFile(Cached + ".%%%%%%", Temp);
+  if (!EC)
+    EC = sys::fs::copy_file(MetadataFile, Temp);
+  if (!EC)
+    EC = sys::fs::rename(Temp, Cached);
+  if (EC) {
+    errs() << "Unable to cache " << MetadataFile << " in " << AnalysisCache
+           << ": " << EC.message() << "\n";
+    if (!Temp.empty())
+      sys::fs::remove(Temp);
+  }
+}
+
+// Calls of a kernel that inlining would give CudaAnalysis the body of
+static void collectDeviceCalls(Function &F,
+                               SmallVectorImpl<CallBase *> &Calls) {
+  for (Instruction &I : instructions(F)) {
+    auto *CB = dyn_cast<CallBase>(&I);
+    if (!CB)
+      continue;
+    Function *Callee = CB->getCalledFunction();
+    if (Callee && Callee != &F && !Callee->isDeclaration() &&
+        !Callee->isIntrinsic() && !Callee->isVarArg())
+      Calls.push_back(CB);
+  }
+}
+
+// The module CudaAnalysis reads when the kernels of M call device functions:
+// a copy with the calls inlined into the kernels, -cuda-analysis-inline-depth
+// levels deep, so that an access in a helper, or through a pointer the kernel
+// passes it, gets the index expression, loops and access count it gets when
+// the helper is inlined by hand, instantiated at every call site with that
+// call's arguments. Recursion stops at the depth. Null when no kernel calls
+// one. M itself is left alone: the device passes transform the kernels as
+// they are, and the records of the kernels, by name, hold for both.
+static std::unique_ptr<Module> instantiateDeviceCalls(
+    Module &M, FunctionAnalysisManager &FAM) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!InlineDepth || !Annotations)
+    return nullptr;
+  // the kernels, of M and then of the copy
+  std::vector<Function *> Kernels;
+  SmallVector<CallBase *, 8> Calls;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    if (F && !F->isDeclaration()) {
+      Kernels.push_back(F);
+      collectDeviceCalls(*F, Calls);
+    }
+  }
+  if (Calls.empty())
+    return nullptr;
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> Copy = CloneModule(M, VMap);
+  FunctionPassManager FPM;
+  FPM.addPass(LoopSimplifyPass());
+  for (Function *&F : Kernels) {
+    F = cast<Function>(VMap[F]);
+    unsigned Inlined = 0;
+    for (unsigned Level = 0; Level < InlineDepth; ++Level) {
+      Calls.clear();
+      collectDeviceCalls(*F, Calls);
+      if (Calls.empty())
+        break;
+      for (CallBase *CB : Calls) {
+        InlineFunctionInfo IFI;
+        if (InlineFunction(*CB, IFI).isSuccess())
+          ++Inlined;
+      }
+    }
+    LLVM_DEBUG(dbgs() << "inlined " << Inlined << " device calls into "
+                      << F->getName() << "\n");
+    if (Inlined)
+      FPM.run(*F, FAM);
+  }
+  return Copy;
+}
+
+namespace {
+
+// New pass manager version: -passes=cuda-analysis. The analysis only reads
+// the module, so every cached analysis survives it.
+struct CudaAnalysisPass : PassInfoMixin<CudaAnalysisPass> {
+  // set when added at an extension point, where host modules come by too
+  bool DeviceOnly;
+
+  explicit CudaAnalysisPass(bool DeviceOnly = false) : DeviceOnly(DeviceOnly) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    if (DeviceOnly && !Triple(M.getTargetTriple()).isNVPTX())
+      return PreservedAnalyses::all();
+    // a module analyzed before gets the same records again
+    std::string Cached;
+    if (!AnalysisCache.empty()) {
+      Cached = cachedMetadata(M);
+      if (!sys::fs::copy_file(Cached, MetadataFile))
+        return PreservedAnalyses::all();
+    }
+    // the copy with the device calls inlined, and the analyses of its
+    // functions, destroyed before it
+    std::unique_ptr<Module> Copy;
+    PassBuilder PB;
+    FunctionAnalysisManager CopyFAM;
+    PB.registerFunctionAnalyses(CopyFAM);
+    Copy = instantiateDeviceCalls(M, CopyFAM);
+    Module &Analyzed = Copy ? *Copy : M;
+    auto &FAM =
+        Copy ? CopyFAM
+             : MAM.getResult<FunctionAnalysisManagerModuleProxy>(M)
+                   .getManager();
+    CudaAnalysis A;
+    A.GetLI = [&](Function &F) -> LoopInfo & {
+      return FAM.getResult<LoopAnalysis>(F);
+    };
+    A.GetSE = [&](Function &F) -> ScalarEvolution & {
+      return FAM.getResult<ScalarEvolutionAnalysis>(F);
+    };
+    A.doInitialization(M);
+    for (auto &F : Analyzed)
+      if (!F.isDeclaration())
+        A.runImpl(F);
+    // the kernel records are about the kernels the device passes transform
+    A.doFinalization(M);
+    if (!Cached.empty())
+      storeMetadata(Cached);
+    return PreservedAnalyses::all();
+  }
+};
+
+} // namespace
+
+// opt -load-pass-plugin=CudaAnalysis.so -passes=cuda-analysis, or
+// clang -fpass-plugin=CudaAnalysis.so, which runs it last on device modules
+// -passes=penguin-progress-hints instruments the device module for the
+// runtime's intra-kernel prefetch, see ProgressHints.h
+// -passes=penguin-grid-split adds the sub-grid parameter to the kernels the
+// -cuda-analysis-metadata file lists, see GridSplit.h
+// -passes=penguin-field-split lets the kernels it lists take their struct
+// array arguments by field, see FieldSplit.h
+// -passes=penguin-kernel-fusion adds the fused kernels of the pairs it lists,
+// see KernelFusion.h
+// -passes=penguin-read-only gives the read-only kernel arguments no store
+// reaches the non-coherent loads, see ReadOnly.h
+// -passes=penguin-access-sampling samples the global accesses of the device
+// code for the runtime's predicted-versus-measured report, see
+// AccessSampling.h
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "CudaAnalysis", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "penguin-progress-hints") {
+                    MPM.addPass(ProgressHintsPass());
+                    return true;
+                  }
+                  if (Name == "penguin-grid-split") {
+                    MPM.addPass(GridSplitPass(MetadataFile));
+                    return true;
+                  }
+                  if (Name == "penguin-field-split") {
+                    MPM.addPass(FieldSplitPass(MetadataFile));
+                    return true;
+                  }
+                  if (Name == "penguin-kernel-fusion") {
+                    MPM.addPass(KernelFusionPass(MetadataFile));
+                    return true;
+                  }
+                  if (Name == "penguin-read-only") {
+                    MPM.addPass(ReadOnlyPass());
+                    return true;
+                  }
+                  if (Name == "penguin-access-sampling") {
+                    MPM.addPass(AccessSamplingPass());
+                    return true;
+                  }
+                  if (Name != "cuda-analysis")
+                    return false;
+                  MPM.addPass(CudaAnalysisPass());
+                  return true;
+                });
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel) {
+                  MPM.addPass(CudaAnalysisPass(/*DeviceOnly=*/true));
+                });
+          }};
+}
@@ -0,0 +1,376 @@
+//===- FieldSplit.cpp - Per-field arrays of kernel struct arrays ----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/FieldSplit.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Transforms/CudaAnalysis/AnalysisMetadata.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-field-split"
+
+// a kernel that passes the argument down more calls deep than this is left
+// as a build error
+static constexpr unsigned MaxInlineRounds = 16;
+
+namespace {
+// Walks the addresses computed from a split argument: element pointers,
+// which point at the struct E elements from the argument, field pointers and
+// byte offsets into an element. With Fields, the base and the stride of each
+// field in the layout the kernel was given, every address a load or store
+// uses is rewritten to its field array.
+class FieldWalker {
+  StructType *Ty;
+  const DataLayout &DL;
+  const StructLayout *SL;
+  cuda_analysis::FieldAccesses &R;
+  ArrayRef<std::pair<Value *, Value *>> Fields;
+  SmallPtrSet<Argument *, 4> Visited;
+
+  bool rewriting() const { return !Fields.empty(); }
+
+  void note(Instruction *I, unsigned Field, bool Store) {
+    (Store ? R.Stored : R.Loaded) |= 1U << Field;
+    R.Accesses[Field].push_back(I);
+  }
+
+  // E + Idx elements
+  Value *advance(Instruction *At, Value *E, Value *Idx) {
+    if (!rewriting())
+      return nullptr;
+    IRBuilder<> B(At);
+    Value *Idx64 = B.CreateSExtOrTrunc(Idx, B.getInt64Ty());
+    return E ? B.CreateAdd(E, Idx64) : Idx64;
+  }
+
+  // Inner bytes into field Field of element E
+  Value *address(Instruction *At, unsigned Field, Value *E, uint64_t Inner,
+                 Type *PtrTy) {
+    IRBuilder<> B(At);
+    Value *Offset = B.CreateMul(E, Fields[Field].second);
+    if (Inner)
+      Offset = B.CreateAdd(Offset, B.getInt64(Inner));
+    Value *P = B.CreateGEP(B.getInt8Ty(), Fields[Field].first, Offset);
+    return B.CreatePointerBitCastOrAddrSpaceCast(P, PtrTy);
+  }
+
+  // Only loaded from and stored to, within field Field
+  bool dereferenced(Value *P, unsigned Field) {
+    for (User *U : P->users()) {
+      if (auto *Load = dyn_cast<LoadInst>(U)) {
+        if (Load->isVolatile())
+          return false;
+        note(Load, Field, false);
+      } else if (auto *Store = dyn_cast<StoreInst>(U)) {
+        if (Store->isVolatile() || Store->getValueOperand() == P)
+          return false;
+        note(Store, Field, true);
+      } else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U)) {
+        if (!dereferenced(U, Field))
+          return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // &element[E].field[rest...]
+  bool field(GetElementPtrInst *GEP, Value *E) {
+    auto *Index = dyn_cast<ConstantInt>(GEP->getOperand(2));
+    if (!Index || Index->getZExtValue() >= Ty->getNumElements())
+      return false;
+    unsigned Field = Index->getZExtValue();
+    if (!dereferenced(GEP, Field))
+      return false;
+    if (!rewriting())
+      return true;
+    E = advance(GEP, E, GEP->getOperand(1));
+    Type *FieldTy = Ty->getElementType(Field);
+    Value *New = address(GEP, Field, E, 0,
+                         FieldTy->getPointerTo(GEP->getAddressSpace()));
+    IRBuilder<> B(GEP);
+    if (GEP->getNumIndices() > 2) {
+      SmallVector<Value *, 4> Rest = {B.getInt64(0)};
+      for (unsigned I = 3; I < GEP->getNumOperands(); I++)
+        Rest.push_back(GEP->getOperand(I));
+      New = B.CreateGEP(FieldTy, New, Rest);
+    }
+    GEP->replaceAllUsesWith(B.CreatePointerCast(New, GEP->getType()));
+    Dead.push_back(GEP);
+    return true;
+  }
+
+  // Offset bytes into element E
+  bool bytes(Value *P, Value *E, uint64_t Offset) {
+    SmallVector<User *, 8> Users(P->users());
+    for (User *U : Users) {
+      if (auto *Cast = dyn_cast<BitCastInst>(U)) {
+        bool Ok = Offset == 0 && Cast->getDestTy()->getPointerElementType() == Ty
+                      ? element(Cast, E)
+                      : bytes(Cast, E, Offset);
+        if (!Ok)
+          return false;
+        Dead.push_back(Cast);
+      } else if (auto *GEP = dyn_cast<GetElementPtrInst>(U)) {
+        APInt Delta(DL.getIndexTypeSizeInBits(GEP->getType()), 0);
+        if (GEP->getPointerOperand() != P ||
+            !GEP->accumulateConstantOffset(DL, Delta))
+          return false;
+        int64_t Total = (int64_t) Offset + Delta.getSExtValue();
+        if (Total < 0)
+          return false;
+        uint64_t Size = SL->getSizeInBytes();
+        Value *Next = rewriting() && Total / Size
+                          ? advance(GEP, E, ConstantInt::get(E->getType(),
+                                                             Total / Size))
+                          : E;
+        if (!bytes(GEP, Next, Total % Size))
+          return false;
+        Dead.push_back(GEP);
+      } else if (isa<LoadInst>(U) || isa<StoreInst>(U)) {
+        auto *I = cast<Instruction>(U);
+        bool Store = isa<StoreInst>(I);
+        Type *AccessTy = Store ? cast<StoreInst>(I)->getValueOperand()->getType()
+                               : I->getType();
+        if ((Store && cast<StoreInst>(I)->getValueOperand() == P) ||
+            (Store ? cast<StoreInst>(I)->isVolatile()
+                   : cast<LoadInst>(I)->isVolatile()) ||
+            Offset >= SL->getSizeInBytes())
+          return false;
+        unsigned Field = SL->getElementContainingOffset(Offset);
+        uint64_t Inner = Offset - SL->getElementOffset(Field);
+        if (Inner + DL.getTypeStoreSize(AccessTy) >
+            DL.getTypeStoreSize(Ty->getElementType(Field)))
+          return false;
+        note(I, Field, Store);
+        if (rewriting()) {
+          unsigned Operand = Store ? 1 : 0;
+          I->setOperand(Operand, address(I, Field, E, Inner,
+                                         I->getOperand(Operand)->getType()));
+        }
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  SmallVector<Instruction *, 16> Dead;
+  // the header computation, which reads the argument itself
+  Value *Skip = nullptr;
+
+  FieldWalker(StructType *Ty, const DataLayout &DL,
+              cuda_analysis::FieldAccesses &R,
+              ArrayRef<std::pair<Value *, Value *>> Fields)
+      : Ty(Ty), DL(DL), SL(DL.getStructLayout(Ty)), R(R), Fields(Fields) {}
+
+  // P points at element E
+  bool element(Value *P, Value *E) {
+    SmallVector<User *, 8> Users(P->users());
+    for (User *U : Users) {
+      if (U == Skip)
+        continue;
+      if (auto *GEP = dyn_cast<GetElementPtrInst>(U)) {
+        if (GEP->getPointerOperand() != P || GEP->getSourceElementType() != Ty)
+          return false;
+        if (GEP->getNumIndices() >= 2) {
+          if (!field(GEP, E))
+            return false;
+          continue;
+        }
+        if (!element(GEP, advance(GEP, E, GEP->getOperand(1))))
+          return false;
+        Dead.push_back(GEP);
+      } else if (auto *Cast = dyn_cast<BitCastInst>(U)) {
+        bool Ok = Cast->getDestTy()->getPointerElementType() == Ty
+                      ? element(Cast, E)
+                      : bytes(Cast, E, 0);
+        if (!Ok)
+          return false;
+        Dead.push_back(Cast);
+      } else if (auto *Call = dyn_cast<CallBase>(U)) {
+        Function *Callee = Call->getCalledFunction();
+        if (rewriting() || !Callee || Callee->isDeclaration() ||
+            Callee->isVarArg() || Call->isInlineAsm())
+          return false;
+        for (unsigned I = 0; I < Call->arg_size(); I++) {
+          if (Call->getArgOperand(I) != P)
+            continue;
+          if (I >= Callee->arg_size() ||
+              Callee->getArg(I)->getType() != P->getType())
+            return false;
+          if (Visited.insert(Callee->getArg(I)).second &&
+              !element(Callee->getArg(I), nullptr))
+            return false;
+        }
+        R.Calls.push_back(Call);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+} // namespace
+
+bool cuda_analysis::findFieldAccesses(Argument &A, FieldAccesses &R) {
+  auto *PtrTy = dyn_cast<PointerType>(A.getType());
+  if (!PtrTy || PtrTy->isOpaque())
+    return false;
+  auto *Ty = dyn_cast<StructType>(PtrTy->getPointerElementType());
+  if (!Ty || !Ty->isSized() || Ty->getNumElements() == 0 ||
+      Ty->getNumElements() > FieldSplitMaxFields)
+    return false;
+  R = FieldAccesses();
+  R.Ty = Ty;
+  R.Accesses.resize(Ty->getNumElements());
+  FieldWalker W(Ty, A.getParent()->getParent()->getDataLayout(), R, {});
+  return W.element(&A, nullptr);
+}
+
+// In the entry block, after its allocas: the base and stride of every field
+// the kernel accesses, from the header when the argument is tagged and from
+// the struct layout otherwise, then every access rebased on them
+static void rewriteArgument(Argument &A, cuda_analysis::FieldAccesses &R) {
+  uint32_t Used = R.Loaded | R.Stored;
+  if (!Used)
+    return;
+  Function &F = *A.getParent();
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  const StructLayout *SL = DL.getStructLayout(R.Ty);
+  unsigned AS = A.getType()->getPointerAddressSpace();
+  LLVMContext &Ctx = F.getContext();
+  Type *Int8PtrTy = Type::getInt8PtrTy(Ctx, AS);
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  // the argument itself is no longer dereferenced
+  A.removeAttr(Attribute::Dereferenceable);
+  A.removeAttr(Attribute::DereferenceableOrNull);
+  BasicBlock &Entry = F.getEntryBlock();
+  auto At = Entry.getFirstInsertionPt();
+  while (isa<AllocaInst>(*At))
+    ++At;
+  IRBuilder<> B(&*At);
+  Value *Int = B.CreatePtrToInt(&A, Int64Ty);
+  Value *Tagged = B.CreateICmpNE(
+      B.CreateLShr(Int, cuda_analysis::FieldSplitTagShift), B.getInt64(0));
+  Value *Untagged = B.CreateIntToPtr(
+      B.CreateAnd(Int, ~(1ULL << cuda_analysis::FieldSplitTagShift)),
+      Int8PtrTy);
+  unsigned NumFields = R.Ty->getNumElements();
+  SmallVector<Value *, 8> Interleaved(NumFields), Split(NumFields);
+  for (unsigned Field = 0; Field < NumFields; Field++)
+    if (Used & (1U << Field))
+      Interleaved[Field] = B.CreateConstInBoundsGEP1_64(
+          B.getInt8Ty(), Untagged, SL->getElementOffset(Field));
+  Instruction *Then = SplitBlockAndInsertIfThen(Tagged, &*At, false);
+  IRBuilder<> TB(Then);
+  Value *Header = TB.CreateBitCast(Untagged, Int64Ty->getPointerTo(AS));
+  for (unsigned Field = 0; Field < NumFields; Field++)
+    if (Used & (1U << Field))
+      Split[Field] = TB.CreateGEP(
+          TB.getInt8Ty(), Untagged,
+          TB.CreateLoad(Int64Ty, TB.CreateConstGEP1_32(Int64Ty, Header, Field)));
+  BasicBlock *Tail = Then->getParent()->getSingleSuccessor();
+  IRBuilder<> PB(&Tail->front());
+  SmallVector<std::pair<Value *, Value *>, 8> Fields(NumFields);
+  for (unsigned Field = 0; Field < NumFields; Field++) {
+    if (!(Used & (1U << Field)))
+      continue;
+    PHINode *Base = PB.CreatePHI(Int8PtrTy, 2);
+    Base->addIncoming(Split[Field], Then->getParent());
+    Base->addIncoming(Interleaved[Field], &Entry);
+    PHINode *Stride = PB.CreatePHI(Int64Ty, 2);
+    Stride->addIncoming(
+        PB.getInt64(DL.getTypeAllocSize(R.Ty->getElementType(Field))),
+        Then->getParent());
+    Stride->addIncoming(PB.getInt64(SL->getSizeInBytes()), &Entry);
+    Fields[Field] = {Base, Stride};
+  }
+  cuda_analysis::FieldAccesses Rewritten = R;
+  FieldWalker W(R.Ty, DL, Rewritten, Fields);
+  W.Skip = Int;
+  if (!W.element(&A, ConstantInt::get(Int64Ty, 0)))
+    report_fatal_error(Twine("penguin-field-split: lost track of ") +
+                       A.getName() + " in " + F.getName());
+  for (Instruction *I : W.Dead)
+    if (I->use_empty())
+      I->eraseFromParent();
+}
+
+PreservedAnalyses FieldSplitPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  // argument, struct bytes, fields loaded, fields stored, fields
+  cuda_analysis::MetadataReader Metadata;
+  if (!Metadata.open(MetadataPath))
+    return PreservedAnalyses::all();
+  StringMap<SmallVector<SmallVector<uint32_t, 5>, 2>> Split;
+  Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+    if (R.Kind == cuda_analysis::RK_FieldSplit && R.Fields.size() >= 5)
+      Split[R.Kernel].push_back(
+          SmallVector<uint32_t, 5>(R.Fields.begin(), R.Fields.begin() + 5));
+  });
+  bool Changed = false;
+  for (auto &S : Split) {
+    Function *F = M.getFunction(S.getKey());
+    if (!F || F->isDeclaration())
+      continue;
+    for (auto &Record : S.getValue()) {
+      auto Mismatch = [&]() {
+        report_fatal_error(Twine("penguin-field-split: argument ") +
+                           Twine(Record[0]) + " of " + F->getName() +
+                           " is not the one " + MetadataPath + " describes");
+      };
+      if (Record[0] >= F->arg_size())
+        Mismatch();
+      Argument &A = *F->getArg(Record[0]);
+      // the host passes split pointers whatever this module looks like, so
+      // the functions the argument goes to are inlined and rewritten with the
+      // kernel
+      cuda_analysis::FieldAccesses R;
+      for (unsigned Round = 0;; Round++) {
+        if (!cuda_analysis::findFieldAccesses(A, R) || Round == MaxInlineRounds)
+          Mismatch();
+        SmallPtrSet<CallBase *, 4> Calls;
+        for (CallBase *Call : R.Calls)
+          if (Call->getFunction() == F)
+            Calls.insert(Call);
+        if (Calls.empty())
+          break;
+        for (CallBase *Call : Calls) {
+          InlineFunctionInfo IFI;
+          if (!InlineFunction(*Call, IFI).isSuccess())
+            Mismatch();
+        }
+      }
+      const DataLayout &DL = M.getDataLayout();
+      if (DL.getTypeAllocSize(R.Ty) != Record[1] ||
+          R.Ty->getNumElements() != Record[4] ||
+          ((R.Loaded | R.Stored) & ~(Record[2] | Record[3])) ||
+          (R.Stored & ~Record[3]))
+        Mismatch();
+      rewriteArgument(A, R);
+      Changed = true;
+    }
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
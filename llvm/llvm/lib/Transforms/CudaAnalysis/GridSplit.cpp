@@ -0,0 +1,236 @@
+//===- GridSplit.cpp - Sub-grid launches of independent kernels -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/GridSplit.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IntrinsicsNVPTX.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Transforms/CudaAnalysis/AnalysisMetadata.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-grid-split"
+
+// NVPTX shared memory, which only the threads of one block see
+static constexpr unsigned SharedAddressSpace = 3;
+
+// Functions nvvm.annotations marks as kernels
+static void collectKernels(Module &M, SmallPtrSetImpl<Function *> &Kernels) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    if (auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0)))
+      Kernels.insert(F);
+  }
+}
+
+static bool isBlockPositionRead(Intrinsic::ID ID) {
+  switch (ID) {
+  case Intrinsic::nvvm_read_ptx_sreg_ctaid_x:
+  case Intrinsic::nvvm_read_ptx_sreg_ctaid_y:
+  case Intrinsic::nvvm_read_ptx_sreg_ctaid_z:
+  case Intrinsic::nvvm_read_ptx_sreg_nctaid_x:
+  case Intrinsic::nvvm_read_ptx_sreg_nctaid_y:
+  case Intrinsic::nvvm_read_ptx_sreg_nctaid_z:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// F and what it calls; only the kernel itself has its block reads rebased
+static bool independentBlocks(const Function &F, bool IsKernel,
+                              SmallPtrSetImpl<const Function *> &Visited) {
+  if (!Visited.insert(&F).second)
+    return true;
+  for (const Instruction &I : instructions(F)) {
+    if (isa<AtomicCmpXchgInst>(I))
+      return false;
+    if (auto *Fence = dyn_cast<FenceInst>(&I)) {
+      if (Fence->getSyncScopeID() != SyncScope::SingleThread)
+        return false;
+      continue;
+    }
+    // an atomic only adds to a location unless a block acts on what it
+    // returned, e.g. the last block of the grid to finish
+    if (isa<AtomicRMWInst>(I) && !I.use_empty())
+      return false;
+    if (auto *Load = dyn_cast<LoadInst>(&I)) {
+      if (Load->isVolatile() &&
+          Load->getPointerAddressSpace() != SharedAddressSpace)
+        return false;
+      continue;
+    }
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      if (Store->isVolatile() &&
+          Store->getPointerAddressSpace() != SharedAddressSpace)
+        return false;
+      continue;
+    }
+    auto *Call = dyn_cast<CallBase>(&I);
+    if (!Call)
+      continue;
+    const Function *Callee = Call->getCalledFunction();
+    if (!Callee || Call->isInlineAsm())
+      return false;
+    if (Callee->isIntrinsic()) {
+      Intrinsic::ID ID = Callee->getIntrinsicID();
+      if (ID == Intrinsic::nvvm_membar_gl || ID == Intrinsic::nvvm_membar_sys)
+        return false;
+      if (!IsKernel && isBlockPositionRead(ID))
+        return false;
+      if (Callee->getName().startswith("llvm.nvvm.atomic") && !I.use_empty())
+        return false;
+      continue;
+    }
+    if (Callee->isDeclaration()) {
+      if (Callee->getName() == "vprintf")
+        continue;
+      return false;
+    }
+    if (!independentBlocks(*Callee, false, Visited))
+      return false;
+  }
+  return true;
+}
+
+bool cuda_analysis::blocksAreIndependent(const Function &F) {
+  if (F.isDeclaration())
+    return false;
+  SmallPtrSet<const Function *, 8> Visited;
+  return independentBlocks(F, true, Visited);
+}
+
+// blockIdx.x = split along y ? ctaid.x : (ctaid.x + offset) mod extent
+// gridDim.x = split along y ? nctaid.x : extent
+// and the other way around for y; z is never split. A sub-grid never gets
+// past the extent, a rotated whole grid wraps around it.
+static void rebaseBlockReads(Function &F, Argument *Split) {
+  SmallVector<IntrinsicInst *, 8> Reads;
+  for (Instruction &I : instructions(F)) {
+    auto *II = dyn_cast<IntrinsicInst>(&I);
+    if (!II)
+      continue;
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::nvvm_read_ptx_sreg_ctaid_x:
+    case Intrinsic::nvvm_read_ptx_sreg_ctaid_y:
+    case Intrinsic::nvvm_read_ptx_sreg_nctaid_x:
+    case Intrinsic::nvvm_read_ptx_sreg_nctaid_y:
+      Reads.push_back(II);
+      break;
+    default:
+      break;
+    }
+  }
+  if (Reads.empty())
+    return;
+  IRBuilder<> B(&*F.getEntryBlock().getFirstInsertionPt());
+  Value *AlongY = B.CreateICmpNE(
+      B.CreateLShr(Split, cuda_analysis::GridSplitYShift), B.getInt64(0));
+  Value *Offset = B.CreateTrunc(Split, B.getInt32Ty());
+  Value *Extent = B.CreateTrunc(
+      B.CreateAnd(B.CreateLShr(Split, cuda_analysis::GridSplitExtentShift),
+                  cuda_analysis::GridSplitExtentMask),
+      B.getInt32Ty());
+  for (IntrinsicInst *II : Reads) {
+    Intrinsic::ID ID = II->getIntrinsicID();
+    bool Y = ID == Intrinsic::nvvm_read_ptx_sreg_ctaid_y ||
+             ID == Intrinsic::nvvm_read_ptx_sreg_nctaid_y;
+    bool Dim = ID == Intrinsic::nvvm_read_ptx_sreg_nctaid_x ||
+               ID == Intrinsic::nvvm_read_ptx_sreg_nctaid_y;
+    B.SetInsertPoint(II->getNextNode());
+    Value *Sum = Dim ? nullptr : B.CreateAdd(II, Offset);
+    Value *Rebased =
+        Dim ? Extent
+            : B.CreateSelect(B.CreateICmpUGE(Sum, Extent),
+                             B.CreateSub(Sum, Extent), Sum);
+    Value *New = Y ? B.CreateSelect(AlongY, Rebased, II)
+                   : B.CreateSelect(AlongY, II, Rebased);
+    II->replaceUsesWithIf(New, [&](Use &U) {
+      return U.getUser() != New && U.getUser() != Sum;
+    });
+  }
+}
+
+// F with an i64 parameter after its own, which takes its place, name and
+// annotations
+static void addSplitParameter(Function &F) {
+  Module &M = *F.getParent();
+  FunctionType *FTy = F.getFunctionType();
+  SmallVector<Type *, 8> Params(FTy->param_begin(), FTy->param_end());
+  Params.push_back(Type::getInt64Ty(M.getContext()));
+  Function *NF = Function::Create(
+      FunctionType::get(FTy->getReturnType(), Params, FTy->isVarArg()),
+      F.getLinkage(), F.getAddressSpace());
+  NF->copyAttributesFrom(&F);
+  NF->copyMetadata(&F, 0);
+  NF->setComdat(F.getComdat());
+  M.getFunctionList().insert(F.getIterator(), NF);
+  NF->takeName(&F);
+  NF->getBasicBlockList().splice(NF->begin(), F.getBasicBlockList());
+  auto NewArg = NF->arg_begin();
+  for (Argument &A : F.args()) {
+    A.replaceAllUsesWith(&*NewArg);
+    NewArg->takeName(&A);
+    ++NewArg;
+  }
+  Argument *Split = NF->getArg(F.arg_size());
+  Split->setName("penguin.grid.split");
+  F.replaceAllUsesWith(ConstantExpr::getBitCast(NF, F.getType()));
+  F.eraseFromParent();
+  rebaseBlockReads(*NF, Split);
+}
+
+PreservedAnalyses GridSplitPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  // the kernels the host transform launches with the parameter, with the
+  // parameters they had
+  cuda_analysis::MetadataReader Metadata;
+  if (!Metadata.open(MetadataPath))
+    return PreservedAnalyses::all();
+  StringMap<unsigned> Split;
+  Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+    if (R.Kind == cuda_analysis::RK_GridSplit && R.Fields.size() >= 1)
+      Split[R.Kernel] = R.Fields[0];
+  });
+  SmallPtrSet<Function *, 16> Kernels;
+  collectKernels(M, Kernels);
+  bool Changed = false;
+  for (Function *F : Kernels) {
+    auto S = Split.find(F->getName());
+    if (S == Split.end() || F->isDeclaration())
+      continue;
+    // the host passes the parameter whatever this module looks like; a
+    // kernel it can't be added to is a build error, not a wrong result
+    if (F->arg_size() != S->second || !cuda_analysis::blocksAreIndependent(*F))
+      report_fatal_error(Twine("penguin-grid-split: ") + F->getName() +
+                         " is not the kernel " + MetadataPath +
+                         " describes");
+    addSplitParameter(*F);
+    Changed = true;
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,242 @@
+//===- KernelFusion.cpp - Fused producer/consumer kernels -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/KernelFusion.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsNVPTX.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Transforms/CudaAnalysis/AnalysisMetadata.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-kernel-fusion"
+
+// NVPTX constant and local memory
+static constexpr unsigned ConstantAddressSpace = 4;
+static constexpr unsigned LocalAddressSpace = 5;
+
+static bool isRead(const Value *V, Intrinsic::ID ID) {
+  auto *II = dyn_cast<IntrinsicInst>(V);
+  return II && II->getIntrinsicID() == ID;
+}
+
+// blockIdx.x * blockDim.x + threadIdx.x, extended or not
+static bool isGlobalIndex(const Value *V) {
+  while (isa<SExtInst>(V) || isa<ZExtInst>(V))
+    V = cast<Instruction>(V)->getOperand(0);
+  auto *Add = dyn_cast<BinaryOperator>(V);
+  if (!Add || Add->getOpcode() != Instruction::Add)
+    return false;
+  for (unsigned T = 0; T < 2; T++) {
+    if (!isRead(Add->getOperand(T), Intrinsic::nvvm_read_ptx_sreg_tid_x))
+      continue;
+    auto *Mul = dyn_cast<BinaryOperator>(Add->getOperand(1 - T));
+    if (!Mul || Mul->getOpcode() != Instruction::Mul)
+      return false;
+    Value *L = Mul->getOperand(0), *R = Mul->getOperand(1);
+    return (isRead(L, Intrinsic::nvvm_read_ptx_sreg_ctaid_x) &&
+            isRead(R, Intrinsic::nvvm_read_ptx_sreg_ntid_x)) ||
+           (isRead(L, Intrinsic::nvvm_read_ptx_sreg_ntid_x) &&
+            isRead(R, Intrinsic::nvvm_read_ptx_sreg_ctaid_x));
+  }
+  return false;
+}
+
+static bool sameElement(uint64_t Bytes, cuda_analysis::ElementWise &R) {
+  if (!R.ElementBytes)
+    R.ElementBytes = Bytes;
+  return R.ElementBytes == Bytes;
+}
+
+// The uses of P, argument Arg or a pointer computed from it; Indexed once it
+// points at the element of the thread
+static bool elementAccesses(const Value *P, unsigned Arg, bool Indexed,
+                            const DataLayout &DL,
+                            cuda_analysis::ElementWise &R) {
+  for (const User *U : P->users()) {
+    if (isa<BitCastInst>(U) || isa<AddrSpaceCastInst>(U)) {
+      if (!elementAccesses(U, Arg, Indexed, DL, R))
+        return false;
+      continue;
+    }
+    if (isa<ICmpInst>(U))
+      continue;
+    if (auto *GEP = dyn_cast<GetElementPtrInst>(U)) {
+      if (Indexed || GEP->getPointerOperand() != P ||
+          GEP->getNumIndices() != 1 || !isGlobalIndex(GEP->getOperand(1)) ||
+          !sameElement(DL.getTypeAllocSize(GEP->getSourceElementType()), R) ||
+          !elementAccesses(GEP, Arg, true, DL, R))
+        return false;
+      continue;
+    }
+    if (auto *Load = dyn_cast<LoadInst>(U)) {
+      if (!Indexed || !Load->isSimple() ||
+          !sameElement(DL.getTypeStoreSize(Load->getType()), R))
+        return false;
+      R.Loaded |= 1u << Arg;
+      continue;
+    }
+    if (auto *Store = dyn_cast<StoreInst>(U)) {
+      if (!Indexed || !Store->isSimple() || Store->getPointerOperand() != P ||
+          !sameElement(
+              DL.getTypeStoreSize(Store->getValueOperand()->getType()), R))
+        return false;
+      R.Stored |= 1u << Arg;
+      continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+// A load or store that isn't through an argument: of the thread's stack or,
+// for loads, of constants
+static bool isPrivateAccess(const Value *Ptr, bool Load) {
+  if (Ptr->getType()->getPointerAddressSpace() == LocalAddressSpace)
+    return true;
+  const Value *Object = getUnderlyingObject(Ptr);
+  if (isa<Argument>(Object) || isa<AllocaInst>(Object))
+    return true;
+  auto *GV = dyn_cast<GlobalVariable>(Object);
+  return Load && GV &&
+         (GV->isConstant() ||
+          GV->getType()->getAddressSpace() == ConstantAddressSpace);
+}
+
+bool cuda_analysis::findElementWiseAccesses(const Function &F,
+                                            ElementWise &R) {
+  if (F.isDeclaration() || F.arg_size() > FusionMaxArgs)
+    return false;
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  R = ElementWise();
+  for (const Argument &A : F.args())
+    if (A.getType()->isPointerTy() &&
+        !elementAccesses(&A, A.getArgNo(), false, DL, R))
+      return false;
+  // the arguments' uses are all accounted for, which leaves the rest
+  for (const Instruction &I : instructions(F)) {
+    if (auto *Load = dyn_cast<LoadInst>(&I)) {
+      if (!Load->isSimple() ||
+          !isPrivateAccess(Load->getPointerOperand(), true))
+        return false;
+      continue;
+    }
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      if (!Store->isSimple() ||
+          !isPrivateAccess(Store->getPointerOperand(), false))
+        return false;
+      continue;
+    }
+    if (I.isAtomic())
+      return false;
+    auto *Call = dyn_cast<CallBase>(&I);
+    if (!Call)
+      continue;
+    auto *II = dyn_cast<IntrinsicInst>(Call);
+    if (!II || !(II->doesNotAccessMemory() || II->isLifetimeStartOrEnd()))
+      return false;
+  }
+  return R.Loaded || R.Stored;
+}
+
+// First's and then Second's threads, in one kernel taking the parameters of
+// both
+static void fuse(Function &First, Function &Second, StringRef Name) {
+  Module &M = *First.getParent();
+  LLVMContext &Ctx = M.getContext();
+  SmallVector<Type *, 16> Params(First.getFunctionType()->param_begin(),
+                                 First.getFunctionType()->param_end());
+  Params.append(Second.getFunctionType()->param_begin(),
+                Second.getFunctionType()->param_end());
+  Function *F = Function::Create(
+      FunctionType::get(Type::getVoidTy(Ctx), Params, false),
+      GlobalValue::ExternalLinkage, First.getAddressSpace(), Name, &M);
+  F->setCallingConv(First.getCallingConv());
+  for (Attribute Attr : First.getAttributes().getFnAttrs())
+    F->addFnAttr(Attr);
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+  SmallVector<CallInst *, 2> Calls;
+  unsigned Next = 0;
+  for (Function *K : {&First, &Second}) {
+    // the same array may come in an argument of each
+    ValueToValueMapTy VMap;
+    Function *Body = CloneFunction(K, VMap);
+    Body->setLinkage(GlobalValue::InternalLinkage);
+    Body->setCallingConv(CallingConv::C);
+    for (Argument &A : Body->args())
+      A.removeAttr(Attribute::NoAlias);
+    SmallVector<Value *, 8> Args;
+    for (unsigned I = 0; I < K->arg_size(); I++)
+      Args.push_back(F->getArg(Next++));
+    Calls.push_back(B.CreateCall(Body, Args));
+  }
+  B.CreateRetVoid();
+  for (CallInst *Call : Calls) {
+    Function *Body = Call->getCalledFunction();
+    InlineFunctionInfo IFI;
+    if (!InlineFunction(*Call, IFI).isSuccess())
+      report_fatal_error(Twine("penguin-kernel-fusion: cannot inline ") +
+                         Body->getName() + " into " + Name);
+    Body->eraseFromParent();
+  }
+  Metadata *Kernel[] = {ValueAsMetadata::get(F), MDString::get(Ctx, "kernel"),
+                        ValueAsMetadata::get(ConstantInt::get(
+                            Type::getInt32Ty(Ctx), 1))};
+  M.getOrInsertNamedMetadata("nvvm.annotations")
+      ->addOperand(MDNode::get(Ctx, Kernel));
+}
+
+PreservedAnalyses KernelFusionPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  cuda_analysis::MetadataReader Metadata;
+  if (!Metadata.open(MetadataPath))
+    return PreservedAnalyses::all();
+  struct Pair {
+    std::string First, Second, Fused;
+    uint32_t ElementBytes;
+  };
+  std::vector<Pair> Pairs;
+  Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+    if (R.Kind == cuda_analysis::RK_KernelFusion && R.Fields.size() >= 3 &&
+        R.Tokens.size() >= 2)
+      Pairs.push_back({R.Kernel.str(), Metadata.string(R.Tokens[0]).str(),
+                       Metadata.string(R.Tokens[1]).str(), R.Fields[2]});
+  });
+  bool Changed = false;
+  for (auto &P : Pairs) {
+    Function *First = M.getFunction(P.First);
+    Function *Second = M.getFunction(P.Second);
+    if (M.getFunction(P.Fused))
+      continue;
+    // the host launches the fused kernel whatever this module looks like; a
+    // pair that can't be fused is a build error, not a wrong result
+    cuda_analysis::ElementWise A, B;
+    if (!First || !Second || !cuda_analysis::findElementWiseAccesses(*First, A) ||
+        !cuda_analysis::findElementWiseAccesses(*Second, B) ||
+        A.ElementBytes != P.ElementBytes || B.ElementBytes != P.ElementBytes)
+      report_fatal_error(Twine("penguin-kernel-fusion: ") + P.First + " and " +
+                         P.Second + " are not the kernels " + MetadataPath +
+                         " describes");
+    fuse(*First, *Second, P.Fused);
+    Changed = true;
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
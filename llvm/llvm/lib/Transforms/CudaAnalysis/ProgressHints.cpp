@@ -0,0 +1,79 @@
+//===- ProgressHints.cpp - Thread block progress counter ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/ProgressHints.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IntrinsicsNVPTX.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-progress-hints"
+
+// Functions nvvm.annotations marks as kernels
+static void collectKernels(Module &M, SmallPtrSetImpl<Function *> &Kernels) {
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    if (auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0)))
+      Kernels.insert(F);
+  }
+}
+
+// if (threadIdx.x == 0 && threadIdx.y == 0 && threadIdx.z == 0)
+//   atomicAdd(&penguin_progress_blocks, 1);
+// at the entry of F, so a block is counted when it starts
+static void insertBlockCount(Function &F, GlobalVariable *Counter) {
+  Module &M = *F.getParent();
+  Instruction *Entry = &*F.getEntryBlock().getFirstInsertionPt();
+  IRBuilder<> B(Entry);
+  Value *X = B.CreateCall(Intrinsic::getDeclaration(
+      &M, Intrinsic::nvvm_read_ptx_sreg_tid_x));
+  Value *Y = B.CreateCall(Intrinsic::getDeclaration(
+      &M, Intrinsic::nvvm_read_ptx_sreg_tid_y));
+  Value *Z = B.CreateCall(Intrinsic::getDeclaration(
+      &M, Intrinsic::nvvm_read_ptx_sreg_tid_z));
+  Value *First = B.CreateICmpEQ(B.CreateOr(B.CreateOr(X, Y), Z), B.getInt32(0));
+  Instruction *Then = SplitBlockAndInsertIfThen(First, Entry, false);
+  B.SetInsertPoint(Then);
+  B.CreateAtomicRMW(AtomicRMWInst::Add, Counter, B.getInt64(1), MaybeAlign(8),
+                    AtomicOrdering::Monotonic);
+}
+
+PreservedAnalyses ProgressHintsPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  GlobalVariable *Counter =
+      M.getGlobalVariable(cuda_analysis::ProgressCounterName);
+  if (!Counter || !Counter->getValueType()->isIntegerTy(64))
+    return PreservedAnalyses::all();
+  SmallPtrSet<Function *, 16> Kernels;
+  collectKernels(M, Kernels);
+  bool Changed = false;
+  for (Function *F : Kernels) {
+    if (F->isDeclaration())
+      continue;
+    insertBlockCount(*F, Counter);
+    Changed = true;
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,281 @@
+//===- ReadOnly.cpp - Read-only kernel pointer arguments ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/CudaAnalysis/ReadOnly.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "penguin-read-only"
+
+// NVPTX shared and local memory, which no kernel argument points into
+static constexpr unsigned SharedAddressSpace = 3;
+static constexpr unsigned LocalAddressSpace = 5;
+
+static bool onlyLoaded(const Value *P, SmallPtrSetImpl<const Value *> &Visited) {
+  if (!Visited.insert(P).second)
+    return true;
+  for (const User *U : P->users()) {
+    if (auto *Load = dyn_cast<LoadInst>(U)) {
+      if (Load->isVolatile())
+        return false;
+      continue;
+    }
+    if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U) ||
+        isa<AddrSpaceCastInst>(U) || isa<PHINode>(U) || isa<SelectInst>(U)) {
+      if (!onlyLoaded(U, Visited))
+        return false;
+      continue;
+    }
+    if (isa<ICmpInst>(U))
+      continue;
+    auto *Call = dyn_cast<CallBase>(U);
+    if (!Call || Call->isInlineAsm())
+      return false;
+    const Function *Callee = Call->getCalledFunction();
+    if (!Callee)
+      return false;
+    if (auto *Transfer = dyn_cast<MemTransferInst>(Call)) {
+      if (Transfer->getRawDest() == P || Transfer->isVolatile())
+        return false;
+      continue;
+    }
+    if (Callee->isIntrinsic()) {
+      // the read-only caches' own loads, prefetches and the like
+      if (!Call->onlyReadsMemory())
+        return false;
+      continue;
+    }
+    if (Callee->isDeclaration()) {
+      if (Callee->getName() == "vprintf")
+        continue;
+      return false;
+    }
+    for (unsigned I = 0; I < Call->arg_size(); I++) {
+      if (Call->getArgOperand(I) != P)
+        continue;
+      if (I >= Callee->arg_size() || !onlyLoaded(Callee->getArg(I), Visited))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool cuda_analysis::isOnlyLoaded(const Argument &A) {
+  if (!A.getType()->isPointerTy())
+    return false;
+  SmallPtrSet<const Value *, 16> Visited;
+  return onlyLoaded(&A, Visited);
+}
+
+static bool onlyStored(const Value *P, SmallPtrSetImpl<const Value *> &Visited) {
+  if (!Visited.insert(P).second)
+    return true;
+  for (const User *U : P->users()) {
+    if (auto *Store = dyn_cast<StoreInst>(U)) {
+      // storing the pointer itself lets it escape
+      if (Store->isVolatile() || Store->getPointerOperand() != P)
+        return false;
+      continue;
+    }
+    if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U) ||
+        isa<AddrSpaceCastInst>(U) || isa<PHINode>(U) || isa<SelectInst>(U)) {
+      if (!onlyStored(U, Visited))
+        return false;
+      continue;
+    }
+    if (isa<ICmpInst>(U))
+      continue;
+    auto *Call = dyn_cast<CallBase>(U);
+    if (!Call || Call->isInlineAsm())
+      return false;
+    const Function *Callee = Call->getCalledFunction();
+    if (!Callee)
+      return false;
+    if (auto *Set = dyn_cast<MemSetInst>(Call)) {
+      if (Set->getRawDest() != P || Set->isVolatile())
+        return false;
+      continue;
+    }
+    if (auto *Transfer = dyn_cast<MemTransferInst>(Call)) {
+      if (Transfer->getRawSource() == P || Transfer->isVolatile())
+        return false;
+      continue;
+    }
+    if (Callee->isIntrinsic()) {
+      if (!Call->doesNotAccessMemory() && !Call->isLifetimeStartOrEnd())
+        return false;
+      continue;
+    }
+    if (Callee->isDeclaration())
+      return false;
+    for (unsigned I = 0; I < Call->arg_size(); I++) {
+      if (Call->getArgOperand(I) != P)
+        continue;
+      if (I >= Callee->arg_size() || !onlyStored(Callee->getArg(I), Visited))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool cuda_analysis::isOnlyStored(const Argument &A) {
+  if (!A.getType()->isPointerTy() || A.use_empty())
+    return false;
+  SmallPtrSet<const Value *, 16> Visited;
+  return onlyStored(&A, Visited);
+}
+
+static bool atomicUse(const Value *P, SmallPtrSetImpl<const Value *> &Visited) {
+  if (!Visited.insert(P).second)
+    return false;
+  for (const User *U : P->users()) {
+    if (auto *RMW = dyn_cast<AtomicRMWInst>(U)) {
+      if (RMW->getPointerOperand() == P)
+        return true;
+      continue;
+    }
+    if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(U)) {
+      if (CmpXchg->getPointerOperand() == P)
+        return true;
+      continue;
+    }
+    if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U) ||
+        isa<AddrSpaceCastInst>(U) || isa<PHINode>(U) || isa<SelectInst>(U)) {
+      if (atomicUse(U, Visited))
+        return true;
+      continue;
+    }
+    auto *Call = dyn_cast<CallBase>(U);
+    const Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+    if (!Callee)
+      continue;
+    if (Callee->isIntrinsic()) {
+      if (Callee->getName().startswith("llvm.nvvm.atomic"))
+        return true;
+      continue;
+    }
+    if (Callee->isDeclaration())
+      continue;
+    for (unsigned I = 0; I < Call->arg_size() && I < Callee->arg_size(); I++)
+      if (Call->getArgOperand(I) == P && atomicUse(Callee->getArg(I), Visited))
+        return true;
+  }
+  return false;
+}
+
+bool cuda_analysis::isAtomicTarget(const Argument &A) {
+  if (!A.getType()->isPointerTy())
+    return false;
+  SmallPtrSet<const Value *, 16> Visited;
+  return atomicUse(&A, Visited);
+}
+
+// Whether a write to Ptr, in the kernel of A or a function it calls, may
+// reach the object of A: unless it is on the stack, in shared memory, or the
+// object of another noalias argument of the kernel
+static bool mayWriteTo(const Value *Ptr, const Argument &A) {
+  if (Ptr->getType()->getPointerAddressSpace() == SharedAddressSpace ||
+      Ptr->getType()->getPointerAddressSpace() == LocalAddressSpace)
+    return false;
+  const Value *Object = getUnderlyingObject(Ptr);
+  if (isa<AllocaInst>(Object))
+    return false;
+  if (auto *Other = dyn_cast<Argument>(Object))
+    return Other == &A || Other->getParent() != A.getParent() ||
+           !Other->hasNoAliasAttr();
+  return true;
+}
+
+static bool noWriteReaches(const Function &F, const Argument &A,
+                           SmallPtrSetImpl<const Function *> &Visited) {
+  if (!Visited.insert(&F).second)
+    return true;
+  for (const Instruction &I : instructions(F)) {
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      if (mayWriteTo(Store->getPointerOperand(), A))
+        return false;
+      continue;
+    }
+    if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+      if (mayWriteTo(RMW->getPointerOperand(), A))
+        return false;
+      continue;
+    }
+    if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+      if (mayWriteTo(CmpXchg->getPointerOperand(), A))
+        return false;
+      continue;
+    }
+    auto *Call = dyn_cast<CallBase>(&I);
+    if (!Call || Call->onlyReadsMemory())
+      continue;
+    if (auto *Mem = dyn_cast<MemIntrinsic>(Call)) {
+      if (mayWriteTo(Mem->getRawDest(), A))
+        return false;
+      continue;
+    }
+    const Function *Callee = Call->getCalledFunction();
+    if (!Callee || Call->isInlineAsm())
+      return false;
+    if (Callee->isIntrinsic()) {
+      // barriers, fences and the special registers write nothing of A's
+      if (Callee->getName().startswith("llvm.nvvm.atomic"))
+        return false;
+      continue;
+    }
+    if (Callee->isDeclaration()) {
+      if (Callee->getName() == "vprintf")
+        continue;
+      return false;
+    }
+    if (!noWriteReaches(*Callee, A, Visited))
+      return false;
+  }
+  return true;
+}
+
+PreservedAnalyses ReadOnlyPass::run(Module &M, ModuleAnalysisManager &) {
+  if (!Triple(M.getTargetTriple()).isNVPTX())
+    return PreservedAnalyses::all();
+  NamedMDNode *Annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!Annotations)
+    return PreservedAnalyses::all();
+  bool Changed = false;
+  for (MDNode *Node : Annotations->operands()) {
+    if (Node->getNumOperands() < 3)
+      continue;
+    auto *Kind = dyn_cast<MDString>(Node->getOperand(1));
+    if (!Kind || Kind->getString() != "kernel")
+      continue;
+    auto *F = mdconst::dyn_extract_or_null<Function>(Node->getOperand(0));
+    if (!F || F->isDeclaration())
+      continue;
+    for (Argument &A : F->args()) {
+      if (A.hasNoAliasAttr() && A.onlyReadsMemory())
+        continue;
+      if (!cuda_analysis::isOnlyLoaded(A))
+        continue;
+      SmallPtrSet<const Function *, 8> Visited;
+      if (!noWriteReaches(*F, A, Visited))
+        continue;
+      A.addAttr(Attribute::NoAlias);
+      A.addAttr(Attribute::ReadOnly);
+      Changed = true;
+    }
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -6,8 +6,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm-c/Core.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopNestAnalysis.h"
 #include "llvm/Analysis/ScalarEvolution.h"
@@ -23,16 +25,22 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/User.h"
 #include "llvm/Pass.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/AllocatorBase.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <fstream>
+#include <functional>
 #include <stack>
 #include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -46,6 +54,13 @@ using namespace llvm;
  unsigned long long GPU_SIZE = (1ULL) * 1024ULL * 1024ULL * 2048ULL;
 double MIN_ALLOC_PERC = 6;
 
+static cl::opt<bool> SubRanges(
+    "penguin-sub-ranges",
+    cl::desc("Hand the sub-allocations of every allocation to the runtime "
+             "with penguinSetSubRange, which keeps a decision and prefetch "
+             "schedule per range, rather than issuing their advisories"),
+    cl::init(false));
+
 namespace {
 
   enum AllocationAccessPatternType {
@@ -87,6 +102,14 @@ namespace {
     struct ExprTreeNode* children[2];
   };
 
+  // Expression trees live until the end of the module: they are allocated
+  // from this arena and released together by releaseExpressionTrees.
+  SpecificBumpPtrAllocator<ExprTreeNode> ExprTreeNodeArena;
+
+  ExprTreeNode *newExprTreeNode() {
+    return new (ExprTreeNodeArena.Allocate()) ExprTreeNode();
+  }
+
   enum AdvisoryType {
     ADVISORY_SET_PREFERRED_LOCATION,
     ADVISORY_SET_ACCESSED_BY,
@@ -98,6 +121,14 @@ namespace {
     ADVISORY_MAX,
   };
 
+  // the runtime's Decision, penguin.h
+  enum RuntimeDecision {
+    RUNTIME_DEC_HOST_PIN = 1,
+    RUNTIME_DEC_GPU_PIN = 2,
+    RUNTIME_DEC_MIGRATE_ON_DEMAND = 4,
+    RUNTIME_DEC_ITERATION_MIGRATION = 5,
+  };
+
   enum BlockSizeType {
     AXIS_TYPE_BDIMX,
     AXIS_TYPE_BDIMY,
@@ -179,28 +210,28 @@ namespace {
   /* std::vector<struct AllocationStruct> AllocationStructs; */
 
   std::set<Value*> StructAllocas;
-  std::map<AllocaInst*, std::map<unsigned, Value*>> StructAllocasToIndexToValuesMap;
+  DenseMap<AllocaInst*, std::map<unsigned, Value*>> StructAllocasToIndexToValuesMap;
 
   std::set<Function *> ListOfLocallyDefinedFunctions;
   std::map<Function *, std::vector<Value *>> FunctionToFormalArgumentMap;
   std::map<CallBase *, std::vector<Value *>> FunctionCallToActualArumentsMap;
   std::map<Value *, std::vector<Value *>> FormalArgumentToActualArgumentMap;
   /* std::map<Value *, Value *> ActualArgumentToFormalArgumentMap; */
-  std::map<Value*, std::map<Value *, Value *>> FunctionCallToFormalArgumentToActualArgumentMap;
-  std::map<Value*, std::map<Value *, Value *>> FunctionCallToActualArgumentToFormalArgumentMap;
+  DenseMap<Value*, std::map<Value *, Value *>> FunctionCallToFormalArgumentToActualArgumentMap;
+  DenseMap<Value*, std::map<Value *, Value *>> FunctionCallToActualArgumentToFormalArgumentMap;
 
   std::set<Value *> OriginalPointers;
   std::map<Value *, Value*> PointerOpToOriginalPointers;
-  std::map<Value *, Value*> PointerOpToOriginalStructPointer;
-  std::map<Value *, unsigned> PointerOpToOriginalStructPointersIndex;
+  DenseMap<Value *, Value*> PointerOpToOriginalStructPointer;
+  DenseMap<Value *, unsigned> PointerOpToOriginalStructPointersIndex;
 
-  std::map<Value*, unsigned> PointerOpToOriginalConstant;
+  DenseMap<Value*, unsigned> PointerOpToOriginalConstant;
 
   std::set<CallBase*> VisitedCallInstForPointerPropogation;
 
   std::set<Instruction*> MemcpyOpForStructs;
-  std::map<Value*, Instruction*> MemcpyOpForStructsSrcToInstMap;
-  std::map<Value*, Instruction*> MemcpyOpForStructsDstToInstMap;
+  DenseMap<Value*, Instruction*> MemcpyOpForStructsSrcToInstMap;
+  DenseMap<Value*, Instruction*> MemcpyOpForStructsDstToInstMap;
 
   // for each kernel invocation, for each argument, store the access count
   std::map<std::string, std::vector<std::pair<unsigned, unsigned>>>
@@ -211,45 +242,45 @@ namespace {
     std::map<unsigned, std::map<IndexAxisType, std::vector<std::string>>>>
       KernelParamReuseInKernel;
   std::map<Value *, unsigned long int> MallocSizeMap;
-  std::map<Value *, unsigned long int> MallocPointerToSizeMap;
-  std::map<Value*, std::map<unsigned, unsigned long long>> MallocPointerStructToIndexToSizeMap;
+  DenseMap<Value *, unsigned long int> MallocPointerToSizeMap;
+  DenseMap<Value*, std::map<unsigned, unsigned long long>> MallocPointerStructToIndexToSizeMap;
 
   std::map<Value *, std::vector<Value *>> KernelArgToStoreMap;
   std::map<Instruction *, Value *> KernelInvocationToStructMap;
-  std::map<Instruction *, std::map<unsigned, Value *>>
+  DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToActualArgMap;
-  std::map<Instruction *, std::map<unsigned, Value *>>
+  DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToAllocationMap;
-  std::map<Instruction *, std::map<unsigned, Value *>>
+  DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToLastStoreMap;
-  std::map<Instruction*, std::map<Value*, Value*>>
+  DenseMap<Instruction*, std::map<Value*, Value*>>
     KernelInvocationToKernArgToAllocationMap;
-  std::map<Instruction *, std::map<unsigned, Value *>>
+  DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToConstantMap;
-  std::map<Instruction *, std::map<unsigned, Value *>>
+  DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToLIVMap;
-  std::map<Instruction *, std::map<Value*, unsigned>>
+  DenseMap<Instruction *, std::map<Value*, unsigned>>
     KernelInvocationToLIVToArgNumMap;
   std::map<Instruction *, std::map<BlockSizeType, unsigned>>
     KernelInvocationToBlockSizeMap;
-  std::map<Instruction *, std::map<GridSizeType, unsigned>>
+  DenseMap<Instruction *, std::map<GridSizeType, unsigned>>
     KernelInvocationToGridSizeMap; // when grid size is constant
-  std::map<Instruction *, std::map<GridSizeType, Value*>>
+  DenseMap<Instruction *, std::map<GridSizeType, Value*>>
     KernelInvocationToGridSizeValueMap; // when grid size is variable
 
 
-  std::map<Instruction*, unsigned long> KernelInvocationToIterMap;
-  std::map<Instruction*, unsigned long> KernelInvocationToStepsMap;
+  DenseMap<Instruction*, unsigned long> KernelInvocationToIterMap;
+  DenseMap<Instruction*, unsigned long> KernelInvocationToStepsMap;
 
-  std::map<Instruction*, std::map<unsigned, unsigned long long>> KernelInvocationToAccessIDToAccessDensity;
-  std::map<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_phi;
-  std::map<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_bidx;
-  std::map<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_bidy;
-  std::map<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_looparg;
-  std::map<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToWSS;
+  DenseMap<Instruction*, std::map<unsigned, unsigned long long>> KernelInvocationToAccessIDToAccessDensity;
+  DenseMap<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_phi;
+  DenseMap<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_bidx;
+  DenseMap<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_bidy;
+  DenseMap<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToPartDiff_looparg;
+  DenseMap<Instruction*, std::map<unsigned, unsigned>> KernelInvocationToAccessIDToWSS;
 
-  std::map<Instruction *, Value*> KernelInvocationToEnclosingLoopMap;
-  std::map<Instruction *, Function*> KernelInvocationToEnclosingFunction;
+  DenseMap<Instruction *, Value*> KernelInvocationToEnclosingLoopMap;
+  DenseMap<Instruction *, Function*> KernelInvocationToEnclosingFunction;
 
   // map from loop id to loop iterations
   std::map<std::string, std::map<unsigned, std::vector<std::string>>> LoopIDToLoopBoundsMap;
@@ -258,6 +289,14 @@ namespace {
   std::map<std::string, std::map<unsigned, ExprTreeNode*>> LoopIDToBoundsExprMapIn;
   std::map<std::string, std::map<unsigned, ExprTreeNode*>> LoopIDToBoundsExprMapFin;
   std::map<std::string, std::map<unsigned, ExprTreeNode*>> LoopIDToBoundsExprMapStep;
+
+  // Drops every reference to the expression trees, then the trees themselves
+  void releaseExpressionTrees() {
+    LoopIDToBoundsExprMapIn.clear();
+    LoopIDToBoundsExprMapFin.clear();
+    LoopIDToBoundsExprMapStep.clear();
+    ExprTreeNodeArena.DestroyAll();
+  }
   std::map<std::string, std::map<unsigned, unsigned>> LoopIDToBoundsMapIn;
   std::map<std::string, std::map<unsigned, unsigned>> LoopIDToBoundsMapFin;
   std::map<std::string, std::map<unsigned, unsigned>> LoopIDToBoundsMapStep;
@@ -282,6 +321,10 @@ namespace {
 
     CudaHostTransform() : ModulePass(ID) {}
 
+    // Function analyses, from the legacy or the new pass manager
+    std::function<LoopInfo &(Function &)> GetLI;
+    std::function<ScalarEvolution &(Function &)> GetSE;
+
     void processMemoryAllocation(CallBase *I) {
       errs() << "processing memory allocation\n";
       I->dump();
@@ -841,7 +884,7 @@ namespace {
     }
 
     ExprTreeNode* operateMax(CallBase* CI, ExprTreeNode* operation, ExprTreeNode* op1, ExprTreeNode* op2, unsigned LoopArg, unsigned loopid) {
-      ExprTreeNode* result = new ExprTreeNode();
+      ExprTreeNode* result = newExprTreeNode();
       unsigned long long v1 = getMaxValueForLiterals(CI, op1, LoopArg, loopid);
       unsigned long long v2 = getMaxValueForLiterals(CI, op2, LoopArg, loopid);
       unsigned long long res = 1;
@@ -867,7 +910,7 @@ namespace {
     }
 
     ExprTreeNode* operateMin(CallBase* CI, ExprTreeNode* operation, ExprTreeNode* op1, ExprTreeNode* op2, unsigned LoopArg, unsigned loopid) {
-      ExprTreeNode* result = new ExprTreeNode();
+      ExprTreeNode* result = newExprTreeNode();
       unsigned long long v1 = getMinValueForLiterals(CI, op1, LoopArg, loopid);
       unsigned long long v2 = getMinValueForLiterals(CI, op2, LoopArg, loopid);
       unsigned long long res = 1;
@@ -893,7 +936,7 @@ namespace {
     }
 
     ExprTreeNode* operate(CallBase* CI, ExprTreeNode* operation, ExprTreeNode* op1, ExprTreeNode* op2) {
-      ExprTreeNode* result = new ExprTreeNode();
+      ExprTreeNode* result = newExprTreeNode();
       unsigned long long v1 = getActualHostValueForLiterals(CI, op1);
       unsigned long long v2 = getActualHostValueForLiterals(CI, op2);
       unsigned long long res = 1;
@@ -915,7 +958,7 @@ namespace {
       return result;
     }
 
-    unsigned long long evaluateRPNforMax(CallBase* CI, std::vector<ExprTreeNode*> RPN, unsigned LoopArg, unsigned loopid) {
+    unsigned long long evaluateRPNforMax(CallBase* CI, const std::vector<ExprTreeNode*> &RPN, unsigned LoopArg, unsigned loopid) {
       errs() << "Evaluating RPN for max\n";
       std::stack<ExprTreeNode*> stack;
       for (auto Token = RPN.begin(); Token != RPN.end(); Token++){
@@ -948,7 +991,7 @@ namespace {
     }
 
 
-    unsigned long long evaluateRPNforMin(CallBase* CI, std::vector<ExprTreeNode*> RPN, unsigned LoopArg, unsigned loopid) {
+    unsigned long long evaluateRPNforMin(CallBase* CI, const std::vector<ExprTreeNode*> &RPN, unsigned LoopArg, unsigned loopid) {
       /* errs() << "Evaluating RPN for min\n"; */
       std::stack<ExprTreeNode*> stack;
       for (auto Token = RPN.begin(); Token != RPN.end(); Token++){
@@ -980,7 +1023,7 @@ namespace {
       return stack.top()->value;
     }
 
-    unsigned long long evaluateRPN(CallBase* CI, std::vector<ExprTreeNode*> RPN) {
+    unsigned long long evaluateRPN(CallBase* CI, const std::vector<ExprTreeNode*> &RPN) {
       /* errs() << "Evaluating RPN\n"; */
       std::stack<ExprTreeNode*> stack;
       for (auto Token = RPN.begin(); Token != RPN.end(); Token++){
@@ -1131,7 +1174,7 @@ namespace {
       }
       for (auto str = RPN.begin(); str != RPN.end(); str++){
         /* errs() << *str << "\n"; */
-        current = new ExprTreeNode();
+        current = newExprTreeNode();
         current->op = getExprTreeOp(*str);
         current->original_str = *str;
         current->parent = nullptr;
@@ -2563,7 +2606,7 @@ namespace {
       return true;
     }
 
-    void computeAdvisoryIterative(std::vector<AllocationStruct>  &AllocationStructs, std::map<Value*, std::map<unsigned long long, unsigned long long>> AllocationToWSSToDensityMap) {
+    void computeAdvisoryIterative(std::vector<AllocationStruct>  &AllocationStructs, const std::map<Value*, std::map<unsigned long long, unsigned long long>> &AllocationToWSSToDensityMap) {
       errs() << "compute advisory iterative \n";
       unsigned long long availableMemory = GPU_SIZE;
       errs() << "availableMemory = " << availableMemory << "\n";
@@ -2635,7 +2678,9 @@ namespace {
               // Only a portion can be placed on the GPU.
               // If the allocation has clustered access pattern across iterations, then prefetch.
               // Else pin a portion.
-              auto WSSToDensityMap = AllocationToWSSToDensityMap[AllocationStruct.AllocationInst];
+              static const std::map<unsigned long long, unsigned long long> NoWSS;
+              auto WSSIt = AllocationToWSSToDensityMap.find(AllocationStruct.AllocationInst);
+              const auto &WSSToDensityMap = WSSIt != AllocationToWSSToDensityMap.end() ? WSSIt->second : NoWSS;
               errs() << "WSS check\n";
               float maxDensityPerWSS = 0.0;
               int selectedWSS = 0;
@@ -2749,6 +2794,74 @@ namespace {
       return nullptr;
     }
 
+    // With -penguin-sub-ranges, registers the sub-allocations of Allocation,
+    // at Ptr, as sub-ranges of the runtime before InsertBefore. Their
+    // prefetches advance in InsertInLoop, the header of the loop around the
+    // launches, if any.
+    void placeSubRanges(Function *F, Instruction *InsertBefore,
+                        Instruction *InsertInLoop, Value *LIV, Value *Ptr,
+                        AllocationStruct &Allocation, unsigned long long Iters,
+                        unsigned long long Step) {
+      LLVMContext &Ctx = F->getContext();
+      auto *I8PPTy = PointerType::get(Type::getInt8PtrTy(Ctx), 0);
+      auto *I64Ty = Type::getInt64Ty(Ctx);
+      auto *I32Ty = Type::getInt32Ty(Ctx);
+      auto PenguinSetSubRange = F->getParent()->getOrInsertFunction(
+          "penguinSetSubRange", Type::getVoidTy(Ctx), I8PPTy, I64Ty, I64Ty,
+          I32Ty, I64Ty, I64Ty, I32Ty);
+      IRBuilder<> Builder(InsertBefore);
+      std::set<unsigned long long> Prefetched;
+      for (auto *Sub : Allocation.SubAllocations) {
+        RuntimeDecision Decision;
+        unsigned long long PrefetchSize = 0, ItersPerBatch = 0;
+        switch (Sub->Advisory) {
+        case ADVISORY_SET_PIN_DEVICE:
+          Decision = RUNTIME_DEC_GPU_PIN;
+          break;
+        case ADVISORY_SET_PIN_HOST:
+          // the rest of a prefetched range stays on the host anyway
+          if (Prefetched.count(Sub->StartIndex))
+            continue;
+          Decision = RUNTIME_DEC_HOST_PIN;
+          break;
+        case ADVISORY_SET_PREFETCH: {
+          // only launches in a loop prefetch, as placeAdvisoryIterative does
+          if (!InsertInLoop || !LIV || !Sub->PrefetchSize ||
+              Sub->Size < Sub->PrefetchSize)
+            continue;
+          auto NumBatches = Sub->Size / Sub->PrefetchSize;
+          Decision = RUNTIME_DEC_ITERATION_MIGRATION;
+          PrefetchSize = Sub->PrefetchSize;
+          ItersPerBatch = (Iters / NumBatches) * Step;
+          Prefetched.insert(Sub->StartIndex);
+          break;
+        }
+        case ADVISORY_SET_DEMAND_MIGRATE:
+          Decision = RUNTIME_DEC_MIGRATE_ON_DEMAND;
+          break;
+        default:
+          continue;
+        }
+        LLVM_DEBUG(dbgs() << "sub-range " << Sub->StartIndex << " + "
+                          << Sub->Size << ": decision " << Decision << "\n");
+        Value *Args[] = {Ptr,
+                         ConstantInt::get(I64Ty, Sub->StartIndex),
+                         ConstantInt::get(I64Ty, Sub->Size),
+                         ConstantInt::get(I32Ty, Decision),
+                         ConstantInt::get(I64Ty, PrefetchSize),
+                         ConstantInt::get(I64Ty, ItersPerBatch),
+                         ConstantInt::get(I32Ty, 0)};
+        Builder.CreateCall(PenguinSetSubRange, Args);
+      }
+      if (Prefetched.empty())
+        return;
+      IRBuilder<> LoopBuilder(InsertInLoop);
+      auto PenguinSubRangeIteration = F->getParent()->getOrInsertFunction(
+          "penguinSubRangeIteration", Type::getVoidTy(Ctx), I8PPTy, I32Ty);
+      Value *Args[] = {Ptr, LoopBuilder.CreateZExtOrTrunc(LIV, I32Ty)};
+      LoopBuilder.CreateCall(PenguinSubRangeIteration, Args);
+    }
+
     /* void placePrefetchCode(Function *F, IRBuilder<> &Builder, Instruction *insertPoint, Value *LIV, unsigned stepsize, unsigned itersPerPrefetch) { */
       /* return; */
     /* } */
@@ -2787,6 +2900,11 @@ namespace {
         auto NearestMemPtr = getNearestValueForMemoryPointer(CIs[0], AllocationInst);
         errs() << " nearest ptr\n";
         NearestMemPtr->dump();
+        if (SubRanges) {
+          placeSubRanges(F, InsertOutsideLoop, InsertInLoop, LIV, NearestMemPtr,
+                         AllocationStructs[I], Iters, Step);
+          continue;
+        }
         auto SubAllocations =  AllocationStructs[I].SubAllocations;
         errs() << "num suballoc = " << SubAllocations.size() << "\n";
         for(auto S = 0; S < SubAllocations.size(); S++) {
@@ -2893,6 +3011,11 @@ namespace {
         AllocationInst->dump();
         auto NearestMemPtr = getNearestValueForMemoryPointer(CI, AllocationInst);
         NearestMemPtr->dump();
+        if (SubRanges) {
+          placeSubRanges(F, CI, nullptr, nullptr, NearestMemPtr,
+                         AllocationStructs[I], 0, 0);
+          continue;
+        }
         auto SubAllocations =  AllocationStructs[I].SubAllocations;
         errs() << "num suballoc = " << SubAllocations.size() << "\n";
         for(auto S = 0; S < SubAllocations.size(); S++) {
@@ -3872,6 +3995,18 @@ namespace {
     }
 
     bool runOnModule(Module &M) override {
+      GetLI = [this](Function &F) -> LoopInfo & {
+        return getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+      };
+      GetSE = [this](Function &F) -> ScalarEvolution & {
+        return getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+      };
+      bool Changed = runImpl(M);
+      releaseExpressionTrees();
+      return Changed;
+    }
+
+    bool runImpl(Module &M) {
 
       findAndAddLocalFunction(M);
       for (auto *Fn : ListOfLocallyDefinedFunctions) {
@@ -4042,10 +4177,13 @@ namespace {
             errs() << "not running on " << F.getName() << "\n";
             continue;
           }
+          if (F.isDeclaration())
+            continue;
+          // once per function: the legacy manager recomputes an on-the-fly
+          // analysis on every getAnalysis call, the new one caches it
+          LoopInfo &LI = GetLI(F);
+          ScalarEvolution &SE = GetSE(F);
           for (auto &BB : F) {
-
-            LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
-            ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
             for (auto &I : BB) {
               if (auto *CI = dyn_cast<CallBase>(&I)) {
                 auto *Callee = CI->getCalledFunction();
@@ -4176,3 +4314,57 @@ namespace {
 char CudaHostTransform::ID = 0;
 static RegisterPass<CudaHostTransform> X("CudaHostTransform",
     "CudaHostTransform Pass", true, true);
+
+namespace {
+
+// New pass manager version: -passes=cuda-host-transform. LoopInfo and ScalarEvolution
+// come from the FunctionAnalysisManager, so a preceding loop-rotate in the
+// same pipeline leaves them cached.
+struct CudaHostTransformPass : PassInfoMixin<CudaHostTransformPass> {
+  // set when added at an extension point, where device modules come by too
+  bool HostOnly;
+
+  explicit CudaHostTransformPass(bool HostOnly = false) : HostOnly(HostOnly) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    if (HostOnly && Triple(M.getTargetTriple()).isNVPTX())
+      return PreservedAnalyses::all();
+    auto &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    CudaHostTransform T;
+    T.GetLI = [&](Function &F) -> LoopInfo & {
+      return FAM.getResult<LoopAnalysis>(F);
+    };
+    T.GetSE = [&](Function &F) -> ScalarEvolution & {
+      return FAM.getResult<ScalarEvolutionAnalysis>(F);
+    };
+    bool Changed = T.doInitialization(M);
+    Changed |= T.runImpl(M);
+    releaseExpressionTrees();
+    Changed |= T.doFinalization(M);
+    return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  }
+};
+
+} // namespace
+
+// opt -load-pass-plugin=CudaHostTransform.so -passes=cuda-host-transform, or
+// clang -fpass-plugin=CudaHostTransform.so, which runs it last on host modules
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "CudaHostTransform", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "cuda-host-transform")
+                    return false;
+                  MPM.addPass(CudaHostTransformPass());
+                  return true;
+                });
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel) {
+                  MPM.addPass(CudaHostTransformPass(/*HostOnly=*/true));
+                });
+          }};
+}
@@ -7,38 +7,57 @@
 
 #include "llvm-c/Core.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopNestAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/CodeGen/RegisterPressure.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/ModuleSummaryIndex.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Pass.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/AllocatorBase.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/InstructionCost.h"
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/CudaAnalysis/AnalysisMetadata.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 
+#include <array>
 #include <cstddef>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <sstream>
 #include <stack>
@@ -50,6 +69,305 @@ using namespace llvm;
 
 #define DEBUG_TYPE "DynamicHostTransform"
 
+static cl::opt<std::string>
+    MetadataFile("cuda-analysis-metadata",
+                 cl::desc("File CudaAnalysis left the device analysis in"),
+                 cl::init(cuda_analysis::DefaultMetadataFile));
+
+static cl::opt<bool> InlinePrefetchGuard(
+    "penguin-inline-prefetch-guard",
+    cl::desc("Test the iteration against the runtime's prefetch period in "
+             "the host loop, and call penguinSuperPrefetchWrapper only on "
+             "batch boundaries"),
+    cl::init(false));
+
+static cl::opt<bool> PrefetchLoopShape(
+    "penguin-prefetch-loop-shape",
+    cl::desc("Pass the start, step and trip count of the host loop, from "
+             "SCEV, to penguinSetPrefetchLoop before the loop, so that the "
+             "iteration prefetch runs no further ahead than the loop goes"),
+    cl::init(true));
+
+static cl::opt<bool> RecordGuard(
+    "penguin-record-guard",
+    cl::desc("Put the code that computes the launch records of a kernel "
+             "launch behind a flag of its own, which the runtime clears once "
+             "the site's records stop changing and sets on a change of its "
+             "inputs"),
+    cl::init(true));
+
+static cl::opt<bool> ManagedArena(
+    "penguin-managed-arena",
+    cl::desc("Serve cudaMallocManaged and cudaFree from the runtime's managed "
+             "arena, which packs small allocations into va_block slabs by "
+             "access density"),
+    cl::init(false));
+
+static cl::opt<bool> ManagedPool(
+    "penguin-managed-pool",
+    cl::desc("Serve cudaMallocAsync, cudaMallocFromPoolAsync and cudaFreeAsync "
+             "from the runtime's managed-backed pools, whose allocations the "
+             "planners place like those of cudaMallocManaged"),
+    cl::init(false));
+
+static cl::opt<bool> NvmeTier(
+    "penguin-nvme-tier",
+    cl::desc("Send cudaMallocManaged and cudaFree to the runtime, which backs "
+             "the allocations the host memory cannot hold with files on NVMe"),
+    cl::init(false));
+
+static cl::opt<bool> ExplicitManaged(
+    "penguin-explicit-managed",
+    cl::desc("Turn the cudaMalloc calls into cudaMallocManaged ones and send "
+             "cudaMemcpy to penguinExplicitMemcpy, so that programs written "
+             "with explicit copies are planned like managed ones"),
+    cl::init(false));
+
+static cl::opt<bool> StagedCopy(
+    "penguin-staged-copy",
+    cl::desc("Pass the pointer arguments of iterative launches through "
+             "penguinStagedPointer, so the runtime may stream read-only "
+             "iteration migration allocations through device buffers"),
+    cl::init(false));
+
+static cl::opt<bool> DeviceCopy(
+    "penguin-device-copy",
+    cl::desc("Let the runtime back the cudaMallocManaged allocations the host "
+             "only initializes and reads back with device memory, copied in "
+             "bulk before the first launch and before the readback"),
+    cl::init(false));
+
+static cl::opt<bool> FieldSplit(
+    "penguin-field-split",
+    cl::desc("Let the runtime pass the arrays of structs that "
+             "-passes=penguin-field-split lets every kernel they go to take "
+             "by field as one array per field"),
+    cl::init(false));
+
+static cl::opt<bool> ReadMostly(
+    "penguin-read-mostly",
+    cl::desc("Call penguinAdviseReadMostly after the cudaMallocManaged of "
+             "allocations that only go to kernel arguments the metadata lists "
+             "as only loaded from"),
+    cl::init(false));
+
+static cl::opt<bool> WriteStream(
+    "penguin-write-stream",
+    cl::desc("Call penguinAdviseWriteStream after the cudaMallocManaged of "
+             "allocations that only go to kernel arguments the metadata lists "
+             "as only stored to"),
+    cl::init(false));
+
+static cl::opt<bool> KernelFusion(
+    "penguin-kernel-fusion",
+    cl::desc("Launch adjacent launches of the kernel pairs "
+             "-passes=penguin-kernel-fusion fused through "
+             "penguinLaunchKernelFused, which may run them as one"),
+    cl::init(false));
+
+static cl::opt<bool> LoopTiling(
+    "penguin-loop-tiling",
+    cl::desc("Launch the element-wise kernels host loops launch over and over "
+             "through penguinLaunchKernelTiled, which may run all iterations "
+             "of one tile of the grid before the next; needs "
+             "-penguin-grid-split"),
+    cl::init(false));
+
+static cl::opt<bool> ReadbackPrefetch(
+    "penguin-readback-prefetch",
+    cl::desc("Pass the managed allocations the host reads back after the "
+             "kernels to penguinReadbackPrefetch after their last launch, "
+             "which brings them back to the host in bulk"),
+    cl::init(false));
+
+static cl::opt<bool> FirstTouch(
+    "penguin-first-touch",
+    cl::desc("Fill the managed allocations the host memsets or memcpys "
+             "before the launches through penguinFirstTouchMemset and "
+             "penguinFirstTouchMemcpy, which fill the ones the runtime will "
+             "pin on the GPU there"),
+    cl::init(false));
+
+static cl::opt<bool> PingPong(
+    "penguin-ping-pong",
+    cl::desc("Pass the regions the host accesses of managed allocations "
+             "between their launches to penguinHostAccess, which moves the "
+             "allocations that go back and forth every launch off their "
+             "placement"),
+    cl::init(false));
+
+static cl::opt<bool> GraphLaunch(
+    "penguin-graph-launch",
+    cl::desc("Launch the kernels of host loops through "
+             "penguinLaunchKernelGraph, which may replay the launches of an "
+             "iteration as one CUDA graph"),
+    cl::init(false));
+
+static cl::opt<bool> LaunchReorder(
+    "penguin-launch-reorder",
+    cl::desc("Launch the launches of a basic block with only their setup "
+             "between them through penguinLaunchKernelReorder, which may run "
+             "the independent ones sharing allocations back to back"),
+    cl::init(false));
+
+static cl::opt<bool> GridSplit(
+    "penguin-grid-split",
+    cl::desc("Launch the kernels -passes=penguin-grid-split gave the sub-grid "
+             "parameter through penguinLaunchKernelSplit, which may issue "
+             "their grid in chunks"),
+    cl::init(false));
+
+// Where the placement decisions come from. static is the SC baseline: the
+// runtime plans from reuse distance and global locality alone. dynamic
+// evaluates the access expressions at every launch. hybrid uses the static
+// planner for launches whose accesses were all analysed and the dynamic one
+// for the rest.
+enum PenguinPolicy { POLICY_STATIC, POLICY_DYNAMIC, POLICY_HYBRID };
+static cl::opt<PenguinPolicy> Policy(
+    "penguin-policy", cl::desc("Placement policy of the instrumented program"),
+    cl::values(clEnumValN(POLICY_STATIC, "static", "SC baseline decisions"),
+               clEnumValN(POLICY_DYNAMIC, "dynamic", "SUV run time decisions"),
+               clEnumValN(POLICY_HYBRID, "hybrid",
+                          "static where the analysis is complete")),
+    cl::init(POLICY_DYNAMIC));
+
+// Launch shapes the runtime plans apart, as a run with PENGUIN_SHAPE_FILE set
+// writes them: the most frequent grids and blocks of each invocation, a line
+// "invid gx gy gz bx by bz" each. A launch of a listed invocation compares
+// its grid and block against them and passes the runtime the index of the
+// one it matches, 0 for none.
+static cl::opt<std::string> ShapeClassesFile(
+    "penguin-shape-classes",
+    cl::desc("File of the launch shapes of each invocation to plan apart"),
+    cl::init(""));
+
+// grid and then block of a shape class
+typedef std::array<unsigned, 6> LaunchShapeClass;
+
+static const std::map<unsigned, std::vector<LaunchShapeClass>> &
+getShapeClasses() {
+  static std::map<unsigned, std::vector<LaunchShapeClass>> Classes;
+  static bool Loaded = false;
+  if (Loaded || ShapeClassesFile.empty())
+    return Classes;
+  Loaded = true;
+  std::ifstream In(ShapeClassesFile);
+  if (!In) {
+    WithColor::warning() << "cannot open " << ShapeClassesFile << "\n";
+    return Classes;
+  }
+  std::string Line;
+  while (std::getline(In, Line)) {
+    std::istringstream Fields(Line);
+    unsigned InvID;
+    LaunchShapeClass Class;
+    if (Fields >> InvID >> Class[0] >> Class[1] >> Class[2] >> Class[3] >>
+        Class[4] >> Class[5])
+      Classes[InvID].push_back(Class);
+  }
+  return Classes;
+}
+
+// Footprints of library entry points whose kernels CudaAnalysis never sees,
+// cuBLAS, cuDNN and the like, in the format of penguin-library-footprints.txt
+// at the top of the tree: a line per pointer argument of a function,
+//   <function> <argument> <r|w|rw> <dense|stream|irregular> <bytes> [<accesses>]
+// where the bytes and the accesses are products of constants and %N, the
+// integer argument N of the call, and "all" bytes is the whole allocation.
+// A call to a listed function is planned like a launch with those records.
+static cl::opt<std::string> LibraryFootprintsFile(
+    "penguin-library-footprints",
+    cl::desc("Footprint database of the library calls to plan as launches"),
+    cl::init(""));
+
+// constant factors and the argument numbers of a footprint formula
+struct LibraryFormula {
+  uint64_t Constant = 1;
+  std::vector<unsigned> Args;
+  bool All = false; // the whole allocation
+};
+
+// one pointer argument of a library entry point
+struct LibraryFootprint {
+  enum PatternKind { LF_DENSE, LF_STREAM, LF_IRREGULAR };
+  unsigned Arg;
+  bool Store;
+  PatternKind Pattern;
+  LibraryFormula Bytes;
+  Optional<LibraryFormula> Accesses;
+};
+
+static bool parseLibraryFormula(StringRef Text, LibraryFormula &Formula) {
+  if (Text == "all") {
+    Formula.All = true;
+    return true;
+  }
+  SmallVector<StringRef, 4> Terms;
+  Text.split(Terms, '*');
+  for (StringRef Term : Terms) {
+    uint64_t N;
+    if (Term.consume_front("%")) {
+      if (Term.getAsInteger(10, N))
+        return false;
+      Formula.Args.push_back(N);
+    } else {
+      if (Term.getAsInteger(10, N))
+        return false;
+      Formula.Constant *= N;
+    }
+  }
+  return true;
+}
+
+static const std::map<std::string, std::vector<LibraryFootprint>> &
+getLibraryFootprints() {
+  static std::map<std::string, std::vector<LibraryFootprint>> Footprints;
+  static bool Loaded = false;
+  if (Loaded || LibraryFootprintsFile.empty())
+    return Footprints;
+  Loaded = true;
+  std::ifstream In(LibraryFootprintsFile);
+  if (!In) {
+    WithColor::warning() << "cannot open " << LibraryFootprintsFile << "\n";
+    return Footprints;
+  }
+  std::string Line;
+  for (unsigned LineNo = 1; std::getline(In, Line); LineNo++) {
+    StringRef Text = StringRef(Line).split('#').first.trim();
+    if (Text.empty())
+      continue;
+    SmallVector<StringRef, 6> Fields;
+    Text.split(Fields, ' ', -1, false);
+    LibraryFootprint Footprint;
+    bool Valid = Fields.size() == 5 || Fields.size() == 6;
+    Valid = Valid && !Fields[1].getAsInteger(10, Footprint.Arg);
+    Valid = Valid && (Fields[2] == "r" || Fields[2] == "w" || Fields[2] == "rw");
+    if (Valid)
+      Footprint.Store = Fields[2] != "r";
+    if (Valid && Fields[3] == "dense")
+      Footprint.Pattern = LibraryFootprint::LF_DENSE;
+    else if (Valid && Fields[3] == "stream")
+      Footprint.Pattern = LibraryFootprint::LF_STREAM;
+    else if (Valid && Fields[3] == "irregular")
+      Footprint.Pattern = LibraryFootprint::LF_IRREGULAR;
+    else
+      Valid = false;
+    Valid = Valid && parseLibraryFormula(Fields[4], Footprint.Bytes);
+    if (Valid && Fields.size() == 6) {
+      LibraryFormula Accesses;
+      Valid = parseLibraryFormula(Fields[5], Accesses) && !Accesses.All;
+      Footprint.Accesses = Accesses;
+    }
+    if (!Valid) {
+      WithColor::warning() << LibraryFootprintsFile << ":" << LineNo
+                           << ": ignoring \"" << Line << "\"\n";
+      continue;
+    }
+    Footprints[Fields[0].str()].push_back(Footprint);
+  }
+  return Footprints;
+}
+
 // The following line is edited by scripts to set the GPU size.
 unsigned long long GPU_SIZE = (1ULL) * 1024ULL * 1024ULL * 2048ULL;
 double MIN_ALLOC_PERC = 6;
@@ -91,6 +409,8 @@ enum ExprTreeOp {
   ETO_BIDY,
   ETO_TIDX,
   ETO_TIDY,
+  ETO_GDIMX,
+  ETO_GDIMY,
   ETO_ARG,
   ETO_GEP,
   ETO_ZEXT,
@@ -132,6 +452,28 @@ struct ExprTreeNodeAdvanced {
   bool isProb = false;
 };
 
+// Expression trees live until the end of the module: they are allocated from
+// these arenas and released together by releaseExpressionTrees.
+SpecificBumpPtrAllocator<ExprTreeNode> ExprTreeNodeArena;
+SpecificBumpPtrAllocator<ExprTreeNodeAdvanced> ExprTreeNodeAdvancedArena;
+
+ExprTreeNode *newExprTreeNode() {
+  return new (ExprTreeNodeArena.Allocate()) ExprTreeNode();
+}
+
+ExprTreeNodeAdvanced *newExprTreeNodeAdvanced() {
+  return new (ExprTreeNodeAdvancedArena.Allocate()) ExprTreeNodeAdvanced();
+}
+
+// Read-only operator[] for the maps passed by const reference: a missing key
+// reads as a default constructed value, without inserting it.
+template <typename MapT>
+typename MapT::mapped_type lookupOrDefault(const MapT &Map,
+                                           const typename MapT::key_type &Key) {
+  auto It = Map.find(Key);
+  return It == Map.end() ? typename MapT::mapped_type() : It->second;
+}
+
 enum AdvisoryType {
   ADVISORY_SET_PREFERRED_LOCATION,
   ADVISORY_SET_ACCESSED_BY,
@@ -225,31 +567,41 @@ bool allocationSorter(AllocationStruct const &Lhs,
     bool multiKernel = false;
 
 std::set<Value *> StructAllocas;
-std::map<AllocaInst *, std::map<unsigned, Value *>>
+DenseMap<AllocaInst *, std::map<unsigned, Value *>>
     StructAllocasToIndexToValuesMap;
 
 std::set<Function *> ListOfLocallyDefinedFunctions;
 std::map<Function *, std::vector<Value *>> FunctionToFormalArgumentMap;
 std::map<CallBase *, std::vector<Value *>> FunctionCallToActualArumentsMap;
+// call sites of every callee, so that mapping formals to actuals visits each
+// call site once
+std::map<Function *, std::vector<CallBase *>> FunctionToCallSitesMap;
 std::map<Value *, std::vector<Value *>> FormalArgumentToActualArgumentMap;
 /* std::map<Value *, Value *> ActualArgumentToFormalArgumentMap; */
-std::map<Value *, std::map<Value *, Value *>>
+DenseMap<Value *, std::map<Value *, Value *>>
     FunctionCallToFormalArgumentToActualArgumentMap;
-std::map<Value *, std::map<Value *, Value *>>
+DenseMap<Value *, std::map<Value *, Value *>>
     FunctionCallToActualArgumentToFormalArgumentMap;
 
 std::set<Value *> OriginalPointers;
 std::map<Value *, Value *> PointerOpToOriginalPointers;
-std::map<Value *, Value *> PointerOpToOriginalStructPointer;
-std::map<Value *, unsigned> PointerOpToOriginalStructPointersIndex;
+DenseMap<Value *, Value *> PointerOpToOriginalStructPointer;
+DenseMap<Value *, unsigned> PointerOpToOriginalStructPointersIndex;
 
-std::map<Value *, unsigned> PointerOpToOriginalConstant;
+DenseMap<Value *, unsigned> PointerOpToOriginalConstant;
 
-std::set<CallBase *> VisitedCallInstForPointerPropogation;
+// functions walked by analyzePointerPropogationRecursive, with the original
+// pointers their formals held: a call site binding them the same way needs
+// no new walk
+std::set<std::pair<Function *, std::vector<Value *>>>
+    VisitedPropagationContexts;
+// original pointers a value may hold across all the call sites of the
+// wrappers it goes through, see resolveOriginalPointers
+std::map<Value *, std::set<Value *>> OriginalPointersCache;
 
 std::set<Instruction *> MemcpyOpForStructs;
-std::map<Value *, Instruction *> MemcpyOpForStructsSrcToInstMap;
-std::map<Value *, Instruction *> MemcpyOpForStructsDstToInstMap;
+DenseMap<Value *, Instruction *> MemcpyOpForStructsSrcToInstMap;
+DenseMap<Value *, Instruction *> MemcpyOpForStructsDstToInstMap;
 
 // for each kernel invocation, for each argument, store the access count
 std::map<std::string, std::vector<std::pair<unsigned, unsigned>>>
@@ -260,41 +612,45 @@ std::map<std::string,
          std::map<unsigned, std::map<IndexAxisType, std::vector<std::string>>>>
     KernelParamReuseInKernel;
 std::map<Value *, unsigned long int> MallocSizeMap;
-std::map<Value *, unsigned long int> MallocPointerToSizeMap;
-std::map<Value *, std::map<unsigned, unsigned long long>>
+DenseMap<Value *, unsigned long int> MallocPointerToSizeMap;
+DenseMap<Value *, std::map<unsigned, unsigned long long>>
     MallocPointerStructToIndexToSizeMap;
 std::set<Value *> MallocPointers;
 
-std::map<Value *, std::vector<Value *>> KernelArgToStoreMap;
-std::map<Instruction *, Value *> KernelInvocationToStructMap;
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Value *, std::vector<Value *>> KernelArgToStoreMap;
+DenseMap<Instruction *, Value *> KernelInvocationToStructMap;
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToActualArgMap;
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToAllocationMap;
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToLastStoreMap;
-std::map<Instruction *, std::map<Value *, Value *>>
+DenseMap<Instruction *, std::map<Value *, Value *>>
     KernelInvocationToKernArgToAllocationMap;
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToConstantMap;
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToArgNumberToLIVMap;
-std::map<Instruction *, std::map<Value *, unsigned>>
+DenseMap<Instruction *, std::map<Value *, unsigned>>
     KernelInvocationToLIVToArgNumMap;
 std::map<Instruction *, std::map<BlockSizeType, unsigned>>
     KernelInvocationToBlockSizeMap;
-std::map<Instruction *, std::map<GridSizeType, unsigned>>
+DenseMap<Instruction *, std::map<GridSizeType, unsigned>>
     KernelInvocationToGridSizeMap; // when grid size is constant
-std::map<Instruction *, std::map<GridSizeType, Value *>>
+DenseMap<Instruction *, std::map<GridSizeType, Value *>>
     KernelInvocationToGridSizeValueMap; // when grid size is variable
 
-    std::map<Value*, Value*> AllocationToFirstMap;
+    DenseMap<Value*, Value*> AllocationToFirstMap;
 
-std::map<Instruction *, std::map<unsigned, Value *>>
+DenseMap<Instruction *, std::map<unsigned, Value *>>
     KernelInvocationToAllocationArgNumberToKernelArgMap;
 
-std::map<Instruction *, Value *> KernelInvocationToGridDimXYValueMap;
-std::map<Instruction *, Value *> KernelInvocationToGridDimZValueMap;
+DenseMap<Instruction *, Value *> KernelInvocationToGridDimXYValueMap;
+DenseMap<Instruction *, Value *> KernelInvocationToGridDimZValueMap;
+// stream operand of the launch, for the residency scope of its stream
+DenseMap<Instruction *, Value *> KernelInvocationToStreamValueMap;
+// __cudaPushCallConfiguration of the launch, for its shape
+DenseMap<Instruction *, CallBase *> KernelInvocationToPushCallMap;
 // std::map<Instruction*, Value*> KernelInvocationToGridDimXYValueMap;
 // std::map<Instruction*, Value*> KernelInvocationToGridDimZValueMap;
 
@@ -302,26 +658,26 @@ std::map<Instruction *, Value *> KernelInvocationToGridDimZValueMap;
 // starts at 1, unique for each kernel invocation
 static unsigned KernelInvocationID = 1;
 
-std::map<Instruction*, unsigned> KernelInvocationToInvocationIDMap;
-std::map<Instruction *, unsigned long> KernelInvocationToIterMap;
-std::map<Instruction *, unsigned long> KernelInvocationToStepsMap;
+DenseMap<Instruction*, unsigned> KernelInvocationToInvocationIDMap;
+DenseMap<Instruction *, unsigned long> KernelInvocationToIterMap;
+DenseMap<Instruction *, unsigned long> KernelInvocationToStepsMap;
 
-std::map<Instruction *, std::map<unsigned, unsigned long long>>
+DenseMap<Instruction *, std::map<unsigned, unsigned long long>>
     KernelInvocationToAccessIDToAccessDensity;
-std::map<Instruction *, std::map<unsigned, unsigned>>
+DenseMap<Instruction *, std::map<unsigned, unsigned>>
     KernelInvocationToAccessIDToPartDiff_phi;
-std::map<Instruction *, std::map<unsigned, unsigned>>
+DenseMap<Instruction *, std::map<unsigned, unsigned>>
     KernelInvocationToAccessIDToPartDiff_bidx;
-std::map<Instruction *, std::map<unsigned, unsigned>>
+DenseMap<Instruction *, std::map<unsigned, unsigned>>
     KernelInvocationToAccessIDToPartDiff_bidy;
-std::map<Instruction *, std::map<unsigned, unsigned>>
+DenseMap<Instruction *, std::map<unsigned, unsigned>>
     KernelInvocationToAccessIDToPartDiff_looparg;
-std::map<Instruction *, std::map<unsigned, unsigned>>
+DenseMap<Instruction *, std::map<unsigned, unsigned>>
     KernelInvocationToAccessIDToWSS;
 
-std::map<Instruction *, Instruction *> KernelInvocationToEnclosingLIVMap;
-std::map<Instruction *, Instruction *> KernelInvocationToEnclosingLoopPredMap;
-std::map<Instruction *, Function *> KernelInvocationToEnclosingFunction;
+DenseMap<Instruction *, Instruction *> KernelInvocationToEnclosingLIVMap;
+DenseMap<Instruction *, Instruction *> KernelInvocationToEnclosingLoopPredMap;
+DenseMap<Instruction *, Function *> KernelInvocationToEnclosingFunction;
 
 // map from loop id to loop iterations
 std::map<std::string, std::map<unsigned, std::vector<std::string>>> LoopIDToLoopBoundsMap;
@@ -356,6 +712,51 @@ std::map<std::string, std::map<unsigned, unsigned>>
     KernelNameToAccessIDToIfCondMap;
 std::map<std::string, std::map<unsigned, unsigned>>
     KernelNameToAccessIDToIfTypeMap;
+// access ids that store to their allocation
+std::map<std::string, std::set<unsigned>> KernelNameToStoreAccessIDsMap;
+// kernel arguments the kernel's atomics update, see RK_Atomic
+std::map<std::string, std::set<unsigned>> KernelNameToAtomicArgsMap;
+// shared memory reads per element of the access ids that fill a tile, see
+// CudaAnalysis::computeTileReuse
+std::map<std::string, std::map<unsigned, unsigned>> KernelNameToAccessIDToTileReuseMap;
+// byte range an access covers in a launch: lowest offset, offset of the last
+// element, the same in the first thread block, and element size, for the
+// accesses CudaAnalysis bounded
+struct AccessFootprint {
+  ExprTreeNode *Lo;
+  ExprTreeNode *Hi;
+  ExprTreeNode *BlockLo;
+  ExprTreeNode *BlockHi;
+  unsigned Bytes;
+  // grid axes whose thread blocks all load [Lo, Hi), see RK_Footprint
+  unsigned Broadcast;
+  // bytes between the elements of neighbouring threads along x
+  ExprTreeNode *ThreadStride;
+};
+std::map<std::string, std::map<unsigned, AccessFootprint>>
+    KernelNameToAccessIDToFootprintMap;
+// likelihood an access under a conditional runs: the static edge
+// probability, in 1/65536, and, when its condition bounds an index of the
+// launch, the bounds of the index and the limit it is checked against
+struct AccessBranch {
+  unsigned Probability;
+  bool Below; // runs for indices below Limit, else at or above it
+  ExprTreeNode *Lo;
+  ExprTreeNode *Hi;
+  ExprTreeNode *Limit;
+};
+std::map<std::string, std::map<unsigned, AccessBranch>>
+    KernelNameToAccessIDToBranchMap;
+// cross-kernel data flow over the launches of a function, see
+// buildDataflowGraph: the allocations no later launch accesses, and the ones
+// the launch that follows reads but this one doesn't access; an allocation is
+// named by the local its pointer is loaded from
+std::map<CallBase *, std::set<AllocaInst *>> KernelInvocationToDeadRootsMap;
+std::map<CallBase *, std::vector<AllocaInst *>> KernelInvocationToNextInputsMap;
+// DF_LOAD and DF_STORE of the allocations of each launch
+enum { DF_LOAD = 1, DF_STORE = 2 };
+std::map<CallBase *, std::map<AllocaInst *, unsigned>>
+    KernelInvocationToAllocationModesMap;
 
 std::set<ExprTreeOp> terminals;
 std::set<ExprTreeOp> operations;
@@ -365,24 +766,94 @@ std::set<Value *> TerminalValues;
 
 std::map<std::string, std::string> HostSideKernelNameToOriginalNameMap;
 
-std::map<Value *, bool> KernelLaunchIsIterative;
+DenseMap<Value *, bool> KernelLaunchIsIterative;
+// iterative launches whose arguments, but the induction variable, and
+// allocations are the same every iteration of their host loop
+DenseMap<Value *, bool> KernelLaunchIsLoopInvariant;
+// value the induction variable of a host loop starts at
+DenseMap<Value *, Value *> LIVToInitialValueMap;
+// start, step and trip count of a host loop as i64, expanded from SCEV at
+// the end of its preheader, where penguinSetPrefetchLoop goes
+struct LoopShape {
+  BasicBlock *Preheader;
+  std::array<Value *, 3> Values;
+};
+DenseMap<Value *, LoopShape> LIVToLoopShapeMap;
+// the same for the loop around it, where penguinSetPrefetchOuterLoop goes
+DenseMap<Value *, LoopShape> LIVToOuterLoopShapeMap;
 std::vector<Value *> KernelLaunches;
 
-std::map<Instruction *, Instruction *> LIVTOInsertionPointMap;
-std::map<Instruction*, Instruction*> KernelInvocationToInsertionPointMap;
+DenseMap<Instruction *, Instruction *> LIVTOInsertionPointMap;
+DenseMap<Instruction*, Instruction*> KernelInvocationToInsertionPointMap;
 
     Instruction* FirstInvocation = nullptr;
     Instruction* FirstInvocationNonIter = nullptr;
+
+// Drops every reference to the expression trees, then the trees themselves
+void releaseExpressionTrees() {
+  LoopIDToBoundsExprMapIn.clear();
+  LoopIDToBoundsExprMapFin.clear();
+  LoopIDToBoundsExprMapStep.clear();
+  KernelNameToAccessIDToExpressionTreeMap.clear();
+  KernelNameToAccessIDToAdvancedExpressionTreeMap.clear();
+  ExprTreeNodeArena.DestroyAll();
+  ExprTreeNodeAdvancedArena.DestroyAll();
+}
+
+static bool isRuntimeCall(const Instruction &I) {
+  auto *CI = dyn_cast<CallBase>(&I);
+  return CI && CI->getCalledFunction() &&
+         CI->getCalledFunction()->getName().startswith("penguin");
+}
+
+// The calls to the runtime already in M, before the transform
+static SmallPtrSet<const Instruction *, 32> runtimeCalls(Module &M) {
+  SmallPtrSet<const Instruction *, 32> Calls;
+  for (Function &F : M)
+    for (Instruction &I : instructions(F))
+      if (isRuntimeCall(I))
+        Calls.insert(&I);
+  return Calls;
+}
+
+// A remark for every call to the runtime the transform inserted, with its
+// arguments: -pass-remarks=DynamicHostTransform, or the YAML of
+// -fsave-optimization-record
+static void
+remarkRuntimeCalls(Module &M,
+                   const SmallPtrSetImpl<const Instruction *> &Before) {
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    OptimizationRemarkEmitter ORE(&F);
+    for (Instruction &I : instructions(F)) {
+      if (!isRuntimeCall(I) || Before.count(&I))
+        continue;
+      auto *CI = cast<CallBase>(&I);
+      ORE.emit([&]() {
+        OptimizationRemark R(DEBUG_TYPE, "RuntimeCall", CI);
+        R << "inserted " << ore::NV("Callee", CI->getCalledFunction()) << "(";
+        for (unsigned A = 0; A < CI->arg_size(); A++)
+          R << (A ? ", " : "") << ore::NV("Arg", CI->getArgOperand(A));
+        return R << ")";
+      });
+    }
+  }
+}
 // DynamicHostTransform
 struct DynamicHostTransform : public ModulePass {
   static char ID; // Pass identification, replacement for typeid
 
   DynamicHostTransform() : ModulePass(ID) {}
 
+  // Function analyses, from the legacy or the new pass manager
+  std::function<LoopInfo &(Function &)> GetLI;
+  std::function<ScalarEvolution &(Function &)> GetSE;
+
   void processMemoryAllocation(CallBase *I) {
-    errs() << "processing memory allocation\n";
-    I->dump();
-    I->getOperand(0)->dump();
+    LLVM_DEBUG(dbgs() << "processing memory allocation\n");
+    LLVM_DEBUG(I->dump());
+    LLVM_DEBUG(I->getOperand(0)->dump());
     MallocPointers.insert(I->getOperand(0));
     // I->getOperand(1) ->dump();
     // I->getOperand(1) ->getType()->dump();
@@ -392,30 +863,30 @@ struct DynamicHostTransform : public ModulePass {
       /* MallocPointerToSizeMap[I->getOperand(0)] = CI->getSExtValue(); */
       auto OGPtr = PointerOpToOriginalPointers[I->getOperand(0)];
       if (OGPtr) {
-        errs() << "og ptrs = ";
-        OGPtr->dump();
+        LLVM_DEBUG(dbgs() << "og ptrs = ");
+        LLVM_DEBUG(OGPtr->dump());
         MallocPointerToSizeMap[OGPtr] = CI->getSExtValue();
         if (StructAllocas.find(OGPtr) != StructAllocas.end()) {
-          errs() << "found struct og ptr\n";
+          LLVM_DEBUG(dbgs() << "found struct og ptr\n");
           if (auto GEPI = dyn_cast<GetElementPtrInst>(I->getOperand(0))) {
-            errs() << "found gepi\n";
+            LLVM_DEBUG(dbgs() << "found gepi\n");
             auto numIndices = GEPI->getNumIndices();
             if (numIndices == 2) {
               if (auto FieldNum = dyn_cast<ConstantInt>(GEPI->getOperand(2))) {
-                errs() << "og is struct\n";
+                LLVM_DEBUG(dbgs() << "og is struct\n");
                 PointerOpToOriginalStructPointersIndex[GEPI] =
                     FieldNum->getSExtValue();
-                errs() << "field num = " << FieldNum->getSExtValue() << "\n";
+                LLVM_DEBUG(dbgs() << "field num = " << FieldNum->getSExtValue() << "\n");
                 MallocPointerStructToIndexToSizeMap[OGPtr]
                                                    [FieldNum->getSExtValue()] =
                                                        CI->getSExtValue();
               }
             } else {
               if (auto FieldNum = dyn_cast<ConstantInt>(GEPI->getOperand(1))) {
-                errs() << "og maybe struct or array\n";
+                LLVM_DEBUG(dbgs() << "og maybe struct or array\n");
                 PointerOpToOriginalStructPointersIndex[GEPI] =
                     FieldNum->getSExtValue();
-                errs() << "field num = " << FieldNum->getSExtValue() << "\n";
+                LLVM_DEBUG(dbgs() << "field num = " << FieldNum->getSExtValue() << "\n");
                 MallocPointerStructToIndexToSizeMap[OGPtr]
                                                    [FieldNum->getSExtValue()] =
                                                        CI->getSExtValue();
@@ -424,20 +895,14 @@ struct DynamicHostTransform : public ModulePass {
           }
         }
       } else {
-        if (FormalArgumentToActualArgumentMap.find(I->getOperand(0)) !=
-            FormalArgumentToActualArgumentMap.end()) {
-          errs() << "found actual arg\n";
-          auto actarg = FormalArgumentToActualArgumentMap[I->getOperand(0)][0];
-          actarg->dump();
-          OGPtr = PointerOpToOriginalPointers[actarg];
-          if (OGPtr) {
-            errs() << "og ptrs = ";
-            OGPtr->dump();
-            MallocPointerToSizeMap[OGPtr] = CI->getSExtValue();
-            if (StructAllocas.find(OGPtr) != StructAllocas.end()) {
-              errs() << "found struct og ptr via args\n";
-              /* MallocPointerStructToIndexToSizeMap[OGPtr][ */
-            }
+        // allocated in a wrapper, for every pointer its call sites pass
+        for (auto *OG : resolveOriginalPointers(I->getOperand(0))) {
+          LLVM_DEBUG(dbgs() << "og ptrs via args = ");
+          LLVM_DEBUG(OG->dump());
+          MallocPointerToSizeMap[OG] = CI->getSExtValue();
+          if (StructAllocas.find(OG) != StructAllocas.end()) {
+            LLVM_DEBUG(dbgs() << "found struct og ptr via args\n");
+            /* MallocPointerStructToIndexToSizeMap[OGPtr][ */
           }
         }
       }
@@ -473,7 +938,7 @@ struct DynamicHostTransform : public ModulePass {
               dyn_cast<ConstantInt>(GEPI->getOperand(NumIndices))) {
         return CI->getSExtValue();
       }
-      errs() << "Unable to extract constant\n";
+      LLVM_DEBUG(dbgs() << "Unable to extract constant\n");
       return -1;
     }
     /* errs() << "Pointer\n"; */
@@ -482,7 +947,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value *recurseTillAllocation(Value *V) {
-    V->dump();
+    LLVM_DEBUG(V->dump());
     auto It = MallocSizeMap.find(V);
     if (It != MallocSizeMap.end()) {
       return V;
@@ -505,13 +970,13 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value *findStoreInstOrStackCopyWithGivenValueOperand(Value *V) {
-    errs() << "fsioscpwvo\n";
+    LLVM_DEBUG(dbgs() << "fsioscpwvo\n");
     for (auto *U : V->users()) {
       /* U->dump(); */
       if (auto *SI = dyn_cast<StoreInst>(U)) {
         if (SI->getPointerOperand() == V) {
-          SI->dump();
-          errs() << "store inst\n";
+          LLVM_DEBUG(SI->dump());
+          LLVM_DEBUG(dbgs() << "store inst\n");
           return SI->getValueOperand();
         }
       }
@@ -520,9 +985,9 @@ struct DynamicHostTransform : public ModulePass {
         // if  the passd value is the destination, then return the source
         auto Callee = CI->getCalledFunction();
         if ((Callee && (Callee->getName() == "llvm.memcpy.p0.p0.i64"))) {
-          CI->dump();
+          LLVM_DEBUG(CI->dump());
           if (CI->getOperand(0) == V) {
-            errs() << "memcpy call \n";
+            LLVM_DEBUG(dbgs() << "memcpy call \n");
             return CI->getOperand(1);
           }
         }
@@ -566,11 +1031,11 @@ struct DynamicHostTransform : public ModulePass {
 
   void findAllocationOnLocalStack(CallBase* Invocation,
           Value* KernelArgStruct) {
-      errs() << "findAllocationOnLocalStack\n";
-      KernelArgStruct->dump();
+      LLVM_DEBUG(dbgs() << "findAllocationOnLocalStack\n");
+      LLVM_DEBUG(KernelArgStruct->dump());
       for (llvm::User *Karg : KernelArgStruct->users()) {
-          errs() << "user: ";
-          Karg->dump();
+          LLVM_DEBUG(dbgs() << "user: ");
+          LLVM_DEBUG(Karg->dump());
           StoreInst* KargSI = nullptr;
           /* if karg is store, direct store, else if karg is gep, look for store */
           if(auto* SI = dyn_cast<StoreInst>(Karg)) {
@@ -597,23 +1062,23 @@ struct DynamicHostTransform : public ModulePass {
               /* errs() << "gepi user list over\n"; */
           }
           if(KargSI) {
-              errs() << "user: kargsi\n";
+              LLVM_DEBUG(dbgs() << "user: kargsi\n");
               int Position = findKernelStructLocationForStoreInstruction(KargSI);
-              Karg->dump();
-              KargSI->dump();
-              errs() << Position << "\n";
+              LLVM_DEBUG(Karg->dump());
+              LLVM_DEBUG(KargSI->dump());
+              LLVM_DEBUG(dbgs() << Position << "\n");
           } else {
               continue;
           }
           int Position = findKernelStructLocationForStoreInstruction(KargSI);
-          errs() << "value stored in kargsi\n";
-          KargSI->getValueOperand()->dump();
+          LLVM_DEBUG(dbgs() << "value stored in kargsi\n");
+          LLVM_DEBUG(KargSI->getValueOperand()->dump());
           // among its users, get the store
           for (llvm::User * KargSIUser: KargSI->getValueOperand()->users()) {
               if(auto* KargSIUserSI = dyn_cast<StoreInst>(KargSIUser)) {
                   if(KargSIUserSI->getPointerOperand() == KargSI->getValueOperand()) {
-                      KargSIUser->dump();
-                      KargSIUserSI->getValueOperand()->dump();
+                      LLVM_DEBUG(KargSIUser->dump());
+                      LLVM_DEBUG(KargSIUserSI->getValueOperand()->dump());
                       KernelInvocationToArgNumberToAllocationMap[Invocation][Position] =
                           KargSIUserSI->getValueOperand();
                       KernelInvocationToArgNumberToActualArgMap[Invocation][Position] =
@@ -622,16 +1087,16 @@ struct DynamicHostTransform : public ModulePass {
                           KargSIUserSI->getValueOperand();
                       KernelInvocationToArgNumberToLastStoreMap[Invocation][Position] =
                           KargSIUserSI->getValueOperand();
-                      errs() << "listing load all users of \n";
+                      LLVM_DEBUG(dbgs() << "listing load all users of \n");
                       auto PtrLd = dyn_cast<LoadInst>(KargSIUserSI->getValueOperand());
                       if(PtrLd) {
                           auto Ptr = dyn_cast<AllocaInst>(PtrLd->getPointerOperand());
                           if(Ptr) {
-                              Ptr->dump();
-                              errs() << "users of now\n";
+                              LLVM_DEBUG(Ptr->dump());
+                              LLVM_DEBUG(dbgs() << "users of now\n");
                               for (auto *user : Ptr->users()) {
                                   if(auto LDU = dyn_cast<LoadInst>(user)) {
-                                      LDU->dump();
+                                      LLVM_DEBUG(LDU->dump());
                                       AllocationToFirstMap[PtrLd] = LDU;
                                   }
                               }
@@ -641,13 +1106,13 @@ struct DynamicHostTransform : public ModulePass {
                   }
                   if(KernelInvocationToEnclosingLIVMap.find(Invocation) != 
                           KernelInvocationToEnclosingLIVMap.end()) {
-                  errs() << "match with LIV\n";
-                      KernelInvocationToEnclosingLIVMap[Invocation]->dump();
+                  LLVM_DEBUG(dbgs() << "match with LIV\n");
+                      LLVM_DEBUG(KernelInvocationToEnclosingLIVMap[Invocation]->dump());
                       if (KernelInvocationToEnclosingLIVMap[Invocation] ==
                               KargSIUserSI->getValueOperand()) {
-                          errs() << "host loop\n";
+                          LLVM_DEBUG(dbgs() << "host loop\n");
                           Value *LIV = KargSIUserSI->getValueOperand();
-                          LIV->dump();
+                          LLVM_DEBUG(LIV->dump());
                           KernelInvocationToArgNumberToLIVMap[Invocation][Position] = LIV;
                           KernelInvocationToLIVToArgNumMap[Invocation][LIV] = Position;
                           KernelInvocationToArgNumberToActualArgMap[Invocation][Position] =
@@ -656,7 +1121,7 @@ struct DynamicHostTransform : public ModulePass {
                   }
               }
           }
-          errs() << "end\n";
+          LLVM_DEBUG(dbgs() << "end\n");
       }
   }
 
@@ -664,7 +1129,7 @@ struct DynamicHostTransform : public ModulePass {
   void recurseTillStoreOrEmtpy(CallBase *Invocation, Value *KernelArgStruct,
                                Value *V, Value *Karg) {
     /* errs() << "recurseTillStoreOrEmpty\n"; */
-    V->dump();
+    LLVM_DEBUG(V->dump());
     if (auto *SI = dyn_cast<StoreInst>(V)) {
       /* errs() << "STORE\n"; */
       KernelArgToStoreMap[KernelArgStruct].push_back(V);
@@ -672,23 +1137,23 @@ struct DynamicHostTransform : public ModulePass {
       int Position = findKernelStructLocationForStoreInstruction(
           SI);                                       // store location tracing
       Value *Val = findValueForStoreInstruction(SI); // store value tracing
-      errs() << "Position in Kernel Arg Struct = " << Position << "\n";
+      LLVM_DEBUG(dbgs() << "Position in Kernel Arg Struct = " << Position << "\n");
       if (Val) {
-        errs() << "Value being written by store operand\n";
-        Val->dump();
+        LLVM_DEBUG(dbgs() << "Value being written by store operand\n");
+        LLVM_DEBUG(Val->dump());
       }
       if (findStoreInstWithGivenValueOperand(
               Val)) { // find where the value is coming from
-        errs() << "\nFOUND SIWGVO\n";
-        findStoreInstWithGivenValueOperand(Val)->dump();
+        LLVM_DEBUG(dbgs() << "\nFOUND SIWGVO\n");
+        LLVM_DEBUG(findStoreInstWithGivenValueOperand(Val)->dump());
         auto *SIWGPO = findStoreInstWithGivenPointerOperand(Val);
         if (SIWGPO) {
-          SIWGPO->dump();
-          errs() << "SIWGPO value: ";
-          SIWGPO->getValueOperand()->dump();
+          LLVM_DEBUG(SIWGPO->dump());
+          LLVM_DEBUG(dbgs() << "SIWGPO value: ");
+          LLVM_DEBUG(SIWGPO->getValueOperand()->dump());
           if (FormalArgumentToActualArgumentMap.find(SIWGPO) !=
               FormalArgumentToActualArgumentMap.end()) {
-            errs() << "found SIWGPO as an argument\n";
+            LLVM_DEBUG(dbgs() << "found SIWGPO as an argument\n");
           }
           /* if (auto *LIPO = dyn_cast<LoadInst>(SIWGPO->getValueOperand())) { */
           /*   errs() << "\nWHICH USES LIPO\n"; */
@@ -736,13 +1201,23 @@ struct DynamicHostTransform : public ModulePass {
           /*   } */
           /* } */
           if (isa<PointerType>(SIWGPO->getValueOperand()->getType())) {
-            errs() << "\n WHICH IS A POINTER\n";
+            LLVM_DEBUG(dbgs() << "\n WHICH IS A POINTER\n");
             auto MallocPointer =
                 PointerOpToOriginalPointers.find(SIWGPO->getValueOperand());
+            // a pointer handed down through wrappers only the call-site
+            // summary resolves
+            if (MallocPointer == PointerOpToOriginalPointers.end() &&
+                !resolveOriginalPointers(SIWGPO->getValueOperand()).empty())
+              MallocPointer = PointerOpToOriginalPointers
+                                  .insert({SIWGPO->getValueOperand(),
+                                           *resolveOriginalPointers(
+                                                SIWGPO->getValueOperand())
+                                                .begin()})
+                                  .first;
             if (MallocPointer != PointerOpToOriginalPointers.end()) {
               /* MallocPointer->first->dump(); */
               /* MallocPointer->second->dump(); */
-              errs() << "FOUND YAY!!\n";
+              LLVM_DEBUG(dbgs() << "FOUND YAY!!\n");
               /* LIPO->getPointerOperand()->dump(); */
               KernelInvocationToArgNumberToAllocationMap[Invocation][Position] =
                   MallocPointer->first;
@@ -764,9 +1239,9 @@ struct DynamicHostTransform : public ModulePass {
           }
           if (KernelInvocationToEnclosingLIVMap[Invocation] ==
               SIWGPO->getValueOperand()) {
-            errs() << "host loop\n";
+            LLVM_DEBUG(dbgs() << "host loop\n");
             Value *LIV = SIWGPO->getValueOperand();
-            LIV->dump();
+            LLVM_DEBUG(LIV->dump());
             KernelInvocationToArgNumberToLIVMap[Invocation][Position] = LIV;
             KernelInvocationToLIVToArgNumMap[Invocation][LIV] = Position;
             KernelInvocationToArgNumberToActualArgMap[Invocation][Position] =
@@ -775,17 +1250,17 @@ struct DynamicHostTransform : public ModulePass {
           KernelInvocationToArgNumberToActualArgMap[Invocation][Position] =
               SIWGPO->getValueOperand();
         } else {
-          errs() << "complicated case\n";
-          Val->dump();
+          LLVM_DEBUG(dbgs() << "complicated case\n");
+          LLVM_DEBUG(Val->dump());
           // iterate over all mempcy for structs and find out if any match Val
           if (MemcpyOpForStructsDstToInstMap.find(Val) !=
               MemcpyOpForStructsDstToInstMap.end()) {
-            errs() << "found writer\n";
+            LLVM_DEBUG(dbgs() << "found writer\n");
             auto memcpyInst = MemcpyOpForStructsDstToInstMap[Val];
-            memcpyInst->dump();
-            errs() << "source\n";
+            LLVM_DEBUG(memcpyInst->dump());
+            LLVM_DEBUG(dbgs() << "source\n");
             auto src = memcpyInst->getOperand(1);
-            src->dump();
+            LLVM_DEBUG(src->dump());
               KernelInvocationToArgNumberToAllocationMap[Invocation][Position] =
                   src;
               KernelInvocationToArgNumberToActualArgMap[Invocation][Position] =
@@ -894,6 +1369,10 @@ struct DynamicHostTransform : public ModulePass {
       return ETO_BDIMX;
     } else if (op.compare("BDIMY") == 0) {
       return ETO_BDIMY;
+    } else if (op.compare("GDIMX") == 0) {
+      return ETO_GDIMX;
+    } else if (op.compare("GDIMY") == 0) {
+      return ETO_GDIMY;
     } else if (op.compare("GEP") == 0) {
       return ETO_GEP;
     } else if (op.compare("ZEXT") == 0) {
@@ -983,7 +1462,7 @@ struct DynamicHostTransform : public ModulePass {
       Stack.push(root);
       while (!Stack.empty()) {
           ExprTreeNodeAdvanced *Current = Stack.top();
-          errs() << Current->original_str << " ";
+          LLVM_DEBUG(dbgs() << Current->original_str << " ");
           if(Current->op == op) {
               return true;
           }
@@ -1005,7 +1484,7 @@ struct DynamicHostTransform : public ModulePass {
       Stack.push(root);
       while (!Stack.empty()) {
           ExprTreeNodeAdvanced *Current = Stack.top();
-          errs() << Current->original_str << " ";
+          LLVM_DEBUG(dbgs() << Current->original_str << " ");
           Stack.pop();
           /* if (isOperation(Current)) { */
               for(auto child = Current->children.begin(); child != Current->children.end(); child++) {
@@ -1023,7 +1502,7 @@ struct DynamicHostTransform : public ModulePass {
     Stack.push(root);
     while (!Stack.empty()) {
       ExprTreeNode *Current = Stack.top();
-      errs() << Current->original_str << " ";
+      LLVM_DEBUG(dbgs() << Current->original_str << " ");
       Stack.pop();
       if (isOperation(Current)) {
         Stack.push(Current->children[0]);
@@ -1097,8 +1576,8 @@ struct DynamicHostTransform : public ModulePass {
           auto griddimx = evaluateRPNForIter0(CI, RRPN);
           return griddimx;
         } else {
-          errs() << "hehe: "
-                 << KernelInvocationToGridSizeMap[CI][AXIS_TYPE_GDIMX] << "\n";
+          LLVM_DEBUG(dbgs() << "hehe: "
+                 << KernelInvocationToGridSizeMap[CI][AXIS_TYPE_GDIMX] << "\n");
           return KernelInvocationToGridSizeMap[CI][AXIS_TYPE_GDIMX] - 1;
         }
       }
@@ -1202,11 +1681,11 @@ struct DynamicHostTransform : public ModulePass {
   ExprTreeNode *operateMax(CallBase *CI, ExprTreeNode *operation,
                            ExprTreeNode *op1, ExprTreeNode *op2,
                            unsigned LoopArg, unsigned loopid) {
-    ExprTreeNode *result = new ExprTreeNode();
+    ExprTreeNode *result = newExprTreeNode();
     unsigned long long v1 = getMaxValueForLiterals(CI, op1, LoopArg, loopid);
     unsigned long long v2 = getMaxValueForLiterals(CI, op2, LoopArg, loopid);
     unsigned long long res = 1;
-    errs() << operation->original_str << "::::" << v1 << " " << v2 << "\n";
+    LLVM_DEBUG(dbgs() << operation->original_str << "::::" << v1 << " " << v2 << "\n");
     if (operation->op == ETO_SHL) {
       res = v1 << v2;
     }
@@ -1230,7 +1709,7 @@ struct DynamicHostTransform : public ModulePass {
   ExprTreeNode *operateMin(CallBase *CI, ExprTreeNode *operation,
                            ExprTreeNode *op1, ExprTreeNode *op2,
                            unsigned LoopArg, unsigned loopid) {
-    ExprTreeNode *result = new ExprTreeNode();
+    ExprTreeNode *result = newExprTreeNode();
     unsigned long long v1 = getMinValueForLiterals(CI, op1, LoopArg, loopid);
     unsigned long long v2 = getMinValueForLiterals(CI, op2, LoopArg, loopid);
     unsigned long long res = 1;
@@ -1258,7 +1737,7 @@ struct DynamicHostTransform : public ModulePass {
 
   ExprTreeNode *operate(CallBase *CI, ExprTreeNode *operation,
                         ExprTreeNode *op1, ExprTreeNode *op2) {
-    ExprTreeNode *result = new ExprTreeNode();
+    ExprTreeNode *result = newExprTreeNode();
     unsigned long long v1 = getActualHostValueForLiterals(CI, op1);
     unsigned long long v2 = getActualHostValueForLiterals(CI, op2);
     unsigned long long res = 1;
@@ -1281,12 +1760,12 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   unsigned long long evaluateRPNforMax(CallBase *CI,
-                                       std::vector<ExprTreeNode *> RPN,
+                                       const std::vector<ExprTreeNode *> &RPN,
                                        unsigned LoopArg, unsigned loopid) {
-    errs() << "Evaluating RPN for max\n";
+    LLVM_DEBUG(dbgs() << "Evaluating RPN for max\n");
     std::stack<ExprTreeNode *> stack;
     for (auto Token = RPN.begin(); Token != RPN.end(); Token++) {
-      errs() << (*Token)->original_str << "\n ";
+      LLVM_DEBUG(dbgs() << (*Token)->original_str << "\n ");
       if (isOperation(*Token)) {
         /* errs() << "operation\n"; */
         ExprTreeNode *op1 = stack.top();
@@ -1297,9 +1776,9 @@ struct DynamicHostTransform : public ModulePass {
         ExprTreeNode *result;
         if (isTerminal(op1) && isTerminal(op2)) {
           result = operateMax(CI, *Token, op1, op2, LoopArg, loopid);
-          errs() << "interm = " << result->value << "\n";
+          LLVM_DEBUG(dbgs() << "interm = " << result->value << "\n");
         } else {
-          errs() << "MAJOR ISSUE: node not teminal\n";
+          LLVM_DEBUG(dbgs() << "MAJOR ISSUE: node not teminal\n");
         }
         result->op = ETO_INTERM;
         stack.push(result);
@@ -1314,7 +1793,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   unsigned long long evaluateRPNforMin(CallBase *CI,
-                                       std::vector<ExprTreeNode *> RPN,
+                                       const std::vector<ExprTreeNode *> &RPN,
                                        unsigned LoopArg, unsigned loopid) {
     /* errs() << "Evaluating RPN for min\n"; */
     std::stack<ExprTreeNode *> stack;
@@ -1332,7 +1811,7 @@ struct DynamicHostTransform : public ModulePass {
           result = operateMin(CI, *Token, op1, op2, LoopArg, loopid);
           /* errs() << "interm = " << result->value << "\n"; */
         } else {
-          errs() << "MAJOR ISSUE: node not teminal\n";
+          LLVM_DEBUG(dbgs() << "MAJOR ISSUE: node not teminal\n");
         }
         result->op = ETO_INTERM;
         stack.push(result);
@@ -1347,7 +1826,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   unsigned long long evaluateRPN(CallBase *CI,
-                                 std::vector<ExprTreeNode *> RPN) {
+                                 const std::vector<ExprTreeNode *> &RPN) {
     /* errs() << "Evaluating RPN\n"; */
     std::stack<ExprTreeNode *> stack;
     for (auto Token = RPN.begin(); Token != RPN.end(); Token++) {
@@ -1364,7 +1843,7 @@ struct DynamicHostTransform : public ModulePass {
           result = operate(CI, *Token, op1, op2);
           /* errs() << "interm = " << result->value << "\n"; */
         } else {
-          errs() << "MAJOR ISSUE: node not teminal\n";
+          LLVM_DEBUG(dbgs() << "MAJOR ISSUE: node not teminal\n");
         }
         result->op = ETO_INTERM;
         stack.push(result);
@@ -1404,23 +1883,23 @@ struct DynamicHostTransform : public ModulePass {
   std::vector<ExprTreeNode *>
   findMultipliersByTraversingUpExprTree(ExprTreeNode *root,
                                         ExprTreeNode *given) {
-    errs() << "\nfind multipliers\n";
+    LLVM_DEBUG(dbgs() << "\nfind multipliers\n");
     std::vector<ExprTreeNode *> Multipliers;
     ExprTreeNode *current = given;
     ExprTreeNode *parent = current->parent;
     while (current != nullptr) {
       parent = current->parent;
       if (parent) {
-          errs()  << parent->original_str << "\n";
+          LLVM_DEBUG(dbgs()  << parent->original_str << "\n");
         if (parent->op == ETO_MUL || parent->op == ETO_SHL) {
-          errs() << parent->original_str << "  " << parent->op << "\n";
+          LLVM_DEBUG(dbgs() << parent->original_str << "  " << parent->op << "\n");
           // URGENT TODO: if op is shl, then we need to note that somehow
           if (parent->children[0] == current) {
             Multipliers.push_back(parent->children[1]);
           } else {
             Multipliers.push_back(parent->children[0]);
           }
-          errs() << "pushed to Multipliers\n";
+          LLVM_DEBUG(dbgs() << "pushed to Multipliers\n");
         }
       }
       current = parent;
@@ -1431,7 +1910,7 @@ struct DynamicHostTransform : public ModulePass {
   std::vector<ExprTreeNode *>
   findDivisorsByTraversingUpExprTree(ExprTreeNode *root,
                                         ExprTreeNode *given) {
-    errs() << "\nfind divisors\n";
+    LLVM_DEBUG(dbgs() << "\nfind divisors\n");
     std::vector<ExprTreeNode *> Multipliers;
     ExprTreeNode *current = given;
     ExprTreeNode *parent = current->parent;
@@ -1439,7 +1918,7 @@ struct DynamicHostTransform : public ModulePass {
       parent = current->parent;
       if (parent) {
         if (parent->op == ETO_UDIV || parent->op == ETO_SDIV) {
-          errs() << parent->original_str << "  " << parent->op << "\n";
+          LLVM_DEBUG(dbgs() << parent->original_str << "  " << parent->op << "\n");
           // URGENT TODO: if op is shl, then we need to note that somehow
           if (parent->children[0] == current) {
             Multipliers.push_back(parent->children[1]);
@@ -1457,15 +1936,15 @@ struct DynamicHostTransform : public ModulePass {
   // Further, we only handle cases where the values across iteratins are of the
   // form C*i, where i is the induction and C is a
   unsigned long long partialDifferenceWRTPhi(CallBase *CI, ExprTreeNode *root) {
-    errs() << "\npartial diff with rt phi\n";
+    LLVM_DEBUG(dbgs() << "\npartial diff with rt phi\n");
     ExprTreeNode *phi = findNodeInExpressionTree(root, ETO_PHI, 0);
     ExprTreeNode *phiterm = findNodeInExpressionTree(root, ETO_PHI_TERM, 0);
     std::vector<ExprTreeNode *> Adders;
     ExprTreeNode *current = phiterm;
     ExprTreeNode *parent;
     if (phi && phiterm) {
-      errs() << phi->original_str << "\n";
-      errs() << phiterm->original_str << "\n";
+      LLVM_DEBUG(dbgs() << phi->original_str << "\n");
+      LLVM_DEBUG(dbgs() << phiterm->original_str << "\n");
       while (current != phi) {
         parent = current->parent;
         if (parent->children[0] == current) {
@@ -1476,7 +1955,7 @@ struct DynamicHostTransform : public ModulePass {
         }
         current = parent;
       }
-      errs() << "partial difference wrt phi node\n";
+      LLVM_DEBUG(dbgs() << "partial difference wrt phi node\n");
       unsigned long long partialDiffWRTPhi =
           evaluateExpressionTree(CI, Adders[0]);
       return partialDiffWRTPhi;
@@ -1492,16 +1971,16 @@ struct DynamicHostTransform : public ModulePass {
     // TODO: fin all nodes of the given type in the expression tree
     ExprTreeNode *node = findNodeInExpressionTree(root, given, arg);
     if (node)
-      errs() << "found node " << node->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "found node " << node->original_str << "\n");
     else
-      errs() << "not found node \n";
+      LLVM_DEBUG(dbgs() << "not found node \n");
     // move up towards root, looking for MUL/SHLs. Store the other child.
     if (node) {
       auto mutlipliers = findMultipliersByTraversingUpExprTree(root, node);
-      errs() << "multipliers => ";
+      LLVM_DEBUG(dbgs() << "multipliers => ");
       for (auto mutliplier = mutlipliers.begin();
            mutliplier != mutlipliers.end(); mutliplier++) {
-        errs() << (*mutliplier)->original_str << ".";
+        LLVM_DEBUG(dbgs() << (*mutliplier)->original_str << ".");
       }
 
       // evaluate the stored other childs and multiply all of them together
@@ -1510,12 +1989,12 @@ struct DynamicHostTransform : public ModulePass {
            mutliplier != mutlipliers.end(); mutliplier++) {
         if ((*mutliplier)->parent->op == ETO_MUL) {
           FinalMultiplier *= evaluateExpressionTree(CI, (*mutliplier));
-          errs() << "finmul = " << FinalMultiplier << "\n";
+          LLVM_DEBUG(dbgs() << "finmul = " << FinalMultiplier << "\n");
         }
         if ((*mutliplier)->parent->op == ETO_SHL) {
           FinalMultiplier = FinalMultiplier
                             << evaluateExpressionTree(CI, (*mutliplier));
-          errs() << "finmul = " << FinalMultiplier << "\n";
+          LLVM_DEBUG(dbgs() << "finmul = " << FinalMultiplier << "\n");
         }
       }
       return FinalMultiplier;
@@ -1535,19 +2014,20 @@ struct DynamicHostTransform : public ModulePass {
       return nullptr;
     }
     if(RPN.size() > 50) {
-      current = new ExprTreeNode();
+      current = newExprTreeNode();
       current->op = ETO_PC; // TODO: use a different technique
       return current;
     }
     if(RPN[0].compare("INCOMP") == 0) {
-      /* current = new ExprTreeNode(); */
-      /* current->op = ETO_INCOMP; */
-      /* return current; */
+      if (Policy != POLICY_STATIC)
         return nullptr;
+      current = newExprTreeNode();
+      current->op = ETO_INCOMP;
+      return current;
     }
     for (auto str = RPN.begin(); str != RPN.end(); str++) {
       /* errs() << *str << "\n"; */
-      current = new ExprTreeNode();
+      current = newExprTreeNode();
       current->op = getExprTreeOp(*str);
       current->original_str = *str;
       current->parent = nullptr;
@@ -1564,16 +2044,16 @@ struct DynamicHostTransform : public ModulePass {
     /* errs() << "\nmaking tree\n"; */
     bool phi_term_seen = false;
     for (auto node = RPN_Nodes.begin(); node != RPN_Nodes.end(); node++) {
-      errs() << "\n" << (*node)->original_str << " ";
+      LLVM_DEBUG(dbgs() << "\n" << (*node)->original_str << " ");
       if (isPhiNode(*node)) { // first phi node is term, second and later are
                               // ops: FIXME
         if (phi_term_seen == false) {
-          errs() << "Terminal PHI";
+          LLVM_DEBUG(dbgs() << "Terminal PHI");
           (*node)->op = ETO_PHI_TERM;
           stack.push(*node);
           phi_term_seen = true;
         } else {
-          errs() << "Operation PHI";
+          LLVM_DEBUG(dbgs() << "Operation PHI");
           if (stack.empty())
             return nullptr;
           ExprTreeNode *child1 = stack.top();
@@ -1590,7 +2070,7 @@ struct DynamicHostTransform : public ModulePass {
           phi_term_seen = false; // Will this work properly?
         }
       } else if (isOperation(*node)) {
-        errs() << "Operation ";
+        LLVM_DEBUG(dbgs() << "Operation ");
         if (stack.empty())
           return nullptr;
         ExprTreeNode *child1 = stack.top();
@@ -1615,17 +2095,17 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   // Create expression tree from parenthesised serialized expression tree
-  ExprTreeNodeAdvanced* createExpressionTreeAdvanced(std::vector<std::string> serializedTree){
+  ExprTreeNodeAdvanced* createExpressionTreeAdvanced(const std::vector<std::string> &serializedTree){
       ExprTreeNodeAdvanced *root = nullptr;
       ExprTreeNodeAdvanced *current = nullptr;
       std::stack<ExprTreeNodeAdvanced *> stack;
       unsigned term_count = 0;
       for (auto str = serializedTree.begin(); str != serializedTree.end(); str++) {
-          errs()<<"adv expr tree " << *str << "\n";
+          LLVM_DEBUG(dbgs()<<"adv expr tree " << *str << "\n");
           if(*str == "(" ) {
               str++;
-          errs()<<"adv expr tree " << *str << "\n";
-              ExprTreeNodeAdvanced* node = new ExprTreeNodeAdvanced();
+          LLVM_DEBUG(dbgs()<<"adv expr tree " << *str << "\n");
+              ExprTreeNodeAdvanced* node = newExprTreeNodeAdvanced();
               node->op = getExprTreeOp(*str);
               node->original_str = *str;
               node->parent = nullptr;
@@ -1656,242 +2136,181 @@ struct DynamicHostTransform : public ModulePass {
 
   void printExpresstionTreeAdvanced(ExprTreeNodeAdvanced* root) {
       if (!root) return;
-      errs() << root->original_str << " ";
-      errs() << "( ";
+      LLVM_DEBUG(dbgs() << root->original_str << " ");
+      LLVM_DEBUG(dbgs() << "( ");
       for (ExprTreeNodeAdvanced* child : root->children) {
           printExpresstionTreeAdvanced(child);
       }
-      errs() << ") ";
+      LLVM_DEBUG(dbgs() << ") ");
   }
 
+  // Reads the records CudaAnalysis left in -cuda-analysis-metadata
   void printKernelDeviceAnalyis() {
-    std::string Data;
-
-    std::ifstream LoopDetailFile("loop_detail_file.lst");
-    if (LoopDetailFile.is_open()) {
-      errs() << "Reading Loop Detail File\n";
-      std::string line;
-      while (getline(LoopDetailFile, line)) {
-        std::stringstream ss(line);
-        std::string word;
-        ss >> word;
-        /* word.erase(0,4); */
-        std::string KernelName = word;
-        errs() << KernelName << " ";
-        ss >> word;
-        unsigned LoopId = stoi(word);
-        ss >> word;
-        unsigned ParentLoopId = stoi(word);
-        /* errs() << LoopId << " "; */
-        LoopIDToParentLoopIDMap[LoopId] = ParentLoopId;
-        std::vector<std::string> IN, FIN, STEP;
-        int in = 0, fin = 0, step = 0, iters = 0;
-        while (ss >> word) {
-          /* errs() << word << " "; */
-          if (word.compare("IT") == 0) {
-            ss >> word;
-            iters = stoi(word);
-            /* errs() << iters; */
-            LoopIDToLoopItersMap[KernelName][LoopId] = iters;
-          } else {
-            /* errs() << word << " "; */
-            LoopIDToLoopBoundsMap[KernelName][LoopId].push_back(word);
-          }
-        }
-        errs() << "\n";
-      }
-    }
-
-    std::ifstream PhiLoopFile("phi_loop_file.lst");
-    if(PhiLoopFile.is_open()) {
-      errs() << "Reading PHI loop File\n";
-      std::string line;
-      while (getline(PhiLoopFile, line)) {
-        std::stringstream ss(line);
-        std::string word;
-        ss >> word;
-        unsigned PhiID = stoi(word);
-        ss >> word;
-        unsigned LoopID = stoi(word);
-        PhiNodeToLoopIDMap[PhiID] = LoopID;
-      }
-    }
-
-    std::ifstream IfDetailFile("if_detail_file.lst");
-    if (IfDetailFile.is_open()) {
-      errs() << "Reading If Detail File\n";
-      std::string line;
-      while (getline(IfDetailFile, line)) {
-        std::stringstream ss(line);
-        std::string word;
-        ss >> word;
-        unsigned IfId = stoi(word);
-        errs() << IfId << " ";
-        while (ss >> word) {
-          errs() << word << " ";
-          IfIDToCondMap[IfId].push_back(word);
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+
+    auto Tokens = [&](const cuda_analysis::MetadataRecord &R) {
+      std::vector<std::string> Words;
+      Words.reserve(R.Tokens.size());
+      for (auto T : R.Tokens)
+        Words.push_back(Metadata.string(T).str());
+      return Words;
+    };
+
+    LLVM_DEBUG(dbgs() << "Reading CudaAnalysis metadata\n");
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      std::string KernelName = R.Kernel.str();
+      switch (R.Kind) {
+      case cuda_analysis::RK_Loop: {
+        if (R.Fields.size() < 2)
+          break;
+        unsigned LoopId = R.Fields[0];
+        LLVM_DEBUG(dbgs() << KernelName << " " << LoopId << "\n");
+        LoopIDToParentLoopIDMap[LoopId] = R.Fields[1];
+        if (R.Fields.size() > 2)
+          LoopIDToLoopItersMap[KernelName][LoopId] = R.Fields[2];
+        auto &Bounds = LoopIDToLoopBoundsMap[KernelName][LoopId];
+        for (auto T : R.Tokens)
+          Bounds.push_back(Metadata.string(T).str());
+        break;
+      }
+      case cuda_analysis::RK_PhiLoop:
+        if (R.Fields.size() < 2)
+          break;
+        PhiNodeToLoopIDMap[R.Fields[0]] = R.Fields[1];
+        break;
+      case cuda_analysis::RK_If: {
+        if (R.Fields.size() < 1)
+          break;
+        unsigned IfId = R.Fields[0];
+        LLVM_DEBUG(dbgs() << IfId << " ");
+        auto &Cond = IfIDToCondMap[IfId];
+        for (auto T : R.Tokens) {
+          LLVM_DEBUG(dbgs() << Metadata.string(T) << " ");
+          Cond.push_back(Metadata.string(T).str());
         }
-        errs() << "\n";
-      }
-    }
-
-    std::ifstream AccessDetailFile("access_detail_file.lst");
-    if (AccessDetailFile.is_open()) {
-      errs() << "Reading Access Detail File\n";
-      std::string line;
-      while (getline(AccessDetailFile, line)) {
-        /* errs() << line; */
-        /* errs() << "\n"; */
-        std::stringstream ss(line);
-        std::string word;
-        ss >> word;
-        /* word.erase(0,4); */
-        std::string KernelName = word;
-        errs() << KernelName << " ";
-        ss >> word;
-        unsigned AccessId = stoi(word);
-        errs() << AccessId << " ";
-        ss >> word;
-        unsigned ParamNumber = stoi(word);
-        errs() << ParamNumber << " ";
+        LLVM_DEBUG(dbgs() << "\n");
+        break;
+      }
+      case cuda_analysis::RK_Access: {
+        if (R.Fields.size() < 5)
+          break;
+        unsigned AccessId = R.Fields[0];
+        LLVM_DEBUG(dbgs() << KernelName << " " << AccessId << " " << R.Fields[1] << " "
+               << R.Fields[2] << " " << R.Fields[3] << " " << R.Fields[4]
+               << "\n");
         KernelNameToAccessIDToAllocationArgMap[KernelName][AccessId] =
-            ParamNumber;
-        ss >> word;
-        unsigned LoopId = stoi(word);
-        errs() << LoopId << " ";
-        KernelNameToAccessIDToEnclosingLoopMap[KernelName][AccessId] = LoopId;
-        ss >> word;
-        unsigned IfId = stoi(word);
-        errs() << IfId << " ";
-        KernelNameToAccessIDToIfCondMap[KernelName][AccessId] = IfId;
-        ss >> word;
-        unsigned IfType = stoi(word);
-        errs() << IfType << " ";
-        KernelNameToAccessIDToIfTypeMap[KernelName][AccessId] = IfType;
-        std::vector<std::string> RPN;
-        while (ss >> word) {
-          errs() << word << " ";
-          if (word.compare("[") == 0 || word.compare("]") == 0) {
-            ;
-          } else {
-            RPN.push_back(word);
-          }
-        }
-        errs() << "good expression\n";
+            R.Fields[1];
+        KernelNameToAccessIDToEnclosingLoopMap[KernelName][AccessId] =
+            R.Fields[2];
+        KernelNameToAccessIDToIfCondMap[KernelName][AccessId] = R.Fields[3];
+        KernelNameToAccessIDToIfTypeMap[KernelName][AccessId] = R.Fields[4];
+        if (R.Fields.size() > 5 && R.Fields[5])
+          KernelNameToStoreAccessIDsMap[KernelName].insert(AccessId);
+        if (R.Fields.size() > 6 && R.Fields[6] > 1)
+          KernelNameToAccessIDToTileReuseMap[KernelName][AccessId] = R.Fields[6];
         KernelNameToAccessIDToExpressionTreeMap[KernelName][AccessId] =
-            createExpressionTree(RPN);
-        errs() << "\n";
-      }
-    }
-
-    std::ifstream AccessTreeFile("access_tree_file.lst");
-    if (AccessTreeFile.is_open()) {
-      errs() << "Reading Access Tree File\n";
-      std::string line;
-      while (getline(AccessTreeFile, line)) {
-        /* errs() << line; */
-        /* errs() << "\n"; */
-        std::stringstream ss(line);
-        std::string word;
-        ss >> word;
-        /* word.erase(0,4); */
-        std::string KernelName = word;
-        errs() << KernelName << " ";
-        ss >> word;
-        unsigned AccessId = stoi(word);
-        errs() << AccessId << " ";
-        std::vector<std::string> RPN;
-        while (ss >> word) {
-          errs() << word << " ";
-          if (word.compare("[") == 0 || word.compare("]") == 0) {
-            ;
-          } else {
-            RPN.push_back(word);
-          }
-        }
-        errs() << "good expression\n";
-        auto test = createExpressionTreeAdvanced(RPN);
+            createExpressionTree(Tokens(R));
+        break;
+      }
+      case cuda_analysis::RK_AccessTree: {
+        if (R.Fields.size() < 1)
+          break;
+        unsigned AccessId = R.Fields[0];
+        LLVM_DEBUG(dbgs() << KernelName << " " << AccessId << " ");
+        auto test = createExpressionTreeAdvanced(Tokens(R));
         printExpresstionTreeAdvanced(test);
         KernelNameToAccessIDToAdvancedExpressionTreeMap[KernelName][AccessId] =
             test;
-        errs() << "\n";
-      }
-    }
-
-
-
-    /* std::ifstream AccessDetailFile("access_detail_file.lst"); */
-    /* errs() << "DEVICE ANALYSIS\n"; */
-    /* while (AccessDetailFile >> Data) { */
-    /*   errs() << Data << "\n"; */
-    /*   Data.erase(0, 4); */
-    /*   std::string KernelName = Data; */
-    /*   // errs() << Data << "\n"; // need to unmangle somehow! */
-    /*   AccessDetailFile >> Data; */
-    /*   errs() << Data << "\n"; */
-    /*   unsigned ParamNumber = stoi(Data); */
-    /*   // errs() << Data << "\n"; */
-    /*   AccessDetailFile >> Data; */
-    /*   errs() << Data << "\n"; */
-    /*   unsigned AccessInfo = stoi(Data); */
-    /*   // errs() << Data << "\n"; */
-    /*   // errs() << "\n"; */
-    /*   AccessDetailFile >> Data; */
-    /*   errs() << Data << "\n"; */
-    /*   KernelParamUsageInKernel[KernelName].push_back( */
-    /*       std::make_pair(ParamNumber, AccessInfo)); */
-    /* } */
-
-    /* std::ifstream ReuseDetailFile("reuse_detail_file.lst"); */
-    /* errs() << "REUSE ANALYSIS FORM DEVICE\n"; */
-    /* for (std::string Line; std::getline(ReuseDetailFile, Line);) { */
-    /*   // errs() << Line << "\n"; */
-    /*   std::stringstream LineStream(Line); */
-    /*   std::string Token; */
-    /*   std::getline(LineStream, Token, ' '); */
-    /*   errs() << "KERNEL NAME: " << Token.erase(0, 4) << "\n"; */
-    /*   std::string KernelName = Token; */
-    /*   std::getline(LineStream, Token, ' '); */
-    /*   errs() << "PARAM #: " << Token << "\n"; */
-    /*   unsigned ParamNumber = stoi(Token); */
-    /*   std::getline(LineStream, Token, ' '); */
-    /*   errs() << "access ID: " << Token << "\n"; */
-    /*   unsigned AccessID = std::stoi(Token); */
-    /*   std::getline(LineStream, Token, ' '); */
-    /*   errs() << "#access : " << Token << "\n"; */
-    /*   unsigned NumberOfAccess = std::stoi(Token); */
-    /*   std::getline(LineStream, Token, ' '); */
-    /*   errs() << "INDEX : " << Token << "\n"; */
-    /*   IndexAxisType ReuseIndexAxis = StringToIndexAxisType[Token]; */
-    /*   for (std::string Token; std::getline(LineStream, Token, ' ');) { */
-    /*     errs() << "Multiplier " << Token << "\n"; */
-    /*     KernelParamReuseInKernel[KernelName][ParamNumber][ReuseIndexAxis] */
-    /*       .push_back(Token); */
-    /*   } */
-    /*   errs() << "\n" */
-    /*     << "\n"; */
-    /* } */
+        LLVM_DEBUG(dbgs() << "\n");
+        break;
+      }
+      case cuda_analysis::RK_Footprint: {
+        if (R.Fields.size() < 3)
+          break;
+        std::vector<std::string> Bounds[5];
+        unsigned Current = 0;
+        for (auto T : R.Tokens) {
+          StringRef Token = Metadata.string(T);
+          if (Token == "LO")
+            Current = 0;
+          else if (Token == "HI")
+            Current = 1;
+          else if (Token == "BLO")
+            Current = 2;
+          else if (Token == "BHI")
+            Current = 3;
+          else if (Token == "TS")
+            Current = 4;
+          else
+            Bounds[Current].push_back(Token.str());
+        }
+        AccessFootprint Footprint = {
+            createExpressionTree(Bounds[0]), createExpressionTree(Bounds[1]),
+            createExpressionTree(Bounds[2]), createExpressionTree(Bounds[3]),
+            R.Fields[2], R.Fields.size() > 3 ? R.Fields[3] : 0,
+            createExpressionTree(Bounds[4])};
+        if (Footprint.Lo && Footprint.Hi)
+          KernelNameToAccessIDToFootprintMap[KernelName][R.Fields[0]] =
+              Footprint;
+        break;
+      }
+      case cuda_analysis::RK_Branch: {
+        if (R.Fields.size() < 2)
+          break;
+        std::vector<std::string> Bounds[3];
+        AccessBranch Branch = {R.Fields[1], false, nullptr, nullptr, nullptr};
+        unsigned Current = 0;
+        for (auto T : R.Tokens) {
+          StringRef Token = Metadata.string(T);
+          if (Token == "LT")
+            Branch.Below = true;
+          else if (Token == "GE")
+            Branch.Below = false;
+          else if (Token == "LO")
+            Current = 0;
+          else if (Token == "HI")
+            Current = 1;
+          else if (Token == "LIM")
+            Current = 2;
+          else
+            Bounds[Current].push_back(Token.str());
+        }
+        if (!Bounds[0].empty() && !Bounds[1].empty() && !Bounds[2].empty()) {
+          Branch.Lo = createExpressionTree(Bounds[0]);
+          Branch.Hi = createExpressionTree(Bounds[1]);
+          Branch.Limit = createExpressionTree(Bounds[2]);
+        }
+        KernelNameToAccessIDToBranchMap[KernelName][R.Fields[0]] = Branch;
+        break;
+      }
+      case cuda_analysis::RK_Atomic:
+        KernelNameToAtomicArgsMap[KernelName].insert(R.Fields.begin(),
+                                                    R.Fields.end());
+        break;
+      default:
+        break;
+      }
+    });
   }
 
   void parseReuseDetailFile() {
-    std::ifstream ResuseDetailFile("reuse_detail_file.lst");
-    errs() << "REUSE ANALYSIS FORM DEVICE\n";
-    for (std::string Line; std::getline(ResuseDetailFile, Line);) {
-      // errs() << Line << "\n";
-      std::stringstream LineStream(Line);
-      std::string Token;
-      std::getline(LineStream, Token, ' ');
-      errs() << "KERNEL NAME: " << Token.erase(0, 4) << "\n";
-      std::getline(LineStream, Token, ' ');
-      errs() << "PARAM #: " << Token << "\n";
-      std::getline(LineStream, Token, ' ');
-      errs() << "INDEX : " << Token << "\n";
-      for (std::string Token; std::getline(LineStream, Token, ' ');) {
-        errs() << "Multiplier " << Token << "\n";
-      }
-      errs() << "\n"
-             << "\n";
-    }
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    LLVM_DEBUG(dbgs() << "REUSE ANALYSIS FORM DEVICE\n");
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind != cuda_analysis::RK_Reuse || R.Fields.size() < 3)
+        return;
+      LLVM_DEBUG(dbgs() << "KERNEL NAME: " << R.Kernel << "\n");
+      LLVM_DEBUG(dbgs() << "PARAM #: " << R.Fields[0] << "\n");
+      for (auto T : R.Tokens) {
+        LLVM_DEBUG(dbgs() << "Multiplier " << Metadata.string(T) << "\n");
+      }
+      LLVM_DEBUG(dbgs() << "\n"
+             << "\n");
+    });
   }
 
   void processKernelSignature(CallBase *I) {
@@ -1901,28 +2320,28 @@ struct DynamicHostTransform : public ModulePass {
     auto *KernelPointer = I->getArgOperand(0);
     if (auto *KernelFunction = dyn_cast_or_null<Function>(KernelPointer)) {
       // KernelFunction->dump();
-      KernelFunction->getFunctionType()->dump();
+      LLVM_DEBUG(KernelFunction->getFunctionType()->dump());
     }
   }
 
   void traverseGridSizeArgument(Value *GridSizeArgument) {
-    errs() << "traverse grid size arg\n";
-    GridSizeArgument->dump();
+    LLVM_DEBUG(dbgs() << "traverse grid size arg\n");
+    LLVM_DEBUG(GridSizeArgument->dump());
   }
 
   void parseGridSizeArgument(Value *GridSizeArgument, CallBase *CI) {
-    errs() << "parsing grid size argrument\n";
-    GridSizeArgument->dump();
+    LLVM_DEBUG(dbgs() << "parsing grid size argrument\n");
+    LLVM_DEBUG(GridSizeArgument->dump());
     if (auto GridSizeOp = dyn_cast<Instruction>(GridSizeArgument)) {
       if (GridSizeOp->getOpcode() == Instruction::Mul) {
-        errs() << "MUL\n";
+        LLVM_DEBUG(dbgs() << "MUL\n");
         for (auto &Operand : GridSizeOp->operands()) {
           /* Operand->dump(); */
           if (auto ConstOper = dyn_cast<ConstantInt>(Operand)) {
             /* errs() << "is constant\n"; */
             /* errs() << ConstOper->getSExtValue() << "\n"; */
             if (ConstOper->getSExtValue() == 4294967297) {
-              errs() << "magic duplication operation\n";
+              LLVM_DEBUG(dbgs() << "magic duplication operation\n");
               for (auto &OtherOpCandidate : GridSizeOp->operands()) {
                 if (OtherOpCandidate != ConstOper) {
                   traverseGridSizeArgument(OtherOpCandidate);
@@ -1937,7 +2356,7 @@ struct DynamicHostTransform : public ModulePass {
         }
       }
       if (GridSizeOp->getOpcode() == Instruction::Or) {
-        errs() << "OR\n";
+        LLVM_DEBUG(dbgs() << "OR\n");
         for (auto &Operand : GridSizeOp->operands()) {
           /* Operand->dump(); */
           if (auto ConstOper = dyn_cast<ConstantInt>(Operand)) {
@@ -1945,11 +2364,11 @@ struct DynamicHostTransform : public ModulePass {
             /* errs() << ConstOper->getSExtValue() << "\n"; */
             if (ConstOper->getSExtValue() ==
                 4294967296) { // hard coded. ideally use arithemtic to figure
-              errs() << "magic operation\n";
+              LLVM_DEBUG(dbgs() << "magic operation\n");
               for (auto &OtherOpCandidate : GridSizeOp->operands()) {
                 if (OtherOpCandidate != ConstOper) {
-                  errs() << "magic operation pushed\n";
-                  CI->dump();
+                  LLVM_DEBUG(dbgs() << "magic operation pushed\n");
+                  LLVM_DEBUG(CI->dump());
                   traverseGridSizeArgument(OtherOpCandidate);
                   KernelInvocationToGridSizeValueMap[CI][AXIS_TYPE_GDIMX] =
                       OtherOpCandidate;
@@ -1965,7 +2384,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   void processKernelShapeArguments(Function &F) {
-    errs() << "process kernel shape arguments\n";
+    LLVM_DEBUG(dbgs() << "process kernel shape arguments\n");
 
     std::vector<CallBase *> PushCall;
     std::vector<CallBase *> PopCall;
@@ -2004,56 +2423,61 @@ struct DynamicHostTransform : public ModulePass {
     // Parsing the SROA. Very weird. No wonder no one wants to static analysis
     // on LLVM CUDA.PopCall
     for (unsigned long Index = 0; Index < PushCall.size(); Index++) {
-      errs() << "TRIPLE " << Index << "\n";
+      LLVM_DEBUG(dbgs() << "TRIPLE " << Index << "\n");
       unsigned GridDimX, GridDimY, GridDimZ = 0;
       unsigned BlockDimX = 0, BlockDimY = 0, BlockDimZ = 0;
       Value *GridXYValue = PushCall[Index]->getOperand(0);
-      PushCall[Index]->dump();
-      GridXYValue->dump();
+      LLVM_DEBUG(PushCall[Index]->dump());
+      LLVM_DEBUG(GridXYValue->dump());
       KernelInvocationToGridDimXYValueMap[LaunchCall[Index]] = GridXYValue;
       if (auto *GridXYConst = dyn_cast<ConstantInt>(GridXYValue)) {
         unsigned long long GridXY = GridXYConst->getSExtValue();
         GridDimY = GridXY >> 32;
         GridDimX = (GridXY << 32) >> 32;
-        errs() << "Grid X = " << GridDimX << "\n";
-        errs() << "Grid Y = " << GridDimY << "\n";
+        LLVM_DEBUG(dbgs() << "Grid X = " << GridDimX << "\n");
+        LLVM_DEBUG(dbgs() << "Grid Y = " << GridDimY << "\n");
         KernelInvocationToGridSizeMap[LaunchCall[Index]][AXIS_TYPE_GDIMX] =
             GridDimX;
         KernelInvocationToGridSizeMap[LaunchCall[Index]][AXIS_TYPE_GDIMY] =
             GridDimY;
       } else {
-        errs() << "heh\n";
+        LLVM_DEBUG(dbgs() << "heh\n");
         parseGridSizeArgument(GridXYValue, LaunchCall[Index]);
       }
       Value *GridZValue = PushCall[Index]->getOperand(1);
       if (auto *GridZConst = dyn_cast<ConstantInt>(GridZValue)) {
         unsigned long GridZ = GridZConst->getSExtValue();
         GridDimZ = GridZ;
-        errs() << "Grid Z = " << GridDimZ << "\n";
+        LLVM_DEBUG(dbgs() << "Grid Z = " << GridDimZ << "\n");
         KernelInvocationToGridSizeMap[LaunchCall[Index]][AXIS_TYPE_GDIMZ] =
             GridDimZ;
       } else {
         static_assert(true, "NO reach here. GRID DIM must be constant \n");
       }
-      GridZValue->dump();
+      LLVM_DEBUG(GridZValue->dump());
       KernelInvocationToGridDimZValueMap[LaunchCall[Index]] = GridZValue;
+      if (PushCall[Index]->arg_size() > 5) {
+        KernelInvocationToStreamValueMap[LaunchCall[Index]] =
+            PushCall[Index]->getArgOperand(5);
+        KernelInvocationToPushCallMap[LaunchCall[Index]] = PushCall[Index];
+      }
       Value *BlockXYValue = PushCall[Index]->getOperand(2);
-      BlockXYValue->dump();
+      LLVM_DEBUG(BlockXYValue->dump());
       if (auto *BlockXYConst = dyn_cast<ConstantInt>(BlockXYValue)) {
         unsigned long long BlockXY = BlockXYConst->getSExtValue();
         BlockDimY = BlockXY >> 32;
         BlockDimX = (BlockXY << 32) >> 32;
-        errs() << "Block X = " << BlockDimX << "\n";
-        errs() << "Block Y = " << BlockDimY << "\n";
+        LLVM_DEBUG(dbgs() << "Block X = " << BlockDimX << "\n");
+        LLVM_DEBUG(dbgs() << "Block Y = " << BlockDimY << "\n");
       } else {
         static_assert(true, "NO reach here. BLOCK DIM must be constant \n");
       }
       Value *BlockZValue = PushCall[Index]->getOperand(3);
-      BlockZValue->dump();
+      LLVM_DEBUG(BlockZValue->dump());
       if (auto *BlockZConst = dyn_cast<ConstantInt>(BlockZValue)) {
         unsigned long BlockZ = BlockZConst->getSExtValue();
         BlockDimZ = BlockZ;
-        errs() << "Block Z = " << BlockDimZ << "\n";
+        LLVM_DEBUG(dbgs() << "Block Z = " << BlockDimZ << "\n");
       } else {
         static_assert(true, "NO reach here. GRID DIM must be constant \n");
       }
@@ -2067,9 +2491,9 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   void processKernelArguments(CallBase *I) {
-    errs() << "Process kernel arguments\n";
+    LLVM_DEBUG(dbgs() << "Process kernel arguments\n");
     /* errs() << "CALL \n"; */
-    I->dump();
+    LLVM_DEBUG(I->dump());
     /* errs() << "NAME \n"; */
     auto *KernelPointer = I->getArgOperand(0);
     if (auto *KernelFunction = dyn_cast_or_null<Function>(KernelPointer)) {
@@ -2079,8 +2503,8 @@ struct DynamicHostTransform : public ModulePass {
     /* errs() << "ARG STRUCT \n"; */
     auto *KernelArgs =
         I->getArgOperand(5); // the 5th argument is the kernel argument struct.
-    errs() << "selected kernel argument\n";
-    KernelArgs->dump();
+    LLVM_DEBUG(dbgs() << "selected kernel argument\n");
+    LLVM_DEBUG(KernelArgs->dump());
     KernelInvocationToStructMap[I] = KernelArgs;
     /* errs() << "USERS \n"; */
     /* for (llvm::User *Karg : KernelArgs->users()) { */
@@ -2096,15 +2520,15 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   unsigned long int getAllocationSize(Value *PointerOp) {
-    errs() << "get alloation size (pointer) \n";
-    PointerOp->dump();
+    LLVM_DEBUG(dbgs() << "get alloation size (pointer) \n");
+    LLVM_DEBUG(PointerOp->dump());
     auto *OriginalPointer = PointerOpToOriginalPointers[PointerOp];
-    OriginalPointer->dump();
+    LLVM_DEBUG(OriginalPointer->dump());
     if (StructAllocas.find(OriginalPointer) != StructAllocas.end()) {
       if (PointerOpToOriginalStructPointersIndex.find(PointerOp) !=
           PointerOpToOriginalStructPointersIndex.end()) {
         auto argnum = PointerOpToOriginalStructPointersIndex[PointerOp];
-        errs() << "faund: " << argnum << "\n";
+        LLVM_DEBUG(dbgs() << "faund: " << argnum << "\n");
         unsigned long int AllocationSize =
             MallocPointerStructToIndexToSizeMap[OriginalPointer][argnum];
         return AllocationSize;
@@ -2115,16 +2539,16 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   unsigned long int getAllocationSize(CallBase *CI, unsigned argid) {
-    errs() << "get alloation size\n";
+    LLVM_DEBUG(dbgs() << "get alloation size\n");
     auto ArgNumberToAllocationMap =
         KernelInvocationToArgNumberToAllocationMap[CI];
     auto PointerOp = ArgNumberToAllocationMap[argid];
-    PointerOp->dump();
+    LLVM_DEBUG(PointerOp->dump());
     auto *OriginalPointer = PointerOpToOriginalPointers[PointerOp];
-    OriginalPointer->dump();
+    LLVM_DEBUG(OriginalPointer->dump());
     if (StructAllocas.find(OriginalPointer) != StructAllocas.end()) {
-      errs() << "faund: " << PointerOpToOriginalStructPointersIndex[PointerOp]
-             << "\n";
+      LLVM_DEBUG(dbgs() << "faund: " << PointerOpToOriginalStructPointersIndex[PointerOp]
+             << "\n");
     }
     unsigned long int AllocationSize = MallocPointerToSizeMap[OriginalPointer];
     return AllocationSize;
@@ -2165,20 +2589,20 @@ struct DynamicHostTransform : public ModulePass {
 
     for (auto Token = RPN.begin(); Token != RPN.end(); Token++) {
       // if terminal (host side terminals only include function arguments)
-      (*Token)->dump();
+      LLVM_DEBUG((*Token)->dump());
       if (TerminalValues.find(*Token) != TerminalValues.end()) {
         auto ActualArg = FormalArgumentToActualArgumentMap[*Token][0];
-        ActualArg->dump();
+        LLVM_DEBUG(ActualArg->dump());
         if (ConstantInt *CoI = dyn_cast<ConstantInt>(ActualArg)) {
           /* errs() << "Yayaya " << CoI->getSExtValue() << "\n"; */
           stack.push(CoI->getSExtValue());
           /* errs() << "stack push = " << CoI->getSExtValue() << "\n"; */
         } else {
           /* errs() << "PANIC!!!!\n"; */
-          errs() << "NOt a constant, so checking for values\n";
+          LLVM_DEBUG(dbgs() << "NOt a constant, so checking for values\n");
           if (PointerOpToOriginalConstant.find(ActualArg) !=
               PointerOpToOriginalConstant.end()) {
-            errs() << PointerOpToOriginalConstant[ActualArg] << "\n";
+            LLVM_DEBUG(dbgs() << PointerOpToOriginalConstant[ActualArg] << "\n");
             stack.push(PointerOpToOriginalConstant[ActualArg]);
           }
         }
@@ -2235,19 +2659,19 @@ struct DynamicHostTransform : public ModulePass {
     std::set<Value *> Visited;
     std::set<Value *> PhiNodesVisited;
 
-    errs() << "Getting Expression Tree\n";
+    LLVM_DEBUG(dbgs() << "Getting Expression Tree\n");
     Stack.push(V);
 
     while (!Stack.empty()) {
       Value *Current = Stack.top();
-      Current->dump();
+      LLVM_DEBUG(Current->dump());
       Stack.pop();
       if (PhiNodesVisited.find(Current) != PhiNodesVisited.end()) {
         RPN.push_back(Current);
         continue;
       }
       if (Visited.find(Current) != Visited.end()) {
-        errs() << "hi\n";
+        LLVM_DEBUG(dbgs() << "hi\n");
         continue;
       }
       RPN.push_back(Current);
@@ -2281,17 +2705,17 @@ struct DynamicHostTransform : public ModulePass {
       }
     }
 
-    errs() << "RPN \n";
+    LLVM_DEBUG(dbgs() << "RPN \n");
     for (auto RPNIter = RPN.begin(); RPNIter != RPN.end(); RPNIter++) {
       if (TerminalValues.find(*RPNIter) != TerminalValues.end() ||
           isa<ConstantInt>(*RPNIter)) {
-        errs() << "terminal ";
+        LLVM_DEBUG(dbgs() << "terminal ");
       } else {
-        errs() << "operand ";
+        LLVM_DEBUG(dbgs() << "operand ");
       }
-      (*RPNIter)->dump();
+      LLVM_DEBUG((*RPNIter)->dump());
     }
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "\n");
 
     return RPN;
   }
@@ -2383,6 +2807,107 @@ struct DynamicHostTransform : public ModulePass {
     return;
   }
 
+  // The string of a clang annotate attribute on the variable Slot points at,
+  // local or global, that starts with Prefix
+  StringRef getVariableAnnotation(Value *Slot, StringRef Prefix) {
+    Slot = Slot->stripPointerCasts();
+    auto String = [&](Value *V) -> StringRef {
+      auto *GV = dyn_cast<GlobalVariable>(V->stripPointerCasts());
+      auto *Data = GV && GV->hasInitializer()
+                       ? dyn_cast<ConstantDataArray>(GV->getInitializer())
+                       : nullptr;
+      if (!Data || !Data->isCString() || !Data->getAsCString().startswith(Prefix))
+        return StringRef();
+      return Data->getAsCString();
+    };
+    std::vector<Value *> Worklist = {Slot};
+    while (!Worklist.empty()) {
+      Value *V = Worklist.back();
+      Worklist.pop_back();
+      for (User *U : V->users()) {
+        if (isa<BitCastInst>(U) || isa<AddrSpaceCastInst>(U))
+          Worklist.push_back(U);
+        auto *II = dyn_cast<IntrinsicInst>(U);
+        if (II && II->getIntrinsicID() == Intrinsic::var_annotation) {
+          StringRef S = String(II->getArgOperand(1));
+          if (!S.empty())
+            return S;
+        }
+      }
+    }
+    auto *GV = dyn_cast<GlobalVariable>(Slot);
+    auto *Annotations =
+        GV ? GV->getParent()->getNamedGlobal("llvm.global.annotations") : nullptr;
+    auto *Entries = Annotations && Annotations->hasInitializer()
+                        ? dyn_cast<ConstantArray>(Annotations->getInitializer())
+                        : nullptr;
+    for (unsigned I = 0; Entries && I < Entries->getNumOperands(); I++) {
+      auto *Entry = dyn_cast<ConstantStruct>(Entries->getOperand(I));
+      if (!Entry || Entry->getNumOperands() < 2 ||
+          Entry->getOperand(0)->stripPointerCasts() != GV)
+        continue;
+      StringRef S = String(Entry->getOperand(1));
+      if (!S.empty())
+        return S;
+    }
+    return StringRef();
+  }
+
+  // PENGUIN_HINT_* of the runtime
+  enum HintKind {
+    HK_DENSE = 1,
+    HK_STREAM = 2,
+    HK_IRREGULAR = 3,
+    HK_COLD = 4,
+    HK_SCRATCH = 0x100
+  };
+
+  // Passes the hint of PENGUIN_ANNOTATE_HINT on the variable a
+  // cudaMallocManaged stores to, "penguin_hint:<pattern>[+scratch]:<priority>",
+  // to penguinHint right after the allocation is recorded
+  void insertCodeToHintAllocation(Instruction *Location, Value *Slot) {
+    StringRef Annotation = getVariableAnnotation(Slot, "penguin_hint:");
+    if (Annotation.empty())
+      return;
+    SmallVector<StringRef, 3> Fields;
+    Annotation.split(Fields, ':');
+    unsigned Pattern = 0, Priority = 0;
+    SmallVector<StringRef, 2> Words;
+    if (Fields.size() == 3)
+      Fields[1].split(Words, '+');
+    for (StringRef Word : Words) {
+      unsigned Kind = StringSwitch<unsigned>(Word.trim())
+                          .Case("dense", HK_DENSE)
+                          .Case("stream", HK_STREAM)
+                          .Case("irregular", HK_IRREGULAR)
+                          .Case("cold", HK_COLD)
+                          .Case("scratch", HK_SCRATCH)
+                          .Default(0);
+      if (!Kind || (Kind != HK_SCRATCH && (Pattern & 0xff))) {
+        Pattern = 0;
+        break;
+      }
+      Pattern |= Kind;
+    }
+    if (!(Pattern & 0xff) || Fields[2].trim().getAsInteger(10, Priority)) {
+      WithColor::warning() << "ignoring annotation \"" << Annotation << "\"\n";
+      return;
+    }
+    LLVM_DEBUG(dbgs() << "hint " << Annotation << "\n");
+    Module *M = Location->getModule();
+    LLVMContext &Ctx = M->getContext();
+    IRBuilder<> Builder(Location);
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    Value *Ptr = Builder.CreateLoad(
+        Int8PtrTy, Builder.CreateBitCast(Slot, Int8PtrTy->getPointerTo()));
+    llvm::FunctionCallee HintFn = M->getOrInsertFunction(
+        "penguinHint", Type::getVoidTy(Ctx), Int8PtrTy, Type::getInt64Ty(Ctx),
+        Type::getInt32Ty(Ctx), Type::getInt32Ty(Ctx));
+    Builder.CreateCall(HintFn, {Ptr, Builder.getInt64(0),
+                                Builder.getInt32(Pattern),
+                                Builder.getInt32(Priority)});
+  }
+
   // TODO: Fix this mess ASAP
   // First get the pointer to the allocation, not the pointer to the pointer!
   void insertCodeToRecordMalloc(CallBase *CI, Value *P, Value *S) {
@@ -2392,7 +2917,7 @@ struct DynamicHostTransform : public ModulePass {
     if(CI->getNextNode()) { // TODO: check for invoke inst (instead of call) , nto this ugly hack.
         IRBuilder<> Builder(CI);
         Builder.SetInsertPoint(CI->getNextNode());
-        P->getType()->dump();
+        LLVM_DEBUG(P->getType()->dump());
         llvm::Value *Ptr = Builder.CreatePtrToInt(P, Builder.getInt64Ty());
         Value *Args[] = {Ptr, S};
         // Builder.CreateCall(Fn, Args);
@@ -2407,19 +2932,19 @@ struct DynamicHostTransform : public ModulePass {
     } else { // else it is an invoke inst
         // get the output of malloc, which is in P, find the successors of this BB,
         auto BB = CI->getParent();
-        errs() << "BB\n";
-        BB->dump();
-        errs() << "BB over\n";
+        LLVM_DEBUG(dbgs() << "BB\n");
+        LLVM_DEBUG(BB->dump());
+        LLVM_DEBUG(dbgs() << "BB over\n");
         InvokeInst* II = dyn_cast<InvokeInst>(CI);
         BasicBlock* succ = II->getNormalDest();
-        errs() << "BB succ\n";
-        succ->dump();
-        errs() << "BB over\n";
+        LLVM_DEBUG(dbgs() << "BB succ\n");
+        LLVM_DEBUG(succ->dump());
+        LLVM_DEBUG(dbgs() << "BB over\n");
         auto IP = succ->getFirstNonPHI();
-        IP->dump();
-        errs() << "BB fi over\n";
+        LLVM_DEBUG(IP->dump());
+        LLVM_DEBUG(dbgs() << "BB fi over\n");
         IRBuilder<> Builder(IP);
-        P->getType()->dump();
+        LLVM_DEBUG(P->getType()->dump());
         llvm::Value *Ptr = Builder.CreatePtrToInt(P, Builder.getInt64Ty());
         Value *Args[] = {Ptr, S};
         // Builder.CreateCall(Fn, Args);
@@ -2435,6 +2960,138 @@ struct DynamicHostTransform : public ModulePass {
     return;
   }
 
+  // Hands the pointer to the runtime before it is freed, so that what the
+  // allocation holds on the GPU goes to the others
+  void insertCodeToRecordFree(CallBase *CI, Value *P) {
+    Function *F = CI->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(CI);
+    llvm::Value *Ptr = Builder.CreatePtrToInt(P, Builder.getInt64Ty());
+    Value *Args[] = {Ptr};
+    llvm::FunctionCallee FreeFunc = F->getParent()->getOrInsertFunction(
+        "penguinFreeAllocation", Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx));
+    Builder.CreateCall(FreeFunc, Args);
+    return;
+  }
+
+  // Sends an allocation call to the runtime's managed arena: the call keeps
+  // its arguments and its result and only changes callee, and the site, an
+  // FNV-1a hash of the function and the call's position in it that stays the
+  // same from one build to the next, is passed just before it.
+  void redirectToArena(CallBase *CI, StringRef Name, unsigned Site) {
+    Function *F = CI->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    if (Site != ~0U) {
+      IRBuilder<> Builder(CI);
+      llvm::FunctionCallee SiteFunc = F->getParent()->getOrInsertFunction(
+          "penguinArenaSite", Type::getVoidTy(Ctx), Type::getInt32Ty(Ctx));
+      Builder.CreateCall(SiteFunc, {Builder.getInt32(Site)});
+    }
+    llvm::FunctionCallee ArenaFunc =
+        F->getParent()->getOrInsertFunction(Name, CI->getFunctionType());
+    CI->setCalledFunction(ArenaFunc);
+    return;
+  }
+
+  // The cudaMallocManaged and cudaFree calls left, not already sent to the
+  // arena or to the device copies, go to penguinNvmeMallocManaged and
+  // penguinNvmeFree
+  void redirectToNvmeTier(Module &M) {
+    std::vector<CallBase *> Calls;
+    for (auto &F : M) {
+      if (F.getName().contains("stub") || F.getName().contains("penguin"))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        auto *Callee = CI ? CI->getCalledFunction() : nullptr;
+        if (Callee && (Callee->getName() == "cudaMallocManaged" ||
+                       Callee->getName() == "cudaFree"))
+          Calls.push_back(CI);
+      }
+    }
+    for (auto *CI : Calls)
+      redirectToArena(CI,
+                      CI->getCalledFunction()->getName() == "cudaFree"
+                          ? "penguinNvmeFree"
+                          : "penguinNvmeMallocManaged",
+                      ~0U);
+  }
+
+  // cudaMalloc(Ptr, Size) becomes cudaMallocManaged(Ptr, Size,
+  // cudaMemAttachGlobal) before anything looks for the allocations
+  void convertExplicitAllocations(Module &M) {
+    std::vector<CallBase *> Calls;
+    for (auto &F : M) {
+      if (F.getName().contains("stub") || F.getName().contains("penguin"))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        auto *Callee = CI ? CI->getCalledFunction() : nullptr;
+        if (Callee && Callee->getName() == "cudaMalloc" &&
+            CI->arg_size() == 2)
+          Calls.push_back(CI);
+      }
+    }
+    for (auto *CI : Calls) {
+      LLVMContext &Ctx = CI->getContext();
+      Value *Args[] = {CI->getArgOperand(0), CI->getArgOperand(1),
+                       ConstantInt::get(Type::getInt32Ty(Ctx), 1)};
+      llvm::FunctionCallee ManagedFunc = CI->getModule()->getOrInsertFunction(
+          "cudaMallocManaged", CI->getType(), Args[0]->getType(),
+          Args[1]->getType(), Type::getInt32Ty(Ctx));
+      IRBuilder<> Builder(CI);
+      CallBase *Managed;
+      if (auto *Invoke = dyn_cast<InvokeInst>(CI))
+        Managed = Builder.CreateInvoke(ManagedFunc, Invoke->getNormalDest(),
+                                       Invoke->getUnwindDest(), Args);
+      else
+        Managed = Builder.CreateCall(ManagedFunc, Args);
+      Managed->takeName(CI);
+      CI->replaceAllUsesWith(Managed);
+      CI->eraseFromParent();
+    }
+  }
+
+  // The cudaMemcpy calls go to penguinExplicitMemcpy, which copies to and
+  // from the managed allocations on the host or, for what is pinned, on the
+  // GPU
+  void redirectExplicitCopies(Module &M) {
+    std::vector<CallBase *> Calls;
+    for (auto &F : M) {
+      if (F.getName().contains("stub") || F.getName().contains("penguin"))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        auto *Callee = CI ? CI->getCalledFunction() : nullptr;
+        if (Callee && Callee->getName() == "cudaMemcpy")
+          Calls.push_back(CI);
+      }
+    }
+    for (auto *CI : Calls)
+      redirectToArena(CI, "penguinExplicitMemcpy", ~0U);
+  }
+
+  unsigned arenaSite(CallBase *CI) {
+    Function *F = CI->getParent()->getParent();
+    uint32_t H = 0x811c9dc5;
+    for (char C : F->getName()) {
+      H = (H ^ (unsigned char)C) * 0x01000193;
+    }
+    unsigned Position = 0;
+    for (auto &I : instructions(F)) {
+      if (&I == CI) {
+        break;
+      }
+      if (auto *Call = dyn_cast<CallBase>(&I)) {
+        auto *Callee = Call->getCalledFunction();
+        Position += Callee && Callee->getName() == "cudaMallocManaged";
+      }
+    }
+    H = (H ^ Position) * 0x01000193;
+    // ~0U is the runtime's unknown site
+    return H == ~0U ? 0 : H;
+  }
+
   void insertCodeToAddAccessCount(Instruction *Location, unsigned aid, Value *P, Value *S) {
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
@@ -2472,11 +3129,12 @@ struct DynamicHostTransform : public ModulePass {
     IRBuilder<> Builder(CI);
     /* V->getType()->dump(); */
     llvm::Value *AID = Builder.getInt32(aid);
-    Value *Args[] = {AID, ac};
+    // the runtime counts in 64 bits, as insertCodeToAddAccessCount declares it
+    Value *Args[] = {AID, Builder.CreateZExtOrTrunc(ac, Builder.getInt64Ty())};
     // Builder.CreateCall(Fn, Args);
     llvm::FunctionCallee AddACToAID = F->getParent()->getOrInsertFunction(
         "add_aid_ac_map", Type::getVoidTy(Ctx), Type::getInt32Ty(Ctx),
-        Type::getInt32Ty(Ctx));
+        Type::getInt64Ty(Ctx));
     Builder.CreateCall(AddACToAID, Args);
     return;
   }
@@ -2600,10 +3258,11 @@ struct DynamicHostTransform : public ModulePass {
     /* V->getType()->dump(); */
     // Builder.CreateCall(Fn, Args);
     llvm::Value *AID = Builder.getInt32(aid);
-    Value *Args[] = {AID, wss};
+    // working sets past 4GB don't fit the 32 bits of the estimate
+    Value *Args[] = {AID, Builder.CreateZExtOrTrunc(wss, Builder.getInt64Ty())};
     llvm::FunctionCallee AddWSS = F->getParent()->getOrInsertFunction(
         "add_aid_wss_map_iterdep", Type::getVoidTy(Ctx), Type::getInt32Ty(Ctx),
-        Type::getInt32Ty(Ctx));
+        Type::getInt64Ty(Ctx));
     Builder.CreateCall(AddWSS, Args);
     // llvm::FunctionCallee PrintAllocFunc = F->getParent()->getOrInsertFunction(
     //     "print_aid_wss_map_iterdep", Type::getVoidTy(Ctx));
@@ -2612,45 +3271,1936 @@ struct DynamicHostTransform : public ModulePass {
     return;
   }
 
-  void insertCodeToAddAIDToInvocationID(Instruction *Location, unsigned aid,
-                                        unsigned invid) {
-    Function *F = Location->getParent()->getParent();
+  void insertCodeToAddAIDToInvocationID(Instruction *Location, unsigned aid,
+                                        unsigned invid) {
+    Function *F = Location->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(Location);
+    /* V->getType()->dump(); */
+    // Builder.CreateCall(Fn, Args);
+    llvm::Value *AID = Builder.getInt32(aid);
+    llvm::Value *INVID = Builder.getInt32(invid);
+    Value *Args[] = {AID, INVID};
+    llvm::FunctionCallee AddAIDToInvocationID = F->getParent()->getOrInsertFunction(
+        "add_aid_invocation_map", Type::getVoidTy(Ctx), Type::getInt32Ty(Ctx),
+        Type::getInt32Ty(Ctx));
+    Builder.CreateCall(AddAIDToInvocationID, Args);
+    // llvm::FunctionCallee PrintAllocFunc =
+    // F->getParent()->getOrInsertFunction(
+    //     "print_aid_wss_map_iterdep", Type::getVoidTy(Ctx));
+    // ArrayRef<Value *> PrintArgs = {};
+    // Builder.CreateCall(PrintAllocFunc, PrintArgs);
+    return;
+  }
+
+  void insertCodeToProcessWSS_iterdep(Instruction* Location) {
+    Function *F = Location->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(Location);
+    /* V->getType()->dump(); */
+    // Builder.CreateCall(Fn, Args);
+    llvm::FunctionCallee ProcessWSS_iter = F->getParent()->getOrInsertFunction(
+        "process_iterdep_access", Type::getVoidTy(Ctx));
+    ArrayRef<Value *> Args = {};
+    Builder.CreateCall(ProcessWSS_iter, Args);
+    return;
+  }
+
+  // Tells the runtime which stream the launch goes on, ahead of the calls
+  // that plan it; the default stream if it isn't known
+  void insertCodeToSetLaunchStream(Instruction *Location, CallBase *CI) {
+    Function *F = Location->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(Location);
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    Value *Stream = Constant::getNullValue(Int8PtrTy);
+    auto S = KernelInvocationToStreamValueMap.find(CI);
+    if (S != KernelInvocationToStreamValueMap.end() &&
+        S->second->getType()->isPointerTy())
+      Stream = Builder.CreateBitCast(S->second, Int8PtrTy);
+    llvm::FunctionCallee SetStreamFn = F->getParent()->getOrInsertFunction(
+        "penguinSetLaunchStream", Type::getVoidTy(Ctx), Int8PtrTy);
+    Builder.CreateCall(SetStreamFn, {Stream});
+  }
+
+  // Brackets the launch with penguinKernelBegin/End, which time the kernel
+  // on its stream while the runtime collects statistics
+  void insertCodeToTimeKernel(CallBase *CI) {
+    Function *F = CI->getParent()->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(CI);
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    Value *Stream = Constant::getNullValue(Int8PtrTy);
+    auto S = KernelInvocationToStreamValueMap.find(CI);
+    if (S != KernelInvocationToStreamValueMap.end() &&
+        S->second->getType()->isPointerTy())
+      Stream = Builder.CreateBitCast(S->second, Int8PtrTy);
+    llvm::FunctionCallee BeginFn = F->getParent()->getOrInsertFunction(
+        "penguinKernelBegin", Type::getVoidTy(Ctx), Int8PtrTy, Int8PtrTy);
+    Builder.CreateCall(BeginFn,
+                       {Builder.CreateBitCast(CI->getArgOperand(0), Int8PtrTy),
+                        Stream});
+    // an invoke ends where it returns normally; the runtime drops an
+    // unmatched begin
+    Instruction *After = CI->getNextNode();
+    if (auto *Invoke = dyn_cast<InvokeInst>(CI)) {
+      BasicBlock *Normal = Invoke->getNormalDest();
+      After = Normal->getSinglePredecessor() ? &*Normal->getFirstInsertionPt()
+                                             : nullptr;
+    }
+    if (!After)
+      return;
+    IRBuilder<> EndBuilder(After);
+    llvm::FunctionCallee EndFn = F->getParent()->getOrInsertFunction(
+        "penguinKernelEnd", Type::getVoidTy(Ctx));
+    EndBuilder.CreateCall(EndFn);
+  }
+
+  // Device copy: a cudaMallocManaged into a local pointer whose value the
+  // host only dereferences before any launch of its function may run or
+  // after they all have, and otherwise only passes to launches and cudaFree
+  struct DeviceCopyCandidate {
+    CallBase *Malloc;
+    std::vector<CallBase *> Frees;
+    // of the pointer into the argument slots of launches
+    std::vector<StoreInst *> ArgumentStores;
+    // where the host reads back, and the pointer it reads through there
+    std::vector<std::pair<Instruction *, Value *>> Readbacks;
+    // the memsets and memcpys that fill it before the launches
+    std::vector<MemIntrinsic *> Initializers;
+  };
+  std::vector<DeviceCopyCandidate> DeviceCopyCandidates;
+  std::map<Function *, bool> FunctionLaunchesKernels;
+
+  bool launchesKernels(Function *F) {
+    if (F->getName().startswith("cudaLaunch") ||
+        F->getName().startswith("cudaGraphLaunch"))
+      return true;
+    if (F->isDeclaration())
+      return false;
+    auto It = FunctionLaunchesKernels.find(F);
+    if (It != FunctionLaunchesKernels.end())
+      return It->second;
+    // recursive calls see no launch until one is found
+    FunctionLaunchesKernels[F] = false;
+    for (auto &I : instructions(*F)) {
+      if (auto *CI = dyn_cast<CallBase>(&I)) {
+        Function *Callee = CI->getCalledFunction();
+        if ((!Callee && !CI->isInlineAsm()) ||
+            (Callee && launchesKernels(Callee)))
+          return FunctionLaunchesKernels[F] = true;
+      }
+    }
+    return false;
+  }
+
+  // With Between, the accesses both before and after some launch go there,
+  // with the pointer each is through, instead of ruling the allocation out
+  bool findDeviceCopyUses(
+      CallBase *Malloc, const std::vector<Instruction *> &Launches,
+      DominatorTree &DT, LoopInfo &LI, DeviceCopyCandidate &C,
+      std::vector<std::pair<Instruction *, Value *>> *Between = nullptr) {
+    auto *Slot =
+        dyn_cast<AllocaInst>(Malloc->getArgOperand(0)->stripPointerCasts());
+    if (!Slot)
+      return false;
+    auto Reaches = [&](Instruction *From, Instruction *To) {
+      return isPotentiallyReachable(From, To, nullptr, &DT, &LI);
+    };
+    // allocated again after a launch
+    for (auto *L : Launches)
+      if (Reaches(L, Malloc))
+        return false;
+    // the loads of the pointer, then what is computed from them, with the
+    // load each comes from
+    std::vector<std::pair<Value *, LoadInst *>> Work;
+    std::set<Value *> Seen;
+    std::vector<Value *> Slots = {Slot};
+    while (!Slots.empty()) {
+      Value *S = Slots.back();
+      Slots.pop_back();
+      for (User *U : S->users()) {
+        if (U == Malloc)
+          continue;
+        if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+          if (II->isLifetimeStartOrEnd())
+            continue;
+          return false;
+        }
+        if (isa<BitCastInst>(U)) {
+          Slots.push_back(U);
+          continue;
+        }
+        auto *Load = dyn_cast<LoadInst>(U);
+        if (!Load || Load->getPointerOperand() != S)
+          return false;
+        Work.push_back({Load, Load});
+      }
+    }
+    std::vector<std::pair<Instruction *, std::pair<Value *, LoadInst *>>>
+        Accesses;
+    while (!Work.empty()) {
+      auto V = Work.back();
+      Work.pop_back();
+      if (!Seen.insert(V.first).second)
+        continue;
+      for (User *U : V.first->users()) {
+        auto *I = dyn_cast<Instruction>(U);
+        if (!I)
+          return false;
+        if (isa<LoadInst>(I)) {
+          Accesses.push_back({I, V});
+        } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+          if (SI->getPointerOperand() == V.first)
+            Accesses.push_back({I, V});
+          else if (isa<AllocaInst>(
+                       SI->getPointerOperand()->stripPointerCasts()) &&
+                   isLaunchArgumentSlot(
+                       SI->getPointerOperand()->stripPointerCasts()))
+            C.ArgumentStores.push_back(SI);
+          else
+            return false;
+        } else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) ||
+                   isa<PHINode>(I) || isa<SelectInst>(I)) {
+          Work.push_back({I, V.second});
+        } else if (isa<ICmpInst>(I)) {
+          continue;
+        } else if (auto *CI = dyn_cast<CallBase>(I)) {
+          Function *Callee = CI->getCalledFunction();
+          if (!Callee)
+            return false;
+          StringRef Name = Callee->getName();
+          if (auto *II = dyn_cast<IntrinsicInst>(CI)) {
+            if (II->isLifetimeStartOrEnd())
+              continue;
+            if (!isa<MemIntrinsic>(II))
+              return false;
+            Accesses.push_back({I, V});
+          } else if (Name == "cudaFree" && CI->getArgOperand(0) == V.first) {
+            C.Frees.push_back(CI);
+          } else if (Name.startswith("cudaMemcpy") ||
+                     Name.startswith("cudaMemset")) {
+            Accesses.push_back({I, V});
+          } else {
+            return false;
+          }
+        } else {
+          return false;
+        }
+      }
+    }
+    if (C.ArgumentStores.empty())
+      return false;
+    std::set<Instruction *> Points;
+    for (auto &A : Accesses) {
+      bool AfterLaunch = false, BeforeLaunch = false;
+      for (auto *L : Launches) {
+        AfterLaunch |= Reaches(L, A.first);
+        BeforeLaunch |= Reaches(A.first, L);
+      }
+      if (AfterLaunch && BeforeLaunch) {
+        if (!Between)
+          return false;
+        Between->push_back({A.first, A.second.first});
+        continue;
+      }
+      if (!AfterLaunch) {
+        auto *Mem = dyn_cast<MemIntrinsic>(A.first);
+        if (Mem && !Mem->isVolatile() && Mem->getRawDest() == A.second.first)
+          C.Initializers.push_back(Mem);
+        continue;
+      }
+      // once before the outermost loop around the read, which has no launch
+      // in it
+      Instruction *Point = A.first;
+      Value *Pointer = A.second.first;
+      Loop *L = LI.getLoopFor(A.first->getParent());
+      while (L && L->getParentLoop())
+        L = L->getParentLoop();
+      if (L && L->getLoopPreheader() &&
+          DT.dominates(A.second.second, L->getLoopPreheader()->getTerminator())) {
+        Point = L->getLoopPreheader()->getTerminator();
+        Pointer = A.second.second;
+      }
+      if (Points.insert(Point).second)
+        C.Readbacks.push_back({Point, Pointer});
+    }
+    C.Malloc = Malloc;
+    return true;
+  }
+
+  // The cudaMallocManaged calls of F and the calls that may launch kernels,
+  // false if there are none of either
+  bool findManagedAllocations(Function &F, std::vector<Instruction *> &Launches,
+                              std::vector<CallBase *> &Mallocs) {
+    for (auto &I : instructions(F)) {
+      auto *CI = dyn_cast<CallBase>(&I);
+      if (!CI || CI->isInlineAsm() || isa<IntrinsicInst>(CI))
+        continue;
+      Function *Callee = CI->getCalledFunction();
+      if (Callee && Callee->getName() == "cudaMallocManaged")
+        Mallocs.push_back(CI);
+      else if (!Callee || launchesKernels(Callee))
+        Launches.push_back(CI);
+    }
+    return !Mallocs.empty() && !Launches.empty();
+  }
+
+  // Before any instrumentation, which adds uses of the pointers
+  void findDeviceCopyCandidates(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      std::vector<Instruction *> Launches;
+      std::vector<CallBase *> Mallocs;
+      if (!findManagedAllocations(F, Launches, Mallocs))
+        continue;
+      DominatorTree DT(F);
+      LoopInfo &LI = GetLI(F);
+      for (auto *Malloc : Mallocs) {
+        DeviceCopyCandidate C;
+        if (findDeviceCopyUses(Malloc, Launches, DT, LI, C)) {
+          LLVM_DEBUG(dbgs() << "device copy candidate\n");
+          LLVM_DEBUG(Malloc->dump());
+          DeviceCopyCandidates.push_back(C);
+        }
+      }
+    }
+  }
+
+  // The runtime decides which candidates get a device copy: their launches
+  // get the pointer through penguinDevicePointer, and the host syncs the
+  // buffer before reading it back
+  void insertCodeForDeviceCopies() {
+    for (auto &C : DeviceCopyCandidates) {
+      Module &M = *C.Malloc->getModule();
+      LLVMContext &Ctx = M.getContext();
+      auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+      C.Malloc->setCalledFunction(M.getOrInsertFunction(
+          "penguinDeviceCopyMalloc", C.Malloc->getFunctionType()));
+      for (auto *Free : C.Frees)
+        Free->setCalledFunction(M.getOrInsertFunction(
+            "penguinDeviceCopyFree", Free->getFunctionType()));
+      llvm::FunctionCallee PointerFn = M.getOrInsertFunction(
+          "penguinDevicePointer", Int8PtrTy, Int8PtrTy);
+      for (auto *SI : C.ArgumentStores) {
+        IRBuilder<> Builder(SI);
+        Value *Host = SI->getValueOperand();
+        Value *Device = Builder.CreateCall(
+            PointerFn, {Builder.CreateBitCast(Host, Int8PtrTy)});
+        SI->setOperand(0, Builder.CreateBitCast(Device, Host->getType()));
+      }
+      llvm::FunctionCallee SyncFn = M.getOrInsertFunction(
+          "penguinDeviceCopySync", Type::getVoidTy(Ctx), Int8PtrTy);
+      for (auto &R : C.Readbacks) {
+        IRBuilder<> Builder(R.first);
+        Builder.CreateCall(SyncFn, {Builder.CreateBitCast(R.second, Int8PtrTy)});
+      }
+    }
+  }
+
+  // Readback prefetch: the allocations of the device copy analysis the host
+  // reads back after the launches, with the points right after the last
+  // launches before the reads, or the exits of the outermost loop around
+  // such a launch, where the runtime may bring them back in bulk
+  struct ReadbackCandidate {
+    AllocaInst *Slot;
+    std::vector<Instruction *> Points;
+  };
+  std::vector<ReadbackCandidate> ReadbackCandidates;
+
+  // Where to prefetch after launch L, if no other launch may follow it
+  bool findReadbackPoints(Instruction *L,
+                          const std::vector<Instruction *> &Launches,
+                          DominatorTree &DT, LoopInfo &LI,
+                          std::vector<Instruction *> &Points) {
+    Loop *Outer = LI.getLoopFor(L->getParent());
+    while (Outer && Outer->getParentLoop())
+      Outer = Outer->getParentLoop();
+    for (auto *Other : Launches)
+      if (Other != L && !(Outer && Outer->contains(Other)) &&
+          isPotentiallyReachable(L, Other, nullptr, &DT, &LI))
+        return false;
+    if (!Outer) {
+      Instruction *After = L->getNextNode();
+      if (auto *Invoke = dyn_cast<InvokeInst>(L)) {
+        BasicBlock *Normal = Invoke->getNormalDest();
+        After = Normal->getSinglePredecessor()
+                    ? &*Normal->getFirstInsertionPt()
+                    : nullptr;
+      }
+      if (!After)
+        return false;
+      Points.push_back(After);
+      return true;
+    }
+    if (!Outer->hasDedicatedExits())
+      return false;
+    SmallVector<BasicBlock *, 4> Exits;
+    Outer->getUniqueExitBlocks(Exits);
+    for (BasicBlock *Exit : Exits)
+      Points.push_back(&*Exit->getFirstInsertionPt());
+    return true;
+  }
+
+  // Before any instrumentation, like findDeviceCopyCandidates
+  void findReadbackPrefetches(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      std::vector<Instruction *> Launches;
+      std::vector<CallBase *> Mallocs;
+      if (!findManagedAllocations(F, Launches, Mallocs))
+        continue;
+      DominatorTree DT(F);
+      LoopInfo &LI = GetLI(F);
+      for (auto *Malloc : Mallocs) {
+        DeviceCopyCandidate C;
+        if (!findDeviceCopyUses(Malloc, Launches, DT, LI, C) ||
+            C.Readbacks.empty())
+          continue;
+        ReadbackCandidate R;
+        R.Slot =
+            cast<AllocaInst>(Malloc->getArgOperand(0)->stripPointerCasts());
+        std::set<Instruction *> Seen;
+        for (auto *L : Launches) {
+          bool Read = false;
+          for (auto &Readback : C.Readbacks)
+            Read |= isPotentiallyReachable(L, Readback.first, nullptr, &DT,
+                                           &LI);
+          std::vector<Instruction *> Points;
+          if (!Read || !findReadbackPoints(L, Launches, DT, LI, Points))
+            continue;
+          for (auto *Point : Points) {
+            bool Freed = false;
+            for (auto *Free : C.Frees)
+              Freed |= isPotentiallyReachable(Free, Point, nullptr, &DT, &LI);
+            if (!Freed && DT.dominates(Malloc, Point) &&
+                Seen.insert(Point).second)
+              R.Points.push_back(Point);
+          }
+        }
+        if (R.Points.empty())
+          continue;
+        LLVM_DEBUG(dbgs() << "readback prefetch at " << R.Points.size()
+                          << " points\n");
+        LLVM_DEBUG(Malloc->dump());
+        ReadbackCandidates.push_back(R);
+      }
+    }
+  }
+
+  // penguinReadbackPrefetch with the pointer in the slot at each point
+  void insertCodeForReadbackPrefetches(Module &M) {
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    llvm::FunctionCallee PrefetchFn = M.getOrInsertFunction(
+        "penguinReadbackPrefetch", Type::getVoidTy(Ctx), Int8PtrTy);
+    for (auto &R : ReadbackCandidates) {
+      for (auto *Point : R.Points) {
+        IRBuilder<> Builder(Point);
+        Value *Slot = Builder.CreateBitCast(R.Slot, Int8PtrTy->getPointerTo());
+        Builder.CreateCall(PrefetchFn, {Builder.CreateLoad(Int8PtrTy, Slot)});
+      }
+    }
+  }
+
+  // First touch: the memsets and memcpys that fill a managed allocation of
+  // the device copy analysis before any launch, which the runtime may do on
+  // the GPU when it knows the allocation is going to be pinned there
+  std::vector<MemIntrinsic *> FirstTouchInitializers;
+
+  // Before any instrumentation, like findDeviceCopyCandidates
+  void findFirstTouchInitializers(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      std::vector<Instruction *> Launches;
+      std::vector<CallBase *> Mallocs;
+      if (!findManagedAllocations(F, Launches, Mallocs))
+        continue;
+      DominatorTree DT(F);
+      LoopInfo &LI = GetLI(F);
+      for (auto *Malloc : Mallocs) {
+        DeviceCopyCandidate C;
+        if (!findDeviceCopyUses(Malloc, Launches, DT, LI, C))
+          continue;
+        for (auto *Mem : C.Initializers)
+          if (isa<MemSetInst>(Mem) || isa<MemCpyInst>(Mem))
+            FirstTouchInitializers.push_back(Mem);
+      }
+    }
+  }
+
+  // penguinFirstTouchMemset(dst, value, length) and
+  // penguinFirstTouchMemcpy(dst, src, length) instead of the intrinsics
+  void insertCodeForFirstTouch(Module &M) {
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    llvm::FunctionCallee MemsetFn =
+        M.getOrInsertFunction("penguinFirstTouchMemset", Type::getVoidTy(Ctx),
+                              Int8PtrTy, Int32Ty, Int64Ty);
+    llvm::FunctionCallee MemcpyFn =
+        M.getOrInsertFunction("penguinFirstTouchMemcpy", Type::getVoidTy(Ctx),
+                              Int8PtrTy, Int8PtrTy, Int64Ty);
+    std::set<MemIntrinsic *> Done;
+    for (auto *Mem : FirstTouchInitializers) {
+      if (!Done.insert(Mem).second)
+        continue;
+      LLVM_DEBUG(dbgs() << "first touch of ");
+      LLVM_DEBUG(Mem->dump());
+      IRBuilder<> Builder(Mem);
+      Value *Dest = Builder.CreateBitCast(Mem->getRawDest(), Int8PtrTy);
+      Value *Length = Builder.CreateZExtOrTrunc(Mem->getLength(), Int64Ty);
+      if (auto *Set = dyn_cast<MemSetInst>(Mem))
+        Builder.CreateCall(
+            MemsetFn,
+            {Dest, Builder.CreateZExt(Set->getValue(), Int32Ty), Length});
+      else
+        Builder.CreateCall(
+            MemcpyFn,
+            {Dest,
+             Builder.CreateBitCast(cast<MemCpyInst>(Mem)->getRawSource(),
+                                   Int8PtrTy),
+             Length});
+      Mem->eraseFromParent();
+    }
+  }
+
+  // Ping-pong: the host accesses of an allocation of the device copy analysis
+  // between its launches, each of which may bring it back from the GPU. The
+  // runtime gets the region the host touches through penguinHostAccess
+  // before the outermost loop around the access that launches nothing, or
+  // at the access outside such loops: the span of the access over the
+  // iterations of those loops where SCEV has it, the whole allocation where
+  // it hasn't.
+
+  // The bytes a load or store I accesses, 0 for other accesses
+  uint64_t hostAccessSize(Instruction *I) {
+    const DataLayout &DL = I->getModule()->getDataLayout();
+    if (auto *Load = dyn_cast<LoadInst>(I))
+      return DL.getTypeStoreSize(Load->getType());
+    if (auto *Store = dyn_cast<StoreInst>(I))
+      return DL.getTypeStoreSize(Store->getValueOperand()->getType());
+    return 0;
+  }
+
+  // The bytes the access I touches, computed before it; null if not known
+  Value *hostAccessBytes(Instruction *I, IRBuilder<> &Builder) {
+    auto *Int64Ty = Builder.getInt64Ty();
+    if (uint64_t Size = hostAccessSize(I))
+      return ConstantInt::get(Int64Ty, Size);
+    if (auto *Mem = dyn_cast<MemIntrinsic>(I))
+      return Builder.CreateZExtOrTrunc(Mem->getLength(), Int64Ty);
+    // cudaMemcpy(dst, src, count, ...) and cudaMemset(dst, value, count)
+    auto *CI = cast<CallBase>(I);
+    if (CI->arg_size() < 3 || !CI->getArgOperand(2)->getType()->isIntegerTy())
+      return nullptr;
+    return Builder.CreateZExtOrTrunc(CI->getArgOperand(2), Int64Ty);
+  }
+
+  // Start and length of what the access through Ptr, of Size bytes, touches
+  // over the iterations of Outer and the loops in it, when they don't vary
+  // in Outer
+  bool hostAccessSpan(Value *Ptr, uint64_t Size, Loop *Outer,
+                      ScalarEvolution &SE, const SCEV *&Start,
+                      const SCEV *&Bytes) {
+    Type *IntTy = SE.getEffectiveSCEVType(Ptr->getType());
+    const SCEV *S = SE.getSCEV(Ptr);
+    const SCEV *Extent = SE.getConstant(IntTy, Size);
+    while (auto *AddRec = dyn_cast<SCEVAddRecExpr>(S)) {
+      if (!Outer->contains(AddRec->getLoop()) || !AddRec->isAffine())
+        return false;
+      auto *Step = dyn_cast<SCEVConstant>(AddRec->getStepRecurrence(SE));
+      const SCEV *Taken = SE.getBackedgeTakenCount(AddRec->getLoop());
+      if (!Step || isa<SCEVCouldNotCompute>(Taken))
+        return false;
+      const SCEV *Span = SE.getMulExpr(
+          SE.getConstant(IntTy, Step->getAPInt().abs().getZExtValue()),
+          SE.getTruncateOrZeroExtend(Taken, IntTy));
+      S = AddRec->getStart();
+      if (Step->getAPInt().isNegative())
+        S = SE.getAddExpr(S, SE.getNegativeSCEV(Span));
+      Extent = SE.getAddExpr(Extent, Span);
+    }
+    if (!SE.isLoopInvariant(S, Outer) || !SE.isLoopInvariant(Extent, Outer))
+      return false;
+    Start = S;
+    Bytes = Extent;
+    return true;
+  }
+
+  // After the other analyses of the pointers, as it adds uses of them
+  void instrumentHostAccesses(Module &M) {
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    llvm::FunctionCallee AccessFn = M.getOrInsertFunction(
+        "penguinHostAccess", Type::getVoidTy(Ctx), Int8PtrTy, Int64Ty);
+    const DataLayout &DL = M.getDataLayout();
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      std::vector<Instruction *> Launches;
+      std::vector<CallBase *> Mallocs;
+      if (!findManagedAllocations(F, Launches, Mallocs))
+        continue;
+      DominatorTree DT(F);
+      LoopInfo &LI = GetLI(F);
+      ScalarEvolution &SE = GetSE(F);
+      // where, and the region or, without one, the slot of the allocation
+      struct HostAccessCall {
+        Instruction *Point;
+        Value *Start;
+        Value *Bytes;
+        AllocaInst *Slot;
+      };
+      std::vector<HostAccessCall> Calls;
+      for (auto *Malloc : Mallocs) {
+        DeviceCopyCandidate C;
+        std::vector<std::pair<Instruction *, Value *>> Between;
+        if (!findDeviceCopyUses(Malloc, Launches, DT, LI, C, &Between) ||
+            Between.empty())
+          continue;
+        auto *Slot =
+            cast<AllocaInst>(Malloc->getArgOperand(0)->stripPointerCasts());
+        std::set<Instruction *> Whole;
+        for (auto &A : Between) {
+          Loop *Outer = nullptr;
+          for (Loop *L = LI.getLoopFor(A.first->getParent()); L;
+               L = L->getParentLoop()) {
+            bool Launching = false;
+            for (auto *Launch : Launches)
+              Launching |= L->contains(Launch);
+            if (Launching)
+              break;
+            Outer = L;
+          }
+          Instruction *Point = A.first;
+          Value *Start = nullptr, *Bytes = nullptr;
+          if (!Outer) {
+            IRBuilder<> Builder(Point);
+            Bytes = hostAccessBytes(A.first, Builder);
+            Start = Bytes ? A.second : nullptr;
+          } else {
+            // loop-simplify gives the loops of the pipeline one
+            if (!Outer->getLoopPreheader())
+              continue;
+            Point = Outer->getLoopPreheader()->getTerminator();
+            const SCEV *S, *N;
+            SCEVExpander Expander(SE, DL, "penguin.host");
+            uint64_t Size = hostAccessSize(A.first);
+            if (Size && hostAccessSpan(A.second, Size, Outer, SE, S, N) &&
+                Expander.isSafeToExpandAt(S, Point) &&
+                Expander.isSafeToExpandAt(N, Point)) {
+              Start = Expander.expandCodeFor(S, Int8PtrTy, Point);
+              Bytes = Expander.expandCodeFor(N, Int64Ty, Point);
+            }
+          }
+          if (Start || Whole.insert(Point).second)
+            Calls.push_back({Point, Start, Bytes, Slot});
+        }
+      }
+      // the expansions are done before any call goes in
+      for (auto &Call : Calls) {
+        IRBuilder<> Builder(Call.Point);
+        Value *Start = Call.Start, *Bytes = Call.Bytes;
+        // 0 bytes from the allocation's pointer is all of it
+        if (!Start) {
+          Start = Builder.CreateLoad(
+              Int8PtrTy,
+              Builder.CreateBitCast(Call.Slot, Int8PtrTy->getPointerTo()));
+          Bytes = ConstantInt::get(Int64Ty, 0);
+        }
+        LLVM_DEBUG(dbgs() << "host access at ");
+        LLVM_DEBUG(Call.Point->dump());
+        Builder.CreateCall(AccessFn,
+                           {Builder.CreateBitCast(Start, Int8PtrTy), Bytes});
+      }
+    }
+  }
+
+  // The launches and argument positions a pointer stored into a launch
+  // argument slot goes to; false if one of them isn't a cudaLaunchKernel
+  bool findLaunchArguments(StoreInst *SI,
+                           std::vector<std::pair<CallBase *, int>> &Uses) {
+    std::vector<Value *> Slots = {SI->getPointerOperand()->stripPointerCasts()};
+    while (!Slots.empty()) {
+      Value *Slot = Slots.back();
+      Slots.pop_back();
+      for (User *U : Slot->users()) {
+        if (isa<BitCastInst>(U)) {
+          Slots.push_back(U);
+          continue;
+        }
+        auto *Store = dyn_cast<StoreInst>(U);
+        if (!Store || Store->getValueOperand() != Slot)
+          continue;
+        int Position = findKernelStructLocationForStoreInstruction(Store);
+        Value *Array = getUnderlyingObject(Store->getPointerOperand());
+        bool Launched = false;
+        for (User *AU : Array->users()) {
+          std::vector<User *> Launches = {AU};
+          if (isa<BitCastInst>(AU))
+            Launches.assign(AU->user_begin(), AU->user_end());
+          for (User *L : Launches) {
+            auto *Launch = dyn_cast<CallBase>(L);
+            if (!Launch || !Launch->getCalledFunction() ||
+                Launch->getCalledFunction()->getName() != "cudaLaunchKernel" ||
+                getUnderlyingObject(Launch->getArgOperand(5)) != Array)
+              continue;
+            Uses.push_back({Launch, Position});
+            Launched = true;
+          }
+        }
+        if (Position < 0 || !Launched)
+          return false;
+      }
+    }
+    return !Uses.empty();
+  }
+
+  // Field split: a device copy candidate that every launch it goes to takes
+  // as an argument the metadata lists as split by field, with the same
+  // struct, is registered with the runtime after its cudaMallocManaged,
+  // with the fields any of the kernels load and store. Its launches get the
+  // pointer through penguinFieldSplitPointer and the host syncs it before
+  // reading it back, as for device copies.
+  void insertCodeToSplitFields(Module &M) {
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    // kernel, argument -> struct bytes, loaded, stored, #fields, fields
+    std::map<std::pair<std::string, unsigned>, std::vector<uint32_t>> Split;
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind == cuda_analysis::RK_FieldSplit && R.Fields.size() >= 5 &&
+          R.Fields.size() == 5 + 2 * (size_t)R.Fields[4])
+        Split[{R.Kernel.str(), R.Fields[0]}] =
+            std::vector<uint32_t>(R.Fields.begin() + 1, R.Fields.end());
+    });
+    if (Split.empty())
+      return;
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    for (auto &C : DeviceCopyCandidates) {
+      if (!isa<CallInst>(C.Malloc))
+        continue;
+      std::vector<uint32_t> Layout;
+      uint32_t Loaded = 0, Stored = 0;
+      bool Splittable = true;
+      for (auto *SI : C.ArgumentStores) {
+        std::vector<std::pair<CallBase *, int>> Uses;
+        if (!findLaunchArguments(SI, Uses)) {
+          Splittable = false;
+          break;
+        }
+        for (auto &Use : Uses) {
+          auto *Kernel = dyn_cast<Function>(
+              Use.first->getArgOperand(0)->stripPointerCasts());
+          auto Name = Kernel ? HostSideKernelNameToOriginalNameMap.find(
+                                   std::string(Kernel->getName()))
+                             : HostSideKernelNameToOriginalNameMap.end();
+          auto S = Name == HostSideKernelNameToOriginalNameMap.end()
+                       ? Split.end()
+                       : Split.find({Name->second, (unsigned)Use.second});
+          if (S == Split.end()) {
+            Splittable = false;
+            break;
+          }
+          // the struct bytes, #fields and fields must agree, the masks are
+          // the union
+          std::vector<uint32_t> Fields = S->second;
+          Loaded |= Fields[1];
+          Stored |= Fields[2];
+          Fields[1] = Fields[2] = 0;
+          if (Layout.empty())
+            Layout = Fields;
+          else if (Layout != Fields)
+            Splittable = false;
+        }
+        if (!Splittable)
+          break;
+      }
+      if (!Splittable || Layout.empty())
+        continue;
+      LLVM_DEBUG(dbgs() << "splitting by field\n");
+      LLVM_DEBUG(C.Malloc->dump());
+      // struct bytes, #fields, loaded, stored, then offset and bytes of each
+      std::vector<Constant *> Words = {ConstantInt::get(Int64Ty, Layout[0]),
+                                       ConstantInt::get(Int64Ty, Layout[3]),
+                                       ConstantInt::get(Int64Ty, Loaded),
+                                       ConstantInt::get(Int64Ty, Stored)};
+      for (size_t W = 4; W < Layout.size(); W++)
+        Words.push_back(ConstantInt::get(Int64Ty, Layout[W]));
+      auto *LayoutTy = ArrayType::get(Int64Ty, Words.size());
+      auto *LayoutGV = new GlobalVariable(
+          M, LayoutTy, true, GlobalValue::PrivateLinkage,
+          ConstantArray::get(LayoutTy, Words), "penguin.field.layout");
+      IRBuilder<> Builder(C.Malloc->getNextNode());
+      Value *Slot = Builder.CreateBitCast(C.Malloc->getArgOperand(0),
+                                          Int8PtrTy->getPointerTo());
+      llvm::FunctionCallee RegisterFn = M.getOrInsertFunction(
+          "penguinFieldSplitRegister", Type::getVoidTy(Ctx), Int8PtrTy,
+          Int64Ty->getPointerTo());
+      Builder.CreateCall(RegisterFn,
+                         {Builder.CreateLoad(Int8PtrTy, Slot),
+                          Builder.CreateConstInBoundsGEP2_32(LayoutTy, LayoutGV,
+                                                             0, 0)});
+      llvm::FunctionCallee PointerFn = M.getOrInsertFunction(
+          "penguinFieldSplitPointer", Int8PtrTy, Int8PtrTy);
+      for (auto *SI : C.ArgumentStores) {
+        IRBuilder<> Builder(SI);
+        Value *Host = SI->getValueOperand();
+        Value *Device = Builder.CreateCall(
+            PointerFn, {Builder.CreateBitCast(Host, Int8PtrTy)});
+        SI->setOperand(0, Builder.CreateBitCast(Device, Host->getType()));
+      }
+      llvm::FunctionCallee SyncFn = M.getOrInsertFunction(
+          "penguinFieldSplitSync", Type::getVoidTy(Ctx), Int8PtrTy);
+      for (auto &R : C.Readbacks) {
+        IRBuilder<> Builder(R.first);
+        Builder.CreateCall(SyncFn, {Builder.CreateBitCast(R.second, Int8PtrTy)});
+      }
+    }
+  }
+
+  // Read mostly and write stream: a cudaMallocManaged into a local pointer
+  // whose value the host only dereferences, copies, frees and passes to
+  // launches
+  struct ReadMostlyCandidate {
+    CallBase *Malloc;
+    std::vector<StoreInst *> ArgumentStores;
+  };
+  std::vector<ReadMostlyCandidate> ReadMostlyCandidates;
+
+  bool findReadMostlyUses(CallBase *Malloc, ReadMostlyCandidate &C) {
+    auto *Slot =
+        dyn_cast<AllocaInst>(Malloc->getArgOperand(0)->stripPointerCasts());
+    if (!Slot)
+      return false;
+    std::vector<Value *> Work;
+    std::vector<Value *> Slots = {Slot};
+    while (!Slots.empty()) {
+      Value *S = Slots.back();
+      Slots.pop_back();
+      for (User *U : S->users()) {
+        if (U == Malloc)
+          continue;
+        if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+          if (II->isLifetimeStartOrEnd())
+            continue;
+          return false;
+        }
+        if (isa<BitCastInst>(U)) {
+          Slots.push_back(U);
+          continue;
+        }
+        auto *Load = dyn_cast<LoadInst>(U);
+        if (!Load || Load->getPointerOperand() != S)
+          return false;
+        Work.push_back(Load);
+      }
+    }
+    std::set<Value *> Seen;
+    while (!Work.empty()) {
+      Value *V = Work.back();
+      Work.pop_back();
+      if (!Seen.insert(V).second)
+        continue;
+      for (User *U : V->users()) {
+        auto *I = dyn_cast<Instruction>(U);
+        if (!I)
+          return false;
+        if (isa<LoadInst>(I) || isa<ICmpInst>(I))
+          continue;
+        if (auto *SI = dyn_cast<StoreInst>(I)) {
+          Value *Dest = SI->getPointerOperand()->stripPointerCasts();
+          if (SI->getPointerOperand() == V)
+            continue;
+          if (isa<AllocaInst>(Dest) && isLaunchArgumentSlot(Dest))
+            C.ArgumentStores.push_back(SI);
+          else
+            return false;
+        } else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) ||
+                   isa<PHINode>(I) || isa<SelectInst>(I)) {
+          Work.push_back(I);
+        } else if (auto *CI = dyn_cast<CallBase>(I)) {
+          Function *Callee = CI->getCalledFunction();
+          if (!Callee)
+            return false;
+          StringRef Name = Callee->getName();
+          if (auto *II = dyn_cast<IntrinsicInst>(CI)) {
+            if (!II->isLifetimeStartOrEnd() && !isa<MemIntrinsic>(II))
+              return false;
+          } else if (Name != "cudaFree" && !Name.startswith("cudaMemcpy") &&
+                     !Name.startswith("cudaMemset")) {
+            return false;
+          }
+        } else {
+          return false;
+        }
+      }
+    }
+    C.Malloc = Malloc;
+    return !C.ArgumentStores.empty();
+  }
+
+  // Before any instrumentation, which adds uses of the pointers
+  void findReadMostlyCandidates(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        if (!CI || !CI->getCalledFunction() ||
+            CI->getCalledFunction()->getName() != "cudaMallocManaged")
+          continue;
+        ReadMostlyCandidate C;
+        if (findReadMostlyUses(CI, C))
+          ReadMostlyCandidates.push_back(C);
+      }
+    }
+  }
+
+  // The value of a footprint formula at library call CI, as an i64; nullptr
+  // if it names an argument that isn't an integer
+  Value *insertCodeToEvaluateLibraryFormula(IRBuilder<> &Builder, CallBase *CI,
+                                            const LibraryFormula &Formula) {
+    Value *V = Builder.getInt64(Formula.Constant);
+    for (unsigned Arg : Formula.Args) {
+      if (Arg >= CI->arg_size() ||
+          !CI->getArgOperand(Arg)->getType()->isIntegerTy())
+        return nullptr;
+      V = Builder.CreateMul(
+          V, Builder.CreateZExtOrTrunc(CI->getArgOperand(Arg),
+                                       Builder.getInt64Ty()));
+    }
+    return V;
+  }
+
+  // Plans each call of -penguin-library-footprints like a kernel launch of
+  // its own invocation ID: the records of its pointer arguments, from their
+  // formulas, then the local planner. Library AIDs count down from the top,
+  // out of the way of CudaAnalysis's.
+  void insertCodeForLibraryCalls(Module &M) {
+    const auto &Footprints = getLibraryFootprints();
+    if (Footprints.empty())
+      return;
+    std::vector<std::pair<CallBase *, const std::vector<LibraryFootprint> *>>
+        Calls;
+    for (auto &F : M)
+      for (auto &I : instructions(F))
+        if (auto *CI = dyn_cast<CallBase>(&I))
+          if (auto *Callee = CI->getCalledFunction()) {
+            auto L = Footprints.find(std::string(Callee->getName()));
+            if (L != Footprints.end())
+              Calls.push_back({CI, &L->second});
+          }
+    LLVMContext &Ctx = M.getContext();
+    static unsigned LibraryAID = ~0u;
+    for (auto &Call : Calls) {
+      CallBase *CI = Call.first;
+      IRBuilder<> Builder(CI);
+      std::vector<LaunchRecord> Records;
+      for (const LibraryFootprint &L : *Call.second) {
+        if (L.Arg >= CI->arg_size() ||
+            !CI->getArgOperand(L.Arg)->getType()->isPointerTy())
+          continue;
+        LaunchRecord R = {LibraryAID--, L.Store ? (unsigned)LR_STORE : 0,
+                          CI->getArgOperand(L.Arg), nullptr, nullptr};
+        R.Arg = L.Arg;
+        if (L.Pattern == LibraryFootprint::LF_IRREGULAR) {
+          R.Flags |= LR_INCOMP;
+          Records.push_back(R);
+          continue;
+        }
+        Value *Bytes =
+            L.Bytes.All ? Builder.getInt64(~0ULL)
+                        : insertCodeToEvaluateLibraryFormula(Builder, CI, L.Bytes);
+        if (!Bytes)
+          continue;
+        R.Flags |= LR_WSS;
+        // a stream covers its bytes from the start once, the whole allocation
+        // is what the runtime knows the size of
+        if (L.Pattern == LibraryFootprint::LF_STREAM || L.Bytes.All) {
+          R.Flags |= LR_FOOTPRINT;
+          R.Lo = Builder.getInt64(0);
+          R.Hi = Bytes;
+        } else {
+          R.WSS = Bytes;
+        }
+        if (L.Accesses)
+          R.AC = insertCodeToEvaluateLibraryFormula(Builder, CI, *L.Accesses);
+        else if (!L.Bytes.All)
+          R.AC = Bytes;
+        if (R.AC)
+          R.Flags |= LR_ACCESS;
+        Records.push_back(R);
+      }
+      if (Records.empty())
+        continue;
+      unsigned InvID = KernelInvocationID++;
+      LLVM_DEBUG(dbgs() << "library call of invocation " << InvID << "\n");
+      LLVM_DEBUG(CI->dump());
+      addCodeToAddInvocationID(CI, InvID);
+      // on no stream the runtime knows of, and of no launch shape
+      llvm::FunctionCallee StreamFn = M.getOrInsertFunction(
+          "penguinSetLaunchStream", Type::getVoidTy(Ctx), Type::getInt8PtrTy(Ctx));
+      Builder.CreateCall(StreamFn, {ConstantPointerNull::get(Type::getInt8PtrTy(Ctx))});
+      insertCodeToRecordLaunch(CI, InvID, Records, nullptr,
+                               CI->getCalledFunction()->getName());
+      KernelInvocationToInvocationIDMap[CI] = InvID;
+      insertCodeToPerformInvocationMemoryMgmt(CI, CI, false);
+    }
+  }
+
+  // A candidate every launch of which takes it as an argument the metadata
+  // lists in a record of kind RK, only loaded from or only stored to, is
+  // passed to AdviseName after its cudaMallocManaged
+  void insertCodeForArgumentAdvice(Module &M, cuda_analysis::RecordKind RK,
+                                   StringRef AdviseName) {
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    std::set<std::pair<std::string, unsigned>> Listed;
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind == RK)
+        for (uint32_t Arg : R.Fields)
+          Listed.insert({R.Kernel.str(), Arg});
+    });
+    if (Listed.empty())
+      return;
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    for (auto &C : ReadMostlyCandidates) {
+      if (!isa<CallInst>(C.Malloc))
+        continue;
+      bool Read = true;
+      for (auto *SI : C.ArgumentStores) {
+        std::vector<std::pair<CallBase *, int>> Uses;
+        if (!findLaunchArguments(SI, Uses)) {
+          Read = false;
+          break;
+        }
+        for (auto &Use : Uses) {
+          auto *Kernel = dyn_cast<Function>(
+              Use.first->getArgOperand(0)->stripPointerCasts());
+          auto Name = Kernel ? HostSideKernelNameToOriginalNameMap.find(
+                                   std::string(Kernel->getName()))
+                             : HostSideKernelNameToOriginalNameMap.end();
+          if (Name == HostSideKernelNameToOriginalNameMap.end() ||
+              !Listed.count({Name->second, (unsigned)Use.second}))
+            Read = false;
+        }
+        if (!Read)
+          break;
+      }
+      if (!Read)
+        continue;
+      LLVM_DEBUG(dbgs() << AdviseName << "\n");
+      LLVM_DEBUG(C.Malloc->dump());
+      IRBuilder<> Builder(C.Malloc->getNextNode());
+      Value *Slot = Builder.CreateBitCast(C.Malloc->getArgOperand(0),
+                                          Int8PtrTy->getPointerTo());
+      llvm::FunctionCallee AdviseFn = M.getOrInsertFunction(
+          AdviseName, Type::getVoidTy(Ctx), Int8PtrTy);
+      Builder.CreateCall(AdviseFn, {Builder.CreateLoad(Int8PtrTy, Slot)});
+    }
+  }
+
+  // Kernel fusion: two cudaLaunchKernel calls in a block with only the setup
+  // of the second between them, which leaves the first's arguments alone
+  struct FusionCandidate {
+    CallInst *First;
+    CallInst *Second;
+    // of the first's argument array and slots, which move after the second
+    std::vector<IntrinsicInst *> LifetimeEnds;
+  };
+  std::vector<FusionCandidate> FusionCandidates;
+
+  static bool isKernelLaunch(Instruction *I) {
+    auto *CI = dyn_cast<CallInst>(I);
+    return CI && CI->getCalledFunction() &&
+           CI->getCalledFunction()->getName() == "cudaLaunchKernel" &&
+           isa<Function>(CI->getArgOperand(0)->stripPointerCasts()) &&
+           CI->use_empty();
+  }
+
+  bool findFusionSetup(CallInst *First, CallInst *Second, FusionCandidate &C) {
+    // the argument array of the first launch and the slots it points to
+    std::set<Value *> Arguments;
+    Value *Array = getUnderlyingObject(First->getArgOperand(5));
+    if (!isa<AllocaInst>(Array))
+      return false;
+    Arguments.insert(Array);
+    for (auto &I : *First->getParent()) {
+      auto *SI = dyn_cast<StoreInst>(&I);
+      if (SI && getUnderlyingObject(SI->getPointerOperand()) == Array)
+        Arguments.insert(getUnderlyingObject(SI->getValueOperand()));
+    }
+    for (Instruction *I = First->getNextNode(); I != Second;
+         I = I->getNextNode()) {
+      if (auto *SI = dyn_cast<StoreInst>(I)) {
+        Value *Object = getUnderlyingObject(SI->getPointerOperand());
+        if (SI->isVolatile() || !isa<AllocaInst>(Object) ||
+            Arguments.count(Object))
+          return false;
+        continue;
+      }
+      if (auto *LI = dyn_cast<LoadInst>(I)) {
+        Value *Object = getUnderlyingObject(LI->getPointerOperand());
+        auto *GV = dyn_cast<GlobalVariable>(Object);
+        if (LI->isVolatile() ||
+            !(isa<AllocaInst>(Object) || (GV && GV->isConstant())))
+          return false;
+        continue;
+      }
+      if (auto *II = dyn_cast<IntrinsicInst>(I)) {
+        if (isa<DbgInfoIntrinsic>(II))
+          continue;
+        if (II->isLifetimeStartOrEnd()) {
+          bool Argument =
+              Arguments.count(getUnderlyingObject(II->getArgOperand(1)));
+          if (Argument && II->getIntrinsicID() == Intrinsic::lifetime_start)
+            return false;
+          if (Argument)
+            C.LifetimeEnds.push_back(II);
+          continue;
+        }
+        auto *Mem = dyn_cast<MemIntrinsic>(II);
+        if (!Mem || Mem->isVolatile())
+          return false;
+        Value *Object = getUnderlyingObject(Mem->getRawDest());
+        if (!isa<AllocaInst>(Object) || Arguments.count(Object))
+          return false;
+        if (auto *Transfer = dyn_cast<MemTransferInst>(Mem))
+          if (!isa<AllocaInst>(getUnderlyingObject(Transfer->getRawSource())))
+            return false;
+        continue;
+      }
+      if (auto *CI = dyn_cast<CallBase>(I)) {
+        Function *Callee = CI->getCalledFunction();
+        if (Callee && (Callee->getName() == "__cudaPushCallConfiguration" ||
+                       Callee->getName() == "__cudaPopCallConfiguration"))
+          continue;
+        return false;
+      }
+      if (I->mayHaveSideEffects() || I->mayReadFromMemory())
+        return false;
+    }
+    C.First = First;
+    C.Second = Second;
+    return true;
+  }
+
+  // Before any instrumentation, which runs between the launches
+  void findFusionCandidates(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      for (auto &BB : F) {
+        CallInst *Last = nullptr;
+        for (auto &I : BB) {
+          if (!isKernelLaunch(&I)) {
+            if (isa<CallBase>(I) && !isa<IntrinsicInst>(I) && Last) {
+              auto *Callee = cast<CallBase>(I).getCalledFunction();
+              if (!Callee ||
+                  (Callee->getName() != "__cudaPushCallConfiguration" &&
+                   Callee->getName() != "__cudaPopCallConfiguration"))
+                Last = nullptr;
+            }
+            continue;
+          }
+          FusionCandidate C;
+          if (Last && findFusionSetup(Last, cast<CallInst>(&I), C)) {
+            FusionCandidates.push_back(C);
+            // a launch goes into one pair
+            Last = nullptr;
+          } else {
+            Last = cast<CallInst>(&I);
+          }
+        }
+      }
+    }
+  }
+
+  // A candidate whose kernels the metadata lists as a pair is launched
+  // through penguinLaunchKernelFused with the operands of both launches, the
+  // fused kernel, which the module registers with a stub of its own, and its
+  // layout: the parameters of each kernel, the arguments each loads and
+  // stores, and whether they take the sub-grid parameter.
+  void insertCodeToFuseKernels(Module &M) {
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    struct Pair {
+      std::vector<uint32_t> Fields;
+      std::string Fused;
+    };
+    std::map<std::pair<std::string, std::string>, Pair> Pairs;
+    std::set<std::string> SplitKernels;
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind == cuda_analysis::RK_KernelFusion && R.Fields.size() >= 7 &&
+          R.Tokens.size() >= 2)
+        Pairs[{R.Kernel.str(), Metadata.string(R.Tokens[0]).str()}] = {
+            std::vector<uint32_t>(R.Fields.begin(), R.Fields.end()),
+            Metadata.string(R.Tokens[1]).str()};
+      if (R.Kind == cuda_analysis::RK_GridSplit)
+        SplitKernels.insert(R.Kernel.str());
+    });
+    if (Pairs.empty())
+      return;
+    // the registrations of the stubs, in the module constructor
+    std::map<Function *, CallBase *> Registrations;
+    for (auto &F : M) {
+      if (!F.getName().contains("__cuda_register_globals"))
+        continue;
+      for (auto &I : instructions(F)) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        if (CI && CI->getCalledFunction() &&
+            CI->getCalledFunction()->getName() == "__cudaRegisterFunction")
+          if (auto *Stub = dyn_cast<Function>(
+                  CI->getArgOperand(1)->stripPointerCasts()))
+            Registrations[Stub] = CI;
+      }
+    }
+    LLVMContext &Ctx = M.getContext();
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    std::map<std::string, Function *> FusedStubs;
+    for (auto &C : FusionCandidates) {
+      auto *FirstStub =
+          cast<Function>(C.First->getArgOperand(0)->stripPointerCasts());
+      auto *SecondStub =
+          cast<Function>(C.Second->getArgOperand(0)->stripPointerCasts());
+      auto FirstName = HostSideKernelNameToOriginalNameMap.find(
+          std::string(FirstStub->getName()));
+      auto SecondName = HostSideKernelNameToOriginalNameMap.find(
+          std::string(SecondStub->getName()));
+      if (FirstName == HostSideKernelNameToOriginalNameMap.end() ||
+          SecondName == HostSideKernelNameToOriginalNameMap.end())
+        continue;
+      auto P = Pairs.find({FirstName->second, SecondName->second});
+      if (P == Pairs.end() || !Registrations.count(FirstStub) ||
+          P->second.Fields[0] != FirstStub->arg_size() ||
+          P->second.Fields[1] != SecondStub->arg_size())
+        continue;
+      LLVM_DEBUG(dbgs() << "fusing " << FirstName->second << " and "
+             << SecondName->second << "\n");
+      Function *&Stub = FusedStubs[P->second.Fused];
+      if (!Stub) {
+        Stub = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                GlobalValue::InternalLinkage,
+                                P->second.Fused + ".stub", M);
+        ReturnInst::Create(Ctx, BasicBlock::Create(Ctx, "entry", Stub));
+        CallBase *Registration = Registrations[FirstStub];
+        auto *Fused = cast<CallBase>(Registration->clone());
+        Fused->insertAfter(Registration);
+        IRBuilder<> Builder(Fused);
+        Value *Name = Builder.CreateGlobalStringPtr(P->second.Fused);
+        Fused->setArgOperand(
+            1, ConstantExpr::getBitCast(Stub,
+                                        Fused->getArgOperand(1)->getType()));
+        Fused->setArgOperand(2, Builder.CreateBitCast(
+                                    Name, Fused->getArgOperand(2)->getType()));
+        Fused->setArgOperand(3, Builder.CreateBitCast(
+                                    Name, Fused->getArgOperand(3)->getType()));
+      }
+      std::vector<uint32_t> &Fields = P->second.Fields;
+      bool Split = GridSplit && SplitKernels.count(P->second.Fused);
+      // first's and second's parameters, loaded and stored arguments, then
+      // the sub-grid parameter
+      std::vector<Constant *> Words;
+      for (unsigned W : {0, 1, 3, 4, 5, 6})
+        Words.push_back(ConstantInt::get(Int64Ty, Fields[W]));
+      Words.push_back(ConstantInt::get(Int64Ty, Split));
+      auto *LayoutTy = ArrayType::get(Int64Ty, Words.size());
+      auto *LayoutGV = new GlobalVariable(
+          M, LayoutTy, true, GlobalValue::PrivateLinkage,
+          ConstantArray::get(LayoutTy, Words), "penguin.fusion.layout");
+      IRBuilder<> Builder(C.Second);
+      std::vector<Type *> Params;
+      std::vector<Value *> Args;
+      for (CallInst *Launch : {C.First, C.Second}) {
+        for (Value *A : Launch->args()) {
+          Params.push_back(A->getType());
+          Args.push_back(A);
+        }
+      }
+      Args.push_back(
+          Builder.CreateBitCast(Stub, C.First->getArgOperand(0)->getType()));
+      Args.push_back(
+          Builder.CreateConstInBoundsGEP2_32(LayoutTy, LayoutGV, 0, 0));
+      Params.push_back(Args[Args.size() - 2]->getType());
+      Params.push_back(Args.back()->getType());
+      llvm::FunctionCallee FusedFn = M.getOrInsertFunction(
+          "penguinLaunchKernelFused",
+          FunctionType::get(C.Second->getType(), Params, false));
+      CallInst *Fused = Builder.CreateCall(FusedFn, Args);
+      Fused->takeName(C.Second);
+      C.Second->replaceAllUsesWith(Fused);
+      C.Second->eraseFromParent();
+      C.First->eraseFromParent();
+      for (auto *End : C.LifetimeEnds)
+        End->moveAfter(Fused);
+    }
+  }
+
+  // Loop tiling: the only launch of a host loop that does nothing else but
+  // set up the launch and wait for it, so the runtime may hold back the
+  // launches of its iterations until the loop exits
+  struct TilingCandidate {
+    CallInst *Launch;
+    std::vector<BasicBlock *> Exits;
+  };
+  std::vector<TilingCandidate> TilingCandidates;
+
+  bool onlyLaunches(Loop *L, TilingCandidate &C) {
+    CallInst *Launch = nullptr;
+    for (BasicBlock *BB : L->blocks()) {
+      for (auto &I : *BB) {
+        if (isKernelLaunch(&I)) {
+          if (Launch)
+            return false;
+          Launch = cast<CallInst>(&I);
+          continue;
+        }
+        if (auto *SI = dyn_cast<StoreInst>(&I)) {
+          if (SI->isVolatile() ||
+              !isa<AllocaInst>(getUnderlyingObject(SI->getPointerOperand())))
+            return false;
+          continue;
+        }
+        if (auto *LI = dyn_cast<LoadInst>(&I)) {
+          Value *Object = getUnderlyingObject(LI->getPointerOperand());
+          auto *GV = dyn_cast<GlobalVariable>(Object);
+          if (LI->isVolatile() ||
+              !(isa<AllocaInst>(Object) || (GV && GV->isConstant())))
+            return false;
+          continue;
+        }
+        if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+          if (isa<DbgInfoIntrinsic>(II) || II->isLifetimeStartOrEnd())
+            continue;
+          auto *Mem = dyn_cast<MemIntrinsic>(II);
+          if (!Mem || Mem->isVolatile() ||
+              !isa<AllocaInst>(getUnderlyingObject(Mem->getRawDest())))
+            return false;
+          auto *Transfer = dyn_cast<MemTransferInst>(Mem);
+          if (Transfer &&
+              !isa<AllocaInst>(getUnderlyingObject(Transfer->getRawSource())))
+            return false;
+          continue;
+        }
+        if (auto *CI = dyn_cast<CallBase>(&I)) {
+          Function *Callee = CI->getCalledFunction();
+          StringRef Name = Callee ? Callee->getName() : "";
+          // waiting on launches the runtime holds back waits on nothing
+          if (isa<CallInst>(CI) &&
+              (Name == "__cudaPushCallConfiguration" ||
+               Name == "__cudaPopCallConfiguration" ||
+               Name == "cudaDeviceSynchronize" ||
+               Name == "cudaGetLastError" || Name == "cudaPeekAtLastError"))
+            continue;
+          return false;
+        }
+        if (I.mayHaveSideEffects() || I.mayReadFromMemory())
+          return false;
+      }
+    }
+    if (!Launch || !L->hasDedicatedExits())
+      return false;
+    C.Launch = Launch;
+    SmallVector<BasicBlock *, 4> Exits;
+    L->getUniqueExitBlocks(Exits);
+    C.Exits.assign(Exits.begin(), Exits.end());
+    return true;
+  }
+
+  // Before any instrumentation, which adds runtime calls to the loops
+  void findTilingCandidates(Module &M) {
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      LoopInfo &LI = GetLI(F);
+      for (auto &BB : F) {
+        for (auto &I : BB) {
+          if (!isKernelLaunch(&I))
+            continue;
+          Loop *L = LI.getLoopFor(&BB);
+          TilingCandidate C;
+          if (L && onlyLaunches(L, C))
+            TilingCandidates.push_back(C);
+        }
+      }
+    }
+  }
+
+  // A candidate launching a kernel the metadata lists for tiling, which
+  // takes the sub-grid parameter, goes through penguinLaunchKernelTiled with
+  // its layout: the parameters, the element bytes, the arguments loaded and
+  // stored, then the bytes of each parameter, which the runtime compares
+  // between iterations. The loop's exits call penguinLaunchTiledFlush.
+  void insertCodeToTileLoops(Module &M) {
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    std::map<std::string, std::vector<uint32_t>> Tiling;
+    std::set<std::string> SplitKernels;
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind == cuda_analysis::RK_LoopTiling && R.Fields.size() >= 3)
+        Tiling[R.Kernel.str()] =
+            std::vector<uint32_t>(R.Fields.begin(), R.Fields.end());
+      if (R.Kind == cuda_analysis::RK_GridSplit)
+        SplitKernels.insert(R.Kernel.str());
+    });
+    LLVMContext &Ctx = M.getContext();
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    const DataLayout &DL = M.getDataLayout();
+    std::set<BasicBlock *> Flushed;
+    for (auto &C : TilingCandidates) {
+      auto *Stub =
+          cast<Function>(C.Launch->getArgOperand(0)->stripPointerCasts());
+      auto Name = HostSideKernelNameToOriginalNameMap.find(
+          std::string(Stub->getName()));
+      if (Name == HostSideKernelNameToOriginalNameMap.end())
+        continue;
+      auto T = Tiling.find(Name->second);
+      if (T == Tiling.end() || !SplitKernels.count(Name->second))
+        continue;
+      LLVM_DEBUG(dbgs() << "tiling the host loop around " << Name->second << "\n");
+      std::vector<Constant *> Words = {
+          ConstantInt::get(Int64Ty, Stub->arg_size())};
+      for (uint32_t Field : T->second)
+        Words.push_back(ConstantInt::get(Int64Ty, Field));
+      for (Argument &A : Stub->args()) {
+        Type *Ty = A.hasByValAttr() ? A.getParamByValType() : A.getType();
+        Words.push_back(ConstantInt::get(Int64Ty, DL.getTypeAllocSize(Ty)));
+      }
+      auto *LayoutTy = ArrayType::get(Int64Ty, Words.size());
+      auto *LayoutGV = new GlobalVariable(
+          M, LayoutTy, true, GlobalValue::PrivateLinkage,
+          ConstantArray::get(LayoutTy, Words), "penguin.tiling.layout");
+      IRBuilder<> Builder(C.Launch);
+      std::vector<Type *> Params;
+      std::vector<Value *> Args;
+      for (Value *A : C.Launch->args()) {
+        Params.push_back(A->getType());
+        Args.push_back(A);
+      }
+      Args.push_back(
+          Builder.CreateConstInBoundsGEP2_32(LayoutTy, LayoutGV, 0, 0));
+      Params.push_back(Args.back()->getType());
+      llvm::FunctionCallee TiledFn = M.getOrInsertFunction(
+          "penguinLaunchKernelTiled",
+          FunctionType::get(C.Launch->getType(), Params, false));
+      CallInst *Tiled = Builder.CreateCall(TiledFn, Args);
+      Tiled->takeName(C.Launch);
+      C.Launch->replaceAllUsesWith(Tiled);
+      C.Launch->eraseFromParent();
+      llvm::FunctionCallee FlushFn = M.getOrInsertFunction(
+          "penguinLaunchTiledFlush", Type::getVoidTy(Ctx));
+      for (BasicBlock *Exit : C.Exits)
+        if (Flushed.insert(Exit).second)
+          IRBuilder<>(&*Exit->getFirstInsertionPt()).CreateCall(FlushFn);
+    }
+  }
+
+  // Graph replay: the launches of the innermost host loop around them, when
+  // neither the fusion nor the tiling takes them. The runtime may hold back
+  // the launches of an iteration and launch them as one graph.
+  struct GraphCandidate {
+    BasicBlock *Header;
+    std::vector<CallInst *> Launches;
+    std::vector<BasicBlock *> Exits;
+  };
+  std::vector<GraphCandidate> GraphCandidates;
+
+  // A held back launch has not run when the host goes on, so the loop must
+  // not wait on it, copy its results or call what may: only launch setup,
+  // error checks and functions outside of CUDA that the module doesn't
+  // define
+  static bool waitsOnNoLaunch(Loop *L) {
+    for (BasicBlock *BB : L->blocks()) {
+      for (auto &I : *BB) {
+        auto *CI = dyn_cast<CallBase>(&I);
+        if (!CI || isa<IntrinsicInst>(CI) || isKernelLaunch(&I))
+          continue;
+        Function *Callee = CI->getCalledFunction();
+        if (!Callee || !isa<CallInst>(CI) || !Callee->isDeclaration())
+          return false;
+        StringRef Name = Callee->getName();
+        if (Name == "__cudaPushCallConfiguration" ||
+            Name == "__cudaPopCallConfiguration" ||
+            Name == "cudaGetLastError" || Name == "cudaPeekAtLastError")
+          continue;
+        if (Name.startswith("cuda") || Name.startswith("__cuda"))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // After findFusionCandidates and findTilingCandidates
+  void findGraphCandidates(Module &M) {
+    std::set<CallInst *> Taken;
+    for (auto &C : FusionCandidates) {
+      Taken.insert(C.First);
+      Taken.insert(C.Second);
+    }
+    for (auto &C : TilingCandidates)
+      Taken.insert(C.Launch);
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      LoopInfo &LI = GetLI(F);
+      std::map<Loop *, std::vector<CallInst *>> Loops;
+      std::set<Loop *> Skipped;
+      for (auto &BB : F) {
+        Loop *L = LI.getLoopFor(&BB);
+        if (!L)
+          continue;
+        for (auto &I : BB) {
+          if (!isKernelLaunch(&I))
+            continue;
+          if (Taken.count(cast<CallInst>(&I)))
+            Skipped.insert(L);
+          Loops[L].push_back(cast<CallInst>(&I));
+        }
+      }
+      for (auto &Launches : Loops) {
+        Loop *L = Launches.first;
+        if (Skipped.count(L) || !L->hasDedicatedExits() ||
+            !waitsOnNoLaunch(L))
+          continue;
+        GraphCandidate C;
+        C.Header = L->getHeader();
+        C.Launches = Launches.second;
+        SmallVector<BasicBlock *, 4> Exits;
+        L->getUniqueExitBlocks(Exits);
+        C.Exits.assign(Exits.begin(), Exits.end());
+        GraphCandidates.push_back(C);
+      }
+    }
+  }
+
+  // Each launch of a candidate goes through penguinLaunchKernelGraph with
+  // its layout, the parameters then the bytes of each. The header calls
+  // penguinGraphIteration with the loop's number before the rest of an
+  // iteration, and the exits call penguinGraphFlush. Launches of kernels the
+  // grid splitting takes stay as they are, and so does the rest of the loop.
+  void insertCodeToGraphLoops(Module &M) {
+    std::set<std::string> SplitKernels;
+    cuda_analysis::MetadataReader Metadata;
+    if (GridSplit && Metadata.open(MetadataFile))
+      Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+        if (R.Kind == cuda_analysis::RK_GridSplit)
+          SplitKernels.insert(R.Kernel.str());
+      });
+    LLVMContext &Ctx = M.getContext();
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    const DataLayout &DL = M.getDataLayout();
+    unsigned LoopId = 0;
+    for (auto &C : GraphCandidates) {
+      bool Split = false;
+      for (CallInst *Launch : C.Launches) {
+        auto *Stub =
+            cast<Function>(Launch->getArgOperand(0)->stripPointerCasts());
+        auto Name = HostSideKernelNameToOriginalNameMap.find(
+            std::string(Stub->getName()));
+        Split |= Name != HostSideKernelNameToOriginalNameMap.end() &&
+                 SplitKernels.count(Name->second);
+      }
+      if (Split)
+        continue;
+      LLVM_DEBUG(dbgs() << "replaying the " << C.Launches.size()
+                        << " launches of the loop at " << C.Header->getName()
+                        << " as a graph\n");
+      for (CallInst *Launch : C.Launches) {
+        auto *Stub =
+            cast<Function>(Launch->getArgOperand(0)->stripPointerCasts());
+        std::vector<Constant *> Words = {
+            ConstantInt::get(Int64Ty, Stub->arg_size())};
+        for (Argument &A : Stub->args()) {
+          Type *Ty = A.hasByValAttr() ? A.getParamByValType() : A.getType();
+          Words.push_back(ConstantInt::get(Int64Ty, DL.getTypeAllocSize(Ty)));
+        }
+        auto *LayoutTy = ArrayType::get(Int64Ty, Words.size());
+        auto *LayoutGV = new GlobalVariable(
+            M, LayoutTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(LayoutTy, Words), "penguin.graph.layout");
+        IRBuilder<> Builder(Launch);
+        std::vector<Type *> Params;
+        std::vector<Value *> Args;
+        for (Value *A : Launch->args()) {
+          Params.push_back(A->getType());
+          Args.push_back(A);
+        }
+        Args.push_back(
+            Builder.CreateConstInBoundsGEP2_32(LayoutTy, LayoutGV, 0, 0));
+        Params.push_back(Args.back()->getType());
+        llvm::FunctionCallee GraphFn = M.getOrInsertFunction(
+            "penguinLaunchKernelGraph",
+            FunctionType::get(Launch->getType(), Params, false));
+        CallInst *Graph = Builder.CreateCall(GraphFn, Args);
+        Graph->takeName(Launch);
+        Launch->replaceAllUsesWith(Graph);
+        Launch->eraseFromParent();
+      }
+      llvm::FunctionCallee IterationFn = M.getOrInsertFunction(
+          "penguinGraphIteration", Type::getVoidTy(Ctx), Int32Ty);
+      IRBuilder<>(&*C.Header->getFirstInsertionPt())
+          .CreateCall(IterationFn, {ConstantInt::get(Int32Ty, LoopId++)});
+      llvm::FunctionCallee FlushFn =
+          M.getOrInsertFunction("penguinGraphFlush", Type::getVoidTy(Ctx));
+      for (BasicBlock *Exit : C.Exits)
+        IRBuilder<>(&*Exit->getFirstInsertionPt()).CreateCall(FlushFn);
+    }
+  }
+
+  // Launch reordering: launches of a block, none of which another step takes,
+  // with only the setup of each between them, so the runtime may hold them
+  // back until the last one and launch them in another order
+  struct ReorderCandidate {
+    std::vector<CallInst *> Launches;
+  };
+  std::vector<ReorderCandidate> ReorderCandidates;
+
+  // Whether I only sets up a launch: stores to the stack, loads of the stack
+  // and of constants, and the launch configuration. A held back launch gets
+  // its argument values as it is held, so they may be stored over.
+  static bool isLaunchSetup(Instruction &I) {
+    if (auto *SI = dyn_cast<StoreInst>(&I))
+      return !SI->isVolatile() &&
+             isa<AllocaInst>(getUnderlyingObject(SI->getPointerOperand()));
+    if (auto *LI = dyn_cast<LoadInst>(&I)) {
+      Value *Object = getUnderlyingObject(LI->getPointerOperand());
+      auto *GV = dyn_cast<GlobalVariable>(Object);
+      return !LI->isVolatile() &&
+             (isa<AllocaInst>(Object) || (GV && GV->isConstant()));
+    }
+    if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+      if (isa<DbgInfoIntrinsic>(II) || II->isLifetimeStartOrEnd())
+        return true;
+      auto *Mem = dyn_cast<MemIntrinsic>(II);
+      if (!Mem || Mem->isVolatile() ||
+          !isa<AllocaInst>(getUnderlyingObject(Mem->getRawDest())))
+        return false;
+      auto *Transfer = dyn_cast<MemTransferInst>(Mem);
+      return !Transfer ||
+             isa<AllocaInst>(getUnderlyingObject(Transfer->getRawSource()));
+    }
+    if (auto *CI = dyn_cast<CallBase>(&I)) {
+      Function *Callee = CI->getCalledFunction();
+      return isa<CallInst>(CI) && Callee &&
+             (Callee->getName() == "__cudaPushCallConfiguration" ||
+              Callee->getName() == "__cudaPopCallConfiguration");
+    }
+    return !I.mayHaveSideEffects() && !I.mayReadFromMemory();
+  }
+
+  // After the fusion, tiling and graph candidates, before any
+  // instrumentation, which runs between the launches
+  void findReorderCandidates(Module &M) {
+    std::set<CallInst *> Taken;
+    for (auto &C : FusionCandidates) {
+      Taken.insert(C.First);
+      Taken.insert(C.Second);
+    }
+    for (auto &C : TilingCandidates)
+      Taken.insert(C.Launch);
+    for (auto &C : GraphCandidates)
+      Taken.insert(C.Launches.begin(), C.Launches.end());
+    for (auto &F : M) {
+      if (F.isDeclaration() || F.getName().contains("stub") ||
+          F.getName().contains("penguin"))
+        continue;
+      for (auto &BB : F) {
+        ReorderCandidate C;
+        for (auto &I : BB) {
+          if (isKernelLaunch(&I) && !Taken.count(cast<CallInst>(&I))) {
+            C.Launches.push_back(cast<CallInst>(&I));
+            continue;
+          }
+          if (C.Launches.empty() || isLaunchSetup(I))
+            continue;
+          if (C.Launches.size() > 1)
+            ReorderCandidates.push_back(C);
+          C.Launches.clear();
+        }
+        if (C.Launches.size() > 1)
+          ReorderCandidates.push_back(C);
+      }
+    }
+  }
+
+  // Whether the data-flow graph has two launches of C that no allocation
+  // joins with a store of either, all their allocation arguments accounted
+  // for; otherwise there is nothing to reorder
+  bool hasIndependentLaunches(const ReorderCandidate &C) {
+    auto AllRooted = [&](CallInst *Launch) {
+      auto *Stub =
+          cast<Function>(Launch->getArgOperand(0)->stripPointerCasts());
+      unsigned Pointers = 0;
+      for (Argument &A : Stub->args())
+        Pointers += A.getType()->isPointerTy() && !A.hasByValAttr();
+      return KernelInvocationToAllocationModesMap[Launch].size() >= Pointers;
+    };
+    for (unsigned i = 0; i < C.Launches.size(); i++) {
+      if (!AllRooted(C.Launches[i]))
+        continue;
+      for (unsigned j = i + 1; j < C.Launches.size(); j++) {
+        if (!AllRooted(C.Launches[j]))
+          continue;
+        auto &A = KernelInvocationToAllocationModesMap[C.Launches[i]];
+        auto &B = KernelInvocationToAllocationModesMap[C.Launches[j]];
+        bool Conflict = false;
+        for (auto &M : A) {
+          auto Other = B.find(M.first);
+          Conflict |= Other != B.end() &&
+                      ((M.second | Other->second) & DF_STORE);
+        }
+        if (!Conflict)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  // Each launch of a candidate goes through penguinLaunchKernelReorder with
+  // its layout: the parameters, the bytes of each, then DF_LOAD and DF_STORE
+  // of each pointer parameter, both for one no access record covers. The
+  // last one is followed by penguinLaunchReorderFlush. Candidates with
+  // launches of kernels the grid splitting takes stay as they are.
+  void insertCodeToReorderLaunches(Module &M) {
+    std::set<std::string> SplitKernels;
+    cuda_analysis::MetadataReader Metadata;
+    if (GridSplit && Metadata.open(MetadataFile))
+      Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+        if (R.Kind == cuda_analysis::RK_GridSplit)
+          SplitKernels.insert(R.Kernel.str());
+      });
+    LLVMContext &Ctx = M.getContext();
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    const DataLayout &DL = M.getDataLayout();
+    for (auto &C : ReorderCandidates) {
+      bool Known = true;
+      for (CallInst *Launch : C.Launches) {
+        auto *Stub =
+            cast<Function>(Launch->getArgOperand(0)->stripPointerCasts());
+        auto Name = HostSideKernelNameToOriginalNameMap.find(
+            std::string(Stub->getName()));
+        Known &= Name != HostSideKernelNameToOriginalNameMap.end() &&
+                 !SplitKernels.count(Name->second);
+      }
+      if (!Known || !hasIndependentLaunches(C))
+        continue;
+      LLVM_DEBUG(dbgs() << "reordering the " << C.Launches.size()
+                        << " launches in "
+                        << C.Launches[0]->getParent()->getName() << "\n");
+      CallInst *Last = nullptr;
+      for (CallInst *Launch : C.Launches) {
+        auto *Stub =
+            cast<Function>(Launch->getArgOperand(0)->stripPointerCasts());
+        std::map<unsigned, unsigned> ArgModes = getArgumentModes(
+            HostSideKernelNameToOriginalNameMap[std::string(Stub->getName())]);
+        std::vector<Constant *> Words = {
+            ConstantInt::get(Int64Ty, Stub->arg_size())};
+        for (Argument &A : Stub->args()) {
+          Type *Ty = A.hasByValAttr() ? A.getParamByValType() : A.getType();
+          Words.push_back(ConstantInt::get(Int64Ty, DL.getTypeAllocSize(Ty)));
+        }
+        for (Argument &A : Stub->args()) {
+          unsigned Mode = 0;
+          if (A.getType()->isPointerTy() && !A.hasByValAttr()) {
+            auto It = ArgModes.find(A.getArgNo());
+            Mode = It != ArgModes.end() ? It->second : DF_LOAD | DF_STORE;
+          }
+          Words.push_back(ConstantInt::get(Int64Ty, Mode));
+        }
+        auto *LayoutTy = ArrayType::get(Int64Ty, Words.size());
+        auto *LayoutGV = new GlobalVariable(
+            M, LayoutTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(LayoutTy, Words), "penguin.reorder.layout");
+        IRBuilder<> Builder(Launch);
+        std::vector<Type *> Params;
+        std::vector<Value *> Args;
+        for (Value *A : Launch->args()) {
+          Params.push_back(A->getType());
+          Args.push_back(A);
+        }
+        Args.push_back(
+            Builder.CreateConstInBoundsGEP2_32(LayoutTy, LayoutGV, 0, 0));
+        Params.push_back(Args.back()->getType());
+        llvm::FunctionCallee ReorderFn = M.getOrInsertFunction(
+            "penguinLaunchKernelReorder",
+            FunctionType::get(Launch->getType(), Params, false));
+        CallInst *Reorder = Builder.CreateCall(ReorderFn, Args);
+        Reorder->takeName(Launch);
+        Launch->replaceAllUsesWith(Reorder);
+        Launch->eraseFromParent();
+        Last = Reorder;
+      }
+      llvm::FunctionCallee FlushFn = M.getOrInsertFunction(
+          "penguinLaunchReorderFlush", Type::getVoidTy(Ctx));
+      IRBuilder<>(Last->getNextNode()).CreateCall(FlushFn);
+    }
+  }
+
+  // Grid splitting: every launch of a kernel the metadata lists as block
+  // independent, which the device module then gave the hidden sub-grid
+  // parameter, goes through penguinLaunchKernelSplit with the number of
+  // arguments in its array; the runtime appends the parameter, split or not.
+  // Launches in stubs that were not inlined are rewritten too.
+  void insertCodeToSplitGrids(Module &M) {
+    cuda_analysis::MetadataReader Metadata;
+    if (!Metadata.open(MetadataFile))
+      return;
+    std::map<std::string, unsigned> SplitKernels;
+    Metadata.forEach([&](const cuda_analysis::MetadataRecord &R) {
+      if (R.Kind == cuda_analysis::RK_GridSplit && R.Fields.size() >= 1)
+        SplitKernels[R.Kernel.str()] = R.Fields[0];
+    });
+    if (SplitKernels.empty())
+      return;
+    std::vector<CallBase *> Launches;
+    for (auto &F : M) {
+      for (auto &BB : F) {
+        for (auto &I : BB) {
+          if (auto *CI = dyn_cast<CallBase>(&I)) {
+            auto *Callee = CI->getCalledFunction();
+            if (Callee && Callee->getName() == "cudaLaunchKernel")
+              Launches.push_back(CI);
+          }
+        }
+      }
+    }
+    LLVMContext &Ctx = M.getContext();
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    for (auto *CI : Launches) {
+      auto *Kernel =
+          dyn_cast<Function>(CI->getArgOperand(0)->stripPointerCasts());
+      if (!Kernel)
+        continue;
+      auto Name = HostSideKernelNameToOriginalNameMap.find(
+          std::string(Kernel->getName()));
+      if (Name == HostSideKernelNameToOriginalNameMap.end())
+        continue;
+      auto S = SplitKernels.find(Name->second);
+      if (S == SplitKernels.end())
+        continue;
+      LLVM_DEBUG(dbgs() << "splitting the grid of " << Name->second << "\n");
+      std::vector<Type *> Params;
+      std::vector<Value *> Args;
+      for (Value *A : CI->args()) {
+        Params.push_back(A->getType());
+        Args.push_back(A);
+      }
+      Params.push_back(Int32Ty);
+      Args.push_back(ConstantInt::get(Int32Ty, S->second));
+      llvm::FunctionCallee SplitFn = M.getOrInsertFunction(
+          "penguinLaunchKernelSplit",
+          FunctionType::get(CI->getType(), Params, false));
+      IRBuilder<> Builder(CI);
+      CallBase *Split;
+      if (auto *Invoke = dyn_cast<InvokeInst>(CI))
+        Split = Builder.CreateInvoke(SplitFn, Invoke->getNormalDest(),
+                                     Invoke->getUnwindDest(), Args);
+      else
+        Split = Builder.CreateCall(SplitFn, Args);
+      Split->takeName(CI);
+      CI->replaceAllUsesWith(Split);
+      CI->eraseFromParent();
+    }
+  }
+
+  // Staged copy: each pointer argument of an iterative launch is replaced in
+  // its slot of the argument array by what penguinStagedPointer returns for
+  // the iteration, the pointer itself unless the runtime streams its
+  // allocation through a device ring. The original goes back once the launch
+  // is issued, in case the store of the argument was hoisted out of the loop.
+  void insertCodeToRemapStagedArguments(CallBase *CI, Value *LIV) {
+    auto A = KernelInvocationToArgNumberToAllocationMap.find(CI);
+    if (A == KernelInvocationToArgNumberToAllocationMap.end())
+      return;
+    Function *F = CI->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
-    IRBuilder<> Builder(Location);
-    /* V->getType()->dump(); */
-    // Builder.CreateCall(Fn, Args);
-    llvm::Value *AID = Builder.getInt32(aid);
-    llvm::Value *INVID = Builder.getInt32(invid);
-    Value *Args[] = {AID, INVID};
-    llvm::FunctionCallee AddAIDToInvocationID = F->getParent()->getOrInsertFunction(
-        "add_aid_invocation_map", Type::getVoidTy(Ctx), Type::getInt32Ty(Ctx),
-        Type::getInt32Ty(Ctx));
-    Builder.CreateCall(AddAIDToInvocationID, Args);
-    // llvm::FunctionCallee PrintAllocFunc =
-    // F->getParent()->getOrInsertFunction(
-    //     "print_aid_wss_map_iterdep", Type::getVoidTy(Ctx));
-    // ArrayRef<Value *> PrintArgs = {};
-    // Builder.CreateCall(PrintAllocFunc, PrintArgs);
-    return;
+    IRBuilder<> Builder(CI);
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    llvm::FunctionCallee RemapFn = F->getParent()->getOrInsertFunction(
+        "penguinStagedPointer", Int64Ty, Int64Ty, Type::getInt32Ty(Ctx));
+    Value *Args = Builder.CreateBitCast(CI->getArgOperand(5),
+                                        Int8PtrTy->getPointerTo());
+    Value *Iter = Builder.CreateZExtOrTrunc(LIV, Builder.getInt32Ty());
+    std::vector<std::pair<Value *, Value *>> Restores;
+    for (auto &Arg : A->second) {
+      if (!Arg.second->getType()->isPointerTy())
+        continue;
+      Value *Slot = Builder.CreateLoad(
+          Int8PtrTy, Builder.CreateConstGEP1_32(Int8PtrTy, Args, Arg.first));
+      Slot = Builder.CreateBitCast(Slot, Int64Ty->getPointerTo());
+      Value *Original = Builder.CreateLoad(Int64Ty, Slot);
+      Builder.CreateStore(Builder.CreateCall(RemapFn, {Original, Iter}), Slot);
+      Restores.push_back({Slot, Original});
+    }
+    Instruction *After = CI->getNextNode();
+    if (auto *Invoke = dyn_cast<InvokeInst>(CI)) {
+      BasicBlock *Normal = Invoke->getNormalDest();
+      After = Normal->getSinglePredecessor() ? &*Normal->getFirstInsertionPt()
+                                             : nullptr;
+    }
+    if (!After)
+      return;
+    IRBuilder<> RestoreBuilder(After);
+    for (auto &R : Restores)
+      RestoreBuilder.CreateStore(R.second, R.first);
   }
 
-  void insertCodeToProcessWSS_iterdep(Instruction* Location) {
+  // Tells the runtime the kernel, grid, block and shared memory of the launch,
+  // as pushed by __cudaPushCallConfiguration, for its occupancy
+  void insertCodeToRecordLaunchShape(Instruction *Location, CallBase *CI) {
+    auto Push = KernelInvocationToPushCallMap.find(CI);
+    if (Push == KernelInvocationToPushCallMap.end())
+      return;
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
-    /* V->getType()->dump(); */
-    // Builder.CreateCall(Fn, Args);
-    llvm::FunctionCallee ProcessWSS_iter = F->getParent()->getOrInsertFunction(
-        "process_iterdep_access", Type::getVoidTy(Ctx));
-    ArrayRef<Value *> Args = {};
-    Builder.CreateCall(ProcessWSS_iter, Args);
-    return;
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    CallBase *PushCall = Push->second;
+    auto Int = [&](unsigned Operand, Type *Ty) -> Value * {
+      Value *V = PushCall->getArgOperand(Operand);
+      if (!V->getType()->isIntegerTy())
+        return ConstantInt::get(Ty, 0);
+      return Builder.CreateZExtOrTrunc(V, Ty);
+    };
+    Value *Args[] = {Builder.CreateBitCast(CI->getArgOperand(0), Int8PtrTy),
+                     Int(0, Int64Ty), Int(1, Int32Ty), Int(2, Int64Ty),
+                     Int(3, Int32Ty), Int(4, Int64Ty)};
+    llvm::FunctionCallee RecordShapeFn = F->getParent()->getOrInsertFunction(
+        "penguinRecordLaunchShape", Type::getVoidTy(Ctx), Int8PtrTy, Int64Ty,
+        Int32Ty, Int64Ty, Int32Ty, Int64Ty);
+    Builder.CreateCall(RecordShapeFn, Args);
   }
 
   // This function should get all the information it needs from the runtime, not
   // from LLVM values
   // must be called once per iteration
-  void insertCodeToPerformInvocationMemoryMgmt(Instruction *Location, CallBase  *CI) {
+  void insertCodeToPerformInvocationMemoryMgmt(Instruction *Location, CallBase  *CI,
+                                               bool StaticDecisions) {
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -2658,15 +5208,63 @@ struct DynamicHostTransform : public ModulePass {
     llvm::ConstantInt *MemSize = Builder.getInt64(6 * 1024ULL * 1024ULL * 1024ULL);
     unsigned invid = KernelInvocationToInvocationIDMap[CI];
     auto InvID = Builder.getInt32(invid);
+    if (Value *Shape = StaticDecisions
+                           ? nullptr
+                           : insertCodeToClassifyLaunchShape(Builder, CI)) {
+      llvm::FunctionCallee ShapeMgmtFn = F->getParent()->getOrInsertFunction(
+          "perform_memory_management_shape", Type::getVoidTy(Ctx),
+          Type::getInt64Ty(Ctx), Type::getInt32Ty(Ctx), Type::getInt32Ty(Ctx));
+      Builder.CreateCall(ShapeMgmtFn, {MemSize, InvID, Shape});
+      return;
+    }
     ArrayRef<Value *> Args = {MemSize, InvID};
     // Builder.CreateCall(Fn, Args);
     llvm::FunctionCallee MemMgmtFn = F->getParent()->getOrInsertFunction(
-        "perform_memory_management", Type::getVoidTy(Ctx),
-        Type::getInt64Ty(Ctx), Type::getInt32Ty(Ctx));
+        StaticDecisions ? "perform_memory_management_static"
+                        : "perform_memory_management",
+        Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx), Type::getInt32Ty(Ctx));
     Builder.CreateCall(MemMgmtFn, Args);
     return;
   }
 
+  // Index, from 1, of the shape class of -penguin-shape-classes the grid and
+  // block CI is launched with match, 0 for none; nullptr if its invocation
+  // has none or the launch shape isn't known
+  Value *insertCodeToClassifyLaunchShape(IRBuilder<> &Builder, CallBase *CI) {
+    auto Classes = getShapeClasses().find(KernelInvocationToInvocationIDMap[CI]);
+    auto Push = KernelInvocationToPushCallMap.find(CI);
+    if (Classes == getShapeClasses().end() ||
+        Push == KernelInvocationToPushCallMap.end())
+      return nullptr;
+    // packed as __cudaPushCallConfiguration takes them, x in the low 32 bits
+    Value *Dims[4];
+    for (unsigned Operand = 0; Operand < 4; Operand++) {
+      Value *V = Push->second->getArgOperand(Operand);
+      if (!V->getType()->isIntegerTy())
+        return nullptr;
+      Dims[Operand] = Builder.CreateZExtOrTrunc(
+          V, Operand % 2 ? Builder.getInt32Ty() : Builder.getInt64Ty());
+    }
+    Value *Shape = Builder.getInt32(0);
+    // the first class listed wins, though the runtime lists each shape once
+    for (unsigned C = Classes->second.size(); C-- > 0;) {
+      const LaunchShapeClass &Class = Classes->second[C];
+      Value *Match = Builder.CreateAnd(
+          Builder.CreateAnd(
+              Builder.CreateICmpEQ(Dims[0],
+                                   Builder.getInt64((uint64_t)Class[1] << 32 |
+                                                    Class[0])),
+              Builder.CreateICmpEQ(Dims[1], Builder.getInt32(Class[2]))),
+          Builder.CreateAnd(
+              Builder.CreateICmpEQ(Dims[2],
+                                   Builder.getInt64((uint64_t)Class[4] << 32 |
+                                                    Class[3])),
+              Builder.CreateICmpEQ(Dims[3], Builder.getInt32(Class[5]))));
+      Shape = Builder.CreateSelect(Match, Builder.getInt32(C + 1), Shape);
+    }
+    return Shape;
+  }
+
   // call this in the Loop, with for each memory allocation as the operatn
   Instruction *insertCodeToPerformMemoryMgmtIteration(Instruction *Location,
                                                       Value *Iter) {
@@ -2707,10 +5305,54 @@ struct DynamicHostTransform : public ModulePass {
         Builder.getInt64(6 * 1024ULL * 1024ULL * 1024ULL);
     ArrayRef<Value *> Args = {MemSize};
     // Builder.CreateCall(Fn, Args);
-    llvm::FunctionCallee MemMgmtFn = F->getParent()->getOrInsertFunction(
-        "perform_memory_management_iterative", Type::getVoidTy(Ctx),
-        Type::getInt64Ty(Ctx));
-    return Builder.CreateCall(MemMgmtFn, Args);
+    Instruction *First = nullptr;
+    for (const char *Name : plannerNames("perform_memory_management_iterative_static",
+                                         "perform_memory_management_iterative")) {
+      llvm::FunctionCallee MemMgmtFn = F->getParent()->getOrInsertFunction(
+          Name, Type::getVoidTy(Ctx), Type::getInt64Ty(Ctx));
+      Instruction *Call = Builder.CreateCall(MemMgmtFn, Args);
+      First = First ? First : Call;
+    }
+    return First;
+  }
+
+  // The runtime planners the policy calls, static first: hybrid runs both and
+  // every launch then follows one of the two plans
+  SmallVector<const char *, 2> plannerNames(const char *Static,
+                                            const char *Dynamic) {
+    SmallVector<const char *, 2> Names;
+    if (Policy != POLICY_DYNAMIC)
+      Names.push_back(Static);
+    if (Policy != POLICY_STATIC)
+      Names.push_back(Dynamic);
+    return Names;
+  }
+
+  // Static decisions need every access of the launch analysed: an expression
+  // tree that is not a pointer chase or indirect, inside computable loops
+  bool useStaticDecisions(CallBase *CI,
+                          const std::map<unsigned, bool> &LoopIDToIncompMap) {
+    if (Policy != POLICY_HYBRID)
+      return Policy == POLICY_STATIC;
+    auto *KernelFunction = dyn_cast_or_null<Function>(CI->getArgOperand(0));
+    std::string OriginalKernelName =
+        getOriginalKernelName(KernelFunction->getName().str());
+    auto &AccessIDToLoopIDMap =
+        KernelNameToAccessIDToEnclosingLoopMap[OriginalKernelName];
+    auto &AccessIDToExprMap =
+        KernelNameToAccessIDToExpressionTreeMap[OriginalKernelName];
+    auto &AccessIDToAdvancedExprMap =
+        KernelNameToAccessIDToAdvancedExpressionTreeMap[OriginalKernelName];
+    for (auto AID = AccessIDToLoopIDMap.begin();
+         AID != AccessIDToLoopIDMap.end(); AID++) {
+      ExprTreeNode *Expr = AccessIDToExprMap[AID->first];
+      if (Expr == nullptr || isPointerChase(Expr) ||
+          isIndirectAccess(AccessIDToAdvancedExprMap[AID->first]))
+        return false;
+      if (AID->second != 0 && lookupOrDefault(LoopIDToIncompMap, AID->second))
+        return false;
+    }
+    return true;
   }
 
   // the arguments to penguin super prefetch must come from runtime maps
@@ -2722,7 +5364,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value *insertTreeEvaluationCodeUsingCoeffecientVectors(
-      CallBase *CI, std::map<ExprTreeNode *, Value *> Unknowns,
+      CallBase *CI, const std::map<ExprTreeNode *, Value *> &Unknowns,
       ExprTreeNode *Node) {
     // for each of ETO_BIDX, ETO_BIDY, ETO_BIDZ, ETO_TIDX, ETO_TIDY, ETO_TIDZ,
     // identify the co-efficients by traversing up the tree
@@ -2730,23 +5372,23 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value *insertTreeEvaluationCode(Instruction *Location, CallBase *CI,
-                                  std::map<ExprTreeNode *, Value *> Unknowns,
+                                  const std::map<ExprTreeNode *, Value *> &Unknowns,
                                   ExprTreeNode *node,
                                   Value *LoopIters = nullptr) {
     if (node == nullptr)
       return nullptr;
-    errs() << "handling node " << node->original_str << "\n";
+    LLVM_DEBUG(dbgs() << "handling node " << node->original_str << "\n");
     if (isTerminal(node)) {
       // handle this node
-      errs() << "iliec: " << node->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
       if (Unknowns.find(node) != Unknowns.end()) {
-        Value *val = Unknowns[node];
-        val->dump();
+        Value *val = lookupOrDefault(Unknowns, node);
+        LLVM_DEBUG(val->dump());
         return val;
       }
       if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                    // bit unsigned integers
-        errs() << "node value = " << node->value << "\n";
+        LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
         node->value =
             stoll(node->original_str); // TODO: remove this hack: ensure that
                                       // the value is set correctly at some
@@ -2755,13 +5397,13 @@ struct DynamicHostTransform : public ModulePass {
       }
       // getting max
       if (node->op == ETO_PHI_TERM) {
-        errs() << "PHI TERM\n";
+        LLVM_DEBUG(dbgs() << "PHI TERM\n");
         return insertConstantNode(Location, unsigned (0));
       }
       assert(false); // must not reach here.
     } else {
       if (node->op == ETO_PHI) {
-        errs() << "PHI (hello hello)\n";
+        LLVM_DEBUG(dbgs() << "PHI (hello hello)\n");
         // TODO: get the phi node to loop id to loop iterations
         // Each phi node (numbered)
         /* // LoopIters->dump(); */
@@ -2770,9 +5412,9 @@ struct DynamicHostTransform : public ModulePass {
         return one;
         // return LoopIters;
       }
-      errs() << "childrens:";
-      errs() << node->children[0]->original_str << " "
-             << node->children[1]->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "childrens:");
+      LLVM_DEBUG(dbgs() << node->children[0]->original_str << " "
+             << node->children[1]->original_str << "\n");
       llvm::Value *Left = insertTreeEvaluationCode(
           Location, CI, Unknowns, node->children[0], LoopIters);
       llvm::Value *Right = insertTreeEvaluationCode(
@@ -2812,20 +5454,20 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value* computeSubExpression(Instruction* Location, CallBase* CI,
-          std::map<ExprTreeNodeAdvanced*, Value*> Unknowns,
+          const std::map<ExprTreeNodeAdvanced*, Value*> &Unknowns,
           ExprTreeNodeAdvanced* node) {
-      errs() << "computeSubExpression\n";
+      LLVM_DEBUG(dbgs() << "computeSubExpression\n");
       if(isTerminal(node)) {
-          errs() << "iliec: " << node->original_str << "\n";
+          LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
           if (Unknowns.find(node) != Unknowns.end()) {
-              errs() << "found unknown\n";
-              Value *val = Unknowns[node];
-              val->dump();
+              LLVM_DEBUG(dbgs() << "found unknown\n");
+              Value *val = lookupOrDefault(Unknowns, node);
+              LLVM_DEBUG(val->dump());
               return val;
           }
           if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                        // bit unsigned integers
-              errs() << "node value = " << node->value << "\n";
+              LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
               node->value =
                   stoll(node->original_str); // TODO: remove this hack: ensure that
                                              // the value is set correctly at some
@@ -2856,8 +5498,8 @@ struct DynamicHostTransform : public ModulePass {
 
   ///// UNknows will be minimum
   Value* computeSmallestValueForTerminalPhi(Instruction* Location,
-          CallBase* CI, std::map<ExprTreeNodeAdvanced*, Value*> Unknowns,
-          ExprTreeNodeAdvanced* node, std::map<unsigned, Value*> LoopIDToNumIterationsMap, Value* totalIncrementOfPhi) {
+          CallBase* CI, const std::map<ExprTreeNodeAdvanced*, Value*> &Unknowns,
+          ExprTreeNodeAdvanced* node, const std::map<unsigned, Value*> &LoopIDToNumIterationsMap, Value* totalIncrementOfPhi) {
       assert(node != nullptr);
       ExprTreeNodeAdvanced* parent = node->parent;
       ExprTreeNodeAdvanced* current = node;
@@ -2878,8 +5520,8 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value* computeLargestValueForTerminalPhi(Instruction* Location,
-          CallBase* CI, std::map<ExprTreeNodeAdvanced*, Value*> Unknowns,
-          ExprTreeNodeAdvanced* node, std::map<unsigned, Value*> LoopIDToNumIterationsMap, Value* totalIncrementOfPhi) {
+          CallBase* CI, const std::map<ExprTreeNodeAdvanced*, Value*> &Unknowns,
+          ExprTreeNodeAdvanced* node, const std::map<unsigned, Value*> &LoopIDToNumIterationsMap, Value* totalIncrementOfPhi) {
       assert(node != nullptr);
       ExprTreeNodeAdvanced* parent = node->parent;
       ExprTreeNodeAdvanced* current = node;
@@ -2900,15 +5542,15 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value* computePerIterationIncrementForTerminalPhi(Instruction* Location,
-          CallBase* CI, std::map<ExprTreeNodeAdvanced*, Value*> Unknowns,
-          ExprTreeNodeAdvanced* node, std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
+          CallBase* CI, const std::map<ExprTreeNodeAdvanced*, Value*> &Unknowns,
+          ExprTreeNodeAdvanced* node, const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
       assert(node != nullptr);
       ExprTreeNodeAdvanced* parent = node->parent;
       ExprTreeNodeAdvanced* current = node;
       Value* Accum = insertConstantNode(Location, unsigned (0));
       while(parent->op != ETO_PHI) {
-          errs() << "comutingn per iter incr\n";
-          errs() << parent->original_str << "\n";
+          LLVM_DEBUG(dbgs() << "comutingn per iter incr\n");
+          LLVM_DEBUG(dbgs() << parent->original_str << "\n");
           // for the parent children, identify the child on other path
           ExprTreeNodeAdvanced* otherChild = nullptr;
           assert(parent->op == ETO_ADD); // Also 
@@ -2925,32 +5567,32 @@ struct DynamicHostTransform : public ModulePass {
       // TODO get loop count for the PHI node, and multiply with accum
       unsigned phiID = node->arg;
       unsigned loopID = PhiNodeToLoopIDMap[phiID];
-      errs() << "per iteration increment, loop phi arg = " << phiID << "  " << loopID << "\n";
-      insertCodeToPrintGenericInt32(Location, LoopIDToNumIterationsMap[loopID]);
+      LLVM_DEBUG(dbgs() << "per iteration increment, loop phi arg = " << phiID << "  " << loopID << "\n");
+      insertCodeToPrintGenericInt32(Location, lookupOrDefault(LoopIDToNumIterationsMap, loopID));
       /* insertCodeToPrintGenericInt32(Location, Accum); */
-      Accum = insertComputationNodeAdvanced(Location, Accum, LoopIDToNumIterationsMap[loopID], ETO_MUL);
+      Accum = insertComputationNodeAdvanced(Location, Accum, lookupOrDefault(LoopIDToNumIterationsMap, loopID), ETO_MUL);
       return Accum;
   }
 
   // this code assumes that PHI nodes are not dependent on other phi nodes
   Value* insertTreeEvaluationCodeForPhi(Instruction* Location, CallBase* CI,
-          std::map<ExprTreeNodeAdvanced*, Value*> Unknowns,
+          const std::map<ExprTreeNodeAdvanced*, Value*> &Unknowns,
           ExprTreeNodeAdvanced* node, bool rootphi, bool minimize, 
-          std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
+          const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
       if(node == nullptr) {
           return nullptr;
       }
       if(isTerminal(node)) {
-          errs() << "iliec: " << node->original_str << "\n";
+          LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
           if (Unknowns.find(node) != Unknowns.end()) {
-              errs() << "found unknown\n";
-              Value *val = Unknowns[node];
-              val->dump();
+              LLVM_DEBUG(dbgs() << "found unknown\n");
+              Value *val = lookupOrDefault(Unknowns, node);
+              LLVM_DEBUG(val->dump());
               return val;
           }
           if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                        // bit unsigned integers
-              errs() << "node value = " << node->value << "\n";
+              LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
               node->value =
                   stoll(node->original_str); // TODO: remove this hack: ensure that
                                              // the value is set correctly at some
@@ -2972,13 +5614,13 @@ struct DynamicHostTransform : public ModulePass {
           /* return insertConstantNode(Location, unsigned (0)); */
       }
       // not terminal
-      errs() << "childrens:";
+      LLVM_DEBUG(dbgs() << "childrens:");
 
       for(auto child = node->children.begin(); child != node->children.end(); child++) {
-          errs() << (*child)->original_str << " ";
+          LLVM_DEBUG(dbgs() << (*child)->original_str << " ");
       }
       if(node->op == ETO_PHI && rootphi == true) {
-          errs() << "root phi\n";
+          LLVM_DEBUG(dbgs() << "root phi\n");
           llvm::Value *Left = insertTreeEvaluationCodeForPhi(
                   Location, CI, Unknowns, node->children[0], false, minimize, LoopIDToNumIterationsMap);
           llvm::Value *Right = insertTreeEvaluationCodeForPhi(
@@ -3014,24 +5656,24 @@ struct DynamicHostTransform : public ModulePass {
   // function works for evaluating both max and min,
   // Unknowns contains max or min, depeneding on the need
   Value *insertTreeEvaluationCodeAdvanced(Instruction *Location, CallBase *CI,
-                                  std::map<ExprTreeNodeAdvanced *, Value *> Unknowns,
+                                  const std::map<ExprTreeNodeAdvanced *, Value *> &Unknowns,
                                   ExprTreeNodeAdvanced *node,
-                                  bool minimize, std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
+                                  bool minimize, const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
     if (node == nullptr)
       return nullptr;
-    errs() << "handling node " << node->original_str << "\n";
+    LLVM_DEBUG(dbgs() << "handling node " << node->original_str << "\n");
     if (isTerminal(node)) {
       // handle this node
-      errs() << "iliec: " << node->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
       if (Unknowns.find(node) != Unknowns.end()) {
-          errs() << "found unknown\n";
-        Value *val = Unknowns[node];
-        val->dump();
+          LLVM_DEBUG(dbgs() << "found unknown\n");
+        Value *val = lookupOrDefault(Unknowns, node);
+        LLVM_DEBUG(val->dump());
         return val;
       }
       if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                    // bit unsigned integers
-        errs() << "node value = " << node->value << "\n";
+        LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
         node->value =
             stoll(node->original_str); // TODO: remove this hack: ensure that
                                       // the value is set correctly at some
@@ -3040,13 +5682,13 @@ struct DynamicHostTransform : public ModulePass {
       }
       // getting max
       if (node->op == ETO_PHI_TERM) {
-        errs() << "PHI TERM\n";
+        LLVM_DEBUG(dbgs() << "PHI TERM\n");
         return insertConstantNode(Location, unsigned (0));
       }
       assert(false); // must not reach here.
     } else {
       if (node->op == ETO_PHI) {
-        errs() << "PHI (hello hello)\n";
+        LLVM_DEBUG(dbgs() << "PHI (hello hello)\n");
         // TODO: get the phi node to loop id to loop iterations
         // Each phi node (numbered)
         /* // LoopIters->dump(); */
@@ -3056,12 +5698,12 @@ struct DynamicHostTransform : public ModulePass {
         return one;
         // return LoopIters;
       }
-      errs() << "childrens:";
+      LLVM_DEBUG(dbgs() << "childrens:");
 
       for(auto child = node->children.begin(); child != node->children.end(); child++) {
-          errs() << (*child)->original_str << " ";
+          LLVM_DEBUG(dbgs() << (*child)->original_str << " ");
       }
-      errs() << "\n";
+      LLVM_DEBUG(dbgs() << "\n");
       if(isOperation(node)) {
           /* errs() << node->children[0]->original_str << " " */
           /* << node->children[1]->original_str << "\n"; */
@@ -3129,11 +5771,11 @@ struct DynamicHostTransform : public ModulePass {
           ExprTreeNode *Node) {
       std::map<ExprTreeNode *, Value *> Unknowns;
       identifyUnknownsFromExpressionTree(Location, CI, Unknowns, Node);
-      errs() << "unknows at partdiff \n";
+      LLVM_DEBUG(dbgs() << "unknows at partdiff \n");
       for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
               UnknownIter++) {
-          errs() << (*UnknownIter).first->original_str << " ";
-          (*UnknownIter).second->dump();
+          LLVM_DEBUG(dbgs() << (*UnknownIter).first->original_str << " ");
+          LLVM_DEBUG((*UnknownIter).second->dump());
       }
       // locate the node in the expression tree which corresponds to the BIDX
       /* ExprTreeNode *BIDXNode = locateNodeWithParticularExprTreeOp(Node, ETO_BIDX); */
@@ -3149,20 +5791,20 @@ struct DynamicHostTransform : public ModulePass {
       for(auto BIDXNodeI = Collection.begin(); BIDXNodeI != Collection.end(); BIDXNodeI++) {
           BIDXNode = *BIDXNodeI;
           if (BIDXNode == nullptr) {
-              errs() << "\nNO BIDX node \n";
+              LLVM_DEBUG(dbgs() << "\nNO BIDX node \n");
               return insertConstantNode(Location, (unsigned long long)(0));
           } else {
-              errs() << "\nBIDX node \n";
+              LLVM_DEBUG(dbgs() << "\nBIDX node \n");
           }
           // traverse up the tree to find multipliers
           std::vector<ExprTreeNode *> Multipliers =
               findMultipliersByTraversingUpExprTree(Node, BIDXNode);
-          errs() << Multipliers.size() << "\n";
-          errs() << "multipliers => ";
+          LLVM_DEBUG(dbgs() << Multipliers.size() << "\n");
+          LLVM_DEBUG(dbgs() << "multipliers => ");
           std::vector<Value *> MultiplierInCode;
           for (auto Multiplier = Multipliers.begin(); Multiplier != Multipliers.end();
                   Multiplier++) {
-              errs() << (*Multiplier)->original_str << ".";
+              LLVM_DEBUG(dbgs() << (*Multiplier)->original_str << ".");
               llvm::Value *Result =
                   insertTreeEvaluationCode(Location, CI, Unknowns, *Multiplier);
               if ((*Multiplier)->parent->op == ETO_SHL) {
@@ -3172,27 +5814,27 @@ struct DynamicHostTransform : public ModulePass {
           }
           std::vector<ExprTreeNode *> Divisions =
               findDivisorsByTraversingUpExprTree(Node, BIDXNode);
-          errs() << Divisions.size() << "\n";
-          errs() << "division => ";
+          LLVM_DEBUG(dbgs() << Divisions.size() << "\n");
+          LLVM_DEBUG(dbgs() << "division => ");
           std::vector<Value *> DivisionInCode;
           for (auto Divisor = Divisions.begin(); Divisor != Divisions.end();
                   Divisor++) {
-              errs() << (*Divisor)->original_str << ".";
+              LLVM_DEBUG(dbgs() << (*Divisor)->original_str << ".");
               llvm::Value *Result =
                   insertTreeEvaluationCode(Location, CI, Unknowns, *Divisor);
               DivisionInCode.push_back(Result);
           }
-          errs() << "\n";
+          LLVM_DEBUG(dbgs() << "\n");
           auto Accumulator = insertConstantNode(Location, (unsigned)1);
           for (auto Multiplier = MultiplierInCode.begin();
                Multiplier != MultiplierInCode.end(); Multiplier++) {
-            (*Multiplier)->dump();
+            LLVM_DEBUG((*Multiplier)->dump());
             Accumulator =
                 insertComputationNode(Location, Accumulator, *Multiplier, ETO_MUL);
           }
           for (auto Divisor = DivisionInCode.begin();
                Divisor != DivisionInCode.end(); Divisor++) {
-            (*Divisor)->dump();
+            LLVM_DEBUG((*Divisor)->dump());
             Accumulator =
                 insertComputationNode(Location, Accumulator, *Divisor, ETO_DIV);
           }
@@ -3220,28 +5862,28 @@ struct DynamicHostTransform : public ModulePass {
                                                 ExprTreeNode *Node) {
     std::map<ExprTreeNode *, Value *> Unknowns;
     identifyUnknownsFromExpressionTree(Location, CI, Unknowns, Node);
-    errs() << "unknows at partdiff \n";
+    LLVM_DEBUG(dbgs() << "unknows at partdiff \n");
     for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
          UnknownIter++) {
-      errs() << (*UnknownIter).first->original_str << " ";
-      (*UnknownIter).second->dump();
+      LLVM_DEBUG(dbgs() << (*UnknownIter).first->original_str << " ");
+      LLVM_DEBUG((*UnknownIter).second->dump());
     }
     // locate the node in the expression tree which corresponds to the BIDY
     ExprTreeNode *BIDYNode = locateNodeWithParticularExprTreeOp(Node, ETO_BIDY);
     if (BIDYNode == nullptr) {
-      errs() << "NO BIDY node \n";
+      LLVM_DEBUG(dbgs() << "NO BIDY node \n");
       return insertConstantNode(Location, (unsigned long long)(0));
     } else {
-      errs() << "BIDY node \n";
+      LLVM_DEBUG(dbgs() << "BIDY node \n");
     }
     // traverse up the tree to find multipliers
     std::vector<ExprTreeNode *> Multipliers =
         findMultipliersByTraversingUpExprTree(Node, BIDYNode);
     std::vector<Value *> MultiplierInCode;
-    errs() << "multipliers => ";
+    LLVM_DEBUG(dbgs() << "multipliers => ");
     for (auto Multiplier = Multipliers.begin(); Multiplier != Multipliers.end();
          Multiplier++) {
-      errs() << (*Multiplier)->original_str << ".";
+      LLVM_DEBUG(dbgs() << (*Multiplier)->original_str << ".");
       llvm::Value *Result =
           insertTreeEvaluationCode(Location, CI, Unknowns, *Multiplier);
       if ((*Multiplier)->parent->op == ETO_SHL) {
@@ -3249,11 +5891,11 @@ struct DynamicHostTransform : public ModulePass {
       }
       MultiplierInCode.push_back(Result);
     }
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "\n");
     auto Accumulator = insertConstantNode(Location, (unsigned)1);
     for (auto Multiplier = MultiplierInCode.begin();
          Multiplier != MultiplierInCode.end(); Multiplier++) {
-      (*Multiplier)->dump();
+      LLVM_DEBUG((*Multiplier)->dump());
       Accumulator =
           insertComputationNode(Location, Accumulator, *Multiplier, ETO_MUL);
     }
@@ -3269,28 +5911,28 @@ struct DynamicHostTransform : public ModulePass {
                                                ExprTreeNode *Node) {
     std::map<ExprTreeNode *, Value *> Unknowns;
     identifyUnknownsFromExpressionTree(Location, CI, Unknowns, Node);
-    errs() << "unknows at partdiff phi \n";
+    LLVM_DEBUG(dbgs() << "unknows at partdiff phi \n");
     for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
          UnknownIter++) {
-      errs() << (*UnknownIter).first->original_str << " ";
-      (*UnknownIter).second->dump();
+      LLVM_DEBUG(dbgs() << (*UnknownIter).first->original_str << " ");
+      LLVM_DEBUG((*UnknownIter).second->dump());
     }
     // locate the node in the expression tree which corresponds to the PHI
     ExprTreeNode *Phi = locateNodeWithParticularExprTreeOp(Node, ETO_PHI);
     ExprTreeNode *PhiTerm =
         locateNodeWithParticularExprTreeOp(Node, ETO_PHI_TERM);
     if (Phi == nullptr || PhiTerm == nullptr) {
-      errs() << "NO PHI node \n";
+      LLVM_DEBUG(dbgs() << "NO PHI node \n");
       return insertConstantNode(Location, (unsigned long long)(0));
     }
-    errs() << "PHI node \n";
+    LLVM_DEBUG(dbgs() << "PHI node \n");
     std::vector<ExprTreeNode *> Multipliers =
         findMultipliersByTraversingUpExprTree(Node, Phi);
     std::vector<Value *> MultiplierInCode;
-    errs() << "multipliers => ";
+    LLVM_DEBUG(dbgs() << "multipliers => ");
     for (auto Multiplier = Multipliers.begin(); Multiplier != Multipliers.end();
          Multiplier++) {
-      errs() << (*Multiplier)->original_str << ".";
+      LLVM_DEBUG(dbgs() << (*Multiplier)->original_str << ".");
       llvm::Value *Result =
           insertTreeEvaluationCode(Location, CI, Unknowns, *Multiplier);
       if ((*Multiplier)->parent->op == ETO_SHL) {
@@ -3298,12 +5940,12 @@ struct DynamicHostTransform : public ModulePass {
       }
       MultiplierInCode.push_back(Result);
     }
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "\n");
     auto Accumulator = insertConstantNode(Location, (unsigned)1);
-    errs() << "MultiplierInCode" << MultiplierInCode.size() << "\n";  
+    LLVM_DEBUG(dbgs() << "MultiplierInCode" << MultiplierInCode.size() << "\n");  
     for (auto Multiplier = MultiplierInCode.begin();
          Multiplier != MultiplierInCode.end(); Multiplier++) {
-      (*Multiplier)->dump();
+      LLVM_DEBUG((*Multiplier)->dump());
       Accumulator =
           insertComputationNode(Location, Accumulator, *Multiplier, ETO_MUL);
     }
@@ -3327,16 +5969,16 @@ struct DynamicHostTransform : public ModulePass {
     }
     auto PhiAdd = insertConstantNode(Location, unsigned(0));
     for (auto Adder = Adders.begin(); Adder != Adders.end(); Adder++) {
-      errs() << "adder => " << (*Adder)->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "adder => " << (*Adder)->original_str << "\n");
       llvm::Value *Result = insertTreeEvaluationCode(Location, CI, Unknowns, *Adder);
       PhiAdd = insertComputationNode(Location, PhiAdd, Result, ETO_ADD);
     }
-    errs() << "phiadd\n";
-    PhiAdd->dump();
+    LLVM_DEBUG(dbgs() << "phiadd\n");
+    LLVM_DEBUG(PhiAdd->dump());
     Accumulator = insertCodeToCastInt32ToInt64(Location, Accumulator);
     PhiAdd = insertCodeToCastInt32ToInt64(Location, PhiAdd);
     Accumulator = insertComputationNode(Location, Accumulator, PhiAdd, ETO_MUL);
-    Accumulator->dump();
+    LLVM_DEBUG(Accumulator->dump());
     // insertCodeToPrintGenericInt64(CI, Accumulator);
     insertCodeToAddPDPhi(Location, Allocation, Accumulator);
     return Accumulator;
@@ -3467,7 +6109,7 @@ struct DynamicHostTransform : public ModulePass {
     std::string OriginalKernelName = getOriginalKernelName(KernelName.str());
     auto LIV = KernelInvocationToEnclosingLIVMap[CI];
     if (LIV == nullptr) {
-      errs() << "PANIC: no enclosing loop found for kernel invocation\n";
+      LLVM_DEBUG(dbgs() << "PANIC: no enclosing loop found for kernel invocation\n");
       return false;
     }
     unsigned LoopArg = KernelInvocationToLIVToArgNumMap[CI][LIV];
@@ -3478,7 +6120,7 @@ struct DynamicHostTransform : public ModulePass {
       llvm::Value *gdimxy_value = KernelInvocationToGridDimXYValueMap[CI];
       if (gdimxy_value) {
         assert(gdimxy_value->getType()->isIntegerTy(64));
-        errs() << "gdimxy value found\n";
+        LLVM_DEBUG(dbgs() << "gdimxy value found\n");
         Function *F = CI->getParent()->getParent();
         LLVMContext &Ctx = F->getContext();
         IRBuilder<> Builder(CI);
@@ -3494,7 +6136,7 @@ struct DynamicHostTransform : public ModulePass {
     assert(gridDimXValue != nullptr);
     // traverse gridDimXValue to see if it contains LIV
     if (isDependentOn(gridDimXValue, LIV)) {
-      errs() << "gridDimXValue is dependent on LIV\n";
+      LLVM_DEBUG(dbgs() << "gridDimXValue is dependent on LIV\n");
       return false;
     }
     return true;
@@ -3518,8 +6160,8 @@ struct DynamicHostTransform : public ModulePass {
 
   void identifyIterationDependentAccesses(
       Instruction *Location, CallBase *CI,
-      std::map<unsigned, Value *> LoopIDToNumIterationsMap) {
-    errs() << "identify iteration dependent accesses\n";
+      const std::map<unsigned, Value *> &LoopIDToNumIterationsMap) {
+    LLVM_DEBUG(dbgs() << "identify iteration dependent accesses\n");
     auto *KernelPointer = CI->getArgOperand(0);
     auto *KernelFunction = dyn_cast_or_null<Function>(KernelPointer);
     auto KernelName = KernelFunction->getName();
@@ -3529,24 +6171,24 @@ struct DynamicHostTransform : public ModulePass {
     // get the host side loop induction variable
     auto LIV = KernelInvocationToEnclosingLIVMap[CI];
     if (LIV == nullptr) {
-      errs() << "PANIC: no enclosing loop found for kernel invocation\n";
+      LLVM_DEBUG(dbgs() << "PANIC: no enclosing loop found for kernel invocation\n");
       return;
     }
     // looparg is the host side LIV that is used in the kernel for some
     // computation
     unsigned LoopArg = KernelInvocationToLIVToArgNumMap[CI][LIV];
-    errs() << "loop arg is " << LoopArg << "\n";
+    LLVM_DEBUG(dbgs() << "loop arg is " << LoopArg << "\n");
     for (auto AID = AccessIDToExprMap.begin(); AID != AccessIDToExprMap.end();
          AID++) {
       auto Expr = (*AID).second;
       if (containsGivenArgOp(Expr, LoopArg)) {
-        errs() << "access id " << (*AID).first << " is dependent on loop arg "
-               << LoopArg << "\n";
+        LLVM_DEBUG(dbgs() << "access id " << (*AID).first << " is dependent on loop arg "
+               << LoopArg << "\n");
         // need max grid dim, block dim, and loop bound
         std::map<unsigned, unsigned> AccessIDToLoopIDMap =
             KernelNameToAccessIDToEnclosingLoopMap[OriginalKernelName];
         auto LoopID = AccessIDToLoopIDMap[AID->first];
-        llvm::Value *LoopIters = LoopIDToNumIterationsMap[LoopID];
+        llvm::Value *LoopIters = lookupOrDefault(LoopIDToNumIterationsMap, LoopID);
         auto wss = estimateWorkingSetSizeIteration(Location, CI, (*AID).second,
                                                    LoopArg, LoopIters);
         /* insertCodeToPrintGenericInt32(Location, wss); */
@@ -3587,7 +6229,7 @@ struct DynamicHostTransform : public ModulePass {
       // assert(false);
     } else {
       if (node->op == ETO_PHI) {
-        errs() << "PHI TERM\n";
+        LLVM_DEBUG(dbgs() << "PHI TERM\n");
         return;
       }
       /* errs() << "unknown check? not terminal\n" << "\n"; */
@@ -3605,7 +6247,7 @@ struct DynamicHostTransform : public ModulePass {
                              ExprTreeNodeAdvanced *node) {
     if (node == nullptr)
       return;
-    errs() << "id min for " << node->original_str << "\n";
+    LLVM_DEBUG(dbgs() << "id min for " << node->original_str << "\n");
     if (isTerminal(node)) {
       if (node->op == ETO_TIDX) {
         auto unknown = insertConstantNode(Location, unsigned(0));
@@ -3631,7 +6273,7 @@ struct DynamicHostTransform : public ModulePass {
       // assert(false);
     } else {
       if (node->op == ETO_PHI) {
-        errs() << "PHI TERM\n";
+        LLVM_DEBUG(dbgs() << "PHI TERM\n");
             for(auto child = node->children.begin(); child != node->children.end(); child++) {
                 identifyMinForUnknowsAdvanced(Location, CI, Unknowns, *child);
             }
@@ -3670,15 +6312,15 @@ struct DynamicHostTransform : public ModulePass {
         auto gdimx_value =
             KernelInvocationToGridSizeValueMap[CI][AXIS_TYPE_GDIMX];
         if (gdimx_value) {
-          errs() << "gdimx value found\n";
-          gdimx_value->dump();
+          LLVM_DEBUG(dbgs() << "gdimx value found\n");
+          LLVM_DEBUG(gdimx_value->dump());
           Unknowns[node] = gdimx_value - 1;
           return;
         }
         llvm::Value *gdimxy_value = KernelInvocationToGridDimXYValueMap[CI];
         if (gdimxy_value) {
           assert(gdimxy_value->getType()->isIntegerTy(64));
-          errs() << "gdimxy value found\n";
+          LLVM_DEBUG(dbgs() << "gdimxy value found\n");
           Function *F = CI->getParent()->getParent();
           LLVMContext &Ctx = F->getContext();
           IRBuilder<> Builder(Location);
@@ -3693,7 +6335,7 @@ struct DynamicHostTransform : public ModulePass {
           return;
         }
         unsigned gdimx = KernelInvocationToGridSizeMap[CI][AXIS_TYPE_GDIMX];
-        errs() << "Gridm is " << gdimx << "\n";
+        LLVM_DEBUG(dbgs() << "Gridm is " << gdimx << "\n");
         /* unknown->dump(); */
         auto unknown = insertConstantNode(Location, gdimx - 1);
         Unknowns[node] = (unknown);
@@ -3703,15 +6345,15 @@ struct DynamicHostTransform : public ModulePass {
         auto gdimy_value =
             KernelInvocationToGridSizeValueMap[CI][AXIS_TYPE_GDIMY];
         if (gdimy_value) {
-          errs() << "gdimy value found\n";
-          gdimy_value->dump();
+          LLVM_DEBUG(dbgs() << "gdimy value found\n");
+          LLVM_DEBUG(gdimy_value->dump());
           Unknowns[node] = gdimy_value - 1;
           return;
         }
         llvm::Value *gdimxy_value = KernelInvocationToGridDimXYValueMap[CI];
         if (gdimxy_value) {
           assert(gdimxy_value->getType()->isIntegerTy(64));
-          errs() << "gdimxy value found\n";
+          LLVM_DEBUG(dbgs() << "gdimxy value found\n");
           Function *F = CI->getParent()->getParent();
           LLVMContext &Ctx = F->getContext();
           IRBuilder<> Builder(Location);
@@ -3725,7 +6367,7 @@ struct DynamicHostTransform : public ModulePass {
           return;
         }
         unsigned gdimy = KernelInvocationToGridSizeMap[CI][AXIS_TYPE_GDIMY];
-        errs() << "Gridm is " << gdimy << "\n";
+        LLVM_DEBUG(dbgs() << "Gridm is " << gdimy << "\n");
         /* unknown->dump(); */
         auto unknown = insertConstantNode(Location, gdimy - 1);
         Unknowns[node] = (unknown);
@@ -3735,7 +6377,7 @@ struct DynamicHostTransform : public ModulePass {
       // assert(false);
     } else {
       if (node->op == ETO_PHI) {
-        errs() << "PHI TERM haha not handled\n";
+        LLVM_DEBUG(dbgs() << "PHI TERM haha not handled\n");
         return;
       }
       /* errs() << "unknown check? not terminal\n" << "\n"; */
@@ -3753,7 +6395,7 @@ struct DynamicHostTransform : public ModulePass {
                              ExprTreeNodeAdvanced *node) {
     if (node == nullptr)
       return;
-    errs() << "id max for " << node->original_str << "\n";
+    LLVM_DEBUG(dbgs() << "id max for " << node->original_str << "\n");
     if (isTerminal(node)) {
       if (node->op == ETO_TIDX) {
         unsigned bdimx = KernelInvocationToBlockSizeMap[CI][AXIS_TYPE_BDIMX];
@@ -3783,7 +6425,7 @@ struct DynamicHostTransform : public ModulePass {
       // assert(false);
     } else {
         if (node->op == ETO_PHI) {
-            errs() << "PHI TERM haha not handled\n";
+            LLVM_DEBUG(dbgs() << "PHI TERM haha not handled\n");
             for(auto child = node->children.begin(); child != node->children.end(); child++) {
                 identifyMaxForUnknowsAdvanced(Location, CI, Unknowns, *child);
             }
@@ -3806,7 +6448,7 @@ struct DynamicHostTransform : public ModulePass {
     // TODO: add bidx, bidy, tidx, tidy etc to the unknowns
     // for example, bidx = gridDimX - 1 // since max
     // also tidx = blockDimX - 1 // since max
-      errs() << "insert code to estimate max value\n";
+      LLVM_DEBUG(dbgs() << "insert code to estimate max value\n");
     identifyMaxForUnknows(Location, CI, Unknowns, Node);
     return insertTreeEvaluationCode(Location, CI, Unknowns, Node, LoopIters);
     // return nullptr;
@@ -3819,11 +6461,11 @@ struct DynamicHostTransform : public ModulePass {
                                ExprTreeNodeAdvanced *Node,
                                std::map<ExprTreeNodeAdvanced *, Value *> Unknowns,
                                unsigned LoopArg, Value *LoopIters,
-                               std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
+                               const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
     // TODO: add bidx, bidy, tidx, tidy etc to the unknowns
     // for example, bidx = gridDimX - 1 // since max
     // also tidx = blockDimX - 1 // since max
-      errs() << "insert code to estimate max value\n";
+      LLVM_DEBUG(dbgs() << "insert code to estimate max value\n");
     identifyMaxForUnknowsAdvanced(Location, CI, Unknowns, Node);
     return insertTreeEvaluationCodeAdvanced(Location, CI, Unknowns, Node, false, LoopIDToNumIterationsMap);
     // return nullptr;
@@ -3832,7 +6474,7 @@ struct DynamicHostTransform : public ModulePass {
   Value *insertCodeToEstimateMinValue(
       Instruction *Location, CallBase *CI, ExprTreeNode *Node,
       std::map<ExprTreeNode *, Value *> Unknowns, unsigned LoopArg) {
-      errs() << "insert code to estimate min value\n";
+      LLVM_DEBUG(dbgs() << "insert code to estimate min value\n");
     identifyMinForUnknows(Location, CI, Unknowns, Node);
     auto zero = insertConstantNode(Location, (unsigned)0);
     return insertTreeEvaluationCode(Location, CI, Unknowns, Node, zero);
@@ -3840,8 +6482,8 @@ struct DynamicHostTransform : public ModulePass {
 
   Value *insertCodeToEstimateMinValueAdvanced(
       Instruction *Location, CallBase *CI, ExprTreeNodeAdvanced *Node,
-      std::map<ExprTreeNodeAdvanced *, Value *> Unknowns, unsigned LoopArg, std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
-      errs() << "insert code to estimate min value\n";
+      std::map<ExprTreeNodeAdvanced *, Value *> Unknowns, unsigned LoopArg, const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
+      LLVM_DEBUG(dbgs() << "insert code to estimate min value\n");
     identifyMinForUnknowsAdvanced(Location, CI, Unknowns, Node);
     auto zero = insertConstantNode(Location, (unsigned)0);
     return insertTreeEvaluationCodeAdvanced(Location, CI, Unknowns, Node, true, LoopIDToNumIterationsMap);  // true for minimize. change to enum
@@ -3855,10 +6497,10 @@ struct DynamicHostTransform : public ModulePass {
     // get the difference
     std::map<ExprTreeNode *, Value *> Unknowns;
     identifyUnknownsFromExpressionTree(Location, CI, Unknowns, Node);
-    errs() << "\nID unknowns\n";
+    LLVM_DEBUG(dbgs() << "\nID unknowns\n");
     for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
          UnknownIter++) {
-      (*UnknownIter).second->dump();
+      LLVM_DEBUG((*UnknownIter).second->dump());
     }
     Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, Node, Unknowns,
                                                    LoopArg, LoopIters);
@@ -3887,21 +6529,21 @@ struct DynamicHostTransform : public ModulePass {
   Value *estimateWorkingSetSizeAdvanced(Instruction *Location, CallBase *CI,
           ExprTreeNodeAdvanced *Node, Value* LoopIters,
           Value *BDIMX, Value* BDIMY,
-          std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
+          const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
       // get the max value the expression tree can take in an iteration
       // get the min value the expression tree can take in an iteration
       // get the difference
       std::map<ExprTreeNodeAdvanced*, Value *> Unknowns;
       // first though, check if expression is trivial
       if(isTrivialExpression(Location, CI, Node)) {
-          errs() << "Trivial expression\n";
+          LLVM_DEBUG(dbgs() << "Trivial expression\n");
           return insertConstantNode(Location, (unsigned long long)(1));
       }
       identifyUnknownsFromExpressionTreeAdvanced(Location, CI, Unknowns, Node);
-      errs() << "\nID unknowns\n";
+      LLVM_DEBUG(dbgs() << "\nID unknowns\n");
       for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
               UnknownIter++) {
-          (*UnknownIter).second->dump();
+          LLVM_DEBUG((*UnknownIter).second->dump());
       }
       Value *maxValue = insertCodeToEstimateMaxValueAdvanced(Location, CI, Node, Unknowns,
               0, LoopIters, LoopIDToNumIterationsMap);
@@ -3921,7 +6563,7 @@ struct DynamicHostTransform : public ModulePass {
           wss = insertCodeToCastInt32ToInt64(Location, wss);
       }
       // insertCodeToPrintGenericInt32(Location, wss);
-      errs() << "estimating working set size\n";
+      LLVM_DEBUG(dbgs() << "estimating working set size\n");
       Function *F = Location->getParent()->getParent();
       LLVMContext &Ctx = F->getContext();
       IRBuilder<> Builder(Location);
@@ -3948,10 +6590,10 @@ struct DynamicHostTransform : public ModulePass {
     // get the difference
     std::map<ExprTreeNode *, Value *> Unknowns;
     identifyUnknownsFromExpressionTree(Location, CI, Unknowns, Node);
-    errs() << "\nID unknowns\n";
+    LLVM_DEBUG(dbgs() << "\nID unknowns\n");
     for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
          UnknownIter++) {
-      (*UnknownIter).second->dump();
+      LLVM_DEBUG((*UnknownIter).second->dump());
     }
     Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, Node, Unknowns,
                                                    0, LoopIters);
@@ -3967,7 +6609,7 @@ struct DynamicHostTransform : public ModulePass {
         wss = insertCodeToCastInt32ToInt64(Location, wss);
     }
     // insertCodeToPrintGenericInt32(Location, wss);
-    errs() << "estimating working set size\n";
+    LLVM_DEBUG(dbgs() << "estimating working set size\n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -3999,20 +6641,20 @@ struct DynamicHostTransform : public ModulePass {
     IRBuilder<> Builder(Location);
     if (KernelInvocationToGridDimXYValueMap.find(CI) ==
         KernelInvocationToGridDimXYValueMap.end()) {
-      errs() << "PANIC: no grid dim XY value found\n";
+      LLVM_DEBUG(dbgs() << "PANIC: no grid dim XY value found\n");
       return nullptr;
     }
     if (KernelInvocationToGridDimZValueMap.find(CI) ==
         KernelInvocationToGridDimZValueMap.end()) {
-      errs() << "PANIC: no grid dim Z value found\n";
+      LLVM_DEBUG(dbgs() << "PANIC: no grid dim Z value found\n");
       return nullptr;
     }
     Value *GridDimXYValue = KernelInvocationToGridDimXYValueMap[CI];
     Value *GridDimZValue = KernelInvocationToGridDimZValueMap[CI];
-    GridDimXYValue->dump();
-    GridDimXYValue->getType()->dump();
-    GridDimZValue->dump();
-    GridDimZValue->getType()->dump();
+    LLVM_DEBUG(GridDimXYValue->dump());
+    LLVM_DEBUG(GridDimXYValue->getType()->dump());
+    LLVM_DEBUG(GridDimZValue->dump());
+    LLVM_DEBUG(GridDimZValue->getType()->dump());
     assert(GridDimXYValue->getType()->isIntegerTy(64));
     assert(GridDimZValue->getType()->isIntegerTy(32));
     // GridDimY = GridXY >> 32;
@@ -4067,15 +6709,44 @@ struct DynamicHostTransform : public ModulePass {
     auto Fn = F->getParent()->getOrInsertFunction("penguinSuperPrefetchWrapper",
                                                   Type::getVoidTy(Ctx), 
                                                   Type::getInt32Ty(Ctx));
+    if (InlinePrefetchGuard) {
+      // if (period != 0 && iter % period == 0) penguinSuperPrefetchWrapper(iter)
+      auto *PeriodVar = F->getParent()->getOrInsertGlobal(
+          "penguin_prefetch_period", Type::getInt32Ty(Ctx));
+      Value *Period = Builder.CreateLoad(Type::getInt32Ty(Ctx), PeriodVar);
+      Period = Builder.CreateZExtOrTrunc(Period, LIV->getType());
+      Instruction *Active = SplitBlockAndInsertIfThen(
+          Builder.CreateICmpNE(Period, ConstantInt::get(LIV->getType(), 0)),
+          Location, false);
+      Builder.SetInsertPoint(Active);
+      Instruction *Boundary = SplitBlockAndInsertIfThen(
+          Builder.CreateICmpEQ(Builder.CreateURem(LIV, Period),
+                               ConstantInt::get(LIV->getType(), 0)),
+          Active, false);
+      Builder.SetInsertPoint(Boundary);
+    }
     auto *Result = Builder.CreateCall(Fn, Args);
+    // once, before the loop, and the loop around it
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    auto SetLoop = [&](DenseMap<Value *, LoopShape> &Shapes, StringRef Name) {
+      auto Shape = Shapes.find(LIV);
+      if (Shape == Shapes.end())
+        return;
+      Builder.SetInsertPoint(Shape->second.Preheader->getTerminator());
+      auto Fn = F->getParent()->getOrInsertFunction(
+          Name, Type::getVoidTy(Ctx), Int64Ty, Int64Ty, Int64Ty);
+      Builder.CreateCall(Fn, Shape->second.Values);
+    };
+    SetLoop(LIVToLoopShapeMap, "penguinSetPrefetchLoop");
+    SetLoop(LIVToOuterLoopShapeMap, "penguinSetPrefetchOuterLoop");
     return Result;
   }
 
   // insert an block which will run on the first iteration only
   llvm::Instruction *insertCodeForFirstIterationExecution(Instruction *Location,
                                                           Value *LIV) {
-      errs() << "first iteration execution at \n";
-      LIV->dump();
+      LLVM_DEBUG(dbgs() << "first iteration execution at \n");
+      LLVM_DEBUG(LIV->dump());
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4083,8 +6754,12 @@ struct DynamicHostTransform : public ModulePass {
     // Builder.CreateCondBr(Builder.CreateICmpEQ(LIV, Builder.getInt32(0)),
     //  Builder.GetInsertBlock(), Builder.GetInsertBlock());
     // BasicBlock* FirstIterBB = BasicBlock::Create(Ctx, "first_iter");
+    // the loop may not start at 0, e.g. for (i = 1; i <= V - 1; i++)
+    Value *Initial = LIVToInitialValueMap.lookup(LIV);
+    if (!Initial || Initial->getType() != LIV->getType())
+      Initial = ConstantInt::get(LIV->getType(), 0);
     llvm::Instruction *IfThen = SplitBlockAndInsertIfThen(
-        Builder.CreateICmpEQ(LIV, Builder.getInt32(0)), Location, false);
+        Builder.CreateICmpEQ(LIV, Initial), Location, false);
     Builder.SetInsertPoint(IfThen);
     // auto fortytwo = insertConstantNode(IfThen, unsigned(42));
     // insertCodeToPrintGenericInt32(IfThen, fortytwo);
@@ -4111,27 +6786,27 @@ struct DynamicHostTransform : public ModulePass {
         LoopIDToLoopBoundsMap[OriginalKernelName];
     for (auto LoopID = kernelLoopToBoundsMap.begin();
          LoopID != kernelLoopToBoundsMap.end(); LoopID++) {
-      errs() << "Loop ID = " << LoopID->first << "\n";
+      LLVM_DEBUG(dbgs() << "Loop ID = " << LoopID->first << "\n");
       ExprTreeNode *LoopIters = partiallyEvaluatedLoopIters(
           Location, CI, OriginalKernelName, LoopID->first);
       if (LoopIters == nullptr) {
-        errs() << "\nPANIC: serious problem with partially evaluated loop "
-                  "iters\n";
+        LLVM_DEBUG(dbgs() << "\nPANIC: serious problem with partially evaluated loop "
+                  "iters\n");
         /* assert(false); */
         LoopIDToIncompMap[LoopID->first] = true;
       } else {
         std::map<ExprTreeNode *, Value *> Unknowns;
         identifyUnknownsFromExpressionTree(Location, CI, Unknowns, LoopIters);
-        errs() << "\nID unknowns\n";
+        LLVM_DEBUG(dbgs() << "\nID unknowns\n");
         for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
              UnknownIter++) {
-          (*UnknownIter).second->dump();
+          LLVM_DEBUG((*UnknownIter).second->dump());
         }
         auto ItersValue =
             insertLoopItersEvaluationCode(Location, CI, Unknowns, LoopIters);
         LoopIDToNumIterationsMap[LoopID->first] = ItersValue;
-        errs() << "itersvalue = ";
-        ItersValue->dump();
+        LLVM_DEBUG(dbgs() << "itersvalue = ");
+        LLVM_DEBUG(ItersValue->dump());
         insertCodeToPrintGenericInt32(Location, ItersValue);
         LoopIDToIncompMap[LoopID->first] = false;
       }
@@ -4144,22 +6819,22 @@ struct DynamicHostTransform : public ModulePass {
   void insertCodeToComputeConditionalExecutionProbability(
       Instruction *Location, CallBase *CI,
       std::map<unsigned, Value*> &IfIDToProbMap) {
-    errs() << "bedug hello\n";
+    LLVM_DEBUG(dbgs() << "bedug hello\n");
     for(auto IfID = IfIDToCondMap.begin();
         IfID != IfIDToCondMap.end(); IfID++) {
-      errs() << "\nIF ID = " << IfID->first;
+      LLVM_DEBUG(dbgs() << "\nIF ID = " << IfID->first);
       ExprTreeNode* expr = createExpressionTree(IfID->second);
       std::map<ExprTreeNode *, Value *> Unknowns;
       identifyUnknownsFromExpressionTree(Location, CI, Unknowns, expr);
-      errs() << "\nID unknowns\n";
+      LLVM_DEBUG(dbgs() << "\nID unknowns\n");
       for (auto UnknownIter = Unknowns.begin(); UnknownIter != Unknowns.end();
           UnknownIter++) {
-        (*UnknownIter).second->dump();
+        LLVM_DEBUG((*UnknownIter).second->dump());
       }
         auto NumExecs =
             insertIfProbEvalCode(Location, CI, Unknowns, expr);
-        errs() << "bedug hello 2\n";
-        NumExecs->dump();
+        LLVM_DEBUG(dbgs() << "bedug hello 2\n");
+        LLVM_DEBUG(NumExecs->dump());
         insertCodeToPrintGenericFloat64(Location, NumExecs);
     }
   }
@@ -4167,16 +6842,16 @@ struct DynamicHostTransform : public ModulePass {
   // identify all the nested loops, sum up (multiply) the number of iterations.
   Value* insertCodeComputeLoopIterationCountNested(
           Instruction* Location, unsigned loopid,
-          std::map<unsigned, Value*> LoopIDToNumIterationsMap) {
-      errs() << "nested loop count evaluation. assuming loopid to num iters map is populated\n";
-      Value* LoopIters = LoopIDToNumIterationsMap[loopid];
+          const std::map<unsigned, Value*> &LoopIDToNumIterationsMap) {
+      LLVM_DEBUG(dbgs() << "nested loop count evaluation. assuming loopid to num iters map is populated\n");
+      Value* LoopIters = lookupOrDefault(LoopIDToNumIterationsMap, loopid);
       if(LoopIters->getType()->isIntegerTy(32)) {
           LoopIters = insertCodeToCastInt32ToInt64(Location, LoopIters);
       }
       unsigned parentLoopId = LoopIDToParentLoopIDMap[loopid];
       while(parentLoopId != 0) {
-          errs() << "lid = " << loopid << " pid = " << parentLoopId << "\n";
-          Value* ParentLoopIters = LoopIDToNumIterationsMap[parentLoopId];
+          LLVM_DEBUG(dbgs() << "lid = " << loopid << " pid = " << parentLoopId << "\n");
+          Value* ParentLoopIters = lookupOrDefault(LoopIDToNumIterationsMap, parentLoopId);
           LoopIters = insertCodeToMultiplyInt64(Location, LoopIters, ParentLoopIters);
           loopid = parentLoopId;
           parentLoopId = LoopIDToParentLoopIDMap[loopid];
@@ -4185,21 +6860,27 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Instruction* insertPointForFirstInvocationNonIter(Instruction* Location) {
-      errs() << "insertPointForFirstInvocationNonIter\n:";
-      Location->dump();
+      LLVM_DEBUG(dbgs() << "insertPointForFirstInvocationNonIter\n:");
+      LLVM_DEBUG(Location->dump());
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
     /* Value *Args[] = {}; */
         ArrayRef<Value *> PrintArgs = {};
-    llvm::FunctionCallee AddAIDToInvocationID = F->getParent()->getOrInsertFunction(
-        "MemoryMgmtFirstInvocationNonIter", Type::getVoidTy(Ctx));
-    return Builder.CreateCall(AddAIDToInvocationID, PrintArgs);
+    Instruction *First = nullptr;
+    for (const char *Name : plannerNames("MemoryMgmtFirstInvocationNonIterStatic",
+                                         "MemoryMgmtFirstInvocationNonIter")) {
+      llvm::FunctionCallee AddAIDToInvocationID =
+          F->getParent()->getOrInsertFunction(Name, Type::getVoidTy(Ctx));
+      Instruction *Call = Builder.CreateCall(AddAIDToInvocationID, PrintArgs);
+      First = First ? First : Call;
+    }
+    return First;
     // return a special point
   }
 
   void insertCodeToRecordReuse(Instruction* Location, unsigned invid, unsigned aid, Value* ac, Value* Allocation) {
-      errs() << "insert code to record reuse\n";
+      LLVM_DEBUG(dbgs() << "insert code to record reuse\n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4232,23 +6913,383 @@ struct DynamicHostTransform : public ModulePass {
         Type::getInt64Ty(Ctx));
     Builder.CreateCall(AddAIDToAC, Args3);
   }
+
+  // One record of a launch site, see penguin_launch_record in the runtime
+  enum LaunchRecordFlags {
+    LR_PCHASE = 1,
+    LR_INCOMP = 2,
+    LR_ACCESS = 4,
+    LR_WSS = 8,
+    LR_STORE = 16,
+    LR_FOOTPRINT = 32,
+    LR_DEAD = 64,
+    LR_NEXT = 128,
+    LR_ATOMIC = 256,
+    LR_BROADCAST = 512
+  };
+  struct LaunchRecord {
+    unsigned AID;
+    unsigned Flags;
+    Value *Allocation;
+    Value *AC;
+    Value *WSS;
+    // byte range of the access, [Lo, Hi), and the bytes one thread block
+    // covers, with LR_FOOTPRINT
+    Value *Lo = nullptr;
+    Value *Hi = nullptr;
+    Value *BlockSpan = nullptr;
+    // the argument of the kernel or library call the allocation is passed
+    // as, which the runtime's overrides are keyed by
+    unsigned Arg = NoArg;
+  };
+  static constexpr unsigned NoArg = ~0U;
+
+  // Computes a footprint bound of CudaAnalysis at the launch, as an i64;
+  // nullptr if the tree has a term other than a constant, an argument or a
+  // block or grid dim
+  Value *insertCodeToEvaluateBound(Instruction *Location, CallBase *CI,
+                                   ExprTreeNode *Node, Value *GDimX,
+                                   Value *GDimY) {
+    if (Node == nullptr)
+      return nullptr;
+    IRBuilder<> Builder(Location);
+    auto *Int64Ty = Builder.getInt64Ty();
+    auto Leaf = [&](Value *V) -> Value * {
+      if (V == nullptr || !V->getType()->isIntegerTy())
+        return nullptr;
+      return Builder.CreateZExtOrTrunc(V, Int64Ty);
+    };
+    switch (Node->op) {
+    case ETO_CONST:
+      return Builder.getInt64(std::stoull(Node->original_str));
+    case ETO_ARG:
+      return Leaf(KernelInvocationToArgNumberToActualArgMap[CI][Node->arg]);
+    case ETO_BDIMX:
+      return Builder.getInt64(KernelInvocationToBlockSizeMap[CI][AXIS_TYPE_BDIMX]);
+    case ETO_BDIMY:
+      return Builder.getInt64(KernelInvocationToBlockSizeMap[CI][AXIS_TYPE_BDIMY]);
+    case ETO_GDIMX:
+      return Leaf(GDimX);
+    case ETO_GDIMY:
+      return Leaf(GDimY);
+    case ETO_ADD:
+    case ETO_SUB:
+    case ETO_MUL:
+    case ETO_UDIV: {
+      Value *Left = insertCodeToEvaluateBound(Location, CI, Node->children[0],
+                                              GDimX, GDimY);
+      Value *Right = insertCodeToEvaluateBound(Location, CI, Node->children[1],
+                                               GDimX, GDimY);
+      if (!Left || !Right)
+        return nullptr;
+      if (Node->op == ETO_ADD)
+        return Builder.CreateAdd(Left, Right);
+      if (Node->op == ETO_MUL)
+        return Builder.CreateMul(Left, Right);
+      if (Node->op == ETO_SUB) {
+        // a lower bound below the argument is clamped to it
+        Value *Below = Builder.CreateICmpULT(Left, Right);
+        return Builder.CreateSelect(Below, Builder.getInt64(0),
+                                    Builder.CreateSub(Left, Right));
+      }
+      Value *Zero = Builder.CreateICmpEQ(Right, Builder.getInt64(0));
+      return Builder.CreateUDiv(
+          Left, Builder.CreateSelect(Zero, Builder.getInt64(1), Right));
+    }
+    default:
+      return nullptr;
+    }
+  }
+
+  // Emits one penguinRecordLaunch call for all records of a launch site. The
+  // access IDs and flags go into a constant global, the run time values into
+  // a stack array allocated once in the entry block.
+  // Local an allocation pointer is loaded from at a launch, which names the
+  // allocation across the launches of the function; nullptr if there is none
+  AllocaInst *getAllocationRoot(Value *Allocation) {
+    auto *Ld = dyn_cast_or_null<LoadInst>(Allocation);
+    if (!Ld)
+      return nullptr;
+    return dyn_cast<AllocaInst>(Ld->getPointerOperand()->stripPointerCasts());
+  }
+
+  // Whether Addr only holds a kernel argument until its launch: it is stored
+  // into and its address goes into the argument array of cudaLaunchKernel
+  bool isLaunchArgumentSlot(Value *Addr) {
+    for (User *U : Addr->users()) {
+      if (isa<BitCastInst>(U)) {
+        if (!isLaunchArgumentSlot(U))
+          return false;
+        continue;
+      }
+      if (auto *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getPointerOperand() == Addr ||
+            isa<AllocaInst>(getUnderlyingObject(SI->getPointerOperand())))
+          continue;
+        return false;
+      }
+      if (auto *I = dyn_cast<Instruction>(U))
+        if (I->isLifetimeStartOrEnd())
+          continue;
+      return false;
+    }
+    return true;
+  }
+
+  // Whether the host never dereferences Ptr: it only goes to the argument
+  // slots of launches, to cudaFree and, as an integer, to the runtime
+  bool isOnlyPassedOn(Value *Ptr) {
+    for (User *U : Ptr->users()) {
+      if (isa<BitCastInst>(U)) {
+        if (!isOnlyPassedOn(U))
+          return false;
+        continue;
+      }
+      if (auto *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getValueOperand() == Ptr &&
+            isa<AllocaInst>(SI->getPointerOperand()->stripPointerCasts()) &&
+            isLaunchArgumentSlot(SI->getPointerOperand()->stripPointerCasts()))
+          continue;
+        return false;
+      }
+      if (isa<PtrToIntInst>(U)) {
+        if (all_of(U->users(), [](User *V) { return isa<CallBase>(V); }))
+          continue;
+        return false;
+      }
+      if (auto *Call = dyn_cast<CallBase>(U)) {
+        Function *Callee = Call->getCalledFunction();
+        if (Callee && Callee->getName() == "cudaFree")
+          continue;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Whether the allocation behind Root is only ever accessed by kernels: the
+  // pointer is set by cudaMalloc* and never stored over, and the host never
+  // reads through it. Its contents are dead after the last launch.
+  bool isDevicePrivate(Value *Root) {
+    for (User *U : Root->users()) {
+      if (isa<BitCastInst>(U)) {
+        if (!isDevicePrivate(U))
+          return false;
+        continue;
+      }
+      if (auto *Ld = dyn_cast<LoadInst>(U)) {
+        if (!isOnlyPassedOn(Ld))
+          return false;
+        continue;
+      }
+      if (isa<PtrToIntInst>(U)) {
+        if (all_of(U->users(), [](User *V) { return isa<CallBase>(V); }))
+          continue;
+        return false;
+      }
+      if (auto *Call = dyn_cast<CallBase>(U)) {
+        Function *Callee = Call->getCalledFunction();
+        if (Call->isLifetimeStartOrEnd() ||
+            (Callee && Callee->getName().startswith("cudaMalloc")))
+          continue;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Producer/consumer relation of the launches of every function, from the
+  // allocations each one loads and stores: an allocation is dead after a
+  // launch when no launch reachable from it accesses it and the host never
+  // does; the launch that follows one is the first reachable after it in
+  // program order, and its inputs are prefetched while the producer runs.
+  // An allocation argument without an access record counts as loaded and
+  // stored.
+  void buildDataflowGraph() {
+    std::map<Function *, std::vector<CallBase *>> FunctionToLaunchesMap;
+    auto &Modes = KernelInvocationToAllocationModesMap;
+    for (auto *KL : KernelLaunches) {
+      auto *CI = dyn_cast<CallBase>(KL);
+      auto *KernelFunction = dyn_cast_or_null<Function>(CI->getArgOperand(0));
+      if (!KernelFunction)
+        continue;
+      std::string OriginalKernelName =
+          getOriginalKernelName(KernelFunction->getName().str());
+      FunctionToLaunchesMap[CI->getFunction()].push_back(CI);
+      std::map<unsigned, unsigned> ArgModes =
+          getArgumentModes(OriginalKernelName);
+      for (auto &A : KernelInvocationToArgNumberToAllocationMap[CI]) {
+        AllocaInst *Root = getAllocationRoot(A.second);
+        if (!Root)
+          continue;
+        auto Mode = ArgModes.find(A.first);
+        Modes[CI][Root] |=
+            Mode != ArgModes.end() ? Mode->second : DF_LOAD | DF_STORE;
+      }
+    }
+    for (auto &FL : FunctionToLaunchesMap) {
+      std::vector<CallBase *> &Launches = FL.second;
+      // a launch the transform skips may access anything
+      unsigned NumLaunches = 0;
+      for (auto &I : instructions(FL.first))
+        if (auto *Call = dyn_cast<CallBase>(&I))
+          if (Call->getCalledFunction() &&
+              Call->getCalledFunction()->getName() == "cudaLaunchKernel")
+            NumLaunches++;
+      bool AllSeen = NumLaunches == Launches.size();
+      for (unsigned i = 0; i < Launches.size(); i++) {
+        CallBase *CI = Launches[i];
+        Instruction *After = CI->getNextNode();
+        if (auto *II = dyn_cast<InvokeInst>(CI))
+          After = &*II->getNormalDest()->getFirstInsertionPt();
+        for (auto &M : Modes[CI]) {
+          bool Later = !AllSeen;
+          for (auto *K : Launches)
+            Later = Later || (Modes[K].count(M.first) &&
+                              isPotentiallyReachable(After, K));
+          if (!Later && isDevicePrivate(M.first)) {
+            LLVM_DEBUG(dbgs() << "dead after invocation "
+                   << KernelInvocationToInvocationIDMap[CI] << "\n");
+            KernelInvocationToDeadRootsMap[CI].insert(M.first);
+          }
+        }
+        CallBase *Next = nullptr;
+        for (unsigned j = 1; j < Launches.size() && !Next; j++) {
+          CallBase *K = Launches[(i + j) % Launches.size()];
+          if (isPotentiallyReachable(After, K))
+            Next = K;
+        }
+        if (!Next)
+          continue;
+        for (auto &M : Modes[Next])
+          if ((M.second & DF_LOAD) && !Modes[CI].count(M.first))
+            KernelInvocationToNextInputsMap[CI].push_back(M.first);
+      }
+    }
+  }
+
+  // DF_LOAD and DF_STORE of the arguments of kernel KernelName the access
+  // records cover, by argument number
+  std::map<unsigned, unsigned> getArgumentModes(const std::string &KernelName) {
+    const std::set<unsigned> &StoreAIDs =
+        KernelNameToStoreAccessIDsMap[KernelName];
+    std::map<unsigned, unsigned> ArgModes;
+    for (auto &A : KernelNameToAccessIDToAllocationArgMap[KernelName])
+      ArgModes[A.second] |= StoreAIDs.count(A.first) ? DF_STORE : DF_LOAD;
+    return ArgModes;
+  }
+
+  // Armed, if given, is the flag of the site, see insertCodeToGuardRecords;
+  // Kernel the name the records' arguments are of, none if empty
+  void insertCodeToRecordLaunch(Instruction *Location, unsigned invid,
+                                std::vector<LaunchRecord> &Records,
+                                GlobalVariable *Armed = nullptr,
+                                StringRef Kernel = "") {
+    if (Records.empty())
+      return;
+    Function *F = Location->getParent()->getParent();
+    Module *M = F->getParent();
+    LLVMContext &Ctx = F->getContext();
+    IRBuilder<> Builder(Location);
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *Int64Ty = Type::getInt64Ty(Ctx);
+    auto *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+    auto *RecordTy = StructType::get(Ctx, {Int32Ty, Int32Ty, Int32Ty});
+    auto *RecordsTy = ArrayType::get(RecordTy, Records.size());
+    auto *DescTy = StructType::get(Ctx, {Int32Ty, Int32Ty,
+                                         RecordTy->getPointerTo(),
+                                         Int32Ty->getPointerTo(), Int8PtrTy});
+    auto *ValuesTy = StructType::get(
+        Ctx, {Int64Ty, Int64Ty, Int64Ty, Int64Ty, Int64Ty, Int64Ty});
+
+    std::vector<Constant *> RecordInits;
+    for (auto &R : Records)
+      RecordInits.push_back(ConstantStruct::get(
+          RecordTy,
+          {ConstantInt::get(Int32Ty, R.AID), ConstantInt::get(Int32Ty, R.Flags),
+           ConstantInt::get(Int32Ty, R.Arg)}));
+    auto *RecordsVar = new GlobalVariable(
+        *M, RecordsTy, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(RecordsTy, RecordInits), "penguin.launch.records");
+    Constant *Zero = ConstantInt::get(Int32Ty, 0);
+    Constant *FirstRecord = ConstantExpr::getInBoundsGetElementPtr(
+        RecordsTy, RecordsVar, ArrayRef<Constant *>({Zero, Zero}));
+    Constant *ArmedPtr =
+        Armed ? cast<Constant>(Armed)
+              : ConstantPointerNull::get(Int32Ty->getPointerTo());
+    Constant *KernelPtr =
+        Kernel.empty()
+            ? ConstantPointerNull::get(Int8PtrTy)
+            : Builder.CreateGlobalStringPtr(Kernel, "penguin.launch.kernel");
+    auto *DescVar = new GlobalVariable(
+        *M, DescTy, true, GlobalValue::PrivateLinkage,
+        ConstantStruct::get(DescTy, {ConstantInt::get(Int32Ty, invid),
+                                     ConstantInt::get(Int32Ty, Records.size()),
+                                     FirstRecord, ArmedPtr, KernelPtr}),
+        "penguin.launch.desc");
+
+    IRBuilder<> EntryBuilder(&*F->getEntryBlock().getFirstInsertionPt());
+    auto *Values = EntryBuilder.CreateAlloca(
+        ArrayType::get(ValuesTy, Records.size()), nullptr, "penguin.launch.values");
+    for (unsigned i = 0; i < Records.size(); i++) {
+      auto &R = Records[i];
+      auto Field = [&](unsigned FieldNo, Value *V) {
+        if (!V)
+          return;
+        if (V->getType()->isPointerTy())
+          V = Builder.CreatePtrToInt(V, Int64Ty);
+        else
+          V = Builder.CreateZExtOrTrunc(V, Int64Ty);
+        Builder.CreateStore(V, Builder.CreateConstInBoundsGEP2_32(
+                                   Values->getAllocatedType(), Values, i, FieldNo));
+      };
+      Field(0, R.Allocation);
+      Field(1, R.AC);
+      Field(2, R.WSS);
+      Field(3, R.Lo);
+      Field(4, R.Hi);
+      Field(5, R.BlockSpan);
+    }
+
+    llvm::FunctionCallee RecordLaunch = M->getOrInsertFunction(
+        "penguinRecordLaunch", Type::getVoidTy(Ctx), Int8PtrTy, Int8PtrTy);
+    Value *Args[] = {Builder.CreateBitCast(DescVar, Int8PtrTy),
+                     Builder.CreateBitCast(Values, Int8PtrTy)};
+    Builder.CreateCall(RecordLaunch, Args);
+  }
+
+  // if (penguin.launch.armed) { <records of the launch at Location> }: the
+  // runtime clears the flag once the site's records stop changing. Returns
+  // where the records go.
+  Instruction *insertCodeToGuardRecords(Instruction *Location,
+                                        GlobalVariable *&Armed) {
+    Module *M = Location->getModule();
+    auto *Int32Ty = Type::getInt32Ty(M->getContext());
+    Armed = new GlobalVariable(*M, Int32Ty, false, GlobalValue::PrivateLinkage,
+                               ConstantInt::get(Int32Ty, 1),
+                               "penguin.launch.armed");
+    IRBuilder<> Builder(Location);
+    Value *Cond = Builder.CreateICmpNE(Builder.CreateLoad(Int32Ty, Armed),
+                                       ConstantInt::get(Int32Ty, 0));
+    return SplitBlockAndInsertIfThen(Cond, Location, false);
+  }
   // find the loop bounds for the loop with the given loop id
 
   void insertCodeToComputeAccessDensity(Instruction* Location,
       CallBase *CI, Value *NumThreadsInGrid,
-      std::map<unsigned, Value *> LoopIDToNumIterationsMap,
-      std::map<unsigned, bool> LoopIDToIncompMap,
+      const std::map<unsigned, Value *> &LoopIDToNumIterationsMap,
+      const std::map<unsigned, bool> &LoopIDToIncompMap,
       std::map<CallBase *, Value *> &KernelInvocationToBDimXMap,
       std::map<CallBase *, Value *> &KernelInvocationToBDimYMap,
       std::map<CallBase *, Value *> &KernelInvocationToGDimXMap,
       std::map<CallBase *, Value *> &KernelInvocationToGDimYMap) {
-    errs() << "called function dynamic AD computation\n";
+    LLVM_DEBUG(dbgs() << "called function dynamic AD computation\n");
     // to compute access density, we need the following in real time.
     // 1. number of threads
     // 2. loop count inside the kernel
     // 3. size of data structures being accessed
     Function *F = CI->getParent()->getParent();
-    CI->dump();
+    LLVM_DEBUG(CI->dump());
     auto *KernelPointer = CI->getArgOperand(0);
     auto *KernelFunction = dyn_cast_or_null<Function>(KernelPointer);
     auto KernelName = KernelFunction->getName();
@@ -4261,7 +7302,24 @@ struct DynamicHostTransform : public ModulePass {
         KernelNameToAccessIDToExpressionTreeMap[OriginalKernelName];
     std::map<unsigned, ExprTreeNodeAdvanced *> AccessIDToAdvancedExprMap=
         KernelNameToAccessIDToAdvancedExpressionTreeMap[OriginalKernelName];
+    const std::set<unsigned> &StoreAIDs =
+        KernelNameToStoreAccessIDsMap[OriginalKernelName];
+    const std::set<unsigned> &AtomicArgs =
+        KernelNameToAtomicArgsMap[OriginalKernelName];
+    const std::map<unsigned, unsigned> &TileReuse =
+        KernelNameToAccessIDToTileReuseMap[OriginalKernelName];
+    const std::map<unsigned, AccessBranch> &Branches =
+        KernelNameToAccessIDToBranchMap[OriginalKernelName];
     std::set<Value *> MallocPointerKernArgs;
+    std::vector<LaunchRecord> Records;
+    bool StaticDecisions = useStaticDecisions(CI, LoopIDToIncompMap);
+    insertCodeToSetLaunchStream(Location, CI);
+    insertCodeToRecordLaunchShape(Location, CI);
+    // the reuse records of an iterative launch take the counts computed
+    // here, outside the guard; those launches record once per loop anyway
+    GlobalVariable *Armed = nullptr;
+    if (RecordGuard && !FirstInvocation && !AccessIDToLoopIDMap.empty())
+      Location = insertCodeToGuardRecords(Location, Armed);
     for (auto AID = AccessIDToLoopIDMap.begin();
          AID != AccessIDToLoopIDMap.end(); AID++) {
         // TODO :: add check if AID is involved with kernel invocation
@@ -4269,33 +7327,37 @@ struct DynamicHostTransform : public ModulePass {
       ExprTreeNode *Expr = AccessIDToExprMap[AID->first];
       ExprTreeNodeAdvanced *AdvExpr = AccessIDToAdvancedExprMap[AID->first];
       unsigned AllocArg = AccessIDToAllocArgMap[AID->first];
-      errs() << "allocation arg = " << AllocArg << "\n";
+      LLVM_DEBUG(dbgs() << "allocation arg = " << AllocArg << "\n");
       auto Allocation =
           KernelInvocationToArgNumberToAllocationMap[CI][AllocArg];
-      Allocation->dump();
+      LLVM_DEBUG(Allocation->dump());
       MallocPointerKernArgs.insert(Allocation);
+      // every record names its allocation, the runtime tracks which ones are
+      // only read and which ones atomics update
+      unsigned StoreFlag = (StoreAIDs.count(AID->first) ? LR_STORE : 0) |
+                           (AtomicArgs.count(AllocArg) ? LR_ATOMIC : 0);
       if(isPointerChase(Expr)) {
           // set the allocation as pointer chase
-          insertCodeToSetPChase(Location, AID->first, Allocation, true);
+          Records.push_back({AID->first, LR_PCHASE | StoreFlag, Allocation, nullptr, nullptr});
           continue; // continue with other accesses (AID for loop).
       }
       llvm::Value *ExecutionCount;
       llvm::Value *LoopIters;
       if (AID->second == 0) {
-        errs() << "\nAID = " << AID->first << " is not in a loop\n";
+        LLVM_DEBUG(dbgs() << "\nAID = " << AID->first << " is not in a loop\n");
         LoopIters = insertConstantNode(Location, unsigned(1));
         ExecutionCount = NumThreadsInGrid;
         // insertCodeToPrintGenericInt64(Location, ExecutionCount);
       } else {
-        errs() << "\nAID = " << AID->first;
-        errs() << "\nLoop ID = " << AID->second;
+        LLVM_DEBUG(dbgs() << "\nAID = " << AID->first);
+        LLVM_DEBUG(dbgs() << "\nLoop ID = " << AID->second);
         /* LoopIters = LoopIDToNumIterationsMap[AID->second]; // returns 32 bit */
         /* llvm::Value *LoopIters_64 = insertCodeToCastInt32ToInt64(Location, LoopIters); */
         // loop iters for nested loops
         // If loop bounds are hard to compute (i.e., unbounded), then cannot compute access density.
-        if(LoopIDToIncompMap[AID->second] == true) {
-            errs() << "loop is incomputable\n";
-          insertCodeToSetIncomp(Location, AID->first, true);
+        if(lookupOrDefault(LoopIDToIncompMap, AID->second) == true) {
+            LLVM_DEBUG(dbgs() << "loop is incomputable\n");
+          Records.push_back({AID->first, LR_INCOMP | StoreFlag, Allocation, nullptr, nullptr});
           continue; // continue with other accesses (AID for loop).
         }
        LoopIters= insertCodeComputeLoopIterationCountNested(Location, AID->second, LoopIDToNumIterationsMap); // returns 64 bit
@@ -4304,8 +7366,24 @@ struct DynamicHostTransform : public ModulePass {
         ExecutionCount = LoopItersTimesNumThreads;
         // insertCodeToPrintGenericInt64(Location, ExecutionCount);
       }
+      // a tile fill is counted by its bandwidth demand: one transfer per K
+      // shared memory accesses of the block
+      auto Reuse = TileReuse.find(AID->first);
+      if (Reuse != TileReuse.end())
+        ExecutionCount = insertComputationNode(
+            Location, ExecutionCount,
+            insertConstantNode(Location, (unsigned long long)Reuse->second),
+            ETO_UDIV);
+      auto Branch = Branches.find(AID->first);
+      if (Branch != Branches.end())
+        ExecutionCount = insertCodeToWeighByBranch(
+            Location, CI, Branch->second, ExecutionCount,
+            KernelInvocationToGDimXMap[CI], KernelInvocationToGDimYMap[CI]);
+      ExecutionCount = insertCodeToWeighBySectors(
+          Location, CI, OriginalKernelName, AID->first, ExecutionCount,
+          KernelInvocationToGDimXMap[CI], KernelInvocationToGDimYMap[CI]);
       // get the pointer to the data structure being accessed
-      insertCodeToAddAccessCount(Location, AID->first, Allocation, ExecutionCount);
+      Records.push_back({AID->first, LR_ACCESS | StoreFlag, Allocation, ExecutionCount, nullptr});
       // Next, we compute partial differences
       llvm::Value *PartDiff_bidx;
       PartDiff_bidx = insertCodeToComputePartDiff_bidx(Location, CI, Allocation, Expr);
@@ -4326,36 +7404,178 @@ struct DynamicHostTransform : public ModulePass {
       }
       auto wss_advanced = estimateWorkingSetSizeAdvanced(Location, CI, AdvExpr, LoopIters, KernelInvocationToBDimXMap[CI], KernelInvocationToBDimYMap[CI], LoopIDToNumIterationsMap);
       /* insertCodeToAddWSS(Location, Allocation, wss); */
-      auto aid_printer = insertConstantNode(Location, unsigned(AID->first));
-      insertCodeToPrintGenericInt32(Location, aid_printer);
-      insertCodeToAddWSS(Location, Allocation, wss_advanced, aid_printer);
+      Records.back().Flags |= LR_WSS;
+      Records.back().WSS = wss_advanced;
+      auto Footprint =
+          KernelNameToAccessIDToFootprintMap[OriginalKernelName].find(AID->first);
+      if (Footprint !=
+          KernelNameToAccessIDToFootprintMap[OriginalKernelName].end()) {
+        Value *Lo = insertCodeToEvaluateBound(Location, CI, Footprint->second.Lo,
+                                              KernelInvocationToGDimXMap[CI],
+                                              KernelInvocationToGDimYMap[CI]);
+        Value *Hi = insertCodeToEvaluateBound(Location, CI, Footprint->second.Hi,
+                                              KernelInvocationToGDimXMap[CI],
+                                              KernelInvocationToGDimYMap[CI]);
+        Value *BlockLo = insertCodeToEvaluateBound(
+            Location, CI, Footprint->second.BlockLo,
+            KernelInvocationToGDimXMap[CI], KernelInvocationToGDimYMap[CI]);
+        Value *BlockHi = insertCodeToEvaluateBound(
+            Location, CI, Footprint->second.BlockHi,
+            KernelInvocationToGDimXMap[CI], KernelInvocationToGDimYMap[CI]);
+        if (Lo && Hi) {
+          IRBuilder<> Builder(Location);
+          Value *Bytes = Builder.getInt64(Footprint->second.Bytes);
+          Records.back().Flags |= LR_FOOTPRINT;
+          if (Footprint->second.Broadcast)
+            Records.back().Flags |= LR_BROADCAST;
+          Records.back().Lo = Lo;
+          Records.back().Hi = Builder.CreateAdd(Hi, Bytes);
+          // 0 if unknown: the runtime then takes the whole range as live
+          if (BlockLo && BlockHi)
+            Records.back().BlockSpan = Builder.CreateAdd(
+                Builder.CreateSub(BlockHi,
+                                  Builder.CreateSelect(
+                                      Builder.CreateICmpULT(BlockHi, BlockLo),
+                                      BlockHi, BlockLo)),
+                Bytes);
+        }
+      }
       auto InvocationId = KernelInvocationToInvocationIDMap[CI];
-      insertCodeToAddAIDToInvocationID(Location, AID->first, InvocationId);
       // for reuse
       if(FirstInvocation) {
           insertCodeToRecordReuse(FirstInvocation, InvocationId, AID->first, ExecutionCount, Allocation);
       }
-      if(FirstInvocationNonIter && multiKernel == true) {
+      // the static planner reads the reuse records even for a single kernel
+      if(FirstInvocationNonIter && (multiKernel == true || StaticDecisions)) {
           insertCodeToRecordReuse(FirstInvocationNonIter, InvocationId, AID->first, ExecutionCount, Allocation);
       }
     }
+    // the access records so far, of their AIDs' arguments
+    for (auto &R : Records)
+      R.Arg = AccessIDToAllocArgMap[R.AID];
+    // an argument only atomics access has no access records of its own
+    for (unsigned Arg : AtomicArgs) {
+      bool Recorded = false;
+      for (auto &A : AccessIDToAllocArgMap)
+        Recorded |= A.second == Arg;
+      auto Allocation = KernelInvocationToArgNumberToAllocationMap[CI].find(Arg);
+      if (Recorded ||
+          Allocation == KernelInvocationToArgNumberToAllocationMap[CI].end() ||
+          !Allocation->second)
+        continue;
+      Records.push_back(
+          {0, LR_ATOMIC | LR_STORE, Allocation->second, nullptr, nullptr});
+      Records.back().Arg = Arg;
+    }
+    // the data-flow graph of the function, see buildDataflowGraph
+    const std::set<AllocaInst *> &DeadRoots = KernelInvocationToDeadRootsMap[CI];
+    for (auto &R : Records)
+      if (DeadRoots.count(getAllocationRoot(R.Allocation)))
+        R.Flags |= LR_DEAD;
+    for (auto *Root : KernelInvocationToNextInputsMap[CI]) {
+      IRBuilder<> Builder(Location);
+      Records.push_back({0, LR_NEXT,
+                         Builder.CreateLoad(Root->getAllocatedType(), Root),
+                         nullptr, nullptr});
+    }
+    insertCodeToRecordLaunch(Location, KernelInvocationToInvocationIDMap[CI],
+                             Records, Armed, OriginalKernelName);
     // iterate over each allocation, and print the access count
     // TODO: Ensure that MalloPointerKernArgs contains only the exact pointers
     // that are passed to the kernel.
     for (auto Pointer = MallocPointerKernArgs.begin();
          Pointer != MallocPointerKernArgs.end(); Pointer++) {
-      (*Pointer)->dump();
+      LLVM_DEBUG((*Pointer)->dump());
       // llvm::Value *AC = insertCodeToGetAccessCount(CI, *Pointer);
       // llvm::Value *Size = insertCodeToGetMemorySize(CI, *Pointer);
       // llvm::Value *AD = insertCodeToGetAccessDensity(CI, *Pointer);
     }
 
     auto InvocationInsertionPoint = KernelInvocationToInsertionPointMap[CI];
-    insertCodeToPerformInvocationMemoryMgmt(InvocationInsertionPoint, CI);
+    insertCodeToPerformInvocationMemoryMgmt(InvocationInsertionPoint, CI,
+                                            StaticDecisions);
 
     return;
   }
 
+  // Scales the access count of an access under a conditional by the share of
+  // the launch that takes its side: the indices of [Lo, Hi] that pass the
+  // check against Limit, when the condition is a bound check the arguments of
+  // this launch evaluate, the static edge probability otherwise
+  Value *insertCodeToWeighByBranch(Instruction *Location, CallBase *CI,
+                                   const AccessBranch &Branch, Value *Count,
+                                   Value *GDimX, Value *GDimY) {
+    IRBuilder<> Builder(Location);
+    Value *Lo = nullptr, *Hi = nullptr, *Limit = nullptr;
+    if (Branch.Lo && Branch.Hi && Branch.Limit) {
+      Lo = insertCodeToEvaluateBound(Location, CI, Branch.Lo, GDimX, GDimY);
+      Hi = insertCodeToEvaluateBound(Location, CI, Branch.Hi, GDimX, GDimY);
+      Limit = insertCodeToEvaluateBound(Location, CI, Branch.Limit, GDimX,
+                                        GDimY);
+    }
+    if (!Lo || !Hi || !Limit)
+      return Builder.CreateLShr(
+          Builder.CreateMul(Count, Builder.getInt64(Branch.Probability)), 16);
+    Value *End = Builder.CreateAdd(Hi, Builder.getInt64(1));
+    Value *First = Branch.Below ? Lo : Builder.CreateSelect(
+                                           Builder.CreateICmpUGT(Limit, Lo),
+                                           Limit, Lo);
+    Value *Last = Branch.Below ? Builder.CreateSelect(
+                                     Builder.CreateICmpULT(Limit, End), Limit,
+                                     End)
+                               : End;
+    Value *Passing = Builder.CreateSelect(Builder.CreateICmpUGT(Last, First),
+                                          Builder.CreateSub(Last, First),
+                                          Builder.getInt64(0));
+    Value *Span = Builder.CreateSub(End, Lo);
+    // an empty or wrapped range says nothing, keep the count
+    Value *IsSpan = Builder.CreateICmpUGT(End, Lo);
+    Value *Weighed = Builder.CreateUDiv(
+        Builder.CreateMul(Count, Passing),
+        Builder.CreateSelect(IsSpan, Span, Builder.getInt64(1)));
+    return Builder.CreateSelect(IsSpan, Weighed, Count);
+  }
+
+  // Scales the access count of an access by the 32 byte sectors a warp
+  // touches at once, over those of a coalesced access of the same element
+  // size: a warp whose threads access neighbouring elements moves as many
+  // sectors as an element has bytes, one whose threads access an element a
+  // row apart, a sector per thread, with a page each once the row is longer
+  // than one. What crosses the link, and what migrates, is sectors, so an
+  // access down a column is that many times as dense as its count. Only for
+  // accesses with a footprint, in bytes, and warps along x of one row.
+  Value *insertCodeToWeighBySectors(Instruction *Location, CallBase *CI,
+                                    const std::string &KernelName,
+                                    unsigned AID, Value *Count, Value *GDimX,
+                                    Value *GDimY) {
+    auto &Footprints = KernelNameToAccessIDToFootprintMap[KernelName];
+    auto Footprint = Footprints.find(AID);
+    if (Footprint == Footprints.end() || !Footprint->second.ThreadStride ||
+        KernelInvocationToBlockSizeMap[CI][AXIS_TYPE_BDIMX] < 32)
+      return Count;
+    Value *Stride = insertCodeToEvaluateBound(
+        Location, CI, Footprint->second.ThreadStride, GDimX, GDimY);
+    if (!Stride)
+      return Count;
+    IRBuilder<> Builder(Location);
+    uint64_t Bytes = std::max(Footprint->second.Bytes, 1u);
+    // a thread covers its own sectors once a stride leaves a gap
+    uint64_t MaxSectors = 32 * ((Bytes + 31) / 32);
+    Stride = Builder.CreateSelect(
+        Builder.CreateICmpULT(Stride, Builder.getInt64(32 * MaxSectors)),
+        Stride, Builder.getInt64(32 * MaxSectors));
+    // the 32 threads of a warp span 31 strides and an element
+    Value *Sectors = Builder.CreateUDiv(
+        Builder.CreateAdd(Builder.CreateMul(Stride, Builder.getInt64(31)),
+                          Builder.getInt64(Bytes + 31)),
+        Builder.getInt64(32));
+    Sectors = Builder.CreateSelect(
+        Builder.CreateICmpULT(Sectors, Builder.getInt64(MaxSectors)), Sectors,
+        Builder.getInt64(MaxSectors));
+    return Builder.CreateUDiv(Builder.CreateMul(Count, Sectors),
+                              Builder.getInt64(Bytes));
+  }
+
   Value *estimateWorkingSetSize(Instruction *Location, Value *Pointer,
                                 Value *PD_bidx, Value *PD_bidy, Value *PD_phi,
                                 Value *LoopIters, Value *BDimx, Value *BDimy,
@@ -4363,7 +7583,7 @@ struct DynamicHostTransform : public ModulePass {
     // auto pd_bidx = getPartDiff_bidx(Location, Pointer);
     // auto pd_bidy = getPartDiff_bidy(Location, Pointer);
     // auto pd_phi = getPartDiff_phi(Location, Pointer);
-    errs() << "estimating working set size\n";
+    LLVM_DEBUG(dbgs() << "estimating working set size\n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4438,9 +7658,9 @@ struct DynamicHostTransform : public ModulePass {
       if (isTerminal(node)) {
           /* errs() << "unknown check? is terminal\n" << "\n"; */
           if (node->op == ETO_ARG) {
-              errs() << "unknown: arg " << node->arg << " \n";
+              LLVM_DEBUG(dbgs() << "unknown: arg " << node->arg << " \n");
               auto unknown = KernelInvocationToArgNumberToActualArgMap[CI][node->arg];
-              unknown->dump();
+              LLVM_DEBUG(unknown->dump());
               Unknowns[node] = (unknown);
               return;
           }
@@ -4533,7 +7753,7 @@ struct DynamicHostTransform : public ModulePass {
     assert(Src1 != nullptr);
     assert(Src2 != nullptr);
     assert(Src1->getType() == Src2->getType());
-    errs() << "insert comparions node\n";
+    LLVM_DEBUG(dbgs() << "insert comparions node\n");
     // insert conversion to double
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
@@ -4542,7 +7762,7 @@ struct DynamicHostTransform : public ModulePass {
     Value *C1 = castToDouble(Location, Src1);
     Value *C2 = castToDouble(Location, Src2);
     llvm::Value *Dst = Builder.CreateFDiv(C2, C1);
-    Dst->getType()->dump();
+    LLVM_DEBUG(Dst->getType()->dump());
     return Dst;
     /* return nullptr; */
   }
@@ -4563,8 +7783,8 @@ struct DynamicHostTransform : public ModulePass {
         }
     }
     assert(Src1->getType() == Src2->getType());
-    errs() << "insert computation node\n";
-    errs() << Op << "\n";
+    LLVM_DEBUG(dbgs() << "insert computation node\n");
+    LLVM_DEBUG(dbgs() << Op << "\n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4572,48 +7792,48 @@ struct DynamicHostTransform : public ModulePass {
     if (Op == ETO_ADD) {
       llvm::Value *Dst = Builder.CreateAdd(Src1, Src2);
       // errs() << "insert computation node\n";
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SUB) {
       llvm::Value *Dst = Builder.CreateSub(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_AND) {
       llvm::Value *Dst = Builder.CreateAnd(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_OR) {
       llvm::Value *Dst = Builder.CreateOr(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_MUL) {
       llvm::Value *Dst = Builder.CreateMul(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SHL) {
       llvm::Value *Dst = Builder.CreateShl(Src2, Src1); // thanks to our convention. TODO: fix convention
       /* llvm::Value *Dst = Builder.CreateShl(Src1, Src2); // thanks to our convention. TODO: fix convention */
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_DIV) {
       llvm::Value *Dst = Builder.CreateUDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_UDIV) {
       llvm::Value *Dst = Builder.CreateUDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SDIV) {
       llvm::Value *Dst = Builder.CreateSDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     assert("shoudl not reachhere\n");
@@ -4636,8 +7856,8 @@ struct DynamicHostTransform : public ModulePass {
         }
     }
     assert(Src1->getType() == Src2->getType());
-    errs() << "insert computation node\n";
-    errs() << Op << "\n";
+    LLVM_DEBUG(dbgs() << "insert computation node\n");
+    LLVM_DEBUG(dbgs() << Op << "\n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4645,48 +7865,48 @@ struct DynamicHostTransform : public ModulePass {
     if (Op == ETO_ADD) {
       llvm::Value *Dst = Builder.CreateAdd(Src1, Src2);
       // errs() << "insert computation node\n";
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SUB) {
       llvm::Value *Dst = Builder.CreateSub(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_AND) {
       llvm::Value *Dst = Builder.CreateAnd(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_OR) {
       llvm::Value *Dst = Builder.CreateOr(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_MUL) {
       llvm::Value *Dst = Builder.CreateMul(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SHL) {
       /* llvm::Value *Dst = Builder.CreateShl(Src2, Src1); // thanks to our convention. TODO: fix convention */
       llvm::Value *Dst = Builder.CreateShl(Src1, Src2); // thanks to our convention. TODO: fix convention
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_DIV) {
       llvm::Value *Dst = Builder.CreateUDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_UDIV) {
       llvm::Value *Dst = Builder.CreateUDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     if (Op == ETO_SDIV) {
       llvm::Value *Dst = Builder.CreateSDiv(Src1, Src2);
-      Dst->getType()->dump();
+      LLVM_DEBUG(Dst->getType()->dump());
       return Dst;
     }
     assert("shoudl not reachhere\n");
@@ -4716,7 +7936,7 @@ struct DynamicHostTransform : public ModulePass {
   // This fuction is used to insert a constant node in the LLVM IR
   // overloaded for fun and (no) profit. will cause pain. someday.
   Value *insertConstantNode(Instruction *Location, unsigned value) {
-      errs() << "insert constant node " << value << " \n";
+      LLVM_DEBUG(dbgs() << "insert constant node " << value << " \n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4726,7 +7946,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   Value *insertConstantNode(Instruction *Location, int value) {
-      errs() << "insert constant node " << value << " \n";
+      LLVM_DEBUG(dbgs() << "insert constant node " << value << " \n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4749,7 +7969,7 @@ struct DynamicHostTransform : public ModulePass {
   // This fuction is used to insert a constant node in the LLVM IR
   // overloaded for fun and (no) profit. will cause pain. someday.
   Value *insertConstantNode(Instruction *Location, bool value) {
-      errs() << "insert constant node " << value << " \n";
+      LLVM_DEBUG(dbgs() << "insert constant node " << value << " \n");
     Function *F = Location->getParent()->getParent();
     LLVMContext &Ctx = F->getContext();
     IRBuilder<> Builder(Location);
@@ -4767,21 +7987,21 @@ struct DynamicHostTransform : public ModulePass {
   // TODO: Unknowns is not the correct word for describing what is currently
   // called so.
   Value * insertLoopItersEvaluationCode(Instruction *Location, CallBase *CI,
-                                std::map<ExprTreeNode *, Value *> Unknowns,
+                                const std::map<ExprTreeNode *, Value *> &Unknowns,
                                 ExprTreeNode *node) {
     if (node == nullptr)
       return nullptr;
     if (isTerminal(node)) {
       // handle this node
-      errs() << "iliec: " << node->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
       if (Unknowns.find(node) != Unknowns.end()) {
-        Value *val = Unknowns[node];
-        val->dump();
+        Value *val = lookupOrDefault(Unknowns, node);
+        LLVM_DEBUG(val->dump());
         return val;
       }
       if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                    // bit unsigned integers
-        errs() << "node value = " << node->value << "\n";
+        LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
         node->value =
             stoi(node->original_str); // TODO: remove this hack: ensure that
                                       // the value is set correctly at some
@@ -4826,15 +8046,15 @@ struct DynamicHostTransform : public ModulePass {
       return nullptr;
     if (isTerminal(node)) {
       // handle this node
-      errs() << "iliec: " << node->original_str << "\n";
+      LLVM_DEBUG(dbgs() << "iliec: " << node->original_str << "\n");
       if (Unknowns.find(node) != Unknowns.end()) {
-        Value *val = Unknowns[node];
-        val->dump();
+        Value *val = lookupOrDefault(Unknowns, node);
+        LLVM_DEBUG(val->dump());
         return val;
       }
       if (node->op == ETO_CONST) { // currently assuming all constants are 32
                                    // bit unsigned integers
-        errs() << "node value = " << node->value << "\n";
+        LLVM_DEBUG(dbgs() << "node value = " << node->value << "\n");
         node->value =
           stoi(node->original_str); // TODO: remove this hack: ensure that
                                     // the value is set correctly at some
@@ -4842,7 +8062,7 @@ struct DynamicHostTransform : public ModulePass {
         return insertConstantNode(Location, node);
       }
       if (node->op == ETO_BIDY) { // fix with co-efficient based solution
-        errs() << "bidy \n";
+        LLVM_DEBUG(dbgs() << "bidy \n");
         identifyMaxForUnknows(Location, CI, Unknowns, node);
         Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, node, Unknowns,
             0, 0);
@@ -4850,7 +8070,7 @@ struct DynamicHostTransform : public ModulePass {
         return insertComputationNode(Location, maxValue, one, ETO_SUB);
       }
       if (node->op == ETO_BIDX) { // fix with co-efficient based solution
-        errs() << "bidx \n";
+        LLVM_DEBUG(dbgs() << "bidx \n");
         identifyMaxForUnknows(Location, CI, Unknowns, node);
         Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, node, Unknowns,
             0, 0);
@@ -4858,7 +8078,7 @@ struct DynamicHostTransform : public ModulePass {
         return insertComputationNode(Location, maxValue, one, ETO_SUB);
       }
       if (node->op == ETO_TIDX) { // fix with co-efficient based solution
-        errs() << "tidx \n";
+        LLVM_DEBUG(dbgs() << "tidx \n");
         identifyMaxForUnknows(Location, CI, Unknowns, node);
         Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, node, Unknowns,
             0, 0);
@@ -4866,7 +8086,7 @@ struct DynamicHostTransform : public ModulePass {
         return insertComputationNode(Location, maxValue, one, ETO_SUB);
       }
       if (node->op == ETO_TIDY) { // fix with co-efficient based solution
-        errs() << "tidy \n";
+        LLVM_DEBUG(dbgs() << "tidy \n");
         identifyMaxForUnknows(Location, CI, Unknowns, node);
         Value *maxValue = insertCodeToEstimateMaxValue(Location, CI, node, Unknowns,
             0, 0);
@@ -4886,10 +8106,10 @@ struct DynamicHostTransform : public ModulePass {
       // return the new LLVM value
       if(node->op == ETO_ICMP || node->children[0]->isProb || node->children[1]->isProb) {
         node->isProb = true;
-        errs() << node->op << "\n";
+        LLVM_DEBUG(dbgs() << node->op << "\n");
         return insertComparisonNode(Location, Left, Right, node->op);
       } else {
-        errs() << node->op << "\n";
+        LLVM_DEBUG(dbgs() << node->op << "\n");
         return insertComputationNode(Location, Left, Right, node->op);
       }
     }
@@ -4913,7 +8133,7 @@ struct DynamicHostTransform : public ModulePass {
       unsigned currentSplit = 0;
       for (auto Token = LoopBoundsTokens.begin();
            Token != LoopBoundsTokens.end(); Token++) {
-        errs() << *Token << " ";
+        LLVM_DEBUG(dbgs() << *Token << " ");
         if ((*Token).compare("IN") == 0) {
           currentSplit = 0;
         } else if ((*Token).compare("FIN") == 0) {
@@ -4941,7 +8161,7 @@ struct DynamicHostTransform : public ModulePass {
 
   ExprTreeNode *doOperationOnNodes(ExprTreeOp Op, ExprTreeNode *Left,
                                    ExprTreeNode *Right) {
-    ExprTreeNode *Result = new ExprTreeNode();
+    ExprTreeNode *Result = newExprTreeNode();
     Result->op = Op;
     Result->children[0] = Left;
     Result->children[1] = Right;
@@ -4987,64 +8207,178 @@ struct DynamicHostTransform : public ModulePass {
     /* CI->getParent()->getParent()->dump(); */
   }
 
+  // Start, step and the trip count of L as i64 at the end of its preheader,
+  // when SCEV has the trip count and they can be computed there
+  bool expandLoopShape(Loop *L, const SCEV *Start, const SCEV *Step,
+                       ScalarEvolution &SE, LoopShape &Shape) {
+    BasicBlock *Preheader = L->getLoopPreheader();
+    if (!Preheader)
+      return false;
+    const SCEV *Taken = SE.getBackedgeTakenCount(L);
+    if (isa<SCEVCouldNotCompute>(Taken))
+      return false;
+    const SCEV *Parts[3] = {Start, Step, SE.getTripCountFromExitCount(Taken)};
+    const DataLayout &DL = Preheader->getModule()->getDataLayout();
+    SCEVExpander Expander(SE, DL, "penguin.loop");
+    Type *Int64Ty = Type::getInt64Ty(Preheader->getContext());
+    for (auto *S : Parts)
+      if (!Expander.isSafeToExpandAt(S, Preheader->getTerminator()))
+        return false;
+    // the start and step are signed, the trip count is not
+    const SCEV *Wide[3] = {SE.getTruncateOrSignExtend(Parts[0], Int64Ty),
+                           SE.getTruncateOrSignExtend(Parts[1], Int64Ty),
+                           SE.getTruncateOrZeroExtend(Parts[2], Int64Ty)};
+    Shape.Preheader = Preheader;
+    for (unsigned I = 0; I < 3; I++)
+      Shape.Values[I] = Expander.expandCodeFor(Wide[I], Int64Ty,
+                                               Preheader->getTerminator());
+    return true;
+  }
+
+  // The shape of the loop L of LIV, and of the loop around it when that
+  // moves the start of LIV by a fixed step, or not at all, per iteration
+  void expandLoopShapes(Loop *L, Value *LIV, ScalarEvolution &SE) {
+    auto *AddRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(LIV));
+    LoopShape Inner;
+    if (!AddRec || AddRec->getLoop() != L || !AddRec->isAffine() ||
+        !expandLoopShape(L, AddRec->getStart(), AddRec->getStepRecurrence(SE),
+                         SE, Inner))
+      return;
+    LIVToLoopShapeMap[LIV] = Inner;
+    Loop *Parent = L->getParentLoop();
+    if (!Parent)
+      return;
+    const SCEV *Start = AddRec->getStart();
+    auto *Outer = dyn_cast<SCEVAddRecExpr>(Start);
+    LoopShape Shape;
+    if (SE.isLoopInvariant(Start, Parent) ?
+            expandLoopShape(Parent, Start, SE.getZero(Start->getType()), SE,
+                            Shape) :
+            Outer && Outer->getLoop() == Parent && Outer->isAffine() &&
+            expandLoopShape(Parent, Outer->getStart(),
+                            Outer->getStepRecurrence(SE), SE, Shape))
+      LIVToOuterLoopShapeMap[LIV] = Shape;
+  }
+
   // identify if a kernel invocation is inside a loop or not
   bool identifyIterative(CallBase *CI, LoopInfo &LI, ScalarEvolution &SE) {
     Loop *loop;
     if (loop = LI.getLoopFor(CI->getParent())) {
-      errs() << "loop found\n";
-      loop->dump();
+      LLVM_DEBUG(dbgs() << "loop found\n");
+      LLVM_DEBUG(loop->dump());
       KernelInvocationToEnclosingLoopPredMap[CI] =
           loop->getLoopPredecessor()->getFirstNonPHI();
       auto *LIV = (loop)->getInductionVariable(SE);
       if (LIV) {
-        errs() << "LIV : ";
-        LIV->dump();
+        LLVM_DEBUG(dbgs() << "LIV : ");
+        LLVM_DEBUG(LIV->dump());
         KernelInvocationToEnclosingLIVMap[CI] = LIV;
       }
       auto CLIV = loop->getCanonicalInductionVariable();
       if (CLIV) {
-        errs() << "CLIV : ";
-        CLIV->dump();
+        LLVM_DEBUG(dbgs() << "CLIV : ");
+        LLVM_DEBUG(CLIV->dump());
       } else {
-        errs() << "LIV not found\n";
+        LLVM_DEBUG(dbgs() << "LIV not found\n");
         llvm::BasicBlock *Loopheader = loop->getHeader();
         for (auto &I : *Loopheader) {
           if (auto *PN = dyn_cast<PHINode>(&I)) {
-            errs() << "PHI node found\n";
-            PN->dump();
+            LLVM_DEBUG(dbgs() << "PHI node found\n");
+            LLVM_DEBUG(PN->dump());
             // get scev node for the phinode
             // KernelInvocationToEnclosingLoopMap[CI] = PN;
           }
         }
       }
+      if (LIV && PrefetchLoopShape && Policy != POLICY_STATIC &&
+          !LIVToLoopShapeMap.count(LIV))
+        expandLoopShapes(loop, LIV, SE);
       auto loopbounds = loop->getBounds(SE);
       if (loopbounds) {
         Value &VInitial = loopbounds->getInitialIVValue();
-        VInitial.dump();
+        LLVM_DEBUG(VInitial.dump());
+        if (LIV)
+          LIVToInitialValueMap[LIV] = &VInitial;
         auto VI = getExpressionTree(&VInitial);
-        errs() << "VI = " << evaluateRPNForIter0(CI, VI);
+        LLVM_DEBUG(dbgs() << "VI = " << evaluateRPNForIter0(CI, VI));
         auto VIC = evaluateRPNForIter0(CI, VI);
-        errs() << "VI = " << VIC << "\n";
+        LLVM_DEBUG(dbgs() << "VI = " << VIC << "\n");
         Value &VFinal = loopbounds->getFinalIVValue();
-        VFinal.dump();
+        LLVM_DEBUG(VFinal.dump());
         auto VF = getExpressionTree(&VFinal);
         auto VFC = evaluateRPNForIter0(CI, VF);
-        errs() << "VF = " << VFC << "\n";
+        LLVM_DEBUG(dbgs() << "VF = " << VFC << "\n");
         Value *VSteps = loopbounds->getStepValue();
-        VSteps->dump();
+        LLVM_DEBUG(VSteps->dump());
         auto VS = getExpressionTree(VSteps);
         auto VSC = evaluateRPNForIter0(CI, VS);
-        errs() << "VS = " << VSC << "\n";
+        LLVM_DEBUG(dbgs() << "VS = " << VSC << "\n");
         KernelInvocationToIterMap[CI] = (VFC - VIC) / VSC;
         KernelInvocationToStepsMap[CI] = VSC;
       } else {
-        errs() << "bound not found\n";
+        LLVM_DEBUG(dbgs() << "bound not found\n");
       }
       return true;
     }
     return false;
   }
 
+  // Whether Ptr is a local no instruction of L writes: it is only stored to
+  // outside L, and its address goes nowhere but cudaMalloc*
+  bool isUnwrittenInLoop(Value *Ptr, Loop *L) {
+    if (!isa<AllocaInst>(Ptr) && !isa<BitCastInst>(Ptr))
+      return false;
+    for (User *U : Ptr->users()) {
+      if (isa<BitCastInst>(U)) {
+        if (!isUnwrittenInLoop(U, L))
+          return false;
+        continue;
+      }
+      if (isa<LoadInst>(U))
+        continue;
+      if (auto *SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getPointerOperand() == Ptr && !L->contains(SI))
+          continue;
+        return false;
+      }
+      if (isa<PtrToIntInst>(U)) {
+        if (all_of(U->users(), [](User *V) { return isa<CallBase>(V); }))
+          continue;
+        return false;
+      }
+      if (auto *Call = dyn_cast<CallBase>(U)) {
+        Function *Callee = Call->getCalledFunction();
+        if (Call->isLifetimeStartOrEnd() ||
+            (Callee && Callee->getName().startswith("cudaMalloc") &&
+             !L->contains(Call)))
+          continue;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Whether a launch in host loop L gets the same arguments every iteration,
+  // but the induction variable, and so the same allocations: its decision
+  // then holds for the whole loop, see KernelLaunchIsLoopInvariant
+  bool argumentsAreLoopInvariant(CallBase *CI, Loop *L) {
+    if (!L)
+      return false;
+    Value *LIV = KernelInvocationToEnclosingLIVMap.lookup(CI);
+    for (auto &A : KernelInvocationToArgNumberToActualArgMap[CI]) {
+      Value *V = A.second;
+      if (!V || V == LIV || L->isLoopInvariant(V))
+        continue;
+      auto *Ld = dyn_cast<LoadInst>(V);
+      if (Ld && !Ld->isVolatile() &&
+          isUnwrittenInLoop(Ld->getPointerOperand()->stripPointerCasts(), L))
+        continue;
+      LLVM_DEBUG(dbgs() << "argument " << A.first << " varies in the host loop\n");
+      return false;
+    }
+    return true;
+  }
+
   void findAndAddLocalFunction(Module &M) {
     for (auto &F : M) {
       if (F.isDeclaration()) {
@@ -5052,7 +8386,7 @@ struct DynamicHostTransform : public ModulePass {
         ;
       }
       if (F.getName().contains("stub")) {
-        errs() << "not running on " << F.getName() << "\n";
+        LLVM_DEBUG(dbgs() << "not running on " << F.getName() << "\n");
         continue;
       }
       // errs() << "locally defined function : " << F.getName() << "\n";
@@ -5077,95 +8411,118 @@ struct DynamicHostTransform : public ModulePass {
   void extractArgsFromFunctionCallSites(CallBase *CI) {
     // CI->dump();
     if (CI->getCalledFunction() == nullptr) {
-      errs() << "FUNCTION CALL is probably indirect\n";
+      LLVM_DEBUG(dbgs() << "FUNCTION CALL is probably indirect\n");
       return;
     }
-    errs() << "CALL TO " << CI->getCalledFunction()->getName().str() << "\n";
+    // an invoke is seen as a CallBase and as an InvokeInst
+    if (FunctionCallToActualArumentsMap.count(CI))
+      return;
+    LLVM_DEBUG(dbgs() << "CALL TO " << CI->getCalledFunction()->getName().str() << "\n");
     for (auto &Arg : CI->args()) {
       // Arg->dump();
       FunctionCallToActualArumentsMap[CI].push_back(Arg);
     }
+    FunctionToCallSitesMap[CI->getCalledFunction()].push_back(CI);
   }
 
   void mapFormalArgumentsToActualArguments() {
-    errs() << "MAPPING FORMAL ARGUMENTS TO ACTUAL ARGUMENTS\n\n";
+    LLVM_DEBUG(dbgs() << "MAPPING FORMAL ARGUMENTS TO ACTUAL ARGUMENTS\n\n");
     for (auto FnIter = FunctionToFormalArgumentMap.begin();
          FnIter != FunctionToFormalArgumentMap.end(); FnIter++) {
-      errs() << "Function Name: " << FnIter->first->getName() << "\n";
+      LLVM_DEBUG(dbgs() << "Function Name: " << FnIter->first->getName() << "\n");
       auto MatchCount = 0;
-      for (auto CallSiteIter = FunctionCallToActualArumentsMap.begin();
-           CallSiteIter != FunctionCallToActualArumentsMap.end();
-           CallSiteIter++) {
-        errs() << "Call site: "
-               << CallSiteIter->first->getCalledFunction()->getName() << "\n";
-        if (CallSiteIter->first->getCalledFunction() == FnIter->first) {
-          errs() << "MATCH!\n";
-          MatchCount++;
-          for (auto FormalArgIter = FnIter->second.begin();
-               FormalArgIter != FnIter->second.end(); FormalArgIter++) {
-            /* errs() << (*FormalArgIter) << "\n"; */
-            /* (*FormalArgIter)->dump(); */
-          }
-          for (auto ActualArgIter = CallSiteIter->second.begin();
-               ActualArgIter != CallSiteIter->second.end(); ActualArgIter++) {
-            /* errs() << (*ActualArgIter) << "\n"; */
-            /* (*ActualArgIter)->dump(); */
-          }
-          for (unsigned long i = 0; i < FnIter->second.size(); i++) {
-            auto *FormalArg = FnIter->second[i];
-            auto *ActualArg = CallSiteIter->second[i];
-            FormalArgumentToActualArgumentMap[FormalArg].push_back(ActualArg);
-            /* auto ActualArgumentToFormalArgumentMap = */
-            FunctionCallToActualArgumentToFormalArgumentMap[CallSiteIter->first]
-                                                           [ActualArg] =
-                                                               FormalArg;
-            /* ActualArgumentToFormalArgumentMap[ActualArg] = (FormalArg); */
-            CallSiteIter->first->dump();
-            errs() << "formal arg to actual arg\n";
-            errs() << FormalArg << "\n";
-            FormalArg->dump();
-            errs() << ActualArg << "\n";
-            ActualArg->dump();
-            FunctionCallToFormalArgumentToActualArgumentMap[CallSiteIter->first]
-                                                           [FormalArg] =
-                                                               (ActualArg);
-          }
+      // only the call sites of this function, not every call of the module
+      for (auto *CallSite : FunctionToCallSitesMap[FnIter->first]) {
+        const std::vector<Value *> &ActualArgs =
+            FunctionCallToActualArumentsMap[CallSite];
+        LLVM_DEBUG(dbgs() << "Call site: " << CallSite->getCalledFunction()->getName()
+               << "\n");
+        MatchCount++;
+        for (unsigned long i = 0;
+             i < FnIter->second.size() && i < ActualArgs.size(); i++) {
+          auto *FormalArg = FnIter->second[i];
+          auto *ActualArg = ActualArgs[i];
+          FormalArgumentToActualArgumentMap[FormalArg].push_back(ActualArg);
+          FunctionCallToActualArgumentToFormalArgumentMap[CallSite][ActualArg] =
+              FormalArg;
+          LLVM_DEBUG(CallSite->dump());
+          LLVM_DEBUG(dbgs() << "formal arg to actual arg\n");
+          LLVM_DEBUG(dbgs() << FormalArg << "\n");
+          LLVM_DEBUG(FormalArg->dump());
+          LLVM_DEBUG(dbgs() << ActualArg << "\n");
+          LLVM_DEBUG(ActualArg->dump());
+          FunctionCallToFormalArgumentToActualArgumentMap[CallSite][FormalArg] =
+              (ActualArg);
         }
       }
       if (MatchCount > 1) {
-        errs() << "MORE THAN ONE CALL SITE \n";
+        LLVM_DEBUG(dbgs() << "MORE THAN ONE CALL SITE \n");
+      }
+    }
+  }
+
+  // Original pointers V may hold: its own, and for a formal argument of a
+  // wrapper those of the actuals at all its call sites, through as many
+  // wrappers as there are. Computed once per value.
+  const std::set<Value *> &resolveOriginalPointers(Value *V) {
+    auto Cached = OriginalPointersCache.find(V);
+    if (Cached != OriginalPointersCache.end())
+      return Cached->second;
+    // inserted first, so that recursive wrappers end
+    std::set<Value *> &Result = OriginalPointersCache[V];
+    auto POGP = PointerOpToOriginalPointers.find(V);
+    if (POGP != PointerOpToOriginalPointers.end() && POGP->second)
+      Result.insert(POGP->second);
+    // a formal kept in a local of the wrapper and loaded back
+    Value *Formal = V;
+    if (auto *Ld = dyn_cast<LoadInst>(V))
+      if (auto *SI = findStoreInstWithGivenPointerOperand(
+              Ld->getPointerOperand()))
+        if (isa<Argument>(SI->getValueOperand()))
+          Formal = SI->getValueOperand();
+    auto Actuals = FormalArgumentToActualArgumentMap.find(Formal);
+    if (Actuals != FormalArgumentToActualArgumentMap.end()) {
+      std::vector<Value *> ActualArgs = Actuals->second;
+      for (auto *Actual : ActualArgs) {
+        const std::set<Value *> &Through = resolveOriginalPointers(Actual);
+        Result.insert(Through.begin(), Through.end());
       }
     }
+    return Result;
   }
 
   void analyzePointerPropogationRecursive(CallBase *CI) {
-    if (VisitedCallInstForPointerPropogation.find(CI) !=
-        VisitedCallInstForPointerPropogation.end()) {
-      return;
-    } else {
-      VisitedCallInstForPointerPropogation.insert(CI);
-    }
     auto *Func = CI->getCalledFunction();
-    errs() << "function name = " << Func->getName() << "\n";
+    // the walk only depends on what the formals hold; every call site that
+    // binds them to the same original pointers would write the same entries
+    std::vector<Value *> Binding;
+    for (auto &Arg : Func->args()) {
+      auto POGP = PointerOpToOriginalPointers.find(&Arg);
+      Binding.push_back(POGP != PointerOpToOriginalPointers.end() ? POGP->second
+                                                                  : nullptr);
+    }
+    if (!VisitedPropagationContexts.insert({Func, Binding}).second)
+      return;
+    LLVM_DEBUG(dbgs() << "function name = " << Func->getName() << "\n");
     /* Func->dump(); */
     if (ListOfLocallyDefinedFunctions.find(Func) ==
         ListOfLocallyDefinedFunctions.end()) {
-      errs() << "not locally define\n";
+      LLVM_DEBUG(dbgs() << "not locally define\n");
       return;
     }
     for (auto &BB : *Func) {
       for (auto &I : BB) {
         if (isa<AllocaInst>(I)) {
           auto AI = dyn_cast<AllocaInst>(&I);
-          I.dump();
-          AI->getType()->dump();
-          AI->getAllocatedType()->dump();
+          LLVM_DEBUG(I.dump());
+          LLVM_DEBUG(AI->getType()->dump());
+          LLVM_DEBUG(AI->getAllocatedType()->dump());
           if (I.getType()->isPointerTy()) {
             OriginalPointers.insert(&I);
             PointerOpToOriginalPointers[&I] = &I;
           }
           if (auto Stype = dyn_cast<StructType>(AI->getAllocatedType())) {
-            errs() << "Struct Type\n";
+            LLVM_DEBUG(dbgs() << "Struct Type\n");
             StructAllocas.insert(AI);
           }
         }
@@ -5178,52 +8535,52 @@ struct DynamicHostTransform : public ModulePass {
           auto POGP = PointerOpToOriginalPointers.find(LI->getPointerOperand());
           if (POGP != PointerOpToOriginalPointers.end()) {
             PointerOpToOriginalPointers[LI] = POGP->second;
-            errs() << "\nLOAD INST \n";
-            LI->dump();
-            POGP->second->dump();
+            LLVM_DEBUG(dbgs() << "\nLOAD INST \n");
+            LLVM_DEBUG(LI->dump());
+            LLVM_DEBUG(POGP->second->dump());
             if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
               PointerOpToOriginalStructPointer[LI] = POGP->second;
               PointerOpToOriginalStructPointersIndex[LI] =
                   PointerOpToOriginalStructPointersIndex
                       [LI->getPointerOperand()];
-              errs() << "zoo zoo = "
+              LLVM_DEBUG(dbgs() << "zoo zoo = "
                      << PointerOpToOriginalStructPointersIndex
-                            [LI->getPointerOperand()];
+                            [LI->getPointerOperand()]);
             }
           }
         }
         if (auto *GEPI = dyn_cast<GetElementPtrInst>(&I)) {
           // LI->getPointerOperand()->dump();
-          errs() << "GEPI testing: ";
-          GEPI->dump();
-          GEPI->getPointerOperand()->dump();
-          errs() << GEPI->getPointerOperand() << "\n";
+          LLVM_DEBUG(dbgs() << "GEPI testing: ");
+          LLVM_DEBUG(GEPI->dump());
+          LLVM_DEBUG(GEPI->getPointerOperand()->dump());
+          LLVM_DEBUG(dbgs() << GEPI->getPointerOperand() << "\n");
           auto POGP =
               PointerOpToOriginalPointers.find(GEPI->getPointerOperand());
           if (POGP != PointerOpToOriginalPointers.end()) {
             PointerOpToOriginalPointers[GEPI] = POGP->second;
-            errs() << "\nGEPI INST \n";
-            GEPI->dump();
-            GEPI->getPointerOperand()->dump();
-            POGP->second->dump();
+            LLVM_DEBUG(dbgs() << "\nGEPI INST \n");
+            LLVM_DEBUG(GEPI->dump());
+            LLVM_DEBUG(GEPI->getPointerOperand()->dump());
+            LLVM_DEBUG(POGP->second->dump());
             if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
               PointerOpToOriginalStructPointer[GEPI] = POGP->second;
               auto numIndices = GEPI->getNumIndices();
               if (numIndices == 2) {
                 if (auto FieldNum =
                         dyn_cast<ConstantInt>(GEPI->getOperand(2))) {
-                  errs() << "og is struct\n";
+                  LLVM_DEBUG(dbgs() << "og is struct\n");
                   PointerOpToOriginalStructPointersIndex[GEPI] =
                       FieldNum->getSExtValue();
-                  errs() << "field num = " << FieldNum << "\n";
+                  LLVM_DEBUG(dbgs() << "field num = " << FieldNum << "\n");
                 }
               } else {
                 if (auto FieldNum =
                         dyn_cast<ConstantInt>(GEPI->getOperand(1))) {
-                  errs() << "og maybe struct or array\n";
+                  LLVM_DEBUG(dbgs() << "og maybe struct or array\n");
                   PointerOpToOriginalStructPointersIndex[GEPI] =
                       FieldNum->getSExtValue();
-                  errs() << "field num = " << FieldNum << "\n";
+                  LLVM_DEBUG(dbgs() << "field num = " << FieldNum << "\n");
                 }
               }
             }
@@ -5234,18 +8591,18 @@ struct DynamicHostTransform : public ModulePass {
           auto POGP = PointerOpToOriginalPointers.find(SI->getValueOperand());
           if (POGP != PointerOpToOriginalPointers.end()) {
             PointerOpToOriginalPointers[SI->getPointerOperand()] = POGP->second;
-            errs() << "\nSTORE INST \n";
-            SI->dump();
-            SI->getPointerOperand()->dump();
-            POGP->second->dump();
+            LLVM_DEBUG(dbgs() << "\nSTORE INST \n");
+            LLVM_DEBUG(SI->dump());
+            LLVM_DEBUG(SI->getPointerOperand()->dump());
+            LLVM_DEBUG(POGP->second->dump());
             if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
               PointerOpToOriginalStructPointer[SI->getPointerOperand()] =
                   POGP->second;
               PointerOpToOriginalStructPointersIndex[SI->getPointerOperand()] =
                   PointerOpToOriginalStructPointersIndex[SI->getValueOperand()];
-              errs() << "zoo zoo = "
+              LLVM_DEBUG(dbgs() << "zoo zoo = "
                      << PointerOpToOriginalStructPointersIndex
-                            [SI->getValueOperand()];
+                            [SI->getValueOperand()]);
             }
           }
         }
@@ -5256,9 +8613,9 @@ struct DynamicHostTransform : public ModulePass {
             continue;
           }
           if ((Callee && (Callee->getName() == "llvm.memcpy.p0.p0.i64"))) {
-            errs() << "memcpy found\n";
-            CI->getOperand(0)->dump();
-            CI->getOperand(1)->dump();
+            LLVM_DEBUG(dbgs() << "memcpy found\n");
+            LLVM_DEBUG(CI->getOperand(0)->dump());
+            LLVM_DEBUG(CI->getOperand(1)->dump());
             bool isStackVar0 = isa<AllocaInst>(CI->getOperand(0));
             bool isStackVar1 = isa<AllocaInst>(CI->getOperand(1));
             if (isStackVar0 || isStackVar1) {
@@ -5267,8 +8624,8 @@ struct DynamicHostTransform : public ModulePass {
               MemcpyOpForStructsDstToInstMap[CI->getOperand(0)] = CI;
               if (PointerOpToOriginalPointers.find(CI->getOperand(1)) !=
                   PointerOpToOriginalPointers.end()) {
-                errs() << "memcpy taint propogated\n";
-                PointerOpToOriginalPointers[CI->getOperand(1)]->dump();
+                LLVM_DEBUG(dbgs() << "memcpy taint propogated\n");
+                LLVM_DEBUG(PointerOpToOriginalPointers[CI->getOperand(1)]->dump());
                 PointerOpToOriginalPointers[CI->getOperand(0)] =
                     PointerOpToOriginalPointers[CI->getOperand(1)];
                 auto OriginalPointer =
@@ -5279,16 +8636,16 @@ struct DynamicHostTransform : public ModulePass {
                       OriginalPointer;
                   PointerOpToOriginalStructPointersIndex[CI->getOperand(0)] =
                       PointerOpToOriginalStructPointersIndex[CI->getOperand(1)];
-                  errs()
+                  LLVM_DEBUG(dbgs()
                       << "zoo zoo = "
                       << PointerOpToOriginalStructPointersIndex[CI->getOperand(
-                             1)];
+                             1)]);
                 }
               }
             }
           }
-          errs() << "CallBase : ";
-          CI->dump();
+          LLVM_DEBUG(dbgs() << "CallBase : ");
+          LLVM_DEBUG(CI->dump());
           auto *Func = CI->getCalledFunction();
           if (ListOfLocallyDefinedFunctions.find(Func) ==
               ListOfLocallyDefinedFunctions.end()) {
@@ -5298,28 +8655,28 @@ struct DynamicHostTransform : public ModulePass {
           for (auto &Arg : CI->args()) {
             auto POGP = PointerOpToOriginalPointers.find(Arg);
             if (POGP != PointerOpToOriginalPointers.end()) {
-              errs() << "\nCALL INST \n";
-              CI->dump();
-              Arg->dump();
+              LLVM_DEBUG(dbgs() << "\nCALL INST \n");
+              LLVM_DEBUG(CI->dump());
+              LLVM_DEBUG(Arg->dump());
               auto *OriginalPointer = POGP->second;
-              OriginalPointer->dump();
+              LLVM_DEBUG(OriginalPointer->dump());
               auto ActualArgumentToFormalArgumentMap =
                   FunctionCallToActualArgumentToFormalArgumentMap[CI];
               auto *FormalArg =
                   ActualArgumentToFormalArgumentMap[Arg]; // ->dump();
-              FormalArg->dump();
-              errs() << FormalArg << "\n";
+              LLVM_DEBUG(FormalArg->dump());
+              LLVM_DEBUG(dbgs() << FormalArg << "\n");
               PointerOpToOriginalPointers[FormalArg] = OriginalPointer;
               if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
                 PointerOpToOriginalStructPointer[FormalArg] = POGP->second;
                 PointerOpToOriginalStructPointersIndex[FormalArg] =
                     PointerOpToOriginalStructPointersIndex[Arg];
-                errs() << "zoo zoo = "
-                       << PointerOpToOriginalStructPointersIndex[Arg];
+                LLVM_DEBUG(dbgs() << "zoo zoo = "
+                       << PointerOpToOriginalStructPointersIndex[Arg]);
               }
             }
           }
-          errs() << "Recurse into called functions\n";
+          LLVM_DEBUG(dbgs() << "Recurse into called functions\n");
           analyzePointerPropogationRecursive(CI);
         }
       }
@@ -5328,7 +8685,7 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   void analyzePointerPropogation(Module &M) {
-    errs() << "POINTER COLLECTION IN MAIN\n";
+    LLVM_DEBUG(dbgs() << "POINTER COLLECTION IN MAIN\n");
     // PointerOpToOriginalPointers;
     // OriginalPointers;
     for (auto &F : M) {
@@ -5339,22 +8696,22 @@ struct DynamicHostTransform : public ModulePass {
         for (auto &I : BB) {
           if (isa<AllocaInst>(I)) {
             auto AI = dyn_cast<AllocaInst>(&I);
-            I.dump();
-            AI->getType()->dump();
-            AI->getAllocatedType()->dump();
+            LLVM_DEBUG(I.dump());
+            LLVM_DEBUG(AI->getType()->dump());
+            LLVM_DEBUG(AI->getAllocatedType()->dump());
             if (I.getType()->isPointerTy()) {
               // OriginalPointers.insert(&I);
               PointerOpToOriginalPointers[&I] = &I;
             }
             if (auto Stype = dyn_cast<StructType>(AI->getAllocatedType())) {
-              errs() << "Struct Type\n";
+              LLVM_DEBUG(dbgs() << "Struct Type\n");
               StructAllocas.insert(AI);
             }
           }
         }
       }
     }
-    errs() << "POINTER PROPOGATION\n";
+    LLVM_DEBUG(dbgs() << "POINTER PROPOGATION\n");
     for (auto &F : M) {
       if (F.getName() != "main") {
         continue;
@@ -5367,17 +8724,17 @@ struct DynamicHostTransform : public ModulePass {
                 PointerOpToOriginalPointers.find(LI->getPointerOperand());
             if (POGP != PointerOpToOriginalPointers.end()) {
               PointerOpToOriginalPointers[LI] = POGP->second;
-              errs() << "\nLOAD INST \n";
-              LI->dump();
-              POGP->second->dump();
+              LLVM_DEBUG(dbgs() << "\nLOAD INST \n");
+              LLVM_DEBUG(LI->dump());
+              LLVM_DEBUG(POGP->second->dump());
               if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
                 PointerOpToOriginalStructPointer[LI] = POGP->second;
                 PointerOpToOriginalStructPointersIndex[LI] =
                     PointerOpToOriginalStructPointersIndex
                         [LI->getPointerOperand()];
-                errs() << "zoo zoo = "
+                LLVM_DEBUG(dbgs() << "zoo zoo = "
                        << PointerOpToOriginalStructPointersIndex
-                              [LI->getPointerOperand()];
+                              [LI->getPointerOperand()]);
               }
             }
           }
@@ -5387,10 +8744,10 @@ struct DynamicHostTransform : public ModulePass {
             if (POGP != PointerOpToOriginalPointers.end()) {
               PointerOpToOriginalPointers[SI->getPointerOperand()] =
                   POGP->second;
-              errs() << "\nSTORE INST \n";
-              SI->dump();
-              SI->getPointerOperand()->dump();
-              POGP->second->dump();
+              LLVM_DEBUG(dbgs() << "\nSTORE INST \n");
+              LLVM_DEBUG(SI->dump());
+              LLVM_DEBUG(SI->getPointerOperand()->dump());
+              LLVM_DEBUG(POGP->second->dump());
               if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
                 PointerOpToOriginalStructPointer[SI->getPointerOperand()] =
                     POGP->second;
@@ -5398,13 +8755,13 @@ struct DynamicHostTransform : public ModulePass {
                     [SI->getPointerOperand()] =
                         PointerOpToOriginalStructPointersIndex
                             [SI->getValueOperand()];
-                errs() << "zoo zoo = "
+                LLVM_DEBUG(dbgs() << "zoo zoo = "
                        << PointerOpToOriginalStructPointersIndex
-                              [SI->getValueOperand()];
+                              [SI->getValueOperand()]);
               }
             }
             if (isa<ConstantInt>(SI->getValueOperand())) {
-              errs() << "Constant store\n";
+              LLVM_DEBUG(dbgs() << "Constant store\n");
               auto con = dyn_cast<ConstantInt>(SI->getValueOperand());
               PointerOpToOriginalConstant[SI->getPointerOperand()] =
                   con->getSExtValue();
@@ -5416,28 +8773,28 @@ struct DynamicHostTransform : public ModulePass {
                 PointerOpToOriginalPointers.find(GEPI->getPointerOperand());
             if (POGP != PointerOpToOriginalPointers.end()) {
               PointerOpToOriginalPointers[GEPI] = POGP->second;
-              errs() << "\nGEPI INST \n";
-              GEPI->dump();
-              GEPI->getPointerOperand()->dump();
-              POGP->second->dump();
+              LLVM_DEBUG(dbgs() << "\nGEPI INST \n");
+              LLVM_DEBUG(GEPI->dump());
+              LLVM_DEBUG(GEPI->getPointerOperand()->dump());
+              LLVM_DEBUG(POGP->second->dump());
               if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
                 PointerOpToOriginalStructPointer[GEPI] = POGP->second;
                 auto numIndices = GEPI->getNumIndices();
                 if (numIndices == 2) {
                   if (auto FieldNum =
                           dyn_cast<ConstantInt>(GEPI->getOperand(2))) {
-                    errs() << "og is struct\n";
+                    LLVM_DEBUG(dbgs() << "og is struct\n");
                     PointerOpToOriginalStructPointersIndex[GEPI] =
                         FieldNum->getSExtValue();
-                    errs() << "field num = " << FieldNum << "\n";
+                    LLVM_DEBUG(dbgs() << "field num = " << FieldNum << "\n");
                   }
                 } else {
                   if (auto FieldNum =
                           dyn_cast<ConstantInt>(GEPI->getOperand(1))) {
-                    errs() << "og maybe struct or array\n";
+                    LLVM_DEBUG(dbgs() << "og maybe struct or array\n");
                     PointerOpToOriginalStructPointersIndex[GEPI] =
                         FieldNum->getSExtValue();
-                    errs() << "field num = " << FieldNum << "\n";
+                    LLVM_DEBUG(dbgs() << "field num = " << FieldNum << "\n");
                   }
                 }
               }
@@ -5450,9 +8807,9 @@ struct DynamicHostTransform : public ModulePass {
               continue;
             }
             if ((Callee && (Callee->getName() == "llvm.memcpy.p0.p0.i64"))) {
-              errs() << "memcpy found\n";
-              CI->getOperand(0)->dump();
-              CI->getOperand(1)->dump();
+              LLVM_DEBUG(dbgs() << "memcpy found\n");
+              LLVM_DEBUG(CI->getOperand(0)->dump());
+              LLVM_DEBUG(CI->getOperand(1)->dump());
               bool isStackVar0 = isa<AllocaInst>(CI->getOperand(0));
               bool isStackVar1 = isa<AllocaInst>(CI->getOperand(1));
               if (isStackVar0 || isStackVar1) {
@@ -5461,8 +8818,8 @@ struct DynamicHostTransform : public ModulePass {
                 MemcpyOpForStructsDstToInstMap[CI->getOperand(0)] = CI;
                 if (PointerOpToOriginalPointers.find(CI->getOperand(1)) !=
                     PointerOpToOriginalPointers.end()) {
-                  errs() << "memcpy taint propogated \n ";
-                  PointerOpToOriginalPointers[CI->getOperand(1)]->dump();
+                  LLVM_DEBUG(dbgs() << "memcpy taint propogated \n ");
+                  LLVM_DEBUG(PointerOpToOriginalPointers[CI->getOperand(1)]->dump());
                   PointerOpToOriginalPointers[CI->getOperand(0)] =
                       PointerOpToOriginalPointers[CI->getOperand(1)];
                   auto OriginalPointer =
@@ -5474,9 +8831,9 @@ struct DynamicHostTransform : public ModulePass {
                     PointerOpToOriginalStructPointersIndex[CI->getOperand(0)] =
                         PointerOpToOriginalStructPointersIndex[CI->getOperand(
                             1)];
-                    errs() << "zoo zoo = "
+                    LLVM_DEBUG(dbgs() << "zoo zoo = "
                            << PointerOpToOriginalStructPointersIndex
-                                  [CI->getOperand(1)];
+                                  [CI->getOperand(1)]);
                   }
                 }
               }
@@ -5488,29 +8845,29 @@ struct DynamicHostTransform : public ModulePass {
             for (auto &Arg : CI->args()) {
               auto POGP = PointerOpToOriginalPointers.find(Arg);
               if (POGP != PointerOpToOriginalPointers.end()) {
-                errs() << "\nCALL INST \n";
-                CI->dump();
-                Arg->dump();
-                errs() << Arg << "\n";
+                LLVM_DEBUG(dbgs() << "\nCALL INST \n");
+                LLVM_DEBUG(CI->dump());
+                LLVM_DEBUG(Arg->dump());
+                LLVM_DEBUG(dbgs() << Arg << "\n");
                 auto *OriginalPointer = POGP->second;
-                OriginalPointer->dump();
+                LLVM_DEBUG(OriginalPointer->dump());
                 auto ActualArgumentToFormalArgumentMap =
                     FunctionCallToActualArgumentToFormalArgumentMap[CI];
                 Value *FormalArg =
                     ActualArgumentToFormalArgumentMap[Arg]; // ->dump();
-                FormalArg->dump();
-                errs() << FormalArg << "\n";
+                LLVM_DEBUG(FormalArg->dump());
+                LLVM_DEBUG(dbgs() << FormalArg << "\n");
                 PointerOpToOriginalPointers[FormalArg] = OriginalPointer;
                 if (StructAllocas.find(POGP->second) != StructAllocas.end()) {
                   PointerOpToOriginalStructPointer[FormalArg] = POGP->second;
                   PointerOpToOriginalStructPointersIndex[FormalArg] =
                       PointerOpToOriginalStructPointersIndex[Arg];
-                  errs() << "zoo zoo = "
-                         << PointerOpToOriginalStructPointersIndex[Arg];
+                  LLVM_DEBUG(dbgs() << "zoo zoo = "
+                         << PointerOpToOriginalStructPointersIndex[Arg]);
                 }
               }
             }
-            errs() << "Recurse into called functions\n";
+            LLVM_DEBUG(dbgs() << "Recurse into called functions\n");
             analyzePointerPropogationRecursive(CI);
           }
         }
@@ -5526,6 +8883,8 @@ struct DynamicHostTransform : public ModulePass {
     terminals.insert(ETO_BIDY);
     terminals.insert(ETO_BDIMX);
     terminals.insert(ETO_BDIMY);
+    terminals.insert(ETO_GDIMX);
+    terminals.insert(ETO_GDIMY);
     terminals.insert(ETO_PHI_TERM);
     terminals.insert(ETO_ARG);
     terminals.insert(ETO_CONST);
@@ -5545,69 +8904,69 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   void printLoopInformation() {
-    errs() << "loop information\n";
+    LLVM_DEBUG(dbgs() << "loop information\n");
     for (auto I = LoopIDToLoopItersMap.begin(); I != LoopIDToLoopItersMap.end();
          I++) {
-      errs() << I->first << "\n";
+      LLVM_DEBUG(dbgs() << I->first << "\n");
       for (auto L = I->second.begin(); L != I->second.end(); L++) {
-        errs() << L->first << " ==> " << L->second << "\n";
+        LLVM_DEBUG(dbgs() << L->first << " ==> " << L->second << "\n");
       }
     }
     for (auto I = LoopIDToLoopBoundsMap.begin();
          I != LoopIDToLoopBoundsMap.end(); I++) {
-      errs() << I->first << "\n";
+      LLVM_DEBUG(dbgs() << I->first << "\n");
       for (auto L = I->second.begin(); L != I->second.end(); L++) {
-        errs() << L->first << " ==> ";
+        LLVM_DEBUG(dbgs() << L->first << " ==> ");
         for (auto str = L->second.begin(); str != L->second.end(); str++) {
-          errs() << *str << " ";
+          LLVM_DEBUG(dbgs() << *str << " ");
         }
       }
     }
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "\n");
 
-    errs() << "phi to loop mapping\n";
+    LLVM_DEBUG(dbgs() << "phi to loop mapping\n");
     for (auto I = PhiNodeToLoopIDMap.begin();
          I != PhiNodeToLoopIDMap.end(); I++) {
-        errs() << I->first << " " << I->second << "\n";
+        LLVM_DEBUG(dbgs() << I->first << " " << I->second << "\n");
     }
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "\n");
   }
 
   void printAccessInformation() {
-    errs() << "access information\n";
-    errs() << "\n";
+    LLVM_DEBUG(dbgs() << "access information\n");
+    LLVM_DEBUG(dbgs() << "\n");
     // the key for all the AccessId maps is the same (kernel name), so use any
     // to iterate
     for (auto I = KernelNameToAccessIDToAllocationArgMap.begin();
          I != KernelNameToAccessIDToAllocationArgMap.end(); I++) {
-      errs() << "\nkernel name: " << I->first << "\n";
+      LLVM_DEBUG(dbgs() << "\nkernel name: " << I->first << "\n");
       std::map<unsigned, unsigned> AccessIDToArgMap =
           KernelNameToAccessIDToAllocationArgMap[I->first];
-      errs() << "AID to arg map\n";
+      LLVM_DEBUG(dbgs() << "AID to arg map\n");
       for (auto AID = AccessIDToArgMap.begin(); AID != AccessIDToArgMap.end();
            AID++) {
-        errs() << AID->first << " " << AID->second << "\n";
+        LLVM_DEBUG(dbgs() << AID->first << " " << AID->second << "\n");
       }
-      errs() << "AID to loop map\n";
+      LLVM_DEBUG(dbgs() << "AID to loop map\n");
       std::map<unsigned, unsigned> AccessIDToLoopMap =
           KernelNameToAccessIDToEnclosingLoopMap[I->first];
       for (auto AID = AccessIDToLoopMap.begin(); AID != AccessIDToLoopMap.end();
            AID++) {
-        errs() << AID->first << " " << AID->second << "\n";
+        LLVM_DEBUG(dbgs() << AID->first << " " << AID->second << "\n");
       }
-      errs() << "AID to expression tree map\n";
+      LLVM_DEBUG(dbgs() << "AID to expression tree map\n");
       std::map<unsigned, ExprTreeNode *> AccessIDToExprMap =
           KernelNameToAccessIDToExpressionTreeMap[I->first];
       std::map<unsigned, ExprTreeNodeAdvanced *> AccessIDToAdvancedExprMap =
           KernelNameToAccessIDToAdvancedExpressionTreeMap[I->first];
       for (auto AID = AccessIDToExprMap.begin(); AID != AccessIDToExprMap.end();
            AID++) {
-        errs() << "\nAID = " << AID->first << "  ";
+        LLVM_DEBUG(dbgs() << "\nAID = " << AID->first << "  ");
         traverseExpressionTree(AID->second);
       }
       for (auto AID = AccessIDToAdvancedExprMap.begin(); AID != AccessIDToAdvancedExprMap.end();
            AID++) {
-        errs() << "\nAAID = " << AID->first << "  ";
+        LLVM_DEBUG(dbgs() << "\nAAID = " << AID->first << "  ");
         traverseExpressionTree(AID->second);
       }
     }
@@ -5637,10 +8996,45 @@ struct DynamicHostTransform : public ModulePass {
   }
 
   bool runOnModule(Module &M) override {
-
+    GetLI = [this](Function &F) -> LoopInfo & {
+      return getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+    };
+    GetSE = [this](Function &F) -> ScalarEvolution & {
+      return getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+    };
+    auto Before = runtimeCalls(M);
+    bool Changed = runImpl(M);
+    remarkRuntimeCalls(M, Before);
+    releaseExpressionTrees();
+    return Changed;
+  }
+
+  bool runImpl(Module &M) {
+
+    if (ExplicitManaged)
+      convertExplicitAllocations(M);
+    // the arena takes the cudaMallocManaged calls instead
+    if ((DeviceCopy || FieldSplit) && !ManagedArena && Policy != POLICY_STATIC)
+      findDeviceCopyCandidates(M);
+    if (ReadbackPrefetch && !ManagedArena && Policy != POLICY_STATIC)
+      findReadbackPrefetches(M);
+    if (FirstTouch && !ManagedArena && Policy != POLICY_STATIC)
+      findFirstTouchInitializers(M);
+    if ((ReadMostly || WriteStream) && Policy != POLICY_STATIC)
+      findReadMostlyCandidates(M);
+    if (KernelFusion && Policy != POLICY_STATIC)
+      findFusionCandidates(M);
+    if (LoopTiling && GridSplit && Policy != POLICY_STATIC)
+      findTilingCandidates(M);
+    if (GraphLaunch && Policy != POLICY_STATIC)
+      findGraphCandidates(M);
+    if (LaunchReorder && Policy != POLICY_STATIC)
+      findReorderCandidates(M);
+    if (PingPong && !ManagedArena && Policy != POLICY_STATIC)
+      instrumentHostAccesses(M);
     findAndAddLocalFunction(M);
     for (auto *Fn : ListOfLocallyDefinedFunctions) {
-      errs() << "Locally defined function " << Fn->getName().str() << "\n";
+      LLVM_DEBUG(dbgs() << "Locally defined function " << Fn->getName().str() << "\n");
     }
 
     for (auto &F : M) {
@@ -5648,17 +9042,17 @@ struct DynamicHostTransform : public ModulePass {
     }
     for (auto FTFA = FunctionToFormalArgumentMap.begin();
          FTFA != FunctionToFormalArgumentMap.end(); FTFA++) {
-      errs() << "Function name = " << FTFA->first->getName().str() << "\n";
+      LLVM_DEBUG(dbgs() << "Function name = " << FTFA->first->getName().str() << "\n");
       for (auto Arg = FTFA->second.begin(); Arg != FTFA->second.end(); Arg++) {
-        errs() << "Arg name = ";
-        (*Arg)->dump();
-        errs() << "\n";
+        LLVM_DEBUG(dbgs() << "Arg name = ");
+        LLVM_DEBUG((*Arg)->dump());
+        LLVM_DEBUG(dbgs() << "\n");
       }
     }
 
     for (auto &F : M) {
       if (F.getName().contains("stub")) {
-        errs() << "not running on " << F.getName() << "\n";
+        LLVM_DEBUG(dbgs() << "not running on " << F.getName() << "\n");
         continue;
       }
       for (auto &BB : F) {
@@ -5684,31 +9078,39 @@ struct DynamicHostTransform : public ModulePass {
     }
 
     mapFormalArgumentsToActualArguments();
-    errs() << "\n\n FORMAL ARG TO ACTUAL ARG MAP\n\n";
+    LLVM_DEBUG(dbgs() << "\n\n FORMAL ARG TO ACTUAL ARG MAP\n\n");
     for (auto FATAAM = FormalArgumentToActualArgumentMap.begin();
          FATAAM != FormalArgumentToActualArgumentMap.end(); FATAAM++) {
-      errs() << "formal arg\n";
-      FATAAM->first->dump();
-      errs() << "actual args\n";
+      LLVM_DEBUG(dbgs() << "formal arg\n");
+      LLVM_DEBUG(FATAAM->first->dump());
+      LLVM_DEBUG(dbgs() << "actual args\n");
       for (auto ActualArgIter = FATAAM->second.begin();
            ActualArgIter != FATAAM->second.end(); ActualArgIter++) {
         /* errs() << (*ActualArgIter) << "\n"; */
-        (*ActualArgIter)->dump();
+        LLVM_DEBUG((*ActualArgIter)->dump());
       }
     }
 
     analyzePointerPropogation(M);
-    errs() << "\nPOINTER PROPOGATION RESULTS\n";
+    LLVM_DEBUG(dbgs() << "\nPOINTER PROPOGATION RESULTS\n");
     for (auto POGP = PointerOpToOriginalPointers.begin();
          POGP != PointerOpToOriginalPointers.end(); POGP++) {
-      errs() << "\n";
-      POGP->first->dump();
-      POGP->second->dump();
+      LLVM_DEBUG(dbgs() << "\n");
+      LLVM_DEBUG(POGP->first->dump());
+      LLVM_DEBUG(POGP->second->dump());
     }
 
+    std::vector<CallBase *> MallocCalls;
+    std::vector<CallBase *> FreeCalls;
+    std::vector<CallBase *> StreamOrderedCalls;
     for (auto &F : M) {
       if (F.getName().contains("stub")) {
-        errs() << "not running on " << F.getName() << "\n";
+        LLVM_DEBUG(dbgs() << "not running on " << F.getName() << "\n");
+        continue;
+      }
+      // the runtime's own allocations, the arena's slabs, are not the
+      // program's
+      if (F.getName().contains("penguin")) {
         continue;
       }
       for (auto &BB : F) {
@@ -5717,7 +9119,23 @@ struct DynamicHostTransform : public ModulePass {
             auto *Callee = CI->getCalledFunction();
             if (Callee && Callee->getName() == "cudaMallocManaged") {
               processMemoryAllocation(CI);
+              MallocCalls.push_back(CI);
+            }
+            if (Callee && Callee->getName() == "cudaFree") {
+              FreeCalls.push_back(CI);
+            }
+            // the runtime registers and forgets these itself
+            if (ManagedPool && Callee &&
+                (Callee->getName() == "cudaMallocAsync" ||
+                 Callee->getName() == "cudaMallocFromPoolAsync")) {
+              processMemoryAllocation(CI);
+              StreamOrderedCalls.push_back(CI);
             }
+            if (ManagedPool && Callee &&
+                (Callee->getName() == "cudaFreeAsync" ||
+                 Callee->getName() == "cudaMemPoolCreate" ||
+                 Callee->getName() == "cudaMemPoolDestroy"))
+              StreamOrderedCalls.push_back(CI);
             if (Callee && Callee->getName() == ("cudaLaunchKernel")) {
             }
           }
@@ -5725,26 +9143,57 @@ struct DynamicHostTransform : public ModulePass {
       }
     }
 
-    errs() << "\nMALLOC SIZE MAP\n";
+    LLVM_DEBUG(dbgs() << "\nMALLOC SIZE MAP\n");
     for (auto I = MallocSizeMap.begin(); I != MallocSizeMap.end(); I++) {
-      I->first->dump();
+      LLVM_DEBUG(I->first->dump());
       if (auto *CI = dyn_cast<CallBase>(I->first)) {
-        CI->getOperand(0)->dump();
+        LLVM_DEBUG(CI->getOperand(0)->dump());
       }
-      errs() << "Size  " << I->second << "\n";
+      LLVM_DEBUG(dbgs() << "Size  " << I->second << "\n");
     }
 
-    errs() << "\nmemory size printing\n";
+    LLVM_DEBUG(dbgs() << "\nmemory size printing\n");
     // quick insert test for printing memory size
     for (auto I = MallocSizeMap.begin(); I != MallocSizeMap.end(); I++) {
-      I->first->dump();
+      LLVM_DEBUG(I->first->dump());
       if (auto *CI = dyn_cast<CallBase>(I->first)) {
+        if (CI->getCalledFunction() &&
+            CI->getCalledFunction()->getName() != "cudaMallocManaged")
+          continue;
         /* CI->getOperand(1)->dump(); */
         // insertCodeToPrintAddress(CI, CI->getOperand(0));
         // insertCodeToPrintSize(CI, CI->getOperand(1));
+        Instruction *After =
+            isa<InvokeInst>(CI)
+                ? cast<InvokeInst>(CI)->getNormalDest()->getFirstNonPHI()
+                : CI->getNextNode();
         insertCodeToRecordMalloc(CI, CI->getOperand(0), CI->getOperand(1));
+        if (After)
+          insertCodeToHintAllocation(After, CI->getOperand(0));
+      }
+    }
+    for (auto *CI : FreeCalls) {
+      insertCodeToRecordFree(CI, CI->getArgOperand(0));
+    }
+    if (ManagedArena) {
+      // sites first, the position of a call counts the cudaMallocManaged
+      // calls before it
+      std::vector<unsigned> Sites;
+      for (auto *CI : MallocCalls) {
+        Sites.push_back(arenaSite(CI));
+      }
+      for (unsigned I = 0; I < MallocCalls.size(); I++) {
+        redirectToArena(MallocCalls[I], "penguinArenaMallocManaged", Sites[I]);
+      }
+      for (auto *CI : FreeCalls) {
+        redirectToArena(CI, "penguinArenaFree", ~0U);
       }
     }
+    for (auto *CI : StreamOrderedCalls) {
+      // cudaMallocAsync -> penguinMallocAsync and so on
+      std::string Name = "penguin" + CI->getCalledFunction()->getName().drop_front(4).str();
+      redirectToArena(CI, Name, ~0U);
+    }
 
     // Note: we are computing the block size earlier/seperately from the main
     // loop below because of the push pop and sroa shenanigans.
@@ -5753,46 +9202,46 @@ struct DynamicHostTransform : public ModulePass {
     // in another method, called from the main loop.
     for (auto &F : M) {
       if (F.getName().contains("stub")) {
-        errs() << "not running on " << F.getName() << "\n";
+        LLVM_DEBUG(dbgs() << "not running on " << F.getName() << "\n");
         continue;
       }
       // comment this for mummer
       processKernelShapeArguments(F);
     };
-    errs() << "KERNEL INVOCATION TO BLOCK SIZE MAP\n";
+    LLVM_DEBUG(dbgs() << "KERNEL INVOCATION TO BLOCK SIZE MAP\n");
     for (auto Iter = KernelInvocationToBlockSizeMap.begin();
          Iter != KernelInvocationToBlockSizeMap.end(); Iter++) {
-      (*Iter).first->dump();
+      LLVM_DEBUG((*Iter).first->dump());
       for (auto BDimIter = (*Iter).second.begin();
            BDimIter != (*Iter).second.end(); BDimIter++) {
-        errs() << (*BDimIter).first << " ";
-        errs() << (*BDimIter).second << "\n";
+        LLVM_DEBUG(dbgs() << (*BDimIter).first << " ");
+        LLVM_DEBUG(dbgs() << (*BDimIter).second << "\n");
       }
     }
 
     for (auto &F : M) {
       if (F.getName().contains("__cuda_module_ctor") ||
           F.getName().contains("__cuda_register_globals")) {
-        errs() << "CTOR FOUND\n";
+        LLVM_DEBUG(dbgs() << "CTOR FOUND\n");
         for (auto &BB : F) {
           for (auto &I : BB) {
             if (auto *CI = dyn_cast<CallBase>(&I)) {
-              CI->dump();
+              LLVM_DEBUG(CI->dump());
               auto *Callee = CI->getCalledFunction();
               if (Callee && Callee->getName() == ("__cudaRegisterFunction")) {
-                errs() << "Found a registration\n";
-                errs() << Callee->getName() << "\n";
+                LLVM_DEBUG(dbgs() << "Found a registration\n");
+                LLVM_DEBUG(dbgs() << Callee->getName() << "\n");
                 /* CI->getArgOperand(1)->dump(); */
                 if (llvm::Function *Fn =
                         dyn_cast<Function>(CI->getArgOperand(1))) {
-                  errs() << " func name = " << Fn->getName() << "\n";
+                  LLVM_DEBUG(dbgs() << " func name = " << Fn->getName() << "\n");
                   if (llvm::GlobalVariable *DvFn =
                           dyn_cast<GlobalVariable>(CI->getArgOperand(2))) {
-                    errs() << " device side name = ";
+                    LLVM_DEBUG(dbgs() << " device side name = ");
                     auto DvFnStr =
                         dyn_cast<ConstantDataArray>(DvFn->getInitializer());
                     if (DvFnStr) {
-                      errs() << DvFnStr->getAsCString() << "\n";
+                      LLVM_DEBUG(dbgs() << DvFnStr->getAsCString() << "\n");
                       HostSideKernelNameToOriginalNameMap[std::string(
                           Fn->getName())] =
                           std::string(DvFnStr->getAsCString());
@@ -5814,14 +9263,16 @@ struct DynamicHostTransform : public ModulePass {
     for (auto &F : M) {
 
       if (F.getName().contains("stub")) {
-        errs() << "not running on " << F.getName() << "\n";
+        LLVM_DEBUG(dbgs() << "not running on " << F.getName() << "\n");
         continue;
       }
+      if (F.isDeclaration())
+        continue;
+      // once per function: the legacy manager recomputes an on-the-fly
+      // analysis on every getAnalysis call, the new one caches it
+      LoopInfo &LI = GetLI(F);
+      ScalarEvolution &SE = GetSE(F);
       for (auto &BB : F) {
-
-        LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
-        ScalarEvolution &SE =
-            getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
         for (auto &I : BB) {
           if (auto *CI = dyn_cast<CallBase>(&I)) {
             auto *Callee = CI->getCalledFunction();
@@ -5840,7 +9291,7 @@ struct DynamicHostTransform : public ModulePass {
               auto *KernelPointer = CI->getArgOperand(0);
               auto *KernelFunction = dyn_cast_or_null<Function>(KernelPointer);
               auto KernelName = KernelFunction->getName();
-              errs() << "Name of kernel = " << KernelName << "\n";
+              LLVM_DEBUG(dbgs() << "Name of kernel = " << KernelName << "\n");
               if (KernelName.compare("_ZN8GpuBTree7kernels25__device_stub__"
                                      "init_btreeI13PoolAllocatorEEvPjT_") == 0)
                 continue;
@@ -5862,9 +9313,12 @@ struct DynamicHostTransform : public ModulePass {
               processKernelInvocation(CI);
               processKernelSignature(CI);
               processKernelArguments(CI);
+              if (Iterative)
+                KernelLaunchIsLoopInvariant[CI] =
+                    argumentsAreLoopInvariant(CI, LI.getLoopFor(CI->getParent()));
 
               FunctionsWithKernelLaunches.insert(&F);
-              errs() << "insert into FunctionsWithKernelLaunches\n";
+              LLVM_DEBUG(dbgs() << "insert into FunctionsWithKernelLaunches\n");
             }
           }
         }
@@ -5872,20 +9326,21 @@ struct DynamicHostTransform : public ModulePass {
     }
     /* return true; */
 
-    errs() << "the numeber of invocations is " << KernelLaunches.size();
+    LLVM_DEBUG(dbgs() << "the numeber of invocations is " << KernelLaunches.size());
     if(KernelLaunches.size() > 1) {
         multiKernel = true;
     }
+    buildDataflowGraph();
 
     bool LoopSingleRunFunctionInserted = false;
     bool FirstInvocationFound = false;
-    errs() << "Kernel Launches listed here\n";
+    LLVM_DEBUG(dbgs() << "Kernel Launches listed here\n");
           Instruction *InsertionPoint;
     // iterate over kernel launches and insert code
     for (auto KL = KernelLaunches.begin(); KL != KernelLaunches.end(); KL++) {
-      (*KL)->dump();
+      LLVM_DEBUG((*KL)->dump());
       if (KernelLaunchIsIterative[*KL]) {
-        errs() << "Iterative kernel\n";
+        LLVM_DEBUG(dbgs() << "Iterative kernel\n");
         // numThread computation may be hoisted, only if numThreads is
         // iteation-independent
         auto CI = dyn_cast<CallBase>(*KL);
@@ -5894,7 +9349,7 @@ struct DynamicHostTransform : public ModulePass {
         std::map<unsigned, bool> LoopIDToIncompMap;
         std::map<unsigned, Value *> IfIDToProbMap;
         if (gridSizeIsIterationIndependent(CI)) {
-          errs() << "grid size is iteration independent\n";
+          LLVM_DEBUG(dbgs() << "grid size is iteration independent\n");
           // identify  the instruction just above the loop header
           // auto *LoopHeader = getEnclosingLoopPreheaderFirst(CI);
           // LoopHeader->dump();
@@ -5905,10 +9360,11 @@ struct DynamicHostTransform : public ModulePass {
               if (LIVTOInsertionPointMap.find(LIV) != LIVTOInsertionPointMap.end()) {
                   InsertionPoint = LIVTOInsertionPointMap[LIV];
               } else {
-                  errs() << "launch where chosing insertpoint =\n";
-                  CI->dump();
+                  LLVM_DEBUG(dbgs() << "launch where chosing insertpoint =\n");
+                  LLVM_DEBUG(CI->dump());
                   InsertionPoint = insertCodeForFirstIterationExecution(CI, LIV);
-                  IterationDecisionPoint = insertCodeForIterationDecision(CI, LIV);
+                  if (Policy != POLICY_STATIC)
+                    IterationDecisionPoint = insertCodeForIterationDecision(CI, LIV);
                   LIVTOInsertionPointMap[LIV] = InsertionPoint;
               }
               InsertionPoint = insertCodeToPerformIterativeMemoryMgmt(InsertionPoint);
@@ -5917,7 +9373,20 @@ struct DynamicHostTransform : public ModulePass {
                   FirstInvocation = InsertionPoint;
               LoopSingleRunFunctionInserted = true;
           }
-          KernelInvocationToInsertionPointMap[CI] = CI;
+          // after the planning and the iteration prefetch of this iteration
+          if (StagedCopy && Policy != POLICY_STATIC && LIV)
+            insertCodeToRemapStagedArguments(CI, LIV);
+          // the same arguments every iteration: decide once, at the end of
+          // the first iteration's planning, and leave the iteration prefetch
+          // alone in the loop body
+          if (KernelLaunchIsLoopInvariant[CI] && LIVTOInsertionPointMap.count(LIV) &&
+              LIVTOInsertionPointMap[LIV]->getParent() == InsertionPoint->getParent()) {
+            LLVM_DEBUG(dbgs() << "hoisting the memory management of the launch\n");
+            KernelInvocationToInsertionPointMap[CI] =
+                InsertionPoint->getParent()->getTerminator();
+          } else {
+            KernelInvocationToInsertionPointMap[CI] = CI;
+          }
           insertCodeToComputeKernelLoopIterationCount(InsertionPoint, CI,
                                                       LoopIDToNumIterationsMap, LoopIDToIncompMap);
           identifyIterationDependentAccesses(InsertionPoint, CI,
@@ -5941,8 +9410,8 @@ struct DynamicHostTransform : public ModulePass {
                   KernelInvocationToBDimXMap, KernelInvocationToBDimYMap,
                   KernelInvocationToGDimXMap, KernelInvocationToGDimYMap);
         } else {
-          errs() << "grid size is not iteration independent\n";
-          errs() << "we will assume that kernel is not iterative and perform other optimization\n";
+          LLVM_DEBUG(dbgs() << "grid size is not iteration independent\n");
+          LLVM_DEBUG(dbgs() << "we will assume that kernel is not iterative and perform other optimization\n");
         if (llvm::CallBase *CI = dyn_cast<CallBase>(*KL)) {
           std::map<unsigned, Value *> LoopIDToNumIterationsMap;
         std::map<unsigned, bool> LoopIDToIncompMap;
@@ -5969,7 +9438,7 @@ struct DynamicHostTransform : public ModulePass {
         }
         }
       } else {
-        errs() << "not iterative kernel\n";
+        LLVM_DEBUG(dbgs() << "not iterative kernel\n");
         if (llvm::CallBase *CI = dyn_cast<CallBase>(*KL)) {
           std::map<unsigned, Value *> LoopIDToNumIterationsMap;
         std::map<unsigned, bool> LoopIDToIncompMap;
@@ -6000,6 +9469,48 @@ struct DynamicHostTransform : public ModulePass {
         }
       }
     }
+    // last, so the begin sits right before the launch, after its planning
+    for (auto *KL : KernelLaunches)
+      insertCodeToTimeKernel(cast<CallBase>(KL));
+    // tells the runtime in this module that the pointers are remapped
+    if (StagedCopy && Policy != POLICY_STATIC) {
+      if (auto *Remap = M.getGlobalVariable("penguin_staged_remap"))
+        Remap->setInitializer(ConstantInt::get(Remap->getValueType(), 1));
+    }
+    if (DeviceCopy && !DeviceCopyCandidates.empty())
+      insertCodeForDeviceCopies();
+    if (FieldSplit && !DeviceCopyCandidates.empty())
+      insertCodeToSplitFields(M);
+    if (!ReadbackCandidates.empty())
+      insertCodeForReadbackPrefetches(M);
+    if (!FirstTouchInitializers.empty())
+      insertCodeForFirstTouch(M);
+    if (Policy != POLICY_STATIC && !LibraryFootprintsFile.empty())
+      insertCodeForLibraryCalls(M);
+    if (ReadMostly && !ReadMostlyCandidates.empty())
+      insertCodeForArgumentAdvice(M, cuda_analysis::RK_ReadOnly,
+                                  "penguinAdviseReadMostly");
+    if (WriteStream && !ReadMostlyCandidates.empty())
+      insertCodeForArgumentAdvice(M, cuda_analysis::RK_WriteOnly,
+                                  "penguinAdviseWriteStream");
+    // before the grid splitting, which would take the launches
+    if (KernelFusion && !FusionCandidates.empty())
+      insertCodeToFuseKernels(M);
+    if (!TilingCandidates.empty())
+      insertCodeToTileLoops(M);
+    if (!GraphCandidates.empty())
+      insertCodeToGraphLoops(M);
+    if (!ReorderCandidates.empty())
+      insertCodeToReorderLaunches(M);
+    // after everything else keyed on the cudaLaunchKernel calls
+    if (GridSplit)
+      insertCodeToSplitGrids(M);
+    // the readback and first-touch steps above look for cudaMemcpy
+    if (ExplicitManaged)
+      redirectExplicitCopies(M);
+    // last, the steps above find the allocations by their callee
+    if (NvmeTier && !ManagedArena && Policy != POLICY_STATIC)
+      redirectToNvmeTier(M);
 
     return true;
   }
@@ -6016,6 +9527,62 @@ char DynamicHostTransform::ID = 0;
 static RegisterPass<DynamicHostTransform>
     X("DynamicHostTransform", "DynamicHostTransform Pass", true, true);
 
+namespace {
+
+// New pass manager version: -passes=dynamic-host-transform. LoopInfo and ScalarEvolution
+// come from the FunctionAnalysisManager, so a preceding loop-rotate in the
+// same pipeline leaves them cached.
+struct DynamicHostTransformPass : PassInfoMixin<DynamicHostTransformPass> {
+  // set when added at an extension point, where device modules come by too
+  bool HostOnly;
+
+  explicit DynamicHostTransformPass(bool HostOnly = false) : HostOnly(HostOnly) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    if (HostOnly && Triple(M.getTargetTriple()).isNVPTX())
+      return PreservedAnalyses::all();
+    auto &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    DynamicHostTransform T;
+    T.GetLI = [&](Function &F) -> LoopInfo & {
+      return FAM.getResult<LoopAnalysis>(F);
+    };
+    T.GetSE = [&](Function &F) -> ScalarEvolution & {
+      return FAM.getResult<ScalarEvolutionAnalysis>(F);
+    };
+    auto Before = runtimeCalls(M);
+    bool Changed = T.doInitialization(M);
+    Changed |= T.runImpl(M);
+    remarkRuntimeCalls(M, Before);
+    releaseExpressionTrees();
+    Changed |= T.doFinalization(M);
+    return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  }
+};
+
+} // namespace
+
+// opt -load-pass-plugin=DynamicHostTransform.so -passes=dynamic-host-transform, or
+// clang -fpass-plugin=DynamicHostTransform.so, which runs it last on host modules
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "DynamicHostTransform", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name != "dynamic-host-transform")
+                    return false;
+                  MPM.addPass(DynamicHostTransformPass());
+                  return true;
+                });
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel) {
+                  MPM.addPass(DynamicHostTransformPass(/*HostOnly=*/true));
+                });
+          }};
+}
+
 /*
         traverseExpressionTree(AID->second);
         std::map<ExprTreeNode *, Value *> Unknowns;
@@ -36,6 +36,9 @@
 #include "uvm_hmm.h"
 #include "uvm_mem.h"
 
+#define CREATE_TRACE_POINTS
+#include "uvm_trace.h"
+
 #define NVIDIA_UVM_DEVICE_NAME          "nvidia-uvm"
 
 static dev_t g_uvm_base_dev;
@@ -747,9 +750,25 @@ static long uvm_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_NO_MIGRATE_REGION,         uvm_api_set_no_migrate_region);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_START_STAT_COLLECTION,          uvm_api_start_stat_collection);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_STOP_STAT_COLLECTION,           uvm_api_stop_stat_collection);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SNAPSHOT_STAT_COLLECTION,       uvm_api_snapshot_stat_collection);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_QUICK_MIGRATE_REGION,         uvm_api_set_quick_migration);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_RECONFIGURE_ACCESS_COUNTERS,         uvm_api_reconfigure_access_counters);
         UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_IS_ALLOCATED,         uvm_api_is_allocated);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_PREFETCH_STRIDE,            uvm_api_set_prefetch_stride);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_ACCESS_PATTERN,             uvm_api_set_access_pattern);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_POLICY_BATCH,               uvm_api_set_policy_batch);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_DISCARDABLE,                uvm_api_set_discardable);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_ACCESS_COUNTER_POLICY,      uvm_api_set_access_counter_policy);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_GET_THRASHING_EVENTS,           uvm_api_get_thrashing_events);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_REGISTER_EVENT_RING,            uvm_api_register_event_ring);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_HOST_HUGE_PAGES,            uvm_api_set_host_huge_pages);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_GET_RESIDENCY,                  uvm_api_get_residency);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_MIGRATE_BATCH,                  uvm_api_migrate_batch);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_NEXT_USE,                   uvm_api_set_next_use);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_FAULT_REPLAY_HINT,          uvm_api_set_fault_replay_hint);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_SET_HOST_NUMA_NODE,             uvm_api_set_host_numa_node);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_REGISTER_SUBMIT_RING,           uvm_api_register_submit_ring);
+        UVM_ROUTE_CMD_STACK_INIT_CHECK(UVM_KICK_SUBMIT_RING,               uvm_api_kick_submit_ring);
     }
 
     // Try the test ioctls if none of the above matched
@@ -256,8 +256,42 @@ NV_STATUS uvm_api_populate_pageable(const UVM_POPULATE_PAGEABLE_PARAMS *params,
 NV_STATUS uvm_api_set_prioritized_location(const UVM_SET_PRIORITIZED_LOCATION_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_set_no_migrate_region(const UVM_SET_NO_MIGRATE_REGION_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_start_stat_collection(const UVM_START_STAT_COLLECTION_PARAMS *params, struct file *filp);
-NV_STATUS uvm_api_stop_stat_collection(const UVM_STOP_STAT_COLLECTION_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_stop_stat_collection(UVM_STOP_STAT_COLLECTION_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_snapshot_stat_collection(UVM_SNAPSHOT_STAT_COLLECTION_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_set_quick_migration(const UVM_SET_QUICK_MIGRATE_REGION_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_reconfigure_access_counters(const UVM_RECONFIGURE_ACCESS_COUNTERS_PARAMS *params, struct file *filp);
 NV_STATUS uvm_api_is_allocated(UVM_IS_ALLOCATED_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_prefetch_stride(const UVM_SET_PREFETCH_STRIDE_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_access_pattern(const UVM_SET_ACCESS_PATTERN_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_policy_batch(UVM_SET_POLICY_BATCH_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_discardable(const UVM_SET_DISCARDABLE_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_access_counter_policy(const UVM_SET_ACCESS_COUNTER_POLICY_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_get_thrashing_events(UVM_GET_THRASHING_EVENTS_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_register_event_ring(const UVM_REGISTER_EVENT_RING_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_host_huge_pages(const UVM_SET_HOST_HUGE_PAGES_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_get_residency(const UVM_GET_RESIDENCY_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_migrate_batch(UVM_MIGRATE_BATCH_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_next_use(const UVM_SET_NEXT_USE_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_fault_replay_hint(const UVM_SET_FAULT_REPLAY_HINT_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_set_host_numa_node(const UVM_SET_HOST_NUMA_NODE_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_register_submit_ring(const UVM_REGISTER_SUBMIT_RING_PARAMS *params, struct file *filp);
+NV_STATUS uvm_api_kick_submit_ring(UVM_KICK_SUBMIT_RING_PARAMS *params, struct file *filp);
+
+// One entry of UVM_SET_POLICY_BATCH, with the VA space lock held in write
+// mode, or in read mode if uvm_policy_batch_entry_is_read_safe() says so, and
+// one of UVM_MIGRATE_BATCH, with it held in read mode and mm's mmap_lock in
+// read mode if mm isn't NULL. The copies of the migration are added to
+// tracker. The submit ring worker applies its commands through them.
+//
+// An entry is read safe if it only sets the prioritized location or quick
+// migrate flag of managed va_ranges and splits none of them. The VA space lock
+// must be held in at least read mode, and stay held until the entry is
+// applied.
+bool uvm_policy_batch_entry_is_read_safe(uvm_va_space_t *va_space, const UVM_POLICY_BATCH_ENTRY *entry);
+NV_STATUS uvm_policy_batch_apply(uvm_va_space_t *va_space, struct mm_struct *mm, const UVM_POLICY_BATCH_ENTRY *entry);
+NV_STATUS uvm_migrate_batch_entry(uvm_va_space_t *va_space,
+                                  struct mm_struct *mm,
+                                  const UVM_MIGRATE_BATCH_ENTRY *entry,
+                                  NvU32 flags,
+                                  uvm_tracker_t *tracker);
 #endif // __UVM_API_H__
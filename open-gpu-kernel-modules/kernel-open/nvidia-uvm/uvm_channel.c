@@ -55,6 +55,18 @@ module_param(uvm_channel_gpfifo_loc, charp, S_IRUGO);
 module_param(uvm_channel_gpput_loc, charp, S_IRUGO);
 module_param(uvm_channel_pushbuffer_loc, charp, S_IRUGO);
 
+// Non-zero gives the prefetch migrations user space asks for their own CE,
+// see UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH; 0 copies them with the faults
+static int uvm_channel_prefetch_ce = 1;
+module_param(uvm_channel_prefetch_ce, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_channel_prefetch_ce, "Copy user requested prefetches to the GPU on a CE of their own (1) or with the faults (0). Default: 1.");
+
+// Non-zero stripes those prefetches across every CE that reads sysmem fast,
+// block by block, see uvm_channel_reserve_cpu_to_gpu_stripe
+static int uvm_channel_stripe_ces = 1;
+module_param(uvm_channel_stripe_ces, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_channel_stripe_ces, "Stripe user requested prefetches to the GPU across all the CEs that read sysmem fast (1) or copy them on one CE (0). Default: 1.");
+
 static NV_STATUS manager_create_procfs_dirs(uvm_channel_manager_t *manager);
 static NV_STATUS manager_create_procfs(uvm_channel_manager_t *manager);
 static NV_STATUS channel_create_procfs(uvm_channel_t *channel);
@@ -286,6 +298,18 @@ NV_STATUS uvm_channel_reserve_type(uvm_channel_manager_t *manager, uvm_channel_t
     return channel_reserve_in_pool(manager->pool_to_use.default_for_type[type], channel_out);
 }
 
+NV_STATUS uvm_channel_reserve_cpu_to_gpu_stripe(uvm_channel_manager_t *manager,
+                                                NvU64 stripe,
+                                                uvm_channel_t **channel_out)
+{
+    const unsigned num_stripes = manager->pool_to_use.num_cpu_to_gpu_stripes;
+
+    if (num_stripes < 2)
+        return uvm_channel_reserve_type(manager, UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH, channel_out);
+
+    return channel_reserve_in_pool(manager->pool_to_use.cpu_to_gpu_stripe[do_div(stripe, num_stripes)], channel_out);
+}
+
 NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *manager,
                                          uvm_gpu_t *dst_gpu,
                                          uvm_channel_t **channel_out)
@@ -1045,6 +1069,7 @@ static bool ce_usable_for_channel_type(uvm_channel_type_t type, const UvmGpuCopy
     switch (type) {
         case UVM_CHANNEL_TYPE_CPU_TO_GPU:
         case UVM_CHANNEL_TYPE_GPU_TO_CPU:
+        case UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH:
             return cap->sysmem;
         case UVM_CHANNEL_TYPE_GPU_INTERNAL:
         case UVM_CHANNEL_TYPE_MEMOPS:
@@ -1112,6 +1137,20 @@ static int compare_ce_for_channel_type(const UvmGpuCopyEngineCaps *ce_caps,
 
             break;
 
+        case UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH:
+            // Above all a CE no other type uses, CPU_TO_GPU in particular,
+            // then fast sysmem read
+            ce0_usage = ce_usage_count(ce_index0, preferred_ce);
+            ce1_usage = ce_usage_count(ce_index1, preferred_ce);
+
+            if (ce0_usage != ce1_usage)
+                return ce0_usage - ce1_usage;
+
+            if (cap0->sysmemRead != cap1->sysmemRead)
+                return cap1->sysmemRead - cap0->sysmemRead;
+
+            break;
+
         case UVM_CHANNEL_TYPE_GPU_TO_GPU:
             // Prefer the LCE with the most PCEs
             {
@@ -1204,7 +1243,36 @@ static NV_STATUS pick_ce_for_channel_type(uvm_channel_manager_t *manager,
     return NV_OK;
 }
 
-static NV_STATUS channel_manager_pick_copy_engines(uvm_channel_manager_t *manager, unsigned *preferred_ce)
+// CEs the prefetches to the GPU are striped across: all that read sysmem
+// fast, but the one the faults copy with when prefetches get CEs of their own
+// and at least two others are left.
+static void pick_cpu_to_gpu_stripe_ces(const UvmGpuCopyEngineCaps *ce_caps,
+                                       const unsigned *preferred_ce,
+                                       unsigned long *stripe_ce_mask)
+{
+    NvU32 i;
+
+    bitmap_zero(stripe_ce_mask, UVM_COPY_ENGINE_COUNT_MAX);
+
+    if (!uvm_channel_stripe_ces)
+        return;
+
+    for (i = 0; i < UVM_COPY_ENGINE_COUNT_MAX; ++i) {
+        const UvmGpuCopyEngineCaps *cap = ce_caps + i;
+
+        if (ce_usable_for_channel_type(UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH, cap) && cap->sysmemRead)
+            __set_bit(i, stripe_ce_mask);
+    }
+
+    if (uvm_channel_prefetch_ce &&
+        bitmap_weight(stripe_ce_mask, UVM_COPY_ENGINE_COUNT_MAX) > 2 &&
+        test_bit(preferred_ce[UVM_CHANNEL_TYPE_CPU_TO_GPU], stripe_ce_mask))
+        __clear_bit(preferred_ce[UVM_CHANNEL_TYPE_CPU_TO_GPU], stripe_ce_mask);
+}
+
+static NV_STATUS channel_manager_pick_copy_engines(uvm_channel_manager_t *manager,
+                                                   unsigned *preferred_ce,
+                                                   unsigned long *stripe_ce_mask)
 {
     NV_STATUS status;
     unsigned i;
@@ -1213,7 +1281,8 @@ static NV_STATUS channel_manager_pick_copy_engines(uvm_channel_manager_t *manage
                                   UVM_CHANNEL_TYPE_GPU_TO_CPU,
                                   UVM_CHANNEL_TYPE_GPU_INTERNAL,
                                   UVM_CHANNEL_TYPE_GPU_TO_GPU,
-                                  UVM_CHANNEL_TYPE_MEMOPS};
+                                  UVM_CHANNEL_TYPE_MEMOPS,
+                                  UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH};
 
     memset(&ces_caps, 0, sizeof(ces_caps));
     status = uvm_rm_locked_call(nvUvmInterfaceQueryCopyEnginesCaps(uvm_gpu_device_handle(manager->gpu), &ces_caps));
@@ -1223,13 +1292,16 @@ static NV_STATUS channel_manager_pick_copy_engines(uvm_channel_manager_t *manage
    // The order of picking CEs for each type matters as it's affected by the
    // usage count of each CE and it increases every time a CE is selected.
    // MEMOPS has the least priority as it only cares about low usage of the
-   // CE to improve latency
+   // CE to improve latency. CPU_TO_GPU_PREFETCH comes after it, to get the
+   // CE the others use least
     for (i = 0; i < ARRAY_SIZE(types); ++i) {
         status = pick_ce_for_channel_type(manager, ces_caps.copyEngineCaps, types[i], preferred_ce);
         if (status != NV_OK)
             return status;
     }
 
+    pick_cpu_to_gpu_stripe_ces(ces_caps.copyEngineCaps, preferred_ce, stripe_ce_mask);
+
     return NV_OK;
 }
 
@@ -1414,12 +1486,13 @@ static NV_STATUS channel_manager_create_pools(uvm_channel_manager_t *manager)
     unsigned ce, type;
     unsigned num_channel_pools;
     unsigned preferred_ce[UVM_CHANNEL_TYPE_CE_COUNT];
+    DECLARE_BITMAP(stripe_ce_mask, UVM_COPY_ENGINE_COUNT_MAX);
     uvm_channel_pool_t *pool = NULL;
 
     for (type = 0; type < ARRAY_SIZE(preferred_ce); type++)
         preferred_ce[type] = UVM_COPY_ENGINE_COUNT_MAX;
 
-    status = channel_manager_pick_copy_engines(manager, preferred_ce);
+    status = channel_manager_pick_copy_engines(manager, preferred_ce, stripe_ce_mask);
     if (status != NV_OK)
         return status;
 
@@ -1449,6 +1522,18 @@ static NV_STATUS channel_manager_create_pools(uvm_channel_manager_t *manager)
         manager->pool_to_use.default_for_type[type] = channel_manager_ce_pool(manager, ce);
     }
 
+    if (!uvm_channel_prefetch_ce) {
+        manager->pool_to_use.default_for_type[UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH] =
+            manager->pool_to_use.default_for_type[UVM_CHANNEL_TYPE_CPU_TO_GPU];
+    }
+
+    manager->pool_to_use.num_cpu_to_gpu_stripes = 0;
+    for_each_set_bit(ce, stripe_ce_mask, UVM_COPY_ENGINE_COUNT_MAX) {
+        unsigned stripe = manager->pool_to_use.num_cpu_to_gpu_stripes++;
+
+        manager->pool_to_use.cpu_to_gpu_stripe[stripe] = channel_manager_ce_pool(manager, ce);
+    }
+
     // In SR-IOV heavy, add an additional, single-channel, pool that is
     // dedicated to the MEMOPS type.
     if (uvm_gpu_uses_proxy_channel_pool(manager->gpu)) {
@@ -1585,7 +1670,7 @@ uvm_channel_t *uvm_channel_any_of_type(uvm_channel_manager_t *manager, NvU32 poo
 
 const char *uvm_channel_type_to_string(uvm_channel_type_t channel_type)
 {
-    BUILD_BUG_ON(UVM_CHANNEL_TYPE_COUNT != 5);
+    BUILD_BUG_ON(UVM_CHANNEL_TYPE_COUNT != 6);
 
     switch (channel_type) {
         UVM_ENUM_STRING_CASE(UVM_CHANNEL_TYPE_CPU_TO_GPU);
@@ -1593,6 +1678,7 @@ const char *uvm_channel_type_to_string(uvm_channel_type_t channel_type)
         UVM_ENUM_STRING_CASE(UVM_CHANNEL_TYPE_GPU_INTERNAL);
         UVM_ENUM_STRING_CASE(UVM_CHANNEL_TYPE_MEMOPS);
         UVM_ENUM_STRING_CASE(UVM_CHANNEL_TYPE_GPU_TO_GPU);
+        UVM_ENUM_STRING_CASE(UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH);
         UVM_ENUM_STRING_DEFAULT();
     }
 }
@@ -79,6 +79,12 @@ typedef enum
     // GPU to GPU peer copies
     UVM_CHANNEL_TYPE_GPU_TO_GPU,
 
+    // CPU to GPU copies of the migrations user space asks for
+    // (cudaMemPrefetchAsync, and the bulk migrations of SUV's quick migrate
+    // ranges), on a CE of their own when there is one so that they don't
+    // queue ahead of fault servicing on CPU_TO_GPU
+    UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH,
+
     UVM_CHANNEL_TYPE_CE_COUNT,
 
     // ^^^^^^
@@ -293,6 +299,12 @@ struct uvm_channel_manager_struct
         // If there is no optimal pool (the entry is NULL), use default pool
         // default_for_type[UVM_CHANNEL_GPU_TO_GPU] instead.
         uvm_channel_pool_t *gpu_to_gpu[UVM_ID_MAX_GPUS];
+
+        // Pools the prefetches to the GPU are striped across, one per CE
+        // that reads sysmem fast. With fewer than two there is no striping
+        // and they use default_for_type[UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH].
+        uvm_channel_pool_t *cpu_to_gpu_stripe[UVM_COPY_ENGINE_COUNT_MAX];
+        unsigned num_cpu_to_gpu_stripes;
     } pool_to_use;
 
     struct
@@ -415,6 +427,13 @@ NV_STATUS uvm_channel_reserve_type(uvm_channel_manager_t *manager,
                                    uvm_channel_type_t type,
                                    uvm_channel_t **channel_out);
 
+// Select and reserve a channel for stripe of a prefetch to
+// channel_manager->gpu. Consecutive stripes go to different CEs, so the
+// copies of a large migration run on all of them at once.
+NV_STATUS uvm_channel_reserve_cpu_to_gpu_stripe(uvm_channel_manager_t *channel_manager,
+                                                NvU64 stripe,
+                                                uvm_channel_t **channel_out);
+
 // Select and reserve a channel for a transfer from channel_manager->gpu to
 // dst_gpu.
 NV_STATUS uvm_channel_reserve_gpu_to_gpu(uvm_channel_manager_t *channel_manager,
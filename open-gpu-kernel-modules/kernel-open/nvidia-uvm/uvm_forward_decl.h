@@ -58,6 +58,7 @@ typedef struct uvm_va_block_test_struct uvm_va_block_test_t;
 typedef struct uvm_va_block_wrapper_struct uvm_va_block_wrapper_t;
 typedef struct uvm_va_space_struct uvm_va_space_t;
 typedef struct uvm_va_space_mm_struct uvm_va_space_mm_t;
+typedef struct uvm_va_space_epoch_stats_struct uvm_va_space_epoch_stats_t;
 
 typedef struct uvm_make_resident_context_struct uvm_make_resident_context_t;
 
@@ -374,6 +374,7 @@ static void gpu_info_print_common(uvm_gpu_t *gpu, struct seq_file *s)
     NvU64 mapped_cpu_pages_size;
     NvU32 get, put;
     unsigned int cpu;
+    uvm_pmm_gpu_fragmentation_t fragmentation;
 
     UVM_SEQ_OR_DBG_PRINT(s, "GPU %s\n", uvm_gpu_name(gpu));
     UVM_SEQ_OR_DBG_PRINT(s, "retained_count                         %llu\n", uvm_gpu_retained_count(gpu));
@@ -383,6 +384,12 @@ static void gpu_info_print_common(uvm_gpu_t *gpu, struct seq_file *s)
     else
         UVM_SEQ_OR_DBG_PRINT(s, "closest_cpu_numa_node                  %d\n", gpu->parent->closest_cpu_numa_node);
 
+    uvm_pmm_gpu_get_fragmentation(&gpu->pmm, &fragmentation);
+    UVM_SEQ_OR_DBG_PRINT(s, "pmm_split_root_chunks                  %llu\n", fragmentation.split_root_chunks);
+    UVM_SEQ_OR_DBG_PRINT(s, "pmm_free_in_split_root_chunks          %llu MBs\n", fragmentation.split_free_bytes / (1024 * 1024));
+    UVM_SEQ_OR_DBG_PRINT(s, "pmm_free_in_root_chunks                %llu MBs\n", fragmentation.root_free_bytes / (1024 * 1024));
+    UVM_SEQ_OR_DBG_PRINT(s, "pmm_compacted_root_chunks              %llu\n", fragmentation.compacted_root_chunks);
+
     if (!uvm_procfs_is_debug_enabled())
         return;
 
@@ -203,6 +203,9 @@ struct uvm_fault_service_batch_context_struct
     // Unique id (per-GPU) generated for tools events recording
     NvU32 batch_id;
 
+    // Replay policy of the batch, the one of the first VA space it services
+    uvm_perf_fault_replay_policy_t replay_policy;
+
     uvm_tracker_t tracker;
 
     // Boolean used to avoid sorting the fault batch by instance_ptr if we
@@ -223,6 +226,43 @@ struct uvm_ats_fault_invalidate_struct
     uvm_tlb_batch_t write_faults_tlb_batch;
 };
 
+// VA block of a replayable fault batch deferred to the fault service pool,
+// and the index of its first fault in ordered_fault_cache
+typedef struct
+{
+    uvm_va_block_t *va_block;
+
+    NvU32 first_fault_index;
+} uvm_fault_service_block_t;
+
+// Thread of the pool that services the VA blocks of a replayable fault batch
+// concurrently. See uvm_perf_fault_service_threads.
+typedef struct
+{
+    nv_kthread_q_t q;
+
+    nv_kthread_q_item_t q_item;
+
+    // GPU and VA space being serviced, and the mm locked with it, if any
+    uvm_gpu_t *gpu;
+
+    uvm_va_space_t *va_space;
+
+    struct mm_struct *mm;
+
+    // The worker services the pending blocks whose index modulo the number of
+    // workers is its own
+    NvU32 index;
+
+    // Copy of the batch context that shares its fault arrays and has its own
+    // counters, uTLB information and tracker, merged back by the bottom half
+    uvm_fault_service_batch_context_t batch_context;
+
+    uvm_service_block_context_t block_service_context;
+
+    NV_STATUS status;
+} uvm_fault_service_worker_t;
+
 typedef struct
 {
     // Fault buffer information and structures provided by RM
@@ -258,6 +298,10 @@ typedef struct
         // that comes before the replay method.
         NvU32 replay_update_put_ratio;
 
+        // Batch size chosen for the last VA space serviced, 0 for
+        // uvm_perf_fault_batch_count. See uvm_perf_fault_replay_adaptive.
+        NvU32 adaptive_batch_count;
+
         // Fault statistics. These fields are per-GPU and most of them are only
         // updated during fault servicing, and can be safely incremented.
         // Migrations may be triggered by different GPUs and need to be
@@ -294,6 +338,18 @@ typedef struct
 
         // Information required to invalidate stale ATS PTEs from the GPU TLBs
         uvm_ats_fault_invalidate_t ats_invalidate;
+
+        // Pool servicing the VA blocks of a batch concurrently. It has no
+        // workers unless uvm_perf_fault_service_threads is set.
+        NvU32 num_service_workers;
+
+        uvm_fault_service_worker_t *service_workers;
+
+        // VA blocks of the current VA space waiting for the pool. The array
+        // holds max_batch_size entries.
+        uvm_fault_service_block_t *pending_blocks;
+
+        NvU32 num_pending_blocks;
     } replayable;
 
     struct uvm_non_replayable_fault_buffer_info_struct
@@ -365,6 +421,21 @@ typedef struct
     unsigned node_id;
 } uvm_numa_info_t;
 
+// Most virtual address notifications serviced as one, see
+// service_virt_notifications
+#define UVM_ACCESS_COUNTER_MERGE_MAX 8
+
+// A physical location a virtual address notification could have touched
+typedef struct
+{
+    uvm_gpu_phys_address_t phys_address;
+
+    uvm_processor_id_t resident_id;
+
+    // Index of the notification in its group
+    NvU32 notification;
+} uvm_access_counter_virt_location_t;
+
 struct uvm_access_counter_service_batch_context_struct
 {
     uvm_access_counter_buffer_entry_t *notification_cache;
@@ -385,10 +456,12 @@ struct uvm_access_counter_service_batch_context_struct
         // Scratch space, used to generate artificial physically addressed notifications.
         // Virtual address notifications are always aligned to 64k. This means up to 16
         // different physical locations could have been accessed to trigger one notification.
-        // The sub-granularity mask can correspond to any of them.
+        // The sub-granularity mask can correspond to any of them. Contiguous
+        // notifications of a VA range are serviced together, up to
+        // UVM_ACCESS_COUNTER_MERGE_MAX of them, so that a physical region they
+        // share is only migrated once.
         struct {
-            uvm_processor_id_t resident_processors[16];
-            uvm_gpu_phys_address_t phys_addresses[16];
+            uvm_access_counter_virt_location_t locations[16 * UVM_ACCESS_COUNTER_MERGE_MAX];
             uvm_access_counter_buffer_entry_t phys_entry;
         } scratch;
     } virt;
@@ -33,6 +33,7 @@
 #include "uvm_va_space_mm.h"
 #include "uvm_pmm_sysmem.h"
 #include "uvm_perf_module.h"
+#include "uvm_trace.h"
 
 #define UVM_PERF_ACCESS_COUNTER_BATCH_COUNT_MIN     1
 #define UVM_PERF_ACCESS_COUNTER_BATCH_COUNT_DEFAULT 256
@@ -81,6 +82,17 @@ typedef struct
     uvm_va_space_t *va_space;
 } va_space_access_counters_info_t;
 
+// Whether contiguous virtual address notifications of a VA space are
+// serviced together, see service_virt_notifications
+static int uvm_perf_access_counter_merge = 1;
+
+// Spatial locality a VA range's access counter migrations need before one
+// takes the whole VA block, and twice that before it also takes the next
+// uvm_perf_access_counter_expand_blocks blocks of the range. See
+// access_counter_locality_update. 0 migrates the tracked region only.
+static unsigned uvm_perf_access_counter_expand_score = 4;
+static unsigned uvm_perf_access_counter_expand_blocks = 2;
+
 // Enable/disable access-counter-guided migrations
 //
 static int uvm_perf_access_counter_mimc_migration_enable = -1;
@@ -104,6 +116,18 @@ MODULE_PARM_DESC(uvm_perf_access_counter_momc_migration_enable,
                  "Whether MOMC access counters will trigger migrations."
                  "Valid values: <= -1 (default policy), 0 (off), >= 1 (on)");
 module_param(uvm_perf_access_counter_batch_count, uint, S_IRUGO);
+module_param(uvm_perf_access_counter_merge, int, S_IRUGO);
+module_param(uvm_perf_access_counter_expand_score, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_access_counter_expand_score,
+                 "Migrations next to the previous one of a VA range before access counter migrations "
+                 "take the whole VA block, twice as many for the next blocks too. 0 disables expansion.");
+module_param(uvm_perf_access_counter_expand_blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_access_counter_expand_blocks,
+                 "VA blocks after the block of an access counter migration that it also takes once the "
+                 "range's locality reaches twice uvm_perf_access_counter_expand_score.");
+MODULE_PARM_DESC(uvm_perf_access_counter_merge,
+                 "Whether contiguous access counter notifications are serviced as one migration per "
+                 "physical region. Valid values: 0 (off), 1 (on, default)");
 module_param(uvm_perf_access_counter_granularity, charp, S_IRUGO);
 MODULE_PARM_DESC(uvm_perf_access_counter_granularity,
                  "Size of the physical memory region tracked by each counter. Valid values as"
@@ -493,7 +517,6 @@ fail:
 
 void uvm_gpu_deinit_access_counters(uvm_parent_gpu_t *parent_gpu)
 {
-    pr_alert("num notifications = %d\n", dolphin_ac_count);
     uvm_access_counter_buffer_info_t *access_counters = &parent_gpu->access_counter_buffer_info;
     uvm_access_counter_service_batch_context_t *batch_context = &access_counters->batch_service_context;
 
@@ -543,9 +566,7 @@ static NV_STATUS access_counters_take_ownership(uvm_gpu_t *gpu, UvmGpuAccessCntr
     status = uvm_rm_locked_call(nvUvmInterfaceEnableAccessCntr(gpu->parent->rm_device,
                                                                &access_counters->rm_info,
                                                                config));
-    pr_alert("advanced debug\n");
     if (status != NV_OK) {
-    pr_alert("advanced debug failed\n");
         UVM_ERR_PRINT("Failed to enable access counter notification from RM: %s, GPU %s\n",
                       nvstatusToString(status), uvm_gpu_name(gpu));
         return status;
@@ -609,19 +630,16 @@ static NV_STATUS gpu_access_counters_enable(uvm_gpu_t *gpu, UvmGpuAccessCntrConf
     UVM_ASSERT(gpu->parent->access_counters_supported);
     UVM_ASSERT(gpu->parent->access_counter_buffer_info.rm_info.accessCntrBufferHandle);
 
-    pr_alert("reconfig API called 5.1\n");
     // There cannot be a concurrent modification of the handling count, since
     // the only two writes of that field happen in the enable/disable functions
     // and those are protected by the access counters ISR lock.
     if (gpu->parent->isr.access_counters.handling_ref_count == 0) {
-    pr_alert("reconfig API called 6.1\n");
         NV_STATUS status = access_counters_take_ownership(gpu, config);
 
         if (status != NV_OK)
             return status;
     }
 
-    pr_alert("reconfig API called 5.2\n");
     ++gpu->parent->isr.access_counters.handling_ref_count;
     return NV_OK;
 }
@@ -933,13 +951,34 @@ static void translate_virt_notifications_instance_ptrs(uvm_gpu_t *gpu,
     }
 }
 
+// Sort comparator for pointers to GVA access counter notification buffer
+// entries that sorts by instance pointer and then address
+static int cmp_sort_virt_notifications_by_address(const void *_a, const void *_b)
+{
+    const uvm_access_counter_buffer_entry_t *a = *(const uvm_access_counter_buffer_entry_t **)_a;
+    const uvm_access_counter_buffer_entry_t *b = *(const uvm_access_counter_buffer_entry_t **)_b;
+    int result = cmp_access_counter_instance_ptr(a, b);
+
+    if (result != 0)
+        return result;
+    return UVM_CMP_DEFAULT(a->address.address, b->address.address);
+}
+
 // GVA notifications provide an instance_ptr and ve_id that can be directly
 // translated to a VA space. In order to minimize translations, we sort the
-// entries by instance_ptr.
+// entries by instance_ptr, and by address within it so that contiguous
+// notifications can be serviced together.
 static void preprocess_virt_notifications(uvm_gpu_t *gpu,
                                           uvm_access_counter_service_batch_context_t *batch_context)
 {
-    if (!batch_context->virt.is_single_instance_ptr) {
+    if (uvm_perf_access_counter_merge) {
+        sort(batch_context->virt.notifications,
+             batch_context->virt.num_notifications,
+             sizeof(*batch_context->virt.notifications),
+             cmp_sort_virt_notifications_by_address,
+             NULL);
+    }
+    else if (!batch_context->virt.is_single_instance_ptr) {
         // Sort by instance_ptr
         sort(batch_context->virt.notifications,
              batch_context->virt.num_notifications,
@@ -966,11 +1005,120 @@ static void preprocess_phys_notifications(uvm_access_counter_service_batch_conte
     }
 }
 
+// Grows accessed_pages to the aligned regions of granularity bytes around
+// every accessed page, within the block
+static void accessed_pages_grow(uvm_va_block_t *va_block, uvm_page_mask_t *accessed_pages, NvU64 granularity)
+{
+    uvm_va_block_region_t block_region = uvm_va_block_region_from_block(va_block);
+    uvm_page_index_t page_index = uvm_va_block_first_page_in_mask(block_region, accessed_pages);
+
+    while (page_index < block_region.outer) {
+        NvU64 start = UVM_ALIGN_DOWN(uvm_va_block_cpu_page_address(va_block, page_index), granularity);
+        uvm_va_block_region_t region = uvm_va_block_region_from_start_end(va_block,
+                                                                          max(start, va_block->start),
+                                                                          min(start + granularity - 1, va_block->end));
+
+        uvm_page_mask_region_fill(accessed_pages, region);
+        page_index = uvm_va_block_next_page_in_mask(block_region, accessed_pages, region.outer - 1);
+    }
+}
+
+// Counts a migration of va_block towards the spatial locality of its range:
+// up when it is in the block of the previous one or next to it, halved
+// otherwise. Returns the locality.
+static NvU32 access_counter_locality_update(uvm_va_block_t *va_block)
+{
+    uvm_va_range_t *va_range = va_block->va_range;
+    size_t index = uvm_va_range_block_index(va_range, va_block->start);
+    size_t last = READ_ONCE(va_range->managed.ac_last_block);
+    NvU32 locality = READ_ONCE(va_range->managed.ac_locality);
+
+    // GPUs servicing the range at the same time may lose an update, which
+    // only delays or hastens the expansion
+    if (index + 1 >= last && index <= last + 1)
+        locality = min(locality + 1, 4 * uvm_perf_access_counter_expand_score);
+    else
+        locality /= 2;
+
+    WRITE_ONCE(va_range->managed.ac_locality, locality);
+    WRITE_ONCE(va_range->managed.ac_last_block, index);
+
+    return locality;
+}
+
+// Grows accessed_pages to all pages of the block resident on the CPU, the
+// ones remote accesses reach
+static void accessed_pages_expand(uvm_va_block_t *va_block, uvm_page_mask_t *accessed_pages)
+{
+    const uvm_page_mask_t *cpu_resident = uvm_va_block_resident_mask_get(va_block, UVM_ID_CPU);
+
+    if (cpu_resident)
+        uvm_page_mask_or(accessed_pages, accessed_pages, cpu_resident);
+}
+
+// Applies the range's own threshold and granularity, see
+// UVM_SET_ACCESS_COUNTER_POLICY, and the expansion of its spatial locality.
+// Returns false if the block doesn't migrate yet.
+static bool service_va_block_policy(uvm_processor_id_t processor,
+                                    uvm_va_block_t *va_block,
+                                    uvm_service_block_context_t *service_context,
+                                    uvm_page_mask_t *accessed_pages,
+                                    NvU32 counter_value)
+{
+    uvm_va_policy_t *policy;
+
+    if (uvm_va_block_is_hmm(va_block))
+        return true;
+
+    policy = uvm_va_range_get_policy(va_block->va_range);
+    if (policy->ac_threshold == UVM_ACCESS_COUNTER_THRESHOLD_NEVER)
+        return false;
+
+    // Sampled ranges stay where they are, the runtime only hears of the
+    // notification, once
+    if (policy->ac_threshold == UVM_ACCESS_COUNTER_THRESHOLD_SAMPLE) {
+        if (service_context->num_retries == 0) {
+            uvm_tools_event_ring_push(uvm_va_block_get_va_space(va_block),
+                                      UVM_EVENT_RING_TYPE_ACCESS_COUNTER_SAMPLE,
+                                      processor,
+                                      va_block->va_range->node.start,
+                                      va_block->start,
+                                      uvm_va_block_size(va_block),
+                                      counter_value);
+        }
+        return false;
+    }
+
+    // Count the notification once, not again on allocation retries
+    if (policy->ac_threshold != 0 && service_context->num_retries == 0) {
+        va_block->access_counter_count += counter_value;
+        if (va_block->access_counter_count < policy->ac_threshold)
+            return false;
+
+        va_block->access_counter_count = 0;
+    }
+
+    if (policy->ac_granularity > PAGE_SIZE)
+        accessed_pages_grow(va_block, accessed_pages, policy->ac_granularity);
+
+    if (uvm_perf_access_counter_expand_score != 0) {
+        NvU32 locality = READ_ONCE(va_block->va_range->managed.ac_locality);
+
+        if (service_context->num_retries == 0)
+            locality = access_counter_locality_update(va_block);
+        if (locality >= uvm_perf_access_counter_expand_score)
+            accessed_pages_expand(va_block, accessed_pages);
+    }
+
+    return true;
+}
+
 static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
                                          uvm_va_block_t *va_block,
                                          uvm_va_block_retry_t *va_block_retry,
                                          uvm_service_block_context_t *service_context,
-                                         uvm_page_mask_t *accessed_pages)
+                                         uvm_page_mask_t *accessed_pages,
+                                         NvU32 counter_value)
 {
     NV_STATUS status = NV_OK;
     uvm_va_space_t *va_space = uvm_va_block_get_va_space(va_block);
@@ -995,6 +1143,9 @@ static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
     if (!uvm_processor_mask_test(&va_block->mapped, processor))
         return NV_OK;
 
+    if (!service_va_block_policy(processor, va_block, service_context, accessed_pages, counter_value))
+        return NV_OK;
+
     if (uvm_processor_mask_test(&va_block->resident, processor))
         residency_mask = uvm_va_block_resident_mask_get(va_block, processor);
     else
@@ -1061,6 +1212,11 @@ static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
             continue;
         }
 
+        // Streamed ranges are prefetched ahead of the faults, by the time
+        // the counters fire the stream has moved on
+        if (uvm_va_policy_is_streaming(service_context->block_context.policy))
+            continue;
+
         new_residency = uvm_va_block_select_residency(va_block,
                                                       &service_context->block_context,
                                                       page_index,
@@ -1136,6 +1292,86 @@ static NV_STATUS service_va_block_locked(uvm_processor_id_t processor,
     return status;
 }
 
+// Migrates the CPU-resident pages of the uvm_perf_access_counter_expand_blocks
+// blocks after va_block in its range to processor, once the range's locality
+// is twice uvm_perf_access_counter_expand_score, and those of the other
+// blocks of the aligned granularity region around va_block, for a range whose
+// access counter granularity is larger than a block. The VA space lock must
+// be held.
+static NV_STATUS service_va_block_neighbors(uvm_processor_id_t processor,
+                                            uvm_va_block_t *va_block,
+                                            uvm_service_block_context_t *service_context,
+                                            uvm_page_mask_t *accessed_pages)
+{
+    uvm_va_range_t *va_range = va_block->va_range;
+    uvm_va_policy_t *policy;
+    size_t index;
+    size_t first;
+    size_t last;
+    bool expand;
+    NV_STATUS status = NV_OK;
+
+    if (uvm_va_block_is_hmm(va_block))
+        return NV_OK;
+
+    policy = uvm_va_range_get_policy(va_range);
+    expand = uvm_perf_access_counter_expand_score != 0 &&
+             READ_ONCE(va_range->managed.ac_locality) >= 2 * uvm_perf_access_counter_expand_score;
+    if (!expand && policy->ac_granularity <= UVM_VA_BLOCK_SIZE)
+        return NV_OK;
+
+    // Nor before the block itself crossed the threshold
+    if (policy->ac_threshold != 0 && READ_ONCE(va_block->access_counter_count) != 0)
+        return NV_OK;
+
+    index = uvm_va_range_block_index(va_range, va_block->start);
+    first = index;
+    last = expand ? min(index + uvm_perf_access_counter_expand_blocks, uvm_va_range_num_blocks(va_range) - 1) :
+                    index;
+    if (policy->ac_granularity > UVM_VA_BLOCK_SIZE) {
+        NvU64 start = UVM_ALIGN_DOWN(va_block->start, policy->ac_granularity);
+
+        first = uvm_va_range_block_index(va_range, max(start, va_range->node.start));
+        last = max(last, uvm_va_range_block_index(va_range,
+                                                  min(start + policy->ac_granularity - 1, va_range->node.end)));
+    }
+
+    for (; first <= last; ++first) {
+        uvm_va_block_retry_t va_block_retry;
+        uvm_va_block_t *neighbor;
+
+        if (first == index)
+            continue;
+
+        // Blocks nothing touched yet have nothing on the CPU to migrate
+        neighbor = uvm_va_range_block(va_range, first);
+        if (!neighbor)
+            continue;
+
+        // Serviced as a retry: the notification that expanded to the block
+        // has crossed the threshold already, and doesn't count again towards
+        // the locality
+        service_context->num_retries = 1;
+
+        uvm_mutex_lock(&neighbor->lock);
+        uvm_page_mask_zero(accessed_pages);
+        accessed_pages_expand(neighbor, accessed_pages);
+        status = UVM_VA_BLOCK_RETRY_LOCKED(neighbor, &va_block_retry,
+                                           service_va_block_locked(processor,
+                                                                   neighbor,
+                                                                   &va_block_retry,
+                                                                   service_context,
+                                                                   accessed_pages,
+                                                                   0));
+        uvm_mutex_unlock(&neighbor->lock);
+
+        if (status != NV_OK)
+            break;
+    }
+
+    return status;
+}
+
 static void reverse_mappings_to_va_block_page_mask(uvm_va_block_t *va_block,
                                                    const uvm_reverse_map_t *reverse_mappings,
                                                    size_t num_reverse_mappings,
@@ -1167,6 +1403,27 @@ static void reverse_mappings_to_va_block_page_mask(uvm_va_block_t *va_block,
     }
 }
 
+// The processor a MOMC notification of gpu's memory comes from, as far as
+// the block's mappings tell, for UVM_ACCESS_COUNTER_MOMC_PEER: the CPU if it
+// maps the block, otherwise the one peer GPU that does. Several peers share
+// the block, which then stays on gpu; their MIMC notifications move it.
+static uvm_processor_id_t momc_peer_processor(uvm_gpu_t *gpu, uvm_va_block_t *va_block)
+{
+    uvm_processor_mask_t peers;
+
+    uvm_assert_mutex_locked(&va_block->lock);
+
+    if (uvm_processor_mask_test(&va_block->mapped, UVM_ID_CPU))
+        return UVM_ID_CPU;
+
+    uvm_processor_mask_copy(&peers, &va_block->mapped);
+    uvm_processor_mask_clear(&peers, gpu->id);
+    if (uvm_processor_mask_get_gpu_count(&peers) != 1)
+        return UVM_ID_INVALID;
+
+    return uvm_processor_mask_find_first_gpu_id(&peers);
+}
+
 static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
                                               uvm_access_counter_service_batch_context_t *batch_context,
                                               const uvm_access_counter_buffer_entry_t *current_entry,
@@ -1179,8 +1436,8 @@ static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
     uvm_va_space_t *va_space = NULL;
     struct mm_struct *mm = NULL;
     NV_STATUS status = NV_OK;
-    const uvm_processor_id_t processor = current_entry->counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC?
-                                             gpu->id: UVM_ID_CPU;
+    uvm_processor_id_t processor = current_entry->counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC?
+                                       gpu->id: UVM_ID_CPU;
 
     *out_flags &= ~UVM_ACCESS_COUNTER_ACTION_CLEAR;
 
@@ -1206,6 +1463,8 @@ static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
         if (uvm_va_block_is_dead(va_block))
             goto done;
 
+        uvm_va_range_note_access_counter(va_block->va_range);
+
         va_space_access_counters = va_space_access_counters_info_get(va_space);
         if (UVM_ID_IS_CPU(processor) && !atomic_read(&va_space_access_counters->params.enable_momc_migrations))
             goto done;
@@ -1219,6 +1478,16 @@ static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
 
         uvm_mutex_lock(&va_block->lock);
 
+        if (UVM_ID_IS_CPU(processor) &&
+            atomic_read(&va_space_access_counters->params.enable_momc_migrations) == UVM_ACCESS_COUNTER_MOMC_PEER) {
+            processor = momc_peer_processor(gpu, va_block);
+            if (!UVM_ID_IS_VALID(processor)) {
+                uvm_mutex_unlock(&va_block->lock);
+                *out_flags |= UVM_ACCESS_COUNTER_ACTION_CLEAR;
+                goto done;
+            }
+        }
+
         reverse_mappings_to_va_block_page_mask(va_block, reverse_mappings, num_reverse_mappings, accessed_pages);
 
         status = UVM_VA_BLOCK_RETRY_LOCKED(va_block, &va_block_retry,
@@ -1226,10 +1495,14 @@ static NV_STATUS service_phys_single_va_block(uvm_gpu_t *gpu,
                                                                    va_block,
                                                                    &va_block_retry,
                                                                    service_context,
-                                                                   accessed_pages));
+                                                                   accessed_pages,
+                                                                   current_entry->counter_value));
 
         uvm_mutex_unlock(&va_block->lock);
 
+        if (status == NV_OK)
+            status = service_va_block_neighbors(processor, va_block, service_context, accessed_pages);
+
         if (status == NV_OK)
             *out_flags |= UVM_ACCESS_COUNTER_ACTION_CLEAR;
     }
@@ -1467,6 +1740,12 @@ static NV_STATUS service_phys_notifications(uvm_gpu_t *gpu,
             continue;
 
         status = service_phys_notification(gpu, batch_context, current_entry, &flags);
+        trace_uvm_access_counter_service(uvm_id_value(gpu->id),
+                                         current_entry->address.address,
+                                         false,
+                                         current_entry->counter_value,
+                                         flags,
+                                         status);
         if (flags & UVM_ACCESS_COUNTER_ACTION_NOTIFY)
             uvm_tools_broadcast_access_counter(gpu, current_entry, flags & UVM_ACCESS_COUNTER_ON_MANAGED);
 
@@ -1511,45 +1790,40 @@ static bool phys_address_in_accessed_sub_region(uvm_gpu_phys_address_t address,
     return ((1 << accessed_index) & accessed_mask) != 0;
 }
 
-static NV_STATUS service_virt_notification(uvm_gpu_t *gpu,
-                                           uvm_access_counter_service_batch_context_t *batch_context,
-                                           const uvm_access_counter_buffer_entry_t *current_entry,
-                                           unsigned *out_flags)
+// Sort comparator for the physical locations collected from virtual address
+// notifications
+static int cmp_sort_virt_locations(const void *_a, const void *_b)
+{
+    const uvm_access_counter_virt_location_t *a = _a;
+    const uvm_access_counter_virt_location_t *b = _b;
+
+    return uvm_gpu_phys_addr_cmp(a->phys_address, b->phys_address);
+}
+
+// Adds the physical locations that could have been touched in the 64K VA
+// region of current_entry, notification index of its group, to the scratch
+// locations, from *num_locations on. The VA space lock must be held. Returns
+// the base of the VA range of the region, or its start if there is none.
+static NvU64 collect_virt_notification_locations(uvm_gpu_t *gpu,
+                                                 uvm_access_counter_service_batch_context_t *batch_context,
+                                                 const uvm_access_counter_buffer_entry_t *current_entry,
+                                                 NvU32 index,
+                                                 NvU64 notification_size,
+                                                 NvU32 *num_locations)
 {
-    NV_STATUS status = NV_OK;
-    NvU64 notification_size;
     NvU64 address;
-    uvm_processor_id_t *resident_processors = batch_context->virt.scratch.resident_processors;
-    uvm_gpu_phys_address_t *phys_addresses = batch_context->virt.scratch.phys_addresses;
-    int num_addresses = 0;
-    int i;
+    uvm_va_space_t *va_space = current_entry->virtual_info.va_space;
+    uvm_access_counter_buffer_info_t *access_counters = &gpu->parent->access_counter_buffer_info;
+    const uvm_gpu_access_counter_type_config_t *config = get_config_for_type(access_counters,
+                                                                             current_entry->counter_type);
 
     // Virtual address notifications are always 64K aligned
     NvU64 region_start = current_entry->address.address;
     NvU64 region_end = current_entry->address.address + UVM_PAGE_SIZE_64K;
-    
-
-    uvm_access_counter_buffer_info_t *access_counters = &gpu->parent->access_counter_buffer_info;
-    uvm_access_counter_type_t counter_type = current_entry->counter_type;
+    uvm_va_range_t *va_range = uvm_va_range_find(va_space, region_start);
 
-    const uvm_gpu_access_counter_type_config_t *config = get_config_for_type(access_counters, counter_type);
-
-    uvm_va_space_t *va_space = current_entry->virtual_info.va_space;
-
-    UVM_ASSERT(counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC);
-
-    // Entries with NULL va_space are simply dropped.
-    if (!va_space)
-        return NV_OK;
-
-    status = config_granularity_to_bytes(config->rm.granularity, &notification_size);
-    if (status != NV_OK)
-        return status;
-
-    // Collect physical locations that could have been touched
-    // in the reported 64K VA region. The notification mask can
-    // correspond to any of them.
-    uvm_va_space_down_read(va_space);
+    uvm_va_range_stat_add(va_range, UVM_VA_RANGE_STAT_AC_NOTIFICATIONS, 1);
+    uvm_va_range_note_access_counter(va_range);
     for (address = region_start; address < region_end;) {
         uvm_va_block_t *va_block;
 
@@ -1560,6 +1834,8 @@ static NV_STATUS service_virt_notification(uvm_gpu_t *gpu,
         }
 
         uvm_mutex_lock(&va_block->lock);
+        // The notification is the reference bit of 2Q eviction
+        uvm_va_block_mark_gpu_referenced(va_block, gpu);
         while (address < va_block->end && address < region_end) {
             const unsigned page_index = uvm_va_block_cpu_page_index(va_block, address);
 
@@ -1573,9 +1849,12 @@ static NV_STATUS service_virt_notification(uvm_gpu_t *gpu,
                                                         notification_size,
                                                         config->sub_granularity_region_size,
                                                         current_entry->sub_granularity)) {
-                    resident_processors[num_addresses] = res_id;
-                    phys_addresses[num_addresses] = phys_address;
-                    ++num_addresses;
+                    uvm_access_counter_virt_location_t *location = batch_context->virt.scratch.locations + *num_locations;
+
+                    location->phys_address = phys_address;
+                    location->resident_id = res_id;
+                    location->notification = index;
+                    ++*num_locations;
                 }
                 else {
                   /* pr_alert("skipping\n"); */
@@ -1590,76 +1869,184 @@ static NV_STATUS service_virt_notification(uvm_gpu_t *gpu,
         }
         uvm_mutex_unlock(&va_block->lock);
     }
+
+    return va_range ? va_range->node.start : region_start;
+}
+
+// Services the num_entries notifications from entries on, of the same VA
+// space, counter type and sub-granularity mask: a physical region several of
+// them could have touched is migrated once, with their counter values added
+static NV_STATUS service_virt_notification_group(uvm_gpu_t *gpu,
+                                                 uvm_access_counter_service_batch_context_t *batch_context,
+                                                 uvm_access_counter_buffer_entry_t **entries,
+                                                 NvU32 num_entries,
+                                                 unsigned *out_flags)
+{
+    NV_STATUS status = NV_OK;
+    NvU64 notification_size;
+    NvU32 num_locations = 0;
+    NvU32 i;
+    NvU32 j;
+    const uvm_access_counter_buffer_entry_t *first_entry = entries[0];
+
+    uvm_access_counter_buffer_info_t *access_counters = &gpu->parent->access_counter_buffer_info;
+    uvm_access_counter_type_t counter_type = first_entry->counter_type;
+
+    const uvm_gpu_access_counter_type_config_t *config = get_config_for_type(access_counters, counter_type);
+
+    uvm_va_space_t *va_space = first_entry->virtual_info.va_space;
+    NvU64 range_bases[UVM_ACCESS_COUNTER_MERGE_MAX];
+
+    uvm_access_counter_virt_location_t *locations = batch_context->virt.scratch.locations;
+
+    UVM_ASSERT(counter_type == UVM_ACCESS_COUNTER_TYPE_MIMC);
+    UVM_ASSERT(num_entries > 0 && num_entries <= UVM_ACCESS_COUNTER_MERGE_MAX);
+
+    // Entries with NULL va_space are simply dropped.
+    if (!va_space)
+        return NV_OK;
+
+    status = config_granularity_to_bytes(config->rm.granularity, &notification_size);
+    if (status != NV_OK)
+        return status;
+
+    // Collect physical locations that could have been touched
+    // in the reported 64K VA regions. The notification mask can
+    // correspond to any of them.
+    uvm_va_space_down_read(va_space);
+    for (i = 0; i < num_entries; ++i) {
+        range_bases[i] = collect_virt_notification_locations(gpu,
+                                                             batch_context,
+                                                             entries[i],
+                                                             i,
+                                                             notification_size,
+                                                             &num_locations);
+    }
     uvm_va_space_up_read(va_space);
 
     // The addresses need to be sorted to aid coalescing.
-    sort(phys_addresses,
-         num_addresses,
-         sizeof(*phys_addresses),
-         cmp_sort_gpu_phys_addr,
+    sort(locations,
+         num_locations,
+         sizeof(*locations),
+         cmp_sort_virt_locations,
          NULL);
 
-    for (i = 0; i < num_addresses; ++i) {
+    for (i = 0; i < num_locations; i = j) {
         uvm_access_counter_buffer_entry_t *fake_entry = &batch_context->virt.scratch.phys_entry;
-
-        // Skip the current pointer if the physical region was already handled
-        if (i > 0 && gpu_phys_same_region(phys_addresses[i - 1], phys_addresses[i], notification_size)) {
-            UVM_ASSERT(uvm_id_equal(resident_processors[i - 1], resident_processors[i]));
-            continue;
+        unsigned long notifications = 1UL << locations[i].notification;
+        NvU64 counter_value = 0;
+        unsigned index;
+
+        // Skip the locations in the physical region already handled, found
+        // by this or other notifications of the group, which each count once
+        for (j = i + 1; j < num_locations; ++j) {
+            if (!gpu_phys_same_region(locations[i].phys_address, locations[j].phys_address, notification_size))
+                break;
+            UVM_ASSERT(uvm_id_equal(locations[i].resident_id, locations[j].resident_id));
+            notifications |= 1UL << locations[j].notification;
         }
+        for_each_set_bit(index, &notifications, num_entries)
+            counter_value += entries[index]->counter_value;
+
         UVM_DBG_PRINT_RL("Faking MIMC address[%i/%i]: %llx (granularity mask: %llx) in aperture %s on device %s\n",
                          i,
-                         num_addresses,
-                         phys_addresses[i].address,
+                         num_locations,
+                         locations[i].phys_address.address,
                          notification_size - 1,
-                         uvm_aperture_string(phys_addresses[i].aperture),
+                         uvm_aperture_string(locations[i].phys_address.aperture),
                          uvm_gpu_name(gpu));
 
         // Construct a fake phys addr AC entry
-        fake_entry->counter_type = current_entry->counter_type;
-        fake_entry->address.address = UVM_ALIGN_DOWN(phys_addresses[i].address, notification_size);
-        fake_entry->address.aperture = phys_addresses[i].aperture;
+        fake_entry->counter_type = first_entry->counter_type;
+        fake_entry->address.address = UVM_ALIGN_DOWN(locations[i].phys_address.address, notification_size);
+        fake_entry->address.aperture = locations[i].phys_address.aperture;
         fake_entry->address.is_virtual = false;
-        fake_entry->physical_info.resident_id = resident_processors[i];
-        fake_entry->counter_value = current_entry->counter_value;
-        fake_entry->sub_granularity = current_entry->sub_granularity;
+        fake_entry->physical_info.resident_id = locations[i].resident_id;
+        fake_entry->counter_value = (NvU32)min(counter_value, (NvU64)U32_MAX);
+        fake_entry->sub_granularity = first_entry->sub_granularity;
 
         status = service_phys_notification(gpu, batch_context, fake_entry, out_flags);
         if (status != NV_OK)
             break;
     }
 
+    if (status == NV_OK && num_locations > 0) {
+        for (i = 0; i < num_entries; ++i) {
+            uvm_tools_event_ring_push(va_space,
+                                      UVM_EVENT_RING_TYPE_ACCESS_COUNTER_MIGRATION,
+                                      gpu->id,
+                                      range_bases[i],
+                                      entries[i]->address.address,
+                                      UVM_PAGE_SIZE_64K,
+                                      entries[i]->counter_value);
+        }
+    }
+
     return status;
 }
 
+// Whether entry continues the group of num_entries notifications from
+// entries on. Notifications are sorted by VA space and address.
+static bool virt_notification_extends_group(uvm_access_counter_buffer_entry_t **entries,
+                                            NvU32 num_entries,
+                                            const uvm_access_counter_buffer_entry_t *entry)
+{
+    const uvm_access_counter_buffer_entry_t *last = entries[num_entries - 1];
+
+    if (!uvm_perf_access_counter_merge || num_entries >= UVM_ACCESS_COUNTER_MERGE_MAX)
+        return false;
+
+    return entry->virtual_info.va_space == last->virtual_info.va_space &&
+           entry->counter_type == last->counter_type &&
+           entry->sub_granularity == last->sub_granularity &&
+           entry->address.address <= last->address.address + UVM_PAGE_SIZE_64K;
+}
+
 static NV_STATUS service_virt_notifications(uvm_gpu_t *gpu,
                                             uvm_access_counter_service_batch_context_t *batch_context)
 {
     NvU32 i;
+    NvU32 j;
+    NvU32 k;
     NV_STATUS status = NV_OK;
     preprocess_virt_notifications(gpu, batch_context);
 
     /* pr_alert("in context notifications = %d\n", batch_context->virt.num_notifications); */
     dolphin_ac_count += batch_context->virt.num_notifications;
-    for (i = 0; i < batch_context->virt.num_notifications; ++i) {
-    /* pr_alert("address of notification = %x\n", batch_context->virt.notifications[i]->address); */
+    for (i = 0; i < batch_context->virt.num_notifications; i = j) {
         unsigned flags = 0;
-        uvm_access_counter_buffer_entry_t *current_entry = batch_context->virt.notifications[i];
+        uvm_access_counter_buffer_entry_t **group = batch_context->virt.notifications + i;
 
-        status = service_virt_notification(gpu, batch_context, current_entry, &flags);
+        for (j = i + 1; j < batch_context->virt.num_notifications; ++j) {
+            if (!virt_notification_extends_group(group, j - i, batch_context->virt.notifications[j]))
+                break;
+        }
 
-        UVM_DBG_PRINT_RL("Processed virt access counter (%d/%d): %sMANAGED (status: %d) clear: %s\n",
-                         i + 1,
-                         batch_context->virt.num_notifications,
-                         (flags & UVM_ACCESS_COUNTER_ON_MANAGED) ? "" : "NOT ",
-                         status,
-                         (flags & UVM_ACCESS_COUNTER_ACTION_CLEAR) ? "YES" : "NO");
+        status = service_virt_notification_group(gpu, batch_context, group, j - i, &flags);
 
-        if (uvm_enable_builtin_tests)
-            uvm_tools_broadcast_access_counter(gpu, current_entry, flags & UVM_ACCESS_COUNTER_ON_MANAGED);
+        for (k = i; k < j; ++k) {
+            uvm_access_counter_buffer_entry_t *current_entry = batch_context->virt.notifications[k];
 
-        if (status == NV_OK && (flags & UVM_ACCESS_COUNTER_ACTION_CLEAR))
-            status = access_counter_clear_targeted(gpu, current_entry);
+            trace_uvm_access_counter_service(uvm_id_value(gpu->id),
+                                             current_entry->address.address,
+                                             true,
+                                             current_entry->counter_value,
+                                             flags,
+                                             status);
+
+            UVM_DBG_PRINT_RL("Processed virt access counter (%d/%d): %sMANAGED (status: %d) clear: %s\n",
+                             k + 1,
+                             batch_context->virt.num_notifications,
+                             (flags & UVM_ACCESS_COUNTER_ON_MANAGED) ? "" : "NOT ",
+                             status,
+                             (flags & UVM_ACCESS_COUNTER_ACTION_CLEAR) ? "YES" : "NO");
+
+            if (uvm_enable_builtin_tests)
+                uvm_tools_broadcast_access_counter(gpu, current_entry, flags & UVM_ACCESS_COUNTER_ON_MANAGED);
+
+            if (status == NV_OK && (flags & UVM_ACCESS_COUNTER_ACTION_CLEAR))
+                status = access_counter_clear_targeted(gpu, current_entry);
+        }
 
         if (status != NV_OK)
             break;
@@ -1668,7 +2055,6 @@ static NV_STATUS service_virt_notifications(uvm_gpu_t *gpu,
     return status;
 }
 
-
 void uvm_gpu_service_access_counters(uvm_gpu_t *gpu)
 {
     NV_STATUS status = NV_OK;
@@ -1715,16 +2101,12 @@ static NV_STATUS access_counters_config_from_params(const UVM_RECONFIGURE_ACCESS
     if (params->threshold == 0 || params->threshold > g_uvm_access_counters_threshold_max)
         return NV_ERR_INVALID_ARGUMENT;
 
-    pr_alert("debug 1\n");
-    pr_alert("params->mimcGranularity = %u\n", params->mimc_granularity);
     if (config_granularity_to_bytes(params->mimc_granularity, &tracking_size) != NV_OK)
         return NV_ERR_INVALID_ARGUMENT;
 
-    pr_alert("debug 2\n");
     if (config_granularity_to_bytes(params->momc_granularity, &tracking_size) != NV_OK)
         return NV_ERR_INVALID_ARGUMENT;
 
-    pr_alert("debug 3\n");
     // Since values for granularity/use limit are shared between tests and
     // nv_uvm_types.h, the value will be checked in the call to
     // nvUvmInterfaceEnableAccessCntr
@@ -1944,7 +2326,6 @@ exit_release_gpu:
 }
 
 NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PARAMS *params, struct file *filp) {
-    pr_alert("reconfig API called\n");
     NV_STATUS status = NV_OK;
     uvm_gpu_t *gpu = NULL;
     UvmGpuAccessCntrConfig config = {0};
@@ -1952,12 +2333,10 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
     uvm_va_space_t *va_space_reconfiguration_owner;
     uvm_va_space_t *va_space = uvm_va_space_get(filp);
 
-    pr_alert("reconfig API called1\n");
     status = access_counters_config_from_params(params, &config);
     if (status != NV_OK)
         return status;
 
-    pr_alert("reconfig API called2\n");
     gpu = uvm_va_space_retain_gpu_by_uuid(va_space, &params->gpu_uuid);
     if (!gpu)
         return NV_ERR_INVALID_DEVICE;
@@ -1965,13 +2344,11 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
     /* if (gpu->parent->access_counters_supported) */
     /*     uvm_gpu_access_counters_set_ignore(gpu, true); */
     /* return NV_OK; */
-    pr_alert("reconfig API called3\n");
     if (!gpu->parent->access_counters_supported) {
         status = NV_ERR_NOT_SUPPORTED;
         goto exit_release_gpu;
     }
 
-    pr_alert("reconfig API called4\n");
     // ISR lock ensures that we own GET/PUT registers. It disables interrupts
     // and ensures that no other thread (nor the top half) will be able to
     // re-enable interrupts during reconfiguration.
@@ -1997,7 +2374,6 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
         goto exit_isr_unlock;
     }
 
-    pr_alert("reconfig API called5\n");
     va_space_access_counters = va_space_access_counters_info_get(va_space);
 
     va_space_reconfiguration_owner = gpu->parent->access_counter_buffer_info.reconfiguration_owner;
@@ -2012,9 +2388,7 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
     if (!uvm_processor_mask_test(&va_space->access_counters_enabled_processors, gpu->id)) {
         status = gpu_access_counters_enable(gpu, &config);
 
-    pr_alert("reconfig API called6\n");
         if (status == NV_OK) {
-    pr_alert("reconfig API called7\n");
             uvm_processor_mask_set_atomic(&va_space->access_counters_enabled_processors, gpu->id);
         }
         else
@@ -2023,7 +2397,6 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
         }
     }
 
-    pr_alert("reconfig API called8\n");
     UVM_ASSERT(gpu->parent->isr.access_counters.handling_ref_count > 0);
 
     // Disable counters, and renable with the new configuration.
@@ -2052,11 +2425,12 @@ NV_STATUS uvm_api_reconfigure_access_counters(UVM_RECONFIGURE_ACCESS_COUNTERS_PA
 
     gpu->parent->access_counter_buffer_info.reconfiguration_owner = va_space;
 
-    pr_alert("params.enable_mimc_migrations = %u\n", &va_space_access_counters->params.enable_mimc_migrations);
     uvm_va_space_up_read_rm(va_space);
     uvm_va_space_down_write(va_space);
     atomic_set(&va_space_access_counters->params.enable_mimc_migrations, !!params->enable_mimc_migrations);
-    atomic_set(&va_space_access_counters->params.enable_momc_migrations, !!params->enable_momc_migrations);
+    atomic_set(&va_space_access_counters->params.enable_momc_migrations,
+               params->enable_momc_migrations == UVM_ACCESS_COUNTER_MOMC_PEER?
+                   UVM_ACCESS_COUNTER_MOMC_PEER: !!params->enable_momc_migrations);
     uvm_va_space_up_write(va_space);
 
 exit_isr_unlock:
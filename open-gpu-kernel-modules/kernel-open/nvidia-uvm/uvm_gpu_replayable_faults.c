@@ -24,6 +24,7 @@
 #include "linux/sort.h"
 #include "nv_uvm_interface.h"
 #include "uvm_linux.h"
+#include "uvm_api.h"
 #include "uvm_global.h"
 #include "uvm_gpu_replayable_faults.h"
 #include "uvm_hal.h"
@@ -38,6 +39,7 @@
 #include "uvm_gpu_non_replayable_faults.h"
 #include "uvm_ats_faults.h"
 #include "uvm_test.h"
+#include "uvm_trace.h"
 
 static unsigned long long dolphin_page_fault_count = 0;
 // The documentation at the beginning of uvm_gpu_non_replayable_faults.c
@@ -55,9 +57,10 @@ module_param(uvm_perf_reenable_prefetch_faults_lapse_msec, uint, S_IRUGO);
 #define UVM_PERF_FAULT_BATCH_COUNT_DEFAULT 256
 
 // Number of entries that are fetched from the GPU fault buffer and serviced in
-// batch
+// batch. Writable at run time: a count below the one the GPU was initialized
+// with applies from the next fetch, a larger one is capped to it.
 static unsigned uvm_perf_fault_batch_count = UVM_PERF_FAULT_BATCH_COUNT_DEFAULT;
-module_param(uvm_perf_fault_batch_count, uint, S_IRUGO);
+module_param(uvm_perf_fault_batch_count, uint, S_IRUGO | S_IWUSR);
 
 #define UVM_PERF_FAULT_REPLAY_POLICY_DEFAULT UVM_PERF_FAULT_REPLAY_POLICY_BATCH_FLUSH
 
@@ -82,6 +85,30 @@ module_param(uvm_perf_fault_replay_policy, uint, S_IRUGO);
 static unsigned uvm_perf_fault_replay_update_put_ratio = UVM_PERF_FAULT_REPLAY_UPDATE_PUT_RATIO_DEFAULT;
 module_param(uvm_perf_fault_replay_update_put_ratio, uint, S_IRUGO);
 
+#define UVM_PERF_FAULT_REPLAY_ADAPTIVE_DENSE_DEFAULT 16
+#define UVM_PERF_FAULT_REPLAY_ADAPTIVE_BATCH_US_DEFAULT 200
+
+// VA spaces servicing at most this many faults per VA block are sparse
+#define UVM_PERF_FAULT_REPLAY_ADAPTIVE_SPARSE 2
+
+#define UVM_PERF_FAULT_REPLAY_ADAPTIVE_BATCH_COUNT_MIN 32
+
+// Choose the replay policy and the batch size per VA space from the batches
+// serviced for it and the hint of UVM_SET_FAULT_REPLAY_HINT, instead of using
+// uvm_perf_fault_replay_policy and uvm_perf_fault_batch_count for all of them.
+// See fault_replay_adapt.
+static unsigned uvm_perf_fault_replay_adaptive = 1;
+module_param(uvm_perf_fault_replay_adaptive, uint, S_IRUGO | S_IWUSR);
+
+// Faults per VA block from which a VA space is replayed per block, in full
+// batches
+static unsigned uvm_perf_fault_replay_adaptive_dense = UVM_PERF_FAULT_REPLAY_ADAPTIVE_DENSE_DEFAULT;
+module_param(uvm_perf_fault_replay_adaptive_dense, uint, S_IRUGO | S_IWUSR);
+
+// Service time the batches of a sparse VA space are sized for
+static unsigned uvm_perf_fault_replay_adaptive_batch_us = UVM_PERF_FAULT_REPLAY_ADAPTIVE_BATCH_US_DEFAULT;
+module_param(uvm_perf_fault_replay_adaptive_batch_us, uint, S_IRUGO | S_IWUSR);
+
 #define UVM_PERF_FAULT_MAX_BATCHES_PER_SERVICE_DEFAULT 20
 
 #define UVM_PERF_FAULT_MAX_THROTTLE_PER_SERVICE_DEFAULT 5
@@ -97,6 +124,24 @@ module_param(uvm_perf_fault_max_throttle_per_service, uint, S_IRUGO);
 static unsigned uvm_perf_fault_coalesce = 1;
 module_param(uvm_perf_fault_coalesce, uint, S_IRUGO);
 
+// With UVM_PERF_FAULT_REPLAY_POLICY_BLOCK, faults on contiguous VA blocks of a
+// streaming range (quick_migrate, or a sequential or strided access pattern)
+// are serviced back to back and replayed once for the whole run
+static unsigned uvm_perf_fault_coalesce_blocks = 1;
+module_param(uvm_perf_fault_coalesce_blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_fault_coalesce_blocks,
+                 "Replay once per run of contiguous VA blocks of streaming ranges with the block replay policy");
+
+// Threads servicing the VA blocks of a fault batch concurrently, so that the
+// copy engines are kept busy when servicing is CPU-bound. 0 services the
+// batch in the bottom half only.
+#define UVM_PERF_FAULT_SERVICE_THREADS_MAX 8
+
+static unsigned uvm_perf_fault_service_threads = 0;
+module_param(uvm_perf_fault_service_threads, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_fault_service_threads,
+                 "Threads servicing the VA blocks of a replayable fault batch concurrently, 0 disables the pool");
+
 // This function is used for both the initial fault buffer initialization and
 // the power management resume path.
 static void fault_buffer_reinit_replayable_faults(uvm_parent_gpu_t *parent_gpu)
@@ -117,6 +162,91 @@ static void fault_buffer_reinit_replayable_faults(uvm_parent_gpu_t *parent_gpu)
         parent_gpu->arch_hal->disable_prefetch_faults(parent_gpu);
 }
 
+static void fault_service_worker_entry(void *args);
+
+// There is no error handling in this function. The caller is in charge of
+// calling fault_service_pool_deinit on failure.
+static NV_STATUS fault_service_pool_init(uvm_parent_gpu_t *parent_gpu)
+{
+    NV_STATUS status;
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &parent_gpu->fault_buffer_info.replayable;
+    NvU32 num_workers = min(uvm_perf_fault_service_threads, (unsigned)UVM_PERF_FAULT_SERVICE_THREADS_MAX);
+    NvU32 w;
+
+    if (num_workers != uvm_perf_fault_service_threads) {
+        pr_info("Invalid uvm_perf_fault_service_threads value on GPU %s: %u. Valid range [0:%u] Using %u instead\n",
+                parent_gpu->name,
+                uvm_perf_fault_service_threads,
+                UVM_PERF_FAULT_SERVICE_THREADS_MAX,
+                num_workers);
+    }
+
+    if (num_workers == 0)
+        return NV_OK;
+
+    replayable_faults->pending_blocks = uvm_kvmalloc_zero(parent_gpu->fault_buffer_info.max_batch_size *
+                                                          sizeof(*replayable_faults->pending_blocks));
+    if (!replayable_faults->pending_blocks)
+        return NV_ERR_NO_MEMORY;
+
+    replayable_faults->service_workers = uvm_kvmalloc_zero(num_workers * sizeof(*replayable_faults->service_workers));
+    if (!replayable_faults->service_workers)
+        return NV_ERR_NO_MEMORY;
+
+    for (w = 0; w < num_workers; ++w) {
+        uvm_fault_service_worker_t *worker = &replayable_faults->service_workers[w];
+        char kthread_name[TASK_COMM_LEN + 1];
+
+        snprintf(kthread_name, sizeof(kthread_name), "UVM GPU%u FS%u", uvm_id_value(parent_gpu->id), w);
+        status = errno_to_nv_status(nv_kthread_q_init_on_node(&worker->q,
+                                                              kthread_name,
+                                                              parent_gpu->closest_cpu_numa_node));
+        if (status != NV_OK) {
+            UVM_ERR_PRINT("Failed in nv_kthread_q_init for fault service worker %u: %s, GPU %s\n",
+                          w,
+                          nvstatusToString(status),
+                          parent_gpu->name);
+            return status;
+        }
+
+        // Deinit tears down the workers counted here
+        ++replayable_faults->num_service_workers;
+
+        worker->index = w;
+        nv_kthread_q_item_init(&worker->q_item, fault_service_worker_entry, worker);
+        uvm_tracker_init(&worker->batch_context.tracker);
+
+        worker->batch_context.utlbs = uvm_kvmalloc_zero(replayable_faults->utlb_count *
+                                                        sizeof(*worker->batch_context.utlbs));
+        if (!worker->batch_context.utlbs)
+            return NV_ERR_NO_MEMORY;
+    }
+
+    return NV_OK;
+}
+
+static void fault_service_pool_deinit(uvm_parent_gpu_t *parent_gpu)
+{
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &parent_gpu->fault_buffer_info.replayable;
+    NvU32 w;
+
+    for (w = 0; w < replayable_faults->num_service_workers; ++w) {
+        uvm_fault_service_worker_t *worker = &replayable_faults->service_workers[w];
+
+        nv_kthread_q_stop(&worker->q);
+
+        UVM_ASSERT(uvm_tracker_is_empty(&worker->batch_context.tracker));
+        uvm_tracker_deinit(&worker->batch_context.tracker);
+        uvm_kvfree(worker->batch_context.utlbs);
+    }
+
+    uvm_kvfree(replayable_faults->service_workers);
+    uvm_kvfree(replayable_faults->pending_blocks);
+    replayable_faults->service_workers     = NULL;
+    replayable_faults->pending_blocks      = NULL;
+    replayable_faults->num_service_workers = 0;
+}
+
 // There is no error handling in this function. The caller is in charge of
 // calling fault_buffer_deinit_replayable_faults on failure.
 static NV_STATUS fault_buffer_init_replayable_faults(uvm_parent_gpu_t *parent_gpu)
@@ -167,6 +297,10 @@ static NV_STATUS fault_buffer_init_replayable_faults(uvm_parent_gpu_t *parent_gp
 
     batch_context->max_utlb_id = 0;
 
+    status = fault_service_pool_init(parent_gpu);
+    if (status != NV_OK)
+        return status;
+
     status = uvm_rm_locked_call(nvUvmInterfaceOwnPageFaultIntr(parent_gpu->rm_device, NV_TRUE));
     if (status != NV_OK) {
         UVM_ERR_PRINT("Failed to take page fault ownership from RM: %s, GPU %s\n",
@@ -218,6 +352,8 @@ static void fault_buffer_deinit_replayable_faults(uvm_parent_gpu_t *parent_gpu)
             parent_gpu->arch_hal->enable_prefetch_faults(parent_gpu);
     }
 
+    fault_service_pool_deinit(parent_gpu);
+
     uvm_kvfree(batch_context->fault_cache);
     uvm_kvfree(batch_context->ordered_fault_cache);
     uvm_kvfree(batch_context->utlbs);
@@ -736,6 +872,7 @@ static void fetch_fault_buffer_entries(uvm_gpu_t *gpu,
     NvU32 get;
     NvU32 put;
     NvU32 fault_index;
+    NvU32 batch_size;
     NvU32 num_coalesced_faults;
     NvU32 utlb_id;
     uvm_fault_buffer_entry_t *fault_cache;
@@ -773,9 +910,14 @@ static void fetch_fault_buffer_entries(uvm_gpu_t *gpu,
     if (get == put)
         goto done;
 
+    batch_size = min(gpu->parent->fault_buffer_info.max_batch_size,
+                     max(READ_ONCE(uvm_perf_fault_batch_count), (NvU32)UVM_PERF_FAULT_BATCH_COUNT_MIN));
+    if (READ_ONCE(uvm_perf_fault_replay_adaptive) && replayable_faults->adaptive_batch_count != 0)
+        batch_size = replayable_faults->adaptive_batch_count;
+
     // Parse until get != put and have enough space to cache.
     while ((get != put) &&
-           (fetch_mode == FAULT_FETCH_MODE_ALL || fault_index < gpu->parent->fault_buffer_info.max_batch_size)) {
+           (fetch_mode == FAULT_FETCH_MODE_ALL || fault_index < batch_size)) {
         bool is_same_instance_ptr = true;
         uvm_fault_buffer_entry_t *current_entry = &fault_cache[fault_index];
         uvm_fault_utlb_info_t *current_tlb;
@@ -1128,6 +1270,7 @@ static NV_STATUS service_batch_managed_faults_in_block_locked(uvm_gpu_t *gpu,
                                                               uvm_va_block_retry_t *va_block_retry,
                                                               NvU32 first_fault_index,
                                                               uvm_fault_service_batch_context_t *batch_context,
+                                                              uvm_service_block_context_t *block_context,
                                                               NvU32 *block_faults)
 {
     NV_STATUS status = NV_OK;
@@ -1135,10 +1278,9 @@ static NV_STATUS service_batch_managed_faults_in_block_locked(uvm_gpu_t *gpu,
     uvm_page_index_t first_page_index;
     uvm_page_index_t last_page_index;
     NvU32 page_fault_count = 0;
+    NvU32 new_fault_count = 0;
     uvm_range_group_range_iter_t iter;
-    uvm_replayable_fault_buffer_info_t *replayable_faults = &gpu->parent->fault_buffer_info.replayable;
     uvm_fault_buffer_entry_t **ordered_fault_cache = batch_context->ordered_fault_cache;
-    uvm_service_block_context_t *block_context = &replayable_faults->block_service_context;
     uvm_va_space_t *va_space = uvm_va_block_get_va_space(va_block);
     NvU64 end;
 
@@ -1214,6 +1356,8 @@ static NV_STATUS service_batch_managed_faults_in_block_locked(uvm_gpu_t *gpu,
                                             is_duplicate);
             if(is_duplicate == false) {
               dolphin_page_fault_count += 1;
+              uvm_va_range_stat_add(va_block->va_range, UVM_VA_RANGE_STAT_FAULTS, 1);
+              ++new_fault_count;
             }
         }
 
@@ -1341,6 +1485,9 @@ static NV_STATUS service_batch_managed_faults_in_block_locked(uvm_gpu_t *gpu,
         }
     }
 
+    if (new_fault_count > 0)
+        uvm_tools_event_ring_count_faults(va_space, new_fault_count);
+
     // Apply the changes computed in the fault service block context, if there
     // are pages to be serviced
     if (page_fault_count > 0) {
@@ -1369,12 +1516,12 @@ static NV_STATUS service_batch_managed_faults_in_block(uvm_gpu_t *gpu,
                                                        uvm_va_block_t *va_block,
                                                        NvU32 first_fault_index,
                                                        uvm_fault_service_batch_context_t *batch_context,
+                                                       uvm_service_block_context_t *fault_block_context,
                                                        NvU32 *block_faults)
 {
     NV_STATUS status;
     uvm_va_block_retry_t va_block_retry;
     NV_STATUS tracker_status;
-    uvm_service_block_context_t *fault_block_context = &gpu->parent->fault_buffer_info.replayable.block_service_context;
 
     fault_block_context->operation = UVM_SERVICE_OPERATION_REPLAYABLE_FAULTS;
     fault_block_context->num_retries = 0;
@@ -1387,6 +1534,7 @@ static NV_STATUS service_batch_managed_faults_in_block(uvm_gpu_t *gpu,
                                                                                     &va_block_retry,
                                                                                     first_fault_index,
                                                                                     batch_context,
+                                                                                    fault_block_context,
                                                                                     block_faults));
 
     tracker_status = uvm_tracker_add_tracker_safe(&batch_context->tracker, &va_block->tracker);
@@ -1396,6 +1544,168 @@ static NV_STATUS service_batch_managed_faults_in_block(uvm_gpu_t *gpu,
     return status == NV_OK? tracker_status: status;
 }
 
+// Number of faults of the batch, starting at first_fault_index, that fall in
+// va_block. These are the faults service_batch_managed_faults_in_block
+// services for a block that is not HMM.
+static NvU32 fault_batch_block_faults(uvm_va_block_t *va_block,
+                                      NvU32 first_fault_index,
+                                      uvm_fault_service_batch_context_t *batch_context)
+{
+    uvm_va_space_t *va_space = uvm_va_block_get_va_space(va_block);
+    NvU32 i;
+
+    for (i = first_fault_index;
+         i < batch_context->num_coalesced_faults &&
+         batch_context->ordered_fault_cache[i]->va_space == va_space &&
+         batch_context->ordered_fault_cache[i]->fault_address <= va_block->end;
+         ++i)
+        ;
+
+    return i - first_fault_index;
+}
+
+static void fault_service_worker(void *args)
+{
+    uvm_fault_service_worker_t *worker = (uvm_fault_service_worker_t *)args;
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &worker->gpu->parent->fault_buffer_info.replayable;
+    NvU32 b;
+
+    // The bottom half holds the mm and VA space locks on behalf of the pool
+    // while it waits for the workers
+    if (worker->mm)
+        uvm_record_lock_mmap_lock_read(worker->mm);
+    uvm_record_lock(&worker->va_space->lock, UVM_LOCK_FLAGS_MODE_SHARED);
+
+    worker->status = NV_OK;
+
+    for (b = worker->index; b < replayable_faults->num_pending_blocks; b += replayable_faults->num_service_workers) {
+        uvm_fault_service_block_t *pending = &replayable_faults->pending_blocks[b];
+        NvU32 block_faults;
+
+        worker->status = service_batch_managed_faults_in_block(worker->gpu,
+                                                               pending->va_block,
+                                                               pending->first_fault_index,
+                                                               &worker->batch_context,
+                                                               &worker->block_service_context,
+                                                               &block_faults);
+        if (worker->status != NV_OK)
+            break;
+    }
+
+    uvm_record_unlock(&worker->va_space->lock, UVM_LOCK_FLAGS_MODE_SHARED);
+    if (worker->mm)
+        uvm_record_unlock_mmap_lock_read(worker->mm);
+}
+
+static void fault_service_worker_entry(void *args)
+{
+    UVM_ENTRY_VOID(fault_service_worker(args));
+}
+
+// Services the pending VA blocks of gpu_va_space on the pool and waits for
+// all of them. The counters, fatal fault flags and trackers of the workers are
+// then merged into batch_context, and a single replay is issued on gpu if
+// replay is set.
+static NV_STATUS service_pending_blocks(uvm_gpu_t *gpu,
+                                        uvm_gpu_va_space_t *gpu_va_space,
+                                        struct mm_struct *mm,
+                                        uvm_fault_service_batch_context_t *batch_context,
+                                        uvm_va_block_context_t *va_block_context,
+                                        bool replay)
+{
+    NV_STATUS status = NV_OK;
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &gpu->parent->fault_buffer_info.replayable;
+    NvU32 num_workers;
+    NvU32 w;
+    NvU32 b;
+
+    // Blocks are only deferred once the GPU VA space is known
+    if (replayable_faults->num_pending_blocks == 0)
+        return NV_OK;
+
+    UVM_ASSERT(gpu_va_space);
+
+    num_workers = min(replayable_faults->num_service_workers, replayable_faults->num_pending_blocks);
+
+    for (w = 0; w < num_workers; ++w) {
+        uvm_fault_service_worker_t *worker = &replayable_faults->service_workers[w];
+        uvm_fault_service_batch_context_t *worker_batch = &worker->batch_context;
+
+        worker->gpu = gpu_va_space->gpu;
+        worker->va_space = gpu_va_space->va_space;
+        worker->mm = mm;
+        worker->block_service_context.block_context.mm = mm;
+
+        worker_batch->ordered_fault_cache         = batch_context->ordered_fault_cache;
+        worker_batch->num_coalesced_faults        = batch_context->num_coalesced_faults;
+        worker_batch->max_utlb_id                 = batch_context->max_utlb_id;
+        worker_batch->batch_id                    = batch_context->batch_id;
+        worker_batch->has_fatal_faults            = batch_context->has_fatal_faults;
+        worker_batch->has_throttled_faults        = false;
+        worker_batch->num_invalid_prefetch_faults = 0;
+        worker_batch->num_duplicate_faults        = 0;
+        memset(worker_batch->utlbs, 0, (batch_context->max_utlb_id + 1) * sizeof(*worker_batch->utlbs));
+
+        nv_kthread_q_schedule_q_item(&worker->q, &worker->q_item);
+    }
+
+    for (w = 0; w < num_workers; ++w) {
+        uvm_fault_service_worker_t *worker = &replayable_faults->service_workers[w];
+        uvm_fault_service_batch_context_t *worker_batch = &worker->batch_context;
+        NV_STATUS tracker_status;
+        NvU32 u;
+
+        nv_kthread_q_flush(&worker->q);
+
+        if (status == NV_OK)
+            status = worker->status;
+
+        tracker_status = uvm_tracker_add_tracker_safe(&batch_context->tracker, &worker_batch->tracker);
+        uvm_tracker_clear(&worker_batch->tracker);
+        if (status == NV_OK)
+            status = tracker_status;
+
+        batch_context->num_invalid_prefetch_faults += worker_batch->num_invalid_prefetch_faults;
+        batch_context->num_duplicate_faults += worker_batch->num_duplicate_faults;
+
+        if (worker_batch->has_throttled_faults)
+            batch_context->has_throttled_faults = true;
+
+        if (worker_batch->has_fatal_faults)
+            batch_context->has_fatal_faults = true;
+
+        for (u = 0; u <= batch_context->max_utlb_id; ++u) {
+            if (worker_batch->utlbs[u].has_fatal_faults)
+                batch_context->utlbs[u].has_fatal_faults = true;
+        }
+    }
+
+    // The stride and Markov prefetchers update state shared by the blocks of a
+    // range, so they are notified here rather than by the workers
+    if (status == NV_OK) {
+        for (b = 0; b < replayable_faults->num_pending_blocks; ++b) {
+            uvm_perf_prefetch_stride_notify(replayable_faults->pending_blocks[b].va_block,
+                                            va_block_context,
+                                            gpu_va_space->gpu->id);
+            uvm_perf_prefetch_markov_notify(replayable_faults->pending_blocks[b].va_block,
+                                            va_block_context,
+                                            gpu_va_space->gpu->id);
+        }
+    }
+
+    replayable_faults->num_pending_blocks = 0;
+
+    if (status == NV_OK && replay) {
+        status = push_replay_on_gpu(gpu, UVM_FAULT_REPLAY_TYPE_START, batch_context);
+
+        // See the replay of UVM_PERF_FAULT_REPLAY_POLICY_BLOCK in
+        // service_fault_batch
+        ++batch_context->batch_id;
+    }
+
+    return status;
+}
+
 typedef enum
 {
     // Use this mode when calling from the normal fault servicing path
@@ -1495,6 +1805,119 @@ static NV_STATUS service_non_managed_fault(uvm_fault_buffer_entry_t *current_ent
     return status;
 }
 
+// Whether faults on va_block and on the VA blocks following it in its range
+// are replayed together. See uvm_perf_fault_coalesce_blocks.
+static bool fault_block_coalesces(uvm_va_block_t *va_block)
+{
+    uvm_va_policy_t *policy;
+
+    if (!uvm_perf_fault_coalesce_blocks || uvm_va_block_is_hmm(va_block))
+        return false;
+
+    policy = uvm_va_range_get_policy(va_block->va_range);
+
+    return policy->quick_migrate || uvm_va_policy_is_streaming(policy);
+}
+
+// Whether the fault following a serviced va_block continues its run, so the
+// replay can wait until the next block is resident too
+static bool fault_continues_block_run(uvm_va_block_t *va_block, const uvm_fault_buffer_entry_t *next_entry)
+{
+    return next_entry->va_space == va_block->va_range->va_space &&
+           !next_entry->is_fatal &&
+           next_entry->fault_address > va_block->end &&
+           next_entry->fault_address <= va_block->end + UVM_VA_BLOCK_SIZE &&
+           next_entry->fault_address <= va_block->va_range->node.end;
+}
+
+static NvU64 fault_replay_average(bool first, NvU64 average, NvU64 sample)
+{
+    return first ? sample : (average * 7 + sample) / 8;
+}
+
+// Updates the statistics of va_space with its part of the batch, num_faults
+// faults in num_blocks VA blocks serviced since start_time, and picks the
+// replay policy and the batch size of its next batches. Dense streaming
+// kernels fault on most pages of the blocks they touch and are replayed per
+// block, in full batches. Sparse ones, such as pointer chasing, fault on a
+// page or two per block and are replayed per batch, with batches short enough
+// to be serviced in uvm_perf_fault_replay_adaptive_batch_us. The others, and
+// VA spaces without a hint whose batches are mostly duplicates, flush the
+// buffer with the replay.
+static void fault_replay_adapt(uvm_parent_gpu_t *parent_gpu,
+                               fault_service_mode_t service_mode,
+                               uvm_va_space_t *va_space,
+                               const uvm_fault_service_batch_context_t *batch_context,
+                               NvU32 num_faults,
+                               NvU32 num_blocks,
+                               NvU64 start_time)
+{
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &parent_gpu->fault_buffer_info.replayable;
+    const NvU64 max_batch_size = parent_gpu->fault_buffer_info.max_batch_size;
+    const NvU32 hint = READ_ONCE(va_space->fault_replay.hint);
+    const bool first = va_space->fault_replay.batch_count == 0;
+    uvm_perf_fault_replay_policy_t replay_policy;
+    NvU64 duplicate_pct;
+    NvU64 faults_per_block;
+    NvU64 ns_per_fault;
+    NvU64 batch_count;
+
+    if (service_mode != FAULT_SERVICE_MODE_REGULAR ||
+        !READ_ONCE(uvm_perf_fault_replay_adaptive) ||
+        num_faults == 0 ||
+        batch_context->num_cached_faults == 0)
+        return;
+
+    duplicate_pct = fault_replay_average(first,
+                                         va_space->fault_replay.duplicate_pct,
+                                         batch_context->num_duplicate_faults * 100 / batch_context->num_cached_faults);
+    faults_per_block = fault_replay_average(first,
+                                            va_space->fault_replay.faults_per_block,
+                                            num_faults / max(num_blocks, 1u));
+    ns_per_fault = fault_replay_average(first,
+                                        va_space->fault_replay.ns_per_fault,
+                                        (NV_GETTIME() - start_time) / num_faults);
+
+    if (hint == UVM_FAULT_REPLAY_HINT_STREAMING ||
+        (hint == UVM_FAULT_REPLAY_HINT_NONE && faults_per_block >= READ_ONCE(uvm_perf_fault_replay_adaptive_dense))) {
+        replay_policy = UVM_PERF_FAULT_REPLAY_POLICY_BLOCK;
+        batch_count = max_batch_size;
+    }
+    else if (hint == UVM_FAULT_REPLAY_HINT_IRREGULAR ||
+             (hint == UVM_FAULT_REPLAY_HINT_NONE && faults_per_block <= UVM_PERF_FAULT_REPLAY_ADAPTIVE_SPARSE)) {
+        replay_policy = UVM_PERF_FAULT_REPLAY_POLICY_BATCH;
+        batch_count = ns_per_fault == 0 ? max_batch_size :
+                                          READ_ONCE(uvm_perf_fault_replay_adaptive_batch_us) * 1000ULL / ns_per_fault;
+        batch_count = max(batch_count, (NvU64)UVM_PERF_FAULT_REPLAY_ADAPTIVE_BATCH_COUNT_MIN);
+    }
+    else {
+        replay_policy = UVM_PERF_FAULT_REPLAY_POLICY_BATCH_FLUSH;
+        batch_count = READ_ONCE(uvm_perf_fault_batch_count);
+    }
+
+    if (hint == UVM_FAULT_REPLAY_HINT_NONE && duplicate_pct > replayable_faults->replay_update_put_ratio)
+        replay_policy = UVM_PERF_FAULT_REPLAY_POLICY_BATCH_FLUSH;
+
+    batch_count = max(min(batch_count, max_batch_size), (NvU64)UVM_PERF_FAULT_BATCH_COUNT_MIN);
+
+    va_space->fault_replay.duplicate_pct = duplicate_pct;
+    va_space->fault_replay.faults_per_block = faults_per_block;
+    va_space->fault_replay.ns_per_fault = ns_per_fault;
+    va_space->fault_replay.replay_policy = replay_policy;
+    va_space->fault_replay.batch_count = batch_count;
+
+    replayable_faults->adaptive_batch_count = batch_count;
+}
+
+// Replay policy of a batch whose first faults are on va_space
+static uvm_perf_fault_replay_policy_t fault_replay_policy(uvm_parent_gpu_t *parent_gpu, uvm_va_space_t *va_space)
+{
+    if (READ_ONCE(uvm_perf_fault_replay_adaptive) && va_space->fault_replay.batch_count != 0)
+        return va_space->fault_replay.replay_policy;
+
+    return parent_gpu->fault_buffer_info.replayable.replay_policy;
+}
+
 // Scan the ordered view of faults and group them by different va_blocks.
 // Service faults for each va_block, in batch.
 //
@@ -1510,15 +1933,25 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
     uvm_va_space_t *va_space = NULL;
     uvm_gpu_va_space_t *gpu_va_space = NULL;
     uvm_ats_fault_invalidate_t *ats_invalidate = &gpu->parent->fault_buffer_info.replayable.ats_invalidate;
-    const bool replay_per_va_block = service_mode != FAULT_SERVICE_MODE_CANCEL &&
-                                     gpu->parent->fault_buffer_info.replayable.replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BLOCK;
+    bool replay_per_va_block = false;
     struct mm_struct *mm = NULL;
-    uvm_va_block_context_t *va_block_context =
-        &gpu->parent->fault_buffer_info.replayable.block_service_context.block_context;
+    uvm_replayable_fault_buffer_info_t *replayable_faults = &gpu->parent->fault_buffer_info.replayable;
+    uvm_va_block_context_t *va_block_context = &replayable_faults->block_service_context.block_context;
+
+    // Part of the batch serviced for the current VA space, for
+    // fault_replay_adapt
+    NvU64 va_space_start = 0;
+    NvU32 va_space_first_fault = 0;
+    NvU32 va_space_blocks = 0;
+
+    // The fault cancelling algorithm services the batch in the bottom half
+    const bool use_pool = service_mode != FAULT_SERVICE_MODE_CANCEL && replayable_faults->num_service_workers > 0;
 
     UVM_ASSERT(gpu->parent->replayable_faults_supported);
+    UVM_ASSERT(replayable_faults->num_pending_blocks == 0);
 
     ats_invalidate->write_faults_in_batch = false;
+    batch_context->replay_policy = replayable_faults->replay_policy;
 
     for (i = 0; i < batch_context->num_coalesced_faults;) {
         uvm_va_block_t *va_block;
@@ -1531,11 +1964,23 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
         if (current_entry->va_space != va_space) {
             // Fault on a different va_space, drop the lock of the old one...
             if (va_space != NULL) {
+                status = service_pending_blocks(gpu, gpu_va_space, mm, batch_context, va_block_context, replay_per_va_block);
+                if (status != NV_OK)
+                    goto fail;
+
                 // TLB entries are invalidated per GPU VA space
                 status = uvm_ats_invalidate_tlbs(gpu_va_space, ats_invalidate, &batch_context->tracker);
                 if (status != NV_OK)
                     goto fail;
 
+                fault_replay_adapt(gpu->parent,
+                                   service_mode,
+                                   va_space,
+                                   batch_context,
+                                   i - va_space_first_fault,
+                                   va_space_blocks,
+                                   va_space_start);
+
                 uvm_va_space_up_read(va_space);
                 uvm_va_space_mm_release_unlock(va_space, mm);
                 mm = NULL;
@@ -1554,6 +1999,17 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
 
             uvm_va_space_down_read(va_space);
 
+            // The batch is replayed the way its first VA space is
+            if (i == 0) {
+                batch_context->replay_policy = fault_replay_policy(gpu->parent, va_space);
+                replay_per_va_block = service_mode != FAULT_SERVICE_MODE_CANCEL &&
+                                      batch_context->replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BLOCK;
+            }
+
+            va_space_start = NV_GETTIME();
+            va_space_first_fault = i;
+            va_space_blocks = 0;
+
             gpu_va_space = uvm_gpu_va_space_get_by_parent_gpu(va_space, gpu->parent);
             if (gpu_va_space && gpu_va_space->needs_fault_buffer_flush) {
                 // flush if required and clear the flush flag
@@ -1599,11 +2055,23 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
                                           current_entry->fault_address,
                                           va_block_context,
                                           &va_block);
-        if (status == NV_OK) {
+        if (status == NV_OK && use_pool && !uvm_va_block_is_hmm(va_block)) {
+            // Serviced by the pool once all the blocks of the VA space are
+            // known, and replayed together
+            replayable_faults->pending_blocks[replayable_faults->num_pending_blocks].va_block = va_block;
+            replayable_faults->pending_blocks[replayable_faults->num_pending_blocks].first_fault_index = i;
+            ++replayable_faults->num_pending_blocks;
+            ++va_space_blocks;
+
+            i += fault_batch_block_faults(va_block, i, batch_context);
+            continue;
+        }
+        else if (status == NV_OK) {
             status = service_batch_managed_faults_in_block(gpu_va_space->gpu,
                                                            va_block,
                                                            i,
                                                            batch_context,
+                                                           &replayable_faults->block_service_context,
                                                            &block_faults);
 
             // When service_batch_managed_faults_in_block returns != NV_OK
@@ -1612,6 +2080,12 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
                 goto fail;
 
             i += block_faults;
+            ++va_space_blocks;
+
+            if (service_mode != FAULT_SERVICE_MODE_CANCEL) {
+                uvm_perf_prefetch_stride_notify(va_block, va_block_context, gpu_va_space->gpu->id);
+                uvm_perf_prefetch_markov_notify(va_block, va_block_context, gpu_va_space->gpu->id);
+            }
         }
         else {
             const uvm_fault_buffer_entry_t *previous_entry = i == 0? NULL : batch_context->ordered_fault_cache[i - 1];
@@ -1634,7 +2108,15 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
             continue;
         }
 
-        // Don't issue replays in cancel mode
+        // Don't issue replays in cancel mode. Within a run of contiguous
+        // blocks of a streaming range the replay is issued after the last one;
+        // the batch tracker it acquires covers the migrations of all of them.
+        if (replay_per_va_block &&
+            i < batch_context->num_coalesced_faults &&
+            fault_block_coalesces(va_block) &&
+            fault_continues_block_run(va_block, batch_context->ordered_fault_cache[i]))
+            continue;
+
         if (replay_per_va_block) {
             status = push_replay_on_gpu(gpu, UVM_FAULT_REPLAY_TYPE_START, batch_context);
             if (status != NV_OK)
@@ -1650,12 +2132,31 @@ static NV_STATUS service_fault_batch(uvm_gpu_t *gpu,
     // Only clobber status if invalidate_status != NV_OK, since status may also
     // contain NV_WARN_MORE_PROCESSING_REQUIRED.
     if (va_space != NULL) {
-        NV_STATUS invalidate_status = uvm_ats_invalidate_tlbs(gpu_va_space, ats_invalidate, &batch_context->tracker);
+        NV_STATUS invalidate_status = service_pending_blocks(gpu,
+                                                             gpu_va_space,
+                                                             mm,
+                                                             batch_context,
+                                                             va_block_context,
+                                                             replay_per_va_block);
+        if (invalidate_status == NV_OK)
+            invalidate_status = uvm_ats_invalidate_tlbs(gpu_va_space, ats_invalidate, &batch_context->tracker);
         if (invalidate_status != NV_OK)
             status = invalidate_status;
+        else if (status == NV_OK)
+            fault_replay_adapt(gpu->parent,
+                               service_mode,
+                               va_space,
+                               batch_context,
+                               i - va_space_first_fault,
+                               va_space_blocks,
+                               va_space_start);
     }
 
 fail:
+    // Blocks left pending by a failure are not serviced; their faults are
+    // replayed and come back
+    replayable_faults->num_pending_blocks = 0;
+
     if (va_space != NULL) {
         uvm_va_space_up_read(va_space);
         uvm_va_space_mm_release_unlock(va_space, mm);
@@ -2226,6 +2727,8 @@ void uvm_gpu_service_replayable_faults(uvm_gpu_t *gpu)
 
         ++batch_context->batch_id;
 
+        trace_uvm_fault_batch_start(uvm_id_value(gpu->id), batch_context->batch_id, batch_context->num_cached_faults);
+
         status = preprocess_fault_batch(gpu, batch_context);
 
         num_replays += batch_context->num_replays;
@@ -2237,6 +2740,12 @@ void uvm_gpu_service_replayable_faults(uvm_gpu_t *gpu)
 
         status = service_fault_batch(gpu, FAULT_SERVICE_MODE_REGULAR, batch_context);
 
+        trace_uvm_fault_batch_end(uvm_id_value(gpu->id),
+                                  batch_context->batch_id,
+                                  batch_context->num_coalesced_faults,
+                                  batch_context->num_replays,
+                                  status);
+
     /* pr_alert("num page faults = %d\n", batch_context->num_coalesced_faults); */
         /* dolphin_page_fault_count += batch_context->num_coalesced_faults; */
         /* dolphin_page_fault_count += 1; */
@@ -2269,13 +2778,13 @@ void uvm_gpu_service_replayable_faults(uvm_gpu_t *gpu)
             break;
         }
 
-        if (replayable_faults->replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BATCH) {
+        if (batch_context->replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BATCH) {
             status = push_replay_on_gpu(gpu, UVM_FAULT_REPLAY_TYPE_START, batch_context);
             if (status != NV_OK)
                 break;
             ++num_replays;
         }
-        else if (replayable_faults->replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BATCH_FLUSH) {
+        else if (batch_context->replay_policy == UVM_PERF_FAULT_REPLAY_POLICY_BATCH_FLUSH) {
             uvm_gpu_buffer_flush_mode_t flush_mode = UVM_GPU_BUFFER_FLUSH_MODE_CACHED_PUT;
 
             if (batch_context->num_duplicate_faults * 100 >
@@ -2403,12 +2912,140 @@ NV_STATUS uvm_test_drain_replayable_faults(UVM_TEST_DRAIN_REPLAYABLE_FAULTS_PARA
     return status;
 }
 
+// Adds what the VA space counted since the last snapshot to delta and starts
+// the epoch tagged epoch, returning the tag of the one that ends. The
+// counters are never reset, so increments racing with the snapshot land in
+// one epoch or the next.
+static NvU64 stat_epoch_snapshot(uvm_va_space_t *va_space, NvU64 epoch, NvU64 *delta) {
+  NvU64 previous;
+  int cpu;
+  size_t i;
+
+  uvm_spin_lock(&va_space->stat_epoch.lock);
+  for_each_possible_cpu(cpu) {
+    uvm_va_space_epoch_stats_t *cpu_stats = per_cpu_ptr(va_space->stat_epoch.stats, cpu);
+
+    for (i = 0; i < UVM_VA_RANGE_STAT_COUNT; i++) {
+      NvU64 count = READ_ONCE(cpu_stats->counters[i]);
+
+      delta[i] += count - cpu_stats->snapshot[i];
+      cpu_stats->snapshot[i] = count;
+    }
+  }
+  previous = va_space->stat_epoch.epoch;
+  va_space->stat_epoch.epoch = epoch;
+  uvm_spin_unlock(&va_space->stat_epoch.lock);
+
+  return previous;
+}
+
 NV_STATUS uvm_api_start_stat_collection(const UVM_START_STAT_COLLECTION_PARAMS *params, struct file *filp) {
+  uvm_va_space_t *va_space = uvm_va_space_get(filp);
+  NvU64 discarded[UVM_VA_RANGE_STAT_COUNT] = {0};
+
   dolphin_page_fault_count = 0;
+
+  uvm_va_space_down_read(va_space);
+  uvm_va_space_reset_range_stats(va_space);
+  uvm_va_space_up_read(va_space);
+
+  if (va_space->stat_epoch.stats)
+    stat_epoch_snapshot(va_space, 0, discarded);
+
   return NV_OK;
 }
 
-NV_STATUS uvm_api_stop_stat_collection(const UVM_STOP_STAT_COLLECTION_PARAMS *params, struct file *filp) {
-  pr_alert("page fault count is %llu\n", dolphin_page_fault_count);
+NV_STATUS uvm_api_snapshot_stat_collection(UVM_SNAPSHOT_STAT_COLLECTION_PARAMS *params, struct file *filp) {
+  uvm_va_space_t *va_space = uvm_va_space_get(filp);
+  NvU64 delta[UVM_VA_RANGE_STAT_COUNT] = {0};
+
+  if (!va_space->stat_epoch.stats)
+    return NV_ERR_NOT_SUPPORTED;
+
+  params->previousEpoch = stat_epoch_snapshot(va_space, params->epoch, delta);
+
+  memset(&params->stats, 0, sizeof(params->stats));
+  params->stats.faults = delta[UVM_VA_RANGE_STAT_FAULTS];
+  params->stats.bytesH2D = delta[UVM_VA_RANGE_STAT_BYTES_H2D];
+  params->stats.bytesD2H = delta[UVM_VA_RANGE_STAT_BYTES_D2H];
+  params->stats.evictions = delta[UVM_VA_RANGE_STAT_EVICTIONS];
+  params->stats.thrashingEvents = delta[UVM_VA_RANGE_STAT_THRASHING];
+  params->stats.accessCounterNotifications = delta[UVM_VA_RANGE_STAT_AC_NOTIFICATIONS];
+  params->stats.markovPredictions = delta[UVM_VA_RANGE_STAT_MARKOV_PREDICTIONS];
+  params->stats.markovHits = delta[UVM_VA_RANGE_STAT_MARKOV_HITS];
   return NV_OK;
 }
+
+NV_STATUS uvm_api_stop_stat_collection(UVM_STOP_STAT_COLLECTION_PARAMS *params, struct file *filp) {
+  uvm_va_space_t *va_space = uvm_va_space_get(filp);
+  UVM_VA_RANGE_STATS *entries = NULL;
+  uvm_va_range_t *va_range;
+  NV_STATUS status = NV_OK;
+  NvU32 capacity = params->statsBuffer ? params->statsCount : 0;
+  NvU32 written = 0;
+  NvU32 total = 0;
+
+
+  // Entries are staged in kernel memory so that the user copy doesn't happen
+  // with the va_space lock held.
+  if (capacity) {
+    entries = uvm_kvmalloc(capacity * sizeof(*entries));
+    if (!entries)
+      return NV_ERR_NO_MEMORY;
+  }
+
+  uvm_va_space_down_read(va_space);
+
+  uvm_for_each_va_range(va_range, va_space) {
+    uvm_va_range_stats_t stats;
+    UVM_VA_RANGE_STATS *entry;
+
+    if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED)
+      continue;
+
+    total++;
+    if (written >= capacity)
+      continue;
+
+    uvm_va_range_stats_read(va_range, &stats);
+
+    entry = &entries[written++];
+    entry->base = va_range->node.start;
+    entry->length = uvm_va_range_size(va_range);
+    entry->faults = stats.counters[UVM_VA_RANGE_STAT_FAULTS];
+    entry->bytesH2D = stats.counters[UVM_VA_RANGE_STAT_BYTES_H2D];
+    entry->bytesD2H = stats.counters[UVM_VA_RANGE_STAT_BYTES_D2H];
+    entry->evictions = stats.counters[UVM_VA_RANGE_STAT_EVICTIONS];
+    entry->thrashingEvents = stats.counters[UVM_VA_RANGE_STAT_THRASHING];
+    entry->accessCounterNotifications = stats.counters[UVM_VA_RANGE_STAT_AC_NOTIFICATIONS];
+    entry->markovPredictions = stats.counters[UVM_VA_RANGE_STAT_MARKOV_PREDICTIONS];
+    entry->markovHits = stats.counters[UVM_VA_RANGE_STAT_MARKOV_HITS];
+
+    /* pr_alert("va_range 0x%llx faults %llu h2d %llu d2h %llu\n", entry->base, entry->faults, entry->bytesH2D, entry->bytesD2H); */
+  }
+
+  uvm_va_space_up_read(va_space);
+
+  if (written && nv_copy_to_user((void __user *)params->statsBuffer, entries, written * sizeof(*entries)))
+    status = NV_ERR_INVALID_ADDRESS;
+
+  uvm_kvfree(entries);
+
+  params->statsCount = written;
+  params->statsTotal = total;
+  params->faultCount = dolphin_page_fault_count;
+  return status;
+}
+
+NV_STATUS uvm_api_set_fault_replay_hint(const UVM_SET_FAULT_REPLAY_HINT_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+
+    if (params->hint > UVM_FAULT_REPLAY_HINT_IRREGULAR)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // Read by fault servicing without the VA space lock
+    WRITE_ONCE(va_space->fault_replay.hint, params->hint);
+
+    return NV_OK;
+}
@@ -730,7 +730,8 @@ NV_STATUS uvm_hmm_set_preferred_location(uvm_va_space_t *va_space,
                                          UVM_VA_POLICY_PREFERRED_LOCATION,
                                          is_default,
                                          preferred_location,
-                                         UVM_READ_DUPLICATION_MAX);
+                                         UVM_READ_DUPLICATION_MAX,
+                                         0);
 
         // TODO: Bug 1750144: unset requires re-evaluating accessed-by mappings
         // (see uvm_va_range_set_preferred_location's call of
@@ -784,7 +785,8 @@ NV_STATUS uvm_hmm_set_accessed_by(uvm_va_space_t *va_space,
                                          UVM_VA_POLICY_ACCESSED_BY,
                                          !set_bit,
                                          processor_id,
-                                         UVM_READ_DUPLICATION_MAX);
+                                         UVM_READ_DUPLICATION_MAX,
+                                         0);
 
         // TODO: Bug 1750144: need to call va_block_set_accessed_by_locked()
         // if read duplication isn't enabled.
@@ -798,6 +800,106 @@ NV_STATUS uvm_hmm_set_accessed_by(uvm_va_space_t *va_space,
     return status;
 }
 
+// Set one of the SUV policies on [base, last_address], creating the HMM
+// va_blocks as needed. The PMM eviction lists follow the prioritized location
+// right away, as uvm_va_range_set_prioritized_location() leaves to the next
+// migration of a managed block.
+static NV_STATUS hmm_set_suv_policy(uvm_va_space_t *va_space,
+                                    uvm_va_policy_type_t which,
+                                    bool is_default,
+                                    uvm_processor_id_t processor_id,
+                                    NvU32 level,
+                                    NvU64 base,
+                                    NvU64 last_address)
+{
+    uvm_va_block_t *va_block;
+    NvU64 addr;
+    NV_STATUS status = NV_OK;
+
+    if (!uvm_hmm_is_enabled(va_space))
+        return NV_ERR_INVALID_ADDRESS;
+
+    uvm_assert_mmap_lock_locked(va_space->va_space_mm.mm);
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+    UVM_ASSERT(PAGE_ALIGNED(base));
+    UVM_ASSERT(PAGE_ALIGNED(last_address + 1));
+    UVM_ASSERT(base < last_address);
+
+    for (addr = base; addr < last_address; addr = va_block->end + 1) {
+        NvU64 end;
+
+        status = hmm_va_block_find_create(va_space, addr, true, NULL, &va_block);
+        if (status != NV_OK)
+            break;
+
+        end = min(last_address, va_block->end);
+
+        uvm_mutex_lock(&va_block->lock);
+
+        status = uvm_va_policy_set_range(va_block,
+                                         addr,
+                                         end,
+                                         which,
+                                         is_default,
+                                         processor_id,
+                                         UVM_READ_DUPLICATION_MAX,
+                                         level);
+
+        if (status == NV_OK && which == UVM_VA_POLICY_PRIORITIZED_LOCATION)
+            uvm_va_block_mark_memory_used(va_block);
+
+        uvm_mutex_unlock(&va_block->lock);
+
+        if (status != NV_OK)
+            break;
+    }
+
+    return status;
+}
+
+NV_STATUS uvm_hmm_set_prioritized_location(uvm_va_space_t *va_space,
+                                           uvm_processor_id_t prioritized_location,
+                                           NvU32 level,
+                                           NvU64 base,
+                                           NvU64 last_address)
+{
+    return hmm_set_suv_policy(va_space,
+                              UVM_VA_POLICY_PRIORITIZED_LOCATION,
+                              UVM_ID_IS_INVALID(prioritized_location),
+                              prioritized_location,
+                              level,
+                              base,
+                              last_address);
+}
+
+NV_STATUS uvm_hmm_set_quick_migrate(uvm_va_space_t *va_space,
+                                    bool quick_migrate,
+                                    NvU64 base,
+                                    NvU64 last_address)
+{
+    return hmm_set_suv_policy(va_space,
+                              UVM_VA_POLICY_QUICK_MIGRATE,
+                              !quick_migrate,
+                              UVM_ID_INVALID,
+                              0,
+                              base,
+                              last_address);
+}
+
+NV_STATUS uvm_hmm_set_no_migrate(uvm_va_space_t *va_space,
+                                 bool ignore_ac_notification,
+                                 NvU64 base,
+                                 NvU64 last_address)
+{
+    return hmm_set_suv_policy(va_space,
+                              UVM_VA_POLICY_NO_MIGRATE,
+                              !ignore_ac_notification,
+                              UVM_ID_INVALID,
+                              0,
+                              base,
+                              last_address);
+}
+
 void uvm_hmm_find_policy_end(uvm_va_block_t *va_block,
                              uvm_va_block_context_t *va_block_context,
                              unsigned long addr,
@@ -180,6 +180,27 @@ typedef struct
                                       NvU64 base,
                                       NvU64 last_address);
 
+    // Set the SUV prioritized location and eviction level, the quick migrate
+    // or the no-migrate policy of the given range. UVM_ID_INVALID and false
+    // unset them. Note that 'last_address' is inclusive.
+    // Locking: the va_space->va_space_mm.mm mmap_lock must be locked
+    // and the va_space lock must be held in write mode.
+    NV_STATUS uvm_hmm_set_prioritized_location(uvm_va_space_t *va_space,
+                                               uvm_processor_id_t prioritized_location,
+                                               NvU32 level,
+                                               NvU64 base,
+                                               NvU64 last_address);
+
+    NV_STATUS uvm_hmm_set_quick_migrate(uvm_va_space_t *va_space,
+                                        bool quick_migrate,
+                                        NvU64 base,
+                                        NvU64 last_address);
+
+    NV_STATUS uvm_hmm_set_no_migrate(uvm_va_space_t *va_space,
+                                     bool ignore_ac_notification,
+                                     NvU64 base,
+                                     NvU64 last_address);
+
     // Set the read duplication policy for the given range.
     // Note that 'last_address' is inclusive.
     // Locking: the va_space->va_space_mm.mm mmap_lock must be write locked
@@ -363,6 +384,31 @@ typedef struct
         return NV_ERR_INVALID_ADDRESS;
     }
 
+    static NV_STATUS uvm_hmm_set_prioritized_location(uvm_va_space_t *va_space,
+                                                      uvm_processor_id_t prioritized_location,
+                                                      NvU32 level,
+                                                      NvU64 base,
+                                                      NvU64 last_address)
+    {
+        return NV_ERR_INVALID_ADDRESS;
+    }
+
+    static NV_STATUS uvm_hmm_set_quick_migrate(uvm_va_space_t *va_space,
+                                               bool quick_migrate,
+                                               NvU64 base,
+                                               NvU64 last_address)
+    {
+        return NV_ERR_INVALID_ADDRESS;
+    }
+
+    static NV_STATUS uvm_hmm_set_no_migrate(uvm_va_space_t *va_space,
+                                            bool ignore_ac_notification,
+                                            NvU64 base,
+                                            NvU64 last_address)
+    {
+        return NV_ERR_INVALID_ADDRESS;
+    }
+
     static NV_STATUS uvm_hmm_set_read_duplication(uvm_va_space_t *va_space,
                                                   uvm_read_duplication_policy_t new_policy,
                                                   NvU64 base,
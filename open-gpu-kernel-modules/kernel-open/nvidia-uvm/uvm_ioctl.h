@@ -1051,12 +1051,16 @@ typedef struct
 //
 // UvmSetPrioritizedLocation
 //
+// priority orders eviction among prioritized ranges of a GPU: 1 is evicted
+// first, UVM_PMM_PRIORITY_LEVELS last. 0 is the highest level.
+//
 #define UVM_SET_PRIORITIZED_LOCATION                                    UVM_IOCTL_BASE(75)
 typedef struct
 {
     NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
     NvU64           length             NV_ALIGN_BYTES(8); // IN
     NvProcessorUuid prioritizedLocation;                    // IN
+    NvU32           priority;                             // IN
     NV_STATUS       rmStatus;                             // OUT
 } UVM_SET_PRIORITIZED_LOCATION_PARAMS;
 
@@ -1087,9 +1091,46 @@ typedef struct
 #define UVM_STOP_STAT_COLLECTION                                    UVM_IOCTL_BASE(78)
 typedef struct
 {
+    NvU64           base                       NV_ALIGN_BYTES(8);
+    NvU64           length                     NV_ALIGN_BYTES(8);
+    NvU64           faults                     NV_ALIGN_BYTES(8);
+    NvU64           bytesH2D                   NV_ALIGN_BYTES(8);
+    NvU64           bytesD2H                   NV_ALIGN_BYTES(8);
+    NvU64           evictions                  NV_ALIGN_BYTES(8);
+    NvU64           thrashingEvents            NV_ALIGN_BYTES(8);
+    NvU64           accessCounterNotifications NV_ALIGN_BYTES(8);
+    NvU64           markovPredictions          NV_ALIGN_BYTES(8);
+    NvU64           markovHits                 NV_ALIGN_BYTES(8);
+} UVM_VA_RANGE_STATS;
+
+typedef struct
+{
+    NvU64           statsBuffer        NV_ALIGN_BYTES(8); // IN, UVM_VA_RANGE_STATS array, may be 0
+    NvU32           statsCount;                           // IN capacity, OUT entries written
+    NvU32           statsTotal;                           // OUT managed va_ranges seen
+    NvU64           faultCount         NV_ALIGN_BYTES(8); // OUT faults serviced since the start
     NV_STATUS       rmStatus;                             // OUT
 } UVM_STOP_STAT_COLLECTION_PARAMS;
 
+//
+// UvmSnapshotStatCollection
+//
+// Ends the epoch running and starts the one tagged epoch, for attributing
+// driver activity to the launches of the runtime. stats gets what the
+// managed ranges of the VA space counted in the epoch that ends, which began
+// at the previous snapshot or at UVM_START_STAT_COLLECTION (tagged 0), with
+// base and length 0; previousEpoch is its tag. Unlike UVM_STOP_STAT_COLLECTION
+// it doesn't walk the ranges, so it is cheap enough for every launch.
+//
+#define UVM_SNAPSHOT_STAT_COLLECTION                                  UVM_IOCTL_BASE(97)
+typedef struct
+{
+    NvU64              epoch              NV_ALIGN_BYTES(8); // IN
+    NvU64              previousEpoch      NV_ALIGN_BYTES(8); // OUT
+    UVM_VA_RANGE_STATS stats;                                // OUT
+    NV_STATUS          rmStatus;                             // OUT
+} UVM_SNAPSHOT_STAT_COLLECTION_PARAMS;
+
 //
 // UvmSetQuickMigrate
 //
@@ -1105,6 +1146,16 @@ typedef struct
 //
 // UvmSetNoMigrateRegion
 //
+//
+// UvmReconfigureAccessCounters
+//
+// enable_momc_migrations is UVM_ACCESS_COUNTER_MOMC_PEER to migrate a block
+// of this GPU's memory that a MOMC notification reports toward the one peer
+// GPU mapping it, rather than to the CPU; a block the CPU maps still goes to
+// the CPU and one several peers map stays.
+//
+#define UVM_ACCESS_COUNTER_MOMC_PEER 2
+
 #define UVM_RECONFIGURE_ACCESS_COUNTERS             UVM_IOCTL_BASE(80)
 typedef struct
 {
@@ -1142,6 +1193,492 @@ typedef struct
     NV_STATUS                       rmStatus;                                           // Out
 } UVM_IS_ALLOCATED_PARAMS;
 
+//
+// UvmSetPrefetchStride
+//
+// stride is the distance in bytes between the accesses of consecutive
+// iterations, as the compiler derived it; it seeds the cross-block stride
+// prefetcher of the range. 0 clears it.
+//
+#define UVM_SET_PREFETCH_STRIDE                                       UVM_IOCTL_BASE(82)
+typedef struct
+{
+    NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvS64           stride             NV_ALIGN_BYTES(8); // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_PREFETCH_STRIDE_PARAMS;
+
+//
+// UvmSetAccessPattern
+//
+// Describes how the kernels access the range, as the compiler derived it:
+// pattern is one of UVM_ACCESS_PATTERN_*, stride the bytes an access moves by
+// per iteration (also set by UVM_SET_PREFETCH_STRIDE), span the bytes one
+// iteration touches and flags a mask of UVM_ACCESS_PATTERN_FLAG_*.
+//
+// Sequential and strided ranges are prefetched a whole block at a time and
+// ahead of the fault stream, and access counters are ignored on them. Random
+// and pointer-chasing ranges are not prefetched and are mapped where they
+// reside on faults; access counters still migrate their hot pages.
+//
+// UVM_ACCESS_PATTERN_FLAG_PREDICT has the faults of the range migrate and
+// feed a Markov predictor of its block-to-block transitions, which prefetches
+// the blocks that usually follow the faulting one, see
+// uvm_perf_prefetch_markov. Its predictions and their hits are reported by
+// UVM_STOP_STAT_COLLECTION.
+//
+#define UVM_ACCESS_PATTERN_UNKNOWN          0
+#define UVM_ACCESS_PATTERN_SEQUENTIAL       1
+#define UVM_ACCESS_PATTERN_STRIDED          2
+#define UVM_ACCESS_PATTERN_RANDOM           3
+#define UVM_ACCESS_PATTERN_POINTER_CHASE    4
+#define UVM_ACCESS_PATTERN_COUNT            5
+
+#define UVM_ACCESS_PATTERN_FLAG_READ_ONLY    0x1
+#define UVM_ACCESS_PATTERN_FLAG_WRITE_MOSTLY 0x2
+#define UVM_ACCESS_PATTERN_FLAG_PREDICT      0x4
+#define UVM_ACCESS_PATTERN_FLAGS_ALL         (UVM_ACCESS_PATTERN_FLAG_READ_ONLY | UVM_ACCESS_PATTERN_FLAG_WRITE_MOSTLY | \
+                                              UVM_ACCESS_PATTERN_FLAG_PREDICT)
+
+#define UVM_SET_ACCESS_PATTERN                                        UVM_IOCTL_BASE(83)
+typedef struct
+{
+    NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvS64           stride             NV_ALIGN_BYTES(8); // IN
+    NvU64           span               NV_ALIGN_BYTES(8); // IN
+    NvU32           pattern;                              // IN
+    NvU32           flags;                                // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_ACCESS_PATTERN_PARAMS;
+
+//
+// UvmSetPolicyBatch
+//
+// Applies an array of per-range SUV policies under a single va_space lock.
+// Every entry sets one policy on [base, base + length):
+//   PRIORITIZED_LOCATION: location, value is the priority (see
+//                         UVM_SET_PRIORITIZED_LOCATION)
+//   QUICK_MIGRATE:        value is the quick_migrate flag
+//   NO_MIGRATE:           value is the ignore_ac_notification flag
+//   ACCESS_PATTERN:       value is the pattern, stride, span and flags as in
+//                         UVM_SET_ACCESS_PATTERN
+//   DISCARDABLE:          value is the discardable flag (see
+//                         UVM_SET_DISCARDABLE)
+//   ACCESS_COUNTERS:      value is the threshold and span the granularity (see
+//                         UVM_SET_ACCESS_COUNTER_POLICY)
+//   HOST_HUGE_PAGES:      value is the host_huge_pages flag (see
+//                         UVM_SET_HOST_HUGE_PAGES)
+//   LEASE:                value is the number of epochs, from the current one
+//                         (see UVM_SET_NEXT_USE), after which the prioritized
+//                         location and the no-migrate flag of the range are
+//                         dropped and its chunks go back to the LRU lists; 0
+//                         keeps them until they are changed
+//   HOST_NODE:            value is 1 + the NUMA node the CPU pages of the
+//                         range are allocated on from then on, 0 for the one
+//                         of the VA space (see UVM_SET_HOST_NUMA_NODE). Pages
+//                         already allocated stay where they are.
+// Entries are applied in order up to the first failure. applied is the number
+// of entries applied, and the rmStatus of every entry tried is written back.
+//
+#define UVM_POLICY_BATCH_PRIORITIZED_LOCATION 0
+#define UVM_POLICY_BATCH_QUICK_MIGRATE        1
+#define UVM_POLICY_BATCH_NO_MIGRATE           2
+#define UVM_POLICY_BATCH_ACCESS_PATTERN       3
+#define UVM_POLICY_BATCH_DISCARDABLE          4
+#define UVM_POLICY_BATCH_ACCESS_COUNTERS      5
+#define UVM_POLICY_BATCH_HOST_HUGE_PAGES      6
+#define UVM_POLICY_BATCH_LEASE                7
+#define UVM_POLICY_BATCH_HOST_NODE            8
+
+#define UVM_POLICY_BATCH_MAX_ENTRIES          4096
+
+typedef struct
+{
+    NvU64           base               NV_ALIGN_BYTES(8);
+    NvU64           length             NV_ALIGN_BYTES(8);
+    NvS64           stride             NV_ALIGN_BYTES(8);
+    NvU64           span               NV_ALIGN_BYTES(8);
+    NvProcessorUuid location;
+    NvU32           op;
+    NvU32           value;
+    NvU32           flags;
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_POLICY_BATCH_ENTRY;
+
+#define UVM_SET_POLICY_BATCH                                          UVM_IOCTL_BASE(84)
+typedef struct
+{
+    NvU64           entries            NV_ALIGN_BYTES(8); // IN/OUT, UVM_POLICY_BATCH_ENTRY array
+    NvU32           count;                                // IN
+    NvU32           applied;                              // OUT
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_POLICY_BATCH_PARAMS;
+
+//
+// UvmSetDiscardable
+//
+// Declares the contents of the range dead: evicting its pages from a GPU drops
+// them instead of copying them back to sysmem, and they read back stale data.
+// Pages that have no sysmem copy at all are still copied.
+//
+#define UVM_SET_DISCARDABLE                                           UVM_IOCTL_BASE(85)
+typedef struct
+{
+    NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvBool          discardable;                          // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_DISCARDABLE_PARAMS;
+
+//
+// UvmSetAccessCounterPolicy
+//
+// Per-range access counter migrations, on top of the GPU-wide configuration
+// of UVM_RECONFIGURE_ACCESS_COUNTERS. A VA block of the range migrates once
+// the notified accesses to it add up to threshold; 0 keeps the GPU threshold
+// and UVM_ACCESS_COUNTER_THRESHOLD_NEVER stops the range from migrating.
+// UVM_ACCESS_COUNTER_THRESHOLD_SAMPLE doesn't migrate the range either but
+// reports every notification in the event ring, for the runtime to sample
+// where the GPU accesses it. granularity, a power of two between 4K and
+// UVM_ACCESS_COUNTER_GRANULARITY_MAX, is the region around every notified
+// page that migrates with it; 0 migrates the notified pages only. A region
+// larger than a VA block migrates the blocks around the notified one with
+// it, so a range can migrate at 16M while the GPU tracks at 64K for others.
+//
+#define UVM_ACCESS_COUNTER_THRESHOLD_NEVER  0xffffffff
+#define UVM_ACCESS_COUNTER_THRESHOLD_SAMPLE 0xfffffffe
+#define UVM_ACCESS_COUNTER_GRANULARITY_MAX  (16 * 1024 * 1024ULL)
+
+#define UVM_SET_ACCESS_COUNTER_POLICY                                 UVM_IOCTL_BASE(86)
+typedef struct
+{
+    NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvU64           granularity        NV_ALIGN_BYTES(8); // IN
+    NvU32           threshold;                            // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_ACCESS_COUNTER_POLICY_PARAMS;
+
+//
+// UvmGetThrashingEvents
+//
+// Pops the thrashing reports queued since the previous call. The thrashing
+// detector queues one report per managed range, merging later ones into it,
+// and reports a VA block at most once per thrashing lapse. flags is a mask of
+// UVM_THRASHING_EVENT_FLAG_*: whether pages of the range were pinned or
+// processors throttled on them. Reports that don't fit in eventsBuffer stay
+// queued; dropped counts those lost since the previous call because the queue
+// was full.
+//
+#define UVM_THRASHING_EVENT_QUEUE_SIZE       64
+
+#define UVM_THRASHING_EVENT_FLAG_PINNED      0x1
+#define UVM_THRASHING_EVENT_FLAG_THROTTLED   0x2
+
+typedef struct
+{
+    NvU64           base                       NV_ALIGN_BYTES(8);
+    NvU64           length                     NV_ALIGN_BYTES(8);
+    NvU64           address                    NV_ALIGN_BYTES(8); // first VA block reported
+    NvU32           reports;
+    NvU32           flags;
+} UVM_THRASHING_EVENT;
+
+#define UVM_GET_THRASHING_EVENTS                                      UVM_IOCTL_BASE(87)
+typedef struct
+{
+    NvU64           eventsBuffer       NV_ALIGN_BYTES(8); // IN, UVM_THRASHING_EVENT array
+    NvU32           eventsCount;                          // IN capacity, OUT entries written
+    NvU32           dropped;                              // OUT
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_GET_THRASHING_EVENTS_PARAMS;
+
+//
+// UvmRegisterEventRing
+//
+// Registers a ring of ringSize bytes at ringBuffer, in ordinary (not UVM
+// managed) memory of the calling process, through which the driver notifies
+// the runtime of what it did: evictions of prioritized chunks, migrations
+// triggered by access counters and thrashing reports. The ring starts with a
+// UVM_EVENT_RING_HEADER followed by entries records, entries being a power
+// of 2. The driver writes records and advances put, user space consumes them
+// and advances get; neither side takes a lock. Records that find the ring full
+// are counted in dropped. The header also counts the GPU faults serviced
+// since the registration, for the runtime to tell how hard the kernels fault.
+// A ringBuffer of 0 unregisters the current ring, a new registration replaces
+// it.
+//
+#define UVM_EVENT_RING_TYPE_EVICTION                 1 // value: prioritized level
+#define UVM_EVENT_RING_TYPE_ACCESS_COUNTER_MIGRATION 2 // value: counter value
+#define UVM_EVENT_RING_TYPE_THRASHING                3 // value: UVM_THRASHING_EVENT_FLAG_*
+#define UVM_EVENT_RING_TYPE_ACCESS_COUNTER_SAMPLE    4 // value: counter value
+
+typedef struct
+{
+    NvU32           put;                                  // driver
+    NvU32           get;                                  // user space
+    NvU32           entries;                              // driver, at registration
+    NvU32           dropped;                              // driver
+    NvU64           faults             NV_ALIGN_BYTES(8); // driver, GPU faults serviced
+} UVM_EVENT_RING_HEADER;
+
+typedef struct
+{
+    NvU64           base                       NV_ALIGN_BYTES(8); // managed range
+    NvU64           address                    NV_ALIGN_BYTES(8);
+    NvU64           length                     NV_ALIGN_BYTES(8);
+    NvU64           value                      NV_ALIGN_BYTES(8);
+    NvU32           type;
+    NvU32           processor;                 // 0 for the CPU, the GPU id otherwise
+} UVM_EVENT_RING_RECORD;
+
+#define UVM_REGISTER_EVENT_RING                                       UVM_IOCTL_BASE(88)
+typedef struct
+{
+    NvU64           ringBuffer         NV_ALIGN_BYTES(8); // IN
+    NvU64           ringSize           NV_ALIGN_BYTES(8); // IN, bytes
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_REGISTER_EVENT_RING_PARAMS;
+
+//
+// UvmSetHostHugePages
+//
+// Backs the sysmem pages of the range with 2MB physically contiguous chunks,
+// which GPUs map remotely with 2MB PTEs once the whole VA block is resident
+// on the CPU. The chunks are allocated letting the kernel compact memory
+// rather than falling back to smaller ones at the first failure. Only
+// further CPU allocations are affected; pages already populated keep their
+// size.
+//
+#define UVM_SET_HOST_HUGE_PAGES                                       UVM_IOCTL_BASE(89)
+typedef struct
+{
+    NvU64           requestedBase      NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvBool          hostHugePages;                        // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_HOST_HUGE_PAGES_PARAMS;
+
+//
+// UvmGetResidency
+//
+// For each of rangesCount ranges, fills the range's bitmap with where its
+// pieces of granularity bytes (64K or 2M, counted from base) are resident:
+// processorCount rows of ceil(pieces / 64) NvU64 words, row 0 for the CPU and
+// row n for the GPU of id n, bit i of a row set if every page of piece i in
+// the range is resident on that processor. Pages not allocated yet are
+// resident nowhere. Takes the VA space lock in read mode only and the lock of
+// each VA block while it reads its residency, so the answer may be stale as
+// soon as it is returned.
+//
+#define UVM_RESIDENCY_MAX_RANGES                 4096
+#define UVM_RESIDENCY_MAX_PIECES                 (1 << 20)
+
+typedef struct
+{
+    NvU64           base                       NV_ALIGN_BYTES(8); // IN
+    NvU64           length                     NV_ALIGN_BYTES(8); // IN
+    NvU64           bitmap                     NV_ALIGN_BYTES(8); // IN, NvU64 array
+} UVM_RESIDENCY_RANGE;
+
+#define UVM_GET_RESIDENCY                                             UVM_IOCTL_BASE(90)
+typedef struct
+{
+    NvU64           rangesBuffer       NV_ALIGN_BYTES(8); // IN, UVM_RESIDENCY_RANGE array
+    NvU64           granularity        NV_ALIGN_BYTES(8); // IN
+    NvU32           rangesCount;                          // IN
+    NvU32           processorCount;                       // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_GET_RESIDENCY_PARAMS;
+
+//
+// UvmMigrateBatch
+//
+// Migrates count entries, each [base, base + length) of managed memory to
+// destinationUuid as UVM_MIGRATE would, under a single mmap_lock and VA space
+// lock and with a single tracker, so the copies of one entry are pushed
+// without waiting for those of the previous ones. Entries are migrated from
+// the highest priority down, in array order among equal priorities. A failed
+// entry doesn't stop the others; the rmStatus of every entry is written back
+// and rmStatus is the first failure in array order. flags are
+// UVM_MIGRATE_FLAG_ASYNC and UVM_MIGRATE_FLAG_SKIP_CPU_MAP; without
+// UVM_MIGRATE_FLAG_ASYNC the ioctl returns once every copy is done. Entries
+// of pageable memory are left alone with NV_WARN_NOTHING_TO_DO.
+//
+#define UVM_MIGRATE_BATCH_MAX_ENTRIES            4096
+#define UVM_MIGRATE_BATCH_FLAGS_ALL              (UVM_MIGRATE_FLAG_ASYNC | \
+                                                  UVM_MIGRATE_FLAG_SKIP_CPU_MAP)
+
+typedef struct
+{
+    NvU64           base               NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvProcessorUuid destinationUuid;                      // IN
+    NvU32           priority;                             // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_MIGRATE_BATCH_ENTRY;
+
+#define UVM_MIGRATE_BATCH                                             UVM_IOCTL_BASE(91)
+typedef struct
+{
+    NvU64           entries            NV_ALIGN_BYTES(8); // IN/OUT, UVM_MIGRATE_BATCH_ENTRY array
+    NvU32           count;                                // IN
+    NvU32           flags;                                // IN
+    NvU32           migrated;                             // OUT
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_MIGRATE_BATCH_PARAMS;
+
+//
+// UvmSetNextUse
+//
+// Next-use hints for eviction. epoch is the launch count of the runtime and
+// only goes forward; one behind the current epoch of the VA space leaves it
+// as it is. nextUse of an entry is the epoch at which [base, base + length)
+// of managed memory is needed next, 0 if unknown. Under LRU eviction, a GPU
+// that evicts a used root chunk picks the one needed furthest from the
+// current epoch among the uvm_pmm_next_use_window least recently used;
+// chunks without a hint or with a hint behind the epoch go first, in LRU
+// order. Prioritized chunks are still evicted last. count may be 0 to only
+// advance the epoch. Entries of pageable memory are ignored.
+//
+#define UVM_NEXT_USE_MAX_ENTRIES                 4096
+
+typedef struct
+{
+    NvU64           base               NV_ALIGN_BYTES(8); // IN
+    NvU64           length             NV_ALIGN_BYTES(8); // IN
+    NvU64           nextUse            NV_ALIGN_BYTES(8); // IN
+} UVM_NEXT_USE_ENTRY;
+
+#define UVM_SET_NEXT_USE                                              UVM_IOCTL_BASE(92)
+typedef struct
+{
+    NvU64           entries            NV_ALIGN_BYTES(8); // IN, UVM_NEXT_USE_ENTRY array
+    NvU64           epoch              NV_ALIGN_BYTES(8); // IN
+    NvU32           count;                                // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_NEXT_USE_PARAMS;
+
+//
+// UvmSetFaultReplayHint
+//
+// Access pattern of the kernels the VA space runs next, for the replay policy
+// and the batch size its replayable faults are serviced with when
+// uvm_perf_fault_replay_adaptive is set. UVM_FAULT_REPLAY_HINT_STREAMING gets
+// full batches replayed per VA block, UVM_FAULT_REPLAY_HINT_IRREGULAR small
+// batches replayed as a whole; UVM_FAULT_REPLAY_HINT_NONE leaves the choice to
+// the duplicate ratios and the service times the driver measures. The hint
+// stays until it is set again.
+//
+#define UVM_FAULT_REPLAY_HINT_NONE               0
+#define UVM_FAULT_REPLAY_HINT_STREAMING          1
+#define UVM_FAULT_REPLAY_HINT_IRREGULAR          2
+
+#define UVM_SET_FAULT_REPLAY_HINT                                     UVM_IOCTL_BASE(93)
+typedef struct
+{
+    NvU32           hint;                                 // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_FAULT_REPLAY_HINT_PARAMS;
+
+//
+// UvmSetHostNumaNode
+//
+// NUMA node the CPU pages of the VA space are allocated on from now on:
+// those the CPU faults in, those pinned on the host and those GPU eviction
+// copies back. UVM_HOST_NUMA_NODE_GPU takes the node closest to the PCIe
+// root complex of the first registered GPU that has one,
+// UVM_HOST_NUMA_NODE_LOCAL leaves the choice to the kernel, which allocates
+// on the node of the thread that triggers the allocation; any other value
+// is an online node. The kernel falls back to other nodes when the one
+// chosen is full. The default is uvm_perf_host_numa_node.
+//
+#define UVM_HOST_NUMA_NODE_GPU                   (-2)
+#define UVM_HOST_NUMA_NODE_LOCAL                 (-1)
+
+#define UVM_SET_HOST_NUMA_NODE                                        UVM_IOCTL_BASE(94)
+typedef struct
+{
+    NvS32           node;                                 // IN
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_SET_HOST_NUMA_NODE_PARAMS;
+
+//
+// UvmRegisterSubmitRing
+//
+// Registers a ring of ringSize bytes at ringBuffer, page aligned ordinary
+// (not UVM managed) memory of the calling process, through which user space
+// posts policy and migrate commands without a system call each. The ring
+// starts with a UVM_SUBMIT_RING_HEADER followed by entries commands and then
+// entries completions, entries being a power of 2. User space writes commands
+// and advances sqPut; a driver worker applies them in order, a policy command
+// as an entry of UVM_SET_POLICY_BATCH and a migrate command as one of
+// UVM_MIGRATE_BATCH with the command's flags, advances sqGet and writes a
+// completion with the userData and the status of each command at cqPut. User
+// space consumes completions and advances cqGet; the worker only takes a
+// command once there is room for its completion. Commands that fail don't
+// stop the ones after them. When it runs out of commands or of completion
+// room the worker sets UVM_SUBMIT_RING_FLAG_NEED_WAKEUP in flags and stops,
+// and user space has to call UVM_KICK_SUBMIT_RING after advancing sqPut or
+// cqGet to start it again. The worker isn't the calling thread, so the VA
+// space needs its mm registered (UVM_MM_INITIALIZE); NV_ERR_NOT_SUPPORTED
+// otherwise. A ringBuffer of 0 unregisters the current ring once the worker
+// is done with it, a new registration replaces it.
+//
+#define UVM_SUBMIT_RING_OP_POLICY                0 // policy: a UVM_POLICY_BATCH_ENTRY
+#define UVM_SUBMIT_RING_OP_MIGRATE               1 // migrate: a UVM_MIGRATE_BATCH_ENTRY
+
+#define UVM_SUBMIT_RING_FLAG_NEED_WAKEUP         0x1
+
+typedef struct
+{
+    NvU32           sqPut;                                // user space
+    NvU32           sqGet;                                // driver
+    NvU32           cqPut;                                // driver
+    NvU32           cqGet;                                // user space
+    NvU32           entries;                              // driver, at registration
+    NvU32           flags;                                // driver, UVM_SUBMIT_RING_FLAG_*
+} UVM_SUBMIT_RING_HEADER;
+
+typedef struct
+{
+    NvU64                   userData   NV_ALIGN_BYTES(8); // returned in the completion
+    NvU32                   op;                           // UVM_SUBMIT_RING_OP_*
+    NvU32                   flags;                        // migrate: UVM_MIGRATE_BATCH_FLAGS_ALL
+    UVM_POLICY_BATCH_ENTRY  policy;                       // rmStatus unused
+    UVM_MIGRATE_BATCH_ENTRY migrate;                      // rmStatus unused
+} UVM_SUBMIT_RING_COMMAND;
+
+typedef struct
+{
+    NvU64           userData           NV_ALIGN_BYTES(8);
+    NV_STATUS       rmStatus;
+    NvU32           reserved;
+} UVM_SUBMIT_RING_COMPLETION;
+
+#define UVM_REGISTER_SUBMIT_RING                                      UVM_IOCTL_BASE(95)
+typedef struct
+{
+    NvU64           ringBuffer         NV_ALIGN_BYTES(8); // IN
+    NvU64           ringSize           NV_ALIGN_BYTES(8); // IN, bytes
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_REGISTER_SUBMIT_RING_PARAMS;
+
+//
+// UvmKickSubmitRing
+//
+// Starts the worker of the registered submit ring, for user space to call
+// when it finds UVM_SUBMIT_RING_FLAG_NEED_WAKEUP set after posting commands
+// or consuming completions. A no-op if the worker is already running.
+//
+#define UVM_KICK_SUBMIT_RING                                          UVM_IOCTL_BASE(96)
+typedef struct
+{
+    NV_STATUS       rmStatus;                             // OUT
+} UVM_KICK_SUBMIT_RING_PARAMS;
+
 //
 // Temporary ioctls which should be removed before UVM 8 release
 // Number backwards from 2047 - highest custom ioctl function number
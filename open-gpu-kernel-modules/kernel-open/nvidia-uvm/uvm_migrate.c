@@ -41,6 +41,8 @@
 #include "uvm_va_space_mm.h"
 #include "nv_speculation_barrier.h"
 
+#include <linux/sort.h>
+
 typedef enum
 {
     UVM_MIGRATE_PASS_FIRST,
@@ -69,6 +71,22 @@ static bool is_migration_single_block(uvm_va_range_t *first_va_range, NvU64 base
     return uvm_va_range_block_index(first_va_range, base) == uvm_va_range_block_index(first_va_range, end);
 }
 
+// Ranges SUV migrates in bulk, and those it prioritizes on the destination,
+// are mapped eagerly when they move to a GPU: the mappings are added in the
+// same call as the copy, on the destination and on the GPUs that had the
+// block mapped before, instead of by the faults that would follow.
+static bool block_migrate_is_eager(uvm_va_block_t *va_block, uvm_processor_id_t dest_id)
+{
+    uvm_va_policy_t *policy = uvm_va_range_get_policy(va_block->va_range);
+
+    if (!UVM_ID_IS_GPU(dest_id))
+        return false;
+
+    return policy->quick_migrate ||
+           (uvm_id_equal(policy->prioritized_location, dest_id) &&
+            !uvm_va_range_prioritized_demoted(va_block->va_range));
+}
+
 static NV_STATUS block_migrate_map_mapped_pages(uvm_va_block_t *va_block,
                                                 uvm_va_block_retry_t *va_block_retry,
                                                 uvm_va_block_context_t *va_block_context,
@@ -122,10 +140,13 @@ static NV_STATUS block_migrate_map_unmapped_pages(uvm_va_block_t *va_block,
                                                   uvm_va_block_retry_t *va_block_retry,
                                                   uvm_va_block_context_t *va_block_context,
                                                   uvm_va_block_region_t region,
-                                                  uvm_processor_id_t dest_id)
+                                                  uvm_processor_id_t dest_id,
+                                                  const uvm_processor_mask_t *accessing_gpus)
 
 {
     uvm_tracker_t local_tracker = UVM_TRACKER_INIT();
+    uvm_page_mask_t *clean_pages = &va_block_context->mask_by_prot[UVM_PROT_READ_ONLY - 1].page_mask;
+    bool has_clean_pages;
     NV_STATUS status = NV_OK;
     NV_STATUS tracker_status;
 
@@ -133,6 +154,15 @@ static NV_STATUS block_migrate_map_unmapped_pages(uvm_va_block_t *va_block,
     // first map operation
     uvm_page_mask_complement(&va_block_context->caller_page_mask, &va_block->maybe_mapped_pages);
 
+    // Pages just copied from sysmem are mapped read-only, so that they stay
+    // clean until written
+    has_clean_pages = uvm_va_block_gpu_clean_pages(va_block,
+                                                   dest_id,
+                                                   &va_block_context->caller_page_mask,
+                                                   clean_pages);
+    if (has_clean_pages)
+        uvm_page_mask_andnot(&va_block_context->caller_page_mask, &va_block_context->caller_page_mask, clean_pages);
+
     // Only map those pages that are not mapped anywhere else (likely due
     // to a first touch or a migration). We pass
     // UvmEventMapRemoteCauseInvalid since the destination processor of a
@@ -148,7 +178,8 @@ static NV_STATUS block_migrate_map_unmapped_pages(uvm_va_block_t *va_block,
     if (status != NV_OK)
         goto out;
 
-    // Add mappings for AccessedBy processors
+    // Add mappings for AccessedBy processors, and for the GPUs that accessed
+    // the pages of eagerly mapped ranges before they moved
     //
     // No mappings within this call will operate on dest_id, so we don't
     // need to acquire the map operation above.
@@ -159,7 +190,29 @@ static NV_STATUS block_migrate_map_unmapped_pages(uvm_va_block_t *va_block,
                                                        region,
                                                        &va_block_context->caller_page_mask,
                                                        UVM_PROT_READ_WRITE_ATOMIC,
-                                                       NULL);
+                                                       accessing_gpus);
+    if (status != NV_OK || !has_clean_pages)
+        goto out;
+
+    status = uvm_va_block_map(va_block,
+                              va_block_context,
+                              dest_id,
+                              region,
+                              clean_pages,
+                              UVM_PROT_READ_ONLY,
+                              UvmEventMapRemoteCauseInvalid,
+                              &local_tracker);
+    if (status != NV_OK)
+        goto out;
+
+    status = uvm_va_block_add_mappings_after_migration(va_block,
+                                                       va_block_context,
+                                                       dest_id,
+                                                       dest_id,
+                                                       region,
+                                                       clean_pages,
+                                                       UVM_PROT_READ_ONLY,
+                                                       accessing_gpus);
 
 out:
     tracker_status = uvm_tracker_add_tracker_safe(&va_block->tracker, &local_tracker);
@@ -174,7 +227,8 @@ static NV_STATUS block_migrate_add_mappings(uvm_va_block_t *va_block,
                                             uvm_va_block_retry_t *va_block_retry,
                                             uvm_va_block_context_t *va_block_context,
                                             uvm_va_block_region_t region,
-                                            uvm_processor_id_t dest_id)
+                                            uvm_processor_id_t dest_id,
+                                            const uvm_processor_mask_t *accessing_gpus)
 
 {
     NV_STATUS status;
@@ -183,7 +237,8 @@ static NV_STATUS block_migrate_add_mappings(uvm_va_block_t *va_block,
                                               va_block_retry,
                                               va_block_context,
                                               region,
-                                              dest_id);
+                                              dest_id,
+                                              accessing_gpus);
     if (status != NV_OK)
         return status;
 
@@ -204,11 +259,21 @@ NV_STATUS uvm_va_block_migrate_locked(uvm_va_block_t *va_block,
 {
     uvm_va_space_t *va_space = uvm_va_block_get_va_space(va_block);
     NV_STATUS status, tracker_status = NV_OK;
+    uvm_processor_mask_t accessing_gpus;
+    bool eager;
 
     uvm_assert_mutex_locked(&va_block->lock);
 
     va_block_context->policy = uvm_va_range_get_policy(va_block->va_range);
 
+    // The GPUs mapping the block lose their mappings to the pages that move
+    eager = mode == UVM_MIGRATE_MODE_MAKE_RESIDENT_AND_MAP && block_migrate_is_eager(va_block, dest_id);
+    if (eager) {
+        uvm_processor_mask_copy(&accessing_gpus, &va_block->mapped);
+        uvm_processor_mask_clear(&accessing_gpus, UVM_ID_CPU);
+        uvm_processor_mask_clear(&accessing_gpus, dest_id);
+    }
+
     if (uvm_va_policy_is_read_duplicate(va_block_context->policy, va_space)) {
         status = uvm_va_block_make_resident_read_duplicate(va_block,
                                                            va_block_retry,
@@ -233,7 +298,12 @@ NV_STATUS uvm_va_block_migrate_locked(uvm_va_block_t *va_block,
     if (status == NV_OK && mode == UVM_MIGRATE_MODE_MAKE_RESIDENT_AND_MAP) {
         // block_migrate_add_mappings will acquire the work from the above
         // make_resident call and update the VA block tracker.
-        status = block_migrate_add_mappings(va_block, va_block_retry, va_block_context, region, dest_id);
+        status = block_migrate_add_mappings(va_block,
+                                            va_block_retry,
+                                            va_block_context,
+                                            region,
+                                            dest_id,
+                                            eager ? &accessing_gpus : NULL);
     }
 
     if (out_tracker)
@@ -409,6 +479,21 @@ static void preunmap_multi_block(uvm_va_range_t *va_range,
         unmap_mapping_range(&va_range->va_space->mapping, start, end - start + 1, 1);
 }
 
+// Eagerly mapped ranges move to a GPU a whole 2MB block at a time, even when
+// the request covers part of it. The block is then backed by one root chunk,
+// copied in one push and mapped with a single 2MB PTE rather than split into
+// 64K and 4K ones around the requested part.
+static uvm_va_block_region_t block_migrate_region(uvm_va_block_t *va_block,
+                                                  NvU64 start,
+                                                  NvU64 end,
+                                                  uvm_processor_id_t dest_id)
+{
+    if (block_migrate_is_eager(va_block, dest_id) && uvm_va_block_size(va_block) == UVM_PAGE_SIZE_2M)
+        return uvm_va_block_region_from_block(va_block);
+
+    return uvm_va_block_region_from_start_end(va_block, max(start, va_block->start), min(end, va_block->end));
+}
+
 static NV_STATUS uvm_va_range_migrate_multi_block(uvm_va_range_t *va_range,
                                                   uvm_va_block_context_t *va_block_context,
                                                   NvU64 start,
@@ -438,9 +523,7 @@ static NV_STATUS uvm_va_range_migrate_multi_block(uvm_va_range_t *va_range,
         if (status != NV_OK)
             return status;
 
-        region = uvm_va_block_region_from_start_end(va_block,
-                                                    max(start, va_block->start),
-                                                    min(end, va_block->end));
+        region = block_migrate_region(va_block, start, end, dest_id);
 
         status = UVM_VA_BLOCK_LOCK_RETRY(va_block, &va_block_retry,
                                          uvm_va_block_migrate_locked(va_block,
@@ -987,6 +1070,158 @@ done:
     return status;
 }
 
+typedef struct
+{
+    NvU32 priority;
+    NvU32 index;
+} migrate_batch_order_t;
+
+// Highest priority first, array order among equal priorities
+static int migrate_batch_order_cmp(const void *_a, const void *_b)
+{
+    const migrate_batch_order_t *a = _a;
+    const migrate_batch_order_t *b = _b;
+
+    if (a->priority != b->priority)
+        return a->priority > b->priority ? -1 : 1;
+
+    return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+NV_STATUS uvm_migrate_batch_entry(uvm_va_space_t *va_space,
+                                  struct mm_struct *mm,
+                                  const UVM_MIGRATE_BATCH_ENTRY *entry,
+                                  NvU32 flags,
+                                  uvm_tracker_t *tracker)
+{
+    uvm_gpu_t *dest_gpu = NULL;
+    NV_STATUS status;
+
+    if (uvm_api_range_invalid(entry->base, entry->length))
+        return NV_ERR_INVALID_ADDRESS;
+
+    if (!uvm_uuid_is_cpu(&entry->destinationUuid)) {
+        dest_gpu = uvm_va_space_get_gpu_by_uuid_with_gpu_va_space(va_space, &entry->destinationUuid);
+        if (!dest_gpu)
+            return NV_ERR_INVALID_DEVICE;
+
+        if (!uvm_gpu_can_address(dest_gpu, entry->base, entry->length))
+            return NV_ERR_OUT_OF_RANGE;
+    }
+
+    status = uvm_api_range_type_check(va_space, mm, entry->base, entry->length);
+    if (status != NV_OK)
+        return status;
+
+    status = uvm_migrate(va_space,
+                         mm,
+                         entry->base,
+                         entry->length,
+                         (dest_gpu ? dest_gpu->id : UVM_ID_CPU),
+                         flags,
+                         tracker);
+
+    // Non-migratable pages are left where they are, as UVM_MIGRATE would
+    if (status == NV_WARN_MORE_PROCESSING_REQUIRED)
+        status = NV_OK;
+
+    return status;
+}
+
+NV_STATUS uvm_api_migrate_batch(UVM_MIGRATE_BATCH_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    UVM_MIGRATE_BATCH_ENTRY *entries;
+    migrate_batch_order_t *order;
+    struct mm_struct *mm;
+    NV_STATUS status = NV_OK;
+    NV_STATUS tracker_status;
+    const bool synchronous = !(params->flags & UVM_MIGRATE_FLAG_ASYNC);
+    NvU32 i;
+
+    params->migrated = 0;
+
+    if (params->count == 0)
+        return NV_OK;
+
+    if (params->count > UVM_MIGRATE_BATCH_MAX_ENTRIES)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    if (params->flags & ~UVM_MIGRATE_BATCH_FLAGS_ALL)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // Entries are staged in kernel memory so that the user copies don't happen
+    // with the va_space lock held.
+    entries = uvm_kvmalloc(params->count * sizeof(*entries));
+    order = uvm_kvmalloc(params->count * sizeof(*order));
+    if (!entries || !order) {
+        uvm_kvfree(entries);
+        uvm_kvfree(order);
+        return NV_ERR_NO_MEMORY;
+    }
+
+    if (nv_copy_from_user(entries, (void __user *)params->entries, params->count * sizeof(*entries))) {
+        status = NV_ERR_INVALID_ADDRESS;
+        goto out;
+    }
+
+    for (i = 0; i < params->count; i++) {
+        order[i].priority = entries[i].priority;
+        order[i].index = i;
+    }
+    sort(order, params->count, sizeof(*order), migrate_batch_order_cmp, NULL);
+
+    // mmap_lock will be needed if we have to create CPU mappings
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_read(va_space);
+
+    // Every entry pushes its copies into the shared tracker, so copy engines
+    // work on the earlier entries while the later ones are being set up.
+    for (i = 0; i < params->count; i++) {
+        UVM_MIGRATE_BATCH_ENTRY *entry = &entries[order[i].index];
+
+        entry->rmStatus = uvm_migrate_batch_entry(va_space, mm, entry, params->flags, &tracker);
+        if (entry->rmStatus == NV_OK)
+            params->migrated++;
+    }
+
+    // We only need to hold mmap_lock to create new CPU mappings, so drop it
+    // before waiting for the tracker.
+    if (mm)
+        uvm_up_read_mmap_lock_out_of_order(mm);
+
+    // The VA space lock must be held to prevent GPUs from being unregistered
+    // while we wait.
+    tracker_status = synchronous ? uvm_tracker_wait(&tracker) : NV_OK;
+    uvm_tracker_deinit(&tracker);
+
+    uvm_va_space_up_read(va_space);
+    uvm_va_space_mm_or_current_release(va_space, mm);
+
+    if (synchronous)
+        uvm_tools_flush_events();
+
+    for (i = 0; i < params->count; i++) {
+        if (entries[i].rmStatus != NV_OK && entries[i].rmStatus != NV_WARN_NOTHING_TO_DO) {
+            status = entries[i].rmStatus;
+            break;
+        }
+    }
+
+    if (status == NV_OK)
+        status = tracker_status;
+
+    if (nv_copy_to_user((void __user *)params->entries, entries, params->count * sizeof(*entries)) && status == NV_OK)
+        status = NV_ERR_INVALID_ADDRESS;
+
+out:
+    uvm_kvfree(entries);
+    uvm_kvfree(order);
+
+    return status;
+}
+
 NV_STATUS uvm_api_migrate_range_group(UVM_MIGRATE_RANGE_GROUP_PARAMS *params, struct file *filp)
 {
     NV_STATUS status = NV_OK;
@@ -55,14 +55,74 @@ static unsigned uvm_perf_prefetch_threshold  = UVM_PREFETCH_THRESHOLD_DEFAULT;
 // logic
 static unsigned uvm_perf_prefetch_min_faults = UVM_PREFETCH_MIN_FAULTS_DEFAULT;
 
+#define UVM_PREFETCH_STRIDE_DISABLED 0
+#define UVM_PREFETCH_STRIDE_SEEDED   1
+#define UVM_PREFETCH_STRIDE_ALL      2
+
+// Cross-block stride prefetching: 0 disables it, 1 enables it on the ranges
+// with a stride set through UVM_SET_PREFETCH_STRIDE or UVM_SET_ACCESS_PATTERN
+// and on sequential ones, 2 on every managed range but the random ones
+static unsigned uvm_perf_prefetch_stride = UVM_PREFETCH_STRIDE_SEEDED;
+
+#define UVM_PREFETCH_STRIDE_DEPTH_DEFAULT 2
+#define UVM_PREFETCH_STRIDE_DEPTH_MAX     32
+
+// Number of blocks prefetched ahead of the faulting block
+static unsigned uvm_perf_prefetch_stride_depth = UVM_PREFETCH_STRIDE_DEPTH_DEFAULT;
+
+#define UVM_PREFETCH_STRIDE_CONFIDENCE_DEFAULT 2
+#define UVM_PREFETCH_STRIDE_CONFIDENCE_MAX     16
+
+// Number of consecutive faults with the same block delta before it is
+// trusted. A stride set through UVM_SET_PREFETCH_STRIDE is trusted right away.
+static unsigned uvm_perf_prefetch_stride_confidence = UVM_PREFETCH_STRIDE_CONFIDENCE_DEFAULT;
+
+#define UVM_PREFETCH_MARKOV_DISABLED 0
+#define UVM_PREFETCH_MARKOV_FLAGGED  1
+#define UVM_PREFETCH_MARKOV_ALL      2
+
+// Cross-block Markov prefetching: 0 disables it, 1 enables it on the ranges
+// with UVM_ACCESS_PATTERN_FLAG_PREDICT, 2 on every managed range that isn't
+// streamed or mapped remotely
+static unsigned uvm_perf_prefetch_markov = UVM_PREFETCH_MARKOV_FLAGGED;
+
+#define UVM_PREFETCH_MARKOV_CONFIDENCE_DEFAULT 2
+#define UVM_PREFETCH_MARKOV_CONFIDENCE_MAX     15
+
+// Number of times a block must have followed another before it is prefetched
+// on a fault of the other
+static unsigned uvm_perf_prefetch_markov_confidence = UVM_PREFETCH_MARKOV_CONFIDENCE_DEFAULT;
+
+#define UVM_PREFETCH_QUICK_MIGRATE_EVICT_MS_DEFAULT 100
+
+// Quick migration to a GPU without the free memory for the whole prefetch
+// region: with 0 it fills the region regardless, evicting what it takes;
+// otherwise it moves as much of the region around the fault as fits, or leaves
+// it to the regular prefetch if less than a big page fits or pages of the range
+// were evicted in the last given milliseconds, as filling the region would
+// evict the range's own pages
+static unsigned uvm_perf_prefetch_quick_migrate_evict_ms = UVM_PREFETCH_QUICK_MIGRATE_EVICT_MS_DEFAULT;
+
 // Module parameters for the tunables
 module_param(uvm_perf_prefetch_enable, uint, S_IRUGO);
 module_param(uvm_perf_prefetch_threshold, uint, S_IRUGO);
 module_param(uvm_perf_prefetch_min_faults, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_stride, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_stride_depth, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_stride_confidence, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_markov, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_markov_confidence, uint, S_IRUGO);
+module_param(uvm_perf_prefetch_quick_migrate_evict_ms, uint, S_IRUGO);
 
 static bool g_uvm_perf_prefetch_enable;
 static unsigned g_uvm_perf_prefetch_threshold;
 static unsigned g_uvm_perf_prefetch_min_faults;
+static unsigned g_uvm_perf_prefetch_stride;
+static unsigned g_uvm_perf_prefetch_stride_depth;
+static unsigned g_uvm_perf_prefetch_stride_confidence;
+static unsigned g_uvm_perf_prefetch_markov;
+static unsigned g_uvm_perf_prefetch_markov_confidence;
+static unsigned g_uvm_perf_prefetch_quick_migrate_evict_ms;
 
 void uvm_perf_prefetch_bitmap_tree_iter_init(const uvm_perf_prefetch_bitmap_tree_t *bitmap_tree,
                                              uvm_page_index_t page_index,
@@ -219,6 +279,65 @@ static void grow_fault_granularity(uvm_perf_prefetch_bitmap_tree_t *bitmap_tree,
     }
 }
 
+// Part of max_prefetch_region that quick migration fills for new_residency:
+// all of it if the free memory of the GPU holds the pages not resident there
+// yet, the big-page aligned window around the faulted region that the free
+// memory holds otherwise, or an empty region to leave the block to the regular
+// prefetch. See uvm_perf_prefetch_quick_migrate_evict_ms.
+static uvm_va_block_region_t quick_migrate_region(uvm_va_block_t *va_block,
+                                                  uvm_processor_id_t new_residency,
+                                                  uvm_va_block_region_t max_prefetch_region,
+                                                  uvm_va_block_region_t faulted_region,
+                                                  const uvm_page_mask_t *resident_mask)
+{
+    uvm_va_space_t *va_space = uvm_va_block_get_va_space(va_block);
+    const NvU32 pages_per_chunk = UVM_PAGE_SIZE_64K / PAGE_SIZE;
+    uvm_gpu_t *gpu;
+    NvU64 needed_bytes;
+    NvU64 free_bytes;
+    NvU64 last_eviction_ns;
+    NvU64 free_pages;
+    uvm_page_index_t first;
+    uvm_page_index_t outer;
+
+    if (g_uvm_perf_prefetch_quick_migrate_evict_ms == 0 ||
+        !UVM_ID_IS_GPU(new_residency) ||
+        uvm_va_block_is_hmm(va_block))
+        return max_prefetch_region;
+
+    gpu = uvm_va_space_get_gpu(va_space, new_residency);
+    if (!gpu->pmm.pma_stats || !uvm_gpu_supports_eviction(gpu))
+        return max_prefetch_region;
+
+    needed_bytes = uvm_va_block_region_num_pages(max_prefetch_region);
+    if (resident_mask)
+        needed_bytes -= uvm_page_mask_region_weight(resident_mask, max_prefetch_region);
+    needed_bytes *= PAGE_SIZE;
+
+    free_bytes = UVM_READ_ONCE(gpu->pmm.pma_stats->numFreePages64k) * UVM_PAGE_SIZE_64K;
+    if (needed_bytes <= free_bytes)
+        return max_prefetch_region;
+
+    // Filling the region would evict; once it has evicted pages of this very
+    // range, more of the same only thrashes
+    last_eviction_ns = UVM_READ_ONCE(va_block->va_range->managed.last_eviction_ns);
+    if (last_eviction_ns != 0 &&
+        NV_GETTIME() - last_eviction_ns < (NvU64)g_uvm_perf_prefetch_quick_migrate_evict_ms * 1000 * 1000)
+        return uvm_va_block_region(0, 0);
+
+    free_pages = UVM_ALIGN_DOWN(free_bytes / PAGE_SIZE, pages_per_chunk);
+    if (free_pages == 0)
+        return uvm_va_block_region(0, 0);
+
+    // Window from the chunk of the fault, moved back if it hits the end
+    first = max_t(NvU64, UVM_ALIGN_DOWN(faulted_region.first, pages_per_chunk), max_prefetch_region.first);
+    outer = min_t(NvU64, first + free_pages, max_prefetch_region.outer);
+    if (outer - first < free_pages)
+        first = outer - min_t(NvU64, free_pages, outer - max_prefetch_region.first);
+
+    return uvm_va_block_region(first, outer);
+}
+
 // Within a block we only allow prefetching to a single processor. Therefore,
 // if two processors are accessing non-overlapping regions within the same
 // block they won't benefit from prefetching.
@@ -270,13 +389,27 @@ static NvU32 uvm_perf_prefetch_prenotify_fault_migrations(uvm_va_block_t *va_blo
         goto done;
     }
 
-    // If quick migrate is set, migrate everything
-    if (policy->quick_migrate == true) {
-        /* pr_alert("quickmig\n"); */
+    // If quick migrate is set or the range is streamed, migrate everything
+    // that the destination has the memory for
+    if (uvm_va_policy_is_streaming(policy)) {
         uvm_page_mask_region_fill(prefetch_pages, max_prefetch_region);
         goto done;
     }
 
+    if (policy->quick_migrate == true) {
+        uvm_va_block_region_t quick_region = quick_migrate_region(va_block,
+                                                                  new_residency,
+                                                                  max_prefetch_region,
+                                                                  faulted_region,
+                                                                  resident_mask);
+
+        /* pr_alert("quickmig\n"); */
+        if (uvm_va_block_region_num_pages(quick_region) > 0) {
+            uvm_page_mask_region_fill(prefetch_pages, quick_region);
+            goto done;
+        }
+    }
+
     if (resident_mask)
         uvm_page_mask_or(&bitmap_tree->pages, resident_mask, faulted_pages);
     else
@@ -398,6 +531,10 @@ void uvm_perf_prefetch_get_hint(uvm_va_block_t *va_block,
     if (!va_space->test.page_prefetch_enabled)
         return;
 
+    // Neighbours of a scattered access are not going to be used
+    if (uvm_va_policy_maps_remotely(policy))
+        return;
+
     pending_prefetch_pages = uvm_perf_prefetch_prenotify_fault_migrations(va_block,
                                                                           va_block_context,
                                                                           new_residency,
@@ -406,7 +543,9 @@ void uvm_perf_prefetch_get_hint(uvm_va_block_t *va_block,
                                                                           prefetch_pages,
                                                                           bitmap_tree);
 
-    if (va_block->prefetch_info.fault_migrations_to_last_proc >= g_uvm_perf_prefetch_min_faults &&
+    // Bulk-migrated ranges move the whole block from the first fault on
+    if ((policy->quick_migrate ||
+         va_block->prefetch_info.fault_migrations_to_last_proc >= g_uvm_perf_prefetch_min_faults) &&
         pending_prefetch_pages > 0) {
         bool changed = false;
         uvm_range_group_range_t *rgr;
@@ -434,6 +573,360 @@ void uvm_perf_prefetch_get_hint(uvm_va_block_t *va_block,
 
 }
 
+void uvm_perf_prefetch_stride_init(uvm_perf_prefetch_stride_t *stride)
+{
+    uvm_spin_lock_init(&stride->lock, UVM_LOCK_ORDER_LEAF);
+    stride->last_block = -1;
+    stride->delta = 0;
+    stride->confidence = 0;
+    stride->prefetched_until = -1;
+}
+
+// Block delta of a stride set through UVM_SET_PREFETCH_STRIDE. Strides below
+// a block still move on to the next block, in their direction.
+static NvS64 stride_seed_blocks(NvS64 stride)
+{
+    NvS64 blocks;
+
+    if (stride == 0)
+        return 0;
+
+    blocks = stride / (NvS64)UVM_VA_BLOCK_SIZE;
+    if (blocks == 0)
+        blocks = stride > 0 ? 1 : -1;
+
+    return blocks;
+}
+
+// Updates the predictor with a fault on block and returns the number of blocks,
+// out of the depth next ones, to prefetch along *out_delta, starting at the
+// *out_first-th one after block
+static NvU32 stride_update(uvm_perf_prefetch_stride_t *stride,
+                           NvS64 block,
+                           NvS64 seed,
+                           NvU32 depth,
+                           size_t num_blocks,
+                           NvS64 *out_delta,
+                           NvU32 *out_first)
+{
+    NvU32 first = 0;
+    NvU32 count = 0;
+    NvU32 k;
+
+    uvm_spin_lock(&stride->lock);
+
+    if (stride->last_block < 0) {
+        if (seed != 0) {
+            stride->delta = seed;
+            stride->confidence = g_uvm_perf_prefetch_stride_confidence;
+        }
+    }
+    else if (block != stride->last_block) {
+        NvS64 delta = block - stride->last_block;
+
+        if (delta == stride->delta) {
+            if (stride->confidence < g_uvm_perf_prefetch_stride_confidence)
+                ++stride->confidence;
+        }
+        else {
+            stride->delta = delta;
+            stride->confidence = delta == seed ? g_uvm_perf_prefetch_stride_confidence : 1;
+            stride->prefetched_until = -1;
+        }
+    }
+    else {
+        // More faults on the same block say nothing about the stride
+        goto done;
+    }
+
+    stride->last_block = block;
+
+    if (stride->delta == 0 || stride->confidence < g_uvm_perf_prefetch_stride_confidence)
+        goto done;
+
+    for (k = 1; k <= depth; k++) {
+        NvS64 target = block + k * stride->delta;
+
+        if (target < 0 || target >= (NvS64)num_blocks)
+            break;
+
+        // Skip the blocks already prefetched by a previous fault
+        if (stride->prefetched_until >= 0 &&
+            (stride->delta > 0 ? target <= stride->prefetched_until : target >= stride->prefetched_until))
+            continue;
+
+        if (count == 0)
+            first = k;
+        ++count;
+        stride->prefetched_until = target;
+    }
+
+done:
+    *out_delta = stride->delta;
+    *out_first = first;
+    uvm_spin_unlock(&stride->lock);
+
+    return count;
+}
+
+// Migrates and maps block index of va_range on dest_id. The copies are
+// tracked by the block; the faulting warps don't wait for them.
+static NV_STATUS prefetch_block(uvm_va_range_t *va_range,
+                                NvS64 index,
+                                uvm_va_block_context_t *va_block_context,
+                                uvm_processor_id_t dest_id)
+{
+    uvm_va_block_retry_t va_block_retry;
+    uvm_va_block_t *target_block;
+    NV_STATUS status;
+
+    status = uvm_va_range_block_create(va_range, index, &target_block);
+    if (status != NV_OK)
+        return status;
+
+    if (!uvm_range_group_all_migratable(va_range->va_space, target_block->start, target_block->end))
+        return NV_OK;
+
+    return UVM_VA_BLOCK_LOCK_RETRY(target_block, &va_block_retry,
+                                   uvm_va_block_migrate_locked(target_block,
+                                                               &va_block_retry,
+                                                               va_block_context,
+                                                               uvm_va_block_region_from_block(target_block),
+                                                               dest_id,
+                                                               UVM_MIGRATE_MODE_MAKE_RESIDENT_AND_MAP,
+                                                               NULL));
+}
+
+void uvm_perf_prefetch_stride_notify(uvm_va_block_t *va_block,
+                                     uvm_va_block_context_t *va_block_context,
+                                     uvm_processor_id_t dest_id)
+{
+    uvm_va_range_t *va_range = va_block->va_range;
+    uvm_va_space_t *va_space;
+    uvm_va_policy_t *policy;
+    NvS64 seed;
+    NvS64 block;
+    NvS64 delta;
+    NvU32 depth = g_uvm_perf_prefetch_stride_depth;
+    NvU32 first;
+    NvU32 count;
+    NvU32 k;
+
+    if (g_uvm_perf_prefetch_stride == UVM_PREFETCH_STRIDE_DISABLED || uvm_va_block_is_hmm(va_block))
+        return;
+
+    // The block may have been killed since its faults were serviced
+    if (!va_range || va_range->type != UVM_VA_RANGE_TYPE_MANAGED || !UVM_ID_IS_GPU(dest_id))
+        return;
+
+    va_space = va_range->va_space;
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    if (!va_space->test.page_prefetch_enabled)
+        return;
+
+    policy = uvm_va_range_get_policy(va_range);
+
+    // Don't pull the data away from the place it was asked to stay
+    if (UVM_ID_IS_VALID(policy->preferred_location) && !uvm_id_equal(policy->preferred_location, dest_id))
+        return;
+
+    if (uvm_va_policy_maps_remotely(policy))
+        return;
+
+    seed = stride_seed_blocks(policy->prefetch_stride);
+    if (seed == 0 && policy->access_pattern == UVM_ACCESS_PATTERN_SEQUENTIAL)
+        seed = 1;
+
+    if (seed == 0 && g_uvm_perf_prefetch_stride != UVM_PREFETCH_STRIDE_ALL)
+        return;
+
+    // Streamed ranges run ahead by at least the blocks an iteration touches
+    if (uvm_va_policy_is_streaming(policy)) {
+        NvU64 span_blocks = DIV_ROUND_UP(policy->access_span, UVM_VA_BLOCK_SIZE);
+
+        depth = max_t(NvU64, depth, min_t(NvU64, span_blocks, UVM_PREFETCH_STRIDE_DEPTH_MAX));
+    }
+
+    block = uvm_va_range_block_index(va_range, va_block->start);
+    count = stride_update(&va_range->managed.stride,
+                          block,
+                          seed,
+                          depth,
+                          uvm_va_range_num_blocks(va_range),
+                          &delta,
+                          &first);
+
+    for (k = first; k < first + count; k++) {
+        // Out of memory or any other failure stops prefetching ahead
+        if (prefetch_block(va_range, block + k * delta, va_block_context, dest_id) != NV_OK)
+            break;
+    }
+}
+
+void uvm_perf_prefetch_markov_init(uvm_perf_prefetch_markov_t *markov)
+{
+    uvm_spin_lock_init(&markov->lock, UVM_LOCK_ORDER_LEAF);
+    markov->last_block = -1;
+    memset(markov->predicted, 0, sizeof(markov->predicted));
+    memset(markov->entries, 0, sizeof(markov->entries));
+}
+
+static uvm_perf_prefetch_markov_entry_t *markov_entry(uvm_perf_prefetch_markov_t *markov, NvS64 block)
+{
+    return &markov->entries[block % UVM_PERF_PREFETCH_MARKOV_ENTRIES];
+}
+
+// Counts the transition from to to in the successors of from. A successor
+// that isn't there takes the way with the lowest count once that count has
+// aged to 0, so a steady successor survives a few stray transitions.
+static void markov_record(uvm_perf_prefetch_markov_t *markov, NvS64 from, NvS64 to)
+{
+    uvm_perf_prefetch_markov_entry_t *entry = markov_entry(markov, from);
+    NvU32 weakest = 0;
+    NvU32 w;
+
+    if (entry->tag != from + 1) {
+        memset(entry, 0, sizeof(*entry));
+        entry->tag = from + 1;
+    }
+
+    for (w = 0; w < UVM_PERF_PREFETCH_MARKOV_WAYS; w++) {
+        if (entry->next[w] == to + 1) {
+            if (entry->count[w] < UVM_PREFETCH_MARKOV_CONFIDENCE_MAX)
+                ++entry->count[w];
+            return;
+        }
+
+        if (entry->count[w] < entry->count[weakest])
+            weakest = w;
+    }
+
+    if (entry->count[weakest] > 0) {
+        --entry->count[weakest];
+        return;
+    }
+
+    entry->next[weakest] = to + 1;
+    entry->count[weakest] = 1;
+}
+
+// Updates the predictor with a fault on block and writes the blocks to
+// prefetch after it, most likely first, to out_blocks. Returns their number,
+// with *out_hit set if block is one the previous prediction named.
+static NvU32 markov_update(uvm_perf_prefetch_markov_t *markov,
+                           NvS64 block,
+                           NvS64 out_blocks[UVM_PERF_PREFETCH_MARKOV_WAYS],
+                           bool *out_hit)
+{
+    uvm_perf_prefetch_markov_entry_t *entry;
+    NvU8 counts[UVM_PERF_PREFETCH_MARKOV_WAYS];
+    NvU32 count = 0;
+    NvU32 w;
+
+    *out_hit = false;
+
+    uvm_spin_lock(&markov->lock);
+
+    // More faults on the same block say nothing about the transitions
+    if (block == markov->last_block)
+        goto done;
+
+    if (markov->last_block >= 0) {
+        for (w = 0; w < UVM_PERF_PREFETCH_MARKOV_WAYS; w++) {
+            if (markov->predicted[w] == block + 1)
+                *out_hit = true;
+        }
+
+        markov_record(markov, markov->last_block, block);
+    }
+
+    markov->last_block = block;
+    memset(markov->predicted, 0, sizeof(markov->predicted));
+
+    entry = markov_entry(markov, block);
+    if (entry->tag != block + 1)
+        goto done;
+
+    for (w = 0; w < UVM_PERF_PREFETCH_MARKOV_WAYS; w++) {
+        NvU32 k = count;
+
+        if (entry->next[w] == 0 || entry->count[w] < g_uvm_perf_prefetch_markov_confidence)
+            continue;
+
+        // Kept sorted by count, highest first
+        for (; k > 0 && entry->count[w] > counts[k - 1]; k--) {
+            out_blocks[k] = out_blocks[k - 1];
+            counts[k] = counts[k - 1];
+        }
+
+        out_blocks[k] = (NvS64)entry->next[w] - 1;
+        counts[k] = entry->count[w];
+        markov->predicted[count++] = entry->next[w];
+    }
+
+done:
+    uvm_spin_unlock(&markov->lock);
+
+    return count;
+}
+
+void uvm_perf_prefetch_markov_notify(uvm_va_block_t *va_block,
+                                     uvm_va_block_context_t *va_block_context,
+                                     uvm_processor_id_t dest_id)
+{
+    uvm_va_range_t *va_range = va_block->va_range;
+    uvm_va_space_t *va_space;
+    uvm_va_policy_t *policy;
+    NvS64 blocks[UVM_PERF_PREFETCH_MARKOV_WAYS];
+    NvS64 block;
+    NvU32 count;
+    NvU32 k;
+    bool hit;
+
+    if (g_uvm_perf_prefetch_markov == UVM_PREFETCH_MARKOV_DISABLED || uvm_va_block_is_hmm(va_block))
+        return;
+
+    // The block may have been killed since its faults were serviced
+    if (!va_range || va_range->type != UVM_VA_RANGE_TYPE_MANAGED || !UVM_ID_IS_GPU(dest_id))
+        return;
+
+    va_space = va_range->va_space;
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    if (!va_space->test.page_prefetch_enabled)
+        return;
+
+    policy = uvm_va_range_get_policy(va_range);
+
+    if (UVM_ID_IS_VALID(policy->preferred_location) && !uvm_id_equal(policy->preferred_location, dest_id))
+        return;
+
+    // The stride prefetcher runs ahead of streamed ranges already
+    if (uvm_va_policy_is_streaming(policy) || uvm_va_policy_maps_remotely(policy))
+        return;
+
+    if (!(policy->access_flags & UVM_ACCESS_PATTERN_FLAG_PREDICT) &&
+        g_uvm_perf_prefetch_markov != UVM_PREFETCH_MARKOV_ALL)
+        return;
+
+    block = uvm_va_range_block_index(va_range, va_block->start);
+    count = markov_update(&va_range->managed.markov, block, blocks, &hit);
+
+    if (hit)
+        uvm_va_range_stat_add(va_range, UVM_VA_RANGE_STAT_MARKOV_HITS, 1);
+    if (count)
+        uvm_va_range_stat_add(va_range, UVM_VA_RANGE_STAT_MARKOV_PREDICTIONS, count);
+
+    for (k = 0; k < count; k++) {
+        if (blocks[k] >= (NvS64)uvm_va_range_num_blocks(va_range))
+            continue;
+
+        if (prefetch_block(va_range, blocks[k], va_block_context, dest_id) != NV_OK)
+            break;
+    }
+}
+
 NV_STATUS uvm_perf_prefetch_init()
 {
     g_uvm_perf_prefetch_enable = uvm_perf_prefetch_enable != 0;
@@ -462,6 +955,60 @@ NV_STATUS uvm_perf_prefetch_init()
         g_uvm_perf_prefetch_min_faults = UVM_PREFETCH_MIN_FAULTS_DEFAULT;
     }
 
+    if (uvm_perf_prefetch_stride <= UVM_PREFETCH_STRIDE_ALL) {
+        g_uvm_perf_prefetch_stride = uvm_perf_prefetch_stride;
+    }
+    else {
+        pr_info("Invalid value %u for uvm_perf_prefetch_stride. Using %u instead\n",
+                uvm_perf_prefetch_stride, UVM_PREFETCH_STRIDE_SEEDED);
+
+        g_uvm_perf_prefetch_stride = UVM_PREFETCH_STRIDE_SEEDED;
+    }
+
+    if (uvm_perf_prefetch_stride_depth >= 1 && uvm_perf_prefetch_stride_depth <= UVM_PREFETCH_STRIDE_DEPTH_MAX) {
+        g_uvm_perf_prefetch_stride_depth = uvm_perf_prefetch_stride_depth;
+    }
+    else {
+        pr_info("Invalid value %u for uvm_perf_prefetch_stride_depth. Using %u instead\n",
+                uvm_perf_prefetch_stride_depth, UVM_PREFETCH_STRIDE_DEPTH_DEFAULT);
+
+        g_uvm_perf_prefetch_stride_depth = UVM_PREFETCH_STRIDE_DEPTH_DEFAULT;
+    }
+
+    if (uvm_perf_prefetch_stride_confidence >= 1 &&
+        uvm_perf_prefetch_stride_confidence <= UVM_PREFETCH_STRIDE_CONFIDENCE_MAX) {
+        g_uvm_perf_prefetch_stride_confidence = uvm_perf_prefetch_stride_confidence;
+    }
+    else {
+        pr_info("Invalid value %u for uvm_perf_prefetch_stride_confidence. Using %u instead\n",
+                uvm_perf_prefetch_stride_confidence, UVM_PREFETCH_STRIDE_CONFIDENCE_DEFAULT);
+
+        g_uvm_perf_prefetch_stride_confidence = UVM_PREFETCH_STRIDE_CONFIDENCE_DEFAULT;
+    }
+
+    if (uvm_perf_prefetch_markov <= UVM_PREFETCH_MARKOV_ALL) {
+        g_uvm_perf_prefetch_markov = uvm_perf_prefetch_markov;
+    }
+    else {
+        pr_info("Invalid value %u for uvm_perf_prefetch_markov. Using %u instead\n",
+                uvm_perf_prefetch_markov, UVM_PREFETCH_MARKOV_FLAGGED);
+
+        g_uvm_perf_prefetch_markov = UVM_PREFETCH_MARKOV_FLAGGED;
+    }
+
+    if (uvm_perf_prefetch_markov_confidence >= 1 &&
+        uvm_perf_prefetch_markov_confidence <= UVM_PREFETCH_MARKOV_CONFIDENCE_MAX) {
+        g_uvm_perf_prefetch_markov_confidence = uvm_perf_prefetch_markov_confidence;
+    }
+    else {
+        pr_info("Invalid value %u for uvm_perf_prefetch_markov_confidence. Using %u instead\n",
+                uvm_perf_prefetch_markov_confidence, UVM_PREFETCH_MARKOV_CONFIDENCE_DEFAULT);
+
+        g_uvm_perf_prefetch_markov_confidence = UVM_PREFETCH_MARKOV_CONFIDENCE_DEFAULT;
+    }
+
+    g_uvm_perf_prefetch_quick_migrate_evict_ms = uvm_perf_prefetch_quick_migrate_evict_ms;
+
     return NV_OK;
 }
 
@@ -25,6 +25,7 @@
 #define __UVM_PERF_PREFETCH_H__
 
 #include "uvm_linux.h"
+#include "uvm_lock.h"
 #include "uvm_processors.h"
 #include "uvm_va_block_types.h"
 
@@ -58,9 +59,82 @@ typedef struct
     uvm_page_index_t node_idx;
 } uvm_perf_prefetch_bitmap_tree_iter_t;
 
+// Cross-block stride predictor of a managed VA range. Blocks and deltas are
+// VA block indices within the range.
+typedef struct
+{
+    uvm_spinlock_t lock;
+
+    // Last faulted block, -1 if none yet
+    NvS64 last_block;
+
+    NvS64 delta;
+
+    // Number of consecutive faults that repeated delta
+    NvU32 confidence;
+
+    // Furthest block already prefetched along delta, -1 if none
+    NvS64 prefetched_until;
+} uvm_perf_prefetch_stride_t;
+
+#define UVM_PERF_PREFETCH_MARKOV_ENTRIES 32
+#define UVM_PERF_PREFETCH_MARKOV_WAYS    2
+
+// Successors seen after a block. Blocks are stored as their VA block index
+// within the range plus one, 0 meaning none.
+typedef struct
+{
+    NvU32 tag;
+    NvU32 next[UVM_PERF_PREFETCH_MARKOV_WAYS];
+
+    // Saturating counts of the transitions to next
+    NvU8 count[UVM_PERF_PREFETCH_MARKOV_WAYS];
+} uvm_perf_prefetch_markov_entry_t;
+
+// First-order Markov predictor over the block-to-block fault transitions of a
+// managed VA range, for the irregular accesses the stride predictor misses.
+// entries is direct-mapped on the block index, so blocks that collide evict
+// each other's successors.
+typedef struct
+{
+    uvm_spinlock_t lock;
+
+    // Last faulted block, -1 if none yet
+    NvS64 last_block;
+
+    // Blocks predicted after last_block, to score the prediction on the next
+    // fault of another block
+    NvU32 predicted[UVM_PERF_PREFETCH_MARKOV_WAYS];
+
+    uvm_perf_prefetch_markov_entry_t entries[UVM_PERF_PREFETCH_MARKOV_ENTRIES];
+} uvm_perf_prefetch_markov_t;
+
 // Global initialization function (no clean up needed).
 NV_STATUS uvm_perf_prefetch_init(void);
 
+void uvm_perf_prefetch_stride_init(uvm_perf_prefetch_stride_t *stride);
+
+// Feed a serviced fault on va_block to the stride predictor of its VA range
+// and, once the block-to-block delta is trusted, migrate the blocks predicted
+// ahead of it to dest_id. Prefetching is best effort and errors are dropped.
+// va_block_context must not be NULL and its mm, if any, retained and locked.
+// Locking: The caller must hold the va_space lock for at least read and must
+// not hold the va_block lock.
+void uvm_perf_prefetch_stride_notify(uvm_va_block_t *va_block,
+                                     uvm_va_block_context_t *va_block_context,
+                                     uvm_processor_id_t dest_id);
+
+void uvm_perf_prefetch_markov_init(uvm_perf_prefetch_markov_t *markov);
+
+// Feed a serviced fault on va_block to the Markov predictor of its VA range
+// and migrate to dest_id the successors of the block seen at least
+// uvm_perf_prefetch_markov_confidence times. Counts the predictions and the
+// ones the next faulted block hit in the stats of the range. Same
+// requirements as uvm_perf_prefetch_stride_notify.
+void uvm_perf_prefetch_markov_notify(uvm_va_block_t *va_block,
+                                     uvm_va_block_context_t *va_block_context,
+                                     uvm_processor_id_t dest_id);
+
 // Return a hint with the pages that may be prefetched in the block.
 // The faulted_pages mask and faulted_region are the pages being migrated to
 // the given residency.
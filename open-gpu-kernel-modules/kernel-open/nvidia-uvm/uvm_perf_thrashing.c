@@ -100,6 +100,9 @@ typedef struct
 
     NvU64                  last_thrashing_time_stamp;
 
+    // Last time the block was reported to user space
+    NvU64                     last_report_time_stamp;
+
     // Stats
     NvU32                           throttling_count;
 
@@ -197,6 +200,19 @@ typedef struct
         NvU64                                 pin_ns;
     } params;
 
+    // Thrashing reports waiting for user space, see UVM_GET_THRASHING_EVENTS.
+    // Protected by lock.
+    struct
+    {
+        UVM_THRASHING_EVENT entries[UVM_THRASHING_EVENT_QUEUE_SIZE];
+
+        NvU32                                  count;
+
+        NvU32                                dropped;
+
+        uvm_spinlock_t                          lock;
+    } events;
+
     uvm_va_space_t                         *va_space;
 } va_space_thrashing_info_t;
 
@@ -1006,6 +1022,7 @@ static void thrashing_detected(uvm_va_block_t *va_block,
         ++block_thrashing->num_thrashing_pages;
 
     PROCESSOR_THRASHING_STATS_INC(va_space, processor_id, num_thrashing);
+    uvm_va_range_stat_add(va_block->va_range, UVM_VA_RANGE_STAT_THRASHING, 1);
 
     UVM_ASSERT(thrashing_state_checks(va_block, block_thrashing, page_thrashing, page_index));
 }
@@ -1430,7 +1447,10 @@ static uvm_perf_thrashing_hint_t get_hint_for_migration_thrashing(va_space_thras
 
     policy = uvm_va_policy_get(va_block, uvm_va_block_cpu_page_address(va_block, page_index));
 
-    preferred_location = policy->preferred_location;
+    // SUV prioritized ranges are pinned where the runtime placed them rather
+    // than throttling the processor they were placed for
+    preferred_location = UVM_ID_IS_VALID(policy->preferred_location)? policy->preferred_location :
+                                                                       policy->prioritized_location;
 
     hint.type = UVM_PERF_THRASHING_HINT_TYPE_NONE;
 
@@ -1449,6 +1469,14 @@ static uvm_perf_thrashing_hint_t get_hint_for_migration_thrashing(va_space_thras
         hint.type = UVM_PERF_THRASHING_HINT_TYPE_PIN;
         hint.pin.residency = preferred_location;
     }
+    else if ((uvm_va_policy_maps_remotely(policy) || (policy->access_flags & UVM_ACCESS_PATTERN_FLAG_READ_ONLY)) &&
+             !preferred_location_is_thrashing(preferred_location, page_thrashing) &&
+             thrashing_processors_can_access(va_space, page_thrashing, closest_resident_id)) {
+        // Scattered and read-only pages gain nothing from bouncing between the
+        // thrashing processors; pin them where they are instead of throttling
+        hint.type = UVM_PERF_THRASHING_HINT_TYPE_PIN;
+        hint.pin.residency = closest_resident_id;
+    }
     else if (!preferred_location_is_thrashing(preferred_location, page_thrashing) &&
              thrashing_processors_have_fast_access_to(va_space, page_thrashing, closest_resident_id)) {
         // This is a fast path for those scenarios in which all thrashing
@@ -1562,6 +1590,66 @@ static uvm_perf_thrashing_hint_t get_hint_for_migration_thrashing(va_space_thras
 //   thrashing due to revocation events (mainly due to system-wide atomics). In
 //   that case we keep the page pinned while applying the same algorithm as in
 //   Phase1.
+// Queue a report of the thrashing mitigation applied to the block for user
+// space, merged into the report of its range if there is one
+static void thrashing_report(va_space_thrashing_info_t *va_space_thrashing,
+                             uvm_va_block_t *va_block,
+                             block_thrashing_info_t *block_thrashing,
+                             uvm_processor_id_t requester,
+                             uvm_perf_thrashing_hint_type_t hint_type,
+                             NvU64 time_stamp)
+{
+    uvm_va_range_t *va_range = va_block->va_range;
+    NvU32 flag = hint_type == UVM_PERF_THRASHING_HINT_TYPE_PIN? UVM_THRASHING_EVENT_FLAG_PINNED :
+                                                                UVM_THRASHING_EVENT_FLAG_THROTTLED;
+    NvU32 i;
+
+    if (uvm_va_block_is_hmm(va_block) || !va_range)
+        return;
+
+    if (block_thrashing->last_report_time_stamp != 0 &&
+        time_stamp - block_thrashing->last_report_time_stamp < va_space_thrashing->params.lapse_ns)
+        return;
+
+    block_thrashing->last_report_time_stamp = time_stamp;
+
+    uvm_spin_lock(&va_space_thrashing->events.lock);
+
+    for (i = 0; i < va_space_thrashing->events.count; ++i) {
+        UVM_THRASHING_EVENT *event = &va_space_thrashing->events.entries[i];
+
+        if (event->base == va_range->node.start) {
+            ++event->reports;
+            event->flags |= flag;
+            goto unlock;
+        }
+    }
+
+    if (va_space_thrashing->events.count < UVM_THRASHING_EVENT_QUEUE_SIZE) {
+        UVM_THRASHING_EVENT *event = &va_space_thrashing->events.entries[va_space_thrashing->events.count++];
+
+        event->base    = va_range->node.start;
+        event->length  = uvm_va_range_size(va_range);
+        event->address = va_block->start;
+        event->reports = 1;
+        event->flags   = flag;
+    }
+    else {
+        ++va_space_thrashing->events.dropped;
+    }
+
+unlock:
+    uvm_spin_unlock(&va_space_thrashing->events.lock);
+
+    uvm_tools_event_ring_push(va_space_thrashing->va_space,
+                              UVM_EVENT_RING_TYPE_THRASHING,
+                              requester,
+                              va_range->node.start,
+                              va_block->start,
+                              uvm_va_block_size(va_block),
+                              flag);
+}
+
 uvm_perf_thrashing_hint_t uvm_perf_thrashing_get_hint(uvm_va_block_t *va_block,
                                                       NvU64 address,
                                                       uvm_processor_id_t requester)
@@ -1723,6 +1811,9 @@ done:
         UVM_ASSERT(UVM_ID_IS_INVALID(page_thrashing->pinned_residency_id));
     }
 
+    if (hint.type != UVM_PERF_THRASHING_HINT_TYPE_NONE)
+        thrashing_report(va_space_thrashing, va_block, block_thrashing, requester, hint.type, time_stamp);
+
     return hint;
 }
 
@@ -1887,6 +1978,7 @@ NV_STATUS uvm_perf_thrashing_load(uvm_va_space_t *va_space)
         return NV_ERR_NO_MEMORY;
 
     uvm_spin_lock_init(&va_space_thrashing->pinned_pages.lock, UVM_LOCK_ORDER_LEAF);
+    uvm_spin_lock_init(&va_space_thrashing->events.lock, UVM_LOCK_ORDER_LEAF);
     INIT_LIST_HEAD(&va_space_thrashing->pinned_pages.list);
     INIT_DELAYED_WORK(&va_space_thrashing->pinned_pages.dwork, thrashing_unpin_pages_entry);
 
@@ -2132,3 +2224,54 @@ done_unlock_va_space:
 
     return status;
 }
+
+NV_STATUS uvm_api_get_thrashing_events(UVM_GET_THRASHING_EVENTS_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    va_space_thrashing_info_t *va_space_thrashing;
+    UVM_THRASHING_EVENT *events = NULL;
+    NV_STATUS status = NV_OK;
+    NvU32 capacity = params->eventsBuffer? min(params->eventsCount, (NvU32)UVM_THRASHING_EVENT_QUEUE_SIZE) : 0;
+    NvU32 written = 0;
+
+    params->dropped = 0;
+
+    // Reports are staged in kernel memory so that the user copy doesn't
+    // happen with the lock held
+    if (capacity) {
+        events = uvm_kvmalloc(capacity * sizeof(*events));
+        if (!events)
+            return NV_ERR_NO_MEMORY;
+    }
+
+    uvm_va_space_down_read(va_space);
+
+    va_space_thrashing = va_space_thrashing_info_get_or_null(va_space);
+    if (va_space_thrashing) {
+        uvm_spin_lock(&va_space_thrashing->events.lock);
+
+        written = min(capacity, va_space_thrashing->events.count);
+        if (written) {
+            memcpy(events, va_space_thrashing->events.entries, written * sizeof(*events));
+            memmove(va_space_thrashing->events.entries,
+                    va_space_thrashing->events.entries + written,
+                    (va_space_thrashing->events.count - written) * sizeof(*events));
+            va_space_thrashing->events.count -= written;
+        }
+
+        params->dropped = va_space_thrashing->events.dropped;
+        va_space_thrashing->events.dropped = 0;
+
+        uvm_spin_unlock(&va_space_thrashing->events.lock);
+    }
+
+    uvm_va_space_up_read(va_space);
+
+    if (written && nv_copy_to_user((void __user *)params->eventsBuffer, events, written * sizeof(*events)))
+        status = NV_ERR_INVALID_ADDRESS;
+
+    uvm_kvfree(events);
+
+    params->eventsCount = written;
+    return status;
+}
@@ -100,11 +100,14 @@
 // All allocated user memory root chunks are tracked in an LRU list
 // (root_chunks.va_block_used). A root chunk is moved to the tail of that list
 // whenever any of its subchunks is allocated (unpinned) by a VA block (see
-// uvm_pmm_gpu_unpin_temp()). When a root chunk is selected for eviction, it has
-// the eviction flag set (see pick_root_chunk_to_evict()). This flag affects
-// many of the PMM operations on all of the subchunks of the root chunk being
-// evicted. See usage of (root_)chunk_is_in_eviction(), in particular in
-// chunk_free_locked() and claim_free_chunk().
+// uvm_pmm_gpu_unpin_temp()). Root chunks of VA ranges with a GPU prioritized
+// location are kept in one such list per priority level instead
+// (root_chunks.va_block_prioritized), and are only evicted once va_block_used
+// is empty, the lowest level first. When a root chunk is selected for
+// eviction, it has the eviction flag set (see pick_root_chunk_to_evict()).
+// This flag affects many of the PMM operations on all of the subchunks of the
+// root chunk being evicted. See usage of (root_)chunk_is_in_eviction(), in
+// particular in chunk_free_locked() and claim_free_chunk().
 //
 // To evict a root chunk, all of its free subchunks are pinned, then all
 // resident pages backed by it are moved to the CPU one VA block at a time.
@@ -166,12 +169,14 @@
 #include "uvm_pmm_gpu.h"
 #include "uvm_mem.h"
 #include "uvm_mmu.h"
+#include "uvm_push.h"
 #include "uvm_global.h"
 #include "uvm_kvmalloc.h"
 #include "uvm_va_space.h"
 #include "uvm_va_range.h"
 #include "uvm_va_block.h"
 #include "uvm_test.h"
+#include "uvm_trace.h"
 #include "uvm_linux.h"
 
 static int uvm_global_oversubscription = 1;
@@ -186,6 +191,67 @@ MODULE_PARM_DESC(uvm_global_oversubscription, "Enable (1) or disable (0) global
 static unsigned uvm_perf_pma_batch_nonpinned_order = UVM_PERF_PMA_BATCH_NONPINNED_ORDER_DEFAULT;
 module_param(uvm_perf_pma_batch_nonpinned_order, uint, S_IRUGO);
 
+// Free root chunks, in PMA, below which background eviction starts and at
+// which it stops. 0 disables background eviction.
+static unsigned uvm_pmm_evict_low_watermark = 0;
+module_param(uvm_pmm_evict_low_watermark, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_evict_low_watermark,
+                 "Free 2MB pages below which UVM evicts in the background (0 disables it).");
+
+static unsigned uvm_pmm_evict_high_watermark = 0;
+module_param(uvm_pmm_evict_high_watermark, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_evict_high_watermark,
+                 "Free 2MB pages at which background eviction stops (at least the low watermark).");
+
+// Free root chunks the background zeroer keeps zero, see pmm->zeroer. 0
+// disables it.
+static unsigned uvm_pmm_zero_pool = 8;
+module_param(uvm_pmm_zero_pool, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_zero_pool,
+                 "Free 2MB root chunks UVM keeps zeroed in the background for first touches (0 disables it). Default: 8.");
+
+// The root chunk counts above are for a whole GPU. A MIG GPU instance has
+// only its memory partition, see pmm_partition_chunks.
+#define UVM_PMM_PARTITION_SHARE 8
+
+#define UVM_PMM_EVICT_BATCH_MAX 16
+
+// Root chunks evicted together when an allocation finds no free memory: the
+// one the allocation gets and, up to this many in all, used ones that go on
+// the free lists for the allocations that follow, their copy-backs in flight.
+// 1 evicts one root chunk per allocation.
+static unsigned uvm_pmm_evict_batch = 4;
+module_param(uvm_pmm_evict_batch, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_evict_batch,
+                 "Root chunks evicted per allocation that has to evict (1 to 16, default 4).");
+
+#define UVM_PMM_EVICTION_LRU 0
+#define UVM_PMM_EVICTION_2Q  1
+
+// Replacement policy of the root chunks used by VA blocks. See
+// root_chunks.va_block_probation and pick_used_root_chunk().
+static int uvm_pmm_eviction_policy = UVM_PMM_EVICTION_LRU;
+module_param(uvm_pmm_eviction_policy, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_eviction_policy, "Evict used root chunks in LRU order (0) or with 2Q (1).");
+
+// Least recently used root chunks looked at for the one whose range is needed
+// furthest away, see UVM_SET_NEXT_USE. 0 evicts in plain LRU order.
+static unsigned uvm_pmm_next_use_window = 32;
+module_param(uvm_pmm_next_use_window, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_next_use_window,
+                 "Used root chunks LRU eviction compares the next-use hints of (0 ignores the hints, default 32).");
+
+// Percent of the free user memory of a GPU that, once it is in split root
+// chunks, has the allocations that must evict start a compaction pass. 0
+// disables compaction.
+static unsigned uvm_pmm_compact_threshold = 0;
+module_param(uvm_pmm_compact_threshold, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_pmm_compact_threshold,
+                 "Percent of free GPU memory in split 2MB chunks at which UVM compacts them in the background (0 disables it).");
+
+// Split root chunks compacted per pass at most
+#define UVM_PMM_COMPACT_BATCH 8
+
 // Helper type for refcounting cache
 typedef struct
 {
@@ -316,6 +382,7 @@ static struct list_head *find_free_list(uvm_pmm_gpu_t *pmm,
 static bool check_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
 static struct list_head *find_free_list_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
 static void chunk_free_locked(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
+static void background_zero_kick(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_memory_type_t type);
 
 static size_t root_chunk_index(uvm_pmm_gpu_t *pmm, uvm_gpu_root_chunk_t *root_chunk)
 {
@@ -579,6 +646,8 @@ NV_STATUS uvm_pmm_gpu_alloc(uvm_pmm_gpu_t *pmm,
             goto error;
     }
 
+    background_zero_kick(pmm, mem_type);
+
     return uvm_tracker_wait_deinit(&local_tracker);
 
 error:
@@ -628,6 +697,15 @@ NV_STATUS uvm_pmm_gpu_alloc_kernel(uvm_pmm_gpu_t *pmm,
     return pmm_gpu_alloc_kernel(pmm, num_chunks, chunk_size, memory_type, flags, chunks, out_tracker);
 }
 
+// List a used root chunk belongs on: under 2Q, probation until it's reused
+static struct list_head *root_chunk_used_list(uvm_pmm_gpu_t *pmm, uvm_gpu_root_chunk_t *root_chunk)
+{
+    if (uvm_pmm_eviction_policy == UVM_PMM_EVICTION_2Q && !root_chunk->reused)
+        return &pmm->root_chunks.va_block_probation;
+
+    return &pmm->root_chunks.va_block_used;
+}
+
 static void chunk_update_lists_locked(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
 {
     uvm_gpu_root_chunk_t *root_chunk = root_chunk_from_chunk(pmm, chunk);
@@ -647,31 +725,42 @@ static void chunk_update_lists_locked(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk
         uvm_va_block_t *va_block;
         uvm_processor_id_t processor;
         va_block = chunk->va_block;
-        if (va_block != NULL) {
+        // The policy of an HMM block needs its lock, which can't be taken
+        // here. HMM blocks go on the used list and are put back on their
+        // prioritized list by block_mark_memory_used().
+        if (va_block != NULL && !uvm_va_block_is_hmm(va_block)) {
           /* pr_alert("found va bloke\n"); */
-          processor = uvm_va_range_get_policy(va_block->va_range)->prioritized_location;
-          if (UVM_ID_IS_VALID(processor)) {
+          uvm_va_policy_t *policy = uvm_va_range_get_policy(va_block->va_range);
+          processor = policy->prioritized_location;
+          if (UVM_ID_IS_VALID(processor) && !uvm_va_range_prioritized_demoted(va_block->va_range)) {
             if (UVM_ID_IS_GPU(processor)) {
             //   pr_alert("found GPU %d\n", uvm_id_value(processor));
-              list_move_tail(&root_chunk->chunk.list, &pmm->root_chunks.va_block_prioritized);
+              list_move_tail(&root_chunk->chunk.list,
+                             &pmm->root_chunks.va_block_prioritized[policy->prioritized_level]);
             } else if (UVM_ID_IS_CPU(processor)) {
             //   pr_alert("found CPU %d\n", uvm_id_value(processor));
-              list_move_tail(&root_chunk->chunk.list, &pmm->root_chunks.va_block_used);
+              list_move_tail(&root_chunk->chunk.list, root_chunk_used_list(pmm, root_chunk));
             } else {
               pr_alert("Ought not to reach here\n");
             }
           } else{
             /* pr_alert("Prefered location not set\n"); */
-            list_move_tail(&root_chunk->chunk.list, &pmm->root_chunks.va_block_used);
+            list_move_tail(&root_chunk->chunk.list, root_chunk_used_list(pmm, root_chunk));
           }
         } else {
           /* pr_alert("NOT FOUND found va bloke\n"); */
-          list_move_tail(&root_chunk->chunk.list, &pmm->root_chunks.va_block_used);
+          list_move_tail(&root_chunk->chunk.list, root_chunk_used_list(pmm, root_chunk));
         }
         /* list_move_tail(&root_chunk->chunk.list, &pmm->root_chunks.va_block_used); */
       }
     }
 
+    // A freed root chunk starts over on probation
+    if (root_chunk->chunk.state == UVM_PMM_GPU_CHUNK_STATE_FREE) {
+        root_chunk->reused = false;
+        root_chunk->referenced = false;
+    }
+
     // TODO: Bug 1757148: Improve fragmentation of split chunks
     if (chunk->state == UVM_PMM_GPU_CHUNK_STATE_FREE)
         list_move_tail(&chunk->list, find_free_list_chunk(pmm, chunk));
@@ -703,6 +792,7 @@ void uvm_pmm_gpu_free(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk, uvm_tracker_t
 {
     NV_STATUS status;
     uvm_gpu_root_chunk_t *root_chunk;
+    uvm_pmm_gpu_memory_type_t type;
 
     if (!chunk)
         return;
@@ -728,7 +818,9 @@ void uvm_pmm_gpu_free(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk, uvm_tracker_t
         root_chunk_unlock(pmm, root_chunk);
     }
 
+    type = chunk->type;
     free_chunk(pmm, chunk);
+    background_zero_kick(pmm, type);
 }
 
 static NvU32 num_subchunks(uvm_gpu_chunk_t *parent)
@@ -835,6 +927,11 @@ static void merge_gpu_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
     suballoc = chunk->suballoc;
     chunk->suballoc = NULL;
 
+    if (chunk_is_root_chunk(chunk) && uvm_pmm_gpu_memory_type_is_user(chunk->type)) {
+        UVM_ASSERT(pmm->split_root_chunks > 0);
+        pmm->split_root_chunks--;
+    }
+
     // The resulting chunk is assumed to be non-zero as a simplification,
     // instead of checking that all the subchunks are zero, since callers of
     // uvm_pmm_gpu_alloc are not required to clear it. However, we think that
@@ -1658,6 +1755,35 @@ static bool chunk_is_evictable(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
     return true;
 }
 
+// The eviction list a root chunk is on, a UVM_TRACE_EVICT_*. Walks the list to
+// its head, so only for tracing.
+static NvU32 root_chunk_eviction_list(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
+{
+    struct list_head *node;
+    NvU32 level;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    if (chunk->state == UVM_PMM_GPU_CHUNK_STATE_FREE)
+        return chunk->is_zero ? UVM_TRACE_EVICT_FREE_ZERO : UVM_TRACE_EVICT_FREE;
+
+    for (node = chunk->list.next; node != &chunk->list; node = node->next) {
+        if (node == &pmm->root_chunks.va_block_unused)
+            return UVM_TRACE_EVICT_UNUSED;
+        if (node == &pmm->root_chunks.va_block_probation)
+            return UVM_TRACE_EVICT_PROBATION;
+        if (node == &pmm->root_chunks.va_block_used)
+            return UVM_TRACE_EVICT_USED;
+
+        for (level = 0; level < UVM_PMM_PRIORITY_LEVELS; level++) {
+            if (node == &pmm->root_chunks.va_block_prioritized[level])
+                return UVM_TRACE_EVICT_PRIORITIZED + level;
+        }
+    }
+
+    return UVM_TRACE_EVICT_UNKNOWN;
+}
+
 static void chunk_start_eviction(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
 {
     uvm_gpu_root_chunk_t *root_chunk = root_chunk_from_chunk(pmm, chunk);
@@ -1668,8 +1794,16 @@ static void chunk_start_eviction(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
     UVM_ASSERT(chunk_is_evictable(pmm, chunk));
     UVM_ASSERT(!list_empty(&chunk->list));
 
+    if (trace_uvm_pmm_evict_root_chunk_enabled()) {
+        trace_uvm_pmm_evict_root_chunk(uvm_id_value(uvm_pmm_to_gpu(pmm)->id),
+                                       chunk->address,
+                                       root_chunk_eviction_list(pmm, chunk));
+    }
+
     list_del_init(&chunk->list);
     uvm_gpu_chunk_set_in_eviction(chunk, true);
+    root_chunk->reused = false;
+    root_chunk->referenced = false;
 }
 
 static void root_chunk_update_eviction_list(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk, struct list_head *list)
@@ -1686,15 +1820,21 @@ static void root_chunk_update_eviction_list(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t
         // eviction lists.
         UVM_ASSERT(!list_empty(&chunk->list));
 
+        // Under 2Q, a used chunk stays on probation until it's referenced
+        if (list == &pmm->root_chunks.va_block_used)
+            list = root_chunk_used_list(pmm, root_chunk_from_chunk(pmm, chunk));
+
         list_move_tail(&chunk->list, list);
     }
 
     uvm_spin_unlock(&pmm->list_lock);
 }
 
-void uvm_pmm_gpu_mark_root_chunk_prioritized(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
+void uvm_pmm_gpu_mark_root_chunk_prioritized(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk, NvU32 level)
 {
-    root_chunk_update_eviction_list(pmm, chunk, &pmm->root_chunks.va_block_prioritized);
+    UVM_ASSERT(level < UVM_PMM_PRIORITY_LEVELS);
+
+    root_chunk_update_eviction_list(pmm, chunk, &pmm->root_chunks.va_block_prioritized[level]);
 }
 
 void uvm_pmm_gpu_mark_root_chunk_used(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
@@ -1707,9 +1847,124 @@ void uvm_pmm_gpu_mark_root_chunk_unused(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chu
     root_chunk_update_eviction_list(pmm, chunk, &pmm->root_chunks.va_block_unused);
 }
 
+void uvm_pmm_gpu_mark_root_chunk_referenced(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
+{
+    uvm_gpu_root_chunk_t *root_chunk = root_chunk_from_chunk(pmm, chunk);
+
+    if (uvm_pmm_eviction_policy != UVM_PMM_EVICTION_2Q)
+        return;
+
+    uvm_spin_lock(&pmm->list_lock);
+    root_chunk->referenced = true;
+    uvm_spin_unlock(&pmm->list_lock);
+}
+
+// Epochs from the current one of its VA space to the next use of the root
+// chunk, as hinted for the range of its VA block, or NV_U64_MAX if there's no
+// hint ahead of the current epoch. A split root chunk goes by its first leaf.
+static NvU64 root_chunk_next_use_distance(uvm_gpu_chunk_t *chunk)
+{
+    uvm_va_block_t *va_block;
+    uvm_va_range_t *va_range;
+    NvU64 next_use;
+    NvU64 epoch;
+
+    while (chunk->state == UVM_PMM_GPU_CHUNK_STATE_IS_SPLIT)
+        chunk = chunk->suballoc->subchunks[0];
+
+    va_block = chunk->va_block;
+    if (!va_block)
+        return NV_U64_MAX;
+
+    va_range = va_block->va_range;
+    if (!va_range)
+        return NV_U64_MAX;
+
+    next_use = uvm_va_range_get_policy(va_range)->next_use;
+    epoch = atomic64_read(&va_range->va_space->next_use_epoch);
+    if (next_use == 0 || next_use < epoch)
+        return NV_U64_MAX;
+
+    return next_use - epoch;
+}
+
+// Approximates OPT over the uvm_pmm_next_use_window least recently used root
+// chunks: the first without a hint goes, else the one needed furthest away,
+// the least recently used one among equals.
+static uvm_gpu_chunk_t *pick_furthest_next_use_root_chunk(uvm_pmm_gpu_t *pmm)
+{
+    uvm_gpu_chunk_t *chunk;
+    uvm_gpu_chunk_t *furthest = NULL;
+    NvU64 furthest_distance = 0;
+    NvU64 distance;
+    unsigned scanned = 0;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    if (uvm_pmm_next_use_window == 0)
+        return list_first_chunk(&pmm->root_chunks.va_block_used);
+
+    list_for_each_entry(chunk, &pmm->root_chunks.va_block_used, list) {
+        if (scanned++ == uvm_pmm_next_use_window)
+            break;
+
+        distance = root_chunk_next_use_distance(chunk);
+        if (distance == NV_U64_MAX)
+            return chunk;
+
+        if (!furthest || distance > furthest_distance) {
+            furthest = chunk;
+            furthest_distance = distance;
+        }
+    }
+
+    return furthest;
+}
+
+// Picks the used root chunk to evict. Under LRU, that's the head of
+// va_block_used, or the one needed furthest away near it if the ranges have
+// next-use hints. Under 2Q, the head of the probation list goes first; a chunk
+// that was referenced while on probation moves to the tail of va_block_used
+// instead. Once probation is empty, the head of va_block_used goes, unless it
+// was referenced since the last pass, in which case it gets a second chance at
+// the tail. A pass clears the references it sees, so every chunk is looked at
+// at most twice.
+static uvm_gpu_chunk_t *pick_used_root_chunk(uvm_pmm_gpu_t *pmm)
+{
+    uvm_gpu_chunk_t *chunk;
+    uvm_gpu_root_chunk_t *root_chunk;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    if (uvm_pmm_eviction_policy != UVM_PMM_EVICTION_2Q)
+        return pick_furthest_next_use_root_chunk(pmm);
+
+    while ((chunk = list_first_chunk(&pmm->root_chunks.va_block_probation))) {
+        root_chunk = root_chunk_from_chunk(pmm, chunk);
+        if (!root_chunk->referenced)
+            return chunk;
+
+        root_chunk->referenced = false;
+        root_chunk->reused = true;
+        list_move_tail(&chunk->list, &pmm->root_chunks.va_block_used);
+    }
+
+    while ((chunk = list_first_chunk(&pmm->root_chunks.va_block_used))) {
+        root_chunk = root_chunk_from_chunk(pmm, chunk);
+        if (!root_chunk->referenced)
+            return chunk;
+
+        root_chunk->referenced = false;
+        list_move_tail(&chunk->list, &pmm->root_chunks.va_block_used);
+    }
+
+    return NULL;
+}
+
 static uvm_gpu_root_chunk_t *pick_root_chunk_to_evict(uvm_pmm_gpu_t *pmm)
 {
     uvm_gpu_chunk_t *chunk;
+    NvU32 level;
 
     uvm_spin_lock(&pmm->list_lock);
 
@@ -1737,10 +1992,11 @@ static uvm_gpu_root_chunk_t *pick_root_chunk_to_evict(uvm_pmm_gpu_t *pmm)
     // TODO: Bug 1765193: Move the chunks to the tail of the used list whenever
     // they get mapped.
     if (!chunk)
-        chunk = list_first_chunk(&pmm->root_chunks.va_block_used);
+        chunk = pick_used_root_chunk(pmm);
 
-    if (!chunk)
-        chunk = list_first_chunk(&pmm->root_chunks.va_block_prioritized);
+    // Prioritized chunks go last, lowest level first
+    for (level = 0; !chunk && level < UVM_PMM_PRIORITY_LEVELS; level++)
+        chunk = list_first_chunk(&pmm->root_chunks.va_block_prioritized[level]);
 
     if (chunk)
         chunk_start_eviction(pmm, chunk);
@@ -1833,6 +2089,68 @@ static NV_STATUS pick_and_evict_root_chunk_retry(uvm_pmm_gpu_t *pmm,
     return status;
 }
 
+// Picks up to max unused or used root chunks to evict, in eviction order,
+// under a single hold of the list lock. Free and prioritized root chunks are
+// left alone.
+static NvU32 pick_root_chunks_to_evict_batch(uvm_pmm_gpu_t *pmm, uvm_gpu_root_chunk_t **root_chunks, NvU32 max)
+{
+    uvm_gpu_chunk_t *chunk;
+    NvU32 count = 0;
+
+    uvm_spin_lock(&pmm->list_lock);
+
+    while (count < max) {
+        chunk = list_first_chunk(&pmm->root_chunks.va_block_unused);
+        if (!chunk)
+            chunk = pick_used_root_chunk(pmm);
+        if (!chunk)
+            break;
+
+        chunk_start_eviction(pmm, chunk);
+        root_chunks[count++] = root_chunk_from_chunk(pmm, chunk);
+    }
+
+    uvm_spin_unlock(&pmm->list_lock);
+
+    return count;
+}
+
+// Evicts a root chunk for an allocation of type and, if it is user memory,
+// up to uvm_pmm_evict_batch - 1 more that go on the free lists. Their
+// copy-backs are only pushed, to the root chunks' trackers, so they proceed
+// while the rest of the batch is unmapped, and the allocations that take them
+// wait on them through the trackers. The fault bursts of a full GPU then find
+// free chunks rather than each evicting its own.
+static NV_STATUS pick_and_evict_root_chunk_batch(uvm_pmm_gpu_t *pmm,
+                                                 uvm_pmm_gpu_memory_type_t type,
+                                                 uvm_gpu_chunk_t **out_chunk)
+{
+    uvm_gpu_root_chunk_t *root_chunks[UVM_PMM_EVICT_BATCH_MAX - 1];
+    NV_STATUS status;
+    NvU32 count;
+    NvU32 i;
+
+    uvm_assert_mutex_locked(&pmm->lock);
+
+    status = pick_and_evict_root_chunk_retry(pmm, type, PMM_CONTEXT_DEFAULT, out_chunk);
+    if (status != NV_OK || !uvm_pmm_gpu_memory_type_is_user(type) || uvm_pmm_evict_batch < 2)
+        return status;
+
+    count = pick_root_chunks_to_evict_batch(pmm,
+                                            root_chunks,
+                                            min(uvm_pmm_evict_batch, (unsigned)UVM_PMM_EVICT_BATCH_MAX) - 1);
+
+    for (i = 0; i < count; i++) {
+        // A failed eviction puts the root chunk back, or frees it to PMA if a
+        // page of it is held elsewhere. Either way the allocation already has
+        // its chunk, so just go on.
+        if (evict_root_chunk(pmm, root_chunks[i], PMM_CONTEXT_DEFAULT) == NV_OK)
+            free_chunk_with_merges(pmm, &root_chunks[i]->chunk);
+    }
+
+    return NV_OK;
+}
+
 static uvm_gpu_chunk_t *find_free_chunk_locked(uvm_pmm_gpu_t *pmm,
                                                uvm_pmm_gpu_memory_type_t type,
                                                uvm_chunk_size_t chunk_size,
@@ -1873,21 +2191,23 @@ static uvm_gpu_chunk_t *find_free_chunk_locked(uvm_pmm_gpu_t *pmm,
     return NULL;
 }
 
-static uvm_gpu_chunk_t *claim_free_chunk(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_memory_type_t type, uvm_chunk_size_t chunk_size)
+static uvm_gpu_chunk_t *claim_free_chunk(uvm_pmm_gpu_t *pmm,
+                                         uvm_pmm_gpu_memory_type_t type,
+                                         uvm_chunk_size_t chunk_size,
+                                         uvm_pmm_alloc_flags_t flags)
 {
     uvm_gpu_chunk_t *chunk;
+    const uvm_pmm_list_zero_t first = (flags & UVM_PMM_ALLOC_FLAGS_NONZERO) ? UVM_PMM_LIST_NO_ZERO : UVM_PMM_LIST_ZERO;
+    const uvm_pmm_list_zero_t second = (flags & UVM_PMM_ALLOC_FLAGS_NONZERO) ? UVM_PMM_LIST_ZERO : UVM_PMM_LIST_NO_ZERO;
 
     uvm_spin_lock(&pmm->list_lock);
 
     // Prefer zero free chunks as they are likely going to be used for a new
-    // allocation.
-    //
-    // TODO: Bug 2446832: Allow callers to request non-zero chunks in PMM
-    // allocation functions, so we don't waste zero chunks.
-    chunk = find_free_chunk_locked(pmm, type, chunk_size, UVM_PMM_LIST_ZERO);
+    // allocation, unless the caller overwrites the whole chunk anyway.
+    chunk = find_free_chunk_locked(pmm, type, chunk_size, first);
 
     if (!chunk)
-        chunk = find_free_chunk_locked(pmm, type, chunk_size, UVM_PMM_LIST_NO_ZERO);
+        chunk = find_free_chunk_locked(pmm, type, chunk_size, second);
 
     if (!chunk)
         goto out;
@@ -1914,6 +2234,460 @@ out:
     return chunk;
 }
 
+// A root chunk count of the module parameters for the GPU of pmm: as is on a
+// whole GPU, at most 1/UVM_PMM_PARTITION_SHARE of the memory partition's root
+// chunks on a MIG GPU instance, so that a count set for the whole GPU doesn't
+// keep most of a small partition evicted or zeroed.
+static NvU64 pmm_partition_chunks(uvm_pmm_gpu_t *pmm, NvU64 count)
+{
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    NvU64 cap;
+
+    if (count == 0 || !gpu->parent->smc.enabled)
+        return count;
+
+    cap = max(gpu->mem_info.size / UVM_CHUNK_SIZE_MAX / UVM_PMM_PARTITION_SHARE, 1ull);
+    return min(count, cap);
+}
+
+static NvU64 background_evict_target(uvm_pmm_gpu_t *pmm)
+{
+    return pmm_partition_chunks(pmm, max(uvm_pmm_evict_low_watermark, uvm_pmm_evict_high_watermark));
+}
+
+// Evicts root chunks back to PMA until the high watermark is reached, one at a
+// time so that allocations aren't held off by the PMM lock for long. Runs on
+// pmm->evictor.q.
+static void background_evict(void *args)
+{
+    uvm_pmm_gpu_t *pmm = (uvm_pmm_gpu_t *)args;
+    uvm_gpu_chunk_t *chunk;
+    NV_STATUS status;
+
+    while (UVM_READ_ONCE(pmm->pma_stats->numFreePages2m) < background_evict_target(pmm)) {
+        uvm_mutex_lock(&pmm->lock);
+        status = pick_and_evict_root_chunk_retry(pmm, UVM_PMM_GPU_MEMORY_TYPE_USER, PMM_CONTEXT_DEFAULT, &chunk);
+        uvm_mutex_unlock(&pmm->lock);
+
+        // Nothing left to evict, or the eviction failed. The next allocation
+        // below the low watermark tries again.
+        if (status != NV_OK)
+            break;
+
+        free_root_chunk(pmm, root_chunk_from_chunk(pmm, chunk), FREE_ROOT_CHUNK_MODE_DEFAULT);
+    }
+}
+
+static void background_evict_kick(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_memory_type_t type)
+{
+    if (!pmm->evictor.enabled || !uvm_pmm_gpu_memory_type_is_user(type))
+        return;
+
+    if (UVM_READ_ONCE(pmm->pma_stats->numFreePages2m) >= pmm_partition_chunks(pmm, uvm_pmm_evict_low_watermark))
+        return;
+
+    // Does nothing if it's already pending
+    nv_kthread_q_schedule_q_item(&pmm->evictor.q, &pmm->evictor.q_item);
+}
+
+static NV_STATUS background_evict_init(uvm_pmm_gpu_t *pmm)
+{
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    char kthread_name[TASK_COMM_LEN + 1];
+    NV_STATUS status;
+
+    if (uvm_pmm_evict_low_watermark == 0 || !pmm->pma_stats || !uvm_gpu_supports_eviction(gpu))
+        return NV_OK;
+
+    nv_kthread_q_item_init(&pmm->evictor.q_item, background_evict, pmm);
+    snprintf(kthread_name, sizeof(kthread_name), "UVM GPU%u EV", uvm_id_value(gpu->id));
+    status = errno_to_nv_status(nv_kthread_q_init(&pmm->evictor.q, kthread_name));
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed in nv_kthread_q_init for the evictor: %s, GPU %s\n",
+                      nvstatusToString(status),
+                      uvm_gpu_name(gpu));
+        return status;
+    }
+
+    pmm->evictor.enabled = true;
+    return NV_OK;
+}
+
+static void background_evict_deinit(uvm_pmm_gpu_t *pmm)
+{
+    if (!pmm->evictor.enabled)
+        return;
+
+    pmm->evictor.enabled = false;
+    nv_kthread_q_stop(&pmm->evictor.q);
+}
+
+// Free user memory on the free lists, in chunks smaller than a root chunk
+// and in root chunks
+static void free_list_bytes_locked(uvm_pmm_gpu_t *pmm, NvU64 *split_bytes, NvU64 *root_bytes)
+{
+    uvm_chunk_size_t chunk_size;
+    uvm_pmm_list_zero_t zero_type;
+    uvm_gpu_chunk_t *chunk;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    *split_bytes = 0;
+    *root_bytes = 0;
+
+    for_each_chunk_size(chunk_size, pmm->chunk_sizes[UVM_PMM_GPU_MEMORY_TYPE_USER]) {
+        for (zero_type = 0; zero_type < UVM_PMM_LIST_ZERO_COUNT; ++zero_type) {
+            struct list_head *free_list = find_free_list(pmm, UVM_PMM_GPU_MEMORY_TYPE_USER, chunk_size, zero_type);
+
+            list_for_each_entry(chunk, free_list, list) {
+                if (chunk_size == UVM_CHUNK_SIZE_MAX)
+                    *root_bytes += chunk_size;
+                else
+                    *split_bytes += chunk_size;
+            }
+        }
+    }
+}
+
+void uvm_pmm_gpu_get_fragmentation(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_fragmentation_t *fragmentation)
+{
+    uvm_spin_lock(&pmm->list_lock);
+
+    fragmentation->split_root_chunks = pmm->split_root_chunks;
+    free_list_bytes_locked(pmm, &fragmentation->split_free_bytes, &fragmentation->root_free_bytes);
+
+    uvm_spin_unlock(&pmm->list_lock);
+
+    if (pmm->pma_stats)
+        fragmentation->root_free_bytes += UVM_READ_ONCE(pmm->pma_stats->numFreePages2m) * UVM_CHUNK_SIZE_MAX;
+
+    fragmentation->compacted_root_chunks = atomic64_read(&pmm->compactor.compacted);
+}
+
+// Bytes of the free chunks under chunk. The list lock, with the PMM lock,
+// keeps the tree from being split or merged meanwhile.
+static NvU64 chunk_free_bytes_locked(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
+{
+    NvU64 bytes = 0;
+    size_t i;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    if (chunk->state == UVM_PMM_GPU_CHUNK_STATE_FREE)
+        return uvm_gpu_chunk_get_size(chunk);
+
+    if (chunk->state != UVM_PMM_GPU_CHUNK_STATE_IS_SPLIT)
+        return 0;
+
+    for (i = 0; i < num_subchunks(chunk); i++)
+        bytes += chunk_free_bytes_locked(pmm, chunk->suballoc->subchunks[i]);
+
+    return bytes;
+}
+
+// The split root chunk with the most free memory, at least half of it, among
+// the unused and used ones, its eviction started, while the free user memory
+// in split root chunks is above uvm_pmm_compact_threshold. Prioritized root
+// chunks are left alone.
+static uvm_gpu_root_chunk_t *pick_root_chunk_to_compact(uvm_pmm_gpu_t *pmm)
+{
+    struct list_head *lists[] = {
+        &pmm->root_chunks.va_block_unused,
+        &pmm->root_chunks.va_block_probation,
+        &pmm->root_chunks.va_block_used,
+    };
+    uvm_gpu_chunk_t *chunk, *best = NULL;
+    NvU64 split_bytes, root_bytes;
+    NvU64 best_bytes = 0;
+    size_t i;
+
+    uvm_assert_mutex_locked(&pmm->lock);
+
+    uvm_spin_lock(&pmm->list_lock);
+
+    free_list_bytes_locked(pmm, &split_bytes, &root_bytes);
+    if (pmm->pma_stats)
+        root_bytes += UVM_READ_ONCE(pmm->pma_stats->numFreePages2m) * UVM_CHUNK_SIZE_MAX;
+
+    if (split_bytes < UVM_CHUNK_SIZE_MAX || split_bytes * 100 < (split_bytes + root_bytes) * uvm_pmm_compact_threshold)
+        goto out;
+
+    for (i = 0; i < ARRAY_SIZE(lists); i++) {
+        list_for_each_entry(chunk, lists[i], list) {
+            NvU64 bytes;
+
+            if (chunk->state != UVM_PMM_GPU_CHUNK_STATE_IS_SPLIT || !chunk_is_evictable(pmm, chunk))
+                continue;
+
+            bytes = chunk_free_bytes_locked(pmm, chunk);
+            if (bytes >= UVM_CHUNK_SIZE_MAX / 2 && bytes > best_bytes) {
+                best = chunk;
+                best_bytes = bytes;
+            }
+        }
+    }
+
+    if (best)
+        chunk_start_eviction(pmm, best);
+
+out:
+    uvm_spin_unlock(&pmm->list_lock);
+
+    if (best)
+        return root_chunk_from_chunk(pmm, best);
+    return NULL;
+}
+
+// Evicts split root chunks back to PMA, the emptiest first, one at a time
+// like the background eviction. Runs on pmm->compactor.q.
+static void background_compact(void *args)
+{
+    uvm_pmm_gpu_t *pmm = (uvm_pmm_gpu_t *)args;
+    uvm_gpu_root_chunk_t *root_chunk;
+    NV_STATUS status;
+    NvU32 i;
+
+    for (i = 0; i < UVM_PMM_COMPACT_BATCH; i++) {
+        uvm_mutex_lock(&pmm->lock);
+        root_chunk = pick_root_chunk_to_compact(pmm);
+        status = root_chunk ? evict_root_chunk(pmm, root_chunk, PMM_CONTEXT_DEFAULT) : NV_OK;
+        uvm_mutex_unlock(&pmm->lock);
+
+        // Below the threshold, or nothing worth compacting
+        if (!root_chunk)
+            break;
+
+        // A root chunk with a page held elsewhere has been freed to PMA
+        // already, try the next one. Other failures put the root chunk back.
+        if (status == NV_ERR_IN_USE)
+            continue;
+        if (status != NV_OK)
+            break;
+
+        free_root_chunk(pmm, root_chunk, FREE_ROOT_CHUNK_MODE_DEFAULT);
+        atomic64_inc(&pmm->compactor.compacted);
+    }
+}
+
+static void background_compact_kick(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_memory_type_t type)
+{
+    if (!pmm->compactor.enabled || !uvm_pmm_gpu_memory_type_is_user(type))
+        return;
+
+    // Does nothing if it's already pending
+    nv_kthread_q_schedule_q_item(&pmm->compactor.q, &pmm->compactor.q_item);
+}
+
+static NV_STATUS background_compact_init(uvm_pmm_gpu_t *pmm)
+{
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    char kthread_name[TASK_COMM_LEN + 1];
+    NV_STATUS status;
+
+    if (uvm_pmm_compact_threshold == 0 || !uvm_gpu_supports_eviction(gpu))
+        return NV_OK;
+
+    nv_kthread_q_item_init(&pmm->compactor.q_item, background_compact, pmm);
+    snprintf(kthread_name, sizeof(kthread_name), "UVM GPU%u CP", uvm_id_value(gpu->id));
+    status = errno_to_nv_status(nv_kthread_q_init(&pmm->compactor.q, kthread_name));
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed in nv_kthread_q_init for the compactor: %s, GPU %s\n",
+                      nvstatusToString(status),
+                      uvm_gpu_name(gpu));
+        return status;
+    }
+
+    pmm->compactor.enabled = true;
+    return NV_OK;
+}
+
+static void background_compact_deinit(uvm_pmm_gpu_t *pmm)
+{
+    if (!pmm->compactor.enabled)
+        return;
+
+    pmm->compactor.enabled = false;
+    nv_kthread_q_stop(&pmm->compactor.q);
+}
+
+// Counts the zero free root chunks of user memory, up to max
+static NvU32 zero_pool_count_locked(uvm_pmm_gpu_t *pmm, NvU32 max)
+{
+    struct list_head *free_list = find_free_list(pmm, UVM_PMM_GPU_MEMORY_TYPE_USER, UVM_CHUNK_SIZE_MAX, UVM_PMM_LIST_ZERO);
+    uvm_gpu_chunk_t *chunk;
+    NvU32 count = 0;
+
+    uvm_assert_spinlock_locked(&pmm->list_lock);
+
+    list_for_each_entry(chunk, free_list, list) {
+        if (++count >= max)
+            break;
+    }
+
+    return count;
+}
+
+// Takes a non-zero free root chunk of user memory off its free list, pinned
+// so that neither allocations nor evictions get it, if the pool is short of
+// zero ones.
+static uvm_gpu_root_chunk_t *zero_pool_claim_root_chunk(uvm_pmm_gpu_t *pmm)
+{
+    struct list_head *free_list = find_free_list(pmm, UVM_PMM_GPU_MEMORY_TYPE_USER, UVM_CHUNK_SIZE_MAX, UVM_PMM_LIST_NO_ZERO);
+    uvm_gpu_chunk_t *candidate;
+    uvm_gpu_chunk_t *chunk = NULL;
+    NvU32 pool = pmm_partition_chunks(pmm, uvm_pmm_zero_pool);
+
+    uvm_spin_lock(&pmm->list_lock);
+
+    if (zero_pool_count_locked(pmm, pool) < pool) {
+        list_for_each_entry(candidate, free_list, list) {
+            if (chunk_is_in_eviction(pmm, candidate) ||
+                root_chunk_has_elevated_page(pmm, root_chunk_from_chunk(pmm, candidate)))
+                continue;
+
+            chunk = candidate;
+            break;
+        }
+    }
+
+    if (chunk) {
+        UVM_ASSERT(chunk->state == UVM_PMM_GPU_CHUNK_STATE_FREE);
+        UVM_ASSERT(!chunk->is_zero);
+
+        list_del_init(&chunk->list);
+        chunk_pin(pmm, chunk);
+    }
+
+    uvm_spin_unlock(&pmm->list_lock);
+
+    return chunk ? root_chunk_from_chunk(pmm, chunk) : NULL;
+}
+
+// Zeroes the whole root chunk on the GPU_INTERNAL CE, after the work still
+// pending on it, and waits for the memset.
+static NV_STATUS zero_pool_zero_root_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_root_chunk_t *root_chunk)
+{
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    uvm_gpu_chunk_t *chunk = &root_chunk->chunk;
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    uvm_gpu_address_t address;
+    uvm_push_t push;
+    NV_STATUS status;
+
+    root_chunk_lock(pmm, root_chunk);
+    uvm_tracker_remove_completed(&root_chunk->tracker);
+    status = uvm_tracker_add_tracker_safe(&tracker, &root_chunk->tracker);
+    root_chunk_unlock(pmm, root_chunk);
+
+    if (status != NV_OK)
+        goto out;
+
+    if (uvm_mmu_gpu_needs_static_vidmem_mapping(gpu))
+        address = uvm_gpu_address_virtual_from_vidmem_phys(gpu, chunk->address);
+    else
+        address = uvm_gpu_address_physical(UVM_APERTURE_VID, chunk->address);
+
+    status = uvm_push_begin_acquire(gpu->channel_manager,
+                                    UVM_CHANNEL_TYPE_GPU_INTERNAL,
+                                    &tracker,
+                                    &push,
+                                    "Zero free root chunk [0x%llx, 0x%llx)",
+                                    chunk->address,
+                                    chunk->address + UVM_CHUNK_SIZE_MAX);
+    if (status != NV_OK)
+        goto out;
+
+    gpu->parent->ce_hal->memset_8(&push, address, 0, UVM_CHUNK_SIZE_MAX);
+
+    status = uvm_push_end_and_wait(&push);
+
+out:
+    uvm_tracker_deinit(&tracker);
+
+    return status;
+}
+
+// Puts a root chunk claimed by zero_pool_claim_root_chunk() back on the free
+// list of its zero state
+static void zero_pool_return_root_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_root_chunk_t *root_chunk, bool is_zero)
+{
+    uvm_gpu_chunk_t *chunk = &root_chunk->chunk;
+
+    uvm_spin_lock(&pmm->list_lock);
+
+    chunk->is_zero = is_zero;
+    chunk_unpin(pmm, chunk, UVM_PMM_GPU_CHUNK_STATE_FREE);
+    chunk_update_lists_locked(pmm, chunk);
+
+    uvm_spin_unlock(&pmm->list_lock);
+}
+
+// Zeroes free root chunks until uvm_pmm_zero_pool (pmm_partition_chunks) are
+// zero, one at a time and only while the GPU has no UVM work pending, so that
+// the memsets don't queue ahead of faults and migrations. Runs on
+// pmm->zeroer.q; the next allocation or free tries again.
+static void background_zero(void *args)
+{
+    uvm_pmm_gpu_t *pmm = (uvm_pmm_gpu_t *)args;
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    uvm_gpu_root_chunk_t *root_chunk;
+    NV_STATUS status;
+
+    while (uvm_channel_manager_update_progress(gpu->channel_manager) == 0) {
+        root_chunk = zero_pool_claim_root_chunk(pmm);
+        if (!root_chunk)
+            break;
+
+        status = zero_pool_zero_root_chunk(pmm, root_chunk);
+        zero_pool_return_root_chunk(pmm, root_chunk, status == NV_OK);
+        if (status != NV_OK)
+            break;
+    }
+}
+
+static void background_zero_kick(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_memory_type_t type)
+{
+    if (!pmm->zeroer.enabled || !uvm_pmm_gpu_memory_type_is_user(type))
+        return;
+
+    // Does nothing if it's already pending
+    nv_kthread_q_schedule_q_item(&pmm->zeroer.q, &pmm->zeroer.q_item);
+}
+
+static NV_STATUS background_zero_init(uvm_pmm_gpu_t *pmm)
+{
+    uvm_gpu_t *gpu = uvm_pmm_to_gpu(pmm);
+    char kthread_name[TASK_COMM_LEN + 1];
+    NV_STATUS status;
+
+    // Chunks that need a dynamic mapping to be addressed are zeroed on
+    // population only
+    if (uvm_pmm_zero_pool == 0 || uvm_mmu_gpu_needs_dynamic_vidmem_mapping(gpu))
+        return NV_OK;
+
+    nv_kthread_q_item_init(&pmm->zeroer.q_item, background_zero, pmm);
+    snprintf(kthread_name, sizeof(kthread_name), "UVM GPU%u ZR", uvm_id_value(gpu->id));
+    status = errno_to_nv_status(nv_kthread_q_init(&pmm->zeroer.q, kthread_name));
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed in nv_kthread_q_init for the zeroer: %s, GPU %s\n",
+                      nvstatusToString(status),
+                      uvm_gpu_name(gpu));
+        return status;
+    }
+
+    pmm->zeroer.enabled = true;
+    return NV_OK;
+}
+
+static void background_zero_deinit(uvm_pmm_gpu_t *pmm)
+{
+    if (!pmm->zeroer.enabled)
+        return;
+
+    pmm->zeroer.enabled = false;
+    nv_kthread_q_stop(&pmm->zeroer.q);
+}
+
 static NV_STATUS alloc_or_evict_root_chunk(uvm_pmm_gpu_t *pmm,
                                            uvm_pmm_gpu_memory_type_t type,
                                            uvm_pmm_alloc_flags_t flags,
@@ -1924,9 +2698,11 @@ static NV_STATUS alloc_or_evict_root_chunk(uvm_pmm_gpu_t *pmm,
     uvm_gpu_chunk_t *chunk;
 
     status = alloc_root_chunk(pmm, type, flags, &chunk);
+    background_evict_kick(pmm, type);
     if (status != NV_OK) {
+        background_compact_kick(pmm, type);
         if ((flags & UVM_PMM_ALLOC_FLAGS_EVICT) && uvm_gpu_supports_eviction(gpu))
-            status = pick_and_evict_root_chunk_retry(pmm, type, PMM_CONTEXT_DEFAULT, chunk_out);
+            status = pick_and_evict_root_chunk_batch(pmm, type, chunk_out);
 
         return status;
     }
@@ -1946,10 +2722,12 @@ static NV_STATUS alloc_or_evict_root_chunk_unlocked(uvm_pmm_gpu_t *pmm,
     uvm_gpu_chunk_t *chunk;
 
     status = alloc_root_chunk(pmm, type, flags, &chunk);
+    background_evict_kick(pmm, type);
     if (status != NV_OK) {
+        background_compact_kick(pmm, type);
         if ((flags & UVM_PMM_ALLOC_FLAGS_EVICT) && uvm_gpu_supports_eviction(gpu)) {
             uvm_mutex_lock(&pmm->lock);
-            status = pick_and_evict_root_chunk_retry(pmm, type, PMM_CONTEXT_DEFAULT, chunk_out);
+            status = pick_and_evict_root_chunk_batch(pmm, type, chunk_out);
             uvm_mutex_unlock(&pmm->lock);
         }
 
@@ -1976,7 +2754,7 @@ static NV_STATUS alloc_chunk_with_splits(uvm_pmm_gpu_t *pmm,
 
     // Check for a free chunk again in case a different thread freed something
     // up while this thread was waiting for the PMM lock.
-    chunk = claim_free_chunk(pmm, type, chunk_size);
+    chunk = claim_free_chunk(pmm, type, chunk_size, flags);
     if (chunk) {
         // A free chunk was claimed, return immediately.
         UVM_ASSERT(check_chunk(pmm, chunk));
@@ -1989,7 +2767,7 @@ static NV_STATUS alloc_chunk_with_splits(uvm_pmm_gpu_t *pmm,
 
     // Look for a bigger free chunk that can be split
     for_each_chunk_size_from(cur_size, chunk_sizes) {
-        chunk = claim_free_chunk(pmm, type, cur_size);
+        chunk = claim_free_chunk(pmm, type, cur_size, flags);
         if (chunk)
             break;
     }
@@ -2058,7 +2836,7 @@ NV_STATUS alloc_chunk(uvm_pmm_gpu_t *pmm,
     NV_STATUS status;
     uvm_gpu_chunk_t *chunk;
 
-    chunk = claim_free_chunk(pmm, type, chunk_size);
+    chunk = claim_free_chunk(pmm, type, chunk_size, flags);
     if (chunk) {
         // A free chunk could be claimed, we are done.
         *out_chunk = chunk;
@@ -2401,6 +3179,9 @@ NV_STATUS split_gpu_chunk(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk)
 
     chunk->state = UVM_PMM_GPU_CHUNK_STATE_IS_SPLIT;
 
+    if (chunk_is_root_chunk(chunk) && uvm_pmm_gpu_memory_type_is_user(chunk->type))
+        pmm->split_root_chunks++;
+
     uvm_spin_unlock(&pmm->list_lock);
 
     return NV_OK;
@@ -3313,7 +4094,9 @@ NV_STATUS uvm_pmm_gpu_init(uvm_pmm_gpu_t *pmm)
     }
     INIT_LIST_HEAD(&pmm->root_chunks.va_block_used);
     INIT_LIST_HEAD(&pmm->root_chunks.va_block_unused);
-    INIT_LIST_HEAD(&pmm->root_chunks.va_block_prioritized);
+    INIT_LIST_HEAD(&pmm->root_chunks.va_block_probation);
+    for (i = 0; i < ARRAY_SIZE(pmm->root_chunks.va_block_prioritized); i++)
+        INIT_LIST_HEAD(&pmm->root_chunks.va_block_prioritized[i]);
 
     uvm_mutex_init(&pmm->lock, UVM_LOCK_ORDER_PMM);
     uvm_init_rwsem(&pmm->pma_lock, UVM_LOCK_ORDER_PMM_PMA);
@@ -3387,6 +4170,18 @@ NV_STATUS uvm_pmm_gpu_init(uvm_pmm_gpu_t *pmm)
             if (status != NV_OK)
                 goto cleanup;
         }
+
+        status = background_evict_init(pmm);
+        if (status != NV_OK)
+            goto cleanup;
+
+        status = background_zero_init(pmm);
+        if (status != NV_OK)
+            goto cleanup;
+
+        status = background_compact_init(pmm);
+        if (status != NV_OK)
+            goto cleanup;
     }
 
     return NV_OK;
@@ -3422,6 +4217,11 @@ void uvm_pmm_gpu_deinit(uvm_pmm_gpu_t *pmm)
     if (!pmm->initialized)
         return;
 
+    // Before anything it could touch goes away
+    background_evict_deinit(pmm);
+    background_zero_deinit(pmm);
+    background_compact_deinit(pmm);
+
     release_free_root_chunks(pmm);
 
     gpu = uvm_pmm_to_gpu(pmm);
@@ -59,6 +59,7 @@
 #include "uvm_linux.h"
 #include "uvm_types.h"
 #include "nv_uvm_types.h"
+#include "nv-kthread-q.h"
 
 typedef enum
 {
@@ -158,7 +159,11 @@ typedef enum
     // Do not use batching in this call if PMA page allocaion is required
     UVM_PMM_ALLOC_FLAGS_DONT_BATCH = (1 << 1),
 
-    UVM_PMM_ALLOC_FLAGS_MASK = (1 << 2) - 1
+    // The caller overwrites the whole chunk, so prefer a non-zero free chunk
+    // and leave the zero ones to the allocations that need them
+    UVM_PMM_ALLOC_FLAGS_NONZERO = (1 << 2),
+
+    UVM_PMM_ALLOC_FLAGS_MASK = (1 << 3) - 1
 } uvm_pmm_alloc_flags_t;
 
 
@@ -191,6 +196,9 @@ static void uvm_pmm_list_zero_checks(void)
 #define UVM_PMM_CHUNK_SPLIT_CACHE_SIZES (ilog2(UVM_PMM_MAX_SUBCHUNKS) + 1)
 #define UVM_CHUNK_SIZE_MASK_SIZE (ilog2(UVM_CHUNK_SIZE_MAX) + 1)
 
+// Eviction levels of prioritized VA ranges, see UVM_SET_PRIORITIZED_LOCATION
+#define UVM_PMM_PRIORITY_LEVELS 4
+
 typedef uvm_chunk_size_t uvm_chunk_sizes_mask_t;
 
 typedef struct uvm_pmm_gpu_chunk_suballoc_struct uvm_pmm_gpu_chunk_suballoc_t;
@@ -279,6 +287,14 @@ typedef struct uvm_gpu_root_chunk_struct
     // We can use a regular processor id because indirect peers are not allowed
     // between partitioned GPUs when SMC is enabled.
     uvm_processor_mask_t indirect_peers_mapped;
+
+    // State of the 2Q eviction policy (uvm_pmm_eviction_policy), protected by
+    // PMM's list_lock. reused is set once the chunk has left the probation
+    // list for va_block_used. referenced is set by access counter
+    // notifications on the chunk's VA block, and cleared when eviction looks
+    // at the chunk.
+    bool reused;
+    bool referenced;
 } uvm_gpu_root_chunk_t;
 
 typedef struct
@@ -348,7 +364,17 @@ typedef struct
         // List of root chunks used by VA blocks
         struct list_head va_block_used;
 
-        struct list_head va_block_prioritized;
+        // With the 2Q eviction policy, root chunks used by VA blocks start
+        // here instead, in FIFO order, and are only moved to va_block_used
+        // once they are referenced. They are evicted before va_block_used, so
+        // a single pass over cold memory doesn't flush the chunks that are
+        // reused.
+        struct list_head va_block_probation;
+
+        // Root chunks of VA ranges with a GPU prioritized location, one LRU
+        // list per priority level. They are evicted after va_block_used,
+        // level 0 first.
+        struct list_head va_block_prioritized[UVM_PMM_PRIORITY_LEVELS];
 
         uvm_gpu_root_chunk_indirect_peer_t indirect_peer[UVM_ID_MAX_GPUS];
     } root_chunks;
@@ -369,6 +395,53 @@ typedef struct
     // to be injected.
     NvU32 inject_pma_evict_error_after_num_chunks;
 
+    // Background eviction. When a user allocation leaves fewer free root
+    // chunks in PMA than uvm_pmm_evict_low_watermark, the queue evicts root
+    // chunks until uvm_pmm_evict_high_watermark are free, so that faults find
+    // free memory instead of evicting synchronously.
+    struct
+    {
+        nv_kthread_q_t q;
+
+        nv_kthread_q_item_t q_item;
+
+        bool enabled;
+    } evictor;
+
+    // Background zeroing. While the GPU has no UVM work pending, the queue
+    // zeroes non-zero free root chunks of user memory until
+    // uvm_pmm_zero_pool of them are zero, so that first touches find zero
+    // chunks instead of zeroing on the fault path.
+    struct
+    {
+        nv_kthread_q_t q;
+
+        nv_kthread_q_item_t q_item;
+
+        bool enabled;
+    } zeroer;
+
+    // Background compaction. When an allocation of user memory has to evict
+    // while at least uvm_pmm_compact_threshold percent of the free user
+    // memory is in split root chunks, the queue evicts the split root chunks
+    // with the most free memory and frees them to PMA, so that allocations
+    // find whole root chunks again and VA blocks get large pages. The pages
+    // evicted come back by fault into unsplit root chunks.
+    struct
+    {
+        nv_kthread_q_t q;
+
+        nv_kthread_q_item_t q_item;
+
+        bool enabled;
+
+        // Root chunks freed to PMA by compaction
+        atomic64_t compacted;
+    } compactor;
+
+    // Number of user root chunks in the split state, protected by list_lock
+    NvU64 split_root_chunks;
+
     // The mask of the initialized chunk sizes
     DECLARE_BITMAP(chunk_split_cache_initialized, UVM_PMM_CHUNK_SPLIT_CACHE_SIZES);
 
@@ -380,6 +453,25 @@ typedef struct
 // Return containing GPU
 uvm_gpu_t *uvm_pmm_to_gpu(uvm_pmm_gpu_t *pmm);
 
+typedef struct
+{
+    // User root chunks split into smaller chunks
+    NvU64 split_root_chunks;
+
+    // Free user memory in chunks smaller than a root chunk
+    NvU64 split_free_bytes;
+
+    // Free user memory in whole root chunks, on the free lists or in PMA
+    NvU64 root_free_bytes;
+
+    // Root chunks compaction freed to PMA
+    NvU64 compacted_root_chunks;
+} uvm_pmm_gpu_fragmentation_t;
+
+// Fragmentation of the user memory of the GPU. Walks the free lists, so it is
+// meant for statistics rather than for hot paths.
+void uvm_pmm_gpu_get_fragmentation(uvm_pmm_gpu_t *pmm, uvm_pmm_gpu_fragmentation_t *fragmentation);
+
 // Initialize PMM on GPU
 NV_STATUS uvm_pmm_gpu_init(uvm_pmm_gpu_t *pmm);
 
@@ -583,7 +675,13 @@ void uvm_pmm_gpu_mark_root_chunk_used(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk
 // Mark an allocated user chunk as unused
 void uvm_pmm_gpu_mark_root_chunk_unused(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
 
-void uvm_pmm_gpu_mark_root_chunk_prioritized(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
+// Report an access to an allocated user chunk to the eviction policy; the
+// chunk isn't moved until the next eviction
+void uvm_pmm_gpu_mark_root_chunk_referenced(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk);
+
+// Mark an allocated user chunk as used by a prioritized VA range of the given
+// level
+void uvm_pmm_gpu_mark_root_chunk_prioritized(uvm_pmm_gpu_t *pmm, uvm_gpu_chunk_t *chunk, NvU32 level);
 
 static bool uvm_gpu_chunk_same_root(uvm_gpu_chunk_t *chunk1, uvm_gpu_chunk_t *chunk2)
 {
@@ -33,18 +33,188 @@ MODULE_PARM_DESC(uvm_cpu_chunk_allocation_sizes, "OR'ed value of all CPU chunk a
 
 static struct kmem_cache *g_reverse_page_map_cache __read_mostly;
 
+// Order-0 CPU pages kept allocated for migrations to sysmem of pages resident
+// elsewhere, evictions included, so that their copies don't wait on the page
+// allocator, see g_cpu_page_pool. 0 disables it.
+static unsigned uvm_cpu_evict_pool_pages = 0;
+module_param(uvm_cpu_evict_pool_pages, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_cpu_evict_pool_pages,
+                 "CPU pages UVM keeps allocated in the background for evictions and other copies "
+                 "to sysmem (0 disables it). Pages taken from it are not charged to the memory "
+                 "cgroup of the process. Default: 0.");
+
+// Pages of uvm_cpu_evict_pool_pages, linked through page->lru. The refill
+// worker allocates them, on the node of the last allocation that asked for
+// one, and frees those left on another node.
+static struct
+{
+    uvm_spinlock_t lock;
+    struct list_head pages;
+    unsigned count;
+    int node;
+    nv_kthread_q_t q;
+    nv_kthread_q_item_t q_item;
+    bool enabled;
+} g_cpu_page_pool;
+
+static void cpu_page_pool_refill(void *args)
+{
+    struct page *page, *next;
+    LIST_HEAD(stale);
+    int node;
+
+    uvm_spin_lock(&g_cpu_page_pool.lock);
+    node = g_cpu_page_pool.node;
+    if (node != NUMA_NO_NODE) {
+        list_for_each_entry_safe(page, next, &g_cpu_page_pool.pages, lru) {
+            if (page_to_nid(page) != node) {
+                list_move(&page->lru, &stale);
+                g_cpu_page_pool.count--;
+            }
+        }
+    }
+    uvm_spin_unlock(&g_cpu_page_pool.lock);
+
+    list_for_each_entry_safe(page, next, &stale, lru) {
+        list_del(&page->lru);
+        __free_page(page);
+    }
+
+    while (READ_ONCE(g_cpu_page_pool.count) < uvm_cpu_evict_pool_pages) {
+        // Filling the pool isn't worth reclaiming for, the allocations it
+        // serves fall back to the allocator
+        gfp_t flags = NV_UVM_GFP_FLAGS | GFP_HIGHUSER | __GFP_NORETRY | __GFP_NOWARN;
+
+        if (node == NUMA_NO_NODE)
+            page = alloc_page(flags);
+        else
+            page = alloc_pages_node(node, flags, 0);
+        if (!page)
+            break;
+
+        uvm_spin_lock(&g_cpu_page_pool.lock);
+        list_add(&page->lru, &g_cpu_page_pool.pages);
+        g_cpu_page_pool.count++;
+        uvm_spin_unlock(&g_cpu_page_pool.lock);
+    }
+}
+
+// A page of the pool on node, any node for NUMA_NO_NODE, or NULL
+static struct page *cpu_page_pool_take(int node)
+{
+    struct page *page = NULL;
+
+    if (!g_cpu_page_pool.enabled)
+        return NULL;
+
+    uvm_spin_lock(&g_cpu_page_pool.lock);
+    if (node != NUMA_NO_NODE)
+        g_cpu_page_pool.node = node;
+    if (!list_empty(&g_cpu_page_pool.pages)) {
+        page = list_first_entry(&g_cpu_page_pool.pages, struct page, lru);
+        if (node == NUMA_NO_NODE || page_to_nid(page) == node) {
+            list_del(&page->lru);
+            g_cpu_page_pool.count--;
+        }
+        else {
+            page = NULL;
+        }
+    }
+    uvm_spin_unlock(&g_cpu_page_pool.lock);
+
+    // Does nothing if it's already pending
+    nv_kthread_q_schedule_q_item(&g_cpu_page_pool.q, &g_cpu_page_pool.q_item);
+
+    return page;
+}
+
+static NV_STATUS cpu_page_pool_init(void)
+{
+    NV_STATUS status;
+
+    uvm_spin_lock_init(&g_cpu_page_pool.lock, UVM_LOCK_ORDER_LEAF);
+    INIT_LIST_HEAD(&g_cpu_page_pool.pages);
+    g_cpu_page_pool.node = NUMA_NO_NODE;
+
+    if (uvm_cpu_evict_pool_pages == 0)
+        return NV_OK;
+
+    nv_kthread_q_item_init(&g_cpu_page_pool.q_item, cpu_page_pool_refill, NULL);
+    status = errno_to_nv_status(nv_kthread_q_init(&g_cpu_page_pool.q, "UVM CPU pool"));
+    if (status != NV_OK) {
+        UVM_ERR_PRINT("Failed in nv_kthread_q_init for the CPU page pool: %s\n", nvstatusToString(status));
+        return status;
+    }
+
+    g_cpu_page_pool.enabled = true;
+    nv_kthread_q_schedule_q_item(&g_cpu_page_pool.q, &g_cpu_page_pool.q_item);
+
+    return NV_OK;
+}
+
+static void cpu_page_pool_deinit(void)
+{
+    struct page *page, *next;
+
+    if (!g_cpu_page_pool.enabled)
+        return;
+
+    g_cpu_page_pool.enabled = false;
+    nv_kthread_q_stop(&g_cpu_page_pool.q);
+
+    list_for_each_entry_safe(page, next, &g_cpu_page_pool.pages, lru) {
+        list_del(&page->lru);
+        __free_page(page);
+    }
+    g_cpu_page_pool.count = 0;
+}
+
+// On the node the range of the block allocates its CPU pages on, see
+// UVM_POLICY_BATCH_HOST_NODE, or else the one of its VA space, see
+// UVM_SET_HOST_NUMA_NODE. Like alloc_pages, falls back to other nodes. Single
+// pages that needn't be zeroed come from g_cpu_page_pool when it has one.
+static struct page *cpu_chunk_alloc_pages(uvm_va_block_t *va_block, gfp_t alloc_flags, unsigned order)
+{
+    int node = NUMA_NO_NODE;
+
+    if (!uvm_va_block_is_hmm(va_block))
+        node = READ_ONCE(uvm_va_range_get_policy(va_block->va_range)->host_numa_node);
+    if (node == NUMA_NO_NODE)
+        node = READ_ONCE(uvm_va_block_get_va_space(va_block)->host_numa_node);
+
+    if (order == 0 && !(alloc_flags & __GFP_ZERO)) {
+        struct page *page = cpu_page_pool_take(node);
+        if (page)
+            return page;
+    }
+
+    if (node == NUMA_NO_NODE)
+        return alloc_pages(alloc_flags, order);
+
+    return alloc_pages_node(node, alloc_flags, order);
+}
+
 NV_STATUS uvm_pmm_sysmem_init(void)
 {
+    NV_STATUS status;
+
     g_reverse_page_map_cache = NV_KMEM_CACHE_CREATE("uvm_pmm_sysmem_page_reverse_map_t",
                                                     uvm_reverse_map_t);
     if (!g_reverse_page_map_cache)
         return NV_ERR_NO_MEMORY;
 
+    status = cpu_page_pool_init();
+    if (status != NV_OK) {
+        kmem_cache_destroy_safe(&g_reverse_page_map_cache);
+        return status;
+    }
+
     return NV_OK;
 }
 
 void uvm_pmm_sysmem_exit(void)
 {
+    cpu_page_pool_deinit();
     kmem_cache_destroy_safe(&g_reverse_page_map_cache);
 }
 
@@ -533,6 +703,9 @@ void uvm_cpu_chunk_remove_from_block(uvm_va_block_t *va_block, uvm_cpu_chunk_t *
     UVM_ASSERT(((uvm_cpu_chunk_t **)va_block->cpu.chunks)[page_index] != NULL);
     ((uvm_cpu_chunk_t **)va_block->cpu.chunks)[page_index] = NULL;
     uvm_page_mask_clear(&va_block->cpu.allocated, page_index);
+
+    // The page leaves the contiguous run, if any
+    va_block->cpu.contig = false;
 }
 
 uvm_cpu_chunk_t *uvm_cpu_chunk_get_chunk_for_page(uvm_va_block_t *va_block, uvm_page_index_t page_index)
@@ -561,7 +734,7 @@ NV_STATUS uvm_cpu_chunk_alloc(uvm_va_block_t *va_block,
     if (!uvm_va_block_page_resident_processors_count(va_block, page_index))
         alloc_flags |= __GFP_ZERO;
 
-    chunk = alloc_pages(alloc_flags, 0);
+    chunk = cpu_chunk_alloc_pages(va_block, alloc_flags, 0);
     if (!chunk)
         return NV_ERR_NO_MEMORY;
 
@@ -578,6 +751,57 @@ NV_STATUS uvm_cpu_chunk_alloc(uvm_va_block_t *va_block,
     return NV_OK;
 }
 
+NV_STATUS uvm_cpu_chunk_alloc_contig(uvm_va_block_t *va_block, struct mm_struct *mm)
+{
+    const unsigned order = get_order(UVM_PAGE_SIZE_2M);
+    size_t num_pages = uvm_va_block_num_cpu_pages(va_block);
+    uvm_page_index_t page_index;
+    struct page *page;
+    gfp_t alloc_flags;
+    NV_STATUS status;
+
+    UVM_ASSERT(uvm_va_block_size(va_block) == UVM_PAGE_SIZE_2M);
+    UVM_ASSERT(uvm_page_mask_empty(&va_block->cpu.allocated));
+
+    // No __GFP_NORETRY: unlike the opportunistic large allocations, the range
+    // asked for the run, so let the kernel compact memory for it
+    alloc_flags = (mm ? NV_UVM_GFP_FLAGS_ACCOUNT : NV_UVM_GFP_FLAGS) | GFP_HIGHUSER;
+
+    for (page_index = 0; page_index < num_pages; page_index++) {
+        if (!uvm_va_block_page_resident_processors_count(va_block, page_index)) {
+            alloc_flags |= __GFP_ZERO;
+            break;
+        }
+    }
+
+    page = cpu_chunk_alloc_pages(va_block, alloc_flags, order);
+    if (!page)
+        return NV_ERR_NO_MEMORY;
+
+    // Turn the run into order-0 pages, each with its own reference
+    split_page(page, order);
+
+    for (page_index = 0; page_index < num_pages; page_index++) {
+        if (alloc_flags & __GFP_ZERO)
+            SetPageDirty(page + page_index);
+
+        status = uvm_cpu_chunk_insert_in_block(va_block, page + page_index, page_index);
+        if (status != NV_OK)
+            goto error;
+    }
+
+    return NV_OK;
+
+error:
+    while (page_index-- > 0)
+        uvm_cpu_chunk_remove_from_block(va_block, page + page_index, page_index);
+
+    for (page_index = 0; page_index < num_pages; page_index++)
+        uvm_cpu_chunk_put(page + page_index);
+
+    return status;
+}
+
 #else
 
 struct page *uvm_cpu_chunk_get_cpu_page(uvm_va_block_t *va_block, uvm_cpu_chunk_t *chunk, uvm_page_index_t page_index)
@@ -1164,7 +1388,7 @@ NV_STATUS uvm_cpu_chunk_alloc(uvm_va_block_t *va_block,
         if (!uvm_page_mask_region_full(&zero_page_mask, region))
             alloc_flags |= __GFP_ZERO;
 
-        page = alloc_pages(alloc_flags, get_order(alloc_size));
+        page = cpu_chunk_alloc_pages(va_block, alloc_flags, get_order(alloc_size));
         if (page) {
             if (alloc_flags & __GFP_ZERO)
                 SetPageDirty(page);
@@ -1426,6 +1650,11 @@ bool uvm_cpu_chunk_is_dirty(uvm_cpu_chunk_t *chunk, uvm_page_index_t page_index)
 
     return dirty;
 }
+NV_STATUS uvm_cpu_chunk_alloc_contig(uvm_va_block_t *va_block, struct mm_struct *mm)
+{
+    return NV_ERR_NOT_SUPPORTED;
+}
+
 #endif // !UVM_CPU_CHUNK_SIZE_IS_PAGE_SIZE()
 
 uvm_cpu_chunk_t *uvm_cpu_chunk_first_in_block(uvm_va_block_t *va_block, uvm_page_index_t *out_page_index)
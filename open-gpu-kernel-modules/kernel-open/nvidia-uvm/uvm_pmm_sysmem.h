@@ -283,6 +283,14 @@ NV_STATUS uvm_cpu_chunk_alloc(uvm_va_block_t *va_block,
                               struct mm_struct *mm,
                               uvm_cpu_chunk_t **new_chunk);
 
+// Allocates all the CPU pages of a 2MB VA block with no CPU pages yet as one
+// physically contiguous run and inserts them in the block, without mapping
+// them on any GPU. Only used when CPU chunks are PAGE_SIZE: the pages of the
+// run are independent chunks and are freed one by one. NV_ERR_NOT_SUPPORTED
+// if CPU chunks can be larger, in which case uvm_cpu_chunk_alloc() already
+// tries 2MB first.
+NV_STATUS uvm_cpu_chunk_alloc_contig(uvm_va_block_t *va_block, struct mm_struct *mm);
+
 // Insert a CPU chunk in the va_block's storage structures.
 //
 // On success, NV_OK is returned. On error,
@@ -32,6 +32,15 @@
 
 #include "uvm_gpu_access_counters.h"
 
+// Epochs of the VA space after which a range prioritized on a GPU that counts
+// its accesses, and for which no access counter notification came, has its
+// chunks put on the LRU lists. Ranges are swept every half of it, at the
+// epoch advances of UVM_SET_NEXT_USE.
+static unsigned uvm_perf_prioritized_idle_epochs = 16;
+module_param(uvm_perf_prioritized_idle_epochs, uint, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_prioritized_idle_epochs,
+                 "Epochs without access counter notifications after which prioritized ranges are demoted (0 never demotes, default 16).");
+
 bool uvm_is_valid_vma_range(struct mm_struct *mm, NvU64 start, NvU64 length)
 {
     const NvU64 end = start + length;
@@ -150,6 +159,41 @@ static NV_STATUS split_span_as_needed(uvm_va_space_t *va_space,
     return split_as_needed(va_space, end_addr, split_needed_cb, data);
 }
 
+// Whether split_span_as_needed() would split a managed va_range for
+// [start_addr, end_addr), which only needs the va_space lock in read mode. A
+// span starting outside the managed va_ranges counts as needing a split, its
+// HMM policy nodes are looked up in write mode.
+static bool split_span_is_needed(uvm_va_space_t *va_space,
+                                 NvU64 start_addr,
+                                 NvU64 end_addr,
+                                 uvm_va_policy_is_split_needed_t split_needed_cb,
+                                 void *data)
+{
+    NvU64 addrs[] = { start_addr, end_addr };
+    uvm_va_range_t *va_range;
+    size_t i;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    for (i = 0; i < ARRAY_SIZE(addrs); i++) {
+        va_range = uvm_va_range_find(va_space, addrs[i]);
+        if (!va_range) {
+            if (i == 0)
+                return true;
+            continue;
+        }
+
+        if (addrs[i] == va_range->node.start)
+            continue;
+
+        if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED ||
+            split_needed_cb(uvm_va_range_get_policy(va_range), data))
+            return true;
+    }
+
+    return false;
+}
+
 static bool ingore_notification_is_split_needed(uvm_va_policy_t *policy, void *data)
 {
     bool ignore_ac_notification;
@@ -160,14 +204,21 @@ static bool ingore_notification_is_split_needed(uvm_va_policy_t *policy, void *d
     return (ignore_ac_notification != policy->ignore_ac_notification);
 }
 
-static bool prioritized_location_is_split_needed(uvm_va_policy_t *policy, void *data)
+typedef struct
 {
     uvm_processor_id_t processor_id;
+    NvU32 level;
+} prioritized_location_t;
+
+static bool prioritized_location_is_split_needed(uvm_va_policy_t *policy, void *data)
+{
+    prioritized_location_t *prioritized;
 
     UVM_ASSERT(data);
 
-    processor_id = *(uvm_processor_id_t*)data;
-    return !uvm_id_equal(processor_id, policy->prioritized_location);
+    prioritized = (prioritized_location_t*)data;
+    return !uvm_id_equal(prioritized->processor_id, policy->prioritized_location) ||
+           prioritized->level != policy->prioritized_level;
 }
 
 static bool preferred_location_is_split_needed(uvm_va_policy_t *policy, void *data)
@@ -286,29 +337,37 @@ static NV_STATUS ignore_region_set(uvm_va_space_t *va_space,
     return NV_OK;
   }
 
-  /* return uvm_hmm_set_prioritized_location(va_space, prioritized_location,
-   * base, last_address); */
-  return NV_OK;
+  return uvm_hmm_set_no_migrate(va_space, ignore_ac_notification, base,
+                                last_address);
+}
+
+static bool quick_migrate_is_split_needed(uvm_va_policy_t *policy, void *data)
+{
+    bool quick_migrate;
+
+    UVM_ASSERT(data);
+
+    quick_migrate = *(bool*)data;
+    return (quick_migrate != policy->quick_migrate);
 }
 
 static NV_STATUS quick_migration_set(uvm_va_space_t *va_space,
                                         struct mm_struct *mm,
                                         NvU64 base,
-                                        NvU64 length)
+                                        NvU64 length,
+                                        bool quick_migrate)
 {
     uvm_va_range_t *va_range, *va_range_last;
     const NvU64 last_address = base + length - 1;
     NV_STATUS status;
 
-    uvm_assert_rwsem_locked_write(&va_space->lock);
+    uvm_assert_rwsem_locked(&va_space->lock);
 
     va_range_last = NULL;
     uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
-        bool found_non_migratable_interval = false;
-
         va_range_last = va_range;
 
-        status = uvm_va_range_set_quick_migrate(va_range, true);//  , mm, out_tracker);
+        status = uvm_va_range_set_quick_migrate(va_range, quick_migrate);//  , mm, out_tracker);
         if (status != NV_OK)
             return status;
     }
@@ -318,21 +377,43 @@ static NV_STATUS quick_migration_set(uvm_va_space_t *va_space,
         return NV_OK;
     }
 
-    return NV_OK;
+    // Managed ranges are never split for quick migrate, the whole va_range
+    // takes it; HMM policy nodes follow the requested range exactly.
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+    status = split_span_as_needed(va_space,
+                                  base,
+                                  last_address + 1,
+                                  quick_migrate_is_split_needed,
+                                  &quick_migrate);
+    if (status != NV_OK)
+        return status;
+
+    return uvm_hmm_set_quick_migrate(va_space, quick_migrate, base, last_address);
+}
+
+// Whether quick_migration_set() can run with the va_space lock in read mode:
+// the span starts in a managed va_range, whose flags are all that changes
+static bool quick_migration_is_read_safe(uvm_va_space_t *va_space, NvU64 base)
+{
+    uvm_va_range_t *va_range = uvm_va_range_find(va_space, base);
+
+    return va_range && va_range->type == UVM_VA_RANGE_TYPE_MANAGED;
 }
 
 static NV_STATUS prioritized_location_set(uvm_va_space_t *va_space,
                                         struct mm_struct *mm,
                                         NvU64 base,
                                         NvU64 length,
-                                        uvm_processor_id_t prioritized_location)
+                                        uvm_processor_id_t prioritized_location,
+                                        NvU32 level)
 {
     uvm_va_range_t *va_range, *va_range_last;
     const NvU64 last_address = base + length - 1;
     bool prioritized_location_is_faultable_gpu = false;
+    prioritized_location_t prioritized = { prioritized_location, level };
     NV_STATUS status;
 
-    uvm_assert_rwsem_locked_write(&va_space->lock);
+    uvm_assert_rwsem_locked(&va_space->lock);
 
     if (UVM_ID_IS_VALID(prioritized_location)) {
         /* *first_va_range_to_migrate = NULL; */
@@ -341,13 +422,16 @@ static NV_STATUS prioritized_location_set(uvm_va_space_t *va_space,
                     prioritized_location);
     }
 
-    status = split_span_as_needed(va_space,
-            base,
-            last_address + 1,
-            prioritized_location_is_split_needed,
-            &prioritized_location);
-    if (status != NV_OK)
-        return status;
+    // In read mode the caller checked that there is nothing to split
+    if (split_span_is_needed(va_space, base, last_address + 1, prioritized_location_is_split_needed, &prioritized)) {
+        status = split_span_as_needed(va_space,
+                base,
+                last_address + 1,
+                prioritized_location_is_split_needed,
+                &prioritized);
+        if (status != NV_OK)
+            return status;
+    }
 
     va_range_last = NULL;
     uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
@@ -357,7 +441,7 @@ static NV_STATUS prioritized_location_set(uvm_va_space_t *va_space,
 
         // If we didn't split the ends, check that they match
         if (va_range->node.start < base || va_range->node.end > last_address)
-            UVM_ASSERT(uvm_id_equal(uvm_va_range_get_policy(va_range)->prioritized_location, prioritized_location));
+            UVM_ASSERT(!prioritized_location_is_split_needed(uvm_va_range_get_policy(va_range), &prioritized));
 
         if (UVM_ID_IS_VALID(prioritized_location)) {
             const NvU64 start = max(base, va_range->node.start);
@@ -369,7 +453,7 @@ static NV_STATUS prioritized_location_set(uvm_va_space_t *va_space,
                 return NV_ERR_INVALID_DEVICE;
         }
 
-        status = uvm_va_range_set_prioritized_location(va_range, prioritized_location);//  , mm, out_tracker);
+        status = uvm_va_range_set_prioritized_location(va_range, prioritized_location, level);//  , mm, out_tracker);
         if (status != NV_OK)
             return status;
 
@@ -385,8 +469,21 @@ static NV_STATUS prioritized_location_set(uvm_va_space_t *va_space,
         return NV_OK;
     }
 
-    /* return uvm_hmm_set_prioritized_location(va_space, prioritized_location, base, last_address); */
-    return NV_OK;
+    return uvm_hmm_set_prioritized_location(va_space, prioritized_location, level, base, last_address);
+}
+
+// Whether prioritized_location_set() can run with the va_space lock in read
+// mode: the span is in managed va_ranges and splits none of them
+static bool prioritized_location_is_read_safe(uvm_va_space_t *va_space,
+                                              NvU64 base,
+                                              NvU64 length,
+                                              uvm_processor_id_t prioritized_location,
+                                              NvU32 level)
+{
+    prioritized_location_t prioritized = { prioritized_location, level };
+
+    return quick_migration_is_read_safe(va_space, base) &&
+           !split_span_is_needed(va_space, base, base + length, prioritized_location_is_split_needed, &prioritized);
 }
 
 static NV_STATUS preferred_location_set(uvm_va_space_t *va_space,
@@ -459,8 +556,6 @@ static NV_STATUS preferred_location_set(uvm_va_space_t *va_space,
 
 NV_STATUS uvm_api_set_preferred_location(const UVM_SET_PREFERRED_LOCATION_PARAMS *params, struct file *filp)
 {
-  pr_alert("setting prefferred location\n");
-
   /* return NV_OK; */
     NV_STATUS status;
     NV_STATUS tracker_status;
@@ -524,14 +619,12 @@ NV_STATUS uvm_api_set_preferred_location(const UVM_SET_PREFERRED_LOCATION_PARAMS
 
     // No VA range to migrate, early exit
     if (!first_va_range_to_migrate){
-    pr_alert("NOT needing to migrate\n");
         goto done;
     }
 
     uvm_va_space_downgrade_write(va_space);
     has_va_space_write_lock = false;
 
-    pr_alert("needing to migrate\n");
     // No need to check for holes in the VA ranges span here, this was checked by preferred_location_set
     for (va_range = first_va_range_to_migrate; va_range; va_range = uvm_va_space_iter_next(va_range, end)) {
         uvm_range_group_range_iter_t iter;
@@ -560,6 +653,615 @@ done:
     return status == NV_OK ? tracker_status : status;
 }
 
+NV_STATUS uvm_api_set_prefetch_stride(const UVM_SET_PREFETCH_STRIDE_PARAMS *params, struct file *filp)
+{
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    uvm_va_range_t *va_range;
+    struct mm_struct *mm;
+    const NvU64 start = params->requestedBase;
+    const NvU64 length = params->length;
+    const NvU64 end = start + length - 1;
+
+    UVM_ASSERT(va_space);
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    status = uvm_api_range_type_check(va_space, mm, start, length);
+    if (status != NV_OK) {
+        // Nothing to prefetch across blocks on ATS ranges
+        if (status == NV_WARN_NOTHING_TO_DO)
+            status = NV_OK;
+        goto done;
+    }
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, start, end) {
+        status = uvm_va_range_set_prefetch_stride(va_range, params->stride);
+        if (status != NV_OK)
+            break;
+    }
+
+done:
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    return status;
+}
+
+static NV_STATUS access_pattern_set(uvm_va_space_t *va_space,
+                                   struct mm_struct *mm,
+                                   NvU64 base,
+                                   NvU64 length,
+                                   NvU32 pattern,
+                                   NvS64 stride,
+                                   NvU64 span,
+                                   NvU32 flags)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (pattern >= UVM_ACCESS_PATTERN_COUNT || (flags & ~UVM_ACCESS_PATTERN_FLAGS_ALL))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // A range can't be both
+    if ((flags & UVM_ACCESS_PATTERN_FLAG_READ_ONLY) && (flags & UVM_ACCESS_PATTERN_FLAG_WRITE_MOSTLY))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    status = uvm_api_range_type_check(va_space, mm, base, length);
+    if (status != NV_OK) {
+        // The heuristics using the descriptor only run on managed ranges
+        return status == NV_WARN_NOTHING_TO_DO ? NV_OK : status;
+    }
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_access_pattern(va_range, pattern, stride, span, flags);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_set_access_pattern(const UVM_SET_ACCESS_PATTERN_PARAMS *params, struct file *filp)
+{
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct mm_struct *mm;
+
+    UVM_ASSERT(va_space);
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    status = access_pattern_set(va_space,
+                                mm,
+                                params->requestedBase,
+                                params->length,
+                                params->pattern,
+                                params->stride,
+                                params->span,
+                                params->flags);
+
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    return status;
+}
+
+static NV_STATUS discardable_set(uvm_va_space_t *va_space, NvU64 base, NvU64 length, bool discardable)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_discardable(va_range, discardable);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_set_discardable(const UVM_SET_DISCARDABLE_PARAMS *params, struct file *filp)
+{
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct mm_struct *mm;
+
+    UVM_ASSERT(va_space);
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    status = uvm_api_range_type_check(va_space, mm, params->requestedBase, params->length);
+    if (status == NV_OK)
+        status = discardable_set(va_space, params->requestedBase, params->length, params->discardable);
+    else if (status == NV_WARN_NOTHING_TO_DO)
+        // ATS ranges aren't evicted by UVM
+        status = NV_OK;
+
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    return status;
+}
+
+static bool lease_is_split_needed(uvm_va_policy_t *policy, void *data)
+{
+    UVM_ASSERT(data);
+
+    return *(NvU64 *)data != policy->lease_expiry;
+}
+
+static NV_STATUS lease_set(uvm_va_space_t *va_space, NvU64 base, NvU64 length, NvU32 epochs)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NvU64 expiry = epochs == 0 ? 0 : atomic64_read(&va_space->next_use_epoch) + epochs;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    status = split_span_as_needed(va_space, base, last_address + 1, lease_is_split_needed, &expiry);
+    if (status != NV_OK)
+        return status;
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_lease(va_range, expiry);
+        if (status != NV_OK)
+            return status;
+    }
+
+    if (expiry != 0 && expiry < va_space->lease_next_expiry)
+        va_space->lease_next_expiry = expiry;
+
+    return NV_OK;
+}
+
+// Expires the leases that ran out by the current epoch
+static void lease_expire(uvm_va_space_t *va_space)
+{
+    const NvU64 epoch = atomic64_read(&va_space->next_use_epoch);
+    uvm_va_range_t *va_range;
+    NvU64 expiry;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (epoch < va_space->lease_next_expiry)
+        return;
+
+    va_space->lease_next_expiry = NV_U64_MAX;
+
+    uvm_for_each_va_range(va_range, va_space) {
+        if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED)
+            continue;
+
+        expiry = uvm_va_range_get_policy(va_range)->lease_expiry;
+        if (expiry == 0)
+            continue;
+
+        if (expiry <= epoch)
+            uvm_va_range_expire_lease(va_range);
+        else if (expiry < va_space->lease_next_expiry)
+            va_space->lease_next_expiry = expiry;
+    }
+}
+
+// Demotes the GPU prioritized ranges without a notification in the last
+// uvm_perf_prioritized_idle_epochs. Ranges on GPUs without access counters
+// enabled are left alone, nothing would ever come for them.
+static void prioritized_demote_idle(uvm_va_space_t *va_space)
+{
+    const NvU64 epoch = atomic64_read(&va_space->next_use_epoch);
+    uvm_va_range_t *va_range;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (uvm_perf_prioritized_idle_epochs == 0 || epoch < va_space->prioritized_next_sweep)
+        return;
+
+    va_space->prioritized_next_sweep = epoch + max(uvm_perf_prioritized_idle_epochs / 2, 1u);
+
+    if (uvm_processor_mask_empty(&va_space->access_counters_enabled_processors))
+        return;
+
+    uvm_for_each_va_range(va_range, va_space) {
+        uvm_processor_id_t prioritized_location;
+
+        if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED || va_range->managed.ac_demoted)
+            continue;
+
+        prioritized_location = uvm_va_range_get_policy(va_range)->prioritized_location;
+        if (!UVM_ID_IS_VALID(prioritized_location) || !UVM_ID_IS_GPU(prioritized_location))
+            continue;
+
+        if (!uvm_processor_mask_test(&va_space->access_counters_enabled_processors, prioritized_location))
+            continue;
+
+        if (READ_ONCE(va_range->managed.ac_epoch) + uvm_perf_prioritized_idle_epochs <= epoch)
+            uvm_va_range_demote_prioritized(va_range);
+    }
+}
+
+static NV_STATUS next_use_set(uvm_va_space_t *va_space, NvU64 base, NvU64 length, NvU64 next_use)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_next_use(va_range, next_use);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_set_next_use(const UVM_SET_NEXT_USE_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_NEXT_USE_ENTRY *entries = NULL;
+    struct mm_struct *mm;
+    NV_STATUS status = NV_OK;
+    NvU32 i;
+
+    UVM_ASSERT(va_space);
+
+    if (params->count > UVM_NEXT_USE_MAX_ENTRIES)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // Entries are staged in kernel memory so that the user copies don't happen
+    // with the va_space lock held.
+    if (params->count > 0) {
+        entries = uvm_kvmalloc(params->count * sizeof(*entries));
+        if (!entries)
+            return NV_ERR_NO_MEMORY;
+
+        if (nv_copy_from_user(entries, (void __user *)params->entries, params->count * sizeof(*entries))) {
+            uvm_kvfree(entries);
+            return NV_ERR_INVALID_ADDRESS;
+        }
+    }
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    if (params->epoch > atomic64_read(&va_space->next_use_epoch)) {
+        atomic64_set(&va_space->next_use_epoch, params->epoch);
+        lease_expire(va_space);
+        prioritized_demote_idle(va_space);
+    }
+
+    for (i = 0; i < params->count; i++) {
+        status = uvm_api_range_type_check(va_space, mm, entries[i].base, entries[i].length);
+        if (status == NV_OK)
+            status = next_use_set(va_space, entries[i].base, entries[i].length, entries[i].nextUse);
+        else if (status == NV_WARN_NOTHING_TO_DO)
+            // ATS ranges aren't evicted by UVM
+            status = NV_OK;
+
+        if (status != NV_OK)
+            break;
+    }
+
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    uvm_kvfree(entries);
+
+    return status;
+}
+
+static NV_STATUS host_huge_pages_set(uvm_va_space_t *va_space, NvU64 base, NvU64 length, bool host_huge_pages)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_host_huge_pages(va_range, host_huge_pages);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+static NV_STATUS host_node_set(uvm_va_space_t *va_space, NvU64 base, NvU64 length, NvU32 value)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    int node = (int)value - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (value != 0 && (value > MAX_NUMNODES || !node_online(node)))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_host_numa_node(va_range, value == 0 ? NUMA_NO_NODE : node);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_set_host_huge_pages(const UVM_SET_HOST_HUGE_PAGES_PARAMS *params, struct file *filp)
+{
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct mm_struct *mm;
+
+    UVM_ASSERT(va_space);
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    status = uvm_api_range_type_check(va_space, mm, params->requestedBase, params->length);
+    if (status == NV_OK)
+        status = host_huge_pages_set(va_space, params->requestedBase, params->length, params->hostHugePages);
+    else if (status == NV_WARN_NOTHING_TO_DO)
+        // ATS ranges are backed by the kernel's own pages
+        status = NV_OK;
+
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    return status;
+}
+
+static NV_STATUS access_counter_policy_set(uvm_va_space_t *va_space,
+                                           NvU64 base,
+                                           NvU64 length,
+                                           NvU32 threshold,
+                                           NvU64 granularity)
+{
+    uvm_va_range_t *va_range;
+    const NvU64 last_address = base + length - 1;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (granularity != 0 &&
+        (!is_power_of_2(granularity) || granularity < PAGE_SIZE ||
+         granularity > UVM_ACCESS_COUNTER_GRANULARITY_MAX))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    uvm_for_each_managed_va_range_in_contig(va_range, va_space, base, last_address) {
+        status = uvm_va_range_set_access_counter_policy(va_range, threshold, (NvU32)granularity);
+        if (status != NV_OK)
+            return status;
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_set_access_counter_policy(const UVM_SET_ACCESS_COUNTER_POLICY_PARAMS *params, struct file *filp)
+{
+    NV_STATUS status;
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    struct mm_struct *mm;
+
+    UVM_ASSERT(va_space);
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+    uvm_va_space_down_write(va_space);
+
+    status = uvm_api_range_type_check(va_space, mm, params->requestedBase, params->length);
+    if (status == NV_OK) {
+        status = access_counter_policy_set(va_space,
+                                           params->requestedBase,
+                                           params->length,
+                                           params->threshold,
+                                           params->granularity);
+    }
+    else if (status == NV_WARN_NOTHING_TO_DO) {
+        // ATS ranges aren't migrated by UVM access counters
+        status = NV_OK;
+    }
+
+    uvm_va_space_up_write(va_space);
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    return status;
+}
+
+// Translates the UUID of a prioritized location into a processor that can
+// address [start, start + length)
+static NV_STATUS prioritized_location_id_get(uvm_va_space_t *va_space,
+                                             const NvProcessorUuid *uuid,
+                                             NvU64 start,
+                                             NvU64 length,
+                                             uvm_processor_id_t *out_id)
+{
+    uvm_gpu_t *gpu;
+
+    if (uvm_uuid_is_cpu(uuid)) {
+        *out_id = UVM_ID_CPU;
+        return NV_OK;
+    }
+
+    gpu = uvm_va_space_get_gpu_by_uuid(va_space, uuid);
+    if (!gpu)
+        return NV_ERR_INVALID_DEVICE;
+    if (!uvm_gpu_can_address(gpu, start, length))
+        return NV_ERR_OUT_OF_RANGE;
+
+    *out_id = gpu->id;
+    return NV_OK;
+}
+
+// Priorities are 1-based, 0 is the highest
+static NV_STATUS prioritized_level_get(NvU32 priority, NvU32 *out_level)
+{
+    if (priority > UVM_PMM_PRIORITY_LEVELS)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    *out_level = priority == 0 ? UVM_PMM_PRIORITY_LEVELS - 1 : priority - 1;
+    return NV_OK;
+}
+
+bool uvm_policy_batch_entry_is_read_safe(uvm_va_space_t *va_space, const UVM_POLICY_BATCH_ENTRY *entry)
+{
+    uvm_processor_id_t id;
+    NvU32 level;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    switch (entry->op) {
+        case UVM_POLICY_BATCH_QUICK_MIGRATE:
+            return quick_migration_is_read_safe(va_space, entry->base);
+        case UVM_POLICY_BATCH_PRIORITIZED_LOCATION:
+            // An entry that fails these fails before changing anything
+            if (prioritized_level_get(entry->value, &level) != NV_OK ||
+                prioritized_location_id_get(va_space, &entry->location, entry->base, entry->length, &id) != NV_OK)
+                return true;
+
+            return prioritized_location_is_read_safe(va_space, entry->base, entry->length, id, level);
+        default:
+            return false;
+    }
+}
+
+// Applies one entry of UVM_SET_POLICY_BATCH
+NV_STATUS uvm_policy_batch_apply(uvm_va_space_t *va_space,
+                                 struct mm_struct *mm,
+                                 const UVM_POLICY_BATCH_ENTRY *entry)
+{
+    const NvU64 start = entry->base;
+    const NvU64 length = entry->length;
+    uvm_processor_id_t id;
+    NvU32 level;
+    NV_STATUS status;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    if (entry->op == UVM_POLICY_BATCH_ACCESS_PATTERN)
+        return access_pattern_set(va_space, mm, start, length, entry->value, entry->stride, entry->span, entry->flags);
+
+    status = uvm_api_range_type_check(va_space, mm, start, length);
+    if (status != NV_OK) {
+        // Like the single-range ioctls, ATS ranges are left alone
+        return status == NV_WARN_NOTHING_TO_DO ? NV_OK : status;
+    }
+
+    switch (entry->op) {
+        case UVM_POLICY_BATCH_PRIORITIZED_LOCATION:
+            status = prioritized_level_get(entry->value, &level);
+            if (status != NV_OK)
+                return status;
+
+            status = prioritized_location_id_get(va_space, &entry->location, start, length, &id);
+            if (status != NV_OK)
+                return status;
+
+            return prioritized_location_set(va_space, mm, start, length, id, level);
+        case UVM_POLICY_BATCH_QUICK_MIGRATE:
+            return quick_migration_set(va_space, mm, start, length, entry->value != 0);
+        case UVM_POLICY_BATCH_NO_MIGRATE:
+            return ignore_region_set(va_space, mm, start, length, entry->value != 0);
+        case UVM_POLICY_BATCH_DISCARDABLE:
+            return discardable_set(va_space, start, length, entry->value != 0);
+        case UVM_POLICY_BATCH_ACCESS_COUNTERS:
+            return access_counter_policy_set(va_space, start, length, entry->value, entry->span);
+        case UVM_POLICY_BATCH_HOST_HUGE_PAGES:
+            return host_huge_pages_set(va_space, start, length, entry->value != 0);
+        case UVM_POLICY_BATCH_LEASE:
+            return lease_set(va_space, start, length, entry->value);
+        case UVM_POLICY_BATCH_HOST_NODE:
+            return host_node_set(va_space, start, length, entry->value);
+        default:
+            return NV_ERR_INVALID_ARGUMENT;
+    }
+}
+
+NV_STATUS uvm_api_set_policy_batch(UVM_SET_POLICY_BATCH_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_POLICY_BATCH_ENTRY *entries;
+    struct mm_struct *mm;
+    NV_STATUS status = NV_OK;
+    NvU32 tried;
+    NvU32 i;
+
+    params->applied = 0;
+
+    if (params->count == 0)
+        return NV_OK;
+
+    if (params->count > UVM_POLICY_BATCH_MAX_ENTRIES)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // Entries are staged in kernel memory so that the user copies don't happen
+    // with the va_space lock held.
+    entries = uvm_kvmalloc(params->count * sizeof(*entries));
+    if (!entries)
+        return NV_ERR_NO_MEMORY;
+
+    if (nv_copy_from_user(entries, (void __user *)params->entries, params->count * sizeof(*entries))) {
+        uvm_kvfree(entries);
+        return NV_ERR_INVALID_ADDRESS;
+    }
+
+    mm = uvm_va_space_mm_or_current_retain_lock(va_space);
+
+    // Stop at the first failure; the entries before it stay applied. The
+    // leading entries that only set flags are applied in read mode, the rest
+    // from the first that needs more in write mode.
+    uvm_va_space_down_read(va_space);
+
+    for (i = 0; i < params->count && uvm_policy_batch_entry_is_read_safe(va_space, &entries[i]); i++) {
+        entries[i].rmStatus = uvm_policy_batch_apply(va_space, mm, &entries[i]);
+        if (entries[i].rmStatus != NV_OK) {
+            status = entries[i].rmStatus;
+            break;
+        }
+    }
+
+    uvm_va_space_up_read(va_space);
+
+    if (status == NV_OK && i < params->count) {
+        uvm_va_space_down_write(va_space);
+
+        for (; i < params->count; i++) {
+            entries[i].rmStatus = uvm_policy_batch_apply(va_space, mm, &entries[i]);
+            if (entries[i].rmStatus != NV_OK) {
+                status = entries[i].rmStatus;
+                break;
+            }
+        }
+
+        uvm_va_space_up_write(va_space);
+    }
+
+    uvm_va_space_mm_or_current_release_unlock(va_space, mm);
+
+    params->applied = i;
+
+    // Report the status of every entry that was tried
+    tried = min(i + 1, params->count);
+    if (nv_copy_to_user((void __user *)params->entries, entries, tried * sizeof(*entries)) && status == NV_OK)
+        status = NV_ERR_INVALID_ADDRESS;
+
+    uvm_kvfree(entries);
+
+    return status;
+}
+
 NV_STATUS uvm_api_set_quick_migration(const UVM_SET_QUICK_MIGRATE_REGION_PARAMS *params, struct file *filp)
 {
     NV_STATUS status;
@@ -574,12 +1276,15 @@ NV_STATUS uvm_api_set_quick_migration(const UVM_SET_QUICK_MIGRATE_REGION_PARAMS
     UVM_ASSERT(va_space);
 
     mm = uvm_va_space_mm_or_current_retain_lock(va_space);
-    uvm_va_space_down_write(va_space);
-    has_va_space_write_lock = true;
 
+    // The flags of managed va_ranges are set in read mode, alongside fault
+    // servicing. HMM spans retake the lock in write mode.
+    uvm_va_space_down_read(va_space);
+    has_va_space_write_lock = false;
+
+retry:
     status = uvm_api_range_type_check(va_space, mm, start, length);
     if (status != NV_OK) {
-    pr_alert("sqm not okay\n");
         if (status != NV_WARN_NOTHING_TO_DO)
             goto done;
 
@@ -592,12 +1297,14 @@ NV_STATUS uvm_api_set_quick_migration(const UVM_SET_QUICK_MIGRATE_REGION_PARAMS
     if (range_is_ats)
         goto done;
 
-    status = quick_migration_set(va_space, mm, start, length);
-    if (status != NV_OK)
-        goto done;
+    if (!has_va_space_write_lock && !quick_migration_is_read_safe(va_space, start)) {
+        uvm_va_space_up_read(va_space);
+        uvm_va_space_down_write(va_space);
+        has_va_space_write_lock = true;
+        goto retry;
+    }
 
-    uvm_va_space_downgrade_write(va_space);
-    has_va_space_write_lock = false;
+    status = quick_migration_set(va_space, mm, start, length, params->quickMigrate);
 
 done:
 
@@ -623,6 +1330,7 @@ NV_STATUS uvm_api_set_prioritized_location(const UVM_SET_PRIORITIZED_LOCATION_PA
     uvm_va_range_t *va_range = NULL;
     struct mm_struct *mm;
     uvm_processor_id_t prioritized_location_id;
+    NvU32 level;
     bool has_va_space_write_lock;
     const NvU64 start = params->requestedBase;
     const NvU64 length = params->length;
@@ -630,10 +1338,18 @@ NV_STATUS uvm_api_set_prioritized_location(const UVM_SET_PRIORITIZED_LOCATION_PA
     bool range_is_ats = false;
     UVM_ASSERT(va_space);
 
+    status = prioritized_level_get(params->priority, &level);
+    if (status != NV_OK)
+        return status;
+
     mm = uvm_va_space_mm_or_current_retain_lock(va_space);
-    uvm_va_space_down_write(va_space);
-    has_va_space_write_lock = true;
 
+    // Like quick migration, but a span that splits a va_range also needs the
+    // write mode
+    uvm_va_space_down_read(va_space);
+    has_va_space_write_lock = false;
+
+retry:
     status = uvm_api_range_type_check(va_space, mm, start, length);
     if (status != NV_OK) {
         if (status != NV_WARN_NOTHING_TO_DO)
@@ -642,34 +1358,24 @@ NV_STATUS uvm_api_set_prioritized_location(const UVM_SET_PRIORITIZED_LOCATION_PA
         status = NV_OK;
         range_is_ats = true;
     }
-    if (uvm_uuid_is_cpu(&params->prioritizedLocation)) {
-        prioritized_location_id = UVM_ID_CPU;
-    }
-    else {
-        uvm_gpu_t *gpu = uvm_va_space_get_gpu_by_uuid(va_space, &params->prioritizedLocation);
-
-        if (!gpu)
-            status = NV_ERR_INVALID_DEVICE;
-        else if (!uvm_gpu_can_address(gpu, start, length))
-            status = NV_ERR_OUT_OF_RANGE;
-
-        if (status != NV_OK)
-            goto done;
-
-        prioritized_location_id = gpu->id;
-    }
+    status = prioritized_location_id_get(va_space, &params->prioritizedLocation, start, length, &prioritized_location_id);
+    if (status != NV_OK)
+        goto done;
 
     UVM_ASSERT(status == NV_OK);
 
     if (range_is_ats)
         goto done;
 
-    status = prioritized_location_set(va_space, mm, start, length, prioritized_location_id);
-    if (status != NV_OK)
-        goto done;
+    if (!has_va_space_write_lock &&
+        !prioritized_location_is_read_safe(va_space, start, length, prioritized_location_id, level)) {
+        uvm_va_space_up_read(va_space);
+        uvm_va_space_down_write(va_space);
+        has_va_space_write_lock = true;
+        goto retry;
+    }
 
-    uvm_va_space_downgrade_write(va_space);
-    has_va_space_write_lock = false;
+    status = prioritized_location_set(va_space, mm, start, length, prioritized_location_id, level);
 
 done:
 
@@ -689,7 +1395,6 @@ NV_STATUS
 uvm_api_set_no_migrate_region(const UVM_SET_NO_MIGRATE_REGION_PARAMS *params,
                               struct file *filp) {
   NV_STATUS status;
-  pr_alert("NO MIGRATE API CALLED\n");
   uvm_va_space_t *va_space = uvm_va_space_get(filp);
   uvm_va_range_t *va_range = NULL;
   struct mm_struct *mm;
@@ -715,7 +1420,7 @@ uvm_api_set_no_migrate_region(const UVM_SET_NO_MIGRATE_REGION_PARAMS *params,
     range_is_ats = true;
   }
 
-  ignore_ac_notification = &params->ignore_ac_notification;
+  ignore_ac_notification = params->ignore_ac_notification;
 
   if (range_is_ats)
     goto done;
@@ -262,6 +262,12 @@ NV_STATUS __uvm_push_begin_acquire_on_reserved_channel_with_info(uvm_channel_t *
     __uvm_push_begin_acquire_on_reserved_channel_with_info((channel), NULL, (push), \
         __FILE__, __FUNCTION__, __LINE__, (format), ##__VA_ARGS__)
 
+// Same as uvm_push_begin_on_reserved_channel except it also acquires the input
+// tracker for the caller
+#define uvm_push_begin_acquire_on_reserved_channel(channel, tracker, push, format, ...)  \
+    __uvm_push_begin_acquire_on_reserved_channel_with_info((channel), (tracker), (push), \
+        __FILE__, __FUNCTION__, __LINE__, (format), ##__VA_ARGS__)
+
 // Same as uvm_push_begin_on_channel except it also acquires the input tracker
 // for the caller
 #define uvm_push_begin_acquire_on_channel(channel, tracker, push, format, ...)  \
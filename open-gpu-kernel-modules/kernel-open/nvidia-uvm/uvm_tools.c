@@ -186,6 +186,9 @@ static uvm_spinlock_t g_tools_channel_list_lock;
 static LIST_HEAD(g_tools_channel_list);
 static nv_kthread_q_t g_tools_queue;
 
+// Runs the submit ring workers of all VA spaces
+static nv_kthread_q_t g_tools_submit_ring_queue;
+
 static NV_STATUS tools_update_status(uvm_va_space_t *va_space);
 
 static uvm_tools_event_tracker_t *tools_event_tracker(struct file *filp)
@@ -2244,6 +2247,428 @@ NV_STATUS uvm_test_tools_flush_replay_events(UVM_TEST_TOOLS_FLUSH_REPLAY_EVENTS_
     return status;
 }
 
+// Detaches the registered ring under the lock, so that producers see either
+// the old ring or none, and unmaps it outside of it since vunmap can sleep.
+static void event_ring_unregister(uvm_va_space_t *va_space)
+{
+    struct page **pages;
+    void *header;
+    NvU64 size;
+
+    uvm_spin_lock(&va_space->event_ring.lock);
+    pages = va_space->event_ring.pages;
+    header = va_space->event_ring.header;
+    size = va_space->event_ring.size;
+    va_space->event_ring.header = NULL;
+    va_space->event_ring.records = NULL;
+    va_space->event_ring.entries = 0;
+    va_space->event_ring.pages = NULL;
+    va_space->event_ring.size = 0;
+    uvm_spin_unlock(&va_space->event_ring.lock);
+
+    if (header)
+        unmap_user_pages(pages, header, size);
+}
+
+void uvm_tools_event_ring_destroy(uvm_va_space_t *va_space)
+{
+    event_ring_unregister(va_space);
+}
+
+void uvm_tools_event_ring_push(uvm_va_space_t *va_space,
+                               NvU32 type,
+                               uvm_processor_id_t processor,
+                               NvU64 base,
+                               NvU64 address,
+                               NvU64 length,
+                               NvU64 value)
+{
+    UVM_EVENT_RING_HEADER *header;
+    UVM_EVENT_RING_RECORD *record;
+    NvU32 put;
+
+    // Racy check to keep the common case, no ring, free of the lock
+    if (!READ_ONCE(va_space->event_ring.header))
+        return;
+
+    uvm_spin_lock(&va_space->event_ring.lock);
+
+    header = va_space->event_ring.header;
+    if (!header)
+        goto unlock;
+
+    put = header->put;
+    if (put - smp_load_acquire(&header->get) >= va_space->event_ring.entries) {
+        ++header->dropped;
+        goto unlock;
+    }
+
+    record = &va_space->event_ring.records[put & (va_space->event_ring.entries - 1)];
+    record->type      = type;
+    record->processor = uvm_id_value(processor);
+    record->base      = base;
+    record->address   = address;
+    record->length    = length;
+    record->value     = value;
+
+    // Publish the record before its slot
+    smp_store_release(&header->put, put + 1);
+
+unlock:
+    uvm_spin_unlock(&va_space->event_ring.lock);
+}
+
+void uvm_tools_event_ring_count_faults(uvm_va_space_t *va_space, NvU64 count)
+{
+    UVM_EVENT_RING_HEADER *header;
+
+    if (!READ_ONCE(va_space->event_ring.header))
+        return;
+
+    uvm_spin_lock(&va_space->event_ring.lock);
+
+    header = va_space->event_ring.header;
+    if (header)
+        WRITE_ONCE(header->faults, header->faults + count);
+
+    uvm_spin_unlock(&va_space->event_ring.lock);
+}
+
+NV_STATUS uvm_api_register_event_ring(const UVM_REGISTER_EVENT_RING_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_EVENT_RING_HEADER *header;
+    struct page **pages;
+    NvU64 entries;
+    NV_STATUS status;
+
+    event_ring_unregister(va_space);
+
+    if (params->ringBuffer == 0)
+        return NV_OK;
+
+    if (!IS_ALIGNED(params->ringBuffer, sizeof(NvU64)) || params->ringSize <= sizeof(*header))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // The ring holds as many records as fit, rounded down to a power of 2
+    entries = (params->ringSize - sizeof(*header)) / sizeof(UVM_EVENT_RING_RECORD);
+    if (entries < 2 || entries > UINT_MAX)
+        return NV_ERR_INVALID_ARGUMENT;
+    entries = rounddown_pow_of_two(entries);
+
+    status = map_user_pages(params->ringBuffer, params->ringSize, (void **)&header, &pages);
+    if (status != NV_OK)
+        return status;
+
+    header->put = 0;
+    header->get = 0;
+    header->entries = (NvU32)entries;
+    header->dropped = 0;
+    header->faults = 0;
+
+    uvm_spin_lock(&va_space->event_ring.lock);
+
+    // Lost a race with a concurrent registration, keep that one
+    if (va_space->event_ring.header) {
+        uvm_spin_unlock(&va_space->event_ring.lock);
+        unmap_user_pages(pages, header, params->ringSize);
+        return NV_ERR_IN_USE;
+    }
+
+    va_space->event_ring.records = (UVM_EVENT_RING_RECORD *)(header + 1);
+    va_space->event_ring.entries = (NvU32)entries;
+    va_space->event_ring.pages = pages;
+    va_space->event_ring.size = params->ringSize;
+    smp_store_release(&va_space->event_ring.header, header);
+
+    uvm_spin_unlock(&va_space->event_ring.lock);
+
+    return NV_OK;
+}
+
+// Detaches the registered submit ring under the lock, so that kicks see
+// either the old ring or none, and unmaps it once the worker is done with it.
+static void submit_ring_unregister(uvm_va_space_t *va_space)
+{
+    struct page **pages;
+    void *header;
+    NvU64 size;
+
+    uvm_spin_lock(&va_space->submit_ring.lock);
+    pages = va_space->submit_ring.pages;
+    header = va_space->submit_ring.header;
+    size = va_space->submit_ring.size;
+    va_space->submit_ring.header = NULL;
+    va_space->submit_ring.commands = NULL;
+    va_space->submit_ring.completions = NULL;
+    va_space->submit_ring.entries = 0;
+    va_space->submit_ring.pages = NULL;
+    va_space->submit_ring.size = 0;
+    uvm_spin_unlock(&va_space->submit_ring.lock);
+
+    if (!header)
+        return;
+
+    // The worker may be scheduled or running, with the ring it read before
+    // the detach
+    nv_kthread_q_flush(&g_tools_submit_ring_queue);
+
+    unmap_user_pages(pages, header, size);
+}
+
+void uvm_tools_submit_ring_destroy(uvm_va_space_t *va_space)
+{
+    submit_ring_unregister(va_space);
+}
+
+// Whether the worker has a command to take and room for its completion
+static bool submit_ring_ready(uvm_va_space_t *va_space, UVM_SUBMIT_RING_HEADER *header)
+{
+    return smp_load_acquire(&header->sqPut) != header->sqGet &&
+           header->cqPut - smp_load_acquire(&header->cqGet) < va_space->submit_ring.entries;
+}
+
+static NV_STATUS submit_ring_apply(uvm_va_space_t *va_space,
+                                   struct mm_struct *mm,
+                                   const UVM_SUBMIT_RING_COMMAND *command,
+                                   uvm_tracker_t *tracker)
+{
+    // Without the mm the process is exiting
+    if (!mm)
+        return NV_ERR_INVALID_STATE;
+
+    switch (command->op) {
+        case UVM_SUBMIT_RING_OP_POLICY:
+            return uvm_policy_batch_apply(va_space, mm, &command->policy);
+        case UVM_SUBMIT_RING_OP_MIGRATE:
+            if (command->flags & ~UVM_MIGRATE_BATCH_FLAGS_ALL)
+                return NV_ERR_INVALID_ARGUMENT;
+
+            return uvm_migrate_batch_entry(va_space, mm, &command->migrate, command->flags, tracker);
+        default:
+            return NV_ERR_INVALID_ARGUMENT;
+    }
+}
+
+// Applies the commands at the head of the ring that take the VA space lock in
+// the same mode, write for policies (read for those that only set flags) and
+// read for migrations, at most UVM_SUBMIT_RING_DRAIN_MAX of them and as many
+// as there is completion room for, and posts their completions. Returns the number of commands taken.
+static NvU32 submit_ring_drain(uvm_va_space_t *va_space, UVM_SUBMIT_RING_HEADER *header)
+{
+    UVM_SUBMIT_RING_COMMAND *staged = va_space->submit_ring.staged;
+    NV_STATUS *status = va_space->submit_ring.status;
+    const NvU32 entries = va_space->submit_ring.entries;
+    const NvU32 get = header->sqGet;
+    const NvU32 cq_put = header->cqPut;
+    uvm_tracker_t tracker = UVM_TRACKER_INIT();
+    NV_STATUS tracker_status = NV_OK;
+    struct mm_struct *mm;
+    bool synchronous = false;
+    bool policy;
+    NvU32 count;
+    NvU32 i;
+
+    count = min(smp_load_acquire(&header->sqPut) - get, entries - (cq_put - smp_load_acquire(&header->cqGet)));
+    count = min(count, (NvU32)UVM_SUBMIT_RING_DRAIN_MAX);
+    if (count == 0)
+        return 0;
+
+    // User space may rewrite a slot at any time, the commands are read once
+    for (i = 0; i < count; i++)
+        memcpy(&staged[i], &va_space->submit_ring.commands[(get + i) & (entries - 1)], sizeof(staged[i]));
+
+    policy = staged[0].op != UVM_SUBMIT_RING_OP_MIGRATE;
+    for (i = 1; i < count; i++) {
+        if ((staged[i].op != UVM_SUBMIT_RING_OP_MIGRATE) != policy)
+            break;
+    }
+    count = i;
+
+    mm = uvm_va_space_mm_retain_lock(va_space);
+    if (policy) {
+        // The leading commands that only set flags in read mode, as in
+        // UVM_SET_POLICY_BATCH
+        uvm_va_space_down_read(va_space);
+
+        for (i = 0; i < count && uvm_policy_batch_entry_is_read_safe(va_space, &staged[i].policy); i++)
+            status[i] = submit_ring_apply(va_space, mm, &staged[i], NULL);
+
+        uvm_va_space_up_read(va_space);
+
+        if (i < count) {
+            uvm_va_space_down_write(va_space);
+
+            for (; i < count; i++)
+                status[i] = submit_ring_apply(va_space, mm, &staged[i], NULL);
+
+            uvm_va_space_up_write(va_space);
+        }
+
+        uvm_va_space_mm_release_unlock(va_space, mm);
+    }
+    else {
+        uvm_va_space_down_read(va_space);
+
+        // As in UVM_MIGRATE_BATCH, the copies of every command are pushed
+        // without waiting for those of the previous ones
+        for (i = 0; i < count; i++) {
+            status[i] = submit_ring_apply(va_space, mm, &staged[i], &tracker);
+            if (!(staged[i].flags & UVM_MIGRATE_FLAG_ASYNC))
+                synchronous = true;
+        }
+
+        if (mm)
+            uvm_up_read_mmap_lock_out_of_order(mm);
+
+        if (synchronous)
+            tracker_status = uvm_tracker_wait(&tracker);
+        uvm_tracker_deinit(&tracker);
+
+        uvm_va_space_up_read(va_space);
+        if (mm)
+            uvm_va_space_mm_release(va_space);
+
+        if (synchronous)
+            uvm_tools_flush_events();
+    }
+
+    for (i = 0; i < count; i++) {
+        UVM_SUBMIT_RING_COMPLETION *completion = &va_space->submit_ring.completions[(cq_put + i) & (entries - 1)];
+
+        if (status[i] == NV_OK && !policy && !(staged[i].flags & UVM_MIGRATE_FLAG_ASYNC))
+            status[i] = tracker_status;
+
+        completion->userData = staged[i].userData;
+        completion->rmStatus = status[i];
+    }
+
+    // Publish the completions before their slots, and free the command slots
+    // once their commands are staged
+    smp_store_release(&header->cqPut, cq_put + count);
+    smp_store_release(&header->sqGet, get + count);
+
+    return count;
+}
+
+static void submit_ring_worker(void *args)
+{
+    uvm_va_space_t *va_space = (uvm_va_space_t *)args;
+    UVM_SUBMIT_RING_HEADER *header;
+
+    // Unregistering detaches the ring and then flushes the queue, so the ring
+    // read here stays mapped until the worker returns
+    uvm_spin_lock(&va_space->submit_ring.lock);
+    header = va_space->submit_ring.header;
+    uvm_spin_unlock(&va_space->submit_ring.lock);
+
+    if (!header)
+        return;
+
+    WRITE_ONCE(header->flags, header->flags & ~UVM_SUBMIT_RING_FLAG_NEED_WAKEUP);
+    smp_mb();
+
+    while (READ_ONCE(va_space->submit_ring.header) == header) {
+        if (submit_ring_drain(va_space, header) > 0)
+            continue;
+
+        // Ask for a kick and look again, for the commands and completion
+        // room that user space made before it could see the flag. Pairs with
+        // the barrier between advancing sqPut or cqGet and reading flags in
+        // user space.
+        WRITE_ONCE(header->flags, header->flags | UVM_SUBMIT_RING_FLAG_NEED_WAKEUP);
+        smp_mb();
+
+        if (!submit_ring_ready(va_space, header))
+            break;
+
+        WRITE_ONCE(header->flags, header->flags & ~UVM_SUBMIT_RING_FLAG_NEED_WAKEUP);
+    }
+}
+
+static void submit_ring_worker_entry(void *args)
+{
+    UVM_ENTRY_VOID(submit_ring_worker(args));
+}
+
+NV_STATUS uvm_api_register_submit_ring(const UVM_REGISTER_SUBMIT_RING_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_SUBMIT_RING_HEADER *header;
+    struct page **pages;
+    NvU64 entries;
+    NV_STATUS status;
+
+    submit_ring_unregister(va_space);
+
+    if (params->ringBuffer == 0)
+        return NV_OK;
+
+    if (!uvm_va_space_mm_enabled(va_space))
+        return NV_ERR_NOT_SUPPORTED;
+
+    if (!PAGE_ALIGNED(params->ringBuffer) || params->ringSize <= sizeof(*header))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    // The ring holds as many commands and completions as fit, rounded down to
+    // a power of 2
+    entries = (params->ringSize - sizeof(*header)) /
+              (sizeof(UVM_SUBMIT_RING_COMMAND) + sizeof(UVM_SUBMIT_RING_COMPLETION));
+    if (entries < 2 || entries > UINT_MAX)
+        return NV_ERR_INVALID_ARGUMENT;
+    entries = rounddown_pow_of_two(entries);
+
+    status = map_user_pages(params->ringBuffer, params->ringSize, (void **)&header, &pages);
+    if (status != NV_OK)
+        return status;
+
+    header->sqPut = 0;
+    header->sqGet = 0;
+    header->cqPut = 0;
+    header->cqGet = 0;
+    header->entries = (NvU32)entries;
+    header->flags = UVM_SUBMIT_RING_FLAG_NEED_WAKEUP;
+
+    uvm_spin_lock(&va_space->submit_ring.lock);
+
+    // Lost a race with a concurrent registration, keep that one
+    if (va_space->submit_ring.header) {
+        uvm_spin_unlock(&va_space->submit_ring.lock);
+        unmap_user_pages(pages, header, params->ringSize);
+        return NV_ERR_IN_USE;
+    }
+
+    va_space->submit_ring.commands = (UVM_SUBMIT_RING_COMMAND *)(header + 1);
+    va_space->submit_ring.completions = (UVM_SUBMIT_RING_COMPLETION *)(va_space->submit_ring.commands + entries);
+    va_space->submit_ring.entries = (NvU32)entries;
+    va_space->submit_ring.pages = pages;
+    va_space->submit_ring.size = params->ringSize;
+    nv_kthread_q_item_init(&va_space->submit_ring.q_item, submit_ring_worker_entry, va_space);
+    smp_store_release(&va_space->submit_ring.header, header);
+
+    uvm_spin_unlock(&va_space->submit_ring.lock);
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_kick_submit_ring(UVM_KICK_SUBMIT_RING_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    NV_STATUS status = NV_OK;
+
+    uvm_spin_lock(&va_space->submit_ring.lock);
+
+    // Scheduling an item that is already pending does nothing
+    if (va_space->submit_ring.header)
+        nv_kthread_q_schedule_q_item(&g_tools_submit_ring_queue, &va_space->submit_ring.q_item);
+    else
+        status = NV_ERR_INVALID_STATE;
+
+    uvm_spin_unlock(&va_space->submit_ring.lock);
+
+    return status;
+}
+
 static const struct file_operations uvm_tools_fops =
 {
     .open            = uvm_tools_open_entry,
@@ -2311,6 +2736,10 @@ int uvm_tools_init(dev_t uvm_base_dev)
     if (ret < 0)
         goto err_cache_destroy;
 
+    ret = nv_kthread_q_init(&g_tools_submit_ring_queue, "UVM Submit Ring Queue");
+    if (ret < 0)
+        goto err_stop_tools_queue;
+
     uvm_init_character_device(&g_uvm_tools_cdev, &uvm_tools_fops);
     ret = cdev_add(&g_uvm_tools_cdev, uvm_tools_dev, 1);
     if (ret != 0) {
@@ -2322,6 +2751,9 @@ int uvm_tools_init(dev_t uvm_base_dev)
     return ret;
 
 err_stop_thread:
+    nv_kthread_q_stop(&g_tools_submit_ring_queue);
+
+err_stop_tools_queue:
     nv_kthread_q_stop(&g_tools_queue);
 
 err_cache_destroy:
@@ -2334,6 +2766,7 @@ void uvm_tools_exit(void)
     unsigned i;
     cdev_del(&g_uvm_tools_cdev);
 
+    nv_kthread_q_stop(&g_tools_submit_ring_queue);
     nv_kthread_q_stop(&g_tools_queue);
 
     for (i = 0; i < UvmEventNumTypesAll; ++i)
@@ -117,6 +117,25 @@ void uvm_tools_broadcast_access_counter(uvm_gpu_t *gpu,
 
 void uvm_tools_test_hmm_split_invalidate(uvm_va_space_t *va_space);
 
+// Writes a record to the ring registered with UVM_REGISTER_EVENT_RING, if
+// any. Callable from any context that can take a spinlock.
+void uvm_tools_event_ring_push(uvm_va_space_t *va_space,
+                               NvU32 type,
+                               uvm_processor_id_t processor,
+                               NvU64 base,
+                               NvU64 address,
+                               NvU64 length,
+                               NvU64 value);
+
+// Adds count to the faults of the header of the registered ring, if any
+void uvm_tools_event_ring_count_faults(uvm_va_space_t *va_space, NvU64 count);
+
+void uvm_tools_event_ring_destroy(uvm_va_space_t *va_space);
+
+// Unregisters the ring registered with UVM_REGISTER_SUBMIT_RING, if any, once
+// its worker is done with it. Must be called without the VA space lock held.
+void uvm_tools_submit_ring_destroy(uvm_va_space_t *va_space);
+
 // schedules completed events and then waits from the to be dispatched
 void uvm_tools_flush_events(void);
 
@@ -0,0 +1,213 @@
+/*******************************************************************************
+    Copyright (c) 2024 NVIDIA Corporation
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be
+        included in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*******************************************************************************/
+
+// Tracepoints of the fault, migration, eviction, access counter and SUV policy
+// paths, under the nvidia_uvm system of tracefs and perf. Disabled, each costs
+// a static branch; callers whose arguments take work to compute check
+// trace_<event>_enabled() first.
+//
+// Processors are uvm_id_value() values: 0 is the CPU, GPUs start at 1.
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nvidia_uvm
+
+#if !defined(__UVM_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __UVM_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+#ifndef UVM_TRACE_EVICT_FREE
+
+// Eviction list a root chunk was picked from, see uvm_pmm_evict_root_chunk
+#define UVM_TRACE_EVICT_FREE          0
+#define UVM_TRACE_EVICT_FREE_ZERO     1
+#define UVM_TRACE_EVICT_UNUSED        2
+#define UVM_TRACE_EVICT_PROBATION     3
+#define UVM_TRACE_EVICT_USED          4
+#define UVM_TRACE_EVICT_UNKNOWN       5
+#define UVM_TRACE_EVICT_PRIORITIZED   6 // + the level
+
+// Policies of uvm_va_range_policy without a UVM_POLICY_BATCH_* op
+#define UVM_TRACE_POLICY_PREFETCH_STRIDE 100
+#define UVM_TRACE_POLICY_NEXT_USE        101
+#define UVM_TRACE_POLICY_AC_DEMOTE       102 // 1 demoted, 0 promoted again
+
+#endif
+
+TRACE_EVENT(uvm_fault_batch_start,
+    TP_PROTO(u32 gpu, u32 batch_id, u32 num_cached_faults),
+    TP_ARGS(gpu, batch_id, num_cached_faults),
+    TP_STRUCT__entry(
+        __field(u32, gpu)
+        __field(u32, batch_id)
+        __field(u32, num_cached_faults)
+    ),
+    TP_fast_assign(
+        __entry->gpu = gpu;
+        __entry->batch_id = batch_id;
+        __entry->num_cached_faults = num_cached_faults;
+    ),
+    TP_printk("gpu=%u batch=%u faults=%u", __entry->gpu, __entry->batch_id, __entry->num_cached_faults)
+);
+
+TRACE_EVENT(uvm_fault_batch_end,
+    TP_PROTO(u32 gpu, u32 batch_id, u32 num_coalesced_faults, u32 num_replays, u32 status),
+    TP_ARGS(gpu, batch_id, num_coalesced_faults, num_replays, status),
+    TP_STRUCT__entry(
+        __field(u32, gpu)
+        __field(u32, batch_id)
+        __field(u32, num_coalesced_faults)
+        __field(u32, num_replays)
+        __field(u32, status)
+    ),
+    TP_fast_assign(
+        __entry->gpu = gpu;
+        __entry->batch_id = batch_id;
+        __entry->num_coalesced_faults = num_coalesced_faults;
+        __entry->num_replays = num_replays;
+        __entry->status = status;
+    ),
+    TP_printk("gpu=%u batch=%u coalesced=%u replays=%u status=0x%x",
+              __entry->gpu,
+              __entry->batch_id,
+              __entry->num_coalesced_faults,
+              __entry->num_replays,
+              __entry->status)
+);
+
+// A copy of contiguous pages of a VA block; cause is a
+// uvm_make_resident_cause_t
+TRACE_EVENT(uvm_va_block_migrate,
+    TP_PROTO(u64 address, u64 bytes, u32 src, u32 dst, u32 cause),
+    TP_ARGS(address, bytes, src, dst, cause),
+    TP_STRUCT__entry(
+        __field(u64, address)
+        __field(u64, bytes)
+        __field(u32, src)
+        __field(u32, dst)
+        __field(u32, cause)
+    ),
+    TP_fast_assign(
+        __entry->address = address;
+        __entry->bytes = bytes;
+        __entry->src = src;
+        __entry->dst = dst;
+        __entry->cause = cause;
+    ),
+    TP_printk("address=0x%llx bytes=%llu src=%u dst=%u cause=%u",
+              __entry->address,
+              __entry->bytes,
+              __entry->src,
+              __entry->dst,
+              __entry->cause)
+);
+
+TRACE_EVENT(uvm_pmm_evict_root_chunk,
+    TP_PROTO(u32 gpu, u64 address, u32 list),
+    TP_ARGS(gpu, address, list),
+    TP_STRUCT__entry(
+        __field(u32, gpu)
+        __field(u64, address)
+        __field(u32, list)
+    ),
+    TP_fast_assign(
+        __entry->gpu = gpu;
+        __entry->address = address;
+        __entry->list = list;
+    ),
+    TP_printk("gpu=%u address=0x%llx list=%s level=%u",
+              __entry->gpu,
+              __entry->address,
+              __print_symbolic(min(__entry->list, (u32)UVM_TRACE_EVICT_PRIORITIZED),
+                               { UVM_TRACE_EVICT_FREE,        "free" },
+                               { UVM_TRACE_EVICT_FREE_ZERO,   "free_zero" },
+                               { UVM_TRACE_EVICT_UNUSED,      "unused" },
+                               { UVM_TRACE_EVICT_PROBATION,   "probation" },
+                               { UVM_TRACE_EVICT_USED,        "used" },
+                               { UVM_TRACE_EVICT_UNKNOWN,     "unknown" },
+                               { UVM_TRACE_EVICT_PRIORITIZED, "prioritized" }),
+              __entry->list >= UVM_TRACE_EVICT_PRIORITIZED ? __entry->list - UVM_TRACE_EVICT_PRIORITIZED : 0)
+);
+
+// flags are the UVM_ACCESS_COUNTER_* of the servicing
+TRACE_EVENT(uvm_access_counter_service,
+    TP_PROTO(u32 gpu, u64 address, bool is_virtual, u32 counter_value, u32 flags, u32 status),
+    TP_ARGS(gpu, address, is_virtual, counter_value, flags, status),
+    TP_STRUCT__entry(
+        __field(u32, gpu)
+        __field(u64, address)
+        __field(bool, is_virtual)
+        __field(u32, counter_value)
+        __field(u32, flags)
+        __field(u32, status)
+    ),
+    TP_fast_assign(
+        __entry->gpu = gpu;
+        __entry->address = address;
+        __entry->is_virtual = is_virtual;
+        __entry->counter_value = counter_value;
+        __entry->flags = flags;
+        __entry->status = status;
+    ),
+    TP_printk("gpu=%u address=0x%llx %s count=%u flags=0x%x status=0x%x",
+              __entry->gpu,
+              __entry->address,
+              __entry->is_virtual ? "virt" : "phys",
+              __entry->counter_value,
+              __entry->flags,
+              __entry->status)
+);
+
+// policy is a UVM_POLICY_BATCH_* op or a UVM_TRACE_POLICY_*. value is the
+// flag, level, threshold or epoch the op sets; prioritized locations carry
+// the processor in the upper 32 bits.
+TRACE_EVENT(uvm_va_range_policy,
+    TP_PROTO(u64 start, u64 end, u32 policy, u64 value),
+    TP_ARGS(start, end, policy, value),
+    TP_STRUCT__entry(
+        __field(u64, start)
+        __field(u64, end)
+        __field(u32, policy)
+        __field(u64, value)
+    ),
+    TP_fast_assign(
+        __entry->start = start;
+        __entry->end = end;
+        __entry->policy = policy;
+        __entry->value = value;
+    ),
+    TP_printk("range=[0x%llx, 0x%llx] policy=%u value=0x%llx",
+              __entry->start,
+              __entry->end,
+              __entry->policy,
+              __entry->value)
+);
+
+#endif // __UVM_TRACE_H__
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE uvm_trace
+
+#include <trace/define_trace.h>
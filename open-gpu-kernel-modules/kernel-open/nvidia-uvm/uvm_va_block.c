@@ -39,6 +39,7 @@
 #include "uvm_gpu_access_counters.h"
 #include "uvm_va_space_mm.h"
 #include "uvm_test_ioctl.h"
+#include "uvm_trace.h"
 
 typedef enum
 {
@@ -61,6 +62,15 @@ MODULE_PARM_DESC(uvm_fault_force_sysmem, "Force (1) using sysmem storage for pag
 static int uvm_perf_map_remote_on_eviction __read_mostly = 1;
 module_param(uvm_perf_map_remote_on_eviction, int, S_IRUGO);
 
+// Pages migrated to a GPU keep their sysmem copy allocated. Tracking which of
+// them have not been mapped writable since lets eviction skip their copy back,
+// at the cost of mapping them read-only until they are first written.
+static int uvm_perf_clean_eviction __read_mostly = 1;
+module_param(uvm_perf_clean_eviction, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_clean_eviction,
+                 "Skip the copy to sysmem when evicting pages that are unchanged since they "
+                 "were migrated in (1) or always copy (0). Default: 1.");
+
 // Caching is always disabled for mappings to remote memory. The following two
 // module parameters can be used to force caching for GPU peer/sysmem mappings.
 //
@@ -673,6 +683,33 @@ static void block_gpu_unmap_phys_all_cpu_pages(uvm_va_block_t *block, uvm_gpu_t
     }
 }
 
+// Whether the DMA addresses of the CPU pages of the block are contiguous on
+// every GPU with state in the block. Only meaningful after
+// uvm_cpu_chunk_alloc_contig() populated the block.
+static bool block_cpu_pages_gpu_contig(uvm_va_block_t *block)
+{
+    uvm_gpu_id_t id;
+    uvm_page_index_t page_index;
+    size_t num_pages = uvm_va_block_num_cpu_pages(block);
+
+    for_each_gpu_id(id) {
+        NvU64 first;
+
+        if (!uvm_va_block_gpu_state_get(block, id))
+            continue;
+
+        first = uvm_cpu_chunk_get_gpu_mapping_addr(block, 0, uvm_cpu_chunk_get_chunk_for_page(block, 0), id);
+        for (page_index = 1; page_index < num_pages; page_index++) {
+            uvm_cpu_chunk_t *chunk = uvm_cpu_chunk_get_chunk_for_page(block, page_index);
+
+            if (uvm_cpu_chunk_get_gpu_mapping_addr(block, page_index, chunk, id) != first + page_index * PAGE_SIZE)
+                return false;
+        }
+    }
+
+    return true;
+}
+
 static NV_STATUS block_gpu_map_phys_all_cpu_pages(uvm_va_block_t *block, uvm_gpu_t *gpu)
 {
     NV_STATUS status;
@@ -716,6 +753,10 @@ static NV_STATUS block_gpu_map_phys_all_cpu_pages(uvm_va_block_t *block, uvm_gpu
             goto error;
     }
 
+    // The new GPU may see the run at scattered DMA addresses
+    if (block->cpu.contig)
+        block->cpu.contig = block_cpu_pages_gpu_contig(block);
+
     return NV_OK;
 
 error:
@@ -882,6 +923,11 @@ static void block_unmap_cpu_chunk_on_gpus(uvm_va_block_t *block, uvm_cpu_chunk_t
     }
 }
 
+// The DMA mappings of a CPU chunk live as long as the chunk does, and the
+// block keeps its CPU chunks until it is destroyed or split, whichever
+// processors its pages move between. Migrations in and out of a GPU, the
+// prefetches and evictions of iteration migration included, reuse them; only
+// a new chunk or a new GPU state in the block maps pages again.
 static NV_STATUS block_map_cpu_chunk_on_gpus(uvm_va_block_t *block, uvm_page_index_t page_index)
 {
     NV_STATUS status;
@@ -1033,6 +1079,58 @@ static bool block_cpu_page_is_dirty(uvm_va_block_t *block, uvm_page_index_t page
 //
 // TODO: Bug 1995015: Optimize this function and its callers to avoid calling for
 //                    each page index.
+// Whether the first CPU allocation of the block should populate the whole
+// block at once, see uvm_va_policy_t::host_huge_pages.
+static bool block_cpu_wants_contig(uvm_va_block_t *block)
+{
+    if (uvm_va_block_is_hmm(block))
+        return false;
+
+    if (!uvm_va_range_get_policy(block->va_range)->host_huge_pages)
+        return false;
+
+    if (uvm_va_block_size(block) != UVM_PAGE_SIZE_2M || !IS_ALIGNED(block->start, UVM_PAGE_SIZE_2M))
+        return false;
+
+    return uvm_page_mask_empty(&block->cpu.allocated);
+}
+
+// Populates all the CPU pages of the block from one physically contiguous
+// allocation and maps them on the GPUs. On failure the block is left without
+// CPU pages so the caller can fall back to per-page allocations.
+static NV_STATUS block_populate_cpu_contig(uvm_va_block_t *block, struct mm_struct *mm)
+{
+    NV_STATUS status;
+    uvm_page_index_t page_index;
+    size_t num_pages = uvm_va_block_num_cpu_pages(block);
+
+    status = uvm_cpu_chunk_alloc_contig(block, mm);
+    if (status != NV_OK)
+        return status;
+
+    for (page_index = 0; page_index < num_pages; page_index++) {
+        status = block_map_cpu_chunk_on_gpus(block, page_index);
+        if (status != NV_OK)
+            break;
+    }
+
+    if (status != NV_OK) {
+        // Pages past the failing one were never mapped, unmapping skips them
+        for (page_index = 0; page_index < num_pages; page_index++) {
+            uvm_cpu_chunk_t *chunk = uvm_cpu_chunk_get_chunk_for_page(block, page_index);
+
+            block_unmap_cpu_chunk_on_gpus(block, chunk, page_index);
+            uvm_cpu_chunk_remove_from_block(block, chunk, page_index);
+            uvm_cpu_chunk_put(chunk);
+        }
+        return status;
+    }
+
+    block->cpu.contig = block_cpu_pages_gpu_contig(block);
+
+    return NV_OK;
+}
+
 static NV_STATUS block_populate_page_cpu(uvm_va_block_t *block, uvm_page_index_t page_index, struct mm_struct *mm)
 {
     NV_STATUS status;
@@ -1054,6 +1152,11 @@ static NV_STATUS block_populate_page_cpu(uvm_va_block_t *block, uvm_page_index_t
         return NV_ERR_NO_MEMORY;
     }
 
+    // Host-pinned ranges are remote-mapped by the GPUs, a contiguous block
+    // lets them use 2MB sysmem PTEs. Best effort: fall back to the page.
+    if (block_cpu_wants_contig(block) && block_populate_cpu_contig(block, mm) == NV_OK)
+        return NV_OK;
+
     status = uvm_cpu_chunk_alloc(block, page_index, mm, &chunk);
     if (status != NV_OK)
         goto error;
@@ -1077,6 +1180,7 @@ static NV_STATUS block_alloc_gpu_chunk(uvm_va_block_t *block,
                                        uvm_va_block_retry_t *retry,
                                        uvm_gpu_t *gpu,
                                        uvm_chunk_size_t size,
+                                       uvm_pmm_alloc_flags_t flags,
                                        uvm_gpu_chunk_t **out_gpu_chunk)
 {
     NV_STATUS status = NV_OK;
@@ -1093,7 +1197,7 @@ static NV_STATUS block_alloc_gpu_chunk(uvm_va_block_t *block,
         }
         else {
             // Try allocating a new one without eviction
-            status = uvm_pmm_gpu_alloc_user(&gpu->pmm, 1, size, UVM_PMM_ALLOC_FLAGS_NONE, &gpu_chunk, &retry->tracker);
+            status = uvm_pmm_gpu_alloc_user(&gpu->pmm, 1, size, flags, &gpu_chunk, &retry->tracker);
         }
 
         if (status == NV_ERR_NO_MEMORY) {
@@ -1102,7 +1206,12 @@ static NV_STATUS block_alloc_gpu_chunk(uvm_va_block_t *block,
             // be restarted.
             uvm_mutex_unlock(&block->lock);
 
-            status = uvm_pmm_gpu_alloc_user(&gpu->pmm, 1, size, UVM_PMM_ALLOC_FLAGS_EVICT, &gpu_chunk, &retry->tracker);
+            status = uvm_pmm_gpu_alloc_user(&gpu->pmm,
+                                            1,
+                                            size,
+                                            flags | UVM_PMM_ALLOC_FLAGS_EVICT,
+                                            &gpu_chunk,
+                                            &retry->tracker);
             if (status == NV_OK) {
                 block_retry_add_free_chunk(retry, gpu_chunk);
                 status = NV_ERR_MORE_PROCESSING_REQUIRED;
@@ -1921,6 +2030,30 @@ out:
     return status;
 }
 
+// Whether every page of the region is resident somewhere, in which case a
+// new chunk for it gets overwritten by the migration and is never zeroed by
+// block_zero_new_gpu_chunk.
+static bool block_region_resident_elsewhere(uvm_va_block_t *block, uvm_va_block_region_t region)
+{
+    uvm_page_mask_t *resident_mask;
+    uvm_processor_id_t id;
+    bool full;
+
+    resident_mask = kmem_cache_alloc(g_uvm_page_mask_cache, NV_UVM_GFP_FLAGS);
+    if (!resident_mask)
+        return false;
+
+    uvm_page_mask_zero(resident_mask);
+    for_each_id_in_mask(id, &block->resident)
+        uvm_page_mask_or(resident_mask, resident_mask, uvm_va_block_resident_mask_get(block, id));
+
+    full = uvm_page_mask_region_full(resident_mask, region);
+
+    kmem_cache_free(g_uvm_page_mask_cache, resident_mask);
+
+    return full;
+}
+
 static NV_STATUS block_populate_gpu_chunk(uvm_va_block_t *block,
                                           uvm_va_block_retry_t *retry,
                                           uvm_gpu_t *gpu,
@@ -1948,7 +2081,14 @@ static NV_STATUS block_populate_gpu_chunk(uvm_va_block_t *block,
 
     UVM_ASSERT(uvm_page_mask_region_empty(&gpu_state->resident, chunk_region));
 
-    status = block_alloc_gpu_chunk(block, retry, gpu, chunk_size, &chunk);
+    // Leave the zero chunks to the first touches if this one is overwritten
+    status = block_alloc_gpu_chunk(block,
+                                   retry,
+                                   gpu,
+                                   chunk_size,
+                                   block_region_resident_elsewhere(block, chunk_region) ?
+                                       UVM_PMM_ALLOC_FLAGS_NONZERO : UVM_PMM_ALLOC_FLAGS_NONE,
+                                   &chunk);
     if (status != NV_OK)
         return status;
 
@@ -2234,9 +2374,12 @@ uvm_gpu_phys_address_t uvm_va_block_gpu_phys_page_address(uvm_va_block_t *va_blo
 
 // Begin a push appropriate for copying data from src_id processor to dst_id processor.
 // One of src_id and dst_id needs to be a GPU.
+// Copies to a GPU that user space asked for go on the prefetch channels, away
+// from those servicing faults.
 static NV_STATUS block_copy_begin_push(uvm_va_block_t *va_block,
                                        uvm_processor_id_t dst_id,
                                        uvm_processor_id_t src_id,
+                                       uvm_make_resident_cause_t cause,
                                        uvm_tracker_t *tracker,
                                        uvm_push_t *push)
 {
@@ -2249,7 +2392,10 @@ static NV_STATUS block_copy_begin_push(uvm_va_block_t *va_block,
 
     if (UVM_ID_IS_CPU(src_id)) {
         gpu = block_get_gpu(va_block, dst_id);
-        channel_type = UVM_CHANNEL_TYPE_CPU_TO_GPU;
+        if (cause == UVM_MAKE_RESIDENT_CAUSE_API_MIGRATE)
+            channel_type = UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH;
+        else
+            channel_type = UVM_CHANNEL_TYPE_CPU_TO_GPU;
     }
     else if (UVM_ID_IS_CPU(dst_id)) {
         gpu = block_get_gpu(va_block, src_id);
@@ -2287,6 +2433,27 @@ static NV_STATUS block_copy_begin_push(uvm_va_block_t *va_block,
                                                  va_block->end);
     }
 
+    // Prefetches stripe consecutive blocks across the CEs, so that a bulk
+    // migration copies on all of them at once. The copies of one block
+    // still go to one channel.
+    if (channel_type == UVM_CHANNEL_TYPE_CPU_TO_GPU_PREFETCH) {
+        uvm_channel_t *channel;
+        NV_STATUS status = uvm_channel_reserve_cpu_to_gpu_stripe(gpu->channel_manager,
+                                                                 va_block->start >> UVM_VA_BLOCK_BITS,
+                                                                 &channel);
+        if (status != NV_OK)
+            return status;
+
+        return uvm_push_begin_acquire_on_reserved_channel(channel,
+                                                          tracker,
+                                                          push,
+                                                          "Copy from %s to %s for block [0x%llx, 0x%llx]",
+                                                          block_processor_name(va_block, src_id),
+                                                          block_processor_name(va_block, dst_id),
+                                                          va_block->start,
+                                                          va_block->end);
+    }
+
     return uvm_push_begin_acquire(gpu->channel_manager,
                                   channel_type,
                                   tracker,
@@ -2315,6 +2482,64 @@ static bool block_page_is_clean(uvm_va_block_t *block,
            !block_cpu_page_is_dirty(block, page_index);
 }
 
+// When evicting, a page needs no copy iff...
+// the CPU page already existed and
+// the GPU page is unchanged since it was copied from it or
+// the range is discardable
+static bool block_page_evicts_without_copy(uvm_va_block_t *block,
+                                           uvm_va_block_context_t *block_context,
+                                           uvm_processor_id_t src_id,
+                                           uvm_page_index_t page_index)
+{
+    uvm_va_block_gpu_state_t *gpu_state = uvm_va_block_gpu_state_get(block, src_id);
+
+    if (uvm_va_block_is_hmm(block) ||
+        !uvm_page_mask_test(&block_context->make_resident.cpu_pages_populated, page_index))
+        return false;
+
+    return uvm_page_mask_test(&gpu_state->clean, page_index) ||
+           uvm_va_range_get_policy(block->va_range)->discardable;
+}
+
+// Clean pages are mapped read-only while the rest of the block is writable,
+// which splits its 2MB PTE. Ranges migrated in bulk keep the large mapping.
+static bool block_gpu_tracks_clean_pages(uvm_va_block_t *block, uvm_processor_id_t id)
+{
+    return uvm_perf_clean_eviction &&
+           !uvm_va_block_is_hmm(block) &&
+           !uvm_va_range_get_policy(block->va_range)->quick_migrate &&
+           uvm_gpu_supports_eviction(block_get_gpu(block, id));
+}
+
+bool uvm_va_block_gpu_page_is_clean(uvm_va_block_t *va_block, uvm_processor_id_t id, uvm_page_index_t page_index)
+{
+    uvm_va_block_gpu_state_t *gpu_state;
+
+    if (UVM_ID_IS_CPU(id) || !block_gpu_tracks_clean_pages(va_block, id))
+        return false;
+
+    gpu_state = uvm_va_block_gpu_state_get(va_block, id);
+    return gpu_state && uvm_page_mask_test(&gpu_state->clean, page_index);
+}
+
+bool uvm_va_block_gpu_clean_pages(uvm_va_block_t *va_block,
+                                  uvm_processor_id_t id,
+                                  const uvm_page_mask_t *page_mask,
+                                  uvm_page_mask_t *clean_mask)
+{
+    uvm_va_block_gpu_state_t *gpu_state = NULL;
+
+    if (UVM_ID_IS_GPU(id) && block_gpu_tracks_clean_pages(va_block, id))
+        gpu_state = uvm_va_block_gpu_state_get(va_block, id);
+
+    if (!gpu_state) {
+        uvm_page_mask_zero(clean_mask);
+        return false;
+    }
+
+    return uvm_page_mask_and(clean_mask, page_mask, &gpu_state->clean);
+}
+
 // When the destination is the CPU...
 // if the source is the preferred location, mark as clean
 // otherwise, mark as dirty
@@ -2346,7 +2571,9 @@ static void block_mark_memory_prioritized(uvm_va_block_t *block, uvm_processor_i
     if (uvm_va_block_size(block) == UVM_CHUNK_SIZE_MAX && uvm_gpu_supports_eviction(gpu)) {
         // The chunk has to be there if this GPU is resident
         UVM_ASSERT(uvm_processor_mask_test(&block->resident, id));
-        uvm_pmm_gpu_mark_root_chunk_prioritized(&gpu->pmm, uvm_va_block_gpu_state_get(block, gpu->id)->chunks[0]);
+        uvm_pmm_gpu_mark_root_chunk_prioritized(&gpu->pmm,
+                                                uvm_va_block_gpu_state_get(block, gpu->id)->chunks[0],
+                                                uvm_va_policy_get(block, block->start)->prioritized_level);
     }
 }
 
@@ -2365,10 +2592,16 @@ static void block_mark_memory_used(uvm_va_block_t *block, uvm_processor_id_t id)
       // The chunk has to be there if this GPU is resident
       UVM_ASSERT(uvm_processor_mask_test(&block->resident, id));
       // if the block is an prioritized (Penguin) range, then move it to the end of the prioritzed queue
+      // HMM blocks take the policy of their first page, a root chunk has a
+      // single eviction list
+      uvm_va_policy_t *policy = uvm_va_policy_get(block, block->start);
       uvm_processor_id_t processor;
-      processor = uvm_va_range_get_policy(block->va_range)->prioritized_location;
-      if (UVM_ID_IS_VALID(processor) && UVM_ID_IS_GPU(processor)) {
-        uvm_pmm_gpu_mark_root_chunk_prioritized(&gpu->pmm, uvm_va_block_gpu_state_get(block, gpu->id)->chunks[0]);
+      processor = policy->prioritized_location;
+      if (UVM_ID_IS_VALID(processor) && UVM_ID_IS_GPU(processor) &&
+          !uvm_va_range_prioritized_demoted(block->va_range)) {
+        uvm_pmm_gpu_mark_root_chunk_prioritized(&gpu->pmm,
+                                                uvm_va_block_gpu_state_get(block, gpu->id)->chunks[0],
+                                                policy->prioritized_level);
       } else{
         uvm_pmm_gpu_mark_root_chunk_used(&gpu->pmm, uvm_va_block_gpu_state_get(block, gpu->id)->chunks[0]);
       }
@@ -2467,6 +2700,9 @@ static bool is_block_phys_contig(uvm_va_block_t *block, uvm_processor_id_t id)
     if (UVM_ID_IS_GPU(id))
         return uvm_va_block_size(block) == block_gpu_chunk_size(block, block_get_gpu(block, id), 0);
 
+    if (block->cpu.contig)
+        return true;
+
     return chunk && (uvm_va_block_size(block) <= uvm_cpu_chunk_get_size(chunk));
 }
 
@@ -2475,7 +2711,12 @@ static uvm_va_block_region_t block_phys_contig_region(uvm_va_block_t *block,
                                                       uvm_processor_id_t resident_id)
 {
     if (UVM_ID_IS_CPU(resident_id)) {
-        uvm_cpu_chunk_t *chunk = uvm_cpu_chunk_get_chunk_for_page(block, page_index);
+        uvm_cpu_chunk_t *chunk;
+
+        if (block->cpu.contig)
+            return uvm_va_block_region_from_block(block);
+
+        chunk = uvm_cpu_chunk_get_chunk_for_page(block, page_index);
         return uvm_va_block_region(page_index, page_index + uvm_cpu_chunk_num_pages(chunk));
     }
     else {
@@ -2536,6 +2777,28 @@ static void block_copy_push(uvm_va_block_t *block,
                                          uvm_va_block_region_size(region));
 }
 
+// Account a copied region to the owning va_range's statistics
+static void block_copy_account_stats(uvm_va_block_t *block,
+                                     uvm_processor_id_t dst_id,
+                                     uvm_processor_id_t src_id,
+                                     NvU64 address,
+                                     NvU64 size,
+                                     uvm_make_resident_cause_t cause)
+{
+    trace_uvm_va_block_migrate(address, size, uvm_id_value(src_id), uvm_id_value(dst_id), cause);
+
+    if (UVM_ID_IS_CPU(src_id))
+        uvm_va_range_stat_add(block->va_range, UVM_VA_RANGE_STAT_BYTES_H2D, size);
+    else if (UVM_ID_IS_CPU(dst_id))
+        uvm_va_range_stat_add(block->va_range, UVM_VA_RANGE_STAT_BYTES_D2H, size);
+
+    if (cause == UVM_MAKE_RESIDENT_CAUSE_EVICTION) {
+        uvm_va_range_stat_add(block->va_range, UVM_VA_RANGE_STAT_EVICTIONS, 1);
+        if (block->va_range && block->va_range->type == UVM_VA_RANGE_TYPE_MANAGED)
+            UVM_WRITE_ONCE(block->va_range->managed.last_eviction_ns, NV_GETTIME());
+    }
+}
+
 // Copies pages resident on the src_id processor to the dst_id processor
 //
 // The function adds the pages that were successfully copied to the output
@@ -2597,6 +2860,11 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
         rgr_has_changed = true;
     }
 
+    // CPU pages populated below are not cleared when the data lives
+    // elsewhere, so evictions must copy into them
+    if (cause == UVM_MAKE_RESIDENT_CAUSE_EVICTION)
+        uvm_page_mask_copy(&block_context->make_resident.cpu_pages_populated, &block->cpu.allocated);
+
     // TODO: Bug 3745051: This function is complicated and needs refactoring
     for_each_va_block_page_in_region_mask(page_index, copy_mask, region) {
         NvU64 page_start = uvm_va_block_cpu_page_address(block, page_index);
@@ -2661,8 +2929,16 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
         if (block_page_is_clean(block, dst_id, src_id, page_index))
             continue;
 
+        // Neither are evicted pages whose sysmem copy is current or whose
+        // contents are dead
+        if (cause == UVM_MAKE_RESIDENT_CAUSE_EVICTION &&
+            block_page_evicts_without_copy(block, block_context, src_id, page_index)) {
+            block_update_page_dirty_state(block, dst_id, src_id, page_index);
+            continue;
+        }
+
         if (!copying_gpu) {
-            status = block_copy_begin_push(block, dst_id, src_id, &block->tracker, &push);
+            status = block_copy_begin_push(block, dst_id, src_id, cause, &block->tracker, &push);
             if (status != NV_OK)
                 break;
             copying_gpu = uvm_push_get_gpu(&push);
@@ -2717,6 +2993,12 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
                                             block_transfer_mode,
                                             contig_cause,
                                             &block_context->make_resident);
+            block_copy_account_stats(block,
+                                     dst_id,
+                                     src_id,
+                                     uvm_va_block_region_start(block, contig_region),
+                                     uvm_va_block_region_size(contig_region),
+                                     contig_cause);
 
             contig_start_index = page_index;
             contig_cause = page_cause;
@@ -2746,6 +3028,12 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
                                         block_transfer_mode,
                                         contig_cause,
                                         &block_context->make_resident);
+        block_copy_account_stats(block,
+                                     dst_id,
+                                     src_id,
+                                     uvm_va_block_region_start(block, contig_region),
+                                     uvm_va_block_region_size(contig_region),
+                                     contig_cause);
 
         // TODO: Bug 1766424: If the destination is a GPU and the copy was done
         //       by that GPU, use a GPU-local membar if no peer can currently
@@ -2800,6 +3088,23 @@ static NV_STATUS block_copy_resident_pages_between(uvm_va_block_t *block,
         if (block_transfer_mode == UVM_VA_BLOCK_TRANSFER_MODE_COPY)
             uvm_tools_record_read_duplicate(block, dst_id, region, copy_mask);
 
+        // Pages copied from sysmem stay clean until they are mapped
+        // writable, the CPU copy outlives the migration. Pages copied from
+        // anywhere else have no current copy to fall back to.
+        if (UVM_ID_IS_GPU(dst_id) && transfer_mode != BLOCK_TRANSFER_MODE_INTERNAL_COPY_ONLY) {
+            uvm_va_block_gpu_state_t *dst_gpu_state = uvm_va_block_gpu_state_get(block, dst_id);
+
+            if (UVM_ID_IS_CPU(src_id) && block_gpu_tracks_clean_pages(block, dst_id))
+                uvm_page_mask_or(&dst_gpu_state->clean, &dst_gpu_state->clean, copy_mask);
+            else
+                uvm_page_mask_andnot(&dst_gpu_state->clean, &dst_gpu_state->clean, copy_mask);
+        }
+
+        if (UVM_ID_IS_GPU(src_id)) {
+            uvm_va_block_gpu_state_t *src_gpu_state = uvm_va_block_gpu_state_get(block, src_id);
+            uvm_page_mask_andnot(&src_gpu_state->clean, &src_gpu_state->clean, copy_mask);
+        }
+
         // If we are migrating due to an eviction, set the GPU as evicted and
         // mark the evicted pages. If we are migrating away from the CPU this
         // means that those pages are not evicted.
@@ -6443,6 +6748,11 @@ static NV_STATUS block_map_cpu_to(uvm_va_block_t *block,
     for (pte_bit = 0; pte_bit <= prot_pte_bit; pte_bit++)
         uvm_page_mask_or(&block->cpu.pte_bits[pte_bit], &block->cpu.pte_bits[pte_bit], pages_to_map);
 
+    if (new_prot >= UVM_PROT_READ_WRITE && UVM_ID_IS_GPU(resident_id)) {
+        uvm_va_block_gpu_state_t *resident_gpu_state = uvm_va_block_gpu_state_get(block, resident_id);
+        uvm_page_mask_andnot(&resident_gpu_state->clean, &resident_gpu_state->clean, pages_to_map);
+    }
+
     uvm_page_mask_or(&block->maybe_mapped_pages, &block->maybe_mapped_pages, pages_to_map);
 
     UVM_ASSERT(block_check_mappings(block));
@@ -6568,6 +6878,12 @@ static NV_STATUS block_map_gpu_to(uvm_va_block_t *va_block,
     for (pte_bit = 0; pte_bit <= prot_pte_bit; pte_bit++)
         uvm_page_mask_or(&gpu_state->pte_bits[pte_bit], &gpu_state->pte_bits[pte_bit], pages_to_map);
 
+    // Writes are not tracked, a writable mapping dirties the pages
+    if (new_prot >= UVM_PROT_READ_WRITE && UVM_ID_IS_GPU(resident_id)) {
+        uvm_va_block_gpu_state_t *resident_gpu_state = uvm_va_block_gpu_state_get(va_block, resident_id);
+        uvm_page_mask_andnot(&resident_gpu_state->clean, &resident_gpu_state->clean, pages_to_map);
+    }
+
     uvm_processor_mask_set(&va_block->mapped, gpu->id);
 
     // If we are mapping a UVM-Lite GPU do not update maybe_mapped_pages
@@ -8560,6 +8876,7 @@ static void block_split_gpu(uvm_va_block_t *existing, uvm_va_block_t *new, uvm_g
     }
 
     block_split_page_mask(&existing_gpu_state->evicted, existing_pages, &new_gpu_state->evicted, new_pages);
+    block_split_page_mask(&existing_gpu_state->clean, existing_pages, &new_gpu_state->clean, new_pages);
 }
 
 NV_STATUS uvm_va_block_split(uvm_va_block_t *existing_va_block,
@@ -8760,6 +9077,11 @@ static uvm_prot_t compute_new_permission(uvm_va_block_t *va_block,
 
     UVM_ASSERT(logical_prot >= new_prot);
 
+    // Keep pages that match their sysmem copy read-only, the first write then
+    // faults and dirties them
+    if (new_prot == UVM_PROT_READ_ONLY && uvm_va_block_gpu_page_is_clean(va_block, new_residency, page_index))
+        return new_prot;
+
     if (logical_prot > UVM_PROT_READ_ONLY && new_prot == UVM_PROT_READ_ONLY &&
         !block_region_might_read_duplicate(va_block, uvm_va_block_region_for_page(page_index))) {
         uvm_processor_mask_t processors_with_atomic_mapping;
@@ -9069,6 +9391,10 @@ uvm_prot_t uvm_va_block_page_compute_highest_permission(uvm_va_block_t *va_block
         if (!uvm_processor_mask_test(&va_space->accessible_from[uvm_id_value(residency)], processor_id))
             return UVM_PROT_NONE;
 
+        // Pages unchanged since they were copied from sysmem stay read-only
+        if (uvm_va_block_gpu_page_is_clean(va_block, residency, page_index))
+            return UVM_PROT_READ_ONLY;
+
         // Fast path: if the page is not mapped anywhere else, it can be safely
         // mapped with RWA permission
         if (!uvm_page_mask_test(&va_block->maybe_mapped_pages, page_index))
@@ -9195,7 +9521,9 @@ static bool can_read_duplicate(uvm_va_block_t *va_block,
     if (uvm_va_policy_is_read_duplicate(policy, uvm_va_block_get_va_space(va_block)))
         return true;
 
+    // Write-mostly pages would collapse their copies right away
     if (policy->read_duplication != UVM_READ_DUPLICATION_DISABLED &&
+        !(policy->access_flags & UVM_ACCESS_PATTERN_FLAG_WRITE_MOSTLY) &&
         uvm_page_mask_test(&va_block->read_duplicated_pages, page_index) &&
         thrashing_hint->type != UVM_PERF_THRASHING_HINT_TYPE_PIN)
         return true;
@@ -9337,6 +9665,14 @@ static uvm_processor_id_t block_select_residency(uvm_va_block_t *va_block,
         return closest_resident_processor;
     }
 
+    // Migrating scattered accesses moves more data than they use; map them
+    // where they are and leave the hot pages to the access counters
+    if (uvm_va_policy_maps_remotely(policy) &&
+        uvm_processor_mask_test(&va_space->accessible_from[uvm_id_value(closest_resident_processor)], processor_id) &&
+        operation != UVM_SERVICE_OPERATION_ACCESS_COUNTERS) {
+        return closest_resident_processor;
+    }
+
     // Check if we should map the closest resident processor remotely on atomic
     // fault
     if (map_remote_on_atomic_fault(va_space, access_type_mask, processor_id, closest_resident_processor))
@@ -10218,6 +10554,7 @@ NV_STATUS uvm_va_block_write_from_cpu(uvm_va_block_t *va_block,
     }
 
     gpu = block_get_gpu(va_block, proc);
+    uvm_page_mask_clear(&uvm_va_block_gpu_state_get(va_block, proc)->clean, page_index);
 
     dst_gpu_address = block_phys_page_copy_address(va_block, block_phys_page(proc, page_index), gpu);
     dst_gpu_address.address += page_offset;
@@ -10420,6 +10757,7 @@ NV_STATUS uvm_va_block_evict_chunks(uvm_va_block_t *va_block,
     uvm_va_block_test_t *va_block_test = uvm_va_block_get_test(va_block);
     uvm_va_space_t *va_space = uvm_va_block_get_va_space_maybe_dead(va_block);
     struct mm_struct *mm;
+    NvU32 evicted_pages;
 
     uvm_assert_mutex_locked(&va_block->lock);
 
@@ -10474,6 +10812,7 @@ NV_STATUS uvm_va_block_evict_chunks(uvm_va_block_t *va_block,
 
     // Only move pages resident on the GPU
     uvm_page_mask_and(pages_to_evict, pages_to_evict, uvm_va_block_resident_mask_get(va_block, gpu->id));
+    evicted_pages = uvm_page_mask_weight(pages_to_evict);
 
     block_context->policy = uvm_va_range_get_policy(va_block->va_range);
 
@@ -10491,6 +10830,20 @@ NV_STATUS uvm_va_block_evict_chunks(uvm_va_block_t *va_block,
     if (status != NV_OK)
         goto out;
 
+    // Tell the runtime its prioritized data lost the GPU
+    if (UVM_ID_IS_VALID(block_context->policy->prioritized_location) && evicted_pages != 0) {
+        uvm_va_block_region_t block_region = uvm_va_block_region_from_block(va_block);
+        uvm_page_index_t first_page = uvm_va_block_first_page_in_mask(block_region, pages_to_evict);
+
+        uvm_tools_event_ring_push(va_space,
+                                  UVM_EVENT_RING_TYPE_EVICTION,
+                                  gpu->id,
+                                  va_block->va_range->node.start,
+                                  uvm_va_block_cpu_page_address(va_block, first_page),
+                                  (NvU64)evicted_pages * PAGE_SIZE,
+                                  block_context->policy->prioritized_level);
+    }
+
     // VA space lock may not be held and hence we cannot reestablish any
     // mappings here and need to defer it to a work queue.
     //
@@ -11034,3 +11387,28 @@ void uvm_va_block_mark_cpu_dirty(uvm_va_block_t *va_block)
 {
     block_mark_region_cpu_dirty(va_block, uvm_va_block_region_from_block(va_block));
 }
+
+void uvm_va_block_mark_memory_used(uvm_va_block_t *va_block)
+{
+    uvm_gpu_id_t id;
+
+    uvm_assert_mutex_locked(&va_block->lock);
+
+    for_each_gpu_id_in_mask(id, &va_block->resident)
+        block_mark_memory_used(va_block, id);
+}
+
+void uvm_va_block_mark_gpu_referenced(uvm_va_block_t *va_block, uvm_gpu_t *gpu)
+{
+    uvm_assert_mutex_locked(&va_block->lock);
+
+    // Only root chunk sized blocks are on the PMM eviction lists, see
+    // block_mark_memory_used()
+    if (uvm_va_block_size(va_block) != UVM_CHUNK_SIZE_MAX || !uvm_gpu_supports_eviction(gpu))
+        return;
+
+    if (!uvm_processor_mask_test(&va_block->resident, gpu->id))
+        return;
+
+    uvm_pmm_gpu_mark_root_chunk_referenced(&gpu->pmm, uvm_va_block_gpu_state_get(va_block, gpu->id)->chunks[0]);
+}
@@ -110,6 +110,12 @@ typedef struct
     // Pages that have been evicted to sysmem
     uvm_page_mask_t evicted;
 
+    // Resident pages whose sysmem copy, still allocated since they were
+    // migrated in, is current: no processor has mapped them writable since.
+    // Eviction drops them instead of copying. See
+    // uvm_perf_clean_eviction.
+    uvm_page_mask_t clean;
+
     NvU64 *cpu_chunks_dma_addrs;
 
     // Array of naturally-aligned chunks. Each chunk has the largest possible
@@ -337,6 +343,13 @@ struct uvm_va_block_struct
         // corresponding page index.
         uvm_page_mask_t allocated;
 
+        // True if all the CPU pages of the block come from a single physically
+        // contiguous allocation (see uvm_cpu_chunk_alloc_contig) and are also
+        // contiguous in the DMA address space of every GPU with state in the
+        // block, so GPUs can map them with a single 2MB PTE. Cleared when any
+        // page leaves the block.
+        bool contig;
+
         // Per-page mapping bit vectors, one per bit we need to track. These are
         // used for fast traversal of valid mappings in the block. These contain
         // all non-address bits needed to establish a virtual mapping on this
@@ -446,6 +459,11 @@ struct uvm_va_block_struct
         NvU16 fault_migrations_to_last_proc;
     } prefetch_info;
 
+    // Accesses notified by the access counters since the block last reached
+    // the threshold of its range, if the range has one. See
+    // UVM_SET_ACCESS_COUNTER_POLICY.
+    NvU32 access_counter_count;
+
 #if UVM_IS_CONFIG_HMM()
     struct
     {
@@ -1425,6 +1443,18 @@ size_t uvm_va_block_gpu_chunk_index_range(NvU64 start,
 // If there are any resident CPU pages in the block, mark them as dirty
 void uvm_va_block_mark_cpu_dirty(uvm_va_block_t *va_block);
 
+// Put the root chunks of the block on the PMM eviction list its current
+// policy calls for, on every GPU it is resident on.
+//
+// LOCKING: The caller must hold the va_block lock.
+void uvm_va_block_mark_memory_used(uvm_va_block_t *va_block);
+
+// Report an access by the GPU to the block's memory on it to the PMM eviction
+// policy, see uvm_pmm_gpu_mark_root_chunk_referenced().
+//
+// LOCKING: The caller must hold the va_block lock.
+void uvm_va_block_mark_gpu_referenced(uvm_va_block_t *va_block, uvm_gpu_t *gpu);
+
 // Sets the internal state required to handle fault cancellation
 //
 // This function may require allocating page tables to split big pages into 4K
@@ -1894,6 +1924,20 @@ void uvm_va_block_page_authorized_processors(uvm_va_block_t *va_block,
                                              uvm_prot_t access_permission,
                                              uvm_processor_mask_t *authorized_processors);
 
+// Whether the page, resident on GPU id, is unchanged since it was copied from
+// sysmem. Such pages are mapped read-only so that the first write faults. See
+// uvm_perf_clean_eviction.
+//
+// LOCKING: The caller must hold the va_block lock.
+bool uvm_va_block_gpu_page_is_clean(uvm_va_block_t *va_block, uvm_processor_id_t id, uvm_page_index_t page_index);
+
+// Same for the pages in page_mask; clean_mask is filled with the clean ones and
+// the return value is whether there are any.
+bool uvm_va_block_gpu_clean_pages(uvm_va_block_t *va_block,
+                                  uvm_processor_id_t id,
+                                  const uvm_page_mask_t *page_mask,
+                                  uvm_page_mask_t *clean_mask);
+
 bool uvm_va_block_is_gpu_authorized_on_whole_region(uvm_va_block_t *va_block,
                                                     uvm_va_block_region_t region,
                                                     uvm_gpu_id_t gpu_id,
@@ -165,6 +165,10 @@ typedef struct
         uvm_page_mask_t pages_staged;
         uvm_page_mask_t pages_migrated;
 
+        // CPU pages that were allocated before an eviction started copying
+        // into them. Only these hold data, so only these can be left uncopied.
+        uvm_page_mask_t cpu_pages_populated;
+
         // Out mask filled in by uvm_va_block_make_resident to indicate which
         // pages actually changed residency.
         uvm_page_mask_t pages_changed_residency;
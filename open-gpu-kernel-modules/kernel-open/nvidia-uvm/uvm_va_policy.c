@@ -364,7 +364,8 @@ void uvm_va_policy_clear(uvm_va_block_t *va_block, NvU64 start, NvU64 end)
 static void uvm_va_policy_node_set(uvm_va_policy_node_t *node,
                                    uvm_va_policy_type_t which,
                                    uvm_processor_id_t processor_id,
-                                   uvm_read_duplication_policy_t new_policy)
+                                   uvm_read_duplication_policy_t new_policy,
+                                   NvU32 level)
 {
     switch (which) {
         case UVM_VA_POLICY_PREFERRED_LOCATION:
@@ -383,6 +384,21 @@ static void uvm_va_policy_node_set(uvm_va_policy_node_t *node,
             node->policy.read_duplication = new_policy;
             break;
 
+        case UVM_VA_POLICY_PRIORITIZED_LOCATION:
+            UVM_ASSERT(!UVM_ID_IS_INVALID(processor_id));
+            UVM_ASSERT(level < UVM_PMM_PRIORITY_LEVELS);
+            node->policy.prioritized_location = processor_id;
+            node->policy.prioritized_level = level;
+            break;
+
+        case UVM_VA_POLICY_QUICK_MIGRATE:
+            node->policy.quick_migrate = true;
+            break;
+
+        case UVM_VA_POLICY_NO_MIGRATE:
+            node->policy.ignore_ac_notification = true;
+            break;
+
         default:
             UVM_ASSERT_MSG(0, "Unknown policy type %u\n", which);
             break;
@@ -406,6 +422,20 @@ static void uvm_va_policy_node_clear(uvm_va_block_t *va_block,
             uvm_processor_mask_clear(&node->policy.accessed_by, processor_id);
             break;
 
+        case UVM_VA_POLICY_PRIORITIZED_LOCATION:
+            UVM_ASSERT(UVM_ID_IS_INVALID(processor_id));
+            node->policy.prioritized_location = processor_id;
+            node->policy.prioritized_level = 0;
+            break;
+
+        case UVM_VA_POLICY_QUICK_MIGRATE:
+            node->policy.quick_migrate = false;
+            break;
+
+        case UVM_VA_POLICY_NO_MIGRATE:
+            node->policy.ignore_ac_notification = false;
+            break;
+
         case UVM_VA_POLICY_READ_DUPLICATION:
         default:
             // Read duplication is never set back to UVM_READ_DUPLICATION_UNSET.
@@ -416,7 +446,10 @@ static void uvm_va_policy_node_clear(uvm_va_block_t *va_block,
     // Check to see if the node is now the default and can be removed.
     if (UVM_ID_IS_INVALID(node->policy.preferred_location) &&
             uvm_processor_mask_empty(&node->policy.accessed_by) &&
-            node->policy.read_duplication == UVM_READ_DUPLICATION_UNSET) {
+            node->policy.read_duplication == UVM_READ_DUPLICATION_UNSET &&
+            UVM_ID_IS_INVALID(node->policy.prioritized_location) &&
+            !node->policy.quick_migrate &&
+            !node->policy.ignore_ac_notification) {
         uvm_range_tree_remove(&va_block->hmm.va_policy_tree, &node->node);
         uvm_va_policy_node_free(node);
     }
@@ -427,7 +460,8 @@ static uvm_va_policy_node_t *create_node_and_set(uvm_va_block_t *va_block,
                                                  NvU64 end,
                                                  uvm_va_policy_type_t which,
                                                  uvm_processor_id_t processor_id,
-                                                 uvm_read_duplication_policy_t new_policy)
+                                                 uvm_read_duplication_policy_t new_policy,
+                                                 NvU32 level)
 {
     uvm_va_policy_node_t *node;
 
@@ -436,7 +470,7 @@ static uvm_va_policy_node_t *create_node_and_set(uvm_va_block_t *va_block,
     if (!node)
         return node;
 
-    uvm_va_policy_node_set(node, which, processor_id, new_policy);
+    uvm_va_policy_node_set(node, which, processor_id, new_policy, level);
 
     return node;
 }
@@ -447,7 +481,8 @@ static bool va_policy_node_split_needed(uvm_va_policy_node_t *node,
                                         uvm_va_policy_type_t which,
                                         bool is_default,
                                         uvm_processor_id_t processor_id,
-                                        uvm_read_duplication_policy_t new_policy)
+                                        uvm_read_duplication_policy_t new_policy,
+                                        NvU32 level)
 {
     // If the node doesn't extend beyond the range being set, it doesn't need
     // to be split.
@@ -468,6 +503,16 @@ static bool va_policy_node_split_needed(uvm_va_policy_node_t *node,
         case UVM_VA_POLICY_READ_DUPLICATION:
             return node->policy.read_duplication != new_policy;
 
+        case UVM_VA_POLICY_PRIORITIZED_LOCATION:
+            return !uvm_id_equal(node->policy.prioritized_location, processor_id) ||
+                   (!is_default && node->policy.prioritized_level != level);
+
+        case UVM_VA_POLICY_QUICK_MIGRATE:
+            return node->policy.quick_migrate == is_default;
+
+        case UVM_VA_POLICY_NO_MIGRATE:
+            return node->policy.ignore_ac_notification == is_default;
+
         default:
             UVM_ASSERT(0);
             return false;
@@ -480,7 +525,8 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                   uvm_va_policy_type_t which,
                                   bool is_default,
                                   uvm_processor_id_t processor_id,
-                                  uvm_read_duplication_policy_t new_policy)
+                                  uvm_read_duplication_policy_t new_policy,
+                                  NvU32 level)
 {
     uvm_va_policy_node_t *node, *next, *new;
     NvU64 addr;
@@ -511,7 +557,8 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                    end,
                                    which,
                                    processor_id,
-                                   new_policy);
+                                   new_policy,
+                                   level);
         if (!node)
             return NV_ERR_NO_MEMORY;
 
@@ -523,7 +570,7 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
         node_end = node->node.end;
 
         // Nodes should have been split before setting policy so verify that.
-        UVM_ASSERT(!va_policy_node_split_needed(node, start, end, which, is_default, processor_id, new_policy));
+        UVM_ASSERT(!va_policy_node_split_needed(node, start, end, which, is_default, processor_id, new_policy, level));
 
         next = uvm_va_policy_node_iter_next(va_block, node, end);
 
@@ -532,7 +579,7 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
             // Note that node may have been deleted.
         }
         else {
-            uvm_va_policy_node_set(node, which, processor_id, new_policy);
+            uvm_va_policy_node_set(node, which, processor_id, new_policy, level);
 
             // TODO: Bug 1707562: Add support for merging policy ranges.
         }
@@ -544,7 +591,8 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                       node_start - 1,
                                       which,
                                       processor_id,
-                                      new_policy);
+                                      new_policy,
+                                      level);
             if (!new)
                 return NV_ERR_NO_MEMORY;
         }
@@ -555,7 +603,8 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                       end,
                                       which,
                                       processor_id,
-                                      new_policy);
+                                      new_policy,
+                                      level);
             if (!new)
                 return NV_ERR_NO_MEMORY;
             break;
@@ -29,6 +29,7 @@
 #include "uvm_processors.h"
 #include "uvm_range_tree.h"
 #include "uvm_va_block_types.h"
+#include "uvm_ioctl.h"
 
 // This enum must be kept in sync with UVM_TEST_READ_DUPLICATION_POLICY in
 // uvm_test_ioctl.h
@@ -45,6 +46,12 @@ typedef enum
     UVM_VA_POLICY_PREFERRED_LOCATION = 0,
     UVM_VA_POLICY_ACCESSED_BY,
     UVM_VA_POLICY_READ_DUPLICATION,
+
+    // SUV policies of HMM va_blocks, see UVM_SET_PRIORITIZED_LOCATION,
+    // UVM_SET_QUICK_MIGRATE_REGION and UVM_SET_NO_MIGRATE_REGION
+    UVM_VA_POLICY_PRIORITIZED_LOCATION,
+    UVM_VA_POLICY_QUICK_MIGRATE,
+    UVM_VA_POLICY_NO_MIGRATE,
 } uvm_va_policy_type_t;
 
 //
@@ -62,6 +69,14 @@ typedef struct uvm_va_policy_struct
     // This is set to UVM_ID_INVALID if no preferred location is set.
     uvm_processor_id_t preferred_location;
     uvm_processor_id_t prioritized_location;
+
+    // Eviction level of a GPU prioritized location, below
+    // UVM_PMM_PRIORITY_LEVELS. Higher levels are evicted later.
+    NvU8 prioritized_level;
+
+    // For managed ranges, prioritized_location, prioritized_level and
+    // quick_migrate may change with the va_space lock held in read mode, see
+    // uvm_va_range_managed_t.policy_lock.
     bool quick_migrate;
 
     // Mask of processors that are accessing this VA range and should have
@@ -71,6 +86,40 @@ typedef struct uvm_va_policy_struct
     // Whether to ignore AC notificattions for this range
     bool ignore_ac_notification;
 
+    // Compiler-derived access stride in bytes seeding the cross-block stride
+    // prefetcher, 0 if unset. See UVM_SET_PREFETCH_STRIDE.
+    NvS64 prefetch_stride;
+
+    // Compiler-derived access descriptor, see UVM_SET_ACCESS_PATTERN.
+    // access_pattern is a UVM_ACCESS_PATTERN_* value, access_flags a mask of
+    // UVM_ACCESS_PATTERN_FLAG_* and access_span the bytes an iteration touches.
+    NvU8 access_pattern;
+    NvU8 access_flags;
+    NvU64 access_span;
+
+    // Contents are dead, eviction drops them. See UVM_SET_DISCARDABLE.
+    bool discardable;
+
+    // Access counter migrations of the range, see
+    // UVM_SET_ACCESS_COUNTER_POLICY. 0 leaves either to the GPU configuration.
+    NvU32 ac_threshold;
+    NvU32 ac_granularity;
+
+    // Sysmem pages are allocated as 2MB chunks, see UVM_SET_HOST_HUGE_PAGES.
+    bool host_huge_pages;
+
+    // Node sysmem pages are allocated on, NUMA_NO_NODE for the one of the VA
+    // space. See UVM_POLICY_BATCH_HOST_NODE.
+    int host_numa_node;
+
+    // Epoch of the VA space at which the range is needed next, 0 if unknown.
+    // See UVM_SET_NEXT_USE.
+    NvU64 next_use;
+
+    // Epoch at which prioritized_location and ignore_ac_notification are
+    // dropped, 0 if they are kept. See UVM_POLICY_BATCH_LEASE.
+    NvU64 lease_expiry;
+
 } uvm_va_policy_t;
 
 // Policy nodes are used for storing policies in HMM va_blocks.
@@ -94,6 +143,25 @@ extern uvm_va_policy_t uvm_va_policy_default;
 
 bool uvm_va_policy_is_read_duplicate(uvm_va_policy_t *policy, uvm_va_space_t *va_space);
 
+// Sequential and strided ranges, which are prefetched aggressively
+static bool uvm_va_policy_is_streaming(const uvm_va_policy_t *policy)
+{
+    return policy->access_pattern == UVM_ACCESS_PATTERN_SEQUENTIAL ||
+           policy->access_pattern == UVM_ACCESS_PATTERN_STRIDED;
+}
+
+// Random and pointer-chasing ranges, which are not prefetched and are mapped
+// remotely on faults rather than migrated, unless their transitions are
+// predicted
+static bool uvm_va_policy_maps_remotely(const uvm_va_policy_t *policy)
+{
+    if (policy->access_flags & UVM_ACCESS_PATTERN_FLAG_PREDICT)
+        return false;
+
+    return policy->access_pattern == UVM_ACCESS_PATTERN_RANDOM ||
+           policy->access_pattern == UVM_ACCESS_PATTERN_POINTER_CHASE;
+}
+
 // Returns the uvm_va_policy_t containing addr or default policy if not found.
 // The va_block can be either a UVM or HMM va_block.
 // Locking: The va_block lock must be held.
@@ -144,6 +212,8 @@ void uvm_va_policy_clear(uvm_va_block_t *va_block, NvU64 start, NvU64 end);
 // Fill in any missing policy nodes for the given range and set the policy
 // to the given value. The caller is expected to split any policy nodes
 // before calling this function so the range being set does not.
+// The quick migrate and no-migrate policies are set unless is_default, level
+// is the eviction level of UVM_VA_POLICY_PRIORITIZED_LOCATION.
 // The va_block must be a HMM va_block.
 // Note that start and end + 1 must be page aligned, 'end' is inclusive.
 // TODO: Bug 1707562: Add support for merging policy ranges.
@@ -154,7 +224,8 @@ NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                   uvm_va_policy_type_t which,
                                   bool is_default,
                                   uvm_processor_id_t processor_id,
-                                  uvm_read_duplication_policy_t new_policy);
+                                  uvm_read_duplication_policy_t new_policy,
+                                  NvU32 level);
 
 // Iterators for specific VA policy ranges.
 
@@ -245,7 +316,8 @@ static NV_STATUS uvm_va_policy_set_range(uvm_va_block_t *va_block,
                                          uvm_va_policy_type_t which,
                                          bool is_default,
                                          uvm_processor_id_t processor_id,
-                                         uvm_read_duplication_policy_t new_policy)
+                                         uvm_read_duplication_policy_t new_policy,
+                                         NvU32 level)
 {
     return NV_OK;
 }
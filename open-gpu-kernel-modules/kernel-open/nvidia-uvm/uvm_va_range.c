@@ -30,6 +30,7 @@
 #include "uvm_kvmalloc.h"
 #include "uvm_map_external.h"
 #include "uvm_perf_thrashing.h"
+#include "uvm_trace.h"
 #include "nv_uvm_interface.h"
 
 static struct kmem_cache *g_uvm_va_range_cache __read_mostly;
@@ -165,7 +166,24 @@ static uvm_va_range_t *uvm_va_range_alloc_managed(uvm_va_space_t *va_space, NvU6
     uvm_va_range_get_policy(va_range)->read_duplication = UVM_READ_DUPLICATION_UNSET;
     uvm_va_range_get_policy(va_range)->preferred_location = UVM_ID_INVALID;
     uvm_va_range_get_policy(va_range)->prioritized_location = UVM_ID_INVALID;
+    uvm_va_range_get_policy(va_range)->prioritized_level = 0;
     uvm_va_range_get_policy(va_range)->ignore_ac_notification = false;
+    uvm_va_range_get_policy(va_range)->prefetch_stride = 0;
+    uvm_va_range_get_policy(va_range)->access_pattern = UVM_ACCESS_PATTERN_UNKNOWN;
+    uvm_va_range_get_policy(va_range)->access_flags = 0;
+    uvm_va_range_get_policy(va_range)->access_span = 0;
+    uvm_va_range_get_policy(va_range)->discardable = false;
+    uvm_va_range_get_policy(va_range)->ac_threshold = 0;
+    uvm_va_range_get_policy(va_range)->ac_granularity = 0;
+    uvm_va_range_get_policy(va_range)->host_huge_pages = false;
+    uvm_va_range_get_policy(va_range)->host_numa_node = NUMA_NO_NODE;
+    uvm_va_range_get_policy(va_range)->next_use = 0;
+    uvm_va_range_get_policy(va_range)->lease_expiry = 0;
+    uvm_perf_prefetch_stride_init(&va_range->managed.stride);
+    uvm_perf_prefetch_markov_init(&va_range->managed.markov);
+    va_range->managed.ac_epoch = 0;
+    va_range->managed.ac_demoted = false;
+    uvm_spin_lock_init(&va_range->managed.policy_lock, UVM_LOCK_ORDER_LEAF);
 
     va_range->blocks = uvm_kvmalloc_zero(uvm_va_range_num_blocks(va_range) * sizeof(va_range->blocks[0]));
     if (!va_range->blocks) {
@@ -173,6 +191,11 @@ static uvm_va_range_t *uvm_va_range_alloc_managed(uvm_va_space_t *va_space, NvU6
         goto error;
     }
 
+    // Statistics are best effort, a failed allocation only disables them
+    va_range->managed.stats = alloc_percpu(uvm_va_range_stats_t);
+    if (!va_range->managed.stats)
+        UVM_DBG_PRINT("Failed to allocate va_range stats\n");
+
     return va_range;
 
 error:
@@ -435,6 +458,11 @@ static void uvm_va_range_destroy_managed(uvm_va_range_t *va_range)
 
     status = uvm_range_group_assign_range(va_range->va_space, NULL, va_range->node.start, va_range->node.end);
     UVM_ASSERT(status == NV_OK);
+
+    if (va_range->managed.stats) {
+        free_percpu(va_range->managed.stats);
+        va_range->managed.stats = NULL;
+    }
 }
 
 static void uvm_va_range_destroy_external(uvm_va_range_t *va_range, struct list_head *deferred_free_list)
@@ -1172,6 +1200,23 @@ NV_STATUS uvm_va_range_split(uvm_va_range_t *existing_va_range,
     // concurrently on the eviction path will see the new range's data.
     uvm_va_range_get_policy(new)->read_duplication = uvm_va_range_get_policy(existing_va_range)->read_duplication;
     uvm_va_range_get_policy(new)->preferred_location = uvm_va_range_get_policy(existing_va_range)->preferred_location;
+    uvm_va_range_get_policy(new)->prioritized_location = uvm_va_range_get_policy(existing_va_range)->prioritized_location;
+    uvm_va_range_get_policy(new)->prioritized_level = uvm_va_range_get_policy(existing_va_range)->prioritized_level;
+    uvm_va_range_get_policy(new)->quick_migrate = uvm_va_range_get_policy(existing_va_range)->quick_migrate;
+    uvm_va_range_get_policy(new)->ignore_ac_notification = uvm_va_range_get_policy(existing_va_range)->ignore_ac_notification;
+    uvm_va_range_get_policy(new)->prefetch_stride = uvm_va_range_get_policy(existing_va_range)->prefetch_stride;
+    uvm_va_range_get_policy(new)->access_pattern = uvm_va_range_get_policy(existing_va_range)->access_pattern;
+    uvm_va_range_get_policy(new)->access_flags = uvm_va_range_get_policy(existing_va_range)->access_flags;
+    uvm_va_range_get_policy(new)->access_span = uvm_va_range_get_policy(existing_va_range)->access_span;
+    uvm_va_range_get_policy(new)->discardable = uvm_va_range_get_policy(existing_va_range)->discardable;
+    uvm_va_range_get_policy(new)->ac_threshold = uvm_va_range_get_policy(existing_va_range)->ac_threshold;
+    uvm_va_range_get_policy(new)->ac_granularity = uvm_va_range_get_policy(existing_va_range)->ac_granularity;
+    uvm_va_range_get_policy(new)->host_huge_pages = uvm_va_range_get_policy(existing_va_range)->host_huge_pages;
+    uvm_va_range_get_policy(new)->host_numa_node = uvm_va_range_get_policy(existing_va_range)->host_numa_node;
+    uvm_va_range_get_policy(new)->next_use = uvm_va_range_get_policy(existing_va_range)->next_use;
+    uvm_va_range_get_policy(new)->lease_expiry = uvm_va_range_get_policy(existing_va_range)->lease_expiry;
+    new->managed.ac_epoch = existing_va_range->managed.ac_epoch;
+    new->managed.ac_demoted = existing_va_range->managed.ac_demoted;
     uvm_processor_mask_copy(&uvm_va_range_get_policy(new)->accessed_by,
                             &uvm_va_range_get_policy(existing_va_range)->accessed_by);
     uvm_processor_mask_copy(&new->uvm_lite_gpus, &existing_va_range->uvm_lite_gpus);
@@ -1443,26 +1488,194 @@ static void range_update_uvm_lite_gpus_mask(uvm_va_range_t *va_range)
                             &va_range->uvm_lite_gpus);
 }
 
+static void va_range_trace_policy(uvm_va_range_t *va_range, NvU32 policy, NvU64 value)
+{
+    trace_uvm_va_range_policy(va_range->node.start, va_range->node.end, policy, value);
+}
+
 NV_STATUS uvm_va_range_set_quick_migrate(uvm_va_range_t *va_range, bool quick_migrate)
 {
-    pr_alert("setting quick migrate actuall\n");
-    uvm_va_range_get_policy(va_range)->quick_migrate = quick_migrate;
-    return NV_OK;;
+    uvm_assert_rwsem_locked(&va_range->va_space->lock);
+
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_QUICK_MIGRATE, quick_migrate);
+
+    uvm_spin_lock(&va_range->managed.policy_lock);
+    WRITE_ONCE(uvm_va_range_get_policy(va_range)->quick_migrate, quick_migrate);
+    uvm_spin_unlock(&va_range->managed.policy_lock);
+    return NV_OK;
 }
 
 NV_STATUS uvm_va_range_set_prioritized_location(uvm_va_range_t *va_range,
-                                              uvm_processor_id_t prioritized_location)
+                                              uvm_processor_id_t prioritized_location,
+                                              NvU32 level)
 {
-  pr_alert("actually setting prioritized locatin\n");
+    va_range_trace_policy(va_range,
+                          UVM_POLICY_BATCH_PRIORITIZED_LOCATION,
+                          ((NvU64)uvm_id_value(prioritized_location) << 32) | level);
+
+    uvm_assert_rwsem_locked(&va_range->va_space->lock);
+
     // Now update the va_range state
-    uvm_va_range_get_policy(va_range)->prioritized_location = prioritized_location;
+    uvm_spin_lock(&va_range->managed.policy_lock);
+    WRITE_ONCE(uvm_va_range_get_policy(va_range)->prioritized_location, prioritized_location);
+    WRITE_ONCE(uvm_va_range_get_policy(va_range)->prioritized_level, level);
+
+    // A new pin starts idle for the sweep as of now
+    WRITE_ONCE(va_range->managed.ac_epoch, atomic64_read(&va_range->va_space->next_use_epoch));
+    WRITE_ONCE(va_range->managed.ac_demoted, false);
+    uvm_spin_unlock(&va_range->managed.policy_lock);
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_prefetch_stride(uvm_va_range_t *va_range, NvS64 stride)
+{
+    va_range_trace_policy(va_range, UVM_TRACE_POLICY_PREFETCH_STRIDE, (NvU64)stride);
+    uvm_va_range_get_policy(va_range)->prefetch_stride = stride;
+    uvm_perf_prefetch_stride_init(&va_range->managed.stride);
     return NV_OK;
 }
 
+NV_STATUS uvm_va_range_set_discardable(uvm_va_range_t *va_range, bool discardable)
+{
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_DISCARDABLE, discardable);
+    uvm_va_range_get_policy(va_range)->discardable = discardable;
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_next_use(uvm_va_range_t *va_range, NvU64 next_use)
+{
+    va_range_trace_policy(va_range, UVM_TRACE_POLICY_NEXT_USE, next_use);
+    uvm_va_range_get_policy(va_range)->next_use = next_use;
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_lease(uvm_va_range_t *va_range, NvU64 expiry)
+{
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_LEASE, expiry);
+    uvm_va_range_get_policy(va_range)->lease_expiry = expiry;
+    return NV_OK;
+}
+
+void uvm_va_range_expire_lease(uvm_va_range_t *va_range)
+{
+    uvm_va_policy_t *policy = uvm_va_range_get_policy(va_range);
+    uvm_va_block_t *va_block;
+
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_LEASE, 0);
+
+    policy->prioritized_location = UVM_ID_INVALID;
+    policy->prioritized_level = 0;
+    policy->ignore_ac_notification = false;
+    policy->lease_expiry = 0;
+    WRITE_ONCE(va_range->managed.ac_demoted, false);
+
+    // The chunks go back to the LRU lists now rather than when their blocks
+    // next migrate
+    for_each_va_block_in_va_range(va_range, va_block) {
+        uvm_mutex_lock(&va_block->lock);
+        uvm_va_block_mark_memory_used(va_block);
+        uvm_mutex_unlock(&va_block->lock);
+    }
+}
+
+void uvm_va_range_demote_prioritized(uvm_va_range_t *va_range)
+{
+    uvm_va_block_t *va_block;
+
+    va_range_trace_policy(va_range, UVM_TRACE_POLICY_AC_DEMOTE, 1);
+
+    WRITE_ONCE(va_range->managed.ac_demoted, true);
+
+    for_each_va_block_in_va_range(va_range, va_block) {
+        uvm_mutex_lock(&va_block->lock);
+        uvm_va_block_mark_memory_used(va_block);
+        uvm_mutex_unlock(&va_block->lock);
+    }
+}
+
+void uvm_va_range_note_access_counter(uvm_va_range_t *va_range)
+{
+    uvm_va_block_t *va_block;
+
+    if (!va_range || va_range->type != UVM_VA_RANGE_TYPE_MANAGED)
+        return;
+
+    WRITE_ONCE(va_range->managed.ac_epoch, atomic64_read(&va_range->va_space->next_use_epoch));
+
+    // GPUs servicing the range at the same time may both mark the blocks,
+    // which only moves their chunks to the same list twice
+    if (!READ_ONCE(va_range->managed.ac_demoted))
+        return;
+
+    va_range_trace_policy(va_range, UVM_TRACE_POLICY_AC_DEMOTE, 0);
+
+    WRITE_ONCE(va_range->managed.ac_demoted, false);
+
+    for_each_va_block_in_va_range(va_range, va_block) {
+        uvm_mutex_lock(&va_block->lock);
+        uvm_va_block_mark_memory_used(va_block);
+        uvm_mutex_unlock(&va_block->lock);
+    }
+}
+
+NV_STATUS uvm_va_range_set_host_huge_pages(uvm_va_range_t *va_range, bool host_huge_pages)
+{
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_HOST_HUGE_PAGES, host_huge_pages);
+    uvm_va_range_get_policy(va_range)->host_huge_pages = host_huge_pages;
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_host_numa_node(uvm_va_range_t *va_range, int node)
+{
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_HOST_NODE, node + 1);
+    WRITE_ONCE(uvm_va_range_get_policy(va_range)->host_numa_node, node);
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_access_counter_policy(uvm_va_range_t *va_range, NvU32 threshold, NvU32 granularity)
+{
+    uvm_va_block_t *va_block;
+
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_ACCESS_COUNTERS, ((NvU64)granularity << 32) | threshold);
+
+    uvm_va_range_get_policy(va_range)->ac_threshold = threshold;
+    uvm_va_range_get_policy(va_range)->ac_granularity = granularity;
+
+    // Accesses counted against the old threshold don't carry over
+    for_each_va_block_in_va_range(va_range, va_block) {
+        uvm_mutex_lock(&va_block->lock);
+        va_block->access_counter_count = 0;
+        uvm_mutex_unlock(&va_block->lock);
+    }
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_va_range_set_access_pattern(uvm_va_range_t *va_range,
+                                          NvU32 pattern,
+                                          NvS64 stride,
+                                          NvU64 span,
+                                          NvU32 flags)
+{
+    uvm_va_policy_t *policy = uvm_va_range_get_policy(va_range);
+
+    UVM_ASSERT(pattern < UVM_ACCESS_PATTERN_COUNT);
+    UVM_ASSERT((flags & ~UVM_ACCESS_PATTERN_FLAGS_ALL) == 0);
+
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_ACCESS_PATTERN, pattern);
+
+    policy->access_pattern = pattern;
+    policy->access_flags = flags;
+    policy->access_span = span;
+
+    return uvm_va_range_set_prefetch_stride(va_range, stride);
+}
+
 NV_STATUS uvm_va_range_set_no_migrate_region(uvm_va_range_t *va_range,
                                               bool uvm_set_no_migrate_region)
 {
-  pr_alert("actually setting no migrate region \n");
+    va_range_trace_policy(va_range, UVM_POLICY_BATCH_NO_MIGRATE, uvm_set_no_migrate_region);
+
     // Now update the va_range state
     uvm_va_range_get_policy(va_range)->ignore_ac_notification = uvm_set_no_migrate_region;
     return NV_OK;
@@ -1557,7 +1770,6 @@ NV_STATUS uvm_va_range_set_preferred_location(uvm_va_range_t *va_range,
                            &set_accessed_by_processors,
                            &uvm_va_range_get_policy(va_range)->accessed_by);
 
-  pr_alert("actually setting preferred locatin\n");
     // Now update the va_range state
     uvm_va_range_get_policy(va_range)->preferred_location = preferred_location;
     uvm_processor_mask_copy(&va_range->uvm_lite_gpus, &new_uvm_lite_gpus);
@@ -1741,6 +1953,40 @@ void uvm_vma_wrapper_destroy(uvm_vma_wrapper_t *vma_wrapper)
     kmem_cache_free(g_uvm_vma_wrapper_cache, vma_wrapper);
 }
 
+void uvm_va_range_stats_read(uvm_va_range_t *va_range, uvm_va_range_stats_t *out)
+{
+    int cpu;
+    size_t i;
+
+    memset(out, 0, sizeof(*out));
+
+    if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED || !va_range->managed.stats)
+        return;
+
+    for_each_possible_cpu(cpu) {
+        uvm_va_range_stats_t *cpu_stats = per_cpu_ptr(va_range->managed.stats, cpu);
+
+        for (i = 0; i < UVM_VA_RANGE_STAT_COUNT; i++)
+            out->counters[i] += cpu_stats->counters[i];
+    }
+}
+
+void uvm_va_space_reset_range_stats(uvm_va_space_t *va_space)
+{
+    uvm_va_range_t *va_range;
+    int cpu;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    uvm_for_each_va_range(va_range, va_space) {
+        if (va_range->type != UVM_VA_RANGE_TYPE_MANAGED || !va_range->managed.stats)
+            continue;
+
+        for_each_possible_cpu(cpu)
+            memset(per_cpu_ptr(va_range->managed.stats, cpu), 0, sizeof(uvm_va_range_stats_t));
+    }
+}
+
 static NvU64 sked_reflected_pte_maker(uvm_page_table_range_vec_t *range_vec, NvU64 offset, void *caller_data)
 {
     (void)caller_data;
@@ -42,6 +42,7 @@
 #include "uvm_mem.h"
 #include "uvm_tracker.h"
 #include "uvm_ioctl.h"
+#include "uvm_perf_prefetch.h"
 
 // VA Ranges are the UVM driver equivalent of Linux kernel vmas. They represent
 // user allocations of any page-aligned size. We maintain these as a separate
@@ -132,6 +133,35 @@ typedef struct
 //       which really belongs in the per-type structs (for example, blocks).
 //       We're deferring that cleanup to the full refactor.
 
+// Counters kept per managed va_range. The order matches the
+// UVM_VA_RANGE_STATS fields that follow base/length.
+typedef enum
+{
+    UVM_VA_RANGE_STAT_FAULTS = 0,
+    UVM_VA_RANGE_STAT_BYTES_H2D,
+    UVM_VA_RANGE_STAT_BYTES_D2H,
+    UVM_VA_RANGE_STAT_EVICTIONS,
+    UVM_VA_RANGE_STAT_THRASHING,
+    UVM_VA_RANGE_STAT_AC_NOTIFICATIONS,
+    UVM_VA_RANGE_STAT_MARKOV_PREDICTIONS,
+    UVM_VA_RANGE_STAT_MARKOV_HITS,
+    UVM_VA_RANGE_STAT_COUNT
+} uvm_va_range_stat_t;
+
+typedef struct
+{
+    NvU64 counters[UVM_VA_RANGE_STAT_COUNT];
+} uvm_va_range_stats_t;
+
+// The same counters summed over the managed va_ranges of a VA space, and
+// what each CPU had counted at the last UVM_SNAPSHOT_STAT_COLLECTION, which
+// only the snapshots write. See uvm_va_space_t.stat_epoch.
+struct uvm_va_space_epoch_stats_struct
+{
+    NvU64 counters[UVM_VA_RANGE_STAT_COUNT];
+    NvU64 snapshot[UVM_VA_RANGE_STAT_COUNT];
+};
+
 // va_range state when va_range.type == UVM_VA_RANGE_TYPE_MANAGED
 typedef struct
 {
@@ -145,7 +175,40 @@ typedef struct
     // stored in the va_block for HMM allocations.
     uvm_va_policy_t policy;
 
+    // Serializes the updates of the SUV flags of the policy (prioritized
+    // location and level, quick migrate), which are made with the va_space
+    // lock held in read mode when they need no split, so that replanning
+    // doesn't stall fault servicing. Readers take the flags with READ_ONCE()
+    // and no lock.
+    uvm_spinlock_t policy_lock;
+
     uvm_perf_module_data_desc_t perf_modules_data[UVM_PERF_MODULE_TYPE_COUNT];
+
+    // Per-CPU event counters reported by UVM_STOP_STAT_COLLECTION. May be
+    // NULL if the percpu allocation failed, in which case nothing is counted.
+    uvm_va_range_stats_t __percpu *stats;
+
+    // Block-to-block fault stride learned by the prefetcher
+    uvm_perf_prefetch_stride_t stride;
+
+    // Block-to-block fault transitions learned by the prefetcher
+    uvm_perf_prefetch_markov_t markov;
+
+    // Epoch of the VA space of the last access counter notification on the
+    // range, or of its prioritized location being set, and whether the chunks
+    // of a GPU prioritized location went to the LRU lists for lack of
+    // notifications since. See uvm_perf_prioritized_idle_epochs.
+    NvU64 ac_epoch;
+    bool ac_demoted;
+
+    // Spatial locality of the access counter migrations of the range and
+    // the block index of the last one. See uvm_perf_access_counter_expand_score.
+    NvU32 ac_locality;
+    size_t ac_last_block;
+
+    // Time, in NV_GETTIME() nanoseconds, of the last eviction of pages of the
+    // range. See uvm_perf_prefetch_quick_migrate_evict_ms.
+    NvU64 last_eviction_ns;
 } uvm_va_range_managed_t;
 
 typedef struct
@@ -803,14 +866,73 @@ NV_STATUS uvm_va_range_set_preferred_location(uvm_va_range_t *va_range,
                                               struct mm_struct *mm,
                                               uvm_tracker_t *out_tracker);
 
+// LOCKING: the va_space lock must be held in at least read mode. These two
+//          only change the policy of va_range, under its policy_lock.
 NV_STATUS uvm_va_range_set_quick_migrate(uvm_va_range_t *va_range, bool quick_migrate);
 
+// level is the eviction level of the range, below UVM_PMM_PRIORITY_LEVELS
 NV_STATUS uvm_va_range_set_prioritized_location(uvm_va_range_t *va_range,
-                                              uvm_processor_id_t prioritized_location);
+                                              uvm_processor_id_t prioritized_location,
+                                              NvU32 level);
 
 NV_STATUS uvm_va_range_set_no_migrate_region(uvm_va_range_t *va_range,
                                               bool uvm_set_no_migrate_region);
 
+// Sets the compiler-derived stride, in bytes, of the range and restarts the
+// stride prefetcher from it
+NV_STATUS uvm_va_range_set_prefetch_stride(uvm_va_range_t *va_range, NvS64 stride);
+
+NV_STATUS uvm_va_range_set_discardable(uvm_va_range_t *va_range, bool discardable);
+
+// Sets the epoch at which the range is needed next, see UVM_SET_NEXT_USE
+NV_STATUS uvm_va_range_set_next_use(uvm_va_range_t *va_range, NvU64 next_use);
+
+// Sets the epoch at which the lease of the range runs out, 0 for none. See
+// UVM_POLICY_BATCH_LEASE.
+NV_STATUS uvm_va_range_set_lease(uvm_va_range_t *va_range, NvU64 expiry);
+
+// Drops the prioritized location and the no-migrate flag of a range whose
+// lease ran out and puts the GPU chunks of its blocks back on the LRU lists.
+//
+// LOCKING: The caller must hold the VA space lock in write mode.
+void uvm_va_range_expire_lease(uvm_va_range_t *va_range);
+
+// Puts the GPU chunks of a prioritized range no access counter notification
+// came for in a while on the LRU lists, keeping its prioritized location for
+// when one comes again.
+//
+// LOCKING: The caller must hold the VA space lock in write mode.
+void uvm_va_range_demote_prioritized(uvm_va_range_t *va_range);
+
+// Records an access counter notification on va_range, which may be of any
+// type or NULL. A demoted prioritized range gets its chunks back on their
+// prioritized lists.
+//
+// LOCKING: The caller must hold the VA space lock and no va_block lock.
+void uvm_va_range_note_access_counter(uvm_va_range_t *va_range);
+
+// Whether the chunks of va_range, which may be NULL, are on the LRU lists
+// despite its prioritized location, see uvm_va_range_demote_prioritized().
+static inline bool uvm_va_range_prioritized_demoted(uvm_va_range_t *va_range)
+{
+    return va_range && va_range->type == UVM_VA_RANGE_TYPE_MANAGED && READ_ONCE(va_range->managed.ac_demoted);
+}
+
+NV_STATUS uvm_va_range_set_host_huge_pages(uvm_va_range_t *va_range, bool host_huge_pages);
+
+// See UVM_POLICY_BATCH_HOST_NODE. node is NUMA_NO_NODE or an online node.
+NV_STATUS uvm_va_range_set_host_numa_node(uvm_va_range_t *va_range, int node);
+
+// See UVM_SET_ACCESS_COUNTER_POLICY. Restarts the access count of every block.
+NV_STATUS uvm_va_range_set_access_counter_policy(uvm_va_range_t *va_range, NvU32 threshold, NvU32 granularity);
+
+// Attaches the access descriptor of UVM_SET_ACCESS_PATTERN to the range
+NV_STATUS uvm_va_range_set_access_pattern(uvm_va_range_t *va_range,
+                                          NvU32 pattern,
+                                          NvS64 stride,
+                                          NvU64 span,
+                                          NvU32 flags);
+
 // Add a processor to the accessed_by mask and establish any new required
 // mappings.
 //
@@ -865,6 +987,26 @@ static uvm_va_policy_t *uvm_va_range_get_policy(uvm_va_range_t *va_range)
     return &va_range->managed.policy;
 }
 
+// Account value to the given counter of a managed va_range, and of its VA
+// space. Safe to call with a NULL or non-managed va_range, which are ignored.
+static inline void uvm_va_range_stat_add(uvm_va_range_t *va_range, uvm_va_range_stat_t stat, NvU64 value)
+{
+    if (!va_range || va_range->type != UVM_VA_RANGE_TYPE_MANAGED || !va_range->managed.stats)
+        return;
+
+    this_cpu_add(va_range->managed.stats->counters[stat], value);
+    if (va_range->va_space->stat_epoch.stats)
+        this_cpu_add(va_range->va_space->stat_epoch.stats->counters[stat], value);
+}
+
+// Sum the per-CPU counters of a managed va_range into out
+void uvm_va_range_stats_read(uvm_va_range_t *va_range, uvm_va_range_stats_t *out);
+
+// Reset the counters of every managed va_range in va_space
+//
+// LOCKING: The caller must hold the va_space lock in at least read mode.
+void uvm_va_space_reset_range_stats(uvm_va_space_t *va_space);
+
 NV_STATUS uvm_test_va_range_info(UVM_TEST_VA_RANGE_INFO_PARAMS *params, struct file *filp);
 NV_STATUS uvm_test_va_range_split(UVM_TEST_VA_RANGE_SPLIT_PARAMS *params, struct file *filp);
 NV_STATUS uvm_test_va_range_inject_split_error(UVM_TEST_VA_RANGE_INJECT_SPLIT_ERROR_PARAMS *params, struct file *filp);
@@ -42,6 +42,45 @@
 #include "nv_uvm_interface.h"
 #include "nv-kthread-q.h"
 
+// Where the CPU pages of new VA spaces are allocated, see
+// UVM_SET_HOST_NUMA_NODE
+static int uvm_perf_host_numa_node __read_mostly = UVM_HOST_NUMA_NODE_GPU;
+module_param(uvm_perf_host_numa_node, int, S_IRUGO);
+MODULE_PARM_DESC(uvm_perf_host_numa_node,
+                 "NUMA node the CPU pages of managed memory are allocated on: the node "
+                 "closest to the GPU (-2), the node of the allocating thread (-1) or node n. "
+                 "Default: -2.");
+
+static bool host_numa_node_valid(int node)
+{
+    if (node < 0)
+        return node >= UVM_HOST_NUMA_NODE_GPU;
+
+    return node < MAX_NUMNODES && node_online(node);
+}
+
+static void va_space_update_host_numa_node(uvm_va_space_t *va_space)
+{
+    int node = NUMA_NO_NODE;
+    uvm_gpu_t *gpu;
+
+    uvm_assert_rwsem_locked_write(&va_space->lock);
+
+    if (va_space->host_numa_policy >= 0) {
+        node = va_space->host_numa_policy;
+    }
+    else if (va_space->host_numa_policy == UVM_HOST_NUMA_NODE_GPU) {
+        for_each_va_space_gpu(gpu, va_space) {
+            if (gpu->parent->closest_cpu_numa_node != -1) {
+                node = gpu->parent->closest_cpu_numa_node;
+                break;
+            }
+        }
+    }
+
+    WRITE_ONCE(va_space->host_numa_node, node);
+}
+
 static bool processor_mask_array_test(const uvm_processor_mask_t *mask,
                                       uvm_processor_id_t mask_id,
                                       uvm_processor_id_t id)
@@ -174,6 +213,9 @@ NV_STATUS uvm_va_space_create(struct inode *inode, struct file *filp)
     uvm_mutex_init(&va_space->read_acquire_write_release_lock,
                    UVM_LOCK_ORDER_VA_SPACE_READ_ACQUIRE_WRITE_RELEASE_LOCK);
     uvm_spin_lock_init(&va_space->va_space_mm.lock, UVM_LOCK_ORDER_LEAF);
+    uvm_spin_lock_init(&va_space->event_ring.lock, UVM_LOCK_ORDER_LEAF);
+    uvm_spin_lock_init(&va_space->submit_ring.lock, UVM_LOCK_ORDER_LEAF);
+    uvm_spin_lock_init(&va_space->stat_epoch.lock, UVM_LOCK_ORDER_LEAF);
     uvm_range_tree_init(&va_space->va_range_tree);
     uvm_ats_init_va_space(va_space);
 
@@ -202,6 +244,17 @@ NV_STATUS uvm_va_space_create(struct inode *inode, struct file *filp)
 
     // Init to 0 since we rely on atomic_inc_return behavior to return 1 as the first ID
     atomic64_set(&va_space->range_group_id_counter, 0);
+    atomic64_set(&va_space->next_use_epoch, 0);
+    va_space->lease_next_expiry = NV_U64_MAX;
+    va_space->host_numa_policy = host_numa_node_valid(uvm_perf_host_numa_node) ? uvm_perf_host_numa_node :
+                                                                                UVM_HOST_NUMA_NODE_LOCAL;
+    va_space->host_numa_node = NUMA_NO_NODE;
+    va_space->prioritized_next_sweep = 0;
+
+    // Statistics are best effort, a failed allocation only disables them
+    va_space->stat_epoch.stats = alloc_percpu(uvm_va_space_epoch_stats_t);
+    if (!va_space->stat_epoch.stats)
+        UVM_DBG_PRINT("Failed to allocate va_space stats\n");
 
     INIT_RADIX_TREE(&va_space->range_groups, NV_UVM_GFP_FLAGS);
     uvm_range_tree_init(&va_space->range_group_ranges);
@@ -267,6 +320,7 @@ fail:
     uvm_perf_destroy_va_space_events(&va_space->perf_events);
     uvm_va_space_up_write(va_space);
 
+    free_percpu(va_space->stat_epoch.stats);
     uvm_kvfree(va_space);
 
     return status;
@@ -365,6 +419,8 @@ static void unregister_gpu(uvm_va_space_t *va_space,
         }
     }
 
+    va_space_update_host_numa_node(va_space);
+
     va_space_check_processors_masks(va_space);
 }
 
@@ -419,6 +475,9 @@ void uvm_va_space_destroy(uvm_va_space_t *va_space)
 
     uvm_perf_heuristics_stop(va_space);
 
+    // The submit ring worker takes the VA space lock, stop it first
+    uvm_tools_submit_ring_destroy(va_space);
+
     // Stop all channels before unmapping anything. This kills the channels and
     // prevents spurious MMU faults from being generated (bug 1722021), but
     // doesn't prevent the bottom half from servicing old faults for those
@@ -560,6 +619,9 @@ void uvm_va_space_destroy(uvm_va_space_t *va_space)
 
     uvm_mutex_unlock(&g_uvm_global.global_lock);
 
+    uvm_tools_event_ring_destroy(va_space);
+
+    free_percpu(va_space->stat_epoch.stats);
     uvm_kvfree(va_space);
 }
 
@@ -822,6 +884,8 @@ NV_STATUS uvm_va_space_register_gpu(uvm_va_space_t *va_space,
             goto cleanup;
     }
 
+    va_space_update_host_numa_node(va_space);
+
     if (gpu->parent->numa_info.enabled) {
         *numa_enabled = NV_TRUE;
         *numa_node_id = (NvS32)uvm_gpu_numa_info(gpu)->node_id;
@@ -2320,7 +2384,6 @@ vm_fault_t uvm_va_space_cpu_fault_managed(uvm_va_space_t *va_space,
 }
 
 NV_STATUS uvm_api_is_allocated(UVM_IS_ALLOCATED_PARAMS *params, struct file *filp) {
-    pr_alert("is allocated api called\n");
     uvm_va_space_t *va_space = uvm_va_space_get(filp);
     const NvU64 start = params->requestedBase;
     uvm_va_block_t *va_block;
@@ -2331,3 +2394,152 @@ NV_STATUS uvm_api_is_allocated(UVM_IS_ALLOCATED_PARAMS *params, struct file *fil
     }
     return NV_OK;
 }
+
+// Sets the bits of the pieces of [base, base + length) in bitmap, rows of
+// words NvU64 per processor, on the processors all their pages are resident
+// on
+static void va_space_range_residency(uvm_va_space_t *va_space,
+                                     NvU64 base,
+                                     NvU64 length,
+                                     NvU64 granularity,
+                                     NvU32 processor_count,
+                                     NvU64 words,
+                                     NvU64 *bitmap)
+{
+    NvU64 pieces = DIV_ROUND_UP(length, granularity);
+    NvU64 piece;
+    NvU32 p;
+
+    uvm_assert_rwsem_locked(&va_space->lock);
+
+    for (piece = 0; piece < pieces; piece++) {
+        NvU64 start = base + piece * granularity;
+        NvU64 end = min(start + granularity, base + length) - 1;
+        NvU64 addr = start;
+        NvU64 resident = (processor_count == 64) ? ~0ULL : (1ULL << processor_count) - 1;
+
+        while (addr <= end && resident) {
+            uvm_va_block_t *va_block;
+            uvm_va_block_region_t region;
+
+            if (uvm_va_block_find(va_space, addr, &va_block) != NV_OK) {
+                resident = 0;
+                break;
+            }
+
+            region = uvm_va_block_region_from_start_end(va_block, addr, min(end, va_block->end));
+
+            uvm_mutex_lock(&va_block->lock);
+
+            for (p = 0; p < processor_count; p++) {
+                uvm_processor_id_t id = uvm_id_from_value(p);
+                const uvm_page_mask_t *mask = NULL;
+
+                if (UVM_ID_IS_CPU(id)) {
+                    mask = &va_block->cpu.resident;
+                }
+                else {
+                    uvm_va_block_gpu_state_t *gpu_state = uvm_va_block_gpu_state_get(va_block, id);
+
+                    if (gpu_state)
+                        mask = &gpu_state->resident;
+                }
+
+                if (!mask || !uvm_page_mask_region_full(mask, region))
+                    resident &= ~(1ULL << p);
+            }
+
+            uvm_mutex_unlock(&va_block->lock);
+
+            addr = va_block->end + 1;
+        }
+
+        for (p = 0; p < processor_count; p++) {
+            if (resident & (1ULL << p))
+                bitmap[p * words + piece / 64] |= 1ULL << (piece % 64);
+        }
+    }
+}
+
+NV_STATUS uvm_api_set_host_numa_node(const UVM_SET_HOST_NUMA_NODE_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+
+    if (!host_numa_node_valid(params->node))
+        return NV_ERR_INVALID_ARGUMENT;
+
+    uvm_va_space_down_write(va_space);
+    va_space->host_numa_policy = params->node;
+    va_space_update_host_numa_node(va_space);
+    uvm_va_space_up_write(va_space);
+
+    return NV_OK;
+}
+
+NV_STATUS uvm_api_get_residency(const UVM_GET_RESIDENCY_PARAMS *params, struct file *filp)
+{
+    uvm_va_space_t *va_space = uvm_va_space_get(filp);
+    UVM_RESIDENCY_RANGE *ranges;
+    NvU64 *bitmap = NULL;
+    NV_STATUS status = NV_OK;
+    NvU32 i;
+
+    if ((params->granularity != UVM_PAGE_SIZE_64K && params->granularity != UVM_PAGE_SIZE_2M) ||
+        params->processorCount == 0 ||
+        params->processorCount > min((NvU32)UVM_ID_MAX_PROCESSORS, 64U) ||
+        params->rangesCount == 0 ||
+        params->rangesCount > UVM_RESIDENCY_MAX_RANGES)
+        return NV_ERR_INVALID_ARGUMENT;
+
+    ranges = uvm_kvmalloc(params->rangesCount * sizeof(*ranges));
+    if (!ranges)
+        return NV_ERR_NO_MEMORY;
+
+    if (nv_copy_from_user(ranges, (void __user *)params->rangesBuffer, params->rangesCount * sizeof(*ranges))) {
+        status = NV_ERR_INVALID_ADDRESS;
+        goto done;
+    }
+
+    for (i = 0; i < params->rangesCount; i++) {
+        const UVM_RESIDENCY_RANGE *range = ranges + i;
+        NvU64 pieces = DIV_ROUND_UP(range->length, params->granularity);
+        NvU64 words = DIV_ROUND_UP(pieces, 64);
+        size_t size = words * params->processorCount * sizeof(*bitmap);
+
+        if (range->length == 0 || pieces > UVM_RESIDENCY_MAX_PIECES || !range->bitmap ||
+            range->base + range->length < range->base) {
+            status = NV_ERR_INVALID_ARGUMENT;
+            goto done;
+        }
+
+        bitmap = uvm_kvmalloc_zero(size);
+        if (!bitmap) {
+            status = NV_ERR_NO_MEMORY;
+            goto done;
+        }
+
+        uvm_va_space_down_read(va_space);
+        va_space_range_residency(va_space,
+                                 range->base,
+                                 range->length,
+                                 params->granularity,
+                                 params->processorCount,
+                                 words,
+                                 bitmap);
+        uvm_va_space_up_read(va_space);
+
+        // Copied out without the lock held
+        if (nv_copy_to_user((void __user *)range->bitmap, bitmap, size)) {
+            status = NV_ERR_INVALID_ADDRESS;
+            goto done;
+        }
+
+        uvm_kvfree(bitmap);
+        bitmap = NULL;
+    }
+
+done:
+    uvm_kvfree(bitmap);
+    uvm_kvfree(ranges);
+    return status;
+}
@@ -154,6 +154,9 @@ typedef struct
     uvm_processor_mask_t gpus;
 } uvm_cpu_gpu_affinity_t;
 
+// Commands the submit ring worker applies per VA space lock acquisition
+#define UVM_SUBMIT_RING_DRAIN_MAX 16
+
 struct uvm_va_space_struct
 {
     // Mask of gpus registered with the va space
@@ -197,6 +200,47 @@ struct uvm_va_space_struct
     // Monotonically increasing counter for range groups IDs
     atomic64_t range_group_id_counter;
 
+    // Launch count of the runtime the next-use hints of the ranges are
+    // relative to, see UVM_SET_NEXT_USE. Written with the lock held for
+    // write, read by eviction without it.
+    atomic64_t next_use_epoch;
+
+    // UVM_HOST_NUMA_NODE_* or the node the CPU pages of the VA space are to
+    // be allocated on, see UVM_SET_HOST_NUMA_NODE, and the node it comes to
+    // for the GPUs registered, NUMA_NO_NODE for the kernel's choice. Written
+    // with the lock held for write, host_numa_node is read without it.
+    int host_numa_policy;
+    int host_numa_node;
+
+    // Earliest epoch at which the lease of a range runs out, NV_U64_MAX if no
+    // lease is running. See UVM_POLICY_BATCH_LEASE. Protected by lock.
+    NvU64 lease_next_expiry;
+
+    // Epoch of the next sweep for prioritized ranges without access counter
+    // notifications, see uvm_perf_prioritized_idle_epochs. Protected by lock.
+    NvU64 prioritized_next_sweep;
+
+    // Replay policy and batch size the replayable faults of the VA space are
+    // serviced with, see uvm_perf_fault_replay_adaptive. Written by fault
+    // servicing with the lock held for read; GPUs servicing the VA space at
+    // the same time only blur the averages.
+    struct
+    {
+        // UVM_FAULT_REPLAY_HINT_*, set by UVM_SET_FAULT_REPLAY_HINT
+        NvU32 hint;
+
+        // Running averages over the batches serviced: percentage of
+        // duplicate faults, faults per VA block and service time per fault
+        NvU32 duplicate_pct;
+        NvU32 faults_per_block;
+        NvU64 ns_per_fault;
+
+        // Choice for the next batches. batch_count is 0 until the first batch
+        // of the VA space has been serviced.
+        uvm_perf_fault_replay_policy_t replay_policy;
+        NvU32 batch_count;
+    } fault_replay;
+
     // Range groups
     struct radix_tree_root range_groups;
     uvm_range_tree_t range_group_ranges;
@@ -313,6 +357,56 @@ struct uvm_va_space_struct
         struct list_head node;
     } tools;
 
+    // Ring registered with UVM_REGISTER_EVENT_RING. Producers serialize on
+    // lock, which also protects the mapping against re-registration; user
+    // space consumes without locking.
+    struct
+    {
+        uvm_spinlock_t lock;
+
+        UVM_EVENT_RING_HEADER *header;
+        UVM_EVENT_RING_RECORD *records;
+        NvU32 entries;
+
+        struct page **pages;
+        NvU64 size;
+    } event_ring;
+
+    // Counters of the managed ranges summed over the VA space, which
+    // UVM_SNAPSHOT_STAT_COLLECTION reads per epoch. stats is NULL if the
+    // percpu allocation failed. lock serializes the snapshots; epoch is the
+    // tag of the one running since the last snapshot, 0 after
+    // UVM_START_STAT_COLLECTION.
+    struct
+    {
+        uvm_spinlock_t lock;
+
+        uvm_va_space_epoch_stats_t __percpu *stats;
+        NvU64 epoch;
+    } stat_epoch;
+
+    // Ring registered with UVM_REGISTER_SUBMIT_RING. lock protects the
+    // mapping against re-registration; the worker runs on the submit ring
+    // queue of uvm_tools.c, which unregistering flushes before unmapping the
+    // ring, and stages the commands it applies in kernel memory.
+    struct
+    {
+        uvm_spinlock_t lock;
+
+        UVM_SUBMIT_RING_HEADER *header;
+        UVM_SUBMIT_RING_COMMAND *commands;
+        UVM_SUBMIT_RING_COMPLETION *completions;
+        NvU32 entries;
+
+        struct page **pages;
+        NvU64 size;
+
+        nv_kthread_q_item_t q_item;
+
+        UVM_SUBMIT_RING_COMMAND staged[UVM_SUBMIT_RING_DRAIN_MAX];
+        NV_STATUS status[UVM_SUBMIT_RING_DRAIN_MAX];
+    } submit_ring;
+
     // Boolean which is 1 if all user channels have been already stopped. This
     // is an atomic_t because multiple threads may call
     // uvm_va_space_stop_all_user_channels concurrently.
@@ -0,0 +1,72 @@
+/* Oversubscription set at run time */
+/* Included by penguin.h and by the main.cu of every workload, which may not
+ * include penguin.h itself, so everything here is static inline. */
+
+#ifndef PENGUIN_OVERSUB
+#define PENGUIN_OVERSUB
+
+#include <stdlib.h>
+
+// Framebuffer of the evaluation GPU, in MiB; PENGUIN_GPU_SIZE_MB in the
+// environment overrides it, e.g. with the memory of a MIG instance
+#ifndef PENGUIN_GPU_SIZE_MB
+#define PENGUIN_GPU_SIZE_MB 23860
+#endif
+
+// Footprint of the workload in MiB; the eval build passes it per benchmark,
+// PENGUIN_FOOTPRINT_MB in the environment overrides it
+#ifndef PENGUIN_FOOTPRINT_MB
+#define PENGUIN_FOOTPRINT_MB 0
+#endif
+
+// Headroom the runtime leaves out of the memory the workload gets
+#define PENGUIN_OVERSUB_SLACK_MB 10
+
+// MiB of the GPU the workload gets with PENGUIN_OVERSUB=<percent> set, i.e. a
+// footprint oversubscribed by that much; -1 if oversubscription isn't set
+static inline long long penguin_oversub_available_mb() {
+    const char* oversub = getenv("PENGUIN_OVERSUB");
+    if(oversub == NULL) {
+        return -1;
+    }
+    unsigned long long footprint = PENGUIN_FOOTPRINT_MB;
+    const char* env_footprint = getenv("PENGUIN_FOOTPRINT_MB");
+    if(env_footprint != NULL) {
+        footprint = strtoull(env_footprint, NULL, 10);
+    }
+    long long percent = atoll(oversub);
+    if(footprint == 0 || percent < 0) {
+        return -1;
+    }
+    return footprint * 100 / (100 + percent);
+}
+
+// Bytes main() reserves to leave the workload its share; mib is the
+// compile-time reservation, used when oversubscription isn't set. None when
+// a harness holds the reservation (PENGUIN_RESERVED_MB, see eval/sweep).
+static inline unsigned long long penguin_reservation_bytes(unsigned long long mib) {
+    if(getenv("PENGUIN_RESERVED_MB") != NULL) {
+        return 0;
+    }
+    long long available = penguin_oversub_available_mb();
+    long long gpu = PENGUIN_GPU_SIZE_MB;
+    const char* env_gpu = getenv("PENGUIN_GPU_SIZE_MB");
+    if(env_gpu != NULL) {
+        gpu = atoll(env_gpu);
+    }
+    if(available >= 0 && available < gpu) {
+        mib = gpu - available;
+    }
+    return mib * 1024ULL * 1024ULL;
+}
+
+// MiB the runtime plans with; mbs is the compile-time budget
+static inline unsigned long long penguin_budget_mb(unsigned long long mbs) {
+    long long available = penguin_oversub_available_mb();
+    if(available > PENGUIN_OVERSUB_SLACK_MB) {
+        return available - PENGUIN_OVERSUB_SLACK_MB;
+    }
+    return mbs;
+}
+
+#endif
@@ -1,240 +1,492 @@
 /* Library for calling the new ioctl for prioritizing pages on the GPU */
-/* SUV */
+/* SUV, and the SC baseline (see -penguin-policy in DynamicHostTransform) */
 
 #ifndef PENGUIN
 #define PENGUIN // the penguin library
 
 #define PENGUIN_PRIORITIZED_GPU_IOCTL_NUM 75
+// eviction levels of prioritized ranges in the driver (UVM_PMM_PRIORITY_LEVELS)
+#define PENGUIN_PRIORITY_LEVELS 4
 #define PENGUIN_NO_MIGRATE_IOCTL_NUM 76
 #define PENGUIN_START_STAT_COLLECTION_IOCTL_NUM 77
 #define PENGUIN_STOP_STAT_COLLECTION_IOCTL_NUM 78
 #define PENGUIN_QUICK_MIGRATE_IOCTL_NUM 79
 #define PENGUIN_ACCESS_COUNTER_ENABLE 80
 #define PENGUIN_IS_ALLOCATED 81
+#define PENGUIN_PREFETCH_STRIDE_IOCTL_NUM 82
+#define PENGUIN_ACCESS_PATTERN_IOCTL_NUM 83
+#define PENGUIN_POLICY_BATCH_IOCTL_NUM 84
+#define PENGUIN_DISCARDABLE_IOCTL_NUM 85
+#define PENGUIN_ACCESS_COUNTER_POLICY_IOCTL_NUM 86
+#define PENGUIN_THRASHING_EVENTS_IOCTL_NUM 87
+#define PENGUIN_EVENT_RING_IOCTL_NUM 88
+#define PENGUIN_HOST_HUGE_PAGES_IOCTL_NUM 89
+#define PENGUIN_RESIDENCY_IOCTL_NUM 90
+#define PENGUIN_MIGRATE_BATCH_IOCTL_NUM 91
+#define PENGUIN_NEXT_USE_IOCTL_NUM 92
+#define PENGUIN_FAULT_REPLAY_HINT_IOCTL_NUM 93
+#define PENGUIN_HOST_NUMA_NODE_IOCTL_NUM 94
+#define PENGUIN_SUBMIT_RING_IOCTL_NUM 95
+#define PENGUIN_KICK_SUBMIT_RING_IOCTL_NUM 96
+#define PENGUIN_SNAPSHOT_STAT_COLLECTION_IOCTL_NUM 97
 
 /* #define PENGUIN_MIN_PREFETCH (32*1024*1024) */
 #define PENGUIN_MIN_PREFETCH (8*1024*1024)
 
+// placement solver used by perform_memory_management, see penguin_solver_t
+#ifndef PENGUIN_PLACEMENT_SOLVER
+#define PENGUIN_PLACEMENT_SOLVER PENGUIN_SOLVER_FRACTIONAL
+#endif
+// the exact solver gives up above this many DP cells or this much time
+#define PENGUIN_EXACT_SOLVER_MAX_CELLS (1ULL << 24)
+#define PENGUIN_EXACT_SOLVER_BUDGET_US 2000
+#define PENGUIN_PLACEMENT_UNIT (2*1024*1024ULL)
+// share of its accesses a partially pinned allocation serves from the GPU,
+// per byte pinned; the pinned prefix is not always where the accesses land
+#define PENGUIN_PARTIAL_PIN_BENEFIT 0.5
+
+// batches kept in flight ahead of the one in use, as planned and at most
+#ifndef PENGUIN_PREFETCH_DEPTH
+#define PENGUIN_PREFETCH_DEPTH 2
+#endif
+#ifndef PENGUIN_MAX_PREFETCH_DEPTH
+#define PENGUIN_MAX_PREFETCH_DEPTH 8
+#endif
+// iterations to come penguinSuperPrefetchOrdered looks through for the
+// batches of its look-ahead
+#define PENGUIN_PREFETCH_SCAN 4096
+// look-ahead bytes in flight on the prefetch engine, at most and at first;
+// see penguinPrefetchLimiterUpdate. 0 takes the limit off.
+#ifndef PENGUIN_PREFETCH_CAP_MB
+#define PENGUIN_PREFETCH_CAP_MB 4096
+#endif
+#define PENGUIN_PREFETCH_CAP_STEP (64*1024*1024ULL)
+#define PENGUIN_PREFETCH_CONTROL_US 2000
+// the cap halves when the fault rate of a period is this much above the
+// average and at least this many faults, and grows while the link to the
+// host carries less than the share of its bandwidth
+#define PENGUIN_FAULT_RISE_RATIO 1.25
+#define PENGUIN_FAULT_RISE_MIN 64
+#define PENGUIN_LINK_IDLE_RATIO 0.5
+#define PENGUIN_PREFETCH_INFLIGHT 64
+// access counter threshold of host-pinned allocations whose density is at
+// least PENGUIN_AC_NEAR_PIN_RATIO of the last pinned one's; sparser ones never
+// migrate. See penguinSetAccessCounterPolicy.
+#ifndef PENGUIN_AC_NEAR_PIN_THRESHOLD
+#define PENGUIN_AC_NEAR_PIN_THRESHOLD 512
+#endif
+#ifndef PENGUIN_AC_NEAR_PIN_RATIO
+#define PENGUIN_AC_NEAR_PIN_RATIO 0.5
+#endif
+// thrashing reports of the driver an allocation takes before it is moved off
+// its placement, 0 ignores them. See penguinThrashingFeedback.
+#ifndef PENGUIN_THRASHING_MIN_REPORTS
+#define PENGUIN_THRASHING_MIN_REPORTS 4
+#endif
+// round trips between a launch and the host's accesses after it an
+// allocation takes before it is moved off its placement, 0 ignores them. See
+// penguinHostAccess.
+#ifndef PENGUIN_PING_PONG_TRIPS
+#define PENGUIN_PING_PONG_TRIPS 3
+#endif
+// an atomic access counts as this many plain ones in the access density: it
+// is a round trip, and one over the link if the allocation is not on the GPU
+#ifndef PENGUIN_ATOMIC_WEIGHT
+#define PENGUIN_ATOMIC_WEIGHT 8
+#endif
+// records in the event ring the driver writes to, 0 has no ring and polls the
+// thrashing reports instead. See penguinEventRingDrain.
+#ifndef PENGUIN_EVENT_RING_ENTRIES
+#define PENGUIN_EVENT_RING_ENTRIES 1024
+#endif
+// commands in the submit ring policy batches go to the driver through, 0 has
+// no ring and sends them in batch ioctls. See penguin_policy_flush.
+#ifndef PENGUIN_SUBMIT_RING_ENTRIES
+#define PENGUIN_SUBMIT_RING_ENTRIES 256
+#endif
+// share of a host-pinned allocation access counters migrate before it is moved
+// to the GPU, see penguinAccessCounterFeedback
+#define PENGUIN_AC_MIGRATED_RATIO 0.5
+// a partially pinned allocation swaps a pinned 2MB block for one of its tail
+// blocks with at least this many access counter notifications, and twice the
+// pinned one's, at most PENGUIN_HOT_BLOCK_MAX_SWAPS per launch. See
+// penguin_partial_pin_rebalance.
+#ifndef PENGUIN_HOT_BLOCK_MIN_NOTIFICATIONS
+#define PENGUIN_HOT_BLOCK_MIN_NOTIFICATIONS 8
+#endif
+// allocations the analysis can't follow (pointer chases, incomputable
+// accesses) are sampled with access counters until this many notifications
+// came in, or for at most PENGUIN_AC_SAMPLE_LAUNCHES launches. See
+// penguin_ac_sample_start.
+#ifndef PENGUIN_AC_SAMPLE_MIN_NOTIFICATIONS
+#define PENGUIN_AC_SAMPLE_MIN_NOTIFICATIONS 32
+#endif
+#ifndef PENGUIN_AC_SAMPLE_LAUNCHES
+#define PENGUIN_AC_SAMPLE_LAUNCHES 8
+#endif
+#define PENGUIN_HOT_BLOCK_MAX_SWAPS 4
+// host pinned allocations get one contiguous 2MB run of host memory per block,
+// which the GPU maps with a single PTE, see penguinSetHostHugePages
+#ifndef PENGUIN_HOST_HUGE_PAGES
+#define PENGUIN_HOST_HUGE_PAGES 1
+#endif
+// read duplicate the allocations kernels only load from, see
+// penguin_set_read_dup
+#ifndef PENGUIN_READ_DUPLICATION
+#define PENGUIN_READ_DUPLICATION 1
+#endif
+// devices the runtime places allocations on, the first ones the process sees
+// arguments the kernel fusion masks cover, KernelFusion.h's FusionMaxArgs
+#define PENGUIN_MAX_FUSION_ARGS 32
+#ifndef PENGUIN_MAX_DEVICES
+#define PENGUIN_MAX_DEVICES 8
+#endif
+// link model of the planners, see penguinTopologyProbe: GB/s of one NVLink
+// per direction, of a coherent CPU link and of device memory, with the
+// latency of an access over each, in us
+#ifndef PENGUIN_NVLINK_GBS
+#define PENGUIN_NVLINK_GBS 25.0
+#endif
+#define PENGUIN_C2C_GBS 450.0
+#define PENGUIN_LOCAL_GBS 900.0
+#define PENGUIN_PCIE_LATENCY_US 1.0
+#define PENGUIN_NVLINK_LATENCY_US 0.7
+#define PENGUIN_C2C_LATENCY_US 0.6
+#define PENGUIN_LOCAL_LATENCY_US 0.4
+// reads from the NVMe tier, see penguinNvmeMallocManaged, bound by the host
+// link of the device as well
+#ifndef PENGUIN_NVME_GBS
+#define PENGUIN_NVME_GBS 6.0
+#endif
+#define PENGUIN_NVME_LATENCY_US 80.0
+// bytes moved per counted access, and what servicing the faults of a
+// PENGUIN_PLACEMENT_UNIT migrated on demand adds to its transfer, in us
+#define PENGUIN_ACCESS_BYTES 32
+#define PENGUIN_MIGRATION_FAULT_US 20.0
+// give the launches of each stream a residency scope, see
+// penguin_scope_budget
+#ifndef PENGUIN_STREAM_SCOPES
+#define PENGUIN_STREAM_SCOPES 1
+#endif
+// waves of thread blocks past the running one that the working set of a long
+// launch leaves room for, and that are prefetched ahead of it
+#ifndef PENGUIN_WAVE_LOOKAHEAD
+#define PENGUIN_WAVE_LOOKAHEAD 1
+#endif
+// prefetch ahead of the blocks a running launch has started, counted on the
+// device by the penguin-progress-hints pass; the eval build sets it with
+// SUV_PROGRESS_HINTS
+#ifndef PENGUIN_PROGRESS
+#define PENGUIN_PROGRESS 0
+#endif
+// period the counter is polled at during a launch
+#ifndef PENGUIN_PROGRESS_POLL_US
+#define PENGUIN_PROGRESS_POLL_US 50
+#endif
+// count the global loads and stores of a sample of the threads per 2MB
+// block, in the device histogram the penguin-access-sampling pass adds to,
+// and report them against the access counts and working sets the analysis
+// predicted; the eval build sets it with SUV_ACCESS_SAMPLING
+#ifndef PENGUIN_ACCESS_SAMPLING
+#define PENGUIN_ACCESS_SAMPLING 0
+#endif
+// slots of the histogram, a power of two
+#ifndef PENGUIN_SAMPLE_SLOTS
+#define PENGUIN_SAMPLE_SLOTS 65536
+#endif
+// fewest waves of thread blocks a chunk of a split grid runs, which bounds
+// the number of launches a grid is split into
+#ifndef PENGUIN_GRID_SPLIT_MIN_WAVES
+#define PENGUIN_GRID_SPLIT_MIN_WAVES 2
+#endif
+
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <ctype.h>
 #include <iostream>
 #include <map>
+#include <tuple>
 #include <set>
 #include <vector>
+#include <deque>
+#include <string>
 #include <algorithm>
+#include <numeric>
 #include <stdint.h>
+#include <stddef.h>
 #include <dirent.h>
 #include <sys/ioctl.h>
 #include <cuda_runtime.h>
 #include <nvml.h>
 #include <iterator>
+#include <chrono>
+#include <atomic>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <stdarg.h>
+#include "penguin-oversub.h"
 
 #define NVML_PROFILER 1
-#define NVML_TX 0
+#define NVML_TX 0 // both directions are sampled now; kept for set_profiler_pcie.sh
 unsigned int nvml_running = 0;
 pthread_t monitor;
 
-#define PSF_DIR "/proc/self/fd"
-#define NVIDIA_UVM_PATH "/dev/nvidia-uvm"
-
-static int nvidia_uvm_fd = -1;
-
-/* static volatile unsigned counter = 0; */
-
-unsigned long long MBs = 2259ULL;
-unsigned long long gpu_memory = 1 *  MBs * 1024ULL * 1024ULL;
-unsigned long long available = gpu_memory;
-unsigned long long pinned_memory = 0;
-// add code to evict anything whose use is over
-// add code to prioritize higher AD temporal region over lower AD temporal region
-
-enum State {
-    PENGUIN_STATE_UNKNOWN,
-    PENGUIN_STATE_GPU,
-    PENGUIN_STATE_GPU_PINNED,
-    PENGUIN_STATE_HOST,
-    PENGUIN_STATE_AC,
-    PENGUIN_STATE_MAX
-};
-
-enum Decision {
-    PENGUIN_DEC_NONE,
-    PENGUIN_DEC_HOST_PIN,
-    PENGUIN_DEC_GPU_PIN,
-    PENGUIN_DEC_GPU_HOST_PARTIAL_PIN,
-    PENGUIN_DEC_MIGRATE_ON_DEMAND,
-    PENGUIN_DEC_ITERATION_MIGRATION,
-    PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN,
-    PENGUIN_DEC_ACCESS_COUNTER,
-    PENGUIN_DEC_MAX
-};
-
-typedef enum {
-    PENGUIN_OK,
-    PENGUIN_ERR_PATH,
-    PENGUIN_ERR_IOCTL,
-    PENGUIN_ERR_NOT_IMPLEMENTED
-} penguin_error_t;
+// Overhead profiler. Every entry point of the runtime opens a
+// PENGUIN_ENTRY() scope, and a few costly steps within one a named
+// PENGUIN_OVERHEAD_SCOPE; with PENGUIN_OVERHEAD=1 set, the calls and the
+// steady_clock time of each are counted per thread and summed in a table on
+// stderr at exit. Times are inclusive, so an entry point that calls another
+// counts its time too. Unset, a scope costs a branch; built with
+// -DPENGUIN_OVERHEAD_PROFILER=0 it is compiled out.
+#ifndef PENGUIN_OVERHEAD_PROFILER
+#define PENGUIN_OVERHEAD_PROFILER 1
+#endif
+#define PENGUIN_OVERHEAD_MAX_SITES 256
 
-typedef struct 
+typedef struct
 {
-    void *base;
-    size_t length;
-    uint8_t uuid[16];
-    int status;
-} penguin_prioritized_ioctl_params;
+    unsigned long long calls[PENGUIN_OVERHEAD_MAX_SITES];
+    unsigned long long ns[PENGUIN_OVERHEAD_MAX_SITES];
+} penguin_overhead_counters;
+
+pthread_mutex_t overhead_lock = PTHREAD_MUTEX_INITIALIZER;
+const char* overhead_site_name[PENGUIN_OVERHEAD_MAX_SITES];
+unsigned overhead_sites = 0;
+// the counters of every thread that opened a scope; kept after the thread
+// exits so the summary has them
+std::vector<penguin_overhead_counters*> overhead_threads;
+thread_local penguin_overhead_counters* overhead_counters = NULL;
+std::chrono::steady_clock::time_point overhead_start = std::chrono::steady_clock::now();
+
+void penguin_overhead_report() {
+    pthread_mutex_lock(&overhead_lock);
+    std::vector<std::pair<unsigned long long, unsigned>> order;
+    unsigned long long calls[PENGUIN_OVERHEAD_MAX_SITES] = {};
+    unsigned long long ns[PENGUIN_OVERHEAD_MAX_SITES] = {};
+    for(unsigned site = 0; site < overhead_sites; site++) {
+        for(auto t : overhead_threads) {
+            calls[site] += t->calls[site];
+            ns[site] += t->ns[site];
+        }
+        if(calls[site] != 0) {
+            order.push_back(std::make_pair(ns[site], site));
+        }
+    }
+    pthread_mutex_unlock(&overhead_lock);
+    std::sort(order.rbegin(), order.rend());
+    double wall_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - overhead_start).count();
+    fprintf(stderr, "penguin overhead over %.3f ms of wall time\n", wall_ms);
+    fprintf(stderr, "%-40s %12s %12s %10s %7s\n", "function", "calls", "total ms", "mean us", "wall %");
+    for(auto &o : order) {
+        unsigned site = o.second;
+        fprintf(stderr, "%-40s %12llu %12.3f %10.3f %7.2f\n", overhead_site_name[site], calls[site],
+                ns[site] / 1e6, ns[site] / 1e3 / calls[site], wall_ms > 0 ? ns[site] / 1e4 / wall_ms : 0);
+    }
+}
 
-typedef struct 
-{
-    uint8_t uuid[16];
-    unsigned mimc_gran;
-    unsigned momc_gran;
-    unsigned mimc_use_limit;
-    unsigned momc_use_limit;
-    unsigned threshold;
-    bool enable_mimc;
-    bool enable_momc;
-    int status;
-} penguin_enable_access_counter_param;
+bool penguin_overhead_init() {
+    const char* env = getenv("PENGUIN_OVERHEAD");
+    if(env == NULL || strcmp(env, "0") == 0) {
+        return false;
+    }
+    atexit(penguin_overhead_report);
+    return true;
+}
 
-typedef struct 
-{
-    void *base;
-    size_t length;
-    bool quick_migrate;
-} penguin_quick_migrate_ioctl_params;
+bool overhead_enabled = penguin_overhead_init();
 
-typedef struct 
-{
-    void *base;
-    /* size_t length; */
-    bool is_allocated;
-    int status;
-} penguin_pin_host_params;
+// Index of a scope's name, once per scope
+unsigned penguin_overhead_site(const char* name) {
+    pthread_mutex_lock(&overhead_lock);
+    // the last site holds the scopes there is no room for
+    unsigned site = overhead_sites;
+    if(site < PENGUIN_OVERHEAD_MAX_SITES - 1) {
+        overhead_site_name[site] = name;
+        overhead_sites++;
+    } else {
+        site = PENGUIN_OVERHEAD_MAX_SITES - 1;
+        overhead_site_name[site] = "(other)";
+        overhead_sites = PENGUIN_OVERHEAD_MAX_SITES;
+    }
+    pthread_mutex_unlock(&overhead_lock);
+    return site;
+}
 
-typedef struct 
-{
-    void *base;
-    size_t length;
-    bool ignore_notifications;
-    int status;
-} penguin_ignore_notif_ioctl_params;
+struct penguin_overhead_scope {
+    unsigned site;
+    std::chrono::steady_clock::time_point start;
+    penguin_overhead_scope(unsigned site) : site(site) {
+        if(overhead_enabled) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~penguin_overhead_scope() {
+        if(!overhead_enabled) {
+            return;
+        }
+        unsigned long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if(overhead_counters == NULL) {
+            overhead_counters = new penguin_overhead_counters();
+            pthread_mutex_lock(&overhead_lock);
+            overhead_threads.push_back(overhead_counters);
+            pthread_mutex_unlock(&overhead_lock);
+        }
+        overhead_counters->calls[site]++;
+        overhead_counters->ns[site] += ns;
+    }
+};
 
-typedef struct
-{
-    int status;
-} penguin_start_stat_collection_params;
+#if PENGUIN_OVERHEAD_PROFILER
+#define PENGUIN_OVERHEAD_SCOPE(name) \
+    static unsigned penguin_overhead_site_ = penguin_overhead_site(name); \
+    penguin_overhead_scope penguin_overhead_scope_(penguin_overhead_site_)
+#else
+#define PENGUIN_OVERHEAD_SCOPE(name)
+#endif
 
-typedef struct
-{
-    int status;
-}  penguin_stop_stat_collection_params;
+// The outermost calls of the host thread into the runtime, which the
+// decision log counts
+void penguin_decision_log_call_begin();
+void penguin_decision_log_call_end();
 
-std::map<void*, unsigned long long> allocation_size_map;
-std::map<void*, unsigned long long> allocation_ac_map;
-std::map<void*, unsigned long long> allocation_pd_bidx_map;
-std::map<void*, unsigned long long> allocation_pd_bidy_map;
-std::map<void*, unsigned long long> allocation_pd_phi_map;
-std::map<void*, unsigned long long> allocation_wss_map;
-std::vector<std::pair<void*, unsigned long long>> ad_vector;
-std::vector<std::pair<void*, unsigned long long>> wss_vector;
+struct penguin_call_scope {
+    penguin_call_scope() {
+        penguin_decision_log_call_begin();
+    }
+    ~penguin_call_scope() {
+        penguin_decision_log_call_end();
+    }
+};
 
-std::map<unsigned, unsigned long long> aid_ac_map;
-std::map<unsigned, void*> aid_allocation_map;
-std::map<unsigned, unsigned long long> aid_wss_map_iterdep;
-std::map<unsigned, unsigned long long> aid_wss_map;
-std::map<unsigned, bool> aid_pchase_map;
-std::map<unsigned, unsigned> aid_invocation_id_map;
-std::map<unsigned, bool> aid_ac_incomp_map;
+#define PENGUIN_ENTRY() \
+    PENGUIN_OVERHEAD_SCOPE(__func__); \
+    penguin_call_scope penguin_call_scope_
+
+// Registry lock. Host threads may call the runtime concurrently, e.g. one
+// per stream: the entry points that plan or change the runtime's state open
+// a PENGUIN_LOCKED_ENTRY() scope on this one recursive lock, so their calls
+// take turns, and the state of the launch being planned (its stream and
+// shape, the policy batch) is per thread. The per-iteration path,
+// penguinSuperPrefetch(Wrapper), and the getters take no lock: descriptors
+// never move (penguin_alloc_table), pointers are found through a lock-free
+// index (penguin_alloc_index), the budget is atomic, and the prefetch list is
+// copied under a sequence count (penguin_id_list). The prefetch state of an
+// allocation belongs to the thread whose loop prefetches it.
+pthread_mutex_t registry_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+struct penguin_registry_scope {
+    penguin_registry_scope() {
+        pthread_mutex_lock(&registry_lock);
+    }
+    ~penguin_registry_scope() {
+        pthread_mutex_unlock(&registry_lock);
+    }
+};
 
-// Badly named
-std::map<unsigned, unsigned long long> aid_ac_map_reuse;
-std::map<unsigned, void*> aid_allocation_map_reuse;
-std::map<unsigned, unsigned> aid_invocation_id_map_reuse;
+#define PENGUIN_LOCKED_ENTRY() \
+    PENGUIN_ENTRY(); \
+    penguin_registry_scope penguin_registry_scope_
+
+// NVTX annotations for Nsight Systems, in an "SUV" domain: a range around
+// every planner call and ioctl, and a marker for every decision and every
+// prefetch issued, so the timeline shows them next to the kernels. Emitted
+// only under a tool (NVTX_INJECTION64_PATH is set, as nsys does); nvtx3 is
+// header only, -DPENGUIN_NVTX=0 builds without it.
+#ifndef PENGUIN_NVTX
+#define PENGUIN_NVTX 1
+#endif
+#if PENGUIN_NVTX
+#include <nvtx3/nvToolsExt.h>
+#endif
 
-extern "C"
-void add_aid_ac_map_reuse(unsigned aid, unsigned long long ac) {
-    /* std::cout << "adi aid ac map resue " << aid  << " " << ac << "\n"; */
-    aid_ac_map_reuse[aid] = ac;
-}
+#define PENGUIN_NVTX_PLAN     0xff4caf50
+#define PENGUIN_NVTX_IOCTL    0xff9e9e9e
+#define PENGUIN_NVTX_DECISION 0xffff9800
+#define PENGUIN_NVTX_H2D      0xff2196f3
+#define PENGUIN_NVTX_D2H      0xfff44336
 
-extern "C"
-void add_aid_allocation_map_reuse(unsigned aid, void* allocation) {
-    /* std::cout<< "add_aid_allocation_map reuse" << aid << " " << allocation << std::endl; */
-    aid_allocation_map_reuse[aid] = allocation;
-}
+bool nvtx_enabled = PENGUIN_NVTX && getenv("NVTX_INJECTION64_PATH") != NULL;
+#if PENGUIN_NVTX
+nvtxDomainHandle_t nvtx_domain = nvtx_enabled ? nvtxDomainCreateA("SUV") : NULL;
+#endif
 
-extern "C"
-void add_aid_invocation_map_reuse(unsigned aid, unsigned invocation_id) {
-    /* std::cout<< "add_aid_invocation_map reuse" << aid << " " << invocation_id << std::endl; */
-    aid_invocation_id_map_reuse[aid] = invocation_id;
+// Pushes a range, or places a marker, named by the format; true if pushed
+bool penguin_nvtx_event(bool range, unsigned color, const char* format, ...) {
+#if PENGUIN_NVTX
+    char message[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    nvtxEventAttributes_t event = {};
+    event.version = NVTX_VERSION;
+    event.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+    event.colorType = NVTX_COLOR_ARGB;
+    event.color = color;
+    event.messageType = NVTX_MESSAGE_TYPE_ASCII;
+    event.message.ascii = message;
+    if(range) {
+        nvtxDomainRangePushEx(nvtx_domain, &event);
+        return true;
+    }
+    nvtxDomainMarkEx(nvtx_domain, &event);
+#endif
+    return false;
 }
 
-std::map<void*, unsigned> AllocationToItersPerBatchMap; 
-std::map<void*, unsigned> AllocationToLengthMap; 
-
-// working data structures
-std::map<void*, std::map<unsigned, unsigned long long>> AllocationToInvocationIDtoADMap;
-std::map<void*, std::map<unsigned, Decision>> AllocationToInvocationIDtoDecisionMap;
-
-std::map<unsigned, std::map<void*, Decision>> InvocationIDtoAllocationToADMap;
-std::map<unsigned, std::map<void*, Decision>> InvocationIDtoAllocationToDecisionMap;
-std::map<unsigned, std::map<void*, unsigned long long>> InvocationIDtoAllocationToPartialSize;
-std::map<void*, Decision> AllocationToCommonDecisionMap;
-std::map<void*, unsigned long long> AllocationToPartialSizeMap;
-
-std::map<void*, Decision> AllocationToDecisionMap;
-std::map<void*, bool> AllocationToPrefetchBoolMap;
-std::map<void*, unsigned long long> AllocationToPrefetchSizeMap;
-std::map<void*, unsigned long long> AllocationToPrefetchItersPerBatchMap;
-std::map<void*, unsigned long long> AllocationToPchaseMap;
+struct penguin_nvtx_range {
+    bool pushed;
+    penguin_nvtx_range(bool pushed) : pushed(pushed) {}
+    ~penguin_nvtx_range() {
+#if PENGUIN_NVTX
+        if(pushed) {
+            nvtxDomainRangePop(nvtx_domain);
+        }
+#endif
+    }
+};
 
-static bool is_iterative = false;
+// the arguments are only evaluated under a tool
+#define PENGUIN_NVTX_RANGE(color, ...) \
+    penguin_nvtx_range penguin_nvtx_range_(nvtx_enabled && penguin_nvtx_event(true, color, __VA_ARGS__))
+#define PENGUIN_NVTX_MARK(color, ...) \
+    do { if(nvtx_enabled) penguin_nvtx_event(false, color, __VA_ARGS__); } while(0)
 
-// this bool helps helper function at kernel invocations to quickly decide if 
-// there are any API calls to be made or it can just skip
-std::map<unsigned, bool> InvocationIDtoDecisionBoolMap;
-std::set<unsigned> InvocationIDs;
+#define PSF_DIR "/proc/self/fd"
+#define NVIDIA_UVM_PATH "/dev/nvidia-uvm"
 
-// state maps
-std::map<void*, State> AllocationStateMap;
-std::map<void*, unsigned long long> AllocationGPUResStart;
-std::map<void*, unsigned long long> AllocationGPUResStop;
-std::map<void*, bool> AllocationStateIterBoolMap;
-std::map<void*, unsigned> AllocationStateIterStartMap;
-std::map<void*, unsigned> AllocationStateIterStopMap;
+static int nvidia_uvm_fd = -1;
 
-// Do we need "C" linkage?
+// Returns once the start-up state is there, see penguin_init_run
+static void penguin_init_wait();
 
-void* round_down(void* addr) {
-    unsigned long long ad = (unsigned long long) addr;
-    return (void*) ((ad >> 16) << 16);
+// The fd the CUDA driver opened /dev/nvidia-uvm on when it initialized,
+// found in /proc/self/fd by penguin_init_run; -1 if there is none
+static int penguin_uvm_fd() {
+    if (nvidia_uvm_fd < 0)
+        penguin_init_wait();
+    return nvidia_uvm_fd;
 }
 
-extern "C"
-penguin_error_t penguinSetPrioritizedLocation(void *base, size_t length,
-        unsigned proc_id) {
+static void penguin_uvm_fd_scan() {
+    PENGUIN_OVERHEAD_SCOPE("/proc/self/fd scan");
 
     DIR *d;
     struct dirent *dir;
     char psf_path[512];
     char *psf_realpath;
-    penguin_prioritized_ioctl_params request;
-    int status;
-
-
-    /* std::cout << "set prioritized location " << base << std::endl; */
-
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
-
-    for(int i = 0; i < 16; i++) {
-        request.uuid[i] = prop.uuid.bytes[i];
-        printf("%u", prop.uuid.bytes[i]);
-    }
-
-    request.base = base;
-    request.length = length;
 
     d = opendir(PSF_DIR);
     if (d)
@@ -245,7 +497,7 @@ penguin_error_t penguinSetPrioritizedLocation(void *base, size_t length,
             {
                 sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
                 psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
+                if (psf_realpath != NULL && strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
                     nvidia_uvm_fd = atoi(dir->d_name);
                 free(psf_realpath);
                 if (nvidia_uvm_fd >= 0)
@@ -254,1269 +506,11152 @@ penguin_error_t penguinSetPrioritizedLocation(void *base, size_t length,
         }
         closedir(d);
     }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
+}
+
+static void penguin_submit_ring_quiesce();
+static bool penguin_decision_log_ioctl(unsigned long request, void* params);
+bool penguin_decision_log_replaying();
+
+// ioctl on the UVM fd, timed as one site. The commands posted to the submit
+// ring are applied first, so that the driver sees the calls in program order.
+// A placement ioctl the decision log replays in its place is not made.
+static int penguin_ioctl(unsigned long request, void* params) {
+    penguin_submit_ring_quiesce();
+    if(!penguin_decision_log_ioctl(request, params)) {
+        return 0;
     }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_PRIORITIZED_GPU_IOCTL_NUM, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        return PENGUIN_ERR_IOCTL;
+    PENGUIN_OVERHEAD_SCOPE("ioctl");
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_IOCTL, "ioctl %lu", request);
+    return ioctl(nvidia_uvm_fd, request, params);
+}
+
+// Records of the decision log (see penguin_decision_log_take)
+enum {
+    PENGUIN_LOG_ALLOCATION, // base, length, extra = allocation sequence
+    PENGUIN_LOG_DECISION,   // base, length, value = decision, extra = sequence
+    PENGUIN_LOG_PREFETCH,   // base, length, value = device, extra = PENGUIN_LOG_STREAM_*
+    PENGUIN_LOG_ADVISE,     // base, length, value = device, extra = advice
+    PENGUIN_LOG_POLICY,     // payload: penguin_policy_batch_entry of a batch
+    PENGUIN_LOG_MIGRATE,    // payload: penguin_migrate_batch_entry, extra = flags
+    PENGUIN_LOG_NEXT_USE,   // payload: penguin_next_use_entry, extra = epoch
+    PENGUIN_LOG_IOCTL       // payload: the params, value = ioctl number
+};
+
+bool penguin_decision_log_take(unsigned kind, const void* base, unsigned long long length,
+        long long value, unsigned long long extra, const void* payload = NULL, unsigned bytes = 0);
+void penguin_decision_log_note(unsigned kind, const void* base, unsigned long long length,
+        long long value, unsigned long long extra);
+
+// cudaMemPrefetchAsync and cudaMemAdvise of the runtime, which the decision
+// log records or replays
+cudaError_t penguin_mem_prefetch(const void* base, size_t length, int device,
+        cudaStream_t stream = 0);
+cudaError_t penguin_mem_advise(const void* base, size_t length, cudaMemoryAdvise advice,
+        int device);
+
+// Devices allocations are placed on, at most PENGUIN_MAX_DEVICES
+static int penguin_num_devices() {
+    static int count = 0;
+    penguin_init_wait();
+    if (count == 0) {
+        if (cudaGetDeviceCount(&count) != cudaSuccess || count < 1)
+            count = 1;
+        count = std::min(count, PENGUIN_MAX_DEVICES);
     }
-    return PENGUIN_OK;
+    return count;
 }
 
-extern "C"
-penguin_error_t penguinSetQuickMigrate(void *base, size_t length,
-        bool quick_migrate) {
+// UUID of device, which the ranges placed there are prioritized on
+static const uint8_t* penguin_gpu_uuid(int device = 0) {
+    static uint8_t uuid[PENGUIN_MAX_DEVICES][16];
+    static bool uuid_valid[PENGUIN_MAX_DEVICES];
+    penguin_init_wait();
+    if (!uuid_valid[device]) {
+        cudaDeviceProp prop;
+        cudaGetDeviceProperties(&prop, device);
+        memcpy(uuid[device], prop.uuid.bytes, sizeof(uuid[device]));
+        uuid_valid[device] = true;
+    }
+    return uuid[device];
+}
 
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_quick_migrate_ioctl_params request;
-    int status;
+// Whether NVML is there, initialized once for the whole run
+static bool penguin_nvml_ready() {
+    static int ready = -1;
+    penguin_init_wait();
+    if (ready < 0)
+        ready = nvmlInit() == NVML_SUCCESS;
+    return ready;
+}
 
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
+// The NVML handle of device, by PCI bus as NVML numbers the devices in its
+// own order; false if NVML has none. That of the whole GPU for a MIG
+// instance.
+static bool penguin_nvml_device(int device, nvmlDevice_t* handle) {
+    static nvmlDevice_t handles[PENGUIN_MAX_DEVICES];
+    static signed char found[PENGUIN_MAX_DEVICES]; // 0 not looked up yet
+    penguin_init_wait();
+    if (found[device] == 0) {
+        char bus_id[32];
+        found[device] = penguin_nvml_ready() &&
+            cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), device) == cudaSuccess &&
+            nvmlDeviceGetHandleByPciBusId(bus_id, &handles[device]) == NVML_SUCCESS ? 1 : -1;
+    }
+    *handle = handles[device];
+    return found[device] > 0;
+}
 
-    request.base = base;
-    request.length = length;
+// The MIG GPU instance a device is, if it is one. CUDA then sees the
+// instance alone; NVML reports memory and processes per instance but PCIe
+// and energy only for the GPU it is carved from, which the telemetry
+// apportions by the instance's share of the memory. PENGUIN_MIG=0 takes
+// every device for a whole GPU.
+struct penguin_mig_instance {
+    bool probed = false;
+    bool mig = false;
+    nvmlDevice_t handle;            // of the instance
+    nvmlDevice_t parent;            // of the GPU
+    unsigned long long total = 0;   // memory of the instance, in bytes
+    unsigned long long free = 0;    // of it when probed
+    double share = 1;
+};
 
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
-            }
-        }
-        closedir(d);
+static penguin_mig_instance& penguin_mig(int device = 0) {
+    static penguin_mig_instance instances[PENGUIN_MAX_DEVICES];
+    penguin_mig_instance &m = instances[device];
+    penguin_init_wait();
+    if(m.probed) {
+        return m;
     }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
+    m.probed = true;
+    const char* env = getenv("PENGUIN_MIG");
+    if(env != NULL && strcmp(env, "0") == 0) {
+        return m;
     }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_QUICK_MIGRATE_IOCTL_NUM, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        fprintf(stderr, "debuggy\n");
-        return PENGUIN_ERR_IOCTL;
+    // the UUID CUDA gives a MIG device is the instance's, which NVML names
+    // MIG-<uuid>
+    const uint8_t* u = penguin_gpu_uuid(device);
+    char uuid[64];
+    snprintf(uuid, sizeof(uuid),
+            "MIG-%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+            u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7], u[8], u[9], u[10], u[11], u[12],
+            u[13], u[14], u[15]);
+    unsigned is_mig = 0;
+    nvmlMemory_t instance, whole;
+    if(!penguin_nvml_ready() || nvmlDeviceGetHandleByUUID(uuid, &m.handle) != NVML_SUCCESS ||
+            nvmlDeviceIsMigDeviceHandle(m.handle, &is_mig) != NVML_SUCCESS || !is_mig ||
+            nvmlDeviceGetDeviceHandleFromMigDeviceHandle(m.handle, &m.parent) != NVML_SUCCESS ||
+            nvmlDeviceGetMemoryInfo(m.handle, &instance) != NVML_SUCCESS || instance.total == 0) {
+        return m;
     }
-    return PENGUIN_OK;
+    m.mig = true;
+    m.total = instance.total;
+    m.free = instance.free;
+    if(nvmlDeviceGetMemoryInfo(m.parent, &whole) == NVML_SUCCESS && whole.total > instance.total) {
+        m.share = (double) instance.total / whole.total;
+    }
+    return m;
 }
 
-extern "C"
-penguin_error_t penguinSetNoMigrateRegion(void *base, size_t length,
-        unsigned proc_id, bool setNoMigrate) {
+// UUID the driver takes for the CPU (NV_PROCESSOR_UUID_CPU_DEFAULT)
+static const uint8_t penguin_cpu_uuid[16] = {
+    0xa6, 0x5e, 0x0f, 0x4e, 0xd7, 0xd4, 0x7b, 0xa2,
+    0x50, 0x47, 0x41, 0x2c, 0x14, 0x2a, 0x77, 0x73
+};
 
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_ignore_notif_ioctl_params request;
-    int status;
+// Device the kernel about to be launched runs on
+static int penguin_launch_device() {
+    int device = 0;
+    if (penguin_num_devices() == 1 || cudaGetDevice(&device) != cudaSuccess ||
+            device >= penguin_num_devices())
+        return 0;
+    return device;
+}
 
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
+/* static volatile unsigned counter = 0; */
 
-    request.base = base;
-    request.length = length;
-    request.ignore_notifications = setNoMigrate;
+unsigned long long MBs = 2259ULL;
+// Budget the planners work with and the part of it not given out yet, in
+// bytes. penguinBudgetInit replaces the compile-time value below, see there.
+unsigned long long gpu_memory = 1 *  penguin_budget_mb(MBs) * 1024ULL * 1024ULL;
+std::atomic<unsigned long long> available(gpu_memory);
+unsigned long long pinned_memory = 0;
+// add code to evict anything whose use is over
+// add code to prioritize higher AD temporal region over lower AD temporal region
 
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
-            }
-        }
-        closedir(d);
-    }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
-    }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_NO_MIGRATE_IOCTL_NUM, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        return PENGUIN_ERR_IOCTL;
+// GPU memory budget. At the first planner call it is, in this order, what
+// penguinSetMemoryBudget was given, PENGUIN_GPU_BUDGET_MB, the share
+// PENGUIN_OVERSUB leaves (penguin-oversub.h), or what cudaMemGetInfo reports
+// free less a slack; MBs if none of these is known. In a MIG instance the
+// memory is the instance's, which also caps the budget. On a shared GPU the
+// budget then shrinks by what the other processes allocate beyond what they
+// held at that point, and grows back when they free it, but never above an
+// explicit budget. The other processes are sampled through NVML: the free
+// memory of the driver also drops when our own managed pages fault in.
+// PENGUIN_BUDGET_TRACK=0 keeps the budget fixed. Co-located SUV processes
+// don't track each other but split the device through the arbiter below.
+#define PENGUIN_BUDGET_PERIOD_US 100000
+// smaller moves of the other processes leave the budget alone
+#define PENGUIN_BUDGET_HYSTERESIS (64*1024*1024ULL)
+
+unsigned long long configured_gpu_memory = 0;
+bool budget_set = false;        // by penguinSetMemoryBudget
+bool budget_initialized = false;
+bool budget_elastic = false;    // taken from the free memory, may grow
+bool budget_tracking = false;
+unsigned long long budget_others_base = 0; // other processes, when configured
+unsigned long long budget_checked_ns = 0;
+nvmlDevice_t budget_device;
+// GPU memory the device copies hold, taken out of the budget (see
+// penguinDeviceCopyMalloc)
+unsigned long long device_copy_bytes = 0;
+// Total GPU memory less the slack, 0 if cudaMemGetInfo couldn't tell. The
+// budget never goes above what it leaves besides the memory the planners
+// don't manage: cudaMalloc'd buffers, library workspaces, the context and
+// its page tables, other processes; found at the budget checks from the
+// free memory and the managed pages resident, see penguin_budget_unmanaged.
+// PENGUIN_BUDGET_RECONCILE=0 leaves it to the budget it started with.
+unsigned long long budget_capacity = 0;
+int budget_reconcile = -1;
+
+bool penguin_budget_reconciling() {
+    if(budget_reconcile < 0) {
+        const char* env = getenv("PENGUIN_BUDGET_RECONCILE");
+        budget_reconcile = env == NULL || strcmp(env, "0") != 0;
     }
-    return PENGUIN_OK;
+    return budget_reconcile && budget_capacity > 0;
 }
 
-extern "C"
-penguin_error_t penguinPinHost(void *base, size_t length) {
+static bool penguin_budget_unmanaged(unsigned long long& unmanaged);
 
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_pin_host_params request;
-    int status;
+// Moves gpu_memory to budget; what was given out stays given out
+void penguin_budget_resize(unsigned long long budget) {
+    unsigned long long used = gpu_memory > available ? gpu_memory - available : 0;
+    gpu_memory = budget;
+    available = budget > used ? budget - used : 0;
+}
 
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
+// Link topology, probed with the budgets. Every pair of processors, the
+// devices and PENGUIN_HOST, is joined by a link whose bandwidth and latency
+// price a remote access and a migration between them; the planners weigh
+// pinning, peer mapping and host pinning with these. NVML counts the NVLinks
+// between two devices and the PCIe generation and width of each; without it
+// a link is taken as PCIe gen 3 x16. PENGUIN_NVME stands for the files of
+// the NVMe tier.
+#define PENGUIN_HOST PENGUIN_MAX_DEVICES
+#define PENGUIN_NVME (PENGUIN_MAX_DEVICES + 1)
+
+enum {
+    PENGUIN_LINK_NONE, // no peer access
+    PENGUIN_LINK_LOCAL,
+    PENGUIN_LINK_PCIE,
+    PENGUIN_LINK_NVLINK,
+    PENGUIN_LINK_C2C,
+    PENGUIN_LINK_NVME
+};
 
-    request.base = base;
-    /* request.length = length; */
+const char* penguin_link_name[] = {"none", "local", "pcie", "nvlink", "c2c", "nvme"};
 
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
+typedef struct
+{
+    unsigned kind;
+    double bandwidth; // GB/s
+    double latency;   // us
+} penguin_link;
+
+penguin_link penguin_links[PENGUIN_MAX_DEVICES + 2][PENGUIN_MAX_DEVICES + 2];
+bool topology_probed = false;
+
+penguin_link penguin_make_link(unsigned kind, double bandwidth) {
+    static const double latency[] = {0, PENGUIN_LOCAL_LATENCY_US, PENGUIN_PCIE_LATENCY_US,
+        PENGUIN_NVLINK_LATENCY_US, PENGUIN_C2C_LATENCY_US, PENGUIN_NVME_LATENCY_US};
+    penguin_link link = {kind, bandwidth, latency[kind]};
+    return link;
+}
+
+// GB/s of a PCIe link per direction
+double penguin_pcie_gbs(unsigned gen, unsigned width) {
+    static const double lane[] = {0, 0.25, 0.5, 0.985, 1.969, 3.938, 7.563};
+    if(gen == 0 || gen >= sizeof(lane) / sizeof(lane[0]) || width == 0) {
+        gen = 3;
+        width = 16;
+    }
+    return lane[gen] * width;
+}
+
+void penguinTopologyProbe() {
+    penguin_init_wait();
+    if(topology_probed) {
+        return;
+    }
+    topology_probed = true;
+    int count = penguin_num_devices();
+    std::vector<cudaDeviceProp> props(count);
+    std::vector<nvmlDevice_t> handles(count);
+    std::vector<bool> probed(count, false);
+    for(int d = 0; d < count; d++) {
+        cudaGetDeviceProperties(&props[d], d);
+        probed[d] = penguin_nvml_device(d, &handles[d]);
+    }
+    for(int d = 0; d < count; d++) {
+        unsigned gen = 0;
+        unsigned width = 0;
+        int c2c = 0;
+        if(probed[d]) {
+            nvmlDeviceGetCurrPcieLinkGeneration(handles[d], &gen);
+            nvmlDeviceGetCurrPcieLinkWidth(handles[d], &width);
+        }
+        // a coherent CPU link is the only one with host native atomics
+        cudaDeviceGetAttribute(&c2c, cudaDevAttrHostNativeAtomicSupported, d);
+        penguin_links[d][d] = penguin_make_link(PENGUIN_LINK_LOCAL, PENGUIN_LOCAL_GBS);
+        penguin_links[d][PENGUIN_HOST] = c2c ? penguin_make_link(PENGUIN_LINK_C2C, PENGUIN_C2C_GBS) :
+            penguin_make_link(PENGUIN_LINK_PCIE, penguin_pcie_gbs(gen, width));
+        penguin_links[PENGUIN_HOST][d] = penguin_links[d][PENGUIN_HOST];
+        penguin_links[d][PENGUIN_NVME] = penguin_make_link(PENGUIN_LINK_NVME,
+                std::min(PENGUIN_NVME_GBS, penguin_links[d][PENGUIN_HOST].bandwidth));
+        penguin_links[PENGUIN_NVME][d] = penguin_links[d][PENGUIN_NVME];
+    }
+    for(int d = 0; d < count; d++) {
+        for(int p = 0; p < count; p++) {
+            int access = 0;
+            if(p == d) {
+                continue;
             }
+            if(cudaDeviceGetP2PAttribute(&access, cudaDevP2PAttrAccessSupported, d, p) != cudaSuccess ||
+                    !access) {
+                penguin_links[d][p] = penguin_make_link(PENGUIN_LINK_NONE, 0);
+                continue;
+            }
+            unsigned nvlinks = 0;
+            for(unsigned l = 0; probed[d] && l < NVML_NVLINK_MAX_LINKS; l++) {
+                nvmlEnableState_t active;
+                nvmlPciInfo_t remote;
+                if(nvmlDeviceGetNvLinkState(handles[d], l, &active) == NVML_SUCCESS &&
+                        active == NVML_FEATURE_ENABLED &&
+                        nvmlDeviceGetNvLinkRemotePciInfo(handles[d], l, &remote) == NVML_SUCCESS &&
+                        (int) remote.domain == props[p].pciDomainID && (int) remote.bus == props[p].pciBusID &&
+                        (int) remote.device == props[p].pciDeviceID) {
+                    nvlinks++;
+                }
+            }
+            // over PCIe the slower of the two host links bounds it
+            penguin_links[d][p] = nvlinks ?
+                penguin_make_link(PENGUIN_LINK_NVLINK, nvlinks * PENGUIN_NVLINK_GBS) :
+                penguin_make_link(PENGUIN_LINK_PCIE, std::min(penguin_links[d][PENGUIN_HOST].bandwidth,
+                            penguin_links[p][PENGUIN_HOST].bandwidth));
+            /* std::cout << d << " -> " << p << " " << penguin_link_name[penguin_links[d][p].kind] */
+            /*     << " " << penguin_links[d][p].bandwidth << " GB/s\n"; */
         }
-        closedir(d);
     }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
+}
+
+// Start-up state: the UVM fd, the devices and their UUIDs, NVML and its
+// handles, MIG instances and the link topology, which the first calls that
+// need them would otherwise wait for one after the other. A constructor has
+// a thread of its own gather them while the program starts, and the getters
+// above wait for it only when they are called before it is done; the
+// launches that need none of them never do. PENGUIN_BACKGROUND_INIT=0
+// gathers them at the first call that needs one instead.
+enum {
+    PENGUIN_INIT_IDLE,
+    PENGUIN_INIT_RUNNING,
+    PENGUIN_INIT_DONE
+};
+
+std::atomic<int> init_state(PENGUIN_INIT_IDLE);
+pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t init_cond = PTHREAD_COND_INITIALIZER;
+// on the thread running penguin_init_run, whose getters don't wait
+thread_local bool init_running = false;
+pthread_t init_thread;
+pid_t init_thread_pid = 0;
+
+static void penguin_init_run() {
+    init_running = true;
+    // initializes the driver, which opens /dev/nvidia-uvm
+    int count = penguin_num_devices();
+    penguin_uvm_fd_scan();
+    for(int d = 0; d < count; d++) {
+        nvmlDevice_t handle;
+        penguin_gpu_uuid(d);
+        penguin_nvml_device(d, &handle);
+        penguin_mig(d);
     }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_IS_ALLOCATED, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        return PENGUIN_ERR_IOCTL;
+    penguinTopologyProbe();
+    init_running = false;
+}
+
+static void penguin_init_wait() {
+    if(init_state.load(std::memory_order_acquire) == PENGUIN_INIT_DONE || init_running) {
+        return;
     }
-    if(request.is_allocated) {
-    std::cout << "is alloocated\n";
-    } else {
-    std::cout << "not alloocated\n";
+    PENGUIN_OVERHEAD_SCOPE("init wait");
+    pthread_mutex_lock(&init_lock);
+    while(init_state == PENGUIN_INIT_RUNNING) {
+        pthread_cond_wait(&init_cond, &init_lock);
     }
-    return PENGUIN_OK;
+    if(init_state == PENGUIN_INIT_IDLE) {
+        init_state = PENGUIN_INIT_RUNNING;
+        pthread_mutex_unlock(&init_lock);
+        penguin_init_run();
+        pthread_mutex_lock(&init_lock);
+        init_state.store(PENGUIN_INIT_DONE, std::memory_order_release);
+        pthread_cond_broadcast(&init_cond);
+    }
+    pthread_mutex_unlock(&init_lock);
 }
 
-extern "C"
-void penguinSuperPrefetch(void *base, size_t length, unsigned iter, unsigned iterPerBatch, size_t max) {
-    /* counter++; */
-    if (length == 0) return;
-    if ((iter % iterPerBatch) == 0) {
-        int prefnum = iter / iterPerBatch;
-        if ((prefnum+1) * length > max) {
-            length = max - (prefnum) * length;
-            /* return; // not return, use new value */
-        }
-        printf("base = %p prefnum = %d; iter = %d; length = %llu\n", base, prefnum, iter, length);
-        // TODO: prefetch back, but only if there is memory pressure.
-        auto pref_addr = prefnum*length;
-        if(AllocationGPUResStart[base] <= pref_addr &&
-                (pref_addr + length) < AllocationGPUResStop[base]){
-            return;
-        }
-        /* std::cout << "pref_addr = " << pref_addr << std::endl; */
-        /* std::cout << "alloc start on gpu = " << AllocationGPUResStart[base] << std::endl; */
-        /* std::cout << "alloc stop on gpu = " << AllocationGPUResStop[base] << std::endl; */
+void* penguin_init_thread(void*) {
+    penguin_init_wait();
+    return NULL;
+}
 
-        if(prefnum > 0 && available == 0) {
-            /* std::cout << "revpref\n"; */
-            cudaMemPrefetchAsync((char*)base + ((prefnum-1)*length), length, -1, 0 );
-            AllocationGPUResStart[base] += length;
-            AllocationGPUResStop[base] += length;
-        }
-        /* std::cout << "pre\n"; */
-        cudaMemPrefetchAsync((char*)base + (prefnum*length), length, 0, 0 );
+// The driver calls of a thread left running at exit could race its teardown
+void penguin_init_join() {
+    if(init_thread_pid == getpid()) {
+        pthread_join(init_thread, NULL);
     }
-    return;
+    init_thread_pid = 0;
 }
 
-extern "C"
-void penguinSuperPrefetchWrapper(unsigned iter) {
-    //get parameters from runtime maps and call penguinSuperPrefetch
-    /* std::cout << "penguinSuperPrefetchWrapper " << iter << "\n"; */
-    for(auto memalloc = AllocationToPrefetchBoolMap.begin();
-            memalloc != AllocationToPrefetchBoolMap.end(); memalloc++) {
-        auto base = memalloc->first;
-        if(AllocationToPrefetchBoolMap[base] == true) {
-            /* std::cout << "pspw says prefetch iter " << base << " " << iter << "\n"; */
-            unsigned long long length = AllocationToPrefetchSizeMap[base];
-            auto dsize = allocation_size_map[base];
-            auto iterPerBatch = AllocationToPrefetchItersPerBatchMap[base];
-            penguinSuperPrefetch(base, length, iter, iterPerBatch, dsize);
-            /* penguinSuperPrefetch(base, 512*1024*1024, iter, 128, dsize); */
-        }
+// A child forked while the thread ran has no such thread
+void penguin_init_atfork_child() {
+    pthread_mutex_init(&init_lock, NULL);
+    pthread_cond_init(&init_cond, NULL);
+    if(init_state == PENGUIN_INIT_RUNNING) {
+        init_state = PENGUIN_INIT_IDLE;
     }
 }
 
-void* nvml_monitor(void* argp) {
-    /* printf("ellloooo\n"); */
-    auto status = nvmlInit();
-    if(status != NVML_SUCCESS) {
-        printf("unable to init nvml\n");
-        return NULL;
+__attribute__((constructor))
+void penguin_init_start() {
+    pthread_atfork(NULL, NULL, penguin_init_atfork_child);
+    const char* env = getenv("PENGUIN_BACKGROUND_INIT");
+    if(env != NULL && strcmp(env, "0") == 0) {
+        return;
     }
-    nvmlDevice_t device_;
-    unsigned throughput;
-    unsigned long long total = 0;
-    unsigned long long count = 0;
-    status = nvmlDeviceGetHandleByIndex(0, &device_);
-    while(nvml_running == 1) {
-#if NVML_TX
-        status = nvmlDeviceGetPcieThroughput(device_, NVML_PCIE_UTIL_TX_BYTES, &throughput);
-#else
-        status = nvmlDeviceGetPcieThroughput(device_, NVML_PCIE_UTIL_RX_BYTES, &throughput);
-#endif
-        /* printf("throughput = %u\n", throughput); */
-        total += throughput;
-        count ++;
+    if(pthread_create(&init_thread, NULL, penguin_init_thread, NULL) == 0) {
+        init_thread_pid = getpid();
+        atexit(penguin_init_join);
     }
-#if NVML_TX
-    printf("total TX PCIe = %llu\n", total);
-#else 
-    printf("total RX PCIe = %llu\n", total);
-#endif
-    /* printf("count = %u\n", count); */
-    return NULL;
 }
 
-void nvml_start() {
-#if NVML_PROFILER
-    nvml_running = 1;
-    pthread_create(&monitor, NULL, nvml_monitor, NULL);
-#endif
+// Whether kernels on device can map the memory of peer instead of migrating it
+bool penguin_peer_access(int device, int peer) {
+    penguinTopologyProbe();
+    return penguin_links[device][peer].kind != PENGUIN_LINK_NONE;
 }
 
-void nvml_stop() {
-#if NVML_PROFILER
-    nvml_running = 0;
-    /* printf("nvml: running = 0\n"); */
-    pthread_join(monitor, NULL);
-#endif
+// us the kernels of device spend on accesses to the memory of processor,
+// infinite if they cannot reach it
+double penguin_access_cost(int device, int processor, unsigned long long accesses) {
+    penguinTopologyProbe();
+    const penguin_link& link = penguin_links[device][processor];
+    if(link.kind == PENGUIN_LINK_NONE) {
+        return HUGE_VAL;
+    }
+    return link.latency + (double) accesses * PENGUIN_ACCESS_BYTES / (link.bandwidth * 1e3);
 }
 
-bool ac_enabled = false;
+// us resident memory saves the accesses of device over its host link; the
+// latencies overlap across the accesses and are left out
+double penguin_resident_benefit(int device, unsigned long long accesses) {
+    penguinTopologyProbe();
+    return (double) accesses * PENGUIN_ACCESS_BYTES *
+        (1 / penguin_links[device][PENGUIN_HOST].bandwidth - 1 / penguin_links[device][device].bandwidth) / 1e3;
+}
 
-extern "C"
-penguin_error_t penguinEnableAccessCounters() {
-    if(ac_enabled == true) {
-        return PENGUIN_OK;
+// us a migration of bytes from processor from to processor to takes when
+// faulted in
+double penguin_migration_cost(int from, int to, unsigned long long bytes) {
+    penguinTopologyProbe();
+    const penguin_link& link = from == PENGUIN_HOST || to == PENGUIN_HOST || penguin_peer_access(from, to) ?
+        penguin_links[from][to] : penguin_links[from][PENGUIN_HOST];
+    double units = (double) (bytes + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT;
+    return link.latency + units * PENGUIN_MIGRATION_FAULT_US + bytes / (link.bandwidth * 1e3);
+}
+
+// Budgets of the other devices, which are not tracked: the explicit or
+// oversubscribed budget of device 0, or what each has free less the slack
+// when device 0's is taken from its free memory. Device 0 is gpu_memory and
+// available.
+unsigned long long device_gpu_memory[PENGUIN_MAX_DEVICES];
+std::atomic<unsigned long long> device_available[PENGUIN_MAX_DEVICES];
+
+unsigned long long penguin_device_memory(int device) {
+    return device == 0 ? gpu_memory : device_gpu_memory[device];
+}
+
+std::atomic<unsigned long long>& penguin_device_available(int device) {
+    return device == 0 ? available : device_available[device];
+}
+
+void penguin_device_budgets_init() {
+    int current = 0;
+    cudaGetDevice(&current);
+    for(int d = 1; d < penguin_num_devices(); d++) {
+        size_t free_mem = 0;
+        size_t total_mem = 0;
+        unsigned long long slack = PENGUIN_OVERSUB_SLACK_MB * 1024ULL * 1024ULL;
+        device_gpu_memory[d] = configured_gpu_memory;
+        if(budget_elastic && cudaSetDevice(d) == cudaSuccess &&
+                cudaMemGetInfo(&free_mem, &total_mem) == cudaSuccess) {
+            device_gpu_memory[d] = free_mem > slack ? free_mem - slack : 0;
+        }
+        device_available[d] = device_gpu_memory[d];
     }
-    ac_enabled = true;
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_enable_access_counter_param request;
-    int status;
+    cudaSetDevice(current);
+}
 
-    request.enable_mimc = true;
-    request.enable_momc = false;
-    request.mimc_gran  = 1;
-    request.momc_gran  = 1;
-    request.mimc_use_limit  = 4;
-    request.momc_use_limit  = 4;
-    request.threshold  = 256;
+// Arbitration between the SUV processes sharing device 0. They meet in a
+// shared-memory ledger named after the device UUID, where each declares what
+// it wants to pin: its explicit budget, or the whole capacity when the budget
+// was taken from the free memory. The ledger grants max-min fair shares of its
+// capacity (the device memory less the slack, or PENGUIN_ARBITER_CAPACITY_MB)
+// and regrants them whenever a process joins, leaves, dies or changes its
+// demand. A grant caps the budget, so a smaller one makes the planners unpin
+// down to it at the next launch; the processes in the ledger are left out of
+// what NVML reports the others hold. PENGUIN_ARBITER=0 opts out.
+#define PENGUIN_ARBITER_MAGIC 0x50454e4741524249ULL
+#define PENGUIN_ARBITER_VERSION 1
+#define PENGUIN_ARBITER_SLOTS 64
 
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
+typedef struct
+{
+    int pid; // 0 for a free slot
+    unsigned long long demand;
+    unsigned long long grant;
+} penguin_arbiter_slot;
 
-    for(int i = 0; i < 16; i++) {
-        request.uuid[i] = prop.uuid.bytes[i];
-        printf("%u", prop.uuid.bytes[i]);
+typedef struct
+{
+    unsigned long long magic; // set last by the process that creates it
+    unsigned version;
+    pthread_mutex_t lock;     // robust, process shared
+    unsigned long long capacity;
+    penguin_arbiter_slot slots[PENGUIN_ARBITER_SLOTS];
+} penguin_arbiter_ledger;
+
+penguin_arbiter_ledger* arbiter = NULL;
+int arbiter_slot = -1;
+
+void penguin_arbiter_lock() {
+    if(pthread_mutex_lock(&arbiter->lock) == EOWNERDEAD) {
+        // a process died holding it; the slots are consistent between updates
+        pthread_mutex_consistent(&arbiter->lock);
     }
+}
 
-    fprintf(stderr, "enable access counters\n");
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
-            }
+// Drops the slots of processes that are gone and hands out the capacity: in
+// increasing order of demand each gets the lesser of its demand and an equal
+// share of what is left. Called with the lock held.
+void penguin_arbiter_rebalance() {
+    std::vector<penguin_arbiter_slot*> active;
+    for(unsigned s = 0; s < PENGUIN_ARBITER_SLOTS; s++) {
+        penguin_arbiter_slot &slot = arbiter->slots[s];
+        if(slot.pid != 0 && kill(slot.pid, 0) != 0 && errno == ESRCH) {
+            slot.pid = 0;
+        }
+        if(slot.pid != 0) {
+            active.push_back(&slot);
         }
-        closedir(d);
     }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
+    std::sort(active.begin(), active.end(), [](penguin_arbiter_slot* a, penguin_arbiter_slot* b) {
+        return a->demand < b->demand;
+    });
+    unsigned long long left = arbiter->capacity;
+    for(size_t i = 0; i < active.size(); i++) {
+        unsigned long long share = left / (active.size() - i);
+        active[i]->grant = std::min(active[i]->demand, share);
+        left -= active[i]->grant;
     }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_ACCESS_COUNTER_ENABLE, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        fprintf(stderr, "debuggy\n");
-        return PENGUIN_ERR_IOCTL;
+}
+
+void penguin_arbiter_leave() {
+    if(arbiter_slot < 0) {
+        return;
     }
-    return PENGUIN_OK;
+    penguin_arbiter_lock();
+    arbiter->slots[arbiter_slot].pid = 0;
+    penguin_arbiter_rebalance();
+    pthread_mutex_unlock(&arbiter->lock);
+    arbiter_slot = -1;
 }
 
-extern "C"
-penguin_error_t penguinStartStatCollection() {
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_start_stat_collection_params request;
-    int status;
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
-            }
+// Maps the ledger of device 0, creating it if this is the first process, and
+// takes a slot; false if arbitration is off or the ledger can't be used.
+bool penguin_arbiter_join(unsigned long long capacity) {
+    const char* env = getenv("PENGUIN_ARBITER");
+    if(env != NULL && strcmp(env, "0") == 0) {
+        return false;
+    }
+    const char* env_capacity = getenv("PENGUIN_ARBITER_CAPACITY_MB");
+    if(env_capacity != NULL) {
+        capacity = strtoull(env_capacity, NULL, 10) * 1024ULL * 1024ULL;
+    }
+    char name[64];
+    const uint8_t* uuid = penguin_gpu_uuid();
+    int len = snprintf(name, sizeof(name), "/penguin-arbiter-");
+    for(int b = 0; b < 16; b++) {
+        len += snprintf(name + len, sizeof(name) - len, "%02x", uuid[b]);
+    }
+    bool created = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if(fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name, O_RDWR, 0666);
+    }
+    if(fd < 0 || (created && ftruncate(fd, sizeof(penguin_arbiter_ledger)) != 0)) {
+        if(fd >= 0) {
+            close(fd);
         }
-        closedir(d);
+        return false;
     }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
+    // the creator may not have sized it yet
+    struct stat st;
+    for(unsigned tries = 0; !created && fstat(fd, &st) == 0 &&
+            (size_t) st.st_size < sizeof(penguin_arbiter_ledger) && tries < 100; tries++) {
+        usleep(1000);
     }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_START_STAT_COLLECTION_IOCTL_NUM, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        return PENGUIN_ERR_IOCTL;
+    void* m = mmap(NULL, sizeof(penguin_arbiter_ledger), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        return false;
     }
-    return PENGUIN_OK;
+    penguin_arbiter_ledger* ledger = (penguin_arbiter_ledger*) m;
+    if(created) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&ledger->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        ledger->version = PENGUIN_ARBITER_VERSION;
+        ledger->capacity = capacity;
+        __atomic_store_n(&ledger->magic, PENGUIN_ARBITER_MAGIC, __ATOMIC_RELEASE);
+    }
+    for(unsigned tries = 0; __atomic_load_n(&ledger->magic, __ATOMIC_ACQUIRE) != PENGUIN_ARBITER_MAGIC &&
+            tries < 100; tries++) {
+        usleep(1000);
+    }
+    if(ledger->magic != PENGUIN_ARBITER_MAGIC || ledger->version != PENGUIN_ARBITER_VERSION) {
+        munmap(m, sizeof(penguin_arbiter_ledger));
+        return false;
+    }
+    arbiter = ledger;
+    penguin_arbiter_lock();
+    penguin_arbiter_rebalance();
+    for(unsigned s = 0; s < PENGUIN_ARBITER_SLOTS && arbiter_slot < 0; s++) {
+        if(arbiter->slots[s].pid == 0) {
+            arbiter_slot = s;
+            arbiter->slots[s].pid = getpid();
+            arbiter->slots[s].demand = 0;
+            arbiter->slots[s].grant = 0;
+        }
+    }
+    pthread_mutex_unlock(&arbiter->lock);
+    if(arbiter_slot < 0) {
+        munmap(m, sizeof(penguin_arbiter_ledger));
+        arbiter = NULL;
+        return false;
+    }
+    atexit(penguin_arbiter_leave);
+    return true;
 }
 
-extern "C"
-penguin_error_t penguinStopStatCollection() {
-    DIR *d;
-    struct dirent *dir;
-    char psf_path[512];
-    char *psf_realpath;
-    penguin_stop_stat_collection_params request;
-    int status;
-    cudaDeviceProp prop;
-    cudaGetDeviceProperties(&prop, 0);
-    d = opendir(PSF_DIR);
-    if (d)
-    {
-        while ((dir = readdir(d)) != NULL)
-        {
-            if (dir->d_type == DT_LNK)
-            {
-                sprintf(psf_path, "%s/%s", PSF_DIR, dir->d_name);
-                psf_realpath = realpath(psf_path, NULL);
-                if (strcmp(psf_realpath, NVIDIA_UVM_PATH) == 0)
-                    nvidia_uvm_fd = atoi(dir->d_name);
-                free(psf_realpath);
-                if (nvidia_uvm_fd >= 0)
-                    break;
-            }
-        }
-        closedir(d);
-    }
-    if (nvidia_uvm_fd < 0)
-    {
-        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
-        return PENGUIN_ERR_PATH;
-    }
-    if ((status = ioctl(nvidia_uvm_fd, PENGUIN_STOP_STAT_COLLECTION_IOCTL_NUM, &request)) != 0)
-    {
-        fprintf(stderr, "error: %d\n", status);
-        return PENGUIN_ERR_IOCTL;
-    }
-    return PENGUIN_OK;
-}
-
-
-extern "C"
-void add_invocation_id(unsigned invid) {
-    InvocationIDs.insert(invid);
-    return;
+// Declares what this process wants to pin and returns its grant
+unsigned long long penguin_arbiter_demand(unsigned long long demand) {
+    penguin_arbiter_lock();
+    arbiter->slots[arbiter_slot].demand = demand;
+    penguin_arbiter_rebalance();
+    unsigned long long grant = arbiter->slots[arbiter_slot].grant;
+    pthread_mutex_unlock(&arbiter->lock);
+    return grant;
 }
 
-// TODO: fix this ASAP
-extern "C"
-void addIntoAllocationMap(void** ptr, unsigned long long size) {
-    void* p = (void*) *ptr;
-    /* std::cout << "added to allocation map, " << p << " " << size << "\n"; */
-    allocation_size_map[p] = size;
-    return;
+// Current grant, after dropping the processes that died since the last look
+unsigned long long penguin_arbiter_grant() {
+    penguin_arbiter_lock();
+    penguin_arbiter_rebalance();
+    unsigned long long grant = arbiter->slots[arbiter_slot].grant;
+    pthread_mutex_unlock(&arbiter->lock);
+    return grant;
 }
 
-extern "C"
-void printAllocationMap() {
-    /* std::cout << "size map\n"; */
-    for (auto a = allocation_size_map.begin(); a != allocation_size_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
+// Whether pid holds a slot of the ledger
+bool penguin_arbiter_member(unsigned pid) {
+    if(arbiter == NULL) {
+        return false;
     }
-}
-
-extern "C"
-unsigned long long getAllocationSize(void* ptr) {
-    return allocation_size_map[ptr];
-}
-
-extern "C"
-void addACToAllocation(void* ptr, unsigned long long count) {
-    /* void* p = (void*) *ptr; */
-    /* std::cout << ptr << std::endl; */
-    allocation_ac_map[ptr] += count;
-    return;
-}
-
-extern "C"
-void printACToAllocationMap() {
-    /* std::cout << "ac map\n"; */
-    for (auto a = allocation_ac_map.begin(); a != allocation_ac_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
+    for(unsigned s = 0; s < PENGUIN_ARBITER_SLOTS; s++) {
+        if((unsigned) __atomic_load_n(&arbiter->slots[s].pid, __ATOMIC_RELAXED) == pid) {
+            return true;
+        }
     }
+    return false;
 }
 
-extern "C"
-float getAccessDensity(void* ptr) {
-    return (float) allocation_ac_map[ptr] / (float) allocation_size_map[ptr];
-}
-
-// TODO : add a method for clearing the allocation_ac_map
-
-extern "C"
-unsigned long long accessCountForAllocation(void* ptr) {
-    return allocation_ac_map[ptr];
+// GPU memory held by the other processes the ledger doesn't arbitrate; false
+// if NVML can't tell
+bool penguin_budget_others(unsigned long long &others) {
+    std::vector<nvmlProcessInfo_t> procs(16);
+    unsigned count = procs.size();
+    auto status = nvmlDeviceGetComputeRunningProcesses(budget_device, &count, procs.data());
+    if(status == NVML_ERROR_INSUFFICIENT_SIZE) {
+        procs.resize(count);
+        status = nvmlDeviceGetComputeRunningProcesses(budget_device, &count, procs.data());
+    }
+    if(status != NVML_SUCCESS) {
+        return false;
+    }
+    unsigned pid = getpid();
+    others = 0;
+    for(unsigned p = 0; p < count; p++) {
+        if(procs[p].pid != pid && !penguin_arbiter_member(procs[p].pid) &&
+                procs[p].usedGpuMemory != (unsigned long long) NVML_VALUE_NOT_AVAILABLE) {
+            others += procs[p].usedGpuMemory;
+        }
+    }
+    return true;
 }
 
-extern "C"
-void add_pd_bidx_to_allocation(void* ptr, unsigned pd_bidx) {
-    if(allocation_pd_bidx_map[ptr] < pd_bidx) {
-        allocation_pd_bidx_map[ptr] = pd_bidx;
+void penguinBudgetInit() {
+    if(budget_initialized) {
+        return;
+    }
+    budget_initialized = true;
+    size_t free_mem = 0;
+    size_t total_mem = 0;
+    bool queried = cudaMemGetInfo(&free_mem, &total_mem) == cudaSuccess;
+    penguin_mig_instance &mig = penguin_mig(penguin_launch_device());
+    if(!queried && mig.mig) {
+        free_mem = mig.free;
+        total_mem = mig.total;
+        queried = true;
     }
+    const char* env_budget = getenv("PENGUIN_GPU_BUDGET_MB");
+    if(budget_set) {
+    } else if(env_budget != NULL) {
+        configured_gpu_memory = strtoull(env_budget, NULL, 10) * 1024ULL * 1024ULL;
+    } else if(penguin_oversub_available_mb() >= 0) {
+        configured_gpu_memory = penguin_budget_mb(MBs) * 1024ULL * 1024ULL;
+    } else if(queried) {
+        unsigned long long slack = PENGUIN_OVERSUB_SLACK_MB * 1024ULL * 1024ULL;
+        configured_gpu_memory = free_mem > slack ? free_mem - slack : 0;
+        budget_elastic = true;
+    } else {
+        configured_gpu_memory = MBs * 1024ULL * 1024ULL;
+    }
+    // before sampling the others, so the ledger members are left out
+    unsigned long long slack = PENGUIN_OVERSUB_SLACK_MB * 1024ULL * 1024ULL;
+    unsigned long long capacity = !queried ? configured_gpu_memory : total_mem > slack ? total_mem - slack : 0;
+    budget_capacity = queried ? capacity : 0;
+    if(mig.mig) {
+        // a budget for the whole GPU (MBs, PENGUIN_GPU_SIZE_MB) doesn't fit
+        configured_gpu_memory = std::min(configured_gpu_memory, capacity);
+    }
+    penguin_arbiter_join(capacity);
+    const char* track = getenv("PENGUIN_BUDGET_TRACK");
+    if(track == NULL || strcmp(track, "0") != 0) {
+        int device = 0;
+        // the processes of the instance, not of the whole GPU
+        if(mig.mig) {
+            budget_device = mig.handle;
+        }
+        budget_tracking = (mig.mig || (cudaGetDevice(&device) == cudaSuccess &&
+            device < penguin_num_devices() && penguin_nvml_device(device, &budget_device))) &&
+            penguin_budget_others(budget_others_base);
+    }
+    unsigned long long budget = configured_gpu_memory;
+    if(arbiter != NULL) {
+        if(budget_elastic) {
+            // the free memory was what the other SUV processes left; take up
+            // to the capacity less what the unarbitrated ones hold, the
+            // ledger decides the share
+            capacity = arbiter->capacity;
+            configured_gpu_memory = capacity > budget_others_base ? capacity - budget_others_base : 0;
+        }
+        budget = std::min(configured_gpu_memory,
+                penguin_arbiter_demand(budget_elastic ? capacity : configured_gpu_memory));
+    }
+    /* std::cout << "budget = " << budget << "\n"; */
+    penguin_budget_resize(budget);
+    penguin_device_budgets_init();
+    penguinTopologyProbe();
 }
 
-extern "C"
-void add_pd_bidy_to_allocation(void* ptr, unsigned pd_bidy) {
-    if(allocation_pd_bidy_map[ptr] < pd_bidy) {
-        allocation_pd_bidy_map[ptr] = pd_bidy;
+// Called on entry to the planners. Those that keep state for a budget compare
+// gpu_memory with the budget they planned for.
+void penguinBudgetUpdate() {
+    penguinBudgetInit();
+    // co-located SUV processes split the device through the ledger, and the
+    // others' managed pages look unmanaged from here
+    bool reconcile = arbiter == NULL && penguin_budget_reconciling();
+    if(!budget_tracking && arbiter == NULL && !reconcile) {
+        return;
+    }
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    if(now - budget_checked_ns < PENGUIN_BUDGET_PERIOD_US * 1000ULL) {
+        return;
+    }
+    budget_checked_ns = now;
+    long long target = configured_gpu_memory;
+    if(budget_tracking) {
+        unsigned long long others = 0;
+        if(!penguin_budget_others(others)) {
+            return;
+        }
+        target = (long long) configured_gpu_memory + (long long) budget_others_base - (long long) others;
+        if(!budget_elastic && target > (long long) configured_gpu_memory) {
+            target = configured_gpu_memory;
+        }
+    }
+    // a grant is applied as is, the others come and go in large steps
+    bool exact = (unsigned long long) target == configured_gpu_memory;
+    if(arbiter != NULL) {
+        long long grant = penguin_arbiter_grant();
+        if(grant <= target) {
+            target = grant;
+            exact = true;
+        }
+    }
+    target -= (long long) device_copy_bytes;
+    // the device copies are among the unmanaged memory
+    unsigned long long unmanaged = 0;
+    if(reconcile && penguin_budget_unmanaged(unmanaged)) {
+        long long room = (long long) budget_capacity - (long long) unmanaged;
+        if(room < target) {
+            /* std::cout << "unmanaged " << unmanaged << " leaves " << room << "\n"; */
+            target = room;
+        }
+    }
+    if(target < 0) {
+        target = 0;
+    }
+    if((unsigned long long) llabs(target - (long long) gpu_memory) < PENGUIN_BUDGET_HYSTERESIS && !exact) {
+        return;
+    }
+    if((unsigned long long) target != gpu_memory) {
+        /* std::cout << "budget " << gpu_memory << " -> " << target << "\n"; */
+        penguin_budget_resize(target);
     }
 }
 
+// Replaces the budget found at startup with bytes; the other processes are
+// tracked from what they hold now.
 extern "C"
-void add_pd_phi_to_allocation(void* ptr, unsigned pd_phi) {
-    if(allocation_pd_phi_map[ptr] < pd_phi) {
-        allocation_pd_phi_map[ptr] = pd_phi;
+void penguinSetMemoryBudget(unsigned long long bytes) {
+    PENGUIN_LOCKED_ENTRY();
+    configured_gpu_memory = bytes;
+    budget_set = true;
+    budget_elastic = false;
+    if(budget_initialized) {
+        if(budget_tracking) {
+            penguin_budget_others(budget_others_base);
+        }
+        if(arbiter != NULL) {
+            bytes = std::min(bytes, penguin_arbiter_demand(bytes));
+        }
+        penguin_budget_resize(bytes > device_copy_bytes ? bytes - device_copy_bytes : 0);
     }
 }
 
-extern "C"
-unsigned get_pd_bidx(void* ptr) {
-    /* std::cout <<  "pd_bidx = " << allocation_pd_bidx_map[ptr] << "\n"; */
-    return allocation_pd_bidx_map[ptr];
-}
+enum State {
+    PENGUIN_STATE_UNKNOWN,
+    PENGUIN_STATE_GPU,
+    PENGUIN_STATE_GPU_PINNED,
+    PENGUIN_STATE_HOST,
+    PENGUIN_STATE_AC,
+    PENGUIN_STATE_GPU_PINNED_PART, // static placement only
+    PENGUIN_STATE_MAX
+};
 
-extern "C"
-unsigned get_pd_bidy(void* ptr) {
-    /* std::cout <<  "pd_bidy = " << allocation_pd_bidy_map[ptr] << "\n"; */
-    return allocation_pd_bidy_map[ptr];
-}
+enum Decision {
+    PENGUIN_DEC_NONE,
+    PENGUIN_DEC_HOST_PIN,
+    PENGUIN_DEC_GPU_PIN,
+    PENGUIN_DEC_GPU_HOST_PARTIAL_PIN,
+    PENGUIN_DEC_MIGRATE_ON_DEMAND,
+    PENGUIN_DEC_ITERATION_MIGRATION,
+    PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN,
+    PENGUIN_DEC_ACCESS_COUNTER,
+    PENGUIN_DEC_HOST_WRITE_STREAM,
+    PENGUIN_DEC_MAX
+};
 
-extern "C"
-unsigned get_pd_phi(void* ptr) {
-    /* std::cout <<  "pd_phi = " << allocation_pd_phi_map[ptr] << "\n"; */
-    return allocation_pd_phi_map[ptr];
-}
+const char* penguin_decision_name[PENGUIN_DEC_MAX] = {"none", "host_pin", "gpu_pin",
+    "gpu_host_partial_pin", "migrate_on_demand", "iteration_migration",
+    "iteration_migration_plus_gpu_host_pin", "access_counter", "host_write_stream"};
 
-extern "C"
-void print_pd_bidx_map() {
-    /* std::cout << "bidx map\n"; */
-    for (auto a = allocation_pd_bidx_map.begin(); a != allocation_pd_bidx_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-    }
-}
+typedef enum {
+    PENGUIN_OK,
+    PENGUIN_ERR_PATH,
+    PENGUIN_ERR_IOCTL,
+    PENGUIN_ERR_NOT_IMPLEMENTED,
+    PENGUIN_ERR_CUDA
+} penguin_error_t;
 
-extern "C"
-void print_pd_bidy_map() {
-    /* std::cout << "bidy map\n"; */
-    for (auto a = allocation_pd_bidy_map.begin(); a != allocation_pd_bidy_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-    }
-}
+typedef struct 
+{
+    void *base;
+    size_t length;
+    uint8_t uuid[16];
+    unsigned priority;
+    int status;
+} penguin_prioritized_ioctl_params;
 
-extern "C"
-void print_pd_phi_map() {
-    /* std::cout << "phi map\n"; */
-    for (auto a = allocation_pd_phi_map.begin(); a != allocation_pd_phi_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-    }
-}
+typedef struct 
+{
+    uint8_t uuid[16];
+    unsigned mimc_gran;
+    unsigned momc_gran;
+    unsigned mimc_use_limit;
+    unsigned momc_use_limit;
+    unsigned threshold;
+    bool enable_mimc;
+    uint8_t enable_momc;        // PENGUIN_AC_MOMC_*
+    int status;
+} penguin_enable_access_counter_param;
 
-extern "C"
-void add_wss_to_map(void *ptr, unsigned long long wss, unsigned aid) {
-    aid_wss_map[aid] = wss;
-    if(allocation_wss_map[ptr] < wss) {
-        allocation_wss_map[ptr] = wss;
-    }
-}
+typedef struct 
+{
+    void *base;
+    size_t length;
+    bool quick_migrate;
+} penguin_quick_migrate_ioctl_params;
 
-extern "C"
-void print_wss_map() {
-    /* std::cout << "wss map\n"; */
-    for (auto a = allocation_wss_map.begin(); a != allocation_wss_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-    }
-}
+typedef struct 
+{
+    void *base;
+    /* size_t length; */
+    bool is_allocated;
+    int status;
+} penguin_pin_host_params;
 
-extern "C"
-unsigned long long get_wss(void* ptr) {
-    return allocation_wss_map[ptr];
-}
+typedef struct 
+{
+    void *base;
+    size_t length;
+    bool ignore_notifications;
+    int status;
+} penguin_ignore_notif_ioctl_params;
 
-extern "C"
-void print_value_i32(uint64_t value) {
-    /* std::cout << "value(i32) = " << value << std::endl; */
-}
+typedef struct
+{
+    int status;
+} penguin_start_stat_collection_params;
 
-extern "C"
-void print_value_i64(uint64_t value) {
-    /* std::cout << "value(i64) = " << value << std::endl; */
-}
+typedef struct
+{
+    void *base;
+    size_t length;
+    long long stride;
+    int status;
+} penguin_prefetch_stride_ioctl_params;
 
-extern "C"
-void print_value_f32(float value) {
-    /* std::cout << "value(f32) = " << value << std::endl; */
-}
+// UVM_ACCESS_PATTERN_* and UVM_ACCESS_PATTERN_FLAG_* of the driver
+typedef enum {
+    PENGUIN_PATTERN_UNKNOWN,
+    PENGUIN_PATTERN_SEQUENTIAL,
+    PENGUIN_PATTERN_STRIDED,
+    PENGUIN_PATTERN_RANDOM,
+    PENGUIN_PATTERN_POINTER_CHASE
+} penguin_access_pattern_t;
 
-extern "C"
-void print_value_f64(double value) {
-    /* std::cout << "value(f64) = " << value << std::endl; */
-}
+#define PENGUIN_ACCESS_READ_ONLY 0x1
+#define PENGUIN_ACCESS_WRITE_MOSTLY 0x2
+#define PENGUIN_ACCESS_PREDICT 0x4
 
-extern "C"
-float compute_access_density(void* ptr, unsigned numThreads, unsigned loopIters, unsigned long long size) {
-    float ad = ((float)numThreads * (float)loopIters) / (float)size;
-    /* std::cout << "ad is " << ad << "\n"; */
-    return ad;
-}
+typedef struct
+{
+    void *base;
+    size_t length;
+    long long stride;
+    unsigned long long span;
+    unsigned pattern;
+    unsigned flags;
+    int status;
+} penguin_access_pattern_ioctl_params;
 
-bool sortfunc(std::pair<void*, unsigned long long> &a,  std::pair<void*, unsigned long long> &b){
-    return a.second > b.second;
-}
+typedef struct
+{
+    void *base;
+    size_t length;
+    bool discardable;
+    int status;
+} penguin_discardable_ioctl_params;
 
-bool sortfuncf(std::pair<void*, float> &a,  std::pair<void*, float> &b){
-    return a.second > b.second;
-}
+typedef struct
+{
+    void *base;
+    size_t length;
+    bool host_huge_pages;
+    int status;
+} penguin_host_huge_pages_ioctl_params;
 
+// UVM_ACCESS_COUNTER_THRESHOLD_NEVER and _SAMPLE of the driver
+#define PENGUIN_AC_NEVER 0xffffffffU
+#define PENGUIN_AC_SAMPLE 0xfffffffeU
 
-/* extern "C" */
-/* void sort_wss() { */
-/*   std::copy(allocation_wss_map.begin(), allocation_wss_map.end(),back_inserter<std::vector<std::pair<void*, unsigned long long> > >(wss_vector)); */
-/*   std::sort(wss_vector.begin(), wss_vector.end(), sortfunc); */
-  /* std::cout << "sorted wss\n"; */
-/*   for(auto wss = wss_vector.begin(); wss != wss_vector.end(); wss++) { */
-/*     std::cout << wss->first << " " << wss->second << "\n"; */
-/*   } */
-/* } */
+typedef struct
+{
+    void *base;
+    size_t length;
+    unsigned long long granularity;
+    unsigned threshold;
+    int status;
+} penguin_access_counter_policy_ioctl_params;
 
-#define PG_SIZE (2*1024ULL*1024ULL)
+// UVM_THRASHING_EVENT of the driver: one report per range, whose pages were
+// pinned and/or whose processors were throttled
+#define PENGUIN_THRASHING_QUEUE_SIZE 64
+#define PENGUIN_THRASHING_PINNED 0x1
+#define PENGUIN_THRASHING_THROTTLED 0x2
 
-unsigned long long roundup(unsigned long long value) {
-    return (value + PG_SIZE -1) & ~(PG_SIZE-1);
-}
-    
-extern "C"
-unsigned long long estimate_working_set2(unsigned long long wss_per_tb, unsigned bdimx, unsigned bdimy) {
-    /* std::cout << "wss 2 = " <<  wss_per_tb << std::endl; */
-    wss_per_tb = roundup(wss_per_tb * 4); // 4 bytes per element in all our workloads
-    
-    unsigned long long numTBs = (1536)/(bdimx * bdimy);
-    numTBs = numTBs * 82;
-    /* std::cout << "wss 2 sum = " << wss_per_tb * numTBs << std::endl; */
-    return wss_per_tb * numTBs;
-}
+typedef struct
+{
+    void *base;
+    unsigned long long length;
+    void *address;
+    unsigned reports;
+    unsigned flags;
+} penguin_thrashing_event;
 
-extern "C"
-unsigned estimate_working_set(unsigned long long pd_bidx, unsigned long long pd_bidy, unsigned long long pd_phi, unsigned loopiters, unsigned bdimx, unsigned bdimy, unsigned gdimx, unsigned gdimy) {
-    unsigned long long max = 0;
-    if((pd_phi * loopiters) > max) {
-        max = pd_phi * loopiters;
+typedef struct
+{
+    penguin_thrashing_event *events;
+    unsigned count;
+    unsigned dropped;
+    int status;
+} penguin_thrashing_events_ioctl_params;
+
+// UVM_EVENT_RING_* of the driver: a header, then a power of 2 of records the
+// driver produces at put and the runtime consumes at get, without locks
+#define PENGUIN_EVENT_EVICTION 1        // value: eviction level
+#define PENGUIN_EVENT_AC_MIGRATION 2    // value: access counter value
+#define PENGUIN_EVENT_THRASHING 3       // value: PENGUIN_THRASHING_*
+#define PENGUIN_EVENT_AC_SAMPLE 4       // value: access counter value
+
+typedef struct
+{
+    unsigned put;
+    unsigned get;
+    unsigned entries;
+    unsigned dropped;
+    unsigned long long faults; // GPU faults serviced since the registration
+} penguin_event_ring_header;
+
+typedef struct
+{
+    void *base;
+    void *address;
+    unsigned long long length;
+    unsigned long long value;
+    unsigned type;
+    unsigned processor;
+} penguin_event_record;
+
+typedef struct
+{
+    void *ring;
+    unsigned long long size;
+    int status;
+} penguin_event_ring_ioctl_params;
+
+// UVM_GET_RESIDENCY of the driver: per range, processors rows of one bit per
+// piece of granularity bytes, row 0 the CPU and row n the GPU of id n
+#define PENGUIN_RESIDENCY_MAX_RANGES 4096
+
+typedef struct
+{
+    void *base;
+    unsigned long long length;
+    unsigned long long *bitmap;
+} penguin_residency_range;
+
+typedef struct
+{
+    penguin_residency_range *ranges;
+    unsigned long long granularity;
+    unsigned count;
+    unsigned processors;
+    int status;
+} penguin_residency_ioctl_params;
+
+#define PENGUIN_MIGRATE_BATCH_MAX_ENTRIES 4096
+#define PENGUIN_MIGRATE_ASYNC 0x1 // UVM_MIGRATE_FLAG_ASYNC
+
+// Mirrors UVM_MIGRATE_BATCH_ENTRY
+typedef struct
+{
+    void *base;
+    unsigned long long length;
+    uint8_t uuid[16];
+    unsigned priority; // highest first
+    int status;
+} penguin_migrate_batch_entry;
+
+typedef struct
+{
+    penguin_migrate_batch_entry *entries;
+    unsigned count;
+    unsigned flags;
+    unsigned migrated;
+    int status;
+} penguin_migrate_batch_ioctl_params;
+
+#define PENGUIN_NEXT_USE_MAX_ENTRIES 4096
+
+// Mirrors UVM_NEXT_USE_ENTRY
+typedef struct
+{
+    void *base;
+    unsigned long long length;
+    unsigned long long next_use; // epoch, 0 if unknown
+} penguin_next_use_entry;
+
+typedef struct
+{
+    penguin_next_use_entry *entries;
+    unsigned long long epoch;
+    unsigned count;
+    int status;
+} penguin_next_use_ioctl_params;
+
+// UVM_FAULT_REPLAY_HINT_* of the driver
+typedef enum {
+    PENGUIN_REPLAY_HINT_NONE,
+    PENGUIN_REPLAY_HINT_STREAMING,
+    PENGUIN_REPLAY_HINT_IRREGULAR
+} penguin_replay_hint_t;
+
+typedef struct
+{
+    unsigned hint;
+    int status;
+} penguin_fault_replay_hint_ioctl_params;
+
+// UVM_HOST_NUMA_NODE_* of the driver, or a node
+#define PENGUIN_HOST_NUMA_GPU (-2)
+#define PENGUIN_HOST_NUMA_LOCAL (-1)
+
+typedef struct
+{
+    int node;
+    int status;
+} penguin_host_numa_node_ioctl_params;
+
+// UVM_POLICY_BATCH_* of the driver
+enum {
+    PENGUIN_POLICY_PRIORITIZED_LOCATION,
+    PENGUIN_POLICY_QUICK_MIGRATE,
+    PENGUIN_POLICY_NO_MIGRATE,
+    PENGUIN_POLICY_ACCESS_PATTERN,
+    PENGUIN_POLICY_DISCARDABLE,
+    PENGUIN_POLICY_ACCESS_COUNTERS,
+    PENGUIN_POLICY_HOST_HUGE_PAGES,
+    PENGUIN_POLICY_LEASE,
+    PENGUIN_POLICY_HOST_NODE
+};
+#define PENGUIN_POLICY_BATCH_MAX_ENTRIES 4096
+
+// Mirrors UVM_POLICY_BATCH_ENTRY
+typedef struct
+{
+    void *base;
+    size_t length;
+    long long stride;
+    unsigned long long span;
+    uint8_t uuid[16];
+    unsigned op;
+    unsigned value;
+    unsigned flags;
+    int status;
+} penguin_policy_batch_entry;
+
+typedef struct
+{
+    penguin_policy_batch_entry *entries;
+    unsigned count;
+    unsigned applied;
+    int status;
+} penguin_policy_batch_ioctl_params;
+
+// UVM_SUBMIT_RING_* of the driver: a header, then a power of 2 of commands
+// the runtime produces at sq_put and then as many completions the driver
+// produces at cq_put. The driver sets PENGUIN_SUBMIT_RING_NEED_WAKEUP when
+// its worker stops, to be kicked.
+#define PENGUIN_SUBMIT_POLICY 0   // UVM_SUBMIT_RING_OP_POLICY
+#define PENGUIN_SUBMIT_MIGRATE 1  // UVM_SUBMIT_RING_OP_MIGRATE
+#define PENGUIN_SUBMIT_RING_NEED_WAKEUP 0x1
+
+typedef struct
+{
+    unsigned sq_put;
+    unsigned sq_get;
+    unsigned cq_put;
+    unsigned cq_get;
+    unsigned entries;
+    unsigned flags;
+} penguin_submit_ring_header;
+
+// Mirrors UVM_SUBMIT_RING_COMMAND
+typedef struct
+{
+    unsigned long long user_data;
+    unsigned op;
+    unsigned flags; // migrate: PENGUIN_MIGRATE_ASYNC
+    penguin_policy_batch_entry policy;
+    penguin_migrate_batch_entry migrate;
+} penguin_submit_command;
+
+typedef struct
+{
+    unsigned long long user_data;
+    int status;
+    unsigned reserved;
+} penguin_submit_completion;
+
+typedef struct
+{
+    void *ring;
+    unsigned long long size;
+    int status;
+} penguin_submit_ring_ioctl_params;
+
+typedef struct
+{
+    int status;
+} penguin_kick_submit_ring_ioctl_params;
+
+// Mirrors UVM_VA_RANGE_STATS, one entry per managed VA range
+typedef struct
+{
+    unsigned long long base;
+    unsigned long long length;
+    unsigned long long faults;
+    unsigned long long bytes_h2d;
+    unsigned long long bytes_d2h;
+    unsigned long long evictions;
+    unsigned long long thrashing;
+    unsigned long long ac_notifications;
+    unsigned long long markov_predictions;
+    unsigned long long markov_hits;
+} penguin_range_stats;
+
+typedef struct
+{
+    penguin_range_stats *stats;   // may be NULL
+    unsigned stats_count;         // capacity in, entries written out
+    unsigned stats_total;         // managed ranges in the VA space
+    unsigned long long fault_count; // faults serviced since the start
+    int status;
+}  penguin_stop_stat_collection_params;
+
+// Mirrors UVM_SNAPSHOT_STAT_COLLECTION_PARAMS
+typedef struct
+{
+    unsigned long long epoch;          // tag of the epoch starting
+    unsigned long long previous_epoch; // tag of the one ending
+    penguin_range_stats stats;         // counted in that one, base and length 0
+    int status;
+} penguin_snapshot_stat_collection_params;
+
+// Access patterns a developer may declare for an allocation with penguinHint,
+// or with PENGUIN_ANNOTATE_HINT on the variable a cudaMallocManaged stores
+// it to. The planners take them for the accesses the device analysis leaves
+// as pointer chases or incomputable, where they would otherwise sample the
+// access counters; what the analysis resolved stays as it found.
+#define PENGUIN_HINT_NONE 0
+#define PENGUIN_HINT_DENSE 1     // reused by the kernels, worth keeping on the GPU
+#define PENGUIN_HINT_STREAM 2    // covered about once per launch
+#define PENGUIN_HINT_IRREGULAR 3 // sparse: left to the access counters
+#define PENGUIN_HINT_COLD 4      // seldom touched, the first to stay on the host
+#define PENGUIN_HINT_PATTERN 0xff
+// lifetime, or-ed into the pattern: nothing reads what a launch leaves in it,
+// so the driver may drop its pages once the kernels using it are done
+#define PENGUIN_HINT_SCRATCH 0x100
+// accesses per word a dense hint of priority 0 stands for
+#ifndef PENGUIN_HINT_DENSE_ACCESSES
+#define PENGUIN_HINT_DENSE_ACCESSES 8
+#endif
+// e.g. float* PENGUIN_ANNOTATE_HINT(dense, 16) x; then cudaMallocManaged(&x, ...),
+// read by DynamicHostTransform; scratch lifetime as in PENGUIN_ANNOTATE_HINT(stream+scratch, 0)
+#define PENGUIN_ANNOTATE_HINT(pattern, priority) \
+    __attribute__((annotate("penguin_hint:" #pattern ":" #priority)))
+
+// Per-allocation descriptor table. Every instrumented cudaMallocManaged gets
+// an allocation ID, its index in allocation_table, in addIntoAllocationMap.
+// The fields read by penguinSuperPrefetchWrapper on every loop iteration come
+// first so that the hot state of one allocation sits in a single cache line.
+typedef struct
+{
+    void *base;
+    unsigned long long size;
+    unsigned long long prefetch_size;
+    unsigned long long prefetch_iters_per_batch;
+    unsigned long long gpu_res_start;
+    unsigned long long gpu_res_stop;
+    bool prefetch;
+    State state;
+    Decision decision;
+    // sliding window: prefetch_window bytes set aside on the GPU, of which
+    // prefetch_depth batches are prefetched ahead of the one in use
+    unsigned long long prefetch_window;
+    unsigned prefetch_depth;
+    // batches already queued on the prefetch engine's H2D / D2H streams
+    unsigned prefetch_issued;
+    unsigned prefetch_evicted;
+
+    // position among addIntoAllocationMap calls, the key of the profile
+    unsigned seq;
+
+    unsigned long long ac;
+    unsigned long long wss;
+    unsigned long long pd_bidx;
+    unsigned long long pd_bidy;
+    unsigned long long pd_phi;
+
+    // whether the kernels launched so far load and store the allocation, and
+    // the bytes from base that are read duplicated while it is only loaded
+    bool loaded;
+    bool stored;
+    unsigned long long read_dup;
+    // every kernel argument it is passed to is only loaded from, as far as
+    // DynamicHostTransform -penguin-read-mostly could tell before any launch
+    bool read_only;
+    // likewise only stored to, as -penguin-write-stream found: kept on the
+    // host, which reads it, and written remotely by the kernels
+    bool write_stream;
+    // a kernel's atomics update it: never mapped remotely, where they take
+    // the driver's remote-atomic fault path, and pinned on the GPU rather
+    // than left on the host
+    bool atomic;
+    // no kernel reads the allocation again and the host never does: the
+    // driver drops its pages on eviction, see penguin_discard_dead
+    bool dead;
+
+    // devices whose kernels access the allocation, one bit each, the
+    // accesses counted on each, and the device its GPU part is placed on
+    unsigned devices;
+    unsigned long long device_ac[PENGUIN_MAX_DEVICES];
+    int device;
+
+    // access counter threshold of the allocation while it is host pinned, 0
+    // for the GPU's
+    unsigned ac_threshold;
+
+    // thrashing reports of the driver on the allocation, and whether they,
+    // or its round trips to the host, made the runtime host pin it; the
+    // planner keeps it there
+    unsigned thrashing_reports;
+    bool thrashing_demoted;
+
+    // host accesses between its launches, see penguinHostAccess: the
+    // launch_epoch of its last launch and of the host's last access, the
+    // round trips from a launch to the host so far, the most bytes the host
+    // touched in one, and [host_lo, host_hi) from base it touched since the
+    // last launch. With host_regions the GPU keeps it and the host's regions
+    // are migrated both ways in bulk.
+    unsigned long long gpu_epoch;
+    unsigned long long host_epoch;
+    unsigned round_trips;
+    unsigned long long host_span;
+    unsigned long long host_lo;
+    unsigned long long host_hi;
+    bool host_regions;
+
+    // bytes access counters migrated to the GPU while it is host pinned
+    unsigned long long ac_migrated;
+
+    // one sampled batch, used to size prefetch_depth
+    cudaEvent_t compute_start;
+    cudaEvent_t compute_stop;
+    cudaEvent_t xfer_start;
+    cudaEvent_t xfer_stop;
+    unsigned compute_sample; // 0 idle, 1 started, 2 stopped
+    bool xfer_sample;
+    float batch_compute_ms;
+    float batch_xfer_ms;
+    // iteration prefetch in another order, see penguinSuperPrefetchOrdered:
+    // 1 + the batch of the last boundary, 0 before any, and the batches the
+    // window holds on the GPU
+    unsigned long long prefetch_batch;
+    unsigned prefetch_resident[PENGUIN_MAX_PREFETCH_DEPTH + 1];
+    unsigned prefetch_resident_count;
+
+    // staged copy, see penguin_stage_ring: the device ring the kernels read
+    // the allocation from, in slots of staged_length bytes, the batches
+    // copied to it so far, and per slot the event of its copy, then the
+    // event of the kernels that read it being done
+    char* staged_ring;
+    unsigned long long staged_length;
+    unsigned staged_slots;
+    unsigned staged_issued;
+    cudaEvent_t* staged_events;
+    // the compressed batches, with PENGUIN_STAGED_COMPRESSION
+    struct penguin_stage_cache* staged_cache;
+
+    // malloc'd or mmap'd memory the GPU reaches through HMM, registered with
+    // penguinRegisterSystemAllocation rather than from cudaMallocManaged
+    bool system;
+    // one of those, a file on the NVMe tier
+    bool nvme;
+    // the host memory tier its CPU pages go on, an index in host_tiers, and
+    // 1 + the last one sent to the driver, 0 before any
+    unsigned char host_tier;
+    unsigned char host_tier_sent;
+
+    // what the developer declared with penguinHint: PENGUIN_HINT_* pattern
+    // and lifetime, accesses per word, and the bytes from base it covers
+    unsigned hint;
+    unsigned hint_priority;
+    unsigned long long hint_size;
+
+    // where it was allocated, see penguin_alloc_site, and 1 + the index in
+    // overrides of the rule it is bound to, 0 for none
+    unsigned long long site;
+    unsigned override_rule;
+} __attribute__((aligned(64))) penguin_alloc_desc;
+
+#define PENGUIN_INVALID_ALLOC_ID (~0U)
+
+// Descriptor storage: chunks of PENGUIN_ALLOC_CHUNK descriptors, allocated
+// once and never moved, so a descriptor found without the registry lock
+// stays valid while the table grows. Descriptors are only appended, under
+// the lock, and the count is published once the new one is written.
+#define PENGUIN_ALLOC_CHUNK 1024
+#define PENGUIN_ALLOC_CHUNKS 1024
+
+struct penguin_alloc_table {
+    std::atomic<penguin_alloc_desc*> chunks[PENGUIN_ALLOC_CHUNKS];
+    std::atomic<unsigned> count;
+
+    struct iterator {
+        penguin_alloc_table* table;
+        unsigned id;
+        penguin_alloc_desc& operator*() const { return (*table)[id]; }
+        penguin_alloc_desc* operator->() const { return &(*table)[id]; }
+        iterator& operator++() { id++; return *this; }
+        iterator operator++(int) { iterator i = *this; id++; return i; }
+        bool operator==(const iterator& o) const { return id == o.id; }
+        bool operator!=(const iterator& o) const { return id != o.id; }
+    };
+
+    unsigned size() const {
+        return count.load(std::memory_order_acquire);
     }
-    unsigned long long numTBs = (1536)/(bdimx * bdimy);
-    numTBs = numTBs * 82;
-    /* std::cout << "bdimx,y,liters = " << bdimx << " " << bdimy << " " << loopiters << "\n"; */
-    /* std::cout << "numTBs = " << numTBs << "\n"; */
-    unsigned long long concTBx = (gdimx > numTBs) ? numTBs: gdimx;
-    unsigned long long concTBy = (gdimx > numTBs) ? 1 : (numTBs/gdimx);
-    if((pd_bidx * concTBx) > max) {
-        max = pd_bidx * concTBx;
+    penguin_alloc_desc& operator[](unsigned id) {
+        return chunks[id / PENGUIN_ALLOC_CHUNK].load(std::memory_order_acquire)[id % PENGUIN_ALLOC_CHUNK];
     }
-    if((pd_bidy * concTBy) > max) {
-        max = pd_bidy * concTBy;
+    iterator begin() {
+        return iterator{this, 0};
     }
-    /* std::cout << "params = " << pd_phi << " " << pd_bidx << " " << loopiters << " " << gdimx << " " << concTBx << " " << "\n"; */
-    /* std::cout << "working set = " << max << "\n"; */
-    return max;
-}
-/* float compute_access_pattern_dx(void* ptr, */ 
+    iterator end() {
+        return iterator{this, size()};
+    }
+    void push_back(const penguin_alloc_desc& desc) {
+        unsigned id = count.load(std::memory_order_relaxed);
+        if(id == PENGUIN_ALLOC_CHUNK * PENGUIN_ALLOC_CHUNKS) {
+            fprintf(stderr, "penguin: more than %u allocations\n", id);
+            abort();
+        }
+        penguin_alloc_desc* chunk = chunks[id / PENGUIN_ALLOC_CHUNK].load(std::memory_order_relaxed);
+        if(chunk == NULL) {
+            chunk = new penguin_alloc_desc[PENGUIN_ALLOC_CHUNK];
+            chunks[id / PENGUIN_ALLOC_CHUNK].store(chunk, std::memory_order_release);
+        }
+        chunk[id % PENGUIN_ALLOC_CHUNK] = desc;
+        count.store(id + 1, std::memory_order_release);
+    }
+};
 
+// Pointer -> allocation ID, open addressing over a power of two of slots.
+// Readers probe the current table without a lock. Writers, under the
+// registry lock, set a slot's ID before its key, and past half full publish
+// a table twice the size with every key in it. Keys are never removed: a
+// freed allocation's keys are left without an ID, until an allocation at the
+// same address takes them again, and are not carried over to a bigger table.
+// So a retired table stays valid for the readers still in it; it is kept
+// until exit.
+#define PENGUIN_ALLOC_INDEX_SLOTS 1024 // to start with
+#define PENGUIN_ALLOC_INDEX_EMPTY ((void*) ~0ULL)
 
-extern "C"
-void* identify_memory_allocation(void* addr) {
-    unsigned long long addr_ull = (unsigned long long) addr;
-    for (auto a = allocation_size_map.begin(); a != allocation_size_map.end(); a++) {
-        unsigned long long alloc_ull = (unsigned long long) a->first;
-        unsigned long long size = a->second;
-        if(alloc_ull < addr_ull && addr_ull < alloc_ull + size) {
-            return a->first;
+typedef struct
+{
+    std::atomic<void*> key;
+    std::atomic<unsigned> id;
+} penguin_alloc_slot;
+
+struct penguin_alloc_index {
+    struct table {
+        unsigned long long mask;
+        unsigned long long used;
+        penguin_alloc_slot* slots;
+    };
+    std::atomic<table*> current;
+    std::vector<table*> retired;
+
+    static unsigned long long hash(void* key) {
+        return ((unsigned long long) key >> 4) * 0x9e3779b97f4a7c15ULL;
+    }
+    static table* make(unsigned long long slots) {
+        table* t = new table{slots - 1, 0, new penguin_alloc_slot[slots]};
+        for(unsigned long long s = 0; s < slots; s++) {
+            t->slots[s].key.store(PENGUIN_ALLOC_INDEX_EMPTY, std::memory_order_relaxed);
+        }
+        return t;
+    }
+    // the slot of key in t, or of the first empty slot after its hash
+    static penguin_alloc_slot& probe(table* t, void* key) {
+        for(unsigned long long s = hash(key) & t->mask; ; s = (s + 1) & t->mask) {
+            void* k = t->slots[s].key.load(std::memory_order_acquire);
+            if(k == key || k == PENGUIN_ALLOC_INDEX_EMPTY) {
+                return t->slots[s];
+            }
         }
     }
-    return 0;
-}
 
-extern "C"
-unsigned estimate_working_set_iteration(unsigned gdimx, unsigned gdimy, unsigned bdimx, unsigned bdimy) {
-    return 42;
-}
+    unsigned find(void* key) {
+        table* t = current.load(std::memory_order_acquire);
+        if(t == NULL) {
+            return ~0U;
+        }
+        penguin_alloc_slot& slot = probe(t, key);
+        if(slot.key.load(std::memory_order_acquire) != key) {
+            return ~0U;
+        }
+        return slot.id.load(std::memory_order_acquire);
+    }
+    // under the registry lock
+    void insert(void* key, unsigned id) {
+        table* t = current.load(std::memory_order_relaxed);
+        if(t == NULL || (t->used + 1) * 2 > t->mask + 1) {
+            table* bigger = make(t == NULL ? PENGUIN_ALLOC_INDEX_SLOTS : (t->mask + 1) * 2);
+            for(unsigned long long s = 0; t != NULL && s <= t->mask; s++) {
+                void* k = t->slots[s].key.load(std::memory_order_relaxed);
+                if(k != PENGUIN_ALLOC_INDEX_EMPTY &&
+                        t->slots[s].id.load(std::memory_order_relaxed) != PENGUIN_INVALID_ALLOC_ID) {
+                    penguin_alloc_slot& slot = probe(bigger, k);
+                    slot.id.store(t->slots[s].id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    slot.key.store(k, std::memory_order_relaxed);
+                    bigger->used++;
+                }
+            }
+            current.store(bigger, std::memory_order_release);
+            if(t != NULL) {
+                retired.push_back(t);
+            }
+            t = bigger;
+        }
+        penguin_alloc_slot& slot = probe(t, key);
+        slot.id.store(id, std::memory_order_release);
+        if(slot.key.load(std::memory_order_relaxed) != key) {
+            slot.key.store(key, std::memory_order_release);
+            t->used++;
+        }
+    }
+    // under the registry lock; every key of id is left without one
+    void erase_id(unsigned id) {
+        table* t = current.load(std::memory_order_relaxed);
+        for(unsigned long long s = 0; t != NULL && s <= t->mask; s++) {
+            if(t->slots[s].key.load(std::memory_order_relaxed) != PENGUIN_ALLOC_INDEX_EMPTY &&
+                    t->slots[s].id.load(std::memory_order_relaxed) == id) {
+                t->slots[s].id.store(PENGUIN_INVALID_ALLOC_ID, std::memory_order_release);
+            }
+        }
+    }
+};
 
-extern "C"
-void add_aid_pchase_map(unsigned aid, void* addr, bool pchase) {
-    /* std::cout << "added to pchase map " << aid << " " << addr << "\n"; */
-    aid_pchase_map[aid] = pchase;
-    aid_allocation_map[aid] = addr;
-}
+// IDs of a set of allocations. Changed under the registry lock, where it is
+// walked with begin() and end(); snapshot() copies it without the lock,
+// again while a change was in progress (the sequence count odd or moved).
+#define PENGUIN_MAX_PREFETCH_ALLOCS 256
 
-extern "C"
-void add_aid_ac_incomp_map(unsigned aid, bool incomp) {
-    aid_ac_incomp_map[aid] = incomp;
-}
+struct penguin_id_list {
+    unsigned ids[PENGUIN_MAX_PREFETCH_ALLOCS];
+    std::atomic<unsigned> count;
+    std::atomic<unsigned> seq;
 
-extern "C"
-void add_aid_wss_map_iterdep(unsigned aid, unsigned long long wss) {
-    /* std::cout << "added to iterdep map " << aid << " " << wss << "\n"; */
-    aid_wss_map_iterdep[aid] = wss;
-}
+    unsigned* begin() {
+        return ids;
+    }
+    unsigned* end() {
+        return ids + count.load(std::memory_order_relaxed);
+    }
+    void write_begin() {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void write_end() {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    void push_back(unsigned id) {
+        unsigned n = count.load(std::memory_order_relaxed);
+        if(n == PENGUIN_MAX_PREFETCH_ALLOCS) {
+            printf("more than %d prefetched allocations, %u left out\n", PENGUIN_MAX_PREFETCH_ALLOCS, id);
+            return;
+        }
+        write_begin();
+        __atomic_store_n(&ids[n], id, __ATOMIC_RELAXED);
+        count.store(n + 1, std::memory_order_relaxed);
+        write_end();
+    }
+    void remove(unsigned id) {
+        write_begin();
+        unsigned n = count.load(std::memory_order_relaxed);
+        unsigned kept = 0;
+        for(unsigned i = 0; i < n; i++) {
+            if(ids[i] != id) {
+                __atomic_store_n(&ids[kept++], ids[i], __ATOMIC_RELAXED);
+            }
+        }
+        count.store(kept, std::memory_order_relaxed);
+        write_end();
+    }
+    void clear() {
+        write_begin();
+        count.store(0, std::memory_order_relaxed);
+        write_end();
+    }
+    // copies the IDs to out, PENGUIN_MAX_PREFETCH_ALLOCS of room; returns
+    // how many
+    unsigned snapshot(unsigned* out) {
+        while(true) {
+            unsigned before = seq.load(std::memory_order_acquire);
+            unsigned n = count.load(std::memory_order_relaxed);
+            for(unsigned i = 0; i < n && i < PENGUIN_MAX_PREFETCH_ALLOCS; i++) {
+                out[i] = __atomic_load_n(&ids[i], __ATOMIC_RELAXED);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(before % 2 == 0 && seq.load(std::memory_order_relaxed) == before) {
+                return n;
+            }
+        }
+    }
+};
 
-extern "C"
-void add_aid_wss_map(unsigned aid, unsigned long long wss) {
-    aid_wss_map[aid] = wss;
+penguin_alloc_table allocation_table;
+// IDs of freed allocations, which new ones take before the table grows
+std::vector<unsigned> allocation_free_ids;
+// base address (or an interior pointer resolved to its allocation) -> allocation ID
+penguin_alloc_index allocation_id_map;
+// allocation IDs with iteration prefetch enabled, walked every iteration
+penguin_id_list prefetch_alloc_ids;
+// gcd of prefetch_iters_per_batch over prefetch_alloc_ids, 0 when nothing is
+// prefetched. With -penguin-inline-prefetch-guard the host code only calls
+// penguinSuperPrefetchWrapper on iterations that are a multiple of it, the
+// only ones on which any allocation starts a batch.
+extern "C" {
+unsigned penguin_prefetch_period = 0;
 }
+// base address -> allocation ID, for every allocation with a known size;
+// lets identify_memory_allocation find the enclosing allocation in O(log n)
+std::map<unsigned long long, unsigned> allocation_interval_map;
 
-extern "C"
-void add_aid_ac_map(unsigned aid, unsigned long long ac) {
-    aid_ac_map[aid] = ac;
+unsigned lookup_allocation_id(void* ptr) {
+    return allocation_id_map.find(ptr);
 }
 
-extern "C"
-void add_aid_allocation_map(unsigned aid, void* allocation) {
-    /* std::cout<< "add_aid_allocation_map " << aid << " " << allocation << std::endl; */
-    aid_allocation_map[aid] = allocation;
+// Returns the descriptor for ptr. An unknown pointer gets an empty descriptor
+// (size 0), the same way the per-field std::maps used to on operator[].
+// Finding one takes no lock, creating one takes the registry lock.
+penguin_alloc_desc& allocation_desc(void* ptr) {
+    auto id = lookup_allocation_id(ptr);
+    if(id != PENGUIN_INVALID_ALLOC_ID) {
+        return allocation_table[id];
+    }
+    penguin_registry_scope registry;
+    id = lookup_allocation_id(ptr);
+    if(id != PENGUIN_INVALID_ALLOC_ID) {
+        return allocation_table[id];
+    }
+    penguin_alloc_desc desc = {};
+    desc.base = ptr;
+    desc.state = PENGUIN_STATE_UNKNOWN;
+    desc.decision = PENGUIN_DEC_NONE;
+    if(!allocation_free_ids.empty()) {
+        id = allocation_free_ids.back();
+        allocation_free_ids.pop_back();
+        allocation_table[id] = desc;
+    } else {
+        id = allocation_table.size();
+        allocation_table.push_back(desc);
+    }
+    allocation_id_map.insert(ptr, id);
+    return allocation_table[id];
 }
 
-extern "C"
-void add_aid_invocation_map(unsigned aid, unsigned invocation_id) {
-    aid_invocation_id_map[aid] = invocation_id;
-}
+// Managed arena. With -penguin-managed-arena the instrumentation sends the
+// program's cudaMallocManaged and cudaFree calls to penguinArenaMallocManaged
+// and penguinArenaFree. Objects of up to PENGUIN_ARENA_MAX_OBJECT bytes are
+// carved out of 2MB aligned slabs, one va_block each, and a slab only holds
+// objects of one density class. A slab is one allocation to the planners, so
+// pins and prioritized ranges go to the slabs of dense objects and never
+// cover cold objects that would otherwise share their va_blocks. The density
+// of an allocation site is what the access counts of the analysis credited
+// to its objects, per byte allocated there, in this run or, before its first
+// launch, in the previous one (PENGUIN_ARENA_FILE). PENGUIN_ARENA=0 turns
+// the arena off at run time.
+#define PENGUIN_ARENA_SLAB (2*1024*1024ULL)
+#ifndef PENGUIN_ARENA_MAX_OBJECT
+#define PENGUIN_ARENA_MAX_OBJECT (256*1024ULL)
+#endif
+#define PENGUIN_ARENA_ALIGN 256ULL
+// slabs taken from the driver at a time
+#define PENGUIN_ARENA_REGION_SLABS 16
+// a site is hot above PENGUIN_ARENA_HOT_RATIO times the mean density of the
+// sites and cold below the mean divided by it
+#define PENGUIN_ARENA_HOT_RATIO 2.0
+#define PENGUIN_ARENA_FILE "penguin_arena.bin"
+#define PENGUIN_ARENA_MAGIC 0x50454e4741524e41ULL
+#define PENGUIN_ARENA_NO_SITE (~0U)
 
-extern "C"
-bool is_iterdep_access(unsigned aid) {
-    return (aid_wss_map_iterdep.find(aid) != aid_wss_map_iterdep.end());
-}
+typedef enum {
+    PENGUIN_ARENA_UNKNOWN, // no launch has accessed the site yet
+    PENGUIN_ARENA_COLD,
+    PENGUIN_ARENA_WARM,
+    PENGUIN_ARENA_HOT,
+    PENGUIN_ARENA_CLASSES
+} ArenaClass;
 
-extern "C"
-void print_aid_wss_map_iterdep() {
-    /* std::cout << "aid wss map (iterdep)\n"; */
-    for (auto a = aid_wss_map_iterdep.begin(); a != aid_wss_map_iterdep.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-    }
-}
+typedef struct
+{
+    unsigned long long size;
+    unsigned site;
+} penguin_arena_object;
 
-extern "C"
-void process_iterdep_access() {
-    for (auto a = aid_wss_map_iterdep.begin(); a != aid_wss_map_iterdep.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
+typedef struct
+{
+    unsigned long long used;    // bump offset of the next object
+    unsigned long long live;    // bytes of the objects not freed yet
+    ArenaClass cls;
+} penguin_arena_slab;
+
+typedef struct
+{
+    unsigned long long bytes;   // allocated at the site in this run
+    unsigned long long ac;      // access counts credited to its objects
+    float density;              // of the previous run, < 0 if unknown
+} penguin_arena_site;
+
+// object base -> object, slab base -> slab
+std::map<unsigned long long, penguin_arena_object> arena_objects;
+std::map<unsigned long long, penguin_arena_slab> arena_slabs;
+std::map<unsigned, penguin_arena_site> arena_sites;
+// slab objects of each class are placed in, 0 if none
+unsigned long long arena_current[PENGUIN_ARENA_CLASSES] = {};
+// slabs whose objects were all freed, and the unused rest of the regions
+std::vector<unsigned long long> arena_empty_slabs;
+// site of the next penguinArenaMallocManaged of this thread
+thread_local unsigned arena_next_site = PENGUIN_ARENA_NO_SITE;
+
+// The arena object ptr points into, arena_objects.end() if none
+std::map<unsigned long long, penguin_arena_object>::iterator penguin_arena_find(void* ptr) {
+    unsigned long long p = (unsigned long long) ptr;
+    auto o = arena_objects.upper_bound(p);
+    if(o == arena_objects.begin()) {
+        return arena_objects.end();
     }
+    o--;
+    return p - o->first < o->second.size ? o : arena_objects.end();
 }
 
-extern "C"
-void process_all_accesses() {
+bool penguin_arena_object_base(void* ptr) {
+    return arena_objects.find((unsigned long long) ptr) != arena_objects.end();
 }
 
-// this function is for all non-iterative kernels (and non iteration-dependent accesses within iterative kernels)
-extern "C"
-void perform_memory_management_global() {
-    // many maps
-    /* std::cout << "mm global \n"; */
-    return;
-    std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly;
-    std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly;
-    std::map<void*, unsigned long long> mmg_alloc_ad_map_iteronly;
-    std::map<void*, unsigned long long> mmg_alloc_wss_map;
-    std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly;
+// Credits access counts of a launch to the site of the object they fall in
+void penguin_arena_credit(void* ptr, unsigned long long count) {
+    if(arena_objects.empty()) {
+        return;
+    }
+    auto o = penguin_arena_find(ptr);
+    if(o != arena_objects.end() && o->second.site != PENGUIN_ARENA_NO_SITE) {
+        arena_sites[o->second.site].ac += count;
+    }
+}
 
-    std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_ac_map_invid;
-    std::map<unsigned, std::map<void*, float>> mmg_alloc_ad_map_invid;
-    /* std::cout << "all aid along with ac, allocation, size, invid\n"; */
-    for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) {
-        /* std::cout << a->first << " " << aid_ac_map[a->first] << " " << a->second << " "; */
-        // find the allocation
-        if(allocation_size_map[aid_allocation_map[a->first]] == 0) {
-            /* std::cout << "[inside] "; */
-            void * insideallocation = identify_memory_allocation(aid_allocation_map[a->first]);
-            /* std::cout << insideallocation << "\n"; */
-            allocation_size_map[aid_allocation_map[a->first]] = allocation_size_map[insideallocation];
-        }
-        /* std::cout << allocation_size_map[aid_allocation_map[a->first]] << " "; */
-        /* std::cout << aid_invocation_id_map[a->first] << " "; */
-        if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) {
-            /* std::cout << " iterdep "; */
-            /* std::cout << aid_wss_map_iterdep[a->first]; */
-        }
-        if(aid_pchase_map.find(a->first) != aid_pchase_map.end()) {
-            /* std::cout << " pchase "; */
-        }
-        /* std::cout << "\n"; */
+// Trace of the offline policy simulator, eval/sim. With PENGUIN_SIM_TRACE
+// set to a file name, the runtime records the allocations and their
+// decisions, the launches with the PENGUIN_SIM_BLOCK blocks of every
+// allocation they access, its own prefetches and frees, and at
+// penguinStopStatCollection the faults and migrations the driver counted per
+// range, and writes them there: a penguin_sim_header and then header.records
+// penguin_sim_entry. Accesses are only seen while the planner runs, not
+// when a profile is replayed.
+#define PENGUIN_SIM_MAGIC 0x3143525456555355ULL // "USUVTRC1"
+#define PENGUIN_SIM_BLOCK (2*1024*1024ULL)
+#define PENGUIN_SIM_NO_ALLOC 0xffffffffU
+
+enum penguin_sim_type {
+    PENGUIN_SIM_ALLOC,    // id = allocation, a = base, b = size
+    PENGUIN_SIM_DECISION, // id = allocation, a = Decision
+    PENGUIN_SIM_ACCESS,   // id = allocation, a = first block, b = blocks, of the next launch
+    PENGUIN_SIM_STORE,    // same, for an access that stores
+    PENGUIN_SIM_LAUNCH,   // id = invocation id, a = time in ns
+    PENGUIN_SIM_H2D,      // a = address, b = length
+    PENGUIN_SIM_D2H,      // a = address, b = length
+    PENGUIN_SIM_FREE,     // a = address
+    PENGUIN_SIM_FAULTS,   // id = allocation or PENGUIN_SIM_NO_ALLOC, a = faults, b = evictions
+    PENGUIN_SIM_MIGRATED, // id = same, a = bytes H2D, b = bytes D2H
+    PENGUIN_SIM_MAX
+};
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t block;
+    uint64_t budget;  // bytes of GPU memory the runtime planned with
+    uint64_t records;
+} penguin_sim_header;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t id;
+    uint64_t a;
+    uint64_t b;
+} penguin_sim_entry;
+
+int sim_trace_enabled = -1;
+pthread_mutex_t sim_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+std::vector<penguin_sim_entry> sim_trace;
+
+bool penguin_sim_tracing() {
+    if(sim_trace_enabled < 0) {
+        sim_trace_enabled = getenv("PENGUIN_SIM_TRACE") != NULL;
     }
-    /* std::cout <<"computing access density\n"; */
-    for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) {
-        auto invid = aid_invocation_id_map[a->first];
-        if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) {
-            // check if only a fractiof of the data structure is being accesses in this access
-            auto span = aid_wss_map_iterdep[a->first];
-            auto allocation = aid_allocation_map[a->first];
-            auto dsize = allocation_size_map[allocation];
-            /* std::cout << "hi " << span << "  " << dsize << "\n"; */
-            float span_to_size = (float) span / (float) dsize;
-            if(span_to_size < 0.05 && span != 0) {
-                /* std::cout << "span is smallr than dsize significantly\n"; */
-                mmg_alloc_ac_map_iteronly[a->second] += aid_ac_map[a->first];
-                if(mmg_alloc_span_map_iteronly[a->second] < span) {
-                    mmg_alloc_span_map_iteronly[a->second] = span;
-                }
-            } else {
-                mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
-            }
+    return sim_trace_enabled;
+}
 
-        } else {
-            /* std::cout << aid_ac_map[a->first]; */
-            mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
-            // not an iteration dependent access
-        }
+void penguin_sim_record(unsigned type, unsigned id, unsigned long long a, unsigned long long b) {
+    if(!penguin_sim_tracing()) {
+        return;
     }
-    /* std::cout << "allocation to ac map iteronly\n"; */
-    for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) {
-        auto span = mmg_alloc_span_map_iteronly[a->first];
-        /* std::cout << a->first << " " << a->second << " " << span << " "; */
-        auto ad = (float) a->second / (float) span;
-        /* std::cout << ad  << "\n"; */
-        mmg_alloc_ad_map_iteronly[a->first] = ad;
+    pthread_mutex_lock(&sim_trace_lock);
+    sim_trace.push_back(penguin_sim_entry{type, id, a, b});
+    pthread_mutex_unlock(&sim_trace_lock);
+}
+
+// Access of the launch being planned to [lo, hi) of allocation id
+void penguin_sim_access(unsigned id, unsigned long long lo, unsigned long long hi, bool store) {
+    if(!penguin_sim_tracing() || id == PENGUIN_INVALID_ALLOC_ID) {
+        return;
     }
-    /* std::cout << "allocation to ac to ad map\n"; */
-    float max_ad_among_noniter = 0;
-    for (auto mmg_alloc_ac_map_iter = mmg_alloc_ac_map_invid.begin();
-            mmg_alloc_ac_map_iter != mmg_alloc_ac_map_invid.end();
-            mmg_alloc_ac_map_iter++) {
-        auto invid  = mmg_alloc_ac_map_iter->first;
-        /* std::cout << "invid = " << mmg_alloc_ac_map_iter->first << "\n"; */
-        auto mmg_alloc_ac_map = mmg_alloc_ac_map_iter->second;
-        for(auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) {
-            /* std::cout << a->first << " " << a->second << " "; */
-            auto dsize = allocation_size_map[a->first];
-            auto ad = (float) a->second / (float) dsize;
-            if(ad > max_ad_among_noniter) {
-                max_ad_among_noniter = ad;
-            }
-            /* std::cout << ad  << "\n"; */
-            mmg_alloc_ad_map_invid[invid][a->first] = mmg_alloc_ac_map_invid[invid][a->first] / (float) dsize;
-        }
+    hi = std::min(hi, allocation_table[id].size);
+    if(hi <= lo) {
+        return;
     }
-    /* std::cout << "working set size map\n"; */
-    for (auto a = aid_wss_map.begin(); a != aid_wss_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
-        if(mmg_alloc_wss_map[aid_allocation_map[a->first]] < a->second) {
-            mmg_alloc_wss_map[aid_allocation_map[a->first]] = a->second;
-        }
+    unsigned long long first = lo / PENGUIN_SIM_BLOCK;
+    penguin_sim_record(store ? PENGUIN_SIM_STORE : PENGUIN_SIM_ACCESS, id, first,
+            (hi + PENGUIN_SIM_BLOCK - 1) / PENGUIN_SIM_BLOCK - first);
+}
+
+// Appends the driver's counters and writes the trace out
+void penguin_sim_dump(const std::vector<penguin_range_stats>& stats) {
+    if(!penguin_sim_tracing()) {
+        return;
     }
-    /* std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
-    /* std::cout << "phase 2, decisions for iteronly\n"; */
-    std::copy(mmg_alloc_ad_map_iteronly.begin(), 
-            mmg_alloc_ad_map_iteronly.end(),
-            back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly));
-    std::sort(mmg_alloc_ad_vector_iteronly.begin(),
-            mmg_alloc_ad_vector_iteronly.end(), sortfunc);
-    /* std::cout << "sorted ad iteronly \n"; */
-    for(auto a = mmg_alloc_ad_vector_iteronly.begin();
-            a != mmg_alloc_ad_vector_iteronly.end(); a++) {
-        /* std::cout << a->first << "  " << a->second << "\n"; */
-        if(a->second > max_ad_among_noniter) {
-            /* std::cout << "will be considered; "; */
-            auto span = mmg_alloc_span_map_iteronly[a->first];
-            if(span == 0) {
-                /* std::cout << "skipped\n"; */
-                continue;
-            }
-            /* auto span = 1024*1024; */
-            auto dsize = allocation_size_map[a->first];
-            /* std::cout << "span = " << span << "  "; */
-            auto prefetch_size = span;
-            if(prefetch_size < PENGUIN_MIN_PREFETCH) {
-                prefetch_size = PENGUIN_MIN_PREFETCH;
+    for(auto &r : stats) {
+        unsigned id = PENGUIN_SIM_NO_ALLOC;
+        auto a = allocation_interval_map.upper_bound(r.base);
+        if(a != allocation_interval_map.begin()) {
+            --a;
+            if(r.base < a->first + allocation_table[a->second].size) {
+                id = a->second;
             }
-            if(prefetch_size >= dsize) {
-                prefetch_size = dsize;
-            }
-            /* std::cout << "prefetch = " << prefetch_size << "\n"; */
-            /* auto prefetch_iters_per_batch = dsize/prefetch_size; */
-            auto prefetch_iters_per_batch = prefetch_size/span;
-            /* std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
-            // insert into data structures for penguinSuperPrefetch to read from 
-            AllocationToPrefetchBoolMap[a->first] = true;
-            AllocationToPrefetchSizeMap[a->first] = prefetch_size * 4;
-            AllocationToPrefetchItersPerBatchMap[a->first] = prefetch_iters_per_batch;
-            AllocationToDecisionMap[a->first] = PENGUIN_DEC_ITERATION_MIGRATION;
-            available -= prefetch_size * 4;
-            /* std::cout << "available = " << available << "\n"; */ 
-        } else {
-            /* std::cout << "will NOT be considered\n"; */
         }
-    } // iteronly ends here
-    /* std::cout << "phase 2.5, decision for non-iter\n"; */
-    std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_invid;
-    for (auto invid = mmg_alloc_ad_map_invid.begin();
-            invid != mmg_alloc_ad_map_invid.end(); invid++) {
-        /* std::cout << "processing invid = " << invid->first  << "\n"; */
-        auto mmg_alloc_ad_map = invid->second;
+        penguin_sim_record(PENGUIN_SIM_FAULTS, id, r.faults, r.evictions);
+        penguin_sim_record(PENGUIN_SIM_MIGRATED, id, r.bytes_h2d, r.bytes_d2h);
+    }
+    const char* path = getenv("PENGUIN_SIM_TRACE");
+    FILE* f = fopen(path, "wb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return;
+    }
+    pthread_mutex_lock(&sim_trace_lock);
+    penguin_sim_header header = {PENGUIN_SIM_MAGIC, PENGUIN_SIM_BLOCK, gpu_memory, sim_trace.size()};
+    if(fwrite(&header, sizeof(header), 1, f) != 1 ||
+            fwrite(sim_trace.data(), sizeof(penguin_sim_entry), sim_trace.size(), f) != sim_trace.size()) {
+        fprintf(stderr, "Cannot write %s\n", path);
+    }
+    pthread_mutex_unlock(&sim_trace_lock);
+    fclose(f);
+}
+
+// Sets the decision of an allocation and marks it on the timeline
+void penguin_set_decision(penguin_alloc_desc& desc, Decision decision) {
+    desc.decision = decision;
+    penguin_decision_log_note(PENGUIN_LOG_DECISION, desc.base, desc.size, decision, desc.seq);
+    penguin_sim_record(PENGUIN_SIM_DECISION, lookup_allocation_id(desc.base), decision, 0);
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "%s %p %llu", penguin_decision_name[decision], desc.base, desc.size);
+}
+
+// Overrides: per-allocation settings an operator puts over the planner's,
+// from PENGUIN_OVERRIDE_FILE, see penguin_overrides_load. A rule is keyed by
+// the allocation's site or by a kernel and the argument it is passed as, and
+// sets any of the PENGUIN_OVERRIDE_* below; what it leaves out stays the
+// planner's.
+#define PENGUIN_OVERRIDE_DECISION       1
+#define PENGUIN_OVERRIDE_PRIORITY       2 // eviction level of the GPU pin
+#define PENGUIN_OVERRIDE_PREFETCH       4 // iteration prefetch batch bytes
+#define PENGUIN_OVERRIDE_AC_THRESHOLD   8 // of the access counters while host pinned
+#define PENGUIN_OVERRIDE_AC_GRANULARITY 16 // bytes a notification migrates
+
+struct penguin_override {
+    unsigned long long site; // see penguin_alloc_site, 0 for a kernel rule
+    std::string kernel;      // else the kernel or library call, as the host
+    unsigned arg;            // transform names it, and the argument
+    unsigned set;            // PENGUIN_OVERRIDE_*
+    Decision decision;
+    unsigned priority;
+    unsigned long long prefetch;
+    unsigned ac_threshold;
+    unsigned long long ac_granularity;
+};
+
+std::vector<penguin_override> overrides;
+unsigned override_kernel_rules = 0;
+// bound since the last launch, their overrides are applied at the next one
+std::vector<unsigned> override_pending;
+// a phase began, the file is read again if it changed
+bool overrides_check = false;
+
+int overrides_enabled = -1;
 
-        for(auto alloc = mmg_alloc_ad_map.begin();
-                alloc != mmg_alloc_ad_map.end(); alloc++) {
-            /* std::cout << alloc->first << "  " << alloc->second << std::endl; */
-            // add a check to insert only the relevant 
-            mmg_alloc_ad_vector_invid.push_back(std::pair<void*, float>(alloc->first, alloc->second));
+void penguin_overrides_load(bool forced);
+void penguin_overrides_reload();
+
+bool penguin_overrides_enabled() {
+    if(overrides_enabled < 0) {
+        overrides_enabled = getenv("PENGUIN_OVERRIDE_FILE") != NULL;
+        if(overrides_enabled) {
+            penguin_overrides_load(true);
         }
     }
-    std::sort(mmg_alloc_ad_vector_invid.begin(),
-            mmg_alloc_ad_vector_invid.end(), sortfuncf);
-    /* std::cout << "sorted \n"; */
-    unsigned locally_available = available;
-    for(auto a = mmg_alloc_ad_vector_invid.begin();
-            a != mmg_alloc_ad_vector_invid.end(); a++) {
-        /* std::cout << a->first << " " << a->second << "\n"; */
+    return overrides_enabled;
+}
+
+// The rule of desc if it sets what, NULL otherwise
+const penguin_override* penguin_override_of(const penguin_alloc_desc& desc, unsigned what) {
+    if(desc.override_rule == 0 || desc.override_rule > overrides.size()) {
+        return NULL;
     }
+    const penguin_override& o = overrides[desc.override_rule - 1];
+    return (o.set & what) ? &o : NULL;
+}
 
-    /* std::cout << "wss for allocation\n"; */
-    for(auto a = mmg_alloc_wss_map.begin();
-            a != mmg_alloc_wss_map.end(); a++) {
-        /* std::cout << a->first << " " << a->second << std::endl; */
+// Where an allocation was made, from the return address of the call that
+// registered it: its offset in a shared object or position independent
+// executable, the address itself in an executable linked at a fixed one,
+// either less one so that addr2line -e <object> names the line of the call
+unsigned long long penguin_alloc_site(const void* caller) {
+    unsigned long long site = (unsigned long long) caller - 1;
+    Dl_info info;
+    if(dladdr(caller, &info) == 0 || info.dli_fbase == NULL) {
+        return site;
     }
+    // the object is mapped from its ELF header on
+    if(((const Elf64_Ehdr*) info.dli_fbase)->e_type == ET_DYN) {
+        site -= (unsigned long long) info.dli_fbase;
+    }
+    return site;
+}
 
-    // Actual decision
-    /* std::cout << "actual decision\n"; */
-    if(available > 0) {
-        for(auto a = mmg_alloc_ad_vector_invid.begin();
-                a != mmg_alloc_ad_vector_invid.end(); a++) {
-            /* if */
-            if(mmg_alloc_wss_map.find(a->first) != mmg_alloc_wss_map.end()){
-                auto awss = mmg_alloc_wss_map.find(a->first);
-                auto dsize = allocation_size_map[a->first];
-                /* std::cout << a->first << " " << awss->second << std::endl; */
-                if(awss->second < dsize) {
-                    /* std::cout << "temporal\n"; */
-                    available -= awss->second;
-                } else {
-                    if(available > dsize) {
-                        available -= dsize;
-            /* penguinSetPrioritizedLocation((char*) a->first, dsize, 0); */
-                    } else {
-                        available = 0;
-            /* penguinSetPrioritizedLocation((char*) a->first, available, 0); */
-                    }
-                }
-            }
+// Binds allocation id to the first rule of its site
+void penguin_override_bind_site(unsigned id) {
+    penguin_alloc_desc& desc = allocation_table[id];
+    for(unsigned r = 0; r < overrides.size(); r++) {
+        if(overrides[r].site != 0 && overrides[r].site == desc.site) {
+            desc.override_rule = r + 1;
+            override_pending.push_back(id);
+            return;
         }
     }
+}
 
-    // LAST STEP 
-    // check if memory is available; if so increase prefetch size.
-    if(available > 0) {
-        unsigned numPrefetchedAllocs = 0;
-        unsigned long long PrefetchTotal = 0;
-        for(auto memalloc = AllocationToPrefetchBoolMap.begin();
-                memalloc != AllocationToPrefetchBoolMap.end(); memalloc++) {
-            numPrefetchedAllocs++;
-            PrefetchTotal += AllocationToPrefetchSizeMap[memalloc->first];
-        }
-        /* std::cout << "numPrefetchedAllocs = " << numPrefetchedAllocs << std::endl; */
-        /* std::cout << "prefetchTotal = " << PrefetchTotal << std::endl; */
-        auto available_now = available;
-        for(auto memalloc = AllocationToPrefetchBoolMap.begin();
-                memalloc != AllocationToPrefetchBoolMap.end(); memalloc++) {
-            unsigned long long newAllocation = 
-                (AllocationToPrefetchSizeMap[memalloc->first] * available_now) / PrefetchTotal;
-            available -= newAllocation;
-            AllocationToPrefetchSizeMap[memalloc->first] = newAllocation;
-            auto span = mmg_alloc_span_map_iteronly[memalloc->first];
-            span = span * 4;
-            AllocationToPrefetchItersPerBatchMap[memalloc->first] =
-                newAllocation / span;
-            /* std::cout << memalloc->first << " " << newAllocation << " " */ 
-                /* << newAllocation/span << std::endl; */
+// Binds allocation, passed to kernel as argument arg, to the first rule of
+// the two, unless it has a rule already
+void penguin_override_bind_kernel(void* allocation, const char* kernel, unsigned arg) {
+    auto id = lookup_allocation_id(allocation);
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].override_rule != 0) {
+        return;
+    }
+    for(unsigned r = 0; r < overrides.size(); r++) {
+        if(overrides[r].site == 0 && overrides[r].arg == arg && overrides[r].kernel == kernel) {
+            allocation_table[id].override_rule = r + 1;
+            override_pending.push_back(id);
+            return;
         }
     }
-    /* std::cout << "available = " << available << std::endl; */
 }
 
-extern "C"
-void perform_memory_management_iterative() {
-    /* std::cout << "mm iterative \n"; */
-    is_iterative = true;
-    /* std::cout << "available = " << available << std::endl; */
+void set_allocation_prefetch(void* ptr, unsigned long long prefetch_size,
+        unsigned long long prefetch_iters_per_batch, unsigned long long prefetch_window) {
+    auto id = lookup_allocation_id(ptr);
+    if(id == PENGUIN_INVALID_ALLOC_ID) {
+        allocation_desc(ptr);
+        id = lookup_allocation_id(ptr);
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(!desc.prefetch) {
+        desc.prefetch = true;
+        prefetch_alloc_ids.push_back(id);
+    }
+    // an override's batch, as many iterations to it as to the planner's
+    const penguin_override* o = penguin_override_of(desc, PENGUIN_OVERRIDE_PREFETCH);
+    if(o != NULL && prefetch_size != 0) {
+        prefetch_iters_per_batch = std::max(1ULL, prefetch_iters_per_batch * o->prefetch / prefetch_size);
+        prefetch_size = o->prefetch;
+        prefetch_window = std::max(prefetch_window, prefetch_size);
+    }
+    desc.prefetch_size = prefetch_size;
+    desc.prefetch_iters_per_batch = prefetch_iters_per_batch;
+    desc.prefetch_window = prefetch_window;
+    if(prefetch_size != 0) {
+        penguin_prefetch_period = std::gcd(penguin_prefetch_period,
+                (unsigned) prefetch_iters_per_batch);
+    }
+}
 
-    /* std::cout << "data from reuse\n"; */
-    for (auto a = aid_ac_map_reuse.begin(); a != aid_ac_map_reuse.end(); a++) {
-        /* std::cout << a->first << "  " << a->second << std::endl; */
+// Takes the memory for a sliding window out of available: the batch in use
+// plus PENGUIN_PREFETCH_DEPTH batches ahead, or as many as still fit.
+unsigned long long reserve_prefetch_window(unsigned long long batch) {
+    unsigned long long window = batch * (PENGUIN_PREFETCH_DEPTH + 1);
+    while(window > batch && window > available) {
+        window -= batch;
     }
-    std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly;
-    std::map<void*, unsigned long long> mmg_alloc_ad_map_iteronly;
-    std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly;
-    std::map<unsigned, std::map<void*, float>> mmg_alloc_ac_map_invid;
-    std::map<unsigned, std::map<void*, float>> mmg_alloc_ad_map_invid;
-     std::map<void*, float> mmg_alloc_ad_map_global;
-     std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_global;
-    std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly;
-    for (auto a = aid_allocation_map_reuse.begin(); a != aid_allocation_map_reuse.end(); a++) {
-        auto invid = aid_invocation_id_map[a->first];
-        if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) {
-            // check if only a fractiof of the data structure is being accesses in this access
-            auto span = aid_wss_map_iterdep[a->first];
-            auto allocation = aid_allocation_map_reuse[a->first];
-            auto dsize = allocation_size_map[allocation];
-            /* std::cout << "hi " << span << "  " << dsize << "\n"; */
-            float span_to_size = (float) span / (float) dsize;
-            if(span_to_size < 0.05 && span != 0) {
-                /* std::cout << "span is smallr than dsize significantly\n"; */
-                mmg_alloc_ac_map_iteronly[a->second] += aid_ac_map[a->first];
-                if(mmg_alloc_span_map_iteronly[a->second] < span) {
-                    mmg_alloc_span_map_iteronly[a->second] = span;
-                }
-            } else {
-                mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
-            }
+    if(window > available) {
+        available = 0;
+    } else {
+        available -= window;
+    }
+    return window;
+}
 
-        } else {
-            /* std::cout << aid_ac_map[a->first]; */
-            mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
-            // not an iteration dependent access
+// Placement profile. At exit the final decision of every allocation is
+// written to PENGUIN_PROFILE_FILE (or $PENGUIN_PROFILE), keyed by the
+// executable and the allocation's position among addIntoAllocationMap calls.
+// The next run of the same binary maps the file when the first allocation is
+// registered and replays the decisions at the first launch; as long as every
+// allocation matches its recorded size the planners and the aid recorders
+// are skipped. Set PENGUIN_PROFILE_REPLAY=0 to only record.
+#define PENGUIN_PROFILE_FILE "penguin_profile.bin"
+#define PENGUIN_PROFILE_MAGIC 0x50454e4755494e50ULL
+#define PENGUIN_PROFILE_VERSION 3
+
+static bool profile_loaded = false;
+
+// Tunables of the planner and of the access counters, the constants the eval
+// tune.sh explores per workload. They are the defaults below, then the ones
+// stored in the profile of this binary, then PENGUIN_TUNE, a comma separated
+// list of name=value (min_prefetch=16m,prefetch_batches=2,...); the access
+// counter ones also take PENGUIN_AC_GRANULARITY and PENGUIN_AC_THRESHOLD. The
+// profile saved at exit keeps whatever the run used.
+typedef struct
+{
+    unsigned long long min_prefetch;    // smallest iteration prefetch batch
+    unsigned long long pchase_headroom; // left free when a pointer chase takes the rest
+    double iteronly_ratio;              // span/size below which an access is iteration only
+    unsigned prefetch_batches;          // batches reserved in the rolling window
+    unsigned ac_granularity;            // UVM_ACCESS_COUNTER_GRANULARITY
+    unsigned ac_threshold;
+    unsigned pad;
+} penguin_tunables;
+
+static penguin_tunables tunables = {PENGUIN_MIN_PREFETCH, 10 * 1024ULL*1024ULL, 0.05, 4, 1, 256, 0};
+static bool tunables_ready = false;
+
+// UVM_ACCESS_COUNTER_GRANULARITY of 64k|2m|16m|16g, 0 if it is none of them
+unsigned penguin_ac_granularity_of(const char* s) {
+    static const char* names[] = {"64k", "2m", "16m", "16g"};
+    for(unsigned i = 0; i < 4; i++) {
+        if(strcasecmp(s, names[i]) == 0) {
+            return i + 1;
         }
     }
-    /* std::cout << "allocation to ac map iteronly\n"; */
-    for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) {
-        auto span = mmg_alloc_span_map_iteronly[a->first];
-        /* std::cout << a->first << " " << a->second << " " << span << " "; */
-        auto ad = (float) a->second / (float) span;
-        /* std::cout << ad  << "\n"; */
-        mmg_alloc_ad_map_iteronly[a->first] = ad;
+    return 0;
+}
+
+// Sizes take a k, m or g suffix
+unsigned long long penguin_tune_size(const char* s) {
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch(*end) {
+        case 'k': case 'K': return v << 10;
+        case 'm': case 'M': return v << 20;
+        case 'g': case 'G': return v << 30;
     }
-    /* std::cout << "allocation to ac to ad map\n"; */
-    float max_ad_among_noniter = 0;
-    for (auto mmg_alloc_ac_map_iter = mmg_alloc_ac_map_invid.begin();
-            mmg_alloc_ac_map_iter != mmg_alloc_ac_map_invid.end();
-            mmg_alloc_ac_map_iter++) {
-        auto invid  = mmg_alloc_ac_map_iter->first;
-        /* std::cout << "invid = " << mmg_alloc_ac_map_iter->first << "\n"; */
-        auto mmg_alloc_ac_map = mmg_alloc_ac_map_iter->second;
-        for(auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) {
-            /* std::cout << a->first << " " << a->second << " "; */
-            auto dsize = allocation_size_map[a->first];
-            auto ad = (float) a->second / (float) dsize;
-            if(ad > max_ad_among_noniter) {
-                max_ad_among_noniter = ad;
+    return v;
+}
+
+void penguin_tune_set(const char* name, const char* value) {
+    if(strcmp(name, "min_prefetch") == 0) {
+        tunables.min_prefetch = penguin_tune_size(value);
+    } else if(strcmp(name, "prefetch_batches") == 0 && atoi(value) > 0) {
+        tunables.prefetch_batches = atoi(value);
+    } else if(strcmp(name, "iteronly_ratio") == 0) {
+        tunables.iteronly_ratio = atof(value);
+    } else if(strcmp(name, "pchase_headroom") == 0) {
+        tunables.pchase_headroom = penguin_tune_size(value);
+    } else if(strcmp(name, "ac_granularity") == 0 && penguin_ac_granularity_of(value)) {
+        tunables.ac_granularity = penguin_ac_granularity_of(value);
+    } else if(strcmp(name, "ac_threshold") == 0) {
+        tunables.ac_threshold = strtoul(value, NULL, 10);
+    } else {
+        fprintf(stderr, "ignoring PENGUIN_TUNE %s=%s\n", name, value);
+    }
+}
+
+void penguinProfileLoad();
+
+const penguin_tunables& penguin_tune() {
+    if(tunables_ready) {
+        return tunables;
+    }
+    // the profile's first, PENGUIN_TUNE goes over them
+    if(!profile_loaded) {
+        penguinProfileLoad();
+    }
+    tunables_ready = true;
+    const char* env = getenv("PENGUIN_TUNE");
+    if(env != NULL) {
+        std::string list = env;
+        for(size_t start = 0; start < list.size();) {
+            size_t end = list.find(',', start);
+            if(end == std::string::npos) {
+                end = list.size();
             }
-            /* std::cout << ad  << "\n"; */
-            mmg_alloc_ad_map_invid[invid][a->first] = mmg_alloc_ac_map_invid[invid][a->first] / (float) dsize;
-            mmg_alloc_ad_map_global[a->first] += mmg_alloc_ad_map_invid[invid][a->first];
+            std::string item = list.substr(start, end - start);
+            size_t eq = item.find('=');
+            if(eq != std::string::npos) {
+                penguin_tune_set(item.substr(0, eq).c_str(), item.c_str() + eq + 1);
+            }
+            start = end + 1;
         }
     }
-    /* std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
-    /* std::cout << "phase 2, decisions for iteronly\n"; */
-    std::copy(mmg_alloc_ad_map_iteronly.begin(), 
-            mmg_alloc_ad_map_iteronly.end(),
-            back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly));
-    std::sort(mmg_alloc_ad_vector_iteronly.begin(),
-            mmg_alloc_ad_vector_iteronly.end(), sortfunc);
-    /* std::cout << "sorted ad iteronly \n"; */
-    for(auto a = mmg_alloc_ad_vector_iteronly.begin();
-            a != mmg_alloc_ad_vector_iteronly.end(); a++) {
-        /* std::cout << a->first << "  " << a->second << "\n"; */
-        if(a->second > max_ad_among_noniter) {
-            /* std::cout << "will be considered; "; */
-            auto span = mmg_alloc_span_map_iteronly[a->first];
-            if(span == 0) {
-                /* std::cout << "skipped\n"; */
-                continue;
-            }
-            /* auto span = 1024*1024; */
-            auto dsize = allocation_size_map[a->first];
-            /* std::cout << "span = " << span << "  "; */
-            auto prefetch_size = span;
-            if(prefetch_size < PENGUIN_MIN_PREFETCH) {
-                prefetch_size = PENGUIN_MIN_PREFETCH;
-            }
-            if(prefetch_size >= dsize) {
-                prefetch_size = dsize;
-            }
-            /* std::cout << "prefetch = " << prefetch_size << "\n"; */
-            /* auto prefetch_iters_per_batch = dsize/prefetch_size; */
-            auto prefetch_iters_per_batch = prefetch_size/span;
-            /* std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
-            // insert into data structures for penguinSuperPrefetch to read from 
-            AllocationToPrefetchBoolMap[a->first] = true;
-            AllocationToPrefetchSizeMap[a->first] = prefetch_size * 4;
-            AllocationToPrefetchItersPerBatchMap[a->first] = prefetch_iters_per_batch;
-            AllocationToDecisionMap[a->first] = PENGUIN_DEC_ITERATION_MIGRATION;
-            available -= prefetch_size * 4;
-            /* std::cout << "available = " << available << "\n"; */ 
+    const char* gran = getenv("PENGUIN_AC_GRANULARITY");
+    if(gran != NULL) {
+        if(penguin_ac_granularity_of(gran)) {
+            tunables.ac_granularity = penguin_ac_granularity_of(gran);
         } else {
-            /* std::cout << "will NOT be considered\n"; */
+            fprintf(stderr, "unknown PENGUIN_AC_GRANULARITY %s, using 64k\n", gran);
+            tunables.ac_granularity = 1;
         }
-    } // iteronly ends here
-      // phase 3: decisions for non iterative
-    /* std::cout << "global AD\n"; */
-    for (auto a = mmg_alloc_ad_map_global.begin();
-            a != mmg_alloc_ad_map_global.end(); a++) {
-        /* std::cout << a->first << " " << a->second << std::endl; */
-        mmg_alloc_ad_vector_global.push_back(std::pair<void*, float>(a->first, a->second));
     }
-    std::sort(mmg_alloc_ad_vector_global.begin(),
-            mmg_alloc_ad_vector_global.end(), sortfuncf);
-    /* std::cout << "sorted ad global \n"; */
-    for(auto a = mmg_alloc_ad_vector_global.begin();
-            a != mmg_alloc_ad_vector_global.end(); a++) {
-        /* std::cout << a->first << "  " << a->second << "\n"; */
+    const char* threshold = getenv("PENGUIN_AC_THRESHOLD");
+    if(threshold != NULL) {
+        tunables.ac_threshold = strtoul(threshold, NULL, 10);
     }
-    // consider high AD ones first, then move on to low AD
-    // If AD < 5, consider only for pinning at the same place across iterations
-    /* available = gpu_memory; */
-    /* std::cout << "available " << available << std::endl; */
-    for(auto a = mmg_alloc_ad_vector_global.begin();
-            a != mmg_alloc_ad_vector_global.end(); a++) {
-        /* std::cout << a->first << "  " << a->second << "\n"; */
-        auto dsize = allocation_size_map[a->first];
-        if(available) {
-            if(available > dsize) {
-                if(AllocationStateMap[a->first] == PENGUIN_STATE_GPU_PINNED) {
-                }  else {
-                    /* std::cout << "gpu pin A\n"; */
-                    available -= dsize;
-                    /* std::cout << available <<  std::endl; */
-                    AllocationStateMap[a->first] = PENGUIN_STATE_GPU_PINNED;
-                    AllocationGPUResStart[a->first] = 0;
-                    AllocationGPUResStop[a->first] = dsize;
-                    penguinSetPrioritizedLocation((char*) a->first, dsize, 0);
-                    cudaMemPrefetchAsync((char*)a->first, dsize, 0, 0 );
-                }
-            } else {
-                /* std::cout << "gpu pin B\n"; */
-                    AllocationGPUResStart[a->first] = 0;
-                    AllocationGPUResStop[a->first] = available;
-                /* std::cout << available <<  std::endl; */
-                AllocationStateMap[a->first] = PENGUIN_STATE_GPU_PINNED;
-                penguinSetPrioritizedLocation((char*) a->first, available, 0);
-                cudaMemPrefetchAsync((char*)a->first, available, 0, 0 );
-                available = 0;
-                /* std::cout << "cpu pin rest B\n"; */
-                cudaMemAdvise((char*) a->first + available, dsize - available, cudaMemAdviseSetAccessedBy, 0);
-            }
-        } else {
-                AllocationStateMap[a->first] = PENGUIN_STATE_HOST;
-                /* std::cout << "cpu pin rest B\n"; */
-                /* std::cout << available <<  std::endl; */
-                cudaMemAdvise((char*) a->first + available, dsize - available, cudaMemAdviseSetAccessedBy, 0);
+    return tunables;
+}
+
+typedef struct
+{
+    unsigned long long magic;
+    unsigned long long binary;      // hash of the executable path and mtime
+    unsigned long long gpu_memory;  // budget the decisions were made for
+    unsigned version;
+    unsigned count;
+    penguin_tunables tune;
+} penguin_profile_header;
+
+typedef struct
+{
+    unsigned long long size;        // 0 if the allocation was not recorded
+    unsigned long long gpu_res_stop;
+    unsigned long long prefetch_size;
+    unsigned long long prefetch_iters_per_batch;
+    unsigned long long prefetch_window;
+    unsigned decision;
+    unsigned state;
+    unsigned ac_threshold;
+    int device;
+} penguin_profile_record;
+
+static bool profile_replay = false;
+static const penguin_profile_header *profile_map = NULL;
+static size_t profile_map_size = 0;
+unsigned allocation_seq = 0;
+// allocation IDs registered under replay whose decision is not applied yet
+std::vector<unsigned> profile_pending_ids;
+
+const char* penguin_profile_path() {
+    const char* path = getenv("PENGUIN_PROFILE");
+    return path ? path : PENGUIN_PROFILE_FILE;
+}
+
+unsigned long long penguin_profile_binary() {
+    char exe[4096];
+    auto len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if(len <= 0) {
+        return 0;
+    }
+    exe[len] = 0;
+    // FNV-1a over the path, then the modification time
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for(ssize_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) exe[i]) * 0x100000001b3ULL;
+    }
+    struct stat st;
+    if(stat(exe, &st) == 0) {
+        h = (h ^ (unsigned long long) st.st_mtime) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+const penguin_profile_record* penguin_profile_records() {
+    return (const penguin_profile_record*) (profile_map + 1);
+}
+
+void penguinProfileSave() {
+    if(profile_map) {
+        munmap((void*) profile_map, profile_map_size);
+        profile_map = NULL;
+    }
+    std::vector<penguin_profile_record> records(allocation_seq);
+    bool decided = false;
+    for(auto d = allocation_table.begin(); d != allocation_table.end(); d++) {
+        if(d->size == 0 || d->seq >= allocation_seq) {
+            continue;
         }
+        penguin_profile_record &r = records[d->seq];
+        r.size = d->size;
+        r.gpu_res_stop = d->gpu_res_stop;
+        r.prefetch_size = d->prefetch ? d->prefetch_size : 0;
+        r.prefetch_iters_per_batch = d->prefetch_iters_per_batch;
+        r.prefetch_window = d->prefetch ? d->prefetch_window : 0;
+        r.decision = d->decision;
+        r.state = d->state;
+        r.ac_threshold = d->ac_threshold;
+        r.device = d->device;
+        decided |= d->decision != PENGUIN_DEC_NONE;
     }
+    if(!decided) {
+        return;
+    }
+    penguin_profile_header header = {};
+    header.magic = PENGUIN_PROFILE_MAGIC;
+    header.binary = penguin_profile_binary();
+    header.gpu_memory = configured_gpu_memory;
+    header.version = PENGUIN_PROFILE_VERSION;
+    header.count = allocation_seq;
+    header.tune = penguin_tune();
+    // write a temporary and rename it, a concurrent run never sees half a file
+    std::string path = penguin_profile_path();
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", tmp.c_str());
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(records.data(), sizeof(penguin_profile_record), records.size(), f) == records.size();
+    ok &= fclose(f) == 0;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        unlink(tmp.c_str());
+    }
+}
 
-    // use remaning memory
-    if(available > 0) {
+// Maps the profile of a previous run, if it was made by this binary for the
+// same GPU memory budget.
+void penguinProfileLoad() {
+    profile_loaded = true;
+    penguinBudgetInit();
+    atexit(penguinProfileSave);
+    int fd = open(penguin_profile_path(), O_RDONLY);
+    if(fd < 0) {
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(penguin_profile_header)) {
+        close(fd);
+        return;
+    }
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        return;
     }
+    auto header = (const penguin_profile_header*) m;
+    if(header->magic != PENGUIN_PROFILE_MAGIC || header->version != PENGUIN_PROFILE_VERSION ||
+            header->binary != penguin_profile_binary() || header->gpu_memory != configured_gpu_memory ||
+            (size_t) st.st_size != sizeof(*header) + header->count * sizeof(penguin_profile_record)) {
+        /* std::cout << "stale profile\n"; */
+        munmap(m, st.st_size);
+        return;
+    }
+    // the tunables hold even if the decisions are planned again
+    tunables = header->tune;
+    const char* replay = getenv("PENGUIN_PROFILE_REPLAY");
+    if(replay && strcmp(replay, "0") == 0) {
+        munmap(m, st.st_size);
+        return;
+    }
+    profile_map = header;
+    profile_map_size = st.st_size;
+    profile_replay = true;
+}
 
+void penguin_decision_log_allocation(const penguin_alloc_desc& desc);
 
+// Called for every new allocation. An allocation the profile doesn't know,
+// or knows with another size, means the decisions no longer apply and the
+// run falls back to planning.
+void penguinProfileRegister(unsigned id) {
+    if(!profile_loaded) {
+        penguinProfileLoad();
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    desc.seq = allocation_seq++;
+    penguin_decision_log_allocation(desc);
+    if(!profile_replay) {
+        return;
+    }
+    auto records = penguin_profile_records();
+    if(desc.seq >= profile_map->count ||
+            (records[desc.seq].size != 0 && records[desc.seq].size != desc.size)) {
+        /* std::cout << "profile mismatch at allocation " << desc.seq << "\n"; */
+        profile_replay = false;
+        profile_pending_ids.clear();
+        return;
+    }
+    profile_pending_ids.push_back(id);
 }
 
-/* extern "C" */
-/* void perform_memory_management_global_og() { */
-/*     /1* return; // debuggy: quick test *1/ */
-/*     for(auto InvId = InvocationIDs.begin(); InvId != InvocationIDs.end(); InvId++){ */
-/*         InvocationIDtoDecisionBoolMap[*InvId] = false; */
-/*     } */
-/*     std::cout << "printing all aid along with allocation and ac\n"; */
-/*     for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) { */
-/*         std::cout << a->first << " " << aid_ac_map[a->first] << " " << a->second << " "; */
-/*         std::cout << aid_ac_map[a->first] << " "; */
-/*         std::cout << allocation_size_map[aid_allocation_map[a->first]] << " "; */
-/*         std::cout << aid_invocation_id_map[a->first] << " "; */
-/*         if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) { */
-/*             std::cout << " iterdep "; */
-/*             std::cout << aid_wss_map_iterdep[a->first]; */
-/*         } */
-/*         std::cout << "\n"; */
-/*     } */
+std::map<unsigned, unsigned long long> aid_ac_map;
+std::map<unsigned, void*> aid_allocation_map;
+std::map<unsigned, unsigned long long> aid_wss_map_iterdep;
+std::map<unsigned, unsigned long long> aid_wss_map;
+std::map<unsigned, bool> aid_pchase_map;
+std::map<unsigned, unsigned> aid_invocation_id_map;
+std::map<unsigned, bool> aid_ac_incomp_map;
 
-/*     std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly; */
-/*     std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly; */
-/*     std::map<void*, unsigned long long> mmg_alloc_ad_map_iteronly; */
-/*     std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly; */
+// Incremental state of perform_memory_management_global. An aid is marked
+// dirty whenever one of its recorded values changes; each aid remembers what
+// it last added to the per-allocation totals so that it can be retracted.
+typedef struct
+{
+    void* allocation;
+    unsigned invid;
+    bool iteronly;
+    unsigned long long ac;
+} mmg_aid_contribution;
+
+std::set<unsigned> mmg_dirty_aids;
+// Bumped on every change to what the local planner reads: the aid maps and
+// the allocation sizes. A decision taken at some generation holds for as long
+// as the generation stays the same.
+unsigned long long mmg_input_generation = 1;
+
+// Last decision of perform_memory_management, per invocation ID; generation
+// 0 means none yet
+typedef struct
+{
+    unsigned long long generation;
+    unsigned long long memsize;
+    unsigned long long gpu_memory; // budget at the decision
+    unsigned long long available; // left after the decision
+} mmg_invocation_memo;
+std::vector<mmg_invocation_memo> mmg_invocation_memos;
+
+// Residency scope of a stream: what the last decision for a launch on it
+// keeps on the GPU, held until its kernel is done. Kernels on different
+// streams may run together, so each is planned against the budget the others
+// haven't reserved.
+typedef struct
+{
+    unsigned invid;
+    unsigned long long reserved;
+    cudaEvent_t done; // recorded after the kernel, at the next decision
+    bool launched; // kernel launched, done not recorded yet
+} penguin_residency_scope;
+std::map<cudaStream_t, penguin_residency_scope> residency_scopes;
+
+// Budget of the upcoming launch on stream: gpu_memory less what the kernels
+// still running on the other streams reserved. Scopes whose kernels are done
+// give their reservation back.
+unsigned long long penguin_scope_budget(cudaStream_t stream) {
+    unsigned long long reserved = 0;
+    for(auto s = residency_scopes.begin(); s != residency_scopes.end(); s++) {
+        if(s->first == stream || s->second.reserved == 0) {
+            continue;
+        }
+        // its kernel was launched after its decision, so it is on the stream
+        // by now
+        if(s->second.launched) {
+            cudaEventRecord(s->second.done, s->first);
+            s->second.launched = false;
+        }
+        if(cudaEventQuery(s->second.done) != cudaErrorNotReady) {
+            s->second.reserved = 0;
+            continue;
+        }
+        reserved += s->second.reserved;
+    }
+    return gpu_memory > reserved ? gpu_memory - reserved : 0;
+}
 
-/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_ac_map_invid; */
-/*     std::map<unsigned, std::map<void*, float>> mmg_alloc_ad_map_invid; */
-/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_x_map_invid; */
-/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_y_map_invid; */
-/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_i_map_invid; */
+// Holds reserved bytes for the launch of invid on stream, in place of what its
+// previous launch there held, which runs before it
+void penguin_scope_reserve(cudaStream_t stream, unsigned invid, unsigned long long reserved) {
+    auto s = residency_scopes.find(stream);
+    if(s == residency_scopes.end()) {
+        if(!PENGUIN_STREAM_SCOPES) {
+            return;
+        }
+        penguin_residency_scope scope = {};
+        if(cudaEventCreateWithFlags(&scope.done, cudaEventDisableTiming) != cudaSuccess) {
+            return;
+        }
+        s = residency_scopes.insert(std::make_pair(stream, scope)).first;
+    }
+    s->second.invid = invid;
+    s->second.reserved = reserved;
+    s->second.launched = true;
+}
+std::map<unsigned, mmg_aid_contribution> mmg_aid_contribution_map;
+std::map<void*, std::set<unsigned>> mmg_alloc_aids_map;
+std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly;
+std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly;
+std::map<void*, unsigned long long> mmg_alloc_wss_map;
+std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_ac_map_invid;
+
+// Hash of what the aid maps hold, each entry's hash xored in; launches of an
+// invocation with different shapes set the same values back and forth, which
+// brings it back to what it was. The updates to the aid maps are the part of
+// mmg_input_generation that it covers; the rest counts the allocation changes.
+unsigned long long mmg_aid_fingerprint = 0;
+unsigned long long mmg_aid_updates = 0;
+
+unsigned long long mmg_aid_hash(const void* aid_map, unsigned aid, unsigned long long value) {
+    unsigned long long h = (unsigned long long) aid_map ^ ((unsigned long long) aid << 40) ^
+        (value * 0x9e3779b97f4a7c15ULL);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
 
-/*     for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) { */
-/*         auto invid = aid_invocation_id_map[a->first]; */
-/*         if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) { */
-/*             // check if only a fractiof of the data structure is being accesses in this access */
-/*             auto span = aid_wss_map_iterdep[a->first]; */
-/*             auto allocation = aid_allocation_map[a->first]; */
-/*             auto dsize = allocation_size_map[allocation]; */
-/*             /1* std::cout << "hi " << span << "  " << dsize << "\n"; *1/ */
-/*             float span_to_size = (float) span / (float) dsize; */
-/*             if(span_to_size < 0.05) { */
-/*                 /1* std::cout << "span is smallr than dsize significantly\n"; *1/ */
-/*                 mmg_alloc_ac_map_iteronly[a->second] += aid_ac_map[a->first]; */
-/*                 if(mmg_alloc_span_map_iteronly[a->second] < span) { */
-/*                     mmg_alloc_span_map_iteronly[a->second] = span; */
-/*                 } */
-/*             } else { */
-/*                 mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first]; */
-/*             } */
+// Entry aid of aid_map goes from before, if it had one, to after
+void mmg_aid_changed(const void* aid_map, unsigned aid, bool had, unsigned long long before,
+        unsigned long long after) {
+    if(had) {
+        mmg_aid_fingerprint ^= mmg_aid_hash(aid_map, aid, before);
+    }
+    mmg_aid_fingerprint ^= mmg_aid_hash(aid_map, aid, after);
+    mmg_aid_updates++;
+    mmg_input_generation++;
+}
 
-/*         } else { */
-/*             /1* std::cout << aid_ac_map[a->first]; *1/ */
-/*             mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first]; */
-/*             // not an iteration dependent access */
-/*         } */
-/*     } */
-/*     std::cout << "allocation to ac map iteronly\n"; */
-/*     for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) { */
-/*         auto span = mmg_alloc_span_map_iteronly[a->first]; */
-/*         std::cout << a->first << " " << a->second << " " << span << " "; */
-/*         auto ad = (float) a->second / (float) span; */
-/*         std::cout << ad  << "\n"; */
-/*         mmg_alloc_ad_map_iteronly[a->first] = ad; */
-/*     } */
-/*     std::cout << "allocation to ac map\n"; */
-/*     float max_ad_among_noniter = 0; */
-/*     for (auto mmg_alloc_ac_map_iter = mmg_alloc_ac_map_invid.begin(); */
-/*             mmg_alloc_ac_map_iter != mmg_alloc_ac_map_invid.end(); */
-/*             mmg_alloc_ac_map_iter++) { */
-/*         auto invid  = mmg_alloc_ac_map_iter->first; */
-/*         std::cout << "invid = " << mmg_alloc_ac_map_iter->first << "\n"; */
-/*         auto mmg_alloc_ac_map = mmg_alloc_ac_map_iter->second; */
-/*         for(auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) { */
-/*             std::cout << a->first << " " << a->second << " "; */
-/*             auto dsize = allocation_size_map[a->first]; */
-/*             auto ad = (float) a->second / (float) dsize; */
-/*             if(ad > max_ad_among_noniter) { */
-/*                 max_ad_among_noniter = ad; */
-/*             } */
-/*             std::cout << ad  << "\n"; */
-/*             mmg_alloc_ad_map_invid[invid][a->first] = mmg_alloc_ac_map_invid[invid][a->first] / (float) dsize; */
-/*             mmg_alloc_pd_x_map_invid[invid][a->first] = allocation_pd_bidx_map[a->first]; */
-/*             mmg_alloc_pd_y_map_invid[invid][a->first] = allocation_pd_bidy_map[a->first]; */
-/*             mmg_alloc_pd_i_map_invid[invid][a->first] = allocation_pd_phi_map[a->first]; */
-/*         } */
-/*     } */
-/*     std::cout << "phase 1.5, pchase"; */
-/*     for(auto a = aid_pchase_map.begin(); a != aid_pchase_map.end(); a++) { */
-/*         if(a->second == true) { */
-/*             AllocationToPchaseMap[aid_allocation_map[a->first]] = true; */
-/*         } */
-/*     } */
-/*     std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
-/*     std::cout << "phase 2, decisions for iteronly\n"; */
-/*     std::copy(mmg_alloc_ad_map_iteronly.begin(), */ 
-/*             mmg_alloc_ad_map_iteronly.end(), */
-/*             back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly)); */
-/*     std::sort(mmg_alloc_ad_vector_iteronly.begin(), */
-/*             mmg_alloc_ad_vector_iteronly.end(), sortfunc); */
-/*     std::cout << "sorted ad iteronly \n"; */
-/*     for(auto a = mmg_alloc_ad_vector_iteronly.begin(); */
-/*             a != mmg_alloc_ad_vector_iteronly.end(); a++) { */
-/*         std::cout << a->first << "  " << a->second << "\n"; */
-/*         if(a->second > max_ad_among_noniter) { */
-/*             std::cout << "will be considered; "; */
-/*             auto span = mmg_alloc_span_map_iteronly[a->first]; */
-/*             /1* auto span = 1024*1024; *1/ */
-/*             auto dsize = allocation_size_map[a->first]; */
-/*             std::cout << "span = " << span << "  "; */
-/*             auto prefetch_size = span; */
-/*             if(prefetch_size < PENGUIN_MIN_PREFETCH) { */
-/*                 prefetch_size = PENGUIN_MIN_PREFETCH; */
-/*             } */
-/*             if(prefetch_size >= dsize) { */
-/*                 prefetch_size = dsize; */
-/*             } */
-/*             std::cout << "prefetch = " << prefetch_size << "\n"; */
-/*             /1* auto prefetch_iters_per_batch = dsize/prefetch_size; *1/ */
-/*             auto prefetch_iters_per_batch = prefetch_size/span; */
-/*             std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
-/*             // insert into data structures for penguinSuperPrefetch to read from */ 
-/*             AllocationToPrefetchBoolMap[a->first] = true; */
-/*             AllocationToPrefetchSizeMap[a->first] = prefetch_size * 4; */
-/*             AllocationToPrefetchItersPerBatchMap[a->first] = prefetch_iters_per_batch; */
-/*             AllocationToDecisionMap[a->first] = PENGUIN_DEC_ITERATION_MIGRATION; */
-/*             available -= prefetch_size * 4; */
-/*             std::cout << "available = " << available << "\n"; */ 
-/*         } else { */
-/*             std::cout << "will NOT be considered\n"; */
-/*         } */
-/*     } // iteronly ends here */
-/*     std::cout << "phase 3, decisions on per invocation basis, excluding iteronly\n"; */
-/*     // first phcase */
-/*     // */
-/*     unsigned long long total_size = 0; */
-/*     for (auto a = allocation_size_map.begin(); a != allocation_size_map.end(); a++) { */
-/*         total_size += a->second; */
-/*     } */
-/*     for (auto a = AllocationToPchaseMap.begin(); a != AllocationToPchaseMap.end(); a++) { */
-/*         /1* auto invid = aid_invocation_id_map[a->first]; *1/ */
-/*         for(auto invid = InvocationIDs.begin(); invid != InvocationIDs.end(); invid++){ */
-/*             InvocationIDtoAllocationToDecisionMap[*invid][a->first] = PENGUIN_DEC_ACCESS_COUNTER; */
-/*             unsigned long long psize = allocation_size_map[a->first]; */
-/*             psize = (gpu_memory * psize) / total_size ; */
-/*             available -= psize; */
-/*         } */
-/*     } */
-/*     for (auto invid = mmg_alloc_ad_map_invid.begin(); */
-/*             invid != mmg_alloc_ad_map_invid.end(); invid++) { */
+template <typename T>
+void mmg_update_aid(std::map<unsigned, T>& aid_map, unsigned aid, T value) {
+    auto a = aid_map.find(aid);
+    if(a == aid_map.end() || a->second != value) {
+        mmg_dirty_aids.insert(aid);
+        mmg_aid_changed(&aid_map, aid, a != aid_map.end(),
+                a != aid_map.end() ? (unsigned long long) a->second : 0, (unsigned long long) value);
+    }
+    aid_map[aid] = value;
+}
+
+// Badly named
+std::map<unsigned, unsigned long long> aid_ac_map_reuse;
+std::map<unsigned, void*> aid_allocation_map_reuse;
+std::map<unsigned, unsigned> aid_invocation_id_map_reuse;
+
+extern "C"
+void add_aid_ac_map_reuse(unsigned aid, unsigned long long ac) {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "adi aid ac map resue " << aid  << " " << ac << "\n"; */
+    aid_ac_map_reuse[aid] = ac;
+}
+
+extern "C"
+void add_aid_allocation_map_reuse(unsigned aid, void* allocation) {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout<< "add_aid_allocation_map reuse" << aid << " " << allocation << std::endl; */
+    aid_allocation_map_reuse[aid] = allocation;
+}
+
+extern "C"
+void add_aid_invocation_map_reuse(unsigned aid, unsigned invocation_id) {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout<< "add_aid_invocation_map reuse" << aid << " " << invocation_id << std::endl; */
+    aid_invocation_id_map_reuse[aid] = invocation_id;
+}
+
+// working data structures
+std::map<unsigned, std::map<void*, Decision>> InvocationIDtoAllocationToADMap;
+std::map<unsigned, std::map<void*, Decision>> InvocationIDtoAllocationToDecisionMap;
+std::map<unsigned, std::map<void*, unsigned long long>> InvocationIDtoAllocationToPartialSize;
+
+static bool is_iterative = false;
+
+// this bool helps helper function at kernel invocations to quickly decide if 
+// there are any API calls to be made or it can just skip
+std::map<unsigned, bool> InvocationIDtoDecisionBoolMap;
+std::set<unsigned> InvocationIDs;
+
+// Do we need "C" linkage?
+
+void* round_down(void* addr) {
+    unsigned long long ad = (unsigned long long) addr;
+    return (void*) ((ad >> 16) << 16);
+}
+
+// Migrates count ranges, each to the processor of its uuid, in one
+// UVM_MIGRATE_BATCH that takes the driver's locks once and pipelines the
+// copies of all of them; the status of every entry is written back. With
+// PENGUIN_MIGRATE_ASYNC it returns once the copies are pushed.
+extern "C"
+penguin_error_t penguinMigrateBatch(penguin_migrate_batch_entry *entries, unsigned count,
+        unsigned flags) {
+    PENGUIN_ENTRY();
+
+    penguin_migrate_batch_ioctl_params request;
+    int status;
+
+    request.entries = entries;
+    request.count = count;
+    request.flags = flags;
+    request.migrated = 0;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_MIGRATE_BATCH_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// The prefetches queued by a policy batch go to the driver in one
+// UVM_MIGRATE_BATCH instead of a cudaMemPrefetchAsync each, the moves to the
+// host first so the room they free is there for the moves to the GPU. They
+// start right away rather than behind the work queued on the launch's
+// stream; the kernels that touch a range still in flight wait for its copy
+// in the driver. PENGUIN_MIGRATE_BATCH=0 prefetches them one at a time.
+int migrate_batch_enabled = -1;
+
+bool penguin_migrate_batch_enabled() {
+    if(migrate_batch_enabled < 0) {
+        const char* env = getenv("PENGUIN_MIGRATE_BATCH");
+        migrate_batch_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return migrate_batch_enabled;
+}
+
+// Policies set between penguinPolicyBatchBegin and the matching
+// penguinPolicyBatchEnd are queued and go to the driver in one
+// UVM_SET_POLICY_BATCH per PENGUIN_POLICY_BATCH_MAX_ENTRIES; the prefetches
+// of the ranges pinned meanwhile are issued once the policies are applied
+struct penguin_policy_prefetch {
+    void *base;
+    size_t length;
+    int device;
+    cudaStream_t stream;
+};
+struct penguin_policy_batch {
+    unsigned depth = 0;
+    std::vector<penguin_policy_batch_entry> entries;
+    std::vector<penguin_policy_prefetch> prefetches;
+};
+thread_local penguin_policy_batch policy_batch;
+
+// Prefetches issued in a penguin_prefetch_coalesce_scope wait for the end of
+// the outermost one, see penguin_prefetch_coalesce
+struct penguin_prefetch_coalescer {
+    unsigned depth = 0;
+    bool by_size = false;
+    std::vector<penguin_policy_prefetch> queued;
+};
+thread_local penguin_prefetch_coalescer prefetch_coalescer;
+
+void penguin_prefetch_coalesce(std::vector<penguin_policy_prefetch>& prefetches, bool by_size);
+void penguin_prefetch_coalesce_flush();
+
+bool penguin_policy_batching() {
+    return policy_batch.depth > 0;
+}
+
+penguin_policy_batch_entry& penguin_policy_queue(unsigned op, void *base, size_t length) {
+    penguin_policy_batch_entry entry = {};
+    entry.op = op;
+    entry.base = base;
+    entry.length = length;
+    policy_batch.entries.push_back(entry);
+    return policy_batch.entries.back();
+}
+
+// Registers size bytes at ring, page aligned host memory, as the submit ring
+// of the driver; a NULL ring unregisters it once the driver is done with it.
+// The driver initialises the header.
+extern "C"
+penguin_error_t penguinRegisterSubmitRing(void *ring, size_t size) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_submit_ring_ioctl_params request;
+    int status;
+
+    request.ring = ring;
+    request.size = size;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_SUBMIT_RING_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Policy batches go to the driver through a submit ring rather than
+// UVM_SET_POLICY_BATCH and UVM_MIGRATE_BATCH: penguin_policy_flush posts
+// their policies and prefetches as commands and returns, a driver worker
+// applies them in order, and their completions are reaped at the next flush
+// or before the next ioctl, which waits for the ring to drain. A failed
+// policy is reported then, and a prefetch the driver didn't migrate goes
+// through CUDA as in the batch path. PENGUIN_SUBMIT_RING=0, or a driver
+// without the ring, keeps the batch ioctls.
+struct penguin_submit_pending {
+    bool migrate;
+    penguin_policy_batch_entry policy;
+    penguin_policy_prefetch prefetch;
+};
+penguin_submit_ring_header* submit_ring = NULL;
+penguin_submit_command* submit_commands = NULL;
+penguin_submit_completion* submit_completions = NULL;
+bool submit_ring_failed = false;
+unsigned long long submit_seq = 0;
+// posted commands without a completion reaped yet, in ring order
+std::deque<penguin_submit_pending> submit_pending;
+
+bool penguin_submit_ring_setup() {
+    if(submit_ring != NULL || submit_ring_failed) {
+        return submit_ring != NULL;
+    }
+    const char* env = getenv("PENGUIN_SUBMIT_RING");
+    // a replayed decision log sends its policies as batch ioctls
+    if(PENGUIN_SUBMIT_RING_ENTRIES == 0 || (env != NULL && strcmp(env, "0") == 0) ||
+            penguin_decision_log_replaying()) {
+        submit_ring_failed = true;
+        return false;
+    }
+    size_t size = sizeof(penguin_submit_ring_header) + PENGUIN_SUBMIT_RING_ENTRIES *
+        (sizeof(penguin_submit_command) + sizeof(penguin_submit_completion));
+    void* ring = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(ring == MAP_FAILED) {
+        submit_ring_failed = true;
+        return false;
+    }
+    if(penguinRegisterSubmitRing(ring, size) != PENGUIN_OK) {
+        munmap(ring, size);
+        submit_ring_failed = true;
+        return false;
+    }
+    submit_ring = (penguin_submit_ring_header*)ring;
+    submit_commands = (penguin_submit_command*)(submit_ring + 1);
+    submit_completions = (penguin_submit_completion*)(submit_commands + submit_ring->entries);
+    return true;
+}
+
+// Starts the driver's worker if it stopped. The fence pairs with the one the
+// worker has between setting the flag and looking at the ring again, so one
+// of the two sees the other's update.
+void penguin_submit_ring_kick() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&submit_ring->flags, __ATOMIC_RELAXED) & PENGUIN_SUBMIT_RING_NEED_WAKEUP) {
+        // not through penguin_ioctl, which would wait for the ring
+        penguin_kick_submit_ring_ioctl_params request;
+        ioctl(nvidia_uvm_fd, PENGUIN_KICK_SUBMIT_RING_IOCTL_NUM, &request);
+    }
+}
+
+void penguin_submit_ring_reap() {
+    unsigned mask = submit_ring->entries - 1;
+    unsigned put = __atomic_load_n(&submit_ring->cq_put, __ATOMIC_ACQUIRE);
+    unsigned get = submit_ring->cq_get;
+    for(; get != put && !submit_pending.empty(); get++) {
+        int status = submit_completions[get & mask].status;
+        penguin_submit_pending pending = submit_pending.front();
+        submit_pending.pop_front();
+        if(status == 0) {
+            continue;
+        }
+        if(pending.migrate) {
+            penguin_policy_prefetch &p = pending.prefetch;
+            penguin_mem_prefetch((char*) p.base, p.length, p.device, p.stream);
+        } else {
+            fprintf(stderr, "policy %u of %p (%zu bytes): error %d\n", pending.policy.op,
+                    pending.policy.base, pending.policy.length, status);
+        }
+    }
+    // hand the slots back to the driver
+    __atomic_store_n(&submit_ring->cq_get, get, __ATOMIC_RELEASE);
+}
+
+void penguin_submit_ring_post(penguin_submit_command& command, const penguin_submit_pending& pending) {
+    // taking a command needs room for its completion, so at most entries are
+    // in flight
+    while(submit_pending.size() >= submit_ring->entries) {
+        penguin_submit_ring_reap();
+        penguin_submit_ring_kick();
+        sched_yield();
+    }
+    if(command.op == PENGUIN_SUBMIT_POLICY) {
+        penguin_decision_log_take(PENGUIN_LOG_POLICY, command.policy.base, command.policy.length, 0,
+                0, &command.policy, sizeof(command.policy));
+    } else {
+        penguin_decision_log_take(PENGUIN_LOG_MIGRATE, command.migrate.base, command.migrate.length,
+                0, command.flags, &command.migrate, sizeof(command.migrate));
+    }
+    unsigned put = submit_ring->sq_put;
+    command.user_data = submit_seq++;
+    submit_commands[put & (submit_ring->entries - 1)] = command;
+    __atomic_store_n(&submit_ring->sq_put, put + 1, __ATOMIC_RELEASE);
+    submit_pending.push_back(pending);
+}
+
+static void penguin_submit_ring_quiesce() {
+    if(submit_ring == NULL) {
+        return;
+    }
+    penguin_registry_scope scope;
+    penguin_submit_ring_reap();
+    while(!submit_pending.empty()) {
+        penguin_submit_ring_kick();
+        sched_yield();
+        penguin_submit_ring_reap();
+    }
+}
+
+// The policies, then the prefetches, the moves to the host first
+void penguin_policy_submit(std::vector<penguin_policy_batch_entry>& entries,
+        std::vector<penguin_policy_prefetch>& prefetches) {
+    penguin_submit_ring_reap();
+    for(auto &entry : entries) {
+        penguin_submit_command command = {};
+        penguin_submit_pending pending = {};
+        command.op = PENGUIN_SUBMIT_POLICY;
+        command.policy = entry;
+        pending.policy = entry;
+        penguin_submit_ring_post(command, pending);
+    }
+    for(int host = 1; host >= 0; host--) {
+        for(auto &p : prefetches) {
+            if((p.device == cudaCpuDeviceId) != (bool) host) {
+                continue;
+            }
+            if(!penguin_migrate_batch_enabled()) {
+                penguin_mem_prefetch((char*) p.base, p.length, p.device, p.stream);
+                continue;
+            }
+            penguin_submit_command command = {};
+            penguin_submit_pending pending = {};
+            command.op = PENGUIN_SUBMIT_MIGRATE;
+            command.flags = PENGUIN_MIGRATE_ASYNC;
+            command.migrate.base = p.base;
+            command.migrate.length = p.length;
+            memcpy(command.migrate.uuid, host ? penguin_cpu_uuid : penguin_gpu_uuid(p.device),
+                    sizeof(command.migrate.uuid));
+            pending.migrate = true;
+            pending.prefetch = p;
+            penguin_submit_ring_post(command, pending);
+        }
+    }
+    penguin_submit_ring_kick();
+}
+
+penguin_error_t penguin_policy_flush() {
+    penguin_error_t ret = PENGUIN_OK;
+    std::vector<penguin_policy_batch_entry> entries;
+    entries.swap(policy_batch.entries);
+    penguin_prefetch_coalesce(policy_batch.prefetches, true);
+    if((!entries.empty() || !policy_batch.prefetches.empty()) && penguin_submit_ring_setup()) {
+        std::vector<penguin_policy_prefetch> prefetches;
+        prefetches.swap(policy_batch.prefetches);
+        penguin_policy_submit(entries, prefetches);
+        return PENGUIN_OK;
+    }
+    size_t next = 0;
+    if (!entries.empty() && penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        next = entries.size();
+        ret = PENGUIN_ERR_PATH;
+    }
+    while (next < entries.size()) {
+        penguin_policy_batch_ioctl_params request;
+        int status;
+        request.entries = &entries[next];
+        request.count = std::min(entries.size() - next, (size_t) PENGUIN_POLICY_BATCH_MAX_ENTRIES);
+        request.applied = 0;
+        if ((status = penguin_ioctl(PENGUIN_POLICY_BATCH_IOCTL_NUM, &request)) != 0)
+        {
+            fprintf(stderr, "error: %d\n", status);
+            ret = PENGUIN_ERR_IOCTL;
+            break;
+        }
+        next += request.applied;
+        if (request.status != 0) {
+            // the driver stops at a failed entry; the others still apply, as
+            // they would have one call at a time
+            penguin_policy_batch_entry &failed = entries[next];
+            fprintf(stderr, "policy %u of %p (%zu bytes): error %d\n", failed.op, failed.base,
+                    failed.length, failed.status);
+            ret = PENGUIN_ERR_IOCTL;
+            next++;
+        }
+    }
+    std::vector<penguin_policy_prefetch> prefetches;
+    prefetches.swap(policy_batch.prefetches);
+    std::vector<char> migrated(prefetches.size(), 0);
+    for (size_t first = 0; penguin_migrate_batch_enabled() && first < prefetches.size();
+            first += PENGUIN_MIGRATE_BATCH_MAX_ENTRIES) {
+        size_t count = std::min(prefetches.size() - first, (size_t) PENGUIN_MIGRATE_BATCH_MAX_ENTRIES);
+        std::vector<penguin_migrate_batch_entry> batch(count);
+        for (size_t i = 0; i < count; i++) {
+            penguin_policy_prefetch &p = prefetches[first + i];
+            batch[i].base = p.base;
+            batch[i].length = p.length;
+            bool host = p.device == cudaCpuDeviceId;
+            memcpy(batch[i].uuid, host ? penguin_cpu_uuid : penguin_gpu_uuid(p.device), sizeof(batch[i].uuid));
+            batch[i].priority = host ? 1 : 0;
+            batch[i].status = -1;
+        }
+        if (penguinMigrateBatch(batch.data(), count, PENGUIN_MIGRATE_ASYNC) != PENGUIN_OK) {
+            // a driver without the ioctl; the entries it did migrate are done
+            migrate_batch_enabled = 0;
+        }
+        for (size_t i = 0; i < count; i++) {
+            migrated[first + i] = batch[i].status == 0;
+        }
+    }
+    // what the driver didn't migrate, pageable memory say, goes through CUDA
+    for (size_t i = 0; i < prefetches.size(); i++) {
+        penguin_policy_prefetch &p = prefetches[i];
+        if (!migrated[i]) {
+            penguin_mem_prefetch((char*) p.base, p.length, p.device, p.stream);
+        }
+    }
+    return ret;
+}
+
+extern "C"
+void penguinPolicyBatchBegin() {
+    PENGUIN_LOCKED_ENTRY();
+    policy_batch.depth++;
+}
+
+// Applies the queued policies once the outermost batch ends
+extern "C"
+penguin_error_t penguinPolicyBatchEnd() {
+    PENGUIN_LOCKED_ENTRY();
+    if (policy_batch.depth == 0 || --policy_batch.depth > 0) {
+        return PENGUIN_OK;
+    }
+    return penguin_policy_flush();
+}
+
+// Ends the prioritized location and the no-migrate flag of [base, base +
+// length) in the driver once epochs more launches have started, when the
+// driver puts its chunks back on the LRU lists by itself; 0 keeps them until
+// they are changed. Setting them again leaves the lease as it is.
+bool pin_lease_sent = false;
+
+extern "C"
+penguin_error_t penguinSetLease(void *base, size_t length, unsigned epochs) {
+    PENGUIN_LOCKED_ENTRY();
+    penguinPolicyBatchBegin();
+    penguin_policy_queue(PENGUIN_POLICY_LEASE, base, length).value = epochs;
+    pin_lease_sent = true;
+    return penguinPolicyBatchEnd();
+}
+
+// Has the driver allocate the CPU pages of [base, base + length) on NUMA node
+// node from then on, or on the node of the process for a negative one (see
+// penguinSetHostNumaNode). Pages already on the host are not moved.
+extern "C"
+penguin_error_t penguinSetHostNode(void *base, size_t length, int node) {
+    PENGUIN_LOCKED_ENTRY();
+    penguinPolicyBatchBegin();
+    penguin_policy_queue(PENGUIN_POLICY_HOST_NODE, base, length).value = node < 0 ? 0 : node + 1;
+    return penguinPolicyBatchEnd();
+}
+
+// With PENGUIN_PIN_LEASE=n the ranges the runtime pins on a GPU or keeps from
+// migrating hold the pin for n launches, so an allocation pinned for an early
+// phase doesn't keep its memory through the later ones; a pin the plan still
+// wants is set again, with a new lease, before it runs out. Unset or 0 keeps
+// pins until the runtime undoes them.
+long long pin_lease = -1;
+
+void penguin_lease_pin(void *base, size_t length) {
+    if(pin_lease < 0) {
+        const char* env = getenv("PENGUIN_PIN_LEASE");
+        pin_lease = env == NULL ? 0 : strtoull(env, NULL, 10);
+    }
+    if(pin_lease > 0) {
+        penguinSetLease(base, length, (unsigned) pin_lease);
+    }
+}
+
+// Time the planners took, policy ioctls included; reported by
+// penguinStopStatCollection as the runtime overhead
+unsigned long long runtime_overhead_ns = 0;
+
+// Batches the policies set in a scope
+struct penguin_policy_batch_scope {
+    std::chrono::steady_clock::time_point start;
+    penguin_policy_batch_scope() : start(std::chrono::steady_clock::now()) { penguinPolicyBatchBegin(); }
+    ~penguin_policy_batch_scope() {
+        bool outermost = policy_batch.depth == 1;
+        penguinPolicyBatchEnd();
+        if(outermost) {
+            runtime_overhead_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+    }
+};
+
+// Stream of the launch being planned, set by the host transform right before
+// perform_memory_management; 0 for the launches it doesn't see
+thread_local cudaStream_t launch_stream = 0;
+// the stream itself, which tells when the launch is done
+thread_local cudaStream_t launch_kernel_stream = 0;
+
+// Shape of the launch being planned, from penguinRecordLaunchShape; blocks 0
+// if the host transform didn't see it
+typedef struct
+{
+    unsigned long long blocks;
+    unsigned long long resident_blocks; // blocks the device runs at once
+    unsigned long long first_block;     // blocks launched before it
+    unsigned grid[3];
+    unsigned block[3];
+    const void* func;
+    // blockIdx offset the launch is rotated by, see penguin_block_order, 0
+    // for blockIdx order
+    unsigned long long order_offset;
+    unsigned long long order_wave;      // wave the rotated launch starts at
+    unsigned long long order_next_wave; // first wave not prefetched yet
+} penguin_launch_shape_t;
+thread_local penguin_launch_shape_t launch_shape = {};
+// blocks of the launches seen so far, which the device counts as they start
+unsigned long long progress_blocks_issued = 0;
+// launches penguinSetLaunchStream saw
+unsigned long long launch_epoch = 0;
+
+extern "C"
+void penguinSetLaunchStream(cudaStream_t stream) {
+    PENGUIN_LOCKED_ENTRY();
+    launch_stream = PENGUIN_STREAM_SCOPES ? stream : 0;
+    launch_kernel_stream = stream;
+    launch_shape = penguin_launch_shape_t{};
+    launch_epoch++;
+}
+
+// blocks of a kernel an SM runs at once, per kernel, block size and shared
+// memory
+std::map<std::pair<const void*, std::pair<unsigned, size_t>>, int> penguin_occupancy_cache;
+
+// Grid and block come packed as __cudaPushCallConfiguration takes them, x in
+// the low 32 bits of the first word
+extern "C"
+void penguinRecordLaunchShape(const void* func, unsigned long long grid_xy, unsigned grid_z,
+        unsigned long long block_xy, unsigned block_z, unsigned long long shmem) {
+    PENGUIN_LOCKED_ENTRY();
+    unsigned long long blocks = std::max(grid_xy & 0xffffffffULL, 1ULL) *
+        std::max(grid_xy >> 32, 1ULL) * std::max(grid_z, 1U);
+    unsigned threads = std::max(block_xy & 0xffffffffULL, 1ULL) *
+        std::max(block_xy >> 32, 1ULL) * std::max(block_z, 1U);
+    launch_shape.blocks = blocks;
+    launch_shape.resident_blocks = blocks;
+    launch_shape.first_block = progress_blocks_issued;
+    launch_shape.grid[0] = grid_xy & 0xffffffffULL;
+    launch_shape.grid[1] = grid_xy >> 32;
+    launch_shape.grid[2] = grid_z;
+    launch_shape.block[0] = block_xy & 0xffffffffULL;
+    launch_shape.block[1] = block_xy >> 32;
+    launch_shape.block[2] = block_z;
+    launch_shape.func = func;
+    progress_blocks_issued += blocks;
+    auto key = std::make_pair(func, std::make_pair(threads, (size_t) shmem));
+    auto o = penguin_occupancy_cache.find(key);
+    if (o == penguin_occupancy_cache.end()) {
+        int per_sm = 0;
+        if (cudaOccupancyMaxActiveBlocksPerMultiprocessor(&per_sm, func, threads, shmem) != cudaSuccess) {
+            per_sm = 0;
+        }
+        o = penguin_occupancy_cache.insert(std::make_pair(key, per_sm)).first;
+    }
+    static int sms[PENGUIN_MAX_DEVICES] = {};
+    int device = penguin_launch_device();
+    if (sms[device] == 0 &&
+            cudaDeviceGetAttribute(&sms[device], cudaDevAttrMultiProcessorCount, device) != cudaSuccess) {
+        sms[device] = 0;
+    }
+    if (o->second > 0 && sms[device] > 0) {
+        launch_shape.resident_blocks = std::min(blocks, (unsigned long long) o->second * sms[device]);
+    }
+}
+
+// Waves of thread blocks the launch runs in; blocks are scheduled in about
+// linear blockIdx order, one wave after the other
+unsigned long long penguin_launch_waves() {
+    if (launch_shape.resident_blocks == 0) {
+        return 1;
+    }
+    return (launch_shape.blocks + launch_shape.resident_blocks - 1) / launch_shape.resident_blocks;
+}
+
+// Moves a range just prioritized on device there, after the policy if it is
+// still queued. The move goes on the stream of the launch, ahead of its kernel
+// and beside those of the other streams.
+void penguin_prefetch_pinned(void *base, size_t length, int device = 0) {
+    if (penguin_policy_batching()) {
+        policy_batch.prefetches.push_back(penguin_policy_prefetch{base, length, device, launch_stream});
+        return;
+    }
+    penguin_mem_prefetch((char*) base, length, device, launch_stream);
+}
+
+// Same for a range just pinned on the host
+void penguin_prefetch_host(void *base, size_t length) {
+    penguin_prefetch_pinned(base, length, cudaCpuDeviceId);
+}
+
+static penguin_error_t penguin_prioritize(void *base, size_t length,
+        const uint8_t *uuid, unsigned priority) {
+
+    penguin_prioritized_ioctl_params request;
+    int status;
+
+
+    /* std::cout << "set prioritized location " << base << std::endl; */
+
+    if (penguin_policy_batching()) {
+        penguin_policy_batch_entry &entry = penguin_policy_queue(PENGUIN_POLICY_PRIORITIZED_LOCATION, base, length);
+        memcpy(entry.uuid, uuid, sizeof(entry.uuid));
+        entry.value = priority;
+        if (uuid != penguin_cpu_uuid)
+            penguin_lease_pin(base, length);
+        return PENGUIN_OK;
+    }
+
+    memcpy(request.uuid, uuid, sizeof(request.uuid));
+
+    request.base = base;
+    request.length = length;
+    request.priority = priority;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_PRIORITIZED_GPU_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    if (uuid != penguin_cpu_uuid)
+        penguin_lease_pin(base, length);
+    return PENGUIN_OK;
+}
+
+// Prioritizes the range on device proc_id at an eviction level: 1 is evicted
+// first, PENGUIN_PRIORITY_LEVELS last, and only once nothing unprioritized is
+// left. 0 is the highest level.
+extern "C"
+penguin_error_t penguinSetPrioritizedLocationLevel(void *base, size_t length,
+        unsigned proc_id, unsigned priority) {
+    PENGUIN_LOCKED_ENTRY();
+    if (proc_id >= (unsigned) penguin_num_devices())
+        proc_id = 0;
+    return penguin_prioritize(base, length, penguin_gpu_uuid(proc_id), priority);
+}
+
+extern "C"
+penguin_error_t penguinSetPrioritizedLocation(void *base, size_t length,
+        unsigned proc_id) {
+    PENGUIN_LOCKED_ENTRY();
+    return penguinSetPrioritizedLocationLevel(base, length, proc_id, 0);
+}
+
+// Prioritizes the range on the CPU, which takes its GPU chunks off the
+// prioritized lists: they are evicted like unprioritized ones again
+extern "C"
+penguin_error_t penguinUnsetPrioritizedLocation(void *base, size_t length) {
+    PENGUIN_LOCKED_ENTRY();
+    return penguin_prioritize(base, length, penguin_cpu_uuid, 0);
+}
+
+// Level of the rank-th of count allocations, highest first
+unsigned penguin_priority_for_rank(size_t rank, size_t count) {
+    return PENGUIN_PRIORITY_LEVELS - (unsigned) (rank * PENGUIN_PRIORITY_LEVELS / count);
+}
+
+extern "C"
+penguin_error_t penguinSetQuickMigrate(void *base, size_t length,
+        bool quick_migrate) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_quick_migrate_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_queue(PENGUIN_POLICY_QUICK_MIGRATE, base, length).value = quick_migrate;
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.quick_migrate = quick_migrate;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_QUICK_MIGRATE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        fprintf(stderr, "debuggy\n");
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+extern "C"
+penguin_error_t penguinSetNoMigrateRegion(void *base, size_t length,
+        unsigned proc_id, bool setNoMigrate) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_ignore_notif_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_queue(PENGUIN_POLICY_NO_MIGRATE, base, length).value = setNoMigrate;
+        if (setNoMigrate)
+            penguin_lease_pin(base, length);
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.ignore_notifications = setNoMigrate;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_NO_MIGRATE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    if (setNoMigrate)
+        penguin_lease_pin(base, length);
+    return PENGUIN_OK;
+}
+
+// Seeds the driver's cross-block stride prefetcher of [base, base + length)
+// with the bytes an access moves by per loop iteration; 0 clears it
+extern "C"
+penguin_error_t penguinSetPrefetchStride(void *base, size_t length,
+        long long stride) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_prefetch_stride_ioctl_params request;
+    int status;
+
+    request.base = base;
+    request.length = length;
+    request.stride = stride;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_PREFETCH_STRIDE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Attaches an access descriptor to [base, base + length): the pattern, the
+// bytes an access moves by per loop iteration, the bytes an iteration touches
+// and PENGUIN_ACCESS_* flags. The driver's prefetcher, thrashing detection and
+// access counter migrations follow it.
+extern "C"
+penguin_error_t penguinSetAccessPattern(void *base, size_t length,
+        penguin_access_pattern_t pattern, long long stride,
+        unsigned long long span, unsigned flags) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_access_pattern_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_batch_entry &entry = penguin_policy_queue(PENGUIN_POLICY_ACCESS_PATTERN, base, length);
+        entry.stride = stride;
+        entry.span = span;
+        entry.value = pattern;
+        entry.flags = flags;
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.stride = stride;
+    request.span = span;
+    request.pattern = pattern;
+    request.flags = flags;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_ACCESS_PATTERN_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Declares the contents of [base, base + length) dead, or live again: the
+// driver drops its pages on eviction instead of copying them back, so they
+// read back stale. Only for data no kernel or host code reads again before
+// writing it.
+extern "C"
+penguin_error_t penguinSetDiscardable(void *base, size_t length, bool discardable) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_discardable_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_queue(PENGUIN_POLICY_DISCARDABLE, base, length).value = discardable;
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.discardable = discardable;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_DISCARDABLE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Host memory of [base, base + length) the driver has yet to allocate comes in
+// one physically contiguous 2MB run per block, so GPUs that map the range
+// remotely use 2MB PTEs instead of 4KB ones. Best effort: blocks fall back to
+// 4KB pages when the host has no free run; memory already resident stays as
+// it is.
+extern "C"
+penguin_error_t penguinSetHostHugePages(void *base, size_t length, bool host_huge_pages) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_host_huge_pages_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_queue(PENGUIN_POLICY_HOST_HUGE_PAGES, base, length).value = host_huge_pages;
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.host_huge_pages = host_huge_pages;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_HOST_HUGE_PAGES_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Access counter migrations of [base, base + length): a block migrates once
+// threshold accesses to it have been counted (0 for the GPU's threshold,
+// PENGUIN_AC_NEVER to keep it where it is, PENGUIN_AC_SAMPLE to keep it there
+// and report the notifications in the event ring), along with the aligned
+// granularity bytes around each counted page (0 for the counted pages only,
+// at most 16MB, see penguin_ac_granularity_for).
+// Has no effect until penguinEnableAccessCounters.
+extern "C"
+penguin_error_t penguinSetAccessCounterPolicy(void *base, size_t length,
+        unsigned threshold, unsigned long long granularity) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_access_counter_policy_ioctl_params request;
+    int status;
+
+    if (penguin_policy_batching()) {
+        penguin_policy_batch_entry &entry = penguin_policy_queue(PENGUIN_POLICY_ACCESS_COUNTERS, base, length);
+        entry.value = threshold;
+        entry.span = granularity;
+        return PENGUIN_OK;
+    }
+
+    request.base = base;
+    request.length = length;
+    request.granularity = granularity;
+    request.threshold = threshold;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_ACCESS_COUNTER_POLICY_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Pops up to *count thrashing reports of the driver into events. *count is
+// set to the reports returned and *dropped, if not NULL, to those the driver
+// had no room for since the previous call.
+extern "C"
+penguin_error_t penguinGetThrashingEvents(penguin_thrashing_event *events,
+        unsigned *count, unsigned *dropped) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_thrashing_events_ioctl_params request;
+    int status;
+
+    request.events = events;
+    request.count = *count;
+    *count = 0;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_THRASHING_EVENTS_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    *count = request.count;
+    if (dropped != NULL) {
+        *dropped = request.dropped;
+    }
+    return PENGUIN_OK;
+}
+
+// Registers size bytes at ring, ordinary host memory, as the event ring of
+// the driver; a NULL ring unregisters it. The driver initialises the header.
+extern "C"
+penguin_error_t penguinRegisterEventRing(void *ring, size_t size) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_event_ring_ioctl_params request;
+    int status;
+
+    request.ring = ring;
+    request.size = size;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_EVENT_RING_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Fills the bitmap of each of the count ranges with the pieces of
+// granularity bytes (64K or 2MB) that are resident on each of the first
+// processors, see penguin_residency_range. Takes the driver's VA space lock
+// for reading only.
+extern "C"
+penguin_error_t penguinGetResidency(penguin_residency_range *ranges, unsigned count,
+        unsigned long long granularity, unsigned processors) {
+    PENGUIN_ENTRY();
+
+    penguin_residency_ioctl_params request;
+    int status;
+
+    request.ranges = ranges;
+    request.granularity = granularity;
+    request.count = count;
+    request.processors = processors;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_RESIDENCY_IOCTL_NUM, &request)) != 0 ||
+            (status = request.status) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Event ring registered with the driver, mapped at the first drain; NULL if
+// there is none
+penguin_event_ring_header* event_ring = NULL;
+bool event_ring_failed = false;
+
+extern "C"
+penguin_error_t penguinPinHost(void *base, size_t length) {
+    PENGUIN_LOCKED_ENTRY();
+
+    penguin_pin_host_params request;
+    int status;
+
+    request.base = base;
+    /* request.length = length; */
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_IS_ALLOCATED, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    if(request.is_allocated) {
+    std::cout << "is alloocated\n";
+    } else {
+    std::cout << "not alloocated\n";
+    }
+    return PENGUIN_OK;
+}
+
+// PCIe telemetry. nvml_monitor samples TX and RX together every
+// telemetry_period_us using a timed sleep, along with the energy the devices
+// used, their SM and memory clocks and their utilization. The samples, the
+// kernel launches and the prefetches of the runtime all go into one lock-free
+// ring buffer, which penguinStopStatCollection dumps to PENGUIN_TRACE_FILE.
+#define PENGUIN_TELEMETRY_PERIOD_US 1000
+#define PENGUIN_TRACE_ENTRIES (1 << 16)
+#define PENGUIN_TRACE_FILE "penguin_trace.csv"
+
+enum penguin_trace_type {
+    PENGUIN_TRACE_PCIE,         // a = TX KB/s, b = RX KB/s
+    PENGUIN_TRACE_LAUNCH,       // a = invocation id
+    PENGUIN_TRACE_ITERATION,    // a = loop iteration
+    PENGUIN_TRACE_PREFETCH_H2D, // a = address, b = length
+    PENGUIN_TRACE_PREFETCH_D2H, // a = address, b = length
+    PENGUIN_TRACE_FREE,         // a = address, b = GPU bytes given back
+    PENGUIN_TRACE_ENERGY,       // a = mJ since the monitor started, b = GPU utilization %
+    PENGUIN_TRACE_CLOCK,        // a = SM MHz, b = memory MHz
+    PENGUIN_TRACE_MAX
+};
+
+const char* penguin_trace_name[PENGUIN_TRACE_MAX] = {"pcie", "launch", "iteration", "h2d", "d2h", "free",
+    "energy", "clock"};
+
+typedef struct
+{
+    std::atomic<unsigned long long> seq; // slot + 1 once the entry is complete
+    unsigned long long time_ns;
+    unsigned type;
+    unsigned long long a;
+    unsigned long long b;
+} penguin_trace_entry;
+
+penguin_trace_entry trace_ring[PENGUIN_TRACE_ENTRIES];
+std::atomic<unsigned long long> trace_head(0);
+// invocation id of the launch last planned
+#define PENGUIN_NO_INVOCATION 0xffffffffU
+unsigned launch_invocation = PENGUIN_NO_INVOCATION;
+unsigned telemetry_period_us = PENGUIN_TELEMETRY_PERIOD_US;
+// totals of the last nvml_monitor, kept after it stops for the metrics: PCIe
+// KB, energy in mJ, and the sums of the clocks and the utilization over
+// telemetry_samples
+std::atomic<unsigned long long> telemetry_tx_kb(0);
+std::atomic<unsigned long long> telemetry_rx_kb(0);
+std::atomic<unsigned long long> telemetry_energy_mj(0);
+std::atomic<unsigned long long> telemetry_sm_mhz(0);
+std::atomic<unsigned long long> telemetry_mem_mhz(0);
+std::atomic<unsigned long long> telemetry_util(0);
+std::atomic<unsigned long long> telemetry_samples(0);
+
+typedef struct
+{
+    unsigned long long tx_kb;
+    unsigned long long rx_kb;
+    unsigned long long energy_mj;
+    unsigned long long sm_mhz;
+    unsigned long long mem_mhz;
+    unsigned long long util;
+    unsigned long long samples;
+} penguin_telemetry_totals;
+
+penguin_telemetry_totals penguin_telemetry_now() {
+    penguin_telemetry_totals t;
+    t.tx_kb = telemetry_tx_kb.load(std::memory_order_relaxed);
+    t.rx_kb = telemetry_rx_kb.load(std::memory_order_relaxed);
+    t.energy_mj = telemetry_energy_mj.load(std::memory_order_relaxed);
+    t.sm_mhz = telemetry_sm_mhz.load(std::memory_order_relaxed);
+    t.mem_mhz = telemetry_mem_mhz.load(std::memory_order_relaxed);
+    t.util = telemetry_util.load(std::memory_order_relaxed);
+    t.samples = telemetry_samples.load(std::memory_order_relaxed);
+    return t;
+}
+
+// Energy per phase of the collection (PENGUIN_PHASE_WINDOW): the signature
+// of every phase that ended and the mJ it took, then the one running since
+// phase_energy_start
+std::vector<std::pair<unsigned long long, unsigned long long>> phase_energy;
+unsigned long long phase_energy_signature = 0;
+unsigned long long phase_energy_start = 0;
+bool phase_energy_started = false;
+
+void penguin_phase_energy_next(unsigned long long signature) {
+    unsigned long long now = telemetry_energy_mj.load(std::memory_order_relaxed);
+    if(phase_energy_started) {
+        phase_energy.push_back(std::make_pair(phase_energy_signature,
+                    now > phase_energy_start ? now - phase_energy_start : 0));
+    }
+    phase_energy_started = true;
+    phase_energy_signature = signature;
+    phase_energy_start = now;
+}
+
+unsigned long long penguin_trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void penguin_heatmap_begin(unsigned invid, unsigned long long time_ns);
+
+void penguin_trace(unsigned type, unsigned long long a, unsigned long long b) {
+    auto slot = trace_head.fetch_add(1, std::memory_order_relaxed);
+    penguin_trace_entry &e = trace_ring[slot % PENGUIN_TRACE_ENTRIES];
+    e.seq.store(0, std::memory_order_relaxed);
+    e.time_ns = penguin_trace_now();
+    e.type = type;
+    e.a = a;
+    e.b = b;
+    e.seq.store(slot + 1, std::memory_order_release);
+    if(type == PENGUIN_TRACE_PREFETCH_H2D || type == PENGUIN_TRACE_PREFETCH_D2H) {
+        PENGUIN_NVTX_MARK(type == PENGUIN_TRACE_PREFETCH_H2D ? PENGUIN_NVTX_H2D : PENGUIN_NVTX_D2H,
+                "%s 0x%llx %llu", penguin_trace_name[type], a, b);
+    }
+    switch(type) {
+        case PENGUIN_TRACE_LAUNCH:
+            launch_invocation = a;
+            penguin_sim_record(PENGUIN_SIM_LAUNCH, a, e.time_ns, 0);
+            penguin_heatmap_begin(a, e.time_ns);
+            break;
+        case PENGUIN_TRACE_PREFETCH_H2D:
+            penguin_sim_record(PENGUIN_SIM_H2D, 0, a, b);
+            break;
+        case PENGUIN_TRACE_PREFETCH_D2H:
+            penguin_sim_record(PENGUIN_SIM_D2H, 0, a, b);
+            break;
+        case PENGUIN_TRACE_FREE:
+            penguin_sim_record(PENGUIN_SIM_FREE, 0, a, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+extern "C"
+void penguinSetTelemetryPeriod(unsigned us) {
+    PENGUIN_LOCKED_ENTRY();
+    if(us > 0) {
+        telemetry_period_us = us;
+    }
+}
+
+// Writes the last PENGUIN_TRACE_ENTRIES entries as CSV. Entries that are
+// being overwritten while the dump runs are skipped.
+extern "C"
+void penguinDumpTrace() {
+    PENGUIN_ENTRY();
+    auto head = trace_head.load(std::memory_order_acquire);
+    if(head == 0) {
+        return;
+    }
+    FILE* f = fopen(PENGUIN_TRACE_FILE, "w");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", PENGUIN_TRACE_FILE);
+        return;
+    }
+    fprintf(f, "time_us,event,a,b\n");
+    auto slot = head > PENGUIN_TRACE_ENTRIES ? head - PENGUIN_TRACE_ENTRIES : 0;
+    unsigned long long t0 = 0;
+    for(; slot < head; slot++) {
+        penguin_trace_entry &e = trace_ring[slot % PENGUIN_TRACE_ENTRIES];
+        if(e.seq.load(std::memory_order_acquire) != slot + 1) {
+            continue;
+        }
+        auto time_ns = e.time_ns;
+        auto type = e.type;
+        auto a = e.a;
+        auto b = e.b;
+        if(e.seq.load(std::memory_order_acquire) != slot + 1 || type >= PENGUIN_TRACE_MAX) {
+            continue;
+        }
+        if(t0 == 0) {
+            t0 = time_ns;
+        }
+        fprintf(f, "%llu,%s,%llu,%llu\n", (time_ns - t0) / 1000, penguin_trace_name[type], a, b);
+    }
+    fclose(f);
+}
+
+bool ac_enabled = false;
+
+// UVM_ACCESS_COUNTER_GRANULARITY of PENGUIN_AC_GRANULARITY=64k|2m|16m|16g,
+// 64k when it isn't set or tuned
+unsigned penguin_ac_granularity() {
+    return penguin_tune().ac_granularity;
+}
+
+// Bytes an allocation's access counters migrate at, see
+// penguin_ac_granularity_for
+#ifndef PENGUIN_AC_DENSE_MIN_MB
+#define PENGUIN_AC_DENSE_MIN_MB 64  // smaller ones migrate the counted pages only
+#endif
+#ifndef PENGUIN_AC_HUGE_MIN_MB
+#define PENGUIN_AC_HUGE_MIN_MB 1024 // larger dense ones migrate 16MB at a time
+#endif
+
+int ac_range_granularity_enabled = -1;
+
+bool penguin_ac_range_granularity_enabled() {
+    if(ac_range_granularity_enabled < 0) {
+        const char* env = getenv("PENGUIN_AC_RANGE_GRANULARITY");
+        ac_range_granularity_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return ac_range_granularity_enabled;
+}
+
+// Granularity of the access counter policy of an allocation, from its size
+// and the pattern predicted for it. The GPU tracks at one granularity for all
+// of them; what differs per range is how much migrates with a notification.
+// A small or sparse allocation moves the counted pages only, so that a few
+// hot ones keep their precision; a dense one moves its 2MB blocks, and a huge
+// dense one 16MB regions, which settle it on the GPU in a few notifications
+// instead of flooding the counter buffer a 64K region at a time. 0, the
+// counted pages, with PENGUIN_AC_RANGE_GRANULARITY=0. An override's
+// ac_granularity goes over all of it.
+unsigned long long penguin_ac_granularity_for(const penguin_alloc_desc& desc) {
+    const penguin_override* o = penguin_override_of(desc, PENGUIN_OVERRIDE_AC_GRANULARITY);
+    if(o != NULL) {
+        return o->ac_granularity;
+    }
+    if(!penguin_ac_range_granularity_enabled() || desc.size < PENGUIN_AC_DENSE_MIN_MB * 1024ULL*1024ULL) {
+        return 0;
+    }
+    // declared irregular, or a launch covers little of it
+    bool sparse = (desc.hint & PENGUIN_HINT_PATTERN) == PENGUIN_HINT_IRREGULAR ||
+        (desc.wss != 0 && desc.wss * 4 < desc.size);
+    if(sparse) {
+        return 0;
+    }
+    return desc.size >= PENGUIN_AC_HUGE_MIN_MB * 1024ULL*1024ULL ? 16 * 1024ULL*1024ULL : 2 * 1024ULL*1024ULL;
+}
+
+// What MOMC notifications, of remote accesses to a GPU's memory, do:
+// PENGUIN_AC_MOMC=0 ignores them, cpu migrates the block to the CPU and peer
+// toward the one peer GPU mapping the block, so that data shared by the GPUs
+// settles on the one whose MIMC and MOMC counts pull it the most. peer by
+// default with more than one GPU, 0 otherwise.
+#define PENGUIN_AC_MOMC_OFF  0
+#define PENGUIN_AC_MOMC_CPU  1
+#define PENGUIN_AC_MOMC_PEER 2 // UVM_ACCESS_COUNTER_MOMC_PEER
+
+int penguin_ac_momc_mode = -1;
+
+int penguin_ac_momc() {
+    if(penguin_ac_momc_mode >= 0) {
+        return penguin_ac_momc_mode;
+    }
+    const char* env = getenv("PENGUIN_AC_MOMC");
+    penguin_ac_momc_mode = penguin_num_devices() > 1 ? PENGUIN_AC_MOMC_PEER : PENGUIN_AC_MOMC_OFF;
+    if(env == NULL) {
+    } else if(strcmp(env, "0") == 0) {
+        penguin_ac_momc_mode = PENGUIN_AC_MOMC_OFF;
+    } else if(strcmp(env, "cpu") == 0) {
+        penguin_ac_momc_mode = PENGUIN_AC_MOMC_CPU;
+    } else if(strcmp(env, "peer") == 0) {
+        penguin_ac_momc_mode = PENGUIN_AC_MOMC_PEER;
+    } else {
+        fprintf(stderr, "unknown PENGUIN_AC_MOMC %s, ignoring it\n", env);
+    }
+    return penguin_ac_momc_mode;
+}
+
+// Turns the access counters on for this VA space, migrating a block once its
+// count reaches PENGUIN_AC_THRESHOLD (256 by default or tuned) and handling
+// MOMC notifications as penguin_ac_momc says; replaces reloading the driver
+// with uvm_perf_access_counter_mimc_migration_enable=1
+extern "C"
+penguin_error_t penguinEnableAccessCounters() {
+    PENGUIN_ENTRY();
+    // done once; the calls after that don't wait for the lock
+    if(__atomic_load_n(&ac_enabled, __ATOMIC_ACQUIRE)) {
+        return PENGUIN_OK;
+    }
+    penguin_registry_scope registry;
+    if(ac_enabled == true) {
+        return PENGUIN_OK;
+    }
+    __atomic_store_n(&ac_enabled, true, __ATOMIC_RELEASE);
+    penguin_enable_access_counter_param request;
+    int status;
+
+    request.enable_mimc = true;
+    request.enable_momc = penguin_ac_momc();
+    request.mimc_gran  = penguin_ac_granularity();
+    request.momc_gran  = penguin_ac_granularity();
+    request.mimc_use_limit  = 4;
+    request.momc_use_limit  = 4;
+    request.threshold  = penguin_tune().ac_threshold;
+
+    fprintf(stderr, "enable access counters\n");
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    // every device, allocations can be host pinned for any of them
+    for (int device = 0; device < penguin_num_devices(); device++) {
+        memcpy(request.uuid, penguin_gpu_uuid(device), sizeof(request.uuid));
+        if ((status = penguin_ioctl(PENGUIN_ACCESS_COUNTER_ENABLE, &request)) != 0)
+        {
+            fprintf(stderr, "error: %d\n", status);
+            fprintf(stderr, "debuggy\n");
+            return PENGUIN_ERR_IOCTL;
+        }
+    }
+    return PENGUIN_OK;
+}
+
+#define PENGUIN_POLICY_SUV 0 // the plan the binary was transformed with
+#define PENGUIN_POLICY_UVM 1 // demand paging only
+#define PENGUIN_POLICY_AC  2 // demand paging and access counter migrations
+
+int penguin_policy_mode = -1;
+
+// Policy the run uses, PENGUIN_POLICY=suv|uvm|ac; one transformed binary runs
+// the baselines too, so they need no binary or driver load of their own
+int penguin_policy() {
+    if(penguin_policy_mode >= 0) {
+        return penguin_policy_mode;
+    }
+    penguin_policy_mode = PENGUIN_POLICY_SUV;
+    const char* env = getenv("PENGUIN_POLICY");
+    if(env == NULL || strcmp(env, "suv") == 0) {
+    } else if(strcmp(env, "uvm") == 0) {
+        penguin_policy_mode = PENGUIN_POLICY_UVM;
+    } else if(strcmp(env, "ac") == 0) {
+        penguin_policy_mode = PENGUIN_POLICY_AC;
+    } else {
+        fprintf(stderr, "unknown PENGUIN_POLICY %s, using suv\n", env);
+    }
+    return penguin_policy_mode;
+}
+
+// Whether the planners run; under the baselines the driver alone places the
+// data, with the access counters on for ac. Called from every planner entry
+// point, after CUDA has registered the GPU with the VA space.
+bool penguin_planning() {
+    int policy = penguin_policy();
+    if(policy == PENGUIN_POLICY_AC) {
+        penguinEnableAccessCounters();
+    }
+    return policy == PENGUIN_POLICY_SUV;
+}
+
+// Prefetch engine. Batches are migrated on two non-blocking streams of
+// their own so that the migration of batch N+1 overlaps the kernels working
+// on batch N, which run on the application's default stream.
+typedef struct
+{
+    bool initialized;
+    cudaStream_t h2d;
+    cudaStream_t d2h;
+    cudaEvent_t compute_done; // kernels launched so far on the default stream
+    cudaEvent_t evict_done;   // last D2H eviction
+    cudaEvent_t batch_ready;  // batch needed by the next kernel
+} penguin_prefetch_engine_t;
+
+penguin_prefetch_engine_t prefetch_engine = {};
+
+extern "C"
+penguin_error_t penguinPrefetchEngineInit() {
+    PENGUIN_ENTRY();
+    // set once the streams exist; the per-batch calls don't wait for the lock
+    if(__atomic_load_n(&prefetch_engine.initialized, __ATOMIC_ACQUIRE)) {
+        return PENGUIN_OK;
+    }
+    penguin_registry_scope registry;
+    if(prefetch_engine.initialized) {
+        return PENGUIN_OK;
+    }
+    if(cudaStreamCreateWithFlags(&prefetch_engine.h2d, cudaStreamNonBlocking) != cudaSuccess ||
+            cudaStreamCreateWithFlags(&prefetch_engine.d2h, cudaStreamNonBlocking) != cudaSuccess ||
+            cudaEventCreateWithFlags(&prefetch_engine.compute_done, cudaEventDisableTiming) != cudaSuccess ||
+            cudaEventCreateWithFlags(&prefetch_engine.evict_done, cudaEventDisableTiming) != cudaSuccess ||
+            cudaEventCreateWithFlags(&prefetch_engine.batch_ready, cudaEventDisableTiming) != cudaSuccess) {
+        printf("unable to create prefetch streams\n");
+        return PENGUIN_ERR_CUDA;
+    }
+    __atomic_store_n(&prefetch_engine.initialized, true, __ATOMIC_RELEASE);
+    return PENGUIN_OK;
+}
+
+extern "C"
+void penguinPrefetchEngineSynchronize() {
+    PENGUIN_LOCKED_ENTRY();
+    if(!prefetch_engine.initialized) {
+        return;
+    }
+    cudaStreamSynchronize(prefetch_engine.d2h);
+    cudaStreamSynchronize(prefetch_engine.h2d);
+}
+
+// Decision log. With PENGUIN_DECISION_LOG=<file> the run records what the
+// runtime did to the placement: the decision of every allocation, and every
+// prefetch, advise, policy and placement ioctl it sent to CUDA or the driver,
+// each tagged with the segment of the run it was sent in, 2n - 1 while the
+// n-th outermost call of the host thread into the runtime runs and 2n after
+// it. PENGUIN_DECISION_REPLAY=<file> runs the same binary with the sequence
+// of such a log instead. The planners still run, so that the runtime's own
+// state goes as it would, but what they send is dropped and the log's
+// actions go out in its place: the i-th of a segment when the run sends its
+// own i-th there, the ones left over when the segment ends. Two drivers
+// replaying one log thus see the same calls at the same points of the
+// program, however their faults would have moved the plan. The log names
+// addresses, so the replay stops, and the run plans from there on, at the
+// first allocation that is not where and of the size it was in the log.
+// Queries and setup (residency, events, stats, the access counters) go
+// through either way. Meant for one host thread; what the other threads send
+// is replayed in the segment of the host thread they sent it in.
+#define PENGUIN_DECISION_LOG_MAGIC 0x3130474f4c434544ULL // "DECLOG01"
+
+// stream of a logged prefetch
+enum {
+    PENGUIN_LOG_STREAM_DEFAULT,
+    PENGUIN_LOG_STREAM_LAUNCH,
+    PENGUIN_LOG_STREAM_H2D,
+    PENGUIN_LOG_STREAM_D2H
+};
+
+typedef struct
+{
+    unsigned long long magic;
+    unsigned long long binary; // penguin_profile_binary of the run
+} penguin_log_header;
+
+typedef struct
+{
+    unsigned kind;               // PENGUIN_LOG_*
+    unsigned bytes;              // of the payload after the record
+    unsigned long long segment;
+    unsigned long long base;
+    unsigned long long length;
+    long long value;
+    unsigned long long extra;
+} penguin_log_record;
+
+struct penguin_log_action {
+    penguin_log_record record;
+    std::vector<char> payload;
+};
+
+enum {
+    PENGUIN_LOG_OFF,
+    PENGUIN_LOG_RECORD,
+    PENGUIN_LOG_REPLAY
+};
+int decision_log_mode = -1;
+FILE* decision_log = NULL;
+pthread_mutex_t decision_log_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+pthread_t decision_log_thread;
+thread_local unsigned decision_log_depth = 0;
+unsigned long long decision_log_segment = 0;
+// the replayed log, the next action to send, and the base and size of every
+// allocation by sequence
+std::vector<penguin_log_action> replay_actions;
+size_t replay_next = 0;
+std::vector<std::pair<unsigned long long, unsigned long long>> replay_allocations;
+unsigned long long replay_sent = 0;
+unsigned long long replay_dropped = 0;
+
+void penguin_decision_log_close() {
+    pthread_mutex_lock(&decision_log_lock);
+    if(decision_log_mode == PENGUIN_LOG_RECORD && decision_log != NULL) {
+        fclose(decision_log);
+        decision_log = NULL;
+    } else if(decision_log_mode == PENGUIN_LOG_REPLAY) {
+        fprintf(stderr, "decision log: %llu actions replayed, %llu of the run's own dropped\n",
+                replay_sent, replay_dropped);
+    }
+    decision_log_mode = PENGUIN_LOG_OFF;
+    pthread_mutex_unlock(&decision_log_lock);
+}
+
+bool penguin_decision_log_load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    penguin_log_header header;
+    if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != PENGUIN_DECISION_LOG_MAGIC ||
+            header.binary != penguin_profile_binary()) {
+        fprintf(stderr, "%s is not a decision log of this binary\n", path);
+        fclose(f);
+        return false;
+    }
+    penguin_log_action action;
+    while(fread(&action.record, sizeof(action.record), 1, f) == 1) {
+        action.payload.resize(action.record.bytes);
+        if(action.record.bytes > 0 && fread(action.payload.data(), action.record.bytes, 1, f) != 1) {
+            break;
+        }
+        if(action.record.kind == PENGUIN_LOG_ALLOCATION) {
+            if(replay_allocations.size() <= action.record.extra) {
+                replay_allocations.resize(action.record.extra + 1);
+            }
+            replay_allocations[action.record.extra] = {action.record.base, action.record.length};
+        }
+        replay_actions.push_back(action);
+    }
+    fclose(f);
+    return true;
+}
+
+void penguin_decision_log_init() {
+    if(decision_log_mode >= 0) {
+        return;
+    }
+    pthread_mutex_lock(&decision_log_lock);
+    if(decision_log_mode < 0) {
+        int mode = PENGUIN_LOG_OFF;
+        decision_log_thread = pthread_self();
+        const char* replay = getenv("PENGUIN_DECISION_REPLAY");
+        const char* record = getenv("PENGUIN_DECISION_LOG");
+        if(replay != NULL) {
+            if(penguin_decision_log_load(replay)) {
+                mode = PENGUIN_LOG_REPLAY;
+            }
+        } else if(record != NULL) {
+            penguin_log_header header = {PENGUIN_DECISION_LOG_MAGIC, penguin_profile_binary()};
+            decision_log = fopen(record, "wb");
+            if(decision_log == NULL || fwrite(&header, sizeof(header), 1, decision_log) != 1) {
+                fprintf(stderr, "Cannot write %s\n", record);
+            } else {
+                mode = PENGUIN_LOG_RECORD;
+            }
+        }
+        if(mode != PENGUIN_LOG_OFF) {
+            atexit(penguin_decision_log_close);
+        }
+        decision_log_mode = mode;
+    }
+    pthread_mutex_unlock(&decision_log_lock);
+}
+
+bool penguin_decision_log_replaying() {
+    penguin_decision_log_init();
+    return decision_log_mode == PENGUIN_LOG_REPLAY;
+}
+
+cudaStream_t penguin_decision_log_stream(unsigned long long role) {
+    bool engine = __atomic_load_n(&prefetch_engine.initialized, __ATOMIC_ACQUIRE);
+    switch(role) {
+        case PENGUIN_LOG_STREAM_LAUNCH: return launch_stream;
+        case PENGUIN_LOG_STREAM_H2D: return engine ? prefetch_engine.h2d : 0;
+        case PENGUIN_LOG_STREAM_D2H: return engine ? prefetch_engine.d2h : 0;
+    }
+    return 0;
+}
+
+unsigned long long penguin_decision_log_stream_role(cudaStream_t stream) {
+    if(stream == 0) {
+        return PENGUIN_LOG_STREAM_DEFAULT;
+    }
+    if(__atomic_load_n(&prefetch_engine.initialized, __ATOMIC_ACQUIRE)) {
+        if(stream == prefetch_engine.h2d) {
+            return PENGUIN_LOG_STREAM_H2D;
+        }
+        if(stream == prefetch_engine.d2h) {
+            return PENGUIN_LOG_STREAM_D2H;
+        }
+    }
+    return stream == launch_stream ? PENGUIN_LOG_STREAM_LAUNCH : PENGUIN_LOG_STREAM_DEFAULT;
+}
+
+// Sends a logged action as the recording run did, past the log
+void penguin_decision_log_send(penguin_log_action& action) {
+    penguin_log_record& r = action.record;
+    void* payload = action.payload.data();
+    switch(r.kind) {
+        case PENGUIN_LOG_PREFETCH:
+            cudaMemPrefetchAsync((void*) r.base, r.length, (int) r.value,
+                    penguin_decision_log_stream(r.extra));
+            break;
+        case PENGUIN_LOG_ADVISE:
+            cudaMemAdvise((void*) r.base, r.length, (cudaMemoryAdvise) r.extra, (int) r.value);
+            break;
+        case PENGUIN_LOG_POLICY: {
+            penguin_policy_batch_ioctl_params request = {};
+            request.entries = (penguin_policy_batch_entry*) payload;
+            request.count = r.bytes / sizeof(penguin_policy_batch_entry);
+            ioctl(penguin_uvm_fd(), PENGUIN_POLICY_BATCH_IOCTL_NUM, &request);
+            break;
+        }
+        case PENGUIN_LOG_MIGRATE: {
+            penguin_migrate_batch_ioctl_params request = {};
+            request.entries = (penguin_migrate_batch_entry*) payload;
+            request.count = r.bytes / sizeof(penguin_migrate_batch_entry);
+            request.flags = r.extra;
+            ioctl(penguin_uvm_fd(), PENGUIN_MIGRATE_BATCH_IOCTL_NUM, &request);
+            break;
+        }
+        case PENGUIN_LOG_NEXT_USE: {
+            penguin_next_use_ioctl_params request = {};
+            request.entries = (penguin_next_use_entry*) payload;
+            request.count = r.bytes / sizeof(penguin_next_use_entry);
+            request.epoch = r.extra;
+            ioctl(penguin_uvm_fd(), PENGUIN_NEXT_USE_IOCTL_NUM, &request);
+            break;
+        }
+        case PENGUIN_LOG_IOCTL:
+            ioctl(penguin_uvm_fd(), r.value, payload);
+            break;
+        default:
+            // allocations and decisions are only recorded
+            return;
+    }
+    replay_sent++;
+}
+
+// Records an action the runtime is about to send and returns true, or under
+// replay sends the log's next one of the segment in its place and returns
+// false, for the caller to act as if its own had succeeded
+bool penguin_decision_log_take(unsigned kind, const void* base, unsigned long long length,
+        long long value, unsigned long long extra, const void* payload, unsigned bytes) {
+    penguin_decision_log_init();
+    if(decision_log_mode == PENGUIN_LOG_OFF) {
+        return true;
+    }
+    bool send = true;
+    pthread_mutex_lock(&decision_log_lock);
+    if(decision_log_mode == PENGUIN_LOG_RECORD) {
+        penguin_log_record r = {kind, bytes, decision_log_segment, (unsigned long long) base, length,
+            value, extra};
+        if(fwrite(&r, sizeof(r), 1, decision_log) != 1 ||
+                (bytes > 0 && fwrite(payload, bytes, 1, decision_log) != 1)) {
+            fprintf(stderr, "Cannot write the decision log\n");
+        }
+    } else if(decision_log_mode == PENGUIN_LOG_REPLAY) {
+        send = false;
+        replay_dropped++;
+        // past the allocations and decisions, which are not sent
+        while(replay_next < replay_actions.size() &&
+                replay_actions[replay_next].record.segment <= decision_log_segment &&
+                replay_actions[replay_next].record.kind <= PENGUIN_LOG_DECISION) {
+            replay_next++;
+        }
+        if(replay_next < replay_actions.size() &&
+                replay_actions[replay_next].record.segment == decision_log_segment) {
+            penguin_decision_log_send(replay_actions[replay_next++]);
+        }
+    }
+    pthread_mutex_unlock(&decision_log_lock);
+    return send;
+}
+
+// Records what is not sent anywhere, the allocations and decisions
+void penguin_decision_log_note(unsigned kind, const void* base, unsigned long long length,
+        long long value, unsigned long long extra) {
+    penguin_decision_log_init();
+    if(decision_log_mode == PENGUIN_LOG_RECORD) {
+        penguin_decision_log_take(kind, base, length, value, extra);
+    }
+}
+
+// An allocation registered; under replay it must be the logged one
+void penguin_decision_log_allocation(const penguin_alloc_desc& desc) {
+    penguin_decision_log_note(PENGUIN_LOG_ALLOCATION, desc.base, desc.size, 0, desc.seq);
+    if(decision_log_mode != PENGUIN_LOG_REPLAY) {
+        return;
+    }
+    if(desc.seq >= replay_allocations.size() ||
+            replay_allocations[desc.seq].first != (unsigned long long) desc.base ||
+            replay_allocations[desc.seq].second != desc.size) {
+        fprintf(stderr, "decision log: allocation %u is not the logged one, planning from here on\n",
+                desc.seq);
+        penguin_decision_log_close();
+    }
+}
+
+// Ends the segment of the host thread: under replay the log's actions of it
+// the run didn't take the place of are sent
+void penguin_decision_log_advance() {
+    pthread_mutex_lock(&decision_log_lock);
+    while(decision_log_mode == PENGUIN_LOG_REPLAY && replay_next < replay_actions.size() &&
+            replay_actions[replay_next].record.segment <= decision_log_segment) {
+        penguin_decision_log_send(replay_actions[replay_next++]);
+    }
+    decision_log_segment++;
+    pthread_mutex_unlock(&decision_log_lock);
+}
+
+void penguin_decision_log_call_begin() {
+    if(decision_log_mode == PENGUIN_LOG_OFF) {
+        return;
+    }
+    penguin_decision_log_init();
+    if(decision_log_mode == PENGUIN_LOG_OFF || !pthread_equal(pthread_self(), decision_log_thread)) {
+        return;
+    }
+    if(decision_log_depth++ == 0) {
+        penguin_decision_log_advance();
+    }
+}
+
+void penguin_decision_log_call_end() {
+    if(decision_log_mode == PENGUIN_LOG_OFF || !pthread_equal(pthread_self(), decision_log_thread)) {
+        return;
+    }
+    if(decision_log_depth > 0 && --decision_log_depth == 0) {
+        penguin_decision_log_advance();
+    }
+}
+
+cudaError_t penguin_mem_prefetch_now(const void* base, size_t length, int device, cudaStream_t stream) {
+    if(!penguin_decision_log_take(PENGUIN_LOG_PREFETCH, base, length, device,
+            penguin_decision_log_stream_role(stream))) {
+        return cudaSuccess;
+    }
+    return cudaMemPrefetchAsync(base, length, device, stream);
+}
+
+cudaError_t penguin_mem_prefetch(const void* base, size_t length, int device, cudaStream_t stream) {
+    if(prefetch_coalescer.depth > 0) {
+        prefetch_coalescer.queued.push_back(penguin_policy_prefetch{(void*) base, length, device, stream});
+        return cudaSuccess;
+    }
+    return penguin_mem_prefetch_now(base, length, device, stream);
+}
+
+cudaError_t penguin_mem_advise(const void* base, size_t length, cudaMemoryAdvise advice,
+        int device) {
+    if(!penguin_decision_log_take(PENGUIN_LOG_ADVISE, base, length, device, advice)) {
+        return cudaSuccess;
+    }
+    return cudaMemAdvise(base, length, advice, device);
+}
+
+// The params of the flat placement ioctls, their size and the offset of
+// their status, SIZE_MAX for none
+static bool penguin_decision_log_params(unsigned long request, size_t* size, size_t* status) {
+#define PENGUIN_LOG_PARAMS(num, type) \
+    case num: *size = sizeof(type); *status = offsetof(type, status); return true
+    switch(request) {
+        PENGUIN_LOG_PARAMS(PENGUIN_PRIORITIZED_GPU_IOCTL_NUM, penguin_prioritized_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_NO_MIGRATE_IOCTL_NUM, penguin_ignore_notif_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_PREFETCH_STRIDE_IOCTL_NUM, penguin_prefetch_stride_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_ACCESS_PATTERN_IOCTL_NUM, penguin_access_pattern_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_DISCARDABLE_IOCTL_NUM, penguin_discardable_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_ACCESS_COUNTER_POLICY_IOCTL_NUM,
+                penguin_access_counter_policy_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_HOST_HUGE_PAGES_IOCTL_NUM, penguin_host_huge_pages_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_FAULT_REPLAY_HINT_IOCTL_NUM,
+                penguin_fault_replay_hint_ioctl_params);
+        PENGUIN_LOG_PARAMS(PENGUIN_HOST_NUMA_NODE_IOCTL_NUM, penguin_host_numa_node_ioctl_params);
+        case PENGUIN_QUICK_MIGRATE_IOCTL_NUM:
+            *size = sizeof(penguin_quick_migrate_ioctl_params);
+            *status = SIZE_MAX;
+            return true;
+    }
+#undef PENGUIN_LOG_PARAMS
+    return false;
+}
+
+// The placement ioctls of penguin_ioctl through the decision log; false if
+// one is replayed in its place, whose params then say it succeeded
+static bool penguin_decision_log_ioctl(unsigned long request, void* params) {
+    penguin_decision_log_init();
+    if(decision_log_mode == PENGUIN_LOG_OFF) {
+        return true;
+    }
+    if(request == PENGUIN_POLICY_BATCH_IOCTL_NUM) {
+        auto p = (penguin_policy_batch_ioctl_params*) params;
+        if(penguin_decision_log_take(PENGUIN_LOG_POLICY, NULL, 0, 0, 0, p->entries,
+                p->count * sizeof(*p->entries))) {
+            return true;
+        }
+        for(unsigned i = 0; i < p->count; i++) {
+            p->entries[i].status = 0;
+        }
+        p->applied = p->count;
+        p->status = 0;
+        return false;
+    }
+    if(request == PENGUIN_MIGRATE_BATCH_IOCTL_NUM) {
+        auto p = (penguin_migrate_batch_ioctl_params*) params;
+        if(penguin_decision_log_take(PENGUIN_LOG_MIGRATE, NULL, 0, 0, p->flags, p->entries,
+                p->count * sizeof(*p->entries))) {
+            return true;
+        }
+        for(unsigned i = 0; i < p->count; i++) {
+            p->entries[i].status = 0;
+        }
+        p->migrated = p->count;
+        p->status = 0;
+        return false;
+    }
+    if(request == PENGUIN_NEXT_USE_IOCTL_NUM) {
+        auto p = (penguin_next_use_ioctl_params*) params;
+        if(penguin_decision_log_take(PENGUIN_LOG_NEXT_USE, NULL, 0, 0, p->epoch, p->entries,
+                p->count * sizeof(*p->entries))) {
+            return true;
+        }
+        p->status = 0;
+        return false;
+    }
+    size_t size, status;
+    if(!penguin_decision_log_params(request, &size, &status) ||
+            penguin_decision_log_take(PENGUIN_LOG_IOCTL, NULL, 0, request, 0, params, size)) {
+        return true;
+    }
+    if(status != SIZE_MAX) {
+        *(int*) ((char*) params + status) = 0;
+    }
+    return false;
+}
+
+// Queues batch prefnum of length bytes on the H2D stream, the part of it
+// below max
+void penguin_prefetch_batch_copy(penguin_alloc_desc& desc, size_t length, unsigned prefnum, size_t max,
+        bool timed) {
+    unsigned long long offset = (unsigned long long) prefnum * length;
+    if(offset >= max) {
+        return;
+    }
+    if(offset + length > max) {
+        length = max - offset;
+    }
+    if(timed) {
+        // the events bracket this batch alone, behind what was queued before
+        penguin_prefetch_coalesce_flush();
+        cudaEventRecord(desc.xfer_start, prefetch_engine.h2d);
+        penguin_mem_prefetch_now((char*)desc.base + offset, length, 0, prefetch_engine.h2d);
+        cudaEventRecord(desc.xfer_stop, prefetch_engine.h2d);
+        desc.xfer_sample = true;
+    } else {
+        penguin_mem_prefetch((char*)desc.base + offset, length, 0, prefetch_engine.h2d);
+    }
+    penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) desc.base + offset, length);
+}
+
+// Queues batch prefnum of an allocation on the H2D stream, once. A timed
+// batch is bracketed by the descriptor's transfer events.
+void penguinPrefetchBatch(penguin_alloc_desc& desc, size_t length, unsigned prefnum, size_t max,
+        bool timed) {
+    if(desc.prefetch_issued > prefnum) {
+        return;
+    }
+    penguin_prefetch_batch_copy(desc, length, prefnum, max, timed);
+    desc.prefetch_issued = prefnum + 1;
+}
+
+// Largest look-ahead that the memory set aside for the window allows.
+unsigned penguinMaxPrefetchDepth(penguin_alloc_desc& desc, size_t length) {
+    if(desc.prefetch_window <= length) {
+        return 0;
+    }
+    unsigned long long depth = desc.prefetch_window / length - 1;
+    if(depth > PENGUIN_MAX_PREFETCH_DEPTH) {
+        depth = PENGUIN_MAX_PREFETCH_DEPTH;
+    }
+    return depth;
+}
+
+// The host loops of the iteration prefetch. The iteration the wrapper gets,
+// the induction variable of the inner loop, is start + step * n in its n-th
+// iteration, from penguinSetPrefetchLoop; with penguinSetPrefetchOuterLoop
+// the inner loop's start is in turn start + step * m of the outer loop in
+// its m-th iteration, and a step of 0 there runs the same inner sweep again.
+struct penguin_prefetch_loop {
+    bool known;
+    long long start;
+    long long step;
+    unsigned long long trips;
+};
+penguin_prefetch_loop prefetch_inner = {false, 0, 0, 0};
+penguin_prefetch_loop prefetch_outer = {false, 0, 0, 0};
+// inner loops entered since the outer one was, its iteration when its step
+// is 0
+unsigned long long prefetch_outer_entries = 0;
+
+// Whether the iterations go in another order than 0, 1, 2, ... of a single
+// loop, which penguinSuperPrefetchOrdered handles
+bool penguin_prefetch_ordered() {
+    return prefetch_inner.known && (prefetch_inner.step != 1 || prefetch_outer.known);
+}
+
+// Called by DynamicHostTransform before the loop that calls
+// penguinSuperPrefetchWrapper, with the start and step of its induction
+// variable and its trip count from SCEV
+extern "C"
+void penguinSetPrefetchLoop(long long start, long long step, unsigned long long trips) {
+    PENGUIN_ENTRY();
+    prefetch_inner = {step != 0 && trips > 0, start, step, trips};
+    prefetch_outer_entries++;
+    if(penguin_prefetch_ordered()) {
+        // a batch may start on any iteration
+        penguin_prefetch_period = 1;
+    }
+}
+
+// Before the loop around that one, with how the inner loop's start moves
+// from one of its iterations to the next
+extern "C"
+void penguinSetPrefetchOuterLoop(long long start, long long step, unsigned long long trips) {
+    PENGUIN_ENTRY();
+    prefetch_outer = {trips > 1, start, step, trips};
+    prefetch_outer_entries = 0;
+}
+
+// n of iteration iter of the inner loop, false when iter isn't one of it
+bool penguin_prefetch_position(long long iter, unsigned long long& n) {
+    long long offset = iter - prefetch_inner.start;
+    if(!prefetch_inner.known || offset % prefetch_inner.step != 0 || offset / prefetch_inner.step < 0) {
+        return false;
+    }
+    n = offset / prefetch_inner.step;
+    return n < prefetch_inner.trips;
+}
+
+// m of the outer loop's iteration the inner loop is in
+unsigned long long penguin_prefetch_outer_position() {
+    if(prefetch_outer.step != 0) {
+        long long offset = prefetch_inner.start - prefetch_outer.start;
+        if(offset % prefetch_outer.step == 0 && offset / prefetch_outer.step >= 0) {
+            return offset / prefetch_outer.step;
+        }
+    }
+    return prefetch_outer_entries > 0 ? prefetch_outer_entries - 1 : 0;
+}
+
+// Collects finished samples and re-sizes the look-ahead: the prefetch
+// distance is the iterations the kernels run while one batch crosses PCIe,
+// at the sampled transfer time or, before there is one, at the bandwidth of
+// the link, and enough batches must be in flight to cover it. Batches past
+// the last iteration of the host loop are not fetched. Called at a batch
+// boundary, before the default stream is fenced on the next batch.
+void penguinUpdatePrefetchDepth(penguin_alloc_desc& desc, size_t length, unsigned iter,
+        unsigned iterPerBatch) {
+    auto max_depth = penguinMaxPrefetchDepth(desc, length);
+    // penguinSuperPrefetchOrdered stops at the loop's end on its own
+    unsigned long long n;
+    if(!penguin_prefetch_ordered() && prefetch_inner.step == 1 && penguin_prefetch_position(iter, n)) {
+        unsigned long long last = prefetch_inner.start + prefetch_inner.trips - 1;
+        unsigned long long left = last / iterPerBatch - iter / iterPerBatch;
+        max_depth = left < max_depth ? left : max_depth;
+    }
+    if(desc.compute_start == NULL) {
+        cudaEventCreate(&desc.compute_start);
+        cudaEventCreate(&desc.compute_stop);
+        cudaEventCreate(&desc.xfer_start);
+        cudaEventCreate(&desc.xfer_stop);
+        desc.prefetch_depth = max_depth;
+    }
+    if(desc.compute_sample == 1) {
+        // kernels of the sampled batch end here
+        cudaEventRecord(desc.compute_stop, 0);
+        desc.compute_sample = 2;
+    } else if(desc.compute_sample == 2 && cudaEventQuery(desc.compute_stop) == cudaSuccess) {
+        cudaEventElapsedTime(&desc.batch_compute_ms, desc.compute_start, desc.compute_stop);
+        desc.compute_sample = 0;
+    }
+    if(desc.xfer_sample && cudaEventQuery(desc.xfer_stop) == cudaSuccess) {
+        cudaEventElapsedTime(&desc.batch_xfer_ms, desc.xfer_start, desc.xfer_stop);
+        desc.xfer_sample = false;
+    }
+    double xfer_ms = desc.batch_xfer_ms;
+    if(xfer_ms <= 0) {
+        penguinTopologyProbe();
+        xfer_ms = length / (penguin_links[desc.device >= 0 ? desc.device : 0][PENGUIN_HOST].bandwidth * 1e6);
+    }
+    if(desc.batch_compute_ms > 0) {
+        double iteration_ms = (double) desc.batch_compute_ms / iterPerBatch;
+        unsigned long long distance = (unsigned long long) ceil(xfer_ms / iteration_ms);
+        unsigned long long depth = distance / iterPerBatch + 1;
+        desc.prefetch_depth = depth < max_depth ? depth : max_depth;
+        /* std::cout << "prefetch distance = " << distance << " depth = " << desc.prefetch_depth << std::endl; */
+    } else if(desc.prefetch_depth > max_depth) {
+        desc.prefetch_depth = max_depth;
+    }
+}
+
+// Pinned host pool. The runtime's page-locked buffers, the compressed
+// staging caches and the host side of device copies, come from here rather
+// than from cudaHostAlloc, since pinning costs a registration that takes
+// milliseconds per GB. Buffers below PENGUIN_PLACEMENT_UNIT are carved, by
+// size class in powers of two from PENGUIN_PINNED_MIN_BLOCK, out of chunks
+// of PENGUIN_PINNED_CHUNK_MB that stay for the whole job; larger ones get a
+// chunk of their own rounded up to PENGUIN_PLACEMENT_UNIT. Chunks are mapped
+// on 2MB pages where the kernel has them reserved, on transparent ones
+// otherwise, and registered once, mapped so that the GPU reaches them. A
+// freed buffer is kept by its class for the next one, across allocations
+// and invocations; own chunks beyond PENGUIN_PINNED_CACHE_MB go back.
+// PENGUIN_PINNED_POOL=0 allocates every buffer with cudaHostAlloc.
+#define PENGUIN_PINNED_MIN_BLOCK 4096ULL
+#ifndef PENGUIN_PINNED_CHUNK_MB
+#define PENGUIN_PINNED_CHUNK_MB 64
+#endif
+// bytes of freed own chunks the pool keeps
+#ifndef PENGUIN_PINNED_CACHE_MB
+#define PENGUIN_PINNED_CACHE_MB 1024
+#endif
+
+// class -> freed buffers; live buffer -> its class; the rest of the last
+// shared chunk
+std::map<unsigned long long, std::vector<char*>> pinned_cached;
+std::map<void*, unsigned long long> pinned_blocks;
+unsigned long long pinned_cached_bytes = 0;
+char* pinned_next = NULL;
+unsigned long long pinned_left = 0;
+int pinned_pool_enabled = -1;
+
+bool penguin_pinned_pool_enabled() {
+    if(pinned_pool_enabled < 0) {
+        const char* env = getenv("PENGUIN_PINNED_POOL");
+        pinned_pool_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return pinned_pool_enabled;
+}
+
+unsigned long long penguin_pinned_class(unsigned long long size) {
+    if(size >= PENGUIN_PLACEMENT_UNIT) {
+        return (size + PENGUIN_PLACEMENT_UNIT - 1) & ~(PENGUIN_PLACEMENT_UNIT - 1);
+    }
+    unsigned long long bytes = PENGUIN_PINNED_MIN_BLOCK;
+    while(bytes < size) {
+        bytes <<= 1;
+    }
+    return bytes;
+}
+
+// Maps and registers bytes, a multiple of PENGUIN_PLACEMENT_UNIT
+char* penguin_pinned_map(unsigned long long bytes) {
+    void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(p == MAP_FAILED) {
+        // no hugepages reserved
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED) {
+            return NULL;
+        }
+        madvise(p, bytes, MADV_HUGEPAGE);
+    }
+    if(cudaHostRegister(p, bytes, cudaHostRegisterPortable | cudaHostRegisterMapped) != cudaSuccess) {
+        munmap(p, bytes);
+        return NULL;
+    }
+    return (char*) p;
+}
+
+// Gives back freed own chunks, the largest first, until the pool keeps at
+// most keep bytes of them
+void penguin_pinned_trim(unsigned long long keep) {
+    for(auto c = pinned_cached.rbegin(); c != pinned_cached.rend() && c->first >= PENGUIN_PLACEMENT_UNIT; c++) {
+        while(!c->second.empty() && pinned_cached_bytes > keep) {
+            cudaHostUnregister(c->second.back());
+            munmap(c->second.back(), c->first);
+            c->second.pop_back();
+            pinned_cached_bytes -= c->first;
+        }
+    }
+}
+
+void* penguin_pinned_alloc(unsigned long long size) {
+    if(!penguin_pinned_pool_enabled()) {
+        void* p = NULL;
+        return cudaHostAlloc(&p, size, cudaHostAllocPortable | cudaHostAllocMapped) == cudaSuccess ? p : NULL;
+    }
+    unsigned long long bytes = penguin_pinned_class(size);
+    char* block = NULL;
+    auto c = pinned_cached.find(bytes);
+    if(c != pinned_cached.end() && !c->second.empty()) {
+        block = c->second.back();
+        c->second.pop_back();
+        if(bytes >= PENGUIN_PLACEMENT_UNIT) {
+            pinned_cached_bytes -= bytes;
+        }
+    } else if(bytes >= PENGUIN_PLACEMENT_UNIT) {
+        block = penguin_pinned_map(bytes);
+        if(block == NULL) {
+            penguin_pinned_trim(0);
+            block = penguin_pinned_map(bytes);
+        }
+    } else {
+        if(pinned_left < bytes) {
+            char* chunk = penguin_pinned_map(PENGUIN_PINNED_CHUNK_MB * 1024ULL * 1024ULL);
+            if(chunk == NULL) {
+                return NULL;
+            }
+            // the rest of the last chunk, in the largest classes that fit
+            while(pinned_left >= PENGUIN_PINNED_MIN_BLOCK) {
+                unsigned long long b = PENGUIN_PINNED_MIN_BLOCK;
+                while(b * 2 <= pinned_left && b * 2 < PENGUIN_PLACEMENT_UNIT) {
+                    b <<= 1;
+                }
+                pinned_cached[b].push_back(pinned_next);
+                pinned_next += b;
+                pinned_left -= b;
+            }
+            pinned_next = chunk;
+            pinned_left = PENGUIN_PINNED_CHUNK_MB * 1024ULL * 1024ULL;
+        }
+        block = pinned_next;
+        pinned_next += bytes;
+        pinned_left -= bytes;
+    }
+    if(block != NULL) {
+        pinned_blocks[block] = bytes;
+    }
+    return block;
+}
+
+// The caller makes sure no copy still uses p
+void penguin_pinned_free(void* p) {
+    if(p == NULL) {
+        return;
+    }
+    auto b = pinned_blocks.find(p);
+    if(b == pinned_blocks.end()) {
+        cudaFreeHost(p);
+        return;
+    }
+    unsigned long long bytes = b->second;
+    pinned_blocks.erase(b);
+    pinned_cached[bytes].push_back((char*) p);
+    if(bytes >= PENGUIN_PLACEMENT_UNIT) {
+        pinned_cached_bytes += bytes;
+        if(pinned_cached_bytes > PENGUIN_PINNED_CACHE_MB * 1024ULL * 1024ULL) {
+            penguin_pinned_trim(PENGUIN_PINNED_CACHE_MB * 1024ULL * 1024ULL);
+        }
+    }
+}
+
+// NVMe tier. With -penguin-nvme-tier the host transform sends cudaMallocManaged
+// and cudaFree here. Once the managed footprint outgrows the host memory,
+// less PENGUIN_NVME_HOST_RESERVE_MB, and the GPU budget together, under the
+// SUV policy, an allocation of PENGUIN_NVME_MIN_MB or more is instead an
+// unlinked file in PENGUIN_NVME_DIR mapped shared, which the kernels reach
+// through HMM and the kernel pages in and out of the page cache, rather than
+// a managed allocation the host cannot back. The driver keeps file pages in
+// system memory, so the planners leave such an allocation on its tier, whose
+// accesses they price at the NVMe link, and a staged copy ring is the one way
+// its batches reach the GPU. Built with PENGUIN_GDS=1 (-DSUV_GDS=ON) the
+// rings read them from the file straight into their slots with
+// cuFileReadAsync on the prefetch engine's H2D stream, past the page cache;
+// the dirty pages are written back before each pass. PENGUIN_NVME_ALL=1 puts
+// every large enough allocation on the tier.
+#ifndef PENGUIN_GDS
+#define PENGUIN_GDS 0
+#endif
+#if PENGUIN_GDS
+#include <cufile.h>
+#endif
+#define PENGUIN_NVME_MIN_MB 64
+#ifndef PENGUIN_NVME_HOST_RESERVE_MB
+#define PENGUIN_NVME_HOST_RESERVE_MB 4096
+#endif
+
+typedef struct
+{
+    int fd;               // the unlinked file, mapped at the allocation
+    unsigned long long size;
+#if PENGUIN_GDS
+    int direct_fd;        // the same file opened O_DIRECT, -1 if cuFile has none of it
+    CUfileHandle_t handle;
+    // per ring slot, what cuFileReadAsync reads once the stream gets there
+    std::vector<size_t> sizes;
+    std::vector<off_t> file_offsets;
+    std::vector<off_t> slot_offsets;
+    std::vector<ssize_t> read;
+#endif
+} penguin_nvme_file;
+
+// allocation base -> its file
+std::map<unsigned long long, penguin_nvme_file> nvme_files;
+int nvme_mode = -1;  // 0 off, 1 by footprint, 2 all
+bool gds_opened = false;
+
+bool penguin_system_memory_supported();
+
+int penguin_nvme() {
+    if(nvme_mode < 0) {
+        const char* dir = getenv("PENGUIN_NVME_DIR");
+        const char* all = getenv("PENGUIN_NVME_ALL");
+        nvme_mode = dir == NULL || dir[0] == 0 ? 0 : all != NULL && strcmp(all, "0") != 0 ? 2 : 1;
+    }
+    return nvme_mode;
+}
+
+// Whether size more bytes of managed memory are more than the host and the
+// budget hold together
+bool penguin_nvme_spills(unsigned long long size) {
+    if(penguin_nvme() == 2) {
+        return true;
+    }
+    unsigned long long host = (unsigned long long) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    unsigned long long footprint = size + PENGUIN_NVME_HOST_RESERVE_MB * 1024ULL * 1024ULL;
+    for(auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        if(!a->system) {
+            footprint += a->size;
+        }
+    }
+    penguinBudgetInit();
+    return footprint > host + gpu_memory;
+}
+
+#if PENGUIN_GDS
+void penguin_nvme_open_direct(penguin_nvme_file& f) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", f.fd);
+    f.direct_fd = -1;
+    if(!gds_opened) {
+        if(cuFileDriverOpen().err != CU_FILE_SUCCESS) {
+            return;
+        }
+        gds_opened = true;
+    }
+    int fd = open(path, O_RDONLY | O_DIRECT);
+    if(fd < 0) {
+        return;
+    }
+    CUfileDescr_t descr = {};
+    descr.handle.fd = fd;
+    descr.type = CU_FILE_HANDLE_TYPE_OPAQUE_FD;
+    if(cuFileHandleRegister(&f.handle, &descr).err != CU_FILE_SUCCESS) {
+        close(fd);
+        return;
+    }
+    f.direct_fd = fd;
+}
+#endif
+
+extern "C"
+cudaError_t penguinNvmeMallocManaged(void** ptr, size_t size, unsigned flags) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_nvme() || size < PENGUIN_NVME_MIN_MB * 1024ULL * 1024ULL || flags != cudaMemAttachGlobal ||
+            penguin_policy() != PENGUIN_POLICY_SUV || !penguin_system_memory_supported() ||
+            !penguin_nvme_spills(size)) {
+        return cudaMallocManaged(ptr, size, flags);
+    }
+    std::string path = std::string(getenv("PENGUIN_NVME_DIR")) + "/penguin-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if(fd < 0) {
+        return cudaMallocManaged(ptr, size, flags);
+    }
+    // gone with the process
+    unlink(path.c_str());
+    void* p = MAP_FAILED;
+    if(ftruncate(fd, size) == 0) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(p == MAP_FAILED) {
+        close(fd);
+        return cudaMallocManaged(ptr, size, flags);
+    }
+    penguin_nvme_file& f = nvme_files[(unsigned long long) p];
+    f.fd = fd;
+    f.size = size;
+#if PENGUIN_GDS
+    penguin_nvme_open_direct(f);
+#endif
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "nvme %p %llu", p, (unsigned long long) size);
+    *ptr = p;
+    return cudaSuccess;
+}
+
+// After penguinFreeAllocation, which released its ring
+extern "C"
+cudaError_t penguinNvmeFree(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto f = nvme_files.find((unsigned long long) p);
+    if(f == nvme_files.end()) {
+        return cudaFree(p);
+    }
+#if PENGUIN_GDS
+    if(f->second.direct_fd >= 0) {
+        cuFileHandleDeregister(f->second.handle);
+        close(f->second.direct_fd);
+    }
+#endif
+    munmap(p, f->second.size);
+    close(f->second.fd);
+    nvme_files.erase(f);
+    return cudaSuccess;
+}
+
+// Writes back what the host wrote to the allocation's pages, before a pass of
+// its ring reads the file past them; no kernel stores to a staged one
+void penguin_nvme_pass(penguin_alloc_desc& desc) {
+    if(desc.nvme && PENGUIN_GDS) {
+        msync(desc.base, desc.size, MS_SYNC);
+    }
+}
+
+// Reads bytes at offset of the allocation into slot of its ring in order on
+// the H2D stream, after the read before into it, which recorded ready; false
+// if the file isn't open to cuFile
+bool penguin_nvme_read(penguin_alloc_desc& desc, unsigned slot, unsigned long long offset,
+        unsigned long long bytes, cudaEvent_t ready) {
+#if PENGUIN_GDS
+    auto f = nvme_files.find((unsigned long long) desc.base);
+    if(!desc.nvme || f == nvme_files.end() || f->second.direct_fd < 0) {
+        return false;
+    }
+    penguin_nvme_file& file = f->second;
+    if(file.sizes.size() < desc.staged_slots) {
+        file.sizes.resize(desc.staged_slots);
+        file.file_offsets.resize(desc.staged_slots);
+        file.slot_offsets.resize(desc.staged_slots);
+        file.read.resize(desc.staged_slots);
+    }
+    // cuFile takes the parameters when the stream gets to the read
+    cudaEventSynchronize(ready);
+    file.sizes[slot] = bytes;
+    file.file_offsets[slot] = offset;
+    file.slot_offsets[slot] = slot * desc.staged_length;
+    return cuFileReadAsync(file.handle, desc.staged_ring, &file.sizes[slot], &file.file_offsets[slot],
+            &file.slot_offsets[slot], &file.read[slot], prefetch_engine.h2d).err == CU_FILE_SUCCESS;
+#else
+    return false;
+#endif
+}
+
+// Staged copy. With -penguin-staged-copy the host transform passes the
+// pointer arguments of every iterative launch through penguinStagedPointer,
+// and a read-only iteration migration allocation whose accesses the analysis
+// bounds to the iteration's span is streamed through a ring of device
+// buffers rather than migrated: the batches are copied with cudaMemcpyAsync
+// on the prefetch engine's H2D stream, and the kernels get the pointer
+// rebased onto the slot that holds their batch, so they never fault on it.
+// PENGUIN_STAGED=0 keeps the migration.
+extern "C" {
+// set by the host transform
+int penguin_staged_remap = 0;
+}
+int staged_enabled = -1;
+// allocation IDs with a ring
+std::set<unsigned> staged_ids;
+
+bool penguin_staged_enabled() {
+    if(staged_enabled < 0) {
+        const char* env = getenv("PENGUIN_STAGED");
+        staged_enabled = penguin_staged_remap != 0 && (env == NULL || strcmp(env, "0") != 0);
+    }
+    return staged_enabled;
+}
+
+// Compressed staging, built with PENGUIN_STAGED_COMPRESSION=1
+// (-DSUV_STAGED_COMPRESSION=ON), which puts the kernels below in the device
+// code. A staged allocation's first pass through its ring copies the batches
+// in raw as before, and each slot is then compressed into a pinned host
+// cache that the GPU writes through its mapping. The codec is zero-value
+// compression of 4KB chunks: a bit per 4-byte word and the words that aren't
+// 0, which suits sparse matrices and zero-heavy activations. Once that pass
+// is done, later passes copy the compressed batches in and expand them into
+// their slot on the GPU, if the allocation compressed by at least
+// PENGUIN_COMPRESS_MIN_RATIO. Otherwise the cache is dropped and the ring
+// stays raw. A batch that doesn't compress that well is copied raw either
+// way, and the cache holds at most size / PENGUIN_COMPRESS_MIN_RATIO. The
+// kernels never store to a staged allocation. The host must not write one
+// that is cached between passes; penguinStagedInvalidate drops the cache.
+// PENGUIN_STAGED_COMPRESS=0 keeps the rings raw.
+#ifndef PENGUIN_STAGED_COMPRESSION
+#define PENGUIN_STAGED_COMPRESSION 0
+#endif
+#define PENGUIN_ZVC_CHUNK_WORDS 1024
+#define PENGUIN_COMPRESS_MIN_RATIO 2
+
+// A compressed batch is the word offset of every chunk after the offsets,
+// then per chunk its 32 mask words and the words that aren't 0
+typedef struct penguin_stage_cache
+{
+    char* host;                 // pinned and mapped, the compressed batches
+    char* host_device;          // the GPU's address of it
+    unsigned long long capacity;
+    // mapped: the offset + 1 and the bytes of every compressed batch, 0 for
+    // a raw one, and then the bytes in use
+    unsigned long long* table;
+    unsigned long long* table_device;
+    unsigned long long batches;
+    unsigned* counts;           // device, the words of every chunk of a batch
+    char* scratch;              // device, a compressed batch copied in
+    unsigned long long compressed; // batches of the first pass given to the kernels
+    cudaEvent_t built;          // after the last of them
+    bool recorded;
+    bool checked;
+} penguin_stage_cache;
+
+#if PENGUIN_STAGED_COMPRESSION
+// counts[chunk] = the mask words and the words of the chunk that aren't 0
+extern "C" __global__
+void penguin_zvc_count(const unsigned* in, unsigned long long words, unsigned* counts) {
+    __shared__ unsigned kept;
+    unsigned long long w = (unsigned long long) blockIdx.x * PENGUIN_ZVC_CHUNK_WORDS + threadIdx.x;
+    if(threadIdx.x == 0) {
+        kept = 0;
+    }
+    __syncthreads();
+    unsigned mask = __ballot_sync(0xffffffff, w < words && in[w] != 0);
+    if(threadIdx.x % 32 == 0) {
+        atomicAdd(&kept, __popc(mask));
+    }
+    __syncthreads();
+    if(threadIdx.x == 0) {
+        counts[blockIdx.x] = PENGUIN_ZVC_CHUNK_WORDS / 32 + kept;
+    }
+}
+
+// Turns counts into the offsets of the chunks and takes room in the cache
+// for the batch if it compresses well enough; one thread
+extern "C" __global__
+void penguin_zvc_place(unsigned* counts, unsigned chunks, unsigned long long raw_bytes,
+        unsigned long long* table, unsigned long long batch, unsigned long long batches,
+        unsigned long long capacity) {
+    unsigned long long total = chunks;
+    for(unsigned c = 0; c < chunks; c++) {
+        unsigned n = counts[c];
+        counts[c] = total;
+        total += n;
+    }
+    unsigned long long bytes = total * sizeof(unsigned);
+    unsigned long long used = table[2 * batches];
+    table[2 * batch] = 0;
+    if(bytes * PENGUIN_COMPRESS_MIN_RATIO <= raw_bytes && used + bytes <= capacity) {
+        table[2 * batch] = used + 1;
+        table[2 * batch + 1] = bytes;
+        table[2 * batches] = used + bytes;
+    }
+}
+
+extern "C" __global__
+void penguin_zvc_write(const unsigned* in, unsigned long long words, const unsigned* offsets,
+        unsigned chunks, const unsigned long long* table, unsigned long long batch, char* cache) {
+    __shared__ unsigned warp_kept[PENGUIN_ZVC_CHUNK_WORDS / 32];
+    if(table[2 * batch] == 0) {
+        return;
+    }
+    unsigned* out = (unsigned*) (cache + table[2 * batch] - 1);
+    unsigned* chunk = out + offsets[blockIdx.x];
+    unsigned long long w = (unsigned long long) blockIdx.x * PENGUIN_ZVC_CHUNK_WORDS + threadIdx.x;
+    unsigned v = w < words ? in[w] : 0;
+    unsigned warp = threadIdx.x / 32, lane = threadIdx.x % 32;
+    unsigned mask = __ballot_sync(0xffffffff, v != 0);
+    if(lane == 0) {
+        chunk[warp] = mask;
+        warp_kept[warp] = __popc(mask);
+    }
+    if(threadIdx.x == 0) {
+        out[blockIdx.x] = offsets[blockIdx.x];
+    }
+    __syncthreads();
+    unsigned before = PENGUIN_ZVC_CHUNK_WORDS / 32;
+    for(unsigned p = 0; p < warp; p++) {
+        before += warp_kept[p];
+    }
+    if(v != 0) {
+        chunk[before + __popc(mask & ((1u << lane) - 1))] = v;
+    }
+}
+
+extern "C" __global__
+void penguin_zvc_expand(const unsigned* in, unsigned long long words, unsigned* out) {
+    const unsigned* chunk = in + in[blockIdx.x];
+    unsigned long long w = (unsigned long long) blockIdx.x * PENGUIN_ZVC_CHUNK_WORDS + threadIdx.x;
+    unsigned warp = threadIdx.x / 32, lane = threadIdx.x % 32;
+    unsigned mask = chunk[warp];
+    unsigned before = PENGUIN_ZVC_CHUNK_WORDS / 32;
+    for(unsigned p = 0; p < warp; p++) {
+        before += __popc(chunk[p]);
+    }
+    if(w < words) {
+        out[w] = (mask >> lane) & 1 ? chunk[before + __popc(mask & ((1u << lane) - 1))] : 0;
+    }
+}
+#endif
+
+int staged_compress_enabled = -1;
+
+bool penguin_staged_compress_enabled() {
+    if(staged_compress_enabled < 0) {
+        const char* env = getenv("PENGUIN_STAGED_COMPRESS");
+        staged_compress_enabled = PENGUIN_STAGED_COMPRESSION &&
+            (env == NULL || strcmp(env, "0") != 0);
+    }
+    return staged_compress_enabled;
+}
+
+void penguin_stage_cache_free(penguin_alloc_desc& desc) {
+    penguin_stage_cache* c = desc.staged_cache;
+    if(c == NULL) {
+        return;
+    }
+    desc.staged_cache = NULL;
+    // the kernels writing it may still run
+    cudaDeviceSynchronize();
+    penguin_pinned_free(c->host);
+    penguin_pinned_free(c->table);
+    cudaFree(c->counts);
+    cudaFree(c->scratch);
+    cudaEventDestroy(c->built);
+    delete c;
+}
+
+void penguin_stage_cache_create(penguin_alloc_desc& desc, unsigned long long length) {
+    unsigned long long batches = (desc.size + length - 1) / length;
+    unsigned long long chunks = (length / sizeof(unsigned) + PENGUIN_ZVC_CHUNK_WORDS - 1) /
+        PENGUIN_ZVC_CHUNK_WORDS;
+    penguin_stage_cache* c = new penguin_stage_cache();
+    c->capacity = desc.size / PENGUIN_COMPRESS_MIN_RATIO;
+    c->batches = batches;
+    c->host = (char*) penguin_pinned_alloc(c->capacity);
+    c->table = (unsigned long long*) penguin_pinned_alloc((2 * batches + 1) * sizeof(unsigned long long));
+    bool ok = c->host != NULL && c->table != NULL &&
+        cudaHostGetDevicePointer((void**) &c->host_device, c->host, 0) == cudaSuccess &&
+        cudaHostGetDevicePointer((void**) &c->table_device, c->table, 0) == cudaSuccess &&
+        cudaMalloc((void**) &c->counts, chunks * sizeof(unsigned)) == cudaSuccess &&
+        cudaMalloc((void**) &c->scratch, length) == cudaSuccess &&
+        cudaEventCreateWithFlags(&c->built, cudaEventDisableTiming) == cudaSuccess;
+    desc.staged_cache = c;
+    if(!ok) {
+        penguin_stage_cache_free(desc);
+        return;
+    }
+    memset(c->table, 0, (2 * batches + 1) * sizeof(unsigned long long));
+}
+
+// Once the first pass is done, keeps the cache if the allocation compressed
+// by at least PENGUIN_COMPRESS_MIN_RATIO
+bool penguin_stage_cache_usable(penguin_alloc_desc& desc) {
+    penguin_stage_cache* c = desc.staged_cache;
+    if(c == NULL || !c->recorded) {
+        return false;
+    }
+    if(c->checked) {
+        return true;
+    }
+    if(cudaEventQuery(c->built) != cudaSuccess) {
+        return false;
+    }
+    c->checked = true;
+    unsigned long long link = 0;
+    for(unsigned long long b = 0; b < c->batches; b++) {
+        unsigned long long raw = std::min(desc.staged_length, desc.size - b * desc.staged_length);
+        link += c->table[2 * b] ? c->table[2 * b + 1] : raw;
+    }
+    if(link * PENGUIN_COMPRESS_MIN_RATIO > desc.size) {
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "uncompressed %p %llu/%llu", desc.base, link, desc.size);
+        penguin_stage_cache_free(desc);
+        return false;
+    }
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "compressed %p %llu/%llu", desc.base, link, desc.size);
+    return true;
+}
+
+// Copies batch into slot compressed if the cache has it, on the H2D stream
+bool penguin_staged_copy_compressed(penguin_alloc_desc& desc, unsigned long long batch,
+        char* slot, unsigned long long bytes) {
+#if PENGUIN_STAGED_COMPRESSION
+    if(!penguin_stage_cache_usable(desc)) {
+        return false;
+    }
+    penguin_stage_cache* c = desc.staged_cache;
+    if(batch >= c->batches || c->table[2 * batch] == 0) {
+        return false;
+    }
+    unsigned long long compressed = c->table[2 * batch + 1];
+    cudaMemcpyAsync(c->scratch, c->host + c->table[2 * batch] - 1, compressed,
+            cudaMemcpyHostToDevice, prefetch_engine.h2d);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) desc.base + batch * desc.staged_length,
+            compressed);
+    unsigned long long words = bytes / sizeof(unsigned);
+    unsigned chunks = (words + PENGUIN_ZVC_CHUNK_WORDS - 1) / PENGUIN_ZVC_CHUNK_WORDS;
+    void* args[] = {&c->scratch, &words, &slot};
+    return cudaLaunchKernel((const void*) penguin_zvc_expand, dim3(chunks), dim3(PENGUIN_ZVC_CHUNK_WORDS),
+            args, 0, prefetch_engine.h2d) == cudaSuccess;
+#else
+    return false;
+#endif
+}
+
+// In the first pass, compresses the batch just copied raw into slot
+void penguin_staged_compress(penguin_alloc_desc& desc, unsigned long long batch, char* slot,
+        unsigned long long bytes) {
+#if PENGUIN_STAGED_COMPRESSION
+    penguin_stage_cache* c = desc.staged_cache;
+    if(c == NULL || c->recorded || batch != c->compressed) {
+        return;
+    }
+    c->compressed++;
+    // a batch the codec can't cover stays raw, its entry is 0
+    if(bytes % sizeof(unsigned) == 0) {
+        unsigned long long words = bytes / sizeof(unsigned);
+        unsigned chunks = (words + PENGUIN_ZVC_CHUNK_WORDS - 1) / PENGUIN_ZVC_CHUNK_WORDS;
+        void* count_args[] = {&slot, &words, &c->counts};
+        void* place_args[] = {&c->counts, &chunks, &bytes, &c->table_device, &batch, &c->batches,
+            &c->capacity};
+        void* write_args[] = {&slot, &words, &c->counts, &chunks, &c->table_device, &batch,
+            &c->host_device};
+        cudaLaunchKernel((const void*) penguin_zvc_count, dim3(chunks), dim3(PENGUIN_ZVC_CHUNK_WORDS),
+                count_args, 0, prefetch_engine.h2d);
+        cudaLaunchKernel((const void*) penguin_zvc_place, dim3(1), dim3(1), place_args, 0,
+                prefetch_engine.h2d);
+        cudaLaunchKernel((const void*) penguin_zvc_write, dim3(chunks), dim3(PENGUIN_ZVC_CHUNK_WORDS),
+                write_args, 0, prefetch_engine.h2d);
+    }
+    if(c->compressed == c->batches) {
+        cudaEventRecord(c->built, prefetch_engine.h2d);
+        c->recorded = true;
+    }
+#endif
+}
+
+// Frees the ring once the kernels reading it are done
+void penguin_unstage_ring(penguin_alloc_desc& desc) {
+    if(desc.staged_ring == NULL) {
+        return;
+    }
+    char* ring = desc.staged_ring;
+    // penguinStagedPointer stops handing it out
+    desc.staged_ring = NULL;
+    penguin_stage_cache_free(desc);
+    cudaDeviceSynchronize();
+    cudaFree(ring);
+    for(unsigned e = 0; e < 2 * desc.staged_slots; e++) {
+        cudaEventDestroy(desc.staged_events[e]);
+    }
+    delete[] desc.staged_events;
+    desc.staged_events = NULL;
+    desc.staged_length = 0;
+    desc.staged_slots = 0;
+    staged_ids.erase(lookup_allocation_id(desc.base));
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "unstaged %p", desc.base);
+}
+
+// Gives the allocation a ring of as many batches of length bytes as its
+// prefetch window holds, at least two; a ring of that shape is kept.
+bool penguin_stage_ring(penguin_alloc_desc& desc, unsigned long long length,
+        unsigned long long window) {
+    unsigned long long slots = length ? window / length : 0;
+    if(slots > PENGUIN_MAX_PREFETCH_DEPTH + 1) {
+        slots = PENGUIN_MAX_PREFETCH_DEPTH + 1;
+    }
+    if(desc.staged_ring != NULL && desc.staged_length == length && desc.staged_slots == slots) {
+        return true;
+    }
+    penguin_unstage_ring(desc);
+    if(slots < 2 || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return false;
+    }
+    char* ring = NULL;
+    if(cudaMalloc((void**) &ring, slots * length) != cudaSuccess) {
+        return false;
+    }
+    desc.staged_events = new cudaEvent_t[2 * slots];
+    for(unsigned e = 0; e < 2 * slots; e++) {
+        cudaEventCreateWithFlags(&desc.staged_events[e], cudaEventDisableTiming);
+    }
+    desc.staged_length = length;
+    desc.staged_slots = slots;
+    desc.staged_issued = 0;
+    desc.staged_ring = ring;
+    if(penguin_staged_compress_enabled()) {
+        penguin_stage_cache_create(desc, length);
+    }
+    staged_ids.insert(lookup_allocation_id(desc.base));
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "staged %p %llu x %llu", desc.base, slots, length);
+    return true;
+}
+
+// Batch boundary of a staged allocation: the slot of the batch before is
+// free once the kernels issued so far are done, the batches up to a full
+// ring ahead are copied as their slots free up, and the next kernel waits
+// for its own batch only.
+void penguinStagedBatch(penguin_alloc_desc& desc, unsigned iter) {
+    unsigned long long length = desc.staged_length;
+    unsigned slots = desc.staged_slots;
+    cudaEvent_t* ready = desc.staged_events;
+    cudaEvent_t* done = desc.staged_events + slots;
+    unsigned prefnum = iter / desc.prefetch_iters_per_batch;
+    if(iter == 0) {
+        desc.staged_issued = 0;
+        penguin_nvme_pass(desc);
+    }
+    if(prefnum > 0) {
+        cudaEventRecord(done[(prefnum - 1) % slots], 0);
+    }
+    for(; desc.staged_issued < prefnum + slots; desc.staged_issued++) {
+        unsigned long long batch = desc.staged_issued;
+        unsigned long long offset = batch * length;
+        if(offset >= desc.size) {
+            break;
+        }
+        unsigned slot = batch % slots;
+        if(batch >= slots) {
+            cudaStreamWaitEvent(prefetch_engine.h2d, done[slot], 0);
+        }
+        unsigned long long bytes = std::min(length, desc.size - offset);
+        char* to = desc.staged_ring + slot * length;
+        if(penguin_nvme_read(desc, slot, offset, bytes, ready[slot])) {
+            penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) desc.base + offset, bytes);
+        } else if(!penguin_staged_copy_compressed(desc, batch, to, bytes)) {
+            cudaMemcpyAsync(to, (char*) desc.base + offset, bytes, cudaMemcpyDefault, prefetch_engine.h2d);
+            penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) desc.base + offset, bytes);
+            penguin_staged_compress(desc, batch, to, bytes);
+        }
+        cudaEventRecord(ready[slot], prefetch_engine.h2d);
+    }
+    if((unsigned long long) prefnum * length < desc.size) {
+        cudaStreamWaitEvent(0, ready[prefnum % slots], 0);
+    }
+}
+
+// Called for each pointer argument of an iterative launch. The kernel
+// indexes from the allocation's base, so the pointer is moved back by the
+// offset of the batch in use, which sits at the start of its slot.
+extern "C"
+unsigned long long penguinStagedPointer(unsigned long long ptr, unsigned iter) {
+    PENGUIN_ENTRY();
+    auto id = lookup_allocation_id((void*) ptr);
+    if(id == PENGUIN_INVALID_ALLOC_ID) {
+        return ptr;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    char* ring = desc.staged_ring;
+    if(ring == NULL || desc.prefetch_iters_per_batch == 0) {
+        return ptr;
+    }
+    unsigned long long offset = ptr - (unsigned long long) desc.base;
+    unsigned long long batch = iter / desc.prefetch_iters_per_batch;
+    unsigned long long start = batch * desc.staged_length;
+    if(offset >= desc.size || start >= desc.size) {
+        return ptr;
+    }
+    return (unsigned long long) ring + (batch % desc.staged_slots) * desc.staged_length +
+        offset - start;
+}
+
+// The host is about to write p's allocation, whose compressed batches would
+// then be stale
+extern "C"
+void penguinStagedInvalidate(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto id = lookup_allocation_id(p);
+    if(id != PENGUIN_INVALID_ALLOC_ID) {
+        penguin_stage_cache_free(allocation_table[id]);
+    }
+}
+
+// Prefetch rate limiter. The look-ahead batches may fill the link while the
+// kernels stall on faults for data no batch holds, e.g. pointer chases, so
+// the look-ahead in flight on the prefetch engine is capped: every
+// PENGUIN_PREFETCH_CONTROL_US the cap halves if the GPU faults serviced,
+// counted by the driver in the event ring, rose over their average, and
+// grows by a step while NVML sees the link to the host mostly idle. The
+// batches the kernels wait on are never held back.
+typedef struct
+{
+    cudaEvent_t done;
+    unsigned long long bytes;
+} penguin_inflight_prefetch;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    unsigned long long cap;
+    unsigned long long inflight_bytes;
+    std::deque<penguin_inflight_prefetch> inflight; // in issue order
+    std::vector<cudaEvent_t> free_events;
+    std::chrono::steady_clock::time_point period_start;
+    unsigned long long period_faults; // ring count at the period start
+    double fault_rate; // average, per ms
+} penguin_prefetch_limiter_t;
+
+penguin_prefetch_limiter_t prefetch_limiter = {PTHREAD_MUTEX_INITIALIZER,
+    PENGUIN_PREFETCH_CAP_MB * 1024ULL * 1024ULL, 0, {}, {}, {}, 0, 0};
+// H2D KB/s of the devices, last NVML sample
+std::atomic<unsigned> pcie_rx_kbps(0);
+
+void penguin_limiter_reap() {
+    while(!prefetch_limiter.inflight.empty() &&
+            cudaEventQuery(prefetch_limiter.inflight.front().done) == cudaSuccess) {
+        prefetch_limiter.inflight_bytes -= prefetch_limiter.inflight.front().bytes;
+        prefetch_limiter.free_events.push_back(prefetch_limiter.inflight.front().done);
+        prefetch_limiter.inflight.pop_front();
+    }
+}
+
+void penguinPrefetchLimiterUpdate() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(now - prefetch_limiter.period_start).count();
+    if(elapsed_ms * 1000 < PENGUIN_PREFETCH_CONTROL_US) {
+        return;
+    }
+    unsigned long long faults = event_ring != NULL ? __atomic_load_n(&event_ring->faults, __ATOMIC_RELAXED) : 0;
+    bool first = prefetch_limiter.period_start == std::chrono::steady_clock::time_point();
+    unsigned long long delta = faults - prefetch_limiter.period_faults;
+    double rate = delta / elapsed_ms;
+    prefetch_limiter.period_start = now;
+    prefetch_limiter.period_faults = faults;
+    if(first) {
+        return;
+    }
+    unsigned long long max = PENGUIN_PREFETCH_CAP_MB * 1024ULL * 1024ULL;
+    penguinTopologyProbe();
+    double link_kbps = penguin_links[0][PENGUIN_HOST].bandwidth * 1e6;
+    if(delta >= PENGUIN_FAULT_RISE_MIN && rate > prefetch_limiter.fault_rate * PENGUIN_FAULT_RISE_RATIO) {
+        prefetch_limiter.cap /= 2;
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "prefetch cap %llu", prefetch_limiter.cap);
+    } else if(pcie_rx_kbps.load(std::memory_order_relaxed) < link_kbps * PENGUIN_LINK_IDLE_RATIO &&
+            prefetch_limiter.cap < max) {
+        prefetch_limiter.cap = std::min(max, prefetch_limiter.cap + PENGUIN_PREFETCH_CAP_STEP);
+    }
+    /* std::cout << "fault rate " << rate << " prefetch cap " << prefetch_limiter.cap << std::endl; */
+    prefetch_limiter.fault_rate = (3 * prefetch_limiter.fault_rate + rate) / 4;
+}
+
+// Takes bytes of the cap for a batch about to be issued on the H2D stream;
+// false leaves the batch for later
+bool penguin_limiter_admit(unsigned long long bytes) {
+    if(PENGUIN_PREFETCH_CAP_MB == 0) {
+        return true;
+    }
+    penguin_limiter_reap();
+    if(prefetch_limiter.inflight_bytes + bytes > prefetch_limiter.cap ||
+            prefetch_limiter.inflight.size() >= PENGUIN_PREFETCH_INFLIGHT) {
+        return false;
+    }
+    prefetch_limiter.inflight_bytes += bytes;
+    return true;
+}
+
+// Marks the end of the admitted batch just issued
+void penguin_limiter_issued(unsigned long long bytes) {
+    if(PENGUIN_PREFETCH_CAP_MB == 0) {
+        return;
+    }
+    cudaEvent_t done;
+    if(!prefetch_limiter.free_events.empty()) {
+        done = prefetch_limiter.free_events.back();
+        prefetch_limiter.free_events.pop_back();
+    } else if(cudaEventCreateWithFlags(&done, cudaEventDisableTiming) != cudaSuccess) {
+        prefetch_limiter.inflight_bytes -= bytes;
+        return;
+    }
+    cudaEventRecord(done, prefetch_engine.h2d);
+    prefetch_limiter.inflight.push_back(penguin_inflight_prefetch{done, bytes});
+}
+
+// Prefetch coalescing. The prefetches a scope issues are sorted by stream,
+// processor and address, and the ones that touch or overlap in VA are merged,
+// across allocations too, so that the driver takes one call for them and
+// works through each va_block once. A merged move to a GPU is widened to
+// PENGUIN_PREFETCH_ALIGN boundaries within the allocations at its ends, as
+// far as the memory the plan left (available) pays for; the rest of the
+// blocks at its ends would otherwise fault in or come with a later call,
+// partial block work done twice. Only allocations the plan pins on the GPU
+// or leaves to the driver are widened, and none while sub-ranges are set.
+// The moves go out in the order of their first prefetch, or, where a scope
+// asks for it, those to the host first, then largest first.
+// PENGUIN_PREFETCH_COALESCE=0 issues every prefetch as it comes.
+#ifndef PENGUIN_PREFETCH_ALIGN
+#define PENGUIN_PREFETCH_ALIGN PENGUIN_PLACEMENT_UNIT
+#endif
+int prefetch_coalesce_enabled = -1;
+
+static bool penguin_sub_ranges_set();
+
+bool penguin_prefetch_coalesce_enabled() {
+    if(prefetch_coalesce_enabled < 0) {
+        const char* env = getenv("PENGUIN_PREFETCH_COALESCE");
+        prefetch_coalesce_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return prefetch_coalesce_enabled;
+}
+
+bool penguin_prefetch_widenable(unsigned id) {
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].size == 0) {
+        return false;
+    }
+    Decision decision = allocation_table[id].decision;
+    return decision == PENGUIN_DEC_NONE || decision == PENGUIN_DEC_GPU_PIN ||
+        decision == PENGUIN_DEC_MIGRATE_ON_DEMAND;
+}
+
+// ID of the allocation addr is in
+unsigned penguin_enclosing_allocation_id(unsigned long long addr) {
+    auto a = allocation_interval_map.upper_bound(addr);
+    if(a == allocation_interval_map.begin()) {
+        return PENGUIN_INVALID_ALLOC_ID;
+    }
+    --a;
+    return addr < a->first + allocation_table[a->second].size ? a->second : PENGUIN_INVALID_ALLOC_ID;
+}
+
+// Widens p to PENGUIN_PREFETCH_ALIGN boundaries, by at most slack bytes
+void penguin_prefetch_align(penguin_policy_prefetch& p, unsigned long long& slack) {
+    unsigned long long base = (unsigned long long) p.base;
+    unsigned long long end = base + p.length;
+    unsigned first = penguin_enclosing_allocation_id(base);
+    unsigned last = penguin_enclosing_allocation_id(end - 1);
+    if(!penguin_prefetch_widenable(first) || !penguin_prefetch_widenable(last)) {
+        return;
+    }
+    unsigned long long lo = std::max(base / PENGUIN_PREFETCH_ALIGN * PENGUIN_PREFETCH_ALIGN,
+            (unsigned long long) allocation_table[first].base);
+    unsigned long long hi = std::min((end + PENGUIN_PREFETCH_ALIGN - 1) / PENGUIN_PREFETCH_ALIGN *
+            PENGUIN_PREFETCH_ALIGN, (unsigned long long) allocation_table[last].base + allocation_table[last].size);
+    unsigned long long growth = (base - lo) + (hi - end);
+    if(growth == 0 || growth > slack) {
+        return;
+    }
+    slack -= growth;
+    p.base = (void*) lo;
+    p.length = hi - lo;
+}
+
+void penguin_prefetch_coalesce(std::vector<penguin_policy_prefetch>& prefetches, bool by_size) {
+    if(prefetches.empty() || !penguin_prefetch_coalesce_enabled()) {
+        return;
+    }
+    std::vector<size_t> order(prefetches.size());
+    for(size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const penguin_policy_prefetch &x = prefetches[a], &y = prefetches[b];
+        if(x.stream != y.stream) {
+            return x.stream < y.stream;
+        }
+        if(x.device != y.device) {
+            return x.device < y.device;
+        }
+        return x.base != y.base ? x.base < y.base : a < b;
+    });
+    // merged moves, with the position of their first prefetch
+    std::vector<std::pair<size_t, penguin_policy_prefetch>> moves;
+    for(size_t i : order) {
+        penguin_policy_prefetch& p = prefetches[i];
+        if(p.length == 0) {
+            continue;
+        }
+        if(!moves.empty()) {
+            auto &m = moves.back();
+            char* end = (char*) m.second.base + m.second.length;
+            if(m.second.stream == p.stream && m.second.device == p.device && (char*) p.base <= end) {
+                m.second.length = std::max(end, (char*) p.base + p.length) - (char*) m.second.base;
+                m.first = std::min(m.first, i);
+                continue;
+            }
+        }
+        moves.push_back(std::make_pair(i, p));
+    }
+    // what these moves bring in may not be in the plan's accounts yet
+    unsigned long long slack = available;
+    for(auto m = moves.begin(); m != moves.end(); m++) {
+        if(m->second.device != cudaCpuDeviceId) {
+            slack -= std::min(slack, (unsigned long long) m->second.length);
+        }
+    }
+    for(auto m = moves.begin(); m != moves.end() && !penguin_sub_ranges_set(); m++) {
+        if(m->second.device != cudaCpuDeviceId) {
+            penguin_prefetch_align(m->second, slack);
+        }
+    }
+    // widening may have joined neighbours
+    for(size_t m = 1; m < moves.size(); m++) {
+        penguin_policy_prefetch &a = moves[m - 1].second, &b = moves[m].second;
+        if(a.stream == b.stream && a.device == b.device && (char*) b.base <= (char*) a.base + a.length) {
+            a.length = std::max((char*) a.base + a.length, (char*) b.base + b.length) - (char*) a.base;
+            moves[m - 1].first = std::min(moves[m - 1].first, moves[m].first);
+            moves.erase(moves.begin() + m--);
+        }
+    }
+    std::stable_sort(moves.begin(), moves.end(), [&](const std::pair<size_t, penguin_policy_prefetch>& a,
+            const std::pair<size_t, penguin_policy_prefetch>& b) {
+        if(!by_size) {
+            return a.first < b.first;
+        }
+        bool a_host = a.second.device == cudaCpuDeviceId, b_host = b.second.device == cudaCpuDeviceId;
+        return a_host != b_host ? a_host : a.second.length > b.second.length;
+    });
+    prefetches.clear();
+    for(auto m = moves.begin(); m != moves.end(); m++) {
+        prefetches.push_back(m->second);
+    }
+}
+
+// Issues the prefetches queued so far
+void penguin_prefetch_coalesce_flush() {
+    if(prefetch_coalescer.queued.empty()) {
+        return;
+    }
+    std::vector<penguin_policy_prefetch> queued;
+    queued.swap(prefetch_coalescer.queued);
+    penguin_prefetch_coalesce(queued, prefetch_coalescer.by_size);
+    for(auto p = queued.begin(); p != queued.end(); p++) {
+        penguin_mem_prefetch_now(p->base, p->length, p->device, p->stream);
+    }
+}
+
+// Coalesces the prefetches of a scope; by_size as for penguin_prefetch_coalesce,
+// taken from the outermost scope
+struct penguin_prefetch_coalesce_scope {
+    penguin_prefetch_coalesce_scope(bool by_size = false) {
+        if(prefetch_coalescer.depth++ == 0) {
+            prefetch_coalescer.by_size = by_size;
+        }
+    }
+    ~penguin_prefetch_coalesce_scope() {
+        if(--prefetch_coalescer.depth == 0) {
+            penguin_prefetch_coalesce_flush();
+        }
+    }
+};
+
+// A look-ahead batch of an iteration migration allocation, due at the first
+// iteration of its batch
+typedef struct
+{
+    penguin_alloc_desc* desc;
+    size_t length;
+    unsigned prefnum;
+    size_t max;
+    unsigned long long deadline;
+} penguin_prefetch_request;
+
+bool sortfunc_prefetch_deadline(const penguin_prefetch_request& a, const penguin_prefetch_request& b) {
+    return a.deadline < b.deadline;
+}
+
+// Issues the look-ahead batches of an iteration earliest deadline first, on
+// the H2D stream behind the batches the kernels wait on. A batch that won't
+// be across by its deadline at the sampled bandwidth, after the ones queued
+// before it, is left for a later batch boundary with the rest of its
+// allocation's window, by when it is due sooner or is the demand batch.
+// Look-ahead batches the driver says are on the GPU already are not
+// prefetched again; PENGUIN_RESIDENCY=0 prefetches them regardless.
+int residency_enabled = -1;
+
+bool penguin_residency_enabled() {
+    if(residency_enabled < 0) {
+        const char* env = getenv("PENGUIN_RESIDENCY");
+        residency_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return residency_enabled;
+}
+
+// Sets resident[i] if all of request i is resident on the GPU, in 2MB
+// pieces, with one query for all of them
+void penguin_requests_resident(std::vector<penguin_prefetch_request>& requests, std::vector<char>& resident) {
+    resident.assign(requests.size(), 0);
+    if(!penguin_residency_enabled() || requests.size() > PENGUIN_RESIDENCY_MAX_RANGES) {
+        return;
+    }
+    std::vector<penguin_residency_range> ranges(requests.size());
+    std::vector<unsigned long long> words(requests.size());
+    std::vector<unsigned long long> bitmaps;
+    std::vector<unsigned long long> first(requests.size());
+    for(unsigned i = 0; i < requests.size(); i++) {
+        penguin_prefetch_request& r = requests[i];
+        unsigned long long offset = (unsigned long long) r.prefnum * r.length;
+        ranges[i].base = (char*) r.desc->base + offset;
+        ranges[i].length = std::min((unsigned long long) r.length, r.max - offset);
+        words[i] = ((ranges[i].length + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT + 63) / 64;
+        first[i] = bitmaps.size();
+        // the CPU's row, then the GPU's
+        bitmaps.resize(bitmaps.size() + 2 * words[i], 0);
+    }
+    for(unsigned i = 0; i < requests.size(); i++) {
+        ranges[i].bitmap = bitmaps.data() + first[i];
+    }
+    if(penguinGetResidency(ranges.data(), ranges.size(), PENGUIN_PLACEMENT_UNIT, 2) != PENGUIN_OK) {
+        residency_enabled = 0;
+        return;
+    }
+    for(unsigned i = 0; i < requests.size(); i++) {
+        unsigned long long pieces = (ranges[i].length + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT;
+        const unsigned long long* gpu = ranges[i].bitmap + words[i];
+        bool all = true;
+        for(unsigned long long p = 0; p < pieces && all; p++) {
+            all = (gpu[p / 64] >> (p % 64)) & 1;
+        }
+        resident[i] = all;
+    }
+}
+
+// GPU memory in use besides the managed pages of this process resident on
+// the GPU: what cudaMemGetInfo has in use less what the driver reports of
+// the allocations, in whole PENGUIN_PLACEMENT_UNIT pieces, so a partly
+// resident piece counts as unmanaged and leaves more headroom, not less
+static bool penguin_budget_unmanaged(unsigned long long& unmanaged) {
+    size_t free_mem = 0, total_mem = 0;
+    if(!penguin_residency_enabled() || cudaMemGetInfo(&free_mem, &total_mem) != cudaSuccess) {
+        return false;
+    }
+    std::vector<penguin_residency_range> ranges;
+    std::vector<unsigned long long> words;
+    for(auto d = allocation_table.begin(); d != allocation_table.end(); d++) {
+        if(d->size == 0 || d->system) {
+            continue;
+        }
+        penguin_residency_range range = {};
+        range.base = d->base;
+        range.length = d->size;
+        ranges.push_back(range);
+        words.push_back(((d->size + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT + 63) / 64);
+    }
+    unsigned long long resident = 0;
+    for(size_t b = 0; b < ranges.size(); b += PENGUIN_RESIDENCY_MAX_RANGES) {
+        size_t count = std::min(ranges.size() - b, (size_t) PENGUIN_RESIDENCY_MAX_RANGES);
+        // the CPU's row, then the GPU's
+        std::vector<unsigned long long> bitmaps;
+        std::vector<size_t> first(count);
+        for(size_t i = 0; i < count; i++) {
+            first[i] = bitmaps.size();
+            bitmaps.resize(bitmaps.size() + 2 * words[b + i], 0);
+        }
+        for(size_t i = 0; i < count; i++) {
+            ranges[b + i].bitmap = bitmaps.data() + first[i];
+        }
+        if(penguinGetResidency(ranges.data() + b, count, PENGUIN_PLACEMENT_UNIT, 2) != PENGUIN_OK) {
+            return false;
+        }
+        for(size_t i = 0; i < count; i++) {
+            const unsigned long long* gpu = ranges[b + i].bitmap + words[b + i];
+            unsigned long long pieces = 0;
+            for(unsigned long long w = 0; w < words[b + i]; w++) {
+                pieces += __builtin_popcountll(gpu[w]);
+            }
+            resident += std::min(pieces * PENGUIN_PLACEMENT_UNIT, (unsigned long long) ranges[b + i].length);
+        }
+    }
+    unsigned long long used = total_mem - free_mem;
+    unmanaged = used > resident ? used - resident : 0;
+    return true;
+}
+
+void penguinPrefetchSchedule(std::vector<penguin_prefetch_request>& requests, unsigned iter) {
+    // deadline order, the neighbouring batches of one allocation merged
+    penguin_prefetch_coalesce_scope coalesce;
+    std::stable_sort(requests.begin(), requests.end(), sortfunc_prefetch_deadline);
+    std::vector<char> resident;
+    penguin_requests_resident(requests, resident);
+    pthread_mutex_lock(&prefetch_limiter.lock);
+    penguinPrefetchLimiterUpdate();
+    double queued_ms = 0;
+    std::set<penguin_alloc_desc*> deferred;
+    for(auto r = requests.begin(); r != requests.end(); r++) {
+        penguin_alloc_desc& desc = *r->desc;
+        if(deferred.find(&desc) != deferred.end()) {
+            continue;
+        }
+        if(resident[r - requests.begin()]) {
+            /* std::cout << "resident " << desc.base << " batch " << r->prefnum << std::endl; */
+            desc.prefetch_issued = r->prefnum + 1;
+            continue;
+        }
+        // unsampled allocations are issued as they come
+        if(desc.batch_xfer_ms > 0 && desc.batch_compute_ms > 0) {
+            double due_ms = (double) desc.batch_compute_ms * (r->deadline - iter) / desc.prefetch_iters_per_batch;
+            if(queued_ms + desc.batch_xfer_ms > due_ms) {
+                /* std::cout << "deferred " << desc.base << " batch " << r->prefnum << std::endl; */
+                PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "deferred %p batch %u", desc.base, r->prefnum);
+                deferred.insert(&desc);
+                continue;
+            }
+        }
+        unsigned long long offset = (unsigned long long) r->prefnum * r->length;
+        unsigned long long bytes = std::min((unsigned long long) r->length, r->max - offset);
+        if(!penguin_limiter_admit(bytes)) {
+            /* std::cout << "over the prefetch cap " << desc.base << " batch " << r->prefnum << std::endl; */
+            deferred.insert(&desc);
+            continue;
+        }
+        if(desc.batch_xfer_ms > 0 && desc.batch_compute_ms > 0) {
+            queued_ms += desc.batch_xfer_ms;
+        }
+        penguinPrefetchBatch(desc, r->length, r->prefnum, r->max, !desc.xfer_sample);
+        penguin_limiter_issued(bytes);
+    }
+    pthread_mutex_unlock(&prefetch_limiter.lock);
+}
+
+// The iterations after inner iteration n of (outer) iteration m, in the
+// order the host loops run them
+bool penguin_prefetch_next(unsigned long long& n, unsigned long long& m, long long& start) {
+    if(n + 1 < prefetch_inner.trips) {
+        n++;
+        return true;
+    }
+    if(!prefetch_outer.known || m + 1 >= prefetch_outer.trips) {
+        return false;
+    }
+    // the next inner loop is taken to have as many iterations as this one
+    n = 0;
+    m++;
+    start += prefetch_outer.step;
+    return true;
+}
+
+// Iteration prefetch for host loops that run backwards, with a step other
+// than 1, or nested in an outer loop that moves the inner one's start: the
+// batch of an iteration is still the one of its induction variable, but a
+// batch starts wherever that crosses a batch boundary, the look-ahead is the
+// next prefetch_depth batches the iterations to come reach, in the order
+// they reach them, and the batches the window holds that none of them needs
+// leave the GPU. The look-ahead is issued directly, not through
+// penguinPrefetchSchedule, whose deadlines count iterations upwards.
+void penguinSuperPrefetchOrdered(penguin_alloc_desc& desc, size_t length, unsigned iter,
+        unsigned iterPerBatch, size_t max) {
+    unsigned long long n;
+    if(!penguin_prefetch_position(iter, n)) {
+        return;
+    }
+    unsigned batch = iter / iterPerBatch;
+    if(desc.prefetch_batch == (unsigned long long) batch + 1 && n != 0) {
+        return;
+    }
+    desc.prefetch_batch = (unsigned long long) batch + 1;
+    if((unsigned long long) batch * length >= max || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    penguinUpdatePrefetchDepth(desc, length, iter, iterPerBatch);
+    // the batches of the iterations to come, nearest first
+    std::vector<unsigned> ahead;
+    unsigned long long m = penguin_prefetch_outer_position();
+    long long start = prefetch_inner.start;
+    for(unsigned scanned = 0; ahead.size() < desc.prefetch_depth && scanned < PENGUIN_PREFETCH_SCAN &&
+            penguin_prefetch_next(n, m, start); scanned++) {
+        long long next = start + prefetch_inner.step * (long long) n;
+        if(next < 0 || (unsigned long long) (next / iterPerBatch) * length >= max) {
+            continue;
+        }
+        unsigned b = next / iterPerBatch;
+        if(b != batch && std::find(ahead.begin(), ahead.end(), b) == ahead.end()) {
+            ahead.push_back(b);
+        }
+    }
+    auto reserved = [&](unsigned b) {
+        unsigned long long offset = (unsigned long long) b * length;
+        return desc.gpu_res_start <= offset && offset + length < desc.gpu_res_stop;
+    };
+    // what the window no longer needs leaves once the kernels using it are
+    // done, and the incoming batches need the room it frees
+    bool evicted = false;
+    unsigned kept = 0;
+    for(unsigned r = 0; r < desc.prefetch_resident_count; r++) {
+        unsigned b = desc.prefetch_resident[r];
+        if(b == batch || std::find(ahead.begin(), ahead.end(), b) != ahead.end()) {
+            desc.prefetch_resident[kept++] = b;
+            continue;
+        }
+        if(!evicted) {
+            cudaEventRecord(prefetch_engine.compute_done, 0);
+            cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+            evicted = true;
+        }
+        unsigned long long offset = (unsigned long long) b * length;
+        unsigned long long bytes = std::min((unsigned long long) length, max - offset);
+        penguin_mem_prefetch((char*) desc.base + offset, bytes, -1, prefetch_engine.d2h);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) desc.base + offset, bytes);
+    }
+    desc.prefetch_resident_count = kept;
+    if(evicted) {
+        cudaEventRecord(prefetch_engine.evict_done, prefetch_engine.d2h);
+        cudaStreamWaitEvent(prefetch_engine.h2d, prefetch_engine.evict_done, 0);
+    }
+    auto fetch = [&](unsigned b, bool timed) {
+        if(reserved(b) || std::find(desc.prefetch_resident, desc.prefetch_resident +
+                    desc.prefetch_resident_count, b) != desc.prefetch_resident + desc.prefetch_resident_count ||
+                desc.prefetch_resident_count > PENGUIN_MAX_PREFETCH_DEPTH) {
+            return;
+        }
+        penguin_prefetch_batch_copy(desc, length, b, max, timed);
+        desc.prefetch_resident[desc.prefetch_resident_count++] = b;
+    };
+    // fence the next kernel on this batch only, then run ahead
+    fetch(batch, false);
+    cudaEventRecord(prefetch_engine.batch_ready, prefetch_engine.h2d);
+    cudaStreamWaitEvent(0, prefetch_engine.batch_ready, 0);
+    if(desc.compute_sample == 0) {
+        cudaEventRecord(desc.compute_start, 0);
+        desc.compute_sample = 1;
+    }
+    for(auto b : ahead) {
+        fetch(b, !desc.xfer_sample);
+    }
+}
+
+// With requests, the look-ahead batches are added to them for
+// penguinPrefetchSchedule rather than issued
+void penguinSuperPrefetchDesc(penguin_alloc_desc& desc, size_t length, unsigned iter, unsigned iterPerBatch, size_t max,
+        std::vector<penguin_prefetch_request>* requests = NULL) {
+    /* counter++; */
+    if (length == 0) return;
+    if(desc.staged_ring != NULL) {
+        if(iter % iterPerBatch == 0) {
+            penguinStagedBatch(desc, iter);
+        }
+        return;
+    }
+    if(penguin_prefetch_ordered()) {
+        penguinSuperPrefetchOrdered(desc, length, iter, iterPerBatch, max);
+        return;
+    }
+    if ((iter % iterPerBatch) == 0) {
+        if(penguinPrefetchEngineInit() != PENGUIN_OK) {
+            return;
+        }
+        void *base = desc.base;
+        unsigned prefnum = iter / iterPerBatch;
+        if(iter == 0) {
+            desc.prefetch_issued = 0;
+            desc.prefetch_evicted = 0;
+        }
+        printf("base = %p prefnum = %u; iter = %u; length = %llu\n", base, prefnum, iter, length);
+        auto pref_addr = (unsigned long long) prefnum*length;
+        if(pref_addr >= max) {
+            return;
+        }
+        if(desc.gpu_res_start <= pref_addr &&
+                (pref_addr + length) < desc.gpu_res_stop){
+            return;
+        }
+        /* std::cout << "pref_addr = " << pref_addr << std::endl; */
+        /* std::cout << "alloc start on gpu = " << desc.gpu_res_start << std::endl; */
+        /* std::cout << "alloc stop on gpu = " << desc.gpu_res_stop << std::endl; */
+        penguinUpdatePrefetchDepth(desc, length, iter, iterPerBatch);
+
+        if(desc.prefetch_evicted < prefnum) {
+            /* std::cout << "revpref\n"; */
+            // batches behind the window leave once the kernels using them are done
+            cudaEventRecord(prefetch_engine.compute_done, 0);
+            cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+            for(; desc.prefetch_evicted < prefnum; desc.prefetch_evicted++) {
+                penguin_mem_prefetch((char*)base + ((unsigned long long) desc.prefetch_evicted*length),
+                        length, -1, prefetch_engine.d2h);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_D2H,
+                        (unsigned long long) base + (unsigned long long) desc.prefetch_evicted*length, length);
+                desc.gpu_res_start += length;
+                desc.gpu_res_stop += length;
+            }
+            cudaEventRecord(prefetch_engine.evict_done, prefetch_engine.d2h);
+            // and the incoming batches need the room they free
+            cudaStreamWaitEvent(prefetch_engine.h2d, prefetch_engine.evict_done, 0);
+        }
+        /* std::cout << "pre\n"; */
+        penguinPrefetchBatch(desc, length, prefnum, max, false);
+        // fence the next kernel on this batch only, then run ahead
+        cudaEventRecord(prefetch_engine.batch_ready, prefetch_engine.h2d);
+        cudaStreamWaitEvent(0, prefetch_engine.batch_ready, 0);
+        if(desc.compute_sample == 0) {
+            cudaEventRecord(desc.compute_start, 0);
+            desc.compute_sample = 1;
+        }
+        for(unsigned ahead = 1; ahead <= desc.prefetch_depth; ahead++) {
+            unsigned batch = prefnum + ahead;
+            if(requests == NULL) {
+                penguinPrefetchBatch(desc, length, batch, max, !desc.xfer_sample);
+            } else if(batch >= desc.prefetch_issued && (unsigned long long) batch * length < max) {
+                requests->push_back(penguin_prefetch_request{&desc, length, batch, max,
+                        (unsigned long long) batch * iterPerBatch});
+            }
+        }
+    }
+    return;
+}
+
+// A range of an allocation with a decision of its own, from the analysis:
+// the sub-allocations of CudaHostTransform, e.g. a halo pinned while the
+// interior streams. The planner's decision of the allocation covers the rest
+// of it, and is carried out first, see mmg_apply_decision.
+struct penguin_sub_range {
+    unsigned long long offset;
+    unsigned long long length;
+    Decision decision;
+    // eviction level of the GPU part, see penguinSetPrioritizedLocationLevel
+    unsigned priority;
+    // PENGUIN_DEC_ITERATION_MIGRATION: batches of prefetch_size bytes, one
+    // every prefetch_iters_per_batch iterations
+    unsigned long long prefetch_size;
+    unsigned long long prefetch_iters_per_batch;
+};
+
+// allocation ID -> its sub-ranges, by offset
+std::map<unsigned, std::vector<penguin_sub_range>> sub_ranges;
+std::atomic<unsigned> sub_range_allocations(0);
+// gcd of the sub-ranges' prefetch_iters_per_batch, which the planner folds
+// into penguin_prefetch_period
+unsigned penguin_sub_range_period = 0;
+
+static bool penguin_sub_ranges_set() {
+    return sub_range_allocations.load() > 0;
+}
+
+// With the previous batch of the range evicted, the batch of iteration iter
+// goes to the GPU and the next kernel waits for it
+void penguin_sub_range_batch(penguin_alloc_desc& desc, const penguin_sub_range& range, unsigned iter) {
+    if(range.decision != PENGUIN_DEC_ITERATION_MIGRATION || range.prefetch_size == 0 ||
+            range.prefetch_iters_per_batch == 0 || iter % range.prefetch_iters_per_batch != 0) {
+        return;
+    }
+    unsigned long long prefnum = iter / range.prefetch_iters_per_batch;
+    unsigned long long offset = prefnum * range.prefetch_size;
+    if(offset >= range.length || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    char* base = (char*) desc.base + range.offset;
+    if(prefnum > 0) {
+        cudaEventRecord(prefetch_engine.compute_done, 0);
+        cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+        penguin_mem_prefetch(base + offset - range.prefetch_size, range.prefetch_size, -1,
+                prefetch_engine.d2h);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_D2H,
+                (unsigned long long) base + offset - range.prefetch_size, range.prefetch_size);
+        cudaEventRecord(prefetch_engine.evict_done, prefetch_engine.d2h);
+        cudaStreamWaitEvent(prefetch_engine.h2d, prefetch_engine.evict_done, 0);
+    }
+    unsigned long long length = std::min(range.prefetch_size, range.length - offset);
+    penguin_mem_prefetch(base + offset, length, desc.device, prefetch_engine.h2d);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) base + offset, length);
+    cudaEventRecord(prefetch_engine.batch_ready, prefetch_engine.h2d);
+    cudaStreamWaitEvent(0, prefetch_engine.batch_ready, 0);
+}
+
+// The batches the sub-ranges of allocation id, or of every allocation with
+// sub-ranges, start at iteration iter. Unlike the allocations' batches these
+// take the registry lock, and only an iteration of a program with sub-ranges
+// pays for it.
+void penguin_sub_range_iteration(unsigned iter, unsigned id = PENGUIN_INVALID_ALLOC_ID) {
+    if(sub_range_allocations.load() == 0) {
+        return;
+    }
+    penguin_registry_scope scope;
+    for(auto s = sub_ranges.begin(); s != sub_ranges.end(); s++) {
+        if(id != PENGUIN_INVALID_ALLOC_ID && s->first != id) {
+            continue;
+        }
+        for(auto range = s->second.begin(); range != s->second.end(); range++) {
+            penguin_sub_range_batch(allocation_table[s->first], *range, iter);
+        }
+    }
+}
+
+extern "C"
+void penguinSubRangeIteration(void *base, unsigned iter) {
+    PENGUIN_ENTRY();
+    auto id = lookup_allocation_id(base);
+    if(id != PENGUIN_INVALID_ALLOC_ID) {
+        penguin_sub_range_iteration(iter, id);
+    }
+}
+
+extern "C"
+void penguinSuperPrefetch(void *base, size_t length, unsigned iter, unsigned iterPerBatch, size_t max) {
+    PENGUIN_ENTRY();
+    penguinSuperPrefetchDesc(allocation_desc(base), length, iter, iterPerBatch, max);
+}
+
+extern "C"
+void penguinSuperPrefetchWrapper(unsigned iter) {
+    PENGUIN_ENTRY();
+    if(!penguin_planning()) {
+        return;
+    }
+    //get parameters from the descriptor table and call penguinSuperPrefetch
+    /* std::cout << "penguinSuperPrefetchWrapper " << iter << "\n"; */
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "iteration %u", iter);
+    penguin_trace(PENGUIN_TRACE_ITERATION, iter, 0);
+    unsigned ids[PENGUIN_MAX_PREFETCH_ALLOCS];
+    unsigned count = prefetch_alloc_ids.snapshot(ids);
+    // the batches the next kernels wait on first, then the look-ahead of
+    // every allocation by when it is needed
+    std::vector<penguin_prefetch_request> requests;
+    for(unsigned i = 0; i < count; i++) {
+        penguin_alloc_desc& desc = allocation_table[ids[i]];
+        /* std::cout << "pspw says prefetch iter " << desc.base << " " << iter << "\n"; */
+        penguinSuperPrefetchDesc(desc, desc.prefetch_size, iter,
+                desc.prefetch_iters_per_batch, desc.size, &requests);
+        /* penguinSuperPrefetch(desc.base, 512*1024*1024, iter, 128, desc.size); */
+    }
+    if(!requests.empty()) {
+        penguinPrefetchSchedule(requests, iter);
+    }
+    penguin_sub_range_iteration(iter);
+}
+
+void* nvml_monitor(void* argp) {
+    /* printf("ellloooo\n"); */
+    if(!penguin_nvml_ready()) {
+        printf("unable to init nvml\n");
+        return NULL;
+    }
+    // the devices allocations are placed on. A MIG instance gets its share
+    // of the counters of its GPU, see penguin_mig.
+    std::vector<nvmlDevice_t> devices;
+    std::vector<double> shares;
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        nvmlDevice_t device_;
+        if(penguin_nvml_device(d, &device_)) {
+            devices.push_back(device_);
+            shares.push_back(penguin_mig(d).share);
+        }
+    }
+    unsigned tx;
+    unsigned rx;
+    // KB/s times microseconds, so the totals below are in KB
+    unsigned long long total_tx = 0;
+    unsigned long long total_rx = 0;
+    unsigned long long count = 0;
+    // energy counters of the devices when the monitor started, in mJ; 0 for
+    // a device that has none (before Volta)
+    std::vector<unsigned long long> energy_base(devices.size(), 0);
+    for(size_t d = 0; d < devices.size(); d++) {
+        nvmlDeviceGetTotalEnergyConsumption(devices[d], &energy_base[d]);
+    }
+    telemetry_tx_kb.store(0);
+    telemetry_rx_kb.store(0);
+    telemetry_energy_mj.store(0);
+    telemetry_sm_mhz.store(0);
+    telemetry_mem_mhz.store(0);
+    telemetry_util.store(0);
+    telemetry_samples.store(0);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(nvml_running == 1) {
+        tx = 0;
+        rx = 0;
+        unsigned long long energy = 0;
+        unsigned sm = 0, mem = 0, util = 0;
+        for(size_t d = 0; d < devices.size(); d++) {
+            unsigned device_tx = 0;
+            unsigned device_rx = 0;
+            nvmlDeviceGetPcieThroughput(devices[d], NVML_PCIE_UTIL_TX_BYTES, &device_tx);
+            nvmlDeviceGetPcieThroughput(devices[d], NVML_PCIE_UTIL_RX_BYTES, &device_rx);
+            tx += device_tx * shares[d];
+            rx += device_rx * shares[d];
+            unsigned long long device_energy = 0;
+            if(energy_base[d] != 0 &&
+                    nvmlDeviceGetTotalEnergyConsumption(devices[d], &device_energy) == NVML_SUCCESS &&
+                    device_energy > energy_base[d]) {
+                energy += (device_energy - energy_base[d]) * shares[d];
+            }
+            unsigned device_sm = 0, device_mem = 0;
+            nvmlUtilization_t device_util = {};
+            nvmlDeviceGetClockInfo(devices[d], NVML_CLOCK_SM, &device_sm);
+            nvmlDeviceGetClockInfo(devices[d], NVML_CLOCK_MEM, &device_mem);
+            nvmlDeviceGetUtilizationRates(devices[d], &device_util);
+            sm += device_sm;
+            mem += device_mem;
+            util += device_util.gpu;
+        }
+        // the clocks and the utilization averaged over the devices
+        if(!devices.empty()) {
+            sm /= devices.size();
+            mem /= devices.size();
+            util /= devices.size();
+        }
+        /* printf("throughput = %u %u\n", tx, rx); */
+        penguin_trace(PENGUIN_TRACE_PCIE, tx, rx);
+        penguin_trace(PENGUIN_TRACE_ENERGY, energy, util);
+        penguin_trace(PENGUIN_TRACE_CLOCK, sm, mem);
+        pcie_rx_kbps.store(rx, std::memory_order_relaxed);
+        total_tx += (unsigned long long) tx * telemetry_period_us;
+        total_rx += (unsigned long long) rx * telemetry_period_us;
+        telemetry_tx_kb.store(total_tx / 1000000, std::memory_order_relaxed);
+        telemetry_rx_kb.store(total_rx / 1000000, std::memory_order_relaxed);
+        telemetry_energy_mj.store(energy, std::memory_order_relaxed);
+        telemetry_sm_mhz.fetch_add(sm, std::memory_order_relaxed);
+        telemetry_mem_mhz.fetch_add(mem, std::memory_order_relaxed);
+        telemetry_util.fetch_add(util, std::memory_order_relaxed);
+        telemetry_samples.fetch_add(1, std::memory_order_relaxed);
+        count ++;
+        next.tv_nsec += telemetry_period_us * 1000ULL;
+        while(next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    printf("total TX PCIe = %llu\n", total_tx / 1000000);
+    printf("total RX PCIe = %llu\n", total_rx / 1000000);
+    printf("total energy = %.3f J\n", telemetry_energy_mj.load() / 1e3);
+    /* printf("count = %u\n", count); */
+    return NULL;
+}
+
+void nvml_start() {
+#if NVML_PROFILER
+    // probed here, the monitor only reads them
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        penguin_mig(d);
+    }
+    nvml_running = 1;
+    pthread_create(&monitor, NULL, nvml_monitor, NULL);
+#endif
+}
+
+void nvml_stop() {
+#if NVML_PROFILER
+    nvml_running = 0;
+    /* printf("nvml: running = 0\n"); */
+    pthread_join(monitor, NULL);
+#endif
+}
+
+// Per-kernel timing. The host transform brackets every cudaLaunchKernel with
+// penguinKernelBegin/End, which record an event pair on the launch's stream
+// while statistics are collected; pairs are folded into per-kernel totals
+// when PENGUIN_MAX_KERNEL_TIMINGS are pending and at the end of collection.
+#define PENGUIN_MAX_KERNEL_TIMINGS 4096
+
+typedef struct
+{
+    const void* func;
+    cudaEvent_t start;
+    cudaEvent_t end;
+    unsigned long long* energy; // mJ at the start and the end, with PENGUIN_KERNEL_ENERGY
+} penguin_kernel_timing;
+
+typedef struct
+{
+    unsigned long long launches;
+    double ms;
+    unsigned long long energy_mj;
+} penguin_kernel_stats;
+
+bool metrics_collecting = false;
+std::chrono::steady_clock::time_point metrics_start;
+std::vector<penguin_kernel_timing> kernel_timings;
+std::vector<cudaEvent_t> kernel_event_pool;
+std::map<const void*, penguin_kernel_stats> kernel_stats;
+// the last penguinKernelBegin is waiting for its end, on this stream
+bool kernel_timing_open = false;
+cudaStream_t kernel_timing_stream = 0;
+// kernel energy, off by default: the marks the stream runs around a kernel
+// are in its time; they read what the monitor last sampled, so a kernel
+// shorter than the telemetry period may get nothing or a whole period
+penguin_telemetry_totals metrics_telemetry_start;
+int kernel_energy_enabled = -1;
+
+bool penguin_kernel_energy_enabled() {
+    if(kernel_energy_enabled < 0) {
+        const char* env = getenv("PENGUIN_KERNEL_ENERGY");
+        kernel_energy_enabled = env != NULL && strcmp(env, "0") != 0;
+    }
+    return kernel_energy_enabled;
+}
+
+void CUDART_CB penguin_energy_mark(void* p) {
+    *(unsigned long long*) p = telemetry_energy_mj.load(std::memory_order_relaxed);
+}
+
+cudaEvent_t penguin_kernel_event() {
+    cudaEvent_t event = NULL;
+    if(!kernel_event_pool.empty()) {
+        event = kernel_event_pool.back();
+        kernel_event_pool.pop_back();
+    } else if(cudaEventCreate(&event) != cudaSuccess) {
+        event = NULL;
+    }
+    return event;
+}
+
+// Waits for the pending pairs and adds them to kernel_stats
+void penguin_fold_kernel_timings() {
+    for(auto &t : kernel_timings) {
+        float ms = 0;
+        if(cudaEventSynchronize(t.end) == cudaSuccess &&
+                cudaEventElapsedTime(&ms, t.start, t.end) == cudaSuccess) {
+            penguin_kernel_stats &k = kernel_stats[t.func];
+            k.launches++;
+            k.ms += ms;
+            if(t.energy != NULL && t.energy[1] > t.energy[0]) {
+                k.energy_mj += t.energy[1] - t.energy[0];
+            }
+        }
+        delete[] t.energy;
+        kernel_event_pool.push_back(t.start);
+        kernel_event_pool.push_back(t.end);
+    }
+    kernel_timings.clear();
+    kernel_timing_open = false;
+}
+
+// Driver counters per kernel and per invocation id. Every launch snapshots
+// them (UVM_SNAPSHOT_STAT_COLLECTION) and gives what the driver counted
+// since the previous launch to the kernel and invocation of that one; the
+// end of the collection gives the rest to the last. Launches are
+// asynchronous, so a kernel's epoch runs from its launch to the next one,
+// not over its execution. PENGUIN_EPOCH_STATS=0 turns the snapshots off, as
+// does a driver without the ioctl.
+int epoch_stats_enabled = -1;
+// tag of the epoch running and the launch that began it, NULL if none did
+unsigned long long epoch_tag = 0;
+const void* epoch_func = NULL;
+unsigned epoch_invocation = PENGUIN_NO_INVOCATION;
+std::map<const void*, penguin_range_stats> kernel_epoch_stats;
+std::map<unsigned, penguin_range_stats> invocation_epoch_stats;
+
+bool penguin_epoch_stats_enabled() {
+    if(epoch_stats_enabled < 0) {
+        const char* env = getenv("PENGUIN_EPOCH_STATS");
+        epoch_stats_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return epoch_stats_enabled;
+}
+
+void penguin_range_stats_add(penguin_range_stats& total, const penguin_range_stats& r) {
+    total.faults += r.faults;
+    total.bytes_h2d += r.bytes_h2d;
+    total.bytes_d2h += r.bytes_d2h;
+    total.evictions += r.evictions;
+    total.thrashing += r.thrashing;
+    total.ac_notifications += r.ac_notifications;
+    total.markov_predictions += r.markov_predictions;
+    total.markov_hits += r.markov_hits;
+}
+
+// Empties the epochs for a new collection; the driver's start tags its
+// first epoch 0
+void penguin_epoch_start() {
+    kernel_epoch_stats.clear();
+    invocation_epoch_stats.clear();
+    epoch_tag = 0;
+    epoch_func = NULL;
+    epoch_invocation = PENGUIN_NO_INVOCATION;
+}
+
+// Ends the epoch running and begins the one of a launch of func for
+// invocation invid, or none with func NULL
+void penguin_epoch_snapshot(const void* func, unsigned invid) {
+    if(!penguin_epoch_stats_enabled() || penguin_uvm_fd() < 0) {
+        return;
+    }
+    penguin_snapshot_stat_collection_params request = {};
+    int status;
+    request.epoch = epoch_tag + 1;
+    if((status = penguin_ioctl(PENGUIN_SNAPSHOT_STAT_COLLECTION_IOCTL_NUM, &request)) != 0 ||
+            (status = request.status) != 0) {
+        epoch_stats_enabled = 0;
+        return;
+    }
+    // a snapshot of someone else in between leaves the epoch to no one
+    if(request.previous_epoch == epoch_tag && epoch_func != NULL) {
+        penguin_range_stats_add(kernel_epoch_stats[epoch_func], request.stats);
+        if(epoch_invocation != PENGUIN_NO_INVOCATION) {
+            penguin_range_stats_add(invocation_epoch_stats[epoch_invocation], request.stats);
+        }
+    }
+    epoch_tag = request.epoch;
+    epoch_func = func;
+    epoch_invocation = invid;
+}
+
+extern "C"
+void penguinKernelBegin(const void* func, cudaStream_t stream) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!metrics_collecting) {
+        return;
+    }
+    penguin_epoch_snapshot(func, launch_invocation);
+    if(kernel_timings.size() >= PENGUIN_MAX_KERNEL_TIMINGS) {
+        penguin_fold_kernel_timings();
+    }
+    penguin_kernel_timing t;
+    t.func = func;
+    t.start = penguin_kernel_event();
+    t.end = penguin_kernel_event();
+    t.energy = NULL;
+    if(t.start == NULL || t.end == NULL || cudaEventRecord(t.start, stream) != cudaSuccess) {
+        return;
+    }
+    if(penguin_kernel_energy_enabled()) {
+        t.energy = new unsigned long long[2]();
+        cudaLaunchHostFunc(stream, penguin_energy_mark, t.energy);
+    }
+    kernel_timings.push_back(t);
+    kernel_timing_open = true;
+    kernel_timing_stream = stream;
+}
+
+extern "C"
+void penguinKernelEnd() {
+    PENGUIN_LOCKED_ENTRY();
+    if(!kernel_timing_open) {
+        return;
+    }
+    kernel_timing_open = false;
+    // the end mark runs before the end event, which the fold waits for
+    if(kernel_timings.back().energy != NULL) {
+        cudaLaunchHostFunc(kernel_timing_stream, penguin_energy_mark, kernel_timings.back().energy + 1);
+    }
+    if(cudaEventRecord(kernel_timings.back().end, kernel_timing_stream) != cudaSuccess) {
+        delete[] kernel_timings.back().energy;
+        kernel_event_pool.push_back(kernel_timings.back().start);
+        kernel_event_pool.push_back(kernel_timings.back().end);
+        kernel_timings.pop_back();
+    }
+}
+
+#if PENGUIN_ACCESS_SAMPLING
+// Sampled accesses per 2MB block: slot i counts the block
+// penguin_sample_keys[i] - 1, probed for linearly from a hash of the block
+__device__ unsigned long long penguin_sample_keys[PENGUIN_SAMPLE_SLOTS];
+__device__ unsigned long long penguin_sample_counts[PENGUIN_SAMPLE_SLOTS];
+// accesses of blocks that found no slot
+__device__ unsigned long long penguin_sample_dropped;
+// one thread in this many has its accesses counted, PENGUIN_SAMPLE_PERIOD
+__device__ unsigned int penguin_sample_period = 64;
+
+// Called before every global load and store of the kernels
+// (penguin-access-sampling), with the address accessed
+extern "C" __device__ __attribute__((used, noinline))
+void penguin_sample_access(const void* p) {
+    unsigned long long block = ((unsigned long long) blockIdx.z * gridDim.y + blockIdx.y) *
+        gridDim.x + blockIdx.x;
+    unsigned long long thread = block * blockDim.x * blockDim.y * blockDim.z +
+        (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x + threadIdx.x;
+    if(thread % penguin_sample_period != 0) {
+        return;
+    }
+    unsigned long long key = ((unsigned long long) p >> 21) + 1;
+    unsigned slot = (unsigned) ((key * 0x9E3779B97F4A7C15ULL) >> 40) & (PENGUIN_SAMPLE_SLOTS - 1);
+    for(unsigned probe = 0; probe < 32; probe++) {
+        unsigned long long owner = atomicCAS(&penguin_sample_keys[slot], 0ULL, key);
+        if(owner == 0 || owner == key) {
+            atomicAdd(&penguin_sample_counts[slot], 1ULL);
+            return;
+        }
+        slot = (slot + 1) & (PENGUIN_SAMPLE_SLOTS - 1);
+    }
+    atomicAdd(&penguin_sample_dropped, 1ULL);
+}
+#endif
+
+// Predicted-versus-measured accesses, one row per aid, which
+// penguinStopStatCollection writes when built with PENGUIN_ACCESS_SAMPLING
+#define PENGUIN_SAMPLE_REPORT_FILE "penguin_access_samples.csv"
+
+// access counts the host transform predicted for every aid, summed over the
+// invocations, and the largest working set it predicted for it
+std::map<unsigned, unsigned long long> sampled_predicted_ac;
+std::map<unsigned, unsigned long long> sampled_predicted_wss;
+
+unsigned penguin_sample_period_value() {
+    const char* env = getenv("PENGUIN_SAMPLE_PERIOD");
+    long long period = env != NULL ? atoll(env) : 64;
+    return period >= 1 ? (unsigned) period : 1;
+}
+
+// Empties the device histogram and the predictions for a new collection
+void penguin_sampling_start() {
+#if PENGUIN_ACCESS_SAMPLING
+    sampled_predicted_ac.clear();
+    sampled_predicted_wss.clear();
+    unsigned period = penguin_sample_period_value();
+    void* keys;
+    void* counts;
+    unsigned long long dropped = 0;
+    if(cudaMemcpyToSymbol(penguin_sample_period, &period, sizeof(period)) != cudaSuccess ||
+            cudaMemcpyToSymbol(penguin_sample_dropped, &dropped, sizeof(dropped)) != cudaSuccess ||
+            cudaGetSymbolAddress(&keys, penguin_sample_keys) != cudaSuccess ||
+            cudaGetSymbolAddress(&counts, penguin_sample_counts) != cudaSuccess ||
+            cudaMemset(keys, 0, sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess ||
+            cudaMemset(counts, 0, sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess) {
+        fprintf(stderr, "unable to reset the access samples\n");
+    }
+#endif
+}
+
+// Reads the histogram back and writes PENGUIN_SAMPLE_REPORT_FILE. A block's
+// samples go to the allocations it overlaps in proportion to the overlap,
+// scaled by the sample period; the measured working set of an allocation is
+// the part of it in the blocks accessed. An aid gets the measurements of its
+// allocation, which other aids may share.
+void penguin_sampling_report() {
+#if PENGUIN_ACCESS_SAMPLING
+    std::vector<unsigned long long> keys(PENGUIN_SAMPLE_SLOTS);
+    std::vector<unsigned long long> counts(PENGUIN_SAMPLE_SLOTS);
+    unsigned long long dropped = 0;
+    if(cudaDeviceSynchronize() != cudaSuccess ||
+            cudaMemcpyFromSymbol(keys.data(), penguin_sample_keys,
+                sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess ||
+            cudaMemcpyFromSymbol(counts.data(), penguin_sample_counts,
+                sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess ||
+            cudaMemcpyFromSymbol(&dropped, penguin_sample_dropped, sizeof(dropped)) != cudaSuccess) {
+        fprintf(stderr, "unable to read the access samples\n");
+        return;
+    }
+    unsigned long long period = penguin_sample_period_value();
+    std::map<unsigned, double> measured_ac;
+    std::map<unsigned, unsigned long long> measured_wss;
+    for(unsigned slot = 0; slot < PENGUIN_SAMPLE_SLOTS; slot++) {
+        if(keys[slot] == 0) {
+            continue;
+        }
+        unsigned long long first = (keys[slot] - 1) << 21;
+        unsigned long long last = first + (2ULL << 20);
+        auto a = allocation_interval_map.upper_bound(first);
+        if(a != allocation_interval_map.begin()) {
+            --a;
+        }
+        for(; a != allocation_interval_map.end() && a->first < last; ++a) {
+            unsigned long long base = a->first;
+            unsigned long long end = base + allocation_table[a->second].size;
+            unsigned long long lo = std::max(base, first);
+            unsigned long long hi = std::min(end, last);
+            if(lo >= hi) {
+                continue;
+            }
+            measured_ac[a->second] += (double) counts[slot] * period * (hi - lo) / (last - first);
+            measured_wss[a->second] += hi - lo;
+        }
+    }
+    FILE* f = fopen(PENGUIN_SAMPLE_REPORT_FILE, "w");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", PENGUIN_SAMPLE_REPORT_FILE);
+        return;
+    }
+    fprintf(f, "aid,allocation,predicted_ac,measured_ac,predicted_wss,measured_wss\n");
+    for(auto &aid : aid_allocation_map) {
+        long long id = -1;
+        unsigned long long addr = (unsigned long long) aid.second;
+        auto a = allocation_interval_map.upper_bound(addr);
+        if(a != allocation_interval_map.begin()) {
+            --a;
+            if(addr < a->first + allocation_table[a->second].size) {
+                id = a->second;
+            }
+        }
+        auto ac = sampled_predicted_ac.find(aid.first);
+        auto wss = sampled_predicted_wss.find(aid.first);
+        fprintf(f, "%u,%lld,%llu,%.0f,%llu,%llu\n", aid.first, id,
+                ac != sampled_predicted_ac.end() ? ac->second : 0,
+                id >= 0 ? measured_ac[id] : 0.0,
+                wss != sampled_predicted_wss.end() ? wss->second : 0,
+                id >= 0 ? measured_wss[id] : 0);
+    }
+    fclose(f);
+    if(dropped != 0) {
+        fprintf(stderr, "%llu sampled accesses found no slot, raise PENGUIN_SAMPLE_SLOTS\n", dropped);
+    }
+#endif
+}
+
+// Access heat over time, which penguinStopStatCollection writes to the file
+// PENGUIN_HEATMAP names: per launch and per PENGUIN_HEATMAP_BLOCK block of
+// every allocation, the access counter notifications (migrations and
+// samples) the driver sent while the launch ran and, when built with
+// PENGUIN_ACCESS_SAMPLING, the sampled accesses scaled by the sample period.
+// The driver counts faults per launch and per range only, so they come per
+// launch and per allocation. The file is a penguin_heatmap_header, then
+// header.allocations penguin_heatmap_allocation, header.launches
+// penguin_heatmap_launch and header.cells penguin_heatmap_cell, the cells
+// that saw any; eval/build/heatmap/heatmap.out draws it.
+#define PENGUIN_HEATMAP_MAGIC 0x3150414d54414548ULL // "HEATMAP1"
+#define PENGUIN_HEATMAP_BLOCK (2*1024*1024ULL)
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t block;
+    uint64_t allocations;
+    uint64_t launches;
+    uint64_t cells;
+} penguin_heatmap_header;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t decision;
+    uint64_t base;
+    uint64_t size;
+    uint64_t faults;    // of the driver's ranges in the allocation
+    uint64_t evictions;
+} penguin_heatmap_allocation;
+
+typedef struct
+{
+    uint32_t invocation;
+    uint32_t pad;
+    uint64_t time_ns;
+    uint64_t faults;    // serviced while the launch ran
+} penguin_heatmap_launch;
+
+typedef struct
+{
+    uint32_t launch;    // index into the launches
+    uint32_t id;        // allocation
+    uint64_t block;     // from the allocation's base
+    uint64_t notifications;
+    uint64_t samples;
+} penguin_heatmap_cell;
+
+int heatmap_enabled = -1;
+std::vector<penguin_heatmap_launch> heatmap_launches;
+// (launch, allocation, block) -> cell
+std::map<std::tuple<unsigned, unsigned, unsigned long long>, penguin_heatmap_cell> heatmap_cells;
+// event ring faults at the start of the current launch
+unsigned long long heatmap_faults = 0;
+#if PENGUIN_ACCESS_SAMPLING
+// device histogram counts at the start of the current launch
+std::vector<unsigned long long> heatmap_sample_counts;
+#endif
+
+bool penguin_heatmap_enabled() {
+    if(heatmap_enabled < 0) {
+        heatmap_enabled = getenv("PENGUIN_HEATMAP") != NULL;
+    }
+    return heatmap_enabled;
+}
+
+penguin_heatmap_cell& penguin_heatmap_cell_of(unsigned id, unsigned long long offset) {
+    unsigned launch = heatmap_launches.size() - 1;
+    unsigned long long block = offset / PENGUIN_HEATMAP_BLOCK;
+    penguin_heatmap_cell& cell = heatmap_cells[std::make_tuple(launch, id, block)];
+    cell.launch = launch;
+    cell.id = id;
+    cell.block = block;
+    return cell;
+}
+
+// Counts an access counter notification of the driver at address to the
+// launch running
+void penguin_heatmap_notification(unsigned id, void* address) {
+    if(!penguin_heatmap_enabled() || heatmap_launches.empty()) {
+        return;
+    }
+    unsigned long long offset = (unsigned long long) address - (unsigned long long) allocation_table[id].base;
+    if(offset >= allocation_table[id].size) {
+        return;
+    }
+    penguin_heatmap_cell_of(id, offset).notifications++;
+}
+
+unsigned long long penguin_heatmap_ring_faults() {
+    return event_ring != NULL ? __atomic_load_n(&event_ring->faults, __ATOMIC_RELAXED) : 0;
+}
+
+bool penguinEventRingDrain();
+
+// Ends the launch running: takes the notifications the driver has sent, the
+// faults since the launch started and the accesses sampled since then
+void penguin_heatmap_fold() {
+    penguinEventRingDrain();
+    if(heatmap_launches.empty()) {
+        return;
+    }
+    unsigned long long faults = penguin_heatmap_ring_faults();
+    heatmap_launches.back().faults = faults - heatmap_faults;
+    heatmap_faults = faults;
+#if PENGUIN_ACCESS_SAMPLING
+    std::vector<unsigned long long> keys(PENGUIN_SAMPLE_SLOTS);
+    std::vector<unsigned long long> counts(PENGUIN_SAMPLE_SLOTS);
+    if(cudaDeviceSynchronize() != cudaSuccess ||
+            cudaMemcpyFromSymbol(keys.data(), penguin_sample_keys,
+                sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess ||
+            cudaMemcpyFromSymbol(counts.data(), penguin_sample_counts,
+                sizeof(unsigned long long) * PENGUIN_SAMPLE_SLOTS) != cudaSuccess) {
+        fprintf(stderr, "unable to read the access samples\n");
+        return;
+    }
+    heatmap_sample_counts.resize(PENGUIN_SAMPLE_SLOTS);
+    unsigned long long period = penguin_sample_period_value();
+    for(unsigned slot = 0; slot < PENGUIN_SAMPLE_SLOTS; slot++) {
+        // a slot keeps its block for the collection, so its count only grows
+        unsigned long long samples = counts[slot] - heatmap_sample_counts[slot];
+        heatmap_sample_counts[slot] = counts[slot];
+        if(keys[slot] == 0 || samples == 0) {
+            continue;
+        }
+        unsigned long long first = (keys[slot] - 1) << 21;
+        unsigned long long last = first + (2ULL << 20);
+        auto a = allocation_interval_map.upper_bound(first);
+        if(a != allocation_interval_map.begin()) {
+            --a;
+        }
+        for(; a != allocation_interval_map.end() && a->first < last; ++a) {
+            unsigned long long base = a->first;
+            unsigned long long end = base + allocation_table[a->second].size;
+            unsigned long long lo = std::max(base, first);
+            unsigned long long hi = std::min(end, last);
+            if(lo >= hi) {
+                continue;
+            }
+            penguin_heatmap_cell_of(a->second, lo - base).samples +=
+                samples * period * (hi - lo) / (last - first);
+        }
+    }
+#endif
+}
+
+// Starts launch invid, at time_ns of the trace
+void penguin_heatmap_begin(unsigned invid, unsigned long long time_ns) {
+    if(!penguin_heatmap_enabled() || !metrics_collecting) {
+        return;
+    }
+    penguin_heatmap_fold();
+    heatmap_launches.push_back(penguin_heatmap_launch{invid, 0, time_ns, 0});
+}
+
+// Empties the heat for a new collection, after penguin_sampling_start
+void penguin_heatmap_start() {
+    if(!penguin_heatmap_enabled()) {
+        return;
+    }
+    // what the driver sent before the collection goes to no launch
+    heatmap_launches.clear();
+    penguinEventRingDrain();
+    heatmap_cells.clear();
+    heatmap_faults = penguin_heatmap_ring_faults();
+#if PENGUIN_ACCESS_SAMPLING
+    heatmap_sample_counts.assign(PENGUIN_SAMPLE_SLOTS, 0);
+#endif
+}
+
+// Ends the last launch and writes the heat out, with the driver's counters of
+// the ranges
+void penguin_heatmap_dump(const std::vector<penguin_range_stats>& stats) {
+    if(!penguin_heatmap_enabled()) {
+        return;
+    }
+    penguin_heatmap_fold();
+    std::vector<penguin_heatmap_allocation> allocations;
+    std::map<unsigned, unsigned> index;
+    for(unsigned id = 0; id < allocation_table.size(); id++) {
+        penguin_alloc_desc &desc = allocation_table[id];
+        if(desc.size == 0) {
+            continue;
+        }
+        index[id] = allocations.size();
+        allocations.push_back(penguin_heatmap_allocation{id, (uint32_t) desc.decision,
+                (uint64_t) desc.base, desc.size, 0, 0});
+    }
+    for(auto &r : stats) {
+        auto a = allocation_interval_map.upper_bound(r.base);
+        if(a == allocation_interval_map.begin()) {
+            continue;
+        }
+        --a;
+        auto i = index.find(a->second);
+        if(r.base < a->first + allocation_table[a->second].size && i != index.end()) {
+            allocations[i->second].faults += r.faults;
+            allocations[i->second].evictions += r.evictions;
+        }
+    }
+    const char* path = getenv("PENGUIN_HEATMAP");
+    FILE* f = fopen(path, "wb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return;
+    }
+    penguin_heatmap_header header = {PENGUIN_HEATMAP_MAGIC, PENGUIN_HEATMAP_BLOCK, allocations.size(),
+        heatmap_launches.size(), heatmap_cells.size()};
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(allocations.data(), sizeof(penguin_heatmap_allocation), allocations.size(), f) ==
+            allocations.size() &&
+        fwrite(heatmap_launches.data(), sizeof(penguin_heatmap_launch), heatmap_launches.size(), f) ==
+            heatmap_launches.size();
+    for(auto c = heatmap_cells.begin(); written && c != heatmap_cells.end(); c++) {
+        written = fwrite(&c->second, sizeof(penguin_heatmap_cell), 1, f) == 1;
+    }
+    if(!written) {
+        fprintf(stderr, "Cannot write %s\n", path);
+    }
+    fclose(f);
+    heatmap_launches.clear();
+    heatmap_cells.clear();
+}
+
+extern "C"
+penguin_error_t penguinStartStatCollection() {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_start_stat_collection_params request;
+    int status;
+    penguin_planning();
+    penguin_fold_kernel_timings();
+    kernel_stats.clear();
+    runtime_overhead_ns = 0;
+    penguin_sampling_start();
+    penguin_heatmap_start();
+    penguin_epoch_start();
+    metrics_collecting = true;
+    metrics_start = std::chrono::steady_clock::now();
+    metrics_telemetry_start = penguin_telemetry_now();
+    phase_energy.clear();
+    phase_energy_started = false;
+    penguin_phase_energy_next(phase_energy_signature);
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_START_STAT_COLLECTION_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// Per-range statistics returned by the last penguinStopStatCollection
+#define PENGUIN_MAX_RANGE_STATS 4096
+#define PENGUIN_RANGE_STATS_FILE "penguin_range_stats.csv"
+std::vector<penguin_range_stats> range_stats;
+
+void penguinDumpRangeStats() {
+    if(range_stats.empty()) {
+        return;
+    }
+    FILE* f = fopen(PENGUIN_RANGE_STATS_FILE, "w");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", PENGUIN_RANGE_STATS_FILE);
+        return;
+    }
+    fprintf(f, "base,length,allocation,faults,bytes_h2d,bytes_d2h,evictions,thrashing,ac_notifications,"
+            "markov_predictions,markov_hits\n");
+    for(auto &r : range_stats) {
+        // ranges that don't belong to an instrumented allocation report -1
+        long long id = -1;
+        auto a = allocation_interval_map.upper_bound(r.base);
+        if(a != allocation_interval_map.begin()) {
+            --a;
+            auto &desc = allocation_table[a->second];
+            if(r.base < a->first + desc.size) {
+                id = a->second;
+            }
+        }
+        fprintf(f, "0x%llx,%llu,%lld,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", r.base, r.length, id, r.faults,
+                r.bytes_h2d, r.bytes_d2h, r.evictions, r.thrashing, r.ac_notifications,
+                r.markov_predictions, r.markov_hits);
+    }
+    fclose(f);
+}
+
+// Metrics of a run. penguinStopStatCollection appends one record to
+// $PENGUIN_METRICS (PENGUIN_METRICS_FILE by default): a JSON object per line,
+// or a CSV row, under a header if the file is new, when the name ends in
+// .csv. The CSV row leaves out the per-kernel and per-allocation lists.
+#define PENGUIN_METRICS_FILE "penguin_metrics.json"
+
+const char* penguin_policy_name() {
+    static const char* name[] = {"suv", "uvm", "ac"};
+    return name[penguin_policy()];
+}
+
+// The driver counters of an epoch, as fields of a metrics object
+void penguin_metrics_epoch(FILE* f, const penguin_range_stats& s) {
+    fprintf(f, ",\"faults\":%llu,\"bytes_h2d\":%llu,\"bytes_d2h\":%llu,\"evictions\":%llu,"
+            "\"thrashing\":%llu,\"ac_notifications\":%llu", s.faults, s.bytes_h2d, s.bytes_d2h,
+            s.evictions, s.thrashing, s.ac_notifications);
+}
+
+void penguinWriteMetrics(double wall_ms, unsigned long long fault_count) {
+    const char* path = getenv("PENGUIN_METRICS");
+    if(path == NULL) {
+        path = PENGUIN_METRICS_FILE;
+    }
+    size_t len = strlen(path);
+    bool csv = len >= 4 && strcmp(path + len - 4, ".csv") == 0;
+    FILE* f = fopen(path, "a");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return;
+    }
+    penguin_range_stats total = {};
+    for(auto &r : range_stats) {
+        penguin_range_stats_add(total, r);
+    }
+    unsigned long long launches = 0;
+    double kernel_ms = 0;
+    for(auto &k : kernel_stats) {
+        launches += k.second.launches;
+        kernel_ms += k.second.ms;
+    }
+    unsigned decisions[PENGUIN_DEC_MAX] = {};
+    for(auto &desc : allocation_table) {
+        if(desc.size != 0) {
+            decisions[desc.decision]++;
+        }
+    }
+    const char* oversub = getenv("PENGUIN_OVERSUB");
+    long long oversub_percent = oversub != NULL ? atoll(oversub) : -1;
+    double overhead_ms = runtime_overhead_ns / 1e6;
+    // what nvml_monitor sampled since penguinStartStatCollection, 0 if it
+    // didn't run
+    penguin_telemetry_totals now = penguin_telemetry_now();
+    const penguin_telemetry_totals &start = metrics_telemetry_start;
+    // a monitor started after the collection counts from 0
+    bool restarted = now.samples < start.samples;
+    auto since = [restarted](unsigned long long n, unsigned long long s) { return restarted ? n : n - s; };
+    unsigned long long samples = since(now.samples, start.samples);
+    bool sampled = samples > 0;
+    unsigned long long energy_mj = since(now.energy_mj, start.energy_mj);
+    unsigned long long pcie_tx_kb = since(now.tx_kb, start.tx_kb);
+    unsigned long long pcie_rx_kb = since(now.rx_kb, start.rx_kb);
+    unsigned long long sm_mhz = sampled ? since(now.sm_mhz, start.sm_mhz) / samples : 0;
+    unsigned long long mem_mhz = sampled ? since(now.mem_mhz, start.mem_mhz) / samples : 0;
+    unsigned long long gpu_util = sampled ? since(now.util, start.util) / samples : 0;
+    if(csv) {
+        if(ftell(f) == 0) {
+            fprintf(f, "workload,policy,oversub,budget,wall_ms,kernel_ms,launches,faults,driver_faults,"
+                    "bytes_h2d,bytes_d2h,evictions,thrashing,ac_notifications,overhead_ms,"
+                    "energy_mj,pcie_tx_kb,pcie_rx_kb,sm_mhz,mem_mhz,gpu_util");
+            for(unsigned d = 0; d < PENGUIN_DEC_MAX; d++) {
+                fprintf(f, ",%s", penguin_decision_name[d]);
+            }
+            fprintf(f, "\n");
+        }
+        fprintf(f, "%s,%s,%lld,%llu,%.3f,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,"
+                "%llu,%llu,%llu,%llu,%llu,%llu",
+                program_invocation_short_name, penguin_policy_name(), oversub_percent, gpu_memory,
+                wall_ms, kernel_ms, launches, total.faults, fault_count, total.bytes_h2d,
+                total.bytes_d2h, total.evictions, total.thrashing, total.ac_notifications, overhead_ms,
+                energy_mj, pcie_tx_kb, pcie_rx_kb, sm_mhz, mem_mhz, gpu_util);
+        for(unsigned d = 0; d < PENGUIN_DEC_MAX; d++) {
+            fprintf(f, ",%u", decisions[d]);
+        }
+        fprintf(f, "\n");
+        fclose(f);
+        return;
+    }
+    fprintf(f, "{\"workload\":\"%s\",\"policy\":\"%s\",\"oversub\":%lld,\"budget\":%llu,"
+            "\"wall_ms\":%.3f,\"kernel_ms\":%.3f,\"launches\":%llu,\"faults\":%llu,"
+            "\"driver_faults\":%llu,\"bytes_h2d\":%llu,\"bytes_d2h\":%llu,\"evictions\":%llu,"
+            "\"thrashing\":%llu,\"ac_notifications\":%llu,\"markov_predictions\":%llu,"
+            "\"markov_hits\":%llu,\"overhead_ms\":%.3f,\"energy_mj\":%llu,\"pcie_tx_kb\":%llu,"
+            "\"pcie_rx_kb\":%llu,\"sm_mhz\":%llu,\"mem_mhz\":%llu,\"gpu_util\":%llu,"
+            "\"mig_share\":%.3f,\"decisions\":{",
+            program_invocation_short_name, penguin_policy_name(), oversub_percent, gpu_memory,
+            wall_ms, kernel_ms, launches, total.faults, fault_count, total.bytes_h2d,
+            total.bytes_d2h, total.evictions, total.thrashing, total.ac_notifications,
+            total.markov_predictions, total.markov_hits, overhead_ms, energy_mj, pcie_tx_kb,
+            pcie_rx_kb, sm_mhz, mem_mhz, gpu_util, penguin_mig(penguin_launch_device()).share);
+    for(unsigned d = 0; d < PENGUIN_DEC_MAX; d++) {
+        fprintf(f, "%s\"%s\":%u", d ? "," : "", penguin_decision_name[d], decisions[d]);
+    }
+    fprintf(f, "},\"kernels\":[");
+    bool first = true;
+    for(auto &k : kernel_stats) {
+        // the host stubs are named if the binary exports its symbols
+        Dl_info info;
+        char name[32];
+        const char* symbol = name;
+        if(dladdr(k.first, &info) != 0 && info.dli_sname != NULL) {
+            symbol = info.dli_sname;
+        } else {
+            snprintf(name, sizeof(name), "%p", k.first);
+        }
+        fprintf(f, "%s{\"kernel\":\"%s\",\"launches\":%llu,\"ms\":%.3f", first ? "" : ",",
+                symbol, k.second.launches, k.second.ms);
+        if(penguin_kernel_energy_enabled()) {
+            fprintf(f, ",\"energy_mj\":%llu", k.second.energy_mj);
+        }
+        auto e = kernel_epoch_stats.find(k.first);
+        if(e != kernel_epoch_stats.end()) {
+            penguin_metrics_epoch(f, e->second);
+        }
+        fprintf(f, "}");
+        first = false;
+    }
+    fprintf(f, "],\"invocations\":[");
+    first = true;
+    for(auto &i : invocation_epoch_stats) {
+        fprintf(f, "%s{\"invocation\":%u", first ? "" : ",", i.first);
+        penguin_metrics_epoch(f, i.second);
+        fprintf(f, "}");
+        first = false;
+    }
+    fprintf(f, "],\"phases\":[");
+    // the phase still running ends with the collection
+    first = true;
+    if(sampled && phase_energy_started) {
+        penguin_phase_energy_next(phase_energy_signature);
+        phase_energy_started = false;
+        for(auto &p : phase_energy) {
+            fprintf(f, "%s{\"phase\":\"%llx\",\"energy_mj\":%llu}", first ? "" : ",", p.first, p.second);
+            first = false;
+        }
+    }
+    fprintf(f, "],\"allocations\":[");
+    first = true;
+    for(unsigned id = 0; id < allocation_table.size(); id++) {
+        penguin_alloc_desc &desc = allocation_table[id];
+        if(desc.size == 0) {
+            continue;
+        }
+        fprintf(f, "%s{\"id\":%u,\"size\":%llu,\"decision\":\"%s\",\"site\":\"0x%llx\"}",
+                first ? "" : ",", id, desc.size, penguin_decision_name[desc.decision], desc.site);
+        first = false;
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+}
+
+extern "C"
+penguin_error_t penguinStopStatCollection() {
+    PENGUIN_LOCKED_ENTRY();
+    penguinDumpTrace();
+    penguin_sampling_report();
+    penguin_fold_kernel_timings();
+    penguin_epoch_snapshot(NULL, PENGUIN_NO_INVOCATION);
+    metrics_collecting = false;
+    double wall_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - metrics_start).count();
+    penguin_stop_stat_collection_params request = {};
+    int status;
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        range_stats.clear();
+        penguin_sim_dump(range_stats);
+        penguin_heatmap_dump(range_stats);
+        penguinWriteMetrics(wall_ms, 0);
+        return PENGUIN_ERR_PATH;
+    }
+    range_stats.resize(PENGUIN_MAX_RANGE_STATS);
+    request.stats = range_stats.data();
+    request.stats_count = PENGUIN_MAX_RANGE_STATS;
+    if ((status = penguin_ioctl(PENGUIN_STOP_STAT_COLLECTION_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        range_stats.clear();
+        penguin_sim_dump(range_stats);
+        penguin_heatmap_dump(range_stats);
+        penguinWriteMetrics(wall_ms, 0);
+        return PENGUIN_ERR_IOCTL;
+    }
+    range_stats.resize(request.stats_count);
+    if(request.stats_total > request.stats_count) {
+        fprintf(stderr, "range stats truncated to %u of %u ranges\n", request.stats_count, request.stats_total);
+    }
+    penguinDumpRangeStats();
+    penguin_sim_dump(range_stats);
+    penguin_heatmap_dump(range_stats);
+    penguinWriteMetrics(wall_ms, request.fault_count);
+    return PENGUIN_OK;
+}
+
+
+extern "C"
+void add_invocation_id(unsigned invid) {
+    PENGUIN_LOCKED_ENTRY();
+    InvocationIDs.insert(invid);
+    return;
+}
+
+// Tells the driver which NUMA node the CPU pages of the process go on: the
+// ones the host faults in, pins or gets back from GPU eviction
+// (UVM_SET_HOST_NUMA_NODE)
+extern "C"
+penguin_error_t penguinSetHostNumaNode(int node) {
+    penguin_host_numa_node_ioctl_params request;
+    int status;
+
+    request.node = node;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_HOST_NUMA_NODE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// PENGUIN_HOST_NUMA overrides the driver's uvm_perf_host_numa_node for the
+// process at its first allocation: gpu for the node closest to the GPU,
+// local for the node of the thread touching the page, or a node number
+bool host_numa_sent = false;
+
+void penguin_host_numa() {
+    if(host_numa_sent) {
+        return;
+    }
+    host_numa_sent = true;
+    const char* env = getenv("PENGUIN_HOST_NUMA");
+    if(env == NULL) {
+        return;
+    }
+    int node;
+    if(strcmp(env, "gpu") == 0) {
+        node = PENGUIN_HOST_NUMA_GPU;
+    } else if(strcmp(env, "local") == 0) {
+        node = PENGUIN_HOST_NUMA_LOCAL;
+    } else {
+        node = atoi(env);
+    }
+    penguinSetHostNumaNode(node);
+}
+
+// Host memory tiers. Besides the DRAM of the node closest to the GPU, the
+// host may have DRAM on other sockets and memory-only nodes, CXL expanders,
+// each slower to reach from the GPU. penguin_host_tiers_probe orders the
+// online NUMA nodes from the GPU's node on, with the read bandwidth and
+// latency the ACPI HMAT gives their memory where the firmware has one, and
+// else PENGUIN_REMOTE_DRAM_GBS or PENGUIN_CXL_GBS and the NUMA distance, all
+// bounded by the host link of the GPU; a node's capacity is the memory it
+// has free at the probe. With more than one tier, every allocation gets one
+// for its host pages, those it is faulted into, evicted to or pinned in: by
+// accesses per byte, densest first, each goes to the first tier with room
+// for its whole size, so data cold on the GPU lands on the closest host tier
+// with space and the coldest on CXL memory. penguin_placement_cost prices
+// the host at that tier. PENGUIN_HOST_TIERS=0, or a PENGUIN_HOST_NUMA node,
+// keeps each on the node of the process.
+#ifndef PENGUIN_REMOTE_DRAM_GBS
+#define PENGUIN_REMOTE_DRAM_GBS 20.0
+#endif
+#ifndef PENGUIN_CXL_GBS
+#define PENGUIN_CXL_GBS 8.0
+#endif
+// us a host access takes per 10 of NUMA distance beyond the local node's
+#define PENGUIN_NUMA_DISTANCE_US 0.1
+// plans between two placements when no allocation came or went
+#define PENGUIN_HOST_TIER_PERIOD 64
+#define PENGUIN_MAX_HOST_TIERS 64
+#define PENGUIN_SYS_NODE "/sys/devices/system/node"
+
+enum {
+    PENGUIN_TIER_LOCAL,  // DRAM of the GPU's node
+    PENGUIN_TIER_REMOTE, // DRAM of another socket
+    PENGUIN_TIER_CXL     // a node without CPUs
+};
+
+const char* penguin_tier_name[] = {"local", "remote", "cxl"};
+
+typedef struct
+{
+    int node;
+    unsigned kind;
+    unsigned long long capacity;
+    double bandwidth; // GB/s
+    double latency;   // us added to an access over the host link
+} penguin_host_tier;
+
+std::vector<penguin_host_tier> host_tiers; // closest first
+int host_tiers_enabled = -1;
+unsigned long long host_tiers_generation = 0;
+unsigned host_tiers_plans = 0;
+
+// The first line of a sysfs file, empty if it can't be read
+std::string penguin_sysfs_line(const char* path) {
+    char line[4096] = "";
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        return "";
+    }
+    if(fgets(line, sizeof(line), f) == NULL) {
+        line[0] = 0;
+    }
+    fclose(f);
+    line[strcspn(line, "\n")] = 0;
+    return line;
+}
+
+// Node of the PCIe device of GPU 0, 0 if the platform doesn't say
+int penguin_gpu_numa_node() {
+    char bus_id[32];
+    char path[128];
+    if(cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), 0) != cudaSuccess) {
+        return 0;
+    }
+    for(char* c = bus_id; *c; c++) {
+        *c = tolower(*c);
+    }
+    snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/numa_node", bus_id);
+    std::string line = penguin_sysfs_line(path);
+    int node = line.empty() ? -1 : atoi(line.c_str());
+    return node < 0 ? 0 : node;
+}
+
+// Bytes free on node
+unsigned long long penguin_node_free(int node) {
+    char path[128];
+    char line[256];
+    unsigned long long kb = 0;
+    snprintf(path, sizeof(path), PENGUIN_SYS_NODE "/node%d/meminfo", node);
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        return 0;
+    }
+    while(fgets(line, sizeof(line), f) != NULL) {
+        const char* field = strstr(line, "MemFree:");
+        if(field != NULL) {
+            kb = strtoull(field + strlen("MemFree:"), NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb << 10;
+}
+
+// Whether there is more than one tier to place allocations on
+bool penguin_host_tiers_probe() {
+    if(host_tiers_enabled >= 0) {
+        return host_tiers_enabled;
+    }
+    host_tiers_enabled = 0;
+    const char* env = getenv("PENGUIN_HOST_TIERS");
+    if((env != NULL && strcmp(env, "0") == 0) || getenv("PENGUIN_HOST_NUMA") != NULL) {
+        return false;
+    }
+    DIR* dir = opendir(PENGUIN_SYS_NODE);
+    if(dir == NULL) {
+        return false;
+    }
+    std::vector<int> nodes;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL) {
+        int node;
+        if(sscanf(entry->d_name, "node%d", &node) == 1) {
+            nodes.push_back(node);
+        }
+    }
+    closedir(dir);
+    std::sort(nodes.begin(), nodes.end());
+    penguinTopologyProbe();
+    const penguin_link& host = penguin_links[0][PENGUIN_HOST];
+    int gpu_node = penguin_gpu_numa_node();
+    char path[256];
+    // distances from the GPU's node, one per node in order
+    snprintf(path, sizeof(path), PENGUIN_SYS_NODE "/node%d/distance", gpu_node);
+    std::string distances = penguin_sysfs_line(path);
+    const char* next = distances.c_str();
+    for(unsigned i = 0; i < nodes.size() && host_tiers.size() < PENGUIN_MAX_HOST_TIERS; i++) {
+        char* end;
+        long distance = strtol(next, &end, 10);
+        next = end;
+        penguin_host_tier tier;
+        tier.node = nodes[i];
+        snprintf(path, sizeof(path), PENGUIN_SYS_NODE "/node%d/cpulist", tier.node);
+        tier.kind = tier.node == gpu_node ? PENGUIN_TIER_LOCAL :
+            penguin_sysfs_line(path).empty() ? PENGUIN_TIER_CXL : PENGUIN_TIER_REMOTE;
+        tier.capacity = penguin_node_free(tier.node);
+        if(tier.capacity == 0) {
+            continue;
+        }
+        // HMAT, in MB/s and ns, from the best initiator of the node
+        snprintf(path, sizeof(path), PENGUIN_SYS_NODE "/node%d/access0/initiators/read_bandwidth", tier.node);
+        std::string bandwidth = penguin_sysfs_line(path);
+        snprintf(path, sizeof(path), PENGUIN_SYS_NODE "/node%d/access0/initiators/read_latency", tier.node);
+        std::string latency = penguin_sysfs_line(path);
+        tier.bandwidth = !bandwidth.empty() ? atof(bandwidth.c_str()) / 1e3 :
+            tier.kind == PENGUIN_TIER_LOCAL ? host.bandwidth :
+            tier.kind == PENGUIN_TIER_REMOTE ? PENGUIN_REMOTE_DRAM_GBS : PENGUIN_CXL_GBS;
+        tier.bandwidth = std::min(tier.bandwidth, host.bandwidth);
+        tier.latency = !latency.empty() ? atof(latency.c_str()) / 1e3 :
+            distance > 10 ? (distance - 10) / 10.0 * PENGUIN_NUMA_DISTANCE_US : 0;
+        host_tiers.push_back(tier);
+    }
+    std::stable_sort(host_tiers.begin(), host_tiers.end(),
+            [](const penguin_host_tier& a, const penguin_host_tier& b) {
+        if((a.kind == PENGUIN_TIER_LOCAL) != (b.kind == PENGUIN_TIER_LOCAL)) {
+            return a.kind == PENGUIN_TIER_LOCAL;
+        }
+        return a.bandwidth != b.bandwidth ? a.bandwidth > b.bandwidth : a.latency < b.latency;
+    });
+    /* for(auto &t : host_tiers) { */
+    /*     std::cout << "node " << t.node << " " << penguin_tier_name[t.kind] << " " << (t.capacity >> 20) */
+    /*         << " MB " << t.bandwidth << " GB/s\n"; */
+    /* } */
+    host_tiers_enabled = host_tiers.size() > 1;
+    return host_tiers_enabled;
+}
+
+// us the kernels of device spend on accesses to host memory of tier
+double penguin_host_tier_cost(int device, unsigned tier, unsigned long long accesses) {
+    if(!penguin_host_tiers_probe() || tier >= host_tiers.size()) {
+        return penguin_access_cost(device, PENGUIN_HOST, accesses);
+    }
+    const penguin_link& link = penguin_links[device][PENGUIN_HOST];
+    double bandwidth = std::min(link.bandwidth, host_tiers[tier].bandwidth);
+    return link.latency + host_tiers[tier].latency +
+        (double) accesses * PENGUIN_ACCESS_BYTES / (bandwidth * 1e3);
+}
+
+// Places the allocations on the tiers when one came or went since the last
+// placement, and every PENGUIN_HOST_TIER_PERIOD plans as their access counts
+// change, sending the driver only the ones that move
+void penguin_host_tiers_place() {
+    if(!penguin_host_tiers_probe()) {
+        return;
+    }
+    if(host_tiers_generation == mmg_input_generation && ++host_tiers_plans % PENGUIN_HOST_TIER_PERIOD != 0) {
+        return;
+    }
+    host_tiers_generation = mmg_input_generation;
+    std::vector<unsigned> order;
+    for(unsigned id = 0; id < allocation_table.size(); id++) {
+        const penguin_alloc_desc& desc = allocation_table[id];
+        // system allocations are placed by the kernel's own NUMA policy
+        if(desc.size != 0 && desc.base != NULL && !desc.system) {
+            order.push_back(id);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [](unsigned a, unsigned b) {
+        return (double) allocation_table[a].ac / allocation_table[a].size >
+            (double) allocation_table[b].ac / allocation_table[b].size;
+    });
+    std::vector<unsigned long long> left;
+    for(auto &t : host_tiers) {
+        left.push_back(t.capacity);
+    }
+    for(unsigned id : order) {
+        penguin_alloc_desc& desc = allocation_table[id];
+        unsigned t = 0;
+        while(t + 1 < host_tiers.size() && left[t] < desc.size) {
+            t++;
+        }
+        left[t] -= std::min(left[t], desc.size);
+        desc.host_tier = t;
+        if(desc.host_tier_sent != t + 1) {
+            penguinSetHostNode(desc.base, desc.size, host_tiers[t].node);
+            desc.host_tier_sent = t + 1;
+        }
+    }
+}
+
+void penguin_register_allocation(void* p, unsigned long long size) {
+    penguin_host_numa();
+    // the allocation ID is the descriptor's index in allocation_table
+    allocation_desc(p).size = size;
+    allocation_interval_map[(unsigned long long) p] = lookup_allocation_id(p);
+    penguin_sim_record(PENGUIN_SIM_ALLOC, lookup_allocation_id(p), (unsigned long long) p, size);
+    mmg_input_generation++;
+    penguinProfileRegister(lookup_allocation_id(p));
+}
+
+// Device copies (-penguin-device-copy). The host transform sends here the
+// cudaMallocManaged calls whose pointer the host only touches before the
+// first launch of its function and after the last one. Under the SUV policy
+// an allocation that fits in PENGUIN_DEVICE_COPY_PCT percent of the budget,
+// with the copies before it, becomes a pinned host buffer, which the program
+// keeps as its pointer, and a cudaMalloc'd copy the kernels get instead: the
+// buffer is copied in at the first launch after the host wrote it, and out
+// before the host reads it after a launch. The copy leaves the budget and
+// the planners never see the allocation, so it takes no faults, page table
+// updates or TLB shootdowns. PENGUIN_DEVICE_COPY=0 keeps every allocation
+// managed.
+#define PENGUIN_DEVICE_COPY_PCT 50
+
+// User-space VMM copies. Built with PENGUIN_VMM=1 (-DSUV_VMM=ON), a candidate
+// past the share gets a VA range reserved with cuMemAddressReserve rather
+// than a cudaMalloc'd copy, backed by 2MB physical chunks (cuMemCreate,
+// cuMemMap) while they are resident, which the copies may hold up to
+// PENGUIN_VMM_PCT percent of the budget; one that doesn't fit there with the
+// cudaMalloc'd copies stays managed. A launch given it maps the chunks that
+// aren't and fills them from the host buffer on the prefetch engine's H2D
+// stream; the room they need is taken from the copies the launch wasn't
+// given, least recently given first, whose chunks are written back on the
+// D2H stream once the device is idle and unmapped. The driver never faults on or places these
+// allocations, at the cost of a device synchronization per eviction. A
+// launch whose chunks can't all be mapped gets the host buffer, which the
+// GPU reads over the link. One GPU only; PENGUIN_VMM=0 turns them off.
+#ifndef PENGUIN_VMM
+#define PENGUIN_VMM 0
+#endif
+#if PENGUIN_VMM
+#include <cuda.h>
+#define PENGUIN_VMM_PCT 75
+
+typedef struct
+{
+    CUmemGenericAllocationHandle handle;
+    bool resident;  // mapped and holding the data
+    bool dirty;     // given to a launch since it was filled
+} penguin_vmm_chunk;
+#endif
+
+typedef struct
+{
+    char* host;
+    char* device;
+    unsigned long long size;
+    bool host_dirty;   // written by the host since it was copied in
+    bool device_dirty; // given to a launch since it was copied out
+#if PENGUIN_VMM
+    // a VMM copy's chunks over the reservation, none for a cudaMalloc'd one
+    std::vector<penguin_vmm_chunk> chunks;
+    unsigned long long reserved;
+    unsigned long long epoch;  // launch_epoch of the last launch given it
+#endif
+} penguin_device_copy;
+
+// host base -> copy
+std::map<unsigned long long, penguin_device_copy> device_copies;
+int device_copy_enabled = -1;
+
+bool penguin_device_copy_enabled() {
+    if(device_copy_enabled < 0) {
+        const char* env = getenv("PENGUIN_DEVICE_COPY");
+        device_copy_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return device_copy_enabled;
+}
+
+// The copy whose host buffer holds p
+std::map<unsigned long long, penguin_device_copy>::iterator penguin_device_copy_find(const void* p) {
+    auto c = device_copies.upper_bound((unsigned long long) p);
+    if(c == device_copies.begin()) {
+        return device_copies.end();
+    }
+    c--;
+    return (const char*) p < c->second.host + c->second.size ? c : device_copies.end();
+}
+
+// Whether bytes more fit pct percent of the budget with resident bytes of
+// the copies resident; gpu_memory and device_copy_bytes move together
+bool penguin_device_copy_fits(unsigned long long bytes, unsigned long long resident = device_copy_bytes,
+        unsigned pct = PENGUIN_DEVICE_COPY_PCT) {
+    return (resident + bytes) * 100 <= (gpu_memory + device_copy_bytes) * pct;
+}
+
+#if PENGUIN_VMM
+int vmm_enabled = -1;
+unsigned long long vmm_chunk = 0;   // physical chunk, the granularity rounded up to 2MB
+unsigned long long vmm_resident_bytes = 0;  // of device_copy_bytes
+
+CUmemAllocationProp penguin_vmm_prop() {
+    CUmemAllocationProp prop = {};
+    prop.type = CU_MEM_ALLOCATION_TYPE_PINNED;
+    prop.location.type = CU_MEM_LOCATION_TYPE_DEVICE;
+    prop.location.id = penguin_launch_device();
+    return prop;
+}
+
+bool penguin_vmm_enabled() {
+    if(vmm_enabled < 0) {
+        const char* env = getenv("PENGUIN_VMM");
+        CUmemAllocationProp prop = penguin_vmm_prop();
+        size_t granularity = 0;
+        // the driver calls take the primary context of the runtime
+        vmm_enabled = (env == NULL || strcmp(env, "0") != 0) && penguin_num_devices() == 1 &&
+            cudaFree(0) == cudaSuccess &&
+            cuMemGetAllocationGranularity(&granularity, &prop, CU_MEM_ALLOC_GRANULARITY_MINIMUM) == CUDA_SUCCESS &&
+            granularity > 0;
+        if(vmm_enabled) {
+            vmm_chunk = (PENGUIN_PLACEMENT_UNIT + granularity - 1) / granularity * granularity;
+        }
+    }
+    return vmm_enabled;
+}
+
+unsigned long long penguin_vmm_chunk_bytes(const penguin_device_copy& copy, size_t c) {
+    return std::min(vmm_chunk, copy.size - c * vmm_chunk);
+}
+
+// Reserves the VA range of copy, none of it backed yet
+bool penguin_vmm_reserve(penguin_device_copy& copy) {
+    unsigned long long reserved = (copy.size + vmm_chunk - 1) / vmm_chunk * vmm_chunk;
+    CUdeviceptr base = 0;
+    if(cuMemAddressReserve(&base, reserved, vmm_chunk, 0, 0) != CUDA_SUCCESS) {
+        return false;
+    }
+    copy.device = (char*) base;
+    copy.reserved = reserved;
+    copy.chunks.assign(reserved / vmm_chunk, penguin_vmm_chunk{});
+    return true;
+}
+
+// The caller gives the budget back
+void penguin_vmm_unmap(penguin_device_copy& copy, size_t c) {
+    penguin_vmm_chunk& chunk = copy.chunks[c];
+    cuMemUnmap((CUdeviceptr) (copy.device + c * vmm_chunk), vmm_chunk);
+    cuMemRelease(chunk.handle);
+    chunk.resident = false;
+    chunk.dirty = false;
+    device_copy_bytes -= vmm_chunk;
+    vmm_resident_bytes -= vmm_chunk;
+}
+
+// Copies the chunks of copies the launches had back to the host buffers, on
+// the D2H stream, after the kernels. Returns when they are there.
+void penguin_vmm_write_back(const std::vector<std::pair<penguin_device_copy*, size_t>>& chunks) {
+    cudaDeviceSynchronize();
+    bool copied = false;
+    for(auto &c : chunks) {
+        penguin_device_copy& copy = *c.first;
+        if(!copy.chunks[c.second].dirty) {
+            continue;
+        }
+        unsigned long long offset = c.second * vmm_chunk;
+        unsigned long long bytes = penguin_vmm_chunk_bytes(copy, c.second);
+        cudaMemcpyAsync(copy.host + offset, copy.device + offset, bytes, cudaMemcpyDeviceToHost, prefetch_engine.d2h);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) copy.host + offset, bytes);
+        copy.chunks[c.second].dirty = false;
+        copied = true;
+    }
+    if(copied) {
+        cudaStreamSynchronize(prefetch_engine.d2h);
+    }
+}
+
+// Evicts chunks of the copies the current launch wasn't given, those given
+// least recently first, until bytes more fit PENGUIN_VMM_PCT; nothing if
+// they can't
+bool penguin_vmm_make_room(unsigned long long bytes) {
+    if(penguin_device_copy_fits(bytes, device_copy_bytes, PENGUIN_VMM_PCT)) {
+        return true;
+    }
+    std::vector<std::pair<unsigned long long, penguin_device_copy*>> idle;
+    for(auto &c : device_copies) {
+        if(!c.second.chunks.empty() && c.second.epoch < launch_epoch) {
+            idle.push_back(std::make_pair(c.second.epoch, &c.second));
+        }
+    }
+    std::sort(idle.begin(), idle.end(), [](const std::pair<unsigned long long, penguin_device_copy*>& a,
+            const std::pair<unsigned long long, penguin_device_copy*>& b) { return a.first < b.first; });
+    std::vector<std::pair<penguin_device_copy*, size_t>> victims;
+    unsigned long long freed = 0;
+    for(auto &i : idle) {
+        penguin_device_copy& copy = *i.second;
+        for(size_t c = copy.chunks.size(); c-- > 0 && !penguin_device_copy_fits(bytes, device_copy_bytes - freed, PENGUIN_VMM_PCT);) {
+            if(copy.chunks[c].resident) {
+                victims.push_back(std::make_pair(&copy, c));
+                freed += vmm_chunk;
+            }
+        }
+    }
+    if(!penguin_device_copy_fits(bytes, device_copy_bytes - freed, PENGUIN_VMM_PCT)) {
+        return false;
+    }
+    penguin_vmm_write_back(victims);
+    for(auto &v : victims) {
+        penguin_vmm_unmap(*v.first, v.second);
+    }
+    penguin_budget_resize(gpu_memory + freed);
+    return true;
+}
+
+// Backs and fills every chunk of copy for a launch; false if they don't all
+// fit, with none of them mapped then
+bool penguin_vmm_map(penguin_device_copy& copy) {
+    copy.epoch = launch_epoch;
+    std::vector<size_t> missing;
+    for(size_t c = 0; c < copy.chunks.size(); c++) {
+        if(!copy.chunks[c].resident) {
+            missing.push_back(c);
+        }
+    }
+    unsigned long long bytes = missing.size() * vmm_chunk;
+    if(bytes > 0 && !penguin_vmm_make_room(bytes)) {
+        return false;
+    }
+    CUmemAllocationProp prop = penguin_vmm_prop();
+    CUmemAccessDesc access = {};
+    access.location = prop.location;
+    access.flags = CU_MEM_ACCESS_FLAGS_PROT_READWRITE;
+    size_t mapped = 0;
+    bool backed = penguinPrefetchEngineInit() == PENGUIN_OK;
+    while(backed && mapped < missing.size()) {
+        penguin_vmm_chunk& chunk = copy.chunks[missing[mapped]];
+        CUdeviceptr at = (CUdeviceptr) (copy.device + missing[mapped] * vmm_chunk);
+        if(cuMemCreate(&chunk.handle, vmm_chunk, &prop, 0) != CUDA_SUCCESS) {
+            backed = false;
+        } else if(cuMemMap(at, vmm_chunk, 0, chunk.handle, 0) != CUDA_SUCCESS) {
+            cuMemRelease(chunk.handle);
+            backed = false;
+        } else {
+            chunk.resident = true;
+            device_copy_bytes += vmm_chunk;
+            vmm_resident_bytes += vmm_chunk;
+            mapped++;
+            backed = cuMemSetAccess(at, vmm_chunk, &access, 1) == CUDA_SUCCESS;
+        }
+    }
+    if(!backed) {
+        for(size_t m = 0; m < mapped; m++) {
+            penguin_vmm_unmap(copy, missing[m]);
+        }
+        return false;
+    }
+    penguin_budget_resize(gpu_memory > bytes ? gpu_memory - bytes : 0);
+    // the new chunks, and all of them once the host wrote the buffer
+    std::vector<bool> fill(copy.chunks.size(), copy.host_dirty);
+    for(size_t c : missing) {
+        fill[c] = true;
+    }
+    bool filled = false;
+    for(size_t c = 0; c < copy.chunks.size(); c++) {
+        if(fill[c]) {
+            unsigned long long offset = c * vmm_chunk;
+            unsigned long long chunk_bytes = penguin_vmm_chunk_bytes(copy, c);
+            cudaMemcpyAsync(copy.device + offset, copy.host + offset, chunk_bytes, cudaMemcpyHostToDevice,
+                    prefetch_engine.h2d);
+            penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) copy.host + offset, chunk_bytes);
+            filled = true;
+        }
+    }
+    if(filled) {
+        cudaStreamSynchronize(prefetch_engine.h2d);
+    }
+    copy.host_dirty = false;
+    return true;
+}
+
+// Unmaps every chunk of copy, after writing back those the launches had if
+// the data is kept
+void penguin_vmm_release(penguin_device_copy& copy, bool keep) {
+    std::vector<std::pair<penguin_device_copy*, size_t>> resident;
+    for(size_t c = 0; c < copy.chunks.size(); c++) {
+        if(copy.chunks[c].resident) {
+            resident.push_back(std::make_pair(&copy, c));
+        }
+    }
+    if(resident.empty()) {
+        return;
+    }
+    if(keep) {
+        penguin_vmm_write_back(resident);
+    } else {
+        cudaDeviceSynchronize();
+    }
+    for(auto &r : resident) {
+        penguin_vmm_unmap(copy, r.second);
+    }
+    penguin_budget_resize(gpu_memory + resident.size() * vmm_chunk);
+}
+#endif
+
+extern "C"
+cudaError_t penguinDeviceCopyMalloc(void** ptr, size_t size, unsigned int flags) {
+    PENGUIN_LOCKED_ENTRY();
+    if(size > 0 && penguin_device_copy_enabled() && penguin_policy() == PENGUIN_POLICY_SUV) {
+        penguinBudgetInit();
+        bool fits = penguin_device_copy_fits(size);
+        void* device = NULL;
+        void* host = NULL;
+#if PENGUIN_VMM
+        if(!fits && penguin_vmm_enabled() &&
+                penguin_device_copy_fits(size, device_copy_bytes - vmm_resident_bytes, PENGUIN_VMM_PCT) &&
+                (host = penguin_pinned_alloc(size)) != NULL) {
+            penguin_device_copy copy{(char*) host, NULL, size, true, false};
+            if(penguin_vmm_reserve(copy)) {
+                device_copies[(unsigned long long) host] = copy;
+                PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "vmm copy %p %llu", host, (unsigned long long) size);
+                *ptr = host;
+                return cudaSuccess;
+            }
+            penguin_pinned_free(host);
+        }
+#endif
+        if(fits && cudaMalloc(&device, size) == cudaSuccess) {
+            if((host = penguin_pinned_alloc(size)) != NULL) {
+                device_copies[(unsigned long long) host] =
+                    penguin_device_copy{(char*) host, (char*) device, size, true, false};
+                device_copy_bytes += size;
+                penguin_budget_resize(gpu_memory > size ? gpu_memory - size : 0);
+                PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "device copy %p %llu", host, (unsigned long long) size);
+                *ptr = host;
+                return cudaSuccess;
+            }
+            cudaFree(device);
+        }
+    }
+    return cudaMallocManaged(ptr, size, flags);
+}
+
+// What a launch gets for p, stored into its argument slot
+extern "C"
+void* penguinDevicePointer(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto c = penguin_device_copy_find(p);
+    if(c == device_copies.end()) {
+        return p;
+    }
+    penguin_device_copy& copy = c->second;
+#if PENGUIN_VMM
+    if(!copy.chunks.empty()) {
+        if(!penguin_vmm_map(copy)) {
+            // the launch takes the host buffer, which gets the data back
+            penguin_vmm_release(copy, true);
+            copy.host_dirty = false;
+            copy.device_dirty = false;
+            return p;
+        }
+        for(auto &chunk : copy.chunks) {
+            chunk.dirty = true;
+        }
+        copy.device_dirty = true;
+        return copy.device + ((char*) p - copy.host);
+    }
+#endif
+    if(copy.host_dirty) {
+        cudaMemcpy(copy.device, copy.host, copy.size, cudaMemcpyHostToDevice);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) copy.host, copy.size);
+        copy.host_dirty = false;
+    }
+    copy.device_dirty = true;
+    return copy.device + ((char*) p - copy.host);
+}
+
+// Before the host reads what the kernels wrote
+extern "C"
+void penguinDeviceCopySync(const void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto c = penguin_device_copy_find(p);
+    if(c == device_copies.end() || !c->second.device_dirty) {
+        return;
+    }
+    penguin_device_copy& copy = c->second;
+#if PENGUIN_VMM
+    if(!copy.chunks.empty()) {
+        std::vector<std::pair<penguin_device_copy*, size_t>> resident;
+        for(size_t r = 0; r < copy.chunks.size(); r++) {
+            if(copy.chunks[r].resident) {
+                resident.push_back(std::make_pair(&copy, r));
+            }
+        }
+        penguin_vmm_write_back(resident);
+        copy.device_dirty = false;
+        return;
+    }
+#endif
+    // the launches may be on any stream
+    cudaDeviceSynchronize();
+    cudaMemcpy(copy.host, copy.device, copy.size, cudaMemcpyDeviceToHost);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) copy.host, copy.size);
+    copy.device_dirty = false;
+}
+
+extern "C"
+cudaError_t penguinDeviceCopyFree(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto c = device_copies.find((unsigned long long) p);
+    if(c == device_copies.end()) {
+        return cudaFree(p);
+    }
+    unsigned long long size = c->second.size;
+#if PENGUIN_VMM
+    if(!c->second.chunks.empty()) {
+        penguin_vmm_release(c->second, false);
+        cuMemAddressFree((CUdeviceptr) c->second.device, c->second.reserved);
+        penguin_pinned_free(c->second.host);
+        device_copies.erase(c);
+        return cudaSuccess;
+    }
+#endif
+    cudaError_t status = cudaFree(c->second.device);
+    penguin_pinned_free(c->second.host);
+    device_copies.erase(c);
+    device_copy_bytes -= size;
+    penguin_budget_resize(gpu_memory + size);
+    return status;
+}
+
+// Readback prefetch (-penguin-readback-prefetch). After the last launch
+// before the host reads an allocation back, the host transform passes it
+// here, so its pages come back in one transfer on the D2H stream once the
+// kernels are done, rather than by a fault each when the host touches them.
+// Device copies come back through penguinDeviceCopySync instead.
+// PENGUIN_READBACK_PREFETCH=0 leaves them to the faults.
+int readback_prefetch_enabled = -1;
+
+bool penguin_readback_prefetch_enabled() {
+    if(readback_prefetch_enabled < 0) {
+        const char* env = getenv("PENGUIN_READBACK_PREFETCH");
+        readback_prefetch_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return readback_prefetch_enabled;
+}
+
+extern "C"
+void penguinReadbackPrefetch(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_readback_prefetch_enabled() || penguin_policy() != PENGUIN_POLICY_SUV ||
+            penguin_device_copy_find(p) != device_copies.end()) {
+        return;
+    }
+    unsigned id = lookup_allocation_id(p);
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].size == 0 ||
+            penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    // after the kernels launched so far, on whichever stream
+    cudaEventRecord(prefetch_engine.compute_done, 0);
+    cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+    penguin_mem_prefetch(desc.base, desc.size, cudaCpuDeviceId, prefetch_engine.d2h);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) desc.base, desc.size);
+}
+
+// First-touch placement (-penguin-first-touch). The decisions are made at
+// the first launch, after the host filled the allocations, so a GPU pinned
+// allocation is migrated there in full once it was written on the host.
+// When a replayed profile already says which allocations are pinned, the
+// memsets and memcpys the host transform found filling them before the
+// launches come here instead and write the pinned part on the GPU, where
+// the pages are first touched, and only the rest on the host.
+// PENGUIN_FIRST_TOUCH=0 fills everything on the host.
+int first_touch_enabled = -1;
+
+bool penguin_first_touch_enabled() {
+    if(first_touch_enabled < 0) {
+        const char* env = getenv("PENGUIN_FIRST_TOUCH");
+        first_touch_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return first_touch_enabled;
+}
+
+// How many bytes from p on the profile pins on the GPU, and on which device
+unsigned long long penguin_first_touch_gpu(void* p, unsigned long long length, int* device) {
+    if(!penguin_first_touch_enabled() || penguin_policy() != PENGUIN_POLICY_SUV || !profile_replay) {
+        return 0;
+    }
+    unsigned long long at = (unsigned long long) p;
+    auto a = allocation_interval_map.upper_bound(at);
+    if(a == allocation_interval_map.begin()) {
+        return 0;
+    }
+    a--;
+    penguin_alloc_desc& desc = allocation_table[a->second];
+    unsigned long long base = (unsigned long long) desc.base;
+    if(at >= base + desc.size || desc.seq >= profile_map->count) {
+        return 0;
+    }
+    const penguin_profile_record& r = penguin_profile_records()[desc.seq];
+    if(r.decision != PENGUIN_DEC_GPU_PIN && r.decision != PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) {
+        return 0;
+    }
+    unsigned long long stop = base + (r.gpu_res_stop < desc.size ? r.gpu_res_stop : desc.size);
+    *device = r.device < penguin_num_devices() ? r.device : 0;
+    if(at >= stop) {
+        return 0;
+    }
+    return length < stop - at ? length : stop - at;
+}
+
+extern "C"
+void penguinFirstTouchMemset(void* dst, int value, unsigned long long length) {
+    PENGUIN_LOCKED_ENTRY();
+    int device = 0;
+    unsigned long long gpu = penguin_first_touch_gpu(dst, length, &device);
+    if(gpu > 0) {
+        // the pages are populated where they are prefetched to
+        penguin_mem_prefetch(dst, gpu, device, 0);
+        cudaMemset(dst, value, gpu);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) dst, gpu);
+        // the host may read them right after, as after a memset
+        cudaStreamSynchronize(0);
+    }
+    memset((char*) dst + gpu, value, length - gpu);
+}
+
+extern "C"
+void penguinFirstTouchMemcpy(void* dst, const void* src, unsigned long long length) {
+    PENGUIN_LOCKED_ENTRY();
+    int device = 0;
+    unsigned long long gpu = penguin_first_touch_gpu(dst, length, &device);
+    if(gpu > 0) {
+        penguin_mem_prefetch(dst, gpu, device, 0);
+        cudaMemcpy(dst, src, gpu, cudaMemcpyDefault);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) dst, gpu);
+    }
+    memcpy((char*) dst + gpu, (const char*) src + gpu, length - gpu);
+}
+
+// Explicit copies (-penguin-explicit-managed). The host transform turns the
+// cudaMalloc calls of the program into cudaMallocManaged ones, which the
+// planners then place like any other, and sends its cudaMemcpy calls here.
+// A copy to an allocation writes the part pinned on the GPU there and the
+// rest on the host, where the prefetches the planners issue at the next
+// launch take it from. A copy from one reads the pinned part on the GPU and
+// brings the rest back in one prefetch before reading it on the host, rather
+// than by a fault per page. Copies between allocations, or between memory
+// the runtime does not know, stay cudaMemcpy calls.
+// PENGUIN_EXPLICIT_MANAGED=0 makes every copy a cudaMemcpy.
+int explicit_managed_enabled = -1;
+
+bool penguin_explicit_managed_enabled() {
+    if(explicit_managed_enabled < 0) {
+        const char* env = getenv("PENGUIN_EXPLICIT_MANAGED");
+        explicit_managed_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return explicit_managed_enabled;
+}
+
+// The allocation [p, p + length) is in, NULL if there is none
+penguin_alloc_desc* penguin_explicit_find(const void* p, unsigned long long length) {
+    unsigned long long at = (unsigned long long) p;
+    auto a = allocation_interval_map.upper_bound(at);
+    if(a == allocation_interval_map.begin()) {
+        return NULL;
+    }
+    a--;
+    penguin_alloc_desc& desc = allocation_table[a->second];
+    unsigned long long base = (unsigned long long) desc.base;
+    if(desc.size == 0 || at + length > base + desc.size) {
+        return NULL;
+    }
+    return &desc;
+}
+
+// How many bytes from p the allocation has pinned on the GPU
+unsigned long long penguin_explicit_gpu(const penguin_alloc_desc& desc, const void* p,
+        unsigned long long length) {
+    unsigned long long offset = (const char*) p - (const char*) desc.base;
+    if(desc.state != PENGUIN_STATE_GPU_PINNED || offset >= desc.gpu_res_stop) {
+        return 0;
+    }
+    return length < desc.gpu_res_stop - offset ? length : desc.gpu_res_stop - offset;
+}
+
+extern "C"
+cudaError_t penguinExplicitMemcpy(void* dst, const void* src, size_t count, cudaMemcpyKind kind) {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_alloc_desc* to = penguin_explicit_find(dst, count);
+    penguin_alloc_desc* from = penguin_explicit_find(src, count);
+    if(!penguin_explicit_managed_enabled() || count == 0 || (to == NULL) == (from == NULL)) {
+        return cudaMemcpy(dst, src, count, kind);
+    }
+    // cudaMemcpy waits for the kernels launched so far, and so does this
+    cudaError_t status = cudaDeviceSynchronize();
+    if(status != cudaSuccess) {
+        return status;
+    }
+    if(to != NULL) {
+        int device = to->device;
+        unsigned long long gpu = penguin_explicit_gpu(*to, dst, count);
+        if(gpu == 0) {
+            // before the first launch, from the replayed profile
+            gpu = penguin_first_touch_gpu(dst, count, &device);
+        }
+        if(gpu > 0) {
+            penguin_mem_prefetch(dst, gpu, device, 0);
+            status = cudaMemcpy(dst, src, gpu, cudaMemcpyDefault);
+            penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) dst, gpu);
+        }
+        memcpy((char*) dst + gpu, (const char*) src + gpu, count - gpu);
+        return status;
+    }
+    unsigned long long gpu = penguin_explicit_gpu(*from, src, count);
+    if(gpu > 0) {
+        status = cudaMemcpy(dst, src, gpu, cudaMemcpyDefault);
+    }
+    if(count > gpu) {
+        penguin_mem_prefetch((const char*) src + gpu, count - gpu, cudaCpuDeviceId, 0);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) src + gpu, count - gpu);
+        cudaStreamSynchronize(0);
+        memcpy((char*) dst + gpu, (const char*) src + gpu, count - gpu);
+    }
+    return status;
+}
+
+// Field split (-penguin-field-split). For the same allocations, when every
+// kernel they are passed to only accesses them field by field (RK_FieldSplit
+// of CudaAnalysis), the host transform registers the struct layout and the
+// fields the kernels load and store. At the first launch after the host
+// wrote the array, the runtime copies the fields the kernels access into an
+// allocation of its own, a header with the offset of each field's array and
+// the arrays, 2MB aligned once they are that large, and passes the kernels
+// its address with bit 63 set (see FieldSplit.h). That allocation is the one
+// the planner places, the fields the kernels never touch are never
+// migrated. The fields kernels store are copied back before the host reads
+// them. PENGUIN_FIELD_SPLIT=0 passes the arrays of structs as they are.
+#define PENGUIN_FIELD_SPLIT_TAG (1ULL << 63)
+#define PENGUIN_FIELD_SPLIT_HEADER 256ULL
+#define PENGUIN_FIELD_SPLIT_ALIGN (2ULL * 1024 * 1024)
+
+typedef struct
+{
+    char* base;
+    unsigned long long count; // structs, once split
+    unsigned long long struct_bytes;
+    unsigned fields;
+    unsigned loaded;
+    unsigned stored;
+    std::vector<unsigned long long> field_offsets;
+    std::vector<unsigned long long> field_bytes;
+    // the split allocation, and the offset of each field's array in it, 0
+    // for the ones no kernel accesses
+    char* split;
+    unsigned long long split_bytes;
+    std::vector<unsigned long long> array_offsets;
+    bool host_dirty;   // written by the host since it was split
+    bool device_dirty; // given to a launch that stores since it was gathered
+} penguin_field_split;
+
+// array of structs base -> split
+std::map<unsigned long long, penguin_field_split> field_splits;
+int field_split_enabled = -1;
+
+bool penguin_field_split_enabled() {
+    if(field_split_enabled < 0) {
+        const char* env = getenv("PENGUIN_FIELD_SPLIT");
+        field_split_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return field_split_enabled;
+}
+
+// Bytes of the managed allocation at base, 0 if it was never registered
+unsigned long long penguin_field_split_size(const penguin_field_split& split) {
+    auto id = lookup_allocation_id(split.base);
+    return id == PENGUIN_INVALID_ALLOC_ID ? 0 : allocation_table[id].size;
+}
+
+// The registered array of structs that holds p
+std::map<unsigned long long, penguin_field_split>::iterator penguin_field_split_find(const void* p) {
+    auto s = field_splits.upper_bound((unsigned long long) p);
+    if(s == field_splits.begin()) {
+        return field_splits.end();
+    }
+    s--;
+    const penguin_field_split& split = s->second;
+    unsigned long long size = split.split != NULL ? split.count * split.struct_bytes
+                                                  : penguin_field_split_size(split);
+    return (const char*) p == split.base || (const char*) p < split.base + size ? s : field_splits.end();
+}
+
+// Bytes of a struct the split allocation holds
+unsigned long long penguin_field_split_bytes(const penguin_field_split& split) {
+    unsigned long long bytes = 0;
+    for(unsigned f = 0; f < split.fields; f++) {
+        if((split.loaded | split.stored) & (1U << f)) {
+            bytes += split.field_bytes[f];
+        }
+    }
+    return bytes;
+}
+
+// Lays the split allocation out and allocates it; false if the array is not
+// one of whole structs or there is no room
+bool penguin_field_split_allocate(penguin_field_split& split) {
+    unsigned long long size = penguin_field_split_size(split);
+    if(size == 0 || size % split.struct_bytes != 0) {
+        return false;
+    }
+    split.count = size / split.struct_bytes;
+    split.array_offsets.assign(split.fields, 0);
+    unsigned long long end = PENGUIN_FIELD_SPLIT_HEADER;
+    for(unsigned f = 0; f < split.fields; f++) {
+        if(!((split.loaded | split.stored) & (1U << f))) {
+            continue;
+        }
+        unsigned long long bytes = split.count * split.field_bytes[f];
+        unsigned long long align = bytes >= PENGUIN_FIELD_SPLIT_ALIGN ? PENGUIN_FIELD_SPLIT_ALIGN : 256;
+        end = (end + align - 1) / align * align;
+        split.array_offsets[f] = end;
+        end += bytes;
+    }
+    void* p = NULL;
+    if(cudaMallocManaged(&p, end) != cudaSuccess) {
+        return false;
+    }
+    split.split = (char*) p;
+    split.split_bytes = end;
+    memcpy(split.split, split.array_offsets.data(), split.fields * sizeof(unsigned long long));
+    penguin_register_allocation(split.split, split.split_bytes);
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "field split %p %u of %u fields", split.base,
+                      __builtin_popcount(split.loaded | split.stored), split.fields);
+    return true;
+}
+
+// Copies the fields in mask from the array of structs into the split
+// allocation, or back
+void penguin_field_split_copy(penguin_field_split& split, unsigned mask, bool scatter) {
+    for(unsigned f = 0; f < split.fields; f++) {
+        if(!(mask & (1U << f))) {
+            continue;
+        }
+        unsigned long long bytes = split.field_bytes[f];
+        char* field = split.base + split.field_offsets[f];
+        char* array = split.split + split.array_offsets[f];
+        for(unsigned long long i = 0; i < split.count; i++) {
+            if(scatter) {
+                memcpy(array + i * bytes, field + i * split.struct_bytes, bytes);
+            } else {
+                memcpy(field + i * split.struct_bytes, array + i * bytes, bytes);
+            }
+        }
+    }
+}
+
+// Layout: struct bytes, fields, fields loaded, fields stored, then offset and
+// bytes of each field
+extern "C"
+void penguinFieldSplitRegister(void* p, const unsigned long long* layout) {
+    PENGUIN_LOCKED_ENTRY();
+    if(p == NULL || !penguin_field_split_enabled() || penguin_policy() != PENGUIN_POLICY_SUV ||
+            penguin_device_copy_find(p) != device_copies.end()) {
+        return;
+    }
+    penguin_field_split split = {};
+    split.base = (char*) p;
+    split.struct_bytes = layout[0];
+    split.fields = layout[1];
+    split.loaded = layout[2];
+    split.stored = layout[3];
+    for(unsigned f = 0; f < split.fields; f++) {
+        split.field_offsets.push_back(layout[4 + 2 * f]);
+        split.field_bytes.push_back(layout[5 + 2 * f]);
+    }
+    split.host_dirty = true;
+    field_splits[(unsigned long long) p] = split;
+}
+
+// What a launch gets for p, stored into its argument slot
+extern "C"
+void* penguinFieldSplitPointer(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto s = penguin_field_split_find(p);
+    if(s == field_splits.end()) {
+        return p;
+    }
+    penguin_field_split& split = s->second;
+    if((char*) p != split.base) {
+        // the kernels address a split allocation from its start only; one
+        // given a pointer into the array gets the array, up to date
+        if(split.split != NULL && split.device_dirty) {
+            cudaDeviceSynchronize();
+            penguin_field_split_copy(split, split.stored, false);
+            split.device_dirty = false;
+        }
+        split.host_dirty = true;
+        return p;
+    }
+    if(split.split == NULL && !penguin_field_split_allocate(split)) {
+        field_splits.erase(s);
+        return p;
+    }
+    if(split.host_dirty) {
+        // the launches before may still read the split allocation
+        cudaDeviceSynchronize();
+        penguin_field_split_copy(split, split.loaded | split.stored, true);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) split.split, split.split_bytes);
+        split.host_dirty = false;
+    }
+    if(split.stored) {
+        split.device_dirty = true;
+    }
+    return (void*) ((unsigned long long) split.split | PENGUIN_FIELD_SPLIT_TAG);
+}
+
+// Before the host reads what the kernels wrote
+extern "C"
+void penguinFieldSplitSync(const void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    auto s = penguin_field_split_find(p);
+    if(s == field_splits.end() || s->second.split == NULL || !s->second.device_dirty) {
+        return;
+    }
+    penguin_field_split& split = s->second;
+    // the launches may be on any stream
+    cudaDeviceSynchronize();
+    penguin_field_split_copy(split, split.stored, false);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) split.split, split.split_bytes);
+    split.device_dirty = false;
+}
+
+// TODO: fix this ASAP
+// caller is the allocation's call site, see penguin_alloc_site
+void penguin_add_allocation(void** ptr, unsigned long long size, const void* caller) {
+    PENGUIN_LOCKED_ENTRY();
+    void* p = (void*) *ptr;
+    /* std::cout << "added to allocation map, " << p << " " << size << "\n"; */
+    // arena objects are part of their slab's allocation, device copies are
+    // not managed
+    if(penguin_arena_object_base(p) || penguin_device_copy_find(p) != device_copies.end()) {
+        return;
+    }
+    penguin_register_allocation(p, size);
+    if(nvme_files.count((unsigned long long) p)) {
+        allocation_desc(p).system = true;
+        allocation_desc(p).nvme = true;
+    }
+    allocation_desc(p).site = penguin_alloc_site(caller);
+    if(penguin_overrides_enabled()) {
+        penguin_override_bind_site(lookup_allocation_id(p));
+    }
+    return;
+}
+
+// not inlined, its return address is in the caller
+extern "C" __attribute__((noinline))
+void addIntoAllocationMap(void** ptr, unsigned long long size) {
+    penguin_add_allocation(ptr, size, __builtin_return_address(0));
+}
+
+extern "C"
+void removeFromAllocationMap(void* ptr) {
+    PENGUIN_LOCKED_ENTRY();
+    auto id = lookup_allocation_id(ptr);
+    if(id == PENGUIN_INVALID_ALLOC_ID) {
+        return;
+    }
+    /* std::cout << "removed from allocation map, " << ptr << "\n"; */
+    allocation_interval_map.erase((unsigned long long) allocation_table[id].base);
+    allocation_table[id].size = 0;
+    allocation_table[id].dead = false;
+    allocation_table[id].system = false;
+    allocation_table[id].nvme = false;
+    allocation_table[id].host_tier_sent = 0;
+    allocation_table[id].hint = PENGUIN_HINT_NONE;
+    allocation_table[id].site = 0;
+    allocation_table[id].override_rule = 0;
+    mmg_input_generation++;
+}
+
+// Whether device 0 accesses pageable host memory, i.e. whether the driver
+// runs HMM and the SUV policies apply to system allocations
+bool penguin_system_memory_supported() {
+    static int supported = -1;
+    if(supported < 0) {
+        int pageable = 0;
+        cudaDeviceGetAttribute(&pageable, cudaDevAttrPageableMemoryAccess, 0);
+        supported = pageable != 0;
+    }
+    return supported;
+}
+
+// Registers system-allocated memory (malloc, mmap) the kernels access, so
+// the planner places it like a managed allocation; the driver keeps its
+// policies on the HMM va_blocks. Host huge pages are the one decision left
+// out, they only apply to cudaMallocManaged ranges.
+extern "C"
+penguin_error_t penguinRegisterSystemAllocation(void* ptr, size_t size) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_system_memory_supported()) {
+        fprintf(stderr, "system allocation %p not registered, no pageable memory access\n", ptr);
+        return PENGUIN_ERR_NOT_IMPLEMENTED;
+    }
+    penguin_register_allocation(ptr, size);
+    allocation_desc(ptr).system = true;
+    return PENGUIN_OK;
+}
+
+extern "C"
+void penguinUnregisterSystemAllocation(void* ptr) {
+    removeFromAllocationMap(ptr);
+}
+
+extern "C"
+void printAllocationMap() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "size map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->size << "\n"; */
+    }
+}
+
+extern "C"
+unsigned long long getAllocationSize(void* ptr) {
+    PENGUIN_ENTRY();
+    return allocation_desc(ptr).size;
+}
+
+extern "C"
+void addACToAllocation(void* ptr, unsigned long long count) {
+    PENGUIN_LOCKED_ENTRY();
+    /* void* p = (void*) *ptr; */
+    /* std::cout << ptr << std::endl; */
+    allocation_desc(ptr).ac += count;
+    penguin_arena_credit(ptr, count);
+    return;
+}
+
+extern "C"
+void printACToAllocationMap() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "ac map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->ac << "\n"; */
+    }
+}
+
+extern "C"
+float getAccessDensity(void* ptr) {
+    PENGUIN_ENTRY();
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    return (float) desc.ac / (float) desc.size;
+}
+
+// TODO : add a method for clearing the access counts in allocation_table
+
+extern "C"
+unsigned long long accessCountForAllocation(void* ptr) {
+    PENGUIN_ENTRY();
+    return allocation_desc(ptr).ac;
+}
+
+extern "C"
+void add_pd_bidx_to_allocation(void* ptr, unsigned long long pd_bidx) {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    if(desc.pd_bidx < pd_bidx) {
+        desc.pd_bidx = pd_bidx;
+    }
+}
+
+extern "C"
+void add_pd_bidy_to_allocation(void* ptr, unsigned long long pd_bidy) {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    if(desc.pd_bidy < pd_bidy) {
+        desc.pd_bidy = pd_bidy;
+    }
+}
+
+extern "C"
+void add_pd_phi_to_allocation(void* ptr, unsigned long long pd_phi) {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    if(desc.pd_phi < pd_phi) {
+        desc.pd_phi = pd_phi;
+    }
+}
+
+extern "C"
+unsigned long long get_pd_bidx(void* ptr) {
+    PENGUIN_ENTRY();
+    /* std::cout <<  "pd_bidx = " << allocation_desc(ptr).pd_bidx << "\n"; */
+    return allocation_desc(ptr).pd_bidx;
+}
+
+extern "C"
+unsigned long long get_pd_bidy(void* ptr) {
+    PENGUIN_ENTRY();
+    /* std::cout <<  "pd_bidy = " << allocation_desc(ptr).pd_bidy << "\n"; */
+    return allocation_desc(ptr).pd_bidy;
+}
+
+extern "C"
+unsigned long long get_pd_phi(void* ptr) {
+    PENGUIN_ENTRY();
+    /* std::cout <<  "pd_phi = " << allocation_desc(ptr).pd_phi << "\n"; */
+    return allocation_desc(ptr).pd_phi;
+}
+
+extern "C"
+void print_pd_bidx_map() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "bidx map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->pd_bidx << "\n"; */
+    }
+}
+
+extern "C"
+void print_pd_bidy_map() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "bidy map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->pd_bidy << "\n"; */
+    }
+}
+
+extern "C"
+void print_pd_phi_map() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "phi map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->pd_phi << "\n"; */
+    }
+}
+
+extern "C"
+void add_wss_to_map(void *ptr, unsigned long long wss, unsigned aid) {
+    PENGUIN_LOCKED_ENTRY();
+    auto w = aid_wss_map.find(aid);
+    if(w == aid_wss_map.end() || w->second != wss) {
+        mmg_aid_changed(&aid_wss_map, aid, w != aid_wss_map.end(),
+                w != aid_wss_map.end() ? w->second : 0, wss);
+    }
+    aid_wss_map[aid] = wss;
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    if(desc.wss < wss) {
+        desc.wss = wss;
+    }
+}
+
+extern "C"
+void print_wss_map() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "wss map\n"; */
+    for (auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        /* std::cout << a->base << " " << a->wss << "\n"; */
+    }
+}
+
+extern "C"
+unsigned long long get_wss(void* ptr) {
+    PENGUIN_ENTRY();
+    return allocation_desc(ptr).wss;
+}
+
+extern "C"
+void print_value_i32(unsigned value) {
+    PENGUIN_ENTRY();
+    /* std::cout << "value(i32) = " << value << std::endl; */
+}
+
+extern "C"
+void print_value_i64(uint64_t value) {
+    PENGUIN_ENTRY();
+    /* std::cout << "value(i64) = " << value << std::endl; */
+}
+
+extern "C"
+void print_value_f32(float value) {
+    PENGUIN_ENTRY();
+    /* std::cout << "value(f32) = " << value << std::endl; */
+}
+
+extern "C"
+void print_value_f64(double value) {
+    PENGUIN_ENTRY();
+    /* std::cout << "value(f64) = " << value << std::endl; */
+}
+
+extern "C"
+float compute_access_density(void* ptr, unsigned numThreads, unsigned loopIters, unsigned long long size) {
+    PENGUIN_ENTRY();
+    float ad = ((float)numThreads * (float)loopIters) / (float)size;
+    /* std::cout << "ad is " << ad << "\n"; */
+    return ad;
+}
+
+bool sortfunc(std::pair<void*, unsigned long long> &a,  std::pair<void*, unsigned long long> &b){
+    return a.second > b.second;
+}
+
+bool sortfuncf(std::pair<void*, float> &a,  std::pair<void*, float> &b){
+    return a.second > b.second;
+}
+
+
+/* extern "C" */
+/* void sort_wss() { */
+/*   std::copy(allocation_wss_map.begin(), allocation_wss_map.end(),back_inserter<std::vector<std::pair<void*, unsigned long long> > >(wss_vector)); */
+/*   std::sort(wss_vector.begin(), wss_vector.end(), sortfunc); */
+  /* std::cout << "sorted wss\n"; */
+/*   for(auto wss = wss_vector.begin(); wss != wss_vector.end(); wss++) { */
+/*     std::cout << wss->first << " " << wss->second << "\n"; */
+/*   } */
+/* } */
+
+#define PG_SIZE (2*1024ULL*1024ULL)
+
+unsigned long long roundup(unsigned long long value) {
+    return (value + PG_SIZE -1) & ~(PG_SIZE-1);
+}
+    
+extern "C"
+unsigned long long estimate_working_set2(unsigned long long wss_per_tb, unsigned bdimx, unsigned bdimy) {
+    PENGUIN_ENTRY();
+    /* std::cout << "wss 2 = " <<  wss_per_tb << std::endl; */
+    wss_per_tb = roundup(wss_per_tb * 4); // 4 bytes per element in all our workloads
+    
+    unsigned long long numTBs = (1536)/(bdimx * bdimy);
+    numTBs = numTBs * 82;
+    /* std::cout << "wss 2 sum = " << wss_per_tb * numTBs << std::endl; */
+    return wss_per_tb * numTBs;
+}
+
+extern "C"
+unsigned long long estimate_working_set(unsigned long long pd_bidx, unsigned long long pd_bidy, unsigned long long pd_phi, unsigned loopiters, unsigned bdimx, unsigned bdimy, unsigned gdimx, unsigned gdimy) {
+    PENGUIN_ENTRY();
+    unsigned long long max = 0;
+    if((pd_phi * loopiters) > max) {
+        max = pd_phi * loopiters;
+    }
+    unsigned long long numTBs = (1536)/(bdimx * bdimy);
+    numTBs = numTBs * 82;
+    /* std::cout << "bdimx,y,liters = " << bdimx << " " << bdimy << " " << loopiters << "\n"; */
+    /* std::cout << "numTBs = " << numTBs << "\n"; */
+    unsigned long long concTBx = (gdimx > numTBs) ? numTBs: gdimx;
+    unsigned long long concTBy = (gdimx > numTBs) ? 1 : (numTBs/gdimx);
+    if((pd_bidx * concTBx) > max) {
+        max = pd_bidx * concTBx;
+    }
+    if((pd_bidy * concTBy) > max) {
+        max = pd_bidy * concTBy;
+    }
+    /* std::cout << "params = " << pd_phi << " " << pd_bidx << " " << loopiters << " " << gdimx << " " << concTBx << " " << "\n"; */
+    /* std::cout << "working set = " << max << "\n"; */
+    return max;
+}
+/* float compute_access_pattern_dx(void* ptr, */ 
+
+
+extern "C"
+void* identify_memory_allocation(void* addr) {
+    PENGUIN_LOCKED_ENTRY();
+    unsigned long long addr_ull = (unsigned long long) addr;
+    // the candidate is the allocation with the greatest base at or below addr
+    auto a = allocation_interval_map.upper_bound(addr_ull);
+    if(a == allocation_interval_map.begin()) {
+        return 0;
+    }
+    a--;
+    unsigned long long alloc_ull = a->first;
+    unsigned long long size = allocation_table[a->second].size;
+    if(alloc_ull < addr_ull && addr_ull < alloc_ull + size) {
+        return allocation_table[a->second].base;
+    }
+    return 0;
+}
+
+// Finds the allocation enclosing an interior pointer recorded by the
+// instrumentation and makes the pointer share that allocation's descriptor.
+void* alias_interior_pointer(void* ptr) {
+    auto id = lookup_allocation_id(ptr);
+    if(id != PENGUIN_INVALID_ALLOC_ID && allocation_table[id].size != 0) {
+        return ptr;
+    }
+    void * insideallocation = identify_memory_allocation(ptr);
+    auto inside_id = lookup_allocation_id(insideallocation);
+    if(inside_id == PENGUIN_INVALID_ALLOC_ID) {
+        allocation_desc(ptr);
+    } else {
+        allocation_id_map.insert(ptr, inside_id);
+    }
+    return insideallocation;
+}
+
+extern "C"
+unsigned estimate_working_set_iteration(unsigned gdimx, unsigned gdimy, unsigned bdimx, unsigned bdimy) {
+    PENGUIN_ENTRY();
+    return 42;
+}
+
+extern "C"
+void add_aid_pchase_map(unsigned aid, void* addr, bool pchase) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    /* std::cout << "added to pchase map " << aid << " " << addr << "\n"; */
+    mmg_update_aid(aid_pchase_map, aid, pchase);
+    aid_allocation_map[aid] = addr;
+}
+
+extern "C"
+void add_aid_ac_incomp_map(unsigned aid, bool incomp) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    auto i = aid_ac_incomp_map.find(aid);
+    if(i == aid_ac_incomp_map.end() || i->second != incomp) {
+        mmg_aid_changed(&aid_ac_incomp_map, aid, i != aid_ac_incomp_map.end(),
+                i != aid_ac_incomp_map.end() && i->second, incomp);
+    }
+    aid_ac_incomp_map[aid] = incomp;
+}
+
+extern "C"
+void add_aid_wss_map_iterdep(unsigned aid, unsigned long long wss) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    /* std::cout << "added to iterdep map " << aid << " " << wss << "\n"; */
+    mmg_update_aid(aid_wss_map_iterdep, aid, wss);
+    if(PENGUIN_ACCESS_SAMPLING) {
+        sampled_predicted_wss[aid] = std::max(sampled_predicted_wss[aid], wss);
+    }
+}
+
+extern "C"
+void add_aid_wss_map(unsigned aid, unsigned long long wss) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    mmg_update_aid(aid_wss_map, aid, wss);
+    if(PENGUIN_ACCESS_SAMPLING) {
+        sampled_predicted_wss[aid] = std::max(sampled_predicted_wss[aid], wss);
+    }
+}
+
+extern "C"
+void add_aid_ac_map(unsigned aid, unsigned long long ac) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    mmg_update_aid(aid_ac_map, aid, ac);
+    if(PENGUIN_ACCESS_SAMPLING) {
+        sampled_predicted_ac[aid] += ac;
+    }
+}
+
+extern "C"
+void add_aid_allocation_map(unsigned aid, void* allocation) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    /* std::cout<< "add_aid_allocation_map " << aid << " " << allocation << std::endl; */
+    auto a = aid_allocation_map.find(aid);
+    // perform_memory_management rewrites interior pointers to their allocation,
+    // so the same pointer coming back is not a change
+    if(a == aid_allocation_map.end() || (a->second != allocation &&
+                (lookup_allocation_id(allocation) == PENGUIN_INVALID_ALLOC_ID ||
+                 lookup_allocation_id(allocation) != lookup_allocation_id(a->second)))) {
+        mmg_dirty_aids.insert(aid);
+        mmg_input_generation++;
+    }
+    aid_allocation_map[aid] = allocation;
+}
+
+extern "C"
+void add_aid_invocation_map(unsigned aid, unsigned invocation_id) {
+    PENGUIN_LOCKED_ENTRY();
+    if(profile_replay) {
+        return;
+    }
+    mmg_update_aid(aid_invocation_id_map, aid, invocation_id);
+}
+
+// An allocation that kernels only load from keeps a valid host copy when it
+// is read duplicated on the GPU, so evicting it there needs no D2H transfer.
+// Duplicates [base, base + bytes) of allocation if it is read-only so far, or
+// the analysis says it will be, and drops the duplication of the rest.
+void penguin_set_read_dup(void* allocation, unsigned long long bytes) {
+    auto &desc = allocation_desc(allocation);
+    if(!PENGUIN_READ_DUPLICATION || !(desc.loaded || desc.read_only) || desc.stored) {
+        bytes = 0;
+    }
+    if(bytes > desc.size) {
+        bytes = desc.size;
+    }
+    if(bytes > desc.read_dup) {
+        penguin_mem_advise((char*) allocation + desc.read_dup, bytes - desc.read_dup, cudaMemAdviseSetReadMostly, 0);
+    } else if(bytes < desc.read_dup) {
+        penguin_mem_advise((char*) allocation + bytes, desc.read_dup - bytes, cudaMemAdviseUnsetReadMostly, 0);
+    }
+    desc.read_dup = bytes;
+}
+
+// Called by DynamicHostTransform -penguin-read-mostly after the
+// cudaMallocManaged of an allocation that only goes to kernel arguments the
+// device analysis found to be only loaded from: the planners may read
+// duplicate it before a launch has shown it is not stored, e.g. when they
+// look ahead. A kernel storing to it after all drops the duplication in
+// penguin_note_access.
+extern "C"
+void penguinAdviseReadMostly(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    if(p == NULL || penguin_policy() != PENGUIN_POLICY_SUV ||
+            penguin_device_copy_find(p) != device_copies.end()) {
+        return;
+    }
+    allocation_desc(p).read_only = true;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "read mostly %p", p);
+}
+
+// Called by DynamicHostTransform -penguin-write-stream after the
+// cudaMallocManaged of an allocation that only goes to kernel arguments the
+// device analysis found to be only stored to: an output written once by the
+// kernels and read by the host. It stays in host memory, which the kernels
+// write over the link, rather than migrate to the GPU and back; the planners
+// never see it, so it takes none of the GPU memory. The first kernel to load
+// it after all hands it back to them in penguin_note_access.
+extern "C"
+void penguinAdviseWriteStream(void* p) {
+    PENGUIN_LOCKED_ENTRY();
+    if(p == NULL || penguin_policy() != PENGUIN_POLICY_SUV ||
+            penguin_device_copy_find(p) != device_copies.end()) {
+        return;
+    }
+    allocation_desc(p).write_stream = true;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "write stream %p", p);
+}
+
+// Declares how the kernels access the size bytes at ptr, 0 for the whole
+// allocation: pattern one of PENGUIN_HINT_*, optionally with
+// PENGUIN_HINT_SCRATCH, and priority the accesses per 4-byte word a launch
+// makes, 0 for the pattern's default. A later hint replaces it.
+extern "C"
+void penguinHint(void* ptr, size_t size, unsigned pattern, unsigned priority) {
+    PENGUIN_LOCKED_ENTRY();
+    if(ptr == NULL || penguin_policy() != PENGUIN_POLICY_SUV ||
+            (pattern & PENGUIN_HINT_PATTERN) > PENGUIN_HINT_COLD) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_desc(ptr);
+    desc.hint = pattern;
+    desc.hint_priority = priority;
+    desc.hint_size = size;
+    mmg_input_generation++;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "hint %p %u %u", ptr, pattern, priority);
+}
+
+// The access count and working set the hint of allocation stands for, in
+// place of the unresolved access aid of invocation invid; false if it has
+// none that does
+bool penguin_hint_record(void* allocation, unsigned aid, unsigned invid, int device) {
+    penguin_alloc_desc& desc = allocation_desc(allocation);
+    unsigned pattern = desc.hint & PENGUIN_HINT_PATTERN;
+    if(pattern == PENGUIN_HINT_NONE || pattern == PENGUIN_HINT_IRREGULAR || desc.size == 0) {
+        return false;
+    }
+    unsigned long long bytes = desc.hint_size ? std::min(desc.hint_size, desc.size) : desc.size;
+    unsigned long long per_word = desc.hint_priority;
+    if(per_word == 0) {
+        per_word = pattern == PENGUIN_HINT_DENSE ? PENGUIN_HINT_DENSE_ACCESSES :
+            pattern == PENGUIN_HINT_STREAM ? 1 : 0;
+    }
+    unsigned long long ac = bytes / sizeof(unsigned) * per_word;
+    desc.device_ac[device] += ac;
+    addACToAllocation(allocation, ac);
+    add_aid_allocation_map(aid, allocation);
+    add_aid_ac_map(aid, ac);
+    add_wss_to_map(allocation, bytes, aid);
+    add_aid_invocation_map(aid, invid);
+    return true;
+}
+
+// Set when a device starts accessing an allocation, the placement is redone
+bool mmg_devices_changed = false;
+// Set when an allocation is freed, likewise, so its share goes to the others
+bool mmg_allocation_freed = false;
+// gpu_memory the last global placement was made for, 0 before the first
+unsigned long long mmg_planned_budget = 0;
+
+// Devices whose kernels access the allocation, device 0 before any launch
+unsigned penguin_access_devices(const penguin_alloc_desc& desc) {
+    return desc.devices ? desc.devices : 1u;
+}
+
+// The accessing device with the most accesses counted
+int penguin_home_device(const penguin_alloc_desc& desc) {
+    unsigned devices = penguin_access_devices(desc);
+    int home = -1;
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        if((devices & (1u << d)) && (home < 0 || desc.device_ac[d] > desc.device_ac[home])) {
+            home = d;
+        }
+    }
+    return home < 0 ? 0 : home;
+}
+
+// us the kernels that access the allocation spend on it when it is on
+// processor, over the link of each accessing device; on the host, from its
+// host tier
+double penguin_placement_cost(const penguin_alloc_desc& desc, int processor) {
+    unsigned devices = penguin_access_devices(desc);
+    double cost = 0;
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        if(devices & (1u << d)) {
+            cost += processor == PENGUIN_HOST ? penguin_host_tier_cost(d, desc.host_tier, desc.device_ac[d]) :
+                penguin_access_cost(d, processor, desc.device_ac[d]);
+        }
+    }
+    return cost;
+}
+
+// Device the GPU part of size bytes of an allocation goes on: the home device,
+// unless another one is cheaper for the accessing kernels and it fits there
+// but not at home, or neither fits and it has more room. Any device qualifies
+// as long as its cost is below leaving the allocation on the host, so a fast
+// peer with room takes what the home device cannot, while one only reached
+// over PCIe keeps its memory for its own allocations. Placing it where it
+// doesn't fit only gets a partial pin.
+int penguin_place_device(const penguin_alloc_desc& desc, unsigned long long size) {
+    int best = penguin_home_device(desc);
+    if(penguin_num_devices() == 1) {
+        return best;
+    }
+    double host_cost = penguin_placement_cost(desc, desc.nvme ? PENGUIN_NVME : PENGUIN_HOST);
+    double best_cost = penguin_placement_cost(desc, best);
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        double cost = penguin_placement_cost(desc, d);
+        if(d == best || cost >= host_cost) {
+            continue;
+        }
+        bool fits = penguin_device_available(d) >= size;
+        bool best_fits = penguin_device_available(best) >= size;
+        if(fits != best_fits ? fits : (fits ? cost < best_cost :
+                    penguin_device_available(d) > penguin_device_available(best))) {
+            best = d;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// Maps [base, base + length) of an allocation placed on device from the other
+// devices that access it and can reach device over peer links, which then
+// access it remotely rather than migrate it: always when kernels store to it,
+// as it would move back and forth, and when a copy costs more than the
+// accesses of the device otherwise. Returns whether some device maps it and
+// none is better off with a read duplicate.
+bool penguin_map_peers(void* base, size_t length, const penguin_alloc_desc& desc, int device) {
+    unsigned devices = penguin_access_devices(desc);
+    bool mapped = false;
+    bool duplicate = false;
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        if(d == device || !(devices & (1u << d))) {
+            continue;
+        }
+        if(penguin_peer_access(d, device) && (desc.stored ||
+                    penguin_access_cost(d, device, desc.device_ac[d]) <=
+                    penguin_migration_cost(device, d, length))) {
+            penguin_mem_advise((char*) base, length, cudaMemAdviseSetAccessedBy, d);
+            mapped = true;
+        } else {
+            duplicate = true;
+        }
+    }
+    return mapped && !duplicate;
+}
+
+// Allocations migrated on demand without a loop stride have the driver learn
+// their block-to-block fault transitions and prefetch the blocks that
+// usually follow a faulting one. PENGUIN_MARKOV_PREFETCH=0 leaves them to the
+// faults.
+int markov_prefetch_enabled = -1;
+
+bool penguin_markov_prefetch_enabled() {
+    if(markov_prefetch_enabled < 0) {
+        const char* env = getenv("PENGUIN_MARKOV_PREFETCH");
+        markov_prefetch_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return markov_prefetch_enabled;
+}
+
+// Maps [base, base + length) of an allocation left on the host from every
+// device that accesses it
+void penguin_map_remote(void* base, size_t length, const penguin_alloc_desc& desc) {
+    // faulted over to the GPU instead, where its atomics are native
+    if(desc.atomic) {
+        return;
+    }
+    unsigned devices = penguin_access_devices(desc);
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        if(devices & (1u << d)) {
+            penguin_mem_advise((char*) base, length, cudaMemAdviseSetAccessedBy, d);
+        }
+    }
+}
+
+// Places a write-stream allocation on the host and maps it from the devices
+// that write it, again whenever one more does
+void penguin_write_stream_place(void* allocation, int device) {
+    auto &desc = allocation_desc(allocation);
+    if(desc.decision != PENGUIN_DEC_HOST_WRITE_STREAM) {
+        desc.state = PENGUIN_STATE_HOST;
+        penguin_set_decision(desc, PENGUIN_DEC_HOST_WRITE_STREAM);
+        penguin_mem_advise(allocation, desc.size, cudaMemAdviseSetPreferredLocation, cudaCpuDeviceId);
+        penguinSetNoMigrateRegion(allocation, desc.size, 0, true);
+        penguin_map_remote(allocation, desc.size, desc);
+    } else {
+        penguin_mem_advise(allocation, desc.size, cudaMemAdviseSetAccessedBy, device);
+    }
+}
+
+// A kernel loads the write-stream allocation after all: the planners place
+// it from the next launch on
+void penguin_write_stream_drop(void* allocation) {
+    auto &desc = allocation_desc(allocation);
+    desc.write_stream = false;
+    if(desc.decision == PENGUIN_DEC_HOST_WRITE_STREAM) {
+        penguin_mem_advise(allocation, desc.size, cudaMemAdviseUnsetPreferredLocation, cudaCpuDeviceId);
+        penguinSetNoMigrateRegion(allocation, desc.size, 0, false);
+        penguin_set_decision(desc, PENGUIN_DEC_NONE);
+    }
+    mmg_input_generation++;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "write stream dropped %p", allocation);
+}
+
+// The host regions of a host_regions allocation go back to its GPU part
+// before the launch, rather than fault there a page at a time
+void penguin_host_regions_return(penguin_alloc_desc& desc, int device) {
+    desc.gpu_epoch = launch_epoch;
+    if(!desc.host_regions || desc.host_hi <= desc.host_lo) {
+        return;
+    }
+    unsigned long long stop = desc.decision == PENGUIN_DEC_GPU_PIN ? desc.size :
+        desc.decision == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN ? std::min(desc.gpu_res_stop, desc.size) : 0;
+    if(desc.host_lo < stop) {
+        unsigned long long bytes = std::min(desc.host_hi, stop) - desc.host_lo;
+        penguin_mem_prefetch((char*) desc.base + desc.host_lo, bytes, device, launch_stream);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) desc.base + desc.host_lo, bytes);
+    }
+    desc.host_lo = desc.host_hi = 0;
+}
+
+// A kernel about to be launched on device loads from or stores to allocation
+void penguin_note_access(void* allocation, bool store, int device) {
+    auto &desc = allocation_desc(allocation);
+    penguin_host_regions_return(desc, device);
+    // the graph was wrong about it: live from here on
+    if(desc.dead) {
+        desc.dead = false;
+        penguinSetDiscardable(allocation, desc.size, false);
+    }
+    bool new_device = !(desc.devices & (1u << device));
+    if(new_device) {
+        desc.devices |= 1u << device;
+        mmg_devices_changed |= penguin_num_devices() > 1;
+    }
+    if(desc.write_stream) {
+        if(!store) {
+            penguin_write_stream_drop(allocation);
+        } else if(new_device || desc.decision != PENGUIN_DEC_HOST_WRITE_STREAM) {
+            penguin_write_stream_place(allocation, device);
+        }
+    }
+    if(!store) {
+        desc.loaded = true;
+        return;
+    }
+    if(!desc.stored) {
+        desc.stored = true;
+        // every GPU write would invalidate the duplicates
+        penguin_set_read_dup(allocation, 0);
+    }
+}
+
+// Records of one launch site, batched by DynamicHostTransform into a single
+// penguinRecordLaunch call. The invariant part (access IDs and what is known
+// about them) is a constant global per site; the values computed before the
+// launch come in a stack array with one entry per record.
+#define PENGUIN_LAUNCH_PCHASE 1 // pointer chase on allocation
+#define PENGUIN_LAUNCH_INCOMP 2 // loop bounds not computable
+#define PENGUIN_LAUNCH_ACCESS 4 // ac accesses to allocation
+#define PENGUIN_LAUNCH_WSS    8 // working set wss, in this invocation
+#define PENGUIN_LAUNCH_STORE 16 // the access stores to allocation
+#define PENGUIN_LAUNCH_FOOTPRINT 32 // the access covers [lo, hi) of allocation
+#define PENGUIN_LAUNCH_DEAD 64 // allocation is dead once the launch is done
+#define PENGUIN_LAUNCH_NEXT 128 // allocation is an input of the next launch only
+#define PENGUIN_LAUNCH_ATOMIC 256 // the kernel's atomics update allocation
+#define PENGUIN_LAUNCH_BROADCAST 512 // the thread blocks along a grid axis all load [lo, hi)
+#define PENGUIN_LAUNCH_NO_ARG (~0U)
+
+typedef struct
+{
+    unsigned aid;
+    unsigned flags;
+    // the argument allocation is passed as, PENGUIN_LAUNCH_NO_ARG if none
+    unsigned arg;
+} penguin_launch_record;
+
+typedef struct
+{
+    unsigned invocation_id;
+    unsigned count;
+    const penguin_launch_record *records;
+    // the site's guard, see penguin_record_site_note; NULL for none
+    unsigned *armed;
+    // the kernel or library call the args are of, NULL for none
+    const char *kernel;
+} penguin_launch_desc;
+
+typedef struct
+{
+    void *allocation;
+    unsigned long long ac;
+    unsigned long long wss;
+    unsigned long long lo;
+    unsigned long long hi;
+    unsigned long long block_span; // bytes one thread block covers
+} penguin_launch_values;
+
+// Part of an allocation the first waves of the launch being planned touch,
+// prefetched ahead of it if the allocation is left to migrate on demand
+typedef struct
+{
+    void *allocation;
+    unsigned long long lo;
+    unsigned long long length;
+    unsigned long long hi;       // end of what the launch covers
+    unsigned long long per_wave; // bytes each wave of blocks moves on by
+} penguin_wave_prefetch;
+std::vector<penguin_wave_prefetch> launch_wave_prefetches;
+
+// Allocations the host transform's data-flow graph finds an input of the
+// launch that follows the one being planned, which that one doesn't access;
+// prefetched into what the plan leaves free while the producer runs
+std::vector<void*> launch_next_inputs;
+
+// Allocations no later kernel reads, waiting for the last launch that
+// accesses them to be done
+typedef struct
+{
+    void *allocation;
+    cudaStream_t stream;
+} penguin_dead_pending;
+std::vector<penguin_dead_pending> dead_pending;
+
+// Marks discardable the allocations whose last launch is done, so that
+// evicting them copies nothing back. Only the launches before the one being
+// recorded have been issued.
+void penguin_discard_dead() {
+    for(auto d = dead_pending.begin(); d != dead_pending.end();) {
+        if(cudaStreamQuery(d->stream) == cudaErrorNotReady) {
+            d++;
+            continue;
+        }
+        auto id = lookup_allocation_id(d->allocation);
+        if(id != PENGUIN_INVALID_ALLOC_ID && allocation_table[id].size > 0 &&
+                !allocation_table[id].dead) {
+            /* std::cout << "dead " << d->allocation << std::endl; */
+            allocation_table[id].dead = true;
+            penguinSetDiscardable(d->allocation, allocation_table[id].size, true);
+        }
+        d = dead_pending.erase(d);
+    }
+}
+
+// Hotness of the allocations the analysis can't follow. From the first
+// launch that accesses one through a pointer chase or an incomputable index,
+// the driver reports the access counter notifications on it without
+// migrating anything, and they are counted per PENGUIN_PLACEMENT_UNIT block.
+// Once sampling ends the counters migrate it as before, and the planner pins
+// its hottest blocks in place of the unknown density (penguin_ac_sample_pin).
+struct penguin_ac_sampling {
+    std::vector<unsigned long long> heat; // notified accesses per block
+    unsigned long long notifications;
+    unsigned launches;                    // plans made while sampling
+    bool done;
+    unsigned long long pinned;            // bytes of hot blocks pinned
+};
+
+// allocation ID -> histogram
+std::map<unsigned, penguin_ac_sampling> ac_samples;
+
+void penguin_ac_sample_start(void* ptr) {
+    auto id = lookup_allocation_id(ptr);
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].size == 0) {
+        id = lookup_allocation_id(identify_memory_allocation(ptr));
+    }
+    if(id == PENGUIN_INVALID_ALLOC_ID || ac_samples.find(id) != ac_samples.end()) {
+        return;
+    }
+    const penguin_alloc_desc& desc = allocation_table[id];
+    penguin_ac_sampling& sampling = ac_samples[id];
+    sampling.heat.assign((desc.size + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT, 0);
+    sampling.notifications = 0;
+    sampling.launches = 0;
+    sampling.done = false;
+    sampling.pinned = 0;
+    /* std::cout << "sample " << desc.base << "\n"; */
+    penguinSetAccessCounterPolicy(desc.base, desc.size, PENGUIN_AC_SAMPLE, PENGUIN_PLACEMENT_UNIT);
+    penguinEnableAccessCounters();
+}
+
+// Counts a sampled notification of value accesses at address of allocation id
+void penguin_ac_sample(unsigned id, void* address, unsigned long long value) {
+    auto sampling = ac_samples.find(id);
+    if(sampling == ac_samples.end() || sampling->second.done) {
+        return;
+    }
+    auto offset = (unsigned long long) address - (unsigned long long) allocation_table[id].base;
+    size_t b = offset / PENGUIN_PLACEMENT_UNIT;
+    if(b < sampling->second.heat.size()) {
+        sampling->second.heat[b] += std::max(value, 1ULL);
+        sampling->second.notifications++;
+    }
+}
+
+// Whether allocations are still being sampled
+bool penguin_ac_sampling_active() {
+    for(auto s = ac_samples.begin(); s != ac_samples.end(); s++) {
+        if(!s->second.done) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ends the sampling that has enough notifications, or has run for long
+// enough, at a plan; the counters of the allocation migrate it again
+void penguin_ac_sample_advance() {
+    for(auto s = ac_samples.begin(); s != ac_samples.end(); s++) {
+        penguin_ac_sampling& sampling = s->second;
+        if(sampling.done || (++sampling.launches <= PENGUIN_AC_SAMPLE_LAUNCHES &&
+                    sampling.notifications < PENGUIN_AC_SAMPLE_MIN_NOTIFICATIONS)) {
+            continue;
+        }
+        sampling.done = true;
+        mmg_input_generation++;
+        const penguin_alloc_desc& desc = allocation_table[s->first];
+        /* std::cout << "sampled " << desc.base << " " << sampling.notifications << "\n"; */
+        penguinSetAccessCounterPolicy(desc.base, desc.size, 0, 0);
+    }
+}
+
+// Pins the hottest sampled blocks of allocation, up to budget bytes, once
+// its sampling is done; the blocks nothing was sampled on are left to the
+// access counters. Returns the bytes pinned, 0 if there is no histogram.
+unsigned long long penguin_ac_sample_pin(void* allocation, unsigned long long budget) {
+    auto id = lookup_allocation_id(allocation);
+    auto s = ac_samples.find(id);
+    if(s == ac_samples.end() || !s->second.done || s->second.notifications == 0) {
+        return 0;
+    }
+    penguin_ac_sampling& sampling = s->second;
+    if(sampling.pinned != 0) {
+        return sampling.pinned;
+    }
+    const penguin_alloc_desc& desc = allocation_table[id];
+    std::vector<size_t> order;
+    for(size_t b = 0; b < sampling.heat.size(); b++) {
+        if(sampling.heat[b] != 0) {
+            order.push_back(b);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sampling.heat[a] > sampling.heat[b];
+    });
+    for(auto b = order.begin(); b != order.end(); b++) {
+        char* block = (char*) desc.base + *b * PENGUIN_PLACEMENT_UNIT;
+        size_t length = std::min(PENGUIN_PLACEMENT_UNIT, desc.size - *b * PENGUIN_PLACEMENT_UNIT);
+        if(sampling.pinned + length > budget) {
+            break;
+        }
+        /* std::cout << "hot sampled block " << *b << " of " << desc.base << "\n"; */
+        penguinSetPrioritizedLocation(block, length, desc.device);
+        penguin_prefetch_pinned(block, length, desc.device);
+        sampling.pinned += length;
+    }
+    return sampling.pinned;
+}
+
+// Bytes of allocation the accesses of a launch with a footprint cover: the
+// union of their ranges, within the allocation
+unsigned long long penguin_footprint_union(std::vector<std::pair<unsigned long long, unsigned long long>>& ranges,
+        unsigned long long size) {
+    std::sort(ranges.begin(), ranges.end());
+    unsigned long long covered = 0, end = 0;
+    for(auto r = ranges.begin(); r != ranges.end(); r++) {
+        unsigned long long lo = std::max(r->first, end), hi = std::min(r->second, size);
+        if(hi > lo) {
+            covered += hi - lo;
+            end = hi;
+        }
+    }
+    return covered;
+}
+
+// The split allocation in place of the array of structs in the records of a
+// launch, the bytes scaled to the fields it holds
+const penguin_launch_values* penguin_field_split_values(const penguin_launch_desc* desc,
+                                                        const penguin_launch_values* values,
+                                                        std::vector<penguin_launch_values>& local) {
+    if(field_splits.empty()) {
+        return values;
+    }
+    local.assign(values, values + desc->count);
+    for(auto v = local.begin(); v != local.end(); v++) {
+        auto s = field_splits.find((unsigned long long) v->allocation);
+        if(s == field_splits.end() || s->second.split == NULL) {
+            continue;
+        }
+        const penguin_field_split& split = s->second;
+        unsigned long long bytes = penguin_field_split_bytes(split);
+        v->allocation = split.split;
+        v->wss = v->wss * bytes / split.struct_bytes;
+        v->lo = v->lo / split.struct_bytes * bytes;
+        v->hi = (v->hi + split.struct_bytes - 1) / split.struct_bytes * bytes;
+        v->block_span = v->block_span * bytes / split.struct_bytes;
+    }
+    return local.data();
+}
+
+// Phases. The planner places allocations from the totals of every launch so
+// far, which suits a program that runs one loop, but one that sets up, then
+// solves, then post-processes gets one plan for all three. With
+// PENGUIN_PHASE_WINDOW=n, each launch has a signature: its invocation and the
+// allocations it passes. A phase ends once n launches in a row match no
+// signature of the current phase. The new phase is identified by the
+// signatures of those n launches. Before the next launch the pins of the
+// allocations the new phase doesn't pass are released. The plan made when
+// the same phase ran before is applied again, or else the planner places
+// the allocations of the new phase only, from the totals. Unset or 0 keeps
+// one plan for the whole program.
+long long phase_window = -1;
+
+typedef struct
+{
+    unsigned long long signature;
+    std::vector<void*> allocations;
+} penguin_phase_launch;
+
+typedef struct
+{
+    void* allocation;
+    unsigned long long size;
+    Decision decision;
+    unsigned long long resident;
+    int device;
+    unsigned long long prefetch_size;
+    unsigned long long prefetch_iters_per_batch;
+    unsigned long long prefetch_window;
+} penguin_phase_placement;
+
+typedef struct
+{
+    unsigned long long budget;
+    std::vector<penguin_phase_placement> placements;
+} penguin_phase_plan;
+
+// launch signatures and allocations of the current phase, and the launches
+// since the last one of it
+std::set<unsigned long long> phase_launches;
+std::set<void*> phase_allocations;
+std::deque<penguin_phase_launch> phase_recent;
+// launches of the current phase so far, and its signature, 0 until it has
+// had n
+unsigned long long phase_launch_count = 0;
+unsigned long long phase_signature = 0;
+// once the first phase ended, the planner only places phase_allocations
+bool phase_detected = false;
+// set at a phase change for the next perform_memory_management_global, with
+// the allocations of the phase before that the new one doesn't pass
+bool mmg_phase_changed = false;
+std::vector<void*> phase_released;
+// phase signature -> the plan last made while it ran
+std::map<unsigned long long, penguin_phase_plan> phase_plans;
+
+bool penguin_phases_enabled() {
+    if(phase_window < 0) {
+        const char* env = getenv("PENGUIN_PHASE_WINDOW");
+        phase_window = env == NULL ? 0 : strtoull(env, NULL, 10);
+    }
+    return phase_window > 0;
+}
+
+bool penguin_in_phase(void* allocation) {
+    return !phase_detected || phase_allocations.find(allocation) != phase_allocations.end();
+}
+
+// FNV-1a, 64 bits
+unsigned long long penguin_fnv(unsigned long long hash, unsigned long long value) {
+    for(unsigned b = 0; b < 8; b++) {
+        hash = (hash ^ ((value >> (b * 8)) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The allocations the identified phase passes, and the plan made for it
+void penguin_phase_save() {
+    if(phase_signature == 0) {
+        return;
+    }
+    penguin_phase_plan& plan = phase_plans[phase_signature];
+    plan.budget = mmg_planned_budget;
+    plan.placements.clear();
+    for(auto a = phase_allocations.begin(); a != phase_allocations.end(); a++) {
+        auto id = lookup_allocation_id(*a);
+        if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].base != *a ||
+                allocation_table[id].size == 0) {
+            continue;
+        }
+        penguin_alloc_desc& desc = allocation_table[id];
+        plan.placements.push_back(penguin_phase_placement{*a, desc.size, desc.decision,
+                desc.gpu_res_stop, desc.device, desc.prefetch ? desc.prefetch_size : 0,
+                desc.prefetch_iters_per_batch, desc.prefetch ? desc.prefetch_window : 0});
+    }
+}
+
+void penguin_phase_identify() {
+    unsigned long long signature = 14695981039346656037ULL;
+    for(auto s = phase_launches.begin(); s != phase_launches.end(); s++) {
+        signature = penguin_fnv(signature, *s);
+    }
+    phase_signature = signature != 0 ? signature : 1;
+    phase_energy_signature = phase_signature;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "phase %llx, %zu launches", phase_signature,
+            phase_launches.size());
+}
+
+void penguin_phase_note(const penguin_launch_desc* desc, const penguin_launch_values* values) {
+    if(!penguin_phases_enabled()) {
+        return;
+    }
+    penguin_phase_launch launch;
+    for(unsigned i = 0; i < desc->count; i++) {
+        if(!(desc->records[i].flags & PENGUIN_LAUNCH_NEXT) && values[i].allocation != NULL) {
+            launch.allocations.push_back(values[i].allocation);
+        }
+    }
+    std::sort(launch.allocations.begin(), launch.allocations.end());
+    launch.allocations.erase(std::unique(launch.allocations.begin(), launch.allocations.end()),
+            launch.allocations.end());
+    launch.signature = penguin_fnv(14695981039346656037ULL, desc->invocation_id);
+    for(auto a = launch.allocations.begin(); a != launch.allocations.end(); a++) {
+        launch.signature = penguin_fnv(launch.signature, (unsigned long long) *a);
+    }
+    phase_recent.push_back(launch);
+    bool current = phase_launches.empty() ||
+        phase_launches.find(launch.signature) != phase_launches.end();
+    if(!current && phase_recent.size() < (unsigned long long) phase_window) {
+        return;
+    }
+    std::set<void*> previous;
+    if(!current) {
+        // a new phase, of the launches since the last one of the current
+        penguin_phase_save();
+        previous.swap(phase_allocations);
+        phase_launches.clear();
+        phase_launch_count = 0;
+        phase_signature = 0;
+        phase_detected = true;
+        mmg_phase_changed = true;
+        overrides_check = true;
+        penguin_phase_energy_next(0);
+    }
+    // the odd launch within a phase becomes part of it
+    for(auto r = phase_recent.begin(); r != phase_recent.end(); r++) {
+        phase_launches.insert(r->signature);
+        phase_allocations.insert(r->allocations.begin(), r->allocations.end());
+    }
+    phase_launch_count += phase_recent.size();
+    phase_recent.clear();
+    for(auto a = previous.begin(); a != previous.end(); a++) {
+        if(phase_allocations.find(*a) == phase_allocations.end()) {
+            phase_released.push_back(*a);
+        }
+    }
+    // a phase is known by the launches of its first n
+    if(phase_signature == 0 && phase_launch_count >= (unsigned long long) phase_window) {
+        penguin_phase_identify();
+    }
+}
+
+// Broadcast slices: a load whose footprint the thread blocks along a grid
+// axis share, and that a scalar argument moves from launch to launch, the
+// pivot row k of a blocked Floyd-Warshall say. Such a slice is small next to
+// its allocation but the whole grid reads it, which no decision of the
+// allocation as a whole serves well: it is pinned on the GPU as a sub-range
+// of its own, and given back to the allocation's decision once a launch
+// loads another slice of it. A strided slice, the pivot column, spans about
+// the whole allocation and is left to the planner.
+#ifndef PENGUIN_BROADCAST_MAX_PCT
+// bytes of the slices pinned at once, in percent of the GPU memory
+#define PENGUIN_BROADCAST_MAX_PCT 2
+#endif
+#ifndef PENGUIN_BROADCAST_MAX_SHARE
+// a slice is at most 1/PENGUIN_BROADCAST_MAX_SHARE of its allocation
+#define PENGUIN_BROADCAST_MAX_SHARE 8
+#endif
+
+int broadcast_enabled = -1;
+
+bool penguin_broadcast_enabled() {
+    if(broadcast_enabled < 0) {
+        const char* env = getenv("PENGUIN_BROADCAST");
+        broadcast_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return broadcast_enabled;
+}
+
+// allocation ID -> offset and length of its pinned slice
+std::map<unsigned, std::pair<unsigned long long, unsigned long long>> broadcast_slices;
+unsigned long long broadcast_pinned = 0;
+
+// Gives the slice of allocation id back to the allocation's decision
+void penguin_broadcast_release(unsigned id) {
+    auto b = broadcast_slices.find(id);
+    if(b == broadcast_slices.end()) {
+        return;
+    }
+    unsigned long long offset = b->second.first, length = b->second.second;
+    broadcast_pinned -= std::min(broadcast_pinned, length);
+    broadcast_slices.erase(b);
+    auto s = sub_ranges.find(id);
+    if(s != sub_ranges.end()) {
+        s->second.erase(std::remove_if(s->second.begin(), s->second.end(),
+                    [&](const penguin_sub_range& r) { return r.offset == offset; }), s->second.end());
+        if(s->second.empty()) {
+            sub_ranges.erase(s);
+            sub_range_allocations--;
+        }
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    // the GPU part of a pinned allocation keeps it
+    if(desc.state == PENGUIN_STATE_GPU_PINNED && offset + length <= desc.gpu_res_stop) {
+        return;
+    }
+    char* base = (char*) desc.base + offset;
+    penguinUnsetPrioritizedLocation(base, length);
+    if(desc.state == PENGUIN_STATE_HOST) {
+        penguin_map_remote(base, length, desc);
+    }
+}
+
+// Pins [lo, hi) of allocation, in whole placement units, in place of the
+// slice pinned for it before
+void penguin_broadcast_pin(void* allocation, unsigned long long lo, unsigned long long hi) {
+    auto id = lookup_allocation_id(allocation);
+    if(id == PENGUIN_INVALID_ALLOC_ID) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    unsigned long long offset = lo / PENGUIN_PLACEMENT_UNIT * PENGUIN_PLACEMENT_UNIT;
+    unsigned long long end = std::min(desc.size,
+            (hi + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT * PENGUIN_PLACEMENT_UNIT);
+    auto b = broadcast_slices.find(id);
+    if(b != broadcast_slices.end() && b->second == std::make_pair(offset, end - offset)) {
+        return;
+    }
+    // the sub-ranges of the analysis have the allocation
+    if(b == broadcast_slices.end() && sub_ranges.find(id) != sub_ranges.end()) {
+        return;
+    }
+    penguin_broadcast_release(id);
+    if(offset >= end || (end - offset) * PENGUIN_BROADCAST_MAX_SHARE > desc.size ||
+            (desc.state == PENGUIN_STATE_GPU_PINNED && end <= desc.gpu_res_stop) ||
+            broadcast_pinned + (end - offset) > gpu_memory * PENGUIN_BROADCAST_MAX_PCT / 100) {
+        return;
+    }
+    unsigned long long length = end - offset;
+    sub_ranges.emplace(id, std::vector<penguin_sub_range>{
+            penguin_sub_range{offset, length, PENGUIN_DEC_GPU_PIN, 0, 0, 0}});
+    sub_range_allocations++;
+    broadcast_slices[id] = std::make_pair(offset, length);
+    broadcast_pinned += length;
+    char* base = (char*) desc.base + offset;
+    penguinSetPrioritizedLocationLevel(base, length, desc.device, 0);
+    penguin_prefetch_pinned(base, length, desc.device);
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "broadcast %p+%llu %llu", desc.base, offset, length);
+}
+
+// Launch sites whose records no longer change. DynamicHostTransform puts
+// the code that computes the records of a site, and its penguinRecordLaunch
+// call, behind the site's flag, desc->armed. Once PENGUIN_RECORD_STABLE
+// launches in a row recorded the same values and changed none of the
+// planner's inputs, the runtime clears it, and the site's launches cost one
+// branch; what the records add up on every launch, the access counts, is
+// added from the last values at perform_memory_management. The flag is set
+// again when any input of the planner changes or the phase does, and after
+// PENGUIN_RECORD_REVALIDATE launches of the site, to check its values still
+// hold. Sites whose records act on each launch (dead allocations, inputs of
+// the next one, broadcast slices, waves) keep recording, as does every site
+// while phases are detected, access sampling or the simulator's trace is
+// on, a decision log is recorded or replayed, or PENGUIN_RECORD_GUARD=0.
+#define PENGUIN_RECORD_STABLE 4
+#define PENGUIN_RECORD_REVALIDATE 64
+
+struct penguin_record_site {
+    std::vector<penguin_launch_values> values;
+    const penguin_launch_record* records;
+    unsigned* armed;
+    int device;
+    unsigned stable;
+    unsigned skipped;
+    bool recorded; // the launch being planned recorded its values
+};
+std::map<const penguin_launch_desc*, penguin_record_site> record_sites;
+// invocation ID -> its site while the site doesn't record
+std::map<unsigned, penguin_record_site*> record_disarmed;
+// mmg_input_generation when the last site stopped recording
+unsigned long long record_generation = 0;
+int record_guard_enabled = -1;
+
+bool penguin_record_guard_enabled() {
+    if(record_guard_enabled < 0) {
+        const char* env = getenv("PENGUIN_RECORD_GUARD");
+        record_guard_enabled = env == NULL || strcmp(env, "0") != 0;
+        penguin_decision_log_init();
+        if(PENGUIN_ACCESS_SAMPLING || decision_log_mode != PENGUIN_LOG_OFF) {
+            record_guard_enabled = 0;
+        }
+    }
+    return record_guard_enabled;
+}
+
+void penguin_record_site_rearm(penguin_record_site& site, unsigned stable) {
+    *site.armed = 1;
+    site.stable = stable;
+}
+
+// After penguinRecordLaunch, with the launch's values as the host computed
+// them and mmg_input_generation before the call
+void penguin_record_site_note(const penguin_launch_desc* desc, const penguin_launch_values* values,
+        unsigned long long generation, int device) {
+    if(desc->armed == NULL || !penguin_record_guard_enabled()) {
+        return;
+    }
+    bool eligible = launch_wave_prefetches.empty() && dead_pending.empty() && field_splits.empty() &&
+        !penguin_phases_enabled() && !penguin_sim_tracing();
+    for(unsigned i = 0; i < desc->count; i++) {
+        const penguin_launch_record& r = desc->records[i];
+        auto &a = allocation_desc(values[i].allocation);
+        if((r.flags & (PENGUIN_LAUNCH_DEAD | PENGUIN_LAUNCH_NEXT | PENGUIN_LAUNCH_BROADCAST |
+                       PENGUIN_LAUNCH_PCHASE | PENGUIN_LAUNCH_INCOMP)) ||
+                a.write_stream || (a.hint & PENGUIN_HINT_SCRATCH)) {
+            eligible = false;
+        }
+    }
+    penguin_record_site& site = record_sites[desc];
+    bool same = site.values.size() == desc->count &&
+        memcmp(site.values.data(), values, desc->count * sizeof(penguin_launch_values)) == 0;
+    site.stable = same && mmg_input_generation == generation ? site.stable + 1 : 0;
+    site.values.assign(values, values + desc->count);
+    site.records = desc->records;
+    site.armed = desc->armed;
+    site.device = device;
+    if(eligible && site.stable >= PENGUIN_RECORD_STABLE) {
+        // the others stopped on inputs since changed
+        if(mmg_input_generation != record_generation) {
+            for(auto r = record_disarmed.begin(); r != record_disarmed.end(); r++) {
+                penguin_record_site_rearm(*r->second, 0);
+            }
+            record_disarmed.clear();
+        }
+        *desc->armed = 0;
+        site.skipped = 0;
+        site.recorded = true;
+        record_disarmed[desc->invocation_id] = &site;
+        record_generation = mmg_input_generation;
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "records of %u stable", desc->invocation_id);
+    }
+}
+
+// At perform_memory_management of invocation invid: the access counts of a
+// site that doesn't record, and the sites that record again
+void penguin_record_sites_launched(unsigned invid) {
+    if(record_disarmed.empty()) {
+        return;
+    }
+    auto d = record_disarmed.find(invid);
+    if(d != record_disarmed.end() && d->second->recorded) {
+        d->second->recorded = false;
+    } else if(d != record_disarmed.end()) {
+        penguin_record_site& site = *d->second;
+        // what the site's last launch left for the next one
+        launch_wave_prefetches.clear();
+        launch_next_inputs.clear();
+        for(unsigned i = 0; i < site.values.size(); i++) {
+            const penguin_launch_record& r = site.records[i];
+            const penguin_launch_values& v = site.values[i];
+            if(r.flags & PENGUIN_LAUNCH_ACCESS) {
+                auto ac = (r.flags & PENGUIN_LAUNCH_ATOMIC) ? v.ac * PENGUIN_ATOMIC_WEIGHT : v.ac;
+                allocation_desc(v.allocation).device_ac[site.device] += ac;
+                allocation_desc(v.allocation).ac += ac;
+                penguin_arena_credit(v.allocation, ac);
+            }
+        }
+        // one launch with the same values drops the flag again
+        if(++site.skipped >= PENGUIN_RECORD_REVALIDATE) {
+            penguin_record_site_rearm(site, PENGUIN_RECORD_STABLE - 1);
+            record_disarmed.erase(d);
+        }
+    }
+    if(!record_disarmed.empty() && (mmg_input_generation != record_generation || mmg_phase_changed ||
+            penguin_launch_device() != record_disarmed.begin()->second->device)) {
+        for(auto r = record_disarmed.begin(); r != record_disarmed.end(); r++) {
+            penguin_record_site_rearm(*r->second, 0);
+        }
+        record_disarmed.clear();
+    }
+}
+
+extern "C"
+void penguinRecordLaunch(const penguin_launch_desc* desc, const penguin_launch_values* values) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_planning()) {
+        return;
+    }
+    const penguin_launch_values* recorded = values;
+    unsigned long long generation = mmg_input_generation;
+    std::vector<penguin_launch_values> split_values;
+    values = penguin_field_split_values(desc, values, split_values);
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %u", __func__, desc->invocation_id);
+    int device = penguin_launch_device();
+    // the working set of an allocation whose accesses all have a footprint
+    // is what they cover together, in place of the per access estimate
+    std::map<void*, std::vector<std::pair<unsigned long long, unsigned long long>>> footprints;
+    std::map<void*, unsigned long long> block_spans;
+    std::set<void*> estimated;
+    launch_wave_prefetches.clear();
+    launch_next_inputs.clear();
+    penguin_discard_dead();
+    penguin_phase_note(desc, values);
+    // the allocations of the kernel rules, by the arguments they are passed as
+    penguin_overrides_reload();
+    if(override_kernel_rules != 0 && desc->kernel != NULL) {
+        for(unsigned i = 0; i < desc->count; i++) {
+            if(desc->records[i].arg != PENGUIN_LAUNCH_NO_ARG) {
+                penguin_override_bind_kernel(recorded[i].allocation, desc->kernel, desc->records[i].arg);
+            }
+        }
+    }
+    for(unsigned i = 0; i < desc->count; i++) {
+        const penguin_launch_record& r = desc->records[i];
+        const penguin_launch_values& v = values[i];
+        if(!(r.flags & PENGUIN_LAUNCH_WSS)) {
+            continue;
+        }
+        if(r.flags & PENGUIN_LAUNCH_FOOTPRINT) {
+            footprints[v.allocation].push_back(std::make_pair(v.lo, v.hi));
+            block_spans[v.allocation] = std::max(block_spans[v.allocation], v.block_span);
+        } else {
+            estimated.insert(v.allocation);
+        }
+    }
+    // the slices every thread block loads, of a grid of more than one
+    if(penguin_broadcast_enabled() && launch_shape.blocks != 1) {
+        std::map<void*, std::pair<unsigned long long, unsigned long long>> broadcasts;
+        for(unsigned i = 0; i < desc->count; i++) {
+            const penguin_launch_record& r = desc->records[i];
+            const penguin_launch_values& v = values[i];
+            if(!(r.flags & PENGUIN_LAUNCH_BROADCAST) || !(r.flags & PENGUIN_LAUNCH_FOOTPRINT) ||
+                    allocation_desc(v.allocation).write_stream) {
+                continue;
+            }
+            auto b = broadcasts.emplace(v.allocation, std::make_pair(v.lo, v.hi)).first;
+            b->second.first = std::min(b->second.first, v.lo);
+            b->second.second = std::max(b->second.second, v.hi);
+        }
+        for(auto b = broadcasts.begin(); b != broadcasts.end(); b++) {
+            penguin_broadcast_pin(b->first, b->second.first, b->second.second);
+        }
+    }
+    std::map<void*, unsigned long long> footprint_wss;
+    for(auto f = footprints.begin(); f != footprints.end(); f++) {
+        auto id = lookup_allocation_id(f->first);
+        if(id != PENGUIN_INVALID_ALLOC_ID && estimated.find(f->first) == estimated.end()) {
+            unsigned long long wss = penguin_footprint_union(f->second, allocation_table[id].size);
+            // a launch of several waves only holds the blocks of its
+            // running wave, and the ones after it, at once
+            unsigned long long waves = penguin_launch_waves();
+            unsigned long long span = block_spans[f->first];
+            if(waves > 1 && span > 0) {
+                unsigned long long live = span * launch_shape.resident_blocks *
+                    std::min(waves, 1ULL + PENGUIN_WAVE_LOOKAHEAD);
+                if(live < wss) {
+                    wss = live;
+                    unsigned long long lo = f->second.front().first, hi = lo;
+                    for(auto r = f->second.begin(); r != f->second.end(); r++) {
+                        hi = std::max(hi, std::min(r->second, allocation_table[id].size));
+                    }
+                    launch_wave_prefetches.push_back(penguin_wave_prefetch{f->first, lo, live, hi,
+                        (std::max(hi, lo) - lo + waves - 1) / waves});
+                }
+            }
+            footprint_wss[f->first] = wss;
+        }
+    }
+    for(unsigned i = 0; i < desc->count; i++) {
+        const penguin_launch_record& r = desc->records[i];
+        const penguin_launch_values& v = values[i];
+        if(r.flags & PENGUIN_LAUNCH_NEXT) {
+            launch_next_inputs.push_back(v.allocation);
+            continue;
+        }
+        penguin_note_access(v.allocation, r.flags & PENGUIN_LAUNCH_STORE, device);
+        if((r.flags & PENGUIN_LAUNCH_ATOMIC) && !allocation_desc(v.allocation).atomic) {
+            allocation_desc(v.allocation).atomic = true;
+            mmg_input_generation++;
+        }
+        if(r.flags & PENGUIN_LAUNCH_FOOTPRINT) {
+            penguin_sim_access(lookup_allocation_id(v.allocation), v.lo, v.hi, r.flags & PENGUIN_LAUNCH_STORE);
+        } else {
+            penguin_sim_access(lookup_allocation_id(v.allocation), 0, ~0ULL, r.flags & PENGUIN_LAUNCH_STORE);
+        }
+        // a dead arena object does not make its slab dead
+        if(((r.flags & PENGUIN_LAUNCH_DEAD) || (allocation_desc(v.allocation).hint & PENGUIN_HINT_SCRATCH)) &&
+                penguin_arena_find(v.allocation) == arena_objects.end()) {
+            dead_pending.push_back(penguin_dead_pending{v.allocation, launch_kernel_stream});
+        }
+        // placed on the host in penguin_note_access, out of the planners' way
+        if(allocation_desc(v.allocation).write_stream) {
+            continue;
+        }
+        if((r.flags & (PENGUIN_LAUNCH_PCHASE | PENGUIN_LAUNCH_INCOMP)) &&
+                penguin_hint_record(v.allocation, r.aid, desc->invocation_id, device)) {
+            continue;
+        }
+        if(r.flags & PENGUIN_LAUNCH_PCHASE) {
+            add_aid_pchase_map(r.aid, v.allocation, true);
+            penguin_ac_sample_start(v.allocation);
+            continue;
+        }
+        if(r.flags & PENGUIN_LAUNCH_INCOMP) {
+            add_aid_ac_incomp_map(r.aid, true);
+            penguin_ac_sample_start(v.allocation);
+            continue;
+        }
+        if(r.flags & PENGUIN_LAUNCH_ACCESS) {
+            auto ac = (r.flags & PENGUIN_LAUNCH_ATOMIC) ? v.ac * PENGUIN_ATOMIC_WEIGHT : v.ac;
+            allocation_desc(v.allocation).device_ac[device] += ac;
+            addACToAllocation(v.allocation, ac);
+            add_aid_allocation_map(r.aid, v.allocation);
+            add_aid_ac_map(r.aid, ac);
+        }
+        if(r.flags & PENGUIN_LAUNCH_WSS) {
+            auto f = footprint_wss.find(v.allocation);
+            add_wss_to_map(v.allocation, f != footprint_wss.end() ? f->second : v.wss, r.aid);
+            add_aid_invocation_map(r.aid, desc->invocation_id);
+        }
+    }
+    penguin_record_site_note(desc, recorded, generation, device);
+}
+
+extern "C"
+bool is_iterdep_access(unsigned aid) {
+    PENGUIN_LOCKED_ENTRY();
+    return (aid_wss_map_iterdep.find(aid) != aid_wss_map_iterdep.end());
+}
+
+extern "C"
+void print_aid_wss_map_iterdep() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "aid wss map (iterdep)\n"; */
+    for (auto a = aid_wss_map_iterdep.begin(); a != aid_wss_map_iterdep.end(); a++) {
+        /* std::cout << a->first << " " << a->second << "\n"; */
+    }
+}
+
+extern "C"
+void process_iterdep_access() {
+    PENGUIN_LOCKED_ENTRY();
+    for (auto a = aid_wss_map_iterdep.begin(); a != aid_wss_map_iterdep.end(); a++) {
+        /* std::cout << a->first << " " << a->second << "\n"; */
+    }
+}
+
+extern "C"
+void process_all_accesses() {
+    PENGUIN_LOCKED_ENTRY();
+}
+
+// Phase 1 of the global planner: moves the contribution of every dirty aid
+// onto its allocation and returns the allocations whose totals changed.
+std::set<void*> mmg_attribute_dirty_aids() {
+    std::set<void*> changed;
+    for(auto aid = mmg_dirty_aids.begin(); aid != mmg_dirty_aids.end(); aid++) {
+        auto old = mmg_aid_contribution_map.find(*aid);
+        if(old != mmg_aid_contribution_map.end()) {
+            auto c = old->second;
+            if(c.iteronly) {
+                mmg_alloc_ac_map_iteronly[c.allocation] -= c.ac;
+            } else {
+                mmg_alloc_ac_map_invid[c.invid][c.allocation] -= c.ac;
+            }
+            mmg_alloc_aids_map[c.allocation].erase(*aid);
+            changed.insert(c.allocation);
+            mmg_aid_contribution_map.erase(old);
+        }
+        if(aid_allocation_map.find(*aid) == aid_allocation_map.end()) {
+            continue;
+        }
+        // find the allocation
+        /* std::cout << "[inside] "; */
+        void * allocation = alias_interior_pointer(aid_allocation_map[*aid]);
+        /* std::cout << allocation << "\n"; */
+        if(allocation == 0 || allocation_desc(allocation).size == 0) {
+            continue;
+        }
+        auto dsize = allocation_desc(allocation).size;
+        mmg_aid_contribution c;
+        c.allocation = allocation;
+        c.invid = aid_invocation_id_map[*aid];
+        c.ac = aid_ac_map[*aid];
+        c.iteronly = false;
+        if(aid_wss_map_iterdep.find(*aid) != aid_wss_map_iterdep.end()) {
+            // check if only a fractiof of the data structure is being accesses in this access
+            auto span = aid_wss_map_iterdep[*aid];
+            float span_to_size = (float) span / (float) dsize;
+            if(span_to_size < penguin_tune().iteronly_ratio && span != 0) {
+                /* std::cout << "span is smallr than dsize significantly\n"; */
+                c.iteronly = true;
+            }
+        }
+        if(c.iteronly) {
+            mmg_alloc_ac_map_iteronly[allocation] += c.ac;
+        } else {
+            // not an iteration dependent access
+            mmg_alloc_ac_map_invid[c.invid][allocation] += c.ac;
+        }
+        mmg_aid_contribution_map[*aid] = c;
+        mmg_alloc_aids_map[allocation].insert(*aid);
+        changed.insert(allocation);
+    }
+    mmg_dirty_aids.clear();
+    // the span and working set of an allocation are maxima over its aids
+    for(auto alloc = changed.begin(); alloc != changed.end(); alloc++) {
+        unsigned long long span = 0;
+        unsigned long long wss = 0;
+        auto &aids = mmg_alloc_aids_map[*alloc];
+        for(auto aid = aids.begin(); aid != aids.end(); aid++) {
+            if(mmg_aid_contribution_map[*aid].iteronly && span < aid_wss_map_iterdep[*aid]) {
+                span = aid_wss_map_iterdep[*aid];
+            }
+            auto awss = aid_wss_map.find(*aid);
+            if(awss != aid_wss_map.end() && wss < awss->second) {
+                wss = awss->second;
+            }
+        }
+        mmg_alloc_span_map_iteronly[*alloc] = span;
+        if(wss) {
+            mmg_alloc_wss_map[*alloc] = wss;
+        } else {
+            mmg_alloc_wss_map.erase(*alloc);
+        }
+    }
+    return changed;
+}
+
+// Hot and cold blocks of a partially pinned allocation. The planner pins a
+// prefix, but which blocks are hot depends on the access pattern: the tail is
+// mapped remotely with access counters on, and the notifications the event
+// ring reports on it rank its PENGUIN_PLACEMENT_UNIT blocks. The hottest tail
+// blocks then take the place of the coldest pinned ones.
+struct penguin_partial_pin {
+    // notifications per block, halved at every rebalance
+    std::vector<unsigned> heat;
+    // whether the block is pinned; the one the prefix ends in stays as it is
+    std::vector<unsigned char> pinned;
+    bool dirty;
+};
+
+#define PENGUIN_BLOCK_TAIL 0
+#define PENGUIN_BLOCK_PINNED 1
+#define PENGUIN_BLOCK_FIXED 2
+
+// allocation ID -> blocks, for the partially pinned allocations
+std::map<unsigned, penguin_partial_pin> partial_pins;
+
+// Starts ranking the blocks of an allocation with resident bytes pinned
+void penguin_partial_pin_track(void* allocation, unsigned long long resident) {
+    auto id = lookup_allocation_id(allocation);
+    auto dsize = allocation_table[id].size;
+    size_t blocks = (dsize + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT;
+    penguin_partial_pin& pin = partial_pins[id];
+    pin.heat.assign(blocks, 0);
+    pin.pinned.assign(blocks, PENGUIN_BLOCK_TAIL);
+    pin.dirty = false;
+    for(size_t b = 0; b < blocks && b * PENGUIN_PLACEMENT_UNIT < resident; b++) {
+        pin.pinned[b] = (b + 1) * PENGUIN_PLACEMENT_UNIT <= resident ?
+            PENGUIN_BLOCK_PINNED : PENGUIN_BLOCK_FIXED;
+    }
+    penguinSetAccessCounterPolicy((char*) allocation + resident, dsize - resident,
+            PENGUIN_AC_NEAR_PIN_THRESHOLD, PENGUIN_PLACEMENT_UNIT);
+    penguinEnableAccessCounters();
+}
+
+// Counts an access counter notification at address of allocation id
+void penguin_partial_pin_heat(unsigned id, void* address) {
+    auto pin = partial_pins.find(id);
+    if(pin == partial_pins.end()) {
+        return;
+    }
+    auto offset = (unsigned long long) address - (unsigned long long) allocation_table[id].base;
+    size_t b = offset / PENGUIN_PLACEMENT_UNIT;
+    if(b < pin->second.heat.size()) {
+        pin->second.heat[b]++;
+        pin->second.dirty = true;
+    }
+}
+
+// Swaps the hottest tail blocks of the allocations notified since the
+// previous launch for their coldest pinned ones: the cold block is
+// unprioritized, mapped remotely and moved out first, so the hot one takes
+// its place. Notifications only come from the tail, so a pinned block keeps
+// the heat it was promoted with, and the pinned blocks of the prefix start
+// cold, the last ones first.
+void penguin_partial_pin_rebalance() {
+    for(auto p = partial_pins.begin(); p != partial_pins.end(); p++) {
+        penguin_partial_pin& pin = p->second;
+        if(!pin.dirty) {
+            continue;
+        }
+        pin.dirty = false;
+        const penguin_alloc_desc& desc = allocation_table[p->first];
+        char* base = (char*) desc.base;
+        auto dsize = desc.size;
+        for(unsigned swaps = 0; swaps < PENGUIN_HOT_BLOCK_MAX_SWAPS; swaps++) {
+            size_t hot = pin.heat.size(), cold = pin.heat.size();
+            for(size_t b = 0; b < pin.heat.size(); b++) {
+                if(pin.pinned[b] == PENGUIN_BLOCK_TAIL) {
+                    if(hot == pin.heat.size() || pin.heat[b] > pin.heat[hot]) {
+                        hot = b;
+                    }
+                } else if(pin.pinned[b] == PENGUIN_BLOCK_PINNED) {
+                    if(cold == pin.heat.size() || pin.heat[b] <= pin.heat[cold]) {
+                        cold = b;
+                    }
+                }
+            }
+            if(hot == pin.heat.size() || cold == pin.heat.size() ||
+                    pin.heat[hot] < PENGUIN_HOT_BLOCK_MIN_NOTIFICATIONS ||
+                    pin.heat[hot] <= 2 * pin.heat[cold]) {
+                break;
+            }
+            /* std::cout << "swap block " << cold << " for " << hot << " of " << (void*) base << "\n"; */
+            char* cold_base = base + cold * PENGUIN_PLACEMENT_UNIT;
+            char* hot_base = base + hot * PENGUIN_PLACEMENT_UNIT;
+            size_t hot_length = std::min(PENGUIN_PLACEMENT_UNIT, dsize - hot * PENGUIN_PLACEMENT_UNIT);
+            penguinUnsetPrioritizedLocation(cold_base, PENGUIN_PLACEMENT_UNIT);
+            penguin_map_remote(cold_base, PENGUIN_PLACEMENT_UNIT, desc);
+            penguinSetAccessCounterPolicy(cold_base, PENGUIN_PLACEMENT_UNIT,
+                    PENGUIN_AC_NEAR_PIN_THRESHOLD, PENGUIN_PLACEMENT_UNIT);
+            penguin_mem_prefetch(cold_base, PENGUIN_PLACEMENT_UNIT, cudaCpuDeviceId, launch_stream);
+            penguin_mem_advise(hot_base, hot_length, cudaMemAdviseUnsetAccessedBy, desc.device);
+            penguinSetAccessCounterPolicy(hot_base, hot_length, 0, 0);
+            penguinSetPrioritizedLocation(hot_base, hot_length, desc.device);
+            penguin_prefetch_pinned(hot_base, hot_length, desc.device);
+            pin.pinned[cold] = PENGUIN_BLOCK_TAIL;
+            pin.pinned[hot] = PENGUIN_BLOCK_PINNED;
+        }
+        for(size_t b = 0; b < pin.heat.size(); b++) {
+            pin.heat[b] /= 2;
+        }
+    }
+}
+
+// Places one sub-range of an allocation as its decision says, over whatever
+// the decision of the allocation did to it
+void penguin_apply_sub_range(penguin_alloc_desc& desc, const penguin_sub_range& range) {
+    char* base = (char*) desc.base + range.offset;
+    switch(range.decision) {
+        case PENGUIN_DEC_GPU_PIN:
+            penguinSetPrioritizedLocationLevel(base, range.length, desc.device,
+                    std::min(range.priority, (unsigned) PENGUIN_PRIORITY_LEVELS));
+            penguin_prefetch_pinned(base, range.length, desc.device);
+            break;
+        case PENGUIN_DEC_HOST_PIN:
+        case PENGUIN_DEC_ITERATION_MIGRATION:
+            // the batches of an iteration migration range are prefetched,
+            // see penguin_sub_range_batch, and the rest is read remotely
+            penguinUnsetPrioritizedLocation(base, range.length);
+            penguin_map_remote(base, range.length, desc);
+            break;
+        case PENGUIN_DEC_MIGRATE_ON_DEMAND:
+            penguinUnsetPrioritizedLocation(base, range.length);
+            penguin_mem_advise(base, range.length, cudaMemAdviseUnsetPreferredLocation, desc.device);
+            break;
+        default:
+            break;
+    }
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "%s %p+%llu %llu", penguin_decision_name[range.decision],
+            desc.base, range.offset, range.length);
+}
+
+void penguin_apply_sub_ranges(void* allocation) {
+    auto s = sub_ranges.find(lookup_allocation_id(allocation));
+    if(s == sub_ranges.end()) {
+        return;
+    }
+    for(auto range = s->second.begin(); range != s->second.end(); range++) {
+        penguin_apply_sub_range(allocation_desc(allocation), *range);
+    }
+}
+
+void penguin_sub_range_period_update() {
+    penguin_sub_range_period = 0;
+    for(auto s = sub_ranges.begin(); s != sub_ranges.end(); s++) {
+        for(auto range = s->second.begin(); range != s->second.end(); range++) {
+            if(range->decision == PENGUIN_DEC_ITERATION_MIGRATION && range->prefetch_size != 0) {
+                penguin_sub_range_period = std::gcd(penguin_sub_range_period,
+                        (unsigned) range->prefetch_iters_per_batch);
+            }
+        }
+    }
+    penguin_prefetch_period = std::gcd(penguin_prefetch_period, penguin_sub_range_period);
+}
+
+// Gives the bytes [offset, offset + length) of the allocation at base a
+// decision of their own, replacing the sub-range at the same offset, if any,
+// and places them right away. The planner's decisions of the allocation then
+// leave them be.
+extern "C"
+void penguinSetSubRange(void* base, unsigned long long offset, unsigned long long length,
+        unsigned decision, unsigned long long prefetch_size,
+        unsigned long long prefetch_iters_per_batch, unsigned priority) {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_alloc_desc& desc = allocation_desc(base);
+    if(desc.size == 0 || offset >= desc.size || decision >= PENGUIN_DEC_MAX) {
+        return;
+    }
+    auto id = lookup_allocation_id(base);
+    penguin_sub_range range = {offset, std::min(length, desc.size - offset), (Decision) decision,
+        priority, prefetch_size, prefetch_iters_per_batch};
+    auto s = sub_ranges.find(id);
+    if(s == sub_ranges.end()) {
+        s = sub_ranges.emplace(id, std::vector<penguin_sub_range>()).first;
+        sub_range_allocations++;
+    }
+    auto at = std::lower_bound(s->second.begin(), s->second.end(), offset,
+            [](const penguin_sub_range& r, unsigned long long o) { return r.offset < o; });
+    if(at != s->second.end() && at->offset == offset) {
+        *at = range;
+    } else {
+        s->second.insert(at, range);
+    }
+    penguin_sub_range_period_update();
+    penguin_apply_sub_range(desc, range);
+}
+
+void penguin_forget_sub_ranges(unsigned id) {
+    if(sub_ranges.erase(id)) {
+        sub_range_allocations--;
+        penguin_sub_range_period_update();
+    }
+}
+
+// Carries out a decision of the global planner, once per change. The GPU
+// part goes on device, by default the one the allocation is on already.
+void mmg_apply_decision(void* allocation, Decision decision, unsigned long long resident,
+        int device = -1) {
+    auto dsize = allocation_desc(allocation).size;
+    if(device < 0) {
+        device = allocation_desc(allocation).device;
+    }
+    // atomics over the link are the slowest access there is: fault such an
+    // allocation to the GPU instead of leaving it on the host
+    if(allocation_desc(allocation).atomic &&
+            (decision == PENGUIN_DEC_HOST_PIN || decision == PENGUIN_DEC_ACCESS_COUNTER)) {
+        decision = PENGUIN_DEC_MIGRATE_ON_DEMAND;
+        resident = 0;
+    }
+    // an override's goes over both; the planner still places the others as
+    // if its own had been carried out
+    const penguin_override* o = penguin_override_of(allocation_desc(allocation), PENGUIN_OVERRIDE_DECISION);
+    if(o != NULL) {
+        if(o->decision == PENGUIN_DEC_GPU_PIN) {
+            resident = dsize;
+        } else if(o->decision != PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) {
+            resident = 0;
+        } else if(resident == 0 || resident >= dsize) {
+            resident = dsize / 2;
+        }
+        if(o->decision == PENGUIN_DEC_ACCESS_COUNTER) {
+            penguinEnableAccessCounters();
+        }
+        decision = o->decision;
+    }
+    if(allocation_desc(allocation).decision == decision &&
+            allocation_desc(allocation).gpu_res_stop == resident &&
+            allocation_desc(allocation).device == device) {
+        return;
+    }
+    bool moved = allocation_desc(allocation).device != device;
+    allocation_desc(allocation).device = device;
+    penguin_set_decision(allocation_desc(allocation), decision);
+    partial_pins.erase(lookup_allocation_id(allocation));
+    if(decision != PENGUIN_DEC_HOST_PIN && allocation_desc(allocation).ac_threshold) {
+        allocation_desc(allocation).ac_threshold = 0;
+        penguinSetAccessCounterPolicy(allocation, dsize, 0, 0);
+    }
+    switch(decision) {
+        case PENGUIN_DEC_GPU_PIN:
+        case PENGUIN_DEC_GPU_HOST_PARTIAL_PIN:
+            allocation_desc(allocation).gpu_res_start = 0;
+            allocation_desc(allocation).gpu_res_stop = resident;
+            if(allocation_desc(allocation).state != PENGUIN_STATE_GPU_PINNED || moved) {
+                if(allocation_desc(allocation).state != PENGUIN_STATE_GPU_PINNED) {
+                    pinned_memory += resident;
+                }
+                allocation_desc(allocation).state = PENGUIN_STATE_GPU_PINNED;
+                const penguin_override* level =
+                    penguin_override_of(allocation_desc(allocation), PENGUIN_OVERRIDE_PRIORITY);
+                penguinSetPrioritizedLocationLevel((char*) allocation, resident, device,
+                        level != NULL ? level->priority : 0);
+                // the other devices map it rather than hold duplicates their
+                // budgets don't account for, unless a copy is cheaper
+                bool mapped = penguin_map_peers(allocation, resident, allocation_desc(allocation), device);
+                penguin_set_read_dup(allocation, mapped ? 0 : resident);
+                penguin_prefetch_pinned(allocation, resident, device);
+            }
+            if(resident < dsize) {
+                /* std::cout << "cpu pin rest\n"; */
+                penguin_map_remote((char*) allocation + resident, dsize - resident, allocation_desc(allocation));
+                penguin_partial_pin_track(allocation, resident);
+            }
+            break;
+        case PENGUIN_DEC_HOST_PIN:
+            allocation_desc(allocation).state = PENGUIN_STATE_HOST;
+            // duplicates would pull the range to the GPU after all
+            penguin_set_read_dup(allocation, 0);
+            if(PENGUIN_HOST_HUGE_PAGES && !allocation_desc(allocation).system) {
+                // before anything lands on the host, then populate the whole
+                // range there so the GPU maps it with 2MB PTEs from the start
+                penguinSetHostHugePages(allocation, dsize, true);
+                penguin_prefetch_host(allocation, dsize);
+            }
+            penguin_map_remote(allocation, dsize, allocation_desc(allocation));
+            if(const penguin_override* ac = penguin_override_of(allocation_desc(allocation),
+                        PENGUIN_OVERRIDE_AC_THRESHOLD)) {
+                allocation_desc(allocation).ac_threshold = ac->ac_threshold;
+            }
+            if(allocation_desc(allocation).ac_threshold) {
+                penguinSetAccessCounterPolicy(allocation, dsize, allocation_desc(allocation).ac_threshold,
+                        penguin_ac_granularity_for(allocation_desc(allocation)));
+                if(allocation_desc(allocation).ac_threshold != PENGUIN_AC_NEVER) {
+                    penguinEnableAccessCounters();
+                }
+            }
+            break;
+        case PENGUIN_DEC_ACCESS_COUNTER:
+            allocation_desc(allocation).state = PENGUIN_STATE_AC;
+            penguin_set_read_dup(allocation, 0);
+            // only pointer-chasing allocations get here; map them remotely
+            // and let the counters migrate what is hot
+            penguinSetAccessPattern((char*) allocation, dsize, PENGUIN_PATTERN_POINTER_CHASE, 0, 0, 0);
+            break;
+        case PENGUIN_DEC_MIGRATE_ON_DEMAND:
+            penguin_set_read_dup(allocation, dsize);
+            // faulted in block by block; let the driver run ahead along the
+            // loop stride CudaAnalysis found
+            if(allocation_desc(allocation).pd_phi) {
+                auto stride = allocation_desc(allocation).pd_phi;
+                auto span = mmg_alloc_span_map_iteronly.find(allocation);
+                penguinSetAccessPattern((char*) allocation, dsize,
+                        stride < PENGUIN_PLACEMENT_UNIT ? PENGUIN_PATTERN_SEQUENTIAL : PENGUIN_PATTERN_STRIDED,
+                        stride, span != mmg_alloc_span_map_iteronly.end() ? span->second : stride,
+                        allocation_desc(allocation).read_dup ? PENGUIN_ACCESS_READ_ONLY : 0);
+            } else if(penguin_markov_prefetch_enabled()) {
+                penguinSetAccessPattern((char*) allocation, dsize, PENGUIN_PATTERN_UNKNOWN, 0, 0,
+                        PENGUIN_ACCESS_PREDICT |
+                        (allocation_desc(allocation).read_dup ? PENGUIN_ACCESS_READ_ONLY : 0));
+            }
+            break;
+        default:
+            break;
+    }
+    penguin_apply_sub_ranges(allocation);
+}
+
+// Overrides for tuning a production run without rebuilding it. Each line of
+// PENGUIN_OVERRIDE_FILE is a key and the settings of its rule, # to the end
+// of the line a comment:
+//
+//   site=0x4a3c10 decision=gpu_pin priority=4
+//   kernel=_Z6stencilPfS_i:1 decision=host_pin ac_threshold=64 ac_granularity=2m
+//   kernel=cublasSgemm_v2:7 prefetch=64m
+//
+// site is one of the "site"s of the allocations in PENGUIN_METRICS, see
+// penguin_alloc_site; kernel the kernel's mangled name, or a library call's,
+// and the argument the allocation is passed as. Settings:
+//   decision        host_pin, gpu_pin (all of it), gpu_host_partial_pin (what
+//                   the planner would pin, or half), migrate_on_demand or
+//                   access_counter, counters or not
+//   priority        eviction level of the pin, 0 to PENGUIN_PRIORITY_LEVELS
+//   prefetch        bytes of an iteration prefetch batch, the planner's
+//                   iterations per batch scaled to it
+//   ac_threshold    and
+//   ac_granularity  of the access counters of a host pinned one, see
+//                   penguin_ac_granularity_for, 0 for the counted pages
+// Sizes take a k, m or g suffix. An allocation takes the first rule of its
+// site when it is registered, else the first of a kernel it is passed to
+// once that is launched; the settings apply from the next launch on. The
+// file is read again on SIGHUP, unless the program handles it, and at the
+// start of every phase (PENGUIN_PHASE_WINDOW) if it changed since. The
+// allocations are bound again and the launches record afresh, so a rule
+// taken out hands its allocations back to the planner.
+volatile sig_atomic_t overrides_sighup = 0;
+struct timespec overrides_mtime = {0, 0};
+
+void penguin_overrides_signal(int) {
+    overrides_sighup = 1;
+}
+
+void penguin_overrides_install() {
+    struct sigaction old;
+    if(sigaction(SIGHUP, NULL, &old) != 0 || (old.sa_flags & SA_SIGINFO) || old.sa_handler != SIG_DFL) {
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = penguin_overrides_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+}
+
+bool penguin_override_set(penguin_override& o, const char* name, const char* value) {
+    if(strcmp(name, "decision") == 0) {
+        static const Decision forced[] = {PENGUIN_DEC_HOST_PIN, PENGUIN_DEC_GPU_PIN,
+            PENGUIN_DEC_GPU_HOST_PARTIAL_PIN, PENGUIN_DEC_MIGRATE_ON_DEMAND, PENGUIN_DEC_ACCESS_COUNTER};
+        for(Decision d : forced) {
+            if(strcmp(value, penguin_decision_name[d]) == 0) {
+                o.decision = d;
+                o.set |= PENGUIN_OVERRIDE_DECISION;
+                return true;
+            }
+        }
+        return false;
+    } else if(strcmp(name, "priority") == 0 && (unsigned) atoi(value) <= PENGUIN_PRIORITY_LEVELS) {
+        o.priority = atoi(value);
+        o.set |= PENGUIN_OVERRIDE_PRIORITY;
+    } else if(strcmp(name, "prefetch") == 0 && penguin_tune_size(value) != 0) {
+        o.prefetch = penguin_tune_size(value);
+        o.set |= PENGUIN_OVERRIDE_PREFETCH;
+    } else if(strcmp(name, "ac_threshold") == 0) {
+        o.ac_threshold = strtoul(value, NULL, 10);
+        o.set |= PENGUIN_OVERRIDE_AC_THRESHOLD;
+    } else if(strcmp(name, "ac_granularity") == 0) {
+        o.ac_granularity = penguin_tune_size(value);
+        o.set |= PENGUIN_OVERRIDE_AC_GRANULARITY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// One rule of a line, false for none
+bool penguin_override_parse(char* line, const char* path, unsigned number, penguin_override& o) {
+    line[strcspn(line, "#\n")] = 0;
+    char* save = NULL;
+    char* key = strtok_r(line, " \t\r", &save);
+    if(key == NULL) {
+        return false;
+    }
+    o = penguin_override{0, "", 0, 0, PENGUIN_DEC_NONE, 0, 0, 0, 0};
+    const char* colon = strrchr(key, ':');
+    if(strncmp(key, "site=", 5) == 0 && strtoull(key + 5, NULL, 16) != 0) {
+        o.site = strtoull(key + 5, NULL, 16);
+    } else if(strncmp(key, "kernel=", 7) == 0 && colon != NULL && colon > key + 7 && isdigit(colon[1])) {
+        o.kernel.assign(key + 7, colon - key - 7);
+        o.arg = strtoul(colon + 1, NULL, 10);
+    } else {
+        fprintf(stderr, "ignoring %s:%u %s\n", path, number, key);
+        return false;
+    }
+    for(char* item = strtok_r(NULL, " \t\r", &save); item != NULL; item = strtok_r(NULL, " \t\r", &save)) {
+        char* eq = strchr(item, '=');
+        if(eq != NULL) {
+            *eq = 0;
+        }
+        if(eq == NULL || !penguin_override_set(o, item, eq + 1)) {
+            fprintf(stderr, "ignoring %s:%u %s%s%s\n", path, number, item, eq ? "=" : "", eq ? eq + 1 : "");
+        }
+    }
+    return o.set != 0;
+}
+
+// Reads the file if forced or it changed since, and binds the allocations to
+// its rules again. A file that can't be read keeps the rules there are.
+void penguin_overrides_load(bool forced) {
+    const char* path = getenv("PENGUIN_OVERRIDE_FILE");
+    static bool installed = false;
+    if(!installed) {
+        installed = true;
+        penguin_overrides_install();
+    }
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        fprintf(stderr, "Cannot open %s, overrides unchanged\n", path);
+        return;
+    }
+    if(!forced && st.st_mtim.tv_sec == overrides_mtime.tv_sec && st.st_mtim.tv_nsec == overrides_mtime.tv_nsec) {
+        return;
+    }
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s, overrides unchanged\n", path);
+        return;
+    }
+    std::vector<penguin_override> loaded;
+    char line[4096];
+    penguin_override o;
+    for(unsigned number = 1; fgets(line, sizeof(line), f) != NULL; number++) {
+        if(penguin_override_parse(line, path, number, o)) {
+            loaded.push_back(o);
+        }
+    }
+    fclose(f);
+    overrides_mtime = st.st_mtim;
+    overrides.swap(loaded);
+    override_kernel_rules = 0;
+    for(auto &r : overrides) {
+        override_kernel_rules += r.site == 0;
+    }
+    override_pending.clear();
+    for(unsigned id = 0; id < allocation_table.size(); id++) {
+        allocation_table[id].override_rule = 0;
+        if(allocation_table[id].size != 0) {
+            penguin_override_bind_site(id);
+        }
+    }
+    // the guarded record sites record again, which binds the kernel rules,
+    // and the planner decides again
+    mmg_input_generation++;
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "overrides %zu from %s", overrides.size(), path);
+}
+
+// Carries out the rule of allocation id, bound since the last launch
+void penguin_override_apply(unsigned id) {
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(desc.size == 0 || desc.override_rule == 0) {
+        return;
+    }
+    const penguin_override& o = overrides[desc.override_rule - 1];
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "override %u %p %llu", desc.override_rule, desc.base, desc.size);
+    if(o.set & PENGUIN_OVERRIDE_DECISION) {
+        mmg_apply_decision(desc.base, desc.decision, desc.gpu_res_stop);
+    }
+    // unless the decision changed, the new settings only reach the driver here
+    if((o.set & PENGUIN_OVERRIDE_PRIORITY) && desc.state == PENGUIN_STATE_GPU_PINNED && desc.gpu_res_stop) {
+        penguinSetPrioritizedLocationLevel(desc.base, desc.gpu_res_stop, desc.device, o.priority);
+    }
+    if((o.set & PENGUIN_OVERRIDE_PREFETCH) && desc.prefetch && desc.prefetch_size) {
+        set_allocation_prefetch(desc.base, desc.prefetch_size, desc.prefetch_iters_per_batch,
+                desc.prefetch_window);
+    }
+    if((o.set & (PENGUIN_OVERRIDE_AC_THRESHOLD | PENGUIN_OVERRIDE_AC_GRANULARITY)) &&
+            desc.state == PENGUIN_STATE_HOST) {
+        if(o.set & PENGUIN_OVERRIDE_AC_THRESHOLD) {
+            desc.ac_threshold = o.ac_threshold;
+        }
+        if(desc.ac_threshold) {
+            penguinSetAccessCounterPolicy(desc.base, desc.size, desc.ac_threshold,
+                    penguin_ac_granularity_for(desc));
+            if(desc.ac_threshold != PENGUIN_AC_NEVER) {
+                penguinEnableAccessCounters();
+            }
+        }
+    }
+}
+
+// Reads the file again after a SIGHUP or at the start of a phase
+void penguin_overrides_reload() {
+    if(penguin_overrides_enabled() && (overrides_sighup || overrides_check)) {
+        bool forced = overrides_sighup;
+        overrides_sighup = 0;
+        overrides_check = false;
+        penguin_overrides_load(forced);
+    }
+}
+
+// Before a launch is planned: carries out the rules bound since the last one
+void penguin_overrides_poll() {
+    penguin_overrides_reload();
+    std::vector<unsigned> pending;
+    pending.swap(override_pending);
+    for(unsigned id : pending) {
+        penguin_override_apply(id);
+    }
+}
+
+// Applies the recorded decisions of the allocations registered since the
+// previous launch. Returns true while the profile is being replayed, in which
+// case the caller skips planning.
+bool penguinProfileApply() {
+    if(!profile_replay) {
+        return false;
+    }
+    auto records = penguin_profile_records();
+    for(auto id = profile_pending_ids.begin(); id != profile_pending_ids.end(); id++) {
+        void* base = allocation_table[*id].base;
+        const penguin_profile_record &r = records[allocation_table[*id].seq];
+        auto decision = (Decision) r.decision;
+        allocation_table[*id].ac_threshold = r.ac_threshold;
+        if(r.prefetch_size) {
+            available -= r.prefetch_window < available ? r.prefetch_window : available.load();
+            set_allocation_prefetch(base, r.prefetch_size, r.prefetch_iters_per_batch, r.prefetch_window);
+        }
+        int device = r.device < penguin_num_devices() ? r.device : 0;
+        switch(decision) {
+            case PENGUIN_DEC_GPU_PIN:
+            case PENGUIN_DEC_GPU_HOST_PARTIAL_PIN: {
+                auto &room = penguin_device_available(device);
+                room -= r.gpu_res_stop < room ? r.gpu_res_stop : room.load();
+                mmg_apply_decision(base, decision, r.gpu_res_stop, device);
+                break;
+            }
+            case PENGUIN_DEC_ACCESS_COUNTER:
+                penguinEnableAccessCounters();
+                mmg_apply_decision(base, decision, 0);
+                break;
+            case PENGUIN_DEC_HOST_PIN:
+            case PENGUIN_DEC_MIGRATE_ON_DEMAND:
+                mmg_apply_decision(base, decision, 0);
+                break;
+            default:
+                penguin_set_decision(allocation_table[*id], decision);
+                break;
+        }
+    }
+    profile_pending_ids.clear();
+    return true;
+}
+
+// Ping-pong (-penguin-ping-pong): the host transform passes the regions the
+// host accesses of an allocation between its launches, for convergence
+// checks or partial readbacks, which migrate its pages back from the GPU
+// every iteration and to it again at the next launch. After
+// PENGUIN_PING_PONG_TRIPS such round trips, or sooner when the driver
+// reports it thrashing, the lighter side stops taking the migrations: when
+// the host touches as many bytes per round trip as the kernels' working set
+// the allocation is host pinned, which the GPU maps remotely, and otherwise
+// the GPU keeps it and the host's regions are migrated on their own, to the
+// host in one prefetch before its accesses and back before the next launch.
+// PENGUIN_PING_PONG=0 leaves the allocations where the planners put them.
+int ping_pong_enabled = -1;
+
+bool penguin_ping_pong_enabled() {
+    if(ping_pong_enabled < 0) {
+        const char* env = getenv("PENGUIN_PING_PONG");
+        ping_pong_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return ping_pong_enabled && PENGUIN_PING_PONG_TRIPS > 0;
+}
+
+// Stops prefetching an iteration migration allocation and gives its window
+// back
+void penguin_stop_iteration_prefetch(unsigned id) {
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(desc.prefetch) {
+        desc.prefetch = false;
+        prefetch_alloc_ids.remove(id);
+        available += desc.prefetch_window;
+        penguin_unstage_ring(desc);
+    }
+}
+
+// Picks the side of a ping-ponging allocation that stops migrating it
+void penguin_ping_pong_place(unsigned id) {
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(desc.host_regions || desc.thrashing_demoted) {
+        return;
+    }
+    unsigned long long host = std::max(desc.host_span, desc.host_hi - desc.host_lo);
+    unsigned long long gpu = desc.wss != 0 && desc.wss < desc.size ? desc.wss : desc.size;
+    // atomics stay on the GPU, see mmg_apply_decision
+    if(host >= gpu && !desc.atomic) {
+        if(desc.decision == PENGUIN_DEC_ITERATION_MIGRATION) {
+            penguin_stop_iteration_prefetch(id);
+        }
+        desc.thrashing_demoted = true;
+        mmg_apply_decision(desc.base, PENGUIN_DEC_HOST_PIN, 0);
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "ping pong, host pin %p", desc.base);
+    } else {
+        desc.host_regions = true;
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "ping pong, host regions %p", desc.base);
+    }
+}
+
+// Called by DynamicHostTransform before a host access to [p, p + bytes) of
+// a managed allocation between its launches, or before the loop of them; 0
+// bytes from the allocation's pointer is all of it
+extern "C"
+void penguinHostAccess(void* p, unsigned long long bytes) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_ping_pong_enabled() || penguin_policy() != PENGUIN_POLICY_SUV) {
+        return;
+    }
+    unsigned long long at = (unsigned long long) p;
+    auto a = allocation_interval_map.upper_bound(at);
+    if(a == allocation_interval_map.begin()) {
+        return;
+    }
+    a--;
+    unsigned id = a->second;
+    penguin_alloc_desc& desc = allocation_table[id];
+    unsigned long long offset = at - (unsigned long long) desc.base;
+    // where the host's accesses are local anyway
+    if(offset >= desc.size || desc.thrashing_demoted || desc.decision == PENGUIN_DEC_HOST_PIN ||
+            desc.decision == PENGUIN_DEC_HOST_WRITE_STREAM) {
+        return;
+    }
+    if(bytes == 0 || bytes > desc.size - offset) {
+        bytes = desc.size - offset;
+    }
+    // the first access since a launch took it
+    if(desc.gpu_epoch > desc.host_epoch) {
+        // not the accesses before the first launch, which filled it
+        if(desc.round_trips++ > 0) {
+            desc.host_span = std::max(desc.host_span, desc.host_hi - desc.host_lo);
+        }
+        desc.host_lo = offset;
+        desc.host_hi = offset + bytes;
+        if(desc.round_trips >= PENGUIN_PING_PONG_TRIPS) {
+            penguin_ping_pong_place(id);
+        }
+    } else if(desc.host_hi > desc.host_lo) {
+        desc.host_lo = std::min(desc.host_lo, offset);
+        desc.host_hi = std::max(desc.host_hi, offset + bytes);
+    } else {
+        desc.host_lo = offset;
+        desc.host_hi = offset + bytes;
+    }
+    desc.host_epoch = launch_epoch;
+    if(!desc.host_regions || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    // after the kernels launched so far, and there before the host reads it
+    cudaEventRecord(prefetch_engine.compute_done, 0);
+    cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+    penguin_mem_prefetch(p, bytes, cudaCpuDeviceId, prefetch_engine.d2h);
+    penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, at, bytes);
+    cudaStreamSynchronize(prefetch_engine.d2h);
+}
+
+// Moves allocations the driver reports as thrashing off their placement
+// before the next launch, rather than at the next replan. An allocation
+// migrated on demand that keeps thrashing is host pinned, while a host-pinned
+// one whose pages the driver pinned on the GPU is moved there if it fits.
+// GPU-pinned allocations stay: the driver pins their pages on the GPU instead
+// of throttling it.
+void penguin_thrashing_feedback(unsigned id, unsigned reports, unsigned flags) {
+    if(PENGUIN_THRASHING_MIN_REPORTS == 0) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    desc.thrashing_reports += reports;
+    if(desc.thrashing_reports < PENGUIN_THRASHING_MIN_REPORTS) {
+        return;
+    }
+    desc.thrashing_reports = 0;
+    // thrashing with the host, whose side is known
+    if(desc.round_trips > 0 && penguin_ping_pong_enabled()) {
+        penguin_ping_pong_place(id);
+        return;
+    }
+    switch(desc.decision) {
+        case PENGUIN_DEC_ITERATION_MIGRATION:
+            penguin_stop_iteration_prefetch(id);
+            // fall through
+        case PENGUIN_DEC_MIGRATE_ON_DEMAND:
+        case PENGUIN_DEC_NONE:
+            /* std::cout << "thrashing, host pin " << desc.base << "\n"; */
+            desc.thrashing_demoted = true;
+            mmg_apply_decision(desc.base, PENGUIN_DEC_HOST_PIN, 0);
+            break;
+        case PENGUIN_DEC_HOST_PIN:
+            if(!desc.thrashing_demoted && (flags & PENGUIN_THRASHING_PINNED)) {
+                int device = penguin_place_device(desc, desc.size);
+                if(penguin_device_available(device) >= desc.size) {
+                    /* std::cout << "thrashing, gpu pin " << desc.base << "\n"; */
+                    penguin_device_available(device) -= desc.size;
+                    mmg_apply_decision(desc.base, PENGUIN_DEC_GPU_PIN, desc.size, device);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void penguinThrashingFeedback() {
+    if(PENGUIN_THRASHING_MIN_REPORTS == 0) {
+        return;
+    }
+    penguin_thrashing_event events[PENGUIN_THRASHING_QUEUE_SIZE];
+    unsigned count = PENGUIN_THRASHING_QUEUE_SIZE;
+    if(penguinGetThrashingEvents(events, &count, NULL) != PENGUIN_OK) {
+        return;
+    }
+    for(unsigned e = 0; e < count; e++) {
+        auto id = lookup_allocation_id(events[e].base);
+        if(id != PENGUIN_INVALID_ALLOC_ID) {
+            penguin_thrashing_feedback(id, events[e].reports, events[e].flags);
+        }
+    }
+}
+
+// Moves a host-pinned allocation to the GPU once the driver's access counters
+// migrated PENGUIN_AC_MIGRATED_RATIO of it there anyway, if it fits; a
+// thrashing one stays on the host.
+void penguinAccessCounterFeedback(unsigned id, unsigned long long length) {
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(desc.decision != PENGUIN_DEC_HOST_PIN || desc.thrashing_demoted) {
+        return;
+    }
+    desc.ac_migrated += length;
+    int device = penguin_place_device(desc, desc.size);
+    if(desc.ac_migrated < desc.size * PENGUIN_AC_MIGRATED_RATIO ||
+            penguin_device_available(device) < desc.size) {
+        return;
+    }
+    /* std::cout << "access counters, gpu pin " << desc.base << "\n"; */
+    desc.ac_migrated = 0;
+    penguin_device_available(device) -= desc.size;
+    mmg_apply_decision(desc.base, PENGUIN_DEC_GPU_PIN, desc.size, device);
+}
+
+bool penguin_event_ring_setup() {
+    if(event_ring != NULL || event_ring_failed || PENGUIN_EVENT_RING_ENTRIES == 0) {
+        return event_ring != NULL;
+    }
+    size_t size = sizeof(penguin_event_ring_header) +
+        PENGUIN_EVENT_RING_ENTRIES * sizeof(penguin_event_record);
+    void* ring = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(ring == MAP_FAILED) {
+        event_ring_failed = true;
+        return false;
+    }
+    if(penguinRegisterEventRing(ring, size) != PENGUIN_OK) {
+        munmap(ring, size);
+        event_ring_failed = true;
+        return false;
+    }
+    event_ring = (penguin_event_ring_header*)ring;
+    return true;
+}
+
+// Consumes what the driver recorded since the previous launch: thrashing
+// reports as in penguinThrashingFeedback, access counter migrations as in
+// penguinAccessCounterFeedback, and evictions of prioritized data, which mean
+// the GPU holds less than the budget says; what they evicted is taken out of
+// the available memory of the allocation's device until the next replan.
+// Returns false if there is no ring.
+bool penguinEventRingDrain() {
+    if(!penguin_event_ring_setup()) {
+        return false;
+    }
+    penguin_event_record* records = (penguin_event_record*)(event_ring + 1);
+    unsigned mask = event_ring->entries - 1;
+    unsigned put = __atomic_load_n(&event_ring->put, __ATOMIC_ACQUIRE);
+    unsigned get = event_ring->get;
+    unsigned long long evicted[PENGUIN_MAX_DEVICES] = {};
+    for(; get != put; get++) {
+        const penguin_event_record& record = records[get & mask];
+        // the driver reports the range, which a partial pin splits
+        auto id = lookup_allocation_id(record.base);
+        if(id == PENGUIN_INVALID_ALLOC_ID) {
+            id = lookup_allocation_id(identify_memory_allocation(record.base));
+        }
+        if(record.type == PENGUIN_EVENT_EVICTION) {
+            evicted[id == PENGUIN_INVALID_ALLOC_ID ? 0 : allocation_table[id].device] += record.length;
+            continue;
+        }
+        if(id == PENGUIN_INVALID_ALLOC_ID) {
+            continue;
+        }
+        switch(record.type) {
+            case PENGUIN_EVENT_THRASHING:
+                penguin_thrashing_feedback(id, 1, record.value);
+                break;
+            case PENGUIN_EVENT_AC_MIGRATION:
+                penguinAccessCounterFeedback(id, record.length);
+                penguin_partial_pin_heat(id, record.address);
+                penguin_heatmap_notification(id, record.address);
+                break;
+            case PENGUIN_EVENT_AC_SAMPLE:
+                penguin_ac_sample(id, record.address, record.value);
+                penguin_heatmap_notification(id, record.address);
+                break;
+            default:
+                break;
+        }
+    }
+    // hand the slots back to the driver
+    __atomic_store_n(&event_ring->get, get, __ATOMIC_RELEASE);
+    for(int d = 0; d < penguin_num_devices(); d++) {
+        /* if(evicted[d]) std::cout << "evicted " << evicted[d] << " on " << d << "\n"; */
+        auto &room = penguin_device_available(d);
+        room = room > evicted[d] ? room - evicted[d] : 0;
+    }
+    penguin_partial_pin_rebalance();
+    return true;
+}
+
+// Streams an iteration migration allocation through a staged copy ring when
+// the host transform remaps its pointers, no kernel stores to it, and the
+// analysis bounds all its accesses to the iteration's span: none outside an
+// iteration dependent aid (ac_map_invid, of the planner) and none it only
+// samples or chases. Unstages it otherwise.
+template <typename T>
+void penguin_stage_iteration_allocation(void* alloc, unsigned long long span,
+        unsigned long long iters_per_batch, unsigned long long window,
+        std::map<unsigned, std::map<void*, T>>& ac_map_invid) {
+    penguin_alloc_desc& desc = allocation_desc(alloc);
+    bool bounded = penguin_staged_enabled() && desc.loaded && !desc.stored && span != 0 &&
+        ac_samples.find(lookup_allocation_id(alloc)) == ac_samples.end();
+    for(auto i = ac_map_invid.begin(); bounded && i != ac_map_invid.end(); i++) {
+        auto a = i->second.find(alloc);
+        bounded = a == i->second.end() || a->second == 0;
+    }
+    for(auto a = aid_pchase_map.begin(); bounded && a != aid_pchase_map.end(); a++) {
+        auto p = aid_allocation_map.find(a->first);
+        bounded = !a->second || p == aid_allocation_map.end() ||
+            (unsigned long long) p->second - (unsigned long long) alloc >= desc.size;
+    }
+    if(!bounded || !penguin_stage_ring(desc, span * iters_per_batch, window)) {
+        penguin_unstage_ring(desc);
+    }
+}
+
+// Drops the rings of the allocations a replan no longer prefetches
+void penguin_unstage_unprefetched() {
+    std::vector<unsigned> ids(staged_ids.begin(), staged_ids.end());
+    for(auto id = ids.begin(); id != ids.end(); id++) {
+        if(!allocation_table[*id].prefetch) {
+            penguin_unstage_ring(allocation_table[*id]);
+        }
+    }
+}
+
+// The whole budget back, and no allocation prefetched, for a new placement
+void mmg_plan_reset() {
+    available = gpu_memory;
+    for(int d = 1; d < penguin_num_devices(); d++) {
+        device_available[d] = device_gpu_memory[d];
+    }
+    mmg_planned_budget = gpu_memory;
+    mmg_devices_changed = false;
+    mmg_allocation_freed = false;
+    for(auto id = prefetch_alloc_ids.begin(); id != prefetch_alloc_ids.end(); id++) {
+        allocation_table[*id].prefetch = false;
+    }
+    prefetch_alloc_ids.clear();
+    penguin_prefetch_period = penguin_sub_range_period;
+}
+
+// Phase 2 of the global planner: whole-program placement from the
+// per-allocation totals, of the allocations of the current phase, see
+// penguin_phase_note. Cost depends on the number of allocations and
+// invocations only, not on the number of aids.
+void mmg_plan_global_placement() {
+    std::map<void*, float> mmg_alloc_ad_map_iteronly;
+    std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly;
+    std::map<void*, float> mmg_alloc_ad_map;
+    std::set<void*> mmg_alloc_pchase_set;
+
+    mmg_plan_reset();
+
+    /* std::cout << "allocation to ac map iteronly\n"; */
+    for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) {
+        auto span = mmg_alloc_span_map_iteronly[a->first];
+        if(a->second == 0 || span == 0 || !penguin_in_phase(a->first)) {
+            continue;
+        }
+        /* std::cout << a->first << " " << a->second << " " << span << " "; */
+        auto ad = (float) a->second / (float) span;
+        /* std::cout << ad  << "\n"; */
+        mmg_alloc_ad_map_iteronly[a->first] = ad;
+    }
+    /* std::cout << "allocation to ac to ad map\n"; */
+    float max_ad_among_noniter = 0;
+    for (auto invid = mmg_alloc_ac_map_invid.begin(); invid != mmg_alloc_ac_map_invid.end(); invid++) {
+        for(auto a = invid->second.begin(); a != invid->second.end(); a++) {
+            if(!penguin_in_phase(a->first)) {
+                continue;
+            }
+            auto dsize = allocation_desc(a->first).size;
+            auto ad = (float) a->second / (float) dsize;
+            if(ad > max_ad_among_noniter) {
+                max_ad_among_noniter = ad;
+            }
+            // an allocation is placed by its densest invocation
+            if(a->second && mmg_alloc_ad_map[a->first] < ad) {
+                mmg_alloc_ad_map[a->first] = ad;
+            }
+        }
+    }
+    for (auto a = aid_pchase_map.begin(); a != aid_pchase_map.end(); a++) {
+        auto c = mmg_aid_contribution_map.find(a->first);
+        if(c != mmg_aid_contribution_map.end() && penguin_in_phase(c->second.allocation)) {
+            mmg_alloc_pchase_set.insert(c->second.allocation);
+        }
+    }
+    /* std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
+    /* std::cout << "phase 2, decisions for iteronly\n"; */
+    std::copy(mmg_alloc_ad_map_iteronly.begin(), 
+            mmg_alloc_ad_map_iteronly.end(),
+            back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly));
+    std::sort(mmg_alloc_ad_vector_iteronly.begin(),
+            mmg_alloc_ad_vector_iteronly.end(), sortfunc);
+    /* std::cout << "sorted ad iteronly \n"; */
+    for(auto a = mmg_alloc_ad_vector_iteronly.begin();
+            a != mmg_alloc_ad_vector_iteronly.end(); a++) {
+        /* std::cout << a->first << "  " << a->second << "\n"; */
+        if(a->second > max_ad_among_noniter && !allocation_desc(a->first).thrashing_demoted) {
+            /* std::cout << "will be considered; "; */
+            auto span = mmg_alloc_span_map_iteronly[a->first];
+            auto dsize = allocation_desc(a->first).size;
+            /* std::cout << "span = " << span << "  "; */
+            auto prefetch_size = span;
+            if(prefetch_size < penguin_tune().min_prefetch) {
+                prefetch_size = penguin_tune().min_prefetch;
+            }
+            if(prefetch_size >= dsize) {
+                prefetch_size = dsize;
+            }
+            /* std::cout << "prefetch = " << prefetch_size << "\n"; */
+            auto prefetch_iters_per_batch = prefetch_size/span;
+            /* std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
+            // insert into data structures for penguinSuperPrefetch to read from 
+            auto batches = prefetch_size * penguin_tune().prefetch_batches;
+            auto window = reserve_prefetch_window(batches);
+            set_allocation_prefetch(a->first, batches, prefetch_iters_per_batch, window);
+            penguin_stage_iteration_allocation(a->first, span, prefetch_iters_per_batch, window,
+                    mmg_alloc_ac_map_invid);
+            penguin_set_decision(allocation_desc(a->first), PENGUIN_DEC_ITERATION_MIGRATION);
+            mmg_alloc_ad_map.erase(a->first);
+            /* std::cout << "available = " << available << "\n"; */ 
+        } else {
+            /* std::cout << "will NOT be considered\n"; */
+        }
+    } // iteronly ends here
+    penguin_unstage_unprefetched();
+    /* std::cout << "phase 2.5, decision for non-iter\n"; */
+    std::vector<std::pair<void*, float>> mmg_alloc_ad_vector;
+    for(auto alloc = mmg_alloc_ad_map.begin(); alloc != mmg_alloc_ad_map.end(); alloc++) {
+        mmg_alloc_ad_vector.push_back(std::pair<void*, float>(alloc->first, alloc->second));
+    }
+    std::sort(mmg_alloc_ad_vector.begin(), mmg_alloc_ad_vector.end(), sortfuncf);
+    /* std::cout << "sorted \n"; */
+
+    // Actual decision
+    /* std::cout << "actual decision\n"; */
+    if(!mmg_alloc_pchase_set.empty() || !aid_ac_incomp_map.empty()) {
+        penguinEnableAccessCounters();
+    }
+    for(auto a = mmg_alloc_pchase_set.begin(); a != mmg_alloc_pchase_set.end(); a++) {
+        mmg_apply_decision(*a, PENGUIN_DEC_ACCESS_COUNTER, 0);
+    }
+    // density of the last allocation pinned, hottest first
+    float pin_cutoff_ad = 0;
+    for(auto a = mmg_alloc_ad_vector.begin(); a != mmg_alloc_ad_vector.end(); a++) {
+        if(mmg_alloc_pchase_set.find(a->first) != mmg_alloc_pchase_set.end()) {
+            /* std::cout << "dominated by pchase\n"; */
+            continue;
+        }
+        auto dsize = allocation_desc(a->first).size;
+        auto awss = mmg_alloc_wss_map.find(a->first);
+        int device = penguin_place_device(allocation_desc(a->first), dsize);
+        auto &room = penguin_device_available(device);
+        if(allocation_desc(a->first).thrashing_demoted) {
+            /* std::cout << "thrashed, cpu pin\n"; */
+            mmg_apply_decision(a->first, PENGUIN_DEC_HOST_PIN, 0);
+        } else if(awss != mmg_alloc_wss_map.end() && awss->second < dsize) {
+            /* std::cout << "temporal\n"; */
+            device = penguin_home_device(allocation_desc(a->first));
+            auto &home_room = penguin_device_available(device);
+            home_room -= awss->second < home_room ? awss->second : home_room.load();
+            mmg_apply_decision(a->first, PENGUIN_DEC_MIGRATE_ON_DEMAND, 0, device);
+        } else if(room >= dsize) {
+            /* std::cout << "gpu pin on " << device << "\n"; */
+            room -= dsize;
+            pin_cutoff_ad = a->second;
+            mmg_apply_decision(a->first, PENGUIN_DEC_GPU_PIN, dsize, device);
+        } else if(room > 0) {
+            /* std::cout << "gpu pin on " << device << ", cpu pin rest\n"; */
+            pin_cutoff_ad = a->second;
+            mmg_apply_decision(a->first, PENGUIN_DEC_GPU_HOST_PARTIAL_PIN, room, device);
+            room = 0;
+        } else {
+            /* std::cout << "cpu pin\n"; */
+            // just below the cutoff, the hot blocks are worth migrating
+            allocation_desc(a->first).ac_threshold =
+                a->second >= pin_cutoff_ad * PENGUIN_AC_NEAR_PIN_RATIO ?
+                PENGUIN_AC_NEAR_PIN_THRESHOLD : PENGUIN_AC_NEVER;
+            mmg_apply_decision(a->first, PENGUIN_DEC_HOST_PIN, 0);
+        }
+    }
+
+    // LAST STEP 
+    // check if memory is available; if so widen the prefetch windows.
+    if(available > 0) {
+        unsigned numPrefetchedAllocs = 0;
+        unsigned long long PrefetchTotal = 0;
+        for(auto id = prefetch_alloc_ids.begin(); id != prefetch_alloc_ids.end(); id++) {
+            numPrefetchedAllocs++;
+            PrefetchTotal += allocation_table[*id].prefetch_window;
+        }
+        /* std::cout << "numPrefetchedAllocs = " << numPrefetchedAllocs << std::endl; */
+        /* std::cout << "prefetchTotal = " << PrefetchTotal << std::endl; */
+        unsigned long long available_now = available;
+        for(auto id = prefetch_alloc_ids.begin(); id != prefetch_alloc_ids.end(); id++) {
+            penguin_alloc_desc& memalloc = allocation_table[*id];
+            unsigned long long newAllocation = 
+                (memalloc.prefetch_window * available_now) / PrefetchTotal;
+            available -= newAllocation;
+            memalloc.prefetch_window += newAllocation;
+            /* std::cout << memalloc.base << " " << newAllocation << " " */ 
+                /* << memalloc.prefetch_window << std::endl; */
+        }
+    }
+    /* std::cout << "available = " << available << std::endl; */
+}
+
+// Gives back the GPU memory of an allocation the new phase doesn't pass
+void penguin_phase_release(void* allocation) {
+    auto id = lookup_allocation_id(allocation);
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].base != allocation ||
+            allocation_table[id].size == 0) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    if(desc.state == PENGUIN_STATE_GPU_PINNED) {
+        penguinUnsetPrioritizedLocation(desc.base, desc.size);
+        pinned_memory -= std::min(pinned_memory, desc.gpu_res_stop);
+        desc.state = PENGUIN_STATE_UNKNOWN;
+    }
+    desc.gpu_res_start = 0;
+    desc.gpu_res_stop = 0;
+    partial_pins.erase(id);
+    penguin_set_decision(desc, PENGUIN_DEC_NONE);
+}
+
+// Places the allocations of the current phase as the plan made the last time
+// it ran did, for the same budget. False if there is none.
+bool penguin_phase_apply_plan() {
+    auto plan = phase_plans.find(phase_signature);
+    if(phase_signature == 0 || plan == phase_plans.end() || plan->second.budget != gpu_memory) {
+        return false;
+    }
+    mmg_plan_reset();
+    for(auto p = plan->second.placements.begin(); p != plan->second.placements.end(); p++) {
+        auto id = lookup_allocation_id(p->allocation);
+        if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].base != p->allocation ||
+                allocation_table[id].size != p->size) {
+            continue;
+        }
+        if(p->decision == PENGUIN_DEC_ITERATION_MIGRATION) {
+            available -= std::min(available.load(), p->prefetch_window);
+            set_allocation_prefetch(p->allocation, p->prefetch_size, p->prefetch_iters_per_batch,
+                    p->prefetch_window);
+            penguin_set_decision(allocation_table[id], PENGUIN_DEC_ITERATION_MIGRATION);
+            continue;
+        }
+        if(p->decision == PENGUIN_DEC_GPU_PIN || p->decision == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) {
+            auto &room = penguin_device_available(p->device);
+            room -= std::min(room.load(), p->resident);
+        }
+        mmg_apply_decision(p->allocation, p->decision, p->resident, p->device);
+    }
+    penguin_unstage_unprefetched();
+    return true;
+}
+
+// this function is for all non-iterative kernels (and non iteration-dependent accesses within iterative kernels)
+// It is called before every launch; only aids recorded or changed since the
+// previous call are attributed, and the placement is redone only if some
+// allocation's totals moved or the budget did.
+extern "C"
+void perform_memory_management_global() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "mm global \n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s", __func__);
+    penguinBudgetUpdate();
+    if(penguinProfileApply()) {
+        return;
+    }
+    bool replan = mmg_planned_budget != 0 && mmg_planned_budget != gpu_memory;
+    replan |= mmg_devices_changed;
+    replan |= mmg_allocation_freed;
+    if(!mmg_dirty_aids.empty()) {
+        replan |= !mmg_attribute_dirty_aids().empty();
+    }
+    if(mmg_phase_changed) {
+        mmg_phase_changed = false;
+        for(auto a = phase_released.begin(); a != phase_released.end(); a++) {
+            penguin_phase_release(*a);
+        }
+        phase_released.clear();
+        // a phase seen before is placed as it was then, at once
+        replan = !penguin_phase_apply_plan();
+    }
+    if(replan) {
+        mmg_plan_global_placement();
+    }
+    if(!penguinEventRingDrain()) {
+        penguinThrashingFeedback();
+    }
+}
+
+extern "C"
+void perform_memory_management_iterative() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "mm iterative \n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s", __func__);
+    is_iterative = true;
+    penguinBudgetUpdate();
+    if(penguinProfileApply()) {
+        return;
+    }
+    /* std::cout << "available = " << available << std::endl; */
+
+    /* std::cout << "data from reuse\n"; */
+    for (auto a = aid_ac_map_reuse.begin(); a != aid_ac_map_reuse.end(); a++) {
+        /* std::cout << a->first << "  " << a->second << std::endl; */
+    }
+    std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly;
+    std::map<void*, unsigned long long> mmg_alloc_ad_map_iteronly;
+    std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly;
+    std::map<unsigned, std::map<void*, float>> mmg_alloc_ac_map_invid;
+    std::map<unsigned, std::map<void*, float>> mmg_alloc_ad_map_invid;
+     std::map<void*, float> mmg_alloc_ad_map_global;
+     std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_global;
+    std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly;
+    for (auto a = aid_allocation_map_reuse.begin(); a != aid_allocation_map_reuse.end(); a++) {
+        auto invid = aid_invocation_id_map[a->first];
+        if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) {
+            // check if only a fractiof of the data structure is being accesses in this access
+            auto span = aid_wss_map_iterdep[a->first];
+            auto allocation = aid_allocation_map_reuse[a->first];
+            auto dsize = allocation_desc(allocation).size;
+            /* std::cout << "hi " << span << "  " << dsize << "\n"; */
+            float span_to_size = (float) span / (float) dsize;
+            if(span_to_size < penguin_tune().iteronly_ratio && span != 0) {
+                /* std::cout << "span is smallr than dsize significantly\n"; */
+                mmg_alloc_ac_map_iteronly[a->second] += aid_ac_map[a->first];
+                if(mmg_alloc_span_map_iteronly[a->second] < span) {
+                    mmg_alloc_span_map_iteronly[a->second] = span;
+                }
+            } else {
+                mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
+            }
+
+        } else {
+            /* std::cout << aid_ac_map[a->first]; */
+            mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first];
+            // not an iteration dependent access
+        }
+    }
+    /* std::cout << "allocation to ac map iteronly\n"; */
+    for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) {
+        auto span = mmg_alloc_span_map_iteronly[a->first];
+        /* std::cout << a->first << " " << a->second << " " << span << " "; */
+        auto ad = (float) a->second / (float) span;
+        /* std::cout << ad  << "\n"; */
+        mmg_alloc_ad_map_iteronly[a->first] = ad;
+    }
+    /* std::cout << "allocation to ac to ad map\n"; */
+    float max_ad_among_noniter = 0;
+    for (auto mmg_alloc_ac_map_iter = mmg_alloc_ac_map_invid.begin();
+            mmg_alloc_ac_map_iter != mmg_alloc_ac_map_invid.end();
+            mmg_alloc_ac_map_iter++) {
+        auto invid  = mmg_alloc_ac_map_iter->first;
+        /* std::cout << "invid = " << mmg_alloc_ac_map_iter->first << "\n"; */
+        auto mmg_alloc_ac_map = mmg_alloc_ac_map_iter->second;
+        for(auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) {
+            /* std::cout << a->first << " " << a->second << " "; */
+            auto dsize = allocation_desc(a->first).size;
+            auto ad = (float) a->second / (float) dsize;
+            if(ad > max_ad_among_noniter) {
+                max_ad_among_noniter = ad;
+            }
+            /* std::cout << ad  << "\n"; */
+            mmg_alloc_ad_map_invid[invid][a->first] = mmg_alloc_ac_map_invid[invid][a->first] / (float) dsize;
+            mmg_alloc_ad_map_global[a->first] += mmg_alloc_ad_map_invid[invid][a->first];
+        }
+    }
+    /* std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
+    /* std::cout << "phase 2, decisions for iteronly\n"; */
+    std::copy(mmg_alloc_ad_map_iteronly.begin(), 
+            mmg_alloc_ad_map_iteronly.end(),
+            back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly));
+    std::sort(mmg_alloc_ad_vector_iteronly.begin(),
+            mmg_alloc_ad_vector_iteronly.end(), sortfunc);
+    /* std::cout << "sorted ad iteronly \n"; */
+    for(auto a = mmg_alloc_ad_vector_iteronly.begin();
+            a != mmg_alloc_ad_vector_iteronly.end(); a++) {
+        /* std::cout << a->first << "  " << a->second << "\n"; */
+        if(a->second > max_ad_among_noniter) {
+            /* std::cout << "will be considered; "; */
+            auto span = mmg_alloc_span_map_iteronly[a->first];
+            if(span == 0) {
+                /* std::cout << "skipped\n"; */
+                continue;
+            }
+            /* auto span = 1024*1024; */
+            auto dsize = allocation_desc(a->first).size;
+            /* std::cout << "span = " << span << "  "; */
+            auto prefetch_size = span;
+            if(prefetch_size < penguin_tune().min_prefetch) {
+                prefetch_size = penguin_tune().min_prefetch;
+            }
+            if(prefetch_size >= dsize) {
+                prefetch_size = dsize;
+            }
+            /* std::cout << "prefetch = " << prefetch_size << "\n"; */
+            /* auto prefetch_iters_per_batch = dsize/prefetch_size; */
+            auto prefetch_iters_per_batch = prefetch_size/span;
+            /* std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
+            // insert into data structures for penguinSuperPrefetch to read from 
+            auto batches = prefetch_size * penguin_tune().prefetch_batches;
+            auto window = reserve_prefetch_window(batches);
+            set_allocation_prefetch(a->first, batches, prefetch_iters_per_batch, window);
+            penguin_stage_iteration_allocation(a->first, span, prefetch_iters_per_batch, window,
+                    mmg_alloc_ac_map_invid);
+            penguin_set_decision(allocation_desc(a->first), PENGUIN_DEC_ITERATION_MIGRATION);
+            /* std::cout << "available = " << available << "\n"; */ 
+        } else {
+            /* std::cout << "will NOT be considered\n"; */
+        }
+    } // iteronly ends here
+      // phase 3: decisions for non iterative
+    /* std::cout << "global AD\n"; */
+    for (auto a = mmg_alloc_ad_map_global.begin();
+            a != mmg_alloc_ad_map_global.end(); a++) {
+        /* std::cout << a->first << " " << a->second << std::endl; */
+        mmg_alloc_ad_vector_global.push_back(std::pair<void*, float>(a->first, a->second));
+    }
+    std::sort(mmg_alloc_ad_vector_global.begin(),
+            mmg_alloc_ad_vector_global.end(), sortfuncf);
+    /* std::cout << "sorted ad global \n"; */
+    for(auto a = mmg_alloc_ad_vector_global.begin();
+            a != mmg_alloc_ad_vector_global.end(); a++) {
+        /* std::cout << a->first << "  " << a->second << "\n"; */
+    }
+    // consider high AD ones first, then move on to low AD
+    // If AD < 5, consider only for pinning at the same place across iterations
+    /* available = gpu_memory; */
+    /* std::cout << "available " << available << std::endl; */
+    for(auto a = mmg_alloc_ad_vector_global.begin();
+            a != mmg_alloc_ad_vector_global.end(); a++) {
+        /* std::cout << a->first << "  " << a->second << "\n"; */
+        auto dsize = allocation_desc(a->first).size;
+        // the AD rank is the eviction order should the driver have to evict
+        unsigned priority = penguin_priority_for_rank(a - mmg_alloc_ad_vector_global.begin(),
+                mmg_alloc_ad_vector_global.size());
+        if(available) {
+            if(available > dsize) {
+                if(allocation_desc(a->first).state == PENGUIN_STATE_GPU_PINNED) {
+                }  else {
+                    /* std::cout << "gpu pin A\n"; */
+                    available -= dsize;
+                    /* std::cout << available <<  std::endl; */
+                    allocation_desc(a->first).state = PENGUIN_STATE_GPU_PINNED;
+                    allocation_desc(a->first).gpu_res_start = 0;
+                    allocation_desc(a->first).gpu_res_stop = dsize;
+                    penguinSetPrioritizedLocationLevel((char*) a->first, dsize, 0, priority);
+                    penguin_prefetch_pinned(a->first, dsize);
+                }
+            } else {
+                /* std::cout << "gpu pin B\n"; */
+                    allocation_desc(a->first).gpu_res_start = 0;
+                    allocation_desc(a->first).gpu_res_stop = available;
+                /* std::cout << available <<  std::endl; */
+                allocation_desc(a->first).state = PENGUIN_STATE_GPU_PINNED;
+                penguinSetPrioritizedLocationLevel((char*) a->first, available, 0, priority);
+                penguin_prefetch_pinned(a->first, available);
+                available = 0;
+                /* std::cout << "cpu pin rest B\n"; */
+                penguin_mem_advise((char*) a->first + available, dsize - available, cudaMemAdviseSetAccessedBy, 0);
+            }
+        } else {
+                allocation_desc(a->first).state = PENGUIN_STATE_HOST;
+                /* std::cout << "cpu pin rest B\n"; */
+                /* std::cout << available <<  std::endl; */
+                penguin_mem_advise((char*) a->first + available, dsize - available, cudaMemAdviseSetAccessedBy, 0);
+        }
+    }
+
+    // use remaning memory
+    if(available > 0) {
+    }
+
+
+}
+
+/* extern "C" */
+/* void perform_memory_management_global_og() { */
+/*     /1* return; // debuggy: quick test *1/ */
+/*     for(auto InvId = InvocationIDs.begin(); InvId != InvocationIDs.end(); InvId++){ */
+/*         InvocationIDtoDecisionBoolMap[*InvId] = false; */
+/*     } */
+/*     std::cout << "printing all aid along with allocation and ac\n"; */
+/*     for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) { */
+/*         std::cout << a->first << " " << aid_ac_map[a->first] << " " << a->second << " "; */
+/*         std::cout << aid_ac_map[a->first] << " "; */
+/*         std::cout << allocation_desc(aid_allocation_map[a->first).size] << " "; */
+/*         std::cout << aid_invocation_id_map[a->first] << " "; */
+/*         if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) { */
+/*             std::cout << " iterdep "; */
+/*             std::cout << aid_wss_map_iterdep[a->first]; */
+/*         } */
+/*         std::cout << "\n"; */
+/*     } */
+
+/*     std::map<void*, unsigned long long> mmg_alloc_ac_map_iteronly; */
+/*     std::map<void*, unsigned long long> mmg_alloc_span_map_iteronly; */
+/*     std::map<void*, unsigned long long> mmg_alloc_ad_map_iteronly; */
+/*     std::vector<std::pair<void*, unsigned long long>> mmg_alloc_ad_vector_iteronly; */
+
+/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_ac_map_invid; */
+/*     std::map<unsigned, std::map<void*, float>> mmg_alloc_ad_map_invid; */
+/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_x_map_invid; */
+/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_y_map_invid; */
+/*     std::map<unsigned, std::map<void*, unsigned long long>> mmg_alloc_pd_i_map_invid; */
+
+/*     for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) { */
+/*         auto invid = aid_invocation_id_map[a->first]; */
+/*         if(aid_wss_map_iterdep.find(a->first) != aid_wss_map_iterdep.end()) { */
+/*             // check if only a fractiof of the data structure is being accesses in this access */
+/*             auto span = aid_wss_map_iterdep[a->first]; */
+/*             auto allocation = aid_allocation_map[a->first]; */
+/*             auto dsize = allocation_desc(allocation).size; */
+/*             /1* std::cout << "hi " << span << "  " << dsize << "\n"; *1/ */
+/*             float span_to_size = (float) span / (float) dsize; */
+/*             if(span_to_size < 0.05) { */
+/*                 /1* std::cout << "span is smallr than dsize significantly\n"; *1/ */
+/*                 mmg_alloc_ac_map_iteronly[a->second] += aid_ac_map[a->first]; */
+/*                 if(mmg_alloc_span_map_iteronly[a->second] < span) { */
+/*                     mmg_alloc_span_map_iteronly[a->second] = span; */
+/*                 } */
+/*             } else { */
+/*                 mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first]; */
+/*             } */
+
+/*         } else { */
+/*             /1* std::cout << aid_ac_map[a->first]; *1/ */
+/*             mmg_alloc_ac_map_invid[invid][a->second] += aid_ac_map[a->first]; */
+/*             // not an iteration dependent access */
+/*         } */
+/*     } */
+/*     std::cout << "allocation to ac map iteronly\n"; */
+/*     for(auto a = mmg_alloc_ac_map_iteronly.begin(); a != mmg_alloc_ac_map_iteronly.end(); a++) { */
+/*         auto span = mmg_alloc_span_map_iteronly[a->first]; */
+/*         std::cout << a->first << " " << a->second << " " << span << " "; */
+/*         auto ad = (float) a->second / (float) span; */
+/*         std::cout << ad  << "\n"; */
+/*         mmg_alloc_ad_map_iteronly[a->first] = ad; */
+/*     } */
+/*     std::cout << "allocation to ac map\n"; */
+/*     float max_ad_among_noniter = 0; */
+/*     for (auto mmg_alloc_ac_map_iter = mmg_alloc_ac_map_invid.begin(); */
+/*             mmg_alloc_ac_map_iter != mmg_alloc_ac_map_invid.end(); */
+/*             mmg_alloc_ac_map_iter++) { */
+/*         auto invid  = mmg_alloc_ac_map_iter->first; */
+/*         std::cout << "invid = " << mmg_alloc_ac_map_iter->first << "\n"; */
+/*         auto mmg_alloc_ac_map = mmg_alloc_ac_map_iter->second; */
+/*         for(auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) { */
+/*             std::cout << a->first << " " << a->second << " "; */
+/*             auto dsize = allocation_desc(a->first).size; */
+/*             auto ad = (float) a->second / (float) dsize; */
+/*             if(ad > max_ad_among_noniter) { */
+/*                 max_ad_among_noniter = ad; */
+/*             } */
+/*             std::cout << ad  << "\n"; */
+/*             mmg_alloc_ad_map_invid[invid][a->first] = mmg_alloc_ac_map_invid[invid][a->first] / (float) dsize; */
+/*             mmg_alloc_pd_x_map_invid[invid][a->first] = allocation_pd_bidx_map[a->first]; */
+/*             mmg_alloc_pd_y_map_invid[invid][a->first] = allocation_pd_bidy_map[a->first]; */
+/*             mmg_alloc_pd_i_map_invid[invid][a->first] = allocation_pd_phi_map[a->first]; */
+/*         } */
+/*     } */
+/*     std::cout << "phase 1.5, pchase"; */
+/*     for(auto a = aid_pchase_map.begin(); a != aid_pchase_map.end(); a++) { */
+/*         if(a->second == true) { */
+/*             AllocationToPchaseMap[aid_allocation_map[a->first]] = true; */
+/*         } */
+/*     } */
+/*     std::cout << "max ad among non iter = " << max_ad_among_noniter << "\n"; */
+/*     std::cout << "phase 2, decisions for iteronly\n"; */
+/*     std::copy(mmg_alloc_ad_map_iteronly.begin(), */ 
+/*             mmg_alloc_ad_map_iteronly.end(), */
+/*             back_inserter<std::vector<std::pair<void*, unsigned long long> > >(mmg_alloc_ad_vector_iteronly)); */
+/*     std::sort(mmg_alloc_ad_vector_iteronly.begin(), */
+/*             mmg_alloc_ad_vector_iteronly.end(), sortfunc); */
+/*     std::cout << "sorted ad iteronly \n"; */
+/*     for(auto a = mmg_alloc_ad_vector_iteronly.begin(); */
+/*             a != mmg_alloc_ad_vector_iteronly.end(); a++) { */
+/*         std::cout << a->first << "  " << a->second << "\n"; */
+/*         if(a->second > max_ad_among_noniter) { */
+/*             std::cout << "will be considered; "; */
+/*             auto span = mmg_alloc_span_map_iteronly[a->first]; */
+/*             /1* auto span = 1024*1024; *1/ */
+/*             auto dsize = allocation_desc(a->first).size; */
+/*             std::cout << "span = " << span << "  "; */
+/*             auto prefetch_size = span; */
+/*             if(prefetch_size < PENGUIN_MIN_PREFETCH) { */
+/*                 prefetch_size = PENGUIN_MIN_PREFETCH; */
+/*             } */
+/*             if(prefetch_size >= dsize) { */
+/*                 prefetch_size = dsize; */
+/*             } */
+/*             std::cout << "prefetch = " << prefetch_size << "\n"; */
+/*             /1* auto prefetch_iters_per_batch = dsize/prefetch_size; *1/ */
+/*             auto prefetch_iters_per_batch = prefetch_size/span; */
+/*             std::cout << "prefetch iters per batch= " << prefetch_iters_per_batch << "\n"; */
+/*             // insert into data structures for penguinSuperPrefetch to read from */ 
+/*             AllocationToPrefetchBoolMap[a->first] = true; */
+/*             AllocationToPrefetchSizeMap[a->first] = prefetch_size * 4; */
+/*             AllocationToPrefetchItersPerBatchMap[a->first] = prefetch_iters_per_batch; */
+/*             AllocationToDecisionMap[a->first] = PENGUIN_DEC_ITERATION_MIGRATION; */
+/*             available -= prefetch_size * 4; */
+/*             std::cout << "available = " << available << "\n"; */ 
+/*         } else { */
+/*             std::cout << "will NOT be considered\n"; */
+/*         } */
+/*     } // iteronly ends here */
+/*     std::cout << "phase 3, decisions on per invocation basis, excluding iteronly\n"; */
+/*     // first phcase */
+/*     // */
+/*     unsigned long long total_size = 0; */
+/*     for (auto a = allocation_size_map.begin(); a != allocation_size_map.end(); a++) { */
+/*         total_size += a->second; */
+/*     } */
+/*     for (auto a = AllocationToPchaseMap.begin(); a != AllocationToPchaseMap.end(); a++) { */
+/*         /1* auto invid = aid_invocation_id_map[a->first]; *1/ */
+/*         for(auto invid = InvocationIDs.begin(); invid != InvocationIDs.end(); invid++){ */
+/*             InvocationIDtoAllocationToDecisionMap[*invid][a->first] = PENGUIN_DEC_ACCESS_COUNTER; */
+/*             unsigned long long psize = allocation_desc(a->first).size; */
+/*             psize = (gpu_memory * psize) / total_size ; */
+/*             available -= psize; */
+/*         } */
+/*     } */
+/*     for (auto invid = mmg_alloc_ad_map_invid.begin(); */
+/*             invid != mmg_alloc_ad_map_invid.end(); invid++) { */
 /*         std::cout << "processing invid = " << invid->first  << "\n"; */
 /*         auto mmg_alloc_ad_map = invid->second; */
 /*         std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_invid; */
@@ -1533,7 +11668,7 @@ void perform_memory_management_iterative() {
 /*                 std::cout << "AD too low: ignoring or host pinning (default)\n"; */
 /*                 InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first] = PENGUIN_DEC_HOST_PIN; */
 /*             } */
-/*             auto dsize = allocation_size_map[alloc->first]; */
+/*             auto dsize = allocation_desc(alloc->first).size; */
 /*             if((alloc->second > 5) && (allocation_wss_map[alloc->first] < 0.5 * (dsize))) { */
 /*                 std::cout << "migrate on demand " << allocation_wss_map[alloc->first]  << " " << (0.5 * dsize) << "\n"; */
 /*                 InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first] = PENGUIN_DEC_MIGRATE_ON_DEMAND; */
@@ -1549,7 +11684,7 @@ void perform_memory_management_iterative() {
 /*             std::sort(mmg_alloc_ad_vector_invid.begin(), */
 /*                     mmg_alloc_ad_vector_invid.end(), sortfuncf); */
 /*             std::cout << "sorted \n"; */
-/*             unsigned locally_available = available; */
+/*             unsigned long long locally_available = available; */
 /*             for(auto a = mmg_alloc_ad_vector_invid.begin(); */
 /*                     a != mmg_alloc_ad_vector_invid.end(); a++) { */
 /*                 std::cout << a->first << " " << a->second << "\n"; */
@@ -1558,7 +11693,7 @@ void perform_memory_management_iterative() {
 /*                     continue; */
 /*                 } */
 /*                 if(locally_available) { */
-/*                     auto dsize = allocation_size_map[a->first]; */
+/*                     auto dsize = allocation_desc(a->first).size; */
 /*                     if(locally_available >= dsize) { */
 /*                         InvocationIDtoAllocationToDecisionMap[invid->first][a->first] = PENGUIN_DEC_GPU_PIN; */
 /*                         std::cout << "available before= " << locally_available << "\n"; */ 
@@ -1583,406 +11718,3059 @@ void perform_memory_management_iterative() {
 /*         } */
 /*     } */
 
-/*     std::cout << "print decisions\n"; */
-/*     for(auto alloc = allocation_size_map.begin(); alloc != allocation_size_map.end(); alloc++) { */
-/*         std::cout << alloc->first << "\n"; */
-/*         auto common_decision = PENGUIN_DEC_NONE; */
-/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
-/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
-/*             std::cout << invid->first << "  " << InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first] << "\n"; */
-/*         } */
-/*         std::cout << "\n"; */
-/*     } */
+/*     std::cout << "print decisions\n"; */
+/*     for(auto alloc = allocation_size_map.begin(); alloc != allocation_size_map.end(); alloc++) { */
+/*         std::cout << alloc->first << "\n"; */
+/*         auto common_decision = PENGUIN_DEC_NONE; */
+/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
+/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
+/*             std::cout << invid->first << "  " << InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first] << "\n"; */
+/*         } */
+/*         std::cout << "\n"; */
+/*     } */
+
+/*     // identify common decisions */
+/*     // by going over each allocation, and looking at each of the decisions (nc2) */
+/*     std::cout << "identify common decisions\n"; */
+/*     for(auto alloc = allocation_size_map.begin(); alloc != allocation_size_map.end(); alloc++) { */
+/*         std::cout << alloc->first << "\n"; */
+/*         auto common_decision = PENGUIN_DEC_NONE; */
+/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
+/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
+/*             if(AllocationToDecisionMap[alloc->first]  == PENGUIN_DEC_ACCESS_COUNTER ) { */
+/*                 AllocationToCommonDecisionMap[alloc->first] = PENGUIN_DEC_ACCESS_COUNTER; */
+/*             } */
+/*         } */
+/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
+/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
+/*             auto dec = InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first]; */
+/*             if(AllocationToDecisionMap[alloc->first]  == PENGUIN_DEC_ITERATION_MIGRATION ) { */
+/*                 if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) { */
+/*                     common_decision = PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN; */
+/*                     AllocationToPartialSizeMap[alloc->first] */
+/*                         = InvocationIDtoAllocationToPartialSize[invid->first][alloc->first] ; */
+/*                 } */
+/*             } */
+/*             if(dec == PENGUIN_DEC_HOST_PIN && common_decision == PENGUIN_DEC_NONE) { */
+/*                 common_decision = PENGUIN_DEC_HOST_PIN; */
+/*             } else if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN && common_decision == PENGUIN_DEC_NONE) { */
+/*                 common_decision = PENGUIN_DEC_GPU_HOST_PARTIAL_PIN; */
+/*             } else if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN && common_decision == PENGUIN_DEC_HOST_PIN) { */
+/*                 common_decision = PENGUIN_DEC_GPU_HOST_PARTIAL_PIN; */
+/*                 auto parsize = AllocationToPartialSizeMap[alloc->first]; */
+/*                 if(parsize < InvocationIDtoAllocationToPartialSize[invid->first][alloc->first]) { */
+/*                     AllocationToPartialSizeMap[alloc->first] */
+/*                         = InvocationIDtoAllocationToPartialSize[invid->first][alloc->first] ; */
+/*                 } */
+/*             } */
+/*         } */
+/*         std::cout << "common decision = " << common_decision << "\n"; */
+/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
+/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
+/*             if(common_decision == PENGUIN_DEC_NONE) { */
+/*                 if(AllocationToPrefetchBoolMap[alloc->first] == false) { */
+/*                     InvocationIDtoDecisionBoolMap[invid->first] = true; */
+/*                     std::cout << alloc->first << " "; */
+/*                     std::cout << "need to take per allocation, per invocation decision\n"; */
+/*                     AllocationStateMap[alloc->first] = PENGUIN_STATE_UNKNOWN; */
+/*                 } */
+/*             } */
+/*             else { */
+/*                 AllocationToCommonDecisionMap[alloc->first] = common_decision; */
+/*             } */
+/*         } */
+/*     } */
+
+/*     // if a data structure is being iteration prefetched and GPU host pinned */
+
+/*     // perform default decision */
+/*     // */
+/*     std::cout << "performing allocation common decision here\n"; */
+/*     // first handle pointer chase */
+/*     bool pchase_enabled = false; */
+/*     for(auto alloc = AllocationToCommonDecisionMap.begin(); */
+/*             alloc != AllocationToCommonDecisionMap.end(); alloc++) { */
+/*         if(alloc->second == PENGUIN_DEC_ACCESS_COUNTER) { */
+/*             pchase_enabled = true; */
+/*             penguinEnableAccessCounters(); */
+/*         } */
+/*     } */
+/*     for(auto alloc = AllocationToCommonDecisionMap.begin(); */
+/*             alloc != AllocationToCommonDecisionMap.end(); alloc++) { */
+/*         std::cout << alloc->first << " " << alloc->second << "\n"; */
+/*         if(alloc->second == PENGUIN_DEC_MIGRATE_ON_DEMAND) { */
+/*             continue; */
+/*         } */
+/*         if(alloc->second == PENGUIN_DEC_GPU_PIN) { */
+/*             auto dsize = allocation_desc(alloc->first).size; */
+/*             std::cout << "gpu pin " << dsize << "\n"; */
+/*             char* ptr = (char*) alloc->first; */
+/*             /1* cudaMemPrefetchAsync(ptr, dsize, 0, 0 ); *1/ */
+/*             /1* penguinSetPrioritizedLocation((char*) alloc->first, dsize, 0); *1/ */
+/*             continue; */
+/*         } */
+/*         if(alloc->second == PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN) { */
+/*             // asssuming partial size is larger than prefetch size */
+/*             // TODO: check for the above */
+/*             unsigned long long partial_size = AllocationToPartialSizeMap[alloc->first]; */
+/*             auto span = mmg_alloc_span_map_iteronly[alloc->first]; */
+/*             unsigned long long prefetch_iters_per_batch = partial_size/span; */
+/*             unsigned long long prefetch_size = AllocationToPrefetchSizeMap[alloc->first]; */
+/*             std::cout << "prefetching and partial pinning together\n"; */
+/*             std::cout << prefetch_size << " " << partial_size << "  " << span << " " << prefetch_iters_per_batch << "\n"; */
+/*             AllocationToPrefetchBoolMap[alloc->first] = true; */
+/*             AllocationToPrefetchSizeMap[alloc->first] = prefetch_size + partial_size; */
+/*             AllocationToPrefetchItersPerBatchMap[alloc->first] = prefetch_iters_per_batch; */
+/*             char* ptr = (char*) alloc->first; */
+/*             auto dsize = allocation_desc(alloc->first).size; */
+/*             cudaMemAdvise(ptr, dsize, cudaMemAdviseSetAccessedBy, 0); */
+/*         } */
+/*         if(alloc->second == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) { */
+/*             auto dsize = allocation_desc(alloc->first).size; */
+/*             auto partial_size = AllocationToPartialSizeMap[alloc->first]; */
+/*             std::cout << "partial pin " << partial_size << "\n"; */
+/*             if(AllocationToPrefetchBoolMap[alloc->first] == true) { */
+/*                 std::cout << "prefetching and partial pinning together\n"; */
+/*                 // asssuming partial size is larger than prefetch size */
+/*                 // TODO: check for the above */
+/*                 AllocationToPrefetchSizeMap[alloc->first] = partial_size; */
+/*                 auto span = mmg_alloc_span_map_iteronly[alloc->first]; */
+/*                 auto prefetch_iters_per_batch = partial_size/span; */
+/*                 AllocationToPrefetchItersPerBatchMap[alloc->first] = prefetch_iters_per_batch; */
+/*             } else { */
+/*                 char* ptr = (char*) alloc->first; */
+/*                 cudaMemPrefetchAsync(ptr, partial_size, 0, 0 ); */
+/*                 penguinSetPrioritizedLocation((char*) alloc->first, partial_size, 0); */
+/*                 cudaMemAdvise(ptr + partial_size, dsize - partial_size, cudaMemAdviseSetAccessedBy, 0); */
+/*             } */
+/*             continue; */
+/*         } */
+/*         if(alloc->second == PENGUIN_DEC_HOST_PIN) { */
+/*             auto dsize = allocation_desc(alloc->first).size; */
+/*             std::cout << "host pin " << dsize << "\n"; */
+/*             char* ptr = (char*) alloc->first; */
+/*             cudaMemAdvise(ptr , dsize, cudaMemAdviseSetAccessedBy, 0); */
+/*             continue; */
+/*         } */
+/*     } */
+/*     return; */
+/* } */
+
+// Take the memory size (can also get from this file, or by querying APIs),
+// and the invocation ID;
+// Then for each allocation used in the invocation, takes appropriate action
+// Placement solver. Every candidate allocation is an item whose weight is
+// the memory it needs on the GPU (its working set if temporal, else its size)
+// and whose benefit is the time its accesses save once resident, over the
+// host link of the device (see penguin_resident_benefit).
+// The solver fills the GPU budget and returns the resident bytes per item:
+// all of weight means GPU pin, less means partial pin, zero means host.
+typedef enum {
+    PENGUIN_SOLVER_FRACTIONAL, // by benefit per byte, partial pin of the first misfit
+    PENGUIN_SOLVER_EXACT,      // 0/1 DP in PENGUIN_PLACEMENT_UNITs, bounded in time
+    PENGUIN_SOLVER_MAX
+} penguin_solver_t;
+
+const char* penguin_solver_name[PENGUIN_SOLVER_MAX] = {"fractional", "exact"};
+
+typedef struct
+{
+    void* allocation;
+    unsigned long long weight;
+    double benefit;
+    bool divisible; // may be partially pinned
+    unsigned long long resident;
+} penguin_placement_item;
+
+penguin_solver_t placement_solver = PENGUIN_PLACEMENT_SOLVER;
+static int reported_placement_solver = -1;
+
+extern "C"
+void penguinSetPlacementSolver(unsigned solver) {
+    PENGUIN_LOCKED_ENTRY();
+    if(solver < PENGUIN_SOLVER_MAX) {
+        placement_solver = (penguin_solver_t) solver;
+    }
+}
+
+bool sortfunc_placement(const penguin_placement_item &a, const penguin_placement_item &b){
+    return a.benefit * b.weight > b.benefit * a.weight;
+}
+
+double placement_value(std::vector<penguin_placement_item>& items) {
+    double value = 0;
+    for(auto i = items.begin(); i != items.end(); i++) {
+        if(i->resident == i->weight) {
+            value += i->benefit;
+        } else if(i->resident) {
+            value += i->benefit * PENGUIN_PARTIAL_PIN_BENEFIT * i->resident / i->weight;
+        }
+    }
+    return value;
+}
+
+// Gives what is left of capacity to the densest divisible item not yet resident.
+void penguinFillPartialPin(std::vector<penguin_placement_item>& items, unsigned long long capacity) {
+    for(auto i = items.begin(); i != items.end() && capacity > 0; i++) {
+        if(i->resident == 0 && i->divisible) {
+            i->resident = capacity < i->weight ? capacity : i->weight;
+            capacity -= i->resident;
+        }
+    }
+}
+
+void penguinSolvePlacementFractional(std::vector<penguin_placement_item>& items, unsigned long long capacity) {
+    std::sort(items.begin(), items.end(), sortfunc_placement);
+    for(auto i = items.begin(); i != items.end(); i++) {
+        i->resident = 0;
+        if(i->weight <= capacity) {
+            i->resident = i->weight;
+            capacity -= i->weight;
+        } else if(i->divisible && capacity > 0) {
+            i->resident = capacity;
+            capacity = 0;
+        }
+    }
+}
+
+// Returns false, leaving items untouched, when the instance is over budget.
+bool penguinSolvePlacementExact(std::vector<penguin_placement_item>& items, unsigned long long capacity) {
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long units = capacity / PENGUIN_PLACEMENT_UNIT;
+    if((items.size() + 1) * (units + 1) > PENGUIN_EXACT_SOLVER_MAX_CELLS) {
+        return false;
+    }
+    std::sort(items.begin(), items.end(), sortfunc_placement);
+    std::vector<double> best(units + 1, 0);
+    std::vector<std::vector<bool>> taken(items.size(), std::vector<bool>(units + 1, false));
+    for(unsigned i = 0; i < items.size(); i++) {
+        unsigned long long w = (items[i].weight + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT;
+        for(unsigned long long c = units; c >= w && c > 0; c--) {
+            if(best[c - w] + items[i].benefit > best[c]) {
+                best[c] = best[c - w] + items[i].benefit;
+                taken[i][c] = true;
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if(elapsed > PENGUIN_EXACT_SOLVER_BUDGET_US) {
+            return false;
+        }
+    }
+    std::vector<penguin_placement_item> exact = items;
+    unsigned long long c = units;
+    unsigned long long left = capacity;
+    for(int i = exact.size() - 1; i >= 0; i--) {
+        exact[i].resident = 0;
+        if(taken[i][c]) {
+            exact[i].resident = exact[i].weight;
+            left -= exact[i].weight;
+            c -= (exact[i].weight + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT;
+        }
+    }
+    penguinFillPartialPin(exact, left);
+    // the fractional fill may still be the better of the two
+    penguinSolvePlacementFractional(items, capacity);
+    if(placement_value(exact) > placement_value(items)) {
+        items = exact;
+    }
+    return true;
+}
+
+penguin_solver_t penguinSolvePlacement(std::vector<penguin_placement_item>& items, unsigned long long capacity) {
+    penguin_solver_t used = placement_solver;
+    if(used != PENGUIN_SOLVER_EXACT || !penguinSolvePlacementExact(items, capacity)) {
+        if(used == PENGUIN_SOLVER_EXACT) {
+            printf("placement solver exact over budget with %zu items\n", items.size());
+        }
+        used = PENGUIN_SOLVER_FRACTIONAL;
+        penguinSolvePlacementFractional(items, capacity);
+    }
+    if(reported_placement_solver != used) {
+        printf("placement solver = %s\n", penguin_solver_name[used]);
+        reported_placement_solver = used;
+    }
+    return used;
+}
+
+// Belady schedule for multi-kernel programs. The allocations each
+// invocation touches are known from the reuse records of the first
+// invocation; before every launch the allocations whose next use is
+// furthest away are sent back to the host and the ones the upcoming
+// invocation needs are prefetched, both on the prefetch engine's streams.
+// Invocations are assumed to repeat in order, so the next use after the
+// last invocation wraps around to the first.
+std::map<unsigned, std::set<void*>> belady_invid_alloc_map;
+std::map<unsigned, std::map<void*, unsigned>> belady_next_use_map; // invid -> alloc -> next use
+unsigned belady_max_invid = 0;
+std::map<void*, unsigned> belady_resident_map; // alloc -> next use
+std::set<std::pair<unsigned, void*>> belady_resident_order;
+unsigned long long belady_resident_bytes = 0;
+
+void belady_set_resident(void* alloc, unsigned next_use) {
+    auto r = belady_resident_map.find(alloc);
+    if(r != belady_resident_map.end()) {
+        belady_resident_order.erase(std::make_pair(r->second, alloc));
+    } else {
+        belady_resident_bytes += allocation_desc(alloc).size;
+    }
+    belady_resident_map[alloc] = next_use;
+    belady_resident_order.insert(std::make_pair(next_use, alloc));
+}
+
+void belady_evict(void* alloc) {
+    auto r = belady_resident_map.find(alloc);
+    belady_resident_order.erase(std::make_pair(r->second, alloc));
+    belady_resident_map.erase(r);
+    belady_resident_bytes -= allocation_desc(alloc).size;
+}
+
+// Called before the launch of invocation invid.
+void penguinBeladySchedule(unsigned invid) {
+    auto needed = belady_invid_alloc_map.find(invid);
+    if(belady_max_invid < 2 || needed == belady_invid_alloc_map.end()) {
+        return;
+    }
+    if(penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    unsigned long long capacity = gpu_memory > pinned_memory ? gpu_memory - pinned_memory : 0;
+    unsigned long long incoming = 0;
+    for(auto a = needed->second.begin(); a != needed->second.end(); a++) {
+        if(belady_resident_map.find(*a) == belady_resident_map.end()) {
+            incoming += allocation_desc(*a).size;
+        }
+    }
+    // evict furthest next use first, never what this invocation needs
+    bool evicted = false;
+    auto victim = belady_resident_order.rbegin();
+    while(belady_resident_bytes + incoming > capacity && victim != belady_resident_order.rend()) {
+        void* alloc = victim->second;
+        victim++;
+        if(needed->second.find(alloc) != needed->second.end() ||
+                allocation_desc(alloc).state == PENGUIN_STATE_GPU_PINNED) {
+            continue;
+        }
+        if(!evicted) {
+            cudaEventRecord(prefetch_engine.compute_done, 0);
+            cudaStreamWaitEvent(prefetch_engine.d2h, prefetch_engine.compute_done, 0);
+            evicted = true;
+        }
+        /* std::cout << "belady evict " << alloc << " next use " << belady_resident_map[alloc] << std::endl; */
+        penguin_mem_prefetch((char*) alloc, allocation_desc(alloc).size, -1, prefetch_engine.d2h);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) alloc, allocation_desc(alloc).size);
+        belady_evict(alloc);
+        victim = belady_resident_order.rbegin();
+    }
+    if(evicted) {
+        cudaEventRecord(prefetch_engine.evict_done, prefetch_engine.d2h);
+        cudaStreamWaitEvent(prefetch_engine.h2d, prefetch_engine.evict_done, 0);
+    }
+    {
+        penguin_prefetch_coalesce_scope coalesce(true);
+        for(auto a = needed->second.begin(); a != needed->second.end(); a++) {
+            if(belady_resident_map.find(*a) == belady_resident_map.end()) {
+                /* std::cout << "belady prefetch " << *a << std::endl; */
+                penguin_mem_prefetch((char*) *a, allocation_desc(*a).size, 0, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) *a, allocation_desc(*a).size);
+            }
+            belady_set_resident(*a, belady_next_use_map[invid][*a]);
+        }
+    }
+    cudaEventRecord(prefetch_engine.batch_ready, prefetch_engine.h2d);
+    cudaStreamWaitEvent(0, prefetch_engine.batch_ready, 0);
+}
+
+// Advances the driver's epoch to epoch and sets the epoch at which each of
+// the count ranges is needed next, for its eviction to pick the chunks
+// needed furthest away (UVM_SET_NEXT_USE)
+extern "C"
+penguin_error_t penguinSetNextUse(penguin_next_use_entry *entries, unsigned count,
+        unsigned long long epoch) {
+    PENGUIN_ENTRY();
+
+    penguin_next_use_ioctl_params request;
+    int status;
+
+    request.entries = entries;
+    request.epoch = epoch;
+    request.count = count;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_NEXT_USE_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// The Belady next uses go to the driver as well, so that what the driver
+// evicts on its own, under faults, follows them too. The epoch is the launch
+// count; before every launch the allocations of the upcoming invocation get
+// the epoch of their next use, the others keep theirs. PENGUIN_NEXT_USE=0
+// leaves the driver to LRU but still advances the epoch for the leases.
+int next_use_enabled = -1;
+unsigned long long next_use_epoch = 0;
+bool next_use_sent = false;
+bool next_use_failed = false;
+
+void penguin_next_use_hints(unsigned invid) {
+    if(next_use_enabled < 0) {
+        const char* env = getenv("PENGUIN_NEXT_USE");
+        next_use_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    next_use_epoch++;
+    if(next_use_failed) {
+        return;
+    }
+    std::vector<penguin_next_use_entry> entries;
+    auto needed = belady_next_use_map.find(invid);
+    if(next_use_enabled && belady_max_invid >= 2 && needed != belady_next_use_map.end()) {
+        for(auto a = needed->second.begin(); a != needed->second.end(); a++) {
+            if(a->second > invid) {
+                entries.push_back(penguin_next_use_entry{a->first, allocation_desc(a->first).size,
+                    next_use_epoch + a->second - invid});
+            }
+        }
+    }
+    // the epoch alone keeps the hints sent so far aging, runs out the leases
+    // and lets the driver demote GPU pins the access counters see no use of
+    if(entries.empty() && !next_use_sent && !pin_lease_sent && !(ac_enabled && pinned_memory > 0)) {
+        return;
+    }
+    for(size_t first = 0; first == 0 || first < entries.size(); first += PENGUIN_NEXT_USE_MAX_ENTRIES) {
+        unsigned count = (unsigned) std::min(entries.size() - first, (size_t) PENGUIN_NEXT_USE_MAX_ENTRIES);
+        if(penguinSetNextUse(count > 0 ? &entries[first] : NULL, count, next_use_epoch) != PENGUIN_OK) {
+            next_use_failed = true;
+            return;
+        }
+    }
+    next_use_sent = true;
+}
+
+// Tells the driver how the faults of the upcoming kernels are best replayed
+// (UVM_SET_FAULT_REPLAY_HINT)
+extern "C"
+penguin_error_t penguinSetFaultReplayHint(penguin_replay_hint_t hint) {
+    penguin_fault_replay_hint_ioctl_params request;
+    int status;
+
+    request.hint = hint;
+
+    if (penguin_uvm_fd() < 0)
+    {
+        fprintf(stderr, "Cannot open %s\n", PSF_DIR);
+        return PENGUIN_ERR_PATH;
+    }
+    if ((status = penguin_ioctl(PENGUIN_FAULT_REPLAY_HINT_IOCTL_NUM, &request)) != 0)
+    {
+        fprintf(stderr, "error: %d\n", status);
+        return PENGUIN_ERR_IOCTL;
+    }
+    return PENGUIN_OK;
+}
+
+// The access pattern of the invocation for the driver's replay of its faults:
+// irregular if it chases pointers, streaming if CudaAnalysis found a loop
+// stride for every allocation it accesses, none otherwise, leaving it to what
+// the driver measures. PENGUIN_REPLAY_HINT=0 sends none.
+int replay_hint_enabled = -1;
+penguin_replay_hint_t replay_hint_sent = PENGUIN_REPLAY_HINT_NONE;
+bool replay_hint_failed = false;
+
+void penguin_fault_replay_hint(unsigned invid) {
+    if(replay_hint_enabled < 0) {
+        const char* env = getenv("PENGUIN_REPLAY_HINT");
+        replay_hint_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    if(!replay_hint_enabled || replay_hint_failed) {
+        return;
+    }
+    penguin_replay_hint_t hint = PENGUIN_REPLAY_HINT_NONE;
+    bool strided = false;
+    bool unstrided = false;
+    for(auto a = aid_invocation_id_map.begin(); a != aid_invocation_id_map.end(); a++) {
+        if(a->second != invid) {
+            continue;
+        }
+        if(aid_pchase_map.find(a->first) != aid_pchase_map.end()) {
+            hint = PENGUIN_REPLAY_HINT_IRREGULAR;
+            break;
+        }
+        auto alloc = aid_allocation_map.find(a->first);
+        if(alloc == aid_allocation_map.end() ||
+                lookup_allocation_id(alloc->second) == PENGUIN_INVALID_ALLOC_ID) {
+            continue;
+        }
+        if(allocation_desc(alloc->second).pd_phi == 0) {
+            unstrided = true;
+        } else {
+            strided = true;
+        }
+    }
+    if(hint == PENGUIN_REPLAY_HINT_NONE && strided && !unstrided) {
+        hint = PENGUIN_REPLAY_HINT_STREAMING;
+    }
+    if(hint == replay_hint_sent) {
+        return;
+    }
+    if(penguinSetFaultReplayHint(hint) != PENGUIN_OK) {
+        replay_hint_failed = true;
+        return;
+    }
+    replay_hint_sent = hint;
+}
+
+#if PENGUIN_PROGRESS
+// Blocks started on the device, incremented by the first thread of each
+// block of every kernel (penguin-progress-hints)
+__device__ unsigned long long penguin_progress_blocks;
+#endif
+
+// Wave prefetches of a running launch, issued by the progress thread as its
+// blocks get to them
+typedef struct
+{
+    unsigned long long first_block;
+    unsigned long long blocks;
+    unsigned long long resident_blocks;
+    unsigned long long next_wave; // first wave not prefetched yet
+    unsigned long long order_wave; // wave the launch starts at
+    int device;
+    std::vector<penguin_wave_prefetch> ranges;
+} penguin_progress_job;
+
+typedef struct
+{
+    bool started;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t submitted;
+    std::vector<penguin_progress_job> jobs; // in launch order
+} penguin_progress_t;
+
+penguin_progress_t progress = {false, {}, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, {}};
+
+// Blocks started so far, as the device counted them; false if the counter
+// couldn't be read
+bool penguin_progress_read(cudaStream_t stream, unsigned long long& started) {
+#if PENGUIN_PROGRESS
+    return cudaMemcpyFromSymbolAsync(&started, penguin_progress_blocks, sizeof(started), 0,
+            cudaMemcpyDeviceToHost, stream) == cudaSuccess && cudaStreamSynchronize(stream) == cudaSuccess;
+#else
+    return false;
+#endif
+}
+
+// Polls the block counter while there are launches to follow, and
+// prefetches wave w + PENGUIN_WAVE_LOOKAHEAD on the prefetch engine's H2D
+// stream once wave w has started. A job is done when its last block started.
+void* penguin_progress_poller(void* argp) {
+    cudaStream_t poll;
+    if(cudaStreamCreateWithFlags(&poll, cudaStreamNonBlocking) != cudaSuccess) {
+        printf("unable to create progress stream\n");
+        return NULL;
+    }
+    int device = -1;
+    while(true) {
+        pthread_mutex_lock(&progress.lock);
+        while(progress.jobs.empty()) {
+            pthread_cond_wait(&progress.submitted, &progress.lock);
+        }
+        penguin_progress_job job = progress.jobs.front();
+        pthread_mutex_unlock(&progress.lock);
+        if(job.device != device) {
+            device = job.device;
+            cudaSetDevice(device);
+        }
+        unsigned long long counted = 0;
+        if(!penguin_progress_read(poll, counted)) {
+            counted = job.first_block + job.blocks;
+        }
+        unsigned long long started = counted > job.first_block ? counted - job.first_block : 0;
+        unsigned long long waves = (job.blocks + job.resident_blocks - 1) / job.resident_blocks;
+        unsigned long long wave = started / job.resident_blocks;
+        for(; job.next_wave <= wave + PENGUIN_WAVE_LOOKAHEAD && job.next_wave < waves; job.next_wave++) {
+            for(auto r = job.ranges.begin(); r != job.ranges.end(); r++) {
+                unsigned long long offset = r->lo + (job.next_wave + job.order_wave) % waves * r->per_wave;
+                if(offset >= r->hi) {
+                    continue;
+                }
+                unsigned long long length = std::min(r->per_wave, r->hi - offset);
+                /* std::cout << "progress prefetch " << r->allocation << " wave " << job.next_wave << std::endl; */
+                penguin_mem_prefetch((char*) r->allocation + offset, length, device, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) r->allocation + offset, length);
+            }
+        }
+        pthread_mutex_lock(&progress.lock);
+        if(started >= job.blocks) {
+            progress.jobs.erase(progress.jobs.begin());
+        } else {
+            progress.jobs.front().next_wave = job.next_wave;
+        }
+        pthread_mutex_unlock(&progress.lock);
+        if(started < job.blocks) {
+            usleep(PENGUIN_PROGRESS_POLL_US);
+        }
+    }
+    return NULL;
+}
+
+// Hands the waves of the launch being planned past the ones prefetched
+// before it to the progress thread
+void penguin_progress_submit(std::vector<penguin_wave_prefetch>& ranges) {
+    if(!PENGUIN_PROGRESS || ranges.empty() || penguin_launch_waves() <= 1 + PENGUIN_WAVE_LOOKAHEAD ||
+            penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    penguin_progress_job job;
+    job.first_block = launch_shape.first_block;
+    job.blocks = launch_shape.blocks;
+    job.resident_blocks = launch_shape.resident_blocks;
+    job.next_wave = launch_shape.order_offset != 0 ? launch_shape.order_next_wave : 1 + PENGUIN_WAVE_LOOKAHEAD;
+    job.order_wave = launch_shape.order_wave;
+    job.device = penguin_launch_device();
+    job.ranges = ranges;
+    pthread_mutex_lock(&progress.lock);
+    if(!progress.started) {
+        progress.started = pthread_create(&progress.thread, NULL, penguin_progress_poller, NULL) == 0;
+        if(progress.started) {
+            pthread_detach(progress.thread);
+        }
+    }
+    if(progress.started) {
+        progress.jobs.push_back(job);
+        pthread_cond_signal(&progress.submitted);
+    }
+    pthread_mutex_unlock(&progress.lock);
+}
+
+// Residency-ordered grids. Blocks are scheduled in about linear blockIdx
+// order, so a launch sweeps what it streams from the start whatever of it is
+// resident. A launch of several waves of a kernel that takes the sub-grid
+// parameter, whose blocks CudaAnalysis found independent, starts instead at
+// the longest run of waves whose streamed parts are all resident on the GPU,
+// if that is not the first: the parameter's offset rotates blockIdx around
+// the grid (GridSplit.h), in whole rows for a grid of several, the resident
+// waves run first, and the waves after them are prefetched on the prefetch
+// engine's H2D stream while they do. Such a launch goes as one grid.
+// PENGUIN_BLOCK_ORDER=0 keeps blockIdx order.
+int block_order_enabled = -1;
+
+bool penguin_block_order_enabled() {
+    if(block_order_enabled < 0) {
+        const char* env = getenv("PENGUIN_BLOCK_ORDER");
+        block_order_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return block_order_enabled;
+}
+
+// Kernels penguinLaunchKernelSplit launched, which take the parameter
+std::set<const void*> block_order_kernels;
+
+// Sets resident[w] if every range's part of wave w of the launch being
+// planned is resident on the GPU, in PENGUIN_PLACEMENT_UNIT pieces; false if
+// the driver can't tell
+bool penguin_waves_resident(const std::vector<penguin_wave_prefetch>& ranges, unsigned long long waves,
+        std::vector<char>& resident) {
+    if(!penguin_residency_enabled() || ranges.size() > PENGUIN_RESIDENCY_MAX_RANGES) {
+        return false;
+    }
+    std::vector<penguin_residency_range> query(ranges.size());
+    std::vector<unsigned long long> words(ranges.size());
+    std::vector<unsigned long long> bitmaps;
+    std::vector<size_t> first(ranges.size());
+    for(size_t i = 0; i < ranges.size(); i++) {
+        query[i].base = (char*) ranges[i].allocation + ranges[i].lo;
+        query[i].length = ranges[i].hi - ranges[i].lo;
+        words[i] = ((query[i].length + PENGUIN_PLACEMENT_UNIT - 1) / PENGUIN_PLACEMENT_UNIT + 63) / 64;
+        first[i] = bitmaps.size();
+        // the CPU's row, then the GPU's
+        bitmaps.resize(bitmaps.size() + 2 * words[i], 0);
+    }
+    for(size_t i = 0; i < ranges.size(); i++) {
+        query[i].bitmap = bitmaps.data() + first[i];
+    }
+    if(penguinGetResidency(query.data(), query.size(), PENGUIN_PLACEMENT_UNIT, 2) != PENGUIN_OK) {
+        return false;
+    }
+    resident.assign(waves, 1);
+    for(size_t i = 0; i < ranges.size(); i++) {
+        const unsigned long long* gpu = query[i].bitmap + words[i];
+        for(unsigned long long w = 0; w < waves; w++) {
+            unsigned long long lo = w * ranges[i].per_wave;
+            unsigned long long hi = std::min(lo + ranges[i].per_wave, query[i].length);
+            for(unsigned long long p = lo / PENGUIN_PLACEMENT_UNIT; lo < hi && resident[w] &&
+                    p <= (hi - 1) / PENGUIN_PLACEMENT_UNIT; p++) {
+                resident[w] = (gpu[p / 64] >> (p % 64)) & 1;
+            }
+        }
+    }
+    return true;
+}
+
+// Rotates the launch being planned to start at its resident waves, see
+// above; false if it keeps blockIdx order
+bool penguin_block_order(const std::vector<penguin_wave_prefetch>& ranges) {
+    unsigned long long waves = penguin_launch_waves();
+    unsigned long long x = std::max(launch_shape.grid[0], 1U);
+    bool rows = launch_shape.grid[1] > 1;
+    if(!penguin_block_order_enabled() || penguin_policy() != PENGUIN_POLICY_SUV || ranges.empty() ||
+            waves <= 1 + PENGUIN_WAVE_LOOKAHEAD || launch_shape.grid[2] > 1 ||
+            block_order_kernels.find(launch_shape.func) == block_order_kernels.end()) {
+        return false;
+    }
+    std::vector<char> resident;
+    if(!penguin_waves_resident(ranges, waves, resident)) {
+        return false;
+    }
+    unsigned long long start = 0, run = 0;
+    for(unsigned long long w = 0; w < waves;) {
+        unsigned long long end = w;
+        while(end < waves && resident[end]) {
+            end++;
+        }
+        if(end - w > run) {
+            start = w;
+            run = end - w;
+        }
+        w = end + 1;
+    }
+    unsigned long long offset = start * launch_shape.resident_blocks;
+    if(rows) {
+        offset /= x;
+    }
+    if(run == 0 || offset == 0 || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return false;
+    }
+    launch_shape.order_offset = offset;
+    launch_shape.order_wave = (rows ? offset * x : offset) / launch_shape.resident_blocks;
+    launch_shape.order_next_wave = std::min(waves, run + 1 + PENGUIN_WAVE_LOOKAHEAD);
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "block order from wave %llu of %llu", launch_shape.order_wave,
+            waves);
+    // the waves after the resident ones move while those run
+    int device = penguin_launch_device();
+    for(unsigned long long p = run; p < launch_shape.order_next_wave; p++) {
+        unsigned long long w = (p + launch_shape.order_wave) % waves;
+        for(auto r = ranges.begin(); r != ranges.end(); r++) {
+            unsigned long long at = r->lo + w * r->per_wave;
+            if(at >= r->hi) {
+                continue;
+            }
+            unsigned long long length = std::min(r->per_wave, r->hi - at);
+            penguin_mem_prefetch((char*) r->allocation + at, length, device, prefetch_engine.h2d);
+            penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) r->allocation + at, length);
+        }
+    }
+    return true;
+}
+
+// Temporal allocations of a launch of several waves fault in as the blocks
+// get to them; bring in what its first waves touch before it starts, and
+// the rest as it runs where the device counts its blocks
+void penguin_prefetch_waves() {
+    std::vector<penguin_wave_prefetch> ranges;
+    for(auto w = launch_wave_prefetches.begin(); w != launch_wave_prefetches.end(); w++) {
+        auto& desc = allocation_desc(w->allocation);
+        if(desc.decision != PENGUIN_DEC_MIGRATE_ON_DEMAND || desc.state == PENGUIN_STATE_GPU_PINNED ||
+                w->lo >= desc.size) {
+            continue;
+        }
+        ranges.push_back(*w);
+    }
+    // a rotated launch starts on what is resident
+    if(!penguin_block_order(ranges)) {
+        for(auto w = ranges.begin(); w != ranges.end(); w++) {
+            auto& desc = allocation_desc(w->allocation);
+            /* std::cout << "wave prefetch " << w->allocation << " " << w->length << std::endl; */
+            penguin_prefetch_pinned((char*) w->allocation + w->lo, std::min(w->length, desc.size - w->lo),
+                    desc.device);
+        }
+    }
+    penguin_progress_submit(ranges);
+}
+
+// Brings in the inputs of the next launch, in the memory the plan of this
+// one leaves free, on the prefetch engine's H2D stream so that they move
+// while this launch runs
+void penguin_prefetch_consumers() {
+    unsigned long long room = available;
+    if(launch_next_inputs.empty() || room == 0 || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return;
+    }
+    int device = penguin_launch_device();
+    penguin_prefetch_coalesce_scope coalesce(true);
+    for(auto a = launch_next_inputs.begin(); a != launch_next_inputs.end() && room > 0; a++) {
+        auto id = lookup_allocation_id(*a);
+        if(id == PENGUIN_INVALID_ALLOC_ID) {
+            continue;
+        }
+        auto& desc = allocation_table[id];
+        if(desc.size == 0 || desc.state == PENGUIN_STATE_GPU_PINNED ||
+                (desc.decision != PENGUIN_DEC_NONE && desc.decision != PENGUIN_DEC_MIGRATE_ON_DEMAND)) {
+            continue;
+        }
+        unsigned long long length = std::min(desc.size, room);
+        /* std::cout << "consumer prefetch " << *a << " " << length << std::endl; */
+        penguin_mem_prefetch(*a, length, device, prefetch_engine.h2d);
+        penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) *a, length);
+        room -= length;
+    }
+}
+
+// Grid splitting (-penguin-grid-split). The kernels whose thread blocks are
+// independent take a hidden last parameter, where their sub-grid sits in the
+// whole grid (GridSplit.h), and every launch of them comes here. A launch the
+// planner streams in waves is issued as chunks of as many waves as half the
+// memory the plan leaves free holds, along x, or along y in whole rows of
+// blocks: the next chunk's part of each streamed allocation is prefetched on
+// the prefetch engine's H2D stream while a chunk runs, the next chunk waits
+// for it, and what a chunk is done with is evicted on the D2H stream. Other
+// launches go as one grid. PENGUIN_GRID_SPLIT=0 never splits.
+int grid_split_enabled = -1;
+
+bool penguin_grid_split_enabled() {
+    if(grid_split_enabled < 0) {
+        const char* env = getenv("PENGUIN_GRID_SPLIT");
+        grid_split_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return grid_split_enabled;
+}
+
+// [offset, offset + length) of range r that waves [first, last) touch
+bool penguin_grid_chunk_range(const penguin_wave_prefetch& r, unsigned long long first,
+        unsigned long long last, unsigned long long& offset, unsigned long long& length) {
+    offset = r.lo + first * r.per_wave;
+    if(offset >= r.hi || last <= first) {
+        return false;
+    }
+    length = std::min((last - first) * r.per_wave, r.hi - offset);
+    return true;
+}
+
+extern "C"
+cudaError_t penguinLaunchKernelSplit(const void* func, dim3 grid, dim3 block, void** args,
+        size_t shmem, cudaStream_t stream, int nargs) {
+    PENGUIN_LOCKED_ENTRY();
+    std::vector<void*> chunk_args(args, args + nargs);
+    unsigned long long split = (unsigned long long) grid.x << 32;
+    chunk_args.push_back(&split);
+    bool along_y = grid.y > 1;
+    unsigned long long blocks = (unsigned long long) grid.x * grid.y * grid.z;
+    block_order_kernels.insert(func);
+    // the plan rotated it, see penguin_block_order
+    if(launch_shape.order_offset != 0 && launch_shape.func == func && launch_shape.blocks == blocks) {
+        split = launch_shape.order_offset | ((unsigned long long) (along_y ? grid.y : grid.x) << 32) |
+            (along_y ? 1ULL << 63 : 0);
+        launch_shape.order_offset = 0;
+        return cudaLaunchKernel(func, grid, block, chunk_args.data(), shmem, stream);
+    }
+    // the streamed allocations, as penguin_prefetch_waves found them
+    std::vector<penguin_wave_prefetch> ranges;
+    unsigned long long per_wave = 0;
+    if(penguin_grid_split_enabled() && penguin_policy() == PENGUIN_POLICY_SUV && grid.z == 1 &&
+            launch_shape.blocks == blocks && penguin_launch_waves() > PENGUIN_GRID_SPLIT_MIN_WAVES) {
+        for(auto w = launch_wave_prefetches.begin(); w != launch_wave_prefetches.end(); w++) {
+            auto& desc = allocation_desc(w->allocation);
+            if(desc.decision == PENGUIN_DEC_MIGRATE_ON_DEMAND && desc.state != PENGUIN_STATE_GPU_PINNED &&
+                    w->lo < desc.size) {
+                ranges.push_back(*w);
+                per_wave += w->per_wave;
+            }
+        }
+    }
+    unsigned long long waves = penguin_launch_waves();
+    unsigned long long chunk_waves = per_wave > 0 ? available / 2 / per_wave : waves;
+    chunk_waves = std::max(chunk_waves, (unsigned long long) PENGUIN_GRID_SPLIT_MIN_WAVES);
+    // blocks of the split dimension a chunk runs
+    unsigned long long extent = along_y ? grid.y : grid.x;
+    unsigned long long step = chunk_waves * launch_shape.resident_blocks;
+    if(along_y) {
+        step /= grid.x;
+    }
+    if(ranges.empty() || step == 0 || step >= extent || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        return cudaLaunchKernel(func, grid, block, chunk_args.data(), shmem, stream);
+    }
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %llu", __func__, (extent + step - 1) / step);
+    int device = penguin_launch_device();
+    unsigned long long chunk_blocks = along_y ? step * grid.x : step;
+    cudaError_t status = cudaSuccess;
+    for(unsigned long long offset = 0; offset < extent && status == cudaSuccess; offset += step) {
+        unsigned long long count = std::min(step, extent - offset);
+        unsigned long long chunk = offset / step;
+        unsigned long long first = chunk * chunk_blocks / launch_shape.resident_blocks;
+        unsigned long long last = std::min(waves, (chunk + 1) * chunk_blocks / launch_shape.resident_blocks);
+        // the next chunk's part, which moves while this chunk runs
+        unsigned long long next_last = std::min(waves, (chunk + 2) * chunk_blocks / launch_shape.resident_blocks);
+        for(auto r = ranges.begin(); r != ranges.end(); r++) {
+            unsigned long long at, length;
+            // the plan prefetched the first waves of the first chunk
+            if(chunk == 0 && penguin_grid_chunk_range(*r, 1 + PENGUIN_WAVE_LOOKAHEAD, last, at, length)) {
+                penguin_mem_prefetch((char*) r->allocation + at, length, device, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) r->allocation + at, length);
+            }
+            if(penguin_grid_chunk_range(*r, last, next_last, at, length)) {
+                penguin_mem_prefetch((char*) r->allocation + at, length, device, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) r->allocation + at, length);
+            }
+        }
+        dim3 sub = grid;
+        if(along_y) {
+            sub.y = count;
+        } else {
+            sub.x = count;
+        }
+        split = offset | (extent << 32) | (along_y ? 1ULL << 63 : 0);
+        status = cudaLaunchKernel(func, sub, block, chunk_args.data(), shmem, stream);
+        cudaEvent_t event;
+        if(status != cudaSuccess || cudaEventCreateWithFlags(&event, cudaEventDisableTiming) != cudaSuccess) {
+            continue;
+        }
+        // what the chunk covered, but the wave next to the next chunk, leaves
+        // once the chunk is done
+        cudaEventRecord(event, stream);
+        cudaStreamWaitEvent(prefetch_engine.d2h, event, 0);
+        for(auto r = ranges.begin(); r != ranges.end(); r++) {
+            unsigned long long at, length;
+            if(offset + count < extent && penguin_grid_chunk_range(*r, first, last - 1, at, length)) {
+                penguin_mem_prefetch((char*) r->allocation + at, length, cudaCpuDeviceId, prefetch_engine.d2h);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) r->allocation + at, length);
+            }
+        }
+        // the next chunk starts when its part is in
+        cudaEventRecord(event, prefetch_engine.h2d);
+        cudaStreamWaitEvent(stream, event, 0);
+        cudaEventDestroy(event);
+    }
+    return status;
+}
+
+// Kernel fusion (-penguin-kernel-fusion). Two adjacent launches of a pair of
+// element-wise kernels (KernelFusion.h) come here at the second one, with the
+// fused kernel and its layout: the parameters of each kernel, the arguments
+// each loads and stores, as masks, and whether they take the sub-grid
+// parameter. The pair runs as the fused kernel when the first stores an
+// allocation the second loads, the launches have the same one-dimensional
+// grid and stream and no dynamic shared memory, and any two arguments of
+// which one is stored either are the same pointer or point into different
+// allocations; the array then stays on the GPU from the producer's threads
+// to the consumer's. Other pairs launch one after the other.
+// PENGUIN_KERNEL_FUSION=0 never fuses.
+int kernel_fusion_enabled = -1;
+
+bool penguin_kernel_fusion_enabled() {
+    if(kernel_fusion_enabled < 0) {
+        const char* env = getenv("PENGUIN_KERNEL_FUSION");
+        kernel_fusion_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return kernel_fusion_enabled;
+}
+
+// Base of the allocation holding p, 0 for memory the runtime doesn't know
+unsigned long long penguin_fusion_allocation(void* p) {
+    unsigned long long addr = (unsigned long long) p;
+    auto a = allocation_interval_map.upper_bound(addr);
+    if(a == allocation_interval_map.begin()) {
+        return 0;
+    }
+    a--;
+    return addr < a->first + allocation_table[a->second].size ? a->first : 0;
+}
+
+bool penguin_same_launch_shape(dim3 grid, dim3 block, dim3 other_grid, dim3 other_block) {
+    return grid.x == other_grid.x && grid.y == other_grid.y && grid.z == other_grid.z &&
+        block.x == other_block.x && block.y == other_block.y && block.z == other_block.z;
+}
+
+// Whether the element-wise kernels of two launches see each argument of the
+// other that either stores as the same array or as one they don't share,
+// and whether the first stores an array the second loads
+bool penguin_fusable(void** first_args, unsigned long long first_loaded, unsigned long long first_stored,
+        void** args, unsigned long long loaded, unsigned long long stored, bool& feeds) {
+    feeds = false;
+    for(unsigned i = 0; i < PENGUIN_MAX_FUSION_ARGS; i++) {
+        if(!((first_loaded | first_stored) >> i & 1)) {
+            continue;
+        }
+        void* p = *(void**) first_args[i];
+        for(unsigned j = 0; j < PENGUIN_MAX_FUSION_ARGS; j++) {
+            if(!((loaded | stored) >> j & 1)) {
+                continue;
+            }
+            void* q = *(void**) args[j];
+            // a field split layout, which only the kernels themselves take
+            if(((unsigned long long) p | (unsigned long long) q) >> 63) {
+                return false;
+            }
+            feeds |= p == q && (first_stored >> i & 1) && (loaded >> j & 1);
+            if(p == q || !((first_stored >> i | stored >> j) & 1)) {
+                continue;
+            }
+            unsigned long long a = penguin_fusion_allocation(p);
+            unsigned long long b = penguin_fusion_allocation(q);
+            if(a == 0 || b == 0 || a == b) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+cudaError_t penguin_launch_part(const void* func, dim3 grid, dim3 block, void** args, size_t shmem,
+        cudaStream_t stream, int nargs, bool split) {
+    if(split) {
+        return penguinLaunchKernelSplit(func, grid, block, args, shmem, stream, nargs);
+    }
+    return cudaLaunchKernel(func, grid, block, args, shmem, stream);
+}
+
+extern "C"
+cudaError_t penguinLaunchKernelFused(const void* first, dim3 first_grid, dim3 first_block, void** first_args,
+        size_t first_shmem, cudaStream_t first_stream, const void* func, dim3 grid, dim3 block, void** args,
+        size_t shmem, cudaStream_t stream, const void* fused, const unsigned long long* layout) {
+    PENGUIN_LOCKED_ENTRY();
+    int first_nargs = layout[0];
+    int nargs = layout[1];
+    bool split = layout[6];
+    bool feeds = false;
+    if(penguin_kernel_fusion_enabled() && penguin_policy() == PENGUIN_POLICY_SUV &&
+            penguin_same_launch_shape(grid, block, first_grid, first_block) &&
+            grid.y == 1 && grid.z == 1 && block.y == 1 && block.z == 1 &&
+            first_shmem == 0 && shmem == 0 && first_stream == stream &&
+            penguin_fusable(first_args, layout[2], layout[3], args, layout[4], layout[5], feeds) && feeds) {
+        std::vector<void*> fused_args(first_args, first_args + first_nargs);
+        fused_args.insert(fused_args.end(), args, args + nargs);
+        PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "fused %p %p", first, func);
+        return penguin_launch_part(fused, grid, block, fused_args.data(), 0, stream,
+                first_nargs + nargs, split);
+    }
+    cudaError_t status = penguin_launch_part(first, first_grid, first_block, first_args, first_shmem,
+            first_stream, first_nargs, split);
+    if(status != cudaSuccess) {
+        return status;
+    }
+    return penguin_launch_part(func, grid, block, args, shmem, stream, nargs, split);
+}
+
+// Loop tiling (-penguin-loop-tiling). The only launch of a host loop that
+// does nothing else, of an element-wise kernel taking the sub-grid parameter,
+// comes here with its layout: the parameters, the element bytes, the
+// arguments loaded and stored, then the bytes of each parameter. Launches of
+// the same kernel with the same grid, stream and argument values are held
+// back, and run at penguinLaunchTiledFlush, which the loop's exits call, or
+// at a launch that differs: as many blocks at a time as half the memory the
+// plan leaves free holds of their arrays, every iteration held back on one
+// tile before the next. The next tile is prefetched on the prefetch engine's
+// H2D stream while one runs and a finished one evicted on the D2H stream, so
+// a tile crosses PCIe once for all the iterations rather than once for each.
+// Errors of the held back launches show at the next synchronization.
+// PENGUIN_LOOP_TILING=0 launches every iteration as it comes.
+int loop_tiling_enabled = -1;
+
+bool penguin_loop_tiling_enabled() {
+    if(loop_tiling_enabled < 0) {
+        const char* env = getenv("PENGUIN_LOOP_TILING");
+        loop_tiling_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return loop_tiling_enabled;
+}
+
+typedef struct {
+    const void* func;
+    dim3 grid;
+    dim3 block;
+    size_t shmem;
+    cudaStream_t stream;
+    const unsigned long long* layout;
+    // the argument values back to back, 0 iterations when nothing is held
+    std::vector<char> values;
+    unsigned long long iterations;
+} penguin_tiled_launch;
+
+penguin_tiled_launch tiled_launch;
+
+void penguin_tiled_values(void** args, const unsigned long long* layout, std::vector<char>& values) {
+    for(unsigned long long i = 0; i < layout[0]; i++) {
+        const char* value = (const char*) args[i];
+        values.insert(values.end(), value, value + layout[4 + i]);
+    }
+}
+
+// [offset, offset + length) of array, from its pointer, that blocks [first,
+// first + count) of the grid touch
+bool penguin_tile_range(const std::pair<char*, unsigned long long>& array, unsigned long long per_block,
+        unsigned long long first, unsigned long long count, unsigned long long& offset,
+        unsigned long long& length) {
+    offset = first * per_block;
+    if(count == 0 || offset >= array.second) {
+        return false;
+    }
+    length = std::min(count * per_block, array.second - offset);
+    return true;
+}
+
+extern "C"
+void penguinLaunchTiledFlush() {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_tiled_launch& t = tiled_launch;
+    if(t.iterations == 0) {
+        return;
+    }
+    const unsigned long long* layout = t.layout;
+    std::vector<void*> args;
+    for(unsigned long long i = 0, at = 0; i < layout[0]; at += layout[4 + i], i++) {
+        args.push_back(&t.values[at]);
+    }
+    unsigned long long split = (unsigned long long) t.grid.x << 32;
+    args.push_back(&split);
+    // the arrays, up to the end of their allocations
+    std::vector<std::pair<char*, unsigned long long>> arrays;
+    for(unsigned i = 0; i < PENGUIN_MAX_FUSION_ARGS; i++) {
+        if(!((layout[2] | layout[3]) >> i & 1)) {
+            continue;
+        }
+        char* p = *(char**) args[i];
+        unsigned long long base = penguin_fusion_allocation(p);
+        bool seen = false;
+        for(auto a = arrays.begin(); a != arrays.end(); a++) {
+            seen |= a->first == p;
+        }
+        if(base != 0 && !seen) {
+            arrays.push_back({p, base + allocation_desc((void*) base).size - (unsigned long long) p});
+        }
+    }
+    unsigned long long per_block = (unsigned long long) t.block.x * layout[1];
+    unsigned long long step = arrays.empty() ? t.grid.x : available / 2 / (per_block * arrays.size());
+    step = std::max(step, 1ULL);
+    if(t.iterations == 1 || step >= t.grid.x || penguinPrefetchEngineInit() != PENGUIN_OK) {
+        for(unsigned long long i = 0; i < t.iterations; i++) {
+            cudaLaunchKernel(t.func, t.grid, t.block, args.data(), t.shmem, t.stream);
+        }
+        t.iterations = 0;
+        return;
+    }
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %llu %llu", __func__, t.iterations, (t.grid.x + step - 1) / step);
+    int device = penguin_launch_device();
+    for(unsigned long long first = 0; first < t.grid.x; first += step) {
+        unsigned long long count = std::min(step, t.grid.x - first);
+        unsigned long long next = first + count < t.grid.x ? std::min(step, t.grid.x - first - count) : 0;
+        for(auto a = arrays.begin(); a != arrays.end(); a++) {
+            unsigned long long at, length;
+            if(first == 0 && penguin_tile_range(*a, per_block, first, count, at, length)) {
+                penguin_mem_prefetch(a->first + at, length, device, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) a->first + at, length);
+            }
+        }
+        // the tile starts when its part is in, the next tile's moves while
+        // it runs
+        cudaEvent_t event;
+        if(cudaEventCreateWithFlags(&event, cudaEventDisableTiming) == cudaSuccess) {
+            cudaEventRecord(event, prefetch_engine.h2d);
+            cudaStreamWaitEvent(t.stream, event, 0);
+            cudaEventDestroy(event);
+        }
+        for(auto a = arrays.begin(); a != arrays.end(); a++) {
+            unsigned long long at, length;
+            if(penguin_tile_range(*a, per_block, first + count, next, at, length)) {
+                penguin_mem_prefetch(a->first + at, length, device, prefetch_engine.h2d);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_H2D, (unsigned long long) a->first + at, length);
+            }
+        }
+        dim3 sub = t.grid;
+        sub.x = count;
+        split = first | ((unsigned long long) t.grid.x << 32);
+        for(unsigned long long i = 0; i < t.iterations; i++) {
+            cudaLaunchKernel(t.func, sub, t.block, args.data(), t.shmem, t.stream);
+        }
+        // the last tile stays
+        if(next == 0 || cudaEventCreateWithFlags(&event, cudaEventDisableTiming) != cudaSuccess) {
+            continue;
+        }
+        cudaEventRecord(event, t.stream);
+        cudaStreamWaitEvent(prefetch_engine.d2h, event, 0);
+        cudaEventDestroy(event);
+        for(auto a = arrays.begin(); a != arrays.end(); a++) {
+            unsigned long long at, length;
+            if(penguin_tile_range(*a, per_block, first, count, at, length)) {
+                penguin_mem_prefetch(a->first + at, length, cudaCpuDeviceId, prefetch_engine.d2h);
+                penguin_trace(PENGUIN_TRACE_PREFETCH_D2H, (unsigned long long) a->first + at, length);
+            }
+        }
+    }
+    t.iterations = 0;
+}
+
+extern "C"
+cudaError_t penguinLaunchKernelTiled(const void* func, dim3 grid, dim3 block, void** args, size_t shmem,
+        cudaStream_t stream, const unsigned long long* layout) {
+    PENGUIN_LOCKED_ENTRY();
+    bool feeds;
+    if(!penguin_loop_tiling_enabled() || penguin_policy() != PENGUIN_POLICY_SUV ||
+            grid.y != 1 || grid.z != 1 || block.y != 1 || block.z != 1 ||
+            !penguin_fusable(args, layout[2], layout[3], args, layout[2], layout[3], feeds)) {
+        penguinLaunchTiledFlush();
+        return penguinLaunchKernelSplit(func, grid, block, args, shmem, stream, layout[0]);
+    }
+    std::vector<char> values;
+    penguin_tiled_values(args, layout, values);
+    penguin_tiled_launch& t = tiled_launch;
+    if(t.iterations > 0 && (t.func != func || t.layout != layout || t.shmem != shmem || t.stream != stream ||
+                !penguin_same_launch_shape(grid, block, t.grid, t.block) || t.values != values)) {
+        penguinLaunchTiledFlush();
+    }
+    if(t.iterations == 0) {
+        t.func = func;
+        t.grid = grid;
+        t.block = block;
+        t.shmem = shmem;
+        t.stream = stream;
+        t.layout = layout;
+        t.values.swap(values);
+    }
+    t.iterations++;
+    return cudaSuccess;
+}
+
+// Graph replay (-penguin-graph-launch). The launches of a host loop whose
+// launches are all plain cudaLaunchKernel calls come here with their layout,
+// the number of parameters then the bytes of each, and the loop's header
+// calls penguinGraphIteration before anything else of an iteration. Launches
+// go out as they come until two iterations in a row launch the same kernels
+// with the same grids on the same stream. Those launches are then built
+// into a graph of kernel nodes, one after the other. From then on the
+// launches of an iteration are held back, and the graph is launched once
+// they are all in, with the argument values of the iteration set in its
+// nodes, which takes one launch instead of one per kernel. The prefetches,
+// advice and evictions of the iteration need no graph nodes: they are issued
+// on the prefetch engine's streams before the graph is launched, and the
+// kernels wait on them through the events they record on the launch
+// stream. A launch that doesn't follow the graph sends the held ones out as
+// they were and drops the graph, as do the loop's exits, which call
+// penguinGraphFlush. Errors of the held back launches show at the next
+// synchronization. PENGUIN_GRAPH_LAUNCH=0 launches everything as it comes.
+int graph_launch_enabled = -1;
+
+bool penguin_graph_launch_enabled() {
+    if(graph_launch_enabled < 0) {
+        const char* env = getenv("PENGUIN_GRAPH_LAUNCH");
+        graph_launch_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return graph_launch_enabled;
+}
+
+typedef struct {
+    const void* func;
+    dim3 grid;
+    dim3 block;
+    size_t shmem;
+    cudaStream_t stream;
+    const unsigned long long* layout;
+    std::vector<char> values;
+} penguin_graph_launch;
+
+typedef struct {
+    unsigned loop;
+    // the launches of the last iteration and of this one, held back while
+    // there is a graph
+    std::vector<penguin_graph_launch> previous;
+    std::vector<penguin_graph_launch> current;
+    cudaGraph_t graph;
+    cudaGraphExec_t exec;
+    std::vector<cudaGraphNode_t> nodes;
+    // a graph of the loop failed to build, so it isn't tried again
+    bool failed;
+    unsigned long long replays;
+} penguin_graph_loop;
+
+penguin_graph_loop graph_loop;
+
+bool penguin_same_graph_launch(const penguin_graph_launch& a, const penguin_graph_launch& b) {
+    return a.func == b.func && a.layout == b.layout && a.shmem == b.shmem && a.stream == b.stream &&
+        penguin_same_launch_shape(a.grid, a.block, b.grid, b.block);
+}
+
+void penguin_graph_args(penguin_graph_launch& l, std::vector<void*>& args) {
+    for(unsigned long long i = 0, at = 0; i < l.layout[0]; at += l.layout[1 + i], i++) {
+        args.push_back(&l.values[at]);
+    }
+}
+
+cudaError_t penguin_graph_launch_now(penguin_graph_launch& l) {
+    std::vector<void*> args;
+    penguin_graph_args(l, args);
+    return cudaLaunchKernel(l.func, l.grid, l.block, args.data(), l.shmem, l.stream);
+}
+
+void penguin_graph_drop() {
+    penguin_graph_loop& g = graph_loop;
+    if(g.exec != NULL) {
+        cudaGraphExecDestroy(g.exec);
+    }
+    if(g.graph != NULL) {
+        cudaGraphDestroy(g.graph);
+    }
+    g.exec = NULL;
+    g.graph = NULL;
+    g.nodes.clear();
+}
+
+// The held back launches, as they came
+void penguin_graph_release() {
+    penguin_graph_loop& g = graph_loop;
+    if(g.exec != NULL) {
+        for(auto l = g.current.begin(); l != g.current.end(); l++) {
+            penguin_graph_launch_now(*l);
+        }
+    }
+    penguin_graph_drop();
+}
+
+bool penguin_graph_build(std::vector<penguin_graph_launch>& launches) {
+    penguin_graph_loop& g = graph_loop;
+    if(cudaGraphCreate(&g.graph, 0) != cudaSuccess) {
+        g.graph = NULL;
+        return false;
+    }
+    for(auto l = launches.begin(); l != launches.end(); l++) {
+        std::vector<void*> args;
+        penguin_graph_args(*l, args);
+        cudaKernelNodeParams params = {};
+        params.func = (void*) l->func;
+        params.gridDim = l->grid;
+        params.blockDim = l->block;
+        params.sharedMemBytes = (unsigned) l->shmem;
+        params.kernelParams = args.data();
+        cudaGraphNode_t node;
+        if(cudaGraphAddKernelNode(&node, g.graph, g.nodes.empty() ? NULL : &g.nodes.back(),
+                    g.nodes.empty() ? 0 : 1, &params) != cudaSuccess) {
+            penguin_graph_drop();
+            return false;
+        }
+        g.nodes.push_back(node);
+    }
+    if(cudaGraphInstantiate(&g.exec, g.graph, 0) != cudaSuccess) {
+        g.exec = NULL;
+        penguin_graph_drop();
+        return false;
+    }
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "graph of loop %u, %zu launches", g.loop, g.nodes.size());
+    return true;
+}
+
+// The end of an iteration: the graph with the values of its held launches,
+// or a new graph if it launched what the iteration before did
+void penguin_graph_end_iteration() {
+    penguin_graph_loop& g = graph_loop;
+    if(g.exec != NULL) {
+        bool replayed = g.current.size() == g.nodes.size();
+        for(size_t n = 0; replayed && n < g.nodes.size(); n++) {
+            penguin_graph_launch& l = g.current[n];
+            if(l.values == g.previous[n].values) {
+                continue;
+            }
+            std::vector<void*> args;
+            penguin_graph_args(l, args);
+            cudaKernelNodeParams params = {};
+            params.func = (void*) l.func;
+            params.gridDim = l.grid;
+            params.blockDim = l.block;
+            params.sharedMemBytes = (unsigned) l.shmem;
+            params.kernelParams = args.data();
+            replayed = cudaGraphExecKernelNodeSetParams(g.exec, g.nodes[n], &params) == cudaSuccess;
+        }
+        if(replayed && cudaGraphLaunch(g.exec, g.current[0].stream) == cudaSuccess) {
+            g.replays++;
+        } else {
+            penguin_graph_release();
+        }
+    } else if(!g.failed && !g.current.empty() && g.current.size() == g.previous.size()) {
+        bool same = true;
+        for(size_t n = 0; same && n < g.current.size(); n++) {
+            same = penguin_same_graph_launch(g.current[n], g.previous[n]);
+        }
+        if(same) {
+            g.failed = !penguin_graph_build(g.current);
+        }
+    }
+    g.previous.swap(g.current);
+    g.current.clear();
+}
+
+extern "C"
+void penguinGraphFlush() {
+    PENGUIN_LOCKED_ENTRY();
+    penguin_graph_loop& g = graph_loop;
+    // a last iteration that launched all of the graph replays it, one cut
+    // short launches what it held
+    if(g.exec != NULL && g.current.size() == g.nodes.size()) {
+        penguin_graph_end_iteration();
+    }
+    penguin_graph_release();
+    g.current.clear();
+    g.previous.clear();
+    g.failed = false;
+}
+
+extern "C"
+void penguinGraphIteration(unsigned loop) {
+    PENGUIN_LOCKED_ENTRY();
+    if(graph_loop.loop != loop) {
+        penguinGraphFlush();
+        graph_loop.loop = loop;
+    }
+    penguin_graph_end_iteration();
+}
+
+extern "C"
+cudaError_t penguinLaunchKernelGraph(const void* func, dim3 grid, dim3 block, void** args, size_t shmem,
+        cudaStream_t stream, const unsigned long long* layout) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_graph_launch_enabled() || penguin_policy() != PENGUIN_POLICY_SUV) {
+        return cudaLaunchKernel(func, grid, block, args, shmem, stream);
+    }
+    penguin_graph_loop& g = graph_loop;
+    penguin_graph_launch l = {func, grid, block, shmem, stream, layout, {}};
+    for(unsigned long long i = 0; i < layout[0]; i++) {
+        const char* value = (const char*) args[i];
+        l.values.insert(l.values.end(), value, value + layout[1 + i]);
+    }
+    size_t n = g.current.size();
+    if(g.exec != NULL && n < g.nodes.size() && penguin_same_graph_launch(l, g.previous[n])) {
+        g.current.push_back(l);
+        return cudaSuccess;
+    }
+    penguin_graph_release();
+    g.current.push_back(l);
+    return cudaLaunchKernel(func, grid, block, args, shmem, stream);
+}
+
+// Launch reordering (-penguin-launch-reorder). Launches of a basic block
+// with nothing but their setup between them come here with their layout:
+// the parameters, the bytes of each, then whether the kernel loads (1) and
+// stores (2) through each pointer parameter, 3 for one the analysis doesn't
+// cover. They are held back until penguinLaunchReorderFlush, right after the
+// last of them, which launches them in the order that migrates the fewest
+// bytes: each time the held launch with the fewest bytes of allocations the
+// GPU no longer holds, with gpu_memory taken as an LRU over the allocations
+// of the launches before it, among those that conflict with no earlier one
+// still held. Two launches conflict when they share an allocation one of
+// them stores to, or when one has a pointer into memory the runtime doesn't
+// know. Kernels sharing allocations then run back to back instead of with
+// the data of other kernels migrated through the GPU between them. The plans
+// of the launches are made as they are held, in program order. Errors of
+// the held back launches show at the next synchronization.
+// PENGUIN_LAUNCH_REORDER=0 launches them as they come.
+#define PENGUIN_MAX_REORDER 16
+
+int launch_reorder_enabled = -1;
+
+bool penguin_launch_reorder_enabled() {
+    if(launch_reorder_enabled < 0) {
+        const char* env = getenv("PENGUIN_LAUNCH_REORDER");
+        launch_reorder_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return launch_reorder_enabled;
+}
+
+typedef struct {
+    penguin_graph_launch launch;
+    // base of each allocation its pointer arguments point into, and whether
+    // it stores to it
+    std::vector<std::pair<unsigned long long, bool>> allocations;
+    bool unknown;
+} penguin_reorder_launch;
+
+std::vector<penguin_reorder_launch> reorder_held;
+// allocations of the launches reordered so far, the latest first, as much
+// of them as gpu_memory holds
+std::deque<unsigned long long> reorder_resident;
+
+bool penguin_reorder_conflict(const penguin_reorder_launch& a, const penguin_reorder_launch& b) {
+    if(a.unknown || b.unknown) {
+        return true;
+    }
+    for(auto &x : a.allocations) {
+        for(auto &y : b.allocations) {
+            if(x.first == y.first && (x.second || y.second)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Bytes of the allocations of l that are not in reorder_resident
+unsigned long long penguin_reorder_missing(const penguin_reorder_launch& l) {
+    unsigned long long missing = 0;
+    for(auto &a : l.allocations) {
+        if(std::find(reorder_resident.begin(), reorder_resident.end(), a.first) == reorder_resident.end()) {
+            missing += allocation_desc((void*) a.first).size;
+        }
+    }
+    return missing;
+}
+
+void penguin_reorder_touch(const penguin_reorder_launch& l) {
+    for(auto &a : l.allocations) {
+        auto r = std::find(reorder_resident.begin(), reorder_resident.end(), a.first);
+        if(r != reorder_resident.end()) {
+            reorder_resident.erase(r);
+        }
+        reorder_resident.push_front(a.first);
+    }
+    unsigned long long held = 0;
+    auto r = reorder_resident.begin();
+    while(r != reorder_resident.end() && held + allocation_desc((void*) *r).size <= gpu_memory) {
+        held += allocation_desc((void*) *r).size;
+        r++;
+    }
+    reorder_resident.erase(r, reorder_resident.end());
+}
+
+extern "C"
+void penguinLaunchReorderFlush() {
+    PENGUIN_LOCKED_ENTRY();
+    std::vector<bool> issued(reorder_held.size(), false);
+    for(size_t n = 0; n < reorder_held.size(); n++) {
+        size_t best = reorder_held.size();
+        unsigned long long best_missing = 0;
+        for(size_t i = 0; i < reorder_held.size(); i++) {
+            if(issued[i]) {
+                continue;
+            }
+            bool ready = true;
+            for(size_t j = 0; j < i && ready; j++) {
+                ready = issued[j] || !penguin_reorder_conflict(reorder_held[j], reorder_held[i]);
+            }
+            if(!ready) {
+                continue;
+            }
+            unsigned long long missing = penguin_reorder_missing(reorder_held[i]);
+            if(best == reorder_held.size() || missing < best_missing) {
+                best = i;
+                best_missing = missing;
+            }
+        }
+        if(best != n) {
+            PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "launch %zu of %zu moved to %zu", best,
+                    reorder_held.size(), n);
+        }
+        issued[best] = true;
+        penguin_reorder_touch(reorder_held[best]);
+        penguin_graph_launch_now(reorder_held[best].launch);
+    }
+    reorder_held.clear();
+}
+
+extern "C"
+cudaError_t penguinLaunchKernelReorder(const void* func, dim3 grid, dim3 block, void** args, size_t shmem,
+        cudaStream_t stream, const unsigned long long* layout) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_launch_reorder_enabled() || penguin_policy() != PENGUIN_POLICY_SUV) {
+        return cudaLaunchKernel(func, grid, block, args, shmem, stream);
+    }
+    if(reorder_held.size() >= PENGUIN_MAX_REORDER) {
+        penguinLaunchReorderFlush();
+    }
+    unsigned long long nargs = layout[0];
+    penguin_reorder_launch l = {{func, grid, block, shmem, stream, layout, {}}, {}, false};
+    for(unsigned long long i = 0; i < nargs; i++) {
+        const char* value = (const char*) args[i];
+        l.launch.values.insert(l.launch.values.end(), value, value + layout[1 + i]);
+        unsigned long long mode = layout[1 + nargs + i];
+        if(mode == 0) {
+            continue;
+        }
+        void* p = *(void**) args[i];
+        if(p == NULL) {
+            continue;
+        }
+        // a field split layout, which only the kernels themselves take
+        unsigned long long base = (unsigned long long) p >> 63 ? 0 : penguin_fusion_allocation(p);
+        if(base == 0) {
+            l.unknown = true;
+            continue;
+        }
+        l.allocations.push_back(std::make_pair(base, (mode & 2) != 0));
+    }
+    reorder_held.push_back(l);
+    return cudaSuccess;
+}
+
+// Learned placement. With PENGUIN_MODEL=1 the local planner asks the tree
+// below which of its three placements an allocation gets, from the features
+// its cascade looks at, and keeps its own when the leaf the allocation ends in
+// is less sure than PENGUIN_MODEL_CONFIDENCE (0.8), the fraction of the
+// training allocations of that leaf that had its class. eval/model/train.cpp
+// builds the tree from the rows PENGUIN_MODEL_FEATURES=<file> appends, one per
+// allocation and launch, of runs eval/model/collect.sh times; with
+// PENGUIN_MODEL_EXPLORE=<seed> those runs place at random instead, so the
+// rows cover what the cascade would not pick. The tree shipped is the
+// cascade itself.
+enum penguin_model_feature {
+    PENGUIN_FEAT_DENSITY,   // accesses per byte in the launch
+    PENGUIN_FEAT_WSS_RATIO, // working set over size
+    PENGUIN_FEAT_SIZE_MB,
+    PENGUIN_FEAT_PCHASE,    // a pointer chase in the program
+    PENGUIN_FEAT_ITERDEP,   // accesses that depend on the iteration
+    PENGUIN_FEAT_MAX
+};
 
-/*     // identify common decisions */
-/*     // by going over each allocation, and looking at each of the decisions (nc2) */
-/*     std::cout << "identify common decisions\n"; */
-/*     for(auto alloc = allocation_size_map.begin(); alloc != allocation_size_map.end(); alloc++) { */
-/*         std::cout << alloc->first << "\n"; */
-/*         auto common_decision = PENGUIN_DEC_NONE; */
-/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
-/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
-/*             if(AllocationToDecisionMap[alloc->first]  == PENGUIN_DEC_ACCESS_COUNTER ) { */
-/*                 AllocationToCommonDecisionMap[alloc->first] = PENGUIN_DEC_ACCESS_COUNTER; */
-/*             } */
-/*         } */
-/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
-/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
-/*             auto dec = InvocationIDtoAllocationToDecisionMap[invid->first][alloc->first]; */
-/*             if(AllocationToDecisionMap[alloc->first]  == PENGUIN_DEC_ITERATION_MIGRATION ) { */
-/*                 if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) { */
-/*                     common_decision = PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN; */
-/*                     AllocationToPartialSizeMap[alloc->first] */
-/*                         = InvocationIDtoAllocationToPartialSize[invid->first][alloc->first] ; */
-/*                 } */
-/*             } */
-/*             if(dec == PENGUIN_DEC_HOST_PIN && common_decision == PENGUIN_DEC_NONE) { */
-/*                 common_decision = PENGUIN_DEC_HOST_PIN; */
-/*             } else if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN && common_decision == PENGUIN_DEC_NONE) { */
-/*                 common_decision = PENGUIN_DEC_GPU_HOST_PARTIAL_PIN; */
-/*             } else if(dec == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN && common_decision == PENGUIN_DEC_HOST_PIN) { */
-/*                 common_decision = PENGUIN_DEC_GPU_HOST_PARTIAL_PIN; */
-/*                 auto parsize = AllocationToPartialSizeMap[alloc->first]; */
-/*                 if(parsize < InvocationIDtoAllocationToPartialSize[invid->first][alloc->first]) { */
-/*                     AllocationToPartialSizeMap[alloc->first] */
-/*                         = InvocationIDtoAllocationToPartialSize[invid->first][alloc->first] ; */
-/*                 } */
-/*             } */
-/*         } */
-/*         std::cout << "common decision = " << common_decision << "\n"; */
-/*         for(auto invid = InvocationIDtoAllocationToDecisionMap.begin(); */ 
-/*                 invid != InvocationIDtoAllocationToDecisionMap.end(); invid++) { */
-/*             if(common_decision == PENGUIN_DEC_NONE) { */
-/*                 if(AllocationToPrefetchBoolMap[alloc->first] == false) { */
-/*                     InvocationIDtoDecisionBoolMap[invid->first] = true; */
-/*                     std::cout << alloc->first << " "; */
-/*                     std::cout << "need to take per allocation, per invocation decision\n"; */
-/*                     AllocationStateMap[alloc->first] = PENGUIN_STATE_UNKNOWN; */
-/*                 } */
-/*             } */
-/*             else { */
-/*                 AllocationToCommonDecisionMap[alloc->first] = common_decision; */
-/*             } */
-/*         } */
-/*     } */
+enum penguin_model_class {
+    PENGUIN_MODEL_TEMPORAL, // its working set on demand, PENGUIN_DEC_MIGRATE_ON_DEMAND
+    PENGUIN_MODEL_PIN,      // a solver item, GPU or partial pin
+    PENGUIN_MODEL_HOST,     // PENGUIN_DEC_HOST_PIN
+    PENGUIN_MODEL_MAX
+};
 
-/*     // if a data structure is being iteration prefetched and GPU host pinned */
+typedef struct
+{
+    int feature;            // -1 for a leaf
+    float threshold;        // at most goes to left, more to right
+    int left;
+    int right;
+    int label;              // of a leaf
+    float confidence;
+} penguin_model_node;
+
+// begin penguin_model_tree, written by eval/model/train.cpp -w
+constexpr penguin_model_node penguin_model_tree[] = {
+    {PENGUIN_FEAT_DENSITY, 5, 1, 2, 0, 0},
+    {PENGUIN_FEAT_PCHASE, 0.5f, 3, 4, 0, 0},
+    {PENGUIN_FEAT_WSS_RATIO, 0.999f, 5, 3, 0, 0},
+    {-1, 0, 0, 0, PENGUIN_MODEL_PIN, 1},
+    {-1, 0, 0, 0, PENGUIN_MODEL_HOST, 1},
+    {PENGUIN_FEAT_SIZE_MB, 2, 3, 6, 0, 0},
+    {-1, 0, 0, 0, PENGUIN_MODEL_TEMPORAL, 1},
+};
+// end penguin_model_tree
 
-/*     // perform default decision */
-/*     // */
-/*     std::cout << "performing allocation common decision here\n"; */
-/*     // first handle pointer chase */
-/*     bool pchase_enabled = false; */
-/*     for(auto alloc = AllocationToCommonDecisionMap.begin(); */
-/*             alloc != AllocationToCommonDecisionMap.end(); alloc++) { */
-/*         if(alloc->second == PENGUIN_DEC_ACCESS_COUNTER) { */
-/*             pchase_enabled = true; */
-/*             penguinEnableAccessCounters(); */
-/*         } */
-/*     } */
-/*     for(auto alloc = AllocationToCommonDecisionMap.begin(); */
-/*             alloc != AllocationToCommonDecisionMap.end(); alloc++) { */
-/*         std::cout << alloc->first << " " << alloc->second << "\n"; */
-/*         if(alloc->second == PENGUIN_DEC_MIGRATE_ON_DEMAND) { */
-/*             continue; */
-/*         } */
-/*         if(alloc->second == PENGUIN_DEC_GPU_PIN) { */
-/*             auto dsize = allocation_size_map[alloc->first]; */
-/*             std::cout << "gpu pin " << dsize << "\n"; */
-/*             char* ptr = (char*) alloc->first; */
-/*             /1* cudaMemPrefetchAsync(ptr, dsize, 0, 0 ); *1/ */
-/*             /1* penguinSetPrioritizedLocation((char*) alloc->first, dsize, 0); *1/ */
-/*             continue; */
-/*         } */
-/*         if(alloc->second == PENGUIN_DEC_ITERATION_MIGRATION_PLUS_GPU_HOST_PIN) { */
-/*             // asssuming partial size is larger than prefetch size */
-/*             // TODO: check for the above */
-/*             unsigned long long partial_size = AllocationToPartialSizeMap[alloc->first]; */
-/*             auto span = mmg_alloc_span_map_iteronly[alloc->first]; */
-/*             unsigned long long prefetch_iters_per_batch = partial_size/span; */
-/*             unsigned long long prefetch_size = AllocationToPrefetchSizeMap[alloc->first]; */
-/*             std::cout << "prefetching and partial pinning together\n"; */
-/*             std::cout << prefetch_size << " " << partial_size << "  " << span << " " << prefetch_iters_per_batch << "\n"; */
-/*             AllocationToPrefetchBoolMap[alloc->first] = true; */
-/*             AllocationToPrefetchSizeMap[alloc->first] = prefetch_size + partial_size; */
-/*             AllocationToPrefetchItersPerBatchMap[alloc->first] = prefetch_iters_per_batch; */
-/*             char* ptr = (char*) alloc->first; */
-/*             auto dsize = allocation_size_map[alloc->first]; */
-/*             cudaMemAdvise(ptr, dsize, cudaMemAdviseSetAccessedBy, 0); */
-/*         } */
-/*         if(alloc->second == PENGUIN_DEC_GPU_HOST_PARTIAL_PIN) { */
-/*             auto dsize = allocation_size_map[alloc->first]; */
-/*             auto partial_size = AllocationToPartialSizeMap[alloc->first]; */
-/*             std::cout << "partial pin " << partial_size << "\n"; */
-/*             if(AllocationToPrefetchBoolMap[alloc->first] == true) { */
-/*                 std::cout << "prefetching and partial pinning together\n"; */
-/*                 // asssuming partial size is larger than prefetch size */
-/*                 // TODO: check for the above */
-/*                 AllocationToPrefetchSizeMap[alloc->first] = partial_size; */
-/*                 auto span = mmg_alloc_span_map_iteronly[alloc->first]; */
-/*                 auto prefetch_iters_per_batch = partial_size/span; */
-/*                 AllocationToPrefetchItersPerBatchMap[alloc->first] = prefetch_iters_per_batch; */
-/*             } else { */
-/*                 char* ptr = (char*) alloc->first; */
-/*                 cudaMemPrefetchAsync(ptr, partial_size, 0, 0 ); */
-/*                 penguinSetPrioritizedLocation((char*) alloc->first, partial_size, 0); */
-/*                 cudaMemAdvise(ptr + partial_size, dsize - partial_size, cudaMemAdviseSetAccessedBy, 0); */
-/*             } */
-/*             continue; */
-/*         } */
-/*         if(alloc->second == PENGUIN_DEC_HOST_PIN) { */
-/*             auto dsize = allocation_size_map[alloc->first]; */
-/*             std::cout << "host pin " << dsize << "\n"; */
-/*             char* ptr = (char*) alloc->first; */
-/*             cudaMemAdvise(ptr , dsize, cudaMemAdviseSetAccessedBy, 0); */
-/*             continue; */
-/*         } */
-/*     } */
-/*     return; */
-/* } */
+int model_enabled = -1;
+
+bool penguin_model_enabled() {
+    if(model_enabled < 0) {
+        const char* env = getenv("PENGUIN_MODEL");
+        model_enabled = env != NULL && strcmp(env, "0") != 0;
+    }
+    return model_enabled;
+}
+
+// The leaf of features
+const penguin_model_node& penguin_model_leaf(const float* features) {
+    int n = 0;
+    while(penguin_model_tree[n].feature >= 0) {
+        const penguin_model_node& node = penguin_model_tree[n];
+        n = features[node.feature] <= node.threshold ? node.left : node.right;
+    }
+    return penguin_model_tree[n];
+}
+
+// The class of an allocation, the cascade's unless the model is sure of
+// another one or exploration picks it
+int penguin_model_class_of(const float* features, int heuristic, unsigned invid, unsigned seq) {
+    static const char* explore = getenv("PENGUIN_MODEL_EXPLORE");
+    static const double confidence = getenv("PENGUIN_MODEL_CONFIDENCE") ?
+        atof(getenv("PENGUIN_MODEL_CONFIDENCE")) : 0.8;
+    int c = heuristic;
+    if(explore != NULL) {
+        unsigned long long h = strtoull(explore, NULL, 10) * 0x9e3779b97f4a7c15ULL;
+        h = (h ^ invid) * 0x100000001b3ULL;
+        h = (h ^ seq) * 0x100000001b3ULL;
+        c = (h >> 32) % PENGUIN_MODEL_MAX;
+    } else if(penguin_model_enabled()) {
+        const penguin_model_node& leaf = penguin_model_leaf(features);
+        if(leaf.confidence >= confidence) {
+            c = leaf.label;
+        }
+    }
+    static FILE* rows = [] {
+        const char* path = getenv("PENGUIN_MODEL_FEATURES");
+        return path ? fopen(path, "a") : (FILE*) NULL;
+    }();
+    if(rows != NULL) {
+        fprintf(rows, "%u,%u", invid, seq);
+        for(int f = 0; f < PENGUIN_FEAT_MAX; f++) {
+            fprintf(rows, ",%g", features[f]);
+        }
+        fprintf(rows, ",%d\n", c);
+        fflush(rows);
+    }
+    return c;
+}
+
+// Decisions of the local planner that only follow from its inputs, the aid
+// maps and the allocation sizes, taken at the launch or ahead of it by the
+// lookahead thread. The solve holds if what the access counter shares and
+// the sampled pins leave of the budget is what it was solved for.
+typedef struct
+{
+    unsigned invid;
+    unsigned long long generation; // 0 for no plan
+    unsigned long long memsize;
+    unsigned long long budget;
+    bool has_pchase;
+    bool has_unknown;
+    unsigned long long total_memory_used;
+    std::map<void*, bool> pchase_map;
+    std::vector<penguin_placement_item> items; // pin candidates and temporal regions
+    std::vector<void*> host_pins;
+    bool solved;
+    unsigned long long solved_available;
+} mmg_local_plan;
+
+// What is left of left after the share of a pointer chase allocation
+unsigned long long mmg_pchase_share(unsigned long long left, unsigned long long dsize,
+        unsigned long long total_available, unsigned long long total_memory_used) {
+    unsigned long long size = (dsize *total_available)/ total_memory_used;
+    if(left > 0) {
+        if(left > size) {
+            /* std::cout << "case A\n"; */
+            /* size = (dsize * 2) / 3; */
+            left -= size;
+        } else {
+            /* std::cout << "case B. ought not to come here\n"; */
+            size = left - penguin_tune().pchase_headroom;
+            left -= size;
+        }
+    }
+    /* std::cout << "qeeping " << size << "for pointer chase\n"; */
+    return left;
+}
+
+void mmg_local_plan_compute(mmg_local_plan& plan, unsigned long long memsize, unsigned invid,
+        unsigned long long budget) {
+    plan.invid = invid;
+    plan.generation = mmg_input_generation;
+    plan.memsize = memsize;
+    plan.budget = budget;
+    plan.has_pchase = false;
+    plan.has_unknown = false;
+    plan.pchase_map.clear();
+    plan.items.clear();
+    plan.host_pins.clear();
+    std::map<void*, unsigned long long> mmg_alloc_wss_map;
+    std::map<void*, unsigned long long> mmg_alloc_ac_map;
+    std::map<void*, double> mmg_alloc_ad_map;
+    for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) {
+        /* std::cout << a->first << " " << aid_ac_map[a->first] << " " << a->second << " "; */
+        // find the allocation
+        if(lookup_allocation_id(aid_allocation_map[a->first]) == PENGUIN_INVALID_ALLOC_ID ||
+                allocation_desc(aid_allocation_map[a->first]).size == 0) {
+            /* std::cout << "[inside] "; */
+            void * insideallocation = alias_interior_pointer(aid_allocation_map[a->first]);
+            /* std::cout << insideallocation << "\n"; */
+            // force onto the og allocation
+            aid_allocation_map[a->first] = insideallocation;
+        }
+    }
+    /* std::cout << "working set size map\n"; */
+    for (auto a = aid_wss_map.begin(); a != aid_wss_map.end(); a++) {
+        if(aid_invocation_id_map[a->first] == invid) {
+            /* std::cout << a->first << " " << a->second << "\n"; */
+            if(mmg_alloc_wss_map[aid_allocation_map[a->first]] < a->second) {
+                mmg_alloc_wss_map[aid_allocation_map[a->first]] = a->second;
+            }
+        }
+    }
+    std::set<void*> mmg_alloc_iterdep;
+    for (auto a = aid_wss_map_iterdep.begin(); a != aid_wss_map_iterdep.end(); a++) {
+        if(aid_invocation_id_map[a->first] == invid) {
+            mmg_alloc_iterdep.insert(aid_allocation_map[a->first]);
+        }
+    }
+    for (auto a = aid_pchase_map.begin(); a != aid_pchase_map.end(); a++) {
+        /* std::cout << a->first << " pchase\n"; */
+        plan.has_pchase = true;
+        plan.pchase_map[aid_allocation_map[a->first]] = true;
+    }
+    plan.has_unknown = !aid_ac_incomp_map.empty();
+    /* std::cout << "access count map\n"; */
+    for (auto a = aid_ac_map.begin(); a != aid_ac_map.end(); a++) {
+        if(aid_invocation_id_map[a->first] == invid) {
+            /* std::cout << a->first << " " << a->second << "\n"; */
+            mmg_alloc_ac_map[aid_allocation_map[a->first]] += a->second;
+        }
+    }
+    /* std::cout << "access density map\n"; */
+    std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_invid;
+    for (auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) {
+        mmg_alloc_ad_map[a->first] = (double) a->second / allocation_desc(a->first).size;
+        /* std::cout << a->first << " " << mmg_alloc_ad_map[a->first] << std::endl; */
+        mmg_alloc_ad_vector_invid.push_back(std::pair<void*, float>(a->first, mmg_alloc_ad_map[a->first]));
+    }
+    std::sort(mmg_alloc_ad_vector_invid.begin(),
+            mmg_alloc_ad_vector_invid.end(), sortfuncf);
+    /* std::cout << "sorted \n"; */
+
+    plan.total_memory_used = 0;
+    for(auto a = allocation_table.begin(); a != allocation_table.end(); a++) {
+        plan.total_memory_used += a->size;
+    }
+
+    for(auto a = mmg_alloc_ad_vector_invid.begin();
+            a != mmg_alloc_ad_vector_invid.end(); a++) {
+        if(plan.pchase_map.find(a->first) != plan.pchase_map.end()) {
+            /* std::cout << "dominated by pchase\n"; */
+            continue;
+        }
+        if(mmg_alloc_wss_map.find(a->first) != mmg_alloc_wss_map.end()){
+            auto awss = mmg_alloc_wss_map.find(a->first);
+            auto dsize = allocation_desc(a->first).size;
+            /* std::cout << a->first << " " << awss->second << std::endl; */
+            auto ad = mmg_alloc_ad_map[a->first];
+            penguin_placement_item item;
+            item.allocation = a->first;
+            item.benefit = penguin_resident_benefit(0, mmg_alloc_ac_map[a->first]);
+            item.resident = 0;
+            int c;
+            if(awss->second < dsize && dsize > 2* 1024*1024 && ad > 5) { //TODO:keep low ad temporal on CPU, unless these is left over memory even after reserving enough for the entire temporal
+                c = PENGUIN_MODEL_TEMPORAL;
+            } else if(mmg_alloc_ad_map[a->first] > 5.0 || !plan.has_pchase) {
+                c = PENGUIN_MODEL_PIN;
+            } else {
+                /* std::cout << "cpu pin rest D\n"; */
+                c = PENGUIN_MODEL_HOST;
+            }
+            float features[PENGUIN_FEAT_MAX];
+            features[PENGUIN_FEAT_DENSITY] = ad;
+            features[PENGUIN_FEAT_WSS_RATIO] = (float) awss->second / dsize;
+            features[PENGUIN_FEAT_SIZE_MB] = (float) dsize / (1024*1024);
+            features[PENGUIN_FEAT_PCHASE] = plan.has_pchase;
+            features[PENGUIN_FEAT_ITERDEP] = mmg_alloc_iterdep.count(a->first);
+            c = penguin_model_class_of(features, c, invid, allocation_desc(a->first).seq);
+            if(c == PENGUIN_MODEL_HOST && allocation_desc(a->first).atomic) {
+                c = PENGUIN_MODEL_PIN;
+            }
+            // the driver keeps file pages in system memory
+            if(allocation_desc(a->first).nvme) {
+                c = PENGUIN_MODEL_HOST;
+            }
+            if(c == PENGUIN_MODEL_TEMPORAL) {
+                item.weight = std::min(awss->second, dsize);
+                item.divisible = false;
+            } else if(c == PENGUIN_MODEL_PIN) {
+                item.weight = dsize;
+                item.divisible = true;
+            } else {
+                plan.host_pins.push_back(a->first);
+                continue;
+            }
+            plan.items.push_back(item);
+        }
+    }
+
+    // solved for what the pointer chase allocations not yet on access
+    // counters will leave; the sampled pins are only known as they are made
+    plan.solved = budget > 0 && ac_samples.empty();
+    plan.solved_available = budget;
+    if(plan.solved) {
+        for(auto a = plan.pchase_map.begin(); a != plan.pchase_map.end(); a++) {
+            if(allocation_desc(a->first).state != PENGUIN_STATE_AC) {
+                plan.solved_available = mmg_pchase_share(plan.solved_available,
+                        allocation_desc(a->first).size, budget, plan.total_memory_used);
+            }
+        }
+        penguinSolvePlacement(plan.items, plan.solved_available);
+    }
+}
+
+void mmg_local_plan_apply(mmg_local_plan& plan) {
+    std::map<void*, State> mmg_alloc_decision_map_invid; // decision for upcoming iterations
+    // Actual decision, within the scope of the launch's stream
+    available = plan.budget;
+    /* std::cout << available <<  std::endl; */
+    unsigned long long total_available = plan.budget;
+
+    /* std::cout << "actual decision\n"; */
+    if(available > 0) {
+        if(plan.has_pchase || plan.has_unknown) {
+            /* std::cout << "hi enable access counters\n"; */
+            penguinEnableAccessCounters();
+            /* return; */
+        }
+        for(auto a = plan.pchase_map.begin(); a != plan.pchase_map.end(); a++) {
+            auto dsize = allocation_desc(a->first).size;
+            /* std::cout << std::endl << a->first << "size = " << dsize << std::endl; */
+            /* std::cout << "av = " << available << std::endl; */
+            if(allocation_desc(a->first).state == PENGUIN_STATE_AC) {
+            } else {
+                allocation_desc(a->first).state = PENGUIN_STATE_AC;
+                penguin_set_decision(allocation_desc(a->first), PENGUIN_DEC_ACCESS_COUNTER);
+                /* std::cout << a->first << " " << available << std::endl; */
+                available = mmg_pchase_share(available, dsize, total_available, plan.total_memory_used);
+                /* cudaMemPrefetchAsync((char*)a->first, size, 0, 0 ); */
+            }
+        }
+        // sampled allocations have their hottest blocks pinned, in their
+        // share of the memory
+        for(auto s = ac_samples.begin(); s != ac_samples.end(); s++) {
+            const penguin_alloc_desc& desc = allocation_table[s->first];
+            unsigned long long share = plan.total_memory_used ?
+                (desc.size * total_available) / plan.total_memory_used : 0;
+            available -= std::min(available.load(), penguin_ac_sample_pin(desc.base, std::min(share, available.load())));
+        }
+        for(auto h = plan.host_pins.begin(); h != plan.host_pins.end(); h++) {
+            auto dsize = allocation_desc(*h).size;
+            penguin_mem_advise((char*) *h, dsize, cudaMemAdviseSetAccessedBy, 0);
+            penguinSetNoMigrateRegion((char*) *h, dsize, 0, true);
+            penguin_set_decision(allocation_desc(*h), PENGUIN_DEC_HOST_PIN);
+        }
+        if(!plan.solved || plan.solved_available != available) {
+            penguinSolvePlacement(plan.items, available);
+        }
+        for(auto a = plan.items.begin(); a != plan.items.end(); a++) {
+                                    void *addr = a->allocation;
+                                    addr = round_down(addr);
+            auto dsize = allocation_desc(a->allocation).size;
+            /* std::cout << std::endl << addr << "size = " << dsize << std::endl; */
+            /* std::cout << "av = " << available << std::endl; */
+            if(!a->divisible) {
+                if(a->resident) {
+                    /* std::cout << "temporal\n"; */
+                    available -= a->resident;
+                    /* cudaMemPrefetchAsync((char*)a->allocation, dsize, 0, 0 ); */
+                    mmg_alloc_decision_map_invid[a->allocation] = PENGUIN_STATE_GPU;
+                    penguin_set_decision(allocation_desc(a->allocation), PENGUIN_DEC_MIGRATE_ON_DEMAND);
+                }
+                continue;
+            }
+            if(a->resident == 0 && plan.has_pchase) { // hard to place small regions
+                /* std::cout << "leave to pchase\n"; */
+                continue;
+            }
+            if(allocation_desc(addr).state == PENGUIN_STATE_GPU_PINNED) {
+                continue;
+            }
+            if(a->resident == a->weight) {
+                /* std::cout << "gpu pin A\n"; */
+                allocation_desc(addr).state = PENGUIN_STATE_GPU_PINNED;
+                penguinSetPrioritizedLocation((char*) a->allocation, dsize, 0);
+                penguin_prefetch_pinned(a->allocation, dsize);
+                penguin_set_decision(allocation_desc(a->allocation), PENGUIN_DEC_GPU_PIN);
+                allocation_desc(a->allocation).gpu_res_stop = dsize;
+                available -= dsize;
+                /* std::cout << available <<  std::endl; */
+                pinned_memory += dsize;
+                /* std::cout << "pinned = " << pinned_memory << std::endl; */
+            } else {
+                /* std::cout << "gpu pin B\n"; */
+                allocation_desc(addr).state = PENGUIN_STATE_GPU_PINNED;
+                penguinSetPrioritizedLocation((char*) a->allocation, a->resident, 0);
+                penguin_prefetch_pinned(a->allocation, a->resident);
+                /* std::cout << "cpu pin rest B\n"; */
+                penguin_mem_advise((char*) a->allocation + a->resident, dsize - a->resident, cudaMemAdviseSetAccessedBy, 0);
+                penguin_partial_pin_track(a->allocation, a->resident);
+                penguin_set_decision(allocation_desc(a->allocation), PENGUIN_DEC_GPU_HOST_PARTIAL_PIN);
+                allocation_desc(a->allocation).gpu_res_stop = a->resident;
+                pinned_memory += a->resident;
+                /* std::cout << "pinned = " << pinned_memory << std::endl; */
+                available -= a->resident;
+                /* std::cout << available <<  std::endl; */
+            }
+        }
+    }
+
+    // if there is still free memory
+    if(available > 0) {
+    }
+}
+
+// The lookahead thread plans the invocation that followed this one last
+// time while this one's kernel runs, so that its launch only applies the
+// plan. A plan is taken if nothing it was computed from changed since.
+// PENGUIN_LOOKAHEAD=0 plans every launch at the launch.
+typedef struct
+{
+    bool started;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t requested;
+    bool pending;
+    unsigned invid;
+    unsigned long long memsize;
+    unsigned long long budget;
+    unsigned long long generation;
+    mmg_local_plan plan; // under the registry lock
+    std::map<unsigned, unsigned> successor; // invocation that last followed an invocation
+    unsigned last_invid;
+} penguin_lookahead_t;
+
+penguin_lookahead_t lookahead = {false, {}, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    false, 0, 0, 0, 0, {}, {}, 0};
+int lookahead_enabled = -1;
+
+bool penguin_lookahead_enabled() {
+    if(lookahead_enabled < 0) {
+        const char* env = getenv("PENGUIN_LOOKAHEAD");
+        lookahead_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return lookahead_enabled;
+}
+
+void* penguin_lookahead_planner(void*) {
+    while(true) {
+        pthread_mutex_lock(&lookahead.lock);
+        while(!lookahead.pending) {
+            pthread_cond_wait(&lookahead.requested, &lookahead.lock);
+        }
+        lookahead.pending = false;
+        unsigned invid = lookahead.invid;
+        unsigned long long memsize = lookahead.memsize;
+        unsigned long long budget = lookahead.budget;
+        unsigned long long generation = lookahead.generation;
+        pthread_mutex_unlock(&lookahead.lock);
+        penguin_registry_scope registry;
+        if(generation != mmg_input_generation) {
+            continue;
+        }
+        // steady state, the memo has it already
+        if(invid < mmg_invocation_memos.size() && mmg_invocation_memos[invid].generation == generation &&
+                mmg_invocation_memos[invid].memsize == memsize && mmg_invocation_memos[invid].gpu_memory == budget) {
+            continue;
+        }
+        /* std::cout << "lookahead planning invid " << invid << std::endl; */
+        PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %u", __func__, invid);
+        mmg_local_plan_compute(lookahead.plan, memsize, invid, budget);
+    }
+    return NULL;
+}
+
+// Asks for the plan of the invocation expected after invid, with the inputs
+// as they are now
+void penguin_lookahead_request(unsigned long long memsize, unsigned invid, unsigned long long budget) {
+    if(lookahead.last_invid != 0) {
+        lookahead.successor[lookahead.last_invid] = invid;
+    }
+    lookahead.last_invid = invid;
+    auto next = lookahead.successor.find(invid);
+    if(next == lookahead.successor.end() || !penguin_lookahead_enabled()) {
+        return;
+    }
+    pthread_mutex_lock(&lookahead.lock);
+    if(!lookahead.started) {
+        lookahead.started = pthread_create(&lookahead.thread, NULL, penguin_lookahead_planner, NULL) == 0;
+        if(lookahead.started) {
+            pthread_detach(lookahead.thread);
+        }
+    }
+    if(lookahead.started) {
+        lookahead.pending = true;
+        lookahead.invid = next->second;
+        lookahead.memsize = memsize;
+        lookahead.budget = budget;
+        lookahead.generation = mmg_input_generation;
+        pthread_cond_signal(&lookahead.requested);
+    }
+    pthread_mutex_unlock(&lookahead.lock);
+}
 
-// Take the memory size (can also get from this file, or by querying APIs),
-// and the invocation ID;
-// Then for each allocation used in the invocation, takes appropriate action
-extern "C"
-void perform_memory_management(unsigned long long memsize, unsigned invid) {
-    /* std::cout << "perform mem mgmt\n"; */
-    bool has_pchase = false;
-    bool has_unknown = false;
-    if(!is_iterative) {
-        /* std::cout << "performing local memory mgmt for invid " << invid << std::endl; */
-        std::map<void*, unsigned long long> mmg_alloc_wss_map;
-        std::map<void*, unsigned long long> mmg_alloc_ac_map;
-        std::map<void*, bool> mmg_alloc_pchase_map;
-        std::map<void*, double> mmg_alloc_ad_map;
-        for (auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); a++) {
-            /* std::cout << a->first << " " << aid_ac_map[a->first] << " " << a->second << " "; */
-            // find the allocation
-            if(allocation_size_map[aid_allocation_map[a->first]] == 0) {
-                /* std::cout << "[inside] "; */
-                void * insideallocation = identify_memory_allocation(aid_allocation_map[a->first]);
-                /* std::cout << insideallocation << "\n"; */
-                allocation_size_map[aid_allocation_map[a->first]] = allocation_size_map[insideallocation];
-                // force onto the og allocation
-                aid_allocation_map[a->first] = insideallocation;
-            }
-        }
-        // compute reuse distance at the first invocation
-        if(invid == 1) {
-        }
-        /* std::cout << "working set size map\n"; */
-        for (auto a = aid_wss_map.begin(); a != aid_wss_map.end(); a++) {
-            if(aid_invocation_id_map[a->first] == invid) {
-                /* std::cout << a->first << " " << a->second << "\n"; */
-                if(mmg_alloc_wss_map[aid_allocation_map[a->first]] < a->second) {
-                    mmg_alloc_wss_map[aid_allocation_map[a->first]] = a->second;
-                }
-            }
+// The plan computed ahead for this launch, if its inputs are still the same
+bool penguin_lookahead_take(mmg_local_plan& plan, unsigned long long memsize, unsigned invid,
+        unsigned long long budget) {
+    mmg_local_plan& ahead = lookahead.plan;
+    if(ahead.generation != mmg_input_generation || ahead.invid != invid ||
+            ahead.memsize != memsize || ahead.budget != budget) {
+        return false;
+    }
+    plan = std::move(ahead);
+    ahead.generation = 0;
+    /* std::cout << "lookahead plan for invid " << invid << std::endl; */
+    return true;
+}
+
+// Shapes of the launches of each invocation. With PENGUIN_SHAPE_FILE set the
+// run writes there, at exit, the PENGUIN_SHAPE_CLASSES most frequent grid and
+// block shapes of each invocation, a line "invid gx gy gz bx by bz" each,
+// which -penguin-shape-classes gives the host transform.
+#define PENGUIN_SHAPE_CLASSES 4
+std::map<unsigned, std::map<std::vector<unsigned>, unsigned long long>> shape_counts;
+int shape_file_enabled = -1;
+
+void penguinShapeSave() {
+    FILE* f = fopen(getenv("PENGUIN_SHAPE_FILE"), "w");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", getenv("PENGUIN_SHAPE_FILE"));
+        return;
+    }
+    for(auto i = shape_counts.begin(); i != shape_counts.end(); i++) {
+        std::vector<std::pair<unsigned long long, std::vector<unsigned>>> shapes;
+        for(auto c = i->second.begin(); c != i->second.end(); c++) {
+            shapes.push_back(std::make_pair(c->second, c->first));
         }
-        for (auto a = aid_pchase_map.begin(); a != aid_pchase_map.end(); a++) {
-            /* std::cout << a->first << " pchase\n"; */
-            has_pchase = true;
-            mmg_alloc_pchase_map[aid_allocation_map[a->first]] = true;
-        }
-        for (auto a = aid_ac_incomp_map.begin(); a != aid_ac_incomp_map.end(); a++) {
-            has_unknown = true;
-        }
-        /* std::cout << "access count map\n"; */
-        for (auto a = aid_ac_map.begin(); a != aid_ac_map.end(); a++) {
-            if(aid_invocation_id_map[a->first] == invid) {
-                /* std::cout << a->first << " " << a->second << "\n"; */
-                mmg_alloc_ac_map[aid_allocation_map[a->first]] += a->second;
-            }
-        }
-        /* std::cout << "access density map\n"; */
-        std::vector<std::pair<void*, float>> mmg_alloc_ad_vector_invid;
-        /* std::vector<std::pair<void*, State>> mmg_alloc_decision_vector_invid; */
-        std::map<void*, State> mmg_alloc_decision_map_invid; // decision for upcoming iterations
-        std::map<void*, unsigned long long> mmg_alloc_length_map_invid; // decision for upcoming iterations
-        for (auto a = mmg_alloc_ac_map.begin(); a != mmg_alloc_ac_map.end(); a++) {
-            mmg_alloc_ad_map[a->first] = (double) a->second / allocation_size_map[a->first];
-            /* std::cout << a->first << " " << mmg_alloc_ad_map[a->first] << std::endl; */
-            mmg_alloc_ad_vector_invid.push_back(std::pair<void*, float>(a->first, mmg_alloc_ad_map[a->first]));
-        }
-        std::sort(mmg_alloc_ad_vector_invid.begin(),
-                mmg_alloc_ad_vector_invid.end(), sortfuncf);
-        /* std::cout << "sorted \n"; */
-        unsigned locally_available = available;
-        for(auto a = mmg_alloc_ad_vector_invid.begin();
-                a != mmg_alloc_ad_vector_invid.end(); a++) {
-            /* std::cout << a->first << " " << a->second << "\n"; */
+        std::stable_sort(shapes.begin(), shapes.end(),
+                [](const std::pair<unsigned long long, std::vector<unsigned>>& a,
+                   const std::pair<unsigned long long, std::vector<unsigned>>& b) { return a.first > b.first; });
+        for(size_t c = 0; c < shapes.size() && c < PENGUIN_SHAPE_CLASSES; c++) {
+            const std::vector<unsigned>& d = shapes[c].second;
+            fprintf(f, "%u %u %u %u %u %u %u\n", i->first, d[0], d[1], d[2], d[3], d[4], d[5]);
         }
+    }
+    fclose(f);
+}
 
-        unsigned long long total_memory_used = 0;
-        for(auto a = allocation_size_map.begin(); a != allocation_size_map.end(); a++) {
-            total_memory_used += a->second;
+void penguin_shape_count(unsigned invid) {
+    if(shape_file_enabled < 0) {
+        shape_file_enabled = getenv("PENGUIN_SHAPE_FILE") != NULL;
+        if(shape_file_enabled) {
+            atexit(penguinShapeSave);
         }
+    }
+    if(!shape_file_enabled || launch_shape.blocks == 0) {
+        return;
+    }
+    std::vector<unsigned> shape(launch_shape.grid, launch_shape.grid + 3);
+    shape.insert(shape.end(), launch_shape.block, launch_shape.block + 3);
+    shape_counts[invid][shape]++;
+}
 
-        // Actual decision
-        available = gpu_memory;
-        /* std::cout << available <<  std::endl; */
-        unsigned long long total_available = gpu_memory;
+// Plan of an invocation for one of its shape classes, the index the host
+// transform's guard gives the launch. Launches of different shapes change
+// the aid maps and so the generation every time; the plan of a class holds
+// while the allocations stay the same and the aid maps hold what they did
+// when it was computed.
+typedef struct
+{
+    unsigned long long structure; // generation less the aid map updates
+    unsigned long long fingerprint;
+    mmg_local_plan plan;
+} mmg_shape_plan;
+std::map<std::pair<unsigned, unsigned>, mmg_shape_plan> mmg_shape_plans;
+
+mmg_shape_plan* mmg_shape_plan_find(unsigned invid, unsigned shape, unsigned long long memsize,
+        unsigned long long budget) {
+    auto p = mmg_shape_plans.find(std::make_pair(invid, shape));
+    if(p == mmg_shape_plans.end() || p->second.structure != mmg_input_generation - mmg_aid_updates ||
+            p->second.fingerprint != mmg_aid_fingerprint || p->second.plan.memsize != memsize ||
+            p->second.plan.budget != budget) {
+        return NULL;
+    }
+    return &p->second;
+}
 
-        /* std::cout << "actual decision\n"; */
-        if(available > 0) {
-            if(has_pchase || has_unknown) {
-                /* std::cout << "hi enable access counters\n"; */
-                penguinEnableAccessCounters();
-                /* return; */
+// Launch of invid in shape class shape, 0 for none
+void mmg_perform_local(unsigned long long memsize, unsigned invid, unsigned shape) {
+    /* std::cout << "perform mem mgmt\n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %u", __func__, invid);
+    penguin_trace(PENGUIN_TRACE_LAUNCH, invid, 0);
+    penguin_record_sites_launched(invid);
+    penguin_shape_count(invid);
+    penguinBudgetUpdate();
+    penguin_host_tiers_place();
+    penguinBeladySchedule(invid);
+    penguin_next_use_hints(invid);
+    penguin_fault_replay_hint(invid);
+    penguin_overrides_poll();
+    if(penguinProfileApply()) {
+        return;
+    }
+    // the samples of the launches so far, see penguin_ac_sampling
+    if(penguin_ac_sampling_active()) {
+        penguinEventRingDrain();
+        penguin_ac_sample_advance();
+    }
+    if(!is_iterative) {
+        // steady state: same inputs as at the last decision for this invocation
+        unsigned long long budget = penguin_scope_budget(launch_stream);
+        if(invid < mmg_invocation_memos.size()) {
+            const mmg_invocation_memo& memo = mmg_invocation_memos[invid];
+            if(memo.generation == mmg_input_generation && memo.memsize == memsize &&
+                    memo.gpu_memory == budget) {
+                available = memo.available;
+                penguin_scope_reserve(launch_stream, invid, budget > available ? budget - available : 0);
+                penguin_prefetch_waves();
+                penguin_prefetch_consumers();
+                penguin_lookahead_request(memsize, invid, budget);
+                return;
             }
-            for(auto a = mmg_alloc_pchase_map.begin(); a != mmg_alloc_pchase_map.end(); a++) {
-                auto dsize = allocation_size_map[a->first];
-                /* std::cout << std::endl << a->first << "size = " << dsize << std::endl; */
-                /* std::cout << "av = " << available << std::endl; */
-                if(AllocationStateMap[a->first] == PENGUIN_STATE_AC) {
-                } else {
-                    AllocationStateMap[a->first] = PENGUIN_STATE_AC;
-                    /* std::cout << a->first << " " << available << std::endl; */
-                        unsigned long long size = (dsize *total_available)/ total_memory_used;
-                    if(available > 0) {
-                        if(available > size) {
-                            /* std::cout << "case A\n"; */
-                            /* size = (dsize * 2) / 3; */
-                            available -= size;
-                        } else {
-                            /* std::cout << "case B. ought not to come here\n"; */
-                            size = available - 10 * 1024ULL*1024ULL;
-                            available -= size;
-                        }
-                    } else {
-                            /* std::cout << "case C\n"; */
-                        size = 0;
-                    }
-                    /* std::cout << "qeeping " << size << "for pointer chase\n"; */
-                    /* cudaMemPrefetchAsync((char*)a->first, size, 0, 0 ); */
-
-                }
+        }
+        mmg_shape_plan* cached = shape != 0 ? mmg_shape_plan_find(invid, shape, memsize, budget) : NULL;
+        if(cached != NULL) {
+            /* std::cout << "shape class " << shape << " plan for invid " << invid << std::endl; */
+            mmg_local_plan_apply(cached->plan);
+        } else {
+            mmg_local_plan plan;
+            if(!penguin_lookahead_take(plan, memsize, invid, budget)) {
+                /* std::cout << "performing local memory mgmt for invid " << invid << std::endl; */
+                mmg_local_plan_compute(plan, memsize, invid, budget);
             }
-            for(auto a = mmg_alloc_ad_vector_invid.begin();
-                    a != mmg_alloc_ad_vector_invid.end(); a++) {
-                /* if */
-                                        void *addr = a->first;
-                                        addr = round_down(addr);
-                auto dsize = allocation_size_map[addr];
-                /* std::cout << std::endl << addr << "size = " << dsize << std::endl; */
-                /* std::cout << "av = " << available << std::endl; */
-                if(mmg_alloc_pchase_map.find(a->first) != mmg_alloc_pchase_map.end()) {
-                    /* std::cout << "dominated by pchase\n"; */
-                    continue;
-                }
-                if(mmg_alloc_wss_map.find(a->first) != mmg_alloc_wss_map.end()){
-                    auto awss = mmg_alloc_wss_map.find(a->first);
-                    auto dsize = allocation_size_map[a->first];
-                    /* std::cout << a->first << " " << awss->second << std::endl; */
-                    auto ad = mmg_alloc_ad_map[a->first];
-                    if(available < 2*1024*1024 && has_pchase) { // hard to place small regions
-                        /* std::cout << "leave to pchase\n"; */
-                        continue;
-                    }
-                    if(awss->second < dsize && dsize > 2* 1024*1024 && ad > 5) { //TODO:keep low ad temporal on CPU, unless these is left over memory even after reserving enough for the entire temporal
-                        /* std::cout << "temporal\n"; */
-                        available -= awss->second;
-                        /* std::cout << available <<  std::endl; */
-                        /* cudaMemPrefetchAsync((char*)a->first, dsize, 0, 0 ); */
-                        mmg_alloc_decision_map_invid[a->first] = PENGUIN_STATE_GPU;
-                    } else {
-                        if(mmg_alloc_ad_map[a->first] > 5.0) {
-                            if(available > dsize) {
-                                if(AllocationStateMap[addr] == PENGUIN_STATE_GPU_PINNED) {
-                                    AllocationStateMap[addr] = PENGUIN_STATE_GPU_PINNED;
-                                }  else {
-                                    /* std::cout << "gpu pin A\n"; */
-                                    AllocationStateMap[addr] = PENGUIN_STATE_GPU_PINNED;
-                                    penguinSetPrioritizedLocation((char*) a->first, dsize, 0);
-                                    cudaMemPrefetchAsync((char*)a->first, dsize, 0, 0 );
-                                available -= dsize;
-                        /* std::cout << available <<  std::endl; */
-                                    pinned_memory += dsize;
-                        /* std::cout << "pinned = " << pinned_memory << std::endl; */
-                                }
-                            } else {
-                                if(AllocationStateMap[addr] == PENGUIN_STATE_GPU_PINNED) {
-                                }  else {
-                                    /* std::cout << "gpu pin B\n"; */
-                                    AllocationStateMap[addr] = PENGUIN_STATE_GPU_PINNED;
-                                    penguinSetPrioritizedLocation((char*) a->first, available, 0);
-                                    cudaMemPrefetchAsync((char*)a->first, available, 0, 0 );
-                                    /* std::cout << "cpu pin rest B\n"; */
-                                    cudaMemAdvise((char*) a->first + available, dsize - available, cudaMemAdviseSetAccessedBy, 0);
-                                    pinned_memory += available;
-                        /* std::cout << "pinned = " << pinned_memory << std::endl; */
-                                    available = 0;
-                        /* std::cout << available <<  std::endl; */
-                                }
-                            }
-                        } else {
-                            if(!has_pchase) {
-                                if(AllocationStateMap[a->first] == PENGUIN_STATE_GPU_PINNED) {
-                                }  else {
-                                    if(available > dsize) {
-                                        /* std::cout << "gpu pin c.1\n"; */
-                                        AllocationStateMap[addr] = PENGUIN_STATE_GPU_PINNED;
-                                        penguinSetPrioritizedLocation((char*) a->first, dsize, 0);
-                                        cudaMemPrefetchAsync((char*)a->first, dsize, 0, 0 );
-                                        available -= dsize;
-                                        /* std::cout << available <<  std::endl; */
-                                    pinned_memory += dsize;
-                        /* std::cout << "pinned = " << pinned_memory << std::endl; */
-                                    } else {
-                                        /* std::cout << "gpu pin c.2\n"; */
-                                        /* std::cout << "cpu pin rest c.2\n"; */
-                                        AllocationStateMap[addr] = PENGUIN_STATE_GPU_PINNED;
-                                        cudaMemPrefetchAsync((char*)a->first, available, 0, 0 );
-                                        cudaMemAdvise((char*) a->first +available, dsize -available, cudaMemAdviseSetAccessedBy, 0);
-                                    pinned_memory += available;
-                        /* std::cout << "pinned = " << pinned_memory << std::endl; */
-                                        available = 0;
-                                        /* std::cout << available <<  std::endl; */
-                                    }
-                                }
-                            } else {
-                                /* std::cout << "cpu pin rest D\n"; */
-                                cudaMemAdvise((char*) a->first , dsize, cudaMemAdviseSetAccessedBy, 0);
-                                penguinSetNoMigrateRegion((char*) a->first, dsize, 0, true);
-                            }
-                        }
-                    }
-                    /* std::cout << "\navailable = " << available << std::endl; */
-                }
+            mmg_local_plan_apply(plan);
+            if(shape != 0) {
+                mmg_shape_plan& s = mmg_shape_plans[std::make_pair(invid, shape)];
+                s.structure = mmg_input_generation - mmg_aid_updates;
+                s.fingerprint = mmg_aid_fingerprint;
+                s.plan = std::move(plan);
             }
         }
-
-        // if there is still free memory
-        if(available > 0) {
+        if(invid >= mmg_invocation_memos.size()) {
+            mmg_invocation_memos.resize(invid + 1, mmg_invocation_memo{0, 0, 0, 0});
         }
+        mmg_invocation_memos[invid] = mmg_invocation_memo{mmg_input_generation, memsize,
+            budget, available};
+        penguin_scope_reserve(launch_stream, invid, budget > available ? budget - available : 0);
+        penguin_prefetch_waves();
+        penguin_prefetch_consumers();
+        penguin_lookahead_request(memsize, invid, budget);
     }
     return;
 }
 
+extern "C"
+void perform_memory_management(unsigned long long memsize, unsigned invid) {
+    PENGUIN_LOCKED_ENTRY();
+    mmg_perform_local(memsize, invid, 0);
+}
+
+// The host transform's -penguin-shape-classes calls this for the launches
+// its guard put in a shape class
+extern "C"
+void perform_memory_management_shape(unsigned long long memsize, unsigned invid, unsigned shape) {
+    PENGUIN_LOCKED_ENTRY();
+    mmg_perform_local(memsize, invid, shape);
+}
+
 extern "C"
 void MemoryMgmtFirstInvocationNonIter() {
+    PENGUIN_LOCKED_ENTRY();
     /* std::cout <<"MemoryMgmtFirstInvocationNonIter\n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s", __func__);
     /* std::cout << "data from reuse\n"; */
-    std::map<unsigned, std::set<void*>> mmg_invid_alloc_list;
+    penguinBudgetUpdate();
+    belady_invid_alloc_map.clear();
+    belady_next_use_map.clear();
+    belady_max_invid = 0;
     for (auto a = aid_ac_map_reuse.begin(); a != aid_ac_map_reuse.end(); a++) {
         /* std::cout << a->first << "  " << a->second << " " << aid_allocation_map_reuse[a->first] << std::endl; */
-        auto alloc = aid_allocation_map_reuse[a->first];
+        void* alloc = alias_interior_pointer(aid_allocation_map_reuse[a->first]);
         auto invid = aid_invocation_id_map_reuse[a->first];
-        mmg_invid_alloc_list[invid].insert(alloc);
+        if(alloc == 0 || allocation_desc(alloc).size == 0) {
+            continue;
+        }
+        belady_invid_alloc_map[invid].insert(alloc);
+        if(invid > belady_max_invid) {
+            belady_max_invid = invid;
+        }
+    }
+    /* std::cout << "max invid = " << belady_max_invid << std::endl; */
+    // single reverse sweep: next use of each allocation after every invocation,
+    // wrapping around to its first use
+    std::map<void*, unsigned> next_use;
+    for(auto i = belady_invid_alloc_map.begin(); i != belady_invid_alloc_map.end(); i++) {
+        for(auto a = i->second.begin(); a != i->second.end(); a++) {
+            if(next_use.find(*a) == next_use.end()) {
+                next_use[*a] = i->first + belady_max_invid;
+            }
+        }
     }
-    /* std::cout << "invid to alloc list\n"; */
-    unsigned max_invid = 0;
-    for(auto i = mmg_invid_alloc_list.begin(); i != mmg_invid_alloc_list.end(); i++) {
-        /* std::cout << i->first << " :  "; */
-        if(i->first > max_invid) {
-            max_invid = i->first;
+    for(auto i = belady_invid_alloc_map.rbegin(); i != belady_invid_alloc_map.rend(); i++) {
+        for(auto a = i->second.begin(); a != i->second.end(); a++) {
+            belady_next_use_map[i->first][*a] = next_use[*a];
+            /* std::cout << *a << " used at " << i->first << " next at " << next_use[*a] << std::endl; */
         }
         for(auto a = i->second.begin(); a != i->second.end(); a++) {
-            /* std::cout << *a << " "; */
-        }
-        /* std::cout << std::endl; */
-    }
-    /* std::cout << "max invid = " << max_invid << std::endl; */
-    /* for each allocation, for each invocation, compute the next reuse */
-    std::map<void*, std::map<unsigned, unsigned>> alloc_inv_resinv_map;
-    for(auto alloc = allocation_size_map.begin(); alloc != allocation_size_map.end(); alloc++) {
-        /* std::cout << alloc->first << std::endl; */
-        for (auto c = 1; c <= max_invid; c++) {
-            /* std::cout << c << std::endl; */
-            unsigned nearest_reuse = 1000 ;
-            for(auto i = mmg_invid_alloc_list.begin(); i != mmg_invid_alloc_list.end(); i++) {
-                if(i->second.find(alloc->first) != i->second.end()) {
-                    /* std::cout << "reuse at " << i->first << std::endl; */
-                    if(i->first > c && i->first < nearest_reuse) {
-                        nearest_reuse = i->first;
-                    }
+            next_use[*a] = i->first;
+        }
+    }
+    /* std::cout << "end MemoryMgmtFirstInvocationNonIter\n"; */
+}
+
+/* Static placement, the SC baseline: -penguin-policy=static, and the launches
+ * of -penguin-policy=hybrid whose accesses were fully analysed. Allocations
+ * are ordered by reuse distance, then by global locality (total access count),
+ * and pinned in that order. The state is kept apart from the dynamic
+ * placement above so that the two can share a binary. */
+#define SC_NO_REUSE 1000
+
+unsigned long long SCAvail = gpu_memory; // GPU memory not held by static pins
+unsigned long long sc_budget = gpu_memory; // gpu_memory SCAvail is part of
+std::map<void*, unsigned long long> SCGPUResidentAllocs;
+std::map<void*, State> SCState;
+std::map<unsigned, std::set<void*>> sc_invid_alloc_map;
+std::map<void*, std::map<unsigned, unsigned>> sc_next_use_map; // alloc -> invid -> next use
+std::map<void*, unsigned long long> sc_global_locality_map;
+std::map<unsigned, std::vector<void*>> sc_invid_order_map; // invid -> allocations, in pin order
+unsigned sc_max_invid = 0;
+
+// Builds the tables above from the reuse records. With wrap, an allocation
+// that is not used again in the iteration is next used at its first use in the
+// next one; otherwise it is never reused.
+void sc_plan_reuse(bool wrap) {
+    sc_invid_alloc_map.clear();
+    sc_next_use_map.clear();
+    sc_global_locality_map.clear();
+    sc_invid_order_map.clear();
+    sc_max_invid = 0;
+    for (auto a = aid_ac_map_reuse.begin(); a != aid_ac_map_reuse.end(); a++) {
+        void* alloc = alias_interior_pointer(aid_allocation_map_reuse[a->first]);
+        if(alloc == 0 || allocation_desc(alloc).size == 0) {
+            continue;
+        }
+        auto invid = aid_invocation_id_map_reuse[a->first];
+        sc_invid_alloc_map[invid].insert(alloc);
+        sc_global_locality_map[alloc] += a->second;
+        if(invid > sc_max_invid) {
+            sc_max_invid = invid;
+        }
+    }
+    for(auto a = sc_global_locality_map.begin(); a != sc_global_locality_map.end(); a++) {
+        SCState[a->first] = PENGUIN_STATE_UNKNOWN;
+    }
+    if(!wrap && sc_max_invid < 2) {
+        return;
+    }
+    std::map<void*, unsigned> next_use;
+    if(wrap) {
+        for(auto i = sc_invid_alloc_map.begin(); i != sc_invid_alloc_map.end(); i++) {
+            for(auto a = i->second.begin(); a != i->second.end(); a++) {
+                if(next_use.find(*a) == next_use.end()) {
+                    next_use[*a] = i->first + sc_max_invid;
                 }
             }
-            /* std::cout << "nearest reuse is " << nearest_reuse << std::endl; */
-            alloc_inv_resinv_map[alloc->first][c] = nearest_reuse;
         }
     }
-    /* std::cout << "end MemoryMgmtFirstInvocationNonIter\n"; */
+    for(auto i = sc_invid_alloc_map.rbegin(); i != sc_invid_alloc_map.rend(); i++) {
+        for(auto a = i->second.begin(); a != i->second.end(); a++) {
+            auto n = next_use.find(*a);
+            sc_next_use_map[*a][i->first] = (n == next_use.end()) ? SC_NO_REUSE : n->second;
+        }
+        for(auto a = i->second.begin(); a != i->second.end(); a++) {
+            next_use[*a] = i->first;
+        }
+    }
+    for(auto i = sc_invid_alloc_map.begin(); i != sc_invid_alloc_map.end(); i++) {
+        unsigned invid = i->first;
+        std::vector<void*> &order = sc_invid_order_map[invid];
+        order.assign(i->second.begin(), i->second.end());
+        std::stable_sort(order.begin(), order.end(), [invid](void* a, void* b) {
+            unsigned ra = sc_next_use_map[a][invid], rb = sc_next_use_map[b][invid];
+            if(ra != rb) {
+                return ra < rb;
+            }
+            return sc_global_locality_map[a] > sc_global_locality_map[b];
+        });
+    }
+}
+
+extern "C"
+void perform_memory_management_iterative_static() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "mm iterative (static)\n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s", __func__);
+    sc_plan_reuse(true);
+}
+
+extern "C"
+void MemoryMgmtFirstInvocationNonIterStatic() {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout <<"MemoryMgmtFirstInvocationNonIter (static)\n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s", __func__);
+    sc_plan_reuse(false);
+}
+
+// Evicts static pins that are reused later than alloc until req bytes are
+// free; returns the free bytes
+unsigned long long sc_make_room(void* alloc, unsigned invid, unsigned long long req,
+        unsigned long long &logical) {
+    auto my_reuse = sc_next_use_map[alloc][invid];
+    unsigned long long free_mem = SCAvail;
+    for(auto ec = SCGPUResidentAllocs.begin(); ec != SCGPUResidentAllocs.end() && free_mem < req; ) {
+        if(my_reuse < sc_next_use_map[ec->first][invid]) {
+            /* std::cout << "evict " << ec->first << std::endl; */
+            penguin_mem_prefetch((char*)ec->first, ec->second, -1, 0 );
+            SCState[ec->first] = PENGUIN_STATE_HOST;
+            SCAvail += ec->second;
+            free_mem += ec->second;
+            logical += ec->second;
+            SCGPUResidentAllocs.erase(ec++);
+        } else {
+            ec++;
+        }
+    }
+    return free_mem;
+}
+
+// Pins len bytes of alloc on the GPU, the rest is accessed from the host
+void sc_pin(void* alloc, unsigned long long len, unsigned long long dsize, State state) {
+    penguinSetPrioritizedLocation((char*) alloc, len, 0);
+    penguin_set_read_dup(alloc, len);
+    penguin_prefetch_pinned(alloc, len);
+    penguin_mem_advise((char*) alloc, dsize, cudaMemAdviseSetAccessedBy, 0);
+    SCGPUResidentAllocs[alloc] = len;
+    SCState[alloc] = state;
+    SCAvail -= len;
+}
+
+extern "C"
+void perform_memory_management_static(unsigned long long memsize, unsigned invid) {
+    PENGUIN_LOCKED_ENTRY();
+    /* std::cout << "perform mem mgmt (static)\n"; */
+    if(!penguin_planning()) {
+        return;
+    }
+    penguin_policy_batch_scope batch;
+    PENGUIN_NVTX_RANGE(PENGUIN_NVTX_PLAN, "%s %u", __func__, invid);
+    penguin_trace(PENGUIN_TRACE_LAUNCH, invid, 0);
+    penguinBudgetUpdate();
+    if(sc_budget != gpu_memory) {
+        // the pins stay, what is left follows the budget
+        unsigned long long held = sc_budget > SCAvail ? sc_budget - SCAvail : 0;
+        SCAvail = gpu_memory > held ? gpu_memory - held : 0;
+        sc_budget = gpu_memory;
+    }
+    unsigned long long logical = gpu_memory;  // logical availability
+    if(sc_max_invid < 2) {
+        // a single invocation: pin by global locality, once
+        if(!SCGPUResidentAllocs.empty()) {
+            return;
+        }
+        std::vector<std::pair<void*, unsigned long long>> by_locality(
+                sc_global_locality_map.begin(), sc_global_locality_map.end());
+        std::sort(by_locality.begin(), by_locality.end(), sortfunc);
+        for(auto al = by_locality.begin(); al != by_locality.end(); al++) {
+            unsigned long long dsize = allocation_desc(al->first).size;
+            if(logical > dsize) {
+                sc_pin(al->first, dsize, dsize, PENGUIN_STATE_GPU_PINNED);
+                logical -= dsize;
+            } else if(logical > 0) {
+                sc_pin(al->first, logical, dsize, PENGUIN_STATE_GPU_PINNED_PART);
+                logical = 0;
+            } else {
+                SCState[al->first] = PENGUIN_STATE_HOST;
+                penguin_mem_advise((char*) al->first, dsize, cudaMemAdviseSetAccessedBy, 0);
+            }
+        }
+        return;
+    }
+    auto order = sc_invid_order_map.find(invid);
+    if(order == sc_invid_order_map.end()) {
+        return;
+    }
+    for(auto al = order->second.begin(); al != order->second.end(); al++) {
+        unsigned long long dsize = allocation_desc(*al).size;
+        State &state = SCState[*al];
+        if(logical > dsize) {
+            if(state != PENGUIN_STATE_GPU_PINNED) {
+                unsigned long long free_mem = (SCAvail > dsize) ? SCAvail :
+                    sc_make_room(*al, invid, dsize, logical);
+                if(free_mem >= dsize) {
+                    sc_pin(*al, dsize, dsize, PENGUIN_STATE_GPU_PINNED);
+                } else if(free_mem > 0) {
+                    sc_pin(*al, free_mem, dsize, PENGUIN_STATE_GPU_PINNED_PART);
+                } else {
+                    state = PENGUIN_STATE_HOST;
+                    penguin_mem_advise((char*) *al, dsize, cudaMemAdviseSetAccessedBy, 0);
+                }
+            }
+            logical -= dsize;
+        } else if(logical > 0) {
+            if(state != PENGUIN_STATE_GPU_PINNED_PART) {
+                unsigned long long req = logical;
+                unsigned long long free_mem = (SCAvail > req) ? SCAvail :
+                    sc_make_room(*al, invid, req, logical);
+                if(free_mem >= req) {
+                    sc_pin(*al, req, dsize, PENGUIN_STATE_GPU_PINNED_PART);
+                } else {
+                    state = PENGUIN_STATE_HOST;
+                    penguin_mem_advise((char*) *al, dsize, cudaMemAdviseSetAccessedBy, 0);
+                }
+            }
+            logical = 0;
+        } else if(state != PENGUIN_STATE_HOST) {
+            state = PENGUIN_STATE_HOST;
+            penguin_mem_advise((char*) *al , dsize, cudaMemAdviseSetAccessedBy, 0);
+        }
+    }
+}
+
+// Drops the aids that point into [base, base + size) from the aid maps, so no
+// planner sees them until the instrumentation records them again, and the
+// allocation from the totals of the global planner
+void mmg_forget_allocation(void* base, unsigned long long size) {
+    auto inside = [base, size](void* ptr) {
+        return (unsigned long long) ptr - (unsigned long long) base < size;
+    };
+    for(auto a = aid_allocation_map.begin(); a != aid_allocation_map.end(); ) {
+        if(!inside(a->second)) {
+            a++;
+            continue;
+        }
+        unsigned aid = a->first;
+        aid_ac_map.erase(aid);
+        aid_wss_map_iterdep.erase(aid);
+        aid_wss_map.erase(aid);
+        aid_pchase_map.erase(aid);
+        aid_invocation_id_map.erase(aid);
+        aid_ac_incomp_map.erase(aid);
+        // retracts its contribution below
+        mmg_dirty_aids.insert(aid);
+        aid_allocation_map.erase(a++);
+    }
+    for(auto a = aid_allocation_map_reuse.begin(); a != aid_allocation_map_reuse.end(); ) {
+        if(!inside(a->second)) {
+            a++;
+            continue;
+        }
+        aid_ac_map_reuse.erase(a->first);
+        aid_invocation_id_map_reuse.erase(a->first);
+        aid_allocation_map_reuse.erase(a++);
+    }
+    mmg_attribute_dirty_aids();
+    mmg_alloc_aids_map.erase(base);
+    mmg_alloc_ac_map_iteronly.erase(base);
+    mmg_alloc_span_map_iteronly.erase(base);
+    mmg_alloc_wss_map.erase(base);
+    for(auto i = mmg_alloc_ac_map_invid.begin(); i != mmg_alloc_ac_map_invid.end(); i++) {
+        i->second.erase(base);
+    }
+    mmg_input_generation++;
+    mmg_allocation_freed = true;
+}
+
+// Drops the allocation from the reuse tables of the Belady and static
+// planners and gives back what they keep on the GPU for it
+unsigned long long penguin_forget_reuse(void* base) {
+    unsigned long long released = 0;
+    if(belady_resident_map.find(base) != belady_resident_map.end()) {
+        belady_evict(base);
+    }
+    for(auto i = belady_invid_alloc_map.begin(); i != belady_invid_alloc_map.end(); i++) {
+        i->second.erase(base);
+    }
+    for(auto i = belady_next_use_map.begin(); i != belady_next_use_map.end(); i++) {
+        i->second.erase(base);
+    }
+    auto sc = SCGPUResidentAllocs.find(base);
+    if(sc != SCGPUResidentAllocs.end()) {
+        released = sc->second;
+        SCAvail += sc->second;
+        SCGPUResidentAllocs.erase(sc);
+    }
+    SCState.erase(base);
+    sc_next_use_map.erase(base);
+    sc_global_locality_map.erase(base);
+    for(auto i = sc_invid_alloc_map.begin(); i != sc_invid_alloc_map.end(); i++) {
+        i->second.erase(base);
+    }
+    for(auto i = sc_invid_order_map.begin(); i != sc_invid_order_map.end(); i++) {
+        i->second.erase(std::remove(i->second.begin(), i->second.end(), base), i->second.end());
+    }
+    return released;
+}
+
+// The instrumentation calls this before every cudaFree. The allocation's pins
+// and prioritized ranges are dropped and its prefetch window and GPU share go
+// back to the budget; the planners forget it, and the next launch places the
+// others in what it held. Its ID and the pointers to it are free for the
+// allocations that come after.
+extern "C"
+void penguinFreeAllocation(void* ptr) {
+    PENGUIN_LOCKED_ENTRY();
+    // the arena releases the slab once all its objects are freed
+    if(penguin_arena_object_base(ptr)) {
+        return;
+    }
+    // and a split array of structs its split allocation
+    auto s = field_splits.find((unsigned long long) ptr);
+    if(s != field_splits.end()) {
+        char* split = s->second.split;
+        field_splits.erase(s);
+        if(split != NULL) {
+            penguinFreeAllocation(split);
+            cudaFree(split);
+        }
+    }
+    auto id = lookup_allocation_id(ptr);
+    if(id == PENGUIN_INVALID_ALLOC_ID || allocation_table[id].base != ptr ||
+            allocation_table[id].size == 0) {
+        return;
+    }
+    penguin_alloc_desc& desc = allocation_table[id];
+    /* std::cout << "freed " << desc.base << " " << desc.size << "\n"; */
+    unsigned long long released = 0;
+    if(desc.prefetch) {
+        desc.prefetch = false;
+        prefetch_alloc_ids.remove(id);
+        if(prefetch_alloc_ids.begin() == prefetch_alloc_ids.end()) {
+            penguin_prefetch_period = penguin_sub_range_period;
+        }
+        released += desc.prefetch_window;
+        available += std::min(desc.prefetch_window, gpu_memory - std::min(gpu_memory, available.load()));
+    }
+    penguin_unstage_ring(desc);
+    unsigned long long sc_released = penguin_forget_reuse(desc.base);
+    if(desc.state == PENGUIN_STATE_GPU_PINNED || sc_released) {
+        // partial pins may have moved their blocks anywhere in it
+        penguinUnsetPrioritizedLocation(desc.base, desc.size);
+    }
+    if(desc.state == PENGUIN_STATE_GPU_PINNED) {
+        unsigned long long resident = desc.gpu_res_stop;
+        pinned_memory -= std::min(pinned_memory, resident);
+        auto &room = penguin_device_available(desc.device);
+        unsigned long long memory = penguin_device_memory(desc.device);
+        room += std::min(resident, memory - std::min(memory, room.load()));
+        released += resident;
+    }
+    released += sc_released;
+    partial_pins.erase(id);
+    penguin_broadcast_release(id);
+    penguin_forget_sub_ranges(id);
+    ac_samples.erase(id);
+    profile_pending_ids.erase(std::remove(profile_pending_ids.begin(),
+                profile_pending_ids.end(), id), profile_pending_ids.end());
+    mmg_forget_allocation(desc.base, desc.size);
+    phase_allocations.erase(desc.base);
+    allocation_interval_map.erase((unsigned long long) desc.base);
+    penguin_trace(PENGUIN_TRACE_FREE, (unsigned long long) desc.base, released);
+    PENGUIN_NVTX_MARK(PENGUIN_NVTX_DECISION, "free %p %llu", desc.base, desc.size);
+
+    cudaEvent_t events[] = {desc.compute_start, desc.compute_stop, desc.xfer_start, desc.xfer_stop};
+    for(unsigned e = 0; e < sizeof(events) / sizeof(events[0]); e++) {
+        if(events[e] != NULL) {
+            cudaEventDestroy(events[e]);
+        }
+    }
+    allocation_id_map.erase_id(id);
+    penguin_alloc_desc freed = {};
+    freed.state = PENGUIN_STATE_UNKNOWN;
+    freed.decision = PENGUIN_DEC_NONE;
+    desc = freed;
+    allocation_free_ids.push_back(id);
+}
+
+// Site densities of the arena, kept from one run to the next like the
+// placement profile
+typedef struct
+{
+    unsigned long long magic;
+    unsigned long long binary;
+    unsigned count;
+} penguin_arena_header;
+
+typedef struct
+{
+    unsigned site;
+    float density;
+} penguin_arena_record;
+
+bool arena_loaded = false;
+int arena_enabled = -1;
+
+bool penguin_arena_enabled() {
+    if(arena_enabled < 0) {
+        const char* env = getenv("PENGUIN_ARENA");
+        arena_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return arena_enabled;
+}
+
+const char* penguin_arena_path() {
+    const char* path = getenv("PENGUIN_ARENA_FILE");
+    return path ? path : PENGUIN_ARENA_FILE;
+}
+
+// accesses per byte, < 0 while unknown
+float penguin_arena_density(const penguin_arena_site& site) {
+    if(site.ac != 0 && site.bytes != 0) {
+        return (float) site.ac / (float) site.bytes;
+    }
+    return site.density;
+}
+
+void penguinArenaSave() {
+    std::vector<penguin_arena_record> records;
+    for(auto s = arena_sites.begin(); s != arena_sites.end(); s++) {
+        float density = penguin_arena_density(s->second);
+        if(density >= 0) {
+            records.push_back(penguin_arena_record{s->first, density});
+        }
+    }
+    if(records.empty()) {
+        return;
+    }
+    penguin_arena_header header = {};
+    header.magic = PENGUIN_ARENA_MAGIC;
+    header.binary = penguin_profile_binary();
+    header.count = records.size();
+    std::string path = penguin_arena_path();
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if(f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", tmp.c_str());
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(records.data(), sizeof(penguin_arena_record), records.size(), f) == records.size();
+    ok &= fclose(f) == 0;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        unlink(tmp.c_str());
+    }
+}
+
+void penguinArenaLoad() {
+    arena_loaded = true;
+    atexit(penguinArenaSave);
+    FILE* f = fopen(penguin_arena_path(), "rb");
+    if(f == NULL) {
+        return;
+    }
+    penguin_arena_header header;
+    if(fread(&header, sizeof(header), 1, f) == 1 && header.magic == PENGUIN_ARENA_MAGIC &&
+            header.binary == penguin_profile_binary()) {
+        std::vector<penguin_arena_record> records(header.count);
+        if(fread(records.data(), sizeof(penguin_arena_record), records.size(), f) == records.size()) {
+            for(auto r = records.begin(); r != records.end(); r++) {
+                arena_sites[r->site].density = r->density;
+            }
+        }
+    }
+    fclose(f);
+}
+
+// Class of the objects of a site, by its density against the mean of the
+// sites whose density is known
+ArenaClass penguin_arena_class(unsigned site) {
+    if(site == PENGUIN_ARENA_NO_SITE) {
+        return PENGUIN_ARENA_UNKNOWN;
+    }
+    float density = penguin_arena_density(arena_sites[site]);
+    if(density < 0) {
+        return PENGUIN_ARENA_UNKNOWN;
+    }
+    double sum = 0;
+    unsigned known = 0;
+    for(auto s = arena_sites.begin(); s != arena_sites.end(); s++) {
+        float d = penguin_arena_density(s->second);
+        if(d >= 0) {
+            sum += d;
+            known++;
+        }
+    }
+    double mean = sum / known;
+    if(density > mean * PENGUIN_ARENA_HOT_RATIO) {
+        return PENGUIN_ARENA_HOT;
+    }
+    if(density * PENGUIN_ARENA_HOT_RATIO < mean) {
+        return PENGUIN_ARENA_COLD;
+    }
+    return PENGUIN_ARENA_WARM;
+}
+
+// An empty slab, registered as an allocation; the driver gives the arena
+// PENGUIN_ARENA_REGION_SLABS of them at a time, over-allocated so that they
+// start on va_block boundaries, and the arena keeps them until the exit.
+// 0 if the driver has no more.
+unsigned long long penguin_arena_take_slab() {
+    if(arena_empty_slabs.empty()) {
+        void* region = NULL;
+        if(cudaMallocManaged(&region, (PENGUIN_ARENA_REGION_SLABS + 1) * PENGUIN_ARENA_SLAB) != cudaSuccess) {
+            return 0;
+        }
+        unsigned long long first = ((unsigned long long) region + PENGUIN_ARENA_SLAB - 1) &
+            ~(PENGUIN_ARENA_SLAB - 1);
+        // lowest address first
+        for(unsigned s = PENGUIN_ARENA_REGION_SLABS; s-- > 0; ) {
+            arena_empty_slabs.push_back(first + s * PENGUIN_ARENA_SLAB);
+        }
+    }
+    unsigned long long slab = arena_empty_slabs.back();
+    arena_empty_slabs.pop_back();
+    penguin_register_allocation((void*) slab, PENGUIN_ARENA_SLAB);
+    return slab;
+}
+
+// The instrumentation calls this just before penguinArenaMallocManaged
+extern "C"
+void penguinArenaSite(unsigned site) {
+    PENGUIN_ENTRY();
+    arena_next_site = site;
+}
+
+// cudaMallocManaged of the instrumented program. Objects too large for a
+// slab, host attached ones and all of them under PENGUIN_ARENA=0 get their
+// own allocation as before.
+extern "C"
+cudaError_t penguinArenaMallocManaged(void** ptr, size_t size, unsigned flags) {
+    PENGUIN_LOCKED_ENTRY();
+    unsigned site = arena_next_site;
+    arena_next_site = PENGUIN_ARENA_NO_SITE;
+    if(!penguin_arena_enabled() || size == 0 || size > PENGUIN_ARENA_MAX_OBJECT ||
+            flags != cudaMemAttachGlobal) {
+        return cudaMallocManaged(ptr, size, flags);
+    }
+    if(!arena_loaded) {
+        penguinArenaLoad();
+    }
+    ArenaClass cls = penguin_arena_class(site);
+    unsigned long long bytes = (size + PENGUIN_ARENA_ALIGN - 1) & ~(PENGUIN_ARENA_ALIGN - 1);
+    unsigned long long slab = arena_current[cls];
+    if(slab == 0 || arena_slabs[slab].used + bytes > PENGUIN_ARENA_SLAB) {
+        // a full slab goes once its last object is freed
+        slab = penguin_arena_take_slab();
+        if(slab == 0) {
+            return cudaMallocManaged(ptr, size, flags);
+        }
+        arena_slabs[slab] = penguin_arena_slab{0, 0, cls};
+        arena_current[cls] = slab;
+    }
+    penguin_arena_slab& s = arena_slabs[slab];
+    unsigned long long base = slab + s.used;
+    s.used += bytes;
+    s.live += bytes;
+    arena_objects[base] = penguin_arena_object{bytes, site};
+    if(site != PENGUIN_ARENA_NO_SITE) {
+        arena_sites[site].bytes += bytes;
+    }
+    /* std::cout << "arena " << site << " class " << cls << " " << (void*) base << " " << size << "\n"; */
+    *ptr = (void*) base;
+    return cudaSuccess;
+}
+
+// cudaFree of the instrumented program. It waits for the device as cudaFree
+// does, since the object's bytes may be handed out again right away. A slab
+// whose objects are all freed is filled again from its start if it is the
+// one its class allocates from, and otherwise forgotten by the planners and
+// kept for any class.
+extern "C"
+cudaError_t penguinArenaFree(void* ptr) {
+    PENGUIN_LOCKED_ENTRY();
+    auto o = arena_objects.find((unsigned long long) ptr);
+    if(o == arena_objects.end()) {
+        return cudaFree(ptr);
+    }
+    cudaError_t err = cudaDeviceSynchronize();
+    unsigned long long slab = o->first & ~(PENGUIN_ARENA_SLAB - 1);
+    unsigned long long bytes = o->second.size;
+    arena_objects.erase(o);
+    penguin_arena_slab& s = arena_slabs[slab];
+    s.live -= bytes;
+    if(s.live != 0) {
+        return err;
+    }
+    if(arena_current[s.cls] == slab) {
+        s.used = 0;
+        return err;
+    }
+    arena_slabs.erase(slab);
+    penguinFreeAllocation((void*) slab);
+    arena_empty_slabs.push_back(slab);
+    return err;
+}
+
+// Managed-backed pools. With -penguin-managed-pool the instrumentation sends
+// the program's cudaMallocAsync, cudaMallocFromPoolAsync, cudaFreeAsync,
+// cudaMemPoolCreate and cudaMemPoolDestroy calls here. Stream-ordered
+// allocations become managed allocations the planners place, prefetch and
+// evict like the others, and so may oversubscribe the device. Each pool
+// keeps the blocks freed from it by size class, powers of two up to
+// PENGUIN_PLACEMENT_UNIT and its multiples above, for the next allocations:
+// on the stream that freed a block right away, as the stream orders them,
+// and on the other streams once the event recorded at the free has passed,
+// so that an allocation seldom waits for cudaMallocManaged.
+// PENGUIN_MANAGED_POOL=0 leaves them to the CUDA pools.
+#define PENGUIN_POOL_MIN_BLOCK 4096ULL
+// freed bytes a pool keeps; blocks beyond go back to the driver
+#ifndef PENGUIN_POOL_CACHE_MB
+#define PENGUIN_POOL_CACHE_MB 1024
+#endif
+
+typedef struct
+{
+    void* ptr;
+    cudaStream_t stream; // freed on
+    cudaEvent_t freed;   // recorded on stream at the free
+} penguin_pool_block;
+
+typedef struct
+{
+    std::map<unsigned long long, std::vector<penguin_pool_block>> cached; // by size class
+    unsigned long long cached_bytes;
+} penguin_managed_pool;
+
+// pool -> its cache, NULL for the current device's default pool; live block
+// -> its pool and size class; block -> the event of its frees
+std::map<cudaMemPool_t, penguin_managed_pool> managed_pools;
+std::map<void*, std::pair<cudaMemPool_t, unsigned long long>> pool_blocks;
+std::map<void*, cudaEvent_t> pool_block_events;
+int managed_pool_enabled = -1;
+
+bool penguin_managed_pool_enabled() {
+    if(managed_pool_enabled < 0) {
+        const char* env = getenv("PENGUIN_MANAGED_POOL");
+        managed_pool_enabled = env == NULL || strcmp(env, "0") != 0;
+    }
+    return managed_pool_enabled;
+}
+
+unsigned long long penguin_pool_class(unsigned long long size) {
+    if(size >= PENGUIN_PLACEMENT_UNIT) {
+        return (size + PENGUIN_PLACEMENT_UNIT - 1) & ~(PENGUIN_PLACEMENT_UNIT - 1);
+    }
+    unsigned long long bytes = PENGUIN_POOL_MIN_BLOCK;
+    while(bytes < size) {
+        bytes <<= 1;
+    }
+    return bytes;
+}
+
+// Gives the block back to the driver; cudaFree waits for the device
+void penguin_pool_release(void* block) {
+    auto e = pool_block_events.find(block);
+    if(e != pool_block_events.end()) {
+        cudaEventDestroy(e->second);
+        pool_block_events.erase(e);
+    }
+    cudaFree(block);
+}
+
+// Releases the cached blocks of pool whose frees have passed, oldest first,
+// until it keeps at most keep bytes
+void penguin_pool_trim(penguin_managed_pool& pool, unsigned long long keep) {
+    for(auto c = pool.cached.begin(); c != pool.cached.end() && pool.cached_bytes > keep; c++) {
+        std::vector<penguin_pool_block>& blocks = c->second;
+        for(size_t b = 0; b < blocks.size() && pool.cached_bytes > keep; ) {
+            if(cudaEventQuery(blocks[b].freed) == cudaErrorNotReady) {
+                b++;
+                continue;
+            }
+            penguin_pool_release(blocks[b].ptr);
+            pool.cached_bytes -= c->first;
+            blocks.erase(blocks.begin() + b);
+        }
+    }
+}
+
+cudaError_t penguin_pool_malloc(void** ptr, size_t size, cudaMemPool_t pool, cudaStream_t stream) {
+    unsigned long long bytes = penguin_pool_class(size);
+    penguin_managed_pool& p = managed_pools[pool];
+    void* block = NULL;
+    auto c = p.cached.find(bytes);
+    if(c != p.cached.end()) {
+        // the block freed last is the likeliest to be resident still
+        std::vector<penguin_pool_block>& blocks = c->second;
+        for(size_t b = blocks.size(); b-- > 0; ) {
+            if(blocks[b].stream == stream || cudaEventQuery(blocks[b].freed) != cudaErrorNotReady) {
+                block = blocks[b].ptr;
+                blocks.erase(blocks.begin() + b);
+                p.cached_bytes -= bytes;
+                break;
+            }
+        }
+    }
+    if(block == NULL) {
+        cudaError_t err = cudaMallocManaged(&block, bytes);
+        if(err == cudaErrorMemoryAllocation) {
+            penguin_pool_trim(p, 0);
+            err = cudaMallocManaged(&block, bytes);
+        }
+        if(err != cudaSuccess) {
+            return err;
+        }
+    }
+    pool_blocks[block] = std::make_pair(pool, bytes);
+    penguin_register_allocation(block, size);
+    *ptr = block;
+    return cudaSuccess;
+}
+
+extern "C"
+cudaError_t penguinMallocAsync(void** ptr, size_t size, cudaStream_t stream) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_managed_pool_enabled() || size == 0) {
+        return cudaMallocAsync(ptr, size, stream);
+    }
+    return penguin_pool_malloc(ptr, size, NULL, stream);
+}
+
+extern "C"
+cudaError_t penguinMallocFromPoolAsync(void** ptr, size_t size, cudaMemPool_t pool, cudaStream_t stream) {
+    PENGUIN_LOCKED_ENTRY();
+    if(!penguin_managed_pool_enabled() || size == 0) {
+        return cudaMallocFromPoolAsync(ptr, size, pool, stream);
+    }
+    return penguin_pool_malloc(ptr, size, pool, stream);
+}
+
+// The planners forget the block at once, as for cudaFree; its bytes are only
+// handed out again in the order of stream
+extern "C"
+cudaError_t penguinFreeAsync(void* ptr, cudaStream_t stream) {
+    PENGUIN_LOCKED_ENTRY();
+    auto b = pool_blocks.find(ptr);
+    if(b == pool_blocks.end()) {
+        return cudaFreeAsync(ptr, stream);
+    }
+    cudaMemPool_t pool = b->second.first;
+    unsigned long long bytes = b->second.second;
+    pool_blocks.erase(b);
+    penguinFreeAllocation(ptr);
+    auto p = managed_pools.find(pool);
+    // its pool was destroyed while it was live
+    if(p == managed_pools.end()) {
+        penguin_pool_release(ptr);
+        return cudaSuccess;
+    }
+    cudaEvent_t& freed = pool_block_events[ptr];
+    if(freed == NULL && cudaEventCreateWithFlags(&freed, cudaEventDisableTiming) != cudaSuccess) {
+        pool_block_events.erase(ptr);
+        cudaStreamSynchronize(stream);
+        penguin_pool_release(ptr);
+        return cudaSuccess;
+    }
+    cudaEventRecord(freed, stream);
+    p->second.cached[bytes].push_back(penguin_pool_block{ptr, stream, freed});
+    p->second.cached_bytes += bytes;
+    if(p->second.cached_bytes > PENGUIN_POOL_CACHE_MB * 1024ULL * 1024ULL) {
+        penguin_pool_trim(p->second, PENGUIN_POOL_CACHE_MB * 1024ULL * 1024ULL);
+    }
+    return cudaSuccess;
+}
+
+// The pool is created as asked, for the calls that query or configure it;
+// its allocations come from its cache here
+extern "C"
+cudaError_t penguinMemPoolCreate(cudaMemPool_t* pool, const cudaMemPoolProps* props) {
+    PENGUIN_LOCKED_ENTRY();
+    cudaError_t err = cudaMemPoolCreate(pool, props);
+    if(err == cudaSuccess && penguin_managed_pool_enabled()) {
+        managed_pools[*pool] = penguin_managed_pool{};
+    }
+    return err;
+}
+
+extern "C"
+cudaError_t penguinMemPoolDestroy(cudaMemPool_t pool) {
+    PENGUIN_LOCKED_ENTRY();
+    auto p = managed_pools.find(pool);
+    if(p != managed_pools.end()) {
+        for(auto c = p->second.cached.begin(); c != p->second.cached.end(); c++) {
+            for(auto b = c->second.begin(); b != c->second.end(); b++) {
+                penguin_pool_release(b->ptr);
+            }
+        }
+        managed_pools.erase(p);
+    }
+    return cudaMemPoolDestroy(pool);
 }
 
 /* std::pair<double, double> compute_intersection(double m1, double c1, double m2, double c2) { */
@@ -2001,6 +14789,7 @@ void MemoryMgmtFirstInvocationNonIter() {
 
 extern "C"
 unsigned larger_of_two (unsigned a, unsigned b) {
+    PENGUIN_ENTRY();
     if (a > b) {
         return a;
     } else {
@@ -2010,6 +14799,7 @@ unsigned larger_of_two (unsigned a, unsigned b) {
 
 extern "C"
 unsigned smaller_of_two (unsigned a, unsigned b) {
+    PENGUIN_ENTRY();
     if (a < b) {
         return a;
     } else {
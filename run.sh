@@ -10,66 +10,62 @@ echo ""
 
 oversub=(15 30 50)
 
+# The driver is loaded once, without access counter migrations; the suv.out
+# of a workload runs every policy (PENGUIN_POLICY) and the ac runs turn the
+# access counters on for their own VA space (PENGUIN_AC_GRANULARITY,
+# PENGUIN_AC_THRESHOLD). Every run is PENGUIN_TRIALS timed trials after
+# PENGUIN_WARMUP warm-ups, see eval/trials.sh.
+export PENGUIN_AC_GRANULARITY=64k
+export PENGUIN_AC_THRESHOLD=256
+bash driver_change.sh 0 64k 256
+
 for ((idx=0; idx<${#benchmarks[@]}; ++idx)); do
     benchmark=${benchmarks[idx]}
     footprint=${footprints[idx]} 
+    bin=${pwd0}/eval/build/${benchmark} # see compile.sh
     echo "Processing $benchmark $footprint"
+    cd ${pwd0}/eval/${benchmark}
+    echo $(pwd)
+    ls -ltr ${bin}/suv.out
     for os in ${oversub[@]}; do
-        cd ${pwd0}
-        bash driver_change.sh 0 64k 256
-        cd eval
-        cd $benchmark
-        echo $(pwd)
-        echo "uvm.${os}.out"
-        echo "running"
-        ls -ltr uvm.${os}.out
-        ./uvm.${os}.out &> uvm.${os}.txt
-        sudo dmesg | tail &> uvm.${os}.pf.txt
-        sleep 3 
-        echo "running"
-        ls -ltr suv.${os}.out
-        ./suv.${os}.out &> suv.${os}.txt
-        sudo dmesg | tail &> suv.${os}.pf.txt
-        sleep 3 
-        cd ${pwd0}
-        bash driver_change.sh 1 64k 256
-        cd eval
-        cd $benchmark
-        ls -ltr uvm.${os}.out
-        ./uvm.${os}.out &> ac.${os}.txt
-        sudo dmesg | tail &> ac.${os}.pf.txt
-        sleep 3 
-        cd ${pwd0}
+        for policy in uvm suv ac; do
+            echo "suv.out, PENGUIN_POLICY=${policy} PENGUIN_OVERSUB=${os}"
+            PENGUIN_POLICY=${policy} PENGUIN_OVERSUB=${os} \
+                bash ${pwd0}/eval/trials.sh ${policy}.${os} ${bin}/suv.out
+        done
         echo ""
     done
+    cd ${pwd0}
 done
 
+# fw's host baseline, the same on every oversubscription; see
+# eval/fw/cpu_report.sh
+if [ -x ${pwd0}/eval/build/fw/cpu.out ]; then
+    cd ${pwd0}/eval/fw
+    bash ${pwd0}/eval/trials.sh cpu ${pwd0}/eval/build/fw/cpu.out
+    cd ${pwd0}
+fi
+
 cd ${pwd0}
 echo ""
 
 oversub=(50)
-bash driver_change.sh 0 64k 256
 
 benchmarks=("2dconv" "alexnet"  "bicg"  "doitgen" "fdtd" "fw" "gemm" "gramschmit" "hellinger-cuda" "mm" "mvt")
 footprints=(8192 3500  4096  8192 6912 4096 6912 3072 6912 5760 4096)
 for ((idx=0; idx<${#benchmarks[@]}; ++idx)); do
     benchmark=${benchmarks[idx]}
     footprint=${footprints[idx]} 
+    bin=${pwd0}/eval/build/${benchmark} # see compile.sh
     echo "Processing $benchmark $footprint"
+    cd ${pwd0}/eval/${benchmark}
+    echo $(pwd)
+    ls -ltr ${bin}/sc.out
     for os in ${oversub[@]}; do
-        cd ${pwd0}
-        bash driver_change.sh 0 64k 256
-        cd eval
-        cd $benchmark
-        echo $(pwd)
-        echo "running"
-        ls -ltr sc.${os}.out
-        ./sc.${os}.out &> sc.${os}.txt
-        sudo dmesg | tail &> sc.${os}.pf.txt
-        sleep 3 
-        cd ${pwd0}
+        PENGUIN_OVERSUB=${os} bash ${pwd0}/eval/trials.sh sc.${os} ${bin}/sc.out
         echo ""
     done
+    cd ${pwd0}
 done
 
 cd ${pwd0}